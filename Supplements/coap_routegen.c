@@ -0,0 +1,246 @@
+/*  CoAP route table generator for otlibext/coap_server.c
+  *
+  * Reads a list of routes and writes the C source of a route table that is a
+  * perfect hash of the paths: each path goes in its own slot, so the device
+  * finds a route with one hash of the Uri-Path and one compare.  The smallest
+  * table that works is used, trying every seed for each size.
+  *
+  * Route list, one route per line ('#' starts a comment):
+  *     <path> <target> <id> [<cmd>] <methods>
+  *     path        Uri-Path segments joined by '/', no leading '/'.  "-" is
+  *                 the empty path.
+  *     target      gfb, isfs, isf (a Veelite file) or alp
+  *     id          file ID, or ALP directive ID
+  *     cmd         ALP directive command (alp only)
+  *     methods     comma separated: get, post, put, delete
+  *
+  * For example:
+  *     sensor/temp     isf     0x20            get
+  *     config/net      isf     0x00            get,put
+  *     app/run         alp     0x90    0x01    post
+  *
+  * Build:  gcc -o coap_routegen coap_routegen.c
+  * Usage:  coap_routegen routes.txt > coap_routes.c
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define MAX_ROUTES      256
+#define MAX_PATH        128
+#define ALP_ID_COAP     0x10        // COAP_ALP_ID default (coap.h)
+
+/// Same as COAP_HASH_STEP() in otlibext/coap.h
+#define HASH_STEP(H, B) (unsigned short)((((H) << 5) + (H)) ^ (B))
+
+typedef struct {
+    char            path[MAX_PATH];
+    const char*     target;
+    unsigned int    id;
+    unsigned int    cmd;
+    unsigned int    methods;
+} route_rec;
+
+static route_rec    route[MAX_ROUTES];
+static int          routes = 0;
+
+
+
+static unsigned short path_hash(unsigned short seed, const char* path) {
+    unsigned short hash = seed;
+
+    while (*path != 0) {
+        hash = HASH_STEP(hash, (unsigned char)*path++);
+    }
+    return hash;
+}
+
+
+static int parse_methods(const char* text) {
+    static const char* name[] = { "get", "post", "put", "delete" };
+    int     mask = 0;
+    int     i;
+    char    buf[64];
+    char*   tok;
+
+    strncpy(buf, text, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    for (tok=strtok(buf, ","); tok!=NULL; tok=strtok(NULL, ",")) {
+        for (i=0; i<4; i++) {
+            if (strcmp(tok, name[i]) == 0) break;
+        }
+        if (i == 4) return -1;
+        mask |= 1 << i;
+    }
+    return mask;
+}
+
+
+static int read_routes(FILE* in) {
+    char    line[256];
+    int     lineno = 0;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char*       field[6];
+        int         n = 0;
+        route_rec*  r;
+        char*       hash;
+
+        lineno++;
+        if ((hash = strchr(line, '#')) != NULL) {
+            *hash = 0;
+        }
+        for (field[n]=strtok(line, " \t\r\n"); (field[n]!=NULL) && (n<5); ) {
+            field[++n] = strtok(NULL, " \t\r\n");
+        }
+        if ((n == 5) && (strtok(NULL, " \t\r\n") != NULL)) {
+            n = 6;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (routes == MAX_ROUTES) {
+            fprintf(stderr, "line %d: too many routes\n", lineno);
+            return -1;
+        }
+
+        r = &route[routes];
+        memset(r, 0, sizeof(route_rec));
+        if ((strlen(field[0]) >= MAX_PATH) || (field[0][0] == '/')) {
+            fprintf(stderr, "line %d: bad path\n", lineno);
+            return -1;
+        }
+        strcpy(r->path, (strcmp(field[0], "-") == 0) ? "" : field[0]);
+
+        if      ((n == 4) && (strcmp(field[1], "gfb") == 0))    r->target = "VL_GFB_BLOCKID";
+        else if ((n == 4) && (strcmp(field[1], "isfs") == 0))   r->target = "VL_ISFS_BLOCKID";
+        else if ((n == 4) && (strcmp(field[1], "isf") == 0))    r->target = "VL_ISF_BLOCKID";
+        else if ((n == 5) && (strcmp(field[1], "alp") == 0))    r->target = "COAP_TARGET_ALP";
+        else {
+            fprintf(stderr, "line %d: bad target, or wrong number of fields\n", lineno);
+            return -1;
+        }
+
+        r->id   = (unsigned int)strtoul(field[2], NULL, 0);
+        r->cmd  = (n == 5) ? (unsigned int)strtoul(field[3], NULL, 0) : 0;
+        if ((r->id > 255) || (r->cmd > 255)) {
+            fprintf(stderr, "line %d: id and cmd are one byte\n", lineno);
+            return -1;
+        }
+        if ((n == 5) && (r->id == ALP_ID_COAP)) {
+            fprintf(stderr, "line %d: a route cannot go back to the CoAP ALP\n", lineno);
+            return -1;
+        }
+        if ((int)(r->methods = parse_methods(field[n-1])) <= 0) {
+            fprintf(stderr, "line %d: bad methods\n", lineno);
+            return -1;
+        }
+        routes++;
+    }
+    return 0;
+}
+
+
+static int fits(unsigned short seed, int slots, int* slot_of) {
+    static unsigned char used[MAX_ROUTES*4];
+    int i;
+
+    memset(used, 0, slots);
+    for (i=0; i<routes; i++) {
+        int slot = path_hash(seed, route[i].path) % slots;
+        if (used[slot]) {
+            return 0;
+        }
+        used[slot]  = 1;
+        slot_of[i]  = slot;
+    }
+    return 1;
+}
+
+
+static void print_methods(unsigned int mask) {
+    static const char* name[] = { "COAP_ALLOW_GET", "COAP_ALLOW_POST",
+                                  "COAP_ALLOW_PUT", "COAP_ALLOW_DELETE" };
+    int i, first = 1;
+
+    for (i=0; i<4; i++) {
+        if (mask & (1 << i)) {
+            printf("%s%s", first ? "" : "|", name[i]);
+            first = 0;
+        }
+    }
+}
+
+
+
+int main(int argc, char** argv) {
+    static int  slot_of[MAX_ROUTES];
+    FILE*       in;
+    int         slots;
+    long        seed = -1;
+    int         i, j;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: coap_routegen routes.txt > coap_routes.c\n");
+        return 1;
+    }
+    in = fopen(argv[1], "r");
+    if (in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    i = read_routes(in);
+    fclose(in);
+    if ((i != 0) || (routes == 0)) {
+        if (routes == 0) fprintf(stderr, "coap_routegen: no routes\n");
+        return 1;
+    }
+    for (i=0; i<routes; i++) {
+        for (j=0; j<i; j++) {
+            if (strcmp(route[i].path, route[j].path) == 0) {
+                fprintf(stderr, "coap_routegen: path \"%s\" is listed twice\n", route[i].path);
+                return 1;
+            }
+        }
+    }
+
+    for (slots=routes; (slots<=routes*4) && (seed<0); slots++) {
+        long s;
+        for (s=0; s<65536; s++) {
+            if (fits((unsigned short)s, slots, slot_of)) {
+                seed = s;
+                break;
+            }
+        }
+    }
+    if (seed < 0) {
+        fprintf(stderr, "coap_routegen: no perfect hash found\n");
+        return 1;
+    }
+    slots--;
+
+    printf("/* CoAP route table, made by Supplements/coap_routegen.c from %s.\n", argv[1]);
+    printf("  * Do not edit: change the route list and run the generator again.\n  */\n\n");
+    printf("#include \"OTAPI.h\"\n#include \"coap.h\"\n\n");
+    printf("#if (OT_FEATURE(COAP) == ENABLED)\n\n");
+    printf("static const coap_route coap_route_table[%d] = {\n", slots);
+    for (j=0; j<slots; j++) {
+        for (i=0; (i<routes) && (slot_of[i]!=j); i++);
+        if (i == routes) {
+            printf("    { NULL, 0, 0, 0, 0 }");
+        }
+        else {
+            printf("    { \"%s\", %s, 0x%02X, 0x%02X, ", route[i].path,
+                    route[i].target, route[i].id, route[i].cmd);
+            print_methods(route[i].methods);
+            printf(" }");
+        }
+        printf("%s\n", (j < (slots-1)) ? "," : "");
+    }
+    printf("};\n\n");
+    printf("const coap_routemap coap_routes = { %ld, %d, coap_route_table };\n\n", seed, slots);
+    printf("#endif\n");
+    return 0;
+}
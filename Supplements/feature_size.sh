@@ -0,0 +1,99 @@
+#!/bin/sh
+# Copyright 2010-2012 JP Norair
+#
+# Licensed under the OpenTag License, Version 1.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# feature_size.sh: code size per device profile and per feature
+#
+# Builds an app's configuration with section-level garbage collection, once
+# per device profile (OT_PARAM_PROFILE, see OT_config.h), and then once per
+# feature in FEATURES toggled on top of the chosen profile (a feature that is
+# not in the app config is taken to default off, and is turned on).  Prints text, data
+# and bss of each image, and the change from the profile image.  The app
+# config is copied and edited in a scratch directory, so the tree is not
+# touched.
+#
+# By default the POSIX board is built with the host gcc, which gives relative
+# sizes.  For target sizes, set CC, SIZE, BOARD, SRCS and CFLAGS for the
+# target toolchain, e.g. CC=arm-none-eabi-gcc SIZE=arm-none-eabi-size.
+#
+# Usage: Supplements/feature_size.sh [app code dir] [profile]
+#        (run from the repository root; profile 1..3, default 1)
+
+APP=${1:-apps/demo_opmode/code}
+PROFILE=${2:-1}
+CC=${CC:-gcc}
+SIZE=${SIZE:-size}
+BOARD=${BOARD:-BOARD_POSIX}
+CFLAGS=${CFLAGS:-"-std=gnu99 -fgnu89-inline -Os -w"}
+SRCS=${SRCS:-"otlib/*.c otkernel/native/*.c otplatform/posix/*.c otradio/posix/*.c"}
+LIBS=${LIBS:-"-lrt"}
+INCS=${INCS:-"-I otlib -I otkernel -I otkernel/native -I board -I otplatform/posix -I otradio/posix"}
+FEATURES=${FEATURES:-"OT_FEATURE_CLIENT OT_FEATURE_M1 OT_FEATURE_DLL_SECURITY M2_FEATURE_BEACONS M2_FEATURE_FECTX M2_FEATURE_FECRX M2_FEATURE_DRIFT OT_FEATURE_STATIC_DISPATCH LOG_FEATURE_DEFERRED"}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Copy the app, and select the board in its platform config
+cp "$APP"/*.h "$APP"/*.c "$WORK"/
+sed -i -e 's|^#define BOARD_|//#define BOARD_|' \
+       -e "s|^//[ ]*#define $BOARD\$|#define $BOARD|" "$WORK/platform_config.h"
+
+# build <label>: builds $WORK, prints one line of the report
+build() {
+    if $CC $CFLAGS -ffunction-sections -fdata-sections -Wl,--gc-sections \
+           -I "$WORK" $INCS "$WORK/main.c" $SRCS $LIBS -o "$WORK/image" 2>"$WORK/log"; then
+        set -- "$1" $($SIZE "$WORK/image" | tail -n 1)
+        if [ -z "$BASE" ]; then BASE=$2; fi
+        printf "%-32s %8s %8s %8s %+8d\n" "$1" "$2" "$3" "$4" $(($2 - BASE))
+    else
+        printf "%-32s build failed: %s\n" "$1" "$(grep -m 1 error "$WORK/log")"
+    fi
+}
+
+# setdef <file> <name> <value>: rewrites a #define in the app config
+setdef() {
+    sed -i "s|^\(#define $2[ ]\+\)[^ /]\+|\1$3|" "$1"
+}
+
+cp "$WORK/app_config.h" "$WORK/app_config.orig"
+printf "%-32s %8s %8s %8s %8s\n" "image" "text" "data" "bss" "delta"
+
+# One image per profile, deltas against the endpoint profile
+BASE=
+for P in 1 2 3; do
+    cp "$WORK/app_config.orig" "$WORK/app_config.h"
+    setdef "$WORK/app_config.h" OT_PARAM_PROFILE $P
+    build "OT_PARAM_PROFILE $P"
+done
+
+# One image per feature toggled on the chosen profile
+cp "$WORK/app_config.orig" "$WORK/app_config.h"
+setdef "$WORK/app_config.h" OT_PARAM_PROFILE $PROFILE
+cp "$WORK/app_config.h" "$WORK/app_config.base"
+echo
+BASE=
+build "profile $PROFILE"
+for F in $FEATURES; do
+    cp "$WORK/app_config.base" "$WORK/app_config.h"
+    if grep -q "^#define $F[ ]\+ENABLED" "$WORK/app_config.h"; then
+        setdef "$WORK/app_config.h" $F DISABLED
+        build "$F off"
+    elif grep -q "^#define $F[ ]\+DISABLED" "$WORK/app_config.h"; then
+        setdef "$WORK/app_config.h" $F ENABLED
+        build "$F on"
+    else
+        echo "#define $F ENABLED" >>"$WORK/app_config.h"
+        build "$F on"
+    fi
+done
@@ -0,0 +1,451 @@
+/*  Host-side driver for the latency benchmark (apps/bench_latency)
+  *
+  * Sends dialogs to a bench_latency gateway over MPipe, one at a time, and
+  * times each one from the host until the first response comes back.  Each
+  * dialog is two MPipe frames, the ALP System API records new_session and
+  * dialog_script, with the same query as Demo_Opmode (collect the sensor list
+  * of the devices that list the sensor protocol).  With the first response,
+  * the gateway sends a LAT message with the trace records of the dialog,
+  * which split the round trip into stages:
+  *     host    host and MPipe: the round trip less the gateway time
+  *     alp     MPipe RX of new_session to the start of the dialog
+  *     csma    start of the dialog to the end of the request TX
+  *     air     request TX to the first response RX (air and endpoint)
+  *     resp    response RX to M2QP taking it as a response
+  *     total   the round trip, as seen by the host
+  * The gateway stages are in GPTIM ticks (-k ticks per second), so they are
+  * only good to a tick.  For finer timing, the gateway holds trig1 high over
+  * the dialog, and toggles trig2 on each trace record.
+  *
+  * A dialog that gets no LAT message in -t ms is lost.  The next dialog starts
+  * -i ms after the last one ended, or after a random time with that mean with
+  * -p (Poisson arrivals, for a closed loop of one request).
+  *
+  * The gateway is a serial port (-d), or a command that is run with its stdin
+  * and stdout on pipes (the POSIX build of bench_latency, which does MPipe on
+  * stdin and stdout).
+  *
+  * Build:  gcc -O2 -o lat_bench lat_bench.c -lm
+  * Usage:  lat_bench [-n dialogs] [-i ms] [-p] [-t ms] [-k hz] -d port [-b baud]
+  *         lat_bench [-n dialogs] [-i ms] [-p] [-t ms] [-k hz] -- command [args]
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/wait.h>
+
+
+#define MAX_DIALOGS     100000
+#define STAGES          6
+
+/// Trace ids, from otlib/system.h
+#define TRACE_FRX       4
+#define TRACE_FTX       5
+#define TRACE_MPRX      7
+#define TRACE_DIALOG    8
+#define TRACE_RESP      9
+
+enum { ST_HOST = 0, ST_ALP, ST_CSMA, ST_AIR, ST_RESP, ST_TOTAL };
+
+static const char* stage_name[STAGES] = {
+    "host", "alp", "csma", "air", "resp", "total"
+};
+
+static double*  stage[STAGES];
+static int      stage_n[STAGES];
+
+static int      fd_out;
+static int      fd_in;
+static unsigned seq = 0;
+
+static unsigned char    rxbuf[4096];
+static size_t           rxlen = 0;
+static unsigned long    bad_crc = 0;
+
+
+
+static unsigned int crc16(const unsigned char* data, int length) {
+/// CRC16-CCITT (0x1021, init 0xFFFF), as in OTlib crc16.c
+    unsigned int crc = 0xFFFF;
+    int i;
+
+    while (length-- > 0) {
+        crc ^= (unsigned int)(*data++) << 8;
+        for (i=0; i<8; i++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc & 0xFFFF;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+
+
+static int send_record(unsigned char cmd, const unsigned char* data, int length) {
+/// One NDEF record (MB & ME, short, ID length 2) for ALP 0x81, in MPipe framing
+    unsigned char   frame[6 + 255 + 4];
+    unsigned int    crc;
+    int             total = 6 + length + 4;
+    int             put   = 0;
+
+    frame[0] = 0xDD;
+    frame[1] = 0x00;
+    frame[2] = (unsigned char)length;
+    frame[3] = 0x02;
+    frame[4] = 0x81;
+    frame[5] = cmd;
+    memcpy(&frame[6], data, length);
+    frame[6+length]   = (unsigned char)(seq >> 8);
+    frame[6+length+1] = (unsigned char)seq;
+    crc = crc16(frame, 6 + length + 2);
+    frame[6+length+2] = (unsigned char)(crc >> 8);
+    frame[6+length+3] = (unsigned char)crc;
+    seq++;
+
+    while (put < total) {
+        ssize_t rc = write(fd_out, &frame[put], total - put);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        put += (int)rc;
+    }
+    return 0;
+}
+
+
+static int send_dialog(void) {
+    static const unsigned char session[] = {
+        0x10,                       // channel: the scan channel of the demo apps
+        0x00, 0x00,                 // subnet, subnet mask
+        0x00, 0x00,                 // flags, flag mask
+        0x00, 0x10                  // timeout: 16 ticks
+    };
+    static const unsigned char script[] = {
+        0x80, 0x00,                 // anycast, single hop
+        5,                          // items
+        1, 0x20, 0x06, 0x00,        // command: na2p request, collect file on file
+        2, 0x27,                    // dialog: 128 tick timeout, same channel
+        3, 0x41, 0x01, 0x02,        // query: search for protocol 0x02
+        6, 0x00, 0x07, 0x00, 0x00,  // isfcomp: protocol list, offset 0
+        7, 0x00, 0x0C, 0x00, 0x20, 0x00, 0x00   // isfcall: sensor list, 32 bytes
+    };
+
+    if (send_record(2, session, sizeof(session)) != 0) {
+        return -1;
+    }
+    return send_record(7, script, sizeof(script));
+}
+
+
+
+static int parse_lat(const unsigned char* data, int length, double tick_ms, double rtt) {
+/// Stage times from the LAT records.  Each record is (id, arg, ticks since the
+/// previous record), so the time of an event is the sum of the ticks up to it.
+    double  t_mprx = -1, t_dialog = -1, t_ftx = -1, t_frx = -1, t_resp = -1;
+    double  t = 0;
+    int     i;
+
+    for (i=0; (i+4)<=length; i+=4) {
+        t += (double)((data[i+2] << 8) | data[i+3]) * tick_ms;
+        switch (data[i]) {
+            case TRACE_MPRX:    if (t_mprx < 0) t_mprx = t;                         break;
+            case TRACE_DIALOG:  if (t_dialog < 0) t_dialog = t;                     break;
+            case TRACE_FTX:     if ((t_dialog >= 0) && (t_ftx < 0)) t_ftx = t;      break;
+            case TRACE_FRX:     if ((t_ftx >= 0) && (t_frx < 0)) t_frx = t;         break;
+            case TRACE_RESP:    if (t_resp < 0) t_resp = t;                         break;
+            default:            break;
+        }
+    }
+    if ((t_mprx < 0) || (t_dialog < 0) || (t_ftx < 0) || (t_frx < 0) || (t_resp < 0)) {
+        return -1;
+    }
+
+    stage[ST_HOST][stage_n[ST_HOST]++]      = rtt - (t_resp - t_mprx);
+    stage[ST_ALP][stage_n[ST_ALP]++]        = t_dialog - t_mprx;
+    stage[ST_CSMA][stage_n[ST_CSMA]++]      = t_ftx - t_dialog;
+    stage[ST_AIR][stage_n[ST_AIR]++]        = t_frx - t_ftx;
+    stage[ST_RESP][stage_n[ST_RESP]++]      = t_resp - t_frx;
+    stage[ST_TOTAL][stage_n[ST_TOTAL]++]    = rtt;
+    return 0;
+}
+
+
+static int wait_lat(double deadline, double start, double tick_ms) {
+/// Reads MPipe frames until a LAT message, or the deadline.  Returns 0 on a
+/// LAT message with all the stages, 1 on one without, -1 on a timeout, and
+/// -2 if the gateway is gone.
+    while (1) {
+        size_t i = 0;
+
+        /// Frames in the buffer
+        while ((i + 10) <= rxlen) {
+            size_t length;
+
+            if ((rxbuf[i+1] != 0x00) || (rxbuf[i+3] != 0x02)) {
+                i++;
+                continue;
+            }
+            length = rxbuf[i+2];
+            if ((i + 6 + length + 4) > rxlen) {
+                break;
+            }
+            if (crc16(&rxbuf[i], (int)(6 + length + 2)) != \
+                (((unsigned int)rxbuf[i+6+length+2] << 8) | rxbuf[i+6+length+3])) {
+                bad_crc++;
+                i++;
+                continue;
+            }
+            if ((length >= 4) && (memcmp(&rxbuf[i+6], "LAT ", 4) == 0)) {
+                double  rtt = now_ms() - start;
+                int     rc  = parse_lat(&rxbuf[i+10], (int)length - 4, tick_ms, rtt);
+                i          += 6 + length + 4;
+                memmove(rxbuf, &rxbuf[i], rxlen - i);
+                rxlen      -= i;
+                return (rc == 0) ? 0 : 1;
+            }
+            i += 6 + length + 4;
+        }
+        memmove(rxbuf, &rxbuf[i], rxlen - i);
+        rxlen -= i;
+        if (rxlen == sizeof(rxbuf)) {
+            rxlen = 0;
+        }
+
+        /// More input
+        {   struct pollfd   pfd;
+            double          left = deadline - now_ms();
+            ssize_t         rc;
+
+            if (left <= 0) {
+                return -1;
+            }
+            pfd.fd      = fd_in;
+            pfd.events  = POLLIN;
+            if (poll(&pfd, 1, (int)ceil(left)) <= 0) {
+                continue;
+            }
+            rc = read(fd_in, &rxbuf[rxlen], sizeof(rxbuf) - rxlen);
+            if (rc == 0) {
+                return -2;
+            }
+            if (rc > 0) {
+                rxlen += (size_t)rc;
+            }
+        }
+    }
+}
+
+
+
+static speed_t baud_code(long baud) {
+    switch (baud) {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 921600:    return B921600;
+        default:        return B0;
+    }
+}
+
+
+static int open_port(const char* path, speed_t speed) {
+/// A port that is not a tty (a pty or a FIFO in testing) is used as it is
+    struct termios tio;
+
+    fd_in = open(path, O_RDWR | O_NOCTTY);
+    if (fd_in < 0) {
+        perror(path);
+        return -1;
+    }
+    if (tcgetattr(fd_in, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(fd_in, TCSANOW, &tio);
+        tcflush(fd_in, TCIOFLUSH);
+    }
+    fd_out = fd_in;
+    return 0;
+}
+
+
+static pid_t run_gateway(char** argv) {
+    int     to_gw[2];
+    int     from_gw[2];
+    pid_t   pid;
+
+    if ((pipe(to_gw) != 0) || (pipe(from_gw) != 0)) {
+        perror("pipe");
+        return -1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(to_gw[0], STDIN_FILENO);
+        dup2(from_gw[1], STDOUT_FILENO);
+        close(to_gw[0]);
+        close(to_gw[1]);
+        close(from_gw[0]);
+        close(from_gw[1]);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    close(to_gw[0]);
+    close(from_gw[1]);
+    fd_out  = to_gw[1];
+    fd_in   = from_gw[0];
+    return pid;
+}
+
+
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double pct(const double* v, int n, double p) {
+    int i = (int)ceil(p * n) - 1;
+    return v[(i < 0) ? 0 : i];
+}
+
+static void print_stages(int sent, int lost, int partial) {
+    int s;
+
+    printf("dialogs %d, lost %d, without all stages %d, bad crc %lu\n",
+           sent, lost, partial, bad_crc);
+    printf("%-6s %10s %10s %10s %10s %10s\n", "stage", "p50 ms", "p90 ms", "p99 ms", "max ms", "mean ms");
+    for (s=0; s<STAGES; s++) {
+        double  sum = 0;
+        int     n   = stage_n[s];
+        int     i;
+        if (n == 0) {
+            continue;
+        }
+        qsort(stage[s], n, sizeof(double), &cmp_double);
+        for (i=0; i<n; i++) {
+            sum += stage[s][i];
+        }
+        printf("%-6s %10.3f %10.3f %10.3f %10.3f %10.3f\n", stage_name[s],
+               pct(stage[s], n, 0.5), pct(stage[s], n, 0.9), pct(stage[s], n, 0.99),
+               stage[s][n-1], sum / n);
+    }
+}
+
+
+
+int main(int argc, char** argv) {
+    const char* port        = NULL;
+    long        baud        = 115200;
+    int         dialogs     = 100;
+    double      interval    = 100;
+    int         poisson     = 0;
+    double      timeout     = 2000;
+    double      tick_hz     = 1024;
+    pid_t       child       = 0;
+    int         lost        = 0;
+    int         partial     = 0;
+    int         sent;
+    int         opt;
+    int         s;
+
+    while ((opt = getopt(argc, argv, "n:i:pt:k:d:b:")) != -1) {
+        switch (opt) {
+            case 'n':   dialogs     = atoi(optarg); break;
+            case 'i':   interval    = atof(optarg); break;
+            case 'p':   poisson     = 1;            break;
+            case 't':   timeout     = atof(optarg); break;
+            case 'k':   tick_hz     = atof(optarg); break;
+            case 'd':   port        = optarg;       break;
+            case 'b':   baud        = atol(optarg); break;
+            default:    optind      = argc+1;       break;
+        }
+    }
+    if ((dialogs < 1) || (dialogs > MAX_DIALOGS) || (tick_hz <= 0) || (baud_code(baud) == B0) \
+     || ((port == NULL) == (optind >= argc))) {
+        fprintf(stderr, "Usage: %s [-n dialogs] [-i ms] [-p] [-t ms] [-k hz] -d port [-b baud]\n"
+                        "       %s [-n dialogs] [-i ms] [-p] [-t ms] [-k hz] -- command [args]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    if (port != NULL) {
+        if (open_port(port, baud_code(baud)) != 0) {
+            return 1;
+        }
+    }
+    else if ((child = run_gateway(&argv[optind])) < 0) {
+        return 1;
+    }
+    for (s=0; s<STAGES; s++) {
+        stage[s] = malloc(sizeof(double) * dialogs);
+    }
+    srand48((long)time(NULL));
+
+    /// Let the gateway start up, and drop what it sends at startup
+    wait_lat(now_ms() + 500, now_ms(), 1000.0 / tick_hz);
+    rxlen = 0;
+
+    for (sent=0; sent<dialogs; sent++) {
+        double  start;
+        double  gap;
+        int     rc;
+
+        start = now_ms();
+        if (send_dialog() != 0) {
+            fprintf(stderr, "gateway write failed\n");
+            break;
+        }
+        rc = wait_lat(start + timeout, start, 1000.0 / tick_hz);
+        if (rc == -2) {
+            fprintf(stderr, "gateway closed its output\n");
+            break;
+        }
+        lost    += (rc == -1);
+        partial += (rc == 1);
+
+        gap = poisson ? (-interval * log(1.0 - drand48())) : interval;
+        if (gap > 0) {
+            struct timespec ts;
+            ts.tv_sec   = (time_t)(gap / 1000);
+            ts.tv_nsec  = (long)((gap - (double)ts.tv_sec * 1000) * 1e6);
+            while ((nanosleep(&ts, &ts) != 0) && (errno == EINTR));
+        }
+    }
+
+    print_stages(sent, lost, partial);
+
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+/*  Host-side decoder for the radio link test (apps/test_radiolink)
+  *
+  * Reads the MPipe output of the sink, and optionally of the source, and
+  * prints one line per step of the test plan: frames sent and received, PER,
+  * RSSI, throughput and radio ISR time per frame.  The input is the raw MPipe
+  * stream (NDEF framing, with the sequence and CRC16 footer).  Messages that
+  * are not LINK records are skipped, and so are messages with a bad CRC.
+  *
+  * Without the source output, PER cannot be known exactly, so it is left out
+  * and only the frames received are shown.
+  *
+  * Build:  gcc -o link_decode link_decode.c
+  * Usage:  link_decode sink.mpipe [source.mpipe]
+  *         link_decode -v sink.mpipe [source.mpipe]   (also RSSI histograms)
+  */
+
+#include <stdio.h>
+#include <string.h>
+
+
+#define MAX_STEPS   256         // step index is one byte, so it always fits
+#define RSSI_BINS   8
+#define RSSI_FLOOR  -110
+#define RSSI_BIN    10
+
+typedef struct {
+    int             valid;
+    unsigned int    pattern;
+    unsigned int    channel;
+    unsigned int    length;
+    unsigned int    frames;
+    unsigned int    errors;
+    unsigned long   bytes;
+    unsigned long   span;
+    int             rssi_min;
+    int             rssi_max;
+    long            rssi_sum;
+    unsigned int    rssi_hist[RSSI_BINS];
+    unsigned long   isr_count;
+    double          isr_total;
+    double          isr_max;
+} step_rec;
+
+typedef struct {
+    int             valid;
+    unsigned long   hz;
+    unsigned int    tick_hz;
+    unsigned int    steps;
+    int             ended;
+    step_rec        step[MAX_STEPS];
+} node_rec;
+
+static node_rec node[2];     // 0 = sink, 1 = source
+
+static const char* pattern_name[] = { "FG", "BG", "FLOOD", "STREAM" };
+
+static unsigned long bad_crc = 0;
+
+
+
+static unsigned int crc16(const unsigned char* data, int length) {
+/// CRC16-CCITT (0x1021, init 0xFFFF), as in OTlib crc16.c
+    unsigned int crc = 0xFFFF;
+    int i;
+
+    while (length-- > 0) {
+        crc ^= (unsigned int)(*data++) << 8;
+        for (i=0; i<8; i++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc & 0xFFFF;
+}
+
+static unsigned long get16(const unsigned char* p) {
+    return ((unsigned long)p[0] << 8) | p[1];
+}
+
+static unsigned long get32(const unsigned char* p) {
+    return (get16(p) << 16) | get16(&p[2]);
+}
+
+
+
+static void parse_record(const unsigned char* rec, int length) {
+    node_rec*   n;
+    step_rec*   s;
+    int         i;
+
+    if (length < 3) {
+        return;
+    }
+
+    switch (rec[0]) {
+        case 'H':
+            if (length < 14) return;
+            if (rec[2] > 1) return;
+            n           = &node[rec[2]];
+            n->valid    = 1;
+            n->steps    = rec[3];
+            n->hz       = get32(&rec[4]);
+            n->tick_hz  = (unsigned int)get16(&rec[12]);
+            break;
+
+        case 'S':
+            if (length < 43) return;
+            if (rec[2] > 1) return;
+            s           = &node[rec[2]].step[rec[1]];
+            memset(s, 0, sizeof(step_rec));
+            s->valid    = 1;
+            s->pattern  = rec[3];
+            s->channel  = rec[4];
+            s->length   = (unsigned int)get16(&rec[5]);
+            s->frames   = (unsigned int)get16(&rec[7]);
+            s->errors   = (unsigned int)get16(&rec[9]);
+            s->bytes    = get32(&rec[11]);
+            s->span     = get32(&rec[15]);
+            s->rssi_min = (short)get16(&rec[19]);
+            s->rssi_max = (short)get16(&rec[21]);
+            s->rssi_sum = (long)(int)get32(&rec[23]);
+            for (i=0; i<RSSI_BINS; i++) {
+                s->rssi_hist[i] = (unsigned int)get16(&rec[27+(i*2)]);
+            }
+            break;
+
+        case 'I':
+            if (length < 14) return;
+            if (rec[2] > 1) return;
+            s               = &node[rec[2]].step[rec[1]];
+            s->isr_count   += get16(&rec[4]);
+            s->isr_total   += (double)get32(&rec[6]);
+            if ((double)get32(&rec[10]) > s->isr_max) {
+                s->isr_max  = (double)get32(&rec[10]);
+            }
+            break;
+
+        case 'E':
+            if (rec[1] <= 1) node[rec[1]].ended = 1;
+            break;
+    }
+}
+
+
+static int read_stream(const char* path) {
+/// Scans for NDEF headers (DD 00 len 02 04 subcode), checks the footer CRC,
+/// and passes the data after the "LINK " label to parse_record().
+    static unsigned char buf[1<<20];
+    FILE*   in;
+    size_t  total;
+    size_t  i = 0;
+
+    in = fopen(path, "rb");
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+    total = fread(buf, 1, sizeof(buf), in);
+    fclose(in);
+
+    while ((i + 10) <= total) {
+        size_t length;
+
+        if ((buf[i] != 0xDD) || (buf[i+1] != 0x00) || (buf[i+3] != 0x02)) {
+            i++;
+            continue;
+        }
+        length = buf[i+2];
+        if ((i + 6 + length + 4) > total) {
+            break;
+        }
+        if (crc16(&buf[i], (int)(6 + length + 2)) != get16(&buf[i+6+length+2])) {
+            bad_crc++;
+            i++;
+            continue;
+        }
+        if ((length > 5) && (memcmp(&buf[i+6], "LINK ", 5) == 0)) {
+            parse_record(&buf[i+11], (int)length - 5);
+        }
+        i += 6 + length + 4;
+    }
+    return 0;
+}
+
+
+static double to_us(const node_rec* n, double units) {
+    return (n->hz == 0) ? 0.0 : (units * 1e6 / (double)n->hz);
+}
+
+
+static void print_steps(int verbose) {
+    node_rec*   rx = &node[0];
+    node_rec*   tx = &node[1];
+    unsigned    i, j;
+
+    printf("# step pattern chan  len |   sent  cca |   rcvd crcerr    PER"
+           " | rssi min/avg/max  | rx kbps | rx isr us/frame | tx isr us/frame\n");
+
+    for (i=0; i<MAX_STEPS; i++) {
+        step_rec* r = &rx->step[i];
+        step_rec* t = &tx->step[i];
+
+        if (!r->valid && !t->valid) {
+            continue;
+        }
+        {   step_rec* d = r->valid ? r : t;
+            printf("%6u %-7s 0x%02X %4u |", i,
+                (d->pattern < 4) ? pattern_name[d->pattern] : "?", d->channel, d->length);
+        }
+
+        if (t->valid) printf(" %6u %4u |", t->frames, t->errors);
+        else          printf(" %6s %4s |", "-", "-");
+
+        if (r->valid) {
+            printf(" %6u %6u", r->frames, r->errors);
+            if (t->valid && (t->frames != 0)) {
+                printf(" %6.3f", 1.0 - ((double)r->frames / (double)t->frames));
+            }
+            else {
+                printf(" %6s", "-");
+            }
+            if (r->frames != 0) {
+                printf(" | %5d %5.1f %5d |", r->rssi_min,
+                        (double)r->rssi_sum / r->frames, r->rssi_max);
+            }
+            else {
+                printf(" | %5s %5s %5s |", "-", "-", "-");
+            }
+            /// Data that came after the first frame, over the time from the
+            /// end of the first frame to the end of the last one.
+            if ((r->frames > 1) && (r->span != 0) && (rx->tick_hz != 0)) {
+                double bits = (double)r->bytes * (r->frames - 1) / r->frames * 8.0;
+                printf(" %7.2f |", bits * rx->tick_hz / (double)r->span / 1000.0);
+            }
+            else {
+                printf(" %7s |", "-");
+            }
+            if (r->frames != 0) printf(" %15.1f |", to_us(rx, r->isr_total) / r->frames);
+            else                printf(" %15s |", "-");
+        }
+        else {
+            printf(" %6s %6s %6s | %5s %5s %5s | %7s | %15s |", "-", "-", "-", "-", "-", "-", "-", "-");
+        }
+
+        if (t->valid && (t->frames != 0)) printf(" %15.1f\n", to_us(tx, t->isr_total) / t->frames);
+        else                              printf(" %15s\n", "-");
+
+        if (verbose && r->valid && (r->frames != 0)) {
+            printf("#      rssi:");
+            for (j=0; j<RSSI_BINS; j++) {
+                if (j == 0)             printf(" <%d:", RSSI_FLOOR + RSSI_BIN);
+                else if (j == RSSI_BINS-1) printf(" >=%d:", RSSI_FLOOR + (int)j*RSSI_BIN);
+                else                    printf(" %d:", RSSI_FLOOR + (int)j*RSSI_BIN);
+                printf("%u", r->rssi_hist[j]);
+            }
+            printf("   isr max %.1f us\n", to_us(rx, r->isr_max));
+        }
+    }
+}
+
+
+
+int main(int argc, char** argv) {
+    int verbose = 0;
+    int arg     = 1;
+
+    if ((argc > 1) && (strcmp(argv[1], "-v") == 0)) {
+        verbose = 1;
+        arg++;
+    }
+    if ((argc - arg) < 1) {
+        fprintf(stderr, "usage: link_decode [-v] sink.mpipe [source.mpipe]\n");
+        return 1;
+    }
+    for (; arg<argc; arg++) {
+        if (read_stream(argv[arg]) != 0) {
+            return 1;
+        }
+    }
+
+    if (!node[0].valid && !node[1].valid) {
+        fprintf(stderr, "link_decode: no LINK records\n");
+        return 1;
+    }
+    if (bad_crc != 0) {
+        fprintf(stderr, "link_decode: %lu messages with a bad CRC skipped\n", bad_crc);
+    }
+    if ((node[0].valid && !node[0].ended) || (node[1].valid && !node[1].ended)) {
+        fprintf(stderr, "link_decode: a test plan did not finish\n");
+    }
+
+    print_steps(verbose);
+    return 0;
+}
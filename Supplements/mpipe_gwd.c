@@ -0,0 +1,553 @@
+/*  Host-side daemon that drives several MPipe-attached gateways at once
+  *
+  * Each argument is the serial (UART or USB CDC) port of one gateway.  All the
+  * ports are served by one epoll loop, so a collection round that is sent to
+  * every gateway runs on all of them in parallel.  Requests are read from
+  * stdin, one batch per line:
+  *     <gateway> <hex>
+  * <gateway> is the index of the port on the command line, or * for all of
+  * them.  <hex> is one or more ALP records in NDEF framing, without the MPipe
+  * footer, as built by alp_api_client.c (alp_new_msg() with gap = 0).  Spaces
+  * in the hex are ignored.
+  *
+  * Each record goes out as one MPipe frame, with the gateway's next sequence
+  * number and the CRC16 footer.  Up to -w frames are in flight per gateway.
+  * The gateway ACKs each frame with the sequence number of the frame (payload
+  * 0, CMD 0, or 0x7F for a CRC error), so ACKs are matched on the sequence.
+  * A NACK or a missing ACK resends the frame.  When the response bit (0x80) of
+  * the ALP CMD is set, the next record that is not an ACK is the response: the
+  * gateway processes frames in order, so responses are matched to the oldest
+  * request still waiting for one.
+  *
+  * Output lines (stdout):
+  *     R <gateway> <seq> <hex>     response record to the request <seq>
+  *     U <gateway> <hex>           record that matches no request
+  *     E <gateway> <seq> <reason>  request failed (nack, timeout, noresponse)
+  *     D <line>                    all the requests of input line <line> done
+  *
+  * Build:  gcc -O2 -o mpipe_gwd mpipe_gwd.c
+  * Usage:  mpipe_gwd [-b baud] [-w window] port [port ...]
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+
+#define MAX_GATEWAYS    64
+#define MAX_INFLIGHT    16          // largest -w
+#define REQ_QUEUE       256         // requests queued per gateway (power of 2)
+#define MAX_BATCHES     1024        // input lines in progress (power of 2)
+#define FRAME_MAX       (6+255+4)
+#define RXBUF_SIZE      4096
+#define TXBUF_SIZE      (MAX_INFLIGHT*FRAME_MAX)
+
+#define ACK_TIMEOUT     250         // ms to wait for an ACK before a resend
+#define RSP_TIMEOUT     3000        // ms to wait for a response after the ACK
+#define MAX_TRIES       3
+
+typedef enum {
+    REQ_queued = 0,
+    REQ_sent,
+    REQ_acked,
+    REQ_done
+} req_state;
+
+typedef struct {
+    unsigned char   frame[FRAME_MAX];
+    int             length;
+    unsigned int    seq;
+    int             batch;
+    int             respond;
+    int             tries;
+    req_state       state;
+    long long       deadline;
+} request;
+
+typedef struct {
+    const char*     path;
+    int             fd;
+    unsigned int    seq;
+    unsigned int    head;           // oldest request not done
+    unsigned int    next;           // next request to send
+    unsigned int    tail;           // next free slot
+    request         req[REQ_QUEUE];
+    unsigned char   rxbuf[RXBUF_SIZE];
+    int             rxlen;
+    unsigned char   txbuf[TXBUF_SIZE];
+    int             txlen;
+} gateway;
+
+static gateway      gw[MAX_GATEWAYS];
+static int          gateways    = 0;
+static int          window      = 2;
+static int          epfd;
+static int          batch_left[MAX_BATCHES];
+static int          batches_open = 0;
+
+
+
+static unsigned int crc16(const unsigned char* data, int length) {
+/// CRC16-CCITT (0x1021, init 0xFFFF), as in OTlib crc16.c
+    unsigned int crc = 0xFFFF;
+    int i;
+
+    while (length-- > 0) {
+        crc ^= (unsigned int)(*data++) << 8;
+        for (i=0; i<8; i++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc & 0xFFFF;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static void print_hex(const unsigned char* data, int length) {
+    while (length-- > 0) {
+        printf("%02X", *data++);
+    }
+}
+
+
+
+static speed_t baud_code(long baud) {
+    switch (baud) {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 921600:    return B921600;
+        default:        return B0;
+    }
+}
+
+static int open_port(gateway* g, speed_t speed) {
+/// A port that is not a tty (a pty or a FIFO in testing) is used as it is
+    struct termios      tio;
+    struct epoll_event  ev;
+
+    g->fd = open(g->path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (g->fd < 0) {
+        perror(g->path);
+        return -1;
+    }
+    if (tcgetattr(g->fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(g->fd, TCSANOW, &tio);
+        tcflush(g->fd, TCIOFLUSH);
+    }
+
+    ev.events   = EPOLLIN;
+    ev.data.ptr = g;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, g->fd, &ev);
+}
+
+
+
+static void set_epollout(gateway* g, int on) {
+    struct epoll_event ev;
+    ev.events   = EPOLLIN | (on ? EPOLLOUT : 0);
+    ev.data.ptr = g;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, g->fd, &ev);
+}
+
+static void flush_tx(gateway* g) {
+    ssize_t n;
+
+    while (g->txlen > 0) {
+        n = write(g->fd, g->txbuf, g->txlen);
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EINTR)) break;
+            perror(g->path);
+            g->txlen = 0;
+            break;
+        }
+        g->txlen -= (int)n;
+        memmove(g->txbuf, &g->txbuf[n], g->txlen);
+    }
+    set_epollout(g, (g->txlen > 0));
+}
+
+static void send_request(gateway* g, request* r) {
+/// The frame is sent as it is, and a resend keeps its sequence number
+    if ((g->txlen + r->length) > TXBUF_SIZE) {
+        return;     // sent on the next pass, once the port drains
+    }
+    memcpy(&g->txbuf[g->txlen], r->frame, r->length);
+    g->txlen   += r->length;
+    r->state    = REQ_sent;
+    r->tries++;
+    r->deadline = now_ms() + ACK_TIMEOUT;
+}
+
+
+
+static void finish(gateway* g, request* r, const char* error) {
+    if (error != NULL) {
+        printf("E %d %u %s\n", (int)(g - gw), r->seq, error);
+    }
+    r->state = REQ_done;
+
+    if (--batch_left[r->batch & (MAX_BATCHES-1)] == 0) {
+        printf("D %d\n", r->batch);
+        batches_open--;
+    }
+    while ((g->head != g->next) && (g->req[g->head & (REQ_QUEUE-1)].state == REQ_done)) {
+        g->head++;
+    }
+}
+
+static void pump(gateway* g) {
+/// Send queued requests while the window has room
+    while ((g->next != g->tail) && ((g->next - g->head) < (unsigned int)window)) {
+        request* r = &g->req[g->next & (REQ_QUEUE-1)];
+        send_request(g, r);
+        if (r->state != REQ_sent) {
+            break;
+        }
+        g->next++;
+    }
+    flush_tx(g);
+}
+
+static void check_timeouts(gateway* g, long long now) {
+    unsigned int i;
+
+    for (i=g->head; i!=g->next; i++) {
+        request* r = &g->req[i & (REQ_QUEUE-1)];
+
+        if ((r->state == REQ_done) || (r->deadline > now)) {
+            continue;
+        }
+        if (r->state == REQ_acked) {
+            finish(g, r, "noresponse");
+        }
+        else if (r->tries < MAX_TRIES) {
+            send_request(g, r);
+        }
+        else {
+            finish(g, r, "timeout");
+        }
+    }
+    pump(g);
+}
+
+static long long next_deadline(void) {
+    long long   soonest = -1;
+    int         i;
+    unsigned int j;
+
+    for (i=0; i<gateways; i++) {
+        for (j=gw[i].head; j!=gw[i].next; j++) {
+            request* r = &gw[i].req[j & (REQ_QUEUE-1)];
+            if ((r->state != REQ_done) && ((soonest < 0) || (r->deadline < soonest))) {
+                soonest = r->deadline;
+            }
+        }
+    }
+    return soonest;
+}
+
+
+
+static void on_ack(gateway* g, unsigned int seq, int nack) {
+    unsigned int i;
+
+    for (i=g->head; i!=g->next; i++) {
+        request* r = &g->req[i & (REQ_QUEUE-1)];
+        if ((r->state != REQ_sent) || (r->seq != seq)) {
+            continue;
+        }
+        if (nack) {
+            if (r->tries < MAX_TRIES)   send_request(g, r);
+            else                        finish(g, r, "nack");
+        }
+        else if (r->respond) {
+            r->state    = REQ_acked;
+            r->deadline = now_ms() + RSP_TIMEOUT;
+        }
+        else {
+            finish(g, r, NULL);
+        }
+        return;
+    }
+}
+
+static void on_record(gateway* g, const unsigned char* rec, int length) {
+/// A response can beat its ACK (a lost ACK, or a gateway that does not ACK),
+/// so a request that is only sent can take it too.
+    unsigned int i;
+
+    for (i=g->head; i!=g->next; i++) {
+        request* r = &g->req[i & (REQ_QUEUE-1)];
+        if (((r->state == REQ_sent) || (r->state == REQ_acked)) && r->respond) {
+            printf("R %d %u ", (int)(g - gw), r->seq);
+            print_hex(rec, length);
+            printf("\n");
+            finish(g, r, NULL);
+            return;
+        }
+    }
+    printf("U %d ", (int)(g - gw));
+    print_hex(rec, length);
+    printf("\n");
+}
+
+static void parse_rx(gateway* g) {
+/// Frames are 6 byte header + payload + 2 byte sequence + CRC16.  A frame with
+/// a bad CRC is dropped one byte at a time, until a good frame is found.
+    int i = 0;
+
+    while ((g->rxlen - i) >= 10) {
+        unsigned char*  f       = &g->rxbuf[i];
+        int             length  = 6 + f[2] + 4;
+        unsigned int    seq;
+
+        if ((f[1] != 0) || (f[3] != 2)) {
+            i++;
+            continue;
+        }
+        if ((g->rxlen - i) < length) {
+            break;
+        }
+        if (crc16(f, length-2) != (((unsigned int)f[length-2] << 8) | f[length-1])) {
+            i++;
+            continue;
+        }
+        seq = ((unsigned int)f[length-4] << 8) | f[length-3];
+
+        if ((f[2] == 0) && (f[4] == 0) && ((f[5] == 0) || (f[5] == 0x7F))) {
+            on_ack(g, seq, (f[5] != 0));
+        }
+        else {
+            on_record(g, f, 6 + f[2]);
+        }
+        i += length;
+    }
+    g->rxlen -= i;
+    memmove(g->rxbuf, &g->rxbuf[i], g->rxlen);
+    pump(g);
+}
+
+static void read_port(gateway* g) {
+    ssize_t n;
+
+    for (;;) {
+        if (g->rxlen == RXBUF_SIZE) {
+            g->rxlen = 0;       // no frame is this long: resync
+        }
+        n = read(g->fd, &g->rxbuf[g->rxlen], RXBUF_SIZE - g->rxlen);
+        if (n <= 0) {
+            break;
+        }
+        g->rxlen += (int)n;
+    }
+    parse_rx(g);
+}
+
+
+
+static int queue_record(gateway* g, const unsigned char* rec, int length, int batch) {
+    request*    r;
+    unsigned    crc;
+
+    if ((g->tail - g->head) >= REQ_QUEUE) {
+        return -1;
+    }
+    r           = &g->req[g->tail & (REQ_QUEUE-1)];
+    memcpy(r->frame, rec, length);
+    r->seq      = g->seq++ & 0xFFFF;
+    r->frame[length++] = (unsigned char)(r->seq >> 8);
+    r->frame[length++] = (unsigned char)r->seq;
+    crc         = crc16(r->frame, length);
+    r->frame[length++] = (unsigned char)(crc >> 8);
+    r->frame[length++] = (unsigned char)crc;
+    r->length   = length;
+    r->batch    = batch;
+    r->respond  = (rec[5] & 0x80) != 0;
+    r->tries    = 0;
+    r->state    = REQ_queued;
+    g->tail++;
+    batch_left[batch & (MAX_BATCHES-1)]++;
+    return 0;
+}
+
+static void do_line(char* line, int batch) {
+/// Parse "<gateway> <hex>" and queue every record on the target gateway(s)
+    static unsigned char msg[REQ_QUEUE*FRAME_MAX];
+    int     length  = 0;
+    int     first, last, i, j;
+    char*   p       = line;
+    char*   end;
+
+    while ((*p == ' ') || (*p == '\t')) p++;
+    if ((*p == '\0') || (*p == '\n') || (*p == '#')) {
+        return;
+    }
+    if (*p == '*') {
+        first   = 0;
+        last    = gateways-1;
+        p++;
+    }
+    else {
+        first   = last = (int)strtol(p, &end, 10);
+        if ((end == p) || (first < 0) || (first >= gateways)) {
+            fprintf(stderr, "line %d: bad gateway\n", batch);
+            return;
+        }
+        p       = end;
+    }
+    while ((*p != '\0') && (length < (int)sizeof(msg))) {
+        unsigned int byte;
+        if ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r')) {
+            p++;
+            continue;
+        }
+        if (sscanf(p, "%2x", &byte) != 1) {
+            fprintf(stderr, "line %d: bad hex\n", batch);
+            return;
+        }
+        msg[length++]   = (unsigned char)byte;
+        p              += 2;
+    }
+
+    /// Check the record framing before anything is queued
+    for (i=0; i<length; i+=6+msg[i+2]) {
+        if (((i+6) > length) || ((i+6+msg[i+2]) > length) || (msg[i+3] != 2)) {
+            fprintf(stderr, "line %d: bad record\n", batch);
+            return;
+        }
+    }
+
+    if (batch_left[batch & (MAX_BATCHES-1)] != 0) {
+        fprintf(stderr, "line %d: too many batches in progress\n", batch);
+        return;
+    }
+    batches_open++;
+    batch_left[batch & (MAX_BATCHES-1)] = 1;    // held until all are queued
+
+    for (j=first; j<=last; j++) {
+        for (i=0; i<length; i+=6+msg[i+2]) {
+            if (queue_record(&gw[j], &msg[i], 6+msg[i+2], batch) != 0) {
+                fprintf(stderr, "line %d: gateway %d queue is full\n", batch, j);
+                break;
+            }
+        }
+        pump(&gw[j]);
+    }
+
+    if (--batch_left[batch & (MAX_BATCHES-1)] == 0) {
+        printf("D %d\n", batch);
+        batches_open--;
+    }
+}
+
+
+
+int main(int argc, char** argv) {
+    struct epoll_event  ev[MAX_GATEWAYS+1];
+    static char         line[2*REQ_QUEUE*FRAME_MAX + 64];
+    int                 linelen     = 0;
+    int                 batch       = 0;
+    int                 input_open  = 1;
+    long                baud        = 115200;
+    int                 opt;
+    int                 i;
+
+    while ((opt = getopt(argc, argv, "b:w:")) != -1) {
+        switch (opt) {
+            case 'b':   baud    = atol(optarg); break;
+            case 'w':   window  = atoi(optarg); break;
+            default:    optind  = argc+1;       break;
+        }
+    }
+    if ((optind >= argc) || ((argc-optind) > MAX_GATEWAYS) || (baud_code(baud) == B0) \
+     || (window < 1) || (window > MAX_INFLIGHT)) {
+        fprintf(stderr, "Usage: %s [-b baud] [-w window (1-%d)] port [port ...]\n",
+                argv[0], MAX_INFLIGHT);
+        return 1;
+    }
+
+    epfd = epoll_create1(0);
+    for (i=optind; i<argc; i++, gateways++) {
+        gw[gateways].path = argv[i];
+        if (open_port(&gw[gateways], baud_code(baud)) != 0) {
+            return 1;
+        }
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    ev[0].events    = EPOLLIN;
+    ev[0].data.ptr  = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev[0]);
+
+    /// Run until stdin is closed and every batch is done
+    while (input_open || (batches_open > 0)) {
+        long long   deadline = next_deadline();
+        int         timeout  = -1;
+        int         n;
+
+        if (deadline >= 0) {
+            long long wait = deadline - now_ms();
+            timeout = (wait < 0) ? 0 : (int)wait;
+        }
+        n = epoll_wait(epfd, ev, MAX_GATEWAYS+1, timeout);
+
+        for (i=0; i<n; i++) {
+            gateway* g = (gateway*)ev[i].data.ptr;
+
+            if (g != NULL) {
+                if (ev[i].events & EPOLLIN)     read_port(g);
+                if (ev[i].events & EPOLLOUT)    flush_tx(g);
+                continue;
+            }
+
+            /// stdin: take whole lines only
+            for (;;) {
+                ssize_t got = read(STDIN_FILENO, &line[linelen], sizeof(line)-1-linelen);
+                char*   eol;
+                if (got == 0) {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+                    input_open = 0;
+                }
+                if (got <= 0) {
+                    break;
+                }
+                linelen        += (int)got;
+                line[linelen]   = '\0';
+                while ((eol = strchr(line, '\n')) != NULL) {
+                    *eol = '\0';
+                    do_line(line, batch++);
+                    linelen -= (int)(eol + 1 - line);
+                    memmove(line, eol+1, linelen+1);
+                }
+                if (linelen == (int)sizeof(line)-1) {
+                    fprintf(stderr, "line %d: too long\n", batch++);
+                    linelen = 0;
+                }
+            }
+        }
+
+        for (i=0; i<gateways; i++) {
+            check_timeouts(&gw[i], now_ms());
+        }
+    }
+    return 0;
+}
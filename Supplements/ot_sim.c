@@ -0,0 +1,825 @@
+/*  Discrete event simulator for networks of POSIX OpenTag nodes
+  *
+  * Runs many nodes of an app built for the POSIX platform in virtual time,
+  * faster than real time.  Each node is a process of the unmodified app (so
+  * /otlib and /otkernel are the real thing), and the processes run on all the
+  * cores of the host.  The simulator owns the clock and the air: see
+  * otplatform/posix/sim_POSIX.h for the protocol.
+  *
+  * Synchronization is conservative.  A frame sent at time t starts at the
+  * other nodes at t + lookahead (-l, in ti), so within a window of that length
+  * the nodes cannot affect each other.  Each round takes the earliest event of
+  * any node, and every node with something to do in the window that starts
+  * there runs its part of the window at once.
+  *
+  * Channel model:
+  * - The nodes are placed at random in a square (-a meters), or at the
+  *   positions in a file (-p, one "x y" line per node).
+  * - Path loss is log-distance: PL = PL0 + 10 n log10(d), d >= 1 m (-P, -x).
+  *   The default PL0 is free space at 1 m and 433 MHz, and n is 3.
+  *   RSSI is the TX EIRP of the frame minus the path loss.  Frames under the
+  *   sensitivity (-f) are not heard.
+  * - A frame is lost at a receiver when the frames that overlap it on the same
+  *   center frequency, summed with the noise floor (-N), are less than the
+  *   capture ratio (-c, dB) under it.  Otherwise it captures the receiver.
+  *   The receiver stays on the first frame it syncs to.  Frames under the
+  *   sensitivity do not add to the interference.
+  *
+  * Stimulus for the apps: -k node,ms,signal[,period_ms] raises the signal in
+  * the node at a virtual time, and again every period.  -e node,NAME=value
+  * sets an environment variable of a node.  Node 0 is all the nodes.  For
+  * apps/demo_opmode, a gateway that sends a query every 2 s to endpoints:
+  *     ot_sim -n 1000 -t 60 -e 0,OT_MODE=endpoint -e 1,OT_MODE=gateway
+  *            -k 1,1000,USR2,2000 -- ./node
+  *
+  * Output (stdout): one line per node, with its position, its radio counts,
+  * the mean access latency of its packets (queued to first frame on the
+  * air), its throughput of good frames, and its energy from the radio
+  * currents (-I tx,rx,sleep mA, -V volts), then the totals of the run.  The
+  * output of each node goes to -o dir/node_<n>.out, or to /dev/null.  Each
+  * node keeps its file system image in the working directory.
+  *
+  * Build:  gcc -O2 -I otplatform/posix -o ot_sim ot_sim.c -lm
+  * Usage:  ot_sim [options] -- node_program [args]
+  */
+
+#define _GNU_SOURCE            // sendmmsg()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "sim_POSIX.h"
+
+
+#define MAX_SIGNALS     64
+#define MAX_ENVS        64
+
+
+/** A frame on the air.  The events of its receivers refer to it, and it is
+  * freed when the last of them has gone to its node.
+  */
+typedef struct {
+    int         refs;
+    int         sender;
+    uint32_t    start;
+    uint32_t    end;
+    uint8_t     channel;
+    uint8_t     eirp;
+    uint8_t     fc;
+    double      eirp_dbm;
+    uint16_t    length;
+    uint8_t     data[SIM_FRAME_MAX];
+} frame;
+
+/** An event for one node.  Events of a node are sorted by time.  An END
+  * event sums the power (mW) of the frames that overlap its frame at the
+  * node, as they are sent.
+  */
+typedef struct {
+    uint32_t    time;
+    uint8_t     type;
+    double      rssi;
+    double      interference;
+    frame*      f;
+    int         signo;
+    uint32_t    period;
+} event;
+
+typedef struct {
+    pid_t       pid;
+    int         fd;
+    double      x;
+    double      y;
+    uint32_t    wake;
+    event*      ev;
+    int         nev;
+    int         evcap;
+    int         heap;           // index in the heap, or -1
+    int*        nb;             // nodes in range, and their path loss
+    float*      nbloss;
+    int         nnb;
+    int         nbdone;
+    sim_stats   stats;
+    int         gotstats;
+    uint64_t    lat_sum;
+    uint32_t    lat_n;
+} node;
+
+typedef struct {
+    int         node;
+    uint32_t    time;
+    int         signo;
+    uint32_t    period;
+} stimulus;
+
+typedef struct {
+    int         node;
+    char*       var;
+} envvar;
+
+
+static node*    nodes;
+static int      num_nodes   = 10;
+static int*     heap;
+static int      heap_n;
+
+static uint32_t lookahead   = 1;
+static double   area        = 100.0;
+static double   pl0         = 25.0;
+static double   pl_exp      = 3.0;
+static double   capture     = 6.0;
+static double   sensitivity = -110.0;
+static double   noise       = -120.0;
+static double   i_tx        = 30.0;
+static double   i_rx        = 16.0;
+static double   i_sleep     = 0.002;
+static double   volts       = 3.0;
+
+static stimulus stim[MAX_SIGNALS];
+static int      num_stim;
+static envvar   envs[MAX_ENVS];
+static int      num_envs;
+
+
+
+
+/** Node Event Lists and the Heap
+  * ============================================================================
+  * The heap holds the nodes that are not running, by the time of their next
+  * timer or event.
+  */
+static uint32_t node_key(node* n) {
+    uint32_t key = n->wake;
+    if ((n->nev > 0) && (n->ev[0].time < key)) {
+        key = n->ev[0].time;
+    }
+    return key;
+}
+
+
+static void heap_swap(int a, int b) {
+    int t   = heap[a];
+    heap[a] = heap[b];
+    heap[b] = t;
+    nodes[heap[a]].heap = a;
+    nodes[heap[b]].heap = b;
+}
+
+
+static void heap_up(int i) {
+    while ((i > 0) && (node_key(&nodes[heap[i]]) < node_key(&nodes[heap[(i-1)/2]]))) {
+        heap_swap(i, (i-1)/2);
+        i = (i-1)/2;
+    }
+}
+
+
+static void heap_down(int i) {
+    for (;;) {
+        int l = 2*i + 1;
+        int m = i;
+        if ((l < heap_n) && (node_key(&nodes[heap[l]]) < node_key(&nodes[heap[m]])))       m = l;
+        if ((l+1 < heap_n) && (node_key(&nodes[heap[l+1]]) < node_key(&nodes[heap[m]])))   m = l+1;
+        if (m == i) {
+            return;
+        }
+        heap_swap(i, m);
+        i = m;
+    }
+}
+
+
+static void heap_push(int id) {
+    heap[heap_n]    = id;
+    nodes[id].heap  = heap_n++;
+    heap_up(heap_n-1);
+}
+
+
+static int heap_pop(void) {
+    int id = heap[0];
+    heap_swap(0, --heap_n);
+    heap_down(0);
+    nodes[id].heap = -1;
+    return id;
+}
+
+
+static void add_event(int id, event* e) {
+/// Events mostly come in time order, so the insert is from the back
+    node*   n = &nodes[id];
+    int     i;
+
+    if (n->nev == n->evcap) {
+        n->evcap    = (n->evcap == 0) ? 8 : (n->evcap * 2);
+        n->ev       = realloc(n->ev, n->evcap * sizeof(event));
+    }
+    for (i=n->nev; (i > 0) && (n->ev[i-1].time > e->time); i--) {
+        n->ev[i] = n->ev[i-1];
+    }
+    n->ev[i] = *e;
+    n->nev++;
+
+    if ((i == 0) && (n->heap >= 0)) {
+        heap_up(n->heap);
+    }
+}
+
+
+
+
+/** Channel Model
+  * ============================================================================
+  */
+static double path_loss(int a, int b) {
+    double dx = nodes[a].x - nodes[b].x;
+    double dy = nodes[a].y - nodes[b].y;
+    double d  = sqrt(dx*dx + dy*dy);
+    return pl0 + (10.0 * pl_exp * log10((d < 1.0) ? 1.0 : d));
+}
+
+
+static uint8_t chan_fc(uint8_t channel) {
+/// Center frequency index, as in radio_POSIX.c
+    return ((channel & 0x30) == 0) ? 7 : (channel & 0x0F);
+}
+
+
+static void find_neighbors(int id) {
+/// The nodes that can hear this one at its highest EIRP (+23.5 dBm)
+    node*   n = &nodes[id];
+    int     i;
+
+    n->nb       = malloc(num_nodes * sizeof(int));
+    n->nbloss   = malloc(num_nodes * sizeof(float));
+    n->nnb      = 0;
+    for (i=0; i<num_nodes; i++) {
+        double loss;
+        if (i == id) {
+            continue;
+        }
+        loss = path_loss(id, i);
+        if ((23.5 - loss) >= sensitivity) {
+            n->nb[n->nnb]       = i;
+            n->nbloss[n->nnb]   = (float)loss;
+            n->nnb++;
+        }
+    }
+    n->nbdone = 1;
+}
+
+
+static double dbm_to_mw(double dbm) {
+    return pow(10.0, dbm / 10.0);
+}
+
+
+static void interfere(node* rx, frame* f, event* end) {
+/// The frames of the node that overlap f on its center frequency, and f,
+/// add to each other's interference.  A frame that is over at the node has
+/// ended before f started, so only the END events still to come are looked
+/// at.  Frames from the node itself are not in its events: it is deaf to
+/// them.
+    int i;
+
+    for (i=0; i<rx->nev; i++) {
+        event* e = &rx->ev[i];
+        if ((e->type != SIM_MSG_END) || (e->f->fc != f->fc) || \
+            (e->f->start >= f->end) || (e->f->end <= f->start)) {
+            continue;
+        }
+        e->interference    += dbm_to_mw(end->rssi);
+        end->interference  += dbm_to_mw(e->rssi);
+    }
+}
+
+
+static int lost(event* end) {
+    return ((end->rssi - (10.0 * log10(dbm_to_mw(noise) + end->interference))) < capture);
+}
+
+
+static void on_tx(int id, sim_msg* msg) {
+    node*   n = &nodes[id];
+    frame*  f;
+    event   e;
+    int     i;
+
+    if (msg->arg != SIM_NEVER) {
+        n->lat_sum += msg->time - msg->arg;
+        n->lat_n++;
+    }
+
+    f           = malloc(sizeof(frame));
+    f->refs     = 0;
+    f->sender   = id;
+    f->start    = msg->time + lookahead;
+    f->end      = f->start + msg->duration;
+    f->channel  = msg->channel;
+    f->eirp     = msg->eirp;
+    f->fc       = chan_fc(msg->channel);
+    f->eirp_dbm = (double)((msg->eirp & 0x7F) >> 1) - 40.0;
+    f->length   = (msg->length > SIM_FRAME_MAX) ? SIM_FRAME_MAX : msg->length;
+    memcpy(f->data, msg->data, f->length);
+
+    if (n->nbdone == 0) {
+        find_neighbors(id);
+    }
+    for (i=0; i<n->nnb; i++) {
+        double rssi = f->eirp_dbm - n->nbloss[i];
+        if (rssi < sensitivity) {
+            continue;
+        }
+        e.f             = f;
+        e.signo         = 0;
+        e.period        = 0;
+        e.rssi          = rssi;
+        e.interference  = 0.0;
+        e.type          = SIM_MSG_START;
+        e.time          = f->start;
+        add_event(n->nb[i], &e);
+        e.type          = SIM_MSG_END;
+        e.time          = f->end;
+        interfere(&nodes[n->nb[i]], f, &e);
+        add_event(n->nb[i], &e);
+        f->refs        += 2;
+    }
+    if (f->refs == 0) {
+        free(f);
+    }
+}
+
+
+
+
+/** Node Processes
+  * ============================================================================
+  */
+static int recv_msg(node* n, sim_msg* msg) {
+    ssize_t bytes;
+
+    do {
+        bytes = recv(n->fd, msg, sizeof(sim_msg), 0);
+    } while ((bytes < 0) && (errno == EINTR));
+
+    return (bytes >= SIM_MSG_HEAD) ? 0 : -1;
+}
+
+
+static void send_msg(node* n, sim_msg* msg) {
+    while (send(n->fd, msg, SIM_MSG_HEAD + msg->length, 0) < 0) {
+        if (errno != EINTR) {
+            return;
+        }
+    }
+}
+
+
+static void wait_sleep(int id) {
+/// Takes the frames of the node until it sleeps
+    static sim_msg  msg;
+    node*           n = &nodes[id];
+
+    for (;;) {
+        if (recv_msg(n, &msg) != 0) {
+            fprintf(stderr, "node %d: gone\n", id+1);
+            n->wake = SIM_NEVER;
+            return;
+        }
+        if (msg.type == SIM_MSG_TX) {
+            on_tx(id, &msg);
+        }
+        else if (msg.type == SIM_MSG_SLEEP) {
+            n->wake = msg.arg;
+            return;
+        }
+    }
+}
+
+
+static void run_node(int id, uint32_t until) {
+/// Sends the events of the window to the node, then RUN, in one system call.
+/// If there are more than the node can take, its window ends at the first
+/// one left.
+    static sim_msg          msg[SIM_EVENTS+1];
+    static struct iovec     iov[SIM_EVENTS+1];
+    static struct mmsghdr   hdr[SIM_EVENTS+1];
+    node*                   n = &nodes[id];
+    int                     sent;
+    int                     i;
+
+    for (i=0; (i < n->nev) && (n->ev[i].time < until); i++) {
+        event*      e = &n->ev[i];
+        sim_msg*    m = &msg[i];
+
+        if (i == SIM_EVENTS) {
+            until = e->time;
+            break;
+        }
+        memset(m, 0, SIM_MSG_HEAD);
+        m->type = e->type;
+        m->time = e->time;
+        if (e->type == SIM_MSG_SIGNAL) {
+            m->arg = (uint32_t)e->signo;
+        }
+        else {
+            m->arg      = (uint32_t)(e->f->sender + 1);
+            m->channel  = e->f->channel;
+            m->eirp     = e->f->eirp;
+            m->duration = (uint16_t)(e->f->end - e->f->start);
+            m->rssi     = (int16_t)lround(e->rssi);
+            if (e->type == SIM_MSG_START) {
+                m->length = e->f->length;
+                memcpy(m->data, e->f->data, e->f->length);
+            }
+            else {
+                m->corrupt = (uint8_t)lost(e);
+            }
+            if (--e->f->refs == 0) {
+                free(e->f);
+            }
+        }
+    }
+    memmove(n->ev, &n->ev[i], (n->nev - i) * sizeof(event));
+    n->nev -= i;
+
+    memset(&msg[i], 0, SIM_MSG_HEAD);
+    msg[i].type = SIM_MSG_RUN;
+    msg[i].arg  = until;
+
+    for (sent=0; sent<=i; sent++) {
+        iov[sent].iov_base          = &msg[sent];
+        iov[sent].iov_len           = SIM_MSG_HEAD + msg[sent].length;
+        memset(&hdr[sent], 0, sizeof(struct mmsghdr));
+        hdr[sent].msg_hdr.msg_iov   = &iov[sent];
+        hdr[sent].msg_hdr.msg_iovlen= 1;
+    }
+    for (sent=0; sent<=i; ) {
+        int got = sendmmsg(n->fd, &hdr[sent], (i+1) - sent, 0);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        sent += got;
+    }
+}
+
+
+static int spawn(int id, char** argv, const char* outdir) {
+    node*   n = &nodes[id];
+    int     sv[2];
+    pid_t   pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0) {
+        perror("socketpair");
+        return -1;
+    }
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        char    buf[64];
+        char    path[512];
+        int     out;
+        int     i;
+
+        close(sv[0]);
+        snprintf(buf, sizeof(buf), "%d", id+1);
+        setenv("OT_NODE", buf, 1);
+        snprintf(buf, sizeof(buf), "%d", sv[1]);
+        setenv(SIM_ENV, buf, 1);
+        for (i=0; i<num_envs; i++) {
+            if ((envs[i].node == 0) || (envs[i].node == id+1)) {
+                putenv(envs[i].var);
+            }
+        }
+        if (outdir != NULL) {
+            snprintf(path, sizeof(path), "%s/node_%d.out", outdir, id+1);
+        }
+        else {
+            snprintf(path, sizeof(path), "/dev/null");
+        }
+        out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out >= 0) {
+            dup2(out, STDOUT_FILENO);
+            close(out);
+        }
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(1);
+    }
+
+    close(sv[1]);
+    n->pid  = pid;
+    n->fd   = sv[0];
+    return 0;
+}
+
+
+
+
+/** Options
+  * ============================================================================
+  */
+static int parse_signal(const char* name) {
+    static const struct { const char* name; int signo; } names[] = {
+        { "HUP", SIGHUP }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+        { "INT", SIGINT }, { "TERM", SIGTERM }, { "URG", SIGURG }
+    };
+    int i;
+
+    if (strncmp(name, "SIG", 3) == 0) {
+        name += 3;
+    }
+    for (i=0; i<(int)(sizeof(names)/sizeof(names[0])); i++) {
+        if (strcmp(name, names[i].name) == 0) {
+            return names[i].signo;
+        }
+    }
+    return atoi(name);
+}
+
+
+static int parse_stimulus(char* arg) {
+    char*   tok[4];
+    int     i = 0;
+
+    if (num_stim == MAX_SIGNALS) {
+        return -1;
+    }
+    for (tok[0]=strtok(arg, ","); (tok[i] != NULL) && (i < 3); tok[++i]=strtok(NULL, ","));
+    if (i < 3) {
+        return -1;
+    }
+    stim[num_stim].node     = atoi(tok[0]);
+    stim[num_stim].time     = (uint32_t)((atof(tok[1]) * 1024.0) / 1000.0);
+    stim[num_stim].signo    = parse_signal(tok[2]);
+    stim[num_stim].period   = (tok[3] != NULL) ? (uint32_t)((atof(tok[3]) * 1024.0) / 1000.0) : 0;
+    num_stim++;
+    return 0;
+}
+
+
+static int parse_env(char* arg) {
+    char* comma = strchr(arg, ',');
+
+    if ((num_envs == MAX_ENVS) || (comma == NULL) || (strchr(comma, '=') == NULL)) {
+        return -1;
+    }
+    *comma                  = '\0';
+    envs[num_envs].node     = atoi(arg);
+    envs[num_envs].var      = comma + 1;
+    num_envs++;
+    return 0;
+}
+
+
+static int place_nodes(const char* posfile, unsigned int seed) {
+    FILE*   fp;
+    int     i;
+
+    srand(seed);
+    for (i=0; i<num_nodes; i++) {
+        nodes[i].x = area * ((double)rand() / RAND_MAX);
+        nodes[i].y = area * ((double)rand() / RAND_MAX);
+    }
+    if (posfile == NULL) {
+        return 0;
+    }
+    fp = fopen(posfile, "r");
+    if (fp == NULL) {
+        perror(posfile);
+        return -1;
+    }
+    for (i=0; i<num_nodes; i++) {
+        if (fscanf(fp, "%lf %lf", &nodes[i].x, &nodes[i].y) != 2) {
+            fprintf(stderr, "%s: %d positions for %d nodes\n", posfile, i, num_nodes);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+
+
+
+/** Report
+  * ============================================================================
+  */
+static void report(uint32_t end, double wall, uint64_t rounds, uint64_t released) {
+    double      sim_s   = end / 1024.0;
+    uint64_t    tx      = 0;
+    uint64_t    good    = 0;
+    uint64_t    lat_sum = 0;
+    uint64_t    lat_n   = 0;
+    double      energy  = 0.0;
+    int         i;
+
+    printf("# node x y tx_frames rx_frames rx_good crc_errs collisions weak "
+           "cca_busy latency_ms good_per_s listen_s energy_mJ\n");
+    for (i=0; i<num_nodes; i++) {
+        node*       n       = &nodes[i];
+        sim_stats*  s       = &n->stats;
+        uint32_t    ok      = s->rx_frames - s->rx_crcerrs;
+        double      tx_s    = s->tx_ti / 1024.0;
+        double      rx_s    = s->listen_ti / 1024.0;
+        double      idle_s  = sim_s - tx_s - rx_s;
+        double      mj      = volts * ((i_tx * tx_s) + (i_rx * rx_s) + (i_sleep * ((idle_s > 0) ? idle_s : 0)));
+
+        printf("%d %.1f %.1f %u %u %u %u %u %u %u %.2f %.3f %.3f %.3f\n",
+               i+1, n->x, n->y, s->tx_frames, s->rx_frames, ok, s->rx_crcerrs,
+               s->rx_collisions, s->rx_weak, s->cca_busy,
+               (n->lat_n != 0) ? ((n->lat_sum * 1000.0) / (n->lat_n * 1024.0)) : 0.0,
+               ok / sim_s, rx_s, mj);
+
+        tx      += s->tx_frames;
+        good    += ok;
+        lat_sum += n->lat_sum;
+        lat_n   += n->lat_n;
+        energy  += mj;
+    }
+
+    printf("# nodes %d, %.1f s simulated in %.1f s (x%.1f), %llu rounds, %.1f nodes per round\n",
+           num_nodes, sim_s, wall, (wall > 0) ? (sim_s / wall) : 0.0,
+           (unsigned long long)rounds, (rounds != 0) ? ((double)released / rounds) : 0.0);
+    printf("# frames sent %llu, received good %llu (%.1f per s), mean latency %.2f ms, "
+           "mean energy %.3f mJ per node\n",
+           (unsigned long long)tx, (unsigned long long)good, good / sim_s,
+           (lat_n != 0) ? ((lat_sum * 1000.0) / (lat_n * 1024.0)) : 0.0,
+           energy / num_nodes);
+}
+
+
+
+
+int main(int argc, char** argv) {
+    static sim_msg  msg;
+    struct rlimit   lim;
+    struct timespec t0, t1;
+    const char*     posfile     = NULL;
+    const char*     outdir      = NULL;
+    unsigned int    seed        = 1;
+    double          seconds     = 60.0;
+    uint32_t        end;
+    uint64_t        rounds      = 0;
+    uint64_t        released    = 0;
+    int*            batch;
+    int             opt;
+    int             i, j;
+
+    while ((opt = getopt(argc, argv, "n:t:l:a:p:s:x:P:c:f:N:k:e:o:I:V:")) != -1) {
+        switch (opt) {
+            case 'n':   num_nodes   = atoi(optarg);             break;
+            case 't':   seconds     = atof(optarg);             break;
+            case 'l':   lookahead   = (uint32_t)atoi(optarg);   break;
+            case 'a':   area        = atof(optarg);             break;
+            case 'p':   posfile     = optarg;                   break;
+            case 's':   seed        = (unsigned int)atoi(optarg); break;
+            case 'x':   pl_exp      = atof(optarg);             break;
+            case 'P':   pl0         = atof(optarg);             break;
+            case 'c':   capture     = atof(optarg);             break;
+            case 'f':   sensitivity = atof(optarg);             break;
+            case 'N':   noise       = atof(optarg);             break;
+            case 'o':   outdir      = optarg;                   break;
+            case 'V':   volts       = atof(optarg);             break;
+            case 'I':   if (sscanf(optarg, "%lf,%lf,%lf", &i_tx, &i_rx, &i_sleep) != 3) {
+                            optind = argc+1;
+                        }
+                        break;
+            case 'k':   if (parse_stimulus(optarg) != 0)    optind = argc+1;    break;
+            case 'e':   if (parse_env(optarg) != 0)         optind = argc+1;    break;
+            default:    optind = argc+1;                        break;
+        }
+    }
+    if ((optind >= argc) || (num_nodes < 1) || (lookahead < 1) || (seconds <= 0)) {
+        fprintf(stderr,
+            "Usage: %s [-n nodes] [-t seconds] [-l lookahead_ti] [-s seed]\n"
+            "          [-a area_m | -p posfile] [-P pl0_dB] [-x exponent] [-c capture_dB]\n"
+            "          [-f sensitivity_dBm] [-N noise_dBm] [-I tx,rx,sleep_mA] [-V volts]\n"
+            "          [-k node,ms,signal[,period_ms]] [-e node,NAME=value] [-o outdir]\n"
+            "          -- node_program [args]\n", argv[0]);
+        return 1;
+    }
+    end = (uint32_t)(seconds * 1024.0);
+
+    /// Every node has a socket
+    getrlimit(RLIMIT_NOFILE, &lim);
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+    signal(SIGPIPE, SIG_IGN);
+
+    nodes   = calloc(num_nodes, sizeof(node));
+    heap    = malloc(num_nodes * sizeof(int));
+    batch   = malloc(num_nodes * sizeof(int));
+    if (place_nodes(posfile, seed) != 0) {
+        return 1;
+    }
+
+    /// Start the nodes.  Each runs its startup at time 0, up to its first sleep.
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i=0; i<num_nodes; i++) {
+        nodes[i].heap = -1;
+        if (spawn(i, &argv[optind], outdir) != 0) {
+            return 1;
+        }
+    }
+    for (i=0; i<num_nodes; i++) {
+        wait_sleep(i);
+    }
+    for (i=0; i<num_stim; i++) {
+        for (j=0; j<num_nodes; j++) {
+            if ((stim[i].node == 0) || (stim[i].node == j+1)) {
+                event e;
+                memset(&e, 0, sizeof(e));
+                e.time      = stim[i].time;
+                e.type      = SIM_MSG_SIGNAL;
+                e.signo     = stim[i].signo;
+                e.period    = stim[i].period;
+                add_event(j, &e);
+            }
+        }
+    }
+    for (i=0; i<num_nodes; i++) {
+        heap_push(i);
+    }
+
+    /// Rounds: all the nodes with something to do before T + lookahead run
+    /// at once, and their frames start at T + lookahead or later.
+    while (heap_n > 0) {
+        uint32_t T = node_key(&nodes[heap[0]]);
+        uint32_t until;
+        int      n = 0;
+
+        if (T >= end) {
+            break;
+        }
+        until = T + lookahead;
+        until = (until > end) ? end : until;
+
+        while ((heap_n > 0) && (node_key(&nodes[heap[0]]) < until)) {
+            batch[n++] = heap_pop();
+        }
+        for (i=0; i<n; i++) {
+            node* nd = &nodes[batch[i]];
+            int   k;
+
+            /// Periodic signals of the window come back for their next time
+            for (k=0; (k < nd->nev) && (k < SIM_EVENTS) && (nd->ev[k].time < until); k++) {
+                if ((nd->ev[k].type == SIM_MSG_SIGNAL) && (nd->ev[k].period != 0)) {
+                    event e = nd->ev[k];
+                    e.time += e.period;
+                    nd->ev[k].period = 0;
+                    add_event(batch[i], &e);
+                }
+            }
+            run_node(batch[i], until);
+        }
+        for (i=0; i<n; i++) {
+            wait_sleep(batch[i]);
+        }
+        for (i=0; i<n; i++) {
+            heap_push(batch[i]);
+        }
+
+        rounds++;
+        released += n;
+    }
+
+    /// Stop: the nodes save their file systems and send their statistics
+    for (i=0; i<num_nodes; i++) {
+        memset(&msg, 0, SIM_MSG_HEAD);
+        msg.type = SIM_MSG_STOP;
+        msg.time = end;
+        send_msg(&nodes[i], &msg);
+    }
+    for (i=0; i<num_nodes; i++) {
+        while (recv_msg(&nodes[i], &msg) == 0) {
+            if (msg.type == SIM_MSG_STATS) {
+                memcpy(&nodes[i].stats, msg.data, sizeof(sim_stats));
+                nodes[i].gotstats = 1;
+            }
+        }
+        close(nodes[i].fd);
+        waitpid(nodes[i].pid, NULL, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    report(end, (t1.tv_sec - t0.tv_sec) + ((t1.tv_nsec - t0.tv_nsec) / 1e9), rounds, released);
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*  Host-side decoder for the OpenTag kernel trace
+  *
+  * Reads the contents of ISF_ID(kernel_trace), as written by sys_trace_export()
+  * and read back over ALP/MPipe, and prints one line per event with the time
+  * (in GPTIM ticks) since the oldest record.  The input is the raw file data:
+  * a big-endian record count, then 4 byte records, oldest first:
+  *     [event id] [argument] [delta ticks, big-endian 16 bit]
+  *
+  * Build:  gcc -o trace_decode trace_decode.c
+  * Usage:  trace_decode [file]     (reads stdin without a file argument)
+  */
+
+#include <stdio.h>
+
+
+static const char* event_name[] = {
+    "null", "TASK", "TXCSMA", "BSCAN", "FRX", "FTX", "BTX", "MPRX", "DIALOG",
+    "RESP"
+};
+
+static const char* task_name[] = {
+    "idle", "processing", "radio", "session", "hold"
+};
+
+
+
+int main(int argc, char** argv) {
+    FILE*           in = stdin;
+    unsigned char   rec[4];
+    unsigned long   time = 0;
+    unsigned int    count;
+    int             first = 1;
+
+    if (argc > 1) {
+        in = fopen(argv[1], "rb");
+        if (in == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    if (fread(rec, 1, 2, in) != 2) {
+        fprintf(stderr, "trace_decode: no data\n");
+        return 1;
+    }
+    count = (rec[0] << 8) | rec[1];
+    printf("# %u events traced since last clear\n", count);
+    printf("#    ticks  delta  event       arg\n");
+
+    while (fread(rec, 1, 4, in) == 4) {
+        unsigned int id    = rec[0];
+        unsigned int arg   = rec[1];
+        unsigned int delta = (rec[2] << 8) | rec[3];
+
+        /// The delta of the oldest record refers to a record that was
+        /// overwritten, so the timeline starts at 0.
+        if (first) {
+            delta = 0;
+            first = 0;
+        }
+        time += delta;
+        printf("%10lu %6u  ", time, delta);
+
+        if (id >= 0x80) {
+            printf("USER+%-5u  %u\n", id-0x80, arg);
+        }
+        else if (id < (sizeof(event_name)/sizeof(char*))) {
+            printf("%-10s  ", event_name[id]);
+            if ((id == 1) && (arg < (sizeof(task_name)/sizeof(char*)))) {
+                printf("%s\n", task_name[arg]);
+            }
+            else {
+                printf("%d\n", (signed char)arg);
+            }
+        }
+        else {
+            printf("?%-9u  %u\n", id, arg);
+        }
+    }
+
+    if (in != stdin) {
+        fclose(in);
+    }
+    return 0;
+}
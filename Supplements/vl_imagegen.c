@@ -0,0 +1,98 @@
+/*  Factory image generator for the X2 veelite cores (OT_FEATURE_VLFACTORY)
+  *
+  * Lays out the stock files of an app the way a fresh format leaves VWORM:
+  * each block starts with its stock array, and the rest of it is erased.
+  * After a format, the X2 block table maps primary block i to page i, so this
+  * is also the physical image of the file system pages.  The output is the C
+  * source of vworm_factory_image[] (in the .vl_factory section), its length
+  * in words and its CRC16, which vworm_factory() programs and checks.  The
+  * erased words at the end are left out.  The stock arrays are in the endian
+  * of the target already, and the words are written little-endian, as on all
+  * of the X2 platforms.
+  *
+  * The stock arrays come from the data_default.c of the app, which is
+  * included here as the app's main.c does.  The tool is built on the host, so
+  * the app's code directory must select the POSIX board.  Link the output
+  * into the MCU build of the same app.
+  *
+  * Build:  gcc -std=gnu99 -fgnu89-inline -I <app code, with BOARD_POSIX>
+  *             -I otlib -I otkernel -I board -I otplatform/posix
+  *             -o vl_imagegen vl_imagegen.c otlib/crc16.c
+  * Usage:  vl_imagegen > vl_factory.c
+  */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "OTAPI.h"
+#include "crc16.h"
+#include "data_default.c"
+
+
+#define IMAGE_BYTES     (ISF_START_VADDR + ISF_TOTAL_BYTES)
+
+static ot_u8 image[IMAGE_BYTES];
+
+
+/// crc16.c ends its streams on this, from OT_utils.c, which the tool does not
+/// link (it pulls in the platform)
+void otutils_null(void) { }
+
+
+
+static int place(const char* name, unsigned int base, const ot_u8* stock,
+                 unsigned int bytes, unsigned int total) {
+    if (bytes > total) {
+        fprintf(stderr, "%s: %u stock bytes do not fit in %u\n", name, bytes, total);
+        return -1;
+    }
+    memcpy(&image[base], stock, bytes);
+    return 0;
+}
+
+
+
+int main(void) {
+    unsigned int    words;
+    unsigned int    i;
+    ot_u16          crc;
+
+    memset(image, 0xFF, sizeof(image));
+    if ((place("overhead", OVERHEAD_START_VADDR, overhead_files, sizeof(overhead_files), OVERHEAD_TOTAL_BYTES) != 0) ||
+        (place("isfs", ISFS_START_VADDR, isfs_stock_codes, sizeof(isfs_stock_codes), ISFS_TOTAL_BYTES) != 0) ||
+#       if (GFB_TOTAL_BYTES > 0)
+        (place("gfb", GFB_START_VADDR, gfb_stock_files, sizeof(gfb_stock_files), GFB_TOTAL_BYTES) != 0) ||
+#       endif
+        (place("isf", ISF_START_VADDR, isf_stock_files, sizeof(isf_stock_files), ISF_TOTAL_BYTES) != 0)) {
+        return 1;
+    }
+
+    /// The image stops at the last programmed word
+    for (words=(IMAGE_BYTES/2); words>0; words--) {
+        if ((image[words*2-2] != 0xFF) || (image[words*2-1] != 0xFF)) {
+            break;
+        }
+    }
+    crc = crc_calc_block((ot_int)(words*2), image);
+
+    printf("/* Factory image of the file system, made by vl_imagegen: do not edit */\n\n");
+    printf("#include \"OT_types.h\"\n");
+    printf("#include \"OT_config.h\"\n");
+    printf("#include \"veelite_core.h\"\n\n");
+    printf("#if (OT_FEATURE(VLFACTORY) == ENABLED)\n\n");
+    printf("#if (CC_SUPPORT == GCC)\n");
+    printf("__attribute__((section(\".vl_factory\")))\n");
+    printf("#elif (CC_SUPPORT == CL430)\n");
+    printf("#pragma DATA_SECTION(vworm_factory_image, \".vl_factory\")\n");
+    printf("#endif\n");
+    printf("const ot_u16 vworm_factory_image[] = {");
+    for (i=0; i<words; i++) {
+        printf("%s0x%04X,", ((i & 7) == 0) ? "\n    " : " ", image[i*2] | (image[i*2+1] << 8));
+    }
+    printf("\n};\n\n");
+    printf("const ot_uint vworm_factory_words = %u;\n", words);
+    printf("const ot_u16 vworm_factory_crc = 0x%04X;\n\n", crc);
+    printf("#endif\n");
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+/* Copyright 2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /apps/bench_latency/code/main.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      Request/response latency, from a host through a gateway
+  *
+  * This Application Does:
+  * <LI> Runs a gateway that takes dialogs from a host over MPipe (ALP
+  *      System API: new_session, then dialog_script)                    </LI>
+  * <LI> Traces the stages of each dialog with the kernel trace: MPipe RX,
+  *      dialog start, request TX, response RX, response accepted        </LI>
+  * <LI> Sends the stage records of each dialog to the host with its first
+  *      response, for the host tool in /Supplements/lat_bench.c          </LI>
+  * <LI> Holds trig1 high from MPipe RX to the first response, and the
+  *      trace toggles trig2 on each record, for a scope                  </LI>
+  *
+  * The host times the whole round trip.  The gateway times its own stages in
+  * GPTIM ticks, so the host can split the round trip into the host and MPipe
+  * part, the gateway processing, and the air plus the responder.  The
+  * responders are any nodes that scan the request channel and answer the
+  * query, e.g. Demo_Opmode.
+  *
+  * This Application Requires:
+  * <LI> OT_FEATURE(TRACE), for the stage records                        </LI>
+  * <LI> OT_FEATURE(MPIPE_CALLBACKS) & ALP, for the requests from the host</LI>
+  * <LI> Gateway build                                                   </LI>
+  * <LI> MPipe RX & Logger                                               </LI>
+  *
+  * Currently Supported Boards:
+  * <LI> All boards that run Demo_Opmode, and BOARD_POSIX                </LI>
+  *
+  * @note On POSIX, MPipe RX is on stdin, so the host tool runs the gateway
+  *       as its child.  See _readme.txt.
+  ******************************************************************************
+  */
+
+#include "OTAPI.h"
+#include "OT_platform.h"
+
+#include "m2_transport.h"
+#include "mpipe.h"
+#include "ndef.h"
+#include "system_native.h"
+
+#if (OT_FEATURE(TRACE) != ENABLED)
+#   error "bench_latency needs OT_FEATURE_TRACE ENABLED (app_config.h)"
+#endif
+#if (OT_FEATURE(MPIPE_CALLBACKS) != ENABLED)
+#   error "bench_latency needs OT_FEATURE_MPIPE_CALLBACKS ENABLED (app_config.h)"
+#endif
+#if (M2_FEATURE(GATEWAY) != ENABLED)
+#   error "bench_latency needs a Gateway build"
+#endif
+
+
+
+
+/** Latency Records <BR>
+  * ========================================================================<BR>
+  * A dialog starts with a new_session record from the host (ALP 0x81, cmd 2).
+  * It clears the trace, so the trace holds only the stages of this dialog.
+  * The LAT message has the trace records that are not kernel task records,
+  * oldest first, as two big-endian words each: (id << 8) | arg, and the
+  * GPTIM ticks since the previous record in the message.  The ticks of the
+  * task records are added to the next record, so no time is lost.
+  */
+#define LAT_ALPID           0x81
+#define LAT_NEWSESSION      2
+#define LAT_MAXRECORDS      60
+
+typedef struct {
+    ot_bool open;
+    ot_u8   data[LAT_MAXRECORDS*4];
+} lat_struct;
+
+lat_struct lat;
+
+
+
+
+/** Dialog Stages <BR>
+  * ========================================================================<BR>
+  */
+void app_rxdone(ot_int code) {
+/// MPipe RX done: a new_session record at the front of dir_in starts a new
+/// dialog (a dialog that got no response is dropped)
+    ot_u8* record = dir_in.getcursor;
+
+    if ((record == dir_in.front) && (record[4] == LAT_ALPID) && \
+        ((record[5] & 7) == LAT_NEWSESSION)) {
+        sys_trace_clear();
+        sys.trace.last  = platform_get_gptim();
+        lat.open        = True;
+        platform_trig1_high();
+    }
+    otapi_ndef_proc(code);
+}
+
+
+void sub_lat_report() {
+/// Copies the stage records into the LAT message, and sends it
+    ot_u16  put     = sys.trace.put;
+    ot_u16  i       = (put > SYS_TRACE_SIZE) ? (put - SYS_TRACE_SIZE) : 0;
+    ot_u16  ticks   = 0;
+    ot_int  length  = 0;
+
+    for (; (i != put) && (length < sizeof(lat.data)); i++) {
+        ot_u16* rec = sys.trace.ring[i & (SYS_TRACE_SIZE-1)];
+        ticks      += rec[1];
+        if ((rec[0] >> 8) != SYS_TRACE_TASK) {
+            lat.data[length++]  = (ot_u8)(rec[0] >> 8);
+            lat.data[length++]  = (ot_u8)rec[0];
+            lat.data[length++]  = (ot_u8)(ticks >> 8);
+            lat.data[length++]  = (ot_u8)ticks;
+            ticks               = 0;
+        }
+    }
+    otapi_log_msg(MSG_raw, 3, length, (ot_u8*)"LAT", lat.data);
+}
+
+
+ot_bool app_std_response(id_tmpl* id, ot_int payload_length, ot_u8* payload) {
+/// The first response ends the dialog for the benchmark.  There is one LAT
+/// message per dialog, because MPipe TX is one packet at a time.
+    if (lat.open) {
+        lat.open = False;
+        platform_trig1_low();
+        sub_lat_report();
+    }
+    return False;
+}
+
+
+
+
+/** Application Main <BR>
+  * ========================================================================<BR>
+  */
+void app_init() {
+    lat.open = False;
+    platform_trig1_low();
+
+    m2qp.signal.std_response = &app_std_response;
+
+    mpipe_setsig_txdone(&otapi_ndef_idle);
+    mpipe_setsig_rxdone(&app_rxdone);
+    otapi_ndef_idle(0);
+}
+
+
+void main(void) {
+    ///1. Standard Power-on routine (Clocks, Timers, IRQ's, etc)
+    ///2. Standard OpenTag Init
+    platform_poweron();
+    platform_init_OT();
+
+    ///3. Listen to MPipe, and let the kernel run the dialogs
+    app_init();
+    otapi_log_msg(MSG_utf8, 6, 26, (ot_u8*)"SYS_ON", (ot_u8*)"System on and Mpipe active");
+
+    platform_ot_preempt();
+    while (1) {
+        SLEEP_MCU();
+    }
+}
+
+
+
+
+/** Default File data <BR>
+  * ========================================================================<BR>
+  */
+#include "data_default.c"
@@ -0,0 +1,774 @@
+/* Copyright 2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /apps/bench_otlib/code/main.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      Microbenchmarks for the OTlib hot paths
+  *
+  * This Application Does:
+  * <LI> Times CRC16, Mode 2 encode/decode, AES, Veelite load/store, vworm
+  *      rewrites, queue operations, session allocation, M2QP comparisons
+  *      and M2NP routing of a query frame                               </LI>
+  * <LI> Reports each result as a CSV record over MPipe (see _readme.txt) </LI>
+  * <LI> Reports the worst-case radio ISR latency added by other ISRs     </LI>
+  * <LI> On POSIX, replays a sniffer capture through the RX parsing
+  *      pipeline, and reports its throughput and per-stage time        </LI>
+  * <LI> Then starts the kernel, like any other app                      </LI>
+  *
+  * The benchmarks run before the kernel is started, with GPTIM pushed out of
+  * the way, so nothing else runs during a measurement.  Each one doubles its
+  * iteration count until the run takes at least BENCH_MIN_UNITS of the
+  * platform_get_cycles() clock.
+  *
+  * This Application Requires:
+  * <LI> OT_FEATURE(PROFILER), for platform_get_cycles()                 </LI>
+  * <LI> OT_FEATURE(DLL_SECURITY), so that AES is built                  </LI>
+  * <LI> MPipe & Logger                                                  </LI>
+  *
+  * Currently Supported Boards:
+  * <LI> All boards that run Demo_Opmode, and BOARD_POSIX                </LI>
+  *
+  * @note The Mode 2 decode benchmark needs a radio driver that can loop TX
+  *       data back into RX, so it only runs on POSIX.
+  ******************************************************************************
+  */
+
+#include "OTAPI.h"
+#include "OT_platform.h"
+
+#include "m2_encode.h"
+#include "m2_transport.h"
+#include "m2_network.h"
+#include "session.h"
+#include "crc16.h"
+#include "crypto_aes128.h"
+#include "radio.h"
+#include "system_native.h"
+#include "veelite.h"
+#include "veelite_core.h"
+
+#if defined(PLATFORM_POSIX)
+#   include <signal.h>
+#   include <stdio.h>
+#   include <stdlib.h>
+#   include <unistd.h>
+#   include "radio_POSIX.h"
+#endif
+
+#if (OT_FEATURE(PROFILER) != ENABLED)
+#   error "bench_otlib needs OT_FEATURE_PROFILER ENABLED (app_config.h)"
+#endif
+
+
+
+
+/** Benchmark Clock <BR>
+  * ========================================================================<BR>
+  * The rate of platform_get_cycles() (PLATFORM_CYCLES_HZ) is different on
+  * each platform.  It is sent in the header record, so the host can turn
+  * units into time.
+  * <LI> POSIX: nanoseconds of CLOCK_MONOTONIC                            </LI>
+  * <LI> MSP430/CC430: GPTIM, a 16 bit timer (PLATFORM_GPTIM_CLK)         </LI>
+  * <LI> Cortex-M: the DWT cycle counter, at the core clock               </LI>
+  */
+#define BENCH_CYCLES_HZ         PLATFORM_CYCLES_HZ
+#define BENCH_CYCLES_MASK       PLATFORM_CYCLES_MASK
+
+/// A run is long enough at 1/4 second.  On GPTIM that is only 256 units, so
+/// results there are good to about 0.5%.
+#define BENCH_MIN_UNITS         (ot_u32)(BENCH_CYCLES_HZ / 4)
+#define BENCH_MAX_ITERS         (ot_u32)(1L << 20)
+#define BENCH_FORMAT            2
+
+
+
+
+/** Benchmark Data <BR>
+  * ========================================================================<BR>
+  */
+typedef void (*bench_fn)(ot_int);
+
+typedef struct {
+    ot_u32  key[4];
+    ot_u32  expkey[44];
+    ot_u32  block[4];
+    ot_u8   buf[256];
+    ot_u8   frame[M2_PARAM_MAXFRAME];
+    ot_u8   qmask[1];
+    ot_u8   qvalue[1];
+    ot_int  frame_len;
+    ot_u16  result;
+    vlFILE* fp;
+} bench_struct;
+
+bench_struct bench;
+
+ot_int bench_count;
+
+
+
+
+/** Benchmarks <BR>
+  * ========================================================================<BR>
+  * Each takes one parameter (usually a length in bytes) and does one
+  * operation.  The call through bench_fn is counted in every result, so the
+  * "null" benchmark is the overhead to subtract.
+  */
+void bench_null(ot_int param) {
+}
+
+void bench_crc_block(ot_int param) {
+    crc_calc_block(param, bench.buf);
+}
+
+void bench_timeout_calc(ot_int param) {
+/// Decode the first param timeout codes, as done for each scan and dialog
+    ot_int i;
+    for (i=0; i<param; i++) {
+        bench.result += otutils_calc_timeout((ot_u8)i);
+    }
+}
+
+void bench_timeout_encode(ot_int param) {
+/// Encode param tick counts, spread over the 16 bit range
+    ot_int i;
+    for (i=0; i<param; i++) {
+        bench.result += otutils_encode_timeout((ot_u16)i * 511);
+    }
+}
+
+void bench_q_byte(ot_int param) {
+/// Byte-wise queue traffic, as done by the protocol parsers
+    ot_int i;
+    q_empty(&txq);
+    for (i=0; i<param; i++) {
+        q_writebyte(&txq, (ot_u8)i);
+    }
+    for (i=0; i<param; i++) {
+        q_readbyte(&txq);
+    }
+}
+
+void bench_q_string(ot_int param) {
+    q_empty(&txq);
+    q_writestring(&txq, bench.buf, param);
+    q_readstring(&txq, &bench.buf[128], param);
+}
+
+void bench_aes_keyschedule(ot_int param) {
+    AES_keyschedule_enc(bench.key, bench.expkey);
+}
+
+void bench_aes_encrypt(ot_int param) {
+    AES_encrypt(bench.block, bench.block, bench.expkey);
+}
+
+void sub_em2_newframe(ot_int param) {
+/// A frame of param bytes (length byte and CRC included) at txq.front
+    txq.front[0]                = (ot_u8)param;
+    txq.getcursor               = txq.front;
+    txq.putcursor               = &txq.front[param-2];
+    txq.length                  = param-2;
+    txq.options.ubyte[UPPER]    = 1;
+    txq.options.ubyte[LOWER]    = 0;
+    em2_encode_newpacket();
+    em2_encode_newframe();
+}
+
+void bench_em2_encode(ot_int param) {
+/// The driver FIFO is flushed between bursts, so only the encoder and the
+/// FIFO writes are timed, not the air.
+    sub_em2_newframe(param);
+    do {
+        em2_encode_data();
+        radio_flush_tx();
+    } while (em2_remaining_bytes() > 0);
+}
+
+#if defined(PLATFORM_POSIX)
+void bench_em2_decode(ot_int param) {
+/// The encoded frame is left in the driver TX buffer by the setup, and each
+/// run copies it into the RX buffer.
+    radio_posix_loopback();
+    q_empty(&rxq);
+    em2_decode_newpacket();
+    em2_decode_newframe();
+    do {
+        em2_decode_data();
+    } while ((em2_remaining_bytes() > 0) && radio_rxopen());
+    crc_check();
+}
+#endif
+
+void bench_vl_open(ot_int param) {
+    vl_close( ISF_open_su((ot_u8)param) );
+}
+
+void bench_vl_load(ot_int param) {
+    vl_load(bench.fp, param, bench.buf);
+}
+
+void bench_vl_store(ot_int param) {
+/// Stores the same data each time, so no flash word changes
+    vl_store(bench.fp, param, bench.buf);
+}
+
+void bench_vl_store_flip(ot_int param) {
+/// Every word changes between 0x0000 and 0xFFFF, which is the worst case for
+/// vworm: on the X2 cores it forces recombination of the blocks.
+    bench.buf[128] ^= 0xFF;
+    platform_memset(&bench.buf[129], bench.buf[128], param-1);
+    vl_store(bench.fp, param, &bench.buf[128]);
+}
+
+void bench_session_new(ot_int param) {
+    session_new(0, M2_NETSTATE_UNASSOC, 0);
+    session_pop();
+}
+
+void bench_isf_comp(ot_int param) {
+/// param = 0: the result is in the query cache, param = 1: file data changed
+/// since the last run, so the comparison is done on the file.
+    vl_writestamp  += param;
+    rxq.getcursor   = rxq.front;
+    m2qp_isf_comp(False, NULL);
+}
+
+void bench_route_ff(ot_int param) {
+/// network_route_ff() works in place on rxq (it strips the CRC), so each run
+/// starts with a fresh copy of the saved frame.
+    m2session session;
+    session.netstate    = M2_NETSTATE_UNASSOC;
+    session.channel     = 0;
+    session.counter     = 0;
+    q_empty(&rxq);
+    platform_memcpy(rxq.front, bench.frame, bench.frame_len);
+    rxq.length          = bench.frame_len;
+    rxq.putcursor       = &rxq.front[bench.frame_len];
+    network_route_ff(&session);
+}
+
+
+
+
+/** Setup & Reporting Routines <BR>
+  * ========================================================================<BR>
+  */
+ot_int sub_u32dec(ot_u8* dst, ot_u32 value) {
+/// Writes value in decimal, returns the number of characters.  The OTlib
+/// otutils_int2dec() is only 16 bits on MSP430.
+    ot_u8   digits[10];
+    ot_int  i = 0;
+    ot_int  n = 0;
+
+    do {
+        digits[i++] = (ot_u8)('0' + (value % 10));
+        value      /= 10;
+    } while (value != 0);
+
+    while (i > 0) {
+        dst[n++] = digits[--i];
+    }
+    return n;
+}
+
+
+void sub_bench_report(const char* label, const char* name, ot_u32* fields, ot_int num_fields) {
+/// One CSV record per log message: name, then the fields
+    ot_u8   line[96];
+    ot_int  label_len;
+    ot_int  length = 0;
+    ot_int  i;
+
+    for (label_len=0; label[label_len]!=0; label_len++);
+    while (*name != 0) {
+        line[length++] = (ot_u8)*name++;
+    }
+    for (i=0; i<num_fields; i++) {
+        line[length++]  = ',';
+        length         += sub_u32dec(&line[length], fields[i]);
+    }
+
+    otapi_log_msg(MSG_utf8, label_len, length, (ot_u8*)label, line);
+    mpipe_wait();
+}
+
+
+void sub_bench_run(const char* name, bench_fn fn, ot_int param, ot_int bytes) {
+/// Doubles the iterations until the run is long enough.  The first call is
+/// not timed, so that caches (query cache, ISF mirror, etc) are warm.
+    ot_u32 fields[4];
+    ot_u32 iters;
+    ot_u32 mark;
+    ot_u32 elapsed;
+    ot_u32 i;
+
+    fn(param);
+    iters = 1;
+
+    while (1) {
+        platform_flush_gptim();
+        mark = platform_get_cycles();
+        for (i=0; i<iters; i++) {
+            fn(param);
+        }
+        elapsed = (platform_get_cycles() - mark) & BENCH_CYCLES_MASK;
+
+        if ((elapsed >= BENCH_MIN_UNITS) || (iters >= BENCH_MAX_ITERS)) {
+            break;
+        }
+        iters <<= 1;
+    }
+
+    fields[0] = (ot_u32)param;
+    fields[1] = iters;
+    fields[2] = elapsed;
+    fields[3] = (ot_u32)bytes;
+    sub_bench_report("BENCH", name, fields, 4);
+    bench_count++;
+}
+
+
+void sub_save_query() {
+/// The query from Demo_Opmode (sensor protocol search on the protocol list),
+/// built with the C API and saved as it would be received: with two bytes
+/// of CRC on the end, which network_route_ff() strips.
+    {   session_tmpl session;
+        session.channel     = 0x00;
+        session.flagmask    = 0;
+        session.flags       = 0;
+        session.subnet      = 0;
+        session.subnetmask  = 0;
+        session.timeout     = 16;
+        otapi_new_session(&session);
+    }
+    {   routing_tmpl routing;
+        routing.hop_code = 0;
+        otapi_open_request(ADDR_anycast, &routing);
+    }
+    {   ot_u8 status;
+        command_tmpl command;
+        command.opcode      = (ot_u8)CMD_collect_file_on_file;
+        command.type        = (ot_u8)CMDTYPE_na2p_request;
+        command.extension   = (ot_u8)CMDEXT_none;
+        otapi_put_command_tmpl(&status, &command);
+    }
+    {   ot_u8 status;
+        dialog_tmpl dialog;
+        dialog.channels = 0;
+        dialog.timeout  = 128;
+        otapi_put_dialog_tmpl(&status, &dialog);
+    }
+    {   ot_u8 status;
+        query_tmpl query;
+        query.code      = M2QC_COR_SEARCH | 1;
+        query.mask      = NULL;
+        query.length    = 1;
+        query.value     = bench.qvalue;
+        otapi_put_query_tmpl(&status, &query);
+    }
+    {   ot_u8 status;
+        isfcomp_tmpl isfcomp;
+        isfcomp.is_series   = False;
+        isfcomp.isf_id      = ISF_ID(protocol_list);
+        isfcomp.offset      = 0;
+        otapi_put_isf_comp(&status, &isfcomp);
+    }
+    {   ot_u8 status;
+        isfcall_tmpl isfcall;
+        isfcall.is_series   = False;
+        isfcall.isf_id      = ISF_ID(sensor_list);
+        isfcall.max_return  = 32;
+        isfcall.offset      = 0;
+        otapi_put_isf_call(&status, &isfcall);
+    }
+    otapi_close_request();
+
+    bench.frame_len = txq.front[0];
+    platform_memcpy(bench.frame, txq.front, bench.frame_len-2);
+    bench.frame[bench.frame_len-2]  = 0;
+    bench.frame[bench.frame_len-1]  = 0;
+
+    session_init();
+}
+
+
+void bench_all() {
+    ot_u32 fields[3];
+    ot_int i;
+
+    /// Header record: format, clock rate, clock mask
+    fields[0] = BENCH_FORMAT;
+    fields[1] = BENCH_CYCLES_HZ;
+    fields[2] = BENCH_CYCLES_MASK;
+    sub_bench_report("BHDR", "bench_otlib", fields, 3);
+
+    /// Keep GPTIM (and so the kernel) quiet during the measurements
+    platform_set_gptim(0xFFFF);
+
+    for (i=0; i<256; i++) {
+        bench.buf[i] = (ot_u8)i;
+    }
+    for (i=0; i<4; i++) {
+        bench.key[i]    = 0x01234567 * (i+1);
+        bench.block[i]  = 0x89ABCDEF * (i+1);
+    }
+    bench.qmask[0]  = 0xFF;
+    bench.qvalue[0] = 0x02;     // sensor protocol id
+
+    sub_bench_run("null",             &bench_null,            0,      0);
+
+    sub_bench_run("crc_block",        &bench_crc_block,       16,     16);
+    sub_bench_run("crc_block",        &bench_crc_block,       64,     64);
+    sub_bench_run("crc_block",        &bench_crc_block,       255,    255);
+
+    sub_bench_run("timeout_calc",     &bench_timeout_calc,    128,    0);
+    sub_bench_run("timeout_encode",   &bench_timeout_encode,  128,    0);
+
+    sub_bench_run("q_byte",           &bench_q_byte,          64,     64);
+    sub_bench_run("q_string",         &bench_q_string,        64,     64);
+
+    sub_bench_run("aes_keyschedule",  &bench_aes_keyschedule, 0,      0);
+    sub_bench_run("aes_encrypt",      &bench_aes_encrypt,     16,     16);
+
+    /// Mode 2 frames: shortest useful, typical, longest.  With a SW PN9 codec,
+    /// build once more with EM2_FUSED DISABLED to get the staged codec.
+    radio_idle();
+    sub_bench_run("em2_encode",       &bench_em2_encode,      16,     16);
+    sub_bench_run("em2_encode",       &bench_em2_encode,      64,     64);
+    sub_bench_run("em2_encode",       &bench_em2_encode,      M2_PARAM_MAXFRAME, M2_PARAM_MAXFRAME);
+#   if defined(PLATFORM_POSIX)
+    {   static const ot_int dec_len[3] = { 16, 64, M2_PARAM_MAXFRAME };
+        for (i=0; i<3; i++) {
+            sub_em2_newframe(dec_len[i]);
+            do {
+                em2_encode_data();
+            } while (em2_remaining_bytes() > 0);
+            sub_bench_run("em2_decode", &bench_em2_decode, dec_len[i], dec_len[i]);
+            radio_flush_tx();
+        }
+    }
+#   endif
+    radio_sleep();
+    q_empty(&txq);
+
+    /// Veelite, on device_features (48 bytes, not mirrored).  The flip
+    /// benchmark changes the file, so the original data is put back.
+    sub_bench_run("vl_open",          &bench_vl_open,         ISF_ID(device_features), 0);
+    bench.fp = ISF_open_su(ISF_ID(device_features));
+    if (bench.fp != NULL) {
+        vl_load(bench.fp, ISF_LEN(device_features), bench.buf);
+        bench.buf[128] = 0;
+        sub_bench_run("vl_load",      &bench_vl_load,         ISF_LEN(device_features), ISF_LEN(device_features));
+        sub_bench_run("vl_store",     &bench_vl_store,        ISF_LEN(device_features), ISF_LEN(device_features));
+        sub_bench_run("vl_store_flip",&bench_vl_store_flip,   ISF_LEN(device_features), ISF_LEN(device_features));
+        vl_store(bench.fp, ISF_LEN(device_features), bench.buf);
+        vl_close(bench.fp);
+    }
+
+    sub_bench_run("session_new",      &bench_session_new,     0,      0);
+    session_init();
+
+    /// M2QP comparison of the Demo_Opmode query, on the protocol list
+    m2qp.qtmpl.code     = M2QC_COR_SEARCH | 1;
+    m2qp.qtmpl.length   = 1;
+    m2qp.qtmpl.mask     = bench.qmask;
+    m2qp.qtmpl.value    = bench.qvalue;
+    q_empty(&rxq);
+    q_writebyte(&rxq, ISF_ID(protocol_list));
+    q_writebyte(&rxq, 0);
+    sub_bench_run("isf_comp",         &bench_isf_comp,        0,      0);
+    sub_bench_run("isf_comp",         &bench_isf_comp,        1,      0);
+
+    /// M2NP + M2QP routing of the whole query frame
+    sub_save_query();
+    sub_bench_run("route_ff",         &bench_route_ff,        bench.frame_len, bench.frame_len);
+
+    /// Put back what the benchmarks used, for the kernel
+    q_empty(&rxq);
+    q_empty(&txq);
+    session_init();
+
+    /// Radio hold-off of the ISRs that ran so far, which include the MPipe
+    /// TX of every record above: the measured worst-case radio ISR latency
+    /// that they add (SYS_PROFILE_RFWAIT, see system.h)
+    fields[0] = (ot_u32)sys.profile[SYS_PROFILE_RFWAIT].count;
+    fields[1] = sys.profile[SYS_PROFILE_RFWAIT].max;
+    fields[2] = sys.profile[SYS_PROFILE_RFWAIT].total;
+    sub_bench_report("BWAIT", "rf_wait", fields, 3);
+
+    fields[0] = (ot_u32)bench_count;
+    sub_bench_report("BEND", "bench_otlib", fields, 1);
+}
+
+
+
+
+/** Capture Replay (POSIX only) <BR>
+  * ========================================================================<BR>
+  * With OT_REPLAY set to a file of MPipe output from a sniffer (see
+  * OT_FEATURE_SNIFFER in system.h), the frames of the capture are routed one
+  * after the other by network_route_ff(), which parses them with M2QP, runs
+  * their queries and builds the responses, as the kernel does for a request
+  * that it receives.  The file system is the image of this node
+  * (ot_node_<OT_NODE>.vworm), so it can be populated beforehand to match the
+  * network that was captured.  Frames with a CRC error, clipped frames and
+  * messages with a bad MPipe CRC are left out.
+  *
+  * A pass routes all of the frames.  The passes double until the run is
+  * long enough, like the benchmarks, and the whole measurement is done
+  * OT_REPLAY_LOOPS times (default 1), so a regression check can take the
+  * best or the median of the runs.
+  */
+#if defined(PLATFORM_POSIX)
+
+#define REPLAY_BYTES    (256*1024)
+#define REPLAY_FILEMAX  (1024*1024)
+
+typedef struct {
+    ot_u32  frames;
+    ot_u32  skipped;
+    ot_u32  bytes;
+    ot_u32  length;
+    ot_u8   data[REPLAY_BYTES];     // [channel][frame], frame[0] = length
+} replay_struct;
+
+replay_struct replay;
+
+
+void sub_replay_put(ot_u8* payload, ot_int length) {
+/// Capture record payload: stamp (4), channel, RSSI, status, frame
+    ot_u8* frame = &payload[7];
+    ot_int flen  = length - 7;
+
+    if ((length < 7) || (payload[6] != 0) || (flen < 6) || (frame[0] != flen) || \
+        ((replay.length + 1 + flen) > REPLAY_BYTES)) {
+        replay.skipped++;
+        return;
+    }
+    replay.data[replay.length] = payload[4];
+    platform_memcpy(&replay.data[replay.length+1], frame, flen);
+    replay.length  += 1 + flen;
+    replay.bytes   += flen;
+    replay.frames++;
+}
+
+
+ot_bool sub_replay_load(const char* path) {
+/// An MPipe message is a run of NDEF records, from the one with MB to the
+/// one with ME, then the sequence and CRC16 footer.
+    static ot_u8 file[REPLAY_FILEMAX];
+    FILE*   in;
+    ot_u32  total;
+    ot_u32  i = 0;
+
+    in = fopen(path, "rb");
+    if (in == NULL) {
+        return False;
+    }
+    total = (ot_u32)fread(file, 1, sizeof(file), in);
+    fclose(in);
+
+    while ((i + 10) <= total) {
+        ot_u32 end = i;
+
+        if (((file[i] & 0xBF) == 0x9D) && (file[i+1] == 0) && (file[i+3] == 2)) {
+            while ((end + 6) <= total) {
+                ot_u8 flags = file[end];
+                end += 6 + file[end+2];
+                if (flags & 0x40) {
+                    break;
+                }
+                if (((end + 6) > total) || ((file[end] & 0x3F) != 0x1D)) {
+                    end = total;
+                    break;
+                }
+            }
+        }
+        if ((end == i) || ((end + 4) > total) || \
+            (crc_calc_block((ot_int)(end + 2 - i), &file[i]) != \
+            (((ot_u16)file[end+2] << 8) | file[end+3]))) {
+            i++;
+            continue;
+        }
+
+        for (; i<end; i+=6+file[i+2]) {
+            if ((file[i+4] == 0x04) && (file[i+5] == DATA_m2frame)) {
+                sub_replay_put(&file[i+6], file[i+2]);
+            }
+        }
+        i = end + 4;
+    }
+    return True;
+}
+
+
+void sub_replay_pass(ot_u32* fields) {
+/// Routes each frame in a fresh session, as the kernel would on RX.  With
+/// fields, the responses are counted: fields[0] = responses, [1] = filtered
+/// (negative score or no response), [2] = longest response in txq, [3] =
+/// response bytes.
+    ot_u32 i;
+
+    for (i=0; i<replay.length; i+=1+replay.data[i+1]) {
+        m2session   session;
+        ot_int      score;
+        ot_int      flen = replay.data[i+1];
+
+        session.netstate    = M2_NETSTATE_UNASSOC;
+        session.channel     = replay.data[i];
+        session.counter     = 0;
+        q_empty(&rxq);
+        platform_memcpy(rxq.front, &replay.data[i+1], flen);
+        rxq.length          = flen;
+        rxq.putcursor       = &rxq.front[flen];
+        q_empty(&txq);
+        score               = network_route_ff(&session);
+
+        if (fields != NULL) {
+            if ((score < 0) || (session.netstate & M2_NETFLAG_SCRAP)) {
+                fields[1]++;
+            }
+            else {
+                fields[0]++;
+                fields[3] += txq.length;
+                if (txq.length > fields[2]) {
+                    fields[2] = txq.length;
+                }
+            }
+        }
+    }
+}
+
+
+void sub_replay_stage(const char* name, ot_u8 id) {
+    ot_u32 fields[3];
+    fields[0] = sys.profile[id].count;
+    fields[1] = sys.profile[id].total;
+    fields[2] = sys.profile[id].max;
+    sub_bench_report("BSTAGE", name, fields, 3);
+}
+
+
+void bench_replay() {
+    static const char* bad_file = "replay,no file";
+    ot_u32  fields[5];
+    ot_u32  passes;
+    ot_u32  mark;
+    ot_u32  elapsed;
+    ot_u32  i;
+    char*   path;
+    ot_int  loops;
+
+    path = getenv("OT_REPLAY");
+    if (path == NULL) {
+        return;
+    }
+    if (sub_replay_load(path) == False) {
+        otapi_log_msg(MSG_utf8, 5, 14, (ot_u8*)"BFAIL", (ot_u8*)bad_file);
+        mpipe_wait();
+        return;
+    }
+    loops = (getenv("OT_REPLAY_LOOPS") != NULL) ? atoi(getenv("OT_REPLAY_LOOPS")) : 1;
+
+    fields[0] = replay.frames;
+    fields[1] = replay.skipped;
+    fields[2] = replay.bytes;
+    sub_bench_report("BRHDR", "replay", fields, 3);
+    if (replay.frames == 0) {
+        return;
+    }
+
+    /// A pass that is not timed warms the caches, and counts the responses
+    platform_set_gptim(0xFFFF);
+    platform_memset((ot_u8*)fields, 0, sizeof(fields));
+    sub_replay_pass(fields);
+    fields[4] = txq.alloc;
+    sub_bench_report("BRUSE", "replay", fields, 5);
+
+    while (--loops >= 0) {
+        passes = 1;
+        while (1) {
+            sys_profile_clear();
+            platform_flush_gptim();
+            mark = platform_get_cycles();
+            for (i=0; i<passes; i++) {
+                sub_replay_pass(NULL);
+            }
+            elapsed = (platform_get_cycles() - mark) & BENCH_CYCLES_MASK;
+
+            if ((elapsed >= BENCH_MIN_UNITS) || (passes >= BENCH_MAX_ITERS)) {
+                break;
+            }
+            passes <<= 1;
+        }
+
+        fields[0] = replay.frames;
+        fields[1] = passes;
+        fields[2] = elapsed;
+        fields[3] = replay.bytes;
+        sub_bench_report("BREPLAY", "replay", fields, 4);
+        sub_replay_stage("m2qp", SYS_PROFILE_M2QP);
+        sub_replay_stage("query", SYS_PROFILE_QUERY);
+        sub_replay_stage("resp", SYS_PROFILE_RESP);
+    }
+
+    q_empty(&rxq);
+    q_empty(&txq);
+    session_init();
+}
+
+#endif
+
+
+
+
+/** User Applet and Button Management Routines <BR>
+  * ========================================================================<BR>
+  */
+void main(void) {
+    ///1. Standard Power-on routine (Clocks, Timers, IRQ's, etc)
+    ///2. Standard OpenTag Init
+    platform_poweron();
+    platform_init_OT();
+
+    ///3. Run the benchmarks, with the kernel not yet started
+    bench_all();
+#   if defined(PLATFORM_POSIX)
+    bench_replay();
+#   endif
+
+    ///4. On POSIX, exit the way a node is powered-down.  Elsewhere, let the
+    ///   kernel run, like any other app.
+#   if defined(PLATFORM_POSIX)
+        kill(getpid(), SIGTERM);
+#   endif
+    platform_ot_preempt();
+    while(1) {
+        SLEEP_MCU();
+    }
+}
+
+
+
+
+/** Default File data <BR>
+  * ========================================================================<BR>
+  */
+#include "data_default.c"
+
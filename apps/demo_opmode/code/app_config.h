@@ -71,27 +71,49 @@
 #define OT_PARAM_BUFFER_SIZE            1024                                // Typically, must be at least 512 bytes    
 #define OT_PARAM_WATCHDOG_PERIOD        16                                  // Number of ticks before exception, following expected event return time
 #define OT_PARAM_KERNEL_LIMIT           -1                                  // Maximum ticks between kernel calls (if<=0, no limit)
+#define OT_PARAM_RXPOOL                 0                                   // Response pool slots for gateways (M2_PARAM_MAXFRAME bytes each)
+#define OT_PARAM_TXPOOL                 0                                   // Staged TX frame slots for gateways (M2_PARAM_MAXFRAME bytes each)
+#define OT_PARAM_PROFILE                0                                   // Device profile: 0 = the role features here, 1 = endpoint, 2 = subcontroller, 3 = gateway
+#define OT_PARAM_BUFPROFILE             0                                   // Buffer layout: 0 = the options here, 1 = endpoint, 2 = gateway
+#define OT_PARAM_OTA_BLOCKS             256                                 // Most frames in an OTA update image (one bitmap bit each)
+#define OT_PARAM_VLLOGS                 1                                   // Log files that can be attached at once (see vllog.h)
+#define OT_PARAM_VLLOG_SEGS             4                                   // Segments per log file (the oldest is reclaimed whole)
+#define OT_PARAM_VSFLASH_LINES          4                                   // Serial flash read cache lines (see vsflash.h)
+#define OT_PARAM_VSFLASH_LINEBYTES      32                                  // Bytes per serial flash cache line (power of 2)
+#define OT_PARAM_VSFLASH_ERASES         8                                   // Serial flash sector erases that can wait in the queue
 
 #define OT_FEATURE(VAL)                 OT_FEATURE_##VAL
 #define OT_FEATURE_SERVER               ENABLED                             // "Server" is a build containing the OpenTag stack
 #define OT_FEATURE_CLIENT               (OT_FEATURE_SERVER != ENABLED)      // "Client" is a command console (typ. PC)
 #define OT_FEATURE_CAPI                 ENABLED                             // "otapi" C function usage in server-side apps
 #define OT_FEATURE_C_SERVER             (OT_FEATURE_CAPI)                   // "otapi" C function usage in server-side apps
-#define OT_FEATURE_DASHFORTH            NOT_AVAILABLE                       // DASHFORTH Applet VM (server-side), or JIT (client-side)
+#define OT_FEATURE_DASHFORTH            DISABLED                            // DASHFORTH Applet VM (server-side), ALP 0x05
 #define OT_FEATURE_LOGGER               ENABLED                             // Mpipe-based data logging & printing
 #define OT_FEATURE_ALP                  (ENABLED || (OT_FEATURE_CLIENT))    // Application Layer Protocol Support
 #define OT_FEATURE_ALPAPI               (ENABLED && (OT_FEATURE_ALP))       // Application Layer Protocol callable API's
 #define OT_FEATURE_MPIPE                ENABLED
+#define OT_FEATURE_TMS3705              DISABLED                            // TMS3705 LF reader driver (PaLFi master, MSP430F5)
+#define OT_FEATURE_MPIPE_DUPLEX         DISABLED                            // Separate dir_in, dir_out buffers (full duplex MPipe)
+#define OT_FEATURE_MPIPE_PORTS          DISABLED                            // UART and USB MPipes at once (needs OT_FEATURE_MPIPE_CALLBACKS)
+#define OT_FEATURE_RXQ_DOUBLE           DISABLED                            // Second RX frame buffer (rxq_next) for the radio
+#define OT_FEATURE_TXPIPE               DISABLED                            // Chain redundant TX copies in the radio driver
+#define OT_FEATURE_STATIC_DISPATCH      DISABLED                            // Direct calls at dispatch points the build fixes (see OT_config.h)
 #define OT_FEATURE_NDEF                 (OT_FEATURE_MPIPE)                  // NDEF wrapper for Messaging API
 #define OT_FEATURE_VEELITE              ENABLED                             // Veelite DASH7 File System
 #define OT_FEATURE_VLFPS                OT_PARAM_VLFPS
 #define OT_FEATURE_VLNVWRITE            ENABLED                             // File writes in Veelite
 #define OT_FEATURE_VLNEW                ENABLED                             // File create/delete in Veelite
 #define OT_FEATURE_VLRESTORE            DISABLED                            // File restore in Veelite
+#define OT_FEATURE_VLINDEX              ENABLED                             // RAM ID->header index for file opens
+#define OT_FEATURE_VLCRC                DISABLED                            // RAM-cached CRC16 checks of stock ISFs
+#define OT_FEATURE_VLSNAPSHOT           DISABLED                            // Veelite tables saved at shutdown for fast boot
+#define OT_FEATURE_VLFACTORY            DISABLED                            // Factory format from a precomputed image (see vworm_factory())
+#define OT_FEATURE_VLLAZYSYNC           DISABLED                            // Sync the ISF mirror to VWORM at Sleep and Off
+#define OT_FEATURE_VLSUMMARY            DISABLED                            // Byte summaries of stock ISFs, to reject queries unread
 #define OT_FEATURE_VL_SECURITY          NOT_AVAILABLE                       // AES128 on pre-shared key, for stored files
 #define OT_FEATURE_DLL_SECURITY         DISABLED                            // AES128 on pre-shared key, for data-link
-#define OT_FEATURE_NL_SECURITY          NOT_AVAILABLE                       // Network Layer Security & key exchange
-#define OT_FEATURE_SENSORS              NOT_AVAILABLE                       // (formal, spec-based sensor config)
+#define OT_FEATURE_NL_SECURITY          DISABLED                            // Network Layer Security & key exchange
+#define OT_FEATURE_SENSORS              DISABLED                            // ADC sampling to a GFB ring file, ALP 0x02
 #define OT_FEATURE_LF                   NOT_AVAILABLE                       // Optional LF interface for event generation
 #define OT_FEATURE_HF                   NOT_AVAILABLE                       // Optional HF interface for event generation
 #define OT_FEATURE_AUTOCOPY             NOT_AVAILABLE                       // A DMA method for moving batch data (experimental)
@@ -110,6 +132,27 @@
 #define OT_FEATURE_MPIPE_CALLBACKS      DISABLED                            // Signal callbacks from MPIPE
 #define OT_FEATURE_SW_WATCHDOG          DISABLED
 #define OT_FEATURE_HW_WATCHDOG          DISABLED
+#define OT_FEATURE_PROFILER             DISABLED                            // Kernel task & radio ISR timing (see sys_profile_export())
+#define OT_FEATURE_ADAPTIVECA           DISABLED                            // Load-adaptive RIGD/RAIND slotting (see sys_ca_export())
+#define OT_FEATURE_SLOPCAL              DISABLED                            // Learn response slop per request type, take it off Tc
+#define OT_FEATURE_RXTUNE               DISABLED                            // Cut the response listen to the learned arrivals (see sys_rxtune_expect())
+#define OT_FEATURE_SNIFFER              DISABLED                            // Capture all frames to MPipe (needs OT_FEATURE_MPIPE_GATHER)
+#define OT_FEATURE_RESPFWD              DISABLED                            // Forward gateway responses to MPipe (needs OT_PARAM_FWDPOOL)
+#define OT_FEATURE_NETSYNC              DISABLED                            // Network time in beacons, sleep scans on a shared schedule
+#define OT_FEATURE_ENERGY               DISABLED                            // Radio & CPU energy account in an ISF (see sys_energy_export())
+#define OT_FEATURE_MEMSTATS             DISABLED                            // Stack, queue, session & file pointer high-water marks, flash wear, ALP 0x06
+#define OT_FEATURE_LINKSTATS            DISABLED                            // Link & protocol counters in an ISF (see sys_linkstats_export())
+#define OT_FEATURE_RFCAL                DISABLED                            // Radio calibration on temperature/supply drift, autocal off
+#define OT_FEATURE_NDEF_STREAM          DISABLED                            // Execute NDEF records as they arrive (needs OT_FEATURE_MPIPE_DUPLEX)
+#define OT_FEATURE_TRACE                DISABLED                            // Kernel & radio event trace ring (see sys_trace_export())
+#define OT_FEATURE_POWERMGR             DISABLED                            // Pick the LPM from the next event ETA (see sys_powerdown())
+#define OT_FEATURE_CLKSCALE             DISABLED                            // CPU clock level per kernel task (see SYS_PERF_...)
+#define OT_FEATURE_APPTASKS             DISABLED                            // App tasks run by priority in idle gaps (see sys_task_add())
+#define OT_FEATURE_EXTQUEUE             DISABLED                            // External event sources, coalesced by priority in idle gaps (see sys_ext_add())
+#define OT_FEATURE_OTA                  DISABLED                            // Over-the-air firmware update by delta image, ALP 0x08 (see ota.h)
+#define OT_FEATURE_VLLOG                DISABLED                            // Append-only log files with range reads, ALP 0x09 (see vllog.h)
+#define OT_FEATURE_VSFLASH              DISABLED                            // External SPI NOR flash with 32 bit addresses (see vsflash.h)
+#define OT_FEATURE_DIALOG_CALLBACKS     DISABLED                            // Completion callback per dialog (see otapi_start_dialog_cb())
 #define OT_FEATURE_WATCHDOG_PERIOD      OT_PARAM_WATCHDOG_PERIOD                              
 
 
@@ -148,6 +191,7 @@
 #define M2_FEATURE_BLINKER              DISABLED                            // Blinker device mode
 #define M2_FEATURE_M2DP                 DISABLED                            // Datastreams & associated commands
 #define M2_FEATURE_DATASTREAM           M2_FEATURE_M2DP
+#define M2_FEATURE_DSWINDOW             DISABLED                            // Sliding-window datastreams (needs ALP)
 #define M2_FEATURE_FECTX                DISABLED  /* test */                          // FEC support for transmissions
 #define M2_FEATURE_FECRX                DISABLED  /* test */                          // FEC support for receptions
 #define M2_FEATURE_BASE                 ENABLED                             // Base channels (ch 00, 80)
@@ -157,9 +201,32 @@
 #define M2_FEATURE_BLINK                DISABLED                            // Blink channels (ch 3x, Bx)
 #define M2_FEATURE_AUTOSCALE            DISABLED                            // Adaptive TX power fall-off algorithm
 #define M2_FEATURE_BEACONS              ENABLED                             // Automated Beacon transmissions
+#define M2_FEATURE_BEACON_CACHE         DISABLED                            // Replay the last beacon frame when its files are unchanged
+#define M2_FEATURE_RESP_CACHE           DISABLED                            // Replay the response to a retransmitted request
+#define M2_FEATURE_FSACOLLECT           DISABLED                            // Framed-slotted A2P collection
+#define M2_FEATURE_MULTIHOP             DISABLED                            // Multi-hop relaying & route cache (subcontroller)
+#define M2_FEATURE_ACKBLOOM             DISABLED                            // Bloom filter A2P ACK sets (see m2qp_put_ackbloom())
+#define M2_FEATURE_ACKSORT              DISABLED                            // Sorted A2P ACK lists (see m2qp_put_acksort())
+#define M2_FEATURE_DIFFCOLLECT          DISABLED                            // Differential collection (see m2qp_put_diffcall())
+#define M2_FEATURE_PACK                 DISABLED                            // Packed collection responses (M2CE_PACK)
+#define M2_FEATURE_PIPELINE             DISABLED                            // Pipelined request dialogs (gateway, subcontroller)
+#define M2_FEATURE_INVENTORY            DISABLED                            // On-device A2P inventory planner (gateway, subcontroller), ALP 0x07
+#define M2_FEATURE_DRIFT                DISABLED                            // Per-subnet clock drift tracking for M2AdvP requests
+#define M2_FEATURE_LINKADAPT            DISABLED                            // Per-peer channel & FEC choice for RM2_CHAN_AUTO sessions
+#define M2_FEATURE_HDRCTX               DISABLED                            // Unicast header compression by peer context (all devices)
+#define M2_FEATURE_RXFILTER             ENABLED                             // Kill RX early on frames for other subnets/devices
+#define M2_FEATURE_ALPSHELL             DISABLED                            // ALP records over M2QP shell port M2QP_PORT_ALP (needs ALP)
 #define M2_PARAM_BEACON_TCA             12                                  // Ticks to do CSMA for Beacons
 #define M2_PARAM_MI_CHANNELS            1                                   // Multi-input channel support, e.g. "MIMO" (1-8)
 #define M2_PARAM_MAXFRAME               255                                 // Max supported frame length in bytes (127-255)
+#define M2_PARAM_QCACHE                 4                                   // Recent query results kept by M2QP (0 = no cache)
+#define M2_PARAM_ISFSCALL               16                                  // Most files in an ISF Series returned by an ISFS Call
+#define M2_PARAM_DIFFTAGS               4                                   // Tags whose last window is kept by a differential requester
+#define M2_PARAM_DIFFBYTES              32                                  // Largest window kept for each tag
+#define M2_PARAM_PIPELINE               4                                   // Requests a pipelining requester takes responses for
+#define M2_PARAM_PIPETIME               1024                                // Ticks a pipelined request takes responses for
+#define M2_PARAM_INVTAGS                16                                  // Tags kept in the set of the inventory planner
+#define M2_PARAM_INVCHANNELS            4                                   // Channels an inventory policy can take turns on
 #if (M2_FEATURE_M2DP == ENABLED)
 #    define M2_PARAM_MFPP             1                                     // Max Frames Per Packet (1-255, partly device-dependent)
 #else
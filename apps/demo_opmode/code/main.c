@@ -165,6 +165,9 @@ void sub_trig4_toggle();
 #elif defined(STM32H152)
 #   include "main_inc_STM32H152.c"
 
+#elif defined(BOARD_POSIX)
+#   include "main_inc_POSIX.c"
+
 #else
 #   error "You have not defined a supported board: select one in build_config.h"
 
@@ -236,14 +239,16 @@ void app_init() {
 
     ///Attribute OpenTag Transport Callbacks with App routines
     m2qp.signal.shell_request   = &app_udp_request;
+#   if ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED))
     m2qp.signal.error_response  = &app_error_response;
     m2qp.signal.std_response    = &app_std_response;
     m2qp.signal.a2p_response    = &app_a2p_response;
+#   endif
 
     //app_task = &app_task_null;
     
     ///Set MPipe to go back to listen after TX.
-#   if ((OT_FEATURE(MPIPE) == ENABLED) && (OT_FEATURE(NDEF) == ENABLED))
+#   if ((OT_FEATURE(MPIPE_CALLBACKS) == ENABLED) && (OT_FEATURE(NDEF) == ENABLED))
         mpipe_setsig_txdone(&otapi_ndef_idle);
         mpipe_setsig_rxdone(&otapi_ndef_proc);
         //otapi_ndef_idle(0);
@@ -683,7 +688,7 @@ void main(void) {
 #   endif
 
     ///4b. Send a message to show that main startup has passed
-    otapi_log_msg(6, 26, (ot_u8*)"SYS_ON", (ot_u8*)"System on and Mpipe active");
+    otapi_log_msg(MSG_utf8, 6, 26, (ot_u8*)"SYS_ON", (ot_u8*)"System on and Mpipe active");
     //platform_swdelay_ms(16);
 
     ///5. MAIN RUNTIME (post-init)  <BR>
@@ -702,7 +707,11 @@ void main(void) {
     while(1) {
         //app_manager();        //kernel pre-emptor demo
         //local_task_manager();
-        SLEEP_MCU();
+#       if (OT_FEATURE(POWERMGR) == ENABLED)
+            sys_powerdown();    // deepest LPM that meets the next kernel event
+#       else
+            SLEEP_MCU();
+#       endif
     }
 
     ///6. Note on manually pre-empting the kernel for you own purposes:
@@ -1274,6 +1283,22 @@ const ot_u8 isf_stock_files[] = {
 };
 
 
+/// On POSIX the stock arrays are copied into the file system image, and the
+/// rest of each block is left erased.  The copy needs the real array sizes.
+#if defined(PLATFORM_POSIX)
+const ot_uint vl_stock_bytes[4] = {
+    sizeof(overhead_files),
+    sizeof(isfs_stock_codes),
+#   if (GFB_TOTAL_BYTES > 0)
+    sizeof(gfb_stock_files),
+#   else
+    0,
+#   endif
+    sizeof(isf_stock_files)
+};
+#endif
+
+
 
 //__attribute__((section(".vl_fallow")))
 //const ot_u8 vl_fallow_space[ (FLASH_PAGE_SIZE*OTF_VWORM_FALLOW_PAGES) ];
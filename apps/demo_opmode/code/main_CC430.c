@@ -738,7 +738,11 @@ void main(void) {
     while(1) {
         //app_manager();        //kernel pre-emptor demo
         //local_task_manager();
-        SLEEP_MCU();
+#       if (OT_FEATURE(POWERMGR) == ENABLED)
+            sys_powerdown();    // deepest LPM that meets the next kernel event
+#       else
+            SLEEP_MCU();
+#       endif
     }
 
     ///6. Note on manually pre-empting the kernel for you own purposes:
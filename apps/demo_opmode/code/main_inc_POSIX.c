@@ -0,0 +1,89 @@
+/* Copyright 2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /apps/Demo_Opmode/Code/main_inc_POSIX.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Opmode Switching Demo for the POSIX host platform
+  *
+  * This file is included into main.c.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/** Application Triggers & Button(s) <BR>
+  * ========================================================================<BR>
+  * A virtual node has no LEDs, so triggers 3 and 4 do nothing.
+  *
+  * The "buttons" are signals, which can be sent with kill(1):
+  * APP_BUTTON_VECTOR   is the Key: it switches between gateway and endpoint
+  * APP_QUERY_VECTOR    sends a query (gateway only), like Joystick LEFT
+  *
+  * The environment variable OT_MODE=endpoint makes the node start as an
+  * endpoint, like holding the Key at startup.
+  */
+#define APP_BUTTON_VECTOR   SIGHUP
+#define APP_QUERY_VECTOR    SIGUSR2
+
+
+
+
+/** LED routines <BR>
+  * ===========================================================================
+  */
+void sub_trig3_high() { }
+void sub_trig3_low() { }
+void sub_trig3_toggle() { }
+void sub_trig4_high() { }
+void sub_trig4_low() { }
+void sub_trig4_toggle() { }
+
+
+void sub_trig_init() {
+}
+
+
+
+
+void app_buttons_isr(int signo) {
+    if (signo == APP_QUERY_VECTOR) {
+        sys.loadapp = &app_send_query;
+    }
+    else {
+        sys.loadapp = (app_devicemode != SYSMODE_GATEWAY) ? \
+                        &app_goto_gateway : &app_goto_endpoint;
+    }
+}
+
+
+void sub_button_init() {
+    char* mode = getenv("OT_MODE");
+
+    if ((mode != NULL) && (strcmp(mode, "endpoint") == 0)) {
+        app_goto_endpoint();
+        app_devicemode = SYSMODE_ENDPOINT;
+    }
+
+    platform_posix_isr(APP_BUTTON_VECTOR, &app_buttons_isr);
+    platform_posix_isr(APP_QUERY_VECTOR, &app_buttons_isr);
+}
+
@@ -42,6 +42,9 @@
 //#define BOARD_EM430RF
 //#define BOARD_eZ430Chronos
 
+//POSIX host (virtual node with simulated radio)
+//#define BOARD_POSIX
+
 
 
 #if defined(BOARD_MLX73Proto_E)
@@ -62,6 +65,9 @@
 #elif defined(BOARD_eZ430Chronos)
 #   include "CC430/board_eZ430Chronos.h"
 
+#elif defined(BOARD_POSIX)
+#   include "posix/board_POSIX.h"
+
 #else
 #   error "BOARD is set to an unknown value in platform_config.h"
 
@@ -45,13 +45,40 @@
 /// ALP Module EXTFs
 //#define EXTF_alp_load_retval
 //#define EXTF_alp_proc
+//#define EXTF_alp_register
 //#define EXTF_alp_proc_filedata
+//#define EXTF_alp_filedata_stream
+//#define EXTF_alp_filedata_close
 //#define EXTF_alp_proc_sensor
 //#define EXTF_alp_proc_dashforth
+//#define EXTF_df_init
+//#define EXTF_df_load
+//#define EXTF_df_load_file
+//#define EXTF_df_push
+//#define EXTF_df_run
+//#define EXTF_df_stop
+//#define EXTF_df_bg_start
+//#define EXTF_df_bg_output
 //#define EXTF_alp_proc_logger
 //#define EXTF_alp_proc_api_session
 //#define EXTF_alp_proc_api_system
 //#define EXTF_alp_proc_api_query
+//#define EXTF_alp_new_msg
+//#define EXTF_alp_new_record
+//#define EXTF_alp_reserve
+//#define EXTF_alp_end_msg
+//#define EXTF_alp_api_sysinit
+//#define EXTF_alp_api_new_session
+//#define EXTF_alp_api_open_request
+//#define EXTF_alp_api_close_request
+//#define EXTF_alp_api_start_flood
+//#define EXTF_alp_api_start_dialog
+//#define EXTF_alp_api_dialog_script
+//#define EXTF_alp_api_script_item
+//#define EXTF_alp_api_session_number
+//#define EXTF_alp_api_flush_sessions
+//#define EXTF_alp_api_is_session_blocked
+//#define EXTF_alp_api_query
 //#define EXTF_alp_proc_sec_example
 
 
@@ -65,6 +92,17 @@
 //#define EXTF_auth_new_nlsuser
 //#define EXTF_auth_search_user
 //#define EXTF_auth_get_dllskey
+//#define EXTF_auth_get_schedule
+
+
+
+
+
+/// AES128 Crypto Module EXTFs
+//#define EXTF_AES_ccm_keyschedule
+//#define EXTF_AES_ccm_derivekey
+//#define EXTF_AES_encrypt_ccm
+//#define EXTF_AES_decrypt_ccm
 
 
 
@@ -80,8 +118,11 @@
 
 /// CRC16 Module EXTFs
 //#define EXTF_crc_calc_block
+//#define EXTF_crc_extend_block
 //#define EXTF_crc_init_stream
 //#define EXTF_crc_calc_stream
+//#define EXTF_crc_calc_nstream
+//#define EXTF_crc_stream_span
 //#define EXTF_crc_update_stream
 //#define EXTF_crc_check
 //#define EXTF_crc_get
@@ -96,6 +137,9 @@
 //#define EXTF_em2_decode_newpacket
 //#define EXTF_em2_encode_newframe
 //#define EXTF_em2_decode_newframe
+//#define EXTF_em2_encode_nextframe
+//#define EXTF_em2_decode_nextframe
+//#define EXTF_em2_decode_bf
 //#define EXTF_em2_remaining_frames
 //#define EXTF_em2_remaining_bytes
 //#define EXTF_em2_complete
@@ -107,6 +151,12 @@
 /// External Module EXTFs
 //#define EXTF_ext_init
 //#define EXTF_ext_get_m2appflags
+//#define EXTF_ext_sensor_task
+//#define EXTF_ext_sensor_period
+//#define EXTF_ext_sensor_flush
+//#define EXTF_ext_sensor_seq
+//#define EXTF_ext_sensor_capacity
+//#define EXTF_ext_sensor_read
 
 
 
@@ -121,13 +171,31 @@
 //#define EXTF_m2np_footer
 //#define EXTF_m2np_put_deviceid
 //#define EXTF_m2np_idcmp
+//#define EXTF_m2np_idlist
+//#define EXTF_m2np_nbr_update
+//#define EXTF_m2np_route_nexthop
+//#define EXTF_m2np_drift_sample
+//#define EXTF_m2np_link_channel
+//#define EXTF_m2np_link_update
+//#define EXTF_m2np_link_loss
+//#define EXTF_m2np_pwr_update
+//#define EXTF_m2np_pwr_eirp
+//#define EXTF_m2np_idhash
 //#define EXTF_m2advp_open
 //#define EXTF_m2advp_close
 //#define EXTF_m2advp_init_flood
+//#define EXTF_m2advp_swap
+//#define EXTF_m2advp_update
 //#define EXTF_m2dp_open
 //#define EXTF_m2dp_parse_dspkt
 //#define EXTF_m2dp_mark_dsframe
 //#define EXTF_m2dp_dsproc
+//#define EXTF_m2dp_sink_open
+//#define EXTF_m2dp_source_open
+//#define EXTF_m2dp_source_next
+//#define EXTF_m2dp_source_ack
+//#define EXTF_m2dp_win_seek
+//#define EXTF_m2dp_win_close
 
 
 
@@ -149,6 +217,19 @@
 //#define EXTF_m2qp_isf_comp
 //#define EXTF_m2qp_isf_call
 //#define EXTF_m2qp_load_isf
+//#define EXTF_m2qp_fsa_init
+//#define EXTF_m2qp_fsa_timeout
+//#define EXTF_m2qp_fsa_endround
+//#define EXTF_m2qp_fsa_damaged
+//#define EXTF_m2qp_fsa_offset
+//#define EXTF_m2qp_put_ackbloom
+//#define EXTF_m2qp_put_acksort
+//#define EXTF_m2qp_put_diffcall
+//#define EXTF_m2qp_pipe_open
+//#define EXTF_m2qp_pipe_match
+//#define EXTF_m2qp_inv_start
+//#define EXTF_m2qp_inv_stop
+//#define EXTF_m2qp_inv_run
 
 
 
@@ -168,6 +249,14 @@
 //#define EXTF_mpipe_rxndef
 //#define EXTF_mpipe_isr
 
+/// TMS3705 EXTFs
+//#define EXTF_tms3705_init
+//#define EXTF_tms3705_load
+//#define EXTF_tms3705_loadwake
+//#define EXTF_tms3705_start
+//#define EXTF_tms3705_kill
+//#define EXTF_tms3705_status
+
 
 
 
@@ -183,9 +272,23 @@
 
 
 
+/// OTA module EXTFs
+//#define EXTF_ota_open
+//#define EXTF_ota_mark
+//#define EXTF_ota_missing
+//#define EXTF_ota_verify
+//#define EXTF_ota_apply
+
+
+
+
+
 /// OT Utils EXTFs
 //#define EXTF_otutils_calc_timeout
 //#define EXTF_otutils_encode_timeout
+//#define EXTF_otutils_range16
+//#define EXTF_otutils_pack
+//#define EXTF_otutils_unpack
 
 
 
@@ -226,10 +329,23 @@
 //#define EXTF_otapi_log_msg
 //#define EXTF_otapi_log_hexmsg
 //#define EXTF_otapi_log_code
+//#define EXTF_otapi_log_drain
+//#define EXTF_otapi_log_drops
+
 
 
 
 
+/// PRand Module EXTFs
+//#define EXTF_prand_seed
+//#define EXTF_prand_reseed
+//#define EXTF_prand_service
+//#define EXTF_platform_init_prand
+//#define EXTF_platform_prand_u8
+//#define EXTF_platform_prand_u16
+
+
+
 
 /// Queue EXTFs
 //#define EXTF_q_init
@@ -248,6 +364,14 @@
 //#define EXTF_q_readlong
 //#define EXTF_q_writestring
 //#define EXTF_q_readstring
+//#define EXTF_rq_init
+//#define EXTF_rq_empty
+//#define EXTF_rq_length
+//#define EXTF_rq_space
+//#define EXTF_rq_writebyte
+//#define EXTF_rq_readbyte
+//#define EXTF_rq_writestring
+//#define EXTF_rq_readstring
 
 
 
@@ -261,12 +385,15 @@
 //#define EXTF_radio_gag
 //#define EXTF_radio_sleep
 //#define EXTF_radio_idle
+//#define EXTF_radio_recalibrate
 //#define EXTF_radio_flush_tx
 //#define EXTF_radio_flush_rx
 //#define EXTF_radio_putbyte
 //#define EXTF_radio_putfourbytes
+//#define EXTF_radio_putbytes
 //#define EXTF_radio_getbyte
 //#define EXTF_radio_getfourbytes
+//#define EXTF_radio_getbytes
 //#define EXTF_radio_rxopen
 //#define EXTF_radio_rxopen_4
 //#define EXTF_radio_txopen
@@ -276,6 +403,7 @@
 //#define EXTF_rm2_scale_codec
 //#define EXTF_rm2_rxinit_ff
 //#define EXTF_rm2_rxinit_bf
+//#define EXTF_rm2_rxinit_sniff
 //#define EXTF_rm2_txinit_ff
 //#define EXTF_rm2_txinit_bf
 //#define EXTF_rm2_txstop_flood
@@ -296,11 +424,16 @@
 //#define EXTF_session_init
 //#define EXTF_session_refresh
 //#define EXTF_session_new
+//#define EXTF_session_renew
+//#define EXTF_session_setchannel
 //#define EXTF_session_occupied
 //#define EXTF_session_pop
 //#define EXTF_session_flush
 //#define EXTF_session_drop
 //#define EXTF_session_count
+//#define EXTF_session_hwm
+//#define EXTF_session_hwm_clear
+//#define EXTF_session_nls
 //#define EXTF_session_top
 
 
@@ -308,11 +441,13 @@
 /// System EXTFs
 //#define EXTF_sys_init
 //#define EXTF_sys_refresh
+//#define EXTF_sys_reconfigure
 //#define EXTF_sys_change_settings
 //#define EXTF_sys_goto_off
 //#define EXTF_sys_goto_sleep
 //#define EXTF_sys_goto_hold
 //#define EXTF_sys_panic
+//#define EXTF_sys_rtc_alarm
 //#define EXTF_sys_idle
 //#define EXTF_sys_default_csma
 //#define EXTF_sys_quit_rf
@@ -320,6 +455,49 @@
 //#define EXTF_sys_clear_mutex
 //#define EXTF_sys_get_mutex
 //#define EXTF_sys_event_manager
+//#define EXTF_sys_profile_log
+//#define EXTF_sys_profile_isrstart
+//#define EXTF_sys_profile_isrstop
+//#define EXTF_sys_profile_waitstart
+//#define EXTF_sys_profile_waitstop
+//#define EXTF_sys_profile_clear
+//#define EXTF_sys_profile_export
+//#define EXTF_sys_ca_clear
+//#define EXTF_sys_ca_export
+//#define EXTF_sys_slop_clear
+//#define EXTF_sys_rxtune_clear
+//#define EXTF_sys_rxtune_expect
+//#define EXTF_sys_rxtune_response
+//#define EXTF_sys_sniffer_start
+//#define EXTF_sys_sniffer_stop
+//#define EXTF_sys_sniffer_drops
+//#define EXTF_sys_respfwd_put
+//#define EXTF_sys_respfwd_drops
+//#define EXTF_sys_netsync_time
+//#define EXTF_sys_netsync_synced
+//#define EXTF_sys_netsync_set
+//#define EXTF_sys_netsync_eta
+//#define EXTF_sys_energy_clear
+//#define EXTF_sys_energy_export
+//#define EXTF_sys_stack_paint
+//#define EXTF_sys_mem_write
+//#define EXTF_sys_mem_clear
+//#define EXTF_sys_linkstats_clear
+//#define EXTF_sys_linkstats_export
+//#define EXTF_sys_rfcal_check
+//#define EXTF_sys_trace
+//#define EXTF_sys_trace_clear
+//#define EXTF_sys_trace_export
+//#define EXTF_sys_powerdown
+//#define EXTF_sys_pm_limit
+//#define EXTF_sys_task_add
+//#define EXTF_sys_task_remove
+//#define EXTF_sys_task_yield
+//#define EXTF_sys_ext_add
+//#define EXTF_sys_ext_remove
+//#define EXTF_sys_ext_post
+//#define EXTF_sys_pm_clear
+//#define EXTF_sys_pm_export
 //#define EXTF_sys_sig_loadapp
 #define EXTF_sys_sig_panic
 #define EXTF_sys_sig_rfainit
@@ -337,28 +515,51 @@
 //#define EXTF_vworm_format
 //#define EXTF_vworm_init
 //#define EXTF_vworm_save
+//#define EXTF_vworm_save_snapshot
+//#define EXTF_vworm_load_snapshot
+//#define EXTF_vworm_flush
+//#define EXTF_vworm_window
 //#define EXTF_vworm_read
 //#define EXTF_vworm_write
 //#define EXTF_vworm_mark
 //#define EXTF_vworm_mark_physical
 //#define EXTF_vworm_get
+//#define EXTF_vworm_get_direct
+//#define EXTF_vworm_read_block
+//#define EXTF_vworm_write_block
+//#define EXTF_vworm_restore
 //#define EXTF_vworm_print_table
 //#define EXTF_vworm_wipeblock
+//#define EXTF_vworm_wear
+//#define EXTF_vworm_factory
 //#define EXTF_vsram_read
 //#define EXTF_vsram_mark
 //#define EXTF_vsram_mark_physical
 //#define EXTF_vsram_get
+//#define EXTF_vsram_read_block
+//#define EXTF_vsram_write_block
 
 
 
 /// Veelite Module EXTFs
 //#define EXTF_vl_init
+//#define EXTF_vl_fastinit
+//#define EXTF_vl_save
 //#define EXTF_vl_get_fp
 //#define EXTF_vl_get_fd
+//#define EXTF_vl_fp_hwm
+//#define EXTF_vl_fp_hwm_clear
 //#define EXTF_vl_new
 //#define EXTF_vl_delete
+//#define EXTF_vl_defragment
+//#define EXTF_vl_restore
+//#define EXTF_vl_restore_all
+//#define EXTF_vl_verify
 //#define EXTF_vl_getheader_vaddr
 //#define EXTF_vl_getheader
+//#define EXTF_vl_nextheader
+//#define EXTF_vl_get_direct
+//#define EXTF_vl_direct_valid
 //#define EXTF_vl_open_file
 //#define EXTF_vl_open
 //#define EXTF_GFB_open_su
@@ -371,7 +572,10 @@
 //#define EXTF_GFB_chmod_su
 //#define EXTF_ISFS_chmod_su
 //#define EXTF_ISF_chmod_su
+//#define EXTF_ISF_verify
+//#define EXTF_ISF_summary
 //#define EXTF_vl_read
+//#define EXTF_vl_read_block
 //#define EXTF_vl_write
 //#define EXTF_vl_close
 //#define EXTF_vl_checklength
@@ -379,6 +583,21 @@
 //#define EXTF_ISF_syncmirror
 //#define EXTF_ISF_loadmirror
 
+//#define EXTF_vllog_open
+//#define EXTF_vllog_find
+//#define EXTF_vllog_get
+//#define EXTF_vllog_append
+//#define EXTF_vllog_clear
+//#define EXTF_vllog_first
+//#define EXTF_vllog_read
+
+//#define EXTF_vsflash_init
+//#define EXTF_vsflash_read
+//#define EXTF_vsflash_write
+//#define EXTF_vsflash_erase
+//#define EXTF_vsflash_service
+//#define EXTF_vsflash_flush
+
 
 
 
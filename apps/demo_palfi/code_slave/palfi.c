@@ -81,6 +81,80 @@
 #endif
 
 
+/** Number of one tick wait slots in a row that an SPI-Link job will wait for
+  * the PaLFi core to drop BUSY, before it is dropped (see palfi_spi_run()).
+  */
+#ifndef PALFI_SPI_WAITS
+#   define PALFI_SPI_WAITS  64
+#endif
+
+
+/** SPI trimming is done in fixed-point.  LF periods are measured in ns Q4 
+  * (1/16 ns), from SMCLK timer captures.  The target is the 134.2 kHz LF
+  * carrier, which has a 7452 ns period.
+  */
+#define PALFI_TICK_NSQ4     ((ot_u32)16000000 / ((PLATFORM_HSCLOCK_HZ/PLATFORM_SMCLK_DIV)/1000))
+#define PALFI_LFPERIOD_NSQ4 ((ot_u32)7452 * 16)
+
+
+/** The SPI trim values are stored in a user ISF, with the temperature and 
+  * voltage at trimming (palfi_trimcache).  SPI trimming just programs the
+  * stored values, without measuring, while the temperature and voltage are 
+  * within PALFI_TRIM_DTEMP and PALFI_TRIM_DVOLT of the stored ones.  These are
+  * in the units of the T and V elements of the UHF message.
+  */
+#ifndef PALFI_TRIMFILE_ID
+#   define PALFI_TRIMFILE_ID    0xFE
+#endif
+#ifndef PALFI_TRIM_DTEMP
+#   define PALFI_TRIM_DTEMP     50
+#endif
+#ifndef PALFI_TRIM_DVOLT
+#   define PALFI_TRIM_DVOLT     20
+#endif
+
+
+/** Pre-armed UHF reply (PALFI_FASTREPLY)
+  * While PaLFi is idle, the UHF message header (everything up to the UDP 
+  * data) is built once, and saved with the transport state that goes with it.
+  * After an LF wake-up, the reply is made right away in the external process:
+  * the header is copied into txq, the dialog ID of the new session is put in,
+  * and only the data elements (T, V, R, E, D) are written.  The encoder adds the CRC at TX, as always.  The session has
+  * a zero counter, so it goes to the top of the session stack.  With 
+  * PALFI_FASTREPLY_NOCSMA, it is also sent without CSMA-CA, which is only 
+  * right where the channel policy allows it.
+  *
+  * The header has the device ID and network defaults, which come from files,
+  * so it is built again when any file has changed (vl_writestamp, vl_mapstamp).
+  * Frames with DLLS are not pre-armed, because the DLLS sequence changes with
+  * each frame.
+  */
+#ifndef PALFI_FASTREPLY
+#   define PALFI_FASTREPLY          ENABLED
+#endif
+#ifndef PALFI_FASTREPLY_NOCSMA
+#   define PALFI_FASTREPLY_NOCSMA   DISABLED
+#endif
+#define PALFI_UHF_HEADMAX           32
+#define PALFI_UHF_DIALOGID          4
+
+#if (PALFI_FASTREPLY == ENABLED)
+typedef struct {
+    ot_u16  stamp;              // file stamp when the header was built
+    ot_u8   length;             // header length, 0 when not armed
+    ot_u8   fr_info;
+    ot_u8   addr_ctl;
+    ot_u8   cmd_code;
+    ot_u8   cmd_ext;
+    ot_u8   rx_timeout;
+    ot_u8   header[PALFI_UHF_HEADMAX];
+}
+palfi_uhftmpl;
+
+palfi_uhftmpl palfi_uhf;
+#endif
+
+
 palfi_struct palfi;
 palfiext_struct palfiext;
 
@@ -90,13 +164,23 @@ void sub_memset(ot_u8* start, ot_u8 size, ot_u8 val);
 void sub_program_channels(palfi_CHAN channel, ot_u8 trim_val, ot_u8 base_val);
 void sub_prog_trimswitch(ot_s8 trim_val);
 void sub_measurefreq_init(ot_u8 trim_val);
-void sub_measurefreq_finish(float* t_pulse);
+void sub_measurefreq_finish(ot_u32* t_pulse);
 void sub_calculate_trim();
+ot_bool sub_trimcache_load();
+void sub_trimcache_store();
+void sub_trim_finish();
 
+void sub_powerdown_finish();
 ot_u8 sub_spi_trx(ot_u8 write);
+ot_u8 sub_spi_xfer(ot_u8 write);
 ot_bool sub_loaduhf();
 void sub_adc_measurement(ot_int* buffer);
 void sub_build_uhfmsg(ot_int* buffer);
+ot_u8* sub_new_uhfmsg();
+void sub_put_uhfdata(ot_int* buffer);
+void sub_store_uhfdata(ot_u8* data_start);
+ot_bool sub_arm_uhfmsg();
+ot_bool sub_fast_uhfmsg(ot_int* buffer);
 
 
 // Palfi Actions are non-blocking states in the application.  Simple features 
@@ -216,25 +300,49 @@ void sys_sig_extprocess(void* data) {
 /// wait slot elapses.  It is defined in /OTlib/system.h.  This implementation
 /// checks the value of the event number, which indicates if there should be 
 /// the normal routine, the trimming routine, or nothing.
+///
+/// The LF wake-up states talk to the PaLFi core with SPI-Link jobs.  A state
+/// that queues a job goes back to the top, where the job is run.  If the core
+/// is busy, the kernel calls this function again after a wait slot, and the 
+/// state machine goes on (with the same event number) once the job is done.
+    static const ot_u8 cmd_status[]     = { 0x00 };
+    static const ot_u8 cmd_rssi[]       = { 0x03, 0xF3, 0x44, 0x00 };
+    static const ot_u8 cmd_powerdown[]  = { 0x03, 0xF3, 0x41, 0x0F };
 
     sys_sig_extprocess_TOP:
+    if ((palfi.spi.wsize | palfi.spi.rsize) != 0) {
+        ot_int spi_code = palfi_spi_run();
+        if (spi_code == 0) {
+            return;
+        }
+        if (spi_code < 0) {
+            sys.evt.EXT.event_no = 14;  // PaLFi core is not answering
+        }
+    }
+
     switch (sys.evt.EXT.event_no) {
         // Normal 0.1
         case 1:     // no break
         
-        // Trimming & Normal 0.1
-        case 2: {   sub_memset(palfi.status, 4, 0);
+        // Trimming & Normal 0.1: start SPI-Link, read status
+        case 2:     sub_memset(palfi.status, 4, 0);
                     sub_memset(&palfi.rssi_ok, 6, 0xFF);
                     palfi_spi_startup();
-                    palfi_cmdstatus();
-
-                    // Check for Wake A/B event on [0]:BIT0/BIT1, which we call event A/B
+                    palfi_spi_queue(cmd_status, 1, palfi.status, 4);
+                    sys.evt.EXT.event_no += 10;
+                    goto sys_sig_extprocess_TOP;
+        
+        // Normal 0.2
+        case 11:    // no break
+        
+        // Trimming & Normal 0.2: status has been read
+        case 12: {  // Check for Wake A/B event on [0]:BIT0/BIT1, which we call event A/B
                     // Wake A and B cannot physically happen at the same time
                     palfi.wake_event = (palfi.status[0] & 3);
                     if (palfi.wake_event) {
                         palfi.wake_event    += ('A'-1);
-                        sys.evt.EXT.event_no+= 2;
-                        palfi_cmdrssi();
+                        sys.evt.EXT.event_no-= 8;
+                        palfi_spi_queue(cmd_rssi, 4, &palfi.rssi_ok, 6);
                     }
                     else {
                         ot_u8 i;
@@ -245,9 +353,9 @@ void sys_sig_extprocess(void* data) {
                             }
                         }
                         // This sets the event number to the appropriate case
-                        // number below: range is 5 to 8
+                        // number below: range is 5 to 8, or 15 for nothing
                         sys.evt.EXT.event_no = (palfi.wake_event) ? \
-                                    sys.evt.EXT.event_no+4+(i<<1) : 0;
+                                    sys.evt.EXT.event_no-6+(i<<1) : 15;
                     }
                 } 
                 goto sys_sig_extprocess_TOP;
@@ -263,10 +371,20 @@ void sys_sig_extprocess(void* data) {
                         PALFI_BYPASS_PORT->DOUT |= PALFI_BYPASS_PIN;
                     } // no break
         
-        // Trimming & Normal Exit
+        // Trimming & Normal Exit: power-down PaLFi, then send UHF message
         case 4:     
         sys_sig_extprocess_EXIT2:
-                    palfi_powerdown();
+                    palfi_spi_queue(cmd_powerdown, 4, NULL, 0);
+                    sys.evt.EXT.event_no = 13;
+                    goto sys_sig_extprocess_TOP;
+                    
+        case 13:    sub_powerdown_finish();
+#                   if (PALFI_FASTREPLY == ENABLED)
+                    if (palfi_uhf.length != 0) {
+                        sub_loaduhf();
+                        break;
+                    }
+#                   endif
                     sys.loadapp = &sub_loaduhf;
                     break;
         
@@ -293,6 +411,15 @@ void sys_sig_extprocess(void* data) {
                     }
                     break;
         
+        // No event: power-down PaLFi
+        case 15:    palfi_spi_queue(cmd_powerdown, 4, NULL, 0);
+                    sys.evt.EXT.event_no = 14;
+                    goto sys_sig_extprocess_TOP;
+        
+        // PaLFi is powered-down, or it is not answering
+        case 14:    sub_powerdown_finish();
+                    break;
+        
         // Some type of error
         default:    palfi_powerdown();
                     break;
@@ -311,21 +438,104 @@ void sys_sig_extprocess(void* data) {
 ot_bool sub_loaduhf() {
 /// Attach this applet to the kernel applet loader.  It will do an ADC capture
 /// and build a DASH7 UDP packet (using a generic app protocol).  After it runs
-/// it always clears the applet loader to null, so it only runs once.
+/// it clears the applet loader, so it only runs once.  With PALFI_FASTREPLY, 
+/// the external process calls it directly when the reply is pre-armed, and 
+/// the loader is left to pre-arm the next reply.
     ot_int data_buffer[2];
     sub_adc_measurement(data_buffer);
-    sub_build_uhfmsg(data_buffer);
     
+#   if (PALFI_FASTREPLY == ENABLED)
+    if (sub_fast_uhfmsg(data_buffer) == False)
+#   endif
+        sub_build_uhfmsg(data_buffer);
+    
+#   if (PALFI_FASTREPLY == ENABLED)
+    sys.loadapp = &sub_arm_uhfmsg;
+#   else
     sys.loadapp = &sys_loadapp_null;
+#   endif
     return True;
 }
 
 
+ot_bool sub_arm_uhfmsg() {
+/// Applet loader while PaLFi is idle: builds the UHF message up to the data,
+/// saves it as the pre-armed header, and takes its session off the stack.  It
+/// waits for the kernel to have no sessions and no radio activity.
+#if (PALFI_FASTREPLY == ENABLED)
+    if ((session_count() < 0) && (sys.mutex == 0)) {
+        ot_u8* data_start;
+        
+        data_start          = sub_new_uhfmsg();
+        palfi_uhf.length    = (ot_u8)(data_start - txq.front);
+        if ((m2np.header.fr_info & M2FI_DLLS) || (palfi_uhf.length > PALFI_UHF_HEADMAX)) {
+            palfi_uhf.length = 0;
+        }
+        else {
+            platform_memcpy(palfi_uhf.header, txq.front, palfi_uhf.length);
+            palfi_uhf.stamp     = (ot_u16)(vl_writestamp + vl_mapstamp);
+            palfi_uhf.fr_info   = m2np.header.fr_info;
+            palfi_uhf.addr_ctl  = m2np.header.addr_ctl;
+            palfi_uhf.cmd_code  = m2qp.cmd.code;
+            palfi_uhf.cmd_ext   = m2qp.cmd.ext;
+            palfi_uhf.rx_timeout= (ot_u8)dll.comm.rx_timeout;
+        }
+        
+        session_pop();
+        q_empty(&txq);
+        sys.loadapp = &sys_loadapp_null;
+    }
+#endif
+    return False;
+}
+
+
+ot_bool sub_fast_uhfmsg(ot_int* buffer) {
+/// Makes the UHF message from the pre-armed header.  Returns False when there
+/// is no header, or files have changed since it was built.
+#if (PALFI_FASTREPLY == ENABLED)
+    session_tmpl s_tmpl;
+    ot_u8* data_start;
+
+    if ((palfi_uhf.length == 0) || \
+        (palfi_uhf.stamp != (ot_u16)(vl_writestamp + vl_mapstamp))) {
+        palfi_uhf.length = 0;
+        return False;
+    }
+    
+    s_tmpl.channel      = (palfi.wake_event & 1) ? ALERT_CHAN1 : ALERT_CHAN2;
+    s_tmpl.subnetmask   = 0;
+    s_tmpl.flagmask     = 0;
+    s_tmpl.timeout      = 10;
+    if (otapi_new_session(&s_tmpl) == 0) {
+        return False;
+    }
+#   if (PALFI_FASTREPLY_NOCSMA == ENABLED)
+    dll.comm.csmaca_params  = (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA);
+#   endif
+    dll.comm.rx_timeout     = palfi_uhf.rx_timeout;
+    m2qp.cmd.code           = palfi_uhf.cmd_code;
+    m2qp.cmd.ext            = palfi_uhf.cmd_ext;
+    m2np.header.fr_info     = palfi_uhf.fr_info;
+    m2np.header.addr_ctl    = palfi_uhf.addr_ctl;
+    
+    q_start(&txq, palfi_uhf.length, 0);
+    platform_memcpy(txq.front, palfi_uhf.header, palfi_uhf.length);
+    txq.front[PALFI_UHF_DIALOGID] = session_top()->dialog_id;
+    
+    data_start = txq.putcursor;
+    sub_put_uhfdata(buffer);
+    sub_store_uhfdata(data_start);
+    otapi_close_request();
+    return True;
+#else
+    return False;
+#endif
+}
+
+
 void sub_adc_measurement(ot_int* buffer) {
 /// This is a blocking ADC capture routine.  It should take about 1.6 ms.
-/// @todo change the algorithm to fixed-point.
-    float scratch;
-
     ADC12CTL0   = 0;
 
     // Reset REFMSTR to hand over control to: REFVSEL_1 = 2.0V, ADC12_A ref control registers  
@@ -345,16 +555,10 @@ void sub_adc_measurement(ot_int* buffer) {
   
     while ((ADC12CTL1 & ADC12BUSY) == ADC12BUSY);
 
-    ///@note I think floats are bad, but at the moment I don't care to untangle
-    ///      this knot into fixed-point (same goes for below)
-    scratch     = (float)ADC12MEM1;
-    scratch     = ((scratch * 2.0f / 4095) * 2 * 1000 - 100);
-    buffer[0]   = (ot_int)scratch;
-    
-    scratch     = (float)ADC12MEM0;
-    scratch     = ((scratch * 2.0f / 4095) * 100);
-    scratch     = scratch*24.0f/725*100;
-    buffer[1]   = (ot_int)scratch;
+    // Temperature: (MEM1 * 2.0V/4095) * 2000 - 100
+    // Voltage:     (MEM0 * 2.0V/4095) * 100 * 2400/725
+    buffer[0]   = (ot_int)(((ot_u32)ADC12MEM1 * 4000) / 4095) - 100;
+    buffer[1]   = (ot_int)(((ot_u32)ADC12MEM0 * 480000) / ((ot_u32)4095 * 725));
     
     // Shut everything down
     ADC12CTL0  &= ~(ADC12ENC | ADC12SC);
@@ -368,9 +572,22 @@ void sub_build_uhfmsg(ot_int* buffer) {
 /// The protocol has data elements marked by a letter (T, V, R, E, D) that
 /// signify Temperature, Voltage, RSSI (LF), PaLFi wake Event, and RX Data.
 /// The elements are fixed/known length.
+    ot_u8* data_start;
+    
+    data_start = sub_new_uhfmsg();
+    sub_put_uhfdata(buffer);
+    sub_store_uhfdata(data_start);
+    
+    // Finish Message
+    otapi_close_request();
+}
+
+
+ot_u8* sub_new_uhfmsg() {
+/// Opens the session and writes the message up to the UDP data.  Returns the
+/// start of the UDP data.
     session_tmpl    s_tmpl;
     command_tmpl    c_tmpl;
-    ot_u8*          data_start;
     ot_u8           status;
 
     // Create a new session: you could change these parameters
@@ -395,8 +612,11 @@ void sub_build_uhfmsg(ot_int* buffer) {
     q_writebyte(&txq, 255);        // Source Port: 255 (custom application port)
     q_writebyte(&txq, 255);        // Destination Port (same value)
     
-    data_start = txq.putcursor;
-    
+    return txq.putcursor;
+}
+
+
+void sub_put_uhfdata(ot_int* buffer) {
     // Place temperature data
     q_writebyte(&txq, 'T');
     q_writeshort(&txq, buffer[0]);
@@ -418,21 +638,30 @@ void sub_build_uhfmsg(ot_int* buffer) {
         q_writebyte(&txq, 'D');
         q_writestring(&txq, palfi.rxdata, 8);
     }
-    
-    // Store this information into the Port 255 file for continuous, automated
-    // reporting by DASH7/OpenTag until it is updated next time.  The length of 
-    // this information is always 23 bytes.
-    {
-    	vlFILE* fp;
-    	fp = ISF_open_su(255);
-    	if (fp != NULL) {
-    		vl_store(fp, 23, data_start);
-    		vl_close(fp);
-    	}
+}
+
+
+void sub_store_uhfdata(ot_u8* data_start) {
+/// Store this information into the Port 255 file for continuous, automated
+/// reporting by DASH7/OpenTag until it is updated next time.  The length of 
+/// this information is always 23 bytes.  The pre-armed header does not use 
+/// this file, so it stays armed across the write.
+    vlFILE* fp;
+#   if (PALFI_FASTREPLY == ENABLED)
+    ot_bool armed = (palfi_uhf.stamp == (ot_u16)(vl_writestamp + vl_mapstamp));
+#   endif
+
+    fp = ISF_open_su(255);
+    if (fp != NULL) {
+        vl_store(fp, 23, data_start);
+        vl_close(fp);
     }
     
-    // Finish Message
-    otapi_close_request();
+#   if (PALFI_FASTREPLY == ENABLED)
+    if (armed) {
+        palfi_uhf.stamp = (ot_u16)(vl_writestamp + vl_mapstamp);
+    }
+#   endif
 }
 
 
@@ -497,13 +726,24 @@ void palfi_init() {
     PALFI_SPI->BRW      = 5;                        // goal is roughly 0.5MHz
   //PALFI_SPI->BR1      = 0;
     PALFI_SPI->CTL1    &= ~UCSWRST;
+    
+    // Pre-arm the UHF reply when the kernel is first idle
+#   if (PALFI_FASTREPLY == ENABLED)
+    palfi_uhf.length    = 0;
+    sys.loadapp         = &sub_arm_uhfmsg;
+#   endif
 }
 
 
 void palfi_powerdown() {
     static const ot_u8 cmd_data[] = { 3, 0xF3, 0x41, 0x0F };
     palfi_writeout((ot_u8*)cmd_data);
-    
+    sub_powerdown_finish();
+}
+
+
+void sub_powerdown_finish() {
+/// Everything in the power-down after the SPI-Link command
     PALFI_SPI->CTL1        |= UCSWRST;
     PALFI_WAKE_PORT->IFG   &= ~PALFI_WAKE_PIN;
     PALFI_WAKE_PORT->IE    |= PALFI_WAKE_PIN;
@@ -523,6 +763,46 @@ void palfi_spi_startup() {
 }
 
 
+void palfi_spi_queue(const ot_u8* src, ot_u8 wsize, ot_u8* dst, ot_u8 rsize) {
+    palfi.spi.src   = src;
+    palfi.spi.wsize = wsize;
+    palfi.spi.dst   = dst;
+    palfi.spi.rsize = rsize;
+    palfi.spi.waits = PALFI_SPI_WAITS;
+}
+
+
+ot_int palfi_spi_run() {
+/// Same sequence as sub_spi_trx(), for each byte of the job, except that it
+/// returns to the kernel instead of spinning while BUSY is high.  A byte at 
+/// 0.5 MHz takes ~16us, so the transfer itself is not worth an interrupt.
+    while ((palfi.spi.wsize | palfi.spi.rsize) != 0) {
+        if (PALFI_BUSY_PORT->DIN & PALFI_BUSY_PIN) {
+            PALFI_SPICS_PORT->DOUT |= PALFI_SPICS_PIN;
+            if (--palfi.spi.waits == 0) {
+                palfi.spi.wsize = 0;
+                palfi.spi.rsize = 0;
+                return -1;
+            }
+            sys.evt.EXT.nextevent = 1;
+            return 0;
+        }
+        
+        palfi.spi.waits         = PALFI_SPI_WAITS;
+        PALFI_SPICS_PORT->DOUT &= ~PALFI_SPICS_PIN;
+        if (palfi.spi.wsize != 0) {
+            sub_spi_xfer(*palfi.spi.src++);
+            palfi.spi.wsize--;
+        }
+        else {
+            *palfi.spi.dst++ = sub_spi_xfer(0x00);
+            palfi.spi.rsize--;
+        }
+    }
+    return 1;
+}
+
+
 void palfi_writeout(ot_u8* src) {
     ot_int size = *src;
     while (size >= 0) {
@@ -624,13 +904,11 @@ void sub_memset(ot_u8* start, ot_u8 size, ot_u8 val) {
 
 
 ot_u8 sub_spi_trx(ot_u8 write) {
-/** @note This is the major remaining part of the PaLFi app that is blocking.
-  * The PaLFi Core is slow, and the trx process can take 10-30ms.  So, the
-  * MCLK frequency is divided by 32 during this sequence to conserve power.
-  * Eventually, it might be nice to make it non-blocking, and have the CC430
-  * sleep during the read/write cycle, but that would require saving a lot of
-  * interrupt configurations, or finding a hack to make the BUSY signal a 
-  * Non-Masking Interrupt (NMI).
+/** @note This is blocking, and only the trimming processes still use it (via
+  * palfi_writeout() and palfi_readback()).  The PaLFi Core is slow, and the 
+  * trx process can take 10-30ms.  The LF wake-up processes use SPI-Link jobs
+  * instead (palfi_spi_run()), which wait for BUSY in kernel wait slots.  BUSY
+  * is on P4, which has no port interrupt on CC430.
   */
     //ot_u16 saved_ucsctl5;
     
@@ -642,12 +920,18 @@ ot_u8 sub_spi_trx(ot_u8 write) {
     }
     PALFI_SPICS_PORT->DOUT &= ~PALFI_SPICS_PIN;
     
+    //UCS->CTL5 = saved_ucsctl5;
+    return sub_spi_xfer(write);
+}
+
+
+ot_u8 sub_spi_xfer(ot_u8 write) {
+/// Clock one byte through the SPI, after BUSY is low and CS is asserted
     while ((PALFI_SPI->IFG & UCTXIFG) == 0);
     
     PALFI_SPI->TXBUF = write;
     while ((PALFI_SPI->IFG & UCRXIFG) == 0);
     
-    //UCS->CTL5 = saved_ucsctl5;
     return PALFI_SPI->RXBUF;
 }
 
@@ -662,9 +946,26 @@ ot_u8 sub_spi_trx(ot_u8 write) {
   */
 
 ot_bool palfi_action_spitrim_0(void) {
+    ot_int adc[2];
+    
     PALFI_BYPASS_PORT->DOUT    |= PALFI_BYPASS_PIN;
     PALFI_VCLD_PORT->DOUT      |= PALFI_VCLD_PIN;
-    palfi.channel               = 1;
+    
+    sub_adc_measurement(adc);
+    palfi.trim.temp = adc[0];
+    palfi.trim.volt = adc[1];
+    
+    // The stored trims are still good: program them and skip the measurements
+    if (sub_trimcache_load()) {
+        for (palfi.channel=0; palfi.channel<3; ) {
+            palfi.channel++;
+            sub_prog_trimswitch(palfi.trimval[palfi.channel-1]);
+        }
+        sub_trim_finish();
+        return True;
+    }
+    
+    palfi.channel = 1;
     return palfi_action_spitrim_1();
 }
 
@@ -686,7 +987,7 @@ ot_bool palfi_action_spitrim_2(void) {
 
 
 ot_bool palfi_action_spitrim_3(void) {
-    sub_measurefreq_finish(&palfi.trim.tlow[palfi.channel]);
+    sub_measurefreq_finish(&palfi.trim.tlow[palfi.channel-1]);
     sys.evt.EXT.nextevent   = 5;        // wait ~5 ms
     palfi.action            = &palfi_action_spitrim_4;
     return False;
@@ -702,14 +1003,14 @@ ot_bool palfi_action_spitrim_4(void) {
 
 
 ot_bool palfi_action_spitrim_5(void) {
-    sub_measurefreq_finish(&palfi.trim.thigh[palfi.channel]);
+    sub_measurefreq_finish(&palfi.trim.thigh[palfi.channel-1]);
     sub_calculate_trim();
-    sub_prog_trimswitch(palfi.trimval[palfi.channel]);
+    sub_prog_trimswitch(palfi.trimval[palfi.channel-1]);
     
     // Finish-up if trimming has been done on all 3 channels
     if (palfi.channel == 3) {
-        PALFI_VCLD_PORT->DOUT      &= ~PALFI_VCLD_PIN;      // disable VCL charging
-        PALFI_BYPASS_PORT->DOUT    &= ~PALFI_BYPASS_PIN;    // enable DC/DC converter   
+        sub_trimcache_store();
+        sub_trim_finish();
         return True;
     }
     
@@ -795,7 +1096,7 @@ void sub_measurefreq_init(ot_u8 trim_val) {
 }
 
 
-void sub_measurefreq_finish(float* t_pulse) {
+void sub_measurefreq_finish(ot_u32* t_pulse) {
     PALFI_TIM->CTL = TACLR;
 
     if (sys.evt.EXT.nextevent <= 0) {
@@ -803,27 +1104,107 @@ void sub_measurefreq_finish(float* t_pulse) {
         sys.evt.EXT.event_no= 0;
     }
     else {
-        ot_uint num_periods;
+        ot_u32 ticks;
         palfi_readback(palfi.rxdata, 8);
         
-        num_periods     = palfi.trim.endcount - palfi.trim.startcount;
-        num_periods    *= (PLATFORM_HSCLOCK_HZ/PLATFORM_SMCLK_DIV);    			// Typ ~2.5 MHz
-        *t_pulse        = (float)(palfi.trim.endval - palfi.trim.startval);
-        *t_pulse       /= num_periods;
-        *t_pulse       *= 1000;
+        /// Average period over the captured edges, from the SMCLK ticks
+        /// between the first and last capture (typ ~2.5 MHz, 6400 ns Q4)
+        ticks       = (ot_uint)(palfi.trim.endval - palfi.trim.startval);
+        *t_pulse    = (ticks * PALFI_TICK_NSQ4) / \
+                      (ot_uint)(palfi.trim.endcount - palfi.trim.startcount);
     }
 }
 
 
 void sub_calculate_trim() {
-    float tl2, th2;
+/// trim = 127 * (T0^2 - tl^2) / (th^2 - tl^2), where T0 is the target period,
+/// tl the period with trims off, and th the period with trims on.  Periods are
+/// taken to ns Q2 and each square difference is done as (a-b)*(a+b), so that
+/// it fits in 32 bits.  th is capped at 2*T0, which is far out of trim range.
+    ot_u32  t0, tl, th;
+    ot_u32  trim;
+    
+    t0  = PALFI_LFPERIOD_NSQ4 >> 2;
+    tl  = palfi.trim.tlow[palfi.channel-1] >> 2;
+    th  = palfi.trim.thigh[palfi.channel-1] >> 2;
+    
+    if (tl >= t0) {
+        trim = 0;
+    }
+    else if (th <= t0) {
+        trim = 127;
+    }
+    else {
+        if (th > (t0 << 1)) {
+            th = (t0 << 1);
+        }
+        trim    = ((th - tl) * (th + tl)) / 127;
+        trim    = ((t0 - tl) * (t0 + tl)) / trim;
+        if (trim > 127) {
+            trim = 127;
+        }
+    }
     
-    tl2     = (palfi.trim.tlow[palfi.channel] * palfi.trim.tlow[palfi.channel]);
-    th2     = (palfi.trim.thigh[palfi.channel] * palfi.trim.thigh[palfi.channel]);
-    th2     = ( (((7452.0f*7452.0f)/tl2)-1.0f) / ((th2/tl2)-1.0f) );
-    th2    *= 127;
+    palfi.trimval[palfi.channel-1] = (ot_s8)trim;
+}
+
+
+ot_bool sub_trimcache_load() {
+/// Loads the stored trims into palfi.trimval, if there are trims for all three
+/// channels and they were made near the present temperature and voltage.
+    vlFILE*         fp;
+    palfi_trimcache cache;
+    ot_int          dtemp;
+    ot_int          dvolt;
     
-    palfi.trimval[palfi.channel] = (ot_s8)th2;
+    fp = ISF_open_su(PALFI_TRIMFILE_ID);
+    if (fp == NULL) {
+        return False;
+    }
+    if (vl_load(fp, sizeof(palfi_trimcache), (ot_u8*)&cache) != sizeof(palfi_trimcache)) {
+        cache.channels = 0;
+    }
+    vl_close(fp);
+    
+    dtemp = palfi.trim.temp - cache.temp;
+    dvolt = palfi.trim.volt - cache.volt;
+    if ((cache.channels != 3) || \
+        (dtemp > PALFI_TRIM_DTEMP) || (dtemp < -PALFI_TRIM_DTEMP) || \
+        (dvolt > PALFI_TRIM_DVOLT) || (dvolt < -PALFI_TRIM_DVOLT)) {
+        return False;
+    }
+    
+    platform_memcpy((ot_u8*)palfi.trimval, (ot_u8*)cache.trimval, 3);
+    return True;
+}
+
+
+void sub_trimcache_store() {
+/// Stores the new trims, with the temperature and voltage they were made at.
+/// The file is made the first time.
+    vlFILE*         fp;
+    palfi_trimcache cache;
+    
+    platform_memcpy((ot_u8*)cache.trimval, (ot_u8*)palfi.trimval, 3);
+    cache.channels  = 3;
+    cache.temp      = palfi.trim.temp;
+    cache.volt      = palfi.trim.volt;
+    
+    fp = ISF_open_su(PALFI_TRIMFILE_ID);
+    if (fp == NULL) {
+        if (vl_new(&fp, VL_ISF_BLOCKID, PALFI_TRIMFILE_ID, \
+                    (VL_ACCESS_USER & VL_ACCESS_RW), sizeof(palfi_trimcache), NULL) != 0) {
+            return;
+        }
+    }
+    vl_store(fp, sizeof(palfi_trimcache), (ot_u8*)&cache);
+    vl_close(fp);
+}
+
+
+void sub_trim_finish() {
+    PALFI_VCLD_PORT->DOUT      &= ~PALFI_VCLD_PIN;      // disable VCL charging
+    PALFI_BYPASS_PORT->DOUT    &= ~PALFI_BYPASS_PIN;    // enable DC/DC converter   
 }
 
 
@@ -66,14 +66,44 @@ typedef struct {
     ot_uint startval;
     ot_uint endval;
     
-    float   tlow[3];            ///@todo develop fixed-point solution
-    float   thigh[3];
+    ot_u32  tlow[3];            // LF period with trims off, ns in Q4
+    ot_u32  thigh[3];           // LF period with trims on, ns in Q4
+    ot_int  temp;               // Temperature when trimming began (ADC report units)
+    ot_int  volt;               // Voltage when trimming began (ADC report units)
 } 
 trim_struct;
 
+/** Trim cache file
+  * The trim values from the last SPI trimming, with the temperature and
+  * voltage that they were made at.  It is kept in a user ISF (see 
+  * PALFI_TRIMFILE_ID in palfi.c), so it stays across resets.
+  */
+typedef struct {
+    ot_s8   trimval[3];
+    ot_u8   channels;           // number of channels trimmed (3)
+    ot_int  temp;
+    ot_int  volt;
+}
+palfi_trimcache;
+
+/** SPI-Link job
+  * A job writes wsize bytes from src and then reads rsize bytes into dst.  It
+  * is run by palfi_spi_run() from the PaLFi external process, so the kernel
+  * keeps running while the PaLFi core is busy (see palfi_spi_queue()).
+  */
+typedef struct {
+    const ot_u8*    src;
+    ot_u8*          dst;
+    ot_u8           wsize;      // bytes left to write
+    ot_u8           rsize;      // bytes left to read
+    ot_u8           waits;      // wait slots left before the job is dropped
+}
+palfi_spijob;
+
 typedef struct {
     action_fn   action;         // Action function (internal usage mostly)
     trim_struct trim;           // LF Trimming process data (internal usage mostly)
+    palfi_spijob spi;           // SPI-Link job in progress (internal usage mostly)
     
     ot_s8       trimval[3];     // Normalized Trim values for three channels
     
@@ -141,6 +171,38 @@ void palfi_spi_startup();
 
 
 
+/** @brief  Queue a non-blocking SPI-Link job
+  * @param  src     (const ot_u8*) bytes to write (command stream)
+  * @param  wsize   (ot_u8) number of bytes to write
+  * @param  dst     (ot_u8*) buffer for the bytes read back after the write
+  * @param  rsize   (ot_u8) number of bytes to read back
+  * @retval None
+  * @ingroup PaLFi
+  * @sa palfi_spi_run()
+  *
+  * For a length-prefixed stream like the one palfi_writeout() takes, wsize is
+  * src[0]+1.  The job does not start until palfi_spi_run() is called.
+  */
+void palfi_spi_queue(const ot_u8* src, ot_u8 wsize, ot_u8* dst, ot_u8 rsize);
+
+
+
+/** @brief  Runs the queued SPI-Link job as far as the PaLFi core allows
+  * @param  None
+  * @retval ot_int  1: job done, 0: core is busy, -1: core timed-out
+  * @ingroup PaLFi
+  *
+  * The PaLFi core raises BUSY while it processes each byte, which can take 
+  * some milliseconds.  The BUSY line is not on an interrupt-capable port, so
+  * when it is high this function sets a one tick wait slot on the external 
+  * event and returns 0, and the kernel calls the external process again after
+  * it.  The MCU sleeps, and radio and kernel events run, in the meantime.  
+  * After PALFI_SPI_WAITS wait slots in a row, the job is dropped (-1).
+  */
+ot_int palfi_spi_run();
+
+
+
 /** @brief  Send a stream of data to the PaLFi core, via SPI-link
   * @param  src     (ot_u8*) byte buffer of data to send via SPI
   * @retval None
@@ -149,6 +211,9 @@ void palfi_spi_startup();
   * The stream pointed-to by "src" must have the non-inclusive length supplied
   * as the first byte.  For example, a typical 4 byte command might be supplied
   * as: src[] = { 03, XX, XX, XX }
+  *
+  * This is blocking.  The LF wake-up processes use palfi_spi_queue() instead,
+  * and only the trimming processes still use palfi_writeout().
   */
 void palfi_writeout(ot_u8* src);
 
@@ -114,6 +114,8 @@ SECTIONS
     .text      : {} > FLASH              /* CODE                              */
     .cinit     : {} > FLASH              /* INITIALIZATION TABLES             */
     .const     : {} > FLASH              /* CONSTANT DATA                     */
+    .ramcode   : load = FLASH, run = RAM, table(ramcode_copy)  /* PLATFORM_RAMCODE */
+    .ovly      : {} > FLASH              /* COPY TABLES                       */
     .cio       : {} > RAM                /* C I/O BUFFER                      */
 
     .pinit     : {} > FLASH              /* C++ CONSTRUCTOR TABLES            */
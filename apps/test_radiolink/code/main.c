@@ -0,0 +1,749 @@
+/* Copyright 2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /apps/test_radiolink/code/main.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      Radio link stress test, for a pair of devices
+  *
+  * This Application Does:
+  * <LI> Runs a fixed test plan between a source and a sink: foreground
+  *      frames, background frames, floods and datastreams, on channels of
+  *      both data rates, with and without FEC                            </LI>
+  * <LI> Sink: counts good frames and CRC errors, and keeps the RSSI
+  *      distribution and the time span of the frames, for each step      </LI>
+  * <LI> Both: keep the radio ISR time of each step (from the profiler)   </LI>
+  * <LI> Reports each step as a binary record over MPipe, for the host
+  *      decoder in /Supplements/link_decode.c (see _readme.txt)          </LI>
+  *
+  * The kernel is not started.  Like the radio chain tests, the app drives the
+  * radio module (rm2_...) directly and polls for the results, with GPTIM in
+  * free-running mode as the time base.  The source sends sync frames first,
+  * which carry the time until the plan starts, so both devices then run the
+  * steps of the plan on the same schedule.
+  *
+  * This Application Requires:
+  * <LI> OT_FEATURE(PROFILER), for the ISR times                         </LI>
+  * <LI> M2_FEATURE(FECTX) & M2_FEATURE(FECRX), for the FEC channels     </LI>
+  * <LI> Gateway or Subcontroller build (SYS_RECEIVE & SYS_FLOOD)        </LI>
+  * <LI> MPipe & Logger                                                  </LI>
+  *
+  * Currently Supported Boards:
+  * <LI> All boards that run Demo_Opmode, and BOARD_POSIX                </LI>
+  *
+  * @note The device is the sink, unless LINK_SOURCE is defined.  On POSIX,
+  *       OT_MODE=source or OT_MODE=sink in the environment overrides it.
+  ******************************************************************************
+  */
+
+#include "OTAPI.h"
+#include "OT_platform.h"
+
+#include "m2_network.h"
+#include "radio.h"
+#include "session.h"
+#include "system_native.h"
+
+#if defined(PLATFORM_POSIX)
+#   include <signal.h>
+#   include <stdlib.h>
+#   include <string.h>
+#   include <unistd.h>
+#endif
+
+#if (OT_FEATURE(PROFILER) != ENABLED)
+#   error "test_radiolink needs OT_FEATURE_PROFILER ENABLED (app_config.h)"
+#endif
+#if ((SYS_RECEIVE != ENABLED) || (SYS_FLOOD != ENABLED))
+#   error "test_radiolink needs a Gateway or Subcontroller build"
+#endif
+
+/// The waits below poll GPTIM.  On POSIX they give up the CPU between polls,
+/// because a node that spins delays the signals (the radio ISRs) of the
+/// other nodes on the same host core by a whole scheduler slice.
+#if defined(PLATFORM_POSIX)
+#   define LINK_IDLE()  platform_swdelay_us(20)
+#else
+#   define LINK_IDLE()  do { } while (0)
+#endif
+
+
+
+
+/** Test Plan <BR>
+  * ========================================================================<BR>
+  * Each step is one traffic pattern on one channel.  The channel ID carries
+  * the data rate (0x20 bit: 200 kS/s) and FEC (0x80 bit), as rm2_scale_codec()
+  * uses them.  Times are in ticks (1/1024 s).
+  *
+  * pattern     LINK_FG:     foreground frames with CSMA, one per interval
+  *             LINK_BG:     single background frames with CSMA, one per
+  *                          interval (the ETA field carries the sequence)
+  *             LINK_FLOOD:  background floods, one per interval, each one
+  *                          "length" ticks long
+  *             LINK_STREAM: foreground frames without CSMA, each one sent
+  *                          "interval" ticks after the last one is done
+  * channel     channel ID
+  * length      frame length in bytes with the CRC (FG, STREAM), or the
+  *             length of each flood in ticks (FLOOD).  BG frames are 7 bytes.
+  * count       frames (or floods) to send
+  * interval    see pattern
+  * duration    length of the step.  The source only sends in the window from
+  *             LINK_LEAD after the start to LINK_TAIL before the end.
+  */
+#define LINK_FG             0
+#define LINK_BG             1
+#define LINK_FLOOD          2
+#define LINK_STREAM         3
+
+typedef struct {
+    ot_u8   pattern;
+    ot_u8   channel;
+    ot_u16  length;
+    ot_u16  count;
+    ot_u16  interval;
+    ot_u16  duration;
+} link_step;
+
+#define LINK_LEAD           32
+#define LINK_TAIL           96
+#define LINK_DURATION(COUNT, INTERVAL)  (LINK_LEAD + ((COUNT)*(INTERVAL)) + LINK_TAIL)
+
+static const link_step link_plan[] = {
+    { LINK_FG,      0x10,   16,     50,     24,     LINK_DURATION(50, 24) },
+    { LINK_FG,      0x10,   64,     50,     32,     LINK_DURATION(50, 32) },
+    { LINK_FG,      0x90,   64,     50,     32,     LINK_DURATION(50, 32) },
+    { LINK_FG,      0x2D,   64,     50,     32,     LINK_DURATION(50, 32) },
+    { LINK_FG,      0xAD,   64,     50,     32,     LINK_DURATION(50, 32) },
+    { LINK_FG,      0x10,   128,    50,     64,     LINK_DURATION(50, 64) },
+    { LINK_FG,      0x90,   128,    50,     64,     LINK_DURATION(50, 64) },
+    { LINK_BG,      0x10,   7,      50,     16,     LINK_DURATION(50, 16) },
+    { LINK_BG,      0x2D,   7,      50,     16,     LINK_DURATION(50, 16) },
+    { LINK_FLOOD,   0x10,   128,    4,      256,    LINK_DURATION(4, 256) },
+    { LINK_FLOOD,   0x2D,   128,    4,      256,    LINK_DURATION(4, 256) },
+    { LINK_STREAM,  0x10,   64,     50,     2,      LINK_DURATION(50, 16) },
+    { LINK_STREAM,  0xAD,   64,     50,     2,      LINK_DURATION(50, 16) }
+};
+
+#define LINK_STEPS          (sizeof(link_plan)/sizeof(link_step))
+
+
+/** Sync frames: FG frames on LINK_SYNC_CHANNEL, sent every LINK_SYNC_PERIOD
+  * for LINK_SYNC_TICKS before the plan starts.  The sink waits for one.
+  */
+#define LINK_SYNC_CHANNEL   0x10
+#define LINK_SYNC_PERIOD    64
+#define LINK_SYNC_TICKS     2048
+#define LINK_SYNC_LENGTH    12
+#define LINK_SYNC_STEP      0xFF
+
+/// On MCUs the plan runs over and over.  The source rests this long between
+/// runs, so the sink is listening for the next sync.
+#define LINK_REST_TICKS     1024
+
+#define LINK_MAGIC          0xA7
+#define LINK_SUBNET         0xF0
+#define LINK_FORMAT         1
+#define LINK_ROLE_SINK      0
+#define LINK_ROLE_SOURCE    1
+
+/// RSSI histogram: bin 0 is below LINK_RSSI_FLOOR+LINK_RSSI_BIN dBm, the last
+/// bin is everything above.
+#define LINK_RSSI_BINS      8
+#define LINK_RSSI_FLOOR     -110
+#define LINK_RSSI_BIN       10
+
+
+
+
+/** Test Data <BR>
+  * ========================================================================<BR>
+  * The radio callbacks run in interrupt context.  They only store the result
+  * (and update the ETA of floods), and the main loop does the rest.
+  */
+typedef struct {
+    ot_u32  now;                // tick clock: GPTIM extended to 32 bits
+    ot_u16  gptim;              // last GPTIM value
+    ot_u8   role;
+    ot_u8   step;
+    volatile ot_bool busy;      // radio process is running
+    volatile ot_int  code;      // callback codes of the last process
+    volatile ot_int  fcode;
+    volatile ot_int  eta;       // flood: ETA of the frame after next
+    volatile ot_u16  frames;    // step results
+    ot_u16  errors;
+    ot_u32  bytes;
+    ot_u32  first;
+    ot_u32  last;
+    ot_int  rssi_min;
+    ot_int  rssi_max;
+    ot_long rssi_sum;
+    ot_u16  rssi_hist[LINK_RSSI_BINS];
+} link_struct;
+
+link_struct radiolink;
+m2session   link_session;
+
+
+
+
+/** Clock & Radio Routines <BR>
+  * ========================================================================<BR>
+  */
+ot_u32 sub_ticks() {
+/// GPTIM is free-running (16 bits), so it is extended here.  It is read much
+/// more often than once per 64 seconds.
+    ot_u16 gptim    = platform_get_gptim();
+    radiolink.now  += (ot_u16)(gptim - radiolink.gptim);
+    radiolink.gptim = gptim;
+    return radiolink.now;
+}
+
+ot_bool sub_before(ot_u32 tick) {
+    return (ot_bool)((ot_long)(tick - sub_ticks()) > 0);
+}
+
+void sub_wait_until(ot_u32 tick) {
+    while (sub_before(tick)) {
+        LINK_IDLE();
+    }
+}
+
+
+void sub_comm(ot_u8 channel, ot_u8 csmaca_params, ot_uint rx_timeout) {
+/// Single channel, ad-hoc comm parameters, as in the radio chain tests
+    dll.comm.tca            = 2048;
+    dll.comm.rx_timeout     = rx_timeout;
+    dll.comm.csmaca_params  = csmaca_params;
+    dll.comm.redundants     = 1;
+    dll.comm.tx_channels    = 1;
+    dll.comm.rx_channels    = 1;
+    dll.comm.tx_chanlist    = &dll.comm.scratch[0];
+    dll.comm.rx_chanlist    = &dll.comm.scratch[1];
+    dll.comm.scratch[0]     = channel;
+    dll.comm.scratch[1]     = channel;
+}
+
+
+void sub_rxdone(ot_int pcode, ot_int fcode) {
+    radiolink.code  = pcode;
+    radiolink.fcode = fcode;
+    radiolink.busy  = False;
+}
+
+
+ot_int sub_bgtime() {
+/// Airtime of a BG frame, which can round down to 0 ticks at 200 kS/s
+    ot_int ticks = rm2_pkt_duration(7);
+    return (ticks > 0) ? ticks : 1;
+}
+
+
+void sub_txdone(ot_int pcode, ot_int scratch) {
+/// pcode 2 comes for each flood frame that goes out.  The frame after it is
+/// prepared here, the same way the kernel does it.  Single BG frames have an
+/// ETA of 0 here, so they stop after one frame in any case.
+    if (pcode == 2) {
+        radiolink.frames++;
+        radiolink.eta -= sub_bgtime();
+        if (radiolink.eta < sub_bgtime()) {
+            rm2_txstop_flood();
+        }
+        else {
+            m2advp_update((ot_u16)radiolink.eta);
+        }
+        return;
+    }
+    radiolink.code  = pcode;
+    radiolink.busy  = False;
+}
+
+
+ot_bool sub_wait_radio(ot_u32 deadline) {
+/// Waits for the radio callback.  A process still running at the deadline is
+/// killed (the callback then comes with RM2_ERR_KILL).
+    while (radiolink.busy) {
+        if (sub_before(deadline) == False) {
+            rm2_kill();
+            return False;
+        }
+        LINK_IDLE();
+    }
+    return True;
+}
+
+
+void sub_fgframe(ot_u8 length, ot_u8 step, ot_u16 seq) {
+/// Length, TX EIRP (filled by the driver), subnet, frame info, then the
+/// payload: magic, step, sequence, and a counting pattern.  length includes
+/// the two bytes of CRC, which the encoder adds.
+    ot_int i;
+
+    q_start(&txq, 0, 0);
+    txq.front[0]    = length;
+    txq.front[1]    = 0;
+    txq.front[2]    = LINK_SUBNET;
+    txq.front[3]    = 0x20 | 0x02;
+    txq.putcursor   = &txq.front[4];
+    txq.length      = 4;
+
+    q_writebyte(&txq, LINK_MAGIC);
+    q_writebyte(&txq, step);
+    q_writeshort(&txq, seq);
+    for (i=8; i<(length-2); i++) {
+        q_writebyte(&txq, (ot_u8)i);
+    }
+}
+
+
+ot_int sub_tx(ot_u8 pattern, ot_u32 deadline) {
+/// Sends the frame (or starts the flood) in txq, with the CSMA set in
+/// dll.comm.  CCA failures are counted, and CCA is tried again until the
+/// deadline.  Returns 0 when the TX is done, else an RM2_ERR code.
+    ot_int code;
+
+    radiolink.busy = True;
+    if (pattern == LINK_BG || pattern == LINK_FLOOD) {
+        rm2_txinit_bf(&sub_txdone);
+    }
+    else {
+        rm2_txinit_ff(1, &sub_txdone);
+    }
+
+    while (1) {
+        code = rm2_txcsma();
+        if (code == -1) {
+            break;
+        }
+        if (code >= 0) {
+            sub_wait_until(radiolink.now + code);
+            continue;
+        }
+        if ((code == RM2_ERR_CCAFAIL) && sub_before(deadline)) {
+            radiolink.errors++;
+            sub_wait_until(radiolink.now + 1);
+            continue;
+        }
+        rm2_kill();
+        radiolink.busy = False;
+        return code;
+    }
+
+    /// A single BG frame is a flood that stops after its first frame
+    if (pattern == LINK_BG) {
+        rm2_txstop_flood();
+    }
+    if (radiolink.first == 0) {
+        radiolink.first = radiolink.now;
+    }
+    sub_wait_radio(deadline + LINK_TAIL);
+    radiolink.last = sub_ticks();
+    return radiolink.code;
+}
+
+
+
+
+/** Reporting Routines <BR>
+  * ========================================================================<BR>
+  * Records are binary and big-endian.  Each is one log message with the label
+  * "LINK", and the first byte is the record type (see _readme.txt).
+  */
+ot_u8* sub_put16(ot_u8* cursor, ot_u16 value) {
+    *cursor++ = (ot_u8)(value >> 8);
+    *cursor++ = (ot_u8)value;
+    return cursor;
+}
+
+ot_u8* sub_put32(ot_u8* cursor, ot_u32 value) {
+    cursor = sub_put16(cursor, (ot_u16)(value >> 16));
+    return sub_put16(cursor, (ot_u16)value);
+}
+
+void sub_link_log(ot_u8* record, ot_u8* end) {
+    otapi_log_msg(MSG_raw, 4, (ot_int)(end-record), (ot_u8*)"LINK", record);
+    mpipe_wait();
+}
+
+
+void sub_report_header() {
+    ot_u8   record[16];
+    ot_u8*  cursor = record;
+
+    *cursor++   = 'H';
+    *cursor++   = LINK_FORMAT;
+    *cursor++   = radiolink.role;
+    *cursor++   = (ot_u8)LINK_STEPS;
+    cursor      = sub_put32(cursor, PLATFORM_CYCLES_HZ);
+    cursor      = sub_put32(cursor, PLATFORM_CYCLES_MASK);
+    cursor      = sub_put16(cursor, 1024);
+    sub_link_log(record, cursor);
+}
+
+
+void sub_report_step(const link_step* step) {
+/// The step record, then the ISR time of the radio interrupts that ran
+    static const ot_u8 isr_id[4] = {
+        SYS_PROFILE_RXSYNC, SYS_PROFILE_RXDATA, SYS_PROFILE_RXEND, SYS_PROFILE_TXDATA
+    };
+    ot_u8   record[48];
+    ot_u8*  cursor = record;
+    ot_int  i;
+
+    *cursor++   = 'S';
+    *cursor++   = radiolink.step;
+    *cursor++   = radiolink.role;
+    *cursor++   = step->pattern;
+    *cursor++   = step->channel;
+    cursor      = sub_put16(cursor, step->length);
+    cursor      = sub_put16(cursor, radiolink.frames);
+    cursor      = sub_put16(cursor, radiolink.errors);
+    cursor      = sub_put32(cursor, radiolink.bytes);
+    cursor      = sub_put32(cursor, (radiolink.frames == 0) ? 0 : (radiolink.last - radiolink.first));
+    cursor      = sub_put16(cursor, (ot_u16)radiolink.rssi_min);
+    cursor      = sub_put16(cursor, (ot_u16)radiolink.rssi_max);
+    cursor      = sub_put32(cursor, (ot_u32)radiolink.rssi_sum);
+    for (i=0; i<LINK_RSSI_BINS; i++) {
+        cursor  = sub_put16(cursor, radiolink.rssi_hist[i]);
+    }
+    sub_link_log(record, cursor);
+
+    for (i=0; i<4; i++) {
+        sys_profile* prof = &sys.profile[isr_id[i]];
+        if (prof->count != 0) {
+            cursor      = record;
+            *cursor++   = 'I';
+            *cursor++   = radiolink.step;
+            *cursor++   = radiolink.role;
+            *cursor++   = isr_id[i];
+            cursor      = sub_put16(cursor, prof->count);
+            cursor      = sub_put32(cursor, prof->total);
+            cursor      = sub_put32(cursor, prof->max);
+            sub_link_log(record, cursor);
+        }
+    }
+}
+
+
+void sub_report_end() {
+    ot_u8 record[3];
+    record[0]   = 'E';
+    record[1]   = radiolink.role;
+    record[2]   = (ot_u8)LINK_STEPS;
+    sub_link_log(record, &record[3]);
+}
+
+
+void sub_step_clear() {
+    radiolink.frames   = 0;
+    radiolink.errors   = 0;
+    radiolink.bytes    = 0;
+    radiolink.first    = 0;
+    radiolink.last     = 0;
+    radiolink.rssi_min = 0;
+    radiolink.rssi_max = 0;
+    radiolink.rssi_sum = 0;
+    platform_memset((ot_u8*)radiolink.rssi_hist, 0, sizeof(radiolink.rssi_hist));
+    sys_profile_clear();
+}
+
+
+
+
+/** Source <BR>
+  * ========================================================================<BR>
+  */
+void sub_source_sync(ot_u32 t0) {
+/// Sync frames carry the ticks from their start to t0.  They go out without
+/// CSMA, so the TX starts right after the frame is built.
+    sub_comm(LINK_SYNC_CHANNEL, (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA), 0);
+
+    while ((ot_long)(t0 - sub_ticks()) > LINK_SYNC_PERIOD) {
+        ot_u32 next = radiolink.now + LINK_SYNC_PERIOD;
+        sub_fgframe(LINK_SYNC_LENGTH, LINK_SYNC_STEP, (ot_u16)(t0 - radiolink.now));
+        sub_tx(LINK_FG, next);
+        sub_wait_until(next);
+    }
+    radio_sleep();
+}
+
+
+void sub_source_step(const link_step* step, ot_u32 start) {
+    ot_u32  end     = start + step->duration - LINK_TAIL;
+    ot_u32  next    = start + LINK_LEAD;
+    ot_u8   csmaca;
+    ot_u16  i;
+
+    csmaca = (step->pattern == LINK_STREAM || step->pattern == LINK_FLOOD) ? \
+                (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA) : (M2_CSMACA_NA2P | M2_CSMACA_MACCA);
+    sub_comm(step->channel, csmaca, 0);
+
+    /// rm2_txinit_..() picks the encoder (FEC or not) from the channel that
+    /// is loaded, and CSMA only loads the channel after that.  So the channel
+    /// of the step is loaded first, by an RX that is killed at once.
+    radiolink.busy = True;
+    rm2_rxinit_ff(step->channel, M2_NETSTATE_UNASSOC, 1, &sub_rxdone);
+    rm2_kill();
+
+    link_session.subnet     = radiolink.step;
+    link_session.channel    = step->channel;
+
+    for (i=0; i<step->count; i++) {
+        ot_u16 frames;
+        ot_u16 eta;
+
+        sub_wait_until(next);
+        if (sub_before(end) == False) {
+            break;
+        }
+
+        switch (step->pattern) {
+            case LINK_FG:
+            case LINK_STREAM:
+                sub_fgframe((ot_u8)step->length, radiolink.step, i);
+                if (sub_tx(step->pattern, end) == 0) {
+                    radiolink.frames++;
+                    radiolink.bytes += step->length;
+                }
+                break;
+
+            case LINK_BG:
+            case LINK_FLOOD:
+                eta = (step->pattern == LINK_BG) ? i : step->length;
+                m2advp_init_flood(&link_session, eta);
+                frames          = radiolink.frames;
+                radiolink.eta   = (step->pattern == LINK_BG) ? 0 : ((ot_int)eta - sub_bgtime());
+                if (sub_tx(step->pattern, end) == 0) {
+                    radiolink.frames++;
+                }
+                radiolink.bytes += (ot_u32)(radiolink.frames - frames) * 7;
+                m2advp_close();
+                break;
+        }
+
+        next = (step->pattern == LINK_STREAM) ? (sub_ticks() + step->interval) : \
+                                                (next + step->interval);
+    }
+    radio_sleep();
+}
+
+
+
+
+/** Sink <BR>
+  * ========================================================================<BR>
+  */
+ot_u32 sub_sink_sync() {
+/// Listens on the sync channel until a sync frame comes.  It ends at its
+/// airtime after the source read its clock, so the plan starts at that much
+/// less than the countdown in the frame.
+    ot_u16 countdown;
+
+    sub_comm(LINK_SYNC_CHANNEL, (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA), LINK_SYNC_TICKS);
+
+    while (1) {
+        radiolink.busy = True;
+        rm2_rxinit_ff(LINK_SYNC_CHANNEL, M2_NETSTATE_UNASSOC, 1, &sub_rxdone);
+        while (radiolink.busy) {
+            sub_ticks();
+            LINK_IDLE();
+        }
+        if ((radiolink.code == 0) && (radiolink.fcode == 0) \
+        && (rxq.front[4] == LINK_MAGIC) && (rxq.front[5] == LINK_SYNC_STEP)) {
+            countdown = ((ot_u16)rxq.front[6] << 8) | rxq.front[7];
+            return sub_ticks() + countdown - rm2_pkt_duration(rxq.front[0]);
+        }
+    }
+}
+
+
+void sub_sink_frame(const link_step* step) {
+/// Scores one RX.  Kills are not frames, and frames with a good CRC only
+/// count when they belong to this step, so strays from other nodes are left
+/// out.  Frames with a bad CRC cannot be told apart, so all of them count.
+    ot_u8*  frame = rxq.front;
+    ot_int  rssi;
+    ot_int  bin;
+
+    if (radiolink.code < 0) {
+        return;
+    }
+    if (radiolink.fcode != 0) {
+        radiolink.errors++;
+        return;
+    }
+
+    /// BG frames: subnet (the step), protocol, channel, ETA, CRC
+    if (step->pattern == LINK_BG || step->pattern == LINK_FLOOD) {
+        if ((frame[2] != radiolink.step) || (frame[3] != M2_PROTOCOL_M2ADVP) \
+        || (frame[4] != step->channel)) {
+            return;
+        }
+    }
+    else if ((frame[4] != LINK_MAGIC) || (frame[5] != radiolink.step)) {
+        return;
+    }
+
+    rssi = radio_rssi();
+    if ((radiolink.frames == 0) || (rssi < radiolink.rssi_min))   radiolink.rssi_min = rssi;
+    if ((radiolink.frames == 0) || (rssi > radiolink.rssi_max))   radiolink.rssi_max = rssi;
+    radiolink.rssi_sum += rssi;
+    bin                 = (rssi - LINK_RSSI_FLOOR) / LINK_RSSI_BIN;
+    bin                 = (bin < 0) ? 0 : ((bin >= LINK_RSSI_BINS) ? (LINK_RSSI_BINS-1) : bin);
+    radiolink.rssi_hist[bin]++;
+
+    if (radiolink.frames == 0) {
+        radiolink.first = radiolink.now;
+    }
+    radiolink.last      = radiolink.now;
+    radiolink.bytes    += frame[0];
+    radiolink.frames++;
+}
+
+
+void sub_sink_step(const link_step* step, ot_u32 start) {
+/// RX is started again after each frame, until the end of the step
+    ot_u32  end     = start + step->duration;
+    ot_bool armed   = False;
+
+    radiolink.busy = False;
+
+    while (1) {
+        if (radiolink.busy) {
+            if (sub_before(end) == False) {
+                rm2_kill();
+            }
+            LINK_IDLE();
+            continue;
+        }
+        if (armed) {
+            armed = False;
+            sub_sink_frame(step);
+        }
+        if (sub_before(end) == False) {
+            break;
+        }
+
+        armed       = True;
+        radiolink.busy = True;
+        sub_comm(step->channel, (M2_CSMACA_NA2P | M2_CSMACA_MACCA), (ot_uint)(end - radiolink.now));
+        if (step->pattern == LINK_BG || step->pattern == LINK_FLOOD) {
+            rm2_rxinit_bf(step->channel, &sub_rxdone);
+        }
+        else {
+            rm2_rxinit_ff(step->channel, M2_NETSTATE_UNASSOC, 1, &sub_rxdone);
+        }
+    }
+    radio_sleep();
+}
+
+
+
+
+/** Test Plan Routines <BR>
+  * ========================================================================<BR>
+  */
+void link_init() {
+#   if defined(LINK_SOURCE)
+    radiolink.role = LINK_ROLE_SOURCE;
+#   else
+    radiolink.role = LINK_ROLE_SINK;
+#   endif
+
+#   if defined(PLATFORM_POSIX)
+    {   char* mode = getenv("OT_MODE");
+        if (mode != NULL) {
+            radiolink.role = (strcmp(mode, "source") == 0) ? LINK_ROLE_SOURCE : LINK_ROLE_SINK;
+        }
+    }
+#   endif
+
+    /// GPTIM runs free from here on, and nothing else uses it
+    platform_flush_gptim();
+    radiolink.gptim = platform_get_gptim();
+    radiolink.now   = 0;
+}
+
+
+void link_run() {
+    ot_u32 start;
+
+    sub_report_header();
+
+    if (radiolink.role == LINK_ROLE_SOURCE) {
+        start = sub_ticks() + LINK_SYNC_TICKS;
+        sub_source_sync(start);
+    }
+    else {
+        start = sub_sink_sync();
+    }
+
+    for (radiolink.step=0; radiolink.step<LINK_STEPS; radiolink.step++) {
+        const link_step* step = &link_plan[radiolink.step];
+
+        sub_step_clear();
+        if (radiolink.role == LINK_ROLE_SOURCE) {
+            sub_source_step(step, start);
+        }
+        else {
+            sub_sink_step(step, start);
+        }
+        start += step->duration;
+
+        /// Reports go out after the step, so they do not disturb it.  The
+        /// next step starts LINK_LEAD later, which is enough time for them.
+        sub_wait_until(start);
+        sub_report_step(step);
+    }
+
+    sub_report_end();
+}
+
+
+
+
+/** User Applet and Button Management Routines <BR>
+  * ========================================================================<BR>
+  */
+void main(void) {
+    ///1. Standard Power-on routine (Clocks, Timers, IRQ's, etc)
+    ///2. Standard OpenTag Init
+    platform_poweron();
+    platform_init_OT();
+
+    ///3. Run the test plan, with the kernel not started.  On POSIX, run it
+    ///   once and exit the way a node is powered-down.  Elsewhere, run it
+    ///   over and over.
+    link_init();
+    while (1) {
+        link_run();
+#       if defined(PLATFORM_POSIX)
+            kill(getpid(), SIGTERM);
+#       endif
+        if (radiolink.role == LINK_ROLE_SOURCE) {
+            sub_wait_until(sub_ticks() + LINK_REST_TICKS);
+        }
+    }
+}
+
+
+
+
+/** Default File data <BR>
+  * ========================================================================<BR>
+  */
+#include "data_default.c"
@@ -67,6 +67,22 @@
 
 
 
+/** Power Consumption Estimates <BR>
+  * ========================================================================<BR>
+  * Typical currents in uA, from the datasheets, for the kernel energy account
+  * (OT_FEATURE_ENERGY).  CC430 radio core at 433 MHz, +10 dBm; the core
+  * sleeps with the MCU.  LPMuA has one value per low power mode of the
+  * platform.
+  */
+#define BOARD_PARAM_RFOFFuA             0                       // Radio asleep
+#define BOARD_PARAM_RXuA                15000                   // Radio in RX
+#define BOARD_PARAM_TXuA                29000                   // Radio in TX
+#define BOARD_PARAM_CPUuA               4000                    // CPU active
+#define BOARD_PARAM_LPMuA               { 70, 2, 1 }            // CPU in each LPM
+
+
+
+
 /** Platform Memory Configuration <BR>
   * ========================================================================<BR>
   * OpenTag needs to know where it can put Nonvolatile memory (file system) and
@@ -122,6 +138,7 @@
 #define MCU_FEATURE_MAPEEPROM            DISABLED
 #define MCU_FEATURE_MPIPEDMA             ENABLED
 #define MCU_FEATURE_MEMCPYDMA            DISABLED   // Must be disabled if MPIPEDMA is enabled
+#define MCU_FEATURE_RANDDMA              ENABLED    // ADC entropy harvest in background (see platform_rand())
 
 
 
@@ -255,6 +272,7 @@
 #define OT_GWNADC_PORT      GPIO2
 #define OT_GWNADC_PIN       GPIO_Pin_1
 #define OT_GWNADC_BITS      1
+#define OT_GWNADC_CHAN      1               // ADC12 input channel of GWNADC pin
 //#define OT_GWNZENER_PORT    GPIO2
 //#define OT_GWNZENER_PIN     GPIO_Pin_2
 //#define OT_GWNZENER_HIDRIVE DISABLED
@@ -296,6 +314,19 @@
 #       define MPIPE_DMA     DMA2
 #   else
 #       error "MPIPE_DMANUM is not defined to an available index (0-2)"
+#   endif
+
+    // Full duplex MPipe also needs a DMA for RX.  DMA1 is free while
+    // MEMCPYDMA is disabled.
+#   define MPIPE_RXDMANUM  1
+#   if (MPIPE_RXDMANUM == 0)
+#       define MPIPE_RXDMA   DMA0
+#   elif (MPIPE_RXDMANUM == 1)
+#       define MPIPE_RXDMA   DMA1
+#   elif (MPIPE_RXDMANUM == 2)
+#       define MPIPE_RXDMA   DMA2
+#   else
+#       error "MPIPE_RXDMANUM is not defined to an available index (0-2)"
 #   endif
 #endif
 
@@ -340,6 +371,20 @@
 
 
 
+#if (MCU_FEATURE_RANDDMA == ENABLED)
+#   define RAND_DMANUM      0
+#   if (RAND_DMANUM == 0)
+#       define RAND_DMA       DMA0
+#   elif (RAND_DMANUM == 1)
+#       define RAND_DMA       DMA1
+#   elif (RAND_DMANUM == 2)
+#       define RAND_DMA       DMA2
+#   else
+#       error "RAND_DMANUM is not defined to an available index (0-2)"
+#   endif
+#endif
+
+
 #if (MCU_FEATURE_MEMCPYDMA == ENABLED)
 #   define MEMCPY_DMANUM    1
 #   if (MEMCPY_DMANUM == 0)
@@ -90,6 +90,7 @@
 #define MCU_FEATURE_MAPEEPROM            DISABLED
 #define MCU_FEATURE_MPIPEDMA             (DISABLED || MPIPE_FOR_DEBUGGING)      // MPipe is only useful for debug mode
 #define MCU_FEATURE_MEMCPYDMA            (ENABLED && !MCU_FEATURE_MPIPEDMA)      // Must be disabled if MPIPEDMA is enabled
+#define MCU_FEATURE_RANDDMA              ENABLED    // ADC entropy harvest in background (see platform_rand())
 
 #define MCU_PARAM(VAL)                  MCU_PARAM_##VAL
 #define MCU_PARAM_POINTERSIZE           2
@@ -191,6 +192,22 @@ OT_INLINE_H void BOARD_XTAL_STARTUP(void) {
 
 
 
+/** Power Consumption Estimates <BR>
+  * ========================================================================<BR>
+  * Typical currents in uA, from the datasheets, for the kernel energy account
+  * (OT_FEATURE_ENERGY).  CC430 radio core at 433 MHz, +10 dBm; the core
+  * sleeps with the MCU.  LPMuA has one value per low power mode of the
+  * platform.
+  */
+#define BOARD_PARAM_RFOFFuA             0                       // Radio asleep
+#define BOARD_PARAM_RXuA                15000                   // Radio in RX
+#define BOARD_PARAM_TXuA                29000                   // Radio in TX
+#define BOARD_PARAM_CPUuA               2500                    // CPU active
+#define BOARD_PARAM_LPMuA               { 70, 2, 1 }            // CPU in each LPM
+
+
+
+
 /** Platform Memory Configuration <BR>
   * ========================================================================<BR>
   * OpenTag needs to know where it can put Nonvolatile memory (file system) and
@@ -417,6 +434,7 @@ OT_INLINE_H void BOARD_XTAL_STARTUP(void) {
 #define OT_GWNADC_PORT      GPIO2
 #define OT_GWNADC_PIN       GPIO_Pin_5
 #define OT_GWNADC_BITS      1
+#define OT_GWNADC_CHAN      5               // ADC12 input channel of GWNADC pin
 //#define OT_GWNZENER_PORT    GPIO2
 //#define OT_GWNZENER_PIN     GPIO_Pin_4
 //#define OT_GWNZENER_HIDRIVE DISABLED
@@ -468,6 +486,20 @@ OT_INLINE_H void BOARD_XTAL_STARTUP(void) {
 
 
 
+#if (MCU_FEATURE_RANDDMA == ENABLED)
+#   define RAND_DMANUM      0
+#   if (RAND_DMANUM == 0)
+#       define RAND_DMA       DMA0
+#   elif (RAND_DMANUM == 1)
+#       define RAND_DMA       DMA1
+#   elif (RAND_DMANUM == 2)
+#       define RAND_DMA       DMA2
+#   else
+#       error "RAND_DMANUM is not defined to an available index (0-2)"
+#   endif
+#endif
+
+
 #if (MCU_FEATURE_MEMCPYDMA == ENABLED)
 #   define MEMCPY_DMANUM    1
 #   if (MEMCPY_DMANUM == 0)
@@ -177,6 +177,21 @@ OT_INLINE_H void BOARD_XTAL_STARTUP(void) {
 
 
 
+/** Power Consumption Estimates <BR>
+  * ========================================================================<BR>
+  * Typical currents in uA, from the datasheets, for the kernel energy account
+  * (OT_FEATURE_ENERGY).  CC1101EMK at 433 MHz, +10 dBm, and the F5529 core.
+  * LPMuA has one value per low power mode of the platform.
+  */
+#define BOARD_PARAM_RFOFFuA             1                       // Radio asleep
+#define BOARD_PARAM_RXuA                16000                   // Radio in RX
+#define BOARD_PARAM_TXuA                29000                   // Radio in TX
+#define BOARD_PARAM_CPUuA               4500                    // CPU active
+#define BOARD_PARAM_LPMuA               { 70, 2, 1 }            // CPU in each LPM
+
+
+
+
 /** Platform Memory Configuration <BR>
   * ========================================================================<BR>
   * OpenTag needs to know where it can put Nonvolatile memory (file system) and
@@ -454,7 +469,8 @@ OT_INLINE_H void BOARD_RADIO_SPI_PORTCONF() {
 // If using the normal UART, it is wired to {rx,tx} = {4.4,4.5}.  CTS/RTS could
 // hypothetically be implemented on 4.6/4.7, which are unused.  All other USCIs
 // on the EXP430F5529 board are utilized by other features.
-#if (MCU_FEATURE_MPIPEVCOM != ENABLED)
+// The UART is also used next to USB when MPipe has ports (OT_FEATURE_MPIPE_PORTS).
+#if ((MCU_FEATURE_MPIPEVCOM != ENABLED) || (OT_FEATURE_MPIPE_PORTS == ENABLED))
 #   define MPIPE_UARTNUM        2
 #   define MPIPE_UART_PORTNUM   4
 #   define MPIPE_UART_PORT      GPIO4
@@ -538,14 +554,16 @@ OT_INLINE_H void BOARD_RADIO_SPI_PORTCONF() {
 #define PALFI_UARTRX_MAP    PM_UCA1RXD
 #define PALFI_UARTTX_MAP    PM_UCA1TXD
 #define PALFI_TIMOC_MAP     PM_TB0CCR1A
+#define PALFI_TXCT_MAP      PALFI_Px->MAP5
+#define PALFI_SCIO_MAP      PALFI_Px->MAP4
 
 #define PALFI_PORT          GPIO4
 #define PALFI_TXCT_PIN      GPIO_Pin_5
 #define PALFI_SCIO_PIN      GPIO_Pin_4
 #define PALFI_PINS          (PALFI_TXCT_PIN | PALFI_SCIO_PIN)
 
-#define PALFI_TIMER_VECTOR  TIMER0_B0_VECTOR
-#define PALFI_UART_VECTOR   UCA1_VECTOR
+#define PALFI_TIMER_VECTOR  TIMER0_B1_VECTOR   // CCR1-6 & overflow
+#define PALFI_UART_VECTOR   USCI_A1_VECTOR
 
 
 
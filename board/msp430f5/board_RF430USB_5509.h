@@ -181,6 +181,21 @@ OT_INLINE_H void BOARD_XTAL_STARTUP(void) {
 
 
 
+/** Power Consumption Estimates <BR>
+  * ========================================================================<BR>
+  * Typical currents in uA, from the datasheets, for the kernel energy account
+  * (OT_FEATURE_ENERGY).  CC1101 at 433 MHz, +10 dBm, and the F5509 core.
+  * LPMuA has one value per low power mode of the platform.
+  */
+#define BOARD_PARAM_RFOFFuA             1                       // Radio asleep
+#define BOARD_PARAM_RXuA                16000                   // Radio in RX
+#define BOARD_PARAM_TXuA                29000                   // Radio in TX
+#define BOARD_PARAM_CPUuA               4000                    // CPU active
+#define BOARD_PARAM_LPMuA               { 70, 2, 1 }            // CPU in each LPM
+
+
+
+
 /** Platform Memory Configuration <BR>
   * ========================================================================<BR>
   * The RF430_5509 is __severely__ resource constrained.  The Veelite for this
@@ -401,16 +416,17 @@ OT_INLINE_H void BOARD_RADIO_SPI_ATTACH() {
 
 // DMA is generally deprecated with MSP430, because it is so limited, it is
 // better deployed for other purposes, and because most radios have their own
-// FIFO's these days.
-//#define RADIO_DMA_INDEX     
-//#define RADIO_DMA_RXINDEX   
-//#define RADIO_DMA_TXINDEX           
-//#define RADIO_DMA_RXCHAN    
-//#define RADIO_DMA_RXVECTOR  
-//#define RADIO_DMA_RXINT  	
-//#define RADIO_DMA_TXCHAN    
-//#define RADIO_DMA_TXVECTOR  
-//#define RADIO_DMA_TXINT  	
+// FIFO's these days.  With MCU_FEATURE_RADIODMA, the CC1101 driver clocks
+// its TX FIFO bursts with DMA0, the channel that MEMCPY and MPipe leave free.
+// RX bursts also use DMA if a second channel is given as RADIO_DMA_RX.
+#if (MCU_FEATURE_RADIODMA == ENABLED)
+#   define RADIO_DMA_TXNUM      0
+#   define RADIO_DMA_TX         DMA0
+#   define RADIO_DMA_TXTRIG     23 //DMA_Trigger_UCB1TXIFG
+//#   define RADIO_DMA_RXNUM      
+//#   define RADIO_DMA_RX         
+#   define RADIO_DMA_RXTRIG     22 //DMA_Trigger_UCB1RXIFG
+#endif
 
 #define RADIO_IRQ_PORT      GPIO2 
 #define RADIO_IRQ_SRC()     GPIO2->P2IV
@@ -451,7 +467,8 @@ OT_INLINE_H void BOARD_RADIO_SPI_ATTACH() {
 // If using the normal UART, it is wired to {rx,tx} = {4.4,4.5}.  CTS/RTS could
 // hypothetically be implemented on 4.6/4.7, which are unused.  All other USCIs
 // on the EXP430F5529 board are utilized by other features.
-#if (MCU_FEATURE_MPIPEVCOM != ENABLED)
+// The UART is also used next to USB when MPipe has ports (OT_FEATURE_MPIPE_PORTS).
+#if ((MCU_FEATURE_MPIPEVCOM != ENABLED) || (OT_FEATURE_MPIPE_PORTS == ENABLED))
 #   define MPIPE_UARTNUM        2
 #   define MPIPE_UART_PORTNUM   4
 #   define MPIPE_UART_PORT      GPIO4
@@ -0,0 +1,216 @@
+/* Copyright 2009-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /board/POSIX/board_POSIX.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Board Configuration for a virtual node on a POSIX host
+  * @ingroup    Platform
+  *
+  * A "board" here is one process on a Linux/POSIX host.  Many of them can run
+  * on one machine, and they talk to each other through the simulated radio in
+  * /otradio/posix.  See /otplatform/posix/_Readme_POSIX.txt.
+  *
+  * Do not include this file, include OT_platform.h
+  ******************************************************************************
+  */
+
+
+#ifndef __board_POSIX_H
+#define __board_POSIX_H
+
+#include "build_config.h"
+#include "platform_POSIX.h"
+#include "radio_POSIX.h"
+
+
+
+/// Macro settings: ENABLED, DISABLED, NOT_AVAILABLE
+#ifdef ENABLED
+#   undef ENABLED
+#endif
+#define ENABLED  1
+
+#ifdef DISABLED
+#   undef DISABLED
+#endif
+#define DISABLED  0
+
+#ifdef NOT_AVAILABLE
+#   undef NOT_AVAILABLE
+#endif
+#define NOT_AVAILABLE   DISABLED
+
+
+
+
+/** Additional RF Front End Parameters and Settings <BR>
+  * ========================================================================<BR>
+  * The simulated radio has no band, but some app code looks for it.
+  */
+#define RF_PARAM_BAND   433
+
+
+
+/** Power Consumption Estimates <BR>
+  * ========================================================================<BR>
+  * Typical currents in uA, for the kernel energy account (OT_FEATURE_ENERGY).
+  * The simulator draws no current of its own, so these are the figures of a
+  * CC1101 board, to give the account something to show.  LPMuA has one value
+  * per low power mode of the platform.
+  */
+#define BOARD_PARAM_RFOFFuA             1                       // Radio asleep
+#define BOARD_PARAM_RXuA                16000                   // Radio in RX
+#define BOARD_PARAM_TXuA                29000                   // Radio in TX
+#define BOARD_PARAM_CPUuA               4500                    // CPU active
+#define BOARD_PARAM_LPMuA               { 70 }                  // CPU in each LPM
+
+
+
+
+/** Platform Memory Configuration <BR>
+  * ========================================================================<BR>
+  * The file system is an image file (see veelite_core_POSIX.c) that is mapped
+  * into memory, so the "flash" starts at address 0 of the image.  There is no
+  * erase cycle, so there are no fallow pages.
+  */
+#define SRAM_START_ADDR         0x0000
+#define SRAM_SIZE               (64*1024)
+#define EEPROM_START_ADDR       0
+#define EEPROM_SIZE             0
+#define FLASH_START_ADDR        0x0000
+#define FLASH_START_PAGE        0
+#define FLASH_PAGE_SIZE         512
+#define FLASH_NUM_PAGES         16
+#define FLASH_WORD_BYTES        2
+#define FLASH_WORD_BITS         (FLASH_WORD_BYTES*8)
+#define FLASH_FS_ALLOC          (FLASH_PAGE_SIZE*FLASH_NUM_PAGES)
+#define FLASH_FS_ADDR           0x0000
+#define FLASH_FS_FALLOWS        0
+#define FLASH_PAGE_ADDR(VAL)    (FLASH_START_ADDR + ( (VAL) * FLASH_PAGE_SIZE) )
+
+
+
+
+
+/** MCU Feature settings      <BR>
+  * ========================================================================<BR>
+  * The host has none of the MCU peripherals, so CRC and AES run in software.
+  */
+#define MCU_FEATURE(VAL)                 MCU_FEATURE_##VAL       // FEATURE                  AVAILABILITY
+#define MCU_FEATURE_CRC                  DISABLED                // CCITT CRC16              Low
+#define MCU_FEATURE_AES128               DISABLED                // AES128 engine            Moderate
+#define MCU_FEATURE_ECC                  DISABLED                // ECC engine               Low
+#define MCU_FEATURE_ALGE                 DISABLED                // Algebraic Eraser engine  Rare/None yet
+#define MCU_FEATURE_RADIODMA             DISABLED
+#define MCU_FEATURE_RADIODMA_TXBYTES     0
+#define MCU_FEATURE_RADIODMA_RXBYTES     0
+#define MCU_FEATURE_MAPEEPROM            DISABLED
+#define MCU_FEATURE_MPIPEDMA             DISABLED
+#define MCU_FEATURE_MEMCPYDMA            DISABLED
+#define MCU_FEATURE_RANDDMA              DISABLED
+
+
+
+
+/** Peripheral definitions for this platform <BR>
+  * ========================================================================<BR>
+  * Interrupts are POSIX signals.  Each "vector" is the signal that a driver
+  * installs its handler on with platform_posix_isr().  The handlers mask each
+  * other, like MCU interrupts of the same priority.
+  *
+  * OT_GPTIM:   General Purpose Timer used by OpenTag kernel (a POSIX timer)<BR>
+  * RADIO:      Simulated radio datagram input, and radio event timer       <BR>
+  * MPIPE:      TX done event of the stdout MPipe                          <BR>
+  * MPIPE_RX:   Input on the stdin MPipe (O_ASYNC, a real-time signal)     <BR>
+  */
+#define OT_GPTIM_VECTOR         SIGALRM
+#define OT_GPTIM_CLOCK          CLOCK_MONOTONIC
+#define OT_GPTIM_RES            1024
+#define OT_GPTIM_ERROR          0
+#define OT_GPTIM_ERRDIV         32768
+#define TI_TO_CLK(VAL)          ((OT_GPTIM_RES/1024)*VAL)
+#define CLK_TO_TI(VAL)          (VAL/(OT_GPTIM_RES/1024))
+
+#define RADIO_IRQ_VECTOR        SIGIO
+#define RADIO_TIM_VECTOR        SIGUSR1
+
+#define MPIPE_VECTOR            SIGURG
+#define MPIPE_RX_VECTOR         (SIGRTMIN+1)
+
+#define PLATFORM_GPTIM_HZ       1024
+#define PLATFORM_GPTIM_PS       1
+#define PLATFORM_GPTIM_CLK      1024
+#define PLATFORM_GPTIM_RES      OT_GPTIM_RES
+#define PLATFORM_GPTIM_ERROR    OT_GPTIM_ERROR
+#define PLATFORM_GPTIM_ERRDIV   OT_GPTIM_ERRDIV
+#define PLATFORM_GPTIM_DEV      0
+
+#define GPTIM_HZ_TI             1024
+#define GPTIM_HZ_STI            32768
+
+
+
+
+/** Simulated Radio Network <BR>
+  * ========================================================================<BR>
+  * Every node on the same multicast group and port hears every other node.
+  * The link budget is the same for all pairs: RSSI = TX EIRP - path loss.
+  * The environment variables OT_GROUP, OT_PORT and OT_PATHLOSS override these
+  * at run time, so different experiments do not need different builds.
+  */
+#define RADIO_POSIX_GROUP       "239.255.7.7"
+#define RADIO_POSIX_PORT        7007
+#define RADIO_POSIX_PATHLOSS    60          // dB
+#define RADIO_POSIX_NOISEFLOOR  (-120)      // dBm
+
+
+
+
+/** Flash Memory Setup:
+  * "OTF" means "Open Tag Flash," but if flash is not used, it just means
+  * storage memory.  Unfortunately this does not begin with F.
+  */
+#define OTF_VWORM_PAGES         (FLASH_FS_ALLOC/FLASH_PAGE_SIZE)
+#define OTF_VWORM_FALLOW_PAGES  FLASH_FS_FALLOWS
+#define OTF_VWORM_PAGESIZE      FLASH_PAGE_SIZE
+#define OTF_VWORM_WORD_BYTES    FLASH_WORD_BYTES
+#define OTF_VWORM_WORD_BITS     FLASH_WORD_BITS
+#define OTF_VWORM_SIZE          (OTF_VWORM_PAGES * OTF_VWORM_PAGESIZE)
+#define OTF_VWORM_START_PAGE    ((FLASH_FS_ADDR-FLASH_START_ADDR)/FLASH_PAGE_SIZE)
+#define OTF_VWORM_START_ADDR    FLASH_FS_ADDR
+
+#define OTF_CRC_TABLE           DISABLED
+#define OTF_UHF_TABLE           DISABLED
+#define OTF_UHF_TABLESIZE       0
+#define OTF_M1_ENCODE_TABLE     DISABLED
+#define OTF_M2_ENCODE_TABLE     ENABLED
+
+// Total number of pages taken from program memory
+#define OTF_TOTAL_PAGES         (OTF_VWORM_PAGES)
+
+#define OTF_TOTAL_SIZE          FLASH_FS_ALLOC
+#define OTF_START_PAGE          OTF_VWORM_START_PAGE
+#define OTF_START_ADDR          FLASH_FS_ADDR
+
+#define OTF_VWORM_LAST_PAGE     (OTF_VWORM_START_PAGE + OTF_VWORM_PAGES - 1)
+#define OTF_VWORM_END_ADDR      (FLASH_FS_ADDR + FLASH_FS_ALLOC - 1)
+
+
+
+
+#endif
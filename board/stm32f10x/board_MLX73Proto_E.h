@@ -81,6 +81,21 @@
 
 
 
+/** Power Consumption Estimates <BR>
+  * ========================================================================<BR>
+  * Typical currents in uA, from the datasheets, for the kernel energy account
+  * (OT_FEATURE_ENERGY).  MLX73290 at +10 dBm, and the STM32F103 at 72 MHz
+  * (SLEEP only).  LPMuA has one value per low power mode of the platform.
+  */
+#define BOARD_PARAM_RFOFFuA             1                       // Radio asleep
+#define BOARD_PARAM_RXuA                18000                   // Radio in RX
+#define BOARD_PARAM_TXuA                31000                   // Radio in TX
+#define BOARD_PARAM_CPUuA               36000                   // CPU active
+#define BOARD_PARAM_LPMuA               { 14000 }               // CPU in each LPM
+
+
+
+
 /** Platform Memory Configuration <BR>
   * ========================================================================<BR>
   * OpenTag needs to know where it can put Nonvolatile memory (file system) and
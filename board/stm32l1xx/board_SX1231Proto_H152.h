@@ -76,6 +76,21 @@
 
 
 
+/** Power Consumption Estimates <BR>
+  * ========================================================================<BR>
+  * Typical currents in uA, from the datasheets, for the kernel energy account
+  * (OT_FEATURE_ENERGY).  SX1231 at +13 dBm, and the STM32L152 at 32 MHz
+  * (SLEEP, STOP).  LPMuA has one value per low power mode of the platform.
+  */
+#define BOARD_PARAM_RFOFFuA             1                       // Radio asleep
+#define BOARD_PARAM_RXuA                16000                   // Radio in RX
+#define BOARD_PARAM_TXuA                45000                   // Radio in TX
+#define BOARD_PARAM_CPUuA               7000                    // CPU active
+#define BOARD_PARAM_LPMuA               { 1500, 2 }             // CPU in each LPM
+
+
+
+
 /** Platform Memory Configuration <BR>
   * ========================================================================<BR>
   * OpenTag needs to know where it can put Nonvolatile memory (file system) and
@@ -45,13 +45,25 @@
 
 #include "auth.h"
 #include "buffers.h"
+#include "crc16.h"
 #include "m2_network.h"
 #include "m2_transport.h"
 #include "external.h"
+#include "prand.h"
 #include "queue.h"
 #include "radio.h"
 #include "session.h"
 #include "veelite.h"
+#include "vsflash.h"
+#include "tms3705.h"
+
+#if (LOG_FEATURE(DEFERRED) == ENABLED)
+#   include "OTAPI.h"
+#endif
+#if (((OT_FEATURE(POWERMGR) == ENABLED) && (OT_FEATURE(MPIPE) == ENABLED)) || \
+     (OT_FEATURE(SNIFFER) == ENABLED) || (OT_FEATURE(RESPFWD) == ENABLED))
+#   include "mpipe.h"
+#endif
 
 
 #define SWDP    OT_FEATURE(WATCHDOG_PERIOD)
@@ -78,6 +90,247 @@
 #endif
 
 
+/** Power Manager Defaults
+  * A platform without a low power mode table just has SLEEP_MCU().
+  */
+#if (OT_FEATURE(POWERMGR) == ENABLED)
+#   ifndef PLATFORM_LPM_MODES
+#       define PLATFORM_LPM_MODES           1
+#       define PLATFORM_LPM_UNTIMED         1
+#       define PLATFORM_LPM_WAKE_STI        { 0 }
+#       define PLATFORM_LPM_CLKSTART_STI    0
+#       define platform_enter_lpm(MODE)     do { platform_enable_interrupts(); SLEEP_MCU(); } while(0)
+#   endif
+#   if (PLATFORM_LPM_MODES > SYS_PM_MODES)
+#       error "PLATFORM_LPM_MODES is more than SYS_PM_MODES"
+#   endif
+#endif
+
+/** Energy Account Defaults
+  * A board without current figures gets its time counted, with no charge.
+  */
+#if (OT_FEATURE(ENERGY) == ENABLED)
+#   ifndef BOARD_PARAM_RFOFFuA
+#       define BOARD_PARAM_RFOFFuA  0
+#   endif
+#   ifndef BOARD_PARAM_RXuA
+#       define BOARD_PARAM_RXuA     0
+#   endif
+#   ifndef BOARD_PARAM_TXuA
+#       define BOARD_PARAM_TXuA     0
+#   endif
+#   ifndef BOARD_PARAM_CPUuA
+#       define BOARD_PARAM_CPUuA    0
+#   endif
+#   ifndef BOARD_PARAM_LPMuA
+#       define BOARD_PARAM_LPMuA    { 0 }
+#   endif
+#endif
+
+/** Clock Scaling
+  * A platform without performance levels runs at one speed.
+  */
+#if ((OT_FEATURE(CLKSCALE) == ENABLED) && defined(PLATFORM_PERF_LEVELS))
+#   define SYS_CLKSCALE     ENABLED
+#else
+#   define SYS_CLKSCALE     DISABLED
+#endif
+
+/** Response Pool
+  * Only gateways and subcontrollers collect responses (see sub_rxpool_hold()).
+  */
+#if ((OT_PARAM(RXPOOL) > 0) && \
+     ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED)))
+#   define SYS_RXPOOL       ENABLED
+#else
+#   define SYS_RXPOOL       DISABLED
+#endif
+
+/** Auxiliary Receiver
+  * A gateway with a second receiver (RF_FEATURE_AUXRX) listens on it while it
+  * transmits.  What it hears goes to the response pool, so it needs the pool.
+  */
+#if ((RF_FEATURE(AUXRX) == ENABLED) && (SYS_RXPOOL == ENABLED))
+#   define SYS_AUXRX        ENABLED
+#else
+#   define SYS_AUXRX        DISABLED
+#endif
+
+/** RTC Scheduler
+  * sched_id (1 to 3) is the RTC alarm of an idle event.  SCHED_ARMED is set
+  * in sched_id once the alarm is loaded from the scheduler ISF.  An event
+  * that waits for its alarm has nextevent = SCHED_WAIT, so it is never due by
+  * clocking.
+  */
+#if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
+#   define SCHED_ARMED      0x80
+#   define SCHED_WAIT       ((ot_long)0x7FFFFFFF)
+#endif
+
+
+/** Schedule Tables
+  * The hold scan, sleep scan and beacon transmit sequences are decoded into
+  * RAM by sub_schedule_refresh(), so the idle event processors index an array
+  * instead of opening the ISF.  sys_refresh() loads them, and after that they
+  * are loaded again only when veelite reports that a file has changed 
+  * (vl_writestamp, vl_mapstamp).  Event cursors stay byte offsets into the 
+  * ISF, so the cursor resets elsewhere in the kernel work as before.
+  *
+  * stamp       value of vl_writestamp + vl_mapstamp when tables were loaded
+  * valid       False forces the tables to be reloaded
+  * xxx_count   number of datums in each table
+  * hss[], sss[]: channel, scan flags, Next Scan ticks (host endian)
+  * bts[]       channel, beacon params, ISF call template, Next Beacon ticks
+  */
+#define SCHED_HSS_DATUMS    (ISF_MAX(hold_scan_sequence) / 4)
+#define SCHED_SSS_DATUMS    (ISF_MAX(sleep_scan_sequence) / 4)
+#define SCHED_BTS_DATUMS    (ISF_MAX(beacon_transmit_sequence) / 8)
+
+/// A gateway with network time sync keeps the sleep scan table too, for
+/// sys_netsync_eta()
+#define SCHED_SSS_TABLE     ((M2_FEATURE(ENDPOINT) == ENABLED) || (OT_FEATURE(NETSYNC) == ENABLED))
+
+typedef struct {
+    ot_u8   channel;
+    ot_u8   flags;
+    ot_u16  next;
+} sched_scan;
+
+typedef struct {
+    ot_u8   channel;
+    ot_u8   params;
+    ot_u8   call[4];
+    ot_u16  next;
+} sched_beacon;
+
+typedef struct {
+    ot_u16          stamp;
+    ot_bool         valid;
+    ot_u8           hss_count;
+    sched_scan      hss[SCHED_HSS_DATUMS];
+#   if (SCHED_SSS_TABLE)
+    ot_u8           sss_count;
+    sched_scan      sss[SCHED_SSS_DATUMS];
+#   endif
+#   if (M2_FEATURE(BEACONS) == ENABLED)
+    ot_u8           bts_count;
+    sched_beacon    bts[SCHED_BTS_DATUMS];
+#   endif
+} sched_table;
+
+static sched_table schedule;
+
+
+/** ISF Changes
+  * The bits of vl_isfchange that sys_reconfigure() handles.  The scan and
+  * beacon sequence bits also name the idle events to restart, in the restart
+  * mask of sub_idlevt_restart().
+  */
+#define SYS_ISFCHANGE(NAME) ((ot_u16)1 << ISF_ID(NAME))
+#define SYS_ISFCHANGE_EVENTS ( SYS_ISFCHANGE(sleep_scan_sequence) \
+                             | SYS_ISFCHANGE(hold_scan_sequence) \
+                             | SYS_ISFCHANGE(beacon_transmit_sequence) )
+#define SYS_ISFCHANGE_MASK  ( SYS_ISFCHANGE_EVENTS \
+                            | SYS_ISFCHANGE(network_settings) \
+                            | SYS_ISFCHANGE(channel_configuration) \
+                            | SYS_ISFCHANGE(real_time_scheduler) )
+
+
+/** Beacon Frame Cache
+  * See SYS_BEACON_CACHE in system_native.h.  The frame is saved after 
+  * m2np_footer(), so it includes the length byte at frame[0].
+  *
+  * stamp       value of vl_writestamp + vl_mapstamp when the frame was built
+  * index       beacon datum that built the frame (SCHED_NONE = empty cache)
+  * fr_info     m2np.header.fr_info of the frame
+  * addr_ctl    m2np.header.addr_ctl of the frame
+  * length      bytes in frame[]
+  * netpos      offset of the network time in frame[], 0 if none (NETSYNC)
+  * frame[]     the frame, without CRC
+  */
+#define SCHED_NONE          0xFF
+#define SCHED_DIALOGID      4       // offset of the dialog ID in a beacon
+
+#if (SYS_BEACON_CACHE)
+typedef struct {
+    ot_u16  stamp;
+    ot_u8   index;
+    ot_u8   fr_info;
+    ot_u8   addr_ctl;
+    ot_u8   length;
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+    ot_u8   netpos;
+#   endif
+    ot_u8   frame[SYS_BEACON_CACHE_SIZE];
+} beacon_cache;
+
+static beacon_cache bcache;
+#endif
+
+
+/** Scan Hops
+  * See SYS_SCAN_HOPS in system_native.h.  sub_scan_channel() fills the list 
+  * and arms it, and the listen that fscan or bscan starts next takes it.  
+  * rx_chanlist points into chan[] and moves one channel ahead on each hop, so
+  * rx_chanlist[0] is always the channel being scanned.
+  *
+  * armed       hops for the next listen that starts
+  * left        hops left in the listen underway
+  * chan[]      channel of each hop
+  * dwell[]     scan timeout of each hop
+  */
+#if (SYS_SCANHOP)
+typedef struct {
+    ot_u8   armed;
+    ot_u8   left;
+    ot_u8   chan[SYS_SCAN_HOPS];
+    ot_uint dwell[SYS_SCAN_HOPS];
+} scan_hops;
+
+static scan_hops scanhop;
+#endif
+
+
+/** Response Replay Cache
+  * See SYS_RESP_CACHE in system_native.h.  The request is keyed before it is
+  * routed, and the response is saved after it, together with the state that
+  * routing leaves for the rest of TASK_processing and for the TX.
+  *
+  * time        platform_stamp() when the request was routed
+  * stamp       value of vl_writestamp + vl_mapstamp after routing
+  * hash        CRC of the request from the subnet byte to the end of payload
+  * req_length  length byte of the request, without CRC (0 = empty cache)
+  * length      bytes in frame[]
+  * score       the score that network_route_ff() returned
+  * id[]        dialog ID, address control and source address of the request
+  * session     the session fields that routing set
+  * cmd         m2qp.cmd of the request
+  * header, rt  m2np.header and m2np.rt after routing
+  * comm        dll.comm after routing
+  * frame[]     the response frame, without CRC
+  */
+#if (SYS_RESP_CACHE)
+typedef struct {
+    ot_u32          time;
+    ot_u16          stamp;
+    ot_u16          hash;
+    ot_u8           req_length;
+    ot_u8           length;
+    ot_int          score;
+    ot_u8           id[10];
+    m2session       session;
+    cmd_data        cmd;
+    header_struct   header;
+    routing_tmpl    rt;
+    m2comm_struct   comm;
+    ot_u8           frame[SYS_RESP_CACHE_SIZE];
+} resp_cache;
+
+static resp_cache rcache;
+#endif
+
+
+
 /** Persistent Data Structures 
   */
 m2dll_struct    dll;
@@ -110,6 +363,7 @@ void rfevt_bscan(ot_int scode, ot_int fcode);
 void rfevt_frx(ot_int pcode, ot_int fcode);
 void rfevt_ftx(ot_int pcode, ot_int scratch);
 void rfevt_btx(ot_int flcode, ot_int scratch);
+void rfevt_sniff(ot_int pcode, ot_int fcode);
 
 
 
@@ -119,6 +373,24 @@ void rfevt_btx(ot_int flcode, ot_int scratch);
   * ============================================================================
   * Just used to make the code nice-looking or for code-reuse
   */
+
+/// Sets the radio level of sys.mutex, and keeps the other resource locks.  The
+/// energy account follows the radio level.
+#if (OT_FEATURE(ENERGY) == ENABLED)
+#   define SYS_RADIO_MUTEX(LEVEL)  \
+        do { sys.mutex = (sys.mutex & ~SYS_MUTEX_RADIO) | (LEVEL); sub_energy_radio(); } while(0)
+#else
+#   define SYS_RADIO_MUTEX(LEVEL)  (sys.mutex = (sys.mutex & ~SYS_MUTEX_RADIO) | (LEVEL))
+#endif
+
+/// Counts a link event, or a link event on a channel (see OT_FEATURE_LINKSTATS)
+#if (OT_FEATURE(LINKSTATS) == ENABLED)
+#   define SYS_LS_COUNT(ID)         sub_ls_count(ID)
+#   define SYS_LS_CHANNEL(ID, CH)   sub_ls_channel(ID, CH)
+#else
+#   define SYS_LS_COUNT(ID)         do { } while(0)
+#   define SYS_LS_CHANNEL(ID, CH)   do { } while(0)
+#endif
   
 typedef enum {
     TASK_idle       = 0,
@@ -137,14 +409,49 @@ typedef enum {
 #   endif
     TASK_terminus
 } Task_Index;
-  
-Task_Index sub_clock_tasks(ot_uint elapsed);
-
-void    sub_scan_channel(idletime_event* idlevt, ot_u8 SS_ISF);
 
+#if (SYS_CLKSCALE == ENABLED)
+static const ot_u8 sys_task_perf[TASK_terminus] = {
+    SYS_PERF_LOW,       // TASK_idle: loadapp, veelite maintenance
+    SYS_PERF_HIGH,      // TASK_processing: parse the frame, build the response
+    SYS_PERF_MID,       // TASK_radio: CSMA-CA, RX setup
+    SYS_PERF_MID,       // TASK_session: build the request
+    SYS_PERF_LOW,       // TASK_hold
+#   if (M2_FEATURE(ENDPOINT) == ENABLED)
+    SYS_PERF_LOW,       // TASK_sleep
+#   endif
+#   if (M2_FEATURE(BEACONS) == ENABLED)
+    SYS_PERF_MID,       // TASK_beacon: build the beacon
+#   endif
+#   if (OT_FEATURE(EXTERNAL_EVENT) == ENABLED)
+    SYS_PERF_LOW,       // TASK_external
+#   endif
+};
+#endif
+  
+Task_Index sub_clock_tasks(ot_u32 elapsed);
+ot_long sub_idle_work(ot_long event_eta);
+ot_bool sub_run_apptask(ot_long* event_eta);
+ot_bool sub_run_extevent(ot_long event_eta);
+void    sub_dialog_check();
+void    sub_dialog_txdone(m2session* session);
+void    sub_dialog_nochannel(m2session* session);
+ot_u32  sub_event_manager(ot_u32 elapsed);
+
+void    sub_schedule_refresh();
+void    sub_scan_channel(idletime_event* idlevt, const sched_scan* seq, ot_u8 count);
+ot_bool sub_sniff(ot_u8 channel, ot_u8 netstate, ot_sig2 callback);
+void    sub_scan_arm();
+ot_bool sub_scan_hop();
+
+void    sub_netconf_load();
+void    sub_idlevt_restart(ot_u16 restart);
 void    sub_sys_flush();
 ot_u8   sub_default_idle();
 void    sub_idlevt_ctrl(idletime_event* idlevt, ot_long* eta, ot_u8 sequence_id);
+#if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
+void    sub_activate_scheduler(ot_u8* sched_id);
+#endif
 //void    sub_worevt_ctrl(wakeon_event* worevt, ot_long* eta);
 
 
@@ -162,6 +469,15 @@ void    sub_idlevt_ctrl(idletime_event* idlevt, ot_long* eta, ot_u8 sequence_id)
 ot_bool sub_mac_filter();
 
 
+/** @brief Subnet part of the MAC filter
+  * @param  fr_subnet   (ot_u8) subnet byte of the received frame
+  * @retval ot_bool     True/False on frame subnet passes/fails filter
+  * @ingroup System
+  * @sa sub_mac_filter(), sys_rxfilter()
+  */
+ot_bool sub_subnet_filter(ot_u8 fr_subnet);
+
+
 /** @brief Scrambles the response-channel-list in order to improve collision
   *        avoidance when multiple response channels are available.
   * @ingroup System
@@ -177,10 +493,12 @@ ot_uint sub_fcinit();
 
 
 /** @brief Evaluates the TX slot usage based on the quality of the query
-  * @param  query_score (ot_int) To be defined
+  * @param  query_score (ot_int) Score of the query, from M2QP (0 or more)
   * @retval none        
   * @ingroup System
-  * @note Optional, not implemented yet
+  * @sa sub_fcinit(), SYS_FCSCORE_STEPS
+  *
+  * Higher scores make sub_fcinit() pick an earlier first TX offset.
   */
 void sub_fceval(ot_int query_score);
 
@@ -233,6 +551,252 @@ ot_uint sub_rigd_nextslot();
 ot_uint sub_aind_nextslot();
 
 
+/** @brief Returns the CSMA-CA slotting method to use, 0-4
+  * @retval ot_u8       {0,1,2,3,4} = {RIGD, RAIND, AIND, Default MAC CA, FSA}
+  * @ingroup System
+  *
+  * Without OT_FEATURE(ADAPTIVECA), this is just the method from csmaca_params.
+  * With it, RIGD is changed to RAIND when the measured load is heavy.  FSA 
+  * (framed-slotted) is only returned when M2_FEATURE(FSACOLLECT) is enabled.
+  */
+ot_u8 sub_ca_mode();
+
+
+/** @brief Adds an outcome of the TX CSMA-CA process to the statistics
+  * @param busy         (ot_bool) True on CCA failure, False on clear CSMA
+  * @retval None
+  * @ingroup System
+  */
+void sub_ca_update(ot_bool busy);
+
+
+/** @brief Takes the learned response slop off Tc, and starts a slop sample
+  * @param start        (ot_u32) platform_stamp() from before request routing
+  * @retval None
+  * @ingroup System
+  *
+  * Called by TASK_processing when a request will be answered.  The request
+  * opcode picks the averages, and the processing time is added to them.
+  */
+void sub_slop_apply(ot_u32 start);
+
+
+/** @brief Adds the slop of the response that was just TX'ed, if sampled
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sub_slop_update();
+
+
+/** @brief Starts counting the responses to the request that was just TX'ed
+  * @param session      (m2session*) the session of the request
+  * @retval None
+  * @ingroup System
+  *
+  * The last request is sampled first, if it was counted.
+  */
+void sub_rxtune_start(m2session* session);
+
+
+/** @brief Marks the arrival of a clean frame, for sys_rxtune_response()
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sub_rxtune_arrival();
+
+
+/** @brief Returns the RFA timeout of the response listen that is starting
+  * @param age          (ot_int) ticks since the end of the request TX
+  * @retval ot_int      listen timeout
+  * @ingroup System
+  *
+  * sys.evt.RFA.nextevent holds the dialog timeout when called.
+  */
+ot_int sub_rxtune_window(ot_int age);
+
+
+
+/** @brief Replays the cached response if rxq holds a retransmitted request
+  * @param session      (m2session*) the session of the request
+  * @param key          (ot_u16*) returns the request key for sub_resp_save(),
+  *                     0 if the request cannot be cached
+  * @param score        (ot_int*) returns the cached routing score, on replay
+  * @retval ot_bool     True if the response was loaded into txq
+  * @ingroup System
+  *
+  * Called by TASK_processing in place of network_route_ff().  On replay, the
+  * session, m2np, m2qp.cmd and dll.comm are left as routing left them.
+  */
+ot_bool sub_resp_replay(m2session* session, ot_u16* key, ot_int* score);
+
+
+/** @brief Saves the response in txq, keyed by the request in rxq
+  * @param session      (m2session*) the session of the request
+  * @param key          (ot_u16) key from sub_resp_replay(), 0 to skip
+  * @param score        (ot_int) the score that network_route_ff() returned
+  * @retval None
+  * @ingroup System
+  */
+void sub_resp_save(m2session* session, ot_u16 key, ot_int score);
+
+
+
+/** @brief The kernel in sniffer mode, in place of the normal task manager
+  * @param elapsed      (ot_u32) ticks since the last kernel run
+  * @retval ot_u32      ticks until the kernel needs to run again
+  * @ingroup System
+  * @sa sys_sniffer_start()
+  */
+ot_u32 sub_sniffer_run(ot_u32 elapsed);
+
+
+/** @brief Sets up the radio to receive for the sniffer
+  * @param hop          (ot_bool) True to go to the next channel in the list
+  * @retval None
+  * @ingroup System
+  */
+void sub_sniffer_arm(ot_bool hop);
+
+
+/** @brief Puts the frame in rxq into the capture ring
+  * @param fcode        (ot_int) frame error code from the radio, 0 if good
+  * @retval None
+  * @ingroup System
+  */
+void sub_sniffer_capture(ot_int fcode);
+
+
+/** @brief Sends the next batch of capture records, if MPipe is free
+  * @retval ot_bool     True if there are records in the ring, or going out
+  * @ingroup System
+  */
+ot_bool sub_sniffer_drain();
+
+
+
+/** @brief Sends the queued response records, and frees the slots of the last
+  *        message once MPipe is done with it
+  * @retval ot_long     ticks until it needs to run again, or -1 if nothing is
+  *                     queued
+  * @ingroup System
+  * @sa sys_respfwd_put()
+  */
+ot_long sub_respfwd_drain();
+
+
+
+/** @brief Writes the network time into the beacon that is about to be sent
+  * @retval None
+  * @ingroup System
+  *
+  * Called by sysevt_initftx() before the radio takes txq.  It does nothing if
+  * txq does not hold the beacon that sysevt_beacon() built.
+  */
+void sub_netsync_stamp();
+
+
+/** @brief Puts the sleep scan onto the network schedule
+  * @retval None
+  * @ingroup System
+  * @sa sys_netsync_set()
+  */
+void sub_netsync_align();
+
+
+
+/** @brief Counts the ticks since the last count into the current radio state
+  * @retval None
+  * @ingroup System
+  */
+void sub_energy_clock();
+
+
+/** @brief Updates the radio state of the energy account from the mutex
+  * @retval None
+  * @ingroup System
+  *
+  * Called after each change of the radio level of the mutex.
+  */
+void sub_energy_radio();
+
+
+
+/** @brief Scans a few bytes of the painted stack for the high-water mark
+  * @retval None
+  * @ingroup System
+  */
+void sub_mem_scan();
+
+
+/** @brief Takes the queue high-water marks
+  * @retval None
+  * @ingroup System
+  */
+void sub_mem_sample();
+
+
+
+/** @brief Counts one link event (use SYS_LS_COUNT(), which compiles out)
+  * @param id           (ot_u8) SYS_LS_... index of the counter
+  * @retval None
+  * @ingroup System
+  */
+void sub_ls_count(ot_u8 id);
+
+
+/** @brief Counts one link event, and counts it for its channel
+  * @param id           (ot_u8) SYS_LS_RXFRAMES or SYS_LS_TXRESP
+  * @param channel      (ot_u8) channel ID of the frame
+  * @retval None
+  * @ingroup System
+  */
+void sub_ls_channel(ot_u8 id, ot_u8 channel);
+
+
+/** @brief Loads the link statistics from their ISF, at sys_init()
+  * @retval None
+  * @ingroup System
+  */
+void sub_ls_load();
+
+
+
+/** @brief Starts and collects the ADC bursts of the calibration scheduler
+  * @param event_eta    (ot_long) ticks to the next kernel run
+  * @retval ot_long     event_eta, shorter while a burst is running
+  * @ingroup System
+  */
+ot_long sub_rfcal_idle(ot_long event_eta);
+
+
+
+/** @brief Puts a good response frame into the RX pool, to listen again
+  * @retval ot_bool     True if the frame went into the pool
+  * @ingroup System
+  *
+  * When a session is collecting responses (RESPRX), each response goes into
+  * the RX pool, and the session listens again right away for the rest of the
+  * contention period.  The pool is parsed when the listen is over.  If the
+  * pool is full, the frame is parsed at once, as without the pool.
+  */
+ot_bool sub_rxpool_hold();
+
+
+
+/** @brief Closes the auxiliary receiver and pools the frames it heard
+  * @retval None
+  * @ingroup System
+  * @sa sub_rxpool_hold()
+  *
+  * The auxiliary receiver is open on the session channel while the main radio
+  * transmits.  Its frames are parsed from the RX pool, like held responses.
+  * A frame that does not fit in the pool is dropped.
+  */
+void sub_auxrx_collect();
+
+
 
 
 
@@ -257,7 +821,18 @@ ot_u16 otapi_new_session(session_tmpl* s_tmpl) {
     
     /// Create an ad-hoc session at the top of the stack, and verfy that it was
     /// successfully added to the stack.  (session always begins with req tx)
+#   if (M2_FEATURE(LINKADAPT) == ENABLED)
+    {   ot_u8 channel   = s_tmpl->channel;
+        m2np.la.pending = M2_LINK_NONE;
+        m2np.la.autoch  = (ot_bool)(channel == RM2_CHAN_AUTO);
+        if (m2np.la.autoch) {
+            channel = m2np_link_channel(NULL);  // until the target is known
+        }
+        session = session_new(0, (M2_NETSTATE_INIT | M2_NETSTATE_REQTX), channel);
+    }
+#   else
     session = session_new(0, (M2_NETSTATE_INIT | M2_NETSTATE_REQTX), s_tmpl->channel);
+#   endif
     
     if (session == NULL) {
         //OT_LOGFAIL_SYS(-0x10-1); 
@@ -280,6 +855,9 @@ ot_u16 otapi_new_session(session_tmpl* s_tmpl) {
     dll.comm.tx_chanlist    = &dll.comm.scratch[0];
     dll.comm.rx_chanlist    = &dll.comm.scratch[0];
     dll.comm.csmaca_params  = (M2_CSMACA_NA2P | M2_CSMACA_MACCA);
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    dll.comm.tx_eirp        = M2_PWR_FULL;
+#   endif
 
     /// return a session id of sorts
     return *( ((ot_u16*)session)+1 );
@@ -304,6 +882,20 @@ ot_u16 otapi_open_request(addr_type addr, routing_tmpl* routing) {
         if ((addr & 0x40) == 0) {   
             platform_memcpy((ot_u8*)&m2np.rt, (ot_u8*)routing, sizeof(routing_tmpl));
         }
+        
+#       if (M2_FEATURE(LINKADAPT) == ENABLED)
+        // Auto channel: now that the target is known, pick for its link
+        if (m2np.la.autoch) {
+            m2np.la.autoch      = False;
+            session_setchannel(session, m2np_link_channel( (addr == ADDR_unicast) ? &m2np.rt.dlog : NULL ));
+            dll.comm.scratch[0] = session->channel;
+        }
+#       endif
+        
+#       if (M2_FEATURE(AUTOSCALE) == ENABLED)
+        // Unicast: just enough power for the target, if its path loss is known
+        dll.comm.tx_eirp = m2np_pwr_eirp( (addr == ADDR_unicast) ? &m2np.rt.dlog : NULL );
+#       endif
 
         // Load the header: last argument is for NACK (0 means normal request)
         m2np_header(session, (ot_u8)addr, 0);
@@ -317,6 +909,9 @@ ot_u16 otapi_open_request(addr_type addr, routing_tmpl* routing) {
 ot_u16 otapi_close_request() {
 /// Set the footer if the session is valid
     if (session_count() >= 0) {
+#       if (M2QP_PIPELINE)
+        m2qp_pipe_open( session_top() );
+#       endif
         m2np_footer( session_top() );
         return 1;
     }
@@ -359,9 +954,10 @@ ot_u16 otapi_start_dialog() {
 /// Stop any ongoing processes and seed the event for the event manager.  The
 /// radio killer will work in all cases, but it is bad form to kill sessions
 /// that are moving data.  That is, qualify your app event by making sure that
-/// sys.mutex is less than 2.
-    if (sys.mutex != 0) {
-        sys.mutex = 0;
+/// the only radio lock held is SYS_MUTEX_RADIO_LISTEN.
+    SYS_TRACE(SYS_TRACE_DIALOG, 0);
+    if (sys.mutex & SYS_MUTEX_RADIO) {
+        SYS_RADIO_MUTEX(0);
         rm2_kill();
     }
     platform_ot_preempt();
@@ -371,6 +967,16 @@ ot_u16 otapi_start_dialog() {
 
 
 
+#if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+ot_u16 otapi_start_dialog_cb(sys_dialogfn done) {
+    ot_u16 handle = sys_dialog_watch(done);
+    return (handle != 0) ? (otapi_start_dialog() ? handle : 0) : 0;
+}
+#endif
+
+
+
+
 ot_u16 otapi_sysinit() {
     sys_refresh();
     return 1;
@@ -435,6 +1041,62 @@ void sys_init() {
 #       endif
 #	endif
 
+#   if (OT_FEATURE(POWERMGR) == ENABLED)
+        sys.pm.limit    = PLATFORM_LPM_MODES-1;
+        sys.pm.asleep   = False;
+#   endif
+
+#   if (OT_FEATURE(APPTASKS) == ENABLED)
+        platform_memset((ot_u8*)sys.task, 0, sizeof(sys.task));
+#   endif
+
+#   if (OT_FEATURE(EXTQUEUE) == ENABLED)
+        platform_memset((ot_u8*)&sys.extq, 0, sizeof(sys.extq));
+#   endif
+
+#   if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+        sys.dialog.done = NULL;
+#   endif
+
+#   if (OT_FEATURE(SLOPCAL) == ENABLED)
+        sys_slop_clear();
+#   endif
+
+#   if (OT_FEATURE(RXTUNE) == ENABLED)
+        sys_rxtune_clear();
+#   endif
+
+#   if (OT_FEATURE(SNIFFER) == ENABLED)
+        sys.sniffer.active = False;
+#   endif
+
+#   if (OT_FEATURE(RESPFWD) == ENABLED)
+        platform_memset((ot_u8*)&sys.respfwd, 0, sizeof(sys_respfwd));
+#   endif
+
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+        platform_memset((ot_u8*)&sys.netsync, 0, sizeof(sys_netsync));
+        sys.netsync.synced = (M2_FEATURE(GATEWAY) == ENABLED);
+#   endif
+
+#   if (OT_FEATURE(ENERGY) == ENABLED)
+        platform_memset((ot_u8*)&sys.energy, 0, sizeof(sys_energy));
+        sys.energy.mark = platform_stamp();
+#   endif
+
+    /// The stack marks are from sys_stack_paint(), which runs first
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+        platform_memset((ot_u8*)sys.mem.q_hwm, 0, sizeof(sys.mem.q_hwm));
+#   endif
+
+#   if (OT_FEATURE(LINKSTATS) == ENABLED)
+        sub_ls_load();
+#   endif
+
+#   if (OT_FEATURE(RFCAL) == ENABLED)
+        platform_memset((ot_u8*)&sys.rfcal, 0, sizeof(sys_rfcal));
+#   endif
+
     /// Initialize non-platform modules
     network_init();
     m2qp_init();
@@ -452,20 +1114,17 @@ void sys_init() {
 
 #ifndef EXTF_sys_refresh
 void sys_refresh() {
-    Twobytes scratch;
-    vlFILE* fp;
+    /// Load the Network settings from ISF 0, and decode the scan and beacon 
+    /// sequences.  Everything is reloaded, so no ISF change is pending.
+    vl_isfchange &= ~SYS_ISFCHANGE_MASK;
+    sub_netconf_load();
+    schedule.valid = False;
+    sub_schedule_refresh();
     
-    /// Open Device Features ISF and read the settings bytes
-    fp = ISF_open_su( 0x00 );
-    scratch.ushort          = vl_read(fp, 2);
-    dll.netconf.subnet      = scratch.ubyte[0];
-    dll.netconf.b_subnet    = scratch.ubyte[1];
-    scratch.ushort          = vl_read(fp, 6);
-    dll.netconf.dd_flags    = scratch.ubyte[0];
-    dll.netconf.b_attempts  = scratch.ubyte[1];
-    dll.netconf.active      = vl_read(fp, 4);
-    dll.netconf.hold_limit  = vl_read(fp, 8);   ///@todo endian conversion
-    vl_close(fp);
+    /// Drop the cached beacon, which was built with the old settings
+#   if (SYS_BEACON_CACHE)
+    bcache.index = SCHED_NONE;
+#   endif
 
     sub_sys_flush();
 }
@@ -474,10 +1133,77 @@ void sys_refresh() {
 
 
 
+#ifndef EXTF_sys_reconfigure
+void sys_reconfigure() {
+/// Applies only what the flagged ISFs change.  Sessions are kept.  An idle 
+/// event restarts when its sequence, its RTC alarm, or its active setting has
+/// changed, and the others keep their place in the schedule.
+    ot_u16 changed;
+    ot_u16 restart;
+    
+    changed         = vl_isfchange & SYS_ISFCHANGE_MASK;
+    vl_isfchange   &= ~SYS_ISFCHANGE_MASK;
+    restart         = changed;
+    
+    /// Network settings: a new active setting can change the idle state and
+    /// the scheduled events.  The new idle state is entered now if nothing is
+    /// going on, or else when the current sessions end.
+    if (changed & SYS_ISFCHANGE(network_settings)) {
+        ot_u16  old_active  = dll.netconf.active;
+        ot_u8   old_battempts = dll.netconf.b_attempts;
+        ot_u8   old_idle    = dll.idle_state;
+        
+        sub_netconf_load();
+        if (dll.netconf.active != old_active) {
+            restart |= SYS_ISFCHANGE_EVENTS;
+        }
+        if (dll.netconf.b_attempts != old_battempts) {
+            restart |= SYS_ISFCHANGE(beacon_transmit_sequence);
+        }
+        
+        dll.idle_state = sub_default_idle();
+        if ((dll.idle_state != old_idle) && (session_count() < 0) && \
+            ((sys.mutex & SYS_MUTEX_RADIO) == 0)) {
+            sys_idle();
+        }
+    }
+    
+    /// A new RTC schedule re-arms the alarm of every scheduled event
+    if (changed & SYS_ISFCHANGE(real_time_scheduler)) {
+        restart |= SYS_ISFCHANGE_EVENTS;
+    }
+    
+    /// The drivers keep the settings of the last channel they loaded.  Those 
+    /// are only dropped while the radio is not using them, so the change may 
+    /// wait for a later kernel run.
+    if (changed & SYS_ISFCHANGE(channel_configuration)) {
+        if (sys.mutex & (SYS_MUTEX_RADIO_LISTEN | SYS_MUTEX_RADIO_DATA)) {
+            vl_isfchange |= SYS_ISFCHANGE(channel_configuration);
+        }
+        else {
+            phymac[0].channel = 0x55;       // 55=invalid, forces lookup
+        }
+    }
+
+    /// The schedule tables reload themselves from the stamps, so only the
+    /// events and the beacon cache are left.
+#   if (SYS_BEACON_CACHE)
+    if (changed & (SYS_ISFCHANGE(network_settings) | SYS_ISFCHANGE(beacon_transmit_sequence))) {
+        bcache.index = SCHED_NONE;
+    }
+#   endif
+    sub_idlevt_restart(restart);
+}
+#endif
+
+
+
+
 #ifndef EXTF_sys_change_settings
 void sys_change_settings(ot_u16 new_mask, ot_u16 new_settings) {   
     vlFILE* fp_active;
     vlFILE* fp_supported;
+    ot_u16  active;
     
     // Get Active Settings, Get Supported Settings,
     // Mask-out unsupported settings, apply to new active settings
@@ -485,18 +1211,18 @@ void sys_change_settings(ot_u16 new_mask, ot_u16 new_settings) {
     fp_active           = ISF_open_su( 0x00 );
     fp_supported        = ISF_open_su( 0x01 );
     new_mask           &= vl_read(fp_supported, 8);
-    dll.netconf.active  = vl_read(fp_active, 4);
+    active              = vl_read(fp_active, 4);
     new_settings       &= new_mask;
-    dll.netconf.active &= ~new_mask;
-    dll.netconf.active |= new_settings;
+    active             &= ~new_mask;
+    active             |= new_settings;
     
     // Write the new settings to the ISF 0
-    vl_write(fp_active, 4, dll.netconf.active);
+    vl_write(fp_active, 4, active);
     vl_close(fp_active);
     vl_close(fp_supported);
     
-    // Flush the System of all Sessions and Events, and restart it
-    sub_sys_flush();
+    // Apply the new settings, without flushing the sessions
+    sys_reconfigure();
 }
 #endif
 
@@ -509,6 +1235,20 @@ void sys_goto_off() {
 /// Turn back on.  External events can still initiate TX.
     session_init();
     
+    // Link statistics not yet saved go to the mirror before it is saved
+#   if (OT_FEATURE(LINKSTATS) == ENABLED)
+    if (sys.ls.pending != 0) {
+        sys_linkstats_export();
+    }
+#   endif
+
+    // With a boot snapshot, the next power-up can use vl_fastinit()
+#   if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+        vl_save();
+#   elif (OT_FEATURE(VLLAZYSYNC) == ENABLED)
+        ISF_syncmirror();
+#   endif
+    
     sys.evt.RFA.event_no = 0;
     sys.evt.HSS.event_no = 0;
     
@@ -551,6 +1291,17 @@ void sys_goto_sleep() {
     //    session_flush();
     //}
     
+    /// Save the dirty part of the ISF mirror before a long idle, with the
+    /// link statistics not yet saved
+#   if (OT_FEATURE(LINKSTATS) == ENABLED)
+        if (sys.ls.pending != 0) {
+            sys_linkstats_export();
+        }
+#   endif
+#   if (OT_FEATURE(VLLAZYSYNC) == ENABLED)
+        ISF_syncmirror();
+#   endif
+    
     /// Manage scheduler, if it is enabled and activated
 #   if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
         if (sys.evt.SSS.sched_id != 0) {
@@ -660,7 +1411,7 @@ void sys_idle() {
 
     radio_gag();
     radio_sleep();
-    sys.mutex = 0;
+    SYS_RADIO_MUTEX(0);
     
 //    switch (dll.idle_state & 0x03) {
 //        case 0: sys_goto_off();     break;
@@ -697,7 +1448,21 @@ OT_INLINE void sys_quit_rf() {
 
 #ifndef EXTF_sys_set_mutex
 OT_INLINE void sys_set_mutex(ot_uint set_mask) {
-    sys.mutex = (ot_u8)set_mask;
+    if (set_mask & SYS_MUTEX_RADIO) {
+        sys.mutex &= ~SYS_MUTEX_RADIO;
+    }
+    sys.mutex |= (ot_u8)set_mask;
+#   if (OT_FEATURE(ENERGY) == ENABLED)
+    if (set_mask & SYS_MUTEX_RADIO) {
+        sub_energy_radio();
+    }
+#   endif
+#   if (SYS_CLKSCALE == ENABLED)
+    // The radio sets the data mutex on sync, and the data ISRs follow
+    if (set_mask & SYS_MUTEX_RADIO_DATA) {
+        platform_set_perf(SYS_PERF_HIGH);
+    }
+#   endif
 }
 #endif
 
@@ -707,6 +1472,9 @@ OT_INLINE void sys_set_mutex(ot_uint set_mask) {
 #ifndef EXTF_sys_clear_mutex
 OT_INLINE void sys_clear_mutex(ot_uint clear_mask) {
     sys.mutex &= clear_mask;
+#   if (OT_FEATURE(ENERGY) == ENABLED)
+    sub_energy_radio();
+#   endif
 }
 #endif
 
@@ -724,8 +1492,11 @@ OT_INLINE ot_int sys_get_mutex() {
 
 
 
-///@todo there is potential to optimize this function, or put it inside sub_clock_tasks()
 OT_INLINE void sub_next_event(ot_long* event_eta) {
+/// The idle event ETA is found while they are being clocked, in sub_clock_tasks.
+/// The only thing left to do here is to arm the RTC alarms of idle events that
+/// are run off the RTC scheduler.  Those events then wait for sys_rtc_alarm().
+#if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
     static const ot_u8 isf_lut[] = {
         ISF_ID(hold_scan_sequence),
 #       if (M2_FEATURE(ENDPOINT) == ENABLED)
@@ -738,26 +1509,209 @@ OT_INLINE void sub_next_event(ot_long* event_eta) {
     };
     
     ot_int i;
-    *event_eta = 65535;
 
     for (i=(IDLE_EVENTS-1); i>=0; i--) {
-    	if (sys.evt.idle[i].event_no != 0) {
-    		sub_idlevt_ctrl(&sys.evt.idle[i], event_eta, isf_lut[i]);
+    	if ((sys.evt.idle[i].event_no != 0) && (sys.evt.idle[i].sched_id != 0) && \
+            ((sys.evt.idle[i].sched_id & SCHED_ARMED) == 0)) {
+    		sub_idlevt_ctrl(&sys.evt.idle[i], &sys.evt.idle_eta, isf_lut[i]);
     	}
     }
+#endif
+
+    if (sys.evt.idle_eta < *event_eta) {
+        *event_eta = sys.evt.idle_eta;
+    }
 }
 
 
 
 
 #ifndef EXTF_sys_event_manager
-ot_uint sys_event_manager(ot_uint elapsed) {
+ot_u32 sys_event_manager(ot_u32 elapsed) {
+/// The power manager and clock scaling need to know when the kernel runs.  A
+/// run ends the residency of the mode it woke from, it sets the ETA for the
+/// next sleep, and it leaves the CPU level for the ISRs that run until the
+/// next run.
+    ot_u32  next_event;
+#   if (OT_FEATURE(POWERMGR) == ENABLED)
+    ot_int  i;
+
+    if (sys.pm.asleep) {
+        sys.pm.asleep = False;
+        sys.pm.res[sys.pm.mode].ticks += (elapsed - sys.pm.mark);
+    }
+#   endif
+
+#   if (OT_FEATURE(ENERGY) == ENABLED)
+    sub_energy_clock();
+#   endif
+
+    /// ISFs written since the last run, by ALP, DASH7 or the app, are applied
+    /// before the events that use them
+    if (vl_isfchange & SYS_ISFCHANGE_MASK) {
+        sys_reconfigure();
+    }
+
+    next_event = sub_event_manager(elapsed);
+
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    sub_mem_sample();
+#   endif
+
+#   if (SYS_CLKSCALE == ENABLED)
+    platform_set_perf((sys.mutex & SYS_MUTEX_RADIO_DATA) ? SYS_PERF_HIGH : SYS_PERF_LOW);
+#   endif
+
+#   if (OT_FEATURE(POWERMGR) == ENABLED)
+#       if (OT_PARAM(KERNEL_LIMIT) > 0)
+        if (next_event > OT_PARAM(KERNEL_LIMIT))
+            next_event = OT_PARAM(KERNEL_LIMIT);
+#       endif
+
+    /// Nothing is scheduled when there are no sessions, radio events, or idle
+    /// events, and the kernel is not asked to run periodically.
+    sys.pm.eta      = next_event;
+    sys.pm.untimed  = (ot_bool)((OT_PARAM(KERNEL_LIMIT) <= 0) && \
+                                (session_count() < 0) && \
+                                (sys.evt.RFA.event_no == 0));
+    for (i=0; (i<IDLE_EVENTS) && sys.pm.untimed; i++) {
+        sys.pm.untimed = (ot_bool)(sys.evt.idle[i].event_no == 0);
+    }
+#   if (OT_FEATURE(SNIFFER) == ENABLED)
+    if (sys.sniffer.active) {
+        sys.pm.untimed = False;
+    }
+#   endif
+#   endif
+
+    return next_event;
+}
+
+
+ot_long sub_idle_work(ot_long event_eta) {
+/// Background jobs, run while the kernel waits: in idle time, and while the
+/// radio only listens.  Each job runs when the resources it needs are free,
+/// and it may make event_eta (ticks to the next kernel run) shorter.  An
+/// active radio event counts as a radio lock.
+    ot_u8 held = sys.mutex;
+
+    if (sys.evt.RFA.event_no != 0) {
+        held |= SYS_MUTEX_RADIO_LISTEN;
+    }
+
+#   if (LOG_FEATURE(DEFERRED) == ENABLED)
+    // Deferred log records go out one per pass, and the kernel comes back
+    // next tick while more are waiting.
+    if (((held & SYS_MUTEX_MPIPE) == 0) && otapi_log_drain() && (event_eta > 1)) {
+        event_eta = 1;
+    }
+#   endif
+
+    // Flash erases stall the CPU, so they are only allowed in periods long
+    // enough to hold one, and never while the radio is in use.  Deferred and
+    // cached VWORM writes go to flash here, and long periods also compact the
+    // veelite heaps.
+    if (((held & (SYS_MUTEX_RADIO | SYS_MUTEX_FLASH)) == 0) && (event_eta >= VWORM_ERASE_TICKS)) {
+        sys.mutex |= SYS_MUTEX_FLASH;
+        vworm_window(True);
+#       if (OT_FEATURE(VLNEW) == ENABLED)
+        if (event_eta >= VL_DEFRAG_TICKS) {
+            vl_defragment();
+        }
+#       endif
+        vworm_window(False);
+        sys.mutex &= ~SYS_MUTEX_FLASH;
+    }
+
+    // Serial flash erases go on in the chip while the CPU works or sleeps,
+    // but they draw current and hold the SPI, so one only starts when it can
+    // be done before the radio is next in use.  The kernel comes back for
+    // the next one.
+#   if (OT_FEATURE(VSFLASH) == ENABLED)
+    if (((held & SYS_MUTEX_RADIO) == 0) && (event_eta >= SFLASH_ERASE_TICKS)) {
+        if ((vsflash_service() != 0) && (event_eta > SFLASH_ERASE_TICKS)) {
+            event_eta = SFLASH_ERASE_TICKS;
+        }
+    }
+#   endif
+
+    // Forwarded responses go to the host when their batch is due.  The held
+    // responses are all parsed first, so a round goes out in one message.
+#   if (OT_FEATURE(RESPFWD) == ENABLED)
+    if ((held & (SYS_MUTEX_MPIPE | SYS_MUTEX_PROCESSING)) == 0) {
+        ot_long wait = sub_respfwd_drain();
+        if ((wait >= 0) && (event_eta > wait)) {
+            event_eta = wait;
+        }
+    }
+#   endif
+
+    // The energy account goes to its ISF once per period.  The file may not be
+    // a mirror, so it waits for the radio like a flash job does.
+#   if ((OT_FEATURE(ENERGY) == ENABLED) && (OT_PARAM(ENERGY_PERIOD) > 0))
+    if (((held & (SYS_MUTEX_RADIO | SYS_MUTEX_FLASH)) == 0) && \
+        ((sys.energy.total - sys.energy.exported) >= OT_PARAM(ENERGY_PERIOD))) {
+        sys_energy_export();
+    }
+#   endif
+
+    // Link statistics go to their ISF in batches, by count or by age.  Like
+    // the energy account, they wait for the radio and for flash jobs.
+#   if (OT_FEATURE(LINKSTATS) == ENABLED)
+    if (((held & (SYS_MUTEX_RADIO | SYS_MUTEX_FLASH)) == 0) && (sys.ls.pending != 0)) {
+        if ((sys.ls.pending >= OT_PARAM(LINKSTATS_BATCH)) || ((OT_PARAM(LINKSTATS_PERIOD) > 0) && \
+            ((ot_u32)(platform_stamp() - sys.ls.mark) \
+                >= ((ot_u32)OT_PARAM(LINKSTATS_PERIOD) << PLATFORM_KTIM_SUBBITS)))) {
+            sys_linkstats_export();
+        }
+    }
+#   endif
+
+    // Radio calibration is checked against the temperature and the supply
+    // while the radio is off, so that it never runs as the radio starts.
+#   if ((OT_FEATURE(RFCAL) == ENABLED) && (OT_FEATURE(SENSORS) == ENABLED))
+    if ((held & SYS_MUTEX_RADIO) == 0) {
+        event_eta = sub_rfcal_idle(event_eta);
+    }
+#   endif
+
+    // The stack scan is a few bytes of RAM reads, so it runs on every pass
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    sub_mem_scan();
+#   endif
+
+    // Veelite files not verified since boot or their last write are checked
+    // one per pass.  There is no flash erase, so a listen does not stop it.
+#   if (OT_FEATURE(VLCRC) == ENABLED)
+    if ((held & (SYS_MUTEX_RADIO_DATA | SYS_MUTEX_PROCESSING | SYS_MUTEX_FLASH)) == 0) {
+        vl_verify();
+    }
+#   endif
+
+    return event_eta;
+}
+
+
+ot_u32 sub_event_manager(ot_u32 elapsed) {
 /// Check the event list, and act on them as necessary.  If an event succeeds,
 /// then the sys.evt.process will be put to some other function in the SYS.   
+    Task_Index  task;
+#   if (OT_FEATURE(PROFILER) == ENABLED)
+    ot_u32      prof_mark;
+#   endif
+
+#   if (OT_FEATURE(SNIFFER) == ENABLED)
+    if (sys.sniffer.active) {
+        return sub_sniffer_run(elapsed);
+    }
+#   endif
     
     do {
         /// 1. Flush the timer.  The amount of time the task uses is clocked, 
         ///    and subsequently it is subtracted from all the task timers.
+#       if (OT_FEATURE(TRACE) == ENABLED)
+        sys.trace.last -= platform_get_gptim();     // keep deltas across flush
+#       endif
         platform_flush_gptim();
         
         /// 2. Check the system watchdog to make sure there isn't a task going
@@ -765,19 +1719,36 @@ ot_uint sys_event_manager(ot_uint elapsed) {
         ///    operations are usually interrupt-driven, and they can be made
         ///    fault-tolerant by using the watchdog.
         SYS_WATCHDOG_CHECK();
+        
+        /// 2a. Report a watched dialog that has ended since the last pass.
+        ///     The callback may start a new dialog, which the tasks then see.
+#       if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+        sub_dialog_check();
+#       endif
+        
+        /// 2b. Reseed the prand generator, if it is due (see prand.h)
+        prand_service();
     
         /// 3. Clock idle time events, and any sessions in the session stack.
         ///    The highest priority task that needs servicing will be returned.
         ///    The time required to clock the events is assumed to be negligible
         ///    (it is at most 50 instructions, I would guess)
-        switch (sub_clock_tasks(elapsed)) {
+#       if (OT_FEATURE(PROFILER) == ENABLED)
+        prof_mark = platform_get_cycles();
+#       endif
+        task = sub_clock_tasks(elapsed);
+        SYS_TRACE(SYS_TRACE_TASK, task);
+#       if (SYS_CLKSCALE == ENABLED)
+        platform_set_perf(sys_task_perf[task]);
+#       endif
+        switch (task) {
         
             // Completely Idle Time:
             // Run an external process that can manipulate the kernel.  If the external
             // process (loadapp) does not exist or it does not do anything, then EXIT
             // the kernel and return estimated-time-of-arrival (eta) of next known event.
             case TASK_idle: {
-                ot_long event_eta;
+                ot_long event_eta = SYS_RUN_MAX;
                 
                 if (session_count() >= 0) {
                     m2session* session;
@@ -787,6 +1758,12 @@ ot_uint sys_event_manager(ot_uint elapsed) {
                     }
                     event_eta = session->counter;
                 }
+                
+#               if (M2QP_INVENTORY)
+                // The inventory planner starts its next round when there is
+                // no session, or it shortens the wait to its next pass.
+                if (m2qp_inv_run(&event_eta)) break;
+#               endif
                
 #               if ((OT_FEATURE(SYSKERN_CALLBACKS) == ENABLED) && \
                     !defined(EXTF_sys_sig_loadapp) )
@@ -802,7 +1779,25 @@ ot_uint sys_event_manager(ot_uint elapsed) {
                 if (event_eta <= 0) {
                     break;
                 }
-                return (ot_uint)event_eta;
+                
+#               if (OT_FEATURE(EXTQUEUE) == ENABLED)
+                // One external event handler runs in the gap, ahead of the
+                // app tasks, then the kernel looks at its events again.
+                if (sub_run_extevent(event_eta)) {
+                    break;
+                }
+#               endif
+                
+#               if (OT_FEATURE(APPTASKS) == ENABLED)
+                // One app task runs in the gap, then the kernel looks at its
+                // events again before the next one.
+                if (sub_run_apptask(&event_eta)) {
+                    break;
+                }
+#               endif
+                
+                event_eta = sub_idle_work(event_eta);
+                return (ot_u32)event_eta;
             } 
         
             
@@ -812,15 +1807,38 @@ ot_uint sys_event_manager(ot_uint elapsed) {
             case TASK_processing: {
                 m2session* session;
                 ot_int proc_score;
+#               if (OT_FEATURE(SLOPCAL) == ENABLED)
+                ot_u32 proc_start   = platform_stamp();
+                sys.slop.type       = 0xFF;
+#               endif
                 
                 session             = session_top();
                 session->counter    = 0;
+#               if (SYS_RESP_CACHE)
+                {   ot_u16 key;
+                    if (sub_resp_replay(session, &key, &proc_score) == False) {
+                        proc_score = network_route_ff(session);
+                        sub_resp_save(session, key, proc_score);
+                    }
+                }
+#               else
                 proc_score          = network_route_ff(session);
+#               endif
                 
                 /// If the score is negative, then the packet is not
                 /// meant for this device.  Else, prepare for TX and 
                 /// potentially a follow-up listen.
                 if (proc_score >= 0) {
+                    /// Tc runs from the end of the request frame, so the time
+                    /// since then is taken off (the CRC is already stripped)
+                    {   ot_int age = RM2_RXEND_AGE(rxq.front[0] + 2);
+                        if (age > 0) {
+                            dll.comm.tc = (dll.comm.tc > age) ? (dll.comm.tc - age) : 0;
+                        }
+                    }
+#                   if (OT_FEATURE(SLOPCAL) == ENABLED)
+                    sub_slop_apply(proc_start);
+#                   endif
                     sub_fceval(proc_score);
                     sys.evt.hold_cycle  = 0;
                     dll.idle_state      = M2_MACIDLE_HOLD;
@@ -834,17 +1852,16 @@ ot_uint sys_event_manager(ot_uint elapsed) {
                         session_refresh(dll.comm.tc);
                         session_drop();
                     
-                        /// Offset the Tc if tryping to beat timing slop,
-                        //dll.comm.tc -= OFFSET VALUE ... TBD
-                    
                         s_clone = session_new( \
                                 (dll.comm.tc), 
                                 (M2_NETSTATE_REQRX | M2_NETSTATE_CONNECTED), 
-                                (dll.comm.rx_chanlist[0])   );
+                                (session->channel)  );
                     
                         s_clone->dialog_id      = session->dialog_id;
                         s_clone->subnet         = session->subnet;
-                        s_clone->channel        = session->channel;
+#                       if (OT_FEATURE(NL_SECURITY))
+                        *session_nls(s_clone)   = *session_nls(session);
+#                       endif
                         dll.comm.redundants     = 0;
                         dll.comm.rx_chanlist    = &dll.comm.scratch[1];
                         dll.comm.rx_chanlist[0] = session->channel;   
@@ -852,7 +1869,16 @@ ot_uint sys_event_manager(ot_uint elapsed) {
                         dll.comm.tc            -= rm2_pkt_duration(txq.length);
                     }
                 }
-                sys.mutex = 0;
+                
+#               if (SYS_RXPOOL == ENABLED)
+                /// Parse the held responses, one per pass, once the listen 
+                /// is over (the session is no longer just RESPRX).
+                if (((session->netstate & (M2_NETFLAG_SCRAP | M2_NETSTATE_TMASK)) \
+                    != M2_NETSTATE_RESPRX) && buffers_rxpool_get()) {
+                    break;
+                }
+#               endif
+                SYS_RADIO_MUTEX(0);
             } break;
             
         
@@ -863,7 +1889,7 @@ ot_uint sys_event_manager(ot_uint elapsed) {
             // subthread 4: Radio is known to be doing something: return event_eta
             case TASK_radio: { 
                 if (sys.evt.RFA.nextevent <= 0) {
-                    if (sys.mutex > SYS_MUTEX_RADIO_LISTEN) {
+                    if (sys.mutex & (SYS_MUTEX_RADIO_DATA | SYS_MUTEX_PROCESSING)) {
                         SYS_WATCHDOG_RUN();
                         return 1;           // come back in 1 tick
                     }
@@ -872,6 +1898,11 @@ ot_uint sys_event_manager(ot_uint elapsed) {
                     else                            sysevt_receive();
                     break;
                 }
+                
+                // The radio is only waiting: jobs that do not need it go on
+                if ((sys.mutex & (SYS_MUTEX_RADIO_DATA | SYS_MUTEX_PROCESSING)) == 0) {
+                    return (ot_u32)sub_idle_work(sys.evt.RFA.nextevent);
+                }
                 return sys.evt.RFA.nextevent;
             } 
             
@@ -956,9 +1987,9 @@ ot_uint sys_event_manager(ot_uint elapsed) {
             // External Event Manager
 #           if (OT_FEATURE(EXTERNAL_EVENT) == ENABLED)
             case TASK_external:
-#           ifdef EXTF_sys_sig_extprocess
+#           if defined(EXTF_sys_sig_extprocess)
                 sys_sig_extprocess(NULL);
-#           else
+#           elif (OT_FEATURE(SYSIDLE_CALLBACKS) == ENABLED)
                 sys.evt.EXT.prestart(NULL);
 #           endif
                 break;
@@ -971,6 +2002,10 @@ ot_uint sys_event_manager(ot_uint elapsed) {
             } break;
         }
         
+#       if (OT_FEATURE(PROFILER) == ENABLED)
+        sys_profile_log((ot_u8)task, prof_mark);
+#       endif
+
         /// Clear [optional] watchdog when Radio Tasks are inactive
         SYS_WATCHDOG_RESET();
     
@@ -984,33 +2019,66 @@ ot_uint sys_event_manager(ot_uint elapsed) {
 
 
 #ifndef EXTF_sys_clock_tasks
-OT_INLINE Task_Index sub_clock_tasks(ot_uint elapsed) {
+OT_INLINE Task_Index sub_clock_tasks(ot_u32 elapsed) {
     ot_int i;
+    ot_int elapsed16;
     Task_Index output = TASK_idle;
 
+    // The 16 bit counters only need to go negative when a long sleep passes
+    elapsed16 = (elapsed > 32767) ? 32767 : (ot_int)elapsed;
+
     // Clock Tca & RX timeout
     //dll.comm.rx_timeout -= elapsed;
-    dll.comm.tca        -= elapsed;
+    dll.comm.tca        -= elapsed16;
+
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+    sys.netsync.time    += elapsed;
+#   endif
     //dll.comm.tc         -= elapsed;
 
+    // Clock idle events, and get the soonest one in the same pass, so 
+    // sys_event_manager() does not need to scan them again before it sleeps.
+    sys.evt.idle_eta = SYS_RUN_MAX;
     for (i=(IDLE_EVENTS-1); i>=0; i--) {
         sys.evt.idle[i].nextevent -= (ot_long)elapsed;
-        if ((sys.evt.idle[i].event_no != 0) && (sys.evt.idle[i].nextevent <= 0))
-            output = TASK_hold+i;
+        if (sys.evt.idle[i].event_no != 0) {
+            if (sys.evt.idle[i].nextevent <= 0) {
+                output = TASK_hold+i;
+            }
+            if (sys.evt.idle[i].nextevent < sys.evt.idle_eta) {
+                sys.evt.idle_eta = sys.evt.idle[i].nextevent;
+            }
+        }
+    }
+
+#   if (OT_FEATURE(APPTASKS) == ENABLED)
+    // Clock app tasks.  Late ones keep counting down, to order them.
+    for (i=0; i<SYS_APPTASKS; i++) {
+        sys.task[i].nextevent -= (ot_long)elapsed;
+        if (sys.task[i].nextevent < -SYS_RUN_MAX) {
+            sys.task[i].nextevent = -SYS_RUN_MAX;
+        }
     }
+#   endif
 
     // Clock sessions (Priority 3)
     if (session_refresh(elapsed))
         output = TASK_session;
 
-    // Clock the Radio Event (Priority 2)
+    // Clock the Radio Event (Priority 2).  A due external event that does
+    // not need the radio (SYS_EXT_LOCKS) runs ahead of a radio event that is
+    // not due yet.
     if (sys.evt.RFA.event_no != 0) {
-        output                  = TASK_radio;
-        sys.evt.RFA.nextevent  -= elapsed;
+        sys.evt.RFA.nextevent  -= elapsed16;
+#       if ((OT_FEATURE(EXTERNAL_EVENT) == ENABLED) && ((SYS_EXT_LOCKS & SYS_MUTEX_RADIO) == 0))
+        if ((output != TASK_external) || (sys.evt.RFA.nextevent <= 0) \
+            || (sys.mutex & SYS_EXT_LOCKS))
+#       endif
+            output              = TASK_radio;
     }
 
     // Do Immediate Packet Processing (Priority 1)
-    if (sys.mutex == SYS_MUTEX_PROCESSING) 
+    if (sys.mutex & SYS_MUTEX_PROCESSING)
         output = TASK_processing;
 
     return output;
@@ -1019,907 +2087,3464 @@ OT_INLINE Task_Index sub_clock_tasks(ot_uint elapsed) {
 
 
 
-/** System Events <BR>
+/** Sniffer Mode <BR>
   * ============================================================================
+  * See OT_FEATURE_SNIFFER in system.h.  The capture ring has one producer, the
+  * RX callback, and one consumer, the kernel.  A batch goes to MPipe straight
+  * from the ring, so its bytes are only released when MPipe is done with them.
   */
+#if (OT_FEATURE(SNIFFER) == ENABLED)
+#if (OT_FEATURE(MPIPE_GATHER) != ENABLED)
+#   error "OT_FEATURE_SNIFFER needs OT_FEATURE_MPIPE_GATHER"
+#endif
+#if (OT_PARAM_SNIFFER_RING & (OT_PARAM_SNIFFER_RING-1))
+#   error "OT_PARAM_SNIFFER_RING must be a power of 2"
+#endif
 
+ot_u8       sniffer_buffer[OT_PARAM_SNIFFER_RING];
+RingQueue   sniffer_ring = { (OT_PARAM_SNIFFER_RING-1), 0, 0, sniffer_buffer };
+mpipe_seg   sniffer_seg[2];
 
-/** Idle Time Events <BR>
-  * ======================================================================= <BR>
-  * - Scanning and Beaconing                                                <BR>
-  * - Set up pending radio RX or TX events                                  <BR>
-  * - Include callbacks that run before they start (if callbacks enabled)   <BR>
-  * - Generally run very fast (0 ticks, or negligible)
-  */
 
-OT_INLINE void sysevt_holdscan() {
-#if (M2_FEATURE(BLINKER) != ENABLED)
-    sub_scan_channel(&sys.evt.HSS, ISF_ID(hold_scan_sequence));
-#endif
-}
+#ifndef EXTF_sys_sniffer_start
+ot_bool sys_sniffer_start(ot_u8 channels, ot_u8* chanlist) {
+    if ((channels == 0) || (channels > SYS_SNIFF_CHANNELS)) {
+        return False;
+    }
 
+    /// Nothing else uses the radio while sniffing
+    if (sys.sniffer.active == False) {
+        session_flush();
+        radio_gag();
+        radio_sleep();
+        SYS_RADIO_MUTEX(0);
+        sys.evt.RFA.event_no    = 0;
+        sys.sniffer.listening   = False;
+        sys.sniffer.inflight    = 0;
+        sys.sniffer.drops       = 0;
+        rq_empty(&sniffer_ring);
+    }
 
+    platform_memcpy(sys.sniffer.chanlist, chanlist, channels);
+    sys.sniffer.channels    = channels;
+    sys.sniffer.cursor      = 0;
+    sys.sniffer.dwell       = 0;
+    sys.sniffer.active      = True;
+    platform_ot_preempt();
+    return True;
+}
+#endif
 
 
-OT_INLINE void sysevt_sleepscan() {
-/// See implementation notes for sysevt_holdscan
-#if (M2_FEATURE(ENDPOINT) == ENABLED)
-    sub_scan_channel(&sys.evt.SSS, ISF_ID(sleep_scan_sequence));
+#ifndef EXTF_sys_sniffer_stop
+void sys_sniffer_stop() {
+    if (sys.sniffer.active) {
+        sys.sniffer.active = False;
+        if (sys.sniffer.listening) {
+            rm2_kill();
+        }
+        sys_refresh();
+        platform_ot_preempt();
+    }
+}
 #endif
+
+
+#ifndef EXTF_sys_sniffer_drops
+ot_u16 sys_sniffer_drops() {
+    return sys.sniffer.drops;
 }
+#endif
+
+
+ot_u32 sub_sniffer_run(ot_u32 elapsed) {
+/// The radio receives again as soon as a frame is in.  At the end of a dwell
+/// it goes to the next channel, but not in the middle of a frame.  With one
+/// channel there is nothing to hop to, so a listen that is still on is kept.
+    platform_flush_gptim();
+    sys.sniffer.dwell -= (ot_long)elapsed;
 
+    if ((sys.mutex & SYS_MUTEX_RADIO_DATA) == 0) {
+        if (sys.sniffer.dwell <= 0) {
+            if ((sys.sniffer.channels == 1) && sys.sniffer.listening) {
+                sys.sniffer.dwell = OT_PARAM(SNIFFER_DWELL);
+            }
+            else {
+                sub_sniffer_arm(True);
+            }
+        }
+        else if (sys.sniffer.rearm) {
+            sub_sniffer_arm(False);
+        }
+    }
 
+    if (sub_sniffer_drain() || (sys.sniffer.dwell <= 0)) {
+        return 1;
+    }
+    return (ot_u32)sys.sniffer.dwell;
+}
 
 
-void sub_scan_channel(idletime_event* idlevt, ot_u8 SS_ISF) {
-/// Like with the Beacon event processor, the scan event processor currently
-/// is expected to run in negligible time: it is non-blocking and the actual
-/// reception is another event, so this is generally accurate.  In the future
-/// elapsed time could be taken into account without too much trouble.
-#if ((M2_FEATURE(GATEWAY) == ENABLED) || \
-     (M2_FEATURE(SUBCONTROLLER) == ENABLED) || \
-     (M2_FEATURE(ENDPOINT) == ENABLED))
-    ot_u8       s_channel;
-    ot_u8       s_flags;
-    
-    {
-        Twobytes    scratch;
-        vlFILE*     fp;
-    
-#       if (OT_FEATURE(SYSIDLE_CALLBACKS) == ENABLED)
-            idlevt->prestart( (void*)idlevt );
-#       endif
-    
-        /// Load scan data from the config file (Hold scan or Sleep scan)
-        fp = ISF_open_su( SS_ISF );
-        ///@todo assert fp
-    
-        /// Pull channel ID and Scan flags
-        scratch.ushort          = vl_read(fp, idlevt->cursor);
-        s_channel               = scratch.ubyte[0];
-        s_flags                 = scratch.ubyte[1];
-        
-        /// Set the next idle event from the two-byte Next Scan field
-#       ifdef __BIG_ENDIAN__
-            idlevt->nextevent   = vl_read(fp, idlevt->cursor+=2 );
-#       else
-            scratch.ushort      = vl_read(fp, (idlevt->cursor)+=2 );
-            scratch.ushort      = (scratch.ushort << 8) | (scratch.ushort >> 8);
-            					///@todo implement inline swap function in platform
-            idlevt->nextevent   = (ot_long)scratch.ushort;
-#       endif
-        
-        /// Advance cursor to next datum, go back to 0 if end of sequence
-        idlevt->cursor += 2;
-        if (idlevt->cursor >= fp->length) {
-            idlevt->cursor = 0;
+void sub_sniffer_arm(ot_bool hop) {
+    if (sys.sniffer.listening) {
+        rm2_kill();
+    }
+    if (hop) {
+        sys.sniffer.channel = sys.sniffer.chanlist[sys.sniffer.cursor];
+        if (++sys.sniffer.cursor >= sys.sniffer.channels) {
+            sys.sniffer.cursor = 0;
         }
-        //idlevt->cursor *= (idlevt->cursor < fp->length);
-        vl_close(fp);
+        sys.sniffer.dwell   = OT_PARAM(SNIFFER_DWELL);
     }
-    
-    /// Perform the scan                                                    <BR>
-    ///  - b5:0 of the scan flags is the normal scan timeout                <BR>
-    ///  - b6 of the scan flags enables 1024x multiplier on scan timeout    <BR>
-    ///  - b7 of the scan flags is foreground (0), background (1)
-    dll.comm.rx_timeout     = otutils_calc_timeout(s_flags);
-    dll.comm.redundants     = 0;
-    dll.comm.rx_channels    = 1;
-    dll.comm.rx_chanlist    = &dll.comm.scratch[1];
-    dll.comm.scratch[1]     = s_channel;
-        
-    /// Background Scan or Foreground Scan is based on flags
-    s_flags = (s_flags & 0x80) ? \
-                (M2_NETSTATE_REQRX | M2_NETSTATE_INIT |M2_NETFLAG_FLOOD ) : \
-                (M2_NETSTATE_REQRX | M2_NETSTATE_INIT);
 
-    session_new(0, s_flags, s_channel);
-#endif
+    sys.sniffer.rearm       = False;
+    sys.sniffer.listening   = True;
+    dll.comm.rx_timeout     = (ot_uint)sys.sniffer.dwell;
+    SYS_RADIO_MUTEX(SYS_MUTEX_RADIO_LISTEN);
+    rm2_rxinit_ff(sys.sniffer.channel, M2_NETSTATE_CONNECTED, 1, &rfevt_sniff);
 }
 
 
+void rfevt_sniff(ot_int pcode, ot_int fcode) {
+/// Radio callback while sniffing.  Any end of a listen but a kill or a bad
+/// channel has the kernel receive again right away.  Those wait for the end
+/// of the dwell (a kill is followed by a new listen anyway).
+    sys.sniffer.listening = False;
+    SYS_RADIO_MUTEX(0);
 
+    if ((pcode == 0) && sys.sniffer.active) {
+        sub_sniffer_capture(fcode);
+    }
+    if ((pcode != RM2_ERR_KILL) && (pcode != RM2_ERR_BADCHANNEL)) {
+        sys.sniffer.rearm = True;
+        platform_ot_preempt();
+    }
+}
 
-void sysevt_beacon() {
-/// The beacon event is probably finished, from a feature perspective.  It
-/// behaves like a proper event, returning quickly without much processing,
-/// and it calls the initftx event when it is ready to transmit.  If beacon
-/// process runtime is taken into account later (now it is negligible), some
-/// simple edits can be made to this function, which are noted.
-#if (M2_FEATURE(BEACONS) == ENABLED)
-    vlFILE*     fp;
-    m2session*  session;
-    ot_u8       beacon_params;
-    Queue       beacon_queue;
-    Fourbytes   bq_data;
-    Twobytes    scratch;
 
-    /// Open BTS ISF Element and read the beacon sequence.  Make sure there
-    /// is a beacon file of non-zero length and that beacons are presently
-    /// enabled.  Otherwise, in 64 seconds it will check again.  The value
-    /// 64s is arbitrary.  You can change it or asynchronously pre-empt a
-    /// beacon restart by flushing the system.
-    fp = ISF_open_su( ISF_ID(beacon_transmit_sequence) );
-    if ((dll.netconf.b_attempts == 0) || (fp->length == 0)) {
-        vl_close(fp);
-        sys.evt.BTS.nextevent = 65535;  ///@todo make this an app-config parameter
+void sub_sniffer_capture(ot_int fcode) {
+/// The record is written in two parts, so the kernel only takes a record once
+/// its whole length is in the ring (see sub_sniffer_drain()).
+    ot_u8   header[13];
+    ot_u32  stamp;
+    ot_int  length;
+
+    length      = (ot_int)rxq.length;
+    header[12]  = (fcode != 0) ? SYS_SNIFF_CRCERR : 0;
+    if (length > SYS_SNIFF_FRAMEMAX) {
+        length      = SYS_SNIFF_FRAMEMAX;
+        header[12] |= SYS_SNIFF_CLIPPED;
+    }
+
+    if (rq_space(&sniffer_ring) < (ot_uint)(13 + length)) {
+        sys.sniffer.drops += (sys.sniffer.drops != 65535);
         return;
     }
-    
-    // First 2 bytes: Chan ID, Cmd Code
-    // - Setup beacon ad-hoc session, on specified channel
-    //   (ad hoc sessions never return NULL)
-    // - Assure cmd code is always Broadcast & Announcement
-    scratch.ushort          = vl_read(fp, sys.evt.BTS.cursor);
-    session                 = session_new(0, M2_NETSTATE_INIT, scratch.ubyte[0]);
-    session->subnet         = dll.netconf.b_subnet;
-    beacon_params           = scratch.ubyte[1];
-    session->flags          = (dll.netconf.dd_flags & ~0x30);
-    session->flags         |= (beacon_params & 0x30);
-        
-    // Second & Third 2 bytes: ISF Call Template
-    ///@todo Agaidi has the q init going to 32.  I need to find why
-    q_init(&beacon_queue, &bq_data.ubyte[0], 4);
-    bq_data.ushort[0]       = vl_read(fp, sys.evt.BTS.cursor+=2);
-    bq_data.ushort[1]       = vl_read(fp, sys.evt.BTS.cursor+=2);
-        
-    // Last 2 bytes: Next Scan ticks
-#   ifdef __BIG_ENDIAN__
-        sys.evt.BTS.nextevent   = vl_read(fp, sys.evt.BTS.cursor+=2);
-#   else
-        scratch.ushort          = vl_read(fp, sys.evt.BTS.cursor+=2);
-        scratch.ushort          = (scratch.ushort << 8) | (scratch.ushort >> 8);
-        sys.evt.BTS.nextevent   = (ot_long)scratch.ushort;
-#   endif
-        
-    // - Move cursor onto next beacon period, 
-    // - loop cursor if it is past the length of the list
-    // - and close file
-    sys.evt.BTS.cursor += 2;
-    if (sys.evt.BTS.cursor >= fp->length) {
-        sys.evt.BTS.cursor = 0;
+
+    stamp       = rm2_stamp.rxsync;
+    header[0]   = 0x1D;                 // NDEF short record, MB/ME set on TX
+    header[1]   = 0;
+    header[2]   = (ot_u8)(7 + length);
+    header[3]   = 2;
+    header[4]   = 0x04;                 // logger
+    header[5]   = DATA_m2frame;
+    header[6]   = (ot_u8)(stamp >> 24);
+    header[7]   = (ot_u8)(stamp >> 16);
+    header[8]   = (ot_u8)(stamp >> 8);
+    header[9]   = (ot_u8)stamp;
+    header[10]  = sys.sniffer.channel;
+    header[11]  = (ot_u8)radio_rssi();
+    rq_writestring(&sniffer_ring, header, 13);
+    rq_writestring(&sniffer_ring, rxq.front, length);
+}
+
+
+ot_bool sub_sniffer_drain() {
+/// The batch is the whole records that fit in OT_PARAM_SNIFFER_BATCH bytes (at
+/// least one), as one NDEF message: the first record gets MB, the last ME.  It
+/// is one or two segments, as the ring wraps.
+    ot_u8*  front = (ot_u8*)sniffer_ring.front;
+    ot_u16  get;
+    ot_u16  last;
+    ot_uint avail;
+    ot_uint batch;
+    ot_uint record;
+    ot_int  segs;
+
+    if ((sys.mutex & SYS_MUTEX_MPIPE) || (mpipe_status() != MPIPE_Idle)) {
+        return (ot_bool)(rq_length(&sniffer_ring) != 0);
     }
-    vl_close(fp);
-    
-    ///Start building the beacon packet
-    m2np_header(session, 0x40, 0);
-    q_writebyte(&txq, 0x20 + (beacon_params & 1));
-    {
-        ot_u8 increment;
-        *txq.putcursor  = (beacon_params & 0x04);
-        increment       = ((beacon_params & 0x04) != 0);
-        txq.putcursor  += increment;
-        txq.length     += increment;
+    sniffer_ring.getindex  += sys.sniffer.inflight;
+    sys.sniffer.inflight    = 0;
+
+    get     = sniffer_ring.getindex;
+    last    = get;
+    avail   = rq_length(&sniffer_ring);
+    batch   = 0;
+    while ((batch + 6) <= avail) {
+        record = 6 + front[(ot_u16)(get + batch + 2) & sniffer_ring.mask];
+        if (((batch + record) > avail) || \
+            ((batch != 0) && ((batch + record) > OT_PARAM(SNIFFER_BATCH)))) {
+            break;
+        }
+        last    = get + batch;
+        batch  += record;
+    }
+    if (batch == 0) {
+        return (ot_bool)(avail != 0);
     }
 
-    /// Setup the comm parameters, if the channel is available
-    /// <LI> tx_eirp, cs_rssi, and cca_rssi are set by the radio module </LI>
-    /// <LI> during the CSMA-CA process </LI>
-    dll.comm.tc             = M2_PARAM_BEACON_TCA;
-    dll.comm.rx_timeout     = (beacon_params & 0x02) ? \
-                                0 : rm2_default_tgd(session->channel); 
-    q_writebyte(&txq, (ot_u8)dll.comm.rx_timeout);
+    front[get & sniffer_ring.mask]     |= 0x80;
+    front[last & sniffer_ring.mask]    |= 0x40;
+    get                                &= sniffer_ring.mask;
+    sniffer_seg[0].data     = &front[get];
+    sniffer_seg[0].length   = (ot_int)batch;
+    segs                    = 1;
+    if ((get + batch) > OT_PARAM(SNIFFER_RING)) {
+        sniffer_seg[0].length   = OT_PARAM(SNIFFER_RING) - get;
+        sniffer_seg[1].data     = front;
+        sniffer_seg[1].length   = (ot_int)batch - sniffer_seg[0].length;
+        segs                    = 2;
+    }
+    if (mpipe_txsegs(sniffer_seg, segs, False, MPIPE_Broadcast) >= 0) {
+        sys.sniffer.inflight = (ot_u16)batch;
+    }
+    return True;
+}
+#endif
 
-    dll.comm.csmaca_params  = sys_default_csma(session->channel);
-    dll.comm.csmaca_params |= (beacon_params & 0x04);
-    dll.comm.csmaca_params |= (M2_CSMACA_NA2P | M2_CSMACA_MACCA);
-    dll.comm.redundants     = dll.netconf.b_attempts;              
-    dll.comm.tx_channels    = 1;
-    dll.comm.rx_channels    = 1;
-    dll.comm.tx_chanlist    = &dll.comm.scratch[0];
-    dll.comm.rx_chanlist    = &dll.comm.scratch[1];
-    dll.comm.scratch[0]     = session->channel;
-    dll.comm.scratch[1]     = session->channel;
-        
-    /// Finish building the beacon packet.  If the 
-    if (m2qp_isf_call((beacon_params & 1), &beacon_queue, AUTH_GUEST) >= 0) {
-        m2np_footer(session);
-#       if ((OT_FEATURE(SYSIDLE_CALLBACKS) == ENABLED) &&\
-            !defined(EXTF_sys_sig_btsprestart)  )
-            sys.evt.BTS.prestart( (void*)&sys.evt.BTS );
-#       elif defined(EXTF_sys_sig_btsprestart)
-            sys_sig_btsprestart( (void*)&sys.evt.BTS );
-#       endif
+
+
+
+/** Response Forwarding <BR>
+  * ============================================================================
+  * See OT_FEATURE_RESPFWD in system.h.  Records [0, inflight) are in the MPipe
+  * TX underway, and [inflight, count) wait for the next one.  A record is three
+  * segments: its header, and the ID and payload where they are in the slot.
+  */
+#if (OT_FEATURE(RESPFWD) == ENABLED)
+#if (OT_FEATURE(MPIPE_GATHER) != ENABLED)
+#   error "OT_FEATURE_RESPFWD needs OT_FEATURE_MPIPE_GATHER"
+#endif
+#if (OT_PARAM(FWDPOOL) == 0)
+#   error "OT_FEATURE_RESPFWD needs OT_PARAM_FWDPOOL > 0"
+#endif
+
+sys_fwdrec  respfwd_rec[OT_PARAM(FWDPOOL)];
+mpipe_seg   respfwd_seg[3*OT_PARAM(FWDPOOL)];
+
+
+#ifndef EXTF_sys_respfwd_put
+ot_bool sys_respfwd_put(ot_u8 type, ot_u8 id_length, ot_u8* id, ot_int length, ot_u8* payload) {
+    sys_fwdrec* rec;
+    ot_int      slot;
+
+    if ((sys.respfwd.count >= OT_PARAM(FWDPOOL)) || \
+        ((2 + id_length + length) > 255) || \
+        ((slot = buffers_fwdpool_put()) < 0)) {
+        sys.respfwd.drops += (sys.respfwd.drops != 65535);
+        return False;
     }
-    else {
-        session_pop();
+
+    if (sys.respfwd.count == sys.respfwd.inflight) {
+        sys.respfwd.stamp = platform_stamp();
     }
+    rec             = &respfwd_rec[sys.respfwd.count++];
+    rec->id         = id;
+    rec->payload    = payload;
+    rec->slot       = (ot_u8)slot;
+    rec->header[0]  = 0x1D;             // NDEF short record, MB/ME set on TX
+    rec->header[1]  = 0;
+    rec->header[2]  = (ot_u8)(2 + id_length + length);
+    rec->header[3]  = 2;
+    rec->header[4]  = 0x04;             // logger
+    rec->header[5]  = DATA_m2resp;
+    rec->header[6]  = type;
+    rec->header[7]  = id_length;
+    return True;
+}
 #endif
+
+
+#ifndef EXTF_sys_respfwd_drops
+ot_u16 sys_respfwd_drops() {
+    return sys.respfwd.drops;
 }
+#endif
+
 
+ot_long sub_respfwd_drain() {
+    sys_fwdrec* rec;
+    mpipe_seg*  seg;
+    ot_int      i;
+    ot_int      age;
 
+    if (sys.respfwd.count == 0) {
+        sys.respfwd.flush = False;
+        return -1;
+    }
+    if (mpipe_status() != MPIPE_Idle) {
+        return 1;
+    }
+
+    /// The last message is out: free its slots and move the waiting records
+    /// to the front.
+    if (sys.respfwd.inflight != 0) {
+        for (i=0; i<sys.respfwd.inflight; i++) {
+            buffers_fwdpool_free(respfwd_rec[i].slot);
+        }
+        sys.respfwd.count -= sys.respfwd.inflight;
+        for (i=0; i<sys.respfwd.count; i++) {
+            respfwd_rec[i] = respfwd_rec[i + sys.respfwd.inflight];
+        }
+        sys.respfwd.inflight = 0;
+        if (sys.respfwd.count == 0) {
+            sys.respfwd.flush = False;
+            return -1;
+        }
+    }
 
+    age = PLATFORM_STAMP_AGE(sys.respfwd.stamp);
+    if ((sys.respfwd.flush == False) && \
+        (sys.respfwd.count < OT_PARAM(FWDPOOL)) && \
+        (age < OT_PARAM(RESPFWD_WINDOW))) {
+        return (ot_long)(OT_PARAM(RESPFWD_WINDOW) - age);
+    }
 
+    seg = respfwd_seg;
+    for (i=0, rec=respfwd_rec; i<sys.respfwd.count; i++, rec++) {
+        rec->header[0]  = 0x1D | ((i == 0) ? 0x80 : 0) \
+                        | ((i == (sys.respfwd.count-1)) ? 0x40 : 0);
+        seg->data       = rec->header;
+        seg->length     = 8;
+        seg++;
+        if (rec->header[7] != 0) {
+            seg->data   = rec->id;
+            seg->length = rec->header[7];
+            seg++;
+        }
+        seg->data       = rec->payload;
+        seg->length     = rec->header[2] - 2 - rec->header[7];
+        seg            += (seg->length != 0);
+    }
+    if (mpipe_txsegs(respfwd_seg, (ot_int)(seg - respfwd_seg), False, MPIPE_Broadcast) >= 0) {
+        sys.respfwd.inflight    = sys.respfwd.count;
+        sys.respfwd.flush       = False;
+    }
+    return 1;
+}
+#endif
 
 
 
 
-/** Radio I/O Events
+/** Network Time Sync <BR>
   * ============================================================================
-  * - Initialize RX, Initialize TX, plus variations                         <BR>
-  * - Negotiate radio callbacks with radio core driver                      <BR>
-  * - Include system callbacks that run on init (if callbacks enabled)      <BR>
-  * - Include system callbacks that run on completion (if callbacks enabled)<BR>
-  * - Non-blocking, although sometimes system event handler is paused
+  * See OT_FEATURE_NETSYNC in system.h.  sys.netsync.time is clocked with the
+  * idle events in sub_clock_tasks(), so an event that is put on the network
+  * schedule stays on it until the clocks drift apart.
   */
+#if (OT_FEATURE(NETSYNC) == ENABLED)
+#ifndef EXTF_sys_netsync_time
+ot_u32 sys_netsync_time() {
+    return sys.netsync.time + platform_get_gptim();
+}
+#endif
 
 
-void sysevt_receive() {
-/// Radio receive is handled by radio core interrupts after it is initialized, 
-/// but the system layer is used as a watchdog for the radio core in case no
-/// RX is detected or there is some error in the RX process.
+#ifndef EXTF_sys_netsync_synced
+ot_bool sys_netsync_synced() {
+    return sys.netsync.synced;
+}
+#endif
 
-/// @note if you want to use a built-in RX termination or polling timer inside
-/// the radio core (some devices have these), be very careful.  If the radio
-/// timer gets out of sync with the kernel (i.e. if your core timer isn't very
-/// accurate), then it is going to cause all sorts of timing glitches.  Giving
-/// the kernel control over listening makes the system more stable and better
-/// synchronized.  Usage of HW RX timer is mostly useful for very specific
-/// applications using very custom builds of OpenTag.
 
-#   if (RF_FEATURE(RXTIMER) == DISABLED)
-        rm2_rxtimeout_isr();
-#   else
-        // Add a little bit of time in case the radio timer is a bit slow.
-        sys.evt.RFA.nextevent = 10;
-        sys.evt.RFA.event_no  = 0;
-#   endif
+#ifndef EXTF_sys_netsync_set
+void sys_netsync_set(ot_u32 nettime) {
+#if (M2_FEATURE(GATEWAY) != ENABLED)
+    nettime            += (ot_u32)PLATFORM_STAMP_AGE(rm2_stamp.rxsync);
+    sys.netsync.error   = (ot_long)(nettime - sys_netsync_time());
+    sys.netsync.time    = nettime - platform_get_gptim();
+    sys.netsync.synced  = True;
+    sub_netsync_align();
+#endif
+}
+#endif
+
+
+#ifndef EXTF_sys_netsync_eta
+ot_long sys_netsync_eta(ot_u8 channel) {
+    ot_u32  period;
+    ot_u32  offset;
+    ot_u32  phase;
+    ot_u32  wait;
+    ot_long eta = -1;
+    ot_u8   i;
+
+    sub_schedule_refresh();
+    for (i=0, period=0; i<schedule.sss_count; i++) {
+        period += schedule.sss[i].next;
+    }
+    if ((sys.netsync.synced == False) || (period == 0)) {
+        return -1;
+    }
+
+    phase = sys_netsync_time() % period;
+    for (i=0, offset=0; i<schedule.sss_count; offset+=schedule.sss[i].next, i++) {
+        if (schedule.sss[i].channel == channel) {
+            wait = (offset >= phase) ? (offset - phase) : (offset + period - phase);
+            if ((eta < 0) || (wait < (ot_u32)eta)) {
+                eta = (ot_long)wait;
+            }
+        }
+    }
+    return eta;
 }
+#endif
 
 
+void sub_netsync_stamp() {
+    if ((sys.netsync.txpos != 0) && \
+        (session_top()->dialog_id == sys.netsync.txdialog)) {
+        ot_u32  nettime = sys_netsync_time();
+        ot_u8*  cursor  = &txq.front[sys.netsync.txpos];
+        cursor[0]       = (ot_u8)(nettime >> 24);
+        cursor[1]       = (ot_u8)(nettime >> 16);
+        cursor[2]       = (ot_u8)(nettime >> 8);
+        cursor[3]       = (ot_u8)nettime;
+    }
+    sys.netsync.txpos = 0;
+}
 
 
+void sub_netsync_align() {
+/// Datum N of the sleep scan sequence starts at the sum of the Next Scans of
+/// the datums before it, so the next one to run is the first that starts at
+/// or after the phase.  Chained datums (Next Scan of 0) start together.
+#if (M2_FEATURE(ENDPOINT) == ENABLED)
+    ot_u32  period;
+    ot_u32  offset;
+    ot_u32  phase;
+    ot_u8   i;
 
-void sysevt_bscan() {
-/// The bscan event (Background Scan) is used when the acquired HSS or SSS
-/// period (from some offset in ISF 05 or 04 respectively) specifies a bscan as
-/// opposed to an fscan.  bscan is sessionless, so it excutes directly from the
-/// channel scan event process (it is therefore a child process).
-///
-/// Background scans happen quickly (1-10 ticks) unless you decide to jack-up 
-/// the bscan redundancy to a high amount (best practice is <=5, typ 3).  Bscans
-/// block the system event handler while underway.
-#if ((M2_FEATURE(GATEWAY) == ENABLED) || \
-     (M2_FEATURE(SUBCONTROLLER) == ENABLED) || \
-     (M2_FEATURE(ENDPOINT) == ENABLED))
+    if ((sys.evt.SSS.event_no == 0) || (sys.evt.SSS.sched_id != 0)) {
+        return;
+    }
+    sub_schedule_refresh();
+    for (i=0, period=0; i<schedule.sss_count; i++) {
+        period += schedule.sss[i].next;
+    }
+    if (period == 0) {
+        return;
+    }
 
-#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-        !defined(EXTF_sys_sig_rfainit)  )
-        sys.evt.RFA.init(1);
-#   elif defined(EXTF_sys_sig_rfainit)
-        sys_sig_rfainit(1);
-#   endif
-    
-    sys.evt.RFA.event_no    = 1;
-    sys.evt.RFA.nextevent   = dll.comm.rx_timeout;
-    sys.mutex               = SYS_MUTEX_RADIO_LISTEN;
-    rm2_rxinit_bf(dll.comm.rx_chanlist[0], &rfevt_bscan);
+    phase = sys_netsync_time() % period;
+    for (i=0, offset=0; (i<schedule.sss_count) && (offset<phase); i++) {
+        offset += schedule.sss[i].next;
+    }
+    if (i >= schedule.sss_count) {
+        i       = 0;
+        offset  = period;
+    }
+    sys.evt.SSS.cursor      = (ot_int)i << 2;
+    sys.evt.SSS.nextevent   = (ot_long)(offset - phase) + (ot_long)platform_get_gptim();
 #endif
 }
+#endif
 
 
 
 
-void rfevt_bscan(ot_int scode, ot_int fcode) {
-/// bscan reception radio-core event callback: called by radio core driver when
-/// the bscan process terminates, either due to success or failure
-
-    // CRC Failure (or init), retry
-    if ((scode == -1) && (dll.comm.redundants != 0)) {
-        rm2_rxinit_bf(dll.comm.rx_chanlist[0], &rfevt_bscan);    //non-blocking
+/** Kernel Profiler <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(PROFILER) == ENABLED)
+#ifndef EXTF_sys_profile_log
+void sys_profile_log(ot_u8 id, ot_u32 mark) {
+    sys_profile*    prof;
+    ot_u32          duration;
+    ot_u32          limit;
+    ot_int          bin;
+    
+    prof        = &sys.profile[id];
+    duration    = platform_get_cycles() - mark;
+    
+    prof->count++;
+    prof->total += duration;
+    if (duration > prof->max) {
+        prof->max = duration;
     }
     
-    // Do not retry (success on (scode >= 0) or radio-core-failure otherwise)
-    else {
-        radio_sleep();
-        session_pop();
-
-        if ((scode >= 0) && (sub_mac_filter() == True)) {
-            sys.mutex = SYS_MUTEX_PROCESSING;
-            network_parse_bf();					// must create a new session
+    for (bin=0, limit=16; (bin<(SYS_PROFILE_BINS-1)) && (duration>=limit); bin++) {
+        limit <<= 2;
+    }
+    prof->hist[bin]++;
+    
+    /// Halve everything instead of letting the count roll over
+    if (prof->count == 65535) {
+        prof->count >>= 1;
+        prof->total >>= 1;
+        for (bin=0; bin<SYS_PROFILE_BINS; bin++) {
+            prof->hist[bin] >>= 1;
         }
-#       if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-            !defined(EXTF_sys_sig_rfaterminate)  )
-            sys.evt.RFA.terminate(1, scode);
-#       elif defined(EXTF_sys_sig_rfaterminate)
-            sys_sig_rfaterminate(1, scode);
-#       endif
-
-        sys.mutex 				= 0;
-        sys.evt.RFA.event_no 	= 0;
     }
 }
+#endif
 
 
+#ifndef EXTF_sys_profile_isrstart
+void sys_profile_isrstart() {
+    sys.isr_mark = platform_get_cycles();
+}
+#endif
 
 
-void sysevt_fscan() {
-/// The fscan event (Foreground Scan) is used when the acquired HSS or SSS
-/// period (from some offset in ISF 05 or 04 respectively) specifies a fscan as
-/// opposed to an bscan.  fscan is used in anticipation of a foreground frame
-/// dialog, which is a formal session.
-#if (SYS_RECEIVE == ENABLED)
-    m2session*  session;
+#ifndef EXTF_sys_profile_isrstop
+void sys_profile_isrstop(ot_u8 id) {
+    sys_profile_log(id, sys.isr_mark);
+}
+#endif
 
-#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-        !defined(EXTF_sys_sig_rfainit)  )
-        sys.evt.RFA.init(2);
-#   elif defined(EXTF_sys_sig_rfainit)
-        sys_sig_rfainit(2);
-#   endif
-    
-    /// Set up events so that the next RF event will occur when this times-out.
-    /// Listening will block non-RFA events from occuring.
-    sys.mutex               = SYS_MUTEX_RADIO_LISTEN;
-    sys.evt.RFA.nextevent   = dll.comm.rx_timeout;
-    sys.evt.RFA.event_no    = 2;
-    session                 = session_top();
-    
-    ///@todo find a way to get multiframe indicator in third argument
-    rm2_rxinit_ff(  (session->channel), 
-                    (session->netstate & M2_NETSTATE_SMASK), 
-                    0,
-                    &rfevt_frx  );
+
+#ifndef EXTF_sys_profile_waitstart
+void sys_profile_waitstart() {
+    sys.wait_mark = platform_get_cycles();
+}
 #endif
+
+
+#ifndef EXTF_sys_profile_waitstop
+void sys_profile_waitstop() {
+    sys_profile_log(SYS_PROFILE_RFWAIT, sys.wait_mark);
 }
+#endif
 
 
+#ifndef EXTF_sys_profile_clear
+void sys_profile_clear() {
+    ot_u8*  cursor  = (ot_u8*)sys.profile;
+    ot_int  i       = sizeof(sys.profile);
+    
+    while (--i >= 0) {
+        *cursor++ = 0;
+    }
+}
+#endif
+
 
+#ifndef EXTF_sys_profile_export
+ot_u16 sub_profile_sat(ot_u32 value) {
+    return (value > 65535) ? 65535 : (ot_u16)value;
+}
 
-void rfevt_frx(ot_int pcode, ot_int fcode) {
-/// Radio Core event callback, called by the radio driver when a frame is rx'ed
-/// or if there is some type of error.
-    ot_int frx_code = 0;
+ot_int sys_profile_export() {
+#if defined(ISF_ID_kernel_profile)
+    vlFILE* fp;
+    ot_int  i, j;
+    ot_uint offset = 0;
+    ot_u16  word[3+SYS_PROFILE_BINS];
     
-    // pcode: When negative, a listening timeout.
-    // dll.comm.redundants is decremented after TX.  It must be 0 for scanning.
-    if (pcode < 0) {
-    	m2session* session  = session_top();
-#   if (RF_FEATURE(RXTIMER) == ENABLED)
-        pcode = 0;
-#   endif
-        session->netstate		= (dll.comm.redundants) ? \
-        							(M2_NETSTATE_REQTX | M2_NETSTATE_INIT) : \
-        							(M2_NETFLAG_SCRAP);
-        sys.evt.RFA.event_no 	= 0;	//quit RF (RX) process
-      //frx_code                = -5;   //this doesn't get reported anyway
+    fp = ISF_open_su( ISF_ID(kernel_profile) );
+    if (fp == NULL) {
+        return -1;
     }
     
-    // pcode: When non-negative, the number of frames remaining.
-    else {
-        /// Handle damaged frames (CRC)                                     <BR>
+    for (i=0; i<SYS_PROFILE_IDS; i++) {
+        sys_profile* prof = &sys.profile[i];
+        
+        if ((offset + sizeof(word)) > fp->alloc) {
+            break;
+        }
+        word[0] = prof->count;
+        word[1] = (prof->count == 0) ? 0 : sub_profile_sat(prof->total / prof->count);
+        word[2] = sub_profile_sat(prof->max);
+        for (j=0; j<SYS_PROFILE_BINS; j++) {
+            word[3+j] = prof->hist[j];
+        }
+        for (j=0; j<(3+SYS_PROFILE_BINS); j++, offset+=2) {
+            vl_write(fp, offset, PLATFORM_ENDIAN16(word[j]));
+        }
+    }
+    
+    vl_close(fp);
+    return offset;
+    
+#else
+    return -1;
+#endif
+}
+#endif
+
+#endif
+
+
+
+
+/** Kernel Trace <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(TRACE) == ENABLED)
+#if (SYS_TRACE_SIZE & (SYS_TRACE_SIZE-1))
+#   error "SYS_TRACE_SIZE must be a power of 2"
+#endif
+
+#ifndef EXTF_sys_trace
+void sys_trace(ot_u8 id, ot_u8 arg) {
+/// The put index is incremented first, so an ISR that traces in the middle of
+/// this function gets its own slot.
+    ot_u16* rec;
+    ot_u16  now;
+    
+    now             = platform_get_gptim();
+    rec             = sys.trace.ring[sys.trace.put++ & (SYS_TRACE_SIZE-1)];
+    rec[0]          = ((ot_u16)id << 8) | arg;
+    rec[1]          = now - sys.trace.last;
+    sys.trace.last  = now;
+#   if (SYS_TRACE_TRIG == ENABLED)
+    platform_trig2_toggle();
+#   endif
+}
+#endif
+
+
+#ifndef EXTF_sys_trace_clear
+void sys_trace_clear() {
+    ot_u8*  cursor  = (ot_u8*)&sys.trace;
+    ot_int  i       = sizeof(sys.trace);
+    
+    while (--i >= 0) {
+        *cursor++ = 0;
+    }
+}
+#endif
+
+
+#ifndef EXTF_sys_trace_export
+ot_int sys_trace_export() {
+#if defined(ISF_ID_kernel_trace)
+    vlFILE* fp;
+    ot_u16  i, count;
+    ot_uint offset;
+    
+    fp = ISF_open_su( ISF_ID(kernel_trace) );
+    if (fp == NULL) {
+        return -1;
+    }
+    
+    /// Oldest record is at put when the ring has wrapped, else at 0
+    count   = (sys.trace.put > SYS_TRACE_SIZE) ? SYS_TRACE_SIZE : sys.trace.put;
+    i       = sys.trace.put - count;
+    vl_write(fp, 0, PLATFORM_ENDIAN16(sys.trace.put));
+    
+    for (offset=2; (count != 0) && ((offset+4) <= fp->alloc); count--, i++, offset+=4) {
+        ot_u16* rec = sys.trace.ring[i & (SYS_TRACE_SIZE-1)];
+        vl_write(fp, offset, PLATFORM_ENDIAN16(rec[0]));
+        vl_write(fp, offset+2, PLATFORM_ENDIAN16(rec[1]));
+    }
+    
+    vl_close(fp);
+    return offset;
+    
+#else
+    return -1;
+#endif
+}
+#endif
+
+#endif
+
+
+
+
+/** System Events <BR>
+  * ============================================================================
+  */
+
+
+/** Idle Time Events <BR>
+  * ======================================================================= <BR>
+  * - Scanning and Beaconing                                                <BR>
+  * - Set up pending radio RX or TX events                                  <BR>
+  * - Include callbacks that run before they start (if callbacks enabled)   <BR>
+  * - Generally run very fast (0 ticks, or negligible)
+  */
+
+ot_u8 sub_scan_load(vlFILE* fp, sched_scan* seq, ot_u8 limit) {
+/// Called by sub_schedule_refresh()
+/// Duty: decode a scan sequence ISF into a table, return number of datums
+    ot_int      i;
+    ot_u8       j = 0;
+    Twobytes    scratch;
+
+    if (fp != NULL) {
+        for (i=0; ((i+4) <= fp->length) && (j < limit); i+=4, j++) {
+            scratch.ushort      = vl_read(fp, i);
+            seq[j].channel      = scratch.ubyte[0];
+            seq[j].flags        = scratch.ubyte[1];
+            scratch.ushort      = vl_read(fp, i+2);
+            seq[j].next         = PLATFORM_ENDIAN16(scratch.ushort);
+        }
+        vl_close(fp);
+    }
+    return j;
+}
+
+
+void sub_schedule_refresh() {
+/// Called by sys_refresh() and by the idle event processors
+/// Duty: Reload the schedule tables from the scan and beacon sequence ISFs if
+///       they have not been loaded yet, or if any file has been changed since.
+    ot_u16 stamp = (ot_u16)(vl_writestamp + vl_mapstamp);
+
+    if ((schedule.valid == False) || (schedule.stamp != stamp)) {
+        schedule.hss_count = sub_scan_load(ISF_open_su(ISF_ID(hold_scan_sequence)), 
+                                            schedule.hss, SCHED_HSS_DATUMS);
+#       if (SCHED_SSS_TABLE)
+        schedule.sss_count = sub_scan_load(ISF_open_su(ISF_ID(sleep_scan_sequence)), 
+                                            schedule.sss, SCHED_SSS_DATUMS);
+#       endif
+#       if (M2_FEATURE(BEACONS) == ENABLED)
+        {
+            vlFILE*     fp;
+            ot_int      i;
+            ot_u8       j = 0;
+            Twobytes    scratch;
+            
+            fp = ISF_open_su( ISF_ID(beacon_transmit_sequence) );
+            if (fp != NULL) {
+                for (i=0; ((i+8) <= fp->length) && (j < SCHED_BTS_DATUMS); i+=8, j++) {
+                    scratch.ushort              = vl_read(fp, i);
+                    schedule.bts[j].channel     = scratch.ubyte[0];
+                    schedule.bts[j].params      = scratch.ubyte[1];
+                    scratch.ushort              = vl_read(fp, i+2);
+                    schedule.bts[j].call[0]     = scratch.ubyte[0];
+                    schedule.bts[j].call[1]     = scratch.ubyte[1];
+                    scratch.ushort              = vl_read(fp, i+4);
+                    schedule.bts[j].call[2]     = scratch.ubyte[0];
+                    schedule.bts[j].call[3]     = scratch.ubyte[1];
+                    scratch.ushort              = vl_read(fp, i+6);
+                    schedule.bts[j].next        = PLATFORM_ENDIAN16(scratch.ushort);
+                }
+                vl_close(fp);
+            }
+            schedule.bts_count = j;
+        }
+#       endif
+
+        schedule.stamp = stamp;
+        schedule.valid = True;
+    }
+}
+
+
+
+
+OT_INLINE void sysevt_holdscan() {
+#if (M2_FEATURE(BLINKER) != ENABLED)
+    sub_schedule_refresh();
+    sub_scan_channel(&sys.evt.HSS, schedule.hss, schedule.hss_count);
+#endif
+}
+
+
+
+
+OT_INLINE void sysevt_sleepscan() {
+/// See implementation notes for sysevt_holdscan
+#if (M2_FEATURE(ENDPOINT) == ENABLED)
+    sub_schedule_refresh();
+    sub_scan_channel(&sys.evt.SSS, schedule.sss, schedule.sss_count);
+#endif
+}
+
+
+
+
+void sub_scan_channel(idletime_event* idlevt, const sched_scan* seq, ot_u8 count) {
+/// Like with the Beacon event processor, the scan event processor currently
+/// is expected to run in negligible time: it is non-blocking and the actual
+/// reception is another event, so this is generally accurate.  In the future
+/// elapsed time could be taken into account without too much trouble.
+#if ((M2_FEATURE(GATEWAY) == ENABLED) || \
+     (M2_FEATURE(SUBCONTROLLER) == ENABLED) || \
+     (M2_FEATURE(ENDPOINT) == ENABLED))
+    ot_u8       s_channel;
+    ot_u8       s_flags;
+    ot_u8       index;
+#   if (SYS_SNIFF)
+    ot_int      s_cursor = idlevt->cursor;
+#   endif
+#   if (SYS_SCANHOP)
+    ot_u8       hops;
+#   endif
+    
+#   if (OT_FEATURE(SYSIDLE_CALLBACKS) == ENABLED)
+        idlevt->prestart( (void*)idlevt );
+#   endif
+    
+    /// An empty sequence has nothing to scan: check again later, like the
+    /// beacon event does.
+    if (count == 0) {
+        idlevt->nextevent = 65535;
+        return;
+    }
+    
+    /// Pull channel ID, Scan flags and Next Scan from the table.  The cursor
+    /// is the byte offset of the datum in the ISF (4 bytes per datum), and it
+    /// goes back to 0 at the end of the sequence.
+    index = (ot_u8)(idlevt->cursor >> 2);
+    if (index >= count) {
+        index = 0;
+    }
+    s_channel           = seq[index].channel;
+    s_flags             = seq[index].flags;
+    idlevt->nextevent   = (ot_long)seq[index].next;
+    
+    index++;
+    
+    /// Chain the datums that follow a Next Scan of 0 into this scan event
+#   if (SYS_SCANHOP)
+    scanhop.chan[0]     = s_channel;
+    scanhop.dwell[0]    = otutils_calc_timeout(s_flags);
+    hops                = 1;
+    while ( (idlevt->nextevent == 0) && (index < count) && (hops < SYS_SCAN_HOPS) \
+        &&  (((seq[index].flags ^ s_flags) & 0x80) == 0) ) {
+        scanhop.chan[hops]  = seq[index].channel;
+        scanhop.dwell[hops] = otutils_calc_timeout(seq[index].flags);
+        idlevt->nextevent   = (ot_long)seq[index].next;
+        index++;
+        hops++;
+    }
+    scanhop.armed       = hops - 1;
+#   endif
+    
+    idlevt->cursor      = (index < count) ? ((ot_int)index << 2) : 0;
+    
+    /// A scheduled scan sequence runs once for each RTC alarm
+#   if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
+    if ((idlevt->sched_id != 0) && (idlevt->cursor == 0)) {
+        idlevt->nextevent = SCHED_WAIT;
+    }
+#   endif
+
+    /// A sleep scan sequence with one datum (the cursor is back at 0 after it)
+    /// is periodic, so fscan/bscan can hand it to the radio (sub_sniff).
+#   if (SYS_SNIFF)
+    sys.evt.sniff_period = ((idlevt == &sys.evt.SSS) && (s_cursor == 0) && (idlevt->cursor == 0)) ? \
+                                (ot_uint)idlevt->nextevent : 0;
+#   endif
+#   if (SYS_SNIFF && SYS_SCANHOP)
+    if (hops > 1) {
+        sys.evt.sniff_period = 0;
+    }
+#   endif
+
+    /// Perform the scan                                                    <BR>
+    ///  - b5:0 of the scan flags is the normal scan timeout                <BR>
+    ///  - b6 of the scan flags enables 1024x multiplier on scan timeout    <BR>
+    ///  - b7 of the scan flags is foreground (0), background (1)
+    ///  - a chained scan listens on rx_chanlist[0] first (see sub_scan_hop)
+    dll.comm.rx_timeout     = otutils_calc_timeout(s_flags);
+    dll.comm.redundants     = 0;
+#   if (SYS_SCANHOP)
+    dll.comm.rx_channels    = hops;
+    dll.comm.rx_chanlist    = scanhop.chan;
+#   else
+    dll.comm.rx_channels    = 1;
+    dll.comm.rx_chanlist    = &dll.comm.scratch[1];
+    dll.comm.scratch[1]     = s_channel;
+#   endif
+        
+    /// Background Scan or Foreground Scan is based on flags
+    s_flags = (s_flags & 0x80) ? \
+                (M2_NETSTATE_REQRX | M2_NETSTATE_INIT |M2_NETFLAG_FLOOD ) : \
+                (M2_NETSTATE_REQRX | M2_NETSTATE_INIT);
+
+    session_new(0, s_flags, s_channel);
+#endif
+}
+
+
+
+
+#if (M2_FEATURE(BEACONS) == ENABLED)
+ot_bool sub_beacon_replay(m2session* session, ot_u8 index) {
+/// Called by sysevt_beacon()
+/// Duty: if the cached frame was built by this beacon datum and no file has
+///       changed since, load it into txq with the dialog ID of the new 
+///       session and return True.  Otherwise return False.
+#if (SYS_BEACON_CACHE)
+    if ((bcache.index == index) && \
+        (bcache.stamp == (ot_u16)(vl_writestamp + vl_mapstamp))) {
+        q_start(&txq, 0, 0);
+        q_writestring(&txq, bcache.frame, bcache.length);
+        txq.front[SCHED_DIALOGID]   = session->dialog_id;
+        m2np.header.fr_info         = bcache.fr_info;
+        m2np.header.addr_ctl        = bcache.addr_ctl;
+#       if (OT_FEATURE(NETSYNC) == ENABLED)
+        sys.netsync.txpos           = bcache.netpos;
+        sys.netsync.txdialog        = session->dialog_id;
+#       endif
+        return True;
+    }
+#endif
+    return False;
+}
+
+
+ot_bool sub_beacon_build(m2session* session, ot_u8 beacon_params, Queue* call_q, ot_u8 index) {
+/// Called by sysevt_beacon()
+/// Duty: build the beacon frame in txq and save it in the cache.  Return False
+///       if the ISF call template cannot be answered.
+    ot_u8 cmd_ext = (beacon_params & 0x04);
+
+    m2np_header(session, 0x40, 0);
+    
+    /// With network time sync, the time goes after the command extension.
+    /// It is only a placeholder here: sysevt_initftx() writes it.
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+    sys.netsync.txpos = 0;
+    if (sys.netsync.synced) {
+        cmd_ext |= M2CE_NETTIME;
+    }
+#   endif
+    if (cmd_ext != 0) {
+        q_writebyte(&txq, 0xA0 + (beacon_params & 1));
+        q_writebyte(&txq, cmd_ext);
+    }
+    else {
+        q_writebyte(&txq, 0x20 + (beacon_params & 1));
+    }
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+    if (cmd_ext & M2CE_NETTIME) {
+        sys.netsync.txpos       = (ot_u8)(txq.putcursor - txq.front);
+        sys.netsync.txdialog    = session->dialog_id;
+        q_writelong(&txq, 0);
+    }
+#   endif
+    q_writebyte(&txq, (ot_u8)dll.comm.rx_timeout);
+    
+    if (m2qp_isf_call((beacon_params & 1), call_q, AUTH_GUEST) < 0) {
+        return False;
+    }
+    m2np_footer(session);
+    
+#   if (SYS_BEACON_CACHE)
+    bcache.index = SCHED_NONE;
+    if (((m2np.header.fr_info & (M2FI_DLLS | M2FI_ENADDR)) == M2FI_ENADDR) && \
+        ((m2np.header.addr_ctl & M2_FLAG_NLS) == 0) && \
+        (txq.length <= SYS_BEACON_CACHE_SIZE)) {
+        platform_memcpy(bcache.frame, txq.front, txq.length);
+        bcache.length   = (ot_u8)txq.length;
+        bcache.fr_info  = m2np.header.fr_info;
+        bcache.addr_ctl = m2np.header.addr_ctl;
+#       if (OT_FEATURE(NETSYNC) == ENABLED)
+        bcache.netpos   = sys.netsync.txpos;
+#       endif
+        bcache.stamp    = (ot_u16)(vl_writestamp + vl_mapstamp);
+        bcache.index    = index;
+    }
+#   endif
+    return True;
+}
+#endif
+
+
+
+void sysevt_beacon() {
+/// The beacon event is probably finished, from a feature perspective.  It
+/// behaves like a proper event, returning quickly without much processing,
+/// and it calls the initftx event when it is ready to transmit.  If beacon
+/// process runtime is taken into account later (now it is negligible), some
+/// simple edits can be made to this function, which are noted.
+#if (M2_FEATURE(BEACONS) == ENABLED)
+    m2session*      session;
+    ot_u8           beacon_params;
+    ot_u8           index;
+    Queue           beacon_queue;
+    sched_beacon*   datum;
+
+    /// Get the beacon datum from the schedule table.  Make sure there is a 
+    /// beacon sequence of non-zero length and that beacons are presently
+    /// enabled.  Otherwise, in 64 seconds it will check again.  The value
+    /// 64s is arbitrary.  You can change it or asynchronously pre-empt a
+    /// beacon restart by flushing the system.
+    sub_schedule_refresh();
+    if ((dll.netconf.b_attempts == 0) || (schedule.bts_count == 0)) {
+        sys.evt.BTS.nextevent = 65535;  ///@todo make this an app-config parameter
+        return;
+    }
+    index = (ot_u8)(sys.evt.BTS.cursor >> 3);
+    if (index >= schedule.bts_count) {
+        index = 0;
+    }
+    datum = &schedule.bts[index];
+    
+    // Chan ID, Cmd Code
+    // - Setup beacon ad-hoc session, on specified channel
+    //   (ad hoc sessions never return NULL)
+    // - Assure cmd code is always Broadcast & Announcement
+    session                 = session_new(0, M2_NETSTATE_INIT, datum->channel);
+    session->subnet         = dll.netconf.b_subnet;
+    beacon_params           = datum->params;
+    session->flags          = (dll.netconf.dd_flags & ~0x30);
+    session->flags         |= (beacon_params & 0x30);
+        
+    // ISF Call Template
+    ///@todo Agaidi has the q init going to 32.  I need to find why
+    q_init(&beacon_queue, datum->call, 4);
+        
+    // Next Beacon ticks
+    sys.evt.BTS.nextevent   = (ot_long)datum->next;
+        
+    // - Move cursor onto next beacon period (8 bytes per datum in the ISF)
+    // - loop cursor if it is past the length of the list
+    if ((index+1) < schedule.bts_count) {
+        sys.evt.BTS.cursor = (ot_int)(index+1) << 3;
+    }
+    else {
+        sys.evt.BTS.cursor = 0;
+#       if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
+        if (sys.evt.BTS.sched_id != 0) {
+            sys.evt.BTS.nextevent = SCHED_WAIT;     // once for each RTC alarm
+        }
+#       endif
+    }
+    
+    /// Setup the comm parameters, if the channel is available
+    /// <LI> tx_eirp, cs_rssi, and cca_rssi are set by the radio module </LI>
+    /// <LI> during the CSMA-CA process </LI>
+    dll.comm.tc             = M2_PARAM_BEACON_TCA;
+    dll.comm.rx_timeout     = (beacon_params & 0x02) ? \
+                                0 : rm2_default_tgd(session->channel); 
+    dll.comm.csmaca_params  = sys_default_csma(session->channel);
+    dll.comm.csmaca_params |= (beacon_params & 0x04);
+    dll.comm.csmaca_params |= (M2_CSMACA_NA2P | M2_CSMACA_MACCA);
+    dll.comm.redundants     = dll.netconf.b_attempts;              
+    dll.comm.tx_channels    = 1;
+    dll.comm.rx_channels    = 1;
+    dll.comm.tx_chanlist    = &dll.comm.scratch[0];
+    dll.comm.rx_chanlist    = &dll.comm.scratch[1];
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    dll.comm.tx_eirp        = M2_PWR_FULL;
+#   endif
+    dll.comm.scratch[0]     = session->channel;
+    dll.comm.scratch[1]     = session->channel;
+        
+    /// Build the beacon packet, or replay it from the cache when the beacon
+    /// datum and the files it reads are unchanged since it was built.  If 
+    /// the ISF call template cannot be answered, there is no beacon.
+    if (sub_beacon_replay(session, index) || \
+        sub_beacon_build(session, beacon_params, &beacon_queue, index)) {
+#       if ((OT_FEATURE(SYSIDLE_CALLBACKS) == ENABLED) &&\
+            !defined(EXTF_sys_sig_btsprestart)  )
+            sys.evt.BTS.prestart( (void*)&sys.evt.BTS );
+#       elif defined(EXTF_sys_sig_btsprestart)
+            sys_sig_btsprestart( (void*)&sys.evt.BTS );
+#       endif
+    }
+    else {
+#       if (OT_FEATURE(NETSYNC) == ENABLED)
+        sys.netsync.txpos = 0;
+#       endif
+        session_pop();
+    }
+#endif
+}
+
+
+
+
+
+
+
+
+/** Radio I/O Events
+  * ============================================================================
+  * - Initialize RX, Initialize TX, plus variations                         <BR>
+  * - Negotiate radio callbacks with radio core driver                      <BR>
+  * - Include system callbacks that run on init (if callbacks enabled)      <BR>
+  * - Include system callbacks that run on completion (if callbacks enabled)<BR>
+  * - Non-blocking, although sometimes system event handler is paused
+  */
+
+
+void sysevt_receive() {
+/// Radio receive is handled by radio core interrupts after it is initialized, 
+/// but the system layer is used as a watchdog for the radio core in case no
+/// RX is detected or there is some error in the RX process.
+
+/// @note if you want to use a built-in RX termination or polling timer inside
+/// the radio core (some devices have these), be very careful.  If the radio
+/// timer gets out of sync with the kernel (i.e. if your core timer isn't very
+/// accurate), then it is going to cause all sorts of timing glitches.  Giving
+/// the kernel control over listening makes the system more stable and better
+/// synchronized.  Usage of HW RX timer is mostly useful for very specific
+/// applications using very custom builds of OpenTag.
+
+#   if (RF_FEATURE(RXTIMER) == DISABLED)
+#       if (SYS_SCANHOP)
+        if (sub_scan_hop()) {
+            return;
+        }
+#       endif
+        rm2_rxtimeout_isr();
+#   else
+        // Add a little bit of time in case the radio timer is a bit slow.
+        sys.evt.RFA.nextevent = 10;
+        sys.evt.RFA.event_no  = 0;
+#   endif
+}
+
+
+
+
+
+void sysevt_bscan() {
+/// The bscan event (Background Scan) is used when the acquired HSS or SSS
+/// period (from some offset in ISF 05 or 04 respectively) specifies a bscan as
+/// opposed to an fscan.  bscan is sessionless, so it excutes directly from the
+/// channel scan event process (it is therefore a child process).
+///
+/// Background scans happen quickly (1-10 ticks) unless you decide to jack-up 
+/// the bscan redundancy to a high amount (best practice is <=5, typ 3).  Bscans
+/// block the system event handler while underway.
+#if ((M2_FEATURE(GATEWAY) == ENABLED) || \
+     (M2_FEATURE(SUBCONTROLLER) == ENABLED) || \
+     (M2_FEATURE(ENDPOINT) == ENABLED))
+
+#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+        !defined(EXTF_sys_sig_rfainit)  )
+        sys.evt.RFA.init(1);
+#   elif defined(EXTF_sys_sig_rfainit)
+        sys_sig_rfainit(1);
+#   endif
+    
+    sys.evt.RFA.event_no    = 1;
+    sys.evt.RFA.nextevent   = dll.comm.rx_timeout;
+    SYS_RADIO_MUTEX(SYS_MUTEX_RADIO_LISTEN);
+#   if (SYS_SCANHOP)
+    sub_scan_arm();
+#   endif
+#   if (SYS_SNIFF)
+    if (sub_sniff(dll.comm.rx_chanlist[0], M2_NETFLAG_FLOOD, &rfevt_bscan)) {
+        return;
+    }
+#   endif
+    rm2_rxinit_bf(dll.comm.rx_chanlist[0], &rfevt_bscan);
+#endif
+}
+
+
+
+
+void rfevt_bscan(ot_int scode, ot_int fcode) {
+/// bscan reception radio-core event callback: called by radio core driver when
+/// the bscan process terminates, either due to success or failure
+    SYS_TRACE(SYS_TRACE_BSCAN, scode);
+
+    // CRC Failure (or init), retry
+    if ((scode == -1) && (dll.comm.redundants != 0)) {
+        rm2_rxinit_bf(dll.comm.rx_chanlist[0], &rfevt_bscan);    //non-blocking
+    }
+    
+    // Do not retry (success on (scode >= 0) or radio-core-failure otherwise)
+    else {
+#       if (SYS_SCANHOP)
+        scanhop.left = 0;
+#       endif
+        radio_sleep();
+
+        /// A good BF renews the bscan session in place, else it is popped
+        if ((scode >= 0) && (fcode == 0) && (sub_mac_filter() == True)) {
+            SYS_RADIO_MUTEX(SYS_MUTEX_PROCESSING);
+            if (network_parse_bf() == NULL) {
+                session_pop();
+            }
+        }
+        else {
+            session_pop();
+        }
+#       if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+            !defined(EXTF_sys_sig_rfaterminate)  )
+            sys.evt.RFA.terminate(1, scode);
+#       elif defined(EXTF_sys_sig_rfaterminate)
+            sys_sig_rfaterminate(1, scode);
+#       endif
+
+        SYS_RADIO_MUTEX(0);
+        sys.evt.RFA.event_no 	= 0;
+    }
+}
+
+
+
+
+void sysevt_fscan() {
+/// The fscan event (Foreground Scan) is used when the acquired HSS or SSS
+/// period (from some offset in ISF 05 or 04 respectively) specifies a fscan as
+/// opposed to an bscan.  fscan is used in anticipation of a foreground frame
+/// dialog, which is a formal session.
+#if (SYS_RECEIVE == ENABLED)
+    m2session*  session;
+
+#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+        !defined(EXTF_sys_sig_rfainit)  )
+        sys.evt.RFA.init(2);
+#   elif defined(EXTF_sys_sig_rfainit)
+        sys_sig_rfainit(2);
+#   endif
+    
+    /// Set up events so that the next RF event will occur when this times-out.
+    /// Listening will block non-RFA events from occuring.
+    SYS_RADIO_MUTEX(SYS_MUTEX_RADIO_LISTEN);
+    sys.evt.RFA.nextevent   = dll.comm.rx_timeout;
+    sys.evt.RFA.event_no    = 2;
+    session                 = session_top();
+
+    /// The response window after a request runs from the end of its TX
+    if ((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPRX) {
+        ot_int age = PLATFORM_STAMP_AGE(rm2_stamp.txend);
+#       if (OT_FEATURE(RXTUNE) == ENABLED)
+        sys.evt.RFA.nextevent = sub_rxtune_window(age);
+#       else
+        if ((age > 0) && (age < sys.evt.RFA.nextevent)) {
+            sys.evt.RFA.nextevent -= age;
+        }
+#       endif
+    }
+#   if (SYS_SCANHOP)
+    sub_scan_arm();
+#   endif
+
+#   if (SYS_SNIFF)
+    if (sub_sniff(session->channel, (session->netstate & M2_NETSTATE_SMASK), &rfevt_frx)) {
+        return;
+    }
+#   endif
+    
+    ///@todo find a way to get multiframe indicator in third argument
+    rm2_rxinit_ff(  (session->channel), 
+                    (session->netstate & M2_NETSTATE_SMASK), 
+                    0,
+                    &rfevt_frx  );
+#endif
+}
+
+
+
+
+#if (SYS_SNIFF)
+ot_bool sub_sniff(ot_u8 channel, ot_u8 netstate, ot_sig2 callback) {
+/// Hand a periodic sleep scan over to the radio (rm2_rxinit_sniff).  The RFA
+/// event becomes the refresh timer: when it expires, sysevt_receive() kills
+/// the RX like any scan timeout, and the overdue sleep scan starts it again.
+/// If the radio cannot do this scan, RFA is left as it was for a normal scan.
+    ot_uint period;
+    ot_long refresh;
+
+    period                  = sys.evt.sniff_period;
+    sys.evt.sniff_period    = 0;
+    if (period != 0) {
+        refresh = (ot_long)period << SYS_SNIFF_REFRESH;
+        if (refresh > 32767) {
+            refresh = 32767;            // RFA.nextevent is an ot_int
+        }
+        if (rm2_rxinit_sniff(channel, netstate, period, dll.comm.rx_timeout, callback)) {
+            sys.evt.RFA.nextevent = (ot_int)refresh;
+            return True;
+        }
+    }
+    return False;
+}
+#endif
+
+
+
+
+#if (SYS_SCANHOP)
+void sub_scan_arm() {
+/// Only the listen that starts right after the scan event takes the hops: any
+/// other listen has its own rx_chanlist (or none of the scan's hops armed).
+    scanhop.left    = (dll.comm.rx_chanlist == scanhop.chan) ? scanhop.armed : 0;
+    scanhop.armed   = 0;
+}
+
+
+ot_bool sub_scan_hop() {
+/// Called when the timeout of a scan listen is over.  The radio is not put to
+/// sleep: the RX init of the radio driver retunes the RX that is underway.
+/// TASK_radio does not come here while SYS_MUTEX_RADIO_DATA is set, so a hop
+/// never cuts off a frame.  The fscan session moves along with the scan, so a
+/// dialog that starts from it is on the right channel.
+    if ((scanhop.left == 0) || \
+        ((sys.mutex & SYS_MUTEX_RADIO) != SYS_MUTEX_RADIO_LISTEN)) {
+        scanhop.left = 0;
+        return False;
+    }
+    scanhop.left--;
+    dll.comm.rx_channels--;
+    dll.comm.rx_chanlist++;
+    dll.comm.rx_timeout     = scanhop.dwell[dll.comm.rx_chanlist - scanhop.chan];
+    sys.evt.RFA.nextevent   = dll.comm.rx_timeout;
+    
+    if (sys.evt.RFA.event_no == 1) {
+        rm2_rxinit_bf(dll.comm.rx_chanlist[0], &rfevt_bscan);
+    }
+    else {
+        m2session* session = session_top();
+        session_setchannel(session, dll.comm.rx_chanlist[0]);
+        rm2_rxinit_ff(  (session->channel), 
+                        (session->netstate & M2_NETSTATE_SMASK), 
+                        0,
+                        &rfevt_frx  );
+    }
+    return True;
+}
+#endif
+
+
+
+
+void rfevt_frx(ot_int pcode, ot_int fcode) {
+/// Radio Core event callback, called by the radio driver when a frame is rx'ed
+/// or if there is some type of error.
+    ot_int frx_code = 0;
+    SYS_TRACE(SYS_TRACE_FRX, pcode);
+
+    // Once a frame comes in, the scan stays on its channel
+#   if (SYS_SCANHOP)
+    scanhop.left = 0;
+#   endif
+    
+    // pcode: When negative, a listening timeout.
+    // dll.comm.redundants is decremented after TX.  It must be 0 for scanning.
+    if (pcode < 0) {
+    	m2session* session  = session_top();
+#   if (RF_FEATURE(RXTIMER) == ENABLED)
+        pcode = 0;
+#   endif
+        session->netstate		= (dll.comm.redundants) ? \
+        							(M2_NETSTATE_REQTX | M2_NETSTATE_INIT) : \
+        							(M2_NETFLAG_SCRAP);
+        sys.evt.RFA.event_no 	= 0;	//quit RF (RX) process
+        SYS_LS_COUNT(SYS_LS_RXTIMEOUT);
+#   if (M2_FEATURE(DRIFT) == ENABLED)
+        m2np_drift_sample(-1);
+#   endif
+#   if (M2_FEATURE(LINKADAPT) == ENABLED)
+        m2np_link_loss( (ot_bool)(dll.comm.redundants == 0) );
+#   endif
+#   if (OT_FEATURE(RESPFWD) == ENABLED)
+        sys.respfwd.flush = True;
+#   endif
+#   if (SYS_RXPOOL == ENABLED)
+        if (buffers_rxpool_get()) {
+            SYS_RADIO_MUTEX(SYS_MUTEX_PROCESSING);
+        }
+#   endif
+      //frx_code                = -5;   //this doesn't get reported anyway
+    }
+    
+    // pcode: When non-negative, the number of frames remaining.
+    else {
+        /// Handle damaged frames (CRC)                                     <BR>
         /// - Multiframe datastreams: mark the packet as bad, and continue  <BR>
         /// - Normal data packets (single frame): ignore the packet         <BR>
+        /// - FSA collection: also tally the damaged frame as a collision  <BR>
         if (fcode != 0) {
-#           if (M2_FEATURE(DATASTREAM) == ENABLED)
+#           if ((M2_FEATURE(DATASTREAM) == ENABLED) || \
+                (M2_FEATURE(FSACOLLECT) == ENABLED))
         	m2session*  session;
         	session     = session_top();
+#           endif
+            SYS_LS_COUNT(SYS_LS_RXCRC);
+#           if (M2_FEATURE(FSACOLLECT) == ENABLED)
+            m2qp_fsa_damaged(session);
+#           endif
+#           if (M2_FEATURE(DATASTREAM) == ENABLED)
             if ((session->netstate & M2_NETSTATE_DSDIALOG)) 
                 m2dp_mark_dsframe(session);
             else
 #           endif
-                frx_code = -1;
+                frx_code = -1;
+#           if (M2_FEATURE(LINKADAPT) == ENABLED)
+            m2np_link_loss(False);
+#           endif
+        }
+        
+        /// Run subnet filtering on clean frames
+        else if (sub_mac_filter() == False) {
+            SYS_LS_COUNT(SYS_LS_RXFILTER);
+            frx_code = -4;
+        }
+        else {
+            SYS_LS_CHANNEL(SYS_LS_RXFRAMES, session_top()->channel);
+        }
+        
+        /// Handle cases where the packet is finished.  If an error, attempt
+        /// to resume listening by implicitly restarting the session.  
+        /// If no error, move the session along to packet processing.
+        if (pcode == 0) {
+#           if (M2_FEATURE(DRIFT) == ENABLED)
+            /// Arrival of the request for an advertising flood: the time into
+            /// the listen at sync detect, less the preamble and sync, is when
+            /// it started.
+            if ((frx_code == 0) && (sys.evt.RFA.event_no == 2)) {
+                m2np_drift_sample( (ot_int)(dll.comm.rx_timeout - sys.evt.RFA.nextevent) \
+                                 + (ot_int)platform_get_gptim() \
+                                 - PLATFORM_STAMP_AGE(rm2_stamp.rxsync) - rm2_pkt_duration(0) );
+            }
+#           endif
+#           if (OT_FEATURE(RXTUNE) == ENABLED)
+            if (frx_code == 0) {
+                sub_rxtune_arrival();
+            }
+#           endif
+            sys.evt.RFA.event_no = 0;
+#           if (SYS_RXPOOL == ENABLED)
+            if ((frx_code == 0) && (sub_rxpool_hold() == False))
+#           else
+            if (frx_code == 0)
+#           endif
+            {
+                SYS_RADIO_MUTEX(SYS_MUTEX_PROCESSING);
+                radio_sleep();
+            }
+        }
+    }
+
+
+#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+        !defined(EXTF_sys_sig_rfaterminate)  )
+        sys.evt.RFA.terminate(sys.evt.RFA.event_no, frx_code);
+#   elif defined(EXTF_sys_sig_rfaterminate)
+        sys_sig_rfaterminate(sys.evt.RFA.event_no, frx_code);
+#   endif
+
+    /// When session restart or continuation is needed, pre-empt the kernel.
+    /// The kernel clocks-down listening and contention periods, so if 
+    /// restarting the session, the new listening timeout will be whatever
+    /// remains from the last one.
+    if (pcode == 0) {
+        platform_ot_preempt();
+    }
+}
+
+
+
+
+#if (SYS_RXPOOL == ENABLED)
+ot_bool sub_rxpool_hold() {
+/// The session is restarted by the kernel (TASK_session), like after a bad
+/// frame, but its listen is only what is left of this one.
+    m2session* session = session_top();
+    
+    if (((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPRX) && \
+        (sys.evt.RFA.nextevent > 0) && buffers_rxpool_put()) {
+        dll.comm.rx_timeout = sys.evt.RFA.nextevent;
+        SYS_RADIO_MUTEX(0);
+        return True;
+    }
+    return False;
+}
+#endif
+
+
+
+#if (SYS_AUXRX == ENABLED)
+void sub_auxrx_collect() {
+    rm2_auxrx_close();
+    while (rm2_auxrx_take() && buffers_rxpool_put());
+}
+#endif
+
+
+
+
+void sysevt_initftx() {
+/// Initialize the TX Engine for foreground packet transmission.  This requires
+/// a CSMA-CA routine that runs prior to the data transmission.  The system 
+/// layer manages TX CSMA when it is not part of the Radio Core featureset.
+   
+#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+        !defined(EXTF_sys_sig_rfainit)  )
+        sys.evt.RFA.init(4);
+#   elif defined(EXTF_sys_sig_rfainit)
+        sys_sig_rfainit(4);
+#   endif
+    
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+    sub_netsync_stamp();
+#   endif
+
+    ///@todo 1st argument of rm2_txinit_ff() is estimated number of frames in
+    /// the packet.  for now it is hard coded to 1.
+    rm2_txinit_ff(1, &rfevt_ftx);
+    SYS_RADIO_MUTEX(SYS_MUTEX_RADIO_LISTEN);
+    sys.evt.RFA.event_no    = 3;
+#   if (SYS_AUXRX == ENABLED)
+    rm2_auxrx_open(session_top()->channel);
+#   endif
+#   if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+    sys.ca.retries          = 0;
+#   endif
+#   if (RF_FEATURE(TXTIMER) == DISABLED)
+    sys.evt.RFA.nextevent   = sub_fcinit();     // Normal TX CSMA process
+    dll.comm.tca            = dll.comm.tc;
+#       if (OT_FEATURE(SLOPCAL) == ENABLED)
+        sys.slop.offset     = (ot_u16)sys.evt.RFA.nextevent;
+#       endif
+#   else
+    sys.evt.RFA.nextevent   = dll.comm.tc;      // TX timeout
+#       if (OT_FEATURE(SLOPCAL) == ENABLED)
+        sys.slop.type       = 0xFF;             // the radio picks the offset
+#       endif
+#   endif
+}
+
+
+
+
+void sysevt_initbtx() {
+#if ((M2_FEATURE(GATEWAY) == ENABLED) || \
+     (M2_FEATURE(SUBCONTROLLER) == ENABLED))
+    
+#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+        !defined(EXTF_sys_sig_rfainit)  )
+        sys.evt.RFA.init(5);
+#   elif defined(EXTF_sys_sig_rfainit)
+        sys_sig_rfainit(5);
+#   endif
+    
+    rm2_txinit_bf(&rfevt_btx);
+    SYS_RADIO_MUTEX(SYS_MUTEX_RADIO_LISTEN);
+    sys.evt.RFA.event_no    = 0x13;              
+#   if (RF_FEATURE(TXTIMER) == DISABLED)
+    sys.evt.RFA.nextevent   = 0;    // Normal TX CSMA process
+    dll.comm.tca            = dll.comm.tc;
+#   else
+    sys.evt.RFA.nextevent   = dll.comm.tc + sys.evt.adv_time;   // TX timeout
+#   endif
+
+#endif
+}
+
+
+
+
+void sysevt_txcsma() {
+/// Run the TX CSMA-CA routine, which requires multiple calls if radio core does
+/// not have automated TX contention window handling.
+#if (RF_FEATURE(TXTIMER) != ENABLED)
+    ot_int csma_code = -1;
+    
+    /// First, check Tca to make sure we are within timing requirements
+    if (dll.comm.tca >= 0) {
+        csma_code = rm2_txcsma();
+        SYS_TRACE(SYS_TRACE_TXCSMA, csma_code);
+        
+        // CSMA process continues immediately
+        switch (csma_code) {
+            case RM2_ERR_BADCHANNEL:
+                goto sysevt_txcsma_fail;
+                
+            case RM2_ERR_CCAFAIL:
+                SYS_LS_COUNT(SYS_LS_CCAFAIL);
+#               if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+                sub_ca_update(True);
+#               endif
+#               if (OT_FEATURE(SLOPCAL) == ENABLED)
+                sys.slop.type = 0xFF;       // the retry wait is not slop
+#               endif
+                sys.evt.RFA.nextevent = sub_fcloop();
+                break;
+            
+            ///TX CSMA complete: begin data transfer                                    <BR>
+            /// - Flooding handled specially (no contention, different timeout value)   <BR>
+            /// - A2P must get the full packet TX'ed before the end of contention       <BR>
+            /// - NA2P (normal) must start TX before end of contention
+            case -1: 
+#               if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+                sub_ca_update(False);
+#               endif
+#               if (SYS_FLOOD == ENABLED)
+                sys.evt.RFA.nextevent   = (sys.evt.RFA.event_no & 0x10) ? \
+                                            sys.evt.adv_time : rm2_pkt_duration(txq.length);
+#               else
+                sys.evt.RFA.nextevent   = rm2_pkt_duration(txq.length);
+#               endif
+                SYS_RADIO_MUTEX(SYS_MUTEX_RADIO_DATA);
+                break;
+            
+            default:
+                sys.evt.RFA.nextevent = csma_code;
+                break;
+        }
+    }
+
+    else {
+#       if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+        sys.ca.expired++;
+#       endif
+        sysevt_txcsma_fail:
+        SYS_LS_COUNT(SYS_LS_CSMAFAIL);
+#       if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+            !defined(EXTF_sys_sig_rfaterminate)  )
+            sys.evt.RFA.terminate(3, csma_code);
+#       elif defined(EXTF_sys_sig_rfaterminate)
+            sys_sig_rfaterminate(3, csma_code);
+#       endif
+#       if (SYS_AUXRX == ENABLED)
+        sub_auxrx_collect();
+#       endif
+#       if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+        sub_dialog_nochannel(session_top());
+#       endif
+        session_pop();
+        sys_idle();
+    }
+
+#endif
+}
+
+
+
+
+void rfevt_ftx(ot_int pcode, ot_int scratch) {
+    m2session*  session;
+    SYS_TRACE(SYS_TRACE_FTX, pcode);
+
+    /// Non-final frame TX'ed in multiframe packet
+    if (pcode == 1) {
+        
+        ///@todo possibly put the queue rearrangement here
+    }
+
+#   if (OT_FEATURE(TXPIPE) == ENABLED)
+    /// Last frame of a copy is loaded into the radio.  If the next redundant
+    /// copy needs no CSMA, chain it onto this one (see OT_FEATURE_TXPIPE).
+    /// The final copy always finishes through the path below.
+    else if (pcode == 2) {
+        session = session_top();
+        if ((dll.comm.redundants > 1) && ((dll.comm.rx_timeout == 0) || \
+            ((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPTX))) {
+            dll.comm.redundants    -= 1;
+            sys.evt.RFA.nextevent  += rm2_pkt_duration(txq.length);
+            rm2_prep_resend();
+#           if (OT_FEATURE(SLOPCAL) == ENABLED)
+            sys.slop.type           = 0xFF;     // TX end is of the last copy
+#           endif
+        }
+    }
+#   endif
+
+    /// Packet TX is done.  Handle this event and pre-empt the kernel.
+    /// - Normally, go to response RX.
+    /// - Allow scheduling of redundant TX on responses, or request with no response
+    /// - End session if no redundant, and no listening required
+    else {
+        ot_u8 scrap_bit;
+        SYS_RADIO_MUTEX(0);
+        sys.evt.RFA.event_no    = 0;
+        session                 = session_top();
+#       if (OT_FEATURE(SLOPCAL) == ENABLED)
+        if ((pcode == 0) && \
+            ((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPTX)) {
+            sub_slop_update();
+        }
+        sys.slop.type           = 0xFF;
+#       endif
+#       if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+        if (pcode == 0) {
+            sub_dialog_txdone(session);
+        }
+#       endif
+#       if (OT_FEATURE(LINKSTATS) == ENABLED)
+        if (pcode != 0) {
+            sub_ls_count(SYS_LS_TXERROR);
+        }
+        else if ((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPTX) {
+            sub_ls_channel(SYS_LS_TXRESP, session->channel);
+        }
+        else {
+            sub_ls_count(SYS_LS_TXPACKETS);
+        }
+#       endif
+        scrap_bit               = (dll.comm.rx_timeout == 0) | \
+                                  ((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPTX);
+#       if (OT_FEATURE(RXTUNE) == ENABLED)
+        if ((pcode == 0) && (scrap_bit == 0)) {
+            sub_rxtune_start(session);
+        }
+#       endif
+        
+        // A response follows a scan, which leaves no redundants: it goes once
+        dll.comm.redundants    -= (dll.comm.redundants != 0);
+        
+        // Send redundant TX immediately, but only if no response window or if
+        // this packet is a response.
+        if (scrap_bit && dll.comm.redundants) {
+            dll.comm.csmaca_params = (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA);
+            rm2_prep_resend();
+        }
+        
+        // End Session if no redundant, no response window, if this itself is a
+        // response, or if there is some sort of error
+        else {
+            scrap_bit          |= (pcode != 0);         //some sort of error
+            session->netstate  |= (scrap_bit << 7);     //M2_NETFLAG_SCRAP
+            session->netstate  &= ~M2_NETSTATE_TMASK;
+            session->netstate  |= M2_NETSTATE_RESPRX;
+
+            /// What the auxiliary receiver heard is parsed after the response
+            /// listen, or now if there is none (as at a listen timeout).
+#           if (SYS_AUXRX == ENABLED)
+            sub_auxrx_collect();
+            if (scrap_bit && buffers_rxpool_get()) {
+                SYS_RADIO_MUTEX(SYS_MUTEX_PROCESSING);
+            }
+#           endif
+        }
+    
+#       if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) && !defined(EXTF_sys_sig_rfaterminate))
+            sys.evt.RFA.terminate(5, pcode);
+#       elif defined(EXTF_sys_sig_rfaterminate)
+            sys_sig_rfaterminate(5, pcode);
+#       endif            
+        
+        platform_ot_preempt();
+    }
+}
+
+
+
+
+void rfevt_btx(ot_int flcode, ot_int scratch) {
+    SYS_TRACE(SYS_TRACE_BTX, flcode);
+#if ((M2_FEATURE(SUBCONTROLLER) == ENABLED) || (M2_FEATURE(GATEWAY) == ENABLED))
+    switch (flcode) {
+        /// Flood ends & Request Begins                                     <BR>
+        /// - Swap back control to foreground session (m2advp_close())      <BR>
+        /// - Make sure request session is ready to go by setting to 0      <BR>
+        /// - Turn CSMA-CA OFF and set TX timeout to 2 ticks
+        case 0: {
+            m2session* session;
+            SYS_LS_COUNT(SYS_LS_FLOODS);
+#           if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) && !defined(EXTF_sys_sig_rfaterminate)  )
+                sys.evt.RFA.terminate(4, 0);
+#           elif defined(EXTF_sys_sig_rfaterminate)
+                sys_sig_rfaterminate(4, 0);
+#           endif
+            m2advp_close();
+            session                 = session_top();
+            session->counter        = 0;
+            sys.evt.adv_time        = 0;
+            sys.evt.RFA.event_no    = 0;
+            SYS_RADIO_MUTEX(0);
+            dll.comm.tc             = 2;
+            dll.comm.csmaca_params  = (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA);
+            dll.comm.redundants     = 1;
+            platform_ot_preempt();
+            break;
+        }
+        
+        /// Flood Continues: Prepare the packet after the one just loaded   <BR>
+        /// - platform_get_gptim() must not be touched for this to work, 
+        ///   which means this method only works for contiguous floods.     <BR>
+        /// - The radio has already loaded the frame prepared last time, so
+        ///   the ETA here is for the next one (one packet later).          <BR>
+        /// - End the flood if the counter is over, else maintain flood
+        case 2: {
+            scratch     = sys.evt.adv_time - platform_get_gptim();
+            scratch    -= rm2_pkt_duration(7);
+            ///@todo figure out how to fit this into new event manager
+            
+            if (scratch < rm2_pkt_duration(7)) {
+                rm2_txstop_flood();
+            }
+            else {
+                m2advp_update((ot_u16)scratch);
+            }
+            break;
+        }
+    
+        default: {
+            SYS_LS_COUNT(SYS_LS_FLOODERROR);
+#           if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
+                !defined(EXTF_sys_sig_rfaterminate)  )
+                sys.evt.RFA.terminate(4, flcode);
+#           elif defined(EXTF_sys_sig_rfaterminate)
+                sys_sig_rfaterminate(4, flcode);
+#           endif
+            sys_idle();
+            platform_ot_preempt();
+            break;
+        }
+    }
+#endif
+}
+
+
+
+
+
+/** System Subroutines
+  * ============================================================================
+  */
+
+//void sub_worevt_ctrl(wakeon_event* worevt, ot_long* eta) {
+//    if (worevt->nextevent < *eta) {
+//        *eta = worevt->nextevent;
+//    }
+//}
+
+
+
+#if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
+void sub_activate_scheduler(ot_u8* sched_id) {
+/// Clears the armed flag, so sub_next_event() loads the alarm of the new idle
+/// state from the scheduler ISF.
+    *sched_id &= ~SCHED_ARMED;
+}
+
+
+#ifndef EXTF_sys_rtc_alarm
+void sys_rtc_alarm(ot_u8 alarm_id) {
+    ot_int i;
+
+    for (i=(IDLE_EVENTS-1); i>=0; i--) {
+        if ((sys.evt.idle[i].event_no != 0) && \
+            ((sys.evt.idle[i].sched_id & ~SCHED_ARMED) == alarm_id)) {
+            sys.evt.idle[i].nextevent = 0;
+            platform_ot_preempt();
+        }
+    }
+}
+#endif
+
+#elif (OT_FEATURE(RTC) == ENABLED) && !defined(EXTF_sys_rtc_alarm)
+void sys_rtc_alarm(ot_u8 alarm_id) {
+}
+#endif
+
+
+
+void sub_idlevt_ctrl(idletime_event* idlevt, ot_long* eta, ot_u8 sequence_id) {  
+#if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
+    if (idlevt->sched_id != 0) {
+        vlFILE*     fp;
+        ot_int      offset;
+        ot_u16      ssmask;
+        ot_u16      ssvalue;
+        
+        fp = ISF_open_su( ISF_ID(real_time_scheduler) );
+        ///@todo assert fp
+        
+        // This is an arithmetic trick to convert the sequence id to
+        // the proper offset (sleep, hold, beacon) of the RTC ISF
+        // sleep offset = 0, hold offset = 4, beacon offset = 8
+        offset  = (sequence_id-4) << 2;
+        
+        // Load Mask and Value (always stored as big endian)
+        ssmask  = ISF_read(fp, offset);
+        ssmask	= PLATFORM_ENDIAN16(ssmask);
+        ssvalue = ISF_read(fp, offset+=2);
+        ssvalue = PLATFORM_ENDIAN16(ssvalue);
+        vl_close(fp);
+        
+        // Apply new mask & value to the RTC and reset the synchronized task,
+        // which now waits for its alarm (sys_rtc_alarm())
+        platform_set_rtc_alarm(idlevt->sched_id, ssmask, ssvalue);
+        platform_enable_rtc_alarm(idlevt->sched_id, True);
+        idlevt->sched_id   |= SCHED_ARMED;
+        idlevt->cursor      = 0;
+        idlevt->nextevent   = SCHED_WAIT;
+    }
+#endif
+        
+    if (idlevt->nextevent < *eta) {
+        *eta = idlevt->nextevent;
+    }
+}
+
+
+
+
+void sub_netconf_load() {
+/// Load the Network settings from ISF 0 to the dll.netconf buffer
+    Twobytes scratch;
+    vlFILE* fp;
+    
+    fp = ISF_open_su( ISF_ID(network_settings) );
+    scratch.ushort          = vl_read(fp, 2);
+    dll.netconf.subnet      = scratch.ubyte[0];
+    dll.netconf.b_subnet    = scratch.ubyte[1];
+    scratch.ushort          = vl_read(fp, 6);
+    dll.netconf.dd_flags    = scratch.ubyte[0];
+    dll.netconf.b_attempts  = scratch.ubyte[1];
+    dll.netconf.active      = vl_read(fp, 4);
+    dll.netconf.hold_limit  = vl_read(fp, 8);   ///@todo endian conversion
+    vl_close(fp);
+}
+
+
+
+
+void sub_idlevt_restart(ot_u16 restart) {
+/// Set the scheduler ids of the idle events, and restart the events that are
+/// flagged in restart by the ISF of their sequence.  The scheduler id counts
+/// up over the events that are scheduled by the active setting.
+#   if ((M2_FEATURE(RTCSLEEP) == ENABLED) || \
+        (M2_FEATURE(RTCHOLD) == ENABLED) || \
+        (M2_FEATURE(RTCBEACON) == ENABLED))
+    ot_u8 accum = 0;
+#   endif
+    
+#   if (M2_FEATURE(ENDPOINT) == ENABLED)
+    if (restart & SYS_ISFCHANGE(sleep_scan_sequence)) {
+#       if (M2_FEATURE(RTCSLEEP) == ENABLED)
+            accum              += ((M2_SET_SLEEPSCHED & dll.netconf.active) != 0);
+            sys.evt.SSS.sched_id= accum;
+#       endif
+        sys.evt.SSS.cursor      = 0;
+        sys.evt.SSS.nextevent   = 0;
+    }
+#       if (M2_FEATURE(RTCSLEEP) == ENABLED)
+    else {
+        accum                  += ((M2_SET_SLEEPSCHED & dll.netconf.active) != 0);
+    }
+#       endif
+#   endif
+
+#   if ((M2_FEATURE(ENDPOINT) == ENABLED) || \
+        (M2_FEATURE(SUBCONTROLLER) == ENABLED) || \
+        (M2_FEATURE(GATEWAY) == ENABLED))
+    if (restart & SYS_ISFCHANGE(hold_scan_sequence)) {
+#       if (M2_FEATURE(RTCHOLD) == ENABLED)
+            accum              += ((M2_SET_HOLDSCHED & dll.netconf.active) != 0);
+            sys.evt.HSS.sched_id= accum;
+#       endif
+        sys.evt.HSS.cursor      = 0;
+        sys.evt.HSS.nextevent   = 0;
+    }
+#       if (M2_FEATURE(RTCHOLD) == ENABLED)
+    else {
+        accum                  += ((M2_SET_HOLDSCHED & dll.netconf.active) != 0);
+    }
+#       endif
+#   endif
+
+#   if (M2_FEATURE(BEACONS) == ENABLED)
+    if (restart & SYS_ISFCHANGE(beacon_transmit_sequence)) {
+#       if (M2_FEATURE(RTCBEACON) == ENABLED)
+            accum              += ((M2_SET_BEACONSCHED & dll.netconf.active) != 0);
+            sys.evt.BTS.sched_id= accum;
+#       endif
+        sys.evt.BTS.cursor      = 0;
+        sys.evt.BTS.event_no    = (dll.netconf.b_attempts != 0);
+        sys.evt.BTS.nextevent   = 0;
+    }
+#   endif
+}
+
+
+
+
+void sub_sys_flush() {
+/// (1) Reset sessions. 
+/// (2) Put System states into the right place and flush existing events. 
+/// (3) Set scheduler ids and prepare idle time events
+    session_init();
+    dll.idle_state = sub_default_idle();
+    sub_idlevt_restart(SYS_ISFCHANGE_EVENTS);
+
+    /// Go to the appropriate idle state
+    sys_idle();
+}
+
+
+
+
+ot_u8 sub_default_idle() {
+#if ((M2_FEATURE(ENDPOINT) == ENABLED) || (M2_FEATURE(BLINKER) == ENABLED))
+    ot_u16 active_setting   = dll.netconf.active & M2_SET_CLASSMASK;
+    
+    if (active_setting >= M2_SET_SUBCONTROLLER)       
+        return M2_MACIDLE_HOLD;
+    else if (active_setting & M2_SET_ENDPOINT)  
+        return M2_MACIDLE_SLEEP;
+    
+    return M2_MACIDLE_OFF;
+#else
+    
+    return M2_MACIDLE_HOLD;
+#endif
+}
+
+
+
+
+
+
+
+
+/** Flow & Congestion Control Functions
+  * ============================================================================
+  */
+
+ot_bool sub_mac_filter() {
+/// Link Budget Filtering (LBF) is a normalized RSSI Qualifier.
+/// Subnet Filtering is an numerical qualifier
+    ot_bool qualifier;
+    {
+        // TX EIRP encoded value    = (dBm + 40) * 2
+        // TX EIRP dBm              = ((encoded value) / 2) - 40
+        // Link Loss                = TX EIRP dBm - Detected RX dBm
+        // Link Quality Filter      = (Link Loss <= Link Loss Limit)
+        ot_int linkloss;
+        linkloss    = ((ot_int)((rxq.front[1] >> 1) & 0x3F) - 40) - radio_rssi(); 
+        qualifier   = (ot_bool)(linkloss <= (ot_int)phymac[0].link_qual);
+    }
+    qualifier &= sub_subnet_filter(rxq.front[2]);
+    return qualifier;
+}
+
+
+ot_bool sub_subnet_filter(ot_u8 fr_subnet) {
+    ot_u8 dsm, specifier, mask;
+    
+    dsm         = dll.netconf.subnet & 0x0F;
+    mask        = fr_subnet & dsm;
+    specifier   = (fr_subnet ^ dll.netconf.subnet) & 0xF0;
+    fr_subnet  &= 0xF0;
+    return (ot_bool)(((fr_subnet == 0xF0) || (specifier == 0)) && (mask == dsm));
+}
+
+
+#if (M2_FEATURE(RXFILTER) == ENABLED)
+ot_bool sys_rxfilter() {
+/// The foreground frame header, as in network_route_ff():
+/// [Length][TX EIRP][Subnet][Frame Info] {[Dialog ID][Addr Ctl][Source ID]
+/// [Target ID]}, where the braces are present with M2FI_ENADDR, the IDs are 2
+/// or 8 bytes (M2_FLAG_VID), and the Target ID is only on unicast.  Background
+/// frames (bscan) have another layout.  M2FI_FRCTX frames have a context after
+/// the Addr Ctl, and the IDs only follow it with M2CTX_DEFINE.  With NLS, the
+/// Target ID is encrypted, so it is left to network_route_ff().
+    ot_int bytes;
+    
+#   if (OT_FEATURE(SNIFFER) == ENABLED)
+    if (sys.sniffer.active) {
+        return True;
+    }
+#   endif
+    if (sys.evt.RFA.event_no == 1) {
+        return True;
+    }
+    bytes = rxq.putcursor - rxq.front;
+    if (bytes < 3) {
+        return True;
+    }
+    if (sub_subnet_filter(rxq.front[2]) == False) {
+        return False;
+    }
+    
+#   if (M2_FEATURE(MULTIHOP) != ENABLED)
+    if ((bytes >= 6) && ((rxq.front[3] & (M2FI_NM2 | M2FI_ENADDR | M2FI_DLLS)) == M2FI_ENADDR)) {
+        ot_u8  addr_ctl = rxq.front[5];
+        ot_int id_len   = (addr_ctl & M2_FLAG_VID) ? 2 : 8;
+        ot_int pos      = 6;
+#       if (M2_FEATURE(HDRCTX) == ENABLED)
+        if ((rxq.front[3] & M2FI_FRTYPEMASK) == M2FI_FRCTX) {
+            if ((bytes < 8) || ((rxq.front[6] & (M2CTX_DEFINE >> 8)) == 0)) {
+                return True;
+            }
+            pos = 8;
+        }
+#       endif
+        if (((addr_ctl & (0xC0 | M2_FLAG_NLS)) == 0) && (bytes >= (pos + id_len + id_len))) {
+            return m2np_idcmp(id_len, &rxq.front[pos+id_len]);
+        }
+    }
+#   endif
+    
+    return True;
+}
+#endif
+
+
+
+
+void sub_csma_scramble() {
+/// Sort of optional: Go through the channel list and scramble the channel
+/// entries randomly so that different devices aren't trying to respond on the
+/// same channels at the same time.
+    if (dll.comm.tx_channels > 1) {
+        ot_u8 i, j, k, rot1, rot2, scratch;
+        rot1 = PRAND_U8();
+        rot2 = PRAND_U8();
+        
+        for (i=0; i<(dll.comm.tx_channels-1); i++) {
+            j = i + ((rot1&1) != 0);
+            k = (dll.comm.tx_channels-1) * ((rot2&1) != 0);
+            
+            scratch                 = dll.comm.tx_chanlist[i];
+            dll.comm.tx_chanlist[i] = dll.comm.tx_chanlist[k];
+            dll.comm.tx_chanlist[k] = scratch;
+            scratch                 = dll.comm.tx_chanlist[i];
+            dll.comm.tx_chanlist[i] = dll.comm.tx_chanlist[j];
+            dll.comm.tx_chanlist[j] = scratch;
+            
+            rot1 >>= 1;
+            rot2 >>= 1;
+        }
+    }
+}
+
+
+
+
+#if (SYS_FCSCORE_STEPS > 0)
+static ot_u8 sys_fcsteps = 0;   // window halvings from the query score
+#endif
+
+static ot_uint sys_txduration;  // duration of the TX packet, set by sub_fcinit()
+
+ot_uint sub_random_slot(ot_long window) {
+/// Random offset in [0, window), by multiply-shift instead of modulo, which 
+/// is a software divide on MCUs without a hardware divider.  Windows longer
+/// than 65535 ticks are clipped, as they were with a 16 bit random modulo.
+    if (window <= 0) {
+        return 0;
+    }
+    if (window > 65535) {
+        window = 65535;
+    }
+    return otutils_range16(PRAND_U16(), (ot_u16)window);
+}
+
+
+ot_uint sub_fcinit() {
+/// Pick a time offset to begin the first transmission attempt, and setup
+/// flow-congestion loop parameters.
+    
+    // Pick a slot offset: currently only RIGD and RAIND need a random slot.
+    // {0,1,2,3} = {RIGD, RAIND, AIND, Default MAC CA} 
+    // With adaptive CA, the offset window is narrowed when load is light.
+    // A query score from sub_fceval() narrows it further, once.
+    ot_u8 shift = 0;
+#   if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+    shift = (sys.ca.load < SYS_CA_LIGHT) ? 2 : (sys.ca.load < (SYS_CA_HEAVY/2));
+#   endif
+#   if (SYS_FCSCORE_STEPS > 0)
+    shift      += sys_fcsteps;
+    sys_fcsteps = 0;
+#   endif
+
+    // The packet duration is the same for each slot of this TX
+    sys_txduration = rm2_pkt_duration(txq.front[0]);
+
+    switch ( sub_ca_mode() ) {
+        case 0: return (sub_rigd_newslot() >> shift);
+                
+        case 1: return (sub_random_slot(dll.comm.tca - sys_txduration) >> shift);
+        
+        case 2: 
+        case 3: return 0;
+        
+#       if (M2_FEATURE(FSACOLLECT) == ENABLED)
+        case 4: return m2qp_fsa_offset(sub_aind_nextslot());
+#       endif
+    }
+    //ignore compiler warning here (switch will always return)
+}
+
+
+
+
+void sub_fceval(ot_int query_score) {
+/// When M2QP returns zero, the query has succeeded with no priorities.  Some
+/// queries have priority scores (higher is better).  Each bit of the score
+/// halves the window that sub_fcinit() picks the first TX offset from, so the
+/// best matches tend to reply at the start of the contention period.
+#if (SYS_FCSCORE_STEPS > 0)
+    ot_u8 steps = 0;
+    
+    while ((query_score > 0) && (steps < SYS_FCSCORE_STEPS)) {
+        query_score >>= 1;
+        steps++;
+    }
+    sys_fcsteps = steps;
+#endif
+}
+
+
+
+
+ot_uint sub_fcloop() {
+    /// {0,1,2,3} = {RIGD, RAIND, AIND, Default MAC CA} 
+    /// Default MAC CA just waits Tg before trying again
+    switch ( sub_ca_mode() ) {
+        case 0: return sub_rigd_nextslot() + sub_rigd_newslot();
+        case 1: 
+#       if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+                /// Heavy load: spread the retry over a random 1-4 slots
+                if (sys.ca.load >= SYS_CA_HEAVY) {
+                    ot_u8 slots = 1 + otutils_range16(PRAND_U16(), 1 + (sys.ca.load >> 6));
+                    return sub_aind_nextslot() * slots;
+                }
+#       endif
+                /* fall through */
+        case 2: return sub_aind_nextslot();
+        case 3: return phymac[0].tg;
+        
+        /// FSA retries in the next slot, like AIND
+#       if (M2_FEATURE(FSACOLLECT) == ENABLED)
+        case 4: return sub_aind_nextslot();
+#       endif
+    }
+} //ignore compiler warning here (switch will always return)
+
+
+
+
+ot_uint sub_rigd_newslot() {
+/// halve tc from previous value and offset a random within that duration.
+/// tc reaches 0 after enough failed slots, and then there is no offset left.
+    dll.comm.tc   >>= 1;
+    dll.comm.tca    = dll.comm.tc;
+    return          sub_random_slot(dll.comm.tc);
+}
+
+
+
+
+ot_uint sub_rigd_nextslot() {
+    ot_long wait = (dll.comm.tc - dll.comm.tca);
+    return (wait < 0) ? 0 : (ot_uint)wait;
+}
+
+
+
+
+ot_uint sub_aind_nextslot() {
+/// Works for RAIND or AIND next slot
+    return sys_txduration;
+}
+
+
+
+
+ot_u8 sub_ca_mode() {
+    ot_u8 mode = (dll.comm.csmaca_params >> 3) & 7;
+
+#   if (M2_FEATURE(FSACOLLECT) == ENABLED)
+    if (mode == 4) {
+        return mode;
+    }
+#   endif
+    mode &= 3;
+
+#   if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+    if ((mode == 0) && (sys.ca.load >= SYS_CA_HEAVY)) {
+        mode = 1;
+    }
+#   endif
+
+    return mode;
+}
+
+
+
+
+/** Adaptive CSMA-CA Statistics <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+void sub_ca_update(ot_bool busy) {
+    ot_u8* chan_busy = &sys.ca.busy[phymac[0].channel & 0x0F];
+
+    if (busy) {
+        sys.ca.load    += (255 - sys.ca.load) >> 3;
+        *chan_busy     += (255 - *chan_busy) >> 3;
+        sys.ca.fail++;
+        if (sys.ca.retries != 255) {
+            sys.ca.retries++;
         }
-        
-        /// Run subnet filtering on clean frames
-        else if (sub_mac_filter() == False) {
-            frx_code = -4;
+    }
+    else {
+        sys.ca.load    -= sys.ca.load >> 3;
+        *chan_busy     -= *chan_busy >> 3;
+        sys.ca.clear++;
+        if (sys.ca.max_retries < sys.ca.retries) {
+            sys.ca.max_retries = sys.ca.retries;
         }
-        
-        /// Handle cases where the packet is finished.  If an error, attempt
-        /// to resume listening by implicitly restarting the session.  
-        /// If no error, move the session along to packet processing.
-        if (pcode == 0) {
-            sys.evt.RFA.event_no = 0;
-            if (frx_code == 0) {
-                sys.mutex = SYS_MUTEX_PROCESSING;
-                radio_sleep();
+    }
+}
+
+
+#ifndef EXTF_sys_ca_clear
+void sys_ca_clear() {
+    ot_u8*  cursor  = (ot_u8*)&sys.ca;
+    ot_int  i       = sizeof(sys.ca);
+    
+    while (--i >= 0) {
+        *cursor++ = 0;
+    }
+}
+#endif
+
+
+#ifndef EXTF_sys_ca_export
+ot_int sys_ca_export() {
+#if defined(ISF_ID_csma_statistics)
+    vlFILE* fp;
+    ot_int  i;
+    ot_uint offset;
+    ot_u16  word[5+8];
+
+    fp = ISF_open_su( ISF_ID(csma_statistics) );
+    if (fp == NULL) {
+        return -1;
+    }
+
+    word[0] = sys.ca.clear;
+    word[1] = sys.ca.fail;
+    word[2] = sys.ca.expired;
+    word[3] = sys.ca.max_retries;
+    word[4] = sys.ca.load;
+    for (i=0; i<8; i++) {
+        word[5+i] = ((ot_u16)sys.ca.busy[i<<1] << 8) | sys.ca.busy[(i<<1)+1];
+    }
+    for (i=0, offset=0; (i<(5+8)) && ((offset+2) <= fp->alloc); i++, offset+=2) {
+        vl_write(fp, offset, PLATFORM_ENDIAN16(word[i]));
+    }
+
+    vl_close(fp);
+    return offset;
+
+#else
+    return -1;
+#endif
+}
+#endif
+
+#endif
+
+
+
+
+/** Response Replay Cache <BR>
+  * ============================================================================
+  */
+#if (SYS_RESP_CACHE)
+static ot_u16 sub_resp_key(ot_u8* id_length) {
+/// The request must be a Mode 2 dialog frame with an address, and no DLLS.  
+/// The CRC is still at the end of rxq, and it is left out of the key.
+    ot_u8 fr_info = rxq.front[3];
+    ot_u16 hash;
+
+    if ((fr_info & (M2FI_NM2 | M2FI_CRC32 | M2FI_DLLS | M2FI_ENADDR | M2FI_FRTYPEMASK)) \
+        != (M2FI_ENADDR | M2FI_FRDIALOG)) {
+        return 0;
+    }
+    *id_length  = (rxq.front[5] & M2_FLAG_VID) ? 4 : 10;
+    if ((rxq.front[0] - 2) < (*id_length + 4)) {
+        return 0;
+    }
+    hash = crc_calc_block(rxq.front[0] - 4, &rxq.front[2]);
+    return (hash == 0) ? 1 : hash;
+}
+
+
+ot_bool sub_resp_replay(m2session* session, ot_u16* key, ot_int* score) {
+    ot_u8 id_length;
+
+    *key = sub_resp_key(&id_length);
+    if ((*key == 0) || (rcache.req_length == 0) || \
+        (rcache.hash != *key) || \
+        (rcache.req_length != (ot_u8)(rxq.front[0] - 2)) || \
+        (rcache.stamp != (ot_u16)(vl_writestamp + vl_mapstamp)) || \
+        ((ot_u32)(platform_stamp() - rcache.time) \
+            >= ((ot_u32)SYS_RESP_CACHE_TIME << PLATFORM_KTIM_SUBBITS))) {
+        return False;
+    }
+    while (id_length-- != 0) {
+        if (rcache.id[id_length] != rxq.front[4+id_length]) {
+            return False;
+        }
+    }
+    
+    /// Retransmission: strip the CRC as routing would, and put back what 
+    /// routing left the first time.
+    rxq.front[0]       -= 2;
+    session->protocol   = rcache.session.protocol;
+    session->flags      = rcache.session.flags;
+    session->netstate   = rcache.session.netstate;
+    session->subnet     = rcache.session.subnet;
+    session->dialog_id  = rcache.session.dialog_id;
+    m2qp.cmd            = rcache.cmd;
+    m2np.header         = rcache.header;
+    m2np.rt             = rcache.rt;
+    dll.comm            = rcache.comm;
+    
+    q_start(&txq, 0, 0);
+    q_writestring(&txq, rcache.frame, rcache.length);
+    *score = rcache.score;
+    return True;
+}
+
+
+void sub_resp_save(m2session* session, ot_u16 key, ot_int score) {
+/// Only requests that were answered are saved: datastreams keep their own
+/// state, and the response must fit and have no DLLS.
+    ot_u8 id_length = (rxq.front[5] & M2_FLAG_VID) ? 4 : 10;
+
+    if ((key == 0) || (score < 0) || \
+        ((session->netstate & (M2_NETFLAG_SCRAP | M2_NETSTATE_TMASK)) != M2_NETSTATE_RESPTX) || \
+        ((m2qp.cmd.code & M2OP_MASK) >= M2OP_DS_REQUEST) || \
+        (m2np.header.fr_info & M2FI_DLLS) || \
+        (txq.length > SYS_RESP_CACHE_SIZE)) {
+        return;
+    }
+    rcache.time         = platform_stamp();
+    rcache.stamp        = (ot_u16)(vl_writestamp + vl_mapstamp);
+    rcache.hash         = key;
+    rcache.req_length   = rxq.front[0];
+    rcache.length       = (ot_u8)txq.length;
+    rcache.score        = score;
+    rcache.session      = *session;
+    rcache.cmd          = m2qp.cmd;
+    rcache.header       = m2np.header;
+    rcache.rt           = m2np.rt;
+    rcache.comm         = dll.comm;
+    platform_memcpy(rcache.id, &rxq.front[4], id_length);
+    platform_memcpy(rcache.frame, txq.front, txq.length);
+}
+
+#endif
+
+
+
+
+/** Response Slop Calibration <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(SLOPCAL) == ENABLED)
+static void sub_slop_average(ot_u16* avg, ot_long sample) {
+/// Moves the average 1/8 of the way to the sample (both are ticks << 3)
+    if (sample < 0)     sample = 0;
+    if (sample > 4095)  sample = 4095;
+    *avg = (ot_u16)((ot_int)*avg + (((ot_int)(sample << 3) - (ot_int)*avg) >> 3));
+}
+
+
+void sub_slop_apply(ot_u32 start) {
+    ot_u8   type = m2qp.cmd.code & M2OP_MASK;
+    ot_long slop = sys.slop.slop[type] >> 3;
+
+    sub_slop_average(&sys.slop.proc[type], PLATFORM_STAMP_AGE(start));
+    dll.comm.tc     = (dll.comm.tc > slop) ? (dll.comm.tc - slop) : 0;
+    sys.slop.type   = type;
+    sys.slop.mark   = platform_stamp();
+}
+
+
+void sub_slop_update() {
+/// The frame started one packet duration before the TX end stamp, and the 
+/// CSMA-CA offset was picked on purpose: the rest of the wait is slop.
+    ot_long sample;
+
+    if (sys.slop.type < 16) {
+        sample  = PLATFORM_STAMP_AGE(sys.slop.mark) - PLATFORM_STAMP_AGE(rm2_stamp.txend);
+        sample -= rm2_pkt_duration(txq.length) + sys.slop.offset;
+        sub_slop_average(&sys.slop.slop[sys.slop.type], sample);
+    }
+}
+#endif
+
+
+#ifndef EXTF_sys_slop_clear
+void sys_slop_clear() {
+#if (OT_FEATURE(SLOPCAL) == ENABLED)
+    platform_memset((ot_u8*)&sys.slop, 0, sizeof(sys.slop));
+    sys.slop.type = 0xFF;
+#endif
+}
+#endif
+
+
+
+
+
+/** Self-tuning Response Window <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(RXTUNE) == ENABLED)
+static ot_u16 sub_rxtune_age() {
+    ot_long age = PLATFORM_STAMP_AGE(rm2_stamp.txend);
+    if (age < 0)     age = 0;
+    if (age > 4095)  age = 4095;
+    return (ot_u16)age;
+}
+
+
+static void sub_rxtune_sample(sys_rxtune_entry* entry, ot_u16 sample) {
+/// Average moves 1/8 of the way to the sample, deviation 1/4 (ticks << 3)
+    ot_int error;
+
+    if (entry->count == 0) {
+        entry->avg  = sample << 3;
+        entry->dev  = sample << 2;
+    }
+    else {
+        error       = (ot_int)(sample << 3) - (ot_int)entry->avg;
+        entry->avg  = (ot_u16)((ot_int)entry->avg + (error >> 3));
+        error       = (error < 0) ? -error : error;
+        entry->dev  = (ot_u16)((ot_int)entry->dev + ((error - (ot_int)entry->dev) >> 2));
+    }
+    entry->count += (entry->count != 255);
+}
+
+
+void sub_rxtune_start(m2session* session) {
+    sys_rxtune_entry* entry;
+    ot_u16 key;
+
+    /// Sample the last request: its last response, or a cut window that may
+    /// have been too short (the deviation grows by half, or to the margin)
+    if (sys.rxtune.active) {
+        entry = &sys.rxtune.entry[sys.rxtune.index];
+        if (sys.rxtune.responses != 0) {
+            sub_rxtune_sample(entry, sys.rxtune.last);
+        }
+        else if (sys.rxtune.cut) {
+            entry->dev  = (entry->dev == 0) ? (SYS_RXTUNE_MARGIN << 3) : \
+                          (entry->dev > 21844) ? 32767 : (entry->dev + (entry->dev >> 1));
+        }
+    }
+
+    /// Only M2QP requests are counted (datastreams are not)
+    sys.rxtune.active = (ot_bool)((m2np.header.fr_info & M2FI_ENADDR) != 0);
+    if (sys.rxtune.active) {
+        key                 = ((ot_u16)(m2qp.cmd.code & M2OP_MASK) << 8) | session->channel;
+        sys.rxtune.index    = (key ^ (key >> 4) ^ (key >> 8)) & (SYS_RXTUNE_KEYS-1);
+        entry               = &sys.rxtune.entry[sys.rxtune.index];
+        if (entry->key != key) {
+            platform_memset((ot_u8*)entry, 0, sizeof(sys_rxtune_entry));
+            entry->key      = key;
+        }
+        sys.rxtune.expect   = sys.rxtune.next_expect;
+        if ((sys.rxtune.expect == 0) && \
+            ((m2np.header.addr_ctl & 0xC0) == M2RT_UNICAST)) {
+            sys.rxtune.expect = 1;
+        }
+        sys.rxtune.cut          = False;
+        sys.rxtune.responses    = 0;
+    }
+    sys.rxtune.next_expect = 0;
+}
+
+
+void sub_rxtune_arrival() {
+    sys.rxtune.arrival = sub_rxtune_age();
+}
+
+
+ot_int sub_rxtune_window(ot_int age) {
+/// A listen that is over ends after one tick, through the listen timeout
+    sys_rxtune_entry* entry;
+    ot_int  window;
+    ot_u32  cut;
+
+    window = sys.evt.RFA.nextevent;
+    if (sys.rxtune.active) {
+        if ((sys.rxtune.expect != 0) && (sys.rxtune.responses >= sys.rxtune.expect)) {
+            dll.comm.redundants = 0;
+            return 1;
+        }
+        entry = &sys.rxtune.entry[sys.rxtune.index];
+        if (entry->count >= SYS_RXTUNE_MIN) {
+            cut = (((ot_u32)entry->avg + ((ot_u32)entry->dev << 2)) >> 3) + SYS_RXTUNE_MARGIN;
+            if (cut < (ot_u32)window) {
+                sys.rxtune.cut = True;
+                return (age < (ot_int)cut) ? ((ot_int)cut - ((age > 0) ? age : 0)) : 1;
             }
         }
     }
+    if ((age > 0) && (age < window)) {
+        window -= age;
+    }
+    return window;
+}
+#endif
+
+
+#ifndef EXTF_sys_rxtune_clear
+void sys_rxtune_clear() {
+#if (OT_FEATURE(RXTUNE) == ENABLED)
+    platform_memset((ot_u8*)&sys.rxtune, 0, sizeof(sys.rxtune));
+#endif
+}
+#endif
+
+
+#ifndef EXTF_sys_rxtune_expect
+void sys_rxtune_expect(ot_u8 responders) {
+#if (OT_FEATURE(RXTUNE) == ENABLED)
+    sys.rxtune.next_expect = responders;
+#endif
+}
+#endif
+
+
+#ifndef EXTF_sys_rxtune_response
+void sys_rxtune_response() {
+#if (OT_FEATURE(RXTUNE) == ENABLED)
+    if (sys.rxtune.active) {
+        sys.rxtune.last = sys.rxtune.arrival;
+        sys.rxtune.responses += (sys.rxtune.responses != 255);
+    }
+#endif
+}
+#endif
+
+
+
+
+
+/** Power Manager <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(POWERMGR) == ENABLED)
+
+#ifndef EXTF_sys_powerdown
+void sys_powerdown() {
+/// The budget is the time to the next kernel run, less the radio cold start,
+/// in STI.  The deepest mode whose wakeup and clock restart fit the budget is
+/// used.  Interrupts are held from the choice until the sleep, so that a
+/// kernel run cannot change the schedule under the choice.
+    static const ot_u16 wake_sti[PLATFORM_LPM_MODES] = PLATFORM_LPM_WAKE_STI;
+    ot_long budget;
+    ot_u8   mode;
+
+    platform_disable_interrupts();
+
+    sys.pm.mark = platform_get_gptim();
+    mode        = sys.pm.limit;
+
+    if (sys.mutex != 0) {
+        mode = 0;
+    }
+#   if (OT_FEATURE(MPIPE) == ENABLED)
+    else if (mpipe_status() != MPIPE_Idle) {
+        mode = 0;
+    }
+#   endif
+#   if (OT_FEATURE(TMS3705) == ENABLED)
+    else if (tms3705_status() == TMS3705_BUSY) {
+        mode = 0;
+    }
+#   endif
+    else if (sys.pm.untimed == False) {
+        budget  = ((ot_long)sys.pm.eta - (ot_long)sys.pm.mark) << 5;
+        budget -= SYS_PM_RADIO_STI;
+        if (mode >= PLATFORM_LPM_UNTIMED) {
+            mode = PLATFORM_LPM_UNTIMED - 1;
+        }
+        while ((mode != 0) && ((ot_long)(wake_sti[mode] + PLATFORM_LPM_CLKSTART_STI) > budget)) {
+            mode--;
+        }
+    }
+
+    sys.pm.mode     = mode;
+    sys.pm.asleep   = True;
+    sys.pm.res[mode].entries++;
+    platform_enter_lpm(mode);
+
+    /// If the interrupt that woke the MCU did not run the kernel, the
+    /// residency ends here.
+    if (sys.pm.asleep) {
+        sys.pm.asleep = False;
+        sys.pm.res[mode].ticks += (ot_u16)(platform_get_gptim() - sys.pm.mark);
+    }
+}
+#endif
+
+
+#ifndef EXTF_sys_pm_limit
+void sys_pm_limit(ot_u8 mode) {
+    sys.pm.limit = (mode < PLATFORM_LPM_MODES) ? mode : (PLATFORM_LPM_MODES-1);
+}
+#endif
+
+
+#ifndef EXTF_sys_pm_clear
+void sys_pm_clear() {
+    ot_u8*  cursor  = (ot_u8*)sys.pm.res;
+    ot_int  i       = sizeof(sys.pm.res);
+
+    while (--i >= 0) {
+        *cursor++ = 0;
+    }
+}
+#endif
+
+
+#ifndef EXTF_sys_pm_export
+ot_int sys_pm_export() {
+#if defined(ISF_ID_power_residency)
+    vlFILE* fp;
+    ot_int  i;
+    ot_uint offset;
+    ot_u16  word[SYS_PM_MODES*3];
+
+    fp = ISF_open_su( ISF_ID(power_residency) );
+    if (fp == NULL) {
+        return -1;
+    }
+
+    for (i=0; i<SYS_PM_MODES; i++) {
+        word[(i*3)+0] = sys.pm.res[i].entries;
+        word[(i*3)+1] = (ot_u16)(sys.pm.res[i].ticks >> 16);
+        word[(i*3)+2] = (ot_u16)sys.pm.res[i].ticks;
+    }
+    for (i=0, offset=0; (i<(SYS_PM_MODES*3)) && ((offset+2) <= fp->alloc); i++, offset+=2) {
+        vl_write(fp, offset, PLATFORM_ENDIAN16(word[i]));
+    }
+
+    vl_close(fp);
+    return offset;
+
+#else
+    return -1;
+#endif
+}
+#endif
+
+#endif
+
+
+
+
+/** Energy Account <BR>
+  * ============================================================================
+  * See OT_FEATURE_ENERGY in system.h.  The stamp mark only moves by whole
+  * ticks, so the sub-tick remainders are not lost between counts.
+  */
+#if (OT_FEATURE(ENERGY) == ENABLED)
+
+void sub_energy_clock() {
+    ot_u32 ticks;
+    ticks               = (platform_stamp() - sys.energy.mark) >> PLATFORM_KTIM_SUBBITS;
+    sys.energy.mark    += (ticks << PLATFORM_KTIM_SUBBITS);
+    sys.energy.total   += ticks;
+    sys.energy.ticks[sys.energy.radio] += ticks;
+}
+
+
+void sub_energy_radio() {
+    ot_u8 state;
+
+    if (sys.mutex & SYS_MUTEX_RADIO_DATA) {
+        state = ((sys.evt.RFA.event_no & 0x0F) >= 3) ? SYS_EN_RADIO_TX : SYS_EN_RADIO_RX;
+    }
+    else if (sys.mutex & SYS_MUTEX_RADIO_LISTEN) {
+        state = SYS_EN_RADIO_RX;
+    }
+    else {
+        state = SYS_EN_RADIO_OFF;
+    }
+
+    if (state != sys.energy.radio) {
+        sub_energy_clock();
+        sys.energy.radio = state;
+    }
+}
+
+
+ot_u32 sub_energy_mc(ot_u32 ticks, ot_u32 ua) {
+/// mC = uA * ticks / 1024000, taken apart so that no product overflows 32 bits
+/// for any count of ticks and any current under 4 A.
+    ot_u32 secs = ticks >> 10;
+    ot_u32 ma   = ua / 1000;
+    ot_u32 rem  = ua % 1000;
+
+    return (secs * ma) + ((secs / 1000) * rem) + (((secs % 1000) * rem) / 1000) \
+            + (((ticks & 1023) * ua) / 1024000);
+}
+
+
+#ifndef EXTF_sys_energy_clear
+void sys_energy_clear() {
+    sub_energy_clock();
+    sys.energy.total    = 0;
+    sys.energy.exported = 0;
+    platform_memset((ot_u8*)sys.energy.ticks, 0, sizeof(sys.energy.ticks));
+#   if (OT_FEATURE(POWERMGR) == ENABLED)
+    sys_pm_clear();
+#   endif
+}
+#endif
+
+
+#ifndef EXTF_sys_energy_export
+ot_int sys_energy_export() {
+#if defined(ISF_ID_energy_account)
+    static const ot_u32 lpm_ua[SYS_PM_MODES] = BOARD_PARAM_LPMuA;
+    static const ot_u32 radio_ua[SYS_EN_RADIO_STATES] = \
+                { BOARD_PARAM_RFOFFuA, BOARD_PARAM_RXuA, BOARD_PARAM_TXuA };
+    vlFILE* fp;
+    ot_int  i;
+    ot_uint offset;
+    ot_u32  active;
+    ot_u32  rec[(4+SYS_PM_MODES)*2];
+
+    sub_energy_clock();
+    sys.energy.exported = sys.energy.total;
+
+    fp = ISF_open_su( ISF_ID(energy_account) );
+    if (fp == NULL) {
+        return -1;
+    }
 
+    for (i=0; i<SYS_EN_RADIO_STATES; i++) {
+        rec[(i*2)+0] = sys.energy.ticks[i];
+        rec[(i*2)+1] = sub_energy_mc(sys.energy.ticks[i], radio_ua[i]);
+    }
 
-#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-        !defined(EXTF_sys_sig_rfaterminate)  )
-        sys.evt.RFA.terminate(sys.evt.RFA.event_no, frx_code);
-#   elif defined(EXTF_sys_sig_rfaterminate)
-        sys_sig_rfaterminate(sys.evt.RFA.event_no, frx_code);
-#   endif
+    active = sys.energy.total;
+    for (i=0; i<SYS_PM_MODES; i++) {
+#       if (OT_FEATURE(POWERMGR) == ENABLED)
+        ot_u32 ticks = sys.pm.res[i].ticks;
+        active = (active > ticks) ? (active - ticks) : 0;
+#       else
+        ot_u32 ticks = 0;
+#       endif
+        rec[((4+i)*2)+0] = ticks;
+        rec[((4+i)*2)+1] = sub_energy_mc(ticks, lpm_ua[i]);
+    }
+    rec[6] = active;
+    rec[7] = sub_energy_mc(active, BOARD_PARAM_CPUuA);
 
-    /// When session restart or continuation is needed, pre-empt the kernel.
-    /// The kernel clocks-down listening and contention periods, so if 
-    /// restarting the session, the new listening timeout will be whatever
-    /// remains from the last one.
-    if (pcode == 0) {
-        platform_ot_preempt();
+    for (i=0, offset=0; (i<((4+SYS_PM_MODES)*4)) && ((offset+2) <= fp->alloc); i++, offset+=2) {
+        ot_u16 word = (i & 1) ? (ot_u16)rec[i>>1] : (ot_u16)(rec[i>>1] >> 16);
+        vl_write(fp, offset, PLATFORM_ENDIAN16(word));
     }
+
+    vl_close(fp);
+    return offset;
+
+#else
+    sub_energy_clock();
+    sys.energy.exported = sys.energy.total;
+    return -1;
+#endif
 }
+#endif
 
+#endif
 
 
 
-void sysevt_initftx() {
-/// Initialize the TX Engine for foreground packet transmission.  This requires
-/// a CSMA-CA routine that runs prior to the data transmission.  The system 
-/// layer manages TX CSMA when it is not part of the Radio Core featureset.
-   
-#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-        !defined(EXTF_sys_sig_rfainit)  )
-        sys.evt.RFA.init(4);
-#   elif defined(EXTF_sys_sig_rfainit)
-        sys_sig_rfainit(4);
-#   endif
-    
-    ///@todo 1st argument of rm2_txinit_ff() is estimated number of frames in
-    /// the packet.  for now it is hard coded to 1.
-    rm2_txinit_ff(1, &rfevt_ftx);
-    sys.mutex               = SYS_MUTEX_RADIO_LISTEN;
-    sys.evt.RFA.event_no    = 3;
-#   if (RF_FEATURE(TXTIMER) == DISABLED)
-    sys.evt.RFA.nextevent   = sub_fcinit();     // Normal TX CSMA process
-    dll.comm.tca            = dll.comm.tc;
-#   else
-    sys.evt.RFA.nextevent   = dll.comm.tc;      // TX timeout
-#   endif
-}
 
+/** Memory Statistics <BR>
+  * ============================================================================
+  * See OT_FEATURE_MEMSTATS in system.h.  The paint starts SYS_MEM_STACKGAP
+  * bytes below the frame of sys_stack_paint(), to keep clear of its own
+  * locals, so the painted size is PLATFORM_STACK_SIZE less the gap.
+  */
+#if (OT_FEATURE(MEMSTATS) == ENABLED)
 
+#define SYS_MEM_STACKGAP    32
+#define SYS_MEM_SCANBYTES   16
 
+#if ((PLATFORM_STACK_SIZE > 0) && (PLATFORM_STACK_SIZE <= SYS_MEM_STACKGAP))
+#   error "PLATFORM_STACK_SIZE must be more than SYS_MEM_STACKGAP"
+#endif
+
+#if (   (OT_FEATURE(NDEF)  == ENABLED) || \
+        (OT_FEATURE(ALP)   == ENABLED) || \
+        (OT_FEATURE(MPIPE) == ENABLED) )
+#   define SYS_MEM_DIRQ(Q)  (Q)
+#else
+#   define SYS_MEM_DIRQ(Q)  NULL
+#endif
+
+static Queue* const mem_queue[SYS_MEM_QUEUES] = {
+    &rxq, &txq, SYS_MEM_DIRQ(&dir_in), SYS_MEM_DIRQ(&dir_out)
+};
 
-void sysevt_initbtx() {
-#if ((M2_FEATURE(GATEWAY) == ENABLED) || \
-     (M2_FEATURE(SUBCONTROLLER) == ENABLED))
-    
-#   if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-        !defined(EXTF_sys_sig_rfainit)  )
-        sys.evt.RFA.init(5);
-#   elif defined(EXTF_sys_sig_rfainit)
-        sys_sig_rfainit(5);
-#   endif
-    
-    rm2_txinit_bf(&rfevt_btx);
-    sys.mutex               = SYS_MUTEX_RADIO_LISTEN;
-    sys.evt.RFA.event_no    = 0x13;              
-#   if (RF_FEATURE(TXTIMER) == DISABLED)
-    sys.evt.RFA.nextevent   = 0;    // Normal TX CSMA process
-    dll.comm.tca            = dll.comm.tc;
-#   else
-    sys.evt.RFA.nextevent   = dll.comm.tc + sys.evt.adv_time;   // TX timeout
-#   endif
 
+#ifndef EXTF_sys_stack_paint
+void sys_stack_paint() {
+#if (PLATFORM_STACK_SIZE > 0)
+    volatile ot_u8  marker;
+    ot_u8*          cursor;
+
+    cursor              = (ot_u8*)&marker - SYS_MEM_STACKGAP;
+    sys.mem.stack_base  = (ot_u8*)&marker - PLATFORM_STACK_SIZE;
+    sys.mem.stack_free  = (PLATFORM_STACK_SIZE - SYS_MEM_STACKGAP);
+    sys.mem.stack_scan  = 0;
+
+    while (cursor > sys.mem.stack_base) {
+        *(--cursor) = SYS_MEM_STACKFILL;
+    }
 #endif
 }
+#endif
 
 
+void sub_mem_scan() {
+/// The stack only grows down into the paint, so the lowest byte that is not
+/// the fill is the mark.  The scan covers a few bytes per pass, from the
+/// bottom up to the last mark, and then starts over.
+#if (PLATFORM_STACK_SIZE > 0)
+    ot_u8*  cursor  = sys.mem.stack_base + sys.mem.stack_scan;
+    ot_int  i       = SYS_MEM_SCANBYTES;
 
+    while ((--i >= 0) && (sys.mem.stack_scan < sys.mem.stack_free)) {
+        if (*cursor++ != SYS_MEM_STACKFILL) {
+            sys.mem.stack_free = sys.mem.stack_scan;
+            break;
+        }
+        sys.mem.stack_scan++;
+    }
+    if (sys.mem.stack_scan >= sys.mem.stack_free) {
+        sys.mem.stack_scan = 0;
+    }
+#endif
+}
 
-void sysevt_txcsma() {
-/// Run the TX CSMA-CA routine, which requires multiple calls if radio core does
-/// not have automated TX contention window handling.
-#if (RF_FEATURE(TXTIMER) != ENABLED)
-    ot_int csma_code = -1;
-    
-    /// First, check Tca to make sure we are within timing requirements
-    if (dll.comm.tca >= 0) {
-        csma_code = rm2_txcsma();
-        
-        // CSMA process continues immediately
-        switch (csma_code) {
-            case RM2_ERR_BADCHANNEL:
-                goto sysevt_txcsma_fail;
-                
-            case RM2_ERR_CCAFAIL:
-                sys.evt.RFA.nextevent = sub_fcloop();
-                break;
-            
-            ///TX CSMA complete: begin data transfer                                    <BR>
-            /// - Flooding handled specially (no contention, different timeout value)   <BR>
-            /// - A2P must get the full packet TX'ed before the end of contention       <BR>
-            /// - NA2P (normal) must start TX before end of contention
-            case -1: 
-#               if (SYS_FLOOD == ENABLED)
-                sys.evt.RFA.nextevent   = (sys.evt.RFA.event_no & 0x10) ? \
-                                            sys.evt.adv_time : rm2_pkt_duration(txq.length);
-#               else
-                sys.evt.RFA.nextevent   = rm2_pkt_duration(txq.length);
-#               endif
-                sys.mutex               = SYS_MUTEX_RADIO_DATA;
-                break;
-            
-            default:
-                sys.evt.RFA.nextevent = csma_code;
-                break;
+
+void sub_mem_sample() {
+    ot_int i;
+
+    for (i=0; i<SYS_MEM_QUEUES; i++) {
+        Queue*  q = mem_queue[i];
+        ot_u16  used;
+        if (q != NULL) {
+            used = (ot_u16)(((q->putcursor > q->getcursor) ? q->putcursor : q->getcursor) - q->front);
+            if (used > q->alloc) {
+                used = q->alloc;
+            }
+            if (used > sys.mem.q_hwm[i]) {
+                sys.mem.q_hwm[i] = used;
+            }
         }
     }
+}
 
-    else {
-        sysevt_txcsma_fail:
-#       if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-            !defined(EXTF_sys_sig_rfaterminate)  )
-            sys.evt.RFA.terminate(3, csma_code);
-#       elif defined(EXTF_sys_sig_rfaterminate)
-            sys_sig_rfaterminate(3, csma_code);
-#       endif
-        session_pop();
-        sys_idle();
+
+#ifndef EXTF_sys_mem_write
+ot_int sys_mem_write(ot_u8* dst) {
+    ot_u16  word[2 + (SYS_MEM_QUEUES*2)];
+    ot_int  i;
+
+    word[0] = (PLATFORM_STACK_SIZE > 0) ? (PLATFORM_STACK_SIZE - SYS_MEM_STACKGAP) : 0;
+    word[1] = sys.mem.stack_free;
+    for (i=0; i<SYS_MEM_QUEUES; i++) {
+        word[2+(i*2)] = (mem_queue[i] != NULL) ? mem_queue[i]->alloc : 0;
+        word[3+(i*2)] = sys.mem.q_hwm[i];
+    }
+    for (i=0; i<(2 + (SYS_MEM_QUEUES*2)); i++) {
+        *dst++ = (ot_u8)(word[i] >> 8);
+        *dst++ = (ot_u8)word[i];
     }
 
+    *dst++ = (ot_u8)OT_FEATURE(SESSION_DEPTH);
+    *dst++ = (ot_u8)session_hwm();
+    *dst++ = (ot_u8)OT_FEATURE(VLFPS);
+    *dst   = vl_fp_hwm();
+
+    return SYS_MEM_RECORD;
+}
 #endif
+
+
+#ifndef EXTF_sys_mem_clear
+void sys_mem_clear() {
+    platform_memset((ot_u8*)sys.mem.q_hwm, 0, sizeof(sys.mem.q_hwm));
+    session_hwm_clear();
+    vl_fp_hwm_clear();
 }
+#endif
 
+#endif
 
 
 
-void rfevt_ftx(ot_int pcode, ot_int scratch) {
-    m2session*  session;
 
-    /// Non-final frame TX'ed in multiframe packet
-    if (pcode == 1) {
-        
-        ///@todo possibly put the queue rearrangement here
-    }
+/** Link Statistics <BR>
+  * ============================================================================
+  * See OT_FEATURE_LINKSTATS in system.h.  A channel takes the first free slot
+  * of the table the first time it is counted, and keeps it until the counts
+  * are cleared.  The file image is packed into 16 bit words, so that loading
+  * and saving are the same loop.
+  */
+#if (OT_FEATURE(LINKSTATS) == ENABLED)
 
-    /// Packet TX is done.  Handle this event and pre-empt the kernel.
-    /// - Normally, go to response RX.
-    /// - Allow scheduling of redundant TX on responses, or request with no response
-    /// - End session if no redundant, and no listening required
-    else {
-        ot_u8 scrap_bit;
-        sys.mutex               = 0;
-        sys.evt.RFA.event_no    = 0;
-        session                 = session_top();
-        scrap_bit               = (dll.comm.rx_timeout == 0) | \
-                                  ((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPTX);
-        dll.comm.redundants    -= 1;
-        
-        // Send redundant TX immediately, but only if no response window or if
-        // this packet is a response.
-        if (scrap_bit && dll.comm.redundants) {
-            dll.comm.csmaca_params = (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA);
-            rm2_prep_resend();
+#define SYS_LS_WORDS    ((SYS_LS_COUNTERS*2) + (SYS_LS_CHANNELS*5))
+
+void sub_ls_count(ot_u8 id) {
+    sys.ls.count[id]++;
+    sys.ls.pending++;
+}
+
+
+void sub_ls_channel(ot_u8 id, ot_u8 channel) {
+    ot_int i;
+    sub_ls_count(id);
+
+    for (i=0; i<SYS_LS_CHANNELS; i++) {
+        sys_lschannel* slot = &sys.ls.chan[i];
+        if ((slot->rx == 0) && (slot->resp == 0)) {
+            slot->channel = channel;
         }
-        
-        // End Session if no redundant, no response window, if this itself is a
-        // response, or if there is some sort of error
-        else {
-            scrap_bit          |= (pcode != 0);         //some sort of error
-            session->netstate  |= (scrap_bit << 7);     //M2_NETFLAG_SCRAP
-            session->netstate  &= ~M2_NETSTATE_TMASK;
-            session->netstate  |= M2_NETSTATE_RESPRX;
+        if (slot->channel == channel) {
+            if (id == SYS_LS_RXFRAMES)  slot->rx++;
+            else                        slot->resp++;
+            break;
         }
-    
-#       if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) && !defined(EXTF_sys_sig_rfaterminate))
-            sys.evt.RFA.terminate(5, pcode);
-#       elif defined(EXTF_sys_sig_rfaterminate)
-            sys_sig_rfaterminate(5, pcode);
-#       endif            
-        
-        platform_ot_preempt();
     }
 }
 
 
+void sub_ls_pack(ot_u16* word) {
+    ot_int i;
+
+    for (i=0; i<SYS_LS_COUNTERS; i++) {
+        *word++ = (ot_u16)(sys.ls.count[i] >> 16);
+        *word++ = (ot_u16)sys.ls.count[i];
+    }
+    for (i=0; i<SYS_LS_CHANNELS; i++) {
+        *word++ = (ot_u16)sys.ls.chan[i].channel << 8;
+        *word++ = (ot_u16)(sys.ls.chan[i].rx >> 16);
+        *word++ = (ot_u16)sys.ls.chan[i].rx;
+        *word++ = (ot_u16)(sys.ls.chan[i].resp >> 16);
+        *word++ = (ot_u16)sys.ls.chan[i].resp;
+    }
+}
+
+
+void sub_ls_unpack(ot_u16* word) {
+    ot_int i;
 
+    for (i=0; i<SYS_LS_COUNTERS; i++, word+=2) {
+        sys.ls.count[i] = ((ot_u32)word[0] << 16) | word[1];
+    }
+    for (i=0; i<SYS_LS_CHANNELS; i++, word+=5) {
+        sys.ls.chan[i].channel  = (ot_u8)(word[0] >> 8);
+        sys.ls.chan[i].rx       = ((ot_u32)word[1] << 16) | word[2];
+        sys.ls.chan[i].resp     = ((ot_u32)word[3] << 16) | word[4];
+    }
+}
 
-void rfevt_btx(ot_int flcode, ot_int scratch) {
-#if ((M2_FEATURE(SUBCONTROLLER) == ENABLED) || (M2_FEATURE(GATEWAY) == ENABLED))
-    switch (flcode) {
-        /// Flood ends & Request Begins                                     <BR>
-        /// - Swap back control to foreground session (m2advp_close())      <BR>
-        /// - Make sure request session is ready to go by setting to 0      <BR>
-        /// - Turn CSMA-CA OFF and set TX timeout to 2 ticks
-        case 0: {
-            m2session* session;
-#           if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) && !defined(EXTF_sys_sig_rfaterminate)  )
-                sys.evt.RFA.terminate(4, 0);
-#           elif defined(EXTF_sys_sig_rfaterminate)
-                sys_sig_rfaterminate(4, 0);
-#           endif
-            m2advp_close();
-            session                 = session_top();
-            session->counter        = 0;
-            sys.evt.adv_time        = 0;
-            sys.evt.RFA.event_no    = 0;
-            sys.mutex               = 0;
-            dll.comm.tc             = 2;
-            dll.comm.csmaca_params  = (M2_CSMACA_NOCSMA | M2_CSMACA_MACCA);
-            dll.comm.redundants     = 1;
-            platform_ot_preempt();
-            break;
-        }
-        
-        /// Flood Continues: Dump-out another flood packet                  <BR>
-        /// - platform_get_gptim() must not be touched for this to work, 
-        ///   which means this method only works for contiguous floods.     <BR>
-        /// - End the flood if the counter is over, else maintain flood
-        case 2: {
-            scratch = sys.evt.adv_time - platform_get_gptim();
-            ///@todo figure out how to fit this into new event manager
-            
-            if (scratch < rm2_pkt_duration(7)) {
-                rm2_txstop_flood();
-            }
-            else {
-                txq.front[3]    = ((ot_u8*)&scratch)[UPPER];
-                txq.front[4]    = ((ot_u8*)&scratch)[LOWER];
-                txq.putcursor   = &txq.front[5];
-            }
-            break;
-        }
-    
-        default: {
-#           if ((OT_FEATURE(SYSRF_CALLBACKS) == ENABLED) &&\
-                !defined(EXTF_sys_sig_rfaterminate)  )
-                sys.evt.RFA.terminate(4, flcode);
-#           elif defined(EXTF_sys_sig_rfaterminate)
-                sys_sig_rfaterminate(4, flcode);
-#           endif
-            sys_idle();
-            platform_ot_preempt();
-            break;
+
+void sub_ls_load() {
+/// A file that is short, or missing, loads as zeros for the rest
+    ot_u16  word[SYS_LS_WORDS];
+#   if defined(ISF_ID_link_statistics)
+    vlFILE* fp;
+    ot_int  i;
+    ot_uint offset;
+#   endif
+
+    platform_memset((ot_u8*)&sys.ls, 0, sizeof(sys_linkstats));
+    platform_memset((ot_u8*)word, 0, sizeof(word));
+    sys.ls.mark = platform_stamp();
+
+#   if defined(ISF_ID_link_statistics)
+    fp = ISF_open_su( ISF_ID(link_statistics) );
+    if (fp != NULL) {
+        for (i=0, offset=0; (i<SYS_LS_WORDS) && ((offset+2) <= fp->length); i++, offset+=2) {
+            word[i] = PLATFORM_ENDIAN16( vl_read(fp, offset) );
+        }
+        vl_close(fp);
+    }
+#   endif
+
+    sub_ls_unpack(word);
+}
+
+
+#ifndef EXTF_sys_linkstats_clear
+void sys_linkstats_clear() {
+    platform_memset((ot_u8*)sys.ls.count, 0, sizeof(sys.ls.count));
+    platform_memset((ot_u8*)sys.ls.chan, 0, sizeof(sys.ls.chan));
+    sys_linkstats_export();
+}
+#endif
+
+
+#ifndef EXTF_sys_linkstats_export
+ot_int sys_linkstats_export() {
+/// Only the words that changed are written, so the mirror marks (and then
+/// syncs to flash) only those.
+#if defined(ISF_ID_link_statistics)
+    vlFILE* fp;
+    ot_int  i;
+    ot_uint offset;
+    ot_u16  word[SYS_LS_WORDS];
+
+    sys.ls.pending  = 0;
+    sys.ls.mark     = platform_stamp();
+
+    fp = ISF_open_su( ISF_ID(link_statistics) );
+    if (fp == NULL) {
+        return -1;
+    }
+
+    sub_ls_pack(word);
+    for (i=0, offset=0; (i<SYS_LS_WORDS) && ((offset+2) <= fp->alloc); i++, offset+=2) {
+        ot_u16 data = PLATFORM_ENDIAN16(word[i]);
+        if (((offset+2) > fp->length) || (vl_read(fp, offset) != data)) {
+            vl_write(fp, offset, data);
         }
     }
+
+    vl_close(fp);
+#   if (OT_FEATURE(VLLAZYSYNC) != ENABLED)
+    ISF_syncmirror();
+#   endif
+    return offset;
+
+#else
+    sys.ls.pending  = 0;
+    sys.ls.mark     = platform_stamp();
+    return -1;
 #endif
 }
+#endif
 
+#endif
 
 
 
 
-/** System Subroutines
+/** Radio Calibration Scheduler <BR>
   * ============================================================================
+  * See OT_FEATURE_RFCAL in system.h.  The ADC is shared with the sensor
+  * pipeline: a burst that cannot start now starts on a later pass.  The first
+  * burst is at the first pass after boot, to take the startup calibration.
   */
+#if (OT_FEATURE(RFCAL) == ENABLED)
+
+#if (OT_FEATURE(SENSORS) == ENABLED)
+ot_long sub_rfcal_idle(ot_long event_eta) {
+    if (sys.rfcal.busy) {
+        if (platform_adc_busy() == False) {
+            sys.rfcal.busy = False;
+            sys_rfcal_check(sys.rfcal.sample);
+        }
+    }
+    else if ((sys.rfcal.valid == False) || \
+            ((ot_u32)(platform_stamp() - sys.rfcal.mark) \
+                >= ((ot_u32)OT_PARAM(RFCAL_PERIOD) << PLATFORM_KTIM_SUBBITS))) {
+        if (platform_adc_start(sys.rfcal.sample, 2, 1)) {
+            sys.rfcal.busy = True;
+            sys.rfcal.mark = platform_stamp();
+        }
+    }
 
-//void sub_worevt_ctrl(wakeon_event* worevt, ot_long* eta) {
-//    if (worevt->nextevent < *eta) {
-//        *eta = worevt->nextevent;
-//    }
-//}
+    // The burst is done in microseconds, so the kernel comes back next tick
+    if (sys.rfcal.busy && (event_eta > 1)) {
+        event_eta = 1;
+    }
+    return event_eta;
+}
+#endif
 
 
+#ifndef EXTF_sys_rfcal_check
+ot_bool sys_rfcal_check(ot_u16* sample) {
+    ot_bool recal = False;
 
-void sub_idlevt_ctrl(idletime_event* idlevt, ot_long* eta, ot_u8 sequence_id) {  
-#if (M2_FEATURE(RTC_SCHEDULER) == ENABLED)
-    if (idlevt->sched_id != 0) {
-        vlFILE*     fp;
-        ot_int      offset;
-        ot_u16      ssmask;
-        ot_u16      ssvalue;
-        
-        fp = ISF_open_su( ISF_ID(real_time_scheduler) );
-        ///@todo assert fp
-        
-        // This is an arithmetic trick to convert the sequence id to
-        // the proper offset (sleep, hold, beacon) of the RTC ISF
-        // sleep offset = 0, hold offset = 4, beacon offset = 8
-        offset  = (sequence_id-4) << 2;
-        
-        // Load Mask and Value (always stored as big endian)
-        ssmask  = ISF_read(fp, offset);
-        ssmask	= PLATFORM_ENDIAN16(ssmask);
-        ssvalue = ISF_read(fp, offset+=2);
-        ssvalue = PLATFORM_ENDIAN16(ssvalue);
-        vl_close(fp);
-        
-        // Apply new mask & value to the RTC and reset the synchronized task
-        platform_set_rtc_alarm(idlevt->sched_id, ssmask, ssvalue);
-        idlevt->cursor      = 0;
-        idlevt->nextevent   = 0;
-    }
-#endif
-        
-    if (idlevt->nextevent < *eta) {
-        *eta = idlevt->nextevent;
+    if (sys.rfcal.valid) {
+        ot_int dtemp = (ot_int)sample[0] - (ot_int)sys.rfcal.cal[0];
+        ot_int dvolt = (ot_int)sample[1] - (ot_int)sys.rfcal.cal[1];
+
+        recal = (ot_bool)((dtemp > OT_PARAM(RFCAL_TEMPDRIFT)) || (dtemp < -OT_PARAM(RFCAL_TEMPDRIFT)) || \
+                          (dvolt > OT_PARAM(RFCAL_VOLTDRIFT)) || (dvolt < -OT_PARAM(RFCAL_VOLTDRIFT)));
+        if (recal == False) {
+            return False;
+        }
+        radio_recalibrate();
+        sys.rfcal.count++;
     }
+
+    sys.rfcal.valid     = True;
+    sys.rfcal.cal[0]    = sample[0];
+    sys.rfcal.cal[1]    = sample[1];
+    return recal;
 }
+#endif
 
+#endif
 
 
 
-void sub_sys_flush() {
-/// (1) Reset sessions. 
-/// (2) Put System states into the right place and flush existing events. 
-/// (3) Set scheduler ids and prepare idle time events
-    ot_u8 accum = 0;
-    
-    session_init();
-    dll.idle_state = sub_default_idle();
-    
-#   if (M2_FEATURE(ENDPOINT) == ENABLED)
-#       if (M2_FEATURE(RTCSLEEP) == ENABLED)
-            accum              += ((M2_SET_SLEEPSCHED & dll.netconf.active) != 0);
-            sys.evt.SSS.sched_id= accum;
-#       endif
-        sys.evt.SSS.cursor      = 0;
-        sys.evt.SSS.nextevent   = 0;
-#   endif
 
-#   if ((M2_FEATURE(ENDPOINT) == ENABLED) || \
-        (M2_FEATURE(SUBCONTROLLER) == ENABLED) || \
-        (M2_FEATURE(GATEWAY) == ENABLED))
-#       if (M2_FEATURE(RTCHOLD) == ENABLED)
-            accum              += ((M2_SET_HOLDSCHED & dll.netconf.active) != 0);
-            sys.evt.HSS.sched_id= accum;
-#       endif
-        sys.evt.HSS.cursor      = 0;
-        sys.evt.HSS.nextevent   = 0;
-#   endif
+/** App Tasks <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(APPTASKS) == ENABLED)
 
-#   if (M2_FEATURE(BEACONS) == ENABLED)
-#       if (M2_FEATURE(RTCBEACON) == ENABLED)
-            accum              += ((M2_SET_BEACONSCHED & dll.netconf.active) != 0);
-            sys.evt.BTS.sched_id= accum;
-#       endif
-        sys.evt.BTS.cursor      = 0;
-        sys.evt.BTS.event_no    = (dll.netconf.b_attempts != 0);
-        sys.evt.BTS.nextevent   = 0;
-#   endif
+ot_bool sub_run_apptask(ot_long* event_eta) {
+/// event_eta is from the last GPTIM flush, like the task budget.  Tasks that
+/// are not due yet cut the ETA, so the kernel wakes up for them.
+    sys_apptask*    task = NULL;
+    ot_int          i;
 
-    /// Go to the appropriate idle state
-    sys_idle();
-}
+    for (i=0; i<SYS_APPTASKS; i++) {
+        if (sys.task[i].run == NULL) {
+            continue;
+        }
+        if (sys.task[i].nextevent > 0) {
+            if (sys.task[i].nextevent < *event_eta) {
+                *event_eta = sys.task[i].nextevent;
+            }
+        }
+        else if ((task == NULL) || (sys.task[i].prio < task->prio) || \
+                ((sys.task[i].prio == task->prio) && (sys.task[i].nextevent < task->nextevent))) {
+            task = &sys.task[i];
+        }
+    }
 
+    if ((task == NULL) || (*event_eta <= SYS_APPTASK_GUARD)) {
+        return False;
+    }
 
+    sys.task_end = (*event_eta > (65535+SYS_APPTASK_GUARD)) ? 65535 : \
+                    (ot_u16)(*event_eta - SYS_APPTASK_GUARD);
+    task->nextevent = task->run();
+    if (task->nextevent < 0) {
+        task->run = NULL;
+    }
+    return True;
+}
 
 
-ot_u8 sub_default_idle() {
-#if ((M2_FEATURE(ENDPOINT) == ENABLED) || (M2_FEATURE(BLINKER) == ENABLED))
-    ot_u16 active_setting   = dll.netconf.active & M2_SET_CLASSMASK;
-    
-    if (active_setting >= M2_SET_SUBCONTROLLER)       
-        return M2_MACIDLE_HOLD;
-    else if (active_setting & M2_SET_ENDPOINT)  
-        return M2_MACIDLE_SLEEP;
-    
-    return M2_MACIDLE_OFF;
-#else
-    
-    return M2_MACIDLE_HOLD;
-#endif
+#ifndef EXTF_sys_task_add
+ot_int sys_task_add(sys_taskfn run, ot_u8 prio, ot_long start) {
+    ot_int i;
+
+    for (i=0; i<SYS_APPTASKS; i++) {
+        if (sys.task[i].run == NULL) {
+            sys.task[i].prio        = prio;
+            sys.task[i].nextevent   = start;
+            sys.task[i].run         = run;
+            return i;
+        }
+    }
+    return -1;
 }
+#endif
 
 
+#ifndef EXTF_sys_task_remove
+void sys_task_remove(ot_int id) {
+    if ((ot_uint)id < SYS_APPTASKS) {
+        sys.task[id].run = NULL;
+    }
+}
+#endif
+
 
+#ifndef EXTF_sys_task_yield
+ot_bool sys_task_yield() {
+    return (ot_bool)(platform_get_gptim() >= sys.task_end);
+}
+#endif
 
+#endif
 
 
 
 
-/** Flow & Congestion Control Functions
+/** External Event Queue <BR>
   * ============================================================================
   */
+#if (OT_FEATURE(EXTQUEUE) == ENABLED)
 
-ot_bool sub_mac_filter() {
-/// Link Budget Filtering (LBF) is a normalized RSSI Qualifier.
-/// Subnet Filtering is an numerical qualifier
-    ot_bool qualifier;
-    {
-        // TX EIRP encoded value    = (dBm + 40) * 2
-        // TX EIRP dBm              = ((encoded value) / 2) - 40
-        // Link Loss                = TX EIRP dBm - Detected RX dBm
-        // Link Quality Filter      = (Link Loss <= Link Loss Limit)
-        ot_int linkloss;
-        linkloss    = ((ot_int)((rxq.front[1] >> 1) & 0x3F) - 40) - radio_rssi(); 
-        qualifier   = (ot_bool)(linkloss <= (ot_int)phymac[0].link_qual);
+ot_bool sub_run_extevent(ot_long event_eta) {
+/// The count is taken with the interrupts held, so a post that comes during
+/// the handler is kept for the next call.
+    ot_int  i;
+    ot_int  src = -1;
+    ot_u8   count;
+
+    if ((event_eta <= SYS_APPTASK_GUARD) || (sys.mutex & SYS_EXT_LOCKS)) {
+        return False;
     }
-    {
-        ot_u8 fr_subnet, dsm, specifier, mask;
-        
-        fr_subnet   = rxq.front[2];
-        dsm         = dll.netconf.subnet & 0x0F;
-        mask        = fr_subnet & dsm;
-        specifier   = (fr_subnet ^ dll.netconf.subnet) & 0xF0;
-        fr_subnet  &= 0xF0;
-        qualifier  &= (ot_bool)(((fr_subnet == 0xF0) || (specifier == 0)) && (mask == dsm));
+
+    for (i=0; i<SYS_EXTQ_SOURCES; i++) {
+        if ((sys.extq.count[i] != 0) && (sys.extq.handler[i] != NULL) && \
+            ((src < 0) || (sys.extq.prio[i] < sys.extq.prio[src]))) {
+            src = i;
+        }
+    }
+    if (src < 0) {
+        return False;
     }
-    return qualifier;
-}
 
+    platform_disable_interrupts();
+    count                   = sys.extq.count[src];
+    sys.extq.count[src]     = 0;
+    platform_enable_interrupts();
 
+    sys.extq.handler[src](count);
+    return True;
+}
 
 
-void sub_csma_scramble() {
-/// Sort of optional: Go through the channel list and scramble the channel
-/// entries randomly so that different devices aren't trying to respond on the
-/// same channels at the same time.
-    if (dll.comm.tx_channels > 1) {
-        ot_u8 i, j, k, rot1, rot2, scratch;
-        rot1 = platform_prand_u8();
-        rot2 = platform_prand_u8();
-        
-        for (i=0; i<(dll.comm.tx_channels-1); i++) {
-            j = i + ((rot1&1) != 0);
-            k = (dll.comm.tx_channels-1) * ((rot2&1) != 0);
-            
-            scratch                 = dll.comm.tx_chanlist[i];
-            dll.comm.tx_chanlist[i] = dll.comm.tx_chanlist[k];
-            dll.comm.tx_chanlist[k] = scratch;
-            scratch                 = dll.comm.tx_chanlist[i];
-            dll.comm.tx_chanlist[i] = dll.comm.tx_chanlist[j];
-            dll.comm.tx_chanlist[j] = scratch;
-            
-            rot1 >>= 1;
-            rot2 >>= 1;
+#ifndef EXTF_sys_ext_add
+ot_int sys_ext_add(sys_extfn handler, ot_u8 prio) {
+    ot_int i;
+
+    for (i=0; i<SYS_EXTQ_SOURCES; i++) {
+        if (sys.extq.handler[i] == NULL) {
+            sys.extq.prio[i]    = prio;
+            sys.extq.count[i]   = 0;
+            sys.extq.handler[i] = handler;
+            return i;
         }
     }
+    return -1;
 }
+#endif
 
 
+#ifndef EXTF_sys_ext_remove
+void sys_ext_remove(ot_int id) {
+    if ((ot_uint)id < SYS_EXTQ_SOURCES) {
+        sys.extq.handler[id]    = NULL;
+        sys.extq.count[id]      = 0;
+    }
+}
+#endif
 
 
-ot_uint sub_fcinit() {
-/// Pick a time offset to begin the first transmission attempt, and setup
-/// flow-congestion loop parameters.
-    
-    // Pick a slot offset: currently only RIGD and RAIND need a random slot.
-    // {0,1,2,3} = {RIGD, RAIND, AIND, Default MAC CA} 
-    switch ( (dll.comm.csmaca_params >> 3) & 0x03 ) {
-        case 0: return sub_rigd_newslot();
-                
-        case 1: {
-            ot_u16 random;
-            random  = platform_prand_u16();
-            random %= (dll.comm.tca - rm2_pkt_duration(txq.front[0]));
-            return random;
+#ifndef EXTF_sys_ext_post
+void sys_ext_post(ot_int id) {
+/// A post to a free source is dropped by the kernel, which skips it.  The
+/// kernel is pre-empted so that it sees the post in its next pass, even if it
+/// was asleep until a later event.
+    if ((ot_uint)id < SYS_EXTQ_SOURCES) {
+        if (sys.extq.count[id] != 255) {
+            sys.extq.count[id]++;
         }
-        
-        case 2: 
-        case 3: return 0;
+        platform_ot_preempt();
     }
-    //ignore compiler warning here (switch will always return)
 }
+#endif
 
+#endif
 
 
 
-void sub_fceval(ot_int query_score) {
-/// @todo When M2QP returns zero, the query has succeeded with no priorities.  
-/// Some queries have priority scores.  In these cases, higher scores may be 
-/// used to affect CSMA-CA reply ordering (higher is better).  This feature is 
-/// not yet implemented.
+
+/** Dialog Completion <BR>
+  * ============================================================================
+  */
+#if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+
+ot_u16 sub_dialog_ticks() {
+    ot_int age = PLATFORM_STAMP_AGE(sys.dialog.stamp);
+    return (age > 0) ? (ot_u16)age : 1;
 }
 
 
+ot_bool sub_dialog_watched(m2session* session) {
+    return (ot_bool)((sys.dialog.done != NULL) && \
+                     (session->dialog_id == sys.dialog.dialog_id));
+}
 
 
-ot_uint sub_fcloop() {
-    /// {0,1,2,3} = {RIGD, RAIND, AIND, Default MAC CA} 
-    /// Default MAC CA just waits Tg before trying again
-    switch ( (dll.comm.csmaca_params >> 3) & 3 ) {
-        case 0: return sub_rigd_nextslot() + sub_rigd_newslot();
-        case 1: 
-        case 2: return sub_aind_nextslot();
-        case 3: return phymac[0].tg;
-    }
-} //ignore compiler warning here (switch will always return)
+void sub_dialog_end(ot_u8 status) {
+/// The watch is cleared before the call, so the callback can start another
+    sys_dialog_result   result;
+    sys_dialogfn        done;
 
+    result              = sys.dialog.result;
+    result.total_ticks  = sub_dialog_ticks();
+    if (result.status == SYS_DIALOG_RUN) {
+        result.status   = sys.dialog.sent ? SYS_DIALOG_DONE : status;
+    }
+    done                = sys.dialog.done;
+    sys.dialog.done     = NULL;
+    done(&result);
+}
 
 
+void sub_dialog_check() {
+/// The dialog is over once no session in the stack has its dialog ID
+    ot_int i;
 
-ot_uint sub_rigd_newslot() {
-/// halve tc from previous value and offset a random within that duration
-    ot_u16 random;
-    random          = platform_prand_u16();
-    dll.comm.tc   >>= 1;
-    dll.comm.tca    = dll.comm.tc;
-    return          (random % dll.comm.tc);
+    if (sys.dialog.done == NULL) {
+        return;
+    }
+    for (i=session.top; i>=0; i--) {
+        if (session.pool[session.heap[i]].dialog_id == sys.dialog.dialog_id) {
+            return;
+        }
+    }
+    sub_dialog_end(SYS_DIALOG_DROPPED);
 }
 
 
+void sub_dialog_txdone(m2session* session) {
+    if (sub_dialog_watched(session) && (sys.dialog.sent == False)) {
+        sys.dialog.sent             = True;
+        sys.dialog.result.tx_ticks  = sub_dialog_ticks();
+    }
+}
 
 
-ot_uint sub_rigd_nextslot() {
-    ot_long wait = (dll.comm.tc - dll.comm.tca);
-    return (wait < 0) ? 0 : (ot_uint)wait;
+void sub_dialog_nochannel(m2session* session) {
+    if (sub_dialog_watched(session) && (sys.dialog.sent == False)) {
+        sys.dialog.result.status = SYS_DIALOG_NOCHANNEL;
+    }
 }
 
 
+#ifndef EXTF_sys_dialog_watch
+ot_u16 sys_dialog_watch(sys_dialogfn done) {
+    m2session* session;
 
+    if (sys.dialog.done != NULL) {
+        sub_dialog_end(SYS_DIALOG_DROPPED);
+    }
+    if (session_count() < 0) {
+        return 0;
+    }
 
-ot_uint sub_aind_nextslot() {
-/// Works for RAIND or AIND next slot
-    return rm2_pkt_duration(txq.front[0]);
+    session = session_top();
+    platform_memset((ot_u8*)&sys.dialog.result, 0, sizeof(sys_dialog_result));
+    sys.dialog.result.handle    = *((ot_u16*)&session->channel);
+    sys.dialog.dialog_id        = session->dialog_id;
+    sys.dialog.sent             = False;
+    sys.dialog.stamp            = platform_stamp();
+    sys.dialog.done             = done;
+    return sys.dialog.result.handle;
 }
+#endif
 
 
+#ifndef EXTF_sys_dialog_response
+void sys_dialog_response(ot_u8 dialog_id, ot_bool error) {
+    if ((sys.dialog.done != NULL) && (dialog_id == sys.dialog.dialog_id)) {
+        if (error) {
+            sys.dialog.result.errors += (sys.dialog.result.errors != 255);
+        }
+        else {
+            sys.dialog.result.responses += (sys.dialog.result.responses != 255);
+        }
+        if (sys.dialog.result.resp_ticks == 0) {
+            sys.dialog.result.resp_ticks = sub_dialog_ticks();
+        }
+    }
+}
+#endif
 
+#endif
@@ -28,6 +28,7 @@
 #ifndef __SYSTEM_NATIVE_H
 #define __SYSTEM_NATIVE_H
 
+#include "OT_platform.h"     // RF_FEATURE(), for SYS_SNIFF
 #include "system.h"
 
 
@@ -88,6 +89,78 @@ typedef struct {
 #define OT_FEATURE_EXTERNAL_EVENT	ENABLED
 #endif
 
+/** Radio-timed sleep scan (RF_FEATURE(SCANCYCLE))
+  * A sleep scan sequence with only one scan is periodic, so it is handed to
+  * the radio with rm2_rxinit_sniff(), and the MCU stays asleep until a sync
+  * word is found.  The scan is restarted by the kernel every
+  * 2^SYS_SNIFF_REFRESH periods, which is also a watchdog for the radio.
+  */
+#ifndef SYS_SNIFF_REFRESH
+#define SYS_SNIFF_REFRESH   6
+#endif
+#define SYS_SNIFF   ((M2_FEATURE(ENDPOINT) == ENABLED) && (RF_FEATURE(SCANCYCLE) == ENABLED))
+
+/** Multi-channel scan (SYS_SCAN_HOPS)
+  * A scan datum with Next Scan = 0 is chained to the datum after it (if that
+  * is the same kind of scan, fscan or bscan), up to SYS_SCAN_HOPS channels.
+  * The chain is one scan event: the radio is woken once and it hops from 
+  * channel to channel, listening on each for the timeout of its own datum.  
+  * A hop waits while a frame is coming in, and a frame ends the hopping.  The
+  * hops are timed by the kernel, so a radio RX timer disables them.
+  */
+#ifndef SYS_SCAN_HOPS
+#define SYS_SCAN_HOPS       4
+#endif
+#define SYS_SCANHOP ((SYS_SCAN_HOPS > 1) && SYS_RFA_RECEIVE)
+
+/** Beacon frame cache (M2_FEATURE(BEACON_CACHE))
+  * The last beacon frame built is kept, up to SYS_BEACON_CACHE_SIZE bytes, 
+  * with the beacon datum that built it.  When that datum comes up again and
+  * no file has changed since (vl_writestamp, vl_mapstamp), the frame is copied
+  * to txq with the new dialog ID instead of being built again.  The encoder
+  * adds the CRC at TX, as always.  Frames with DLLS or NLS are not cached,
+  * because the sequence changes with each frame.  Only use it if the ISFs in the
+  * beacon call templates are written through veelite.
+  */
+#ifndef M2_FEATURE_BEACON_CACHE
+#define M2_FEATURE_BEACON_CACHE     DISABLED
+#endif
+#ifndef SYS_BEACON_CACHE_SIZE
+#define SYS_BEACON_CACHE_SIZE       64
+#endif
+#define SYS_BEACON_CACHE    ((M2_FEATURE(BEACONS) == ENABLED) && (M2_FEATURE(BEACON_CACHE) == ENABLED))
+
+/** Response replay cache (M2_FEATURE(RESP_CACHE))
+  * The last response frame sent is kept, up to SYS_RESP_CACHE_SIZE bytes, with
+  * a key of the request that caused it: its dialog ID, its source address and
+  * a CRC of the rest of its bytes (the TX EIRP byte is left out).  When the 
+  * same request comes in again within SYS_RESP_CACHE_TIME ticks and no file
+  * has changed since (vl_writestamp, vl_mapstamp), it is a retransmission: the
+  * response is copied to txq instead of parsing the request again, so a write
+  * or a shell command is not run twice.  DLLS frames and datastream requests
+  * are not cached.
+  */
+#ifndef M2_FEATURE_RESP_CACHE
+#define M2_FEATURE_RESP_CACHE       DISABLED
+#endif
+#ifndef SYS_RESP_CACHE_SIZE
+#define SYS_RESP_CACHE_SIZE         64
+#endif
+#ifndef SYS_RESP_CACHE_TIME
+#define SYS_RESP_CACHE_TIME         2048
+#endif
+#define SYS_RESP_CACHE      (M2_FEATURE(RESP_CACHE) == ENABLED)
+
+/** Query score reply ordering
+  * A query that passes with a positive score (correlation and window searches)
+  * narrows the window of the first response TX offset toward its start, by
+  * half for each bit of the score, up to SYS_FCSCORE_STEPS halvings.  Better 
+  * matches then tend to reply first.  0 turns it off.  See sub_fceval().
+  */
+#ifndef SYS_FCSCORE_STEPS
+#define SYS_FCSCORE_STEPS   3
+#endif
+
 #define HSS_INDEX       0
 #define SSS_INDEX       (HSS_INDEX+(M2_FEATURE(ENDPOINT) == ENABLED))
 #define BTS_INDEX       (SSS_INDEX+(M2_FEATURE(BEACONS) == ENABLED))
@@ -107,6 +180,10 @@ typedef struct {
     ot_sysevt       process;            // event processing function
     ot_uint         adv_time;           // Time for advertising
     ot_uint         hold_cycle;         // current hold cycle
+    ot_long         idle_eta;           // soonest idle event, from last clocking
+#   if (SYS_SNIFF)
+    ot_uint         sniff_period;       // sleep scan period, 0 if not periodic
+#   endif
     radio_event     RFA;                // RF Active event
     idletime_event  idle[IDLE_EVENTS];
 } 
@@ -132,6 +209,57 @@ typedef struct {
 #   if (OT_FEATURE(SW_WATCHDOG) == ENABLED)
         ot_u16      watchdog;
 #   endif
+#   if (OT_FEATURE(PROFILER) == ENABLED)
+        ot_u32      isr_mark;
+        ot_u32      wait_mark;
+        sys_profile profile[SYS_PROFILE_IDS];
+#   endif
+#   if (OT_FEATURE(ADAPTIVECA) == ENABLED)
+        sys_castats ca;
+#   endif
+#   if (OT_FEATURE(SLOPCAL) == ENABLED)
+        sys_slopstats slop;
+#   endif
+#   if (OT_FEATURE(RXTUNE) == ENABLED)
+        sys_rxtune  rxtune;
+#   endif
+#   if (OT_FEATURE(SNIFFER) == ENABLED)
+        sys_sniffer sniffer;
+#   endif
+#   if (OT_FEATURE(RESPFWD) == ENABLED)
+        sys_respfwd respfwd;
+#   endif
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+        sys_netsync netsync;
+#   endif
+#   if (OT_FEATURE(POWERMGR) == ENABLED)
+        sys_powerstats pm;
+#   endif
+#   if (OT_FEATURE(ENERGY) == ENABLED)
+        sys_energy  energy;
+#   endif
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+        sys_memstats mem;
+#   endif
+#   if (OT_FEATURE(LINKSTATS) == ENABLED)
+        sys_linkstats ls;
+#   endif
+#   if (OT_FEATURE(RFCAL) == ENABLED)
+        sys_rfcal   rfcal;
+#   endif
+#   if (OT_FEATURE(TRACE) == ENABLED)
+        sys_tracebuf trace;
+#   endif
+#   if (OT_FEATURE(APPTASKS) == ENABLED)
+        sys_apptask task[SYS_APPTASKS];
+        ot_u16      task_end;       // GPTIM value where the running task yields
+#   endif
+#   if (OT_FEATURE(EXTQUEUE) == ENABLED)
+        sys_extqueue extq;
+#   endif
+#   if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+        sys_dialogwatch dialog;
+#   endif
 #   if (OT_FEATURE(SYSKERN_CALLBACKS) == ENABLED)
         ot_bool (*loadapp)(void);
         ot_sig  panic;
@@ -226,9 +226,12 @@ typedef enum {
 	MSG_raw 		= 4,
 	MSG_utf8		= 5,
 	MSG_utf16		= 6,
-	MSG_utf8hex		= 7
+	MSG_utf8hex		= 7,
+	DATA_m2frame	= 8,	// sniffer capture record (OT_FEATURE_SNIFFER)
+	DATA_m2resp		= 9		// forwarded response (OT_FEATURE_RESPFWD)
 } logmsg_type;
 
+
 #if (OT_FEATURE(LOGGER) == ENABLED)
 
 /** @brief  Loads a Logger header into the output queue
@@ -332,6 +335,33 @@ void otapi_log_hexmsg(ot_int label_len, ot_int data_len, ot_u8* label, ot_u8* da
   */
 void otapi_log_code(ot_int label_len, ot_u8* label, ot_u16 code);
 
+
+
+#if (LOG_FEATURE(DEFERRED) == ENABLED)
+/** Deferred Logging (see LOG_FEATURE_DEFERRED in OT_config.h)
+  * Each deferred record payload is prefixed by the 32 bit platform_get_time() 
+  * (big endian), and hex messages are sent as MSG_raw: the host formats them.
+  */
+
+/** @brief  Sends the oldest deferred log record, if MPipe is idle
+  * @param  None
+  * @retval ot_bool     True if more records are waiting in the log ring
+  * @ingroup OTAPI_core
+  *
+  * The kernel calls this from its idle task.  It is safe to call it from the
+  * application, too, but never from an ISR.
+  */
+ot_bool otapi_log_drain();
+
+
+/** @brief  Returns the number of log records dropped because the ring was full
+  * @param  None
+  * @retval ot_u16      Dropped record count (saturates at 65535)
+  * @ingroup OTAPI_core
+  */
+ot_u16 otapi_log_drops();
+#endif
+
 #endif
 
 
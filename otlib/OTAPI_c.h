@@ -176,6 +176,10 @@ ot_u16 otapi_sysinit();
   * that you would generate by this function are ad-hoc, meaning they are not
   * scheduled for some time in the future (they happen right away).  Scheduled
   * sessions are reserved for internal DASH7 usage.
+  *
+  * With M2_FEATURE(LINKADAPT), s_tmpl->channel may be RM2_CHAN_AUTO.  The
+  * channel is then picked by otapi_open_request(), from the link quality of
+  * the unicast target (see m2np_link_channel()).
   */
 ot_u16 otapi_new_session(session_tmpl* s_tmpl);
 
@@ -274,6 +278,28 @@ ot_u16 otapi_start_dialog();
 
 
 
+#if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+#include "system.h"
+
+/** @brief  Begins a DASH7 dialog onto the top session, and calls back when
+  *         it is over
+  * @param  done            (sys_dialogfn) completion callback
+  * @retval ot_u16          handle of the dialog, 0 on failure
+  * @ingroup OTAPI_c
+  * @sa otapi_start_dialog()
+  * @sa sys_dialog_watch()
+  *
+  * The same as otapi_start_dialog(), but the kernel calls done once the
+  * dialog is over, with a sys_dialog_result: the handle, how it ended, the
+  * number of responses and error responses, and its timing in ticks.  The
+  * handle is the session number that otapi_new_session() returned.  The app
+  * has nothing to poll, and it can sleep until the callback (see system.h).
+  */
+ot_u16 otapi_start_dialog_cb(sys_dialogfn done);
+#endif
+
+
+
 
 
 
@@ -40,6 +40,7 @@
 #include "alp.h"
 #include "buffers.h"
 #include "mpipe.h"
+#include "OT_platform.h"
 
 
 
@@ -62,19 +63,109 @@ ot_bool sub_dirout_check(ot_int payload_length) {
 
 
 
+#if (LOG_FEATURE(DEFERRED) == ENABLED)
+#if (LOG_RING_SIZE & (LOG_RING_SIZE-1))
+#   error "LOG_RING_SIZE must be a power of 2"
+#endif
+
+/// Ring records are: subcode, payload length, payload (timestamp first). The
+/// kernel is the only consumer, and it only takes a record once all of it is
+/// in the ring.  Producers may be ISRs or the kernel: an ISR always runs to
+/// completion before the code it interrupted resumes, so the busy flag only
+/// needs to catch a push that interrupts another push (it is dropped).
+ot_u8           log_buffer[LOG_RING_SIZE];
+RingQueue       log_ring    = { (LOG_RING_SIZE-1), 0, 0, log_buffer };
+ot_u16          log_drops   = 0;
+volatile ot_u8  log_busy    = 0;
+
+
+void sub_log_push(ot_u8 subcode, ot_int label_len, ot_u8* label, ot_int data_len, ot_u8* data) {
+    ot_u8   header[6];
+    ot_u32  time;
+    ot_int  payload_length = 4 + data_len;
+    
+    if (label != NULL) {
+        payload_length += label_len + 1;
+    }
+    
+    if ((log_busy == 0) && sub_dirout_check(payload_length) && \
+        (rq_space(&log_ring) >= (payload_length+2)) ) {
+        log_busy    = 1;
+        header[0]   = subcode;
+        header[1]   = (ot_u8)payload_length;
+        time        = platform_get_time();
+        header[2]   = (ot_u8)(time >> 24);
+        header[3]   = (ot_u8)(time >> 16);
+        header[4]   = (ot_u8)(time >> 8);
+        header[5]   = (ot_u8)time;
+        rq_writestring(&log_ring, header, 6);
+        if (label != NULL) {
+            rq_writestring(&log_ring, label, label_len);
+            rq_writebyte(&log_ring, ' ');
+        }
+        rq_writestring(&log_ring, data, data_len);
+        log_busy    = 0;
+    }
+    else if (log_drops != 65535) {
+        log_drops++;
+    }
+}
+
+
+#ifndef EXTF_otapi_log_drain
+ot_bool otapi_log_drain() {
+    ot_uint length;
+    ot_uint avail = rq_length(&log_ring);
+    
+    if (avail < 2) {
+        return False;
+    }
+    length = log_ring.front[(ot_u16)(log_ring.getindex+1) & log_ring.mask];
+    if ((avail < (length+2)) || (mpipe_status() != MPIPE_Idle)) {
+        return True;
+    }
+    
+    otapi_log_header((ot_u8)rq_readbyte(&log_ring), length);
+    rq_readbyte(&log_ring);
+    rq_readstring(&log_ring, dir_out.putcursor, length);
+    dir_out.putcursor  += length;
+    dir_out.length     += length;
+    mpipe_txndef(dir_out.front, False, MPIPE_Broadcast);
+    
+    return (ot_bool)(rq_length(&log_ring) != 0);
+}
+#endif
+
+
+#ifndef EXTF_otapi_log_drops
+ot_u16 otapi_log_drops() {
+    return log_drops;
+}
+#endif
+#endif
+
+
+
 #ifndef EXTF_otapi_log
 void otapi_log(ot_u8 subcode, ot_int length, ot_u8* data) {
+#   if (LOG_FEATURE(DEFERRED) == ENABLED)
+    sub_log_push(subcode, 0, NULL, length, data);
+#   else
     if (sub_dirout_check(length)) {
         otapi_log_header(subcode, length);
         q_writestring(&dir_out, data, length);
         mpipe_txndef(dir_out.front, False, MPIPE_Broadcast);
     }
+#   endif
 }
 #endif
 
 
 #ifndef EXTF_otapi_log_msg
 void otapi_log_msg(logmsg_type logcmd, ot_int label_len, ot_int data_len, ot_u8* label, ot_u8* data) {
+#   if (LOG_FEATURE(DEFERRED) == ENABLED)
+    sub_log_push(logcmd, label_len, label, data_len, data);
+#   else
     ot_int payload_length = label_len + 1 + data_len;
     
     if (sub_dirout_check(payload_length)) {
@@ -85,12 +176,16 @@ void otapi_log_msg(logmsg_type logcmd, ot_int label_len, ot_int data_len, ot_u8*
         
         mpipe_txndef(dir_out.front, False, MPIPE_Broadcast);
     }
+#   endif
 }
 #endif
 
 
 #ifndef EXTF_otapi_log_hexmsg
 void otapi_log_hexmsg(ot_int label_len, ot_int data_len, ot_u8* label, ot_u8* data) {
+#   if (LOG_FEATURE(DEFERRED) == ENABLED)
+    sub_log_push(MSG_raw, label_len, label, data_len, data);
+#   else
     ot_int payload_length = label_len + 1 + (data_len<<1);
 
     if (sub_dirout_check(payload_length)) {
@@ -101,6 +196,7 @@ void otapi_log_hexmsg(ot_int label_len, ot_int data_len, ot_u8* label, ot_u8* da
         
         mpipe_txndef(dir_out.front, False, MPIPE_Broadcast);
     }
+#   endif
 }
 #endif
 
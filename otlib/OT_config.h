@@ -37,6 +37,187 @@
 #include "extf_config.h"
 
 
+/// CRC16 Engine Selection:
+/// When the MCU does not have usable CRC HW (MCU_FEATURE_CRC), the CRC16 module
+/// in OTlib/crc16.c is built with one of the SW engines below.  The app config
+/// can define CRC16_ENGINE to pick one, otherwise the 256 entry table is used.
+/// <LI> BITWISE: reference loop, no table, slowest </LI>
+/// <LI> NIBBLE:  16 entry table (32 bytes), for flash-tight parts </LI>
+/// <LI> TABLE:   256 entry table (512 bytes), one lookup per byte </LI>
+/// <LI> SLICE4:  4x 256 entry tables (2048 bytes), folds 4 bytes per lookup 
+///               round.  Best on 32 bit cores like Cortex-M3. </LI>
+#define CRC16_ENGINE_BITWISE    0
+#define CRC16_ENGINE_NIBBLE     1
+#define CRC16_ENGINE_TABLE      2
+#define CRC16_ENGINE_SLICE4     3
+
+#ifndef CRC16_ENGINE
+#   define CRC16_ENGINE         CRC16_ENGINE_TABLE
+#endif
+
+/// Fused SW codec:
+/// With the TABLE engine, the em2 encoder and decoder for whitened frames do
+/// the CRC update and the PN9 whitening in one pass over each FIFO burst (see
+/// m2_encode.c).  Define EM2_FUSED DISABLED to get the staged path, where 
+/// the CRC, the copy and the whitening each take a pass, e.g. to benchmark it.
+#ifndef EM2_FUSED
+#   define EM2_FUSED            ENABLED
+#endif
+
+/// Hot code in RAM:
+/// PLATFORM_RAMCODE links the functions marked with OT_RAMCODE() (the radio
+/// ISRs and the em2 decoders) to run from SRAM, and platform_poweron() copies
+/// them there from flash.  On the MSP430/CC430 this removes the flash wait
+/// states from the RX path, and these ISRs can then run while veelite erases
+/// a flash segment.  Anything they call that is not marked still runs from
+/// flash.  It also turns on CRC16_TABLE_RAM and puts the em2 tables in SRAM.
+/// Platforms that do not support it ignore it.
+#ifndef PLATFORM_RAMCODE
+#   define PLATFORM_RAMCODE     DISABLED
+#endif
+
+/// Interrupt nesting:
+/// MSP430 interrupts have fixed priorities and do not nest, so a long handler
+/// (the kernel in the GPTIM ISR, or MPipe) holds off the radio ISRs until it
+/// returns.  PLATFORM_ISR_NESTING lets these handlers enable GIE once they have
+/// cleared their own flag, so that the radio ISRs can preempt them.  The GPTIM,
+/// RTC and DMA ISRs wait until the handler is done.  Other ISRs (e.g. an MPipe
+/// UART or RTS pin) can preempt it too, as they can on STM32.  Platforms with
+/// an NVIC set the radio above the rest instead (see their platform header).
+#ifndef PLATFORM_ISR_NESTING
+#   define PLATFORM_ISR_NESTING DISABLED
+#endif
+
+/// CRC16 tables in RAM:
+/// The table engines keep their tables in flash.  On parts where flash reads
+/// have wait states (e.g. STM32 above 24 MHz), CRC16_TABLE_RAM puts them in 
+/// SRAM instead, as initialized data, so each lookup is one bus cycle.  The
+/// STM32 CRC units are CRC-32 only, so STM32 builds should use SLICE4 with 
+/// this option rather than MCU_FEATURE_CRC.
+#ifndef CRC16_TABLE_RAM
+#   define CRC16_TABLE_RAM      PLATFORM_RAMCODE
+#endif
+
+
+
+/// Deferred Logging:
+/// With LOG_FEATURE(DEFERRED), the log functions in OTAPI_logger.c do not write
+/// to MPipe.  They append a record to a RAM ring of LOG_RING_SIZE bytes (power
+/// of 2), and the kernel drains it from the idle task, when MPipe is idle.
+#ifndef LOG_FEATURE_DEFERRED
+#   define LOG_FEATURE_DEFERRED DISABLED
+#endif
+#ifndef LOG_RING_SIZE
+#   define LOG_RING_SIZE        256
+#endif
+
+
+
+/// Device Profiles:
+/// OT_PARAM_PROFILE derives the Mode 2 device role features, and the buffer
+/// profile below, from one choice.  Roles that a profile leaves out are
+/// compiled out, and with section-level garbage collection in the linker
+/// (-ffunction-sections -fdata-sections, --gc-sections), so is anything only
+/// they reference.  Supplements/feature_size.sh reports the image size of each
+/// profile and of each feature toggled on top of one.
+/// <LI> CUSTOM:        the app config sets M2_FEATURE_GATEWAY, _SUBCONTROLLER
+///                     and _ENDPOINT, and OT_PARAM_BUFPROFILE </LI>
+/// <LI> ENDPOINT:      endpoint only, endpoint buffers </LI>
+/// <LI> SUBCONTROLLER: subcontroller and endpoint, endpoint buffers </LI>
+/// <LI> GATEWAY:       gateway only, gateway buffers if OT_PARAM_BUFFER_SIZE
+///                     is at least 4096, else endpoint buffers </LI>
+/// A buffer profile set in the app config (not CUSTOM) is kept.
+#define OT_PROFILE_CUSTOM           0
+#define OT_PROFILE_ENDPOINT         1
+#define OT_PROFILE_SUBCONTROLLER    2
+#define OT_PROFILE_GATEWAY          3
+
+#ifndef OT_PARAM_PROFILE
+#   define OT_PARAM_PROFILE     OT_PROFILE_CUSTOM
+#endif
+#if (OT_PARAM_PROFILE != OT_PROFILE_CUSTOM)
+#   undef M2_FEATURE_GATEWAY
+#   undef M2_FEATURE_SUBCONTROLLER
+#   undef M2_FEATURE_ENDPOINT
+#   if (OT_PARAM_PROFILE == OT_PROFILE_GATEWAY)
+#       define M2_FEATURE_GATEWAY       ENABLED
+#       define M2_FEATURE_SUBCONTROLLER DISABLED
+#       define M2_FEATURE_ENDPOINT      DISABLED
+#   else
+#       define M2_FEATURE_GATEWAY       DISABLED
+#       define M2_FEATURE_ENDPOINT      ENABLED
+#       if (OT_PARAM_PROFILE == OT_PROFILE_SUBCONTROLLER)
+#           define M2_FEATURE_SUBCONTROLLER ENABLED
+#       else
+#           define M2_FEATURE_SUBCONTROLLER DISABLED
+#       endif
+#   endif
+#   if (!defined(OT_PARAM_BUFPROFILE) || (OT_PARAM_BUFPROFILE == 0))
+#       undef OT_PARAM_BUFPROFILE
+#       if ((OT_PARAM_PROFILE == OT_PROFILE_GATEWAY) && (OT_PARAM_BUFFER_SIZE >= 4096))
+#           define OT_PARAM_BUFPROFILE  BUF_PROFILE_GATEWAY
+#       else
+#           define OT_PARAM_BUFPROFILE  BUF_PROFILE_ENDPOINT
+#       endif
+#   endif
+#endif
+
+
+
+/// Buffer Profiles:
+/// OT_PARAM_BUFPROFILE picks the layout of otbuf (see buffers.h) in one line,
+/// rather than option by option.  A profile other than CUSTOM replaces the
+/// buffer options in the app config.
+/// <LI> CUSTOM:   the app config sets OT_FEATURE_RXQ_DOUBLE, OT_PARAM_RXPOOL,
+///                OT_PARAM_TXPOOL, OT_FEATURE_MPIPE_DUPLEX and so on </LI>
+/// <LI> ENDPOINT: one rxq, one txq, and half duplex console queues </LI>
+/// <LI> GATEWAY:  for parts with SRAM to spare (16KB and up): rxq_next, eight
+///                response slots, two staged TX frames, full duplex console
+///                queues and two query blocks.  OT_PARAM_BUFFER_SIZE must be
+///                at least 4096 with 255 byte frames. </LI>
+#define BUF_PROFILE_CUSTOM      0
+#define BUF_PROFILE_ENDPOINT    1
+#define BUF_PROFILE_GATEWAY     2
+
+#ifndef OT_PARAM_BUFPROFILE
+#   define OT_PARAM_BUFPROFILE  BUF_PROFILE_CUSTOM
+#endif
+#if (OT_PARAM_BUFPROFILE != BUF_PROFILE_CUSTOM)
+#   undef OT_FEATURE_RXQ_DOUBLE
+#   undef OT_FEATURE_MPIPE_DUPLEX
+#   undef OT_PARAM_RXPOOL
+#   undef OT_PARAM_TXPOOL
+#   undef OT_PARAM_SCRATCH_QUERY
+#endif
+#if (OT_PARAM_BUFPROFILE == BUF_PROFILE_ENDPOINT)
+#   define OT_FEATURE_RXQ_DOUBLE    DISABLED
+#   define OT_FEATURE_MPIPE_DUPLEX  DISABLED
+#   define OT_PARAM_RXPOOL          0
+#   define OT_PARAM_TXPOOL          0
+#   define OT_PARAM_SCRATCH_QUERY   1
+#elif (OT_PARAM_BUFPROFILE == BUF_PROFILE_GATEWAY)
+#   define OT_FEATURE_RXQ_DOUBLE    ENABLED
+#   define OT_FEATURE_MPIPE_DUPLEX  ENABLED
+#   define OT_PARAM_RXPOOL          8
+#   define OT_PARAM_TXPOOL          2
+#   define OT_PARAM_SCRATCH_QUERY   2
+#endif
+
+
+
+/// Static Dispatch:
+/// With OT_FEATURE(STATIC_DISPATCH), hot dispatch points that the build
+/// configuration already fixes are called directly, not through a function
+/// pointer: the Mode 2 encoder and decoder (m2_encode.h), the CRC stream
+/// (crc16.c), and the Veelite file backends (vl_read(), vl_write()).  The
+/// kernel and M2NP callbacks are already static when their _CALLBACKS feature
+/// is off, or when an EXTF_ function replaces them.
+#ifndef OT_FEATURE_STATIC_DISPATCH
+#   define OT_FEATURE_STATIC_DISPATCH   DISABLED
+#endif
+
+
+
 /// Intra-Word Addressing: 
 /// Using these addressing constants in the extended type unions ensures that
 /// the code is portable across little and big endian architectures.
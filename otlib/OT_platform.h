@@ -70,6 +70,31 @@ void platform_disable_interrupts();
 void platform_enable_interrupts();
 
 
+/** @brief Enters a low power mode from the platform's low power mode table
+  * @param mode         (ot_u8) mode number, 0 to PLATFORM_LPM_MODES-1
+  * @retval None
+  * @ingroup Platform
+  * @sa sys_powerdown()
+  *
+  * Call it with interrupts on hold.  It enables them as it goes to sleep, and
+  * returns after the wakeup with them enabled.  Only platforms that define
+  * PLATFORM_LPM_MODES in their platform header implement it.
+  */
+void platform_enter_lpm(ot_u8 mode);
+
+
+/** @brief Sets the CPU performance level, for kernel clock scaling
+  * @param level        (ot_u8) SYS_PERF_LOW, SYS_PERF_MID or SYS_PERF_HIGH
+  * @retval None
+  * @ingroup Platform
+  * @sa OT_FEATURE(CLKSCALE) in system.h
+  *
+  * Changes the CPU clock only: GPTIM, the RTC and MPipe keep their rates.  It
+  * does nothing when the level is already set.
+  */
+void platform_set_perf(ot_u8 level);
+
+
 /** @brief The function that pauses OpenTag
   * @param None
   * @retval None
@@ -301,6 +326,11 @@ void platform_init_memcpy();
 
 
 
+/** @brief Seeds the pseudo-random generator (see platform_prand_u8())
+  * @param seed         (ot_u16) device-unique seed, e.g. from the device ID
+  * @retval None
+  * @ingroup Platform
+  */
 void platform_init_prand(ot_u16 seed);
 
 
@@ -315,6 +345,32 @@ void platform_init_prand(ot_u16 seed);
 ot_u16 platform_get_gptim();
 
 
+/** @brief Gets a free-running counter value for timing kernel code
+  * @param None
+  * @retval ot_u32      current counter value
+  * @ingroup Platform
+  *
+  * Only required when OT_FEATURE(PROFILER) is ENABLED.  Cortex-M platforms 
+  * return the DWT cycle counter.  MSP430 platforms return GPTIM, which is much
+  * coarser but is always running while the kernel is.
+  *
+  * PLATFORM_CYCLES_HZ is the rate of this counter, and PLATFORM_CYCLES_MASK is
+  * its width: differences of two values must be taken modulo the mask.
+  */
+ot_u32 platform_get_cycles();
+
+#if defined(PLATFORM_POSIX)
+#   define PLATFORM_CYCLES_HZ       1000000000
+#   define PLATFORM_CYCLES_MASK     0xFFFFFFFF
+#elif defined(PLATFORM_GPTIM_CLK)
+#   define PLATFORM_CYCLES_HZ       PLATFORM_GPTIM_CLK
+#   define PLATFORM_CYCLES_MASK     0x0000FFFF
+#else
+#   define PLATFORM_CYCLES_HZ       PLATFORM_HSCLOCK_HZ
+#   define PLATFORM_CYCLES_MASK     0xFFFFFFFF
+#endif
+
+
 /** @brief Zeros GPTIM and sets it to interrupt when hitting the supplied value.
   * @param value        (ot_u16)Number of ticks before timeout & interrupt
   * @retval 
@@ -331,6 +387,109 @@ void platform_set_gptim(ot_u16 value);
 void platform_flush_gptim();
 
 
+/** Kernel Timer (KTIM) <BR>
+  * GPTIM is a 16 bit timer.  The kernel timer extends it to 32 bits: GPTIM
+  * runs freely and the platform counts its overflows, and the kernel deadline
+  * uses one compare, which is only loaded once the overflow count reaches the
+  * upper half of the deadline.  The overflow interrupt does nothing else, so a
+  * long sleep is not broken up by kernel runs at each wrap of GPTIM.
+  *
+  * platform_get_gptim(), platform_set_gptim() and platform_flush_gptim() work
+  * as before, but relative to a mark (the time of the last set or flush)
+  * instead of by zeroing the timer.
+  *
+  * GPTIM may count 2^PLATFORM_KTIM_SUBBITS sub-ticks per tick.  The mark only
+  * moves by whole ticks, so the sub-tick is carried from one kernel run to the
+  * next, and slots can be aligned to a sub-tick with platform_get_ktim().
+  */
+#ifndef PLATFORM_KTIM_SUBBITS
+#   define PLATFORM_KTIM_SUBBITS    0
+#endif
+
+/** @brief Gets the kernel timer, in sub-ticks since the mark
+  * @param None
+  * @retval ot_u32      ticks << PLATFORM_KTIM_SUBBITS, plus the sub-tick
+  * @ingroup Platform
+  */
+ot_u32 platform_get_ktim();
+
+
+/** @brief Moves the mark to now, and interrupts after the supplied ticks
+  * @param value        (ot_u32) Number of ticks before timeout & interrupt
+  * @retval None
+  * @ingroup Platform
+  *
+  * This is the 32 bit platform_set_gptim().  platform_ot_run() uses it with
+  * the return value of sys_event_manager().
+  */
+void platform_set_ktim(ot_u32 value);
+
+
+/** @brief Gets the free-running kernel timer count, for event timestamps
+  * @param None
+  * @retval ot_u32      count in sub-ticks (2^PLATFORM_KTIM_SUBBITS per tick)
+  * @ingroup Platform
+  *
+  * Unlike platform_get_ktim(), the count does not move with the mark, so a
+  * stamp taken in an ISR is still good after the kernel has run.  The radio
+  * drivers stamp sync detect and TX end with it (see rm2_stamp, radio.h).
+  * Differences are taken modulo 2^32: PLATFORM_STAMP_AGE() is the number of
+  * ticks since a stamp.
+  */
+ot_u32 platform_stamp();
+
+#define PLATFORM_STAMP_AGE(STAMP)   \
+    ((ot_int)((ot_u32)(platform_stamp() - (STAMP)) >> PLATFORM_KTIM_SUBBITS))
+
+
+
+/** Code in RAM <BR>
+  * OT_RAMCODE(FN) goes on the line before the definition of FN, and puts FN
+  * in the .ramcode section when PLATFORM_RAMCODE is enabled (see OT_config.h).
+  * Platforms that support it define it in their header; elsewhere it is empty.
+  */
+#ifndef OT_RAMCODE
+#   define OT_RAMCODE(FN)
+#endif
+
+
+
+/** Interrupt Nesting <BR>
+  * A long handler starts timing its radio hold-off with SYS_PROFILE_WAIT_START()
+  * (system.h), calls PLATFORM_ISR_NEST() once it has cleared its own flag, and
+  * PLATFORM_ISR_UNNEST() at its end.  With PLATFORM_ISR_NESTING (OT_config.h),
+  * the radio ISRs can preempt the code between them.  While a handler is
+  * nested, the other platform ISRs mask their own interrupt enables and return
+  * with the flags still set: PLATFORM_ISR_DEFER_DMA() does this for a DMA ISR.
+  * platform_isr_unnest() puts the enables back, and then they run.
+  *
+  * Platforms that support nesting (MSP430) define these in their header.  The
+  * defaults do no nesting, and end the hold-off at PLATFORM_ISR_UNNEST().
+  */
+#ifndef PLATFORM_ISR_NEST
+#   define PLATFORM_ISR_NEST()          do { } while(0)
+#   define PLATFORM_ISR_UNNEST()        SYS_PROFILE_WAIT_STOP()
+#   define PLATFORM_ISR_DEFER_DMA()     False
+#endif
+
+void platform_isr_nest();
+void platform_isr_unnest();
+ot_bool platform_isr_defer_dma();
+
+
+
+/** Stack Size <BR>
+  * PLATFORM_STACK_SIZE is the number of bytes of stack below the frame of
+  * sys_stack_paint(), which platform_poweron() calls first, and which fills
+  * them with a pattern (see OT_FEATURE_MEMSTATS in system.h).  It must be a
+  * bit less than the stack that the linker file reserves, or the paint goes
+  * over other RAM.  Zero leaves the stack alone.
+  */
+#ifndef PLATFORM_STACK_SIZE
+#   define PLATFORM_STACK_SIZE      0
+#endif
+
+
 
 void platform_run_watchdog();
 
@@ -400,6 +559,50 @@ void platform_trig2_toggle();
 
 
 
+#if (MCU_FEATURE(AES128) == ENABLED)
+/** @brief Hardware AES128 (ECB) on one or more 16 byte blocks
+  * @param  input       (ot_u32*) input blocks, word-aligned
+  * @param  output      (ot_u32*) output blocks (may be the same as input)
+  * @param  key         (ot_u32*) 128 bit key, as stored (not expanded)
+  * @param  blocks      (ot_int) number of 16 byte blocks
+  * @retval None
+  * @ingroup Platform
+  *
+  * These are the hardware backend to crypto_aes128 (AES_USEHW).  The engine
+  * keeps the last key it was given, so a key that matches it is not loaded
+  * again, and the decryption key is not derived again.  Encrypt and decrypt
+  * block until done.  platform_aes_start() returns once the job is running
+  * and calls "callback" from interrupt context, with the number of blocks done
+  * (or -1 on engine error), when it finishes.  Do not touch either buffer
+  * until then, or until platform_aes_busy() returns False.
+  */
+    void platform_aes_encrypt(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks);
+    void platform_aes_decrypt(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks);
+    void platform_aes_start(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks,
+                            ot_bool decrypt, ot_sig callback );
+    ot_bool platform_aes_busy();
+#endif
+
+
+
+#if (OT_FEATURE(SENSORS) == ENABLED)
+/** @brief Sensor ADC bursts, for the sensor pipeline (see external.h)
+  * @param  buffer      (ot_u16*) output: round 0 of all channels, then round 1...
+  * @param  channels    (ot_u8) number of channels
+  * @param  rounds      (ot_u8) conversions of each channel
+  * @retval ot_bool     False if the ADC is in use or the burst is too long
+  * @ingroup Platform
+  *
+  * The ADC input of each channel is set by the platform (board header).  The 
+  * burst runs in the background and the conversions are moved to buffer by
+  * DMA.  Do not touch buffer until platform_adc_busy() returns False.
+  */
+    ot_bool platform_adc_start(ot_u16* buffer, ot_u8 channels, ot_u8 rounds);
+    ot_bool platform_adc_busy();
+#endif
+
+
+
 
 /** @brief A random number generator.  Used within OpenTag.
   * @param rand_out     (ot_u8*) Pointer to the output random data
@@ -413,6 +616,10 @@ void platform_trig2_toggle();
   * it should be much faster, and one way to make it faster is to apply a zener 
   * diode, which guarantees more bits of noise per acquisition.  A good zener
   * circuit and a 200ksps 12 bit ADC can therefore provide 5us/byte.
+  *
+  * Platforms may decouple the draw from the sampling by keeping a pool of
+  * conditioned entropy that is refilled in the background (CC430 does this
+  * with an ADC12 -> DMA harvest, see platform_CC430.c).
   */
 void platform_rand(ot_u8* rand_out, ot_int bytes_out);
 
@@ -423,7 +630,10 @@ void platform_rand(ot_u8* rand_out, ot_int bytes_out);
   * @retval ot_u8       8 bit pseudo random number
   * @ingroup Platform
   *
-  * A quickly generated 8 bit random number, not recommended for crypto.
+  * A quickly generated 8 bit random number, not recommended for crypto.  It
+  * is implemented for all platforms by otlib/prand.c (32 bit xorshift, which
+  * is reseeded from platform_rand() now and then), and it uses no peripheral.
+  * Kernel code uses the PRAND_U8() macro from prand.h directly.
   */
 ot_u8 platform_prand_u8();
 
@@ -434,7 +644,8 @@ ot_u8 platform_prand_u8();
   * @retval ot_u16       16 bit pseudo random number
   * @ingroup Platform
   *
-  * A quickly generated 16 bit random number, not recommended for crypto.
+  * A quickly generated 16 bit random number, not recommended for crypto.  See
+  * platform_prand_u8().
   */
 ot_u16 platform_prand_u16();
 
@@ -446,20 +657,75 @@ ot_u16 platform_prand_u16();
   * @param  length      (ot_int) number of bytes to transfer/copy
   * @retval None
   * @ingroup Platform
+  *
+  * If MCU_FEATURE(MEMCPYDMA) is ENABLED, copies of MEMCPY_DMA_THRESHOLD bytes
+  * or more use the DMA, and shorter ones use the CPU.  The threshold may be
+  * set in the board config header.
   */
 void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length);
 
 
+/** @brief platform_memcpy() for 16 bit aligned data
+  * @param  dest        (ot_u16*) destination memory address, aligned
+  * @param  src         (ot_u16*) source memory address, aligned
+  * @param  length      (ot_int) number of 16 bit words to copy
+  * @retval None
+  * @ingroup Platform
+  */
+void platform_memcpy_2(ot_u16* dest, ot_u16* src, ot_int length);
+
+
+/** @brief Non-blocking memcpy
+  * @param  dest        (ot_u8*) destination memory address
+  * @param  src         (ot_u8*) source memory address
+  * @param  length      (ot_int) number of bytes to transfer/copy
+  * @retval None
+  * @ingroup Platform
+  *
+  * On platforms where the DMA can run beside the CPU, this returns as soon as
+  * the DMA is started.  Do not touch either buffer until platform_memcpy_busy()
+  * returns False (or platform_memcpy_wait() returns).  Other platforms just do
+  * a blocking copy.  Other platform memcpy calls wait for it automatically.
+  */
+void platform_memcpy_async(ot_u8* dest, ot_u8* src, ot_int length);
+
+
+/** @brief Returns True while a platform_memcpy_async() copy is running
+  * @param  None
+  * @retval ot_bool     True while copying
+  * @ingroup Platform
+  */
+ot_bool platform_memcpy_busy();
+
+
+/** @brief Blocks until a platform_memcpy_async() copy is done
+  * @param  None
+  * @retval None
+  * @ingroup Platform
+  */
+void platform_memcpy_wait();
+
+
+/** @brief platform-specific memset
+  * @param  dest        (ot_u8*) destination memory address
+  * @param  value       (ot_u8) byte value to write
+  * @param  length      (ot_int) number of bytes to write
+  * @retval None
+  * @ingroup Platform
+  */
+void platform_memset(ot_u8* dest, ot_u8 value, ot_int length);
 
 
-/** @brief Inserts a delay time via a SysTick mechanism
+
+
+/** @brief Inserts a delay time via a timer
   * @param n        (ot_uint) Number of ticks before resuming.
   * @retval None
   * @ingroup Platform
   *
-  * The "systick" is platform dependent and not always implemented
+  * The timer is platform dependent and not always implemented
   *
-  * @note the behavior of the system during SysTick wait state is implementation
+  * @note the behavior of the system during the wait is implementation
   * dependent.  Typically, it uses the lowest-power sleep mode that allows the
   * SRAM to stay alive.
   */
@@ -468,24 +734,122 @@ void platform_delay(ot_uint n);
 
 
 
-/** @brief Uses busywait loop to delay the processor for number of milliseconds
+/** @brief Delays the processor for number of milliseconds
   * @param n : Number of milliseconds to delay, up to 65535 
   * @retval None
   * @ingroup Platform
+  *
+  * On platforms that have PLATFORM_DELAY_SLEEP_US, delays at least that long
+  * sleep on a timer compare, and shorter ones are a busywait loop.  Drivers 
+  * use it for oscillator and synthesizer settling times.
   */
 void platform_swdelay_ms(ot_uint n);
 
 
 
 
-/** @brief Uses busywait loop to delay the processor for number of microseconds
+/** @brief Delays the processor for number of microseconds
   * @param n : Number of microseconds to delay, up to 65535
   * @retval None
   * @ingroup Platform
+  *
+  * Same as platform_swdelay_ms(), for short waits.
   */
 void platform_swdelay_us(ot_uint n);
 
 
 
 
+/** Firmware Banks (OT_FEATURE(OTA))
+  * ========================================================================<BR>
+  * Only required when OT_FEATURE(OTA) is ENABLED.  Bank 0 is the running
+  * firmware, and bank 1 is the update bank, which the new firmware is written
+  * into.  Where the banks are, and how the bootloader swaps them, is up to
+  * the platform and its linker layout.
+  */
+
+/** @brief Reads bytes from a firmware bank
+  * @param bank         (ot_u8) 0 = running firmware, 1 = update bank
+  * @param addr         (ot_u32) byte offset into the bank
+  * @param data         (ot_u8*) output
+  * @param length       (ot_uint) number of bytes
+  * @retval ot_u8       0 on success, non-zero if the bytes are out of the bank
+  * @ingroup Platform
+  */
+ot_u8 platform_fw_read(ot_u8 bank, ot_u32 addr, ot_u8* data, ot_uint length);
+
+/** @brief Writes bytes into the update bank
+  * @param addr         (ot_u32) byte offset into the bank
+  * @param data         (ot_u8*) bytes to write
+  * @param length       (ot_uint) number of bytes
+  * @retval ot_u8       0 on success, non-zero on a fault
+  * @ingroup Platform
+  *
+  * The bank is written in order from 0, so the platform can erase each page
+  * when the first write reaches it.
+  */
+ot_u8 platform_fw_write(ot_u32 addr, ot_u8* data, ot_uint length);
+
+/** @brief Hands the update bank to the bootloader
+  * @param length       (ot_u32) bytes of new firmware in the update bank
+  * @retval None
+  * @ingroup Platform
+  *
+  * On most platforms this marks the update bank and resets, so it does not
+  * return.
+  */
+void platform_fw_commit(ot_u32 length);
+
+
+
+
+/** Serial Flash (OT_FEATURE(VSFLASH))
+  * ========================================================================<BR>
+  * Only required when OT_FEATURE(VSFLASH) is ENABLED.  The SPI driver of an
+  * external NOR flash, used by vsflash.c.  The geometry of the chip is given
+  * by SFLASH_PAGE_SIZE, SFLASH_SECTOR_SIZE and SFLASH_NUM_SECTORS.  Program
+  * and erase only start the operation on the chip, and the driver reports it
+  * in platform_sflash_busy() until the chip is done.
+  */
+
+/** @brief Reads bytes from the serial flash
+  * @param addr         (ot_u32) first address
+  * @param data         (ot_u8*) output
+  * @param length       (ot_uint) number of bytes
+  * @retval ot_u8       0 on success, non-zero on a fault
+  * @ingroup Platform
+  *
+  * The chip is not busy when it is called.
+  */
+ot_u8 platform_sflash_read(ot_u32 addr, ot_u8* data, ot_uint length);
+
+/** @brief Sends a page-program burst to the serial flash
+  * @param addr         (ot_u32) first address
+  * @param data         (ot_u8*) bytes to program
+  * @param length       (ot_uint) number of bytes, all in one page
+  * @retval ot_u8       0 on success, non-zero on a fault
+  * @ingroup Platform
+  *
+  * The chip is not busy when it is called.  The burst may go out by DMA, but
+  * data must be sent by the time it returns.
+  */
+ot_u8 platform_sflash_program(ot_u32 addr, ot_u8* data, ot_uint length);
+
+/** @brief Starts the erase of a sector of the serial flash
+  * @param addr         (ot_u32) first address of the sector
+  * @retval ot_u8       0 on success, non-zero on a fault
+  * @ingroup Platform
+  */
+ot_u8 platform_sflash_erase(ot_u32 addr);
+
+/** @brief Returns True while the serial flash programs or erases
+  * @param none
+  * @retval ot_bool     True if the chip is busy
+  * @ingroup Platform
+  */
+ot_bool platform_sflash_busy(void);
+
+
+
+
 #endif
@@ -99,16 +99,27 @@ typedef unsigned short      ot_u16;
     
 /** @typedef ot_long
   * equivalent to @c signed @c long.  A word in OpenTag is ALWAYS 32 bits.
+  * On LP64 hosts (e.g. the POSIX platform) long is 64 bits, so int is used.
   */
+#if defined(__LP64__)
+typedef signed int          ot_long;
+typedef signed int          ot_s32;
+#else
 typedef signed long         ot_long;
 typedef signed long         ot_s32;
+#endif
     
     
 /** @typedef ot_ulong
   * equivalent to @c unsigned @c long.  A word in OpenTag is ALWAYS 32 bits.
   */
+#if defined(__LP64__)
+typedef unsigned int        ot_ulong;
+typedef unsigned int        ot_u32;
+#else
 typedef unsigned long       ot_ulong;
 typedef unsigned long       ot_u32;
+#endif
     
         
 /** @typedef Twobytes
@@ -35,39 +35,237 @@ void otutils_sigv_null(void* a)             { }
 
 
 #ifndef EXTF_otutils_calc_timeout
+/// Exp-Mantissa expansion, from a table: (mantissa+1) * 2^(2*exp), where the
+/// multiply is a SW multiply or a shift loop on MSP430
+static const ot_u16 otutils_timeout_table[128] = {
+        0,     1,     2,     3,     4,     5,     6,     7,
+        8,     9,    10,    11,    12,    13,    14,    15,
+        4,     8,    12,    16,    20,    24,    28,    32,
+       36,    40,    44,    48,    52,    56,    60,    64,
+       16,    32,    48,    64,    80,    96,   112,   128,
+      144,   160,   176,   192,   208,   224,   240,   256,
+       64,   128,   192,   256,   320,   384,   448,   512,
+      576,   640,   704,   768,   832,   896,   960,  1024,
+      256,   512,   768,  1024,  1280,  1536,  1792,  2048,
+     2304,  2560,  2816,  3072,  3328,  3584,  3840,  4096,
+     1024,  2048,  3072,  4096,  5120,  6144,  7168,  8192,
+     9216, 10240, 11264, 12288, 13312, 14336, 15360, 16384,
+     4096,  8192, 12288, 16384, 20480, 24576, 28672, 32768,
+    36864, 40960, 45056, 49152, 53248, 57344, 61440,     0,
+    16384, 32768, 49152,     0, 16384, 32768, 49152,     0,
+    16384, 32768, 49152,     0, 16384, 32768, 49152,     0
+};
+
 ot_u16 otutils_calc_timeout(ot_u8 timeout_code) {
-    ot_u8 shift;
-    ot_u16 timeout;
-    shift       = (timeout_code >> 3) & 0x0E;
-    timeout     = (timeout_code & 0x0F);
-    timeout    += (shift != 0);
-    timeout    *= ((ot_u16)1 << shift);
-    
-    return timeout;
+    return otutils_timeout_table[timeout_code & 0x7F];
 }
 #endif
 
 
 
-// Exp-Mantissa expansion for common 7-bit field
+// Exp-Mantissa encoding for common 7-bit field
 #ifndef EXTF_otutils_encode_timeout
 ot_u8 otutils_encode_timeout(ot_u16 timeout_ticks) {
-    ot_u8 exp;
+/// The exponent is found by comparing with the top of the range of each one
+/// (compares that set a flag, not a loop).  Only the odd exponents are used,
+/// and the mantissa is rounded down, same as always.
+    ot_u8 step;
     
     if (timeout_ticks < 16) {
         return (ot_u8)timeout_ticks;
     }
     
-    exp = 1;
-    timeout_ticks >>= 2;
+    step    = (timeout_ticks > 67) + (timeout_ticks > 1087) + (timeout_ticks > 17407);
+    timeout_ticks >>= (step << 2) + 2;
     
-    while (timeout_ticks > 16) {
-        exp += 2;
-        timeout_ticks >>= 4;
+    return (ot_u8)((((step << 1) + 1) << 4) + timeout_ticks - 1);
+}
+#endif
+
+
+
+// Multiply-shift range reduction
+#ifndef EXTF_otutils_range16
+ot_u16 otutils_range16(ot_u16 random, ot_u16 range) {
+    return (ot_u16)(((ot_u32)random * (ot_u32)range) >> 16);
+}
+#endif
+
+
+
+// Byte packing, greedy: at each byte the token that saves the most is taken (a
+// run, a copy or deltas), and bytes that none of them saves anything on are
+// gathered into literals.  When packing in place, a copy only reaches back to
+// the bytes that are not packed over yet.
+#ifndef EXTF_otutils_pack
+static ot_u8* otutils_putliteral(ot_u8* dst, ot_u8* literal, ot_int count) {
+    if (count > 0) {
+        *dst++ = (ot_u8)(count - 1);
+        while (count-- > 0) {
+            *dst++ = *literal++;
+        }
     }
-    timeout_ticks--;
-    
-    return (exp << 4) + (ot_u8)timeout_ticks;
+    return dst;
+}
+
+ot_int otutils_pack(ot_u8* dst, ot_u8* src, ot_int length) {
+    ot_u8*  dst_start   = dst;
+    ot_int  literal     = 0;
+    ot_int  i           = 0;
+    ot_u8   last        = 0;
+
+    while (i < length) {
+        ot_u8*  end;
+        ot_int  max, run, copy, delta, distance;
+        ot_int  gain, lo, p, k;
+        ot_u8   token;
+        ot_u8   prev;
+
+        max = length - i;
+        if (max > 66) {
+            max = 66;
+        }
+
+        /// Run of one byte
+        for (run=1; (run < max) && (src[i+run] == src[i]); run++);
+
+        /// Copy: the lowest byte to copy from is one that the literals and
+        /// tokens up to here are not packed over
+        end = dst + ((i > literal) ? (i - literal + 1) : 0);
+        lo  = (i > 256) ? (i - 256) : 0;
+        if ((end > (src + lo)) && (end <= (src + i))) {
+            lo = (ot_int)(end - src);
+        }
+        copy        = 0;
+        distance    = 0;
+        for (p=i-1; p>=lo; p--) {
+            for (k=0; (k < max) && (src[p+k] == src[i+k]); k++);
+            if (k > copy) {
+                copy        = k;
+                distance    = i - p;
+                if (k == max) break;
+            }
+        }
+
+        /// Deltas of -8 to 7 from the byte before
+        prev = last;
+        for (delta=0; (delta < max) && (delta < 65); delta++) {
+            ot_s8 d = (ot_s8)(src[i+delta] - prev);
+            if ((d < -8) || (d > 7)) break;
+            prev = src[i+delta];
+        }
+
+        /// Take the token that saves the most, or keep the byte as a literal
+        gain    = 0;
+        token   = 0;
+        if ((run - 2) > gain) {
+            gain    = run - 2;
+            token   = 1;
+        }
+        if ((copy - 2) > gain) {
+            gain    = copy - 2;
+            token   = 3;
+        }
+        if ((delta - 1 - ((delta+1) >> 1)) > gain) {
+            token   = 2;
+        }
+
+        if (token == 0) {
+            last = src[i++];
+            if ((i - literal) == 64) {
+                dst     = otutils_putliteral(dst, &src[literal], 64);
+                literal = i;
+            }
+            continue;
+        }
+
+        dst = otutils_putliteral(dst, &src[literal], i - literal);
+        if (token == 1) {
+            *dst++  = 0x40 | (ot_u8)(run - 3);
+            *dst++  = src[i];
+            i      += run;
+        }
+        else if (token == 3) {
+            *dst++  = 0xC0 | (ot_u8)(copy - 3);
+            *dst++  = (ot_u8)(distance - 1);
+            i      += copy;
+        }
+        else {
+            *dst++  = 0x80 | (ot_u8)(delta - 2);
+            for (p=0; p<delta; p++) {
+                ot_u8 nibble = (ot_u8)(src[i] - last) & 0x0F;
+                last = src[i++];
+                if (p & 1)  dst[-1] |= nibble;
+                else        *dst++   = nibble << 4;
+            }
+        }
+        last    = src[i-1];
+        literal = i;
+    }
+
+    dst = otutils_putliteral(dst, &src[literal], i - literal);
+    return (ot_int)(dst - dst_start);
+}
+#endif
+
+
+
+// Byte unpacking: tokens are checked against the end of the packed data and
+// against the limit before anything is written.
+#ifndef EXTF_otutils_unpack
+ot_int otutils_unpack(ot_u8* dst, ot_u8* src, ot_int length, ot_int limit) {
+    ot_u8*  end     = src + length;
+    ot_int  output  = 0;
+    ot_u8   last    = 0;
+
+    while (src < end) {
+        ot_u8   token   = *src++;
+        ot_int  count   = token & 0x3F;
+        ot_int  need;
+        ot_int  i;
+
+        switch (token >> 6) {
+            case 0: count  += 1;    need = count;               break;
+            case 2: count  += 2;    need = (count + 1) >> 1;    break;
+            default: count += 3;    need = 1;                   break;
+        }
+        if (((src + need) > end) || ((output + count) > limit)) {
+            return -1;
+        }
+        if ((dst < src) && ((dst + output + count) > (src + need))) {
+            return -1;
+        }
+
+        switch (token >> 6) {
+            case 0: for (i=0; i<count; i++) dst[output+i] = *src++;
+                    break;
+
+            case 1: for (i=0; i<count; i++) dst[output+i] = *src;
+                    src++;
+                    break;
+
+            case 2: for (i=0; i<count; i++) {
+                        ot_u8 nibble = (i & 1) ? (*src++ & 0x0F) : (*src >> 4);
+                        last = last + (ot_u8)(((ot_s8)(nibble << 4)) >> 4);
+                        dst[output+i] = last;
+                    }
+                    src += (count & 1);
+                    break;
+
+            case 3: i = (ot_int)*src++ + 1;
+                    if (i > output) {
+                        return -1;
+                    }
+                    for (i=output-i; count>0; count--, i++, output++) {
+                        dst[output] = dst[i];
+                    }
+                    break;
+        }
+        output += count;
+        last    = dst[output-1];
+    }
+
+    return output;
 }
 #endif
 
@@ -75,54 +273,65 @@ ot_u8 otutils_encode_timeout(ot_u16 timeout_ticks) {
 
 
 
-// Binary data to hex-text
+// Binary data to hex-text, from a 16 byte table (no compare per nibble).
+// dst is not always aligned, and MSP430/Cortex-M0 fault on unaligned word 
+// stores, so the two characters are stored as bytes.
 #ifndef EXTF_otutils_bin2hex
+static const ot_u8 otutils_hexdigit[16] = { 
+    '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' 
+};
+
 ot_int otutils_bin2hex(ot_u8* src, ot_u8* dst, ot_int size) {
     ot_u8* src_end;
-    ot_u8* dst_start;
-    src_end     = src + size;
-    dst_start   = dst;
+    src_end = src + size;
     
     while (src != src_end) {
         ot_u8 scratch;
-        //*dst++      = ' ';          ///@todo Don't use this space after OTcom gets updated
-        scratch     = *src >> 4;
-        scratch    += (scratch >= 10) ? ('A'-10) : '0';
-        *dst++      = scratch;
-        scratch     = *src++ & 0x0F;
-        scratch    += (scratch >= 10) ? ('A'-10) : '0';
-        *dst++      = scratch;
+        scratch = *src++;
+        dst[0]  = otutils_hexdigit[scratch >> 4];
+        dst[1]  = otutils_hexdigit[scratch & 0x0F];
+        dst    += 2;
     }
     
-    return (ot_int)(dst - dst_start);
+    return (size << 1);
 }
 #endif
 
 
+
+// ot_int type to decimal text, by repeated subtraction of the powers of ten 
+// (at most 9 per digit), so there is no divide or multiply.  The magnitude is
+// taken unsigned, so -32768 is written right.
 #ifndef EXTF_otutils_int2dec
+static const ot_u16 otutils_pow10[4] = { 10000, 1000, 100, 10 };
+
 ot_int otutils_int2dec(ot_u8* dst, ot_int data) {
     ot_u8*  dst_start;
+    ot_u16  value;
     ot_bool force;
-    ot_int  divider;
-    ot_int  digit;
-
-    dst_start = dst;
-
-    *dst++  = ' ';  //delimiter
+    ot_int  i;
 
+    dst_start   = dst;
+    *dst++      = ' ';  //delimiter
+    value       = (ot_u16)data;
+    
     if (data < 0) {
-        data    = 0 - data;
+        value   = (ot_u16)0 - value;
         *dst++  = '-';
     }
 
-    for (divider=10000, force=False; divider!=0; divider/=10) {
-        digit = (data/divider);
-        if (digit | force) {
+    for (i=0, force=False; i<4; i++) {
+        ot_u8 digit = '0';
+        while (value >= otutils_pow10[i]) {
+            value  -= otutils_pow10[i];
+            digit++;
+        }
+        if ((digit != '0') | force) {
             force   = True;
-            *dst++  = digit + '0';
-            data   -= digit*divider;
+            *dst++  = digit;
         }
     }
+    *dst++ = (ot_u8)value + '0';
 
     return (ot_int)(dst - dst_start);
 }
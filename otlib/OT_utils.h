@@ -47,6 +47,28 @@ ot_u16 otutils_calc_timeout(ot_u8 timeout_code);
 ot_u8 otutils_encode_timeout(ot_u16 timeout_ticks);
 
 
+// Maps a 16 bit random number to [0, range) with a multiply and shift (the
+// top 16 bits of random*range), so there is no divide as with modulo
+ot_u16 otutils_range16(ot_u16 random, ot_u16 range);
+
+
+// Byte packing: tokens of one control byte, with the low six bits as a count
+//   00nnnnnn               n+1 literal bytes follow
+//   01nnnnnn [byte]        byte, n+3 times
+//   10nnnnnn [nibbles]     n+2 bytes, each the last one plus a signed nibble
+//                          (-8 to 7), two nibbles per byte, high one first
+//   11nnnnnn [distance-1]  n+3 bytes copied from up to 256 bytes back
+// Packed data is never more than OTUTILS_PACKMARGIN(length) bytes longer than
+// the input.  dst may be the same buffer, that many bytes before src.
+#define OTUTILS_PACKMARGIN(LEN) ((((LEN)+63) >> 6) + 1)
+ot_int otutils_pack(ot_u8* dst, ot_u8* src, ot_int length);
+
+// Unpacks length bytes of packed data, to no more than limit bytes.  Returns
+// the unpacked length, or -1 if the data is not good.  If dst is in the same
+// buffer, before src, it must not catch up with the data still to be read.
+ot_int otutils_unpack(ot_u8* dst, ot_u8* src, ot_int length, ot_int limit);
+
+
 // Binary data to hex-text
 ot_int otutils_bin2hex(ot_u8* src, ot_u8* dst, ot_int size);
 
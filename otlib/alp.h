@@ -65,6 +65,189 @@ typedef struct {
     void*       bookmark;           // Internal use only (private)
 } alp_record;
 
+/// On an output record, bookmark is normally ignored.  A caller that can send
+/// a payload from where it is (NDEF with MPIPE_GATHER) sets it to out_q before
+/// alp_proc().  The processor may then write no payload to out_q, and set 
+/// bookmark to its payload, which must stay valid until the response is sent.
+
+
+
+/** ALP Directive Handler
+  * All ALP processors share this signature, so they can be vectored through
+  * the directive table in alp_main.c.  Handlers may be registered at runtime
+  * (see alp_register()) for ID's that do not have a built-in processor.
+  */
+typedef void (*alp_handler)(alp_record*, alp_record*, Queue*, Queue*, id_tmpl*);
+
+
+
+/** ALP Directive ID's
+  * Built-in ID's have fixed values, regardless of which features are compiled
+  * in.  A disabled feature simply maps to the null processor.
+  */
+#define ALP_ID_NULL         0x00
+#define ALP_ID_FILEDATA     0x01
+#define ALP_ID_SENSOR       0x02
+#define ALP_ID_SECURITY     0x03
+#define ALP_ID_LOGGER       0x04
+#define ALP_ID_DASHFORTH    0x05
+#define ALP_ID_MEMSTATS     0x06
+#define ALP_ID_INVENTORY    0x07
+#define ALP_ID_OTA          0x08
+#define ALP_ID_VLLOG        0x09
+#define ALP_ID_API_SESSION  0x80
+#define ALP_ID_API_SYSTEM   0x81
+#define ALP_ID_API_QUERY    0x82
+
+
+/** ALP-API Query CMD's
+  * The Query CMD is the M2QP function index + 1, in the order of the C-API 
+  * functions vectored by alp_proc_api_query().  Bit 7 is the response bit.
+  */
+#define ALP_QUERY_COMMAND       1
+#define ALP_QUERY_DIALOG        2
+#define ALP_QUERY_QUERY         3
+#define ALP_QUERY_ACK           4
+#define ALP_QUERY_ERROR         5
+#define ALP_QUERY_ISFCOMP       6
+#define ALP_QUERY_ISFCALL       7
+#define ALP_QUERY_ISFRETURN     8
+#define ALP_QUERY_REQDS         9
+#define ALP_QUERY_PROPDS        10
+#define ALP_QUERY_SHELL         11
+#define ALP_QUERY_FUNCTIONS     11
+
+
+/** Streaming file reads over NDEF: see alp_filedata_stream() */
+#ifndef ALP_FILE_STREAM
+#   define ALP_FILE_STREAM  DISABLED
+#endif
+
+
+/** Number of runtime-registered ALP handlers (requires ALPEXT) */
+#ifndef ALP_EXT_SLOTS
+#   define ALP_EXT_SLOTS    4
+#endif
+
+
+
+
+
+#if ((OT_FEATURE(CLIENT) == ENABLED) && (OT_FEATURE(ALP) == ENABLED))
+
+/** ALP Client Message
+  * A client builds ALP-API records into a Queue that it allocates.  Fields are
+  * written in place, and any field that does not fit clears status, so the
+  * builder calls can be chained and checked once with alp_end_msg().
+  *
+  * q           Queue holding the message (emptied by alp_new_msg())
+  * record      Header of the open record (NULL if none is open)
+  * script      Item count of an open dialog script (NULL if none is open)
+  * gap         Bytes left free after each record (e.g. the MPipe footer)
+  * status      False after any field did not fit
+  */
+typedef struct {
+    Queue*  q;
+    ot_u8*  record;
+    ot_u8*  script;
+    ot_u8   gap;
+    ot_bool status;
+} alp_msg;
+
+
+/** @brief  Starts a new message in a Queue
+  * @param  msg         (alp_msg*) message to start
+  * @param  q           (Queue*) preallocated Queue for the message
+  * @param  gap         (ot_u8) bytes to leave free after each record
+  * @retval None
+  * @ingroup ALP
+  */
+void alp_new_msg(alp_msg* msg, Queue* q, ot_u8 gap);
+
+/** @brief  Closes the open record and opens a new one
+  * @param  msg         (alp_msg*) message being built
+  * @param  dir_id      (ot_u8) ALP ID of the new record
+  * @param  dir_cmd     (ot_u8) ALP CMD of the new record
+  * @retval ot_bool     False if the Queue has no room for the record
+  * @ingroup ALP
+  */
+ot_bool alp_new_record(alp_msg* msg, ot_u8 dir_id, ot_u8 dir_cmd);
+
+/** @brief  Reserves payload bytes in the open record, for direct writing
+  * @param  msg         (alp_msg*) message being built
+  * @param  length      (ot_int) number of bytes
+  * @retval ot_u8*      Start of the bytes, or NULL if they do not fit
+  * @ingroup ALP
+  */
+ot_u8* alp_reserve(alp_msg* msg, ot_int length);
+
+/** @brief  Closes the last record and ends the message
+  * @param  msg         (alp_msg*) message being built
+  * @retval ot_int      Bytes in the Queue, or -1 if the message is bad
+  * @ingroup ALP
+  *
+  * Each record is the 6 byte header, the payload, and the gap.  Records with
+  * a gap may be sent one at a time, e.g. with mpipe_txndef().
+  */
+ot_int alp_end_msg(alp_msg* msg);
+
+
+/** Template writers: same layout as the breakdown in alp_api_server.c */
+void alp_put_u8(alp_msg* msg, ot_u8 value);
+void alp_put_u16(alp_msg* msg, ot_u16 value);
+void alp_put_string(alp_msg* msg, ot_u8* data, ot_int length);
+void alp_put_queue(alp_msg* msg, Queue* data);
+void alp_put_session_tmpl(alp_msg* msg, session_tmpl* session);
+void alp_put_command_tmpl(alp_msg* msg, command_tmpl* command);
+void alp_put_id_tmpl(alp_msg* msg, id_tmpl* id);
+void alp_put_routing_tmpl(alp_msg* msg, routing_tmpl* routing);
+void alp_put_dialog_tmpl(alp_msg* msg, dialog_tmpl* dialog);
+void alp_put_query_tmpl(alp_msg* msg, query_tmpl* query);
+void alp_put_ack_tmpl(alp_msg* msg, ack_tmpl* ack);
+void alp_put_error_tmpl(alp_msg* msg, error_tmpl* error);
+void alp_put_shell_tmpl(alp_msg* msg, shell_tmpl* shell);
+void alp_put_isfcomp_tmpl(alp_msg* msg, isfcomp_tmpl* isfcomp);
+void alp_put_isfcall_tmpl(alp_msg* msg, isfcall_tmpl* isfcall);
+
+
+/** ALP-API record builders
+  * Each opens one record for the C-API function of the same name, with the 
+  * response bit set when respond is True, and returns msg->status.
+  */
+ot_bool alp_api_sysinit(alp_msg* msg, ot_bool respond);
+ot_bool alp_api_new_session(alp_msg* msg, ot_bool respond, session_tmpl* session);
+ot_bool alp_api_open_request(alp_msg* msg, ot_bool respond, addr_type addr, routing_tmpl* routing);
+ot_bool alp_api_close_request(alp_msg* msg, ot_bool respond);
+ot_bool alp_api_start_flood(alp_msg* msg, ot_bool respond, ot_u16 duration);
+ot_bool alp_api_start_dialog(alp_msg* msg, ot_bool respond);
+ot_bool alp_api_session_number(alp_msg* msg, ot_bool respond);
+ot_bool alp_api_flush_sessions(alp_msg* msg, ot_bool respond);
+ot_bool alp_api_is_session_blocked(alp_msg* msg, ot_bool respond, ot_u8 chan_id);
+
+/** @brief  Opens a Query API record for one M2QP template
+  * @param  msg         (alp_msg*) message being built
+  * @param  respond     (ot_bool) True to request a response
+  * @param  query_cmd   (ot_u8) ALP_QUERY_... value
+  * @param  tmpl        (void*) template for the function (Queue* for DS)
+  * @retval ot_bool     msg->status
+  * @ingroup ALP
+  */
+ot_bool alp_api_query(alp_msg* msg, ot_bool respond, ot_u8 query_cmd, void* tmpl);
+
+/** @brief  Opens a dialog script record (open, puts, close & start dialog)
+  * @param  msg         (alp_msg*) message being built
+  * @param  respond     (ot_bool) True to request a response
+  * @param  addr        (addr_type) addressing of the request
+  * @param  routing     (routing_tmpl*) routing (and dlog target for unicast)
+  * @retval ot_bool     msg->status
+  * @ingroup ALP
+  *
+  * Add the puts with alp_api_script_item(), before the next record is opened.
+  */
+ot_bool alp_api_dialog_script(alp_msg* msg, ot_bool respond, addr_type addr, routing_tmpl* routing);
+ot_bool alp_api_script_item(alp_msg* msg, ot_u8 query_cmd, void* tmpl);
+
+#endif
 
 
 
@@ -114,6 +297,24 @@ void alp_proc(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q
 
 
 
+#if (OT_FEATURE(ALPEXT) == ENABLED)
+/** @brief  Register a handler for an ALP directive ID at runtime
+  * @param  dir_id      (ot_u8) ALP directive ID to handle
+  * @param  proc        (alp_handler) handler function, or NULL to unregister
+  * @retval ot_bool     True on success, False if no slot is free or if dir_id
+  *                     already has a built-in processor
+  * @ingroup ALP
+  *
+  * Registered handlers are checked before otapi_alpext_proc(), which remains
+  * the catch-all for ID's that are neither built-in nor registered.  ID's of
+  * disabled built-in features (e.g. Sensors when SENSORS is DISABLED) may be
+  * registered.
+  */
+ot_bool alp_register(ot_u8 dir_id, alp_handler proc);
+#endif
+
+
+
 
 
 /** @note Subprotocol processing functions
@@ -135,9 +336,37 @@ void alp_proc_filedata(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Que
 
 
 
+#if (ALP_FILE_STREAM == ENABLED)
+/** @brief  Continue a streaming file read into the output queue
+  * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
+  * @param  out_q       (Queue*) output queue for the continuation payload
+  * @retval ot_int      bytes written to out_q, or -1 if no stream is open
+  * @ingroup ALP
+  *
+  * When a root user (wireline) reads file data, and the last read in the 
+  * record does not fit in out_q, the file is kept open instead of rewriting
+  * the request for a follow-up.  The response is marked with the chunk flag,
+  * and each call to this function writes the next chunk of raw file data.
+  * out_rec is loaded with the response ID & CMD, and the chunk flag is set 
+  * until the final chunk, after which the file is closed.  NDEF calls this 
+  * from its TX-done callback, so the MPipe ACK provides the flow control.
+  */
+ot_int alp_filedata_stream(alp_record* out_rec, Queue* out_q);
+
+
+/** @brief  Close the streaming file read, if one is open
+  * @param  None
+  * @retval None
+  * @ingroup ALP
+  */
+void alp_filedata_close();
+#endif
+
+
+
 
 #if (OT_FEATURE(SENSORS) == ENABLED)
-/* @brief  Process a received sensor configurator ALP record (not implemented)
+/* @brief  Process a received sensor ALP record (status, sample windows)
   * @param  in_rec      (alp_record*) Header of input ALP record, to be processed
   * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
   * @param  in_q        (Queue*) input queue containing record
@@ -154,9 +383,6 @@ void alp_proc_sensor(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue
 
 
 #if (OT_FEATURE(DASHFORTH) == ENABLED)
-#   if (OT_FEATURE(CAPI) != ENABLED)
-#       error For DASHForth to work, C-API must be ENABLED (it is not: check OT_config.h).
-#   endif
 /** @brief  Process a received DASHFORTH ALP record
   * @param  in_rec      (alp_record*) Header of input ALP record, to be processed
   * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
@@ -172,6 +398,70 @@ void alp_proc_dashforth(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Qu
 
 
 
+#if (OT_FEATURE(MEMSTATS) == ENABLED)
+/** @brief  Process a received memory statistics ALP record (read, clear, wear)
+  * @param  in_rec      (alp_record*) Header of input ALP record, to be processed
+  * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
+  * @param  in_q        (Queue*) input queue containing record
+  * @param  out_q       (Queue*) output queue for [optional] record response
+  * @param  user_id     (id_tmpl*) user id for performing the record 
+  * @retval None
+  * @ingroup ALP
+  */
+void alp_proc_memstats(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q, id_tmpl* user_id);
+#endif
+
+
+
+
+#if (M2_FEATURE(INVENTORY) == ENABLED)
+/** @brief  Process a received inventory planner ALP record (start, stop, read)
+  * @param  in_rec      (alp_record*) Header of input ALP record, to be processed
+  * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
+  * @param  in_q        (Queue*) input queue containing record
+  * @param  out_q       (Queue*) output queue for [optional] record response
+  * @param  user_id     (id_tmpl*) user id for performing the record 
+  * @retval None
+  * @ingroup ALP
+  */
+void alp_proc_inventory(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q, id_tmpl* user_id);
+#endif
+
+
+
+
+#if (OT_FEATURE(OTA) == ENABLED)
+/** @brief  Process a received firmware update ALP record (open, verify, apply)
+  * @param  in_rec      (alp_record*) Header of input ALP record, to be processed
+  * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
+  * @param  in_q        (Queue*) input queue containing record
+  * @param  out_q       (Queue*) output queue for [optional] record response
+  * @param  user_id     (id_tmpl*) user id for performing the record 
+  * @retval None
+  * @ingroup ALP
+  */
+void alp_proc_ota(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q, id_tmpl* user_id);
+#endif
+
+
+
+
+#if (OT_FEATURE(VLLOG) == ENABLED)
+/** @brief  Process a received log file ALP record (status, clear, records)
+  * @param  in_rec      (alp_record*) Header of input ALP record, to be processed
+  * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
+  * @param  in_q        (Queue*) input queue containing record
+  * @param  out_q       (Queue*) output queue for [optional] record response
+  * @param  user_id     (id_tmpl*) user id for performing the record 
+  * @retval None
+  * @ingroup ALP
+  */
+void alp_proc_vllog(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q, id_tmpl* user_id);
+#endif
+
+
+
+
 
 
 #if (LOG_FEATURE(ANY) == ENABLED)
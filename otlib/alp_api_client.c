@@ -25,6 +25,14 @@
   * the API message from simpler primitives.  In other words, client sends API
   * messages, server receives them and does something (whatever the API message
   * requires).
+  *
+  * The message is built in a Queue that the client allocates, as a series of
+  * NDEF records (6 byte header, no Type, 2 byte ID = ALP ID & CMD).  Fields
+  * are written straight into the Queue, in the layout that the breakdown
+  * functions in alp_api_server.c read them.  Each record may be followed by a
+  * gap, so that a record can be sent from where it is with mpipe_txndef(),
+  * which puts its footer after the record.  The code uses only the Queue
+  * type, so it also builds on a host controller.
   * 
   ******************************************************************************
   */
@@ -35,13 +43,426 @@
 #if ((OT_FEATURE(ALP) == ENABLED) && (OT_FEATURE(CLIENT) == ENABLED))
 
 #include "OT_platform.h"
-#include "buffers.h"
 #include "queue.h"
 
-///@todo All this stuff.  Much can be copied (and cleaned up) from testbeds 
-///      I made for other purposes.
 
+/// NDEF header of an ALP-API record: flags, Type length (0), payload length, 
+/// ID length (2), ALP ID, ALP CMD.  Flags are SR | IL | TNF_UNKNOWN, plus MB 
+/// on the first record and ME on the last.
+#define CLIENT_HEADER_LENGTH    6
+#define CLIENT_RECORD_FLAGS     (0x10 | 0x08 | 0x05)
+
+#define CLIENT_RESPOND(RESPOND) (((RESPOND) != False) ? 0x80 : 0)
+
+
+
+
+void sub_end_record(alp_msg* msg) {
+    if (msg->record != NULL) {
+        msg->record[2]      = (ot_u8)(msg->q->putcursor - msg->record - CLIENT_HEADER_LENGTH);
+        msg->q->putcursor  += msg->gap;
+        msg->q->length     += msg->gap;
+    }
+}
 
+
+
+#ifndef EXTF_alp_new_msg
+void alp_new_msg(alp_msg* msg, Queue* q, ot_u8 gap) {
+    q_empty(q);
+    msg->q      = q;
+    msg->record = NULL;
+    msg->script = NULL;
+    msg->gap    = gap;
+    msg->status = True;
+}
 #endif
 
 
+
+#ifndef EXTF_alp_new_record
+ot_bool alp_new_record(alp_msg* msg, ot_u8 dir_id, ot_u8 dir_cmd) {
+    ot_u8* header;
+    
+    /// The record must have room for its gap as well as its header
+    sub_end_record(msg);
+    if ((msg->q->putcursor + (msg->gap + CLIENT_HEADER_LENGTH)) > msg->q->back) {
+        msg->record = NULL;
+        msg->status = False;
+        return False;
+    }
+    
+    header          = msg->q->putcursor;
+    header[0]       = CLIENT_RECORD_FLAGS | ((msg->record == NULL) ? ALP_FLAG_MB : 0);
+    header[1]       = 0;
+    header[2]       = 0;
+    header[3]       = 2;
+    header[4]       = dir_id;
+    header[5]       = dir_cmd;
+    msg->record     = header;
+    msg->script     = NULL;
+    msg->q->putcursor  += CLIENT_HEADER_LENGTH;
+    msg->q->length     += CLIENT_HEADER_LENGTH;
+    return True;
+}
+#endif
+
+
+
+#ifndef EXTF_alp_reserve
+ot_u8* alp_reserve(alp_msg* msg, ot_int length) {
+/// Space is given only inside an open record, and only so far that the gap
+/// still fits and the payload stays a short record (255 bytes).
+    ot_u8* field = msg->q->putcursor;
+    
+    if ( (msg->record == NULL) || (msg->status == False) \
+      || ((field + (length + msg->gap)) > msg->q->back) \
+      || ((field + length) > (msg->record + (CLIENT_HEADER_LENGTH + 255))) ) {
+        msg->status = False;
+        return NULL;
+    }
+    msg->q->putcursor  += length;
+    msg->q->length     += length;
+    return field;
+}
+#endif
+
+
+
+#ifndef EXTF_alp_end_msg
+ot_int alp_end_msg(alp_msg* msg) {
+    if ((msg->record == NULL) || (msg->status == False)) {
+        return -1;
+    }
+    msg->record[0] |= ALP_FLAG_ME;
+    sub_end_record(msg);
+    msg->record     = NULL;
+    msg->script     = NULL;
+    return msg->q->length;
+}
+#endif
+
+
+
+
+/** Template writers <BR>
+  * ========================================================================<BR>
+  * Each writer reserves the whole template and then fills it in, so nothing
+  * is written when the template does not fit.  16 bit values are big endian.
+  */
+
+#define PUT16(PTR, VAL)     do { (PTR)[0] = (ot_u8)((VAL) >> 8); (PTR)[1] = (ot_u8)(VAL); } while(0)
+
+void alp_put_u8(alp_msg* msg, ot_u8 value) {
+    ot_u8* f = alp_reserve(msg, 1);
+    if (f != NULL) {
+        f[0] = value;
+    }
+}
+
+void alp_put_u16(alp_msg* msg, ot_u16 value) {
+    ot_u8* f = alp_reserve(msg, 2);
+    if (f != NULL) {
+        PUT16(f, value);
+    }
+}
+
+void alp_put_string(alp_msg* msg, ot_u8* data, ot_int length) {
+    ot_u8* f = alp_reserve(msg, length);
+    if (f != NULL) {
+        platform_memcpy(f, data, length);
+    }
+}
+
+void alp_put_queue(alp_msg* msg, Queue* data) {
+    ot_int length   = data->length;
+    ot_u8* f        = alp_reserve(msg, 2+length);
+    if (f != NULL) {
+        PUT16(f, length);
+        platform_memcpy(&f[2], data->front, length);
+    }
+}
+
+void alp_put_session_tmpl(alp_msg* msg, session_tmpl* session) {
+    ot_u8* f = alp_reserve(msg, 7);
+    if (f != NULL) {
+        f[0] = session->channel;
+        f[1] = session->subnet;
+        f[2] = session->subnetmask;
+        f[3] = session->flags;
+        f[4] = session->flagmask;
+        PUT16(&f[5], session->timeout);
+    }
+}
+
+void alp_put_command_tmpl(alp_msg* msg, command_tmpl* command) {
+    ot_u8* f = alp_reserve(msg, 3);
+    if (f != NULL) {
+        f[0] = command->type;
+        f[1] = command->opcode;
+        f[2] = command->extension;
+    }
+}
+
+void alp_put_id_tmpl(alp_msg* msg, id_tmpl* id) {
+    ot_u8* f = alp_reserve(msg, 1+id->length);
+    if (f != NULL) {
+        f[0] = id->length;
+        platform_memcpy(&f[1], id->value, id->length);
+    }
+}
+
+void alp_put_routing_tmpl(alp_msg* msg, routing_tmpl* routing) {
+/// Only the low hop code bits go on the wire: the server derives the others
+/// from hop_ext and the ID lengths.
+    ot_u8 hop_code = routing->hop_code & 0x03;
+    alp_put_u8(msg, hop_code);
+    
+    if (hop_code > 1) {
+        alp_put_u8(msg, routing->hop_ext);
+        alp_put_id_tmpl(msg, &routing->orig);
+        alp_put_id_tmpl(msg, &routing->dest);
+    }
+}
+
+void alp_put_dialog_tmpl(alp_msg* msg, dialog_tmpl* dialog) {
+/// The timeout is one byte on the wire.  Bit 7 set means a channel list follows.
+    ot_u8 timeout = (ot_u8)dialog->timeout;
+    
+    if (timeout & 0x80) {
+        ot_u8* f = alp_reserve(msg, 2+dialog->channels);
+        if (f != NULL) {
+            f[0] = timeout;
+            f[1] = (ot_u8)dialog->channels;
+            platform_memcpy(&f[2], dialog->chanlist, dialog->channels);
+        }
+    }
+    else {
+        alp_put_u8(msg, timeout);
+    }
+}
+
+void alp_put_query_tmpl(alp_msg* msg, query_tmpl* query) {
+    ot_int  masklen = (query->code & 0x80) ? query->length : 0;
+    ot_u8*  f       = alp_reserve(msg, 2+masklen+query->length);
+    if (f != NULL) {
+        f[0] = query->code;
+        f[1] = query->length;
+        platform_memcpy(&f[2], query->mask, masklen);
+        platform_memcpy(&f[2+masklen], query->value, query->length);
+    }
+}
+
+void alp_put_ack_tmpl(alp_msg* msg, ack_tmpl* ack) {
+    ot_int  listlen = ack->count * ack->length;
+    ot_u8*  f       = alp_reserve(msg, 2+listlen);
+    if (f != NULL) {
+        f[0] = ack->count;
+        f[1] = ack->length;
+        platform_memcpy(&f[2], ack->list, listlen);
+    }
+}
+
+void alp_put_error_tmpl(alp_msg* msg, error_tmpl* error) {
+/// Error data has no length on the wire: the server takes the rest of the 
+/// record, so add it after with alp_put_string() if there is any.
+    ot_u8* f = alp_reserve(msg, 2);
+    if (f != NULL) {
+        f[0] = error->code;
+        f[1] = error->subcode;
+    }
+}
+
+void alp_put_shell_tmpl(alp_msg* msg, shell_tmpl* shell) {
+    ot_u8* f = alp_reserve(msg, 3+shell->data_length);
+    if (f != NULL) {
+        f[0] = shell->req_port;
+        f[1] = shell->resp_port;
+        f[2] = shell->data_length;
+        platform_memcpy(&f[3], shell->data, shell->data_length);
+    }
+}
+
+void alp_put_isfcomp_tmpl(alp_msg* msg, isfcomp_tmpl* isfcomp) {
+    ot_u8* f = alp_reserve(msg, 4);
+    if (f != NULL) {
+        f[0] = isfcomp->is_series;
+        f[1] = isfcomp->isf_id;
+        PUT16(&f[2], isfcomp->offset);
+    }
+}
+
+void alp_put_isfcall_tmpl(alp_msg* msg, isfcall_tmpl* isfcall) {
+    ot_u8* f = alp_reserve(msg, 6);
+    if (f != NULL) {
+        f[0] = isfcall->is_series;
+        f[1] = isfcall->isf_id;
+        PUT16(&f[2], isfcall->max_return);
+        PUT16(&f[4], isfcall->offset);
+    }
+}
+
+
+
+
+/** ALP-API records <BR>
+  * ========================================================================<BR>
+  * Each call opens one record for the API function and writes its arguments.
+  */
+
+typedef void (*sub_puttmpl)(alp_msg*, void*);
+
+/// Indexed by Query dir cmd - 1, in the order of the server's cmd[] table
+static const sub_puttmpl query_put[ALP_QUERY_FUNCTIONS] = {
+    (sub_puttmpl)&alp_put_command_tmpl,
+    (sub_puttmpl)&alp_put_dialog_tmpl,
+    (sub_puttmpl)&alp_put_query_tmpl,
+    (sub_puttmpl)&alp_put_ack_tmpl,
+    (sub_puttmpl)&alp_put_error_tmpl,
+    (sub_puttmpl)&alp_put_isfcomp_tmpl,
+    (sub_puttmpl)&alp_put_isfcall_tmpl,
+    (sub_puttmpl)&alp_put_isfcall_tmpl,
+    (sub_puttmpl)&alp_put_queue,
+    (sub_puttmpl)&alp_put_queue,
+    (sub_puttmpl)&alp_put_shell_tmpl
+};
+
+
+
+ot_bool sub_put_api_record(alp_msg* msg, ot_bool respond, ot_u8 dir_id, ot_u8 dir_cmd) {
+    alp_new_record(msg, dir_id, (dir_cmd | CLIENT_RESPOND(respond)));
+    return msg->status;
+}
+
+
+ot_bool sub_put_query_item(alp_msg* msg, ot_u8 query_cmd, void* tmpl) {
+    if ((ot_u8)(query_cmd-1) >= ALP_QUERY_FUNCTIONS) {
+        msg->status = False;
+    }
+    else {
+        query_put[query_cmd-1](msg, tmpl);
+    }
+    return msg->status;
+}
+
+
+void sub_put_open_request(alp_msg* msg, addr_type addr, routing_tmpl* routing) {
+/// Same form as the server's sub_open_request(): addressing byte, then the
+/// target ID for unicast, then routing for unicast & anycast
+    alp_put_u8(msg, (ot_u8)addr);
+    if (((ot_u8)addr & 0x40) == 0) {
+        if (((ot_u8)addr & 0x80) == 0) {
+            alp_put_id_tmpl(msg, &routing->dlog);
+        }
+        alp_put_routing_tmpl(msg, routing);
+    }
+}
+
+
+
+#ifndef EXTF_alp_api_sysinit
+ot_bool alp_api_sysinit(alp_msg* msg, ot_bool respond) {
+    return sub_put_api_record(msg, respond, ALP_ID_API_SYSTEM, 1);
+}
+#endif
+
+#ifndef EXTF_alp_api_new_session
+ot_bool alp_api_new_session(alp_msg* msg, ot_bool respond, session_tmpl* session) {
+    if (sub_put_api_record(msg, respond, ALP_ID_API_SYSTEM, 2)) {
+        alp_put_session_tmpl(msg, session);
+    }
+    return msg->status;
+}
+#endif
+
+#ifndef EXTF_alp_api_open_request
+ot_bool alp_api_open_request(alp_msg* msg, ot_bool respond, addr_type addr, routing_tmpl* routing) {
+    if (sub_put_api_record(msg, respond, ALP_ID_API_SYSTEM, 3)) {
+        sub_put_open_request(msg, addr, routing);
+    }
+    return msg->status;
+}
+#endif
+
+#ifndef EXTF_alp_api_close_request
+ot_bool alp_api_close_request(alp_msg* msg, ot_bool respond) {
+    return sub_put_api_record(msg, respond, ALP_ID_API_SYSTEM, 4);
+}
+#endif
+
+#ifndef EXTF_alp_api_start_flood
+ot_bool alp_api_start_flood(alp_msg* msg, ot_bool respond, ot_u16 duration) {
+    if (sub_put_api_record(msg, respond, ALP_ID_API_SYSTEM, 5)) {
+        alp_put_u16(msg, duration);
+    }
+    return msg->status;
+}
+#endif
+
+#ifndef EXTF_alp_api_start_dialog
+ot_bool alp_api_start_dialog(alp_msg* msg, ot_bool respond) {
+    return sub_put_api_record(msg, respond, ALP_ID_API_SYSTEM, 6);
+}
+#endif
+
+#ifndef EXTF_alp_api_dialog_script
+ot_bool alp_api_dialog_script(alp_msg* msg, ot_bool respond, addr_type addr, routing_tmpl* routing) {
+    if (sub_put_api_record(msg, respond, ALP_ID_API_SYSTEM, 7)) {
+        sub_put_open_request(msg, addr, routing);
+        msg->script = alp_reserve(msg, 1);
+        if (msg->script != NULL) {
+            msg->script[0] = 0;
+        }
+    }
+    return msg->status;
+}
+#endif
+
+#ifndef EXTF_alp_api_script_item
+ot_bool alp_api_script_item(alp_msg* msg, ot_u8 query_cmd, void* tmpl) {
+    if (msg->script == NULL) {
+        msg->status = False;
+    }
+    else {
+        alp_put_u8(msg, query_cmd);
+        if (sub_put_query_item(msg, query_cmd, tmpl)) {
+            msg->script[0]++;
+        }
+    }
+    return msg->status;
+}
+#endif
+
+#ifndef EXTF_alp_api_session_number
+ot_bool alp_api_session_number(alp_msg* msg, ot_bool respond) {
+    return sub_put_api_record(msg, respond, ALP_ID_API_SESSION, 1);
+}
+#endif
+
+#ifndef EXTF_alp_api_flush_sessions
+ot_bool alp_api_flush_sessions(alp_msg* msg, ot_bool respond) {
+    return sub_put_api_record(msg, respond, ALP_ID_API_SESSION, 2);
+}
+#endif
+
+#ifndef EXTF_alp_api_is_session_blocked
+ot_bool alp_api_is_session_blocked(alp_msg* msg, ot_bool respond, ot_u8 chan_id) {
+    if (sub_put_api_record(msg, respond, ALP_ID_API_SESSION, 3)) {
+        alp_put_u8(msg, chan_id);
+    }
+    return msg->status;
+}
+#endif
+
+#ifndef EXTF_alp_api_query
+ot_bool alp_api_query(alp_msg* msg, ot_bool respond, ot_u8 query_cmd, void* tmpl) {
+    if (sub_put_api_record(msg, respond, ALP_ID_API_QUERY, query_cmd)) {
+        sub_put_query_item(msg, query_cmd, tmpl);
+    }
+    return msg->status;
+}
+#endif
+
+
+#endif
+
@@ -57,7 +57,8 @@ typedef enum {
     sysindex_open_request   = 3,
     sysindex_close_request  = 4,
     sysindex_start_flood    = 5,
-    sysindex_start_dialog   = 6
+    sysindex_start_dialog   = 6,
+    sysindex_dialog_script  = 7
 } sysindex;
 
 typedef enum {
@@ -170,6 +171,8 @@ void sub_breakdown_id_tmpl(Queue* in_q, void* data_type) {
 void sub_breakdown_dialog_tmpl(Queue* in_q, void* data_type) {
     ((dialog_tmpl*)data_type)->timeout = q_readbyte(in_q);
     
+    ((dialog_tmpl*)data_type)->channels = 0;
+    
     if (((dialog_tmpl*)data_type)->timeout & 0x80) {
         ((dialog_tmpl*)data_type)->channels = q_readbyte(in_q);
         ((dialog_tmpl*)data_type)->chanlist = \
@@ -238,6 +241,109 @@ void sub_breakdown_isfcall_tmpl(Queue* in_q, void* data_type) {
 
 
 
+/// M2QP API lookup tables: argmap links each M2QP function to its template
+static const ot_u8 argmap[OTAPI_M2QP_FUNCTIONS] = \
+    { 5, 8, 9, 10, 11, 12, 13, 13, 3, 3, 14 };
+
+static const sub_bdtmpl tmpl[15] = {
+    &sub_breakdown_u8,            //0
+    &sub_breakdown_u16,           //1
+    &sub_breakdown_u32,           //2
+    &sub_breakdown_queue,         //3
+    &sub_breakdown_session_tmpl,  //4
+    &sub_breakdown_command_tmpl,  //5
+    &sub_breakdown_id_tmpl,       //6
+    &sub_breakdown_routing_tmpl,  //7
+    &sub_breakdown_dialog_tmpl,   //8
+    &sub_breakdown_query_tmpl,    //9
+    &sub_breakdown_ack_tmpl,      //10
+    &sub_breakdown_error_tmpl,    //11
+    &sub_breakdown_isfcomp_tmpl,  //12
+    &sub_breakdown_isfcall_tmpl,  //13
+    &sub_breakdown_shell_tmpl     //14
+};
+
+static const otapi_cmd cmd[OTAPI_M2QP_FUNCTIONS] = {
+    (otapi_cmd)&otapi_put_command_tmpl,      //5
+    (otapi_cmd)&otapi_put_dialog_tmpl,       //8
+    (otapi_cmd)&otapi_put_query_tmpl,        //9
+    (otapi_cmd)&otapi_put_ack_tmpl,          //10
+    (otapi_cmd)&otapi_put_error_tmpl,        //11
+    (otapi_cmd)&otapi_put_isf_comp,          //12
+    (otapi_cmd)&otapi_put_isf_call,          //13
+    (otapi_cmd)&otapi_put_isf_return,        //13
+    (otapi_cmd)&otapi_put_reqds,             //3
+    (otapi_cmd)&otapi_put_propds,            //3
+    (otapi_cmd)&otapi_put_shell_tmpl         //14
+};
+
+
+/// Packed templates: the wire layout matches the C struct, so the template is
+/// bounds-checked and copied as one block.  packsize is 0 for templates that
+/// have pointers or padding, which use the breakdown functions.  packswap has
+/// a bit set for each 16 bit word that needs byte-swapping (wire data is big 
+/// endian), so the fixup compiles out on big endian platforms.
+static const ot_u8 packsize[15] = {
+    0, 0, 0, 0, 0, __SIZEOF_command_tmpl, 0, 0, 0, 0, 0, 0, 
+    __SIZEOF_isfcomp_tmpl, __SIZEOF_isfcall_tmpl, 0
+};
+
+#ifndef __BIG_ENDIAN__
+static const ot_u8 packswap[15] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x06, 0
+};
+#endif
+
+
+
+
+ot_bool sub_unpack_tmpl(ot_u8 tmpl_i, Queue* in_q, ot_u8* data_type) {
+    ot_int size = packsize[tmpl_i];
+    
+    if ((in_q->getcursor + size) > in_q->back) {
+        return False;
+    }
+    platform_memcpy(data_type, in_q->getcursor, size);
+    in_q->getcursor += size;
+    
+#   ifndef __BIG_ENDIAN__
+    {   ot_u8 swap;
+        for (swap=packswap[tmpl_i]; swap!=0; swap>>=1, data_type+=2) {
+            if (swap & 1) {
+                ot_u8 scratch   = data_type[0];
+                data_type[0]    = data_type[1];
+                data_type[1]    = scratch;
+            }
+        }
+    }
+#   endif
+    return True;
+}
+
+
+
+ot_u16 sub_put_tmpl(ot_u8 lookup_cmd, Queue* in_q, ot_u8* status) {
+/// Load template from ALP dir cmd into C datatype, then run the M2QP command
+/// using this template.  dt_buf is word-aligned, for the packed templates.
+    ot_u32  dt_buf[6];      // 24 bytes is a safe amount
+    ot_u8   tmpl_i = argmap[lookup_cmd];
+    
+    if (packsize[tmpl_i] != 0) {
+        if (sub_unpack_tmpl(tmpl_i, in_q, (ot_u8*)dt_buf) == False) {
+            *status = 0;
+            return 0;
+        }
+    }
+    else {
+        tmpl[tmpl_i](in_q, (void*)dt_buf);
+    }
+    
+    return cmd[lookup_cmd](status, (void*)dt_buf);
+}
+
+
+
+
 
 
 
@@ -245,6 +351,51 @@ void sub_breakdown_isfcall_tmpl(Queue* in_q, void* data_type) {
 
 
 
+
+ot_u16 sub_open_request(Queue* in_q) {
+    ot_u8 addr_byte;
+    ot_u8 routing[sizeof(routing_tmpl)];
+    sub_breakdown_u8(in_q, &addr_byte);
+    
+    // Use routing_tmpl for unicast or anycast and additionally grab
+    // target id for unicast
+    if ((addr_byte & 0x40) == 0) {
+        if ((addr_byte & 0x80) == 0) {
+            sub_breakdown_id_tmpl(in_q, &((routing_tmpl*)routing)->dlog);
+        }
+        sub_breakdown_routing_tmpl(in_q, routing);
+    }
+    return otapi_open_request( (addr_type)addr_byte, (routing_tmpl*)routing );
+}
+
+
+
+ot_u16 sub_dialog_script(Queue* in_q) {
+/// Dialog script: one record opens a request, puts M2QP templates, closes the
+/// request, and starts the dialog.  The record data is the open_request data,
+/// then a count byte, then for each item the M2QP dir cmd (as it would be for
+/// alp_proc_api_query(), without response bit) followed by its template.  The
+/// dialog is not started if any put fails.
+    ot_u8 items;
+    ot_u8 status = 1;
+    
+    sub_open_request(in_q);
+    items = q_readbyte(in_q);
+    
+    while ((items-- != 0) && (status != 0)) {
+        ot_u8 lookup_cmd = (q_readbyte(in_q) & ~0x80) - 1;
+        if (lookup_cmd >= OTAPI_M2QP_FUNCTIONS) {
+            return 0;
+        }
+        sub_put_tmpl(lookup_cmd, in_q, &status);
+    }
+    
+    otapi_close_request();
+    return (status != 0) ? otapi_start_dialog() : 0;
+}
+
+
+
 void alp_proc_api_session(alp_record* in_rec, alp_record* out_rec,
                                 Queue* in_q, Queue* out_q, id_tmpl* user_id ) {
 /// @note Usage of Session functions via API
@@ -256,6 +407,7 @@ void alp_proc_api_session(alp_record* in_rec, alp_record* out_rec,
 /// Standard form is ot_u16 otapi_function(ot_u8*, void*).
     ot_u16 retval;
     ot_bool respond         = (ot_bool)(in_rec->dir_cmd & 0x80);
+    in_rec->dir_cmd        &= ~0x80;
     out_rec->payload_length = 0;
 
     if ( (in_rec->dir_cmd > 3) || (!auth_isroot(user_id)) )
@@ -302,7 +454,7 @@ void alp_proc_api_system(alp_record* in_rec, alp_record* out_rec,
     function_code           = (sysindex)in_rec->dir_cmd;
     out_rec->payload_length = 0;
     
-    if ( (function_code > 6) || (!auth_isroot(user_id)) )
+    if ( (function_code > sysindex_dialog_script) || (!auth_isroot(user_id)) )
         return;
     
     switch ( function_code ) {
@@ -320,22 +472,9 @@ void alp_proc_api_system(alp_record* in_rec, alp_record* out_rec,
             break;
         }
         
-        case sysindex_open_request: {
-            ot_u8 addr_byte;
-            ot_u8 routing[sizeof(routing_tmpl)];
-            sub_breakdown_u8(in_q, &addr_byte);
-            
-            // Use routing_tmpl for unicast or anycast and additionally grab
-            // target id for unicast
-            if ((addr_byte & 0x40) == 0) {
-                if ((addr_byte & 0x80) == 0) {
-                    sub_breakdown_id_tmpl(in_q, &((routing_tmpl*)routing)->dlog);
-                }
-                sub_breakdown_routing_tmpl(in_q, routing);
-            }
-            retval = otapi_open_request( (addr_type)addr_byte, (routing_tmpl*)routing );
+        case sysindex_open_request:
+            retval = sub_open_request(in_q);
             break;
-        }
         
         case sysindex_close_request: 
             retval = otapi_close_request();
@@ -351,6 +490,10 @@ void alp_proc_api_system(alp_record* in_rec, alp_record* out_rec,
         case sysindex_start_dialog:
             retval = otapi_start_dialog();
             break;
+        
+        case sysindex_dialog_script:
+            retval = sub_dialog_script(in_q);
+            break;
     }
     
     /// Write back the twobyte retval integer when response is enabled
@@ -366,44 +509,6 @@ void alp_proc_api_query(alp_record* in_rec, alp_record* out_rec,
 /// abide, apart from special cases which *must* be cleared by the developer
 /// community prior to becoming official.
 /// The form is: ot_u16 otapi_function(ot_u8*, void*)
-    static const ot_u8 argmap[OTAPI_M2QP_FUNCTIONS] = \
-        { 5, 8, 9, 10, 11, 12, 13, 13, 3, 3, 14 };
-
-    //sub_bdtmpl  get_tmpl;
-    static const sub_bdtmpl tmpl[15] = {
-        &sub_breakdown_u8,            //0
-        &sub_breakdown_u16,           //1
-        &sub_breakdown_u32,           //2
-        &sub_breakdown_queue,         //3
-        &sub_breakdown_session_tmpl,  //4
-        &sub_breakdown_command_tmpl,  //5
-        &sub_breakdown_id_tmpl,       //6
-        &sub_breakdown_routing_tmpl,  //7
-        &sub_breakdown_dialog_tmpl,   //8
-        &sub_breakdown_query_tmpl,    //9
-        &sub_breakdown_ack_tmpl,      //10
-        &sub_breakdown_error_tmpl,    //11
-        &sub_breakdown_isfcomp_tmpl,  //12
-        &sub_breakdown_isfcall_tmpl,  //13
-        &sub_breakdown_shell_tmpl     //14
-    };
-
-    //otapi_cmd   cmd;
-    static const otapi_cmd cmd[11] = {
-        (otapi_cmd)&otapi_put_command_tmpl,      //5
-        (otapi_cmd)&otapi_put_dialog_tmpl,       //8
-        (otapi_cmd)&otapi_put_query_tmpl,        //9
-        (otapi_cmd)&otapi_put_ack_tmpl,          //10
-        (otapi_cmd)&otapi_put_error_tmpl,        //11
-        (otapi_cmd)&otapi_put_isf_comp,          //12
-        (otapi_cmd)&otapi_put_isf_call,          //13
-        (otapi_cmd)&otapi_put_isf_return,        //13
-        (otapi_cmd)&otapi_put_reqds,             //3
-        (otapi_cmd)&otapi_put_propds,            //3
-        (otapi_cmd)&otapi_put_shell_tmpl         //14
-    };
-
-    ot_u8   dt_buf[24];   // 24 bytes is a safe amount, although less might suffice
     ot_u16  txq_len;
     ot_u8   status;
     ot_u8   lookup_cmd      = (in_rec->dir_cmd & ~0x80) - 1;
@@ -413,47 +518,7 @@ void alp_proc_api_query(alp_record* in_rec, alp_record* out_rec,
     if ( (lookup_cmd >= OTAPI_M2QP_FUNCTIONS) || (auth_isroot(user_id) == False) )
         return;
     
-    /// Load template from ALP dir cmd into C datatype
-    /*
-    switch (argmap[lookup_cmd]) {
-        case 0:     get_tmpl = &sub_breakdown_u8;               break;
-        case 1:     get_tmpl = &sub_breakdown_u16;              break;
-        case 2:     get_tmpl = &sub_breakdown_u32;              break;
-        case 3:     get_tmpl = &sub_breakdown_queue;            break;
-        case 4:     get_tmpl = &sub_breakdown_session_tmpl;     break;
-        case 5:     get_tmpl = &sub_breakdown_command_tmpl;     break;
-        case 6:     get_tmpl = &sub_breakdown_id_tmpl;          break;
-        case 7:     get_tmpl = &sub_breakdown_routing_tmpl;     break;
-        case 8:     get_tmpl = &sub_breakdown_dialog_tmpl;      break;
-        case 9:     get_tmpl = &sub_breakdown_query_tmpl;       break;
-        case 10:    get_tmpl = &sub_breakdown_ack_tmpl;         break;
-        case 11:    get_tmpl = &sub_breakdown_error_tmpl;       break;
-        case 12:    get_tmpl = &sub_breakdown_isfcomp_tmpl;     break;
-        case 13:    get_tmpl = &sub_breakdown_isfcall_tmpl;     break;
-        case 14:    get_tmpl = &sub_breakdown_shell_tmpl;       break;
-    }
-    get_tmpl(in_q, (void*)dt_buf);
-    */
-    tmpl[argmap[lookup_cmd]](in_q, (void*)dt_buf);
-    
-    /// Run ALP command, using input template
-    /*
-    switch (lookup_cmd) {
-        case 0: 	cmd = &otapi_put_command_tmpl;				break; 	//5
-        case 1:     cmd = &otapi_put_dialog_tmpl;               break;	//8
-        case 2:     cmd = &otapi_put_query_tmpl;                break;	//9
-        case 3:     cmd = &otapi_put_ack_tmpl;                  break;	//10
-        case 4:     cmd = &otapi_put_error_tmpl;                break;	//11
-        case 5:     cmd = &otapi_put_isf_comp;                  break;	//12
-        case 6:     cmd = &otapi_put_isf_call;                  break; 	//13
-        case 7:     cmd = &otapi_put_isf_return;                break; 	//13
-        case 8:     cmd = &otapi_put_reqds;                     break;	//3
-        case 9:     cmd = &otapi_put_propds;                    break;	//3
-        case 10:    cmd = &otapi_put_shell_tmpl;                break;	//14
-    }
-    txq_len = cmd(&status, (void*)dt_buf);
-    */
-    txq_len = cmd[lookup_cmd](&status, (void*)dt_buf);
+    txq_len = sub_put_tmpl(lookup_cmd, in_q, &status);
     
     /// Response to ALP query command includes three bytes:
     /// byte 1 - status (0 is error)
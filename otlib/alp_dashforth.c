@@ -21,7 +21,29 @@
   * @brief      ALP to DASHForth applet extractor
   * @ingroup    ALP
   *
-  * Placeholder for future dashforth module ALP wrapper
+  * Runs DASHForth applets (see dashforth.h) that are sent in the record, or
+  * that are stored in a file, and responds with their output.
+  *
+  * Directive Command Field:
+  * b7:     Respond Bit     0 don't respond
+  *                         1 Respond with directive return template
+  *
+  * b3-0:   Operand         0000: Run Applet (in record)
+  *                         0010: Run Stored Applet
+  *                         0100: Start Stored Applet in background (APPTASKS)
+  *                         0110: Read Background Applet
+  *                         xxx1: Return (response to the above)
+  *
+  * Run Applet:         [args: 1] [arg: 2 each] [bytecode]
+  * Run Stored Applet:  [block: 1] [id: 1] [args: 1] [arg: 2 each]
+  * Start in background: same as Run Stored Applet
+  * Return:             [state: 1] [output]
+  *
+  * Arguments are pushed in order, so the last one is on top.  The state is
+  * the signed run state (0 is done, negative is an error).  An applet that is
+  * run from ALP has DASHFORTH_STEPS words to finish, and its output is written
+  * straight to the response.  Files are read with the rights of the user of
+  * the record, so DASHForth needs no user system of its own.
   * 
   ******************************************************************************
   */
@@ -35,12 +57,102 @@
 
 #include "dashforth.h"
 
-// DASHForth APL processor would go here.  It does not have to do much, just
-// push the applet to the VM.  I'm not sure if the directive cmd has any usage
-// for DASHForth aside from the response bit.
+/// VM for applets run from ALP.  ALP records are processed one at a time,
+/// and each applet is run to its end, so one VM is enough.
+static df_vm alp_df;
+
+
+ot_int sub_readargs(df_cell* args, Queue* in_q, ot_int* remaining) {
+/// Arguments come before the bytecode, but go on the stack after the load
+    ot_int nargs = q_readbyte(in_q);
+    ot_int i;
+    *remaining  -= 1 + (nargs << 1);
+    if ((nargs > DASHFORTH_DSTACK) || (*remaining < 0)) {
+        return -1;
+    }
+    for (i=0; i<nargs; i++) {
+        args[i] = (df_cell)q_readshort(in_q);
+    }
+    return nargs;
+}
+
+
+void alp_proc_dashforth(alp_record* in_rec, alp_record* out_rec,
+                            Queue* in_q, Queue* out_q, id_tmpl* user_id) {
+    df_cell args[DASHFORTH_DSTACK];
+    ot_int  nargs;
+    ot_int  state       = DF_ERR_LOAD;
+    ot_int  remaining   = in_rec->payload_length;
+    ot_u8   cmd         = in_rec->dir_cmd & 0x0F;
+    ot_u8*  head        = out_q->putcursor;
+    ot_int  length      = out_q->length;
+
+    // Return commands are not handled by the server (ignore)
+    out_rec->payload_length = 0;
+    if ((cmd & 1) || (cmd > 6) || ((out_q->putcursor + 1) > out_q->back)) {
+        return;
+    }
+    q_writebyte(out_q, 0);
+    df_init(&alp_df, out_q, user_id);
+
+    switch (cmd) {
+        case 0: nargs = sub_readargs(args, in_q, &remaining);
+                if (nargs >= 0) {
+                    state = df_load(&alp_df, in_q->getcursor, (ot_uint)remaining);
+                    in_q->getcursor += remaining;
+                }
+                break;
+        
+        case 2:
+        case 4: {
+            ot_u8 block = q_readbyte(in_q);
+            ot_u8 id    = q_readbyte(in_q);
+            remaining  -= 2;
+            nargs       = sub_readargs(args, in_q, &remaining);
+            if (nargs < 0) {
+                break;
+            }
+            if (cmd == 4) {
+#               if (OT_FEATURE(APPTASKS) == ENABLED)
+                state = df_bg_start(block, id, args, nargs, user_id);
+#               endif
+                nargs = -1;
+                break;
+            }
+            state = df_load_file(&alp_df, block, id);
+        } break;
+        
+        case 6: nargs = -1;
+#               if (OT_FEATURE(APPTASKS) == ENABLED)
+                state = df_bg_output(out_q);
+#               endif
+                break;
+    }
+
+    if ((state == DF_STATE_RUN) && (nargs >= 0)) {
+        ot_int i;
+        for (i=0; i<nargs; i++) {
+            df_push(&alp_df, args[i]);
+        }
+        state = df_run(&alp_df, DASHFORTH_STEPS);
+        if (state == DF_STATE_RUN) {
+            df_stop(&alp_df, DF_ERR_STEPS);
+            state = DF_ERR_STEPS;
+        }
+    }
+
+    if (in_rec->dir_cmd & 0x80) {
+        *head                   = (ot_u8)state;
+        out_rec->flags         &= ~ALP_FLAG_CF;
+        out_rec->dir_cmd        = (in_rec->dir_cmd & 0x7F) | 1;
+        out_rec->payload_length = out_q->putcursor - head;
+    }
+    else {
+        out_q->putcursor        = head;
+        out_q->length           = length;
+    }
+}
 
-// DASHForth manages its own user system, pusuant to the auth module, but
-// independently configurable.
 
 #endif
 
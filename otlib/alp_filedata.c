@@ -59,6 +59,13 @@
   *                         1101: Return File Header + Data 
   *                         1110: Restore File (optional) 
   *                         1111: Return Error
+  *
+  * Restore File puts stock files back to their defaults.  With an empty file
+  * id list, it restores the whole filesystem (root only).
+  *
+  * Read File Headers with an empty file id list returns the headers of all
+  * the files in the block, packed 6 bytes each (id, mod, length, alloc).  If
+  * they do not all fit, the chunk flag is set on the response.
   ******************************************************************************
   */
 
@@ -103,6 +110,21 @@ ot_int sub_filerestore(ot_bool respond, alp_record* in_rec,
 
 
 
+#if (ALP_FILE_STREAM == ENABLED)
+/// Streaming read cursor: the file stays open for the whole transfer, and it
+/// is only used by wireline (root) sessions.  fp == NULL when idle.
+typedef struct {
+    vlFILE* fp;
+    ot_u16  offset;
+    ot_u16  limit;
+    ot_u8   dir_cmd;
+} alp_filestream;
+
+alp_filestream alp_stream = { NULL, 0, 0, 0 };
+#endif
+
+
+
 
 
 
@@ -188,6 +210,40 @@ ot_bool sub_testchunk(ot_int data_in) {
 
 
 
+/// Packed header output: id & mod, length, alloc
+void sub_putheader(Queue* out_q, vaddr header) {
+    q_writeshort_be(out_q, vworm_read(header + 4)); // id & mod
+    q_writeshort(out_q, vworm_read(header + 0));    // length
+    q_writeshort(out_q, vworm_read(header + 2));    // alloc
+}
+
+
+
+/// File data is copied out in one block read, as much of it as fits (whole
+/// words, with the same room check as a word-by-word copy).  Returns the
+/// number of bytes copied.
+ot_int sub_copyout(vlFILE* fp, ot_u16 offset, ot_u16 limit, Queue* out_q) {
+    ot_int bytes;
+    ot_int room;
+    
+    if (offset >= limit) {
+        return 0;
+    }
+    bytes   = (limit - offset + 1) & ~1;
+    room    = (out_q->back - out_q->putcursor - 1) & ~1;
+    if (bytes > room) {
+        bytes = (room > 0) ? room : 0;
+    }
+    if (vl_read_block(fp, offset, bytes, out_q->putcursor) != 0) {
+        return 0;
+    }
+    out_q->putcursor   += bytes;
+    out_q->length      += bytes;
+    return bytes;
+}
+
+
+
 /// This is a form of overwrite protection
 ot_bool sub_qnotfull(ot_bool write, ot_u8 write_size, Queue* q) {
     return (ot_bool)(((q->putcursor+write_size) < q->back) || (write == False));
@@ -254,6 +310,23 @@ ot_int sub_fileheaders( ot_bool respond, alp_record* in_rec,
 
     /// Only run if respond bit is set!
     if (respond) {
+        /// An empty file id list reads all the headers in the block, in one
+        /// pass over its header table.  The room for them is checked once.
+        if (data_in == 0) {
+            vaddr   header;
+            ot_int  room    = (out_q->back - out_q->putcursor - 1) / 6;
+            ot_int  index   = 0;
+            
+            while ((index = vl_nextheader(&header, file_block, index)) >= 0) {
+                if (room-- <= 0) {
+                    data_in = 1;
+                    break;
+                }
+                sub_putheader(out_q, header);
+                data_out += 6;
+            }
+        }
+    
         while ((data_in > 0) && sub_qnotfull(respond, 6, out_q)) {
             vaddr   header;
             ot_bool allow_output = True;
@@ -263,9 +336,7 @@ ot_int sub_fileheaders( ot_bool respond, alp_record* in_rec,
             allow_output = (ot_bool)(vl_getheader_vaddr(&header, file_block, \
                                     q_readbyte(in_q), VL_ACCESS_R, NULL) == 0);
             if (allow_output) {
-                q_writeshort_be(out_q, vworm_read(header + 4)); // id & mod
-                q_writeshort(out_q, vworm_read(header + 0)); // length
-                q_writeshort(out_q, vworm_read(header + 2)); // alloc
+                sub_putheader(out_q, header);
                 data_out += 6;
             }
         }
@@ -291,6 +362,11 @@ ot_int sub_filedata(ot_bool respond, alp_record* in_rec,
     vlBLOCK file_block  = (vlBLOCK)((in_rec->dir_cmd >> 4) & 0x07);
     ot_u8   file_mod    = ((in_rec->dir_cmd & 0x02) ? VL_ACCESS_W : VL_ACCESS_R);
     
+#   if (ALP_FILE_STREAM == ENABLED)
+    /// A new request cancels any stream that is still open
+    alp_filedata_close();
+#   endif
+    
     while (data_in > 0) {
         vaddr   header;
         ot_u8   err_code;
@@ -349,9 +425,11 @@ ot_int sub_filedata(ot_bool respond, alp_record* in_rec,
         // Read from File
         // 1. No error for bad read parameter, just fix the limit
         // 2. If inc_header param is set, include the file header in output
-        // 3. Read out file data
+        // 3. Read out file data, in one block copy, and stream or chunk
+        //    whatever does not fit
         else {
-            ot_u8 overhead;
+            ot_u8   overhead;
+            ot_int  copied;
             //limit       = (limit > fp->length) ? fp->length : limit;
             overhead    = 6;
             overhead   += (inc_header != 0) << 2; 
@@ -370,11 +448,25 @@ ot_int sub_filedata(ot_bool respond, alp_record* in_rec,
             q_writeshort(out_q, span);
             data_out += 6;
             
-            for (; offset<limit; offset+=2, span-=2, data_out+=2) {
-                if ((out_q->putcursor+2) >= out_q->back) {
-                    goto sub_filedata_overrun;
+            copied      = sub_copyout(fp, offset, limit, out_q);
+            offset     += copied;
+            span       -= copied;
+            data_out   += copied;
+            
+            if (offset < limit) {
+#               if (ALP_FILE_STREAM == ENABLED)
+                /// Stream the rest when this is the last read in the
+                /// record: the file stays open (bookmark -> chunk flag)
+                if ((user_id == NULL) && ((data_in-5) <= 0)) {
+                    alp_stream.fp       = fp;
+                    alp_stream.offset   = offset;
+                    alp_stream.limit    = limit;
+                    alp_stream.dir_cmd  = (in_rec->dir_cmd & 0x7F) | 0x01;
+                    in_rec->bookmark    = (void*)1;
+                    return data_out;
                 }
-                q_writeshort_be(out_q, vl_read(fp, offset));
+#               endif
+                goto sub_filedata_overrun;
             }
         }
         
@@ -490,17 +582,33 @@ ot_int sub_filecreate(  ot_bool respond, alp_record* in_rec,
 
 
 
-/// Not currently supported, always returns "unrestorable" error
+/// Stock files are restored from the stock filesystem image (vl_restore()).
+/// An empty file id list restores the whole filesystem (root only), and the
+/// response is a single (255, error) pair.
 ot_int sub_filerestore( ot_bool respond, alp_record* in_rec,
                         Queue* in_q, Queue* out_q, id_tmpl* user_id ) {
     
     ot_int  data_out    = 0;
     ot_int  data_in     = in_rec->payload_length;
-    //vlBLOCK file_block  = ((in_rec->dir_cmd >> 4) & 0x07);
+    vlBLOCK file_block  = (vlBLOCK)((in_rec->dir_cmd >> 4) & 0x07);
+    
+#   if (ALP_FILE_STREAM == ENABLED)
+    /// An open stream would keep its file from being restored
+    alp_filedata_close();
+#   endif
+    
+    if (data_in == 0) {
+        ot_u8 err_code = auth_isroot(user_id) ? vl_restore_all() : 0x04;
+        if (respond && sub_qnotfull(respond, 2, out_q)) {
+            q_writebyte(out_q, 255);
+            q_writebyte(out_q, err_code);
+            data_out += 2;
+        }
+    }
     
     while ((data_in > 0) && sub_qnotfull(respond, 2, out_q)) {
-        ot_u8   err_code    = 0x03;
         ot_u8   file_id     = q_readbyte(in_q);
+        ot_u8   err_code    = vl_restore(file_block, file_id, user_id);
         data_in            -= 1;
     
         if (respond) {
@@ -526,6 +634,48 @@ ot_int sub_filerestore( ot_bool respond, alp_record* in_rec,
 
 
 
+
+#if (ALP_FILE_STREAM == ENABLED)
+#ifndef EXTF_alp_filedata_stream
+ot_int alp_filedata_stream(alp_record* out_rec, Queue* out_q) {
+    ot_int data_out = 0;
+    
+    if (alp_stream.fp == NULL) {
+        return -1;
+    }
+    
+    data_out            = sub_copyout(alp_stream.fp, alp_stream.offset, alp_stream.limit, out_q);
+    alp_stream.offset  += data_out;
+    
+    out_rec->dir_id         = ALP_ID_FILEDATA;
+    out_rec->dir_cmd        = alp_stream.dir_cmd;
+    out_rec->payload_length = data_out;
+    out_rec->flags         &= ~ALP_FLAG_CF;
+    
+    if (alp_stream.offset < alp_stream.limit) {
+        out_rec->flags     |= ALP_FLAG_CF;
+    }
+    else {
+        alp_filedata_close();
+    }
+    
+    return data_out;
+}
+#endif
+
+
+#ifndef EXTF_alp_filedata_close
+void alp_filedata_close() {
+    if (alp_stream.fp != NULL) {
+        vl_close(alp_stream.fp);
+        alp_stream.fp = NULL;
+    }
+}
+#endif
+#endif
+
+
+
     
     
 #endif
@@ -0,0 +1,189 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/alp_inventory.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      ALP to Inventory Planner processor
+  * @ingroup    ALP
+  *
+  * ALP access to the inventory planner of a gateway or subcontroller
+  * (M2_FEATURE_INVENTORY in m2_transport.h).  The host sets the policy, and
+  * the planner runs the rounds.  The responses come to the host as usual.
+  *
+  * Directive Command Field:
+  * b7:     Respond Bit     0 don't respond
+  *                         1 Respond with directive return template
+  *
+  * b3-0:   Operand         0000: Read Status
+  *                         0001: Return Status
+  *                         0010: Start (root)
+  *                         0011: Stop (root)
+  *                         0100: Read Tags
+  *                         0101: Return Tags
+  *                         1111: Return Error
+  *
+  * Status:         [state] [round] [q] [ID length] [pass: 2] [tags: 2]
+  *                 [tags added in the pass: 2]
+  * Start:          [opcode] [flags] [subnet] [q] [slot ticks: 2] [rounds]
+  *                 [tca] [period: 2] [comp ISF] [call ISF] [max return]
+  *                 [channels] [channel list: channels]
+  * Read Tags:      [index of the first tag]
+  * Return Tags:    [index] [number of tags] [IDs], as many as fit
+  * Return Error:   [error: 2], 0 is no error
+  *
+  ******************************************************************************
+  */
+
+
+#include "alp.h"
+#include "OTAPI.h"
+
+#if (   (OT_FEATURE(SERVER) == ENABLED) \
+     && (OT_FEATURE(ALP) == ENABLED) \
+     && (M2QP_INVENTORY) )
+
+#include "auth.h"
+
+
+#define INVENTORY_CMD_READ      0x00
+#define INVENTORY_CMD_START     0x02
+#define INVENTORY_CMD_STOP      0x03
+#define INVENTORY_CMD_TAGS      0x04
+#define INVENTORY_CMD_ERROR     0x0F
+
+#define INVENTORY_STATUS        10
+#define INVENTORY_POLICY        14
+
+
+void alp_proc_inventory(alp_record* in_rec, alp_record* out_rec,
+                        Queue* in_q, Queue* out_q, id_tmpl* user_id    ) {
+    ot_bool respond = (ot_bool)(in_rec->dir_cmd & 0x80);
+    ot_u8   cmd     = in_rec->dir_cmd & 0x0F;
+    ot_u16  error   = 0;
+
+    out_rec->payload_length = 0;
+
+    switch (cmd) {
+        case INVENTORY_CMD_READ: {
+            if (respond == False) {
+                break;
+            }
+            if ((out_q->putcursor + INVENTORY_STATUS) > out_q->back) {
+                error = 255;
+                break;
+            }
+            q_writebyte(out_q, m2qp.inv.state);
+            q_writebyte(out_q, m2qp.inv.round);
+            q_writebyte(out_q, m2qp.fsa.q);
+            q_writebyte(out_q, m2qp.inv.length);
+            q_writeshort(out_q, m2qp.inv.pass);
+            q_writeshort(out_q, m2qp.inv.count);
+            q_writeshort(out_q, m2qp.inv.fresh);
+            out_rec->payload_length = INVENTORY_STATUS;
+        } break;
+
+        case INVENTORY_CMD_START: {
+            inv_policy  policy;
+            ot_int      i;
+
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+                break;
+            }
+            if (in_rec->payload_length < INVENTORY_POLICY) {
+                error = 255;
+                break;
+            }
+            policy.opcode       = q_readbyte(in_q);
+            policy.flags        = q_readbyte(in_q);
+            policy.subnet       = q_readbyte(in_q);
+            policy.q            = q_readbyte(in_q);
+            policy.slot_ticks   = q_readshort(in_q);
+            policy.rounds       = q_readbyte(in_q);
+            policy.tca          = q_readbyte(in_q);
+            policy.period       = q_readshort(in_q);
+            policy.comp_id      = q_readbyte(in_q);
+            policy.call_id      = q_readbyte(in_q);
+            policy.max_return   = q_readbyte(in_q);
+            policy.channels     = q_readbyte(in_q);
+
+            if ((policy.channels > M2_PARAM(INVCHANNELS)) || \
+                (in_rec->payload_length != (INVENTORY_POLICY + policy.channels))) {
+                error = 255;
+                break;
+            }
+            for (i=0; i<policy.channels; i++) {
+                policy.chanlist[i] = q_readbyte(in_q);
+            }
+            if (m2qp_inv_start(&policy) == False) {
+                error = 255;
+            }
+        } break;
+
+        case INVENTORY_CMD_STOP: {
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+            }
+            else {
+                m2qp_inv_stop();
+            }
+        } break;
+
+        case INVENTORY_CMD_TAGS: {
+            ot_int index, number;
+
+            if (respond == False) {
+                break;
+            }
+            index   = (in_rec->payload_length != 0) ? q_readbyte(in_q) : 0;
+            index   = (index > m2qp.inv.count) ? m2qp.inv.count : index;
+            number  = (ot_int)(out_q->back - out_q->putcursor) - 2;
+            number  = (number < 0) ? 0 : (number / m2qp.inv.length);
+            number  = (number > (m2qp.inv.count - index)) ? (m2qp.inv.count - index) : number;
+
+            /// The payload length is one byte, so 30 8-byte IDs at most
+            number  = (number > (253 / m2qp.inv.length)) ? (253 / m2qp.inv.length) : number;
+            if ((out_q->putcursor + 2) > out_q->back) {
+                error = 255;
+                break;
+            }
+            q_writebyte(out_q, (ot_u8)index);
+            q_writebyte(out_q, (ot_u8)number);
+            out_rec->payload_length = 2 + (number * m2qp.inv.length);
+            while (number-- > 0) {
+                q_writestring(out_q, m2qp.inv.tag[index++], m2qp.inv.length);
+            }
+        } break;
+
+        // Return commands are not handled by the server (ignore)
+        default: return;
+    }
+
+    if (respond) {
+        out_rec->flags  &= ~ALP_FLAG_CF;
+        out_rec->dir_cmd = (in_rec->dir_cmd & 0x7F) | 1;
+        if ((error != 0) || (cmd == INVENTORY_CMD_START) || (cmd == INVENTORY_CMD_STOP)) {
+            out_rec->payload_length = 0;
+            alp_load_retval(True, INVENTORY_CMD_ERROR, error, out_rec, out_q);
+        }
+    }
+}
+
+
+#endif
+
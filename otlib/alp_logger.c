@@ -24,6 +24,12 @@
   * When called by ALP, Logger acts the same way "echo" does.  It echos to the
   * logger output, which by official implementation is always Mpipe.  Therefore,
   * this is one way to send a message to the client connected to a server.
+  *
+  * The echo is not copied when it can be avoided.  If the caller accepts a
+  * payload left in place (out_rec->bookmark is out_q, see alp_record), the 
+  * output payload is the input payload, and NDEF sends it straight from 
+  * dir_in (MPIPE_GATHER).  If the input payload is already where the output
+  * goes (half duplex dir_in and dir_out share memory), it is just kept.
   * 
   ******************************************************************************
   */
@@ -52,7 +58,14 @@ void alp_proc_logger(alp_record* in_rec, alp_record* out_rec, \
         
         // Calling logger echos input queue to output queue.
         // Caller needs to decide what to do with the output queue.
-        if (in_q != out_q) {
+        if (out_rec->bookmark == (void*)out_q) {
+            out_rec->bookmark = (void*)in_q->getcursor;
+        }
+        else if (in_q->getcursor == out_q->putcursor) {
+            out_q->putcursor   += out_rec->payload_length;
+            out_q->length      += out_rec->payload_length;
+        }
+        else if (in_q != out_q) {
             q_writestring(out_q, in_q->getcursor, out_rec->payload_length);
         }                    
     }
@@ -37,34 +37,119 @@
 
 #include "alp.h"
 #include "OTAPI.h"
+#include "ota.h"
+#include "vllog.h"
 
 #if ((OT_FEATURE(ALP) == ENABLED) && (OT_FEATURE(SERVER) == ENABLED))
 
-#define ALP_FILESYSTEM  1
 #define ALP_SENSORS     (OT_FEATURE(SENSORS) == ENABLED)
-#define ALP_SECURITY    ((OT_FEATURE(NL_SECURITY) == ENABLED) || (OT_FEATURE(DLL_SECURITY) == ENABLED))
-#define ALP_LOGGER      (LOG_FEATURE(ANY) == ENABLED)
 #define ALP_DASHFORTH   (OT_FEATURE(DASHFORTH) == ENABLED)
-#define ALP_API         ((OT_FEATURE(ALPAPI) == ENABLED)*3)
+#define ALP_MEMSTATS    (OT_FEATURE(MEMSTATS) == ENABLED)
+#define ALP_INVENTORY   (M2QP_INVENTORY)
+#define ALP_OTA         (OTA_SUPPORT)
+#define ALP_VLLOG       (VLLOG_SUPPORT)
+#define ALP_SECURITY    (OT_FEATURE(SECURITY) == ENABLED)
+#define ALP_LOGGER      (LOG_FEATURE(ANY) == ENABLED)
+#define ALP_API         (OT_FEATURE(ALPAPI) == ENABLED)
 #define ALP_EXT         (OT_FEATURE(ALPEXT) == ENABLED)
 
-
-#define ALP_MAX         9
-#define ALP_FUNCTIONS   (   ALP_FILESYSTEM \
-                          + ALP_SENSORS \
-                          + ALP_SECURITY \
-                          + ALP_LOGGER \
-                          + ALP_DASHFORTH \
-                          + ALP_API \
-                          + ALP_EXT     )
+/// The call table has two contiguous ranges: 0x00-0x09 (standard ALPs) and
+/// 0x80-0x82 (OTAPI ALPs), which are packed together at compile time.
+#define ALP_STD_IDS     (ALP_ID_VLLOG+1)
+#define ALP_API_IDS     (ALP_ID_API_QUERY-ALP_ID_API_SESSION+1)
+#define ALP_FUNCTIONS   (ALP_STD_IDS + ALP_API_IDS)
 
 
-typedef void (*sub_proc)(alp_record*, alp_record*, Queue*, Queue*, id_tmpl*);
 
 void sub_proc_null(alp_record* a0, alp_record* a1, Queue* a2, Queue* a3, id_tmpl* a4) {
 }
 
 
+static const alp_handler alp_table[ALP_FUNCTIONS] = {
+    &sub_proc_null,                         // 0x00: Null
+    &alp_proc_filedata,                     // 0x01: Filesystem
+#   if (ALP_SENSORS)
+    &alp_proc_sensor,                       // 0x02: Sensor Configuration
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_SECURITY)
+    &alp_proc_sec_example,                  // 0x03: Security
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_LOGGER)
+    &alp_proc_logger,                       // 0x04: Logger
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_DASHFORTH)
+    &alp_proc_dashforth,                    // 0x05: DASHForth applets
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_MEMSTATS)
+    &alp_proc_memstats,                     // 0x06: Memory statistics
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_INVENTORY)
+    &alp_proc_inventory,                    // 0x07: Inventory planner
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_OTA)
+    &alp_proc_ota,                          // 0x08: Firmware update
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_VLLOG)
+    &alp_proc_vllog,                        // 0x09: Log files
+#   else
+    &sub_proc_null,
+#   endif
+#   if (ALP_API)
+    &alp_proc_api_session,                  // 0x80: Session API
+    &alp_proc_api_system,                   // 0x81: System API
+    &alp_proc_api_query                     // 0x82: Query API
+#   else
+    &sub_proc_null,
+    &sub_proc_null,
+    &sub_proc_null
+#   endif
+};
+
+
+#if (ALP_EXT)
+typedef struct {
+    ot_u8       dir_id;
+    alp_handler proc;
+} alp_slot;
+
+alp_slot alp_ext[ALP_EXT_SLOTS];
+#endif
+
+
+
+
+ot_u8 sub_table_index(ot_u8 dir_id) {
+/// Compress the two table ranges into a single index.  Out-of-range ID's get
+/// an index >= ALP_FUNCTIONS.
+    if (dir_id >= ALP_ID_API_SESSION) {
+        dir_id -= (ALP_ID_API_SESSION - ALP_STD_IDS);
+        if (dir_id < ALP_STD_IDS) {
+            dir_id = ALP_FUNCTIONS;
+        }
+    }
+    else if (dir_id >= ALP_STD_IDS) {
+        dir_id = ALP_FUNCTIONS;
+    }
+    return dir_id;
+}
+
+
+
+#ifndef EXTF_alp_load_retval
 void alp_load_retval(ot_bool respond, ot_u8 out_dir_cmd, ot_u16 retval, 
                      alp_record* out_rec, Queue* out_q) {
 /// Write back the twobye retval integer when response is enabled
@@ -75,118 +160,80 @@ void alp_load_retval(ot_bool respond, ot_u8 out_dir_cmd, ot_u16 retval,
         q_writeshort(out_q, retval);
     }
 }
+#endif
+
+
+
+#if (ALP_EXT)
+#ifndef EXTF_alp_register
+ot_bool alp_register(ot_u8 dir_id, alp_handler proc) {
+    ot_u8    i;
+    alp_slot* free_slot = NULL;
+    ot_u8    dir_i      = sub_table_index(dir_id);
+
+    /// Built-in processors and the Null ALP cannot be displaced
+    if ((dir_id == ALP_ID_NULL) || \
+        ((dir_i < ALP_FUNCTIONS) && (alp_table[dir_i] != &sub_proc_null))) {
+        return False;
+    }
+
+    /// Replace (or remove) an existing registration, else use a free slot.
+    /// Empty slots have proc == NULL.
+    for (i=0; i<ALP_EXT_SLOTS; i++) {
+        if (alp_ext[i].proc == NULL) {
+            if (free_slot == NULL) {
+                free_slot = &alp_ext[i];
+            }
+        }
+        else if (alp_ext[i].dir_id == dir_id) {
+            alp_ext[i].proc = proc;
+            return True;
+        }
+    }
+
+    if (proc == NULL) {
+        return True;
+    }
+    if (free_slot == NULL) {
+        return False;
+    }
+    free_slot->dir_id   = dir_id;
+    free_slot->proc     = proc;
+    return True;
+}
+#endif
+#endif
+
 
   
+#ifndef EXTF_alp_proc
 void alp_proc(alp_record* in_rec, alp_record* out_rec, \
                 Queue* in_q, Queue* out_q, id_tmpl* user_id) {
-    
     ot_u8       dir_i;
-    sub_proc    proc = &sub_proc_null;
+    alp_handler proc;
     
-    // 0x80 directives are OTAPI, but they are compressed into the call table
     out_rec->dir_id = in_rec->dir_id;
-    dir_i           = in_rec->dir_id;
-    
-    if (in_rec->dir_id >= 0x80) {
-        dir_i -= (0x80-ALP_FILESYSTEM-ALP_SENSORS-ALP_SECURITY-ALP_LOGGER-ALP_DASHFORTH-1);
-    }
+    dir_i           = sub_table_index(in_rec->dir_id);
+    proc            = (dir_i < ALP_FUNCTIONS) ? alp_table[dir_i] : &sub_proc_null;
     
-    switch (dir_i) {
-        case 0: //Null ALP would go here, if it needs to
-            break;
-        
-        case 1: //Filesystem ALP
-            proc = &alp_proc_filedata;
-            break;
-        
-#       if (OT_FEATURE(SENSORS) == ENABLED)
-        case (1+ALP_FILESYSTEM):
-            break;
-#       endif
-        
-#       if (OT_FEATURE(SECURITY) == ENABLED)
-        case (1+ALP_FILESYSTEM+ALP_SENSORS):
-            break;
-#       endif
-        
-#       if (LOG_FEATURE(ANY) == ENABLED)
-        case (1+ALP_FILESYSTEM+ALP_SENSORS+ALP_SECURITY):
-            break;
-#       endif
-        
-#       if (OT_FEATURE(DASHFORTH) == ENABLED)
-        case (1+ALP_FILESYSTEM+ALP_SENSORS+ALP_SECURITY+ALP_LOGGER+ALP_DASHFORTH):
-            break;
-#       endif
-        
-#       if (OT_FEATURE(ALPAPI) == ENABLED)
-        case (1+ALP_FILESYSTEM+ALP_SENSORS+ALP_SECURITY+ALP_LOGGER+ALP_DASHFORTH):
-            proc = &alp_proc_api_session;
-            break;
-        
-        case (2+ALP_FILESYSTEM+ALP_SENSORS+ALP_SECURITY+ALP_LOGGER+ALP_DASHFORTH):
-            proc = &alp_proc_api_system;
-            break;
-        
-        case (3+ALP_FILESYSTEM+ALP_SENSORS+ALP_SECURITY+ALP_LOGGER+ALP_DASHFORTH):
-            proc = &alp_proc_api_query;
-            break;
-#       endif
-
-        default:
-#       if (OT_FEATURE(ALPEXT) == ENABLED)
-            proc = &otapi_alpext_proc;
-#       else
-            proc = &sub_proc_null;
-#       endif
-            break;
+#   if (ALP_EXT)
+    /// Unhandled ID's go to registered handlers, then to the catch-all
+    if ((proc == &sub_proc_null) && (in_rec->dir_id != ALP_ID_NULL)) {
+        ot_u8 i;
+        proc = &otapi_alpext_proc;
+        for (i=0; i<ALP_EXT_SLOTS; i++) {
+            if ((alp_ext[i].proc != NULL) && (alp_ext[i].dir_id == in_rec->dir_id)) {
+                proc = alp_ext[i].proc;
+                break;
+            }
+        }
     }
-    
-    proc(in_rec, out_rec, in_q, out_q, user_id);
-    
-    
-    /*
-    const sub_proc proc[ALP_FUNCTIONS] = { 
-#   if (1)
-        &alp_proc_filedata,                     // 0x01 -> 0
-#   endif
-#   if (OT_FEATURE(SENSORS) == ENABLED)
-        &alp_proc_sensors,                      // 0x02 -> 1
-#   endif
-#   if (OT_FEATURE(SECURITY) == ENABLED)        
-        &alp_proc_security,                     // 0x03 -> 2
-#   endif
-#   if (LOG_FEATURE(ANY) == ENABLED)
-        &alp_proc_logger,                       // 0x04 -> 3
-#   endif
-#   if (OT_FEATURE(DASHFORTH) == ENABLED)
-        &alp_proc_dashforth,                    // 0x05 -> 4
-#   endif
-
-#   if (OT_FEATURE(ALPAPI) == ENABLED)
-        &alp_proc_api_session,                 // 0x80 -> 5
-        &alp_proc_api_system,                  // 0x81 -> 6
-        &alp_proc_api_query                    // 0x82 -> 7
-#   else
-        &sub_proc_null,
-        &sub_proc_null,
-        &sub_proc_null
 #   endif
-
-};
     
-    // 0x80 directives are OTAPI, but they are compressed into the call table
-    ot_u8 dir_i;
-    out_rec->dir_id = in_rec->dir_id;
-    dir_i          -= (in_rec->dir_id >= 0x80) ? (0x80-4) : 1;
-    
-    // Prevent segmentation fault
-    if (dir_i < ALP_FUNCTIONS) {
-        // The proc function will sort-out the rest of the out_rec attributes
-        proc[dir_i](in_rec, out_rec, in_q, out_q, user_id);
-    }
-    */
+    // The proc function will sort-out the rest of the out_rec attributes
+    proc(in_rec, out_rec, in_q, out_q, user_id);
 }
+#endif
 
 
 #endif
@@ -0,0 +1,147 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/alp_memstats.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      ALP to Memory Statistics processor
+  * @ingroup    ALP
+  *
+  * ALP access to the RAM high-water marks of the kernel (OT_FEATURE_MEMSTATS
+  * in system.h), for sizing the buffers, the session stack and the veelite
+  * file pointers of an app, and to the flash wear of VWORM (vworm_stats and
+  * vworm_wear() in veelite_core.h).
+  *
+  * Directive Command Field:
+  * b7:     Respond Bit     0 don't respond
+  *                         1 Respond with directive return template
+  *
+  * b3-0:   Operand         0000: Read Statistics
+  *                         0001: Return Statistics
+  *                         0010: Clear Marks (root)
+  *                         0100: Read Flash Wear
+  *                         0101: Return Flash Wear
+  *                         1111: Return Error
+  *
+  * Statistics:     the SYS_MEM_RECORD bytes of sys_mem_write()
+  * Flash Wear:     [pages: 2] [least erases of a page: 2] [most erases: 2]
+  *                 [erases: 4] [recombines: 4] [rewrites: 4]
+  * Return Error:   [error: 2], 0 is no error
+  *
+  * Clear starts the queue, session and file pointer marks over.  The stack
+  * mark stays, as the stack is only painted at boot.
+  *
+  ******************************************************************************
+  */
+
+
+#include "alp.h"
+
+#if (   (OT_FEATURE(SERVER) == ENABLED) \
+     && (OT_FEATURE(ALP) == ENABLED) \
+     && (OT_FEATURE(MEMSTATS) == ENABLED) )
+
+#include "auth.h"
+#include "queue.h"
+#include "system.h"
+#include "veelite_core.h"
+
+
+#define MEMSTATS_CMD_READ   0x00
+#define MEMSTATS_CMD_CLEAR  0x02
+#define MEMSTATS_CMD_WEAR   0x04
+#define MEMSTATS_CMD_ERROR  0x0F
+
+#define MEMSTATS_WEAR       18
+
+
+void alp_proc_memstats(alp_record* in_rec, alp_record* out_rec,
+                        Queue* in_q, Queue* out_q, id_tmpl* user_id    ) {
+    ot_bool respond = (ot_bool)(in_rec->dir_cmd & 0x80);
+    ot_u8   cmd     = in_rec->dir_cmd & 0x0F;
+    ot_u16  error   = 0;
+
+    out_rec->payload_length = 0;
+
+    switch (cmd) {
+        case MEMSTATS_CMD_READ: {
+            ot_int length;
+            if (respond == False) {
+                break;
+            }
+            if ((out_q->putcursor + SYS_MEM_RECORD) > out_q->back) {
+                error = 255;
+                break;
+            }
+            length                  = sys_mem_write(out_q->putcursor);
+            out_q->putcursor       += length;
+            out_q->length          += length;
+            out_rec->payload_length = (ot_u8)length;
+        } break;
+
+        case MEMSTATS_CMD_CLEAR: {
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+            }
+            else {
+                sys_mem_clear();
+            }
+        } break;
+
+        case MEMSTATS_CMD_WEAR: {
+            ot_u16  least   = 0xFFFF;
+            ot_u16  most    = 0;
+            ot_int  i;
+
+            if (respond == False) {
+                break;
+            }
+            if ((out_q->putcursor + MEMSTATS_WEAR) > out_q->back) {
+                error = 255;
+                break;
+            }
+            for (i=0; i<VWORM_NUM_PAGES; i++) {
+                ot_u16 wear = vworm_wear(i);
+                least       = (wear < least) ? wear : least;
+                most        = (wear > most) ? wear : most;
+            }
+            q_writeshort(out_q, VWORM_NUM_PAGES);
+            q_writeshort(out_q, (most < least) ? 0 : least);
+            q_writeshort(out_q, most);
+            q_writelong(out_q, vworm_stats.erases);
+            q_writelong(out_q, vworm_stats.recombines);
+            q_writelong(out_q, vworm_stats.rewrites);
+            out_rec->payload_length = MEMSTATS_WEAR;
+        } break;
+
+        // Return commands are not handled by the server (ignore)
+        default: return;
+    }
+
+    if (respond) {
+        out_rec->flags  &= ~ALP_FLAG_CF;
+        out_rec->dir_cmd = (in_rec->dir_cmd & 0x7F) | 1;
+        if ((error != 0) || (cmd == MEMSTATS_CMD_CLEAR)) {
+            out_rec->payload_length = 0;
+            alp_load_retval(True, MEMSTATS_CMD_ERROR, error, out_rec, out_q);
+        }
+    }
+}
+
+
+#endif
+
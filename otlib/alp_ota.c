@@ -0,0 +1,146 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/alp_ota.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      ALP to Firmware Update processor
+  * @ingroup    ALP
+  *
+  * ALP control of the over-the-air firmware update (OT_FEATURE_OTA in ota.h).
+  * The gateway opens the transfer, streams the image into ISF_ID(ota_image)
+  * from the frame that the status gives, and then verifies and applies it.
+  *
+  * Directive Command Field:
+  * b7:     Respond Bit     0 don't respond
+  *                         1 Respond with directive return template
+  *
+  * b3-0:   Operand         0000: Read Status
+  *                         0001: Return Status
+  *                         0010: Open (root), returns Status
+  *                         0011: Verify (root), returns Status
+  *                         0100: Apply (root)
+  *                         1111: Return Error
+  *
+  * Status:         [state] [error] [bytes per frame] [frames: 2]
+  *                 [frames received: 2] [first missing frame: 2]
+  * Open:           [bytes per frame] [frames: 2]
+  * Return Error:   [error: 2], 0 is no error
+  *
+  * Apply only returns an error: when it works, the device resets into the new
+  * firmware on most platforms.
+  *
+  ******************************************************************************
+  */
+
+
+#include "alp.h"
+#include "ota.h"
+
+#if (   (OT_FEATURE(SERVER) == ENABLED) \
+     && (OT_FEATURE(ALP) == ENABLED) \
+     && (OTA_SUPPORT) )
+
+#include "auth.h"
+#include "queue.h"
+
+
+#define OTA_CMD_READ        0x00
+#define OTA_CMD_OPEN        0x02
+#define OTA_CMD_VERIFY      0x03
+#define OTA_CMD_APPLY       0x04
+#define OTA_CMD_ERROR       0x0F
+
+#define OTA_STATUS          9
+
+
+void alp_proc_ota(alp_record* in_rec, alp_record* out_rec,
+                        Queue* in_q, Queue* out_q, id_tmpl* user_id    ) {
+    ot_bool respond = (ot_bool)(in_rec->dir_cmd & 0x80);
+    ot_u8   cmd     = in_rec->dir_cmd & 0x0F;
+    ot_u16  error   = 0;
+
+    out_rec->payload_length = 0;
+
+    switch (cmd) {
+        case OTA_CMD_READ:
+            break;
+
+        case OTA_CMD_OPEN: {
+            ot_u8   seg_bytes;
+            ot_u16  blocks;
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+                break;
+            }
+            if (in_rec->payload_length != 3) {
+                error = 255;
+                break;
+            }
+            seg_bytes   = q_readbyte(in_q);
+            blocks      = q_readshort(in_q);
+            if (ota_open(seg_bytes, blocks) < 0) {
+                error = 255;
+            }
+        } break;
+
+        case OTA_CMD_VERIFY: {
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+            }
+            else {
+                ota_verify();
+            }
+        } break;
+
+        case OTA_CMD_APPLY: {
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+            }
+            else {
+                error = ota_apply();
+            }
+        } break;
+
+        // Return commands are not handled by the server (ignore)
+        default: return;
+    }
+
+    if (respond) {
+        out_rec->flags  &= ~ALP_FLAG_CF;
+        out_rec->dir_cmd = (in_rec->dir_cmd & 0x70) | 1;
+        if ((error != 0) || (cmd == OTA_CMD_APPLY)) {
+            alp_load_retval(True, OTA_CMD_ERROR, error, out_rec, out_q);
+        }
+        else if ((out_q->putcursor + OTA_STATUS) > out_q->back) {
+            alp_load_retval(True, OTA_CMD_ERROR, 255, out_rec, out_q);
+        }
+        else {
+            q_writebyte(out_q, ota.state);
+            q_writebyte(out_q, ota.error);
+            q_writebyte(out_q, ota.seg_bytes);
+            q_writeshort(out_q, ota.blocks);
+            q_writeshort(out_q, ota.received);
+            q_writeshort(out_q, ota_missing());
+            out_rec->payload_length = OTA_STATUS;
+        }
+    }
+}
+
+
+#endif
+
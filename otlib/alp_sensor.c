@@ -21,7 +21,29 @@
   * @brief      ALP to Sensor protocol processor
   * @ingroup    ALP
   *
-  * Placeholder for future sensor protocol ALP wrapper
+  * ALP access to the sensor pipeline of the External module (external.h).
+  *
+  * Directive Command Field:
+  * b7:     Respond Bit     0 don't respond
+  *                         1 Respond with directive return template
+  *
+  * b3-0:   Operand         0000: Read Status
+  *                         0001: Return Status
+  *                         0100: Read Samples
+  *                         0101: Return Samples
+  *                         0110: Flush Samples to File (root)
+  *                         0111: Write Sample Period (root)
+  *                         1111: Return Error
+  *
+  * Status:         [seq: 2] [capacity: 2] [channels: 1]
+  * Read Samples:   [first seq: 2] [max records: 1]
+  * Return Samples: [first seq: 2] [channels: 1] [records: 1] [values: 2 each]
+  * Write Period:   [ticks: 2], 0 stops sampling
+  * Return Error:   [error: 2], 0 is no error
+  *
+  * A window read costs one record header and two bytes per value, and the
+  * records are read straight from the ring file (or from RAM when they are
+  * not flushed yet), so a client can poll the new records at any rate.
   * 
   ******************************************************************************
   */
@@ -38,10 +60,85 @@
 #include "queue.h"
 
 
-// No implementaton yet!
+#define SENSOR_CMD_STATUS   0x00
+#define SENSOR_CMD_READ     0x04
+#define SENSOR_CMD_FLUSH    0x06
+#define SENSOR_CMD_PERIOD   0x07
+#define SENSOR_CMD_ERROR    0x0F
+
+
 void alp_proc_sensor(alp_record* in_rec, alp_record* out_rec, 
                         Queue* in_q, Queue* out_q, id_tmpl* user_id    ) {
+    ot_bool respond = (ot_bool)(in_rec->dir_cmd & 0x80);
+    ot_u8   cmd     = in_rec->dir_cmd & 0x0F;
+    ot_u16  error   = 0;
+    
+    out_rec->payload_length = 0;
+
+    switch (cmd) {
+        case SENSOR_CMD_STATUS: {
+            if (respond) {
+                q_writeshort(out_q, ext_sensor_seq());
+                q_writeshort(out_q, ext_sensor_capacity());
+                q_writebyte(out_q, EXT_SENSOR_CHANNELS);
+                out_rec->payload_length = 5;
+            }
+        } break;
+        
+        case SENSOR_CMD_READ: {
+            ot_u16  seq     = q_readshort(in_q);
+            ot_u8   count   = q_readbyte(in_q);
+            ot_u8*  head    = out_q->putcursor;
+            ot_int  records;
+            
+            if (respond == False) {
+                break;
+            }
+            if ((out_q->putcursor + 4) >= out_q->back) {
+                error = 255;
+                break;
+            }
+            out_q->putcursor   += 4;
+            out_q->length      += 4;
+            records             = ext_sensor_read(&seq, count, out_q, user_id);
+            if (records < 0) {
+                out_q->putcursor    = head;
+                out_q->length      -= 4;
+                error               = 5;    // access denied, or no file
+                break;
+            }
+            head[0]                 = (ot_u8)(seq >> 8);
+            head[1]                 = (ot_u8)seq;
+            head[2]                 = EXT_SENSOR_CHANNELS;
+            head[3]                 = (ot_u8)records;
+            out_rec->payload_length = 4 + (records * EXT_SENSOR_RECBYTES);
+        } break;
+        
+        case SENSOR_CMD_FLUSH:
+        case SENSOR_CMD_PERIOD: {
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+            }
+            else if (cmd == SENSOR_CMD_PERIOD) {
+                ext_sensor_period(q_readshort(in_q));
+            }
+            else {
+                error = ext_sensor_flush();
+            }
+        } break;
+        
+        // Return commands are not handled by the server (ignore)
+        default: return;
+    }
     
+    if (respond) {
+        out_rec->flags  &= ~ALP_FLAG_CF;
+        out_rec->dir_cmd = (in_rec->dir_cmd & 0x7F) | 1;
+        if ((error != 0) || (cmd >= SENSOR_CMD_FLUSH)) {
+            out_rec->payload_length = 0;
+            alp_load_retval(True, SENSOR_CMD_ERROR, error, out_rec, out_q);
+        }
+    }
 }
 
 
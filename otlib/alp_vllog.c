@@ -0,0 +1,186 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/alp_vllog.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      ALP to Log File processor
+  * @ingroup    ALP
+  *
+  * ALP access to the append-only log files (OT_FEATURE_VLLOG in vllog.h).  A
+  * client reads a range of records by sequence number, and it can start from
+  * the last record it has, so it only gets the ones that are new.  The app
+  * attaches the log files with vllog_open().
+  *
+  * Directive Command Field:
+  * b7:     Respond Bit     0 don't respond
+  *                         1 Respond with directive return template
+  *
+  * b6-4:   File Block      001 GFB
+  *                         010 ISFSB (Series)
+  *                         011 ISFB
+  *
+  * b3-0:   Operand         0000: Read Status
+  *                         0001: Return Status
+  *                         0010: Clear (root)
+  *                         0100: Read Records
+  *                         0101: Return Records
+  *                         1111: Return Error
+  *
+  * Read Status:    [file id]
+  * Status:         [file id] [record bytes] [segments] [records per segment: 2]
+  *                 [first: 4] [next: 4]
+  * Clear:          [file id]
+  * Read Records:   [file id] [first: 4] [number of records]
+  * Return Records: [file id] [first: 4] [number of records] [records], as many
+  *                 as fit.  The first moves up to the oldest record that is
+  *                 still in the log, and void records are all 0xFF.
+  * Return Error:   [error: 2], 0 is no error, 1 is a file that is not a log
+  *
+  ******************************************************************************
+  */
+
+
+#include "alp.h"
+#include "vllog.h"
+
+#if (   (OT_FEATURE(SERVER) == ENABLED) \
+     && (OT_FEATURE(ALP) == ENABLED) \
+     && (VLLOG_SUPPORT) )
+
+#include "auth.h"
+#include "queue.h"
+
+
+#define VLLOG_CMD_READ      0x00
+#define VLLOG_CMD_CLEAR     0x02
+#define VLLOG_CMD_RECORDS   0x04
+#define VLLOG_CMD_ERROR     0x0F
+
+#define VLLOG_STATUS        15
+#define VLLOG_RECHEAD       6
+
+
+void alp_proc_vllog(alp_record* in_rec, alp_record* out_rec,
+                        Queue* in_q, Queue* out_q, id_tmpl* user_id    ) {
+    ot_bool         respond = (ot_bool)(in_rec->dir_cmd & 0x80);
+    ot_u8           cmd     = in_rec->dir_cmd & 0x0F;
+    ot_u16          error   = 0;
+    ot_u8           file_id = 0;
+    ot_int          log_id  = -1;
+    vllog_struct*   log;
+
+    out_rec->payload_length = 0;
+
+    if ((cmd == VLLOG_CMD_READ) || (cmd == VLLOG_CMD_CLEAR) || (cmd == VLLOG_CMD_RECORDS)) {
+        if (in_rec->payload_length == 0) {
+            error = 255;
+            goto alp_proc_vllog_RESPOND;
+        }
+        file_id = q_readbyte(in_q);
+        log_id  = vllog_find((vlBLOCK)((in_rec->dir_cmd >> 4) & 0x07), file_id);
+        if (log_id < 0) {
+            error = 1;
+            goto alp_proc_vllog_RESPOND;
+        }
+    }
+    log = vllog_get(log_id);
+
+    switch (cmd) {
+        case VLLOG_CMD_READ: {
+            if (respond == False) {
+                break;
+            }
+            if ((out_q->putcursor + VLLOG_STATUS) > out_q->back) {
+                error = 255;
+                break;
+            }
+            q_writebyte(out_q, file_id);
+            q_writebyte(out_q, log->rec_bytes);
+            q_writebyte(out_q, OT_PARAM(VLLOG_SEGS));
+            q_writeshort(out_q, log->per_seg);
+            q_writelong(out_q, vllog_first(log_id));
+            q_writelong(out_q, log->next);
+            out_rec->payload_length = VLLOG_STATUS;
+        } break;
+
+        case VLLOG_CMD_CLEAR: {
+            if (auth_isroot(user_id) == False) {
+                error = 5;
+            }
+            else if (vllog_clear(log_id) != 0) {
+                error = 255;
+            }
+        } break;
+
+        case VLLOG_CMD_RECORDS: {
+            ot_u8*  head;
+            ot_u32  seq;
+            ot_uint count;
+            ot_int  number;
+
+            if (respond == False) {
+                break;
+            }
+            if ((in_rec->payload_length != VLLOG_RECHEAD) || \
+                ((out_q->putcursor + VLLOG_RECHEAD) > out_q->back)) {
+                error = 255;
+                break;
+            }
+            seq     = q_readlong(in_q);
+            count   = q_readbyte(in_q);
+
+            /// The payload length is one byte, and the head goes in last, when
+            /// the range is known
+            if (count > ((255 - VLLOG_RECHEAD) / log->rec_bytes)) {
+                count = (255 - VLLOG_RECHEAD) / log->rec_bytes;
+            }
+            head                = out_q->putcursor;
+            out_q->putcursor   += VLLOG_RECHEAD;
+            number              = vllog_read(log_id, &seq, count, out_q, user_id);
+            if (number < 0) {
+                out_q->putcursor    = head;
+                error               = 4;
+                break;
+            }
+            head[0] = file_id;
+            head[1] = (ot_u8)(seq >> 24);
+            head[2] = (ot_u8)(seq >> 16);
+            head[3] = (ot_u8)(seq >> 8);
+            head[4] = (ot_u8)seq;
+            head[5] = (ot_u8)number;
+            out_rec->payload_length = VLLOG_RECHEAD + (number * log->rec_bytes);
+        } break;
+
+        // Return commands are not handled by the server (ignore)
+        default: return;
+    }
+
+    alp_proc_vllog_RESPOND:
+    if (respond) {
+        out_rec->flags  &= ~ALP_FLAG_CF;
+        out_rec->dir_cmd = (in_rec->dir_cmd & 0x7F) | 1;
+        if ((error != 0) || (cmd == VLLOG_CMD_CLEAR)) {
+            out_rec->payload_length = 0;
+            alp_load_retval(True, VLLOG_CMD_ERROR, error, out_rec, out_q);
+        }
+    }
+}
+
+
+#endif
+
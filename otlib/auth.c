@@ -36,10 +36,10 @@
 #include "crypto_aes128.h"
 
 
-#define _SEC_NL     0 //OT_FEATURE(NLSECURITY)
-#define _SEC_DLL    0 //OT_FEATURE(DLLSECURITY)
-#define _SEC_ALL    0 //(_SEC_NL && _SEC_DLL)
-#define _SEC_ANY    0 //(_SEC_NL || _SEC_DLL)
+#define _SEC_NL     OT_FEATURE(NL_SECURITY)
+#define _SEC_DLL    OT_FEATURE(DLL_SECURITY)
+#define _SEC_ALL    (_SEC_NL && _SEC_DLL)
+#define _SEC_ANY    (_SEC_NL || _SEC_DLL)
 
 #define AUTH_HEAP_SIZE 0
 
@@ -49,32 +49,61 @@ const id_tmpl*   auth_guest;
 
 
 
-/** @typedef crypto_Heap_Type
-  * Struct used for the Key Heap Data Type
-  *
-  * ot_uint end:            byte offset to end of heap where there is free space
-  * ot_u8   heapdata[]:     heap data storage.  Stores crypto_Entries mixed with
-  *                         key data. 
+/** @typedef auth_store
+  * Storage for the ID and key of a user table entry.  The auth_entry at the
+  * same index points into it.
   */
 typedef struct {
-    ot_u8   alloc;
     id_tmpl id;
-} heap_item;
+    ot_u8   idval[8];
+    ot_u8   key[AUTH_DLLS_KEYBYTES];
+} auth_store;
+
 
+#define _SEC_TABLESIZE  AUTH_TABLE_SIZE
+#define _SEC_HASHSIZE   AUTH_HASH_SIZE
 
-#define _SEC_HEAPSIZE   ((16+sizeof(heap_item))*2)  //OT_PARAM(AUTH_HEAP_SIZE)
-#define _SEC_TABLESIZE  2   //OT_PARAM(AUTH_TABLE_SIZE)
+#if ((_SEC_HASHSIZE & (_SEC_HASHSIZE-1)) || (_SEC_HASHSIZE <= _SEC_TABLESIZE))
+#   error "AUTH_HASH_SIZE must be a power of two, and larger than AUTH_TABLE_SIZE"
+#endif
 
+
+/** @typedef auth_dllskey
+  * A slot of the DLLS key table: a key from the root (user=0) or user (user=1)
+  * key ISF, and its schedule.  Keys from the ISFs never expire by themselves
+  * (AUTH_LIFETIME_STATIC), but the slots are kept in lifetime order so that 
+  * crypto_cull() can drop keys that do.
+  */
 typedef struct {
-    ot_int free_space;
-    ot_int end;
-    ot_u8  data[_SEC_HEAPSIZE];
-} auth_heap_struct;
+    ot_u32  lifetime;
+    ot_u8   user;
+    ot_u8   protocol;
+    ot_u32  key[AUTH_DLLS_KEYBYTES/4];
+    ot_u32  schedule[AES_EXPKEY_SIZE];
+} auth_dllskey;
 
+typedef struct {
+    ot_u16          stamp;
+    ot_int          used;
+    ot_s8           index[2][AUTH_DLLS_PROTOCOLS];
+    auth_dllskey    slot[AUTH_DLLS_SLOTS];
+} auth_dlls_struct;
+
+
+#if (_SEC_DLL)
+    auth_dlls_struct  auth_dlls;
+#endif
 
+/// The user table: auth_hash[] holds the table index of each user at (or
+/// probing on from) the hash of its ID, or -1.  auth_mask[] is the access 
+/// mask each user gets, worked out when the user is added.
 #if (_SEC_ANY)
     auth_entry        auth_table[_SEC_TABLESIZE];
-    auth_heap_struct  auth_heap;
+    auth_store        auth_userdata[_SEC_TABLESIZE];
+    ot_u8             auth_mask[_SEC_TABLESIZE];
+    ot_s8             auth_hash[_SEC_HASHSIZE];
+    ot_int            auth_users;
+    ot_u32            auth_schedule[_SEC_TABLESIZE][AES_EXPKEY_SIZE];
 #endif
 
 
@@ -114,14 +143,89 @@ void crypto_clean();
 
 
 void auth_init() { 
-#if (_SEC_NLS)
-///@todo
+#if (_SEC_ANY)
+    auth_users = 0;
+    platform_memset((ot_u8*)auth_hash, 0xFF, sizeof(auth_hash));
+#endif
+#if (_SEC_DLL)
+    crypto_clean();
 #endif
 }
 
 
 
 
+#if (_SEC_DLL)
+void sub_dlls_load(ot_u8 user) {
+/// Copies each record of one key ISF into a free slot.  Records with a 
+/// protocol ID that is not indexed, or a duplicate of one already loaded,
+/// are skipped.  Keys shorter than 16 bytes are zero-padded.
+    vlFILE*         fp;
+    auth_dllskey*   slot;
+    ot_uint         cursor;
+    ot_int          i;
+    
+    fp = ISF_open_su(ISF_ID(root_authentication_key) + user);
+    if (fp == NULL) {
+        return;
+    }
+    
+    for (cursor=0; (cursor<fp->length) && (auth_dlls.used<AUTH_DLLS_SLOTS); ) {
+        Twobytes scratch;
+        scratch.ushort  = vl_read(fp, cursor);
+        cursor         += 2;
+        
+        if ((scratch.ubyte[1] < AUTH_DLLS_PROTOCOLS) && \
+            (auth_dlls.index[user][scratch.ubyte[1]] < 0)) {
+            slot            = &auth_dlls.slot[auth_dlls.used];
+            slot->lifetime  = AUTH_LIFETIME_STATIC;
+            slot->user      = user;
+            slot->protocol  = scratch.ubyte[1];
+            
+            for (i=0; i<AUTH_DLLS_KEYBYTES; i+=2) {
+                ((ot_u16*)slot->key)[i>>1] = (i < scratch.ubyte[0]) ? \
+                                                vl_read(fp, cursor+i) : 0;
+            }
+            AES_ccm_keyschedule(slot->key, slot->schedule);
+            auth_dlls.index[user][slot->protocol] = (ot_s8)auth_dlls.used;
+            auth_dlls.used++;
+        }
+        cursor += scratch.ubyte[0];
+    }
+    
+    vl_close(fp);
+}
+
+
+auth_dllskey* sub_dlls_find(ot_u8 protocol) {
+/// The table is only reloaded when a key ISF has changed.  Otherwise this is
+/// a direct index by user and protocol.
+    ot_u16  stamp   = (ot_u16)(vl_keystamp + vl_mapstamp);
+    ot_u8   user    = ((protocol & AUTH_FLAG_ISROOT) == 0);
+    ot_s8   i;
+    
+    if (auth_dlls.stamp != stamp) {
+        auth_dlls.stamp = stamp;
+        auth_dlls.used  = 0;
+        platform_memset((ot_u8*)auth_dlls.index, 0xFF, sizeof(auth_dlls.index));
+        sub_dlls_load(0);
+        sub_dlls_load(1);
+        crypto_sort();
+    }
+    crypto_cull();
+    
+    protocol &= ~(AUTH_FLAG_ISGLOBAL | AUTH_FLAG_ISROOT);
+    if (protocol >= AUTH_DLLS_PROTOCOLS) {
+        return NULL;
+    }
+    i = auth_dlls.index[user][protocol];
+    return (i < 0) ? NULL : &auth_dlls.slot[i];
+}
+#endif
+
+
+
+
 ot_bool sub_idcmp(id_tmpl* user_id, auth_entry* auth_id) {
     //ot_int i;
     ot_bool id_check = True;
@@ -142,13 +246,57 @@ ot_bool sub_idcmp(id_tmpl* user_id, auth_entry* auth_id) {
 
 
 
+#if (_SEC_ANY)
+ot_int sub_idhash(id_tmpl* user_id) {
+/// XOR-folds the 2 or 8 byte ID down to a hash index
+    ot_u16 hash = ((ot_u16*)user_id->value)[0];
+
+    if (user_id->length == 8) {
+        hash ^= ((ot_u16*)user_id->value)[1];
+        hash ^= ((ot_u16*)user_id->value)[2];
+        hash ^= ((ot_u16*)user_id->value)[3];
+    }
+    hash ^= (hash >> 8);
+
+    return (ot_int)(hash & (_SEC_HASHSIZE-1));
+}
+
+
+ot_int sub_user_find(id_tmpl* user_id) {
+/// Linear probing from the hash of the ID.  The hash has more slots than the
+/// table has entries, so an empty slot always ends the probe.
+    ot_int slot = sub_idhash(user_id);
+    ot_s8  i;
+
+    while ((i = auth_hash[slot]) >= 0) {
+        if (sub_idcmp(user_id, &auth_table[i])) {
+            return i;
+        }
+        slot = (slot + 1) & (_SEC_HASHSIZE-1);
+    }
+    return -1;
+}
+
+
+void sub_hash_insert(ot_int i) {
+    ot_int slot = sub_idhash(auth_table[i].id);
+
+    while (auth_hash[slot] >= 0) {
+        slot = (slot + 1) & (_SEC_HASHSIZE-1);
+    }
+    auth_hash[slot] = (ot_s8)i;
+}
+#endif
+
+
+
 ot_bool auth_isroot(id_tmpl* user_id) {
 /// NULL is how root is implemented in internal calls
 #if (_SEC_ANY)
     if (user_id == NULL) {
         return True;
     }
-    return (ot_bool)auth_search_user(user_id, AUTH_FLAG_ISROOT);
+    return (ot_bool)(auth_search_user(user_id, AUTH_FLAG_ISROOT) != NULL);
     
 #else
     return (ot_bool)(user_id == NULL);
@@ -159,81 +307,206 @@ ot_bool auth_isroot(id_tmpl* user_id) {
 
 ot_u8 auth_check(ot_u8 data_mod, ot_u8 req_mod, id_tmpl* user_id) {
 #if (_SEC_ANY)
-/// Find the ID in the table, then mask the user's mod with the file's mod
-/// and the mod from the request (i.e. read, write).
-    return (ot_u8)auth_search_user(user_id, (data_mod & req_mod));
+/// Find the ID in the table, then mask the user's access mask with the file's
+/// mod and the mod from the request (i.e. read, write).
+    ot_int i = sub_user_find(user_id);
     
-#else
+    if (i >= 0) {
+        return (auth_mask[i] & data_mod & req_mod);
+    }
+#endif
+
 /// If the code gets here then there was not a user match, or the device is not
 /// implementing user authentication.  Try guest access.
-    return (0x07 & data_mod & req_mod);
-#endif
+    return (VL_ACCESS_GUEST & data_mod & req_mod);
 }
 
 
 
 
 auth_entry* auth_new_nlsuser(auth_entry* new_user, ot_u8* new_data) {
-#if (_SEC_NLS)
-#endif
+#if (_SEC_ANY)
+/// An existing user is updated in place.  A new user takes a free entry, or
+/// else replaces the user whose key expires soonest, and then the hash index
+/// is rebuilt because that user's ID is gone.
+    auth_entry* entry;
+    auth_store* store;
+    ot_bool     rebuild = False;
+    ot_u8       idlen;
+    ot_int      i;
+
+    idlen = new_user->id->length;
+    if ((idlen != 2) && (idlen != 8)) {
+        return NULL;
+    }
+
+    i = sub_user_find(new_user->id);
+    if (i < 0) {
+        if (auth_users < _SEC_TABLESIZE) {
+            i = auth_users++;
+        }
+        else {
+            ot_int j;
+            for (i=0, j=1; j<_SEC_TABLESIZE; j++) {
+                if (auth_table[j].lifetime < auth_table[i].lifetime) {
+                    i = j;
+                }
+            }
+            rebuild = True;
+        }
+    }
+
+    entry               = &auth_table[i];
+    store               = &auth_userdata[i];
+    store->id.length    = idlen;
+    store->id.value     = store->idval;
+    platform_memcpy(store->idval, new_user->id->value, idlen);
+    platform_memcpy(store->key, new_data, AUTH_DLLS_KEYBYTES);
+
+    entry->mod          = new_user->mod;
+    entry->protocol     = new_user->protocol;
+    entry->lifetime     = new_user->lifetime;
+    entry->id           = &store->id;
+    entry->key          = store->key;
+    entry->schedule     = NULL;
+    auth_mask[i]        = (entry->mod & AUTH_FLAG_ISROOT) ? VL_ACCESS_SU : \
+                            (VL_ACCESS_GUEST | (entry->mod & VL_ACCESS_SU));
+
+    /// A new entry probes to its spot.  A replaced entry needs the whole index
+    /// rebuilt, which is cheap because the table is small.
+    if (rebuild) {
+        platform_memset((ot_u8*)auth_hash, 0xFF, sizeof(auth_hash));
+        for (i=0; i<auth_users; i++) {
+            sub_hash_insert(i);
+        }
+    }
+    else if (sub_user_find(entry->id) < 0) {
+        sub_hash_insert(i);
+    }
+    return entry;
+
+#else
     return NULL;
+#endif
 }
 
 
 
 auth_entry* auth_search_user(id_tmpl* user_id, ot_u8 mod_flags) {
 #if (_SEC_ANY)
-    ot_int i;
+    ot_int i = sub_user_find(user_id);
 
-    for (i=0; (i<_SEC_TABLESIZE) && (auth_table[i]!=NULL); i++) {
-        if (auth_table[i]->mod & mod_flags) {
-            if (sub_idcmp(user_id, auth_table[i])) {
-                return auth_table[i];
-            }
-        }
+    if ((i >= 0) && (auth_table[i].mod & mod_flags)) {
+        return &auth_table[i];
     }
+#endif
+    return NULL;
+}
 
 
 
+ot_u32* auth_get_schedule(auth_entry* user) {
+#if (_SEC_ANY)
+    ot_int i = (ot_int)(user - auth_table);
+
+    if ((i < 0) || (i >= _SEC_TABLESIZE)) {
+        return NULL;
+    }
+    if (user->schedule == NULL) {
+        user->schedule = auth_schedule[i];
+        AES_ccm_keyschedule((ot_u32*)user->key, user->schedule);
+    }
+    return user->schedule;
+
+#else
+    return NULL;
+#endif
+}
+
+
+
+ot_u32* auth_get_nlsschedule(id_tmpl* user_id, ot_u8 protocol) {
+#if (_SEC_NL)
+    ot_int i = sub_user_find(user_id);
+
+    if ((i >= 0) && (auth_table[i].protocol == protocol)) {
+        return auth_get_schedule(&auth_table[i]);
+    }
 #endif
     return NULL;
 }
 
 
+
 ot_u8* auth_get_dllskey(ot_u8 protocol, ot_u8* header) {
 #if (_SEC_DLL)
-    ot_u8 offset;
-    ot_u8 cursor;
-    vlFILE* fp;
-    
-    offset      = ((protocol & AUTH_FLAG_ISROOT) == 0);
-    protocol   &= 0x7F;
-    fp          = isf_open_su(ISF_ID(root_authentication_key) + offset);
-    cursor      = 0;
-    
-    /// Go through the Key list, see if there is one that matches the protocol
-    while (cursor < fp->length) {
-        Twobytes scratch;
-        scratch.ushort  = vl_read(fp, cursor);
-        cursor         += 2;
-          
-        if (scratch.ubyte[1] == protocol) {
-            for (offset=0; offset<scratch.ubyte[0]; offset+=2, cursor+=2) {
-                *((ot_u16*)(keybuf+offset)) = vl_read(fp, cursor);
-            }
-            vl_close(fp);
-            return keybuf;
+    auth_dllskey* slot = sub_dlls_find(protocol);
+    return (slot == NULL) ? NULL : (ot_u8*)slot->key;
+#else
+    return NULL;
+#endif
+}
+
+
+
+ot_u32* auth_get_dllsschedule(ot_u8 protocol) {
+#if (_SEC_DLL)
+    auth_dllskey* slot = sub_dlls_find(protocol);
+    return (slot == NULL) ? NULL : slot->schedule;
+#else
+    return NULL;
+#endif
+}
+
+
+
+
+#if (_SEC_DLL)
+void crypto_sort() {
+/// Insertion sort by lifetime, soonest to expire first.  The table is tiny.
+    ot_int i, j;
+
+    for (i=1; i<auth_dlls.used; i++) {
+        auth_dllskey scratch = auth_dlls.slot[i];
+        
+        for (j=i; (j>0) && (auth_dlls.slot[j-1].lifetime > scratch.lifetime); j--) {
+            auth_dlls.slot[j] = auth_dlls.slot[j-1];
         }
-        cursor += scratch.ubyte[0];
+        auth_dlls.slot[j] = scratch;
     }
     
-    vl_close(fp);
-    return NULL;
+    /// Schedules moved with their slots, and the index is rebuilt
+    platform_memset((ot_u8*)auth_dlls.index, 0xFF, sizeof(auth_dlls.index));
+    for (i=0; i<auth_dlls.used; i++) {
+        auth_dlls.index[auth_dlls.slot[i].user][auth_dlls.slot[i].protocol] = (ot_s8)i;
+    }
+}
+
+
+void crypto_cull() {
+/// Keys are sorted, so the expired ones are at the front
+#if (OT_FEATURE(RTC) == ENABLED)
+    ot_u32  now = platform_get_time();
+    ot_int  i, j;
     
-#else
-    return NULL;
+    for (i=0; (i<auth_dlls.used) && (auth_dlls.slot[i].lifetime <= now); i++);
+    if (i != 0) {
+        for (j=0; (i+j)<auth_dlls.used; j++) {
+            auth_dlls.slot[j] = auth_dlls.slot[i+j];
+        }
+        auth_dlls.used = j;
+        crypto_sort();
+    }
 #endif
 }
 
 
+void crypto_clean() {
+/// The next lookup reloads the table from the key ISFs
+    auth_dlls.used  = 0;
+    auth_dlls.stamp = (ot_u16)(vl_keystamp + vl_mapstamp) - 1;
+}
+#endif
+
+
 
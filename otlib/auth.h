@@ -50,6 +50,15 @@
 ///@todo bring this into OT_config.h eventually, when the feature gets supported
 #define AUTH_NUM_ELEMENTS 0
 
+/// NLS user table size, and the size of its ID hash index (a power of two,
+/// larger than the table, so that probes stay short)
+#ifndef AUTH_TABLE_SIZE
+#   define AUTH_TABLE_SIZE      2
+#endif
+#ifndef AUTH_HASH_SIZE
+#   define AUTH_HASH_SIZE       4
+#endif
+
 
 extern const id_tmpl*   auth_guest;
 
@@ -63,6 +72,7 @@ extern const id_tmpl*   auth_guest;
   * lifetime    (ot_u32)    UTC time of when key expires
   * id          (id_tmpl*)  Device ID of user
   * key         (ot_u8*)    Key of user (length implied from protocol id)
+  * schedule    (ot_u32*)   AES key schedule of key, NULL until first used
   */
 typedef struct {
     ot_u8       mod;
@@ -70,6 +80,7 @@ typedef struct {
     ot_u32      lifetime;
     id_tmpl*    id;
     ot_u8*      key;
+    ot_u32*     schedule;
 } auth_entry;
 
 
@@ -112,8 +123,9 @@ ot_u8 auth_check(ot_u8 data_mod, ot_u8 req_mod, id_tmpl* user_id);
   * @retval auth_entry* : pointer to Key in Heap.  NULL on error.
   * @ingroup Authentication
   *
-  * If a new key is added, but there is no room left, the oldest key will be
-  * deleted to make room for this new key.
+  * If a new key is added, but there is no room left, the key that expires
+  * soonest is deleted to make room for this new key.  A user that is already
+  * in the table is updated.  The ID and key are copied into the table.
   */
 auth_entry* auth_new_nlsuser(auth_entry* new_user, ot_u8* new_data);
 
@@ -129,14 +141,68 @@ auth_entry* auth_search_user(id_tmpl* user_id, ot_u8 mod_flags);
 
 
 
+/** @brief Returns the AES-CCM key schedule of a user's key, made on first use
+  * @param user     (auth_entry*) entry from auth_search_user()
+  * @retval ot_u32* Key schedule for AES_encrypt_ccm() / AES_decrypt_ccm()
+  * @ingroup Authentication
+  *
+  * The schedule is kept with the table entry, so it is computed once per key
+  * rather than once per frame.  NULL if the entry is not in the table.
+  */
+ot_u32* auth_get_schedule(auth_entry* user);
+
+
+
+/** @brief Returns the key schedule of a user's NLS key, if it has the protocol
+  * @param user_id  (id_tmpl*) Device ID of user
+  * @param protocol (ot_u8) NLS code from the frame (the key's protocol ID)
+  * @retval ot_u32* Key schedule, or NULL if there is no such user or key
+  * @ingroup Authentication
+  *
+  * This is the user's long term key.  NLS only uses it to derive the key of
+  * each dialog, which is kept with the session (see m2_network.h).
+  */
+ot_u32* auth_get_nlsschedule(id_tmpl* user_id, ot_u8 protocol);
+
+
+
+/** DLLS Key Table <BR>
+  * ========================================================================<BR>
+  * The root and user authentication key ISFs are lists of [length][protocol]
+  * [key data] records.  They are loaded into a RAM table, with key schedules,
+  * and found through an index by user and protocol, so per-frame lookup does
+  * not touch the ISF.  The table is reloaded after a write to either file
+  * (see vl_keystamp).  Protocol IDs from AUTH_DLLS_PROTOCOLS up are not kept.
+  */
+#ifndef AUTH_DLLS_PROTOCOLS
+#   define AUTH_DLLS_PROTOCOLS  4
+#endif
+#ifndef AUTH_DLLS_SLOTS
+#   define AUTH_DLLS_SLOTS      2
+#endif
+
+#define AUTH_DLLS_KEYBYTES      16
+#define AUTH_LIFETIME_STATIC    0xFFFFFFFF
+
+
+
 /** @brief Returns the stored User or Root key that matches the protocol ID
-  * @param protocol (ot_u8) Protocol ID of the DLLS method
+  * @param protocol (ot_u8) Protocol ID of the DLLS method, | AUTH_FLAG_ISROOT
+  *                         for the root key
   * @param header   (ot_u8*) optional header data (defined by protocol ID) 
-  * @retval ot_u8*  Key Data
+  * @retval ot_u8*  Key Data, or NULL if there is no such key
   * @ingroup Authentication
-
+  */
 ot_u8* auth_get_dllskey(ot_u8 protocol, ot_u8* header);
+
+
+
+/** @brief Returns the AES-CCM key schedule of the key auth_get_dllskey() finds
+  * @param protocol (ot_u8) Protocol ID, as with auth_get_dllskey()
+  * @retval ot_u32* Key schedule, or NULL if there is no such key
+  * @ingroup Authentication
   */
+ot_u32* auth_get_dllsschedule(ot_u8 protocol);
 
 
 
@@ -31,6 +31,30 @@ ot_u8 otbuf[OT_FEATURE(BUFFER_SIZE)];
 #if (OT_FEATURE(SERVER) == ENABLED)
     Queue rxq;
     Queue txq;
+#   if (OT_FEATURE(RXQ_DOUBLE) == ENABLED)
+    Queue rxq_next;
+#   endif
+#   if (OT_PARAM(RXPOOL) > 0)
+    /// Slots [head, head+count) hold frames, in order.  The others are free.
+    static Queue    rxpool[OT_PARAM(RXPOOL)];
+    static ot_u8    rxpool_head;
+    static ot_u8    rxpool_count;
+#   endif
+#   if (OT_PARAM(TXPOOL) > 0)
+    static Queue    txpool[OT_PARAM(TXPOOL)];
+#   endif
+#   if (OT_PARAM(FWDPOOL) > 0)
+    /// Bit N of fwdpool_used is set while slot N holds a frame
+    static Queue    fwdpool[OT_PARAM(FWDPOOL)];
+    static ot_u16   fwdpool_used;
+#   endif
+
+    /// Each scratch class is a run of blocks in otbuf.  A free block holds
+    /// the index of the next free block of its class in its first byte.
+    static const ot_u8 scratch_size[BUF_SCRATCH_CLASSES]  = { BUF_SCRATCH_QUERYSIZE };
+    static const ot_u8 scratch_count[BUF_SCRATCH_CLASSES] = { OT_PARAM(SCRATCH_QUERY) };
+    static ot_u8*   scratch_base[BUF_SCRATCH_CLASSES];
+    static ot_u8    scratch_free[BUF_SCRATCH_CLASSES];
 #endif
 
 #if (   (OT_FEATURE(NDEF)  == ENABLED) || \
@@ -47,9 +71,50 @@ void buffers_init() {
 
 #   if (OT_FEATURE(SERVER) == ENABLED)
         /// TX/RX queues
-        max = M2_PARAM_MAXFRAME + (M2_PARAM_MAXFRAME & 1);  //keep even
+        max = BUF_FRAME;    //keep even
         q_init(&rxq, otbuf, max);
         q_init(&txq, otbuf+max, max);
+#       if (OT_FEATURE(RXQ_DOUBLE) == ENABLED)
+        q_init(&rxq_next, otbuf+(2*max), max);
+        max *= 3;
+#       else
+        max <<= 1;  // (max *= 2)
+#       endif
+#       if (OT_PARAM(RXPOOL) > 0)
+        {   ot_int i;
+            for (i=0; i<OT_PARAM(RXPOOL); i++, max+=BUF_FRAME) {
+                q_init(&rxpool[i], otbuf+max, BUF_FRAME);
+            }
+            rxpool_head     = 0;
+            rxpool_count    = 0;
+        }
+#       endif
+#       if (OT_PARAM(TXPOOL) > 0)
+        {   ot_int i;
+            for (i=0; i<OT_PARAM(TXPOOL); i++, max+=BUF_FRAME) {
+                q_init(&txpool[i], otbuf+max, BUF_FRAME);
+            }
+        }
+#       endif
+#       if (OT_PARAM(FWDPOOL) > 0)
+        {   ot_int i;
+            for (i=0; i<OT_PARAM(FWDPOOL); i++, max+=BUF_FRAME) {
+                q_init(&fwdpool[i], otbuf+max, BUF_FRAME);
+            }
+            fwdpool_used = 0;
+        }
+#       endif
+
+        {   ot_int i, j;
+            for (i=0; i<BUF_SCRATCH_CLASSES; i++) {
+                scratch_base[i] = otbuf+max;
+                scratch_free[i] = (scratch_count[i] != 0) ? 0 : BUF_SCRATCH_NONE;
+                for (j=1; j<=scratch_count[i]; j++, max+=scratch_size[i]) {
+                    otbuf[max]  = (j < scratch_count[i]) ? (ot_u8)j : BUF_SCRATCH_NONE;
+                }
+            }
+            max += (max & 1);
+        }
 #   else
         max = 0;
 #   endif
@@ -57,16 +122,21 @@ void buffers_init() {
 #if (   (OT_FEATURE(NDEF)  == ENABLED) || \
         (OT_FEATURE(ALP)   == ENABLED) || \
         (OT_FEATURE(MPIPE) == ENABLED) )
-        /// Console queues can use the same space (half duplex).  For heavy
-        /// clients with memory to spare, feel free to make full duplex.
-        max <<= 1;  // (max *= 2)
+#   if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+    {   /// Console queues get half of the remaining space each (full duplex)
+        ot_int half = ((OT_FEATURE(BUFFER_SIZE)-max) >> 1) & ~1;
+        q_init(&dir_in, otbuf+max, half);
+        q_init(&dir_out, otbuf+max+half, half);
+    }
+#   else
+        /// Console queues can use the same space (half duplex).
         q_init(&dir_in, otbuf+max, (OT_FEATURE(BUFFER_SIZE)-max) );    
         q_init(&dir_out, otbuf+max, (OT_FEATURE(BUFFER_SIZE)-max) );    
 #   endif
+#   endif
 }
 
 
-/// Experimental
 void buffers_swap(Queue* q1, Queue* q2) {
     Queue scratch;
     
@@ -77,4 +147,116 @@ void buffers_swap(Queue* q1, Queue* q2) {
 
 
 
+Queue* buffers_get(ot_u8 handle) {
+    switch (handle) {
+#   if (OT_FEATURE(SERVER) == ENABLED)
+        case BUF_RXQ:       return &rxq;
+        case BUF_TXQ:       return &txq;
+#       if (OT_FEATURE(RXQ_DOUBLE) == ENABLED)
+        case BUF_RXNEXT:    return &rxq_next;
+#       endif
+#   endif
+#   if (   (OT_FEATURE(NDEF)  == ENABLED) || \
+            (OT_FEATURE(ALP)   == ENABLED) || \
+            (OT_FEATURE(MPIPE) == ENABLED) )
+        case BUF_DIRIN:     return &dir_in;
+        case BUF_DIROUT:    return &dir_out;
+#   endif
+        default: break;
+    }
+    
+#   if ((OT_FEATURE(SERVER) == ENABLED) && (OT_PARAM(RXPOOL) > 0))
+    if ((handle >= BUF_RXSLOT(0)) && (handle < BUF_RXSLOT(OT_PARAM(RXPOOL)))) {
+        return &rxpool[handle - BUF_RXSLOT(0)];
+    }
+#   endif
+#   if ((OT_FEATURE(SERVER) == ENABLED) && (OT_PARAM(TXPOOL) > 0))
+    if ((handle >= BUF_TXSLOT(0)) && (handle < BUF_TXSLOT(OT_PARAM(TXPOOL)))) {
+        return &txpool[handle - BUF_TXSLOT(0)];
+    }
+#   endif
+#   if ((OT_FEATURE(SERVER) == ENABLED) && (OT_PARAM(FWDPOOL) > 0))
+    if ((handle >= BUF_FWDSLOT(0)) && (handle < BUF_FWDSLOT(OT_PARAM(FWDPOOL)))) {
+        return &fwdpool[handle - BUF_FWDSLOT(0)];
+    }
+#   endif
+    return NULL;
+}
+
+
+
+
+#if ((OT_FEATURE(SERVER) == ENABLED) && (OT_PARAM(RXPOOL) > 0))
+ot_bool buffers_rxpool_put() {
+    ot_int i;
+    
+    if (rxpool_count >= OT_PARAM(RXPOOL)) {
+        return False;
+    }
+    i = rxpool_head + rxpool_count;
+    if (i >= OT_PARAM(RXPOOL)) {
+        i -= OT_PARAM(RXPOOL);
+    }
+    buffers_swap(&rxq, &rxpool[i]);
+    q_empty(&rxq);
+    rxpool_count++;
+    return True;
+}
+
+
+ot_bool buffers_rxpool_get() {
+    if (rxpool_count == 0) {
+        return False;
+    }
+    buffers_swap(&rxq, &rxpool[rxpool_head]);
+    rxpool_count--;
+    if (++rxpool_head >= OT_PARAM(RXPOOL)) {
+        rxpool_head = 0;
+    }
+    return True;
+}
+#endif
+
+
+
+#if ((OT_FEATURE(SERVER) == ENABLED) && (OT_PARAM(FWDPOOL) > 0))
+ot_int buffers_fwdpool_put() {
+    ot_int i;
+    
+    for (i=0; i<OT_PARAM(FWDPOOL); i++) {
+        if ((fwdpool_used & (1 << i)) == 0) {
+            buffers_swap(&rxq, &fwdpool[i]);
+            q_empty(&rxq);
+            fwdpool_used |= (1 << i);
+            return i;
+        }
+    }
+    return -1;
+}
+
 
+void buffers_fwdpool_free(ot_int slot) {
+    fwdpool_used &= ~(1 << slot);
+}
+#endif
+
+
+
+#if (OT_FEATURE(SERVER) == ENABLED)
+ot_u8* buffers_scratch_alloc(ot_u8 cls) {
+    ot_u8* block;
+    
+    if (scratch_free[cls] == BUF_SCRATCH_NONE) {
+        return NULL;
+    }
+    block               = scratch_base[cls] + (scratch_free[cls] * scratch_size[cls]);
+    scratch_free[cls]   = block[0];
+    return block;
+}
+
+
+void buffers_scratch_free(ot_u8 cls, ot_u8* block) {
+    block[0]            = scratch_free[cls];
+    scratch_free[cls]   = (ot_u8)((block - scratch_base[cls]) / scratch_size[cls]);
+}
+#endif
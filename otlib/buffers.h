@@ -43,6 +43,99 @@
 #define BUF2_ALLOC  (OT_FEATURE(BUFFER_SIZE) - 512)
 
 
+/** Buffer layout options
+  * OT_FEATURE_MPIPE_DUPLEX:  dir_in and dir_out get separate halves of the
+  *                           console space, so MPipe RX and TX can overlap.
+  *                           A full duplex MPipe may use dir_in as its RX
+  *                           ring, delivering frames in place.
+  * OT_FEATURE_RXQ_DOUBLE:    a second RX frame buffer, rxq_next, lets the 
+  *                           radio receive one frame while the kernel parses
+  *                           the last.  The two are exchanged with 
+  *                           buffers_swap(&rxq, &rxq_next).
+  * OT_PARAM_RXPOOL:          number of RX pool slots (0 = none).  A gateway
+  *                           puts each response into the pool as it comes in
+  *                           and keeps listening, and the responses are
+  *                           parsed when the listen is over.  Each slot is
+  *                           M2_PARAM_MAXFRAME bytes.
+  * OT_PARAM_TXPOOL:          number of TX slots (0 = none), where a gateway
+  *                           can build frames ahead of time, and exchange
+  *                           them into txq with buffers_swap() when it is
+  *                           time to send.  Each slot is M2_PARAM_MAXFRAME
+  *                           bytes.
+  * OT_PARAM_FWDPOOL:         number of forwarding slots (0 = none, at most
+  *                           16).  A response that is forwarded to the host
+  *                           (OT_FEATURE_RESPFWD) is kept in one until MPipe
+  *                           has sent it.  Each slot is M2_PARAM_MAXFRAME
+  *                           bytes.
+  * These options take space from the console queues.  OT_PARAM_BUFPROFILE, in
+  * OT_config.h, sets all of them at once.
+  */
+#ifndef OT_FEATURE_MPIPE_DUPLEX
+#   define OT_FEATURE_MPIPE_DUPLEX  DISABLED
+#endif
+#ifndef OT_FEATURE_RXQ_DOUBLE
+#   define OT_FEATURE_RXQ_DOUBLE    DISABLED
+#endif
+#ifndef OT_PARAM_RXPOOL
+#   define OT_PARAM_RXPOOL          0
+#endif
+#ifndef OT_PARAM_TXPOOL
+#   define OT_PARAM_TXPOOL          0
+#endif
+#ifndef OT_PARAM_FWDPOOL
+#   define OT_PARAM_FWDPOOL         0
+#endif
+#if (OT_PARAM_FWDPOOL > 16)
+#   error "OT_PARAM_FWDPOOL can be at most 16"
+#endif
+
+
+/** Scratch Pool
+  * Fixed-size blocks for working data that a dialog needs for a little while,
+  * so that it does not have to be stashed in some unused part of rxq or txq.
+  * Each user has its own block class, sized at compile-time, and the free
+  * blocks of a class are kept on a list, so alloc and free are O(1).  Like
+  * the RX pool, the blocks take space from the console queues.
+  * BUF_SCRATCH_QUERY:        M2QP comparison data or correlation ring, which
+  *                           is at most 32 bytes.  OT_PARAM_SCRATCH_QUERY is
+  *                           the number of blocks (comparisons that can run
+  *                           at the same time).
+  */
+#ifndef OT_PARAM_SCRATCH_QUERY
+#   define OT_PARAM_SCRATCH_QUERY   1
+#endif
+#define BUF_SCRATCH_QUERY       0
+#define BUF_SCRATCH_QUERYSIZE   32
+#define BUF_SCRATCH_CLASSES     1
+#define BUF_SCRATCH_NONE        0xFF
+
+
+/// Frame buffers and scratch blocks come first in otbuf, and the console
+/// queues get the rest.
+#define BUF_FRAME           (M2_PARAM_MAXFRAME + (M2_PARAM_MAXFRAME & 1))
+#define BUF_FRAMES          (2 + (OT_FEATURE(RXQ_DOUBLE) == ENABLED) + \
+                            OT_PARAM(RXPOOL) + OT_PARAM(TXPOOL) + \
+                            OT_PARAM(FWDPOOL))
+#define BUF_LAYOUT_SIZE     ((BUF_FRAMES*BUF_FRAME) + \
+                            (OT_PARAM(SCRATCH_QUERY)*BUF_SCRATCH_QUERYSIZE))
+
+#if ((OT_FEATURE(SERVER) == ENABLED) && (BUF_LAYOUT_SIZE >= OT_FEATURE(BUFFER_SIZE)))
+#   error "OT_PARAM_BUFFER_SIZE is too small for the frame buffers that are configured"
+#endif
+
+
+/// Buffer handles: buffers_get() gives the Queue for a handle, so code that
+/// works with several frame buffers does not need to name each global.
+#define BUF_RXQ             0
+#define BUF_TXQ             1
+#define BUF_RXNEXT          2
+#define BUF_DIRIN           3
+#define BUF_DIROUT          4
+#define BUF_RXSLOT(N)       (5 + (N))
+#define BUF_TXSLOT(N)       (5 + OT_PARAM(RXPOOL) + (N))
+#define BUF_FWDSLOT(N)      (5 + OT_PARAM(RXPOOL) + OT_PARAM(TXPOOL) + (N))
+
+
 /// Buffer Partitions
 /// Number of partitions allowed is the total allocated size divided by 256.
 /// Partitions, hence, are always 256 bytes.
@@ -71,6 +164,11 @@ extern ot_u8 otbuf[OT_FEATURE(BUFFER_SIZE)];
     /// Required Queues (on server side): rxq and txq are used for DASH7 I/O
     extern Queue rxq;
     extern Queue txq;
+    
+#   if (OT_FEATURE(RXQ_DOUBLE) == ENABLED)
+    /// Second RX frame buffer (see OT_FEATURE_RXQ_DOUBLE)
+    extern Queue rxq_next;
+#   endif
 #endif
 
 #if (   (OT_FEATURE(NDEF)  == ENABLED) || \
@@ -99,5 +197,101 @@ void buffers_init();
 
 
 
+/** @brief Exchanges the buffers and states of two Queues
+  * @param q1       (Queue*) first Queue
+  * @param q2       (Queue*) second Queue
+  * @retval none
+  * @ingroup Buffers
+  *
+  * With OT_FEATURE_RXQ_DOUBLE, the radio driver can swap rxq and rxq_next
+  * when a frame is complete, and start the next reception right away.  The
+  * kernel then parses the frame from rxq_next.
+  */
+void buffers_swap(Queue* q1, Queue* q2);
+
+
+
+
+/** @brief Gives the Queue for a buffer handle
+  * @param handle   (ot_u8) BUF_RXQ, BUF_TXQ, BUF_RXSLOT(n), ...
+  * @retval Queue*  the Queue, or NULL if the layout does not have it
+  * @ingroup Buffers
+  *
+  * BUF_RXQ and BUF_TXQ are always rxq and txq, so endpoint code can keep
+  * using the globals.  Pool slots hold whatever buffers_swap() or the pool
+  * functions last put there.
+  */
+Queue* buffers_get(ot_u8 handle);
+
+
+
+
+/** @brief Moves the frame in rxq into the RX pool, leaving rxq empty
+  * @param none
+  * @retval ot_bool     False if the pool is full (rxq is not changed)
+  * @ingroup Buffers
+  *
+  * The frame is not copied: rxq is exchanged with a free slot.  Only call
+  * this when the radio is not writing to rxq.  Needs OT_PARAM_RXPOOL > 0.
+  */
+ot_bool buffers_rxpool_put();
+
+
+
+/** @brief Moves the oldest frame in the RX pool into rxq
+  * @param none
+  * @retval ot_bool     False if the pool is empty (rxq is not changed)
+  * @ingroup Buffers
+  *
+  * What was in rxq is lost.  Needs OT_PARAM_RXPOOL > 0.
+  */
+ot_bool buffers_rxpool_get();
+
+
+
+/** @brief Moves the frame in rxq into a free forwarding slot, leaving rxq empty
+  * @param none
+  * @retval ot_int      slot number, or -1 if all slots are in use
+  * @ingroup Buffers
+  *
+  * Like buffers_rxpool_put(), the frame is not copied, so pointers into it
+  * stay good until the slot is freed.  Needs OT_PARAM_FWDPOOL > 0.
+  */
+ot_int buffers_fwdpool_put();
+
+
+
+/** @brief Frees a forwarding slot
+  * @param slot     (ot_int) slot number from buffers_fwdpool_put()
+  * @retval none
+  * @ingroup Buffers
+  */
+void buffers_fwdpool_free(ot_int slot);
+
+
+
+
+/** @brief Takes a block from the scratch pool
+  * @param cls      (ot_u8) block class, BUF_SCRATCH_...
+  * @retval ot_u8*  the block, or NULL if all blocks of the class are in use
+  * @ingroup Buffers
+  *
+  * The block is not cleared.  Give it back with buffers_scratch_free() when
+  * the work is done.  Needs OT_FEATURE(SERVER).
+  */
+ot_u8* buffers_scratch_alloc(ot_u8 cls);
+
+
+
+/** @brief Gives a block back to the scratch pool
+  * @param cls      (ot_u8) block class that it came from
+  * @param block    (ot_u8*) block from buffers_scratch_alloc()
+  * @retval none
+  * @ingroup Buffers
+  */
+void buffers_scratch_free(ot_u8 cls, ot_u8* block);
+
+
+
 
 #endif
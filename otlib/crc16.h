@@ -42,13 +42,31 @@ typedef struct {
     ot_u8*      cursor;
     ot_u8*      end;
     ot_u16      val;
+#   if (OT_FEATURE(STATIC_DISPATCH) == ENABLED)
+    ot_u8       step;       // stream state: CRC_STEP_... in crc16.c
+#   else
     void        (*stream)();
+#   endif
 } crc_struct;
 
 extern crc_struct crc;
 
 
-extern const ot_u16 crc_table[256];
+/// Tables are const (flash) unless CRC16_TABLE_RAM is enabled
+#if (CRC16_TABLE_RAM == ENABLED)
+#   define CRC16_TABLE_CONST
+#else
+#   define CRC16_TABLE_CONST    const
+#endif
+
+#if ((CRC16_ENGINE == CRC16_ENGINE_TABLE) || (CRC16_ENGINE == CRC16_ENGINE_SLICE4))
+    extern CRC16_TABLE_CONST ot_u16 crc_table[256];
+
+    /// Folds byte C into the CRC16 value CRCV with crc_table, so that a codec
+    /// loop can keep the CRC in a register while it works on the same byte.
+#   define CRC16_TABLE_BYTE(CRCV, C)    \
+                ((ot_u16)((CRCV) << 8) ^ crc_table[(ot_u8)((CRCV) >> 8) ^ (C)])
+#endif
 
 
 
@@ -61,6 +79,20 @@ extern const ot_u16 crc_table[256];
 ot_u16 crc_calc_block(ot_int block_size, ot_u8 *block_addr);
 
 
+/** @brief Continues a CRC16 from a saved value over another data block
+  * @param crc_val    : (ot_u16) CRC16 value of the data preceding the block
+  * @param block_size : (ot_int) number of bytes in the data block
+  * @param block_addr : (ot_u8*) address of the data block
+  * @retval ot_u16 : CRC16 value of the preceding data and the block together
+  * @ingroup CRC16
+  *
+  * A frame that only changes at the end (i.e. a counter) can keep the CRC of
+  * its constant part and compute just the last few bytes each time.  Only
+  * available with the SW CRC engines (MCU_FEATURE(CRC) disabled).
+  */
+ot_u16 crc_extend_block(ot_u16 crc_val, ot_int block_size, ot_u8* block_addr);
+
+
 
 
 
@@ -98,6 +130,37 @@ void crc_calc_stream();
 
 
 
+/** @brief Runs the CRC stream for n bytes at once
+  * @param n            (ot_int) number of stream steps to run
+  * @retval None
+  * @ingroup CRC16
+  *
+  * Equivalent to calling crc_calc_stream() n times, but the data is folded in
+  * a single pass.  Use this when a burst of bytes has been moved to or from
+  * the radio buffer, in order to update the CRC once per burst rather than
+  * once per byte.  If n runs past the end of the stream, the CRC is written to
+  * the end of the stream just as with crc_calc_stream().
+  */
+void crc_calc_nstream(ot_int n);
+
+
+
+
+/** @brief Data bytes of the CRC stream that are ready to fold, up to n
+  * @param n            (ot_int) most bytes the caller will fold
+  * @retval ot_int      Bytes of stream data at crc.cursor, up to n.  0 when the
+  *                     stream is writing out the CRC or is done.
+  * @ingroup CRC16
+  *
+  * For a caller that folds the stream data into crc.val itself (e.g. with
+  * CRC16_TABLE_BYTE()), and then advances crc.cursor by the same amount.  It
+  * must call crc_calc_nstream() afterwards, with 0 or with the steps left, so
+  * that the stream moves to the CRC write-out at the end of the data.
+  */
+ot_int crc_stream_span(ot_int n);
+
+
+
 /** @brief Updates the end of the CRC stream
   * @param new_end      (ot_u8*) new end pointer for crc stream
   * @retval None
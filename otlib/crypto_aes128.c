@@ -25,6 +25,8 @@
   */
 
 #include "crypto_aes128.h"   
+#include "OT_utils.h"
+#include "system.h"
 #include "veelite.h"
 
 
@@ -35,13 +37,13 @@
 #define byte0(x) (x >> 24)          /* first byte from left   */           
                                                                 
 // Return an ot_u32 from 4 ot_u8
-#define WORD8_TO_WORD32(b0, b1, b2, b3) ((ot_u32)(b0) < 24 | (ot_u32)(b1) < 16 | (ot_u32)(b2) < 8 | (b3))
+#define WORD8_TO_WORD32(b0, b1, b2, b3) ((ot_u32)(b0) << 24 | (ot_u32)(b1) << 16 | (ot_u32)(b2) << 8 | (b3))
 
 // Multiply for 2 each byte of a WORD32 working in parallel mode on each one
-#define Xtime(x)  ((((x) & 0x7f7f7f7f) < 1) ^ ((((x) & 0x80808080) >> 7) * 0x0000001b))   
+#define Xtime(x)  ((((x) & 0x7f7f7f7f) << 1) ^ ((((x) & 0x80808080) >> 7) * 0x0000001b))   
 
 // Right shift x of n bytes
-#define upr(x,n) (x >> 8*n) | (x < (32 - 8*n))    
+#define upr(x,n) (((x) >> 8*n) | ((x) << (32 - 8*n)))    
 
 // Develop of the matrix necessary for the MixColomn procedure
 #define fwd_mcol(x)  (Xtime(x)^(upr((x^Xtime(x)),3)) ^ (upr(x,2)) ^ (upr(x,1)))   
@@ -50,9 +52,9 @@
 #define inv_mcol(x)  (f2=Xtime(x),f4=Xtime(f2),f8=Xtime(f4),(x)^=f8, f2^=f4^f8^(upr((f2^(x)),3))^(upr((f4^(x)),2))^(upr((x),1)))   
 
 // Rotation macro 
-#define rot3(x) ((x < 8 ) | (x >> 24)) /* rotate right by 24 bit */   
-#define rot2(x) ((x < 16) | (x >> 16)) /* rotate right by 16 bit */   
-#define rot1(x) ((x < 24) | (x >> 8 )) /* rotate right by 8 bit  */   
+#define rot3(x) (((x) << 8 ) | ((x) >> 24)) /* rotate right by 24 bit */   
+#define rot2(x) (((x) << 16) | ((x) >> 16)) /* rotate right by 16 bit */   
+#define rot1(x) (((x) << 24) | ((x) >> 8 )) /* rotate right by 8 bit  */   
 
 
 
@@ -315,6 +317,14 @@ void AES_load_static_key(ot_u8 key_id, ot_u32* key) {
 *******************************************************************************/   
 void AES_keyschedule_enc(ot_u32* key, ot_u32* expkey) {
 #if (AES_USEHW == ENABLED)
+    /// The engine does its own key expansion, so the "expanded key" is just
+    /// a copy of the key (AES_EXPKEY_SIZE is still reserved by the caller).
+    if (expkey != key) {
+        expkey[0] = key[0];
+        expkey[1] = key[1];
+        expkey[2] = key[2];
+        expkey[3] = key[3];
+    }
 
 #elif ((AES_USEFAST == ENABLED) || (AES_USELITE == ENABLED))
     register ot_u32* local_pointer = expkey;   
@@ -363,6 +373,8 @@ void AES_keyschedule_enc(ot_u32* key, ot_u32* expkey) {
 *******************************************************************************/   
 void AES_keyschedule_dec(ot_u32* key, ot_u32* expkey) {
 #if (AES_USEHW == ENABLED)
+    /// The engine derives the decryption key itself, once per key.
+    AES_keyschedule_enc(key, expkey);
 
 #elif (AES_USEFAST == ENABLED)
     register ot_u32* local_pointer;// = expkey;   
@@ -426,6 +438,7 @@ void AES_keyschedule_dec(ot_u32* key, ot_u32* expkey) {
 *******************************************************************************/   
 void AES_encrypt(ot_u32* input_pointer, ot_u32* output_pointer, ot_u32* expkey) {
 #if (AES_USEHW == ENABLED)
+    platform_aes_encrypt(input_pointer, output_pointer, expkey, 1);
 
 #elif (AES_USEFAST == ENABLED)
   register ot_u32 s0;   
@@ -607,6 +620,7 @@ void AES_encrypt(ot_u32* input_pointer, ot_u32* output_pointer, ot_u32* expkey)
 *******************************************************************************/   
 void AES_decrypt(ot_u32* input_pointer, ot_u32* output_pointer, ot_u32* expkey) {
 #if (AES_USEHW == ENABLED)
+    platform_aes_decrypt(input_pointer, output_pointer, expkey, 1);
 
 #elif (AES_USEFAST == ENABLED)   
   register ot_u32 s0;   
@@ -779,3 +793,234 @@ void AES_decrypt(ot_u32* input_pointer, ot_u32* output_pointer, ot_u32* expkey)
    
    
    
+
+
+
+
+/** AES-CCM Bulk Functions <BR>
+  * ========================================================================<BR>
+  * Working blocks are word-aligned RAM, so they can go straight to a hardware
+  * engine.  The software cipher works on big-endian words, so blocks are
+  * converted around it.  A CCM block here is either a CBC-MAC state or a 
+  * counter block A_i = [flags=L-1][nonce][i], which encrypts to keystream S_i.
+  */
+#if (AES_NEEDED)
+
+#define AES_CCM_L           2
+
+void sub_ccm_crypt(ot_u32* block, ot_int blocks, ot_u32* expkey) {
+#if (AES_USEHW == ENABLED)
+    platform_aes_encrypt(block, block, expkey, blocks);
+
+#else
+    for (; blocks > 0; blocks--, block += 4) {
+        ENDIANIZE_U32(block[0]);
+        ENDIANIZE_U32(block[1]);
+        ENDIANIZE_U32(block[2]);
+        ENDIANIZE_U32(block[3]);
+        AES_encrypt(block, block, expkey);
+        ENDIANIZE_U32(block[0]);
+        ENDIANIZE_U32(block[1]);
+        ENDIANIZE_U32(block[2]);
+        ENDIANIZE_U32(block[3]);
+    }
+#endif
+}
+
+
+void sub_ccm_mac(ot_u32* mac, ot_u8* data, ot_int length, ot_int start, ot_u32* expkey) {
+/// CBC-MAC over "length" bytes, XORed in from byte "start" of the first block.
+/// The last block is zero-padded, which is the same as XORing nothing.
+    ot_u8* x = (ot_u8*)mac;
+
+    while (length > 0) {
+        for (; (start < 16) && (length > 0); start++, length--) {
+            x[start] ^= *data++;
+        }
+        sub_ccm_crypt(mac, 1, expkey);
+        start = 0;
+    }
+}
+
+
+void sub_ccm_keystream(ot_u32* ks, ot_u8* nonce, ot_u16 counter, ot_int blocks, ot_u32* expkey) {
+/// Makes S_counter ... S_(counter+blocks-1) in one engine job
+    ot_u8*  a = (ot_u8*)ks;
+    ot_int  i;
+
+    for (i=0; i<blocks; i++, counter++, a+=16) {
+        a[0] = (AES_CCM_L - 1);
+        platform_memcpy(&a[1], nonce, AES_CCM_NONCE_SIZE);
+        a[14] = (ot_u8)(counter >> 8);
+        a[15] = (ot_u8)counter;
+    }
+    sub_ccm_crypt(ks, blocks, expkey);
+}
+
+
+ot_int sub_ccm_start(ot_u32* mac, Queue* q, ot_int a_len, ot_int m_len, 
+                     ot_u8* nonce, ot_int mic_len, ot_u32* expkey) {
+/// Checks the parameters, then runs the CBC-MAC over B0 and the header
+    ot_u8* blk = (ot_u8*)mac;
+
+    if ((a_len < 0) || (m_len < 0) || \
+        (mic_len < 4) || (mic_len > 16) || (mic_len & 1)) {
+        return -1;
+    }
+
+    blk[0]   = ((a_len != 0) << 6) | (((mic_len-2) >> 1) << 3) | (AES_CCM_L - 1);
+    platform_memcpy(&blk[1], nonce, AES_CCM_NONCE_SIZE);
+    blk[14]  = (ot_u8)(m_len >> 8);
+    blk[15]  = (ot_u8)m_len;
+    sub_ccm_crypt(mac, 1, expkey);
+
+    if (a_len != 0) {
+        blk[0] ^= (ot_u8)(a_len >> 8);
+        blk[1] ^= (ot_u8)a_len;
+        sub_ccm_mac(mac, q->getcursor, a_len, 2, expkey);
+    }
+    return 0;
+}
+
+
+ot_int sub_ccm_run(Queue* q, ot_int a_len, ot_int m_len, ot_u8* nonce, 
+                   ot_int mic_len, ot_u32* expkey, ot_u8* mic, ot_bool decrypt) {
+/// Walks the message a block at a time.  The plaintext goes into the MAC: it
+/// is read before XOR when encrypting and after XOR when decrypting.  On exit,
+/// "mic" holds the MIC computed over the plaintext.
+    ot_u32  mac[4];
+    ot_u32  ks[AES_CCM_AHEAD*4];
+    ot_u8*  data;
+    ot_u8*  stream;
+    ot_u16  counter;
+    ot_int  avail;
+    ot_int  i, j;
+
+    if (sub_ccm_start(mac, q, a_len, m_len, nonce, mic_len, expkey) != 0) {
+        return -1;
+    }
+
+    data    = q->getcursor + a_len;
+    counter = 1;
+    avail   = 0;
+
+    while (m_len > 0) {
+#       if (OT_FEATURE(PROFILER) == ENABLED)
+        ot_u32 mark = platform_get_cycles();
+#       endif
+        ot_int chunk = (m_len < 16) ? m_len : 16;
+
+        if (avail == 0) {
+            avail   = ((m_len + 15) >> 4);
+            avail   = (avail < AES_CCM_AHEAD) ? avail : AES_CCM_AHEAD;
+            sub_ccm_keystream(ks, nonce, counter, avail, expkey);
+            counter+= avail;
+            stream  = (ot_u8*)ks;
+        }
+
+        if (decrypt == False) {
+            sub_ccm_mac(mac, data, chunk, 0, expkey);
+        }
+        for (i=0; i<chunk; i++) {
+            data[i] ^= stream[i];
+        }
+        if (decrypt) {
+            sub_ccm_mac(mac, data, chunk, 0, expkey);
+        }
+
+        data   += chunk;
+        stream += 16;
+        m_len  -= chunk;
+        avail--;
+
+#       if (OT_FEATURE(PROFILER) == ENABLED)
+        sys_profile_log(SYS_PROFILE_CCM, mark);
+#       endif
+    }
+
+    /// U = T XOR S_0, using the keystream buffer for S_0
+    sub_ccm_keystream(ks, nonce, 0, 1, expkey);
+    for (j=0; j<mic_len; j++) {
+        mic[j] = ((ot_u8*)mac)[j] ^ ((ot_u8*)ks)[j];
+    }
+    return 0;
+}
+
+
+
+
+#ifndef EXTF_AES_ccm_keyschedule
+void AES_ccm_keyschedule(ot_u32* key, ot_u32* expkey) {
+#if (AES_USEHW == ENABLED)
+    AES_keyschedule_enc(key, expkey);
+
+#else
+    ot_u32 bekey[4];
+    ot_int i;
+
+    for (i=0; i<4; i++) {
+        bekey[i] = GET_BE_U32(key[i]);
+    }
+    AES_keyschedule_enc(bekey, expkey);
+#endif
+}
+#endif
+
+
+#ifndef EXTF_AES_ccm_derivekey
+void AES_ccm_derivekey(ot_u32* newkey, ot_u8* info, ot_u32* expkey) {
+    platform_memcpy((ot_u8*)newkey, info, 16);
+    sub_ccm_crypt(newkey, 1, expkey);
+}
+#endif
+
+
+#ifndef EXTF_AES_encrypt_ccm
+ot_int AES_encrypt_ccm(Queue* q, ot_int a_len, ot_u8* nonce, ot_int mic_len, ot_u32* expkey) {
+    ot_int m_len = (ot_int)(q->putcursor - q->getcursor) - a_len;
+
+    if ((q->putcursor + mic_len) > q->back) {
+        return -1;
+    }
+    if (sub_ccm_run(q, a_len, m_len, nonce, mic_len, expkey, q->putcursor, False) != 0) {
+        return -1;
+    }
+    q->putcursor   += mic_len;
+    q->length      += mic_len;
+    return mic_len;
+}
+#endif
+
+
+#ifndef EXTF_AES_decrypt_ccm
+ot_int AES_decrypt_ccm(Queue* q, ot_int a_len, ot_u8* nonce, ot_int mic_len, ot_u32* expkey) {
+    ot_u8   mic[16];
+    ot_u8   diff;
+    ot_u8*  rxmic;
+    ot_int  m_len;
+    ot_int  i;
+
+    m_len = (ot_int)(q->putcursor - q->getcursor) - a_len - mic_len;
+    if (sub_ccm_run(q, a_len, m_len, nonce, mic_len, expkey, mic, True) != 0) {
+        return -1;
+    }
+
+    /// Compare the whole MIC, so timing does not show where it differs
+    rxmic   = q->putcursor - mic_len;
+    diff    = 0;
+    for (i=0; i<mic_len; i++) {
+        diff |= rxmic[i] ^ mic[i];
+    }
+    q->putcursor   -= mic_len;
+    q->length      -= mic_len;
+
+    if (diff != 0) {
+        platform_memset(q->getcursor + a_len, 0, m_len);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+#endif
+
@@ -31,6 +31,7 @@
 #include "OT_types.h"
 #include "OT_config.h"
 #include "OT_platform.h" 
+#include "queue.h"
 
 
 /** @note Note on AES configuration <BR>
@@ -43,9 +44,14 @@
   *      
   * fast - version with different key-schedule for encryption/decryption using: 
   *        256 + 256 + 10*4 + 256*4*2 bytes data = 2058 bytes of look-up table.
+  *
+  * If the MCU has an AES engine (MCU_FEATURE_AES128), neither is built and the
+  * functions below go to platform_aes_encrypt() / platform_aes_decrypt().  The
+  * platform versions also take multiple blocks, and platform_aes_start() runs
+  * a job in the background with a completion callback.
   */
 
-#define AES_NEEDED      (OT_FEATURE(DLL_SECURITY) || OT_FEATURE(VL_SECURITY))
+#define AES_NEEDED      (OT_FEATURE(DLL_SECURITY) || OT_FEATURE(NL_SECURITY) || OT_FEATURE(VL_SECURITY))
 #define AES_USEHW       (AES_NEEDED && MCU_FEATURE(AES128))
 #define AES_USEFAST     (AES_NEEDED && (MCU_FEATURE(AES128)==DISABLED))
 #define AES_USELITE     (AES_NEEDED && (MCU_FEATURE(AES128)==DISABLED) && MCU_FEATURE(AES128_LITE))
@@ -98,6 +104,84 @@ void AES_encrypt(ot_u32* input_pointer, ot_u32* output_pointer, ot_u32* expkey);
 void AES_decrypt(ot_u32* input_pointer, ot_u32* output_pointer, ot_u32* expkey); 
  
  
+ 
+
+/** AES-CCM Bulk Functions <BR>
+  * ========================================================================<BR>
+  * CCM (RFC 3610) as used by DASH7 security, on a Queue, in place.  The length
+  * field is two bytes (L = 2), so the nonce is AES_CCM_NONCE_SIZE bytes.  Only
+  * the forward cipher is used, so one key schedule from AES_ccm_keyschedule()
+  * serves both directions, and it can be cached with the key (see auth.h).
+  *
+  * The CTR keystream is made AES_CCM_AHEAD blocks at a time, ahead of the data
+  * cursor, so hardware engines get multi-block jobs.  With OT_FEATURE(PROFILER)
+  * each 16 byte block is logged to SYS_PROFILE_CCM: the mean / 16 is the cost
+  * per byte, in platform_get_cycles() units.
+  */
+#define AES_CCM_NONCE_SIZE  13
+
+#ifndef AES_CCM_AHEAD
+#   define AES_CCM_AHEAD    4
+#endif
+
+
+
+/** @brief Makes the AES-CCM key schedule from a key as stored (bytes)
+  * @param key          (ot_u32*) 16 byte key, in stored byte order
+  * @param expkey       (ot_u32*) AES_EXPKEY_SIZE words of schedule output
+  * @retval None
+  * @ingroup AES128
+  */
+void AES_ccm_keyschedule(ot_u32* key, ot_u32* expkey);
+
+
+
+/** @brief Derives a new key by encrypting a block of info with a key schedule
+  * @param newkey       (ot_u32*) 16 byte key output, in stored byte order
+  * @param info         (ot_u8*) 16 bytes of info (e.g. a dialog's identity)
+  * @param expkey       (ot_u32*) schedule from AES_ccm_keyschedule()
+  * @retval None
+  * @ingroup AES128
+  *
+  * newkey = AES(expkey, info), so it can go straight to AES_ccm_keyschedule().
+  * It is one block of the cipher, so a key made once per dialog costs about
+  * as much as 16 bytes of CCM data.
+  */
+void AES_ccm_derivekey(ot_u32* newkey, ot_u8* info, ot_u32* expkey);
+
+
+
+/** @brief Encrypts and authenticates the data in a Queue with AES-CCM
+  * @param q            (Queue*) getcursor: start of data, putcursor: end
+  * @param a_len        (ot_int) bytes at getcursor that are authenticated only
+  * @param nonce        (ot_u8*) AES_CCM_NONCE_SIZE bytes of nonce
+  * @param mic_len      (ot_int) MIC bytes: 4, 6, 8, 10, 12, 14, or 16
+  * @param expkey       (ot_u32*) schedule from AES_ccm_keyschedule()
+  * @retval ot_int      mic_len, or -1 on bad input or no room for the MIC
+  * @ingroup AES128
+  *
+  * The bytes after the a_len header, up to putcursor, are encrypted in place
+  * and the MIC is written at putcursor.  getcursor is not moved.
+  */
+ot_int AES_encrypt_ccm(Queue* q, ot_int a_len, ot_u8* nonce, ot_int mic_len, ot_u32* expkey);
+
+
+
+/** @brief Decrypts and checks the data in a Queue with AES-CCM
+  * @param q            (Queue*) getcursor: start of data, putcursor: end of MIC
+  * @param a_len        (ot_int) bytes at getcursor that are authenticated only
+  * @param nonce        (ot_u8*) AES_CCM_NONCE_SIZE bytes of nonce
+  * @param mic_len      (ot_int) MIC bytes: 4, 6, 8, 10, 12, 14, or 16
+  * @param expkey       (ot_u32*) schedule from AES_ccm_keyschedule()
+  * @retval ot_int      0 when the MIC is good, -1 otherwise
+  * @ingroup AES128
+  *
+  * The data is decrypted in place and the MIC is taken off the queue.  If the
+  * MIC does not match, the decrypted data is zeroed.
+  */
+ot_int AES_decrypt_ccm(Queue* q, ot_int a_len, ot_u8* nonce, ot_int mic_len, ot_u32* expkey);
+
+ 
 
 #endif
  
@@ -0,0 +1,576 @@
+/* Copyright 2010-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/dashforth.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      DASHForth applet VM
+  * @ingroup    DASHForth
+  *
+  * See dashforth.h for the bytecode and the model of execution.
+  ******************************************************************************
+  */
+
+#include "dashforth.h"
+
+#if (OT_FEATURE(DASHFORTH) == ENABLED)
+
+#include "OT_platform.h"
+#include "system.h"
+
+
+#define DF_SP0(VM)      (&(VM)->dstack[DF_GUARD_LO-1])
+#define DF_SPMAX(VM)    (&(VM)->dstack[DF_GUARD_LO+DASHFORTH_DSTACK-1])
+#define DF_FLAG(EXPR)   ((df_cell)0 - (df_cell)(EXPR))
+
+/// Operand kinds of the bytecode, for the loader
+#define OPD_NONE        0
+#define OPD_LIT8        1
+#define OPD_LIT16       2
+#define OPD_TARGET      3
+
+
+
+
+/** Primitives <BR>
+  * ========================================================================<BR>
+  * Each primitive does its word and nothing else.  The inner interpreter
+  * checks the data stack after each word, and the guard cells take the reads
+  * and writes of a word that runs on a stack that is too shallow or too deep.
+  */
+
+static void p_exit(df_vm* vm) {
+    if (vm->rp == vm->rstack) {
+        vm->state = DF_STATE_DONE;
+    }
+    else {
+        vm->ip = (--vm->rp)->ip;
+    }
+}
+
+static void p_lit(df_vm* vm) {
+    *++vm->sp = (vm->ip++)->lit;
+}
+
+static void p_branch(df_vm* vm) {
+    vm->ip = vm->ip->ip;
+}
+
+static void p_zbranch(df_vm* vm) {
+    vm->ip = (*vm->sp-- == 0) ? vm->ip->ip : (vm->ip + 1);
+}
+
+static void p_call(df_vm* vm) {
+    if (vm->rp == &vm->rstack[DASHFORTH_RSTACK]) {
+        vm->state = DF_ERR_RSTACK;
+        return;
+    }
+    (vm->rp++)->ip  = vm->ip + 1;
+    vm->ip          = vm->ip->ip;
+}
+
+static void p_dup(df_vm* vm)    { vm->sp[1] = vm->sp[0]; vm->sp++; }
+static void p_drop(df_vm* vm)   { vm->sp--; }
+static void p_over(df_vm* vm)   { vm->sp[1] = vm->sp[-1]; vm->sp++; }
+
+static void p_swap(df_vm* vm) {
+    df_cell a   = vm->sp[0];
+    vm->sp[0]   = vm->sp[-1];
+    vm->sp[-1]  = a;
+}
+
+static void p_rot(df_vm* vm) {
+    df_cell a   = vm->sp[-2];
+    vm->sp[-2]  = vm->sp[-1];
+    vm->sp[-1]  = vm->sp[0];
+    vm->sp[0]   = a;
+}
+
+static void p_tor(df_vm* vm) {
+    if (vm->rp == &vm->rstack[DASHFORTH_RSTACK]) {
+        vm->state = DF_ERR_RSTACK;
+        return;
+    }
+    (vm->rp++)->n = *vm->sp--;
+}
+
+static void p_rfrom(df_vm* vm) {
+    if (vm->rp == vm->rstack) {
+        vm->state = DF_ERR_RSTACK;
+        return;
+    }
+    *++vm->sp = (--vm->rp)->n;
+}
+
+static void p_rfetch(df_vm* vm) {
+    if (vm->rp == vm->rstack) {
+        vm->state = DF_ERR_RSTACK;
+        return;
+    }
+    *++vm->sp = vm->rp[-1].n;
+}
+
+static void p_add(df_vm* vm)    { vm->sp--; vm->sp[0] += vm->sp[1]; }
+static void p_sub(df_vm* vm)    { vm->sp--; vm->sp[0] -= vm->sp[1]; }
+static void p_mul(df_vm* vm)    { vm->sp--; vm->sp[0] *= vm->sp[1]; }
+static void p_and(df_vm* vm)    { vm->sp--; vm->sp[0] &= vm->sp[1]; }
+static void p_or(df_vm* vm)     { vm->sp--; vm->sp[0] |= vm->sp[1]; }
+static void p_xor(df_vm* vm)    { vm->sp--; vm->sp[0] ^= vm->sp[1]; }
+static void p_negate(df_vm* vm) { vm->sp[0] = -vm->sp[0]; }
+static void p_invert(df_vm* vm) { vm->sp[0] = ~vm->sp[0]; }
+static void p_abs(df_vm* vm)    { if (vm->sp[0] < 0) vm->sp[0] = -vm->sp[0]; }
+
+static void p_div(df_vm* vm) {
+    vm->sp--;
+    if (vm->sp[1] == 0) vm->state = DF_ERR_MATH;
+    else                vm->sp[0] /= vm->sp[1];
+}
+
+static void p_mod(df_vm* vm) {
+    vm->sp--;
+    if (vm->sp[1] == 0) vm->state = DF_ERR_MATH;
+    else                vm->sp[0] %= vm->sp[1];
+}
+
+static void p_lshift(df_vm* vm) {
+    vm->sp--;
+    vm->sp[0] = (vm->sp[1] & ~15) ? 0 : (df_cell)((ot_u16)vm->sp[0] << vm->sp[1]);
+}
+
+static void p_rshift(df_vm* vm) {
+    vm->sp--;
+    vm->sp[0] = (vm->sp[1] & ~15) ? 0 : (df_cell)((ot_u16)vm->sp[0] >> vm->sp[1]);
+}
+
+static void p_min(df_vm* vm) {
+    vm->sp--;
+    if (vm->sp[1] < vm->sp[0]) vm->sp[0] = vm->sp[1];
+}
+
+static void p_max(df_vm* vm) {
+    vm->sp--;
+    if (vm->sp[1] > vm->sp[0]) vm->sp[0] = vm->sp[1];
+}
+
+static void p_eq(df_vm* vm)     { vm->sp--; vm->sp[0] = DF_FLAG(vm->sp[0] == vm->sp[1]); }
+static void p_lt(df_vm* vm)     { vm->sp--; vm->sp[0] = DF_FLAG(vm->sp[0] < vm->sp[1]); }
+static void p_gt(df_vm* vm)     { vm->sp--; vm->sp[0] = DF_FLAG(vm->sp[0] > vm->sp[1]); }
+static void p_zeq(df_vm* vm)    { vm->sp[0] = DF_FLAG(vm->sp[0] == 0); }
+
+static void p_ult(df_vm* vm) {
+    vm->sp--;
+    vm->sp[0] = DF_FLAG((ot_u16)vm->sp[0] < (ot_u16)vm->sp[1]);
+}
+
+static void p_fetch(df_vm* vm) {
+    if ((ot_u16)vm->sp[0] >= DASHFORTH_VARS)    vm->state = DF_ERR_VAR;
+    else                                        vm->sp[0] = vm->var[vm->sp[0]];
+}
+
+static void p_store(df_vm* vm) {
+    vm->sp -= 2;
+    if ((ot_u16)vm->sp[2] >= DASHFORTH_VARS)    vm->state = DF_ERR_VAR;
+    else                                        vm->var[vm->sp[2]] = vm->sp[1];
+}
+
+static void p_plusstore(df_vm* vm) {
+    vm->sp -= 2;
+    if ((ot_u16)vm->sp[2] >= DASHFORTH_VARS)    vm->state = DF_ERR_VAR;
+    else                                        vm->var[vm->sp[2]] += vm->sp[1];
+}
+
+
+static vlFILE* sub_file(df_vm* vm, df_cell block, df_cell id) {
+/// The file that was read last stays open, because an applet usually reads
+/// many values from one file.
+    if ((vm->fp != NULL) && (vm->fblock == (ot_u8)block) && (vm->fid == (ot_u8)id)) {
+        return vm->fp;
+    }
+    if (vm->fp != NULL) {
+        vl_close(vm->fp);
+    }
+    vm->fblock  = (ot_u8)block;
+    vm->fid     = (ot_u8)id;
+    vm->fp      = vl_open((vlBLOCK)block, (ot_u8)id, VL_ACCESS_R, vm->user_id);
+    if (vm->fp == NULL) {
+        vm->state = DF_ERR_FILE;
+    }
+    return vm->fp;
+}
+
+static ot_u8 sub_byte(vlFILE* fp, ot_u16 off) {
+    Twobytes val;
+    val.ushort = vl_read(fp, off & ~1);
+    return val.ubyte[off & 1];
+}
+
+static void p_fread(df_vm* vm) {
+    vlFILE* fp;
+    ot_u16  off;
+    vm->sp -= 2;
+    off = (ot_u16)vm->sp[2];
+    fp  = sub_file(vm, vm->sp[0], vm->sp[1]);
+    if (fp != NULL) {
+        if ((off >= fp->length) || ((fp->length - off) < 2)) {
+            vm->state = DF_ERR_FILE;
+            return;
+        }
+        vm->sp[0] = (df_cell)(((ot_u16)sub_byte(fp, off) << 8) | sub_byte(fp, off+1));
+    }
+}
+
+static void p_freadb(df_vm* vm) {
+    vlFILE* fp;
+    ot_u16  off;
+    vm->sp -= 2;
+    off = (ot_u16)vm->sp[2];
+    fp  = sub_file(vm, vm->sp[0], vm->sp[1]);
+    if (fp != NULL) {
+        if (off >= fp->length) {
+            vm->state = DF_ERR_FILE;
+            return;
+        }
+        vm->sp[0] = sub_byte(fp, off);
+    }
+}
+
+static void p_flen(df_vm* vm) {
+    vlFILE* fp;
+    vm->sp--;
+    fp = sub_file(vm, vm->sp[0], vm->sp[1]);
+    if (fp != NULL) {
+        vm->sp[0] = (df_cell)fp->length;
+    }
+}
+
+static void p_emit(df_vm* vm) {
+    if ((vm->out->putcursor + 2) > vm->out->back) {
+        vm->state = DF_ERR_OUTPUT;
+        return;
+    }
+    q_writeshort(vm->out, (ot_u16)*vm->sp--);
+}
+
+static void p_emitb(df_vm* vm) {
+    if ((vm->out->putcursor + 1) > vm->out->back) {
+        vm->state = DF_ERR_OUTPUT;
+        return;
+    }
+    q_writebyte(vm->out, (ot_u8)*vm->sp--);
+}
+
+
+
+
+/** Opcode Table <BR>
+  * ========================================================================<BR>
+  */
+typedef struct {
+    df_prim fn;
+    ot_u8   operand;
+} df_op;
+
+static const df_op df_ops[DF_OPCODES] = {
+    { &p_exit,      OPD_NONE },     // 0x00
+    { &p_lit,       OPD_LIT8 },
+    { &p_lit,       OPD_LIT16 },
+    { &p_branch,    OPD_TARGET },
+    { &p_zbranch,   OPD_TARGET },
+    { &p_call,      OPD_TARGET },
+    { &p_dup,       OPD_NONE },
+    { &p_drop,      OPD_NONE },
+    { &p_swap,      OPD_NONE },     // 0x08
+    { &p_over,      OPD_NONE },
+    { &p_rot,       OPD_NONE },
+    { &p_tor,       OPD_NONE },
+    { &p_rfrom,     OPD_NONE },
+    { &p_rfetch,    OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { &p_add,       OPD_NONE },     // 0x10
+    { &p_sub,       OPD_NONE },
+    { &p_mul,       OPD_NONE },
+    { &p_div,       OPD_NONE },
+    { &p_mod,       OPD_NONE },
+    { &p_negate,    OPD_NONE },
+    { &p_and,       OPD_NONE },
+    { &p_or,        OPD_NONE },
+    { &p_xor,       OPD_NONE },     // 0x18
+    { &p_invert,    OPD_NONE },
+    { &p_lshift,    OPD_NONE },
+    { &p_rshift,    OPD_NONE },
+    { &p_min,       OPD_NONE },
+    { &p_max,       OPD_NONE },
+    { &p_abs,       OPD_NONE },
+    { NULL,         OPD_NONE },
+    { &p_eq,        OPD_NONE },     // 0x20
+    { &p_lt,        OPD_NONE },
+    { &p_gt,        OPD_NONE },
+    { &p_zeq,       OPD_NONE },
+    { &p_ult,       OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { &p_fetch,     OPD_NONE },     // 0x28
+    { &p_store,     OPD_NONE },
+    { &p_plusstore, OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { &p_fread,     OPD_NONE },     // 0x30
+    { &p_freadb,    OPD_NONE },
+    { &p_flen,      OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { NULL,         OPD_NONE },
+    { &p_emit,      OPD_NONE },     // 0x38
+    { &p_emitb,     OPD_NONE }
+};
+
+
+
+
+/** VM Functions <BR>
+  * ========================================================================<BR>
+  */
+
+#ifndef EXTF_df_init
+void df_init(df_vm* vm, Queue* out, id_tmpl* user_id) {
+    vm->ip      = vm->code;
+    vm->sp      = DF_SP0(vm);
+    vm->rp      = vm->rstack;
+    vm->state   = DF_ERR_LOAD;
+    vm->user_id = user_id;
+    vm->out     = out;
+    vm->fp      = NULL;
+    vm->code[0].fn = &p_exit;
+    platform_memset((ot_u8*)vm->var, 0, sizeof(vm->var));
+}
+#endif
+
+
+#ifndef EXTF_df_load
+ot_int df_load(df_vm* vm, ot_u8* bytecode, ot_uint length) {
+/// Pass 1 checks the opcodes and maps the byte offset of each word to its
+/// cell.  Pass 2 writes the threaded code, with targets as cell addresses.
+/// Every word takes as many cells as bytes, or fewer, so the code fits.
+    ot_u8   map[DASHFORTH_BYTES];
+    ot_uint i;
+    ot_u8   cell;
+
+    vm->state = DF_ERR_LOAD;
+    if (length > DASHFORTH_BYTES) {
+        return DF_ERR_LOAD;
+    }
+
+    for (i=0, cell=0; i<length; ) {
+        ot_u8 op = bytecode[i];
+        if ((op >= DF_OPCODES) || (df_ops[op].fn == NULL)) {
+            return DF_ERR_LOAD;
+        }
+        map[i++] = cell++;
+        if (df_ops[op].operand != OPD_NONE) {
+            ot_u8 bytes = (df_ops[op].operand == OPD_LIT8) ? 1 : 2;
+            if ((i + bytes) > length) {
+                return DF_ERR_LOAD;
+            }
+            for (; bytes!=0; bytes--) {
+                map[i++] = 0xFF;
+            }
+            cell++;
+        }
+    }
+
+    for (i=0; i<length; ) {
+        ot_u8       op      = bytecode[i];
+        df_code*    code    = &vm->code[map[i]];
+        code->fn            = df_ops[op].fn;
+
+        switch (df_ops[op].operand) {
+            case OPD_LIT8:  code[1].lit = (df_cell)(signed char)bytecode[i+1];
+                            i += 2;
+                            break;
+
+            case OPD_LIT16: code[1].lit = (df_cell)(((ot_u16)bytecode[i+1] << 8) | bytecode[i+2]);
+                            i += 3;
+                            break;
+
+            case OPD_TARGET: {
+                ot_uint target = ((ot_uint)bytecode[i+1] << 8) | bytecode[i+2];
+                if (target == length) {
+                    code[1].ip = &vm->code[cell];       // the final EXIT
+                }
+                else if ((target > length) || (map[target] == 0xFF)) {
+                    return DF_ERR_LOAD;
+                }
+                else {
+                    code[1].ip = &vm->code[map[target]];
+                }
+                i += 3;
+            } break;
+
+            default:        i += 1;
+                            break;
+        }
+    }
+
+    // Running off the end is an EXIT
+    vm->code[cell].fn   = &p_exit;
+    vm->ip              = vm->code;
+    vm->state           = DF_STATE_RUN;
+    return DF_STATE_RUN;
+}
+#endif
+
+
+#ifndef EXTF_df_load_file
+ot_int df_load_file(df_vm* vm, ot_u8 block, ot_u8 id) {
+    ot_u8   bytecode[DASHFORTH_BYTES];
+    vlFILE* fp;
+    ot_uint length;
+
+    fp = vl_open((vlBLOCK)block, id, VL_ACCESS_R, vm->user_id);
+    if (fp == NULL) {
+        vm->state = DF_ERR_FILE;
+        return DF_ERR_FILE;
+    }
+    length = fp->length;
+    if (length > DASHFORTH_BYTES) {
+        vl_close(fp);
+        vm->state = DF_ERR_LOAD;
+        return DF_ERR_LOAD;
+    }
+    vl_load(fp, length, bytecode);
+    vl_close(fp);
+
+    return df_load(vm, bytecode, length);
+}
+#endif
+
+
+#ifndef EXTF_df_push
+void df_push(df_vm* vm, df_cell n) {
+    if (vm->sp == DF_SPMAX(vm)) {
+        vm->state = DF_ERR_STACK;
+        return;
+    }
+    *++vm->sp = n;
+}
+#endif
+
+
+#ifndef EXTF_df_stop
+void df_stop(df_vm* vm, ot_int state) {
+    if (vm->fp != NULL) {
+        vl_close(vm->fp);
+        vm->fp = NULL;
+    }
+    vm->state = state;
+}
+#endif
+
+
+#ifndef EXTF_df_run
+ot_int df_run(df_vm* vm, ot_uint steps) {
+/// Inner interpreter: call the primitive that ip points to, and move on.  The
+/// primitives change state to stop the applet.
+    df_cell* sp0    = DF_SP0(vm);
+    df_cell* spmax  = DF_SPMAX(vm);
+
+    while ((vm->state == DF_STATE_RUN) && (steps != 0)) {
+        steps--;
+        (vm->ip++)->fn(vm);
+        if ((vm->sp < sp0) || (vm->sp > spmax)) {
+            vm->state = DF_ERR_STACK;
+        }
+    }
+
+    if (vm->state != DF_STATE_RUN) {
+        df_stop(vm, vm->state);
+    }
+    return vm->state;
+}
+#endif
+
+
+
+
+/** Background Applet <BR>
+  * ========================================================================<BR>
+  */
+#if (OT_FEATURE(APPTASKS) == ENABLED)
+
+static df_vm    df_bg;
+static Queue    df_bgq;
+static ot_u8    df_bgout[DASHFORTH_OUTBYTES];
+static ot_bool  df_bgtask = False;
+
+ot_long sub_bg_task() {
+    if (df_run(&df_bg, DASHFORTH_SLICE) == DF_STATE_RUN) {
+        return 0;
+    }
+    df_bgtask = False;
+    return -1;
+}
+
+
+#ifndef EXTF_df_bg_start
+ot_int df_bg_start(ot_u8 block, ot_u8 id, df_cell* args, ot_int nargs, id_tmpl* user_id) {
+    if (df_bg.state == DF_STATE_RUN) {
+        df_stop(&df_bg, DF_ERR_STEPS);
+    }
+    q_init(&df_bgq, df_bgout, DASHFORTH_OUTBYTES);
+    df_init(&df_bg, &df_bgq, user_id);
+    if (df_load_file(&df_bg, block, id) != DF_STATE_RUN) {
+        return df_bg.state;
+    }
+    for (; nargs>0; nargs--) {
+        df_push(&df_bg, *args++);
+    }
+
+    // The task of a stopped applet may still be in the list: it ends itself
+    if ((df_bgtask == False) && (sys_task_add(&sub_bg_task, DASHFORTH_PRIO, 0) >= 0)) {
+        df_bgtask = True;
+    }
+    if (df_bgtask == False) {
+        df_stop(&df_bg, DF_ERR_STEPS);
+    }
+    return df_bg.state;
+}
+#endif
+
+
+#ifndef EXTF_df_bg_output
+ot_int df_bg_output(Queue* out) {
+    if (df_bg.state != DF_STATE_RUN) {
+        ot_int length = df_bgq.length;
+        if ((out->putcursor + length) > out->back) {
+            length = out->back - out->putcursor;
+        }
+        q_writestring(out, df_bgout, length);
+    }
+    return df_bg.state;
+}
+#endif
+
+#endif
+
+#endif
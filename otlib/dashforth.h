@@ -0,0 +1,296 @@
+/* Copyright 2010-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/dashforth.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      DASHForth applet VM
+  * @defgroup   DASHForth (DASHForth Module)
+  * @ingroup    DASHForth
+  *
+  * DASHForth applets are small Forth programs that run on the device, so that
+  * a query or an aggregation can be done where the data is, and only the
+  * result goes over the air.
+  *
+  * Applets are sent and stored as bytecode (one byte per word, with inline
+  * operands), which is the same on every platform.  When an applet is loaded,
+  * the bytecode is checked and translated into direct-threaded code in RAM:
+  * each word becomes the address of its primitive, and each operand (literal
+  * or branch target) becomes a cell of its own.  The inner interpreter then
+  * only calls the next primitive, with no decoding and no range checks.
+  * The data stack has guard cells at both ends, so it is checked once per
+  * word by the inner interpreter, not by each primitive.
+  *
+  * Every run has a budget of words.  An applet that runs out of budget is
+  * paused, and can be resumed, so an applet never holds the CPU for more than
+  * a known time.  Applets started in the background run DASHFORTH_SLICE
+  * words per app task slice (OT_FEATURE(APPTASKS)).
+  *
+  * Applets can read files (with the access rights of the user that sent the
+  * applet), keep a few variables, and emit output, which is the response.
+  ******************************************************************************
+  */
+
+#ifndef __DASHFORTH_H
+#define __DASHFORTH_H
+
+#include "OT_types.h"
+#include "OT_config.h"
+
+#if (OT_FEATURE(DASHFORTH) == ENABLED)
+
+#include "OTAPI_tmpl.h"
+#include "queue.h"
+#include "veelite.h"
+
+
+/** DASHForth VM parameters
+  * DASHFORTH_BYTES:    Max bytecode length of an applet (254 max).  The
+  *                     threaded code takes (DASHFORTH_BYTES+1) cells.
+  * DASHFORTH_DSTACK:   Data stack depth, cells
+  * DASHFORTH_RSTACK:   Return stack depth, cells (calls and >R)
+  * DASHFORTH_VARS:     Variables, cells
+  * DASHFORTH_STEPS:    Word budget of an applet run by ALP, which responds
+  *                     only when the applet is done
+  * DASHFORTH_SLICE:    Word budget of a background applet per app task slice
+  * DASHFORTH_OUTBYTES: Output buffer of a background applet
+  * DASHFORTH_PRIO:     App task priority of a background applet
+  */
+#ifndef DASHFORTH_BYTES
+#   define DASHFORTH_BYTES      128
+#endif
+#ifndef DASHFORTH_DSTACK
+#   define DASHFORTH_DSTACK     16
+#endif
+#ifndef DASHFORTH_RSTACK
+#   define DASHFORTH_RSTACK     8
+#endif
+#ifndef DASHFORTH_VARS
+#   define DASHFORTH_VARS       8
+#endif
+#ifndef DASHFORTH_STEPS
+#   define DASHFORTH_STEPS      2048
+#endif
+#ifndef DASHFORTH_SLICE
+#   define DASHFORTH_SLICE      64
+#endif
+#ifndef DASHFORTH_OUTBYTES
+#   define DASHFORTH_OUTBYTES   32
+#endif
+#ifndef DASHFORTH_PRIO
+#   define DASHFORTH_PRIO       2
+#endif
+
+#if (DASHFORTH_BYTES > 254)
+#   error "DASHFORTH_BYTES must be 254 or less"
+#endif
+
+
+
+/** Bytecode
+  * Operands are big endian.  Branch and call targets are byte offsets in the
+  * applet, and must be the start of a word.  True is -1, False is 0.  The
+  * applet ends with EXIT at the top level, or when it runs off its end.
+  */
+#define DF_EXIT         0x00    // ( -- )           return, or end the applet
+#define DF_LIT8         0x01    // ( -- n )         1 byte operand, signed
+#define DF_LIT16        0x02    // ( -- n )         2 byte operand
+#define DF_BRANCH       0x03    // ( -- )           2 byte target
+#define DF_ZBRANCH      0x04    // ( f -- )         2 byte target, if f is 0
+#define DF_CALL         0x05    // ( -- )           2 byte target
+#define DF_DUP          0x06    // ( a -- a a )
+#define DF_DROP         0x07    // ( a -- )
+#define DF_SWAP         0x08    // ( a b -- b a )
+#define DF_OVER         0x09    // ( a b -- a b a )
+#define DF_ROT          0x0A    // ( a b c -- b c a )
+#define DF_TOR          0x0B    // ( a -- )         >R
+#define DF_RFROM        0x0C    // ( -- a )         R>
+#define DF_RFETCH       0x0D    // ( -- a )         R@
+#define DF_ADD          0x10    // ( a b -- a+b )
+#define DF_SUB          0x11    // ( a b -- a-b )
+#define DF_MUL          0x12    // ( a b -- a*b )
+#define DF_DIV          0x13    // ( a b -- a/b )
+#define DF_MOD          0x14    // ( a b -- a%b )
+#define DF_NEGATE       0x15    // ( a -- -a )
+#define DF_AND          0x16    // ( a b -- a&b )
+#define DF_OR           0x17    // ( a b -- a|b )
+#define DF_XOR          0x18    // ( a b -- a^b )
+#define DF_INVERT       0x19    // ( a -- ~a )
+#define DF_LSHIFT       0x1A    // ( a n -- a<<n )
+#define DF_RSHIFT       0x1B    // ( a n -- a>>n )  logical
+#define DF_MIN          0x1C    // ( a b -- min )
+#define DF_MAX          0x1D    // ( a b -- max )
+#define DF_ABS          0x1E    // ( a -- |a| )
+#define DF_EQ           0x20    // ( a b -- f )
+#define DF_LT           0x21    // ( a b -- f )
+#define DF_GT           0x22    // ( a b -- f )
+#define DF_ZEQ          0x23    // ( a -- f )
+#define DF_ULT          0x24    // ( a b -- f )     unsigned
+#define DF_FETCH        0x28    // ( v -- n )       variable v
+#define DF_STORE        0x29    // ( n v -- )
+#define DF_PLUSSTORE    0x2A    // ( n v -- )
+#define DF_FREAD        0x30    // ( blk id off -- n )  16 bits, big endian
+#define DF_FREADB       0x31    // ( blk id off -- c )
+#define DF_FLEN         0x32    // ( blk id -- len )
+#define DF_EMIT         0x38    // ( n -- )         2 bytes of output
+#define DF_EMITB        0x39    // ( c -- )         1 byte of output
+#define DF_OPCODES      0x3A
+
+
+/** Run states, from df_run().  Errors are negative.
+  */
+#define DF_STATE_RUN        1       // budget used up, df_run() again to resume
+#define DF_STATE_DONE       0
+#define DF_ERR_LOAD         -1      // bad opcode, operand or target
+#define DF_ERR_STACK        -2      // data stack under or overflow
+#define DF_ERR_RSTACK       -3
+#define DF_ERR_MATH         -4      // divide by zero
+#define DF_ERR_VAR          -5      // variable out of range
+#define DF_ERR_FILE         -6      // file cannot be opened or read
+#define DF_ERR_OUTPUT       -7      // output is full
+#define DF_ERR_STEPS        -8      // budget used up, and not resumed
+
+
+typedef ot_int df_cell;
+
+struct df_vm_struct;
+typedef void (*df_prim)(struct df_vm_struct*);
+
+typedef union df_code_union {
+    df_prim                 fn;
+    df_cell                 lit;
+    union df_code_union*    ip;
+} df_code;
+
+typedef union {
+    df_code*    ip;
+    df_cell     n;
+} df_rcell;
+
+#define DF_GUARD_LO     3           // deepest read below an empty stack (ROT)
+#define DF_GUARD_HI     1           // most cells a word pushes
+
+typedef struct df_vm_struct {
+    df_code*    ip;
+    df_cell*    sp;                 // top of stack
+    df_rcell*   rp;                 // next free return stack cell
+    ot_int      state;
+    id_tmpl*    user_id;            // for file access, NULL is root
+    Queue*      out;
+    vlFILE*     fp;                 // last file read, kept open for the run
+    ot_u8       fblock;
+    ot_u8       fid;
+    df_cell     dstack[DF_GUARD_LO + DASHFORTH_DSTACK + DF_GUARD_HI];
+    df_rcell    rstack[DASHFORTH_RSTACK];
+    df_cell     var[DASHFORTH_VARS];
+    df_code     code[DASHFORTH_BYTES + 1];
+} df_vm;
+
+
+
+
+/** @brief  Resets a VM
+  * @param  vm          (df_vm*) VM
+  * @param  out         (Queue*) output, written at the putcursor
+  * @param  user_id     (id_tmpl*) user running the applet, NULL for root
+  * @retval None
+  * @ingroup DASHForth
+  */
+void df_init(df_vm* vm, Queue* out, id_tmpl* user_id);
+
+
+/** @brief  Checks bytecode and loads it as threaded code
+  * @param  vm          (df_vm*) VM, after df_init()
+  * @param  bytecode    (ot_u8*) applet bytecode
+  * @param  length      (ot_uint) bytes of bytecode
+  * @retval ot_int      DF_STATE_RUN if it is ready, or DF_ERR_LOAD
+  * @ingroup DASHForth
+  */
+ot_int df_load(df_vm* vm, ot_u8* bytecode, ot_uint length);
+
+
+/** @brief  Loads an applet stored in a file
+  * @param  vm          (df_vm*) VM, after df_init()
+  * @param  block       (ot_u8) vlBLOCK of the file
+  * @param  id          (ot_u8) file ID
+  * @retval ot_int      DF_STATE_RUN, DF_ERR_FILE or DF_ERR_LOAD
+  * @ingroup DASHForth
+  *
+  * The file is opened with the rights of the VM user, for read.
+  */
+ot_int df_load_file(df_vm* vm, ot_u8 block, ot_u8 id);
+
+
+/** @brief  Pushes an argument onto the data stack, before df_run()
+  * @param  vm          (df_vm*) VM
+  * @param  n           (df_cell) argument
+  * @retval None
+  * @ingroup DASHForth
+  */
+void df_push(df_vm* vm, df_cell n);
+
+
+/** @brief  Runs the loaded applet
+  * @param  vm          (df_vm*) VM
+  * @param  steps       (ot_uint) budget of words
+  * @retval ot_int      DF_STATE_RUN if the budget is used up, DF_STATE_DONE,
+  *                     or an error.  The open file is closed unless RUN.
+  * @ingroup DASHForth
+  */
+ot_int df_run(df_vm* vm, ot_uint steps);
+
+
+/** @brief  Stops the applet and closes its file, if any
+  * @param  vm          (df_vm*) VM
+  * @param  state       (ot_int) state to leave the VM in
+  * @retval None
+  * @ingroup DASHForth
+  */
+void df_stop(df_vm* vm, ot_int state);
+
+
+
+#if (OT_FEATURE(APPTASKS) == ENABLED)
+/** @brief  Starts a stored applet in the background
+  * @param  block       (ot_u8) vlBLOCK of the file
+  * @param  id          (ot_u8) file ID
+  * @param  args        (df_cell*) arguments, pushed in order
+  * @param  nargs       (ot_int) number of arguments
+  * @param  user_id     (id_tmpl*) user, NULL for root
+  * @retval ot_int      DF_STATE_RUN if it is started, or a load error
+  * @ingroup DASHForth
+  *
+  * A background applet that is still running is stopped first.  The applet
+  * runs as an app task, DASHFORTH_SLICE words per slice.  Its
+  * output goes to a buffer of DASHFORTH_OUTBYTES, read by df_bg_output().
+  */
+ot_int df_bg_start(ot_u8 block, ot_u8 id, df_cell* args, ot_int nargs, id_tmpl* user_id);
+
+
+/** @brief  State and output of the background applet
+  * @param  out         (Queue*) output, written at the putcursor
+  * @retval ot_int      state of the applet (DF_STATE_RUN while running)
+  * @ingroup DASHForth
+  *
+  * The output is copied when the applet is no longer running.
+  */
+ot_int df_bg_output(Queue* out);
+#endif
+
+
+#endif
+#endif
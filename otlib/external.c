@@ -22,8 +22,9 @@
   * @defgroup   External (External Module)
   * @ingroup    External
   *
-  * @note       WORK IN PROGRESS.  Sensors/External Events are not supported
-  *             in this version of OpenTag.
+  * @note       External Events are not supported in this version of OpenTag.
+  *             Sensors are sampled by the pipeline below, when SENSORS is
+  *             ENABLED (see external.h).
   ******************************************************************************
   */
 
@@ -32,7 +33,92 @@
 #include "external.h"
 
 
-void ext_init() { }
+#if (OT_FEATURE(SENSORS) == ENABLED)
+#include "OT_platform.h"
+#include "system.h"
+#include "veelite.h"
+
+#define SENSOR_BURST    (EXT_SENSOR_CHANNELS*EXT_SENSOR_ROUNDS)
+#define SENSOR_DIVISOR  (EXT_SENSOR_ROUNDS*EXT_SENSOR_DECIMATE)
+
+typedef struct {
+    ot_bool busy;                   // a burst is running
+    ot_u8   bursts;                 // bursts summed into acc
+    ot_u8   pending;                // records in rec, not in the file yet
+    ot_u16  period;
+    ot_u16  seq;                    // number of the next record (file + RAM)
+    ot_u16  capacity;               // records in the ring file
+    ot_u32  acc[EXT_SENSOR_CHANNELS];
+    ot_u16  rec[EXT_SENSOR_COALESCE][EXT_SENSOR_CHANNELS];
+    ot_u16  burst[SENSOR_BURST];    // DMA target
+} ext_sensor_struct;
+
+static ext_sensor_struct ext_sensor;
+
+
+void sub_sensor_init() {
+/// Pick up the ring where it was left.  The file is started over if its 
+/// header is not there or was made for a different number of channels.
+    vlFILE* fp;
+
+    platform_memset((ot_u8*)&ext_sensor, 0, sizeof(ext_sensor_struct));
+    ext_sensor.period = EXT_SENSOR_PERIOD;
+
+    fp = vl_open(VL_GFB_BLOCKID, EXT_SENSOR_FILE, VL_ACCESS_R, NULL);
+    if (fp != NULL) {
+        ot_uint alloc = vl_checkalloc(fp);
+        if (alloc > EXT_SENSOR_HEADBYTES) {
+            ext_sensor.capacity = (alloc - EXT_SENSOR_HEADBYTES) / EXT_SENSOR_RECBYTES;
+        }
+        if ((vl_checklength(fp) >= EXT_SENSOR_HEADBYTES) && \
+            ((ot_u8)vl_read(fp, 2) == EXT_SENSOR_CHANNELS)) {
+            ext_sensor.seq = vl_read(fp, 0);
+        }
+        vl_close(fp);
+    }
+
+#   if (OT_FEATURE(APPTASKS) == ENABLED)
+    sys_task_add(&ext_sensor_task, EXT_SENSOR_PRIO, EXT_SENSOR_PERIOD);
+#   endif
+}
+
+
+void sub_sensor_collect() {
+/// Sum the burst into the accumulators.  When EXT_SENSOR_DECIMATE bursts are
+/// in, each channel is averaged, with rounding, into a 12.4 fixed point value.
+    ot_u16* sample = ext_sensor.burst;
+    ot_int  i, j;
+
+    for (i=0; i<EXT_SENSOR_ROUNDS; i++) {
+        for (j=0; j<EXT_SENSOR_CHANNELS; j++) {
+            ext_sensor.acc[j] += *sample++;
+        }
+    }
+
+    if (++ext_sensor.bursts >= EXT_SENSOR_DECIMATE) {
+        ot_u16* rec = ext_sensor.rec[ext_sensor.pending];
+        for (j=0; j<EXT_SENSOR_CHANNELS; j++) {
+            rec[j]              = (ot_u16)(((ext_sensor.acc[j] << 4) + (SENSOR_DIVISOR/2)) / SENSOR_DIVISOR);
+            ext_sensor.acc[j]   = 0;
+        }
+        ext_sensor.bursts = 0;
+        ext_sensor.seq++;
+
+        if (++ext_sensor.pending >= EXT_SENSOR_COALESCE) {
+            ext_sensor_flush();
+        }
+    }
+}
+
+#endif
+
+
+
+void ext_init() { 
+#if (OT_FEATURE(SENSORS) == ENABLED)
+    sub_sensor_init();
+#endif
+}
 
 
 #ifndef EXTF_ext_get_m2appflags
@@ -41,3 +127,144 @@ ot_u8 ext_get_m2appflags() {
     return 0;
 }
 #endif
+
+
+
+#if (OT_FEATURE(SENSORS) == ENABLED)
+#ifndef EXTF_ext_sensor_task
+ot_long ext_sensor_task() {
+    if (ext_sensor.busy) {
+        if (platform_adc_busy()) {
+            return 1;
+        }
+        ext_sensor.busy = False;
+        sub_sensor_collect();
+        return (ot_long)ext_sensor.period - EXT_SENSOR_CONVTICKS;
+    }
+    if (ext_sensor.period == 0) {
+        return -1;
+    }
+    if (platform_adc_start(ext_sensor.burst, EXT_SENSOR_CHANNELS, EXT_SENSOR_ROUNDS) == False) {
+        return 1;
+    }
+    ext_sensor.busy = True;
+    return EXT_SENSOR_CONVTICKS;
+}
+#endif
+
+
+#ifndef EXTF_ext_sensor_period
+void ext_sensor_period(ot_u16 period) {
+/// When sampling was stopped, its app task is gone and is added again
+#   if (OT_FEATURE(APPTASKS) == ENABLED)
+    if ((ext_sensor.period == 0) && (period != 0) && (ext_sensor.busy == False)) {
+        sys_task_add(&ext_sensor_task, EXT_SENSOR_PRIO, period);
+    }
+#   endif
+    ext_sensor.period = period;
+}
+#endif
+
+
+#ifndef EXTF_ext_sensor_flush
+ot_u8 ext_sensor_flush() {
+/// One open and one header update for all of the pending records
+    vlFILE* fp;
+    ot_u16  seq;
+    ot_u8   i;
+    ot_u8   output = 0;
+
+    if (ext_sensor.pending == 0) {
+        return 0;
+    }
+
+    fp = vl_open(VL_GFB_BLOCKID, EXT_SENSOR_FILE, VL_ACCESS_W, NULL);
+    if ((fp == NULL) || (ext_sensor.capacity == 0)) {
+        output = 255;
+    }
+    else {
+        seq = ext_sensor.seq - ext_sensor.pending;
+        for (i=0; i<ext_sensor.pending; i++, seq++) {
+            ot_uint offset  = EXT_SENSOR_HEADBYTES + ((seq % ext_sensor.capacity) * EXT_SENSOR_RECBYTES);
+            ot_u8   j;
+            for (j=0; j<EXT_SENSOR_CHANNELS; j++, offset+=2) {
+                output |= vl_write(fp, offset, ext_sensor.rec[i][j]);
+            }
+        }
+        output |= vl_write(fp, 0, ext_sensor.seq);
+        output |= vl_write(fp, 2, EXT_SENSOR_CHANNELS);
+    }
+    if (fp != NULL) {
+        vl_close(fp);
+    }
+
+    // Records that do not make it to the file are dropped, so RAM stays free
+    ext_sensor.pending = 0;
+    return output;
+}
+#endif
+
+
+#ifndef EXTF_ext_sensor_seq
+ot_u16 ext_sensor_seq() {
+    return ext_sensor.seq;
+}
+#endif
+
+
+#ifndef EXTF_ext_sensor_capacity
+ot_u16 ext_sensor_capacity() {
+    return ext_sensor.capacity;
+}
+#endif
+
+
+#ifndef EXTF_ext_sensor_read
+ot_int ext_sensor_read(ot_u16* seq, ot_uint count, Queue* q, id_tmpl* user_id) {
+/// The window is cut to the records still held: the ring (capacity) plus the
+/// records in RAM.  Sequence math is modulo 2^16, like seq itself.
+    vlFILE* fp;
+    ot_u16  oldest;
+    ot_u16  avail;
+    ot_u16  flushed;
+    ot_uint fit;
+    ot_int  i, j;
+
+    fp = vl_open(VL_GFB_BLOCKID, EXT_SENSOR_FILE, VL_ACCESS_R, user_id);
+    if (fp == NULL) {
+        return -1;
+    }
+
+    flushed = ext_sensor.seq - ext_sensor.pending;
+    avail   = ext_sensor.pending + ((flushed < ext_sensor.capacity) ? flushed : ext_sensor.capacity);
+    oldest  = ext_sensor.seq - avail;
+    if ((ot_u16)(*seq - oldest) > avail) {
+        *seq = oldest;
+    }
+    avail   = ext_sensor.seq - *seq;
+    fit     = (ot_uint)(q->back - q->putcursor) / EXT_SENSOR_RECBYTES;
+    if (count > avail)  count = avail;
+    if (count > fit)    count = fit;
+
+    for (i=0; i<(ot_int)count; i++) {
+        ot_u16 n = *seq + i;
+        if ((ot_u16)(n - flushed) < ext_sensor.pending) {
+            ot_u16* rec = ext_sensor.rec[(ot_u16)(n - flushed)];
+            for (j=0; j<EXT_SENSOR_CHANNELS; j++) {
+                q_writeshort(q, rec[j]);
+            }
+        }
+        else {
+            ot_uint offset = EXT_SENSOR_HEADBYTES + ((n % ext_sensor.capacity) * EXT_SENSOR_RECBYTES);
+            for (j=0; j<EXT_SENSOR_CHANNELS; j++, offset+=2) {
+                q_writeshort(q, vl_read(fp, offset));
+            }
+        }
+    }
+
+    vl_close(fp);
+    return (ot_int)count;
+}
+#endif
+
+#endif
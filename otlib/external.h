@@ -33,6 +33,7 @@
 #define __EXTERNAL_H
 
 #include "OT_types.h"
+#include "OT_config.h"
 
 
 /** @brief  Initialize External module data elements (objects)
@@ -60,6 +61,123 @@ void ext_init();
 ot_u8 ext_get_m2appflags();
 
 
+
+
+#if (OT_FEATURE(SENSORS) == ENABLED)
+#include "OTAPI_tmpl.h"
+#include "queue.h"
+
+/** Sensor sampling pipeline
+  * Sensors are sampled in bursts by the platform ADC: each burst converts the
+  * EXT_SENSOR_CHANNELS channels EXT_SENSOR_ROUNDS times, and the DMA moves the
+  * conversions to RAM, so the CPU only wakes to start the burst and to pick it
+  * up.  EXT_SENSOR_DECIMATE bursts are averaged into one record, which holds
+  * one 16 bit value per channel in 12.4 fixed point (ADC counts x 16).
+  *
+  * Records go to a ring in GFB file EXT_SENSOR_FILE, which must be created
+  * with room for the records (its alloc sets how many it holds).  They are
+  * kept in RAM and written EXT_SENSOR_COALESCE records at a time, so the file
+  * is written once per EXT_SENSOR_COALESCE records, not once per sample.
+  * The file is:
+  * [seq: 2 bytes] [channels: 1 byte] [rfu: 1 byte] [record 0] [record 1] ...
+  * seq is the number of the next record.  Record n is in slot (n % capacity),
+  * and values are stored in platform endian.
+  *
+  * The pipeline runs from ext_sensor_task().  With OT_FEATURE(APPTASKS), 
+  * ext_init() adds it as an app task at priority EXT_SENSOR_PRIO; otherwise
+  * the app calls it and honors the return value.
+  */
+#ifndef EXT_SENSOR_CHANNELS
+#   define EXT_SENSOR_CHANNELS  2
+#endif
+#ifndef EXT_SENSOR_ROUNDS
+#   define EXT_SENSOR_ROUNDS    8       // channels x rounds: 16 max on ADC12
+#endif
+#ifndef EXT_SENSOR_DECIMATE
+#   define EXT_SENSOR_DECIMATE  1       // bursts per record
+#endif
+#ifndef EXT_SENSOR_PERIOD
+#   define EXT_SENSOR_PERIOD    1024    // ticks between bursts
+#endif
+#ifndef EXT_SENSOR_CONVTICKS
+#   define EXT_SENSOR_CONVTICKS 2       // ticks given to a burst to finish
+#endif
+#ifndef EXT_SENSOR_COALESCE
+#   define EXT_SENSOR_COALESCE  8       // records per file write
+#endif
+#ifndef EXT_SENSOR_FILE
+#   define EXT_SENSOR_FILE      0       // GFB file ID
+#endif
+#ifndef EXT_SENSOR_PRIO
+#   define EXT_SENSOR_PRIO      1
+#endif
+
+#define EXT_SENSOR_HEADBYTES    4
+#define EXT_SENSOR_RECBYTES     (EXT_SENSOR_CHANNELS*2)
+
+
+/** @brief  Runs the sensor pipeline
+  * @param  None
+  * @retval ot_long     ticks until it should run again, or <0 if stopped
+  * @ingroup External
+  *
+  * The signature is sys_taskfn, so it can be an app task.  It starts a burst,
+  * or picks up the burst it started and processes it.
+  */
+ot_long ext_sensor_task();
+
+
+/** @brief  Sets the time between bursts
+  * @param  period      (ot_u16) ticks between bursts, 0 stops sampling
+  * @retval None
+  * @ingroup External
+  */
+void ext_sensor_period(ot_u16 period);
+
+
+/** @brief  Writes the records held in RAM to the ring file
+  * @param  None
+  * @retval ot_u8       Non-zero on failure (e.g. no file)
+  * @ingroup External
+  */
+ot_u8 ext_sensor_flush();
+
+
+/** @brief  Sequence number of the next record
+  * @param  None
+  * @retval ot_u16      records made since the file was new (mod 2^16)
+  * @ingroup External
+  */
+ot_u16 ext_sensor_seq();
+
+
+/** @brief  Number of records the ring file holds
+  * @param  None
+  * @retval ot_u16      capacity, 0 if there is no file
+  * @ingroup External
+  */
+ot_u16 ext_sensor_capacity();
+
+
+/** @brief  Copies a window of records to a queue
+  * @param  seq         (ot_u16*) In: number of the first record.  Out: number
+  *                     of the first record written, which is later if the
+  *                     records asked for are no longer in the ring.
+  * @param  count       (ot_uint) max number of records
+  * @param  q           (Queue*) output, records written at the putcursor
+  * @param  user_id     (id_tmpl*) user reading the file, NULL for root
+  * @retval ot_int      records written, or -1 if the file cannot be read
+  * @ingroup External
+  *
+  * Records still in RAM are read as well, so a window never waits for a
+  * flush.  Values are written big endian, as is usual in ALP.  The count is 
+  * cut to the records that are there, and to the ones that fit in q.
+  */
+ot_int ext_sensor_read(ot_u16* seq, ot_uint count, Queue* q, id_tmpl* user_id);
+
+#endif
+
+
 #endif
 
 
@@ -24,6 +24,8 @@
   ******************************************************************************
   */
 
+#include <stddef.h>
+
 #include "OT_config.h"
 #include "OT_platform.h"
 
@@ -35,9 +37,75 @@
 
 em2_struct   em2;
 
+/// Tables are const (flash) unless PLATFORM_RAMCODE is enabled
+#if (PLATFORM_RAMCODE == ENABLED)
+#   define EM2_TABLE_CONST
+#else
+#   define EM2_TABLE_CONST      const
+#endif
+
+#ifndef EM2_ENCODER
 void (*em2_encode_data)();
+#endif
+#ifndef EM2_DECODER
 void (*em2_decode_data)();
+#endif
+
+
+
+/** CRC streaming in bursts  <BR>
+  * ========================================================================<BR>
+  * On TX, the whole frame is in txq before encoding starts, so the CRC stream
+  * can run ahead of the encoder.  Rather than stepping the CRC once per byte,
+  * the encoder advances it one FIFO-full at a time (it never needs more than
+  * that before the next check).  On RX, the decoders count the bytes drained
+  * from the FIFO and fold them into the CRC once per burst.
+  */
+#define EM2_CRC_BURST   RADIO_BUFFER_TXMAX
 
+#define EM2_CRC_AHEAD(AHEAD)    do { \
+                                    if (AHEAD == 0) { \
+                                        AHEAD = EM2_CRC_BURST; \
+                                        crc_calc_nstream(EM2_CRC_BURST); \
+                                    } \
+                                    AHEAD--; \
+                                } while(0)
+
+
+
+
+
+/** @brief  Moves a span of encoded TX data into the TX buffer
+  * @param  span        (ot_u8*) encoded data, starting at txq.getcursor
+  * @param  limit       (ot_int) number of bytes in the span
+  * @retval ot_int      Number of bytes the radio took
+  * @ingroup Encode
+  */
+ot_int sub_txspan(ot_u8* span, ot_int limit) {
+    ot_int n;
+    n               = radio_putbytes(span, limit);
+    txq.getcursor  += n;
+    em2.bytes      -= n;
+    return n;
+}
+
+
+/** @brief  Moves ready bytes of the frame from the RX buffer into rxq
+  * @param  None
+  * @retval ot_int      Number of bytes landed at the old rxq.putcursor
+  * @ingroup Encode
+  *
+  * The radio driver transfers the bytes directly to rxq.putcursor, so the 
+  * decoders can work on the span in place instead of queueing byte-by-byte.
+  */
+ot_int sub_rxspan() {
+    ot_int n;
+    n               = radio_getbytes(rxq.putcursor, em2.bytes);
+    rxq.putcursor  += n;
+    rxq.length     += n;
+    em2.bytes      -= n;
+    return n;
+}
 
 
 
@@ -48,24 +116,19 @@ void (*em2_decode_data)();
     
 #   ifndef EXTF_em2_encode_data_HW
     void em2_encode_data_HW() {
-        while ( (em2.bytes > 0) && (radio_txopen() == True) ) {
-            radio_putbyte( q_readbyte(&txq) );
-            em2.bytes--;
-        }
+        sub_txspan(txq.getcursor, em2.bytes);
     }
 #   endif
     
 #   ifndef EXTF_em2_decode_data_HW
+    OT_RAMCODE(em2_decode_data_HW)
     void em2_decode_data_HW() {
         if (em2.state == 0) {
             em2.state--;
             q_writebyte(&rxq, radio_getbyte() );
             em2.bytes = (ot_int)rxq.front[0] - 1;
         }
-        while ( (em2.bytes > 0) && (radio_rxopen() == True) ) {
-            q_writebyte(&rxq, radio_getbyte() );
-            em2.bytes--;
-        }
+        sub_rxspan();
     }
 #   endif
 #endif
@@ -77,29 +140,31 @@ void (*em2_decode_data)();
 
 #   ifndef EXTF_em2_encode_data_HW_CRC
     void em2_encode_data_HW_CRC() {
-        while ( (em2.bytes > 0) && (radio_txopen() == True) ) {
-            crc_calc_stream();
-            radio_putbyte( q_readbyte(&txq) );
-            em2.bytes--;
-        }
+        ot_int n;
+        do {
+            n = (em2.bytes < EM2_CRC_BURST) ? em2.bytes : EM2_CRC_BURST;
+            if (n <= 0) {
+                break;
+            }
+            crc_calc_nstream(n);
+        } while (sub_txspan(txq.getcursor, n) == n);
     }
 #   endif
     
 #   ifndef EXTF_em2_decode_data_HW_CRC
+    OT_RAMCODE(em2_decode_data_HW_CRC)
     void em2_decode_data_HW_CRC() {  
+        ot_int burst = 0;
         if (em2.state == 0) {
             em2.state--;
             *rxq.putcursor  = radio_getbyte();
             em2.bytes       = (ot_int)*rxq.putcursor - 1;
             rxq.length++;
             crc_init_stream(rxq.front[0], rxq.putcursor++);
-            crc_calc_stream();
-        }
-        while ( (em2.bytes > 0) && (radio_rxopen() == True) ) {
-            q_writebyte(&rxq, radio_getbyte() );
-            crc_calc_stream();
-            em2.bytes--;
+            burst = 1;
         }
+        burst += sub_rxspan();
+        crc_calc_nstream(burst);
     }
 #   endif
 #endif
@@ -113,48 +178,176 @@ void (*em2_decode_data)();
 /// Mode 2.  The CC430/CC11xx have suitable HW.  There is one other chip I know
 /// of that has suitable HW, but it is not yet public knowledge.
 
-    void init_PN9() { em2.PN9_lfsr.ushort = 0x01FF; }
-    ot_u8 get_PN9() { return em2.PN9_lfsr.ubyte[LOWER]; }
-
-    void rotate_PN9() {
-    /// Nibble-wise PN9 implementation.  Runs pretty fast, no table.
-#       define PN9reg       em2.PN9_lfsr.ushort
-
-        // Method 1: looks longer, but probably 13 cycles
-        ot_u16 x;
-        x           = (PN9reg << 5) ^ PN9reg;
-        x          &= 0x01E0;
-        PN9reg    >>= 4;
-        PN9reg     |= x;
-        x           = (PN9reg << 5) ^ PN9reg;
-        x          &= 0x01E0;
-        PN9reg    >>= 4;
-        PN9reg     |= x;
-
-        /*
-        // Method 2: looks smaller, but probably 17 cycles
-        ot_u16 x1, x2, x3;
-        x1      = PN9reg & 0x01E0;              //abcd_____
-        x2      = (PN9reg << 5) & 0x01E0;       //fghi_____
-        x3      = (PN9reg << 1) & 0x01E0;       //bcde_____
-        x2     ^= x1;
-        PN9reg  = x2 ^ x3;
-        PN9reg |= x2 >> 4;
-        PN9reg |= x1 >> 8;
-        */
+    /// The PN9 sequence is reset at the start of every frame, so whitening
+    /// never uses more than M2_PARAM_MAXFRAME bytes of keystream.  Instead of
+    /// stepping the LFSR for every byte (in the RX/TX ISRs), the keystream is
+    /// kept in a 256 byte table: PN9 seed 0x1FF, 8 LFSR steps per byte.
+#   if (M2_PARAM_MAXFRAME > 256)
+#       error "PN9 table supports frames up to 256 bytes (M2_PARAM_MAXFRAME)"
+#   endif
+
+    static EM2_TABLE_CONST ot_u8 PN9table[256] = {
+        0xFF, 0xE1, 0x1D, 0x9A, 0xED, 0x85, 0x33, 0x24, 0xEA, 0x7A, 0xD2, 0x39, 0x70, 0x97, 0x57, 0x0A,
+        0x54, 0x7D, 0x2D, 0xD8, 0x6D, 0x0D, 0xBA, 0x8F, 0x67, 0x59, 0xC7, 0xA2, 0xBF, 0x34, 0xCA, 0x18,
+        0x30, 0x53, 0x93, 0xDF, 0x92, 0xEC, 0xA7, 0x15, 0x8A, 0xDC, 0xF4, 0x86, 0x55, 0x4E, 0x18, 0x21,
+        0x40, 0xC4, 0xC4, 0xD5, 0xC6, 0x91, 0x8A, 0xCD, 0xE7, 0xD1, 0x4E, 0x09, 0x32, 0x17, 0xDF, 0x83,
+        0xFF, 0xF0, 0x0E, 0xCD, 0xF6, 0xC2, 0x19, 0x12, 0x75, 0x3D, 0xE9, 0x1C, 0xB8, 0xCB, 0x2B, 0x05,
+        0xAA, 0xBE, 0x16, 0xEC, 0xB6, 0x06, 0xDD, 0xC7, 0xB3, 0xAC, 0x63, 0xD1, 0x5F, 0x1A, 0x65, 0x0C,
+        0x98, 0xA9, 0xC9, 0x6F, 0x49, 0xF6, 0xD3, 0x0A, 0x45, 0x6E, 0x7A, 0xC3, 0x2A, 0x27, 0x8C, 0x10,
+        0x20, 0x62, 0xE2, 0x6A, 0xE3, 0x48, 0xC5, 0xE6, 0xF3, 0x68, 0xA7, 0x04, 0x99, 0x8B, 0xEF, 0xC1,
+        0x7F, 0x78, 0x87, 0x66, 0x7B, 0xE1, 0x0C, 0x89, 0xBA, 0x9E, 0x74, 0x0E, 0xDC, 0xE5, 0x95, 0x02,
+        0x55, 0x5F, 0x0B, 0x76, 0x5B, 0x83, 0xEE, 0xE3, 0x59, 0xD6, 0xB1, 0xE8, 0x2F, 0x8D, 0x32, 0x06,
+        0xCC, 0xD4, 0xE4, 0xB7, 0x24, 0xFB, 0x69, 0x85, 0x22, 0x37, 0xBD, 0x61, 0x95, 0x13, 0x46, 0x08,
+        0x10, 0x31, 0x71, 0xB5, 0x71, 0xA4, 0x62, 0xF3, 0x79, 0xB4, 0x53, 0x82, 0xCC, 0xC5, 0xF7, 0xE0,
+        0x3F, 0xBC, 0x43, 0xB3, 0xBD, 0x70, 0x86, 0x44, 0x5D, 0x4F, 0x3A, 0x07, 0xEE, 0xF2, 0x4A, 0x81,
+        0xAA, 0xAF, 0x05, 0xBB, 0xAD, 0x41, 0xF7, 0xF1, 0x2C, 0xEB, 0x58, 0xF4, 0x97, 0x46, 0x19, 0x03,
+        0x66, 0x6A, 0xF2, 0x5B, 0x92, 0xFD, 0xB4, 0x42, 0x91, 0x9B, 0xDE, 0xB0, 0xCA, 0x09, 0x23, 0x04,
+        0x88, 0x98, 0xB8, 0xDA, 0x38, 0x52, 0xB1, 0xF9, 0x3C, 0xDA, 0x29, 0x41, 0xE6, 0xE2, 0x7B, 0xF0
+    };
+    
+    /// Whitening of spans is done a machine word at a time, when the data and
+    /// the keystream share alignment.
+#   if (PLATFORM_POINTER_SIZE >= 4)
+        typedef ot_u32  pn9_word;
+#   else
+        typedef ot_u16  pn9_word;
+#   endif
+#   define PN9_WORDBYTES   ((ot_int)sizeof(pn9_word))
+#   define PN9_WORDMASK    (sizeof(pn9_word) - 1)
+#   define PN9_ALIGN(PTR)  ((size_t)(PTR) & PN9_WORDMASK)
+
+    void init_PN9()     { em2.PN9_index = 0; }
+    ot_u8 get_PN9()     { return PN9table[em2.PN9_index]; }
+    void rotate_PN9()   { em2.PN9_index++; }
+    
+    void em2_PN9_span(ot_u8* data, ot_int length) {
+        const ot_u8* key;
+        key             = &PN9table[em2.PN9_index];
+        em2.PN9_index  += length;
+        
+        if (PN9_ALIGN(data) == PN9_ALIGN(key)) {
+            for (; (length > 0) && PN9_ALIGN(data); length--) {
+                *data++ ^= *key++;
+            }
+            for (; length >= PN9_WORDBYTES; length -= PN9_WORDBYTES) {
+                *(pn9_word*)data   ^= *(const pn9_word*)key;
+                data               += PN9_WORDBYTES;
+                key                += PN9_WORDBYTES;
+            }
+        }
+        for (; length > 0; length--) {
+            *data++ ^= *key++;
+        }
+    }
+    
+    
+    /** Fused CRC + PN9 kernels  <BR>
+      * ====================================================================<BR>
+      * With the TABLE CRC engine, whitened frames are coded in one loop per
+      * burst: the CRC is folded and the byte whitened while it is in a 
+      * register, instead of a CRC pass, a copy and a whitening pass.  FEC
+      * frames keep their own loops, because the Viterbi decoder costs far
+      * more per byte than these and the FEC encoder already reads each byte
+      * once.  SLICE4 keeps the staged path, as it folds four bytes a round.
+      */
+#   define EM2_FUSEDCRC ( (EM2_FUSED == ENABLED) && \
+                          (MCU_FEATURE(CRC) == DISABLED) && \
+                          (CRC16_ENGINE == CRC16_ENGINE_TABLE) )
+
+#   if (EM2_FUSEDCRC)
+    void sub_crcpn9_span(ot_u8* out, ot_u8* in, ot_int n) {
+    /// TX: the CRC is of the plain bytes, in, and the whitened bytes go to
+    /// out.  After a short TX the CRC stream is ahead of in, so the bytes
+    /// before crc.cursor are only whitened.  The CRC write-out lands in txq
+    /// (in) before those bytes are whitened.
+        const ot_u8* key;
+        ot_int  lead;
+        ot_int  fold;
+        ot_int  i;
+        
+        key             = &PN9table[em2.PN9_index];
+        em2.PN9_index  += n;
+        lead            = (ot_int)(crc.cursor - in);
+        lead            = ((lead < 0) || (lead > n)) ? n : lead;
+        
+        for (i=0; i<lead; i++) {
+            out[i] = in[i] ^ key[i];
+        }
+        if (lead < n) {
+            ot_u16 crcv = crc.val;
+            fold        = lead + crc_stream_span(n - lead);
+            for (; i<fold; i++) {
+                ot_u8 c = in[i];
+                crcv    = CRC16_TABLE_BYTE(crcv, c);
+                out[i]  = c ^ key[i];
+            }
+            crc.val     = crcv;
+            crc.cursor  = &in[fold];
+            crc_calc_nstream(n - fold);
+            for (; i<n; i++) {
+                out[i] = in[i] ^ key[i];
+            }
+        }
+    }
+    
+    
+    OT_RAMCODE(sub_pn9crc_span)
+    void sub_pn9crc_span(ot_u8* data, ot_int n) {
+    /// RX: dewhitens in place and folds the plain bytes.  The span always 
+    /// starts at crc.cursor for a frame that is being decoded.
+        const ot_u8* key;
+        ot_u16  crcv;
+        ot_int  fold;
+        ot_int  i;
+        
+        if (crc.cursor != data) {
+            em2_PN9_span(data, n);
+            crc_calc_nstream(n);
+            return;
+        }
+        key             = &PN9table[em2.PN9_index];
+        em2.PN9_index  += n;
+        crcv            = crc.val;
+        fold            = crc_stream_span(n);
+        for (i=0; i<fold; i++) {
+            ot_u8 c = data[i] ^ key[i];
+            data[i] = c;
+            crcv    = CRC16_TABLE_BYTE(crcv, c);
+        }
+        for (; i<n; i++) {
+            data[i] ^= key[i];
+        }
+        crc.val     = crcv;
+        crc.cursor += fold;
+        crc_calc_nstream(n - fold);
     }
+#   endif
 #endif
     
 #if ( (RF_FEATURE(PN9) != ENABLED) || \
          ((M2_FEATURE(FECTX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED)) )
 #   ifndef EXTF_em2_encode_data_PN9
     void em2_encode_data_PN9() {
-        while ( (em2.bytes > 0) && (radio_txopen() == True) ) {
-            crc_calc_stream();
-            radio_putbyte( q_readbyte(&txq) ^ get_PN9() );
-            rotate_PN9();
-            em2.bytes--;
-        }
+    /// txq must stay unwhitened (it may be resent), so each burst is whitened
+    /// in a scratch span.  Keystream for bytes the radio didn't take is given
+    /// back, and those bytes are whitened again on the next call.
+        ot_u8  span[EM2_CRC_BURST];
+        ot_int n, k;
+        do {
+            n = (em2.bytes < EM2_CRC_BURST) ? em2.bytes : EM2_CRC_BURST;
+            if (n <= 0) {
+                break;
+            }
+#           if (EM2_FUSEDCRC)
+            sub_crcpn9_span(span, txq.getcursor, n);
+#           else
+            crc_calc_nstream(n);
+            platform_memcpy(span, txq.getcursor, n);
+            em2_PN9_span(span, n);
+#           endif
+            k               = sub_txspan(span, n);
+            em2.PN9_index  -= (n - k);
+        } while (k == n);
     }
 #   endif
 #endif
@@ -162,7 +355,9 @@ void (*em2_decode_data)();
 #if ( (RF_FEATURE(PN9) != ENABLED) || \
          ((M2_FEATURE(FECRX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED)) )
 #   ifndef EXTF_em2_decode_data_PN9
+    OT_RAMCODE(em2_decode_data_PN9)
     void em2_decode_data_PN9() {
+        ot_int burst = 0;
         if (em2.state == 0) {
             em2.state--;
             *rxq.putcursor  = (radio_getbyte() ^ get_PN9());
@@ -170,14 +365,21 @@ void (*em2_decode_data)();
             rxq.length++;
             rotate_PN9();
             crc_init_stream(rxq.front[0], rxq.putcursor++);
-            crc_calc_stream();
+            burst = 1;
         }
-        while ( (em2.bytes > 0) && (radio_rxopen() == True) ) {
-            q_writebyte(&rxq, (radio_getbyte() ^ get_PN9()) );
-            crc_calc_stream();         
-            rotate_PN9();
-            em2.bytes--;
+#       if (EM2_FUSEDCRC)
+        crc_calc_nstream(burst);
+        {   ot_u8* span = rxq.putcursor;
+            sub_pn9crc_span(span, sub_rxspan());
         }
+#       else
+        {   ot_u8* span = rxq.putcursor;
+            ot_int n     = sub_rxspan();
+            em2_PN9_span(span, n);
+            burst += n;
+        }
+        crc_calc_nstream(burst);
+#       endif
     }
 #   endif
 #endif
@@ -187,294 +389,243 @@ void (*em2_decode_data)();
 
 
 
-#if ((M2_FEATURE(FECTX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
+#if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
 /// Only compile these functions if the RF core does not have a built-in FEC
 /// encoder/decoder.  Some radios have FEC, although it is not to the spec of
 /// Mode 2.  The CC11xx has suitable HW, although the CC430 does not.  There is 
 /// one other chip I know of that has suitable HW, but it is not yet public
 /// knowledge.
 
-//#   include "m2_encode_table.h"
+    /** @brief  Interleaves (or de-interleaves) a 4 byte block of FEC symbols
+      * @param  out     (ot_u8*) 4 byte output block
+      * @param  in      (ot_u8*) 4 byte input block
+      * @retval None
+      * @ingroup Encode
+      *
+      * The Mode 2 interleaver treats the block as a 4x4 matrix of 2 bit symbols
+      * and transposes it: symbol m of output byte n is symbol n of input byte m.
+      * The transpose is its own inverse, so the decoder uses it, too.
+      */
+    void sub_fec_interleave(ot_u8* out, ot_u8* in) {
+        ot_int i;
+        for (i=0; i<4; i++) {
+            ot_int shift = (i << 1);
+            out[i]  = ((in[3] >> shift) & 3) << 6;
+            out[i] |= ((in[2] >> shift) & 3) << 4;
+            out[i] |= ((in[1] >> shift) & 3) << 2;
+            out[i] |= ((in[0] >> shift) & 3);
+        }
+    }
+#endif
+
+
 
-static const ot_u8 FECtable[16] = { 0, 3, 1, 2, 3, 0, 2, 1, 3, 0, 2, 1, 0, 3, 1, 2 }; 
+#if ((M2_FEATURE(FECTX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
+    /// The convolutional encoder is rate 1/2, K=4, with generator taps as in
+    /// FECtable[16] = { 0, 3, 1, 2, 3, 0, 2, 1, 3, 0, 2, 1, 0, 3, 1, 2 }.
+    /// It is run a nibble at a time: the index is (3b encoder state << 4) | 
+    /// input nibble, and the output is the 8 bits (4 symbols) for that nibble.
+    static EM2_TABLE_CONST ot_u8 FECnibtable[128] = {
+        0x00, 0x03, 0x0D, 0x0E, 0x37, 0x34, 0x3A, 0x39, 0xDF, 0xDC, 0xD2, 0xD1, 0xE8, 0xEB, 0xE5, 0xE6,
+        0x7C, 0x7F, 0x71, 0x72, 0x4B, 0x48, 0x46, 0x45, 0xA3, 0xA0, 0xAE, 0xAD, 0x94, 0x97, 0x99, 0x9A,
+        0xF0, 0xF3, 0xFD, 0xFE, 0xC7, 0xC4, 0xCA, 0xC9, 0x2F, 0x2C, 0x22, 0x21, 0x18, 0x1B, 0x15, 0x16,
+        0x8C, 0x8F, 0x81, 0x82, 0xBB, 0xB8, 0xB6, 0xB5, 0x53, 0x50, 0x5E, 0x5D, 0x64, 0x67, 0x69, 0x6A,
+        0xC0, 0xC3, 0xCD, 0xCE, 0xF7, 0xF4, 0xFA, 0xF9, 0x1F, 0x1C, 0x12, 0x11, 0x28, 0x2B, 0x25, 0x26,
+        0xBC, 0xBF, 0xB1, 0xB2, 0x8B, 0x88, 0x86, 0x85, 0x63, 0x60, 0x6E, 0x6D, 0x54, 0x57, 0x59, 0x5A,
+        0x30, 0x33, 0x3D, 0x3E, 0x07, 0x04, 0x0A, 0x09, 0xEF, 0xEC, 0xE2, 0xE1, 0xD8, 0xDB, 0xD5, 0xD6,
+        0x4C, 0x4F, 0x41, 0x42, 0x7B, 0x78, 0x76, 0x75, 0x93, 0x90, 0x9E, 0x9D, 0xA4, 0xA7, 0xA9, 0xAA
+    };
     
 #   ifndef EXTF_em2_encode_data_FEC
     void em2_encode_data_FEC() {
-        ot_int      i, j, k;
-        ot_u8       scratch;
-        ot_u8       input;
-        ot_u8       data_buffer[RADIO_BUFFER_TXMAX];
-        Twobytes    FECoutput;
-        Twobytes    FECreg;       //@todo adjust to allow multiframe packets
-        Fourbytes   INToutput;
-        
-        k               = 0;
-        FECreg.ushort   = 0;      //@todo adjust to allow multiframe packets
+        ot_int  ahead = 0;
+        ot_u8   block[4];
+        ot_u8   output[4];
         
         // Encode each input byte into two output bytes, and add the trellis
         // terminator to the end of the message (0x0B).  The number of
         // pre-encoded bytes plus the trellis terminator must be even, so one 
-        // or two trellis terminators are added (odd or even).  The number of 
-        // post-encoded bytes is always a multiple of 4
+        // or two trellis terminators are added (odd or even).  Two input bytes
+        // yield one 4 byte block, which is interleaved and loaded straight 
+        // into the radio buffer, so the encoder state lives in em2.fec_state.
         while ( (em2.state != 0) && (radio_txopen_4() == True) ) {
+            ot_int i;
             
-            if (em2.bytes == 0) {
-                em2.state--;
-                input = 0x0B;                   //trellis terminator
-            }
-            else {
-                em2.bytes--;
-                crc_calc_stream();
-                input   = q_readbyte(&txq);
-                input  ^= get_PN9();
-                rotate_PN9();
-            }
-
-            FECoutput.ushort     = 0;
-            FECreg.ubyte[UPPER] &= 0x07;
-            FECreg.ubyte[LOWER]  = input;
-            
-            for (j=8; j>0; j--) {
-                FECoutput.ushort = (FECoutput.ushort << 2) | FECtable[ (FECreg.ushort >> 7) ];
-                FECreg.ushort    = (FECreg.ushort << 1) & 0x7FF;
-            }
-            data_buffer[k++] = FECoutput.ubyte[UPPER];
-            data_buffer[k++] = FECoutput.ubyte[LOWER];
-        }
-        
-        // Interleave the buffer after it is encoded
-        // The interleaver operates on four bytes at a time
-        for (i=0; i<k; i+=4) {
-            INToutput.ulong = 0;
-            
-            for (j=0; j<16; j++) {
-                scratch         = data_buffer[i + (~j & 0x03)];
-                //INToutput.ulong = (INToutput.ulong << 2) | ((scratch >> (2 * ((j & 0x0C) >> 2))) & 0x03);
-                INToutput.ulong = (INToutput.ulong << 2) | ((scratch >> (((j & 0x0C) >> 2) << 1)) & 0x03);
+            for (i=0; i<4; i+=2) {
+                ot_u8 input;
+                
+                if (em2.bytes == 0) {
+                    em2.state--;
+                    input = 0x0B;                   //trellis terminator
+                }
+                else {
+                    em2.bytes--;
+                    EM2_CRC_AHEAD(ahead);
+                    input   = q_readbyte(&txq);
+                    input  ^= get_PN9();
+                    rotate_PN9();
+                }
+                
+                block[i]        = FECnibtable[(em2.fec_state << 4) | (input >> 4)];
+                block[i+1]      = FECnibtable[input & 0x7F];
+                em2.fec_state   = input & 0x07;
             }
-            /*
-            INToutput.ubyte[B3]  = (data_buffer[i+3] & 0x03) << 6;
-            INToutput.ubyte[B3] |= (data_buffer[i+2] & 0x03) << 4;
-            INToutput.ubyte[B3] |= (data_buffer[i+1] & 0x03) << 2;
-            INToutput.ubyte[B3] |= (data_buffer[i+0] & 0x03);
-            
-            INToutput.ubyte[B2]  = (data_buffer[i+3] & 0x0C) << 4;
-            INToutput.ubyte[B2] |= (data_buffer[i+2] & 0x0C) << 2;
-            INToutput.ubyte[B2] |= (data_buffer[i+1] & 0x0C);
-            INToutput.ubyte[B2] |= (data_buffer[i+0] & 0x0C) >> 2;
-            
-            INToutput.ubyte[B1]  = (data_buffer[i+3] & 0x30) << 2;
-            INToutput.ubyte[B1] |= (data_buffer[i+2] & 0x30);
-            INToutput.ubyte[B1] |= (data_buffer[i+1] & 0x30) >> 2;
-            INToutput.ubyte[B1] |= (data_buffer[i+0] & 0x30) >> 4;
             
-            INToutput.ubyte[B0]  = (data_buffer[i+3] & 0xC0);
-            INToutput.ubyte[B0] |= (data_buffer[i+2] & 0xC0) >> 2;
-            INToutput.ubyte[B0] |= (data_buffer[i+1] & 0xC0) >> 4;
-            INToutput.ubyte[B0] |= (data_buffer[i+0] & 0xC0) >> 6;
-            */
-            radio_putfourbytes(&INToutput.ubyte[0]);
+            sub_fec_interleave(output, block);
+            radio_putfourbytes(output);
         }
-        
     }
 #   endif
 #endif
 
 
 #if ((M2_FEATURE(FECRX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
-    /// @note I am not aware if CC430 has the computational ability to decode FEC in
-    ///       real time.  Thus packets might be limited to the size of the radio
-    ///       buffer.  I am going to test it soon!
-
-    static const ot_u8 TrellisSourceState[8][2] = {
-        {0, 4},         // State {0,4} -> State 0
-        {0, 4},         // State {0,4} -> State 1
-        {1, 5},         // State {1,5} -> State 2
-        {1, 5},         // State {1,5} -> State 3
-        {2, 6},         // State {2,6} -> State 4
-        {2, 6},         // State {2,6} -> State 5
-        {3, 7},         // State {3,7} -> State 6
-        {3, 7}          // State {3,7} -> State 7
-    };
-
-    static const ot_u8 TrellisTransitionOutput[8][2] = {
-        {0, 3},         // State {0,4} -> State 0 produces {"00", "11"}
-        {3, 0},         // State {0,4} -> State 1 produces {"11", "00"}
-        {1, 2},         // State {1,5} -> State 2 produces {"01", "10"}
-        {2, 1},         // State {1,5} -> State 3 produces {"10", "01"}
-        {3, 0},         // State {2,6} -> State 4 produces {"11", "00"}
-        {0, 3},         // State {2,6} -> State 5 produces {"00", "11"}
-        {2, 1},         // State {3,7} -> State 6 produces {"10", "01"}
-        {1, 2}          // State {3,7} -> State 7 produces {"01", "10"}
-    };
-
-    static const ot_u8 TrellisTransitionInput[8] = { 0, 1, 0, 1, 0, 1, 0, 1 };
-
-    ot_u8 hamming_weight(ot_u8 a) {
-        a = ((a & 0xAA) >> 1) + (a & 0x55);
-        a = ((a & 0xCC) >> 2) + (a & 0x33);
-        a = ((a & 0xF0) >> 4) + (a & 0x0F);
-        return a;
-    }
-
-    /** @fn       min
-      * @brief    Returns the minimum of two byte values
-      * @param a  Value 1
-      * @param b  Value 2
-      * @return   Minimum of two values: Value 1 or Value 2
-      */
-    ot_u8 min(ot_u8 a, ot_u8 b) {
-        return (a <= b ? a : b);
+    /// The trellis has 8 states, which is 4 butterflies.  Destination states 
+    /// 2k and 2k+1 both come from source states k and k+4.  The transition 
+    /// k -> 2k produces the symbol FECbutterfly[k], and every other transition
+    /// in the butterfly produces that symbol or its complement, so one branch
+    /// metric (0-2) is enough to compute all four costs.
+    static EM2_TABLE_CONST ot_u8 FECbutterfly[4]  = { 0, 1, 3, 2 };
+    static EM2_TABLE_CONST ot_u8 FEChamming[4]    = { 0, 1, 1, 2 };
+
+    void sub_fec_putbyte(ot_u8 new_byte) {
+        new_byte ^= get_PN9();
+        rotate_PN9();
+        q_writebyte(&rxq, new_byte);
     }
-
     
     
 #   ifndef EXTF_em2_decode_data_FEC
+    OT_RAMCODE(em2_decode_data_FEC)
     void em2_decode_data_FEC() {
-
-        // Two sets of buffers (last, current) for each destination state for holding: 
-        ot_u32  path_matrix[2][8];      // Encoder input data (32b window)
-    
-        // Decoding
-        ot_u8   input;
-        ot_u8   min_cost;
-    
-        // Deinterleaving
-        ot_u8*  data_in;
-        ot_u8   deint_data[4];
-    
-        // Variables used to hold # Viterbi iterations to run, # bytes output,
-        // minimum cost for any destination state, bit index of input symbol
-        ot_int  i, j;
-        ot_int  bit_shift = 6;
-        
-        while ( (em2.bytes > 0) && (radio_rxopen_4() == True) ) {
-            
-            /// De-interleave a 4 byte block
-            {
-                ot_u8   int_data[4];
-                radio_getfourbytes(int_data);
-                em2.bytes -= 4;
+        ot_int  burst = 0;
             
-                for (i=0; i<4; i++) {
-                    input = 0;
-                    for (j=3; j>=0; j--) {
-                        input  <<= 2;
-                        input   |= (int_data[j] >> (i<<1)) & 0x03;
-                    }
-                    deint_data[i] = input;
-                }
-                data_in = deint_data;
-            }
+        /// Each 4 byte block from the radio is de-interleaved and run through
+        /// the Viterbi decoder, one encoder symbol (2b) at a time.  The path 
+        /// metrics and the 32b survivor paths live in em2, so decoding picks 
+        /// up where it left off on each RX FIFO burst.
+        while ( (em2.bytes > 0) && (radio_rxopen_4() == True) ) {
+            ot_u8   block[4];
+            ot_u8   deint_data[4];
+            ot_u8   min_cost;
+            ot_int  i;
             
+            radio_getfourbytes(block);
+            em2.bytes -= 4;
+            sub_fec_interleave(deint_data, block);
             
-            // DECODE the deinterleaved data
-            // Process up to 4 bytes of de-interleaved input data, 
-            // processing one encoder symbol (2b) at a time
-            for (i=16; i>0; i--) {
+            for (i=0; i<16; i++) {
+                ot_u8*  cost_last;
+                ot_u8*  cost_cur;
+                ot_u32* path_last;
+                ot_u32* path_cur;
                 ot_u8   symbol;
+                ot_int  min_state;
+                ot_int  k;
                 
+                cost_last   = em2.cost_matrix[em2.last_buffer];
+                cost_cur    = em2.cost_matrix[em2.current_buffer];
+                path_last   = em2.path_matrix[em2.last_buffer];
+                path_cur    = em2.path_matrix[em2.current_buffer];
+                symbol      = (deint_data[i>>2] >> (6 - ((i&3)<<1))) & 3;
                 min_cost    = 0xFF;
-                symbol      = ((*data_in) >> bit_shift) & 0x03;
-                bit_shift  -= 2;
-                
-                if (bit_shift < 0) {       // if bit shifting is all done (byte finished)
-                    bit_shift = 6;              // reset bit_shift
-                    data_in++;                  // Update pointer to the next byte of received data
-                }
-                
-                
-                // For each destination state in the trellis, 
-                // calculate hamming costs for both possible paths into state, 
-                // and select the one with lowest cost. 
-                for (j=0; j<8; j++) {
-                    ot_u8   state0;
-                    ot_u8   state1;
-                    ot_u8   cost0;
-                    ot_u8   cost1;
+                min_state   = 0;
                 
-                    input = TrellisTransitionInput[j];
-        
-                    // Calculate cost of transition from each of the 2 source states
-                    //    (cost is Hamming difference between received 2b symbol 
-                    //     and expected symbol for transition) 
-                    state0  = TrellisSourceState[j][0];
-                    cost0   = em2.cost_matrix[em2.last_buffer][state0];
-                    cost0  += hamming_weight(symbol ^ TrellisTransitionOutput[j][0]);
+                // Add-Compare-Select over each butterfly: keep the cheaper of
+                // the two paths into each destination state.
+                for (k=0; k<4; k++) {
+                    ot_u8 metric;
+                    ot_u8 cost0;
+                    ot_u8 cost1;
+                    ot_int j;
                     
-                    state1  = TrellisSourceState[j][1];
-                    cost1   = em2.cost_matrix[em2.last_buffer][state1];
-                    cost1  += hamming_weight(symbol ^ TrellisTransitionOutput[j][1]);
+                    metric  = FEChamming[symbol ^ FECbutterfly[k]];
+                    j       = k << 1;
                     
-                    // Select transition that gives lowest cost in destination state, 
-                    // copy that source state's path and add new decoded bit 
+                    cost0   = cost_last[k] + metric;
+                    cost1   = cost_last[k+4] + (2 - metric);
                     if (cost0 <= cost1) {
-                        em2.cost_matrix[em2.current_buffer][j]  = cost0;
-                        path_matrix[em2.current_buffer][j]      = path_matrix[em2.last_buffer][state0] << 1; 
-                        path_matrix[em2.current_buffer][j]     |= input;
-                        min_cost                                = min(min_cost, cost0);
+                        cost_cur[j] = cost0;
+                        path_cur[j] = (path_last[k] << 1);
                     }
                     else {
-                        em2.cost_matrix[em2.current_buffer][j]  = cost1;
-                        path_matrix[em2.current_buffer][j]      = path_matrix[em2.last_buffer][state1] << 1;
-                        path_matrix[em2.current_buffer][j]     |= input;
-                        min_cost                                = min(min_cost, cost1);
+                        cost_cur[j] = cost1;
+                        path_cur[j] = (path_last[k+4] << 1);
+                    }
+                    if (cost_cur[j] < min_cost) {
+                        min_cost    = cost_cur[j];
+                        min_state   = j;
+                    }
+                    
+                    j++;
+                    cost0   = cost_last[k] + (2 - metric);
+                    cost1   = cost_last[k+4] + metric;
+                    if (cost0 <= cost1) {
+                        cost_cur[j] = cost0;
+                        path_cur[j] = (path_last[k] << 1) | 1;
+                    }
+                    else {
+                        cost_cur[j] = cost1;
+                        path_cur[j] = (path_last[k+4] << 1) | 1;
+                    }
+                    if (cost_cur[j] < min_cost) {
+                        min_cost    = cost_cur[j];
+                        min_state   = j;
                     }
                 }
                 em2.path_bits++;
                 
-                // If trellis history is sufficiently long, 
-                // output a byte of decoded data
+                // If trellis history is sufficiently long, output a byte of 
+                // decoded data from the best path.  The first byte is the
+                // frame length, which sets the amount of FEC data to receive.
                 if (em2.path_bits == 32) {
                     ot_u8 new_byte;
                     
                     em2.path_bits  -= 8;
-                    //em2.path_bits   = 24;
-                    new_byte        = (ot_u8)(path_matrix[em2.current_buffer][0] >> 24);
-                    new_byte       ^= get_PN9();
-                    rotate_PN9();
-                    q_writebyte(&rxq, new_byte);
+                    new_byte        = (ot_u8)(path_cur[min_state] >> 24);
+                    sub_fec_putbyte(new_byte);
+                    burst++;
                     
                     if (em2.state == 0) {
-                        crc_init_stream(new_byte, rxq.front);                 
-                        //em2.databytes   = rxq.front[0];     //frame length is the first byte... always.
-                        em2.databytes   = new_byte;
-                        em2.bytes       = ((em2.databytes >> 1) + 1) << 2;
-                        em2.bytes      -= 4;
                         em2.state--;
+                        new_byte        = rxq.front[0];
+                        crc_init_stream(new_byte, rxq.front);
+                        burst           = 1;
+                        em2.databytes   = new_byte;
+                        em2.bytes      += (((ot_int)new_byte >> 1) + 1) << 2;
+                        em2.bytes      -= 8;
                     }
                     em2.databytes--;
-                    crc_calc_stream();                  
                 }
                 
-                // After having processed 3-symbol trellis terminator, 
-                // flush out remaining data (always end-of-frame)
-                if ( (em2.databytes <= 3)  && (em2.path_bits == ((em2.databytes<<3) + 3)) ) { 
+                // Swap current and last buffers for next iteration
+                em2.last_buffer     ^= 1;
+                em2.current_buffer  ^= 1;
+                
+                // After having processed 3 symbols of the trellis terminator 
+                // (all zeros), the encoder is known to be in state 0: flush 
+                // the remaining data from that path (always end-of-frame).
+                if ( (em2.state != 0) && (em2.databytes <= 3) && \
+                     (em2.path_bits == ((em2.databytes<<3) + 3)) ) { 
                     while (em2.path_bits >= 8) {
-                        ot_u8 new_byte;
-                        
                         em2.databytes--;
-                        new_byte        = (ot_u8)(path_matrix[em2.current_buffer][0] >> em2.path_bits);
+                        sub_fec_putbyte( (ot_u8)(path_cur[0] >> (em2.path_bits-8)) );
                         em2.path_bits  -= 8;
-                        new_byte       ^= get_PN9();
-                        rotate_PN9();
-                        q_writebyte(&rxq, new_byte);
-                        crc_calc_stream();
+                        burst++;
                     }
+                    em2.bytes = 0;
+                    crc_calc_nstream(burst);
                     return;
                 }
-                
-                // Swap current and last buffers for next iteration
-                em2.last_buffer      = (em2.last_buffer+1) & 1;
-                em2.current_buffer   = (em2.current_buffer+1) & 1;
             }
             
             // Normalize costs so that minimum cost becomes 0
-            for (j=0; j<8; j++) {
-                em2.cost_matrix[em2.last_buffer][j] -= min_cost;
+            for (i=0; i<8; i++) {
+                em2.cost_matrix[em2.last_buffer][i] -= min_cost;
             }
         }
         
+        crc_calc_nstream(burst);
     }
 #   endif 
 #endif
@@ -501,6 +652,7 @@ static const ot_u8 FECtable[16] = { 0, 3, 1, 2, 3, 0, 2, 1, 3, 0, 2, 1, 0, 3, 1,
 
 #ifndef EXTF_em2_encode_newpacket
 void em2_encode_newpacket() {
+#ifndef EM2_ENCODER
     ///Option 1: basic Radio HW Encoding
 #   if ((RF_FEATURE(PN9) == ENABLED) || (RF_FEATURE(FEC) == ENABLED))
 #       if (RF_FEATURE(CRC) == ENABLED)
@@ -522,12 +674,14 @@ void em2_encode_newpacket() {
         em2_encode_data = &em2_encode_data_PN9;
         
 #   endif
+#endif
 }
 #endif
 
 
 #ifndef EXTF_em2_decode_newpacket
 void em2_decode_newpacket() {
+#ifndef EM2_DECODER
     ///Option 1: basic Radio HW Decoding
 #   if ((RF_FEATURE(PN9) == ENABLED) || (RF_FEATURE(FEC) == ENABLED))
 #       if (RF_FEATURE(CRC) == ENABLED)
@@ -550,6 +704,7 @@ void em2_decode_newpacket() {
         em2_decode_data = &em2_decode_data_PN9;
 
 #   endif
+#endif
 }
 #endif
 
@@ -579,10 +734,11 @@ void em2_encode_newframe() {
         init_PN9();
 #   endif
 #   if ((M2_FEATURE(FECTX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
-        if (txq.options.ubyte[LOWER] == 1) {
+        if (txq.options.ubyte[LOWER] != 0) {
             // state is 1 if odd amount of data, 2 if even
             em2.state   = ((em2.bytes & 1) == 0);
             em2.state  += 1;
+            em2.fec_state = 0;
                 
             /// Amount of FEC bytes over the air is always a multiple of 4:
             ///  (   (Bytewise Data)       )
@@ -613,16 +769,12 @@ void em2_decode_newframe() {
 
     /// 3. Prepare SW FEC Decoders
 #   if ((M2_FEATURE(FECRX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
-        if (rxq.options.ubyte[LOWER] == 1) {
-#           ifdef __BIG_ENDIAN__
-                ///@todo: make endian agnostic
-#           else
-                *((ot_u32*)(&em2.cost_matrix[0][0])) = 0x64646400;
-                *((ot_u32*)(&em2.cost_matrix[0][4])) = 0x64646464;
-                *((ot_u32*)(&em2.cost_matrix[1][0])) = 0x00000000;
-                *((ot_u32*)(&em2.cost_matrix[1][4])) = 0x00000000;
-                ///@todo Verify: seemed like an error on the last line ([0][4]), which I corrected to [1][4]
-#           endif
+        if (rxq.options.ubyte[LOWER] != 0) {
+            ot_int i;
+            for (i=0; i<8; i++) {
+                em2.cost_matrix[0][i]   = (i == 0) ? 0 : 100;
+                em2.path_matrix[0][i]   = 0;
+            }
 
             em2.path_bits       = 0;
             em2.last_buffer     = 0;
@@ -634,6 +786,62 @@ void em2_decode_newframe() {
 
 
 
+#if (M2_FEATURE(MULTIFRAME) == ENABLED)
+#ifndef EXTF_em2_encode_nextframe
+void em2_encode_nextframe() {
+/// The next frame of an MFP is already in txq, right after the one that is
+/// draining.  Its length comes from its length byte, which counts the CRC (the
+/// CRC is not in txq yet unless it is a SW CRC that was already added).  Only
+/// the frame state is reset: the encoder chosen for the packet stays.
+    q_rebase(&txq, txq.getcursor);
+    txq.length = txq.front[0];
+#   if (RF_FEATURE(CRC) != ENABLED)
+    if (txq.options.ubyte[UPPER] != 0)
+#   endif
+        txq.length -= 2;
+    em2_encode_newframe();
+}
+#endif
+
+
+#ifndef EXTF_em2_decode_nextframe
+void em2_decode_nextframe() {
+/// The next frame lands right after the last one, and may already be coming
+/// out of the RX FIFO.
+    q_rebase(&rxq, rxq.putcursor);
+    em2_decode_newframe();
+}
+#endif
+#endif
+
+
+
+#ifndef EXTF_em2_decode_bf
+ot_int em2_decode_bf() {
+#if (RF_FEATURE(PN9) == ENABLED)
+#   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
+    if ((phymac[0].channel & 0x80) == 0)
+#   endif
+    {
+        ot_int n;
+        n               = radio_getbytes(rxq.putcursor, (ot_int)rxq.front[0]);
+        rxq.putcursor  += n;
+        em2.state       = -1;
+        em2.bytes       = 0;
+        if (n != (ot_int)rxq.front[0]) {
+            return -1;                  // the frame was cut short
+        }
+        crc_calc_block(n, &rxq.front[2]);
+        return (ot_int)crc_check() - 1;
+    }
+#endif
+    em2_decode_data();
+    return (ot_int)crc_check() - 1;
+}
+#endif
+
+
+
 #ifndef EXTF_em2_remaining_frames
 ot_int em2_remaining_frames() {
 /// Returns 0 if no more frames, or non-zero if more frames
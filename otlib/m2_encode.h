@@ -41,6 +41,7 @@
 
 #include "OT_types.h"
 #include "OT_config.h"
+#include "OT_platform.h"
 
 
 
@@ -51,7 +52,7 @@ typedef struct {
 
 #   if ( (RF_FEATURE(PN9) != ENABLED) || \
          ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) != ENABLED)) )
-        Twobytes PN9_lfsr;
+        ot_int  PN9_index;
 #   endif
 
 #   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
@@ -60,6 +61,8 @@ typedef struct {
         ot_u8   last_buffer;
         ot_u8   current_buffer;
         ot_u8   cost_matrix[2][8];
+        ot_u32  path_matrix[2][8];
+        ot_u8   fec_state;
 #   endif
 
 } em2_struct;
@@ -120,6 +123,44 @@ void em2_decode_newframe();
 
 
 
+/** @brief  Moves the encoder to the next frame of a multiframe packet
+  * @param  None
+  * @retval None
+  * @ingroup Encode
+  *
+  * The next frame must follow the current one in txq (its first byte is its
+  * length).  Call this as soon as the current frame is done, then fill the
+  * radio buffer with em2_encode_data(), and only then run any callbacks, so
+  * the radio does not run dry at the frame boundary.
+  */
+void em2_encode_nextframe();
+
+
+/** @brief  Moves the decoder to the next frame of a multiframe packet
+  * @param  None
+  * @retval None
+  * @ingroup Encode
+  */
+void em2_decode_nextframe();
+
+
+/** @brief  Decodes a whole background frame once it is in the RX buffer
+  * @param  None
+  * @retval ot_int      0 on good Frame CRC, negative on bad
+  * @ingroup Encode
+  *
+  * Background frames are constant length (rxq.front[0]), so there is no need
+  * for the streaming decoder: the frame comes out of the RX buffer in one
+  * transfer and the CRC is run as one block.  Call it from the RX-done ISR of
+  * a background RX, in place of em2_decode_data() and crc_check().  If the
+  * frame needs a SW decoder (FEC or PN9 not done by the radio), it falls back
+  * to em2_decode_data().
+  */
+ot_int em2_decode_bf();
+
+
+
+
 /** @brief  Returns the number of frames following the current one
   * @param none
   * @retval ot_int      value from em2.frames
@@ -150,6 +191,35 @@ ot_bool em2_complete();
 
 
 
+/** Static dispatch (OT_FEATURE(STATIC_DISPATCH))
+  * When the build can only use one encoder (or decoder), em2_encode_data
+  * (em2_decode_data) is a macro for it, and the radio driver calls it
+  * directly.  Software FEC picks FEC or PN9 for each packet, so with
+  * M2_FEATURE(FECTX) or M2_FEATURE(FECRX) and no FEC in the radio, that side
+  * keeps the function pointer.
+  */
+#if (OT_FEATURE(STATIC_DISPATCH) == ENABLED)
+#   if ((M2_FEATURE(FECTX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
+#   elif (RF_FEATURE(PN9) != ENABLED)
+#       define EM2_ENCODER  em2_encode_data_PN9
+#   elif (RF_FEATURE(CRC) != ENABLED)
+#       define EM2_ENCODER  em2_encode_data_HW_CRC
+#   elif ((RF_FEATURE(FEC) == ENABLED) || (M2_FEATURE(FEC) != ENABLED))
+#       define EM2_ENCODER  em2_encode_data_HW
+#   endif
+
+#   if ((M2_FEATURE(FECRX) == ENABLED) && (RF_FEATURE(FEC) != ENABLED))
+#   elif (RF_FEATURE(PN9) != ENABLED)
+#       define EM2_DECODER  em2_decode_data_PN9
+#   elif (RF_FEATURE(CRC) != ENABLED)
+#       define EM2_DECODER  em2_decode_data_HW_CRC
+#   elif ((RF_FEATURE(FEC) == ENABLED) || (M2_FEATURE(FEC) != ENABLED))
+#       define EM2_DECODER  em2_decode_data_HW
+#   endif
+#endif
+
+
+
 /** @par Mode 2 Encode Data function pointer
   * The function @c em2_encode_newframe() sets this function pointer to the 
   * appropriate encode function, based on the queue options field and compiled
@@ -161,7 +231,12 @@ ot_bool em2_complete();
   * @retval None
   * @ingroup Encode
   */
-extern void (*em2_encode_data)();
+#ifdef EM2_ENCODER
+#   define em2_encode_data  EM2_ENCODER
+    void EM2_ENCODER();
+#else
+    extern void (*em2_encode_data)();
+#endif
 
 
 /** @par Decode function pointer
@@ -174,7 +249,12 @@ extern void (*em2_encode_data)();
   * @retval None
   * @ingroup Encode
   */
-extern void (*em2_decode_data)();
+#ifdef EM2_DECODER
+#   define em2_decode_data  EM2_DECODER
+    void EM2_DECODER();
+#else
+    extern void (*em2_decode_data)();
+#endif
 
 
 
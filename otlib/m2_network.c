@@ -39,7 +39,11 @@
 
 #include "auth.h"
 #include "buffers.h"
+#include "crc16.h"
+#include "crypto_aes128.h"
+#include "ota.h"
 #include "queue.h"
+#include "radio.h"
 #include "system.h"         //including system.h just for some constants
 #include "veelite.h"
 
@@ -64,6 +68,485 @@ m2dp_struct m2dp;
   * - In some OSI models, these might be in the "LLC" layer of the MAC.  They
   *   fit more nicely and cleanly in this module, though.
   */
+
+void sub_idcache_load() {
+/// Device IDs are compared on every addressed frame, so they are kept in RAM
+/// instead of being read from the ISFs each time.
+    vlFILE* fp;
+    ot_int  i;
+    
+    //file 0=network_settings, 1=device_features
+    fp          = ISF_open_su( 0 );
+    m2np.id.vid = vl_read(fp, 0);
+    vl_close(fp);
+    
+    fp          = ISF_open_su( 1 );
+    for (i=0; i<4; i++) {
+        m2np.id.uid[i] = vl_read(fp, i<<1);
+    }
+    vl_close(fp);
+    
+    m2np.id.stamp = vl_idstamp;
+}
+
+
+OT_INLINE void sub_idcache_check() {
+    if (m2np.id.stamp != vl_idstamp) {
+        sub_idcache_load();
+    }
+}
+
+
+#if (OT_FEATURE(DLL_SECURITY))
+void sub_dlls_nonce(ot_u8* nonce, ot_u8* header) {
+/// Nonce is [subnet][frame info][DLLS code][sequence], zero padded
+    platform_memcpy(nonce, header, 2+M2_DLLS_HDRBYTES);
+    platform_memset(&nonce[2+M2_DLLS_HDRBYTES], 0, AES_CCM_NONCE_SIZE-(2+M2_DLLS_HDRBYTES));
+}
+
+
+ot_int sub_dlls_decrypt() {
+/// Authenticate and decrypt the received frame in place with the cached key
+/// schedule, then take the MIC off the frame length.  rxq.front[0] is already
+/// the length without CRC.
+    ot_u8   nonce[AES_CCM_NONCE_SIZE];
+    ot_u32* expkey;
+    ot_u8*  end;
+    
+    m2np.dlls.code  = rxq.front[4];
+    expkey          = auth_get_dllsschedule(m2np.dlls.code);
+    end             = &rxq.front[rxq.front[0]];
+    
+    if ((expkey == NULL) || \
+        (end < &rxq.front[4+M2_DLLS_HDRBYTES+M2_DLLS_MICBYTES])) {
+        return -1;
+    }
+    
+    sub_dlls_nonce(nonce, &rxq.front[2]);
+    rxq.getcursor   = &rxq.front[2];
+    rxq.putcursor   = end;
+    if (AES_decrypt_ccm(&rxq, 2+M2_DLLS_HDRBYTES, nonce, M2_DLLS_MICBYTES, expkey) != 0) {
+        return -1;
+    }
+    
+    rxq.front[0]   -= M2_DLLS_MICBYTES;
+    rxq.getcursor   = &rxq.front[4+M2_DLLS_HDRBYTES];
+    return 0;
+}
+
+
+void sub_dlls_encrypt() {
+/// Encrypt the frame in txq, after the DLLS header, and append the MIC.  If
+/// there is no key or no room, the payload is dropped and the frame goes out
+/// without a MIC, so receivers reject it instead of seeing it in the clear.
+    ot_u8   nonce[AES_CCM_NONCE_SIZE];
+    ot_u32* expkey;
+    ot_u8*  getcursor;
+    
+    getcursor       = txq.getcursor;
+    expkey          = auth_get_dllsschedule(txq.front[4]);
+    txq.getcursor   = &txq.front[2];
+    sub_dlls_nonce(nonce, &txq.front[2]);
+    
+    if ((expkey == NULL) || \
+        (AES_encrypt_ccm(&txq, 2+M2_DLLS_HDRBYTES, nonce, M2_DLLS_MICBYTES, expkey) < 0)) {
+        txq.putcursor   = &txq.front[4+M2_DLLS_HDRBYTES];
+        txq.length      = 4+M2_DLLS_HDRBYTES;
+    }
+    txq.getcursor   = getcursor;
+}
+#endif
+
+
+#if (OT_FEATURE(NL_SECURITY))
+void sub_nls_self(id_tmpl* self, ot_bool use_vid) {
+/// This device's ID, as m2np_put_deviceid() writes it
+    sub_idcache_check();
+    self->length    = use_vid ? 2 : 8;
+    self->value     = use_vid ? (ot_u8*)&m2np.id.vid : (ot_u8*)m2np.id.uid;
+}
+
+
+void sub_nls_nonce(ot_u8* nonce, ot_u8* header, id_tmpl* sender) {
+/// Nonce is [NLS code][sequence][sender ID], zero padded
+    platform_memcpy(nonce, header, M2_NLS_HDRBYTES);
+    platform_memset(&nonce[M2_NLS_HDRBYTES], 0, AES_CCM_NONCE_SIZE-M2_NLS_HDRBYTES);
+    platform_memcpy(&nonce[M2_NLS_HDRBYTES], sender->value, sender->length);
+}
+
+
+ot_bool sub_nls_derive(session_nlskey* nls, m2session* session, id_tmpl* requester) {
+/// Derives the key of the dialog from the requester's NLS key, and makes its
+/// schedule.  This is the only place NLS makes a key schedule.
+    ot_u32  info[4];
+    ot_u32  key[4];
+    ot_u8*  block = (ot_u8*)info;
+    ot_u32* userkey;
+    
+    userkey = auth_get_nlsschedule(requester, nls->code);
+    if (userkey == NULL) {
+        return False;
+    }
+    
+    platform_memset(block, 0, 16);
+    block[0]    = session->subnet;
+    block[1]    = session->dialog_id;
+    block[2]    = nls->code;
+    platform_memcpy(&block[3], requester->value, requester->length);
+    
+    AES_ccm_derivekey(key, block, userkey);
+    AES_ccm_keyschedule(key, nls->schedule);
+    nls->ready  = True;
+    return True;
+}
+
+
+ot_int sub_nls_decrypt(m2session* session) {
+/// rxq.getcursor is at the NLS header.  Authenticate and decrypt the rest of
+/// the frame in place, then take the MIC off the frame length.  The first
+/// frame of a dialog derives the key of the dialog, from its sender's key.
+    session_nlskey* nls;
+    ot_u8   nonce[AES_CCM_NONCE_SIZE];
+    ot_u8*  header;
+    ot_u8*  end;
+    ot_bool derived = False;
+    
+    nls     = session_nls(session);
+    header  = rxq.getcursor;
+    end     = &rxq.front[rxq.front[0]];
+    
+    if (end < &header[M2_NLS_HDRBYTES+M2_NLS_MICBYTES]) {
+        return -1;
+    }
+    if (nls->ready == False) {
+        nls->code = header[0];
+        if (sub_nls_derive(nls, session, &m2np.rt.dlog) == False) {
+            return -1;
+        }
+        derived = True;
+    }
+    if (nls->code != header[0]) {
+        return -1;
+    }
+    
+    sub_nls_nonce(nonce, header, &m2np.rt.dlog);
+    rxq.getcursor   = &rxq.front[2];
+    rxq.putcursor   = end;
+    if (AES_decrypt_ccm(&rxq, (ot_int)(&header[M2_NLS_HDRBYTES] - &rxq.front[2]), \
+                        nonce, M2_NLS_MICBYTES, nls->schedule) != 0) {
+        /// A first frame that fails leaves no key behind
+        nls->ready = (ot_bool)(derived == False);
+        return -1;
+    }
+    
+    rxq.front[0]   -= M2_NLS_MICBYTES;
+    rxq.getcursor   = &header[M2_NLS_HDRBYTES];
+    return 0;
+}
+
+
+void sub_nls_header(m2session* session) {
+/// Writes the NLS header to txq.  The first frame of a dialog is the request,
+/// so it derives the key of the dialog from this device's own key.
+    session_nlskey* nls = session_nls(session);
+    
+    if (nls->ready == False) {
+        id_tmpl self;
+        sub_nls_self(&self, (ot_bool)(m2np.header.addr_ctl & M2AC_VID));
+        nls->code = m2np.nls.code;
+        sub_nls_derive(nls, session, &self);
+    }
+    
+    m2np.nls.hdr = txq.putcursor;
+    q_writebyte(&txq, nls->code);
+    q_writelong(&txq, m2np.nls.seq++);
+}
+
+
+void sub_nls_encrypt(m2session* session) {
+/// Encrypt the frame in txq, after the NLS header, and append the MIC.  If 
+/// there is no key or no room, the payload is dropped, as with DLLS.
+    session_nlskey* nls = session_nls(session);
+    ot_u8   nonce[AES_CCM_NONCE_SIZE];
+    ot_u8*  getcursor;
+    ot_u8*  end;
+    id_tmpl self;
+    
+    getcursor       = txq.getcursor;
+    end             = &m2np.nls.hdr[M2_NLS_HDRBYTES];
+    txq.getcursor   = &txq.front[2];
+    sub_nls_self(&self, (ot_bool)(m2np.header.addr_ctl & M2AC_VID));
+    sub_nls_nonce(nonce, m2np.nls.hdr, &self);
+    
+    if ((nls->ready == False) || \
+        (AES_encrypt_ccm(&txq, (ot_int)(end - &txq.front[2]), nonce, \
+                         M2_NLS_MICBYTES, nls->schedule) < 0)) {
+        txq.putcursor   = end;
+        txq.length      = (ot_int)(end - txq.front);
+    }
+    txq.getcursor   = getcursor;
+}
+#endif
+
+
+#if (M2_FEATURE(MULTIHOP) == ENABLED)
+ot_u16 sub_route_hash(ot_u8 length, ot_u8* id) {
+/// Route cache key.  A collision can only send a frame to the wrong next hop,
+/// and the hop count still ends it there.
+    ot_u16 hash = length;
+    
+    while (length-- != 0) {
+        hash = (hash << 5) + hash + *id++;
+    }
+    return hash;
+}
+
+
+ot_bool sub_nbr_match(m2nbr_struct* nbr, ot_u8 length, ot_u8* id) {
+    ot_int i;
+    
+    if (nbr->length != length) {
+        return False;
+    }
+    for (i=0; i<length; i++) {
+        if (nbr->id[i] != id[i]) {
+            return False;
+        }
+    }
+    return True;
+}
+
+
+ot_int sub_route_find(ot_u16 hash) {
+    ot_int i;
+    
+    for (i=0; i<M2_PARAM(ROUTES); i++) {
+        if ((m2np.mh.route[i].nbr != M2_ROUTE_NONE) && (m2np.mh.route[i].hash == hash)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+void sub_route_learn(ot_int nbr) {
+/// The originator of a routed frame is reachable via the neighbor that sent it
+    ot_u16  hash;
+    ot_int  i;
+    
+    if (nbr >= 0) {
+        hash    = sub_route_hash(m2np.rt.orig.length, m2np.rt.orig.value);
+        i       = sub_route_find(hash);
+        if (i < 0) {
+            i = m2np.mh.cursor;
+            if (++m2np.mh.cursor >= M2_PARAM(ROUTES)) {
+                m2np.mh.cursor = 0;
+            }
+            m2np.mh.route[i].hash = hash;
+        }
+        m2np.mh.route[i].nbr = (ot_u8)nbr;
+    }
+}
+
+
+void sub_route_reverse() {
+/// This device is the DEST: swap ORIG and DEST, so the response goes back over
+/// the same route, with a full hop count.
+    id_tmpl swap;
+    ot_u8   hop_code;
+    
+    swap            = m2np.rt.orig;
+    m2np.rt.orig    = m2np.rt.dest;
+    m2np.rt.dest    = swap;
+    hop_code        = m2np.rt.hop_code & ~(M2HC_ORIG | M2HC_DEST);
+    hop_code       |= (m2np.rt.hop_code & M2HC_ORIG) ? M2HC_DEST : 0;
+    hop_code       |= (m2np.rt.hop_code & M2HC_DEST) ? M2HC_ORIG : 0;
+    m2np.rt.hop_code= hop_code | M2HC_HOPMASK;
+}
+
+
+ot_int sub_relay(m2session* session) {
+/// Relay a routed frame that is not for this device in the response slot, one
+/// hop less: unicast to the cached next hop, or anycast if there is no route.
+/// The rest of the frame (M2QP) is copied as it is.
+    ot_u8*  payload;
+    ot_int  length;
+    ot_u8   addressing;
+    id_tmpl nexthop;
+
+    if (((dll.netconf.active & M2_SET_SUBCONTROLLER) == 0) || \
+        ((m2np.rt.hop_code & M2HC_HOPMASK) == 0)) {
+        return -1;
+    }
+    m2np.rt.hop_code--;
+    payload     = rxq.getcursor;
+    length      = (ot_int)(&rxq.front[rxq.front[0]] - payload);
+    addressing  = M2RT_ANYCAST;
+    
+    if (m2np_route_nexthop(&m2np.rt.dest, &nexthop) && \
+        (nexthop.length == m2np.rt.dlog.length)) {
+        addressing          = M2RT_UNICAST;
+        m2np.rt.dlog.value  = nexthop.value;
+    }
+    
+    session->netstate  &= ~M2_NETSTATE_TMASK;
+    session->netstate  |= M2_NETSTATE_RESPTX;
+    m2np_header(session, addressing, 0);
+    q_writestring(&txq, payload, length);
+    return 0;
+}
+#endif
+
+
+#if (M2_FEATURE(HDRCTX) == ENABLED)
+ot_u16 sub_ctx_id(ot_u8 length, ot_u8* peer) {
+    ot_u16 id = (m2np_idhash(length, peer) ^ m2np_idhash(length, NULL)) & M2CTX_IDMASK;
+    return id + (id == 0);
+}
+
+
+m2ctx_struct* sub_ctx_find(ot_u16 id, ot_u8 length) {
+    ot_int i;
+    
+    for (i=0; i<M2_PARAM(HDRCTX); i++) {
+        if ((m2np.hc.ctx[i].id == id) && (m2np.hc.ctx[i].length == length)) {
+            return &m2np.hc.ctx[i];
+        }
+    }
+    return NULL;
+}
+
+
+m2ctx_struct* sub_ctx_keep(ot_u8 length, ot_u8* peer) {
+/// The peer gets its context, in place of the oldest one if it has none
+    ot_u16          id  = sub_ctx_id(length, peer);
+    m2ctx_struct*   ctx = sub_ctx_find(id, length);
+    
+    if (ctx == NULL) {
+        ctx             = &m2np.hc.ctx[m2np.hc.cursor];
+        m2np.hc.cursor  = (m2np.hc.cursor+1 < M2_PARAM(HDRCTX)) ? (m2np.hc.cursor+1) : 0;
+        ctx->id         = id;
+        ctx->length     = length;
+        ctx->ready      = False;
+    }
+    platform_memcpy(ctx->peer, peer, length);
+    return ctx;
+}
+
+
+ot_u16 sub_ctx_tx(m2session* session) {
+/// Returns the context field for the frame that m2np_header() is building, or
+/// 0 if it has none.  Only unicast dialog frames to a known target have one.
+    m2ctx_struct*   ctx;
+    ot_u16          id;
+    ot_u8           length = (m2np.header.addr_ctl & M2_FLAG_VID) ? 2 : 8;
+
+    if (((m2np.header.fr_info & (M2FI_ENADDR | M2FI_FRTYPEMASK)) != M2FI_ENADDR) || \
+        ((m2np.header.addr_ctl & M2RT_MASK) != M2RT_UNICAST) || \
+        (m2np.rt.dlog.value == NULL) || (m2np.rt.dlog.length != length)) {
+        return 0;
+    }
+    id  = sub_ctx_id(length, m2np.rt.dlog.value);
+    ctx = sub_ctx_find(id, length);
+    
+    /// Responses are compressed when the request was a context frame
+    if ((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPTX) {
+        if ((m2np.hc.rx == False) || (ctx == NULL)) {
+            return 0;
+        }
+    }
+    
+    /// Requests are compressed once a context frame has come from the peer.
+    /// Each compressed request uses that up, so if the peer has lost the 
+    /// context, the next request defines it again.
+    else if ((ctx != NULL) && ctx->ready) {
+        ctx->ready = False;
+    }
+    else {
+        sub_ctx_keep(length, m2np.rt.dlog.value);
+        return (id | M2CTX_DEFINE);
+    }
+    m2np.rt.dlog.value = ctx->peer;
+    return id;
+}
+
+
+ot_int sub_ctx_rx(m2session* session) {
+/// Called where the context field of a M2FI_FRCTX frame is.  Returns 1 if the
+/// IDs follow, 0 if the source ID was taken from the context, and -1 if the
+/// frame must be dropped.  Context frames become dialog frames from here on.
+    m2ctx_struct*   ctx;
+    ot_u16          field;
+
+    m2np.hc.rx = False;
+    if (session->protocol != M2FI_FRCTX) {
+        return 1;
+    }
+    if ((m2np.header.addr_ctl & M2RT_MASK) != M2RT_UNICAST) {
+        return -1;
+    }
+    session->protocol   = M2FI_FRDIALOG;
+    m2np.hc.rx          = True;
+    field               = q_readshort(&rxq);
+    if (field & M2CTX_DEFINE) {
+        return 1;
+    }
+    ctx = sub_ctx_find(field, m2np.rt.dlog.length);
+    if (ctx == NULL) {
+        return -1;
+    }
+    ctx->ready          = True;
+    m2np.rt.dlog.value  = ctx->peer;
+    return 0;
+}
+#endif
+
+
+#if (M2_FEATURE(DRIFT) == ENABLED)
+ot_int sub_drift_slop(ot_u8 subnet, ot_u16 eta, ot_int slop) {
+/// Slop to take off the ETA of an advertising flood from this subnet.  It is
+/// the fixed slop until the subnet has learned a rate, after that it is the
+/// deviation guard less the learned error, and the listen is set to cover the
+/// guard on both sides of the learned error.  Either way, the request is left
+/// pending for m2np_drift_sample().
+    m2drift_struct* drift = &m2np.drift;
+    m2peer_struct*  peer;
+    ot_int          i, guard, error;
+    
+    for (i=0; (i<M2_PARAM(DRIFTPEERS)) && (drift->peer[i].subnet != subnet); i++);
+    
+    if (i == M2_PARAM(DRIFTPEERS)) {
+        i = drift->cursor;
+        if (++drift->cursor >= M2_PARAM(DRIFTPEERS)) {
+            drift->cursor = 0;
+        }
+        drift->peer[i].subnet   = subnet;
+        drift->peer[i].samples  = 0;
+    }
+    peer = &drift->peer[i];
+    
+    if (peer->samples >= M2_DRIFT_MINSAMPLES) {
+        error   = (ot_int)(((peer->rate >> 6) * (ot_long)eta) >> 18);
+        guard   = (ot_int)(peer->dev >> 2) + M2_DRIFT_GUARD;    // 4 deviations
+        slop    = guard - error;
+        if (slop > (ot_int)eta) {
+            slop = (ot_int)eta;
+        }
+    }
+    
+    drift->pending  = (ot_u8)i;
+    drift->eta      = eta;
+    drift->start    = (slop > M2_ADV_SLOP) ? -slop : 0;
+    
+    /// Listen until the guard past the learned error, from the session start
+    if (peer->samples >= M2_DRIFT_MINSAMPLES) {
+        error += guard - drift->start;
+        dll.comm.rx_timeout = M2_ADV_LISTEN + ((error > 0) ? error : 0);
+    }
+    return slop;
+}
+#endif
+
 #ifndef EXTF_network_init
 void network_init() {
 #   if (OT_FEATURE(M2NP_CALLBACKS) == ENABLED)
@@ -75,6 +558,48 @@ void network_init() {
     // Hop code should be explicitly set when producing an anycast or unicast 
     // transmission.  OTAPI will do this for you.
     //m2np.rt.hop_code  = 0;
+    
+    sub_idcache_load();
+    
+#   if (OT_FEATURE(DLL_SECURITY))
+        platform_rand((ot_u8*)&m2np.dlls.seq, 4);
+#   endif
+#   if (OT_FEATURE(NL_SECURITY))
+        m2np.nls.code = 0;
+        platform_rand((ot_u8*)&m2np.nls.seq, 4);
+#   endif
+
+#   if (M2_FEATURE(MULTIHOP) == ENABLED)
+    {   ot_int i;
+        m2np.mh.cursor = 0;
+        for (i=0; i<M2_PARAM(NEIGHBORS); i++)   m2np.mh.nbr[i].length = 0;
+        for (i=0; i<M2_PARAM(ROUTES); i++)      m2np.mh.route[i].nbr  = M2_ROUTE_NONE;
+    }
+#   endif
+
+#   if (M2_FEATURE(DRIFT) == ENABLED)
+    {   ot_int i;
+        m2np.drift.pending  = M2_DRIFT_NONE;
+        m2np.drift.cursor   = 0;
+        for (i=0; i<M2_PARAM(DRIFTPEERS); i++)  m2np.drift.peer[i].samples = 0;
+    }
+#   endif
+
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    {   ot_int i;
+        m2np.pwr.cursor     = 0;
+        for (i=0; i<M2_PARAM(PWRPEERS); i++)    m2np.pwr.peer[i].hash = 0;
+    }
+#   endif
+
+#   if (M2_FEATURE(LINKADAPT) == ENABLED)
+    {   ot_int i;
+        m2np.la.pending     = M2_LINK_NONE;
+        m2np.la.cursor      = 0;
+        m2np.la.autoch      = False;
+        for (i=0; i<M2_PARAM(LINKPEERS); i++)   m2np.la.peer[i].hash = 0;
+    }
+#   endif
 }
 #endif
   
@@ -96,15 +621,26 @@ m2session* network_parse_bf() {
             scratch.ubyte[UPPER]    = rxq.getcursor[3];
             scratch.ubyte[LOWER]    = rxq.getcursor[4];
             netstate                = (M2_NETSTATE_REQRX | M2_NETSTATE_INIT);
+            
+            /// The counter runs from the end of the BF, not from now
+            slop                    = RM2_RXEND_AGE(7);
+            if ((slop > 0) && ((ot_uint)slop < scratch.ushort)) {
+                scratch.ushort     -= slop;
+            }
+            
             slop                    = scratch.ushort / OT_GPTIM_ERRDIV;
             slop                   += scratch.ushort / M2_ADV_ERRDIV;
+#           if (M2_FEATURE(DRIFT) == ENABLED)
+            slop                    = sub_drift_slop(rxq.getcursor[0], scratch.ushort, slop);
+#           endif
             
             if (slop > M2_ADV_SLOP) {
                 scratch.ushort -= slop;
                 netstate       |= M2_NETFLAG_FLOOD;
             }
 
-            return session_new( scratch.ushort, netstate, rxq.getcursor[2]);
+            /// The bscan session is still on top: renew it in place
+            return session_renew( scratch.ushort, netstate, rxq.getcursor[2]);
             ///@todo need to put in session subnet?
         }
         
@@ -123,6 +659,13 @@ m2session* network_parse_bf() {
 #ifndef EXTF_network_route_ff
 ot_int network_route_ff(m2session* session) {
     ot_int route_val;
+    ot_int ids = 1;     // 0 for a compressed frame, without IDs (HDRCTX)
+#   if (M2_FEATURE(MULTIHOP) == ENABLED)
+    ot_int nbr = -1;
+#   endif
+#   if (OT_FEATURE(NL_SECURITY))
+    ot_u8 netstate = session->netstate;
+#   endif
 
     /// Strip CRC (-2 bytes)
     rxq.front[0] -= 2;
@@ -142,10 +685,9 @@ ot_int network_route_ff(m2session* session) {
     /// Data Link Layer Security
     if (m2np.header.fr_info & M2FI_DLLS) {
 #   if (OT_FEATURE(DLL_SECURITY))
-        ///@todo experimental
-        AES_load_static_key(ISF_ID(user_authentication_key), (ot_u32*)txq.front);
-        AES_keyschedule_dec((ot_u32*)txq.front, (ot_u32*)(txq.front+16));
-        AES_decrypt(rxq.getcursor, rxq.getcursor, (ot_u32*)(txq.front+16));
+        if (sub_dlls_decrypt() != 0) {
+            return -1;
+        }
 #   else
         return -1;
 #   endif
@@ -164,10 +706,17 @@ ot_int network_route_ff(m2session* session) {
                 session->dialog_id  = q_readbyte(&rxq);
                 break;
                                         
-            default:
-                if (session->dialog_id != q_readbyte(&rxq)) 
+            default: {
+                ot_u8 dialog_id = q_readbyte(&rxq);
+#               if (M2QP_PIPELINE)
+                /// A response may be to any request in the pipeline
+                if (((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPRX) && \
+                    m2qp_pipe_match(dialog_id)) 
+                    break;
+#               endif
+                if (session->dialog_id != dialog_id) 
                     return -1;
-                break;
+            } break;
         }
         
         /// Grab global flags from Address Control
@@ -175,14 +724,37 @@ ot_int network_route_ff(m2session* session) {
         session->flags         |= m2np.header.addr_ctl & 0x3F;
         
         /// Grab Source Address from this packet (dialog address), which is 
-        /// converted to the target address in the response.
+        /// converted to the target address in the response.  A compressed
+        /// frame has neither the Source nor the Target Address.
         m2np.rt.dlog.length = (m2np.header.addr_ctl & M2_FLAG_VID) ? 2 : 8;
-        m2np.rt.dlog.value  = q_markbyte(&rxq, m2np.rt.dlog.length);
+#       if (M2_FEATURE(HDRCTX) == ENABLED)
+        ids = sub_ctx_rx(session);
+        if (ids < 0) {
+            return -1;
+        }
+#       endif
+        if (ids != 0) {
+            m2np.rt.dlog.value  = q_markbyte(&rxq, m2np.rt.dlog.length);
+        }
         
-        /// Network Layer Security
-        /// @note Network Layer Security not supported at this time
+#       if (M2_FEATURE(MULTIHOP) == ENABLED)
+            nbr = m2np_nbr_update(m2np.rt.dlog.length, m2np.rt.dlog.value, radio_rssi());
+#       endif
+#       if (M2_FEATURE(LINKADAPT) == ENABLED)
+            m2np_link_update(m2np.rt.dlog.length, m2np.rt.dlog.value, radio_rssi());
+#       endif
+#       if (M2_FEATURE(AUTOSCALE) == ENABLED)
+            m2np_pwr_update(m2np.rt.dlog.length, m2np.rt.dlog.value, rxq.front[1], radio_rssi());
+#       endif
+        
+        /// Network Layer Security: the rest of the frame is decrypted here.
+        /// A frame that fails does not connect the session to its dialog.
         if (m2np.header.addr_ctl & M2_FLAG_NLS) {
 #       if (OT_FEATURE(NL_SECURITY))
+            if (sub_nls_decrypt(session) != 0) {
+                session->netstate = netstate;
+                return -1;
+            }
 #       else
             return -1;
 #       endif
@@ -191,10 +763,16 @@ ot_int network_route_ff(m2session* session) {
         /// If unicasting, the next data is the target address, which will have
         /// the same length as the source address, and it needs to match this
         /// device's device ID (VID or UID)
-        if ((m2np.header.addr_ctl & 0xC0) == 0) {
+        if (((m2np.header.addr_ctl & 0xC0) == 0) && (ids != 0)) {
             if ( !m2np_idcmp(m2np.rt.dlog.length, q_markbyte(&rxq, m2np.rt.dlog.length)) ) {
                 return -1;
             }
+#           if (M2_FEATURE(HDRCTX) == ENABLED)
+            /// A context define: keep the sender's ID
+            if (m2np.hc.rx) {
+                sub_ctx_keep(m2np.rt.dlog.length, m2np.rt.dlog.value)->ready = True;
+            }
+#           endif
         }
     }
 
@@ -211,8 +789,8 @@ ot_int network_route_ff(m2session* session) {
             m2np.rt.orig.value  = NULL;
             m2np.rt.dest.value  = NULL;
             
-            /// Unicast and Anycast Requests have a routing template
-            /// (Not currently supported, so just move the cursor ahead)
+            /// Unicast and Anycast Requests have a routing template.  Without
+            /// M2_FEATURE(MULTIHOP), the cursor is just moved ahead of it.
             if ((m2np.header.addr_ctl & 0x40) == 0) {
                 m2np.rt.hop_code    = q_readbyte(&rxq);
                 m2np.rt.orig.length = ((m2np.rt.hop_code & M2HC_VID) != 0) ? 2 : 8;                       
@@ -227,8 +805,28 @@ ot_int network_route_ff(m2session* session) {
                 if ((m2np.rt.hop_code & M2HC_DEST) != 0) {
                     m2np.rt.dest.value = q_markbyte(&rxq, m2np.rt.dest.length);
                 }
+                
+#               if (M2_FEATURE(MULTIHOP) == ENABLED)
+                if (m2np.rt.orig.value != NULL) {
+                    sub_route_learn(nbr);
+                }
+                if (m2np.rt.dest.value != NULL) {
+                    if (m2np_idcmp(m2np.rt.dest.length, m2np.rt.dest.value) == False) {
+                        route_val = sub_relay(session);
+                        break;
+                    }
+                    sub_route_reverse();
+                }
+#               endif
+            }
+#           if (OT_FEATURE(PROFILER) == ENABLED)
+            {   ot_u32 mark = platform_get_cycles();
+                route_val   = m2qp_parse_frame(session);   // Routing has passed!
+                sys_profile_log(SYS_PROFILE_M2QP, mark);
             }
+#           else
             route_val = m2qp_parse_frame(session);   // Routing has passed!
+#           endif
             break;
         }
     
@@ -272,6 +870,9 @@ ot_int network_route_ff(m2session* session) {
 
 #ifndef EXTF_m2np_header
 void m2np_header(m2session* session, ot_u8 addressing, ot_u8 nack) {
+#   if (M2_FEATURE(HDRCTX) == ENABLED)
+    ot_u16 ctx;
+#   endif
 
     /// Prep txq, and write Frame Info & Addr Ctrl Fields (universal)
     q_start(&txq, 0, 0);
@@ -287,14 +888,19 @@ void m2np_header(m2session* session, ot_u8 addressing, ot_u8 nack) {
         m2np.header.fr_info    |= frspec ? M2FI_ENADDR : M2FI_STREAM;
         m2np.header.addr_ctl    = frspec ? addressing : 0;
     }
+#   if (M2_FEATURE(HDRCTX) == ENABLED)
+    ctx = sub_ctx_tx(session);
+    if (ctx != 0) {
+        m2np.header.fr_info    |= M2FI_FRCTX;
+    }
+#   endif
     q_writebyte(&txq, m2np.header.fr_info);
     
 #   if (OT_FEATURE(DLL_SECURITY))
+    /// DLLS header: the payload is encrypted in m2np_footer()
     if (m2np.header.fr_info & M2FI_DLLS) {
-        ///@todo experimental
-        AES_load_static_key(ISF_ID(user_authentication_key), (ot_u32*)rxq.front);
-        AES_keyschedule_enc((ot_u32*)rxq.front, (ot_u32*)(rxq.front+16));
-        AES_encrypt(&txq.front[4], &txq.front[4], (ot_u32*)(rxq.front+16));
+        q_writebyte(&txq, m2np.dlls.code);
+        q_writelong(&txq, m2np.dlls.seq++);
     }
 #   endif
     
@@ -303,16 +909,30 @@ void m2np_header(m2session* session, ot_u8 addressing, ot_u8 nack) {
         // Add Dialog ID, Address Ctrl Field, and Source Address
         q_writebyte(&txq, session->dialog_id);
         q_writebyte(&txq, m2np.header.addr_ctl);
-        m2np_put_deviceid( (ot_bool)(m2np.header.addr_ctl & M2AC_VID) );
         
-        ///@todo Put NLS auth header (NLS not currently supported)
+        /// Header context: a compressed frame has no Source or Target address
+#       if (M2_FEATURE(HDRCTX) == ENABLED)
+        if (ctx != 0) {
+            q_writeshort(&txq, ctx);
+        }
+        if ((ctx == 0) || (ctx & M2CTX_DEFINE))
+#       endif
+        {
+            m2np_put_deviceid( (ot_bool)(m2np.header.addr_ctl & M2AC_VID) );
+        }
+        
+        /// NLS header: the rest of the frame is encrypted in m2np_footer()
 #       if (OT_FEATURE(NL_SECURITY))
         if (m2np.header.addr_ctl & M2_FLAG_NLS) {
+            sub_nls_header(session);
         }
 #       endif
         
-        /// Unicast: add Target address, and rebase it from the TX Queue, which
-        /// is non-volatile for the remaining duration of the dialog
+        /// Unicast: add Target address, and rebase it from the TX Queue, 
+        /// which is non-volatile for the remaining duration of the dialog
+#       if (M2_FEATURE(HDRCTX) == ENABLED)
+        if ((ctx == 0) || (ctx & M2CTX_DEFINE))
+#       endif
         if ((m2np.header.addr_ctl & 0xC0) == 0) {
             q_writestring(&txq, m2np.rt.dlog.value, m2np.rt.dlog.length);
             m2np.rt.dlog.value = (txq.putcursor - m2np.rt.dlog.length);
@@ -346,18 +966,19 @@ void m2np_header(m2session* session, ot_u8 addressing, ot_u8 nack) {
 void m2np_footer(m2session* session) {
 #   if (OT_FEATURE(NL_SECURITY))
     if (m2np.header.addr_ctl & M2_FLAG_NLS) {
-        ///@todo Put footer: NLS not currently supported
+        sub_nls_encrypt(session);
     }
 #   endif
 
 #   if (OT_FEATURE(DLL_SECURITY))
-    ///DLLS footer is just padding, goes in automatically during encryption
-    //if (m2np.header.fr_info & M2_FLAG_DLLS) {
-    //}
+    if (m2np.header.fr_info & M2FI_DLLS) {
+        sub_dlls_encrypt();
+    }
 #   endif
     
-    /// Add payload (+txq.length), subtract length byte (-1), add CRC (+2)
-    txq.front[0] = txq.length + 1;
+    /// Frame length: header & payload (+txq.length), plus CRC (+2).  This is
+    /// the whole frame, including the length byte, as the decoders expect it.
+    txq.front[0] = txq.length + 2;
 }
 #endif
 
@@ -365,46 +986,405 @@ void m2np_footer(m2session* session) {
 
 #ifndef EXTF_m2np_put_device_id
 void m2np_put_deviceid(ot_bool use_vid) {
-    vlFILE* fp;
+    sub_idcache_check();
     
-    //file 0=network_settings, 1=device_features
-    fp = ISF_open_su( (ot_u8)(use_vid == False) );
-    ///@todo assert fp
-
-    q_writeshort_be( &txq, vl_read(fp, 0) );
-    if (use_vid == False) {
-    	q_writeshort_be( &txq, vl_read(fp, 2) );
-    	q_writeshort_be( &txq, vl_read(fp, 4) );
-    	q_writeshort_be( &txq, vl_read(fp, 6) );
+    if (use_vid) {
+        q_writeshort_be( &txq, m2np.id.vid );
+    }
+    else {
+        q_writeshort_be( &txq, m2np.id.uid[0] );
+    	q_writeshort_be( &txq, m2np.id.uid[1] );
+    	q_writeshort_be( &txq, m2np.id.uid[2] );
+    	q_writeshort_be( &txq, m2np.id.uid[3] );
     }
-    
-    vl_close(fp);
 }
 #endif
 
 
 #ifndef EXTF_m2np_idcmp
 ot_bool m2np_idcmp(ot_int length, void* id) {
-    ot_bool check = True;
-    ot_u8   use_uid = (length == 8);
-    vlFILE* fp;
+    ot_u16* id16 = (ot_u16*)id;
     
-    //file 0=network_settings, 1=device_features
-    fp = ISF_open_su( use_uid );
-    check &= ( ((ot_u16*)id)[0] == vl_read(fp, 0));
+    sub_idcache_check();
+    
+    if (length == 8) {
+        return (ot_bool)(   (id16[0] == m2np.id.uid[0]) && \
+                            (id16[1] == m2np.id.uid[1]) && \
+                            (id16[2] == m2np.id.uid[2]) && \
+                            (id16[3] == m2np.id.uid[3])     );
+    }
+    return (ot_bool)(id16[0] == m2np.id.vid);
+}
+#endif
+
 
-    if (use_uid) {
-        check &= ( ((ot_u16*)id)[1] == vl_read(fp, 2) );
-        check &= ( ((ot_u16*)id)[2] == vl_read(fp, 4) );
-        check &= ( ((ot_u16*)id)[3] == vl_read(fp, 6) );
+
+#ifndef EXTF_m2np_idlist
+ot_bool m2np_idlist(ot_int length, ot_u8* list, ot_int count, ot_bool sorted) {
+/// This device's ID is taken from the cache once for the whole list.  List
+/// entries can be at any alignment, so they are compared by bytes, and the 
+/// first two bytes reject nearly every other ID.  A sorted list (in byte 
+/// order) is searched by bisection.
+    ot_u8*  self;
+    ot_int  i;
+    
+    sub_idcache_check();
+    self = (length == 8) ? (ot_u8*)m2np.id.uid : (ot_u8*)&m2np.id.vid;
+    
+    if (sorted) {
+        ot_int lo = 0;
+        ot_int hi = count - 1;
+        
+        while (lo <= hi) {
+            ot_int  mid     = (lo + hi) >> 1;
+            ot_u8*  entry   = &list[mid * length];
+            
+            for (i=0; (i<length) && (entry[i] == self[i]); i++);
+            if (i == length) {
+                return True;
+            }
+            if (entry[i] < self[i])     lo = mid + 1;
+            else                        hi = mid - 1;
+        }
+        return False;
     }
     
-    vl_close(fp);
-    return check;
+    for (; count > 0; count--, list+=length) {
+        if ((list[0] == self[0]) && (list[1] == self[1])) {
+            for (i=2; (i<length) && (list[i] == self[i]); i++);
+            if (i == length) {
+                return True;
+            }
+        }
+    }
+    return False;
+}
+#endif
+
+
+
+#ifndef EXTF_m2np_idhash
+ot_u16 m2np_idhash(ot_int length, ot_u8* id) {
+    ot_u16 hash = 5381;
+    
+    /// This device's ID: m2np_put_deviceid() sends the cache bytes in order
+    if (id == NULL) {
+        sub_idcache_check();
+        id = (length == 8) ? (ot_u8*)m2np.id.uid : (ot_u8*)&m2np.id.vid;
+    }
+    
+    while (length-- > 0) {
+        hash = (hash * 33) + *id++;
+    }
+    return hash;
+}
+#endif
+
+
+
+#if (M2_FEATURE(MULTIHOP) == ENABLED)
+#ifndef EXTF_m2np_nbr_update
+ot_int m2np_nbr_update(ot_u8 length, ot_u8* id, ot_int rssi) {
+    m2nbr_struct*   nbr;
+    ot_int          i;
+    ot_int          weak = 0;
+    
+    /// Known neighbor: EWMA of the RSSI.  Also look for the weakest entry, and
+    /// free entries are weakest of all.
+    for (i=0; i<M2_PARAM(NEIGHBORS); i++) {
+        nbr = &m2np.mh.nbr[i];
+        if (nbr->length == 0) {
+            if (m2np.mh.nbr[weak].length != 0) {
+                weak = i;
+            }
+            continue;
+        }
+        if (sub_nbr_match(nbr, length, id)) {
+            nbr->lq += (rssi - nbr->lq) >> M2_LQ_SHIFT;
+            return i;
+        }
+        if ((m2np.mh.nbr[weak].length != 0) && (nbr->lq < m2np.mh.nbr[weak].lq)) {
+            weak = i;
+        }
+    }
+    
+    /// New neighbor: replace the weakest entry if it is stronger, and drop the
+    /// routes that went through the old one.
+    nbr = &m2np.mh.nbr[weak];
+    if ((nbr->length != 0) && (rssi <= nbr->lq)) {
+        return -1;
+    }
+    for (i=0; i<M2_PARAM(ROUTES); i++) {
+        if (m2np.mh.route[i].nbr == weak) {
+            m2np.mh.route[i].nbr = M2_ROUTE_NONE;
+        }
+    }
+    nbr->length = length;
+    nbr->lq     = rssi;
+    platform_memcpy(nbr->id, id, length);
+    return weak;
+}
+#endif
+
+
+#ifndef EXTF_m2np_route_nexthop
+ot_bool m2np_route_nexthop(id_tmpl* dest, id_tmpl* nexthop) {
+    ot_int i;
+    
+    i = sub_route_find( sub_route_hash(dest->length, dest->value) );
+    if (i < 0) {
+        return False;
+    }
+    i               = m2np.mh.route[i].nbr;
+    nexthop->length = m2np.mh.nbr[i].length;
+    nexthop->value  = m2np.mh.nbr[i].id;
+    return True;
+}
+#endif
+#endif
+
+
+#if (M2_FEATURE(DRIFT) == ENABLED)
+#ifndef EXTF_m2np_drift_sample
+void m2np_drift_sample(ot_int arrival) {
+    m2peer_struct*  peer;
+    ot_long         error, rate, dev;
+    
+    if (m2np.drift.pending == M2_DRIFT_NONE) {
+        return;
+    }
+    peer                = &m2np.drift.peer[m2np.drift.pending];
+    m2np.drift.pending  = M2_DRIFT_NONE;
+    
+    /// The window missed the request (or it did not come): go back to the
+    /// fixed slop, and learn again.
+    if ((arrival < 0) || (m2np.drift.eta == 0)) {
+        peer->samples = 0;
+        return;
+    }
+    
+    /// Error of the arrival against the ETA, and as a rate (Q24).  The first
+    /// sample only sets the rate, the rest also give the deviation from it.
+    error   = (ot_long)(m2np.drift.start + arrival);
+    error   = (error > M2_DRIFT_ERRMAX) ? M2_DRIFT_ERRMAX : \
+                ((error < -M2_DRIFT_ERRMAX) ? -M2_DRIFT_ERRMAX : error);
+    rate    = (error << 24) / (ot_long)m2np.drift.eta;
+    rate    = (rate > M2_DRIFT_RATEMAX) ? M2_DRIFT_RATEMAX : \
+                ((rate < -M2_DRIFT_RATEMAX) ? -M2_DRIFT_RATEMAX : rate);
+    
+    if (peer->samples == 0) {
+        peer->rate  = rate;
+        peer->dev   = 0;
+    }
+    else {
+        dev         = error - (((peer->rate >> 6) * (ot_long)m2np.drift.eta) >> 18);
+        dev         = (dev < 0) ? -dev : dev;
+        dev         = (dev << 4) - (ot_long)peer->dev;
+        peer->dev  += (ot_u16)(dev >> M2_DRIFT_SHIFT);
+        peer->rate += (rate - peer->rate) >> M2_DRIFT_SHIFT;
+    }
+    if (peer->samples != 255) {
+        peer->samples++;
+    }
+}
+#endif
+#endif
+
+
+
+
+#if (M2_FEATURE(LINKADAPT) == ENABLED)
+static const ot_int m2la_floor[M2_LINK_LEVELS-1] = {
+    M2_LINK_RSSI_FAST, M2_LINK_RSSI_SLOW
+};
+
+ot_u8 sub_link_chan(ot_u8 level) {
+    if (level == 0) return M2_PARAM(LINKFAST);
+    if (level == 1) return M2_PARAM(LINKSLOW);
+    return (M2_PARAM(LINKSLOW) | RM2_ENCODING_FEC);
+}
+
+ot_int sub_link_find(ot_u16 hash) {
+    ot_int i;
+    for (i=0; i<M2_PARAM(LINKPEERS); i++) {
+        if (m2np.la.peer[i].hash == hash) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void sub_link_level(m2link_struct* peer) {
+/// Move one level at most per sample, and judge the new level from scratch
+    ot_u8 level = peer->level;
+    
+    if ((level < (M2_LINK_LEVELS-1)) && \
+        ((peer->loss >= M2_LINK_LOSSDOWN) || \
+         ((peer->samples != 0) && (peer->rssi < m2la_floor[level])))) {
+        level++;
+    }
+    else if ((level > 0) && (peer->samples != 0) && (peer->loss < M2_LINK_LOSSUP) && \
+             (peer->rssi >= (m2la_floor[level-1] + M2_LINK_HYST))) {
+        level--;
+    }
+    if (level != peer->level) {
+        peer->level = level;
+        peer->loss  = 0;
+    }
+}
+
+
+#ifndef EXTF_m2np_link_channel
+ot_u8 m2np_link_channel(id_tmpl* peer) {
+    ot_u16  hash;
+    ot_int  i;
+    ot_u8   level;
+    
+    m2np.la.pending = M2_LINK_NONE;
+    
+    /// No single target: the most robust level of the known peers
+    if (peer == NULL) {
+        level = M2_LINK_NONE;
+        for (i=0; i<M2_PARAM(LINKPEERS); i++) {
+            if ((m2np.la.peer[i].hash != 0) && \
+                ((level == M2_LINK_NONE) || (m2np.la.peer[i].level > level))) {
+                level = m2np.la.peer[i].level;
+            }
+        }
+        return sub_link_chan( (level == M2_LINK_NONE) ? M2_LINK_START : level );
+    }
+    
+    /// Known peer, or a new one in the oldest entry (hash 0 marks free ones)
+    hash    = m2np_idhash(peer->length, peer->value);
+    hash   += (hash == 0);
+    i       = sub_link_find(hash);
+    if (i < 0) {
+        i                           = m2np.la.cursor;
+        m2np.la.cursor              = (i+1 < M2_PARAM(LINKPEERS)) ? (i+1) : 0;
+        m2np.la.peer[i].hash        = hash;
+        m2np.la.peer[i].loss        = 0;
+        m2np.la.peer[i].level       = M2_LINK_START;
+        m2np.la.peer[i].samples     = 0;
+    }
+    m2np.la.pending = (ot_u8)i;
+    return sub_link_chan(m2np.la.peer[i].level);
+}
+#endif
+
+
+#ifndef EXTF_m2np_link_update
+void m2np_link_update(ot_u8 length, ot_u8* id, ot_int rssi) {
+    m2link_struct*  peer;
+    ot_u16          hash;
+    ot_int          i;
+    
+    hash    = m2np_idhash(length, id);
+    hash   += (hash == 0);
+    i       = sub_link_find(hash);
+    if (i < 0) {
+        return;
+    }
+    peer = &m2np.la.peer[i];
+    
+    if (peer->samples == 0)     peer->rssi  = rssi;
+    else                        peer->rssi += (rssi - peer->rssi) >> M2_LINK_SHIFT;
+    if (peer->samples != 255)   peer->samples++;
+    
+    /// A response from the pending peer is a success
+    if (i == m2np.la.pending) {
+        peer->loss     -= peer->loss >> M2_LINK_SHIFT;
+        m2np.la.pending = M2_LINK_NONE;
+    }
+    sub_link_level(peer);
 }
 #endif
 
 
+#ifndef EXTF_m2np_link_loss
+void m2np_link_loss(ot_bool timeout) {
+    m2link_struct* peer;
+    
+    if (m2np.la.pending == M2_LINK_NONE) {
+        return;
+    }
+    peer        = &m2np.la.peer[m2np.la.pending];
+    peer->loss += (255 - peer->loss) >> M2_LINK_SHIFT;
+    sub_link_level(peer);
+    
+    if (timeout) {
+        m2np.la.pending = M2_LINK_NONE;
+    }
+}
+#endif
+#endif
+
+
+
+
+#if (M2_FEATURE(AUTOSCALE) == ENABLED)
+ot_u8 sub_pwr_eirp(ot_int loss) {
+/// EIRP code that puts the target RSSI (plus margin) at the peer
+    ot_int eirp;
+    eirp = (loss + M2_PARAM(PWRTARGET) + M2_PARAM(PWRMARGIN) + 40) << 1;
+    return (eirp < 0) ? 0 : ((eirp > M2_PWR_FULL) ? M2_PWR_FULL : (ot_u8)eirp);
+}
+
+ot_int sub_pwr_find(ot_u16 hash) {
+    ot_int i;
+    for (i=0; i<M2_PARAM(PWRPEERS); i++) {
+        if (m2np.pwr.peer[i].hash == hash) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+#ifndef EXTF_m2np_pwr_update
+void m2np_pwr_update(ot_u8 length, ot_u8* id, ot_u8 eirp, ot_int rssi) {
+    m2pwrpeer_struct*   peer;
+    ot_u16              hash;
+    ot_int              loss;
+    ot_int              i;
+    
+    loss                = M2_EIRP_DBM(eirp & M2_EIRP_MASK) - rssi;
+    dll.comm.tx_eirp    = sub_pwr_eirp(loss);
+    
+    hash    = m2np_idhash(length, id);
+    hash   += (hash == 0);
+    i       = sub_pwr_find(hash);
+    if (i < 0) {
+        i               = m2np.pwr.cursor;
+        m2np.pwr.cursor = (i+1 < M2_PARAM(PWRPEERS)) ? (i+1) : 0;
+        peer            = &m2np.pwr.peer[i];
+        peer->hash      = hash;
+        peer->loss      = loss;
+    }
+    else {
+        peer            = &m2np.pwr.peer[i];
+        peer->loss     += (loss - peer->loss) >> M2_PWR_SHIFT;
+    }
+}
+#endif
+
+
+#ifndef EXTF_m2np_pwr_eirp
+ot_u8 m2np_pwr_eirp(id_tmpl* peer) {
+    ot_u16  hash;
+    ot_int  i;
+    
+    if (peer == NULL) {
+        return M2_PWR_FULL;
+    }
+    hash    = m2np_idhash(peer->length, peer->value);
+    hash   += (hash == 0);
+    i       = sub_pwr_find(hash);
+    return (i < 0) ? M2_PWR_FULL : sub_pwr_eirp(m2np.pwr.peer[i].loss);
+}
+#endif
+#endif
+
+
 
 
 
@@ -416,7 +1396,34 @@ ot_bool m2np_idcmp(ot_int length, void* id) {
   
 #if (SYS_FLOOD == ENABLED)
     Queue   advq;
-    ot_u8   txadv_buffer[10];
+    ot_u8   txadv_buffer[2][10];    // double-buffered flood frames
+    ot_u8   txadv_back;             // buffer that is not in txq
+    ot_u16  txadv_crc;              // CRC of the constant frame bytes
+
+    /// Frame: subnet, protocol, channel, ETA (2), CRC (2 - unless by the RF)
+#   if (RF_FEATURE(CRC) == ENABLED)
+#       define ADV_FRAMEBYTES   5
+#   else
+#       define ADV_FRAMEBYTES   7
+#   endif
+
+void sub_advp_load(ot_u8* frame, ot_u16 eta) {
+/// Only the ETA changes between flood frames, so the CRC is continued from
+/// the saved CRC of the constant bytes rather than done over the whole frame.
+    frame[3] = ((ot_u8*)&eta)[UPPER];
+    frame[4] = ((ot_u8*)&eta)[LOWER];
+#   if (RF_FEATURE(CRC) != ENABLED)
+    {   ot_u16 crcv;
+#       if (MCU_FEATURE(CRC) == DISABLED)
+        crcv = crc_extend_block(txadv_crc, 2, &frame[3]);
+#       else
+        crcv = crc_calc_block(5, frame);
+#       endif
+        frame[5] = (ot_u8)(crcv >> 8);
+        frame[6] = (ot_u8)crcv;
+    }
+#   endif
+}
 #endif
 
 
@@ -433,6 +1440,28 @@ void m2advp_open(m2session* session) {
 #endif
 
 
+#ifndef EXTF_m2advp_swap
+void m2advp_swap() {
+#if (SYS_FLOOD == ENABLED)
+    q_rebase(&txq, txadv_buffer[txadv_back]);
+    txq.length                  = ADV_FRAMEBYTES;
+    txq.putcursor              += ADV_FRAMEBYTES;
+    txq.options.ubyte[UPPER]    = 0;
+    txadv_back                 ^= 1;
+#endif
+}
+#endif
+
+
+#ifndef EXTF_m2advp_update
+void m2advp_update(ot_u16 eta) {
+#if (SYS_FLOOD == ENABLED)
+    sub_advp_load(txadv_buffer[txadv_back], eta);
+#endif
+}
+#endif
+
+
 #ifndef EXTF_m2advp_close
 void m2advp_close() {
 #if (SYS_FLOOD == ENABLED)
@@ -461,15 +1490,32 @@ ot_int m2advp_init_flood(m2session* session, ot_u16 schedule) {
     /// Store existing TXQ (bit of a hack)
     q_copy(&advq, &txq);
     
-    /// Reinit txq to the advertising buffer, and load data that will stay the
-    /// same for all packets in the flood.
-    q_init(&txq, txadv_buffer, 10);
+    /// Load data that will stay the same for all packets in the flood into
+    /// both frame buffers, and keep the CRC of it.
+    {   ot_int i;
+        ot_int eta_next;
+        
+        for (i=0; i<2; i++) {
+            txadv_buffer[i][0] = session->subnet;
+            txadv_buffer[i][1] = M2_PROTOCOL_M2ADVP;
+            txadv_buffer[i][2] = session->channel;
+        }
+#       if ((RF_FEATURE(CRC) != ENABLED) && (MCU_FEATURE(CRC) == DISABLED))
+        txadv_crc = crc_calc_block(3, txadv_buffer[0]);
+#       endif
+        
+        /// The first frame goes into txq, and the frame after it is ready 
+        /// in the back buffer before the first one is even sent.
+        eta_next = (ot_int)schedule - rm2_pkt_duration(7);
+        sub_advp_load(txadv_buffer[0], schedule);
+        sub_advp_load(txadv_buffer[1], (ot_u16)((eta_next > 0) ? eta_next : 0));
+        txadv_back = 1;
+    }
     
-    txq.front[0]    = session->subnet;
-    txq.front[1]    = M2_PROTOCOL_M2ADVP;
-    txq.front[2]    = session->channel;
-    txq.front[3]    = ((ot_u8*)&schedule)[UPPER];
-    txq.front[4]    = ((ot_u8*)&schedule)[LOWER];
+    /// Reinit txq to the first frame buffer (CRC is already in the frame)
+    q_init(&txq, txadv_buffer[0], 10);
+    txq.length      = ADV_FRAMEBYTES;
+    txq.putcursor  += ADV_FRAMEBYTES;
  
     return 0;
 #else
@@ -558,9 +1604,101 @@ void m2dp_dsproc() {
 #endif
 
 
+#if (M2_FEATURE(DSWINDOW) == ENABLED)
+ot_int sub_dswin_scan(ot_u8 pos) {
+/// Returns the first window position at or after pos which the ACK map does
+/// not cover yet, or -1 if there is none inside the window and the stream.
+    for (; pos<M2_PARAM(DSWINDOW); pos++) {
+        if ((m2dp.win.base + pos) >= m2dp.win.total) {
+            break;
+        }
+        if ((m2dp.win.map & ((ot_u32)1 << pos)) == 0) {
+            return (ot_int)pos;
+        }
+    }
+    return -1;
+}
+
+
+ot_int sub_dswin_sink(m2session* session) {
+/// Write a good frame into the sink ISF at its stream offset and mark it in
+/// the map.  Then slide the window over the frames that are now in order.  The
+/// frame ID ties the frame to a window position (it is free to wrap).
+    ot_u8   delta;
+    ot_u8*  end;
+    
+    delta   = q_readbyte(&rxq) - (ot_u8)m2dp.win.base;
+    end     = &rxq.front[rxq.front[0]];
+    
+    if ((m2dp.dscfg.dmg_count == 0) && \
+        (delta < M2_PARAM(DSWINDOW)) && \
+        ((m2dp.win.base + delta) < m2dp.win.total) && \
+        ((m2dp.win.map & ((ot_u32)1 << delta)) == 0)) {
+        vlFILE* fp;
+        
+        fp = ISF_open_su(m2dp.win.isf_id);
+        if (fp != NULL) {
+            ot_u8   err_code    = 0;
+            ot_uint offset      = (m2dp.win.base + delta) * m2dp.win.seg_bytes;
+            ot_uint limit       = offset + m2dp.win.seg_bytes;
+            
+            for (; (offset < limit) && (rxq.getcursor < end); offset+=2) {
+                err_code |= vl_write(fp, offset, q_readshort_be(&rxq));
+            }
+            vl_close(fp);
+            
+            if (err_code == 0) {
+                m2dp.win.map |= ((ot_u32)1 << delta);
+#               if (OTA_SUPPORT)
+                if (m2dp.win.isf_id == ISF_ID(ota_image)) {
+                    ota_mark(m2dp.win.base + delta);
+                }
+#               endif
+            }
+        }
+        
+        while (m2dp.win.map & 1) {
+            m2dp.win.map >>= 1;
+            m2dp.win.base++;
+        }
+    }
+    m2dp.dscfg.dmg_count = 0;
+    
+    /// The source sets the listen flag on the last frame of a burst.  Reply
+    /// then (or at the end of the stream) with a selective ACK request:
+    /// cmd, [ext], dialog timeout (0), window base (2 bytes), map (4 bytes)
+    if (((session->flags & M2FI_LISTEN) || (m2dp.win.base >= m2dp.win.total)) && \
+        ((m2dp.dscfg.ctl & M2DS_DISABLE_ACKREQ) == 0)) {
+        m2np_header(session, 0, 2);
+        if (m2dp.dscfg.ctl & M2DS_DISABLE_ACKRESP) {
+            q_writebyte(&txq, (0x80 | M2TT_REQNA2P | M2OP_DS_ACK));
+            q_writebyte(&txq, M2CE_NORESP);
+        }
+        else {
+            q_writebyte(&txq, (M2TT_REQNA2P | M2OP_DS_ACK));
+        }
+        q_writebyte(&txq, 0);
+        q_writeshort(&txq, m2dp.win.base);
+        q_writelong(&txq, m2dp.win.map);
+        return 0;
+    }
+    
+    /// Mid-burst frames are stored without any reply
+    return -1;
+}
+#endif
+
+
 #ifndef EXTF_m2dp_parse_dspkt
 ot_int m2dp_parse_dspkt(m2session* session) {
 #if (OT_FEATURE(ALP) == ENABLED)
+#   if (M2_FEATURE(DSWINDOW) == ENABLED)
+    /// Sliding-window sink: the frame goes straight to the sink ISF
+    if (m2dp.win.mode == M2DS_WIN_SINK) {
+        return sub_dswin_sink(session);
+    }
+#   endif
+
     /// Put together the beginning of the ACK request, as long as the ACK is
     /// enabled (set up by the M2QP handshaking).
     if ((m2dp.dscfg.ctl & M2DS_DISABLE_ACKREQ) == 0) {
@@ -637,6 +1775,122 @@ void m2dp_mark_dsframe(m2session* session) {
 
 
 
+#if (M2_FEATURE(DSWINDOW) == ENABLED)
+#ifndef EXTF_m2dp_sink_open
+void m2dp_sink_open(ot_u8 isf_id, ot_u8 seg_bytes, ot_u16 total) {
+    m2dp.win.mode       = M2DS_WIN_SINK;
+    m2dp.win.isf_id     = isf_id;
+    m2dp.win.seg_bytes  = seg_bytes & ~1;
+    m2dp.win.cursor     = 0;
+    m2dp.win.total      = total;
+    m2dp.win.base       = 0;
+    m2dp.win.map        = 0;
+}
+#endif
+
+
+#ifndef EXTF_m2dp_source_open
+ot_u16 m2dp_source_open(ot_u8 isf_id, ot_u8 seg_bytes) {
+    vlFILE* fp;
+    
+    seg_bytes  &= ~1;
+    fp          = ISF_open_su(isf_id);
+    if ((fp == NULL) || (seg_bytes == 0)) {
+        m2dp.win.mode = M2DS_WIN_OFF;
+        return 0;
+    }
+    
+    m2dp_sink_open(isf_id, seg_bytes, ((fp->length + seg_bytes - 1) / seg_bytes));
+    m2dp.win.mode = M2DS_WIN_SOURCE;
+    vl_close(fp);
+    
+    return m2dp.win.total;
+}
+#endif
+
+
+#ifndef EXTF_m2dp_source_next
+ot_int m2dp_source_next(m2session* session) {
+/// Load the next unacknowledged frame of the window, which is read straight
+/// out of the source ISF.
+    vlFILE* fp;
+    ot_int  pos;
+    ot_u16  frame;
+    ot_uint offset;
+    ot_uint limit;
+    
+    pos = sub_dswin_scan(m2dp.win.cursor);
+    if ((m2dp.win.mode != M2DS_WIN_SOURCE) || (pos < 0)) {
+        return -1;
+    }
+    fp = ISF_open_su(m2dp.win.isf_id);
+    if (fp == NULL) {
+        return -1;
+    }
+    
+    m2dp.win.cursor = (ot_u8)pos + 1;
+    frame           = m2dp.win.base + pos;
+    m2dp_open((ot_u8)frame, session);
+    
+    /// The source listens for the ACK after the last frame of the burst, so
+    /// set the listen flag (Frame Info is 3 bytes back from the frame ID)
+    if (sub_dswin_scan(m2dp.win.cursor) < 0) {
+        txq.putcursor[-3] |= M2FI_LISTEN;
+    }
+    
+    offset  = frame * m2dp.win.seg_bytes;
+    limit   = offset + m2dp.win.seg_bytes;
+    limit   = (limit > fp->length) ? fp->length : limit;
+    for (; offset<limit; offset+=2) {
+        q_writeshort_be(&txq, vl_read(fp, offset));
+    }
+    vl_close(fp);
+    
+    return (ot_int)frame;
+}
+#endif
+
+
+#ifndef EXTF_m2dp_source_ack
+ot_bool m2dp_source_ack(Queue* ackq) {
+/// The ACK map is relative to the sink's window base.  Stale ACKs (with a 
+/// base behind the source's base) are ignored.
+    ot_u16  base;
+    ot_u32  map;
+    
+    base    = q_readshort(ackq);
+    map     = q_readlong(ackq);
+    
+    if ((ot_u16)(base - m2dp.win.base) <= M2_PARAM(DSWINDOW)) {
+        m2dp.win.base   = base;
+        m2dp.win.map    = map;
+    }
+    m2dp.win.cursor = 0;
+    
+    return (ot_bool)(m2dp.win.base >= m2dp.win.total);
+}
+#endif
+
+
+#ifndef EXTF_m2dp_win_seek
+void m2dp_win_seek(ot_u16 base, ot_u32 map) {
+    m2dp.win.base   = base;
+    m2dp.win.map    = map;
+    m2dp.win.cursor = 0;
+}
+#endif
+
+
+#ifndef EXTF_m2dp_win_close
+void m2dp_win_close() {
+    m2dp.win.mode = M2DS_WIN_OFF;
+}
+#endif
+#endif
+
+
+
+
 
 
 
@@ -49,6 +49,7 @@
 #define M2FI_FRNACK             (0x01)
 #define M2FI_STREAM             (0x02)
 #define M2FI_RFU                (0x03)
+#define M2FI_FRCTX              (0x03)      // OpenTag extension: M2_FEATURE(HDRCTX)
 #define M2FI_NM2                (0x04)
 #define M2FI_CRC32              (0x08)
 #define M2FI_FRCONT             (0x10)
@@ -97,6 +98,19 @@
 #define M2DS_DISABLE_ACKREQ      (0x01 << 7)
 #define M2DS_DISABLE_ACKRESP     (0x01 << 1)
 
+// Sliding-window datastreams: frames are streamed to/from a veelite ISF, with
+// up to M2_PARAM_DSWINDOW frames (max 32) between selective ACKs.
+#ifndef M2_FEATURE_DSWINDOW
+#   define M2_FEATURE_DSWINDOW      DISABLED
+#endif
+#ifndef M2_PARAM_DSWINDOW
+#   define M2_PARAM_DSWINDOW        8
+#endif
+
+#define M2DS_WIN_OFF             0
+#define M2DS_WIN_SINK            1
+#define M2DS_WIN_SOURCE          2
+
 
 
 
@@ -110,11 +124,321 @@ typedef struct {
     ot_sig2 route;
 } m2npsig_struct;
 
+/** Data Link Layer Security (OT_FEATURE(DLL_SECURITY))
+  * A frame with M2FI_DLLS has a DLLS header after Frame Info: [code][sequence]
+  * The code is the key Protocol ID, | AUTH_FLAG_ISROOT for the root key, and
+  * the sequence is 4 bytes, big endian.  The rest of the frame, up to the CRC,
+  * is AES-CCM ciphertext and a M2_DLLS_MICBYTES MIC.  Subnet, Frame Info and
+  * the DLLS header are authenticated only, and they are also the nonce (zero
+  * padded).  The TX sequence starts random and goes up by one per frame.
+  */
+#define M2_DLLS_HDRBYTES        5
+#ifndef M2_DLLS_MICBYTES
+#   define M2_DLLS_MICBYTES     4
+#endif
+
+/** Network Layer Security (OT_FEATURE(NL_SECURITY))
+  * A frame with M2_FLAG_NLS in Address Control has an NLS header after the
+  * Source ID: [code][sequence], as with DLLS.  The code is the Protocol ID of
+  * the requester's NLS key (see auth_new_nlsuser(): the requester has its own
+  * ID in the table, too), and the key of the dialog is derived from it once:
+  * AES(user key, [subnet][dialog ID][code][requester ID, zero padded]).  The
+  * requester derives it when it sends the request, and the responders when 
+  * they get it, and it is kept with the session (see session_nls()), so each
+  * frame only runs the AES-CCM cipher.  Everything in the frame after the NLS
+  * header is ciphertext, then a M2_NLS_MICBYTES MIC, and the bytes from Subnet
+  * up to the end of the NLS header are authenticated only.  The nonce is 
+  * [code][sequence][sender ID, zero padded].  The TX sequence starts random
+  * and goes up by one per frame.
+  */
+#define M2_NLS_HDRBYTES         5
+#ifndef M2_NLS_MICBYTES
+#   define M2_NLS_MICBYTES      4
+#endif
+
+/** Multi-hop Routing (M2_FEATURE(MULTIHOP))
+  * Every addressed frame updates a small neighbor table: the source ID and an
+  * EWMA of its RSSI.  A routing template with ORIG teaches a route to the
+  * originator, via the neighbor that sent the frame, into a route cache that is
+  * keyed by a hash of the ID.  A subcontroller that gets a routed frame with a
+  * DEST that is not its own ID relays it in its response slot, with one hop
+  * less: unicast to the cached next hop, or anycast if there is no route.  A
+  * device that is the DEST swaps ORIG and DEST, so its response comes back
+  * over the same route.  When a table is full, the weakest neighbor and the
+  * oldest route are replaced.
+  */
+#ifndef M2_FEATURE_MULTIHOP
+#   define M2_FEATURE_MULTIHOP      DISABLED
+#endif
+#ifndef M2_PARAM_NEIGHBORS
+#   define M2_PARAM_NEIGHBORS       8
+#endif
+#ifndef M2_PARAM_ROUTES
+#   define M2_PARAM_ROUTES          8
+#endif
+#define M2_LQ_SHIFT                 2       // EWMA weight of a new RSSI: 1/4
+#define M2_ROUTE_NONE               0xFF
+
+/// length: ID bytes (2 = VID, 8 = UID), 0 if the entry is free
+/// lq:     EWMA of the RSSI, as radio_rssi() returns it
+typedef struct {
+    ot_u8   length;
+    ot_u8   id[8];
+    ot_int  lq;
+} m2nbr_struct;
+
+/// hash:   hash of the destination ID, from sub_route_hash()
+/// nbr:    neighbor table index of the next hop, M2_ROUTE_NONE if free
+typedef struct {
+    ot_u16  hash;
+    ot_u8   nbr;
+} m2route_struct;
+
+typedef struct {
+    ot_u8           cursor;     // next route to replace (oldest)
+    m2nbr_struct    nbr[M2_PARAM(NEIGHBORS)];
+    m2route_struct  route[M2_PARAM(ROUTES)];
+} m2mh_struct;
+
+/** Drift Tracking (M2_FEATURE(DRIFT))
+  * The request after an advertising flood comes at the ETA the flood gives,
+  * plus the error of the two clocks over that ETA.  The error seen for each
+  * request (in ti, from the ETA to the start of the request frame) is kept per
+  * subnet, as a rate (error per ti of ETA) and an EWMA of the deviation from
+  * the rate.  Once a subnet has M2_DRIFT_MINSAMPLES samples, the session for
+  * its next request is moved by the learned error, and it only listens for
+  * the deviation guard on each side of it, rather than for the fixed slop of
+  * OT_GPTIM_ERRDIV and M2_ADV_ERRDIV.  A request that does not come in the
+  * window puts the subnet back on the fixed slop until it learns again.
+  */
+#ifndef M2_FEATURE_DRIFT
+#   define M2_FEATURE_DRIFT         DISABLED
+#endif
+#ifndef M2_PARAM_DRIFTPEERS
+#   define M2_PARAM_DRIFTPEERS      4
+#endif
+#define M2_DRIFT_MINSAMPLES         2
+#define M2_DRIFT_SHIFT              2       // EWMA weight of a new sample: 1/4
+#define M2_DRIFT_ERRMAX             127     // clip on a single error sample (ti)
+#define M2_DRIFT_RATEMAX            ((ot_long)1 << 18)  // clip on the rate: 1/64
+#define M2_DRIFT_GUARD              2       // ti, added to the deviation guard
+#define M2_DRIFT_NONE               0xFF
+
+/// subnet:     subnet of the advertising frames (M2AdvP has no source ID)
+/// samples:    number of requests seen, 0 if the rate is not learned
+/// dev:        EWMA of |error - rate*ETA|, in ti/16
+/// rate:       EWMA of error/ETA, Q24
+typedef struct {
+    ot_u8   subnet;
+    ot_u8   samples;
+    ot_u16  dev;
+    ot_long rate;
+} m2peer_struct;
+
+/// pending:    peer index waiting for its request, or M2_DRIFT_NONE
+/// eta:        ETA given by the flood of the pending peer
+/// start:      session start of the pending request, relative to the ETA
+typedef struct {
+    ot_u8           pending;
+    ot_u8           cursor;     // next peer to replace (oldest)
+    ot_u16          eta;
+    ot_int          start;
+    m2peer_struct   peer[M2_PARAM(DRIFTPEERS)];
+} m2drift_struct;
+
+/** Link Adaptation (M2_FEATURE(LINKADAPT))
+  * A session opened on RM2_CHAN_AUTO gets its channel from the link quality
+  * of the device it unicasts to.  There are three levels, from fast to
+  * robust: the fast channel (M2_PARAM_LINKFAST), the slow channel
+  * (M2_PARAM_LINKSLOW), and the slow channel with FEC.  Each peer has an EWMA
+  * of the RSSI of its responses, and an EWMA of the loss, where a loss is a
+  * response with a bad CRC or a response window that ended with nothing.
+  * - A peer goes one level down when the loss reaches M2_LINK_LOSSDOWN, or
+  *   when its RSSI is below the floor of its level.
+  * - It goes one level up when the loss is under M2_LINK_LOSSUP, and its RSSI
+  *   is M2_LINK_HYST over the floor of the level above.
+  * The loss is reset on each change, so each level is judged on its own.
+  * Broadcast and anycast requests use the most robust level of the known
+  * peers.  Peers are found by m2np_idhash() of their ID.
+  */
+#ifndef M2_FEATURE_LINKADAPT
+#   define M2_FEATURE_LINKADAPT     DISABLED
+#endif
+#ifndef M2_PARAM_LINKPEERS
+#   define M2_PARAM_LINKPEERS       4
+#endif
+#ifndef M2_PARAM_LINKFAST
+#   define M2_PARAM_LINKFAST        0x21    // Turbo channel 1
+#endif
+#ifndef M2_PARAM_LINKSLOW
+#   define M2_PARAM_LINKSLOW        0x10    // Normal channel 0
+#endif
+#ifndef M2_LINK_RSSI_FAST
+#   define M2_LINK_RSSI_FAST        -85     // RSSI floor of the fast channel
+#endif
+#ifndef M2_LINK_RSSI_SLOW
+#   define M2_LINK_RSSI_SLOW        -100    // RSSI floor of the slow channel
+#endif
+#define M2_LINK_HYST                6       // RSSI margin to go up a level
+#define M2_LINK_START               1       // level of a new peer (slow)
+#define M2_LINK_LEVELS              3
+#define M2_LINK_SHIFT               3       // EWMA weight of a new sample: 1/8
+#define M2_LINK_LOSSDOWN            64      // loss (0-255) to go down a level
+#define M2_LINK_LOSSUP              8       // loss (0-255) to go up a level
+#define M2_LINK_NONE                0xFF
+
+/// hash:       m2np_idhash() of the peer ID, 0 if the entry is free
+/// rssi:       EWMA of the RSSI of its responses, from radio_rssi()
+/// loss:       EWMA of the losses (255 when all are lost)
+/// level:      {0,1,2} = {fast, slow, slow + FEC}
+/// samples:    RSSI samples, saturating (the first one sets the EWMA)
+typedef struct {
+    ot_u16  hash;
+    ot_int  rssi;
+    ot_u8   loss;
+    ot_u8   level;
+    ot_u8   samples;
+} m2link_struct;
+
+/** TX Power Control (M2_FEATURE(AUTOSCALE))
+  * Each Mode 2 frame carries the EIRP it was sent with, so the path loss to
+  * its sender is that EIRP less the RSSI it was received with.  The loss is
+  * kept per peer as an EWMA, and dll.comm.tx_eirp is set for each dialog so
+  * the peer gets M2_PARAM_PWRTARGET dBm, plus the margin M2_PARAM_PWRMARGIN:
+  * - A response uses the loss of the request it answers.
+  * - A unicast request uses the loss kept for its target.
+  * - Other requests, and targets with no loss kept, use full power.
+  * Only channels with the autoscale flag are scaled (see RM2_EIRP_AUTOSCALE).
+  */
+#ifndef M2_PARAM_PWRPEERS
+#   define M2_PARAM_PWRPEERS        4
+#endif
+#ifndef M2_PARAM_PWRTARGET
+#   define M2_PARAM_PWRTARGET       -95     // dBm that the peer should get
+#endif
+#ifndef M2_PARAM_PWRMARGIN
+#   define M2_PARAM_PWRMARGIN       10      // dB over the target
+#endif
+#define M2_PWR_SHIFT                2       // EWMA weight of a new sample: 1/4
+#define M2_PWR_FULL                 0x7F
+
+/// hash:       m2np_idhash() of the peer ID, 0 if the entry is free
+/// loss:       EWMA of the path loss to the peer, in dB
+typedef struct {
+    ot_u16  hash;
+    ot_int  loss;
+} m2pwrpeer_struct;
+
+typedef struct {
+    ot_u8               cursor;     // next peer to replace (oldest)
+    m2pwrpeer_struct    peer[M2_PARAM(PWRPEERS)];
+} m2pwr_struct;
+
+/** Header Compression (M2_FEATURE(HDRCTX))
+  * A unicast dialog frame may have a 2 byte context in place of its Source and
+  * Target IDs.  These frames have the M2FI_FRCTX frame type, and the context
+  * comes after the Address Control field:
+  * - With M2CTX_DEFINE, the IDs follow as usual, and the receiver keeps the
+  *   sender's ID under the context ID.
+  * - Without it, the IDs are left out, and the receiver takes the sender's ID
+  *   from the context it keeps.  A device that does not keep it drops the
+  *   frame.
+  * The context ID is the XOR of the m2np_idhash() of both IDs, so the peers
+  * get the same one.  A unicast request defines the context, and once a
+  * context frame has come back from the peer, the next request is compressed.
+  * A request that gets no compressed response is followed by a define again.
+  * Responses to context requests are compressed.  Devices without this
+  * feature drop context frames, so it is for networks where all devices have
+  * it.
+  */
+#ifndef M2_FEATURE_HDRCTX
+#   define M2_FEATURE_HDRCTX        DISABLED
+#endif
+#ifndef M2_PARAM_HDRCTX
+#   define M2_PARAM_HDRCTX          4
+#endif
+#define M2CTX_DEFINE                0x8000
+#define M2CTX_IDMASK                0x7FFF
+
+/// id:         context ID, 0 if the entry is free
+/// length:     length of the peer ID: 2 (VID) or 8 (UID)
+/// ready:      True once a context frame has come from the peer
+/// peer[]:     ID of the peer
+typedef struct {
+    ot_u16  id;
+    ot_u8   length;
+    ot_bool ready;
+    ot_u8   peer[8];
+} m2ctx_struct;
+
+/// rx:         True while the frame being answered was a context frame
+typedef struct {
+    ot_u8           cursor;     // next context to replace (oldest)
+    ot_bool         rx;
+    m2ctx_struct    ctx[M2_PARAM(HDRCTX)];
+} m2hc_struct;
+
+/// pending:    peer index waiting for its response, or M2_LINK_NONE
+/// autoch:     True while the top session was opened on RM2_CHAN_AUTO
+typedef struct {
+    ot_u8           pending;
+    ot_u8           cursor;     // next peer to replace (oldest)
+    ot_bool         autoch;
+    m2link_struct   peer[M2_PARAM(LINKPEERS)];
+} m2la_struct;
+
+/// code:   key used by the last frame received, and by the next one sent
+/// seq:    sequence of the next frame sent
+typedef struct {
+    ot_u8   code;
+    ot_u32  seq;
+} dlls_struct;
+
+/// code:   NLS code of new dialogs that this device requests
+/// seq:    sequence of the next frame sent
+/// hdr:    NLS header of the frame being built in txq, for m2np_footer()
+typedef struct {
+    ot_u8   code;
+    ot_u32  seq;
+    ot_u8*  hdr;
+} nls_struct;
+
+
+
+/// RAM copy of the Device IDs: ISF 0 bytes 0-1 (VID), ISF 1 bytes 0-7 (UID).
+/// It is reloaded whenever vl_idstamp no longer matches stamp.
+typedef struct {
+    ot_u16  stamp;
+    ot_u16  vid;
+    ot_u16  uid[4];
+} idcache_struct;
 
 
 typedef struct {
     routing_tmpl    rt;
     header_struct   header;
+    idcache_struct  id;
+#   if (OT_FEATURE(DLL_SECURITY))
+        dlls_struct     dlls;
+#   endif
+#   if (OT_FEATURE(NL_SECURITY))
+        nls_struct      nls;
+#   endif
+#   if (M2_FEATURE(MULTIHOP) == ENABLED)
+        m2mh_struct     mh;
+#   endif
+#   if (M2_FEATURE(DRIFT) == ENABLED)
+        m2drift_struct  drift;
+#   endif
+#   if (M2_FEATURE(LINKADAPT) == ENABLED)
+        m2la_struct     la;
+#   endif
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+        m2pwr_struct    pwr;
+#   endif
+#   if (M2_FEATURE(HDRCTX) == ENABLED)
+        m2hc_struct     hc;
+#   endif
 #   if (OT_FEATURE(M2NP_CALLBACKS) == ENABLED) 
         m2npsig_struct  signal;    
 #   endif
@@ -128,10 +452,36 @@ typedef struct {
     //ot_u16  data_total;
 } dscfg_struct;
 
+/** dswin_struct
+  * Sliding-window datastream state.  The frame ID byte of each M2DP frame is
+  * the low byte of the frame number, and frame n carries stream bytes from
+  * n*seg_bytes, so frames can land in the file in any order.
+  *
+  * mode:       M2DS_WIN_OFF, M2DS_WIN_SINK or M2DS_WIN_SOURCE
+  * isf_id:     ISF that the stream is written to (sink) or read from (source)
+  * seg_bytes:  stream bytes per frame (even)
+  * cursor:     source: window position of the next frame in this burst
+  * total:      frames in the stream
+  * base:       first frame that is not acknowledged yet
+  * map:        bit i is set when frame (base+i) is received/acknowledged
+  */
+typedef struct {
+    ot_u8   mode;
+    ot_u8   isf_id;
+    ot_u8   seg_bytes;
+    ot_u8   cursor;
+    ot_u16  total;
+    ot_u16  base;
+    ot_u32  map;
+} dswin_struct;
+
 typedef struct {
     dscfg_struct    dscfg;
     //alp_record      in_rec;
     alp_record      out_rec;
+#   if (M2_FEATURE(DSWINDOW) == ENABLED)
+        dswin_struct    win;
+#   endif
 } m2dp_struct;
 
 
@@ -165,9 +515,13 @@ void network_init();
 
 
 /** @brief  parses a background frame, namely one using M2AdvP
-  * @param  session     (m2session*) Pointer to active session
-  * @retval ot_int      -1 on ignore, non-negative on session modified/created
+  * @param  None
+  * @retval m2session*  Follow-up session, or NULL if the frame is ignored
   * @ingroup Network
+  *
+  * The top session must be the background scan that received the frame.  It
+  * is renewed in place as the follow-up session (see session_renew()), so if
+  * NULL is returned, the caller must still pop it.
   */
 m2session* network_parse_bf();
 
@@ -273,6 +627,149 @@ ot_bool m2np_idcmp(ot_int length, void* id);
 
 
 
+/** @brief  Looks for this Device's ID in a list of IDs, such as an ACK list
+  * @param  length      (ot_int) use 2 or 8 to select VID or UID
+  * @param  list        (ot_u8*) IDs, back to back, as they are sent
+  * @param  count       (ot_int) number of IDs in the list
+  * @param  sorted      (ot_bool) True if the list is in ascending byte order
+  * @retval ot_bool     True if this Device's ID is on the list
+  * @ingroup Network
+  *
+  * Same result as m2np_idcmp() on each entry, but this Device's ID is only
+  * loaded once, and a sorted list takes log2(count) compares.
+  */
+ot_bool m2np_idlist(ot_int length, ot_u8* list, ot_int count, ot_bool sorted);
+
+
+
+/** @brief  Hashes a Device ID, as it is sent (h = 33h + b)
+  * @param  length      (ot_int) use 2 or 8 to select VID or UID
+  * @param  id          (ot_u8*) device ID, or NULL for this Device's ID
+  * @retval ot_u16      hash of the ID
+  * @ingroup Network
+  *
+  * A device that hashes its own ID gets the same value as a device that hashes
+  * the ID from a frame it sent, e.g. for M2QP compressed ACK sets.
+  */
+ot_u16 m2np_idhash(ot_int length, ot_u8* id);
+
+
+
+/** @brief  Adds an RSSI sample to the neighbor table entry of a device
+  * @param  length      (ot_u8) ID length: 2 (VID) or 8 (UID)
+  * @param  id          (ot_u8*) device ID of the neighbor
+  * @param  rssi        (ot_int) RSSI of the frame from it, from radio_rssi()
+  * @retval ot_int      neighbor table index, or -1 if not kept
+  * @ingroup Network
+  *
+  * network_route_ff() calls this with the source of each addressed frame.  A
+  * new neighbor replaces the weakest entry when the table is full, but only
+  * if it is stronger.  Only available with M2_FEATURE(MULTIHOP).
+  */
+ot_int m2np_nbr_update(ot_u8 length, ot_u8* id, ot_int rssi);
+
+
+
+/** @brief  Finds the next hop towards a device in the route cache
+  * @param  dest        (id_tmpl*) ID of the destination
+  * @param  nexthop     (id_tmpl*) output: ID of the neighbor to send to
+  * @retval ot_bool     True if there is a route
+  * @ingroup Network
+  *
+  * A gateway can use this to unicast a routed request (DEST = dest) to the
+  * right neighbor, rather than anycast it.  nexthop.value points into the
+  * neighbor table.  Only available with M2_FEATURE(MULTIHOP).
+  */
+ot_bool m2np_route_nexthop(id_tmpl* dest, id_tmpl* nexthop);
+
+
+
+/** @brief  Adds the arrival of an advertised request to the drift tracking
+  * @param  arrival     (ot_int) ti from the session start to the request frame,
+  *                     or -1 if the request did not come in the window
+  * @retval none
+  * @ingroup Network
+  *
+  * network_parse_bf() sets up the pending sample when it opens the session for
+  * the request of a flood, and the kernel calls this when that session gets a
+  * good frame or times out.  It does nothing if there is no pending sample.
+  * Only available with M2_FEATURE(DRIFT).
+  */
+void m2np_drift_sample(ot_int arrival);
+
+
+
+/** @brief  Picks the channel for a request, from the link quality of the peer
+  * @param  peer        (id_tmpl*) ID of the unicast target, or NULL
+  * @retval ot_u8       channel ID
+  * @ingroup Network
+  *
+  * The kernel calls this for sessions opened on RM2_CHAN_AUTO.  With a peer,
+  * the peer gets an entry (if it has none) and it becomes the pending peer,
+  * whose responses and losses are tracked.  Without one, there is no pending
+  * peer, and the channel is the most robust level of the known peers.  Only
+  * available with M2_FEATURE(LINKADAPT).
+  */
+ot_u8 m2np_link_channel(id_tmpl* peer);
+
+
+
+/** @brief  Adds a good response to the link quality of its sender
+  * @param  length      (ot_u8) ID length: 2 (VID) or 8 (UID)
+  * @param  id          (ot_u8*) device ID of the sender
+  * @param  rssi        (ot_int) RSSI of the frame, from radio_rssi()
+  * @retval none
+  * @ingroup Network
+  *
+  * network_route_ff() calls this with the source of each addressed frame.
+  * Only peers that have an entry are updated.  Only available with
+  * M2_FEATURE(LINKADAPT).
+  */
+void m2np_link_update(ot_u8 length, ot_u8* id, ot_int rssi);
+
+
+
+/** @brief  Adds a loss to the link quality of the pending peer
+  * @param  timeout     (ot_bool) True when the last response window is over
+  * @retval none
+  * @ingroup Network
+  *
+  * The kernel calls this on a frame with a bad CRC, and when a response
+  * window ends.  The window of the last redundant request also ends the wait
+  * for the pending peer.  It does nothing if there is no pending peer.  Only
+  * available with M2_FEATURE(LINKADAPT).
+  */
+void m2np_link_loss(ot_bool timeout);
+
+
+
+/** @brief  Adds a frame to the path loss of its sender, and sets the response EIRP
+  * @param  length      (ot_u8) ID length: 2 (VID) or 8 (UID)
+  * @param  id          (ot_u8*) device ID of the sender
+  * @param  eirp        (ot_u8) TX EIRP field of the frame
+  * @param  rssi        (ot_int) RSSI of the frame, from radio_rssi()
+  * @retval none
+  * @ingroup Network
+  *
+  * network_route_ff() calls this with the source of each addressed frame.  It
+  * sets dll.comm.tx_eirp from the loss of this frame, for the response.  Only
+  * available with M2_FEATURE(AUTOSCALE).
+  */
+void m2np_pwr_update(ot_u8 length, ot_u8* id, ot_u8 eirp, ot_int rssi);
+
+
+
+/** @brief  Gives the TX EIRP to use for a request to a peer
+  * @param  peer        (id_tmpl*) ID of the unicast target, or NULL
+  * @retval ot_u8       eirp code for dll.comm.tx_eirp (M2_PWR_FULL if none)
+  * @ingroup Network
+  *
+  * Only available with M2_FEATURE(AUTOSCALE).
+  */
+ot_u8 m2np_pwr_eirp(id_tmpl* peer);
+
+
+
 
 
 
@@ -334,6 +831,35 @@ ot_int m2advp_init_flood(m2session* session, ot_u16 schedule);
 
 
 
+/** @brief  Moves the TX Queue onto the flood frame that is already prepared
+  * @param  none
+  * @retval none
+  * @ingroup Network
+  * @sa m2advp_update()
+  *
+  * Flood frames are double-buffered.  The radio driver calls this as soon as
+  * a frame has been loaded, so the next frame (with its ETA and CRC already
+  * computed) can go to the radio right away.  The frame has its CRC, so the 
+  * CRC option of the TX Queue is cleared.
+  */
+void m2advp_swap();
+
+
+
+/** @brief  Prepares the flood frame that follows the one in the TX Queue
+  * @param  eta         (ot_u16) ticks from the start of the frame to the end
+  *                     of the flood
+  * @retval none
+  * @ingroup Network
+  * @sa m2advp_swap()
+  *
+  * Only the ETA bytes and the CRC are written.  The CRC is continued from the
+  * CRC of the constant part of the frame, which is kept by m2advp_init_flood().
+  */
+void m2advp_update(ot_u16 eta);
+
+
+
 
 
 
@@ -401,6 +927,76 @@ void m2dp_dsproc();
 
 
 
+/** Sliding-Window Datastreams
+  * ========================================================================<BR>
+  * With M2_FEATURE(DSWINDOW), a datastream can run with many frames in flight.
+  * The source sends a burst of up to M2_PARAM_DSWINDOW frames, the sink writes
+  * each good frame straight into its ISF and replies with one selective ACK
+  * (a DS ACK request carrying the window base and bitmap), and the source then
+  * re-sends only the frames the bitmap is missing, along with new ones.
+  */
+
+/** @brief  Opens a datastream sink, which writes received frames to an ISF
+  * @param  isf_id      (ot_u8) ISF to write the stream into
+  * @param  seg_bytes   (ot_u8) stream bytes per frame (must be even)
+  * @param  total       (ot_u16) number of frames in the stream
+  * @retval none
+  * @ingroup Network
+  */
+void m2dp_sink_open(ot_u8 isf_id, ot_u8 seg_bytes, ot_u16 total);
+
+
+/** @brief  Opens a datastream source, which reads frames from an ISF
+  * @param  isf_id      (ot_u8) ISF to send as the stream
+  * @param  seg_bytes   (ot_u8) stream bytes per frame (must be even)
+  * @retval ot_u16      number of frames in the stream, 0 on error
+  * @ingroup Network
+  */
+ot_u16 m2dp_source_open(ot_u8 isf_id, ot_u8 seg_bytes);
+
+
+/** @brief  Loads the next frame of the current burst into the TX queue
+  * @param  session     (m2session*) Pointer to active session
+  * @retval ot_int      frame number loaded, or -1 when the burst is done
+  * @ingroup Network
+  *
+  * Frames already acknowledged are skipped, so after an ACK a burst contains
+  * the missing frames followed by new frames that fit in the window.
+  */
+ot_int m2dp_source_next(m2session* session);
+
+
+/** @brief  Reads a selective ACK and slides the source window
+  * @param  ackq        (Queue*) queue with the cursor on the ACK base field
+  * @retval ot_bool     True when the whole stream is acknowledged
+  * @ingroup Network
+  */
+ot_bool m2dp_source_ack(Queue* ackq);
+
+
+/** @brief  Moves the window of a sliding-window stream that is resumed
+  * @param  base        (ot_u16) first frame that is not acknowledged yet
+  * @param  map         (ot_u32) frames after base that are in already
+  * @retval none
+  * @ingroup Network
+  *
+  * A sink that has some of the stream from before starts at its first missing
+  * frame.  The source then seeks to the same frame, which the sink reports
+  * (an ACK only moves the source window ahead by M2_PARAM_DSWINDOW at most).
+  */
+void m2dp_win_seek(ot_u16 base, ot_u32 map);
+
+
+/** @brief  Closes the sliding-window stream (sink or source)
+  * @param  none
+  * @retval none
+  * @ingroup Network
+  */
+void m2dp_win_close();
+
+
+
+
 
 
 #endif
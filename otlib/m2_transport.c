@@ -31,6 +31,7 @@
 
 #include "alp.h"
 #include "buffers.h"
+#include "crc16.h"
 #include "external.h"
 #include "queue.h"
 #include "system.h"
@@ -38,11 +39,15 @@
 #include "veelite.h"
 
 
-// Sneaky stashing for internal data
-// It overwrites part of the rxq that isn't used for comp & call commands
-#define LOCAL_U8(OFFSET)    rxq.front[rxq.alloc-32+(OFFSET)]
-#define LOCAL_U16(OFFSET)   *((ot_u16*)&rxq.front[rxq.alloc-32+(OFFSET)])
-#define LOCAL_U32(OFFSET)   *((ot_u32*)&rxq.front[rxq.alloc-32+(OFFSET)])
+// Comparison data, in the query block from the scratch pool (see sub_isf_comp)
+#define LOCAL_U8(OFFSET)    m2qp.qbuf[(OFFSET)]
+
+// Mask for queries that do not supply one
+static const ot_u8 sub_nomask[BUF_SCRATCH_QUERYSIZE] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
 // Argument Shortcut for some callbacks
 #if (OT_FEATURE(M2QP_CALLBACKS) == ENABLED)
@@ -87,6 +92,16 @@
 #   define M2QP_CALLBACK(VAL)   False
 #endif
 
+// Standard and A2P responses go to the host by themselves, with the callback
+// only when they cannot be forwarded (see OT_FEATURE_RESPFWD)
+#if ((OT_FEATURE(RESPFWD) == ENABLED) && \
+    ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED)))
+#   define M2QP_RESPONSE(VAL)   (sys_respfwd_put(SYS_FWD_##VAL, m2np.rt.dlog.length, m2np.rt.dlog.value, \
+                                    (ot_int)(rxq.back-rxq.getcursor), rxq.getcursor) ? False : M2QP_CALLBACK(VAL))
+#else
+#   define M2QP_RESPONSE(VAL)   M2QP_CALLBACK(VAL)
+#endif
+
 
 
 
@@ -99,34 +114,315 @@
 m2qp_struct m2qp;
 
 
+/** Query cache:
+  * Results of recent ISF comparisons.  The hash covers the query template,
+  * the ISF target and the requester ID.  The stamp is (vl_writestamp + 
+  * vl_mapstamp) when the result was computed, so an entry is only good while
+  * no file has changed since.
+  */
+#if (M2_PARAM(QCACHE) > 0)
+typedef struct {
+    ot_u16  hash;       // 0 when the entry is unused
+    ot_u16  stamp;
+    ot_int  score;
+    ot_u8   comp_id;
+    ot_u8   code;
+} qcache_entry;
+
+typedef struct {
+    ot_int          next;
+    qcache_entry    entry[M2_PARAM(QCACHE)];
+} qcache_struct;
+
+qcache_struct qcache;
+#endif
+
+
+/** Query pair:
+  * An initial multicast request has a global and a local query on the same
+  * comparison template, so sub_isf_comp_pair() scores both in one pass over
+  * the data.  The loaders work on m2qp.qtmpl, m2qp.corr and m2qp.qbuf, so 
+  * the query that is not being fed waits here, and sub_query_swap() trades 
+  * it in for its turn.  The local query has its own part of the query block,
+  * after the global query's part.
+  *
+  * tmpl, corr  the waiting query
+  * load[]      load function of the global [0] and local [1] queries
+  * window[]    bytes of the data window each query takes
+  * score[]     running score from each load function
+  * turn        1 while the local query is swapped in
+  */
+typedef struct {
+    query_tmpl  tmpl;
+    corr_data   corr;
+    m2qp_loadfn load[2];
+    ot_int      window[2];
+    ot_int      score[2];
+    ot_u8       turn;
+} qpair_struct;
+
+static qpair_struct qpair;
+
+
+/** Differential collection tag cache:
+  * The last window that this requester got from each of a few tags, with the
+  * call that returned it (M2OP_COL_DF and M2OP_COL_DS requests only).
+  *
+  * call        is_series, ISF ID and offset of the ISF Call Template, as
+  *             made by sub_diff_call()
+  * tag[]       ID of the tag (UID or VID)
+  * tag_length  bytes in tag[], 0 if the entry is empty
+  * length      bytes in data[]
+  * data[]      the window
+  *
+  * sent is the entry that the check of the last request was made from 
+  * (M2_PARAM_DIFFTAGS if none), and next is the entry that is replaced next.
+  */
+#define M2QP_DIFFCACHE  ((M2_FEATURE(DIFFCOLLECT) == ENABLED) && \
+                        ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED)))
+
+#if (M2QP_DIFFCACHE)
+typedef struct {
+    ot_u32  call;
+    ot_u8   tag[8];
+    ot_u8   tag_length;
+    ot_u8   length;
+    ot_u8   data[M2_PARAM(DIFFBYTES)];
+} difftag_struct;
+
+typedef struct {
+    ot_u8           sent;
+    ot_u8           next;
+    difftag_struct  entry[M2_PARAM(DIFFTAGS)];
+} diffcache_struct;
+
+static diffcache_struct diffcache;
+#endif
+
+
+/** ISF Call members:
+  * m2qp_isf_call() resolves each file of the called series once (ID, length,
+  * and where its data is), which also checks the read permission.  The return
+  * header and the data window are both made from the array.  data points to
+  * the file data when it can be read in place, and otherwise it is NULL, and
+  * base is the VWORM address of the data.
+  */
+typedef struct {
+    ot_u8           id;
+    ot_u8           length;
+    vaddr           base;
+    const ot_u8*    data;
+} isfcall_member;
+
+
 
 /** @brief Subroutine for use with m2qp_load_isf(): Loads arithmetic comparison.
   * @param cursor       (ot_int*)   Used by m2qp_load_isf()
-  * @param data_byte    (ot_u8)     One byte of data to load (and process)
+  * @param span         (const ot_u8*) Span of data to load (and process)
+  * @param length       (ot_int)    Number of bytes in the span
   * @retval ot_int      always returns 0
   */
-ot_int sub_load_comparison(ot_int* cursor, ot_u8 data_byte);
+ot_int sub_load_comparison(ot_int* cursor, const ot_u8* span, ot_int length);
 
 /** @brief Subroutine for use with m2qp_load_isf(): Performs string token search.
   * @param cursor       (ot_int*)   Used by m2qp_load_isf()
-  * @param data_byte    (ot_u8)     One byte of data to load (and process)
-  * @retval ot_int      returns 1 if there is a match, 0 if no match
+  * @param span         (const ot_u8*) Span of data to load (and process)
+  * @param length       (ot_int)    Number of bytes in the span
+  * @retval ot_int      number of passing windows that end in the span
+  */
+ot_int sub_load_charcorrelation(ot_int* cursor, const ot_u8* span, ot_int length);
+
+/** @brief Sets up m2qp.corr for a new run of sub_load_charcorrelation()
+  * @param none
+  * @retval none
+  */
+void sub_init_charcorrelation();
+
+/** @brief Horspool shift for a window whose newest byte is data_byte
+  * @param data_byte    (ot_u8)     Newest byte of the window
+  * @retval ot_int      Number of windows to advance (1 to token length)
+  */
+ot_int sub_charcorrelation_shift(ot_u8 data_byte);
+
+/** @brief Runs the comparison that m2qp_isf_comp() has set up
+  * @param is_series    (ot_u8)     0 is for ISF Comp, non-zero for ISFS Comp
+  * @param user_id      (id_tmpl*)  User ID that is trying to read the data
+  * @retval ot_int      Same as m2qp_isf_comp()
+  */
+ot_int sub_isf_comp(ot_u8 is_series, id_tmpl* user_id);
+
+/** @brief Finds the tag cache entry of a differential collection call
+  * @param call         (ot_u32)    the call, from sub_diff_call()
+  * @param tag          (id_tmpl*)  ID of the tag, or NULL for any tag
+  * @retval ot_int      entry index, or M2_PARAM(DIFFTAGS) if there is none
+  */
+ot_int sub_diff_find(ot_u32 call, id_tmpl* tag);
+
+/** @brief Restores the window of an unchanged differential collection 
+  *        response in rxq, and keeps the window of the responder
+  * @param is_series    (ot_u8)     0 for M2OP_COL_DF, 1 for M2OP_COL_DS
+  * @retval none
+  */
+void sub_diff_response(ot_u8 is_series);
+
+/** @brief Marks the response in txq as packed, and holds room for packing
+  *        off the back of txq while the window is loaded
+  * @param none
+  * @retval ot_int      the room held, for sub_pack_end()
+  */
+ot_int sub_pack_begin(void);
+
+/** @brief Packs the data window of the response in txq
+  * @param data         (ot_u8*)    start of the window in txq
+  * @param margin       (ot_int)    from sub_pack_begin()
+  * @param nack         (ot_int)    nack of the call (no packing if non-zero)
+  * @retval none
+  */
+void sub_pack_end(ot_u8* data, ot_int margin, ot_int nack);
+
+/** @brief Unpacks the data window of a packed collection response in rxq
+  * @param is_series    (ot_u8)     non-zero for an ISF Series Return Template
+  * @retval ot_bool     False if the packed data is not good
+  */
+ot_bool sub_pack_response(ot_u8 is_series);
+
+/** @brief Ends the pipelined dialog of a unicast response that is parsed
+  * @param session      (m2session*) the session of the response
+  * @retval none
+  */
+void sub_pipe_done(m2session* session);
+
+/** @brief Puts the responder of an A2P response into the inventory tag set
+  * @param none
+  * @retval none
+  */
+void sub_inv_tag(void);
+
+/** @brief Builds the request of the next inventory round and starts it
+  * @param none
+  * @retval ot_bool     False if the session could not be made
+  */
+ot_bool sub_inv_round(void);
+
+/** @brief sub_isf_comp() once it has the query block (m2qp.qbuf)
+  * @param is_series    (ot_u8)     0 is for ISF Comp, non-zero for ISFS Comp
+  * @param user_id      (id_tmpl*)  User ID that is trying to read the data
+  * @retval ot_int      Same as m2qp_isf_comp()
+  */
+ot_int sub_isf_score(ot_u8 is_series, id_tmpl* user_id);
+
+/** @brief Picks the load function and data window of the loaded query
+  * @param load_function (m2qp_loadfn*) Output, load function of the query
+  * @retval ot_int      Bytes of data the query takes
+  */
+ot_int sub_query_setup(m2qp_loadfn* load_function);
+
+/** @brief Turns the score of the load function into the query result
+  * @param score        (ot_int)    Sum of returns from the load function
+  * @retval ot_int      Same as m2qp_isf_comp()
+  */
+ot_int sub_query_result(ot_int score);
+
+/** @brief Checks the loaded query against the summary of the compared file
+  * @param is_series    (ot_u8)     0 is for ISF Comp, non-zero for ISFS Comp
+  * @retval ot_bool     True if the query cannot pass on the file data
+  */
+ot_bool sub_query_reject(ot_u8 is_series);
+
+/** @brief Trades the query in m2qp.qtmpl with the waiting one in qpair
+  * @param none
+  * @retval none
+  */
+void sub_query_swap();
+
+/** @brief Runs the global query and then the local query of a query pair
+  * @param is_series    (ot_u8)     0 is for ISF Comp, non-zero for ISFS Comp
+  * @param user_id      (id_tmpl*)  User ID that is trying to read the data
+  * @param local_score  (ot_int*)   Output, local query result (if global passes)
+  * @retval ot_int      Global query result, same as m2qp_isf_comp()
+  */
+ot_int sub_isf_comp_pair(ot_u8 is_series, id_tmpl* user_id, ot_int* local_score);
+
+/** @brief Scores both queries of a pair in one pass over the data
+  * @param is_series    (ot_u8)     0 is for ISF Comp, non-zero for ISFS Comp
+  * @param user_id      (id_tmpl*)  User ID that is trying to read the data
+  * @param local_score  (ot_int*)   Output, local query result
+  * @retval ot_int      Global query result, same as m2qp_isf_comp()
+  */
+ot_int sub_isf_score_pair(ot_u8 is_series, id_tmpl* user_id, ot_int* local_score);
+
+/** @brief Subroutine for use with m2qp_load_isf(): Feeds both queries of a pair
+  * @param cursor       (ot_int*)   Used by m2qp_load_isf()
+  * @param span         (const ot_u8*) Span of data to load (and process)
+  * @param length       (ot_int)    Number of bytes in the span
+  * @retval ot_int      always returns 0 (scores go to qpair.score[])
   */
-ot_int sub_load_charcorrelation(ot_int* cursor, ot_u8 data_byte);
+ot_int sub_load_pair(ot_int* cursor, const ot_u8* span, ot_int length);
+
+/** @brief m2qp_isf_comp(), once the comparison template has been read
+  * @param is_series    (ot_u8)     0 is for ISF Comp, non-zero for ISFS Comp
+  * @param user_id      (id_tmpl*)  User ID that is trying to read the data
+  * @retval ot_int      Same as m2qp_isf_comp()
+  */
+ot_int sub_isf_cached(ot_u8 is_series, id_tmpl* user_id);
+
+/** @brief Hashes the loaded query, ISF target and requester for the cache
+  * @param is_series    (ot_u8)     0 is for ISF Comp, non-zero for ISFS Comp
+  * @param user_id      (id_tmpl*)  User ID that is trying to read the data
+  * @retval ot_u16      Non-zero hash value
+  */
+ot_u16 sub_qcache_hash(ot_u8 is_series, id_tmpl* user_id);
+
+#if (M2_PARAM(QCACHE) > 0)
+/** @brief Finds the cached result of the loaded query, if it is still good
+  * @param hash         (ot_u16)    Hash from sub_qcache_hash()
+  * @retval qcache_entry* Cache entry, or NULL if there is none
+  */
+qcache_entry* sub_qcache_find(ot_u16 hash);
+
+/** @brief Saves the result of the loaded query over the oldest cache entry
+  * @param hash         (ot_u16)    Hash from sub_qcache_hash()
+  * @param score        (ot_int)    Result of the query
+  * @retval none
+  */
+void sub_qcache_put(ot_u16 hash, ot_int score);
+#endif
+
+/** @brief Resolves the files called by an ISF or ISFS Call Template
+  * @param member       (isfcall_member*) Output, M2_PARAM(ISFSCALL) entries
+  * @param is_series    (ot_u8)     0 is for ISF Call, non-zero for ISFS Call
+  * @param isf_id       (ot_u8)     ID of the ISF or ISFS
+  * @param user_id      (id_tmpl*)  User ID that is trying to read the data
+  * @retval ot_int      Number of members, or negative if not accessible
+  */
+ot_int sub_isfcall_resolve(isfcall_member* member, ot_u8 is_series, ot_u8 isf_id, id_tmpl* user_id);
+
+/** @brief Gives a window of the resolved files' data to a load function
+  * @param member       (isfcall_member*) Members from sub_isfcall_resolve()
+  * @param n_members    (ot_int)    Number of members
+  * @param offset       (ot_int)    Byte offset into the data of the members
+  * @param window_bytes (ot_int)    Number of bytes to process
+  * @param load_function (m2qp_loadfn) Processing function
+  * @retval ot_int      A running sum of returns from the processing function
+  */
+ot_int sub_isfcall_load(isfcall_member* member, ot_int n_members, ot_int offset, 
+                        ot_int window_bytes, m2qp_loadfn load_function);
 
 /** @brief Subroutine for use with m2qp_load_isf(): Loads return template
   * @param cursor       (ot_int*)   Used by m2qp_load_isf()
-  * @param data_byte    (ot_u8)     One byte of data to load (and process)
+  * @param span         (const ot_u8*) Span of data to load (and process)
+  * @param length       (ot_int)    Number of bytes in the span
   * @retval ot_int      always returns 0
   */
-ot_int sub_load_return(ot_int* cursor, ot_u8 data_byte);
+ot_int sub_load_return(ot_int* cursor, const ot_u8* span, ot_int length);
 
 /** @brief Subroutine for use with m2qp_load_isf(): Does nothing
   * @param cursor       (ot_int*)   Used by m2qp_load_isf()
-  * @param data_byte    (ot_u8)     One byte of data to load (and process)
+  * @param span         (const ot_u8*) Span of data to load (and process)
+  * @param length       (ot_int)    Number of bytes in the span
   * @retval ot_int      always returns 0
   */
-ot_int sub_load_nonnull(ot_int* cursor, ot_u8 data_byte);
+ot_int sub_load_nonnull(ot_int* cursor, const ot_u8* span, ot_int length);
 
 
 
@@ -177,7 +473,8 @@ ot_u16 otapi_put_dialog_tmpl(ot_u8* status, dialog_tmpl* dialog) {
     else {
         // Calculate actual timeout and write timeout code field
         dll.comm.rx_timeout = otutils_calc_timeout(dialog->timeout);
-        dialog->timeout    |= (dialog->channels != 0) ? 0 : 0x80;
+        dialog->timeout    &= 0x7F;
+        dialog->timeout    |= (dialog->channels != 0) ? 0x80 : 0;
         q_writebyte(&txq, dialog->timeout);
     
         // Write response list
@@ -348,7 +645,9 @@ typedef void (*m2qp_subproc)(void);
 
 void    sub_opgroup_null(void);
 void    sub_opgroup_shell(void);
+void    sub_alpshell(void);
 void    sub_opgroup_collection(void);
+void    sub_opgroup_diffcollection(void);
 void    sub_opgroup_datastream(void);
 void    sub_ack_datastream(void);
 void    sub_opgroup_rfu(void);
@@ -357,7 +656,10 @@ ot_int  sub_parse_response(m2session* session);
 ot_int  sub_parse_error(m2session* session);
 ot_int  sub_parse_request(m2session* session);
 void    sub_renack(ot_int nack);
-void    sub_load_query();
+ot_bool sub_ack_room(void);
+void    sub_ack_put(void);
+void    sub_ack_insert(void);
+void    sub_load_query(query_tmpl* qtmpl);
 ot_int  sub_process_query(m2session* session);
 
 
@@ -370,6 +672,14 @@ ot_bool m2qp_sigresp_null(id_tmpl* responder_id, ot_int payload_length, ot_u8* p
 
 #ifndef EXTF_m2qp_init
 void m2qp_init() {
+#if (M2QP_PIPELINE)
+    platform_memset((ot_u8*)&m2qp.pipe, 0, sizeof(pipe_data));
+#endif
+#if (M2QP_INVENTORY)
+    m2qp.inv.state  = M2_INV_OFF;
+    m2qp.inv.length = 8;
+    m2qp.inv.count  = 0;
+#endif
 #if (OT_FEATURE(M2QP_CALLBACKS) == ENABLED)
     ///@todo udp shell request callback
     
@@ -425,13 +735,41 @@ ot_int sub_parse_response(m2session* session) {
 /// or 5-way datastream session.
     ot_u8   test;
     ot_u8   cmd_opcode;
+#   if (M2_FEATURE(PACK) == ENABLED)
+    ot_u8   ext;
+#   endif
 
     /// Make sure response command opcode matches the last request's opcode
     /// (this ensures that the response is to our request).
     cmd_opcode  = m2qp.cmd.code & 0x0F;
-    test        = q_readbyte(&rxq) & 0x0F;  
+    test        = q_readbyte(&rxq);
+#   if (M2_FEATURE(PACK) == ENABLED)
+    ext         = (test & 0x80) ? q_readbyte(&rxq) : 0;
+#   endif
+    test       &= 0x0F;
     
     if (test == cmd_opcode) {
+        SYS_TRACE(SYS_TRACE_RESP, cmd_opcode);
+#       if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+        sys_dialog_response(session->dialog_id, False);
+#       endif
+#       if (OT_FEATURE(RXTUNE) == ENABLED)
+        sys_rxtune_response();
+#       endif
+#       if (M2_FEATURE(PACK) == ENABLED)
+            /// Packed collection: unpack the window in place
+            if ((ext & M2CE_PACK) && \
+                ((ot_u8)(cmd_opcode - M2OP_COL_FF) <= (M2OP_COL_DS - M2OP_COL_FF)) && \
+                (sub_pack_response(cmd_opcode & 1) == False)) {
+                return -1;
+            }
+#       endif
+#       if (M2QP_DIFFCACHE)
+            /// Differential collection: restore an unchanged window
+            if ((cmd_opcode & ~1) == M2OP_COL_DF) {
+                sub_diff_response(cmd_opcode & 1);
+            }
+#       endif
 #       if ((M2_FEATURE(DATASTREAM) == ENABLED) && (OT_FEATURE(ALP) == ENABLED))
             /// Manage Responses to Request and Propose Datastream
             if ((cmd_opcode - M2OP_DS_REQUEST) <= 1) {
@@ -451,7 +789,7 @@ ot_int sub_parse_response(m2session* session) {
                 return (ot_int)test;
             }
 #           if (OT_FEATURE(M2QP_CALLBACKS) == ENABLED)
-            else if (cmd_opcode == 10) {
+            else if (cmd_opcode == M2OP_DS_ACK) {
             	test = (ot_u8)M2QP_CALLBACK(DSACK);
                 if ( test ) {
                     ///@todo Prepare the next stream packet
@@ -459,12 +797,10 @@ ot_int sub_parse_response(m2session* session) {
                 return (ot_int)test;
             }
 #           endif
-            else if (((m2qp.cmd.code & 0x60) == 0x40) && \
-                    ((txq.back - txq.putcursor) > 48) )
+            else if (((m2qp.cmd.code & 0x60) == 0x40) && sub_ack_room())
 
 #       else //((M2_FEATURE(DATASTREAM) == ENABLED) && (OT_FEATURE(ALP) == ENABLED))
-        if (((m2qp.cmd.code & 0x60) == 0x40) && \
-            ((txq.back - txq.putcursor) > 48) )
+        if (((m2qp.cmd.code & 0x60) == 0x40) && sub_ack_room())
 #       endif
         
         /// If using A2P, put this responder's ID onto the ACK chain        <BR>
@@ -474,15 +810,29 @@ ot_int sub_parse_response(m2session* session) {
         {
             ///@todo check to make sure NumACKs is 0 on 1st run (might be done)
             ///@todo Might put in some type of return scoring, later
-            txq.getcursor[0]++;
-            q_writestring(&txq, m2np.rt.dlog.value, m2np.rt.dlog.length);
-            test = (ot_u8)M2QP_CALLBACK(A2P);
+#           if (M2QP_INVENTORY)
+            if (m2qp.inv.state == M2_INV_ROUND) {
+                sub_inv_tag();
+            }
+            else
+#           endif
+            sub_ack_put();
+#           if (M2_FEATURE(FSACOLLECT) == ENABLED)
+            if ((m2qp.fsa.good != 255) && \
+                ((m2qp.cmd.ext & M2CE_CA_MASK) == M2CE_CA_FSA)) {
+                m2qp.fsa.good++;
+            }
+#           endif
+            test = (ot_u8)M2QP_RESPONSE(A2P);
         }
         
         /// If nothing else, the response is a normal response (NA2P), so run
         /// the callback as normal
         else {
-            test = (ot_u8)M2QP_CALLBACK(STANDARD);
+            test = (ot_u8)M2QP_RESPONSE(STANDARD);
+#           if (M2QP_PIPELINE)
+            sub_pipe_done(session);
+#           endif
         }
         
         /// Make into 0/-1 form for returning
@@ -497,6 +847,12 @@ ot_int sub_parse_response(m2session* session) {
 ot_int sub_parse_error(m2session* session) {
 /// Forwards error payload to a callback.  
 /// Deciding what to do with the error data is a job for the Application Layer
+#   if (OT_FEATURE(DIALOG_CALLBACKS) == ENABLED)
+    sys_dialog_response(session->dialog_id, True);
+#   endif
+#   if (OT_FEATURE(RXTUNE) == ENABLED)
+    sys_rxtune_response();
+#   endif
     return (ot_int)M2QP_CALLBACK(ERROR);
 }
 #endif
@@ -504,6 +860,112 @@ ot_int sub_parse_error(m2session* session) {
 
 
 
+
+#if (M2_FEATURE(ACKBLOOM) == ENABLED)
+ot_bool sub_ackbloom(ot_u8* filter, ot_u8 size, ot_u16 hash, ot_bool add) {
+/// Double hashing: probe i is filter bit (start + i*step), both mixed from the
+/// ID hash.  Returns True if all the bits were set already.  With add, the
+/// bits are also set.
+    ot_uint bitmask = (8 << size) - 1;
+    ot_uint step    = ((hash >> 8) ^ (hash << 3)) | 1;
+    ot_bool found   = True;
+    ot_int  i;
+    
+    hash ^= (hash >> 8);
+    for (i=0; i<M2_PARAM(ACKBLOOM_K); i++, hash+=step) {
+        ot_uint bit     = hash & bitmask;
+        ot_u8   mask    = (1 << (bit & 7));
+        
+        if ((filter[bit >> 3] & mask) == 0) {
+            found = False;
+        }
+        if (add) {
+            filter[bit >> 3] |= mask;
+        }
+    }
+    return found;
+}
+#endif
+
+
+#if ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED))
+ot_bool sub_ack_room(void) {
+/// An ACK list needs room for another ID, with 48 bytes kept for query data.  
+/// An ACK set is always in the request already.
+#   if (M2_FEATURE(ACKBLOOM) == ENABLED)
+    if (txq.getcursor[0] & M2_ACKBLOOM) {
+        return True;
+    }
+#   endif
+#   if (M2_FEATURE(ACKSORT) == ENABLED)
+    if ((txq.getcursor[0] & M2_ACKSORT_COUNTMASK) == M2_ACKSORT_COUNTMASK) {
+        return False;
+    }
+#   endif
+    return (ot_bool)((txq.back - txq.putcursor) > 48);
+}
+
+
+void sub_ack_put(void) {
+/// Put the responder on the ACK chain: set its bits in an ACK set, or write
+/// its ID onto an ACK list.  txq.getcursor is at the ACK field.
+#   if (M2_FEATURE(ACKBLOOM) == ENABLED)
+    if (txq.getcursor[0] & M2_ACKBLOOM) {
+        ot_u8 size = txq.getcursor[0] & M2_ACKBLOOM_SIZEMASK;
+        if (txq.getcursor[1] != 255) {
+            txq.getcursor[1]++;
+        }
+        sub_ackbloom(&txq.getcursor[2], size, \
+                    m2np_idhash(m2np.rt.dlog.length, m2np.rt.dlog.value), True);
+        return;
+    }
+#   endif
+#   if (M2_FEATURE(ACKSORT) == ENABLED)
+    if (txq.getcursor[0] & M2_ACKSORT) {
+        sub_ack_insert();
+        return;
+    }
+#   endif
+    txq.getcursor[0]++;
+    q_writestring(&txq, m2np.rt.dlog.value, m2np.rt.dlog.length);
+}
+
+
+#if (M2_FEATURE(ACKSORT) == ENABLED)
+void sub_ack_insert(void) {
+/// The list is at the end of the TX queue.  The new ID is written at the end,
+/// and then moved down to its place in byte order.  An ID that is already on
+/// the list is not added again.
+    ot_int  length  = m2np.rt.dlog.length;
+    ot_int  count   = txq.getcursor[0] & M2_ACKSORT_COUNTMASK;
+    ot_u8*  id      = m2np.rt.dlog.value;
+    ot_u8*  place   = &txq.getcursor[1];
+    ot_u8*  cursor;
+    ot_int  i;
+    
+    for (; count > 0; count--, place+=length) {
+        for (i=0; (i<length) && (place[i] == id[i]); i++);
+        if (i == length) {
+            return;
+        }
+        if (place[i] > id[i]) {
+            break;
+        }
+    }
+    
+    txq.getcursor[0]++;
+    q_writestring(&txq, id, length);
+    for (cursor=(txq.putcursor-length-1); cursor>=place; cursor--) {
+        cursor[length] = cursor[0];
+    }
+    platform_memcpy(place, id, length);
+}
+#endif
+#endif
+
+
+
+
 ot_int sub_parse_request(m2session* session) {
     ot_int  score   = 0;
     ot_u8   cmd_opcode;
@@ -514,9 +976,17 @@ ot_int sub_parse_request(m2session* session) {
     ///     - Load NA2P or A2P dialog type from command code
     m2qp.cmd.code           = q_readbyte(&rxq);
     m2qp.cmd.ext            = (m2qp.cmd.code & 0x80) ? q_readbyte(&rxq) : 0;
+#   if (OT_FEATURE(NETSYNC) == ENABLED)
+    if (m2qp.cmd.ext & M2CE_NETTIME) {
+        sys_netsync_set( q_readlong(&rxq) );
+    }
+#   endif
     dll.comm.csmaca_params  = m2qp.cmd.ext & (M2_CSMACA_CAMASK | M2_CSMACA_NOCSMA);
     dll.comm.csmaca_params |= m2qp.cmd.code & M2_CSMACA_ARBMASK;
     cmd_opcode              = m2qp.cmd.code & M2OP_MASK;
+#   if (M2_FEATURE(FSACOLLECT) == ENABLED)
+    m2qp.fsa.seed           = 0;
+#   endif
     
     /// 2.  All Requests contain the dialog template, so load it.           <BR>
     ///     - [ num resp channels ] [ list of resp channels]                <BR>
@@ -540,13 +1010,22 @@ ot_int sub_parse_request(m2session* session) {
     /// 3. Handle Command Queries (filtering)                               <BR>
     /// Multicast and anycast addressed requests include queries
     if (m2np.header.addr_ctl & 0x80) {
+#       if (OT_FEATURE(PROFILER) == ENABLED)
+        ot_u32 mark = platform_get_cycles();
+        score       = sub_process_query(session);
+        sys_profile_log(SYS_PROFILE_QUERY, mark);
+#       else
         score = sub_process_query(session);
+#       endif
     }
     
     /// 4. If the query is good (sometimes this is trivial):                <BR>
     ///    - Prepare the response header (same for all responses)           <BR>
     ///    - Run command-specific dialog data processing
     if (score >= 0) {
+#       if (OT_FEATURE(PROFILER) == ENABLED)
+        ot_u32 mark = platform_get_cycles();
+#       endif
         q_empty(&txq); // Flush TX Queue
     
         if (m2qp.cmd.ext & M2CE_NORESP) {
@@ -568,10 +1047,13 @@ ot_int sub_parse_request(m2session* session) {
             case 2: sub_opgroup_shell();        break;
             case 3:
             case 4: sub_opgroup_collection();   break;
-            case 5: break;
+            case 5: sub_opgroup_diffcollection(); break;
             case 6: sub_opgroup_datastream();   break;
             case 7: sub_ack_datastream();       break;
         }
+#       if (OT_FEATURE(PROFILER) == ENABLED)
+        sys_profile_log(SYS_PROFILE_RESP, mark);
+#       endif
     }
     
     /// Return the score, which when negative will cause cancellation of the 
@@ -585,6 +1067,17 @@ ot_int sub_parse_request(m2session* session) {
 void sub_opgroup_collection(void) {
     if ((m2qp.cmd.ext & M2CE_NORESP) == 0) {
         ot_int nack;
+#       if (M2_FEATURE(PACK) == ENABLED)
+        if (m2qp.cmd.ext & M2CE_PACK) {
+            ot_u8   is_series   = (m2qp.cmd.code & 1);
+            ot_int  margin      = sub_pack_begin();
+            ot_u8*  header      = txq.putcursor;
+            
+            nack = m2qp_isf_call(is_series, &rxq, &m2np.rt.dlog);
+            sub_pack_end(header + (is_series ? (6 + (header[1] << 1)) : 3), margin, nack);
+        }
+        else
+#       endif
         nack = m2qp_isf_call((m2qp.cmd.code & 1), &rxq, &m2np.rt.dlog);
         if (nack != 0) {
             sub_renack(nack);
@@ -592,11 +1085,56 @@ void sub_opgroup_collection(void) {
     }
 }
 
+void sub_opgroup_diffcollection(void) {
+#if (M2_FEATURE(DIFFCOLLECT) == ENABLED)
+/// The ISF Call Template is followed by the CRC16 of the requester's window.
+/// If this device has the same window, it goes back out of the response, and
+/// only the return header is left.
+    if ((m2qp.cmd.ext & M2CE_NORESP) == 0) {
+        ot_u8*  header;
+        ot_u8   is_series   = (m2qp.cmd.code & 1);
+        ot_int  nack;
+        ot_u16  check;
+#       if (M2_FEATURE(PACK) == ENABLED)
+        ot_int  margin      = (m2qp.cmd.ext & M2CE_PACK) ? sub_pack_begin() : 0;
+#       endif
+        
+        header  = txq.putcursor;
+        nack    = m2qp_isf_call(is_series, &rxq, &m2np.rt.dlog);
+        check   = q_readshort(&rxq);
+        if (nack != 0) {
+            sub_renack(nack);
+        }
+        else {
+            ot_u8*  data    = header + (is_series ? (6 + (header[1] << 1)) : 3);
+            ot_int  length  = (ot_int)(txq.putcursor - data);
+            
+            if ((length > 0) && (crc_calc_block(length, data) == check)) {
+                txq.putcursor   = data;
+                txq.length     -= length;
+            }
+        }
+#       if (M2_FEATURE(PACK) == ENABLED)
+        if (margin != 0) {
+            sub_pack_end(header + (is_series ? (6 + (header[1] << 1)) : 3), margin, nack);
+        }
+#       endif
+    }
+#endif
+}
+
 void sub_opgroup_datastream(void) {
     ///@todo process datastream request
 }
 
 void sub_ack_datastream(void) {
+#   if (M2_FEATURE(DSWINDOW) == ENABLED)
+    /// Sliding-window source: slide the window to the selective ACK
+    if (m2dp.win.mode == M2DS_WIN_SOURCE) {
+        m2dp_source_ack(&rxq);
+        return;
+    }
+#   endif
     ///@todo process datastream request
 }
 
@@ -612,15 +1150,88 @@ void sub_opgroup_shell(void) {
 /// Ports 128 - 255 are ISFs 128 - 255 (check if they are runable)
 
 ///@note None of the "runable file" features exist until DASHForth is ready.
+///      Port M2QP_PORT_ALP is the ALP shell, if it is enabled.
 	ot_bool dummy;
 
     q_writebyte(&txq, rxq.getcursor[1]);    // reverse source/dest for response
     q_writebyte(&txq, rxq.getcursor[0]);    
     
+#   if (M2QP_ALPSHELL)
+    if (rxq.getcursor[0] == M2QP_PORT_ALP) {
+        rxq.getcursor += 2;
+        sub_alpshell();
+        return;
+    }
+#   endif
+    
     dummy = M2QP_CALLBACK(UDP);
 }
 
 
+#if (M2QP_ALPSHELL)
+void sub_alpshell(void) {
+/// The records are run until the input ends, a record is cut short, or the
+/// response is full.  Each output header is reserved in txq before the record
+/// runs, and taken back if the processor writes nothing.  A chunked output
+/// (ALP_FLAG_CF) ends the response, because nothing can follow it.  The last
+/// output record gets ALP_FLAG_ME.
+    alp_record  in_rec;
+    alp_record  out_rec;
+    ot_u8*      last = NULL;
+    
+    out_rec.flags = ALP_FLAG_MB;
+    
+    while ((rxq.back - rxq.getcursor) >= 4) {
+        ot_u8*  header;
+        ot_u8*  next;
+        ot_int  initial_length;
+        
+        in_rec.flags            = q_readbyte(&rxq);
+        in_rec.payload_length   = q_readbyte(&rxq);
+        in_rec.dir_id           = q_readbyte(&rxq);
+        in_rec.dir_cmd          = q_readbyte(&rxq);
+        next                    = rxq.getcursor + in_rec.payload_length;
+        if ((next > rxq.back) || ((txq.back - txq.putcursor) <= 4)) {
+            break;
+        }
+        
+        header                  = txq.putcursor;
+        txq.putcursor          += 4;
+        initial_length          = txq.length;
+        out_rec.payload_length  = 0;
+        out_rec.dir_cmd         = in_rec.dir_cmd;
+        out_rec.bookmark        = NULL;
+        
+        alp_proc(&in_rec, &out_rec, &rxq, &txq, &m2np.rt.dlog);
+        rxq.getcursor           = next;     // payload the processor did not read
+        
+        if ((txq.length == initial_length) && (out_rec.payload_length == 0)) {
+            txq.putcursor = header;
+        }
+        else {
+            last            = header;
+            header[0]       = out_rec.flags & (ALP_FLAG_MB | ALP_FLAG_CF);
+            header[1]       = out_rec.payload_length;
+            header[2]       = out_rec.dir_id;
+            header[3]       = out_rec.dir_cmd;
+            txq.length     += 4;
+            out_rec.flags  &= ~ALP_FLAG_MB;
+            if (out_rec.flags & ALP_FLAG_CF) {
+                break;
+            }
+        }
+        if (in_rec.flags & ALP_FLAG_ME) {
+            break;
+        }
+    }
+    
+    if (last != NULL) {
+        last[0] |= ALP_FLAG_ME;
+    }
+}
+#endif
+
+
 
 void sub_renack(ot_int nack) {
     txq.getcursor[-1]  |= 0x10;     //M2QP Nack Bit
@@ -630,27 +1241,20 @@ void sub_renack(ot_int nack) {
 
 
 
-void sub_load_query(void) {    
-    m2qp.qtmpl.length = q_readbyte(&rxq);
-    m2qp.qtmpl.code   = q_readbyte(&rxq);
+void sub_load_query(query_tmpl* qtmpl) {    
+    qtmpl->length = q_readbyte(&rxq);
+    qtmpl->code   = q_readbyte(&rxq);
     
-    if ((m2qp.qtmpl.code & M2QC_MASKED) != 0) {
+    if ((qtmpl->code & M2QC_MASKED) != 0) {
         /// Option 1: there is a supplied mask
-        m2qp.qtmpl.mask = q_markbyte(&rxq, m2qp.qtmpl.length);
+        qtmpl->mask = q_markbyte(&rxq, qtmpl->length);
     }
     else {
-        /// Option 2: we need to stash a mask of FF's at the back of the queue!
-        /// This is not a problem, because the RX queue will never get this far
-        /// during comp & call commands.
-        m2qp.qtmpl.mask = &rxq.front[rxq.alloc-16];
-
-        *((ot_u32*)&rxq.front[rxq.alloc-16]) = 0xFFFFFFFF;
-        *((ot_u32*)&rxq.front[rxq.alloc-12]) = 0xFFFFFFFF;
-        *((ot_u32*)&rxq.front[rxq.alloc-8])  = 0xFFFFFFFF;
-        *((ot_u32*)&rxq.front[rxq.alloc-4])  = 0xFFFFFFFF;
+        /// Option 2: no mask is supplied, so every bit is compared
+        qtmpl->mask = (ot_u8*)sub_nomask;
     }
 
-    m2qp.qtmpl.value  = q_markbyte(&rxq, m2qp.qtmpl.length);
+    qtmpl->value  = q_markbyte(&rxq, qtmpl->length);
 }
 
 
@@ -664,17 +1268,43 @@ ot_int sub_process_query(m2session* session) {
     /// Look through the ack list for this host's device ID.  If it is
     /// there, then the query can exit.
     if (cmd_type > 0x40) {
-        ot_bool id_test;
+        ot_bool id_test         = False;
+        ot_bool sorted          = False;
         ot_int  number_of_acks  = (ot_int)q_readbyte(&rxq);
+        ot_int  list_acks;
+        
+        /// Sorted ACK list: the count has the sorted flag
+#       if (M2_FEATURE(ACKSORT) == ENABLED)
+        if ((number_of_acks & (M2_ACKBLOOM | M2_ACKSORT)) == M2_ACKSORT) {
+            number_of_acks &= M2_ACKSORT_COUNTMASK;
+            sorted          = True;
+        }
+#       endif
+        list_acks = number_of_acks;
+        
+        /// ACK set: test this host's ID against the filter
+#       if (M2_FEATURE(ACKBLOOM) == ENABLED)
+        if (number_of_acks & M2_ACKBLOOM) {
+            ot_u8 size      = number_of_acks & M2_ACKBLOOM_SIZEMASK;
+            number_of_acks  = (ot_int)q_readbyte(&rxq);
+            list_acks       = 0;
+            id_test         = sub_ackbloom( q_markbyte(&rxq, (1 << size)), size, \
+                                            m2np_idhash(m2np.rt.dlog.length, NULL), False );
+        }
+#       endif
+        
+#       if (M2_FEATURE(FSACOLLECT) == ENABLED)
+        m2qp.fsa.seed           = (ot_u8)number_of_acks;
+#       endif
         
-        do {
-            number_of_acks--;
-            id_test = m2np_idcmp(m2np.rt.dlog.length, \
-                                    q_markbyte(&rxq, m2np.rt.dlog.length));   
+        /// ACK list: this host's ID is loaded once for the whole list
+        if ((list_acks > 0) && (id_test == False)) {
+            id_test = m2np_idlist(m2np.rt.dlog.length, \
+                                q_markbyte(&rxq, list_acks*m2np.rt.dlog.length), \
+                                list_acks, sorted);
         }
-        while ((number_of_acks >= 0) && (id_test == False));
         
-        if (number_of_acks != 0) {
+        if (id_test) {
             goto sub_process_query_exit;
         }
     }
@@ -682,30 +1312,20 @@ ot_int sub_process_query(m2session* session) {
     /// Global Query: All Multicast and Anycast
     /// Load the primary query immediately, for all commands that use a 
     /// query (all multicast, all anycast)
-    sub_load_query();
+    sub_load_query(&m2qp.qtmpl);
     
     /// Local Query: Initial Multicast only
-    /// Save a pointer to the local query, if this is an initial multicast
-    /// request.  This query will be run later.
+    /// Both queries go on the comparison template that follows the local
+    /// query, so they are run together, with one pass over the file data.
+    /// The local query only counts if the global query passes.
     if (cmd_type == 0x40) {
-        ot_int  query_size;
-        ot_u8*  local_ptr;
+        ot_int local_score;
         
-        /// Save a pointer to the local query, and skip to comp template
-        local_ptr       = rxq.getcursor;
-        query_size      = q_readbyte(&rxq);                 //token
-        query_size    <<= ((q_readbyte(&rxq) & 0x80) != 0);  //mask
-        rxq.getcursor  += query_size;
-        
-        /// run the first query... this will actually be the global query
-        /// on commands that also contain a local query.
-        if (m2qp_isf_comp((m2qp.cmd.code & 1), &m2np.rt.dlog) < 0) {
+        sub_load_query(&qpair.tmpl);
+        if (sub_isf_comp_pair((m2qp.cmd.code & 1), &m2np.rt.dlog, &local_score) < 0) {
             goto sub_process_query_exit;
         }
-        
-        /// Backtrace the queue to run the Local query
-        rxq.getcursor   = local_ptr;
-        sub_load_query();
+        return local_score;
     }
 
     /// Run the final query (in all non-exit cases)
@@ -723,157 +1343,1048 @@ ot_int sub_process_query(m2session* session) {
 
 
 
-/** Protocol File System (ISF) Functions      
+/** Framed-Slotted Collection
   * ============================================================================
-  * - ISF manipulation is the core feature of M2QP.
-  * - M2QP ISF manipulation can be done on single files or series of files.
+  * - The requester tallies good and damaged responses in each round, and it
+  *   sizes the next frame from them (the contention period is the frame).
+  * - Each responder picks its slot from a hash of its UID, so no slot number
+  *   needs to be sent in the request.
   */
-#ifndef EXTF_m2qp_isf_comp
-ot_int m2qp_isf_comp(ot_u8 is_series, id_tmpl* user_id) {
-    ot_int  score;
+#if (M2_FEATURE(FSACOLLECT) == ENABLED)
 
-    // Load the data from the file/series into the query buffer
-    {
-        ot_int  (*load_function)(ot_int*, ot_u8);
-        
-        // Assure length is 0 when Non-Null search is used, and set the load
-        // function accordingly, depending on the query method
-        m2qp.qtmpl.length   = (m2qp.qtmpl.code) ? m2qp.qtmpl.length : 0;
-        load_function       = ((m2qp.qtmpl.code & M2QC_COR_SEARCH) != 0) ? \
-                               &sub_load_charcorrelation : &sub_load_comparison;
-    
-        // Get ISF information from queue, and load data 
-        m2qp.qdata.comp_id  = q_readbyte(&rxq);
-        
-        if (is_series)  m2qp.qdata.comp_offset  = q_readshort(&rxq);
-        else            m2qp.qdata.comp_offset  = q_readbyte(&rxq);
-            
-        score   = m2qp_load_isf(is_series, m2qp.qdata.comp_id, m2qp.qdata.comp_offset, 
-                                m2qp.qtmpl.length, load_function, user_id );
-    }
-    
-    // Manage search errors
-    if (score < 0) {
-        return score;
-    }
-    
-    // Manage String Searches:
-    // String search returns a positive number on success, or 0 on fail.  We
-    // need to modify the way it returns.    
-    else if (m2qp.qtmpl.code & M2QC_COR_SEARCH) {
-        score -= (score == 0);
-        
+#ifndef EXTF_m2qp_fsa_init
+void m2qp_fsa_init(ot_u8 q) {
+    m2qp.fsa.q          = (q > M2_PARAM(FSAMAXQ)) ? M2_PARAM(FSAMAXQ) : q;
+    m2qp.fsa.good       = 0;
+    m2qp.fsa.damaged    = 0;
+}
+#endif
+
+
+
+#ifndef EXTF_m2qp_fsa_timeout
+ot_u8 m2qp_fsa_timeout(ot_uint slot_ticks) {
+/// The timeout code is lossy, so step it up until it covers all the slots.
+    ot_u32  ticks;
+    ot_u8   code;
     
-        
-    }
+    ticks   = (ot_u32)slot_ticks << m2qp.fsa.q;
+    ticks   = (ticks > 65535) ? 65535 : ticks;
+    code    = otutils_encode_timeout((ot_u16)ticks);
     
-    // Manage Arithmetic Comparison:
-    // - Other comps are managed by the load function.  For them, just return.
-    // - m2qp_load_isf will return a score based on the load_function you give
-    //   it.  In either of these cases, anything less than 0 means fail.
-    else if (m2qp.qtmpl.code & M2QC_ALU) {
-        ot_int i, j, k;
-
-        // Run Arithmetic comparison
-        for (i=0; i<m2qp.qtmpl.length; i++) {
-            j = m2qp.qtmpl.mask[i] & m2qp.qtmpl.value[i];
-            k = m2qp.qtmpl.mask[i] & LOCAL_U8(i);
-            
-            if (j != k) {
-                switch (m2qp.qtmpl.code & 0x1F) {
-                    case 0: return 0;                   // !=
-                    case 1: return -1;                  // ==
-                    case 2: 
-                    case 3: return (j < k) - 1;         // <, <=
-                    case 4: 
-                    case 5: return (j > k) - 1;         // >, >=
-                    default: return -1;
-                }
-            }
-        }
-        
-        /// If you are here, j == k
-        /// the even numbered codes are non-equalities (!=, <, >)
-        /// so subtract 1 from the equality output to make -1/0
-        return ((ot_int)m2qp.qtmpl.code & 1) - 1;
+    while ((otutils_calc_timeout(code) < ticks) && (code < 0x7F)) {
+        code++;
     }
-    
-    return score;
+    return code;
 }
 #endif
 
 
 
+#ifndef EXTF_m2qp_fsa_endround
+ot_bool m2qp_fsa_endround() {
+/// Damaged frames are counted as collisions.  When there are any, the next
+/// frame is sized to the backlog estimate (2.39 per collision = 612/256).
+/// Otherwise the frame is halved when fewer than half the slots were used.
+    ot_bool more;
+    ot_u16  backlog;
+    ot_u8   q;
+    
+    more = (ot_bool)((m2qp.fsa.good | m2qp.fsa.damaged) != 0);
+    
+    if (m2qp.fsa.damaged != 0) {
+        backlog = ((ot_u16)m2qp.fsa.damaged * 612) >> 8;
+        for (q=0; ((1 << q) < backlog) && (q < M2_PARAM(FSAMAXQ)); q++);
+        m2qp.fsa.q = q;
+    }
+    else if ((m2qp.fsa.q != 0) && (m2qp.fsa.good < (1 << (m2qp.fsa.q-1)))) {
+        m2qp.fsa.q--;
+    }
+    
+    m2qp.fsa.good       = 0;
+    m2qp.fsa.damaged    = 0;
+    return more;
+}
+#endif
+
+
+
+#ifndef EXTF_m2qp_fsa_damaged
+void m2qp_fsa_damaged(m2session* session) {
+    if (((session->netstate & M2_NETSTATE_TMASK) == M2_NETSTATE_RESPRX) && \
+        ((m2qp.cmd.ext & M2CE_CA_MASK) == M2CE_CA_FSA) && \
+        (m2qp.fsa.damaged != 255)) {
+        m2qp.fsa.damaged++;
+    }
+}
+#endif
+
+
+
+#ifndef EXTF_m2qp_fsa_offset
+ot_uint m2qp_fsa_offset(ot_uint slot_ticks) {
+/// 16 bit multiplicative hash (h = 33h + b) of the round seed and the UID.
+/// The UID cache is current here, because the response header is built.
+    ot_u16  hash;
+    ot_uint slots;
+    ot_int  i;
+    
+    slots = (slot_ticks == 0) ? 0 : (ot_uint)(dll.comm.tc / slot_ticks);
+    if (slots <= 1) {
+        return 0;
+    }
+    
+    hash = 5381;
+    hash = (hash * 33) + m2qp.fsa.seed;
+    for (i=0; i<4; i++) {
+        hash = (hash * 33) + (m2np.id.uid[i] >> 8);
+        hash = (hash * 33) + (m2np.id.uid[i] & 0xFF);
+    }
+    
+    return (hash % slots) * slot_ticks;
+}
+#endif
+
+#endif
+
+
+
+
+/** Compressed ACK Set and Sorted ACK List
+  * ============================================================================
+  */
+#if (M2_FEATURE(ACKBLOOM) == ENABLED)
+#ifndef EXTF_m2qp_put_ackbloom
+void m2qp_put_ackbloom(ot_u8 size) {
+    ot_int bytes;
+    
+    if (size > M2_ACKBLOOM_MAXSIZE) {
+        size = M2_ACKBLOOM_MAXSIZE;
+    }
+    txq.getcursor = txq.putcursor;
+    q_writebyte(&txq, M2_ACKBLOOM | size);
+    q_writebyte(&txq, 0);
+    for (bytes=(1 << size); bytes>0; bytes--) {
+        q_writebyte(&txq, 0);
+    }
+}
+#endif
+#endif
+
+
+
+
+#if (M2_FEATURE(ACKSORT) == ENABLED)
+#ifndef EXTF_m2qp_put_acksort
+void m2qp_put_acksort(void) {
+    txq.getcursor = txq.putcursor;
+    q_writebyte(&txq, M2_ACKSORT);
+}
+#endif
+#endif
+
+
+
+#if (M2QP_DIFFCACHE)
+static ot_u32 sub_diff_call(ot_u8 is_series, ot_u8 isf_id, ot_u16 offset) {
+    return ((ot_u32)(is_series != 0) << 24) | ((ot_u32)isf_id << 16) | offset;
+}
+
+
+ot_int sub_diff_find(ot_u32 call, id_tmpl* tag) {
+    ot_int i, j;
+
+    for (i=0; i<M2_PARAM(DIFFTAGS); i++) {
+        difftag_struct* entry = &diffcache.entry[i];
+        
+        if ((entry->tag_length == 0) || (entry->call != call)) {
+            continue;
+        }
+        if (tag == NULL) {
+            break;
+        }
+        if (entry->tag_length == tag->length) {
+            for (j=0; (j<tag->length) && (entry->tag[j] == tag->value[j]); j++);
+            if (j == tag->length) {
+                break;
+            }
+        }
+    }
+    return i;
+}
+
+
+#ifndef EXTF_m2qp_put_diffcall
+ot_u16 m2qp_put_diffcall(ot_u8* status, isfcall_tmpl* isfcall, id_tmpl* tag) {
+    ot_u32  call;
+    ot_int  i;
+    ot_int  length  = 0;
+    ot_u8*  data    = NULL;
+
+    q_writebyte(&txq, (ot_u8)isfcall->max_return);
+    q_writebyte(&txq, isfcall->isf_id);
+    if (isfcall->is_series) {
+        q_writeshort(&txq, (ot_u16)isfcall->offset);
+    }
+    else {
+        q_writebyte(&txq, (ot_u8)isfcall->offset);
+    }
+    
+    /// The check of a call that is not kept is the CRC of nothing
+    call            = sub_diff_call(isfcall->is_series, isfcall->isf_id, (ot_u16)isfcall->offset);
+    i               = sub_diff_find(call, tag);
+    diffcache.sent  = (ot_u8)i;
+    if (i < M2_PARAM(DIFFTAGS)) {
+        length  = diffcache.entry[i].length;
+        data    = diffcache.entry[i].data;
+    }
+    q_writeshort(&txq, crc_calc_block(length, data));
+    
+    *status = 1;
+    return txq.length;
+}
+#endif
+
+
+void sub_diff_response(ot_u8 is_series) {
+/// The return header is [ID][offset][total] for a file, or [ID][n][offset: 2]
+/// [total: 2][n x ID+length] for a series.  An empty window where the total
+/// says there is data is "unchanged", and it gets the window of the entry
+/// that the check was made from.
+    difftag_struct* entry;
+    ot_u8*  header  = rxq.getcursor;
+    ot_u8*  end     = rxq.front + rxq.front[0];
+    ot_u8*  data;
+    ot_u16  offset;
+    ot_u16  total;
+    ot_int  length;
+    ot_int  i;
+    ot_u32  call;
+    
+    if (is_series) {
+        data    = header + 6 + (header[1] << 1);
+        offset  = ((ot_u16)header[2] << 8) | header[3];
+        total   = ((ot_u16)header[4] << 8) | header[5];
+    }
+    else {
+        data    = header + 3;
+        offset  = header[1];
+        total   = header[2];
+    }
+    if (data > end) {
+        return;
+    }
+    length = (ot_int)(end - data);
+    call   = sub_diff_call(is_series, header[0], offset);
+    
+    if ((length == 0) && (offset < total)) {
+        if (diffcache.sent >= M2_PARAM(DIFFTAGS)) {
+            return;
+        }
+        entry   = &diffcache.entry[diffcache.sent];
+        length  = entry->length;
+        if ((entry->tag_length == 0) || (entry->call != call) || \
+            (((ot_int)rxq.front[0] + length) > M2_PARAM(MAXFRAME)) || \
+            ((ot_int)(data - rxq.front) + length > rxq.alloc)) {
+            return;
+        }
+        platform_memcpy(data, entry->data, length);
+        rxq.front[0] += (ot_u8)length;
+    }
+    
+    /// Keep the window of the responder, in its own entry or the next one
+    if (length > M2_PARAM(DIFFBYTES)) {
+        return;
+    }
+    i = sub_diff_find(call, &m2np.rt.dlog);
+    if (i >= M2_PARAM(DIFFTAGS)) {
+        i               = diffcache.next;
+        diffcache.next  = (i+1 < M2_PARAM(DIFFTAGS)) ? (ot_u8)(i+1) : 0;
+    }
+    entry               = &diffcache.entry[i];
+    entry->call         = call;
+    entry->tag_length   = m2np.rt.dlog.length;
+    entry->length       = (ot_u8)length;
+    platform_memcpy(entry->tag, m2np.rt.dlog.value, m2np.rt.dlog.length);
+    if (entry->data != data) {
+        platform_memcpy(entry->data, data, length);
+    }
+}
+#endif
+
+
+
+#if (M2_FEATURE(PACK) == ENABLED)
+ot_int sub_pack_begin(void) {
+/// The room held is the most that packing the rest of the frame can add
+    ot_int margin;
+    
+    txq.putcursor[-1]  |= 0x80;
+    q_writebyte(&txq, M2CE_PACK);
+    margin              = OTUTILS_PACKMARGIN(txq.back - txq.putcursor);
+    txq.back           -= margin;
+    return margin;
+}
+
+
+void sub_pack_end(ot_u8* data, ot_int margin, ot_int nack) {
+/// The window is moved to the back of txq, and it is packed from there to 
+/// where it was.  The room held keeps the packing behind the window.
+    ot_u8*  raw;
+    ot_int  length;
+    ot_int  i;
+    
+    txq.back += margin;
+    if (nack != 0) {
+        return;
+    }
+    length  = (ot_int)(txq.putcursor - data);
+    raw     = txq.back - length;
+    for (i=length-1; i>=0; i--) {
+        raw[i] = data[i];
+    }
+    i               = otutils_pack(data, raw, length);
+    txq.length     -= length - i;
+    txq.putcursor   = data + i;
+}
+#endif
+
+
+#if ((M2_FEATURE(PACK) == ENABLED) && \
+    ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED)))
+ot_bool sub_pack_response(ot_u8 is_series) {
+/// The packed window is moved to the back of rxq, and it is unpacked from 
+/// there to where it was, the way the responder packed it.  The unpacked
+/// frame is no longer than the frame the responder had before packing.
+    ot_u8*  header  = rxq.getcursor;
+    ot_u8*  end     = rxq.front + rxq.front[0];
+    ot_u8*  data;
+    ot_u8*  packed;
+    ot_int  length;
+    ot_int  i;
+    
+    data = header + (is_series ? (6 + (header[1] << 1)) : 3);
+    if (data > end) {
+        return False;
+    }
+    length  = (ot_int)(end - data);
+    packed  = rxq.front + rxq.alloc - length;
+    for (i=length-1; i>=0; i--) {
+        packed[i] = data[i];
+    }
+    i       = (ot_int)(data - rxq.front);
+    length  = otutils_unpack(data, packed, length, M2_PARAM(MAXFRAME) - i);
+    if (length < 0) {
+        return False;
+    }
+    rxq.front[0] = (ot_u8)(i + length);
+    return True;
+}
+#endif
+
+
+
+#if (M2QP_PIPELINE)
+#ifndef EXTF_m2qp_pipe_open
+void m2qp_pipe_open(m2session* session) {
+    pipe_entry* entry;
+    ot_int      i;
+    
+    for (i=0; i<M2_PARAM(PIPELINE); i++) {
+        entry = &m2qp.pipe.entry[i];
+        if (entry->open && (entry->dialog_id == session->dialog_id)) {
+            break;
+        }
+    }
+    if (i == M2_PARAM(PIPELINE)) {
+        i               = m2qp.pipe.next;
+        m2qp.pipe.next  = (i+1 < M2_PARAM(PIPELINE)) ? (ot_u8)(i+1) : 0;
+        entry           = &m2qp.pipe.entry[i];
+    }
+    
+    entry->stamp        = platform_stamp();
+    entry->dialog_id    = session->dialog_id;
+    entry->open         = True;
+    entry->unicast      = ((m2np.header.addr_ctl & 0xC0) == 0);
+    entry->cmd          = m2qp.cmd;
+}
+#endif
+
+
+#ifndef EXTF_m2qp_pipe_match
+ot_bool m2qp_pipe_match(ot_u8 dialog_id) {
+/// The newest request is the one before next, and it does not run out.
+    ot_int newest = (m2qp.pipe.next == 0) ? (M2_PARAM(PIPELINE)-1) : (m2qp.pipe.next-1);
+    ot_int i;
+    
+    for (i=0; i<M2_PARAM(PIPELINE); i++) {
+        pipe_entry* entry = &m2qp.pipe.entry[i];
+        
+        if (entry->open && (entry->dialog_id == dialog_id)) {
+            if ((i != newest) && \
+                ((ot_u16)PLATFORM_STAMP_AGE(entry->stamp) > M2_PARAM(PIPETIME))) {
+                entry->open = False;
+                break;
+            }
+            m2qp.pipe.current   = (ot_u8)i;
+            m2qp.cmd            = entry->cmd;
+            return True;
+        }
+    }
+    return False;
+}
+#endif
+
+
+void sub_pipe_done(m2session* session) {
+/// A unicast request has one response.  If it is the request of the session,
+/// the listen is over, too.
+    pipe_entry* entry = &m2qp.pipe.entry[m2qp.pipe.current];
+    
+    if (entry->open && entry->unicast) {
+        entry->open = False;
+        if (entry->dialog_id == session->dialog_id) {
+            session->netstate |= M2_NETFLAG_SCRAP;
+        }
+    }
+}
+#endif
+
+
+
+
+#if (M2QP_INVENTORY)
+#ifndef EXTF_m2qp_inv_start
+ot_bool m2qp_inv_start(inv_policy* policy) {
+/// Announcements, inventories and the four collections are the A2P opcodes
+/// that a round can use (no UDP, differential collection or datastream).
+    if ((policy->opcode > M2OP_COL_SS) || \
+        ((policy->opcode & 0x0E) == M2OP_UDP_F) || (policy->channels == 0) || \
+        (policy->channels > M2_PARAM(INVCHANNELS))) {
+        return False;
+    }
+    platform_memcpy((ot_u8*)&m2qp.inv.policy, (ot_u8*)policy, sizeof(inv_policy));
+    if (m2qp.inv.policy.period > 32767) {
+        m2qp.inv.policy.period = 32767;
+    }
+    
+    m2qp.inv.state  = M2_INV_START;
+    m2qp.inv.round  = 0;
+    m2qp.inv.chan   = 0;
+    m2qp.inv.length = (policy->flags & M2_INV_VID) ? 2 : 8;
+    m2qp.inv.pass   = 0;
+    m2qp.inv.count  = 0;
+    m2qp.inv.fresh  = 0;
+    return True;
+}
+#endif
+
+
+#ifndef EXTF_m2qp_inv_stop
+void m2qp_inv_stop(void) {
+    m2qp.inv.state = M2_INV_OFF;
+}
+#endif
+
+
+#ifndef EXTF_m2qp_inv_run
+ot_bool m2qp_inv_run(ot_long* event_eta) {
+/// The round on air is over when its session is gone.  A pass ends on a silent
+/// round, or on the last round of the policy.
+    if ((m2qp.inv.state == M2_INV_OFF) || (session_count() >= 0)) {
+        return False;
+    }
+    
+    if (m2qp.inv.state == M2_INV_ROUND) {
+        ot_bool more    = m2qp_fsa_endround();
+        ot_u8   rounds  = (m2qp.inv.policy.rounds == 0) ? 255 : m2qp.inv.policy.rounds;
+        
+        m2qp.inv.round++;
+        if (more && (m2qp.inv.round < rounds)) {
+            return sub_inv_round();
+        }
+        
+        m2qp.inv.pass++;
+        m2qp.inv.stamp  = platform_stamp();
+        m2qp.inv.state  = (m2qp.inv.policy.period == 0) ? M2_INV_OFF : M2_INV_WAIT;
+        if (m2qp.inv.state == M2_INV_OFF) {
+            return False;
+        }
+    }
+    
+    if (m2qp.inv.state == M2_INV_WAIT) {
+        ot_long wait = (ot_long)m2qp.inv.policy.period - PLATFORM_STAMP_AGE(m2qp.inv.stamp);
+        if (wait > 0) {
+            if (wait < *event_eta) {
+                *event_eta = wait;
+            }
+            return False;
+        }
+    }
+    
+    /// New pass: the set is kept only with M2_INV_KEEP
+    if ((m2qp.inv.policy.flags & M2_INV_KEEP) == 0) {
+        m2qp.inv.count = 0;
+    }
+    m2qp.inv.round  = 0;
+    m2qp.inv.fresh  = 0;
+    m2qp_fsa_init(m2qp.inv.policy.q);
+    return sub_inv_round();
+}
+#endif
+
+
+ot_bool sub_inv_round(void) {
+/// A round is a multicast A2P request with the FSA CA code: the initial kind
+/// when the set is empty, else an intermediate one with the newest tags of the
+/// set on its ACK list.  64 bytes are left after the list, for the rest of the
+/// request and for the ACK room check of the responses.
+    inv_policy*     policy = &m2qp.inv.policy;
+    ot_u8           status;
+    ot_bool         initial;
+    
+    {   session_tmpl s_tmpl;
+        s_tmpl.channel      = policy->chanlist[m2qp.inv.chan];
+        s_tmpl.subnet       = policy->subnet;
+        s_tmpl.subnetmask   = 0xFF;
+        s_tmpl.flags        = (policy->flags & M2_INV_VID) ? M2_FLAG_VID : 0;
+        s_tmpl.flagmask     = M2_FLAG_VID;
+        s_tmpl.timeout      = policy->tca;
+        if (otapi_new_session(&s_tmpl) == 0) {
+            return False;
+        }
+        m2qp.inv.chan = (m2qp.inv.chan+1 < policy->channels) ? (m2qp.inv.chan+1) : 0;
+    }
+    otapi_open_request(ADDR_multicast, NULL);
+    
+    initial = (ot_bool)(m2qp.inv.count == 0);
+    {   command_tmpl command;
+        command.type        = initial ? CMDTYPE_a2p_init_request : CMDTYPE_a2p_inter_request;
+        command.opcode      = policy->opcode;
+        command.extension   = M2CE_CA_FSA;
+        otapi_put_command_tmpl(&status, &command);
+    }
+    {   dialog_tmpl dialog;
+        dialog.channels     = 0;
+        dialog.timeout      = m2qp_fsa_timeout(policy->slot_ticks);
+        otapi_put_dialog_tmpl(&status, &dialog);
+    }
+    if (initial == False) {
+        ot_int n, i;
+        n = ((ot_int)(txq.back - txq.putcursor) - 1 - 64) / m2qp.inv.length;
+        n = (n > (ot_int)m2qp.inv.count) ? (ot_int)m2qp.inv.count : n;
+        n = (n > 63) ? 63 : n;      // the flag bits of a count are not used
+        n = (n < 0) ? 0 : n;
+        q_writebyte(&txq, (ot_u8)n);
+        for (i=m2qp.inv.count-n; i<m2qp.inv.count; i++) {
+            q_writestring(&txq, m2qp.inv.tag[i], m2qp.inv.length);
+        }
+    }
+    {   query_tmpl query;
+        query.code          = QCODE_nonnull;
+        query.length        = 0;
+        query.mask          = NULL;
+        query.value         = NULL;
+        otapi_put_query_tmpl(&status, &query);
+        if (initial) {
+            otapi_put_query_tmpl(&status, &query);
+        }
+    }
+    {   isfcomp_tmpl isfcomp;
+        isfcomp.is_series   = (policy->opcode & 1);
+        isfcomp.isf_id      = policy->comp_id;
+        isfcomp.offset      = 0;
+        otapi_put_isf_comp(&status, &isfcomp);
+    }
+    if (policy->opcode >= M2OP_COL_FF) {
+        isfcall_tmpl isfcall;
+        isfcall.is_series   = (policy->opcode & 1);
+        isfcall.isf_id      = policy->call_id;
+        isfcall.max_return  = policy->max_return;
+        isfcall.offset      = 0;
+        otapi_put_isf_call(&status, &isfcall);
+    }
+    otapi_close_request();
+    
+    m2qp.inv.state = M2_INV_ROUND;
+    return (ot_bool)otapi_start_dialog();
+}
+
+
+void sub_inv_tag(void) {
+/// A tag that is in the set already, or that does not fit, is not added.
+    ot_int i, j;
+    
+    if (m2np.rt.dlog.length != m2qp.inv.length) {
+        return;
+    }
+    for (i=0; i<m2qp.inv.count; i++) {
+        for (j=0; (j < m2qp.inv.length) && (m2qp.inv.tag[i][j] == m2np.rt.dlog.value[j]); j++);
+        if (j == m2qp.inv.length) {
+            return;
+        }
+    }
+    if (m2qp.inv.count < M2_PARAM(INVTAGS)) {
+        platform_memcpy(m2qp.inv.tag[m2qp.inv.count], m2np.rt.dlog.value, m2qp.inv.length);
+        m2qp.inv.count++;
+        m2qp.inv.fresh++;
+    }
+}
+#endif
+
+
+
+
+/** Protocol File System (ISF) Functions      
+  * ============================================================================
+  * - ISF manipulation is the core feature of M2QP.
+  * - M2QP ISF manipulation can be done on single files or series of files.
+  */
+#ifndef EXTF_m2qp_isf_comp
+ot_int m2qp_isf_comp(ot_u8 is_series, id_tmpl* user_id) {
+    // Assure length is 0 when Non-Null search is used
+    m2qp.qtmpl.length   = (m2qp.qtmpl.code) ? m2qp.qtmpl.length : 0;
+    
+    // Get ISF information from queue
+    m2qp.qdata.comp_id  = q_readbyte(&rxq);
+    
+    if (is_series)  m2qp.qdata.comp_offset  = q_readshort(&rxq);
+    else            m2qp.qdata.comp_offset  = q_readbyte(&rxq);
+
+    return sub_isf_cached(is_series, user_id);
+}
+#endif
+
+
+
+ot_int sub_isf_cached(ot_u8 is_series, id_tmpl* user_id) {
+#   if (M2_PARAM(QCACHE) > 0)
+    ot_u16          hash;
+    qcache_entry*   entry;
+    ot_int          score;
+    
+    // A cached result is good if the query and target are the same, and no
+    // file has changed since it was computed.  Otherwise, run the comparison
+    // and cache the result.
+    hash    = sub_qcache_hash(is_series, user_id);
+    entry   = sub_qcache_find(hash);
+    if (entry != NULL) {
+        return entry->score;
+    }
+    score = sub_isf_comp(is_series, user_id);
+    sub_qcache_put(hash, score);
+    return score;
+    
+#   else
+    return sub_isf_comp(is_series, user_id);
+#   endif
+}
+
+
+
+ot_int sub_isf_comp_pair(ot_u8 is_series, id_tmpl* user_id, ot_int* local_score) {
+/// The global query is in m2qp.qtmpl, and the local one in qpair.tmpl.  They
+/// share the comparison template, which is read once.  When a cached result
+/// is still good for either one, each query runs on its own, so the cache 
+/// can answer it and a failed global query stops the local one.  Otherwise,
+/// both are scored in one pass.  The local result is only given when the
+/// global query passes.
+    ot_int score;
+    
+    // Assure length is 0 when Non-Null search is used
+    m2qp.qtmpl.length   = (m2qp.qtmpl.code) ? m2qp.qtmpl.length : 0;
+    qpair.tmpl.length   = (qpair.tmpl.code) ? qpair.tmpl.length : 0;
+    
+    // Get ISF information from queue
+    m2qp.qdata.comp_id  = q_readbyte(&rxq);
+    
+    if (is_series)  m2qp.qdata.comp_offset  = q_readshort(&rxq);
+    else            m2qp.qdata.comp_offset  = q_readbyte(&rxq);
+
+#   if (M2_PARAM(QCACHE) > 0)
+    {   ot_u16 ghash;
+        ot_u16 lhash;
+        
+        ghash = sub_qcache_hash(is_series, user_id);
+        sub_query_swap();
+        lhash = sub_qcache_hash(is_series, user_id);
+        sub_query_swap();
+        
+        // One at a time: the global query, and the local query if it passes
+        if ((sub_qcache_find(ghash) != NULL) || (sub_qcache_find(lhash) != NULL)) {
+            score = sub_isf_cached(is_series, user_id);
+            if (score >= 0) {
+                sub_query_swap();
+                *local_score = sub_isf_cached(is_series, user_id);
+                sub_query_swap();
+            }
+            return score;
+        }
+        
+        score = sub_isf_score_pair(is_series, user_id, local_score);
+        sub_qcache_put(ghash, score);
+        if (score >= 0) {
+            sub_query_swap();
+            sub_qcache_put(lhash, *local_score);
+            sub_query_swap();
+        }
+        return score;
+    }
+#   else
+    return sub_isf_score_pair(is_series, user_id, local_score);
+#   endif
+}
+
+
+
+ot_int sub_isf_score_pair(ot_u8 is_series, id_tmpl* user_id, ot_int* local_score) {
+/// Each query has a part of the query block, so the pair only runs in one
+/// pass if both fit.  Otherwise, the queries run one after the other.
+    ot_int window;
+    ot_int score;
+    
+    if ((m2qp.qtmpl.length + qpair.tmpl.length) > BUF_SCRATCH_QUERYSIZE) {
+        score = sub_isf_comp(is_series, user_id);
+        if (score >= 0) {
+            sub_query_swap();
+            *local_score = sub_isf_comp(is_series, user_id);
+            sub_query_swap();
+        }
+        return score;
+    }
+    
+    // A query that the file summary rejects leaves the pass to the other one
+#   if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    if (sub_query_reject(is_series)) {
+        return -1;
+    }
+    sub_query_swap();
+    score = sub_query_reject(is_series);
+    sub_query_swap();
+    if (score) {
+        *local_score = -1;
+        return sub_isf_comp(is_series, user_id);
+    }
+#   endif
+    
+    m2qp.qbuf = buffers_scratch_alloc(BUF_SCRATCH_QUERY);
+    if (m2qp.qbuf == NULL) {
+        *local_score = -1;
+        return -1;
+    }
+    
+    // The pass goes as far as the query that takes the most data
+    qpair.window[0] = sub_query_setup(&qpair.load[0]);
+    sub_query_swap();
+    qpair.window[1] = sub_query_setup(&qpair.load[1]);
+    sub_query_swap();
+    window          = (qpair.window[0] > qpair.window[1]) ? \
+                        qpair.window[0] : qpair.window[1];
+    qpair.score[0]  = 0;
+    qpair.score[1]  = 0;
+    
+    // A file error fails both queries.  Otherwise each gets its own result.
+    score = m2qp_load_isf(is_series, m2qp.qdata.comp_id, m2qp.qdata.comp_offset, 
+                            window, &sub_load_pair, user_id );
+    if (score < 0) {
+        *local_score = score;
+    }
+    else {
+        score           = sub_query_result(qpair.score[0]);
+        sub_query_swap();
+        *local_score    = sub_query_result(qpair.score[1]);
+        sub_query_swap();
+    }
+    
+    buffers_scratch_free(BUF_SCRATCH_QUERY, m2qp.qbuf);
+    return score;
+}
+
+
+
+#if (OT_FEATURE(VLSUMMARY) == ENABLED)
+ot_bool sub_query_reject(ot_u8 is_series) {
+/// A summary only proves that a byte is not in the file, so only template
+/// bytes with a full mask are used.  Series are not summarized.
+#   define SUM_HAS(SUM, B)  ( (((SUM)->filter >> ((B) & 31)) & 1) && \
+                              ((B) >= (SUM)->min) && ((B) <= (SUM)->max) )
+    const vl_summary*   sum;
+    ot_int              length  = (ot_int)m2qp.qtmpl.length;
+    ot_u8               code    = m2qp.qtmpl.code;
+    ot_int              i;
+    
+    if (is_series) {
+        return False;
+    }
+    sum = ISF_summary(m2qp.qdata.comp_id);
+    if (sum == NULL) {
+        return False;
+    }
+    
+    /// Search: a token byte that is not in the file misses in every window,
+    /// so the query fails when there are more of those than a window may miss
+    if (code & M2QC_COR_SEARCH) {
+        ot_int threshold    = (ot_int)(code & M2QC_COR_THRMASK);
+        ot_int allowed      = (threshold > length) ? -1 : ((length - threshold) >> 1);
+        
+        for (i=0; (i<length) && (allowed>=0); i++) {
+            if ((m2qp.qtmpl.mask[i] == 0xFF) && !SUM_HAS(sum, m2qp.qtmpl.value[i])) {
+                allowed--;
+            }
+        }
+        return (ot_bool)(allowed < 0);
+    }
+    
+    /// Arithmetic comparison: == needs every byte in the file.  <, <=, >, >=
+    /// are decided on the first byte when all the data is on one side of it.
+    if ((code & M2QC_ALU) && (length > 0)) {
+        switch (code & 0x1F) {
+            case 1: for (i=0; i<length; i++) {
+                        if ((m2qp.qtmpl.mask[i] == 0xFF) && !SUM_HAS(sum, m2qp.qtmpl.value[i])) {
+                            return True;
+                        }
+                    }
+                    break;
+            case 2:
+            case 3: return (ot_bool)((m2qp.qtmpl.mask[0] == 0xFF) && (m2qp.qtmpl.value[0] > sum->max));
+            case 4:
+            case 5: return (ot_bool)((m2qp.qtmpl.mask[0] == 0xFF) && (m2qp.qtmpl.value[0] < sum->min));
+            default: break;
+        }
+    }
+    return False;
+    
+#   undef SUM_HAS
+}
+#endif
+
+
+
+void sub_query_swap() {
+/// The local query's part of the query block starts after the global query's
+    query_tmpl  tmpl;
+    corr_data   corr;
+    
+    tmpl        = m2qp.qtmpl;
+    m2qp.qtmpl  = qpair.tmpl;
+    qpair.tmpl  = tmpl;
+    corr        = m2qp.corr;
+    m2qp.corr   = qpair.corr;
+    qpair.corr  = corr;
+    
+    qpair.turn ^= 1;
+    if (qpair.turn) m2qp.qbuf  += qpair.tmpl.length;
+    else            m2qp.qbuf  -= m2qp.qtmpl.length;
+}
+
+
+
+#if (M2_PARAM(QCACHE) > 0)
+ot_u16 sub_qcache_hash(ot_u8 is_series, id_tmpl* user_id) {
+/// 16 bit multiplicative hash (h = 33h + b), over the fields that decide the
+/// result of a comparison.
+    ot_u16  hash;
+    ot_int  i;
+
+    hash    = 5381;
+    hash    = (hash * 33) + is_series;
+    hash    = (hash * 33) + m2qp.qtmpl.length;
+    hash    = (hash * 33) + (ot_u16)m2qp.qdata.comp_offset;
+    for (i=0; i<m2qp.qtmpl.length; i++) {
+        hash = (hash * 33) + m2qp.qtmpl.mask[i];
+        hash = (hash * 33) + m2qp.qtmpl.value[i];
+    }
+    if (user_id != NULL) {
+        for (i=0; i<user_id->length; i++) {
+            hash = (hash * 33) + user_id->value[i];
+        }
+    }
+    
+    return (hash == 0) ? 1 : hash;
+}
+
+
+qcache_entry* sub_qcache_find(ot_u16 hash) {
+    ot_u16          stamp;
+    ot_int          i;
+    qcache_entry*   entry;
+    
+    stamp   = (ot_u16)(vl_writestamp + vl_mapstamp);
+    entry   = qcache.entry;
+    for (i=0; i<M2_PARAM(QCACHE); i++, entry++) {
+        if ((entry->hash == hash) && (entry->stamp == stamp) && \
+            (entry->comp_id == m2qp.qdata.comp_id) && \
+            (entry->code == m2qp.qtmpl.code)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+
+void sub_qcache_put(ot_u16 hash, ot_int score) {
+    qcache_entry* entry;
+    
+    entry           = &qcache.entry[qcache.next];
+    qcache.next     = (qcache.next+1 < M2_PARAM(QCACHE)) ? qcache.next+1 : 0;
+    entry->score    = score;
+    entry->hash     = hash;
+    entry->stamp    = (ot_u16)(vl_writestamp + vl_mapstamp);
+    entry->comp_id  = m2qp.qdata.comp_id;
+    entry->code     = m2qp.qtmpl.code;
+}
+#endif
+
+
+
+ot_int sub_isf_comp(ot_u8 is_series, id_tmpl* user_id) {
+/// The comparison data only lives for the comparison, so the block is given
+/// back right away.  With no free block, or a token too long for it, the query
+/// fails, like a file error.
+    ot_int score;
+    
+#   if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    if (sub_query_reject(is_series)) {
+        return -1;
+    }
+#   endif
+    if (m2qp.qtmpl.length > BUF_SCRATCH_QUERYSIZE) {
+        return -1;
+    }
+    m2qp.qbuf = buffers_scratch_alloc(BUF_SCRATCH_QUERY);
+    if (m2qp.qbuf == NULL) {
+        return -1;
+    }
+    score = sub_isf_score(is_series, user_id);
+    buffers_scratch_free(BUF_SCRATCH_QUERY, m2qp.qbuf);
+    return score;
+}
+
+
+ot_int sub_isf_score(ot_u8 is_series, id_tmpl* user_id) {
+    m2qp_loadfn load_function;
+    ot_int      window_bytes;
+    ot_int      score;
+
+    // Load the data from the file/series into the query buffer
+    window_bytes    = sub_query_setup(&load_function);
+    score           = m2qp_load_isf(is_series, m2qp.qdata.comp_id, m2qp.qdata.comp_offset, 
+                                    window_bytes, load_function, user_id );
+    return sub_query_result(score);
+}
+
+
+ot_int sub_query_setup(m2qp_loadfn* load_function) {
+    // Set the load function, depending on the query method.  A search goes
+    // on to the end of the data.
+    if ((m2qp.qtmpl.code & M2QC_COR_SEARCH) != 0) {
+        *load_function  = &sub_load_charcorrelation;
+        sub_init_charcorrelation();
+        return 32767;
+    }
+    *load_function = &sub_load_comparison;
+    return m2qp.qtmpl.length;
+}
+
+
+ot_int sub_query_result(ot_int score) {
+    // Manage search errors
+    if (score < 0) {
+        return score;
+    }
+    
+    // Manage String Searches:
+    // String search returns a positive number on success, or 0 on fail.  We
+    // need to modify the way it returns.    
+    else if (m2qp.qtmpl.code & M2QC_COR_SEARCH) {
+        score -= (score == 0);
+        
+    
+        
+    }
+    
+    // Manage Arithmetic Comparison:
+    // - Other comps are managed by the load function.  For them, just return.
+    // - m2qp_load_isf will return a score based on the load_function you give
+    //   it.  In either of these cases, anything less than 0 means fail.
+    else if (m2qp.qtmpl.code & M2QC_ALU) {
+        ot_int i, j, k;
+
+        // Run Arithmetic comparison
+        for (i=0; i<m2qp.qtmpl.length; i++) {
+            j = m2qp.qtmpl.mask[i] & m2qp.qtmpl.value[i];
+            k = m2qp.qtmpl.mask[i] & LOCAL_U8(i);
+            
+            if (j != k) {
+                switch (m2qp.qtmpl.code & 0x1F) {
+                    case 0: return 0;                   // !=
+                    case 1: return -1;                  // ==
+                    case 2: 
+                    case 3: return (j < k) - 1;         // <, <=
+                    case 4: 
+                    case 5: return (j > k) - 1;         // >, >=
+                    default: return -1;
+                }
+            }
+        }
+        
+        /// If you are here, j == k
+        /// the even numbered codes are non-equalities (!=, <, >)
+        /// so subtract 1 from the equality output to make -1/0
+        return ((ot_int)m2qp.qtmpl.code & 1) - 1;
+    }
+    
+    return score;
+}
+
+
+
 
 #ifndef EXTF_m2qp_isf_call
 ot_int m2qp_isf_call( ot_u8 is_series, Queue* input_q, id_tmpl* user_id ) {
 /// This function takes data from a queue.  That data is a ISF or ISFS Call
 /// Template as described in the Mode 2 Spec.
+    isfcall_member member[M2_PARAM(ISFSCALL)];
     Twobytes scratch;
     ot_u8   isf_id;
-    vlFILE* fp_f;
+    ot_int  n_members;
     ot_int  offset;
     ot_int  max_bytes;
     ot_int  total_length = 0;
+    ot_int  i;
     
-    /// 1. Save Max Bytes & Data ID
+    /// 1. Save Max Bytes & Data ID, and resolve the called files.  If the ISFS
+    ///    or the ISF is not accessible, don't respond by returning negative
     max_bytes   = (ot_int)q_readbyte(input_q);
     isf_id      = q_readbyte(input_q);
     q_writebyte(&txq, isf_id);
     
-    /// 2. Break down a ISF Series Call Template, and build the header                  <BR>
-    ///    - Open ISFS: If not accessible, don't respond by returning negative          <BR>
-    ///    - Load data offset, and write the first part of the return template          <BR>
-    ///    - Go through ISF Elements and write their ID+Length to the return template   <BR>
-    ///    - Write total length to the marked spot on the queue
-    if (is_series) {
-        vlFILE* fp_s;
-        ot_u8*  clength_ptr;
-        ot_int  i;
+    n_members = sub_isfcall_resolve(member, is_series, isf_id, user_id);
+    if (n_members < 0) {
+        return n_members;
+    }
+    for (i=0; i<n_members; i++) {
+        total_length += member[i].length;
+    }
     
-        fp_s = ISFS_open( isf_id, VL_ACCESS_R, user_id );      
-        if (fp_s == NULL) {
-            return -2;
-        }
-        
+    /// 2. Build the header of an ISF Series Return Template: the data offset,
+    ///    the total length, and the ID+Length of each ISF Element
+    if (is_series) {
         offset = q_readshort(input_q);
-        q_writebyte( &txq, (ot_u8)fp_s->length );
+        q_writebyte( &txq, (ot_u8)n_members );
         q_writeshort(&txq, offset );
-        clength_ptr     = txq.putcursor;
-        txq.putcursor  += 2;
-        txq.length     += 2;
-        
-        for (i=0; i<fp_s->length; i++) {
-            if ( (i&1) == 0 ) {
-                scratch.ushort = vl_read(fp_s, i);
-            }
-            fp_f = ISF_open(scratch.ubyte[i&1], VL_ACCESS_R, user_id);
-            if (fp_f != NULL) {
-                q_writebyte(&txq, GET_B0_U16(fp_f->idmod) );
-                q_writebyte(&txq, (ot_u8)fp_f->length );
-                total_length += fp_f->length;
-            }
-            vl_close(fp_f);
+        q_writeshort(&txq, total_length );
+        for (i=0; i<n_members; i++) {
+            q_writebyte(&txq, member[i].id );
+            q_writebyte(&txq, member[i].length );
         }
-        vl_close(fp_s);
-        
-        scratch.ushort  = total_length;
-        clength_ptr[0]  = scratch.ubyte[UPPER];
-        clength_ptr[1]  = scratch.ubyte[LOWER];
     }
     
-    /// 3. Break down a ISF Element Call Template, and build the header.
-    ///    If ISF Element is not accessible, don't respond
+    /// 3. Build the header of an ISF Element Return Template
     else {
-        fp_f = ISF_open( isf_id, VL_ACCESS_R, user_id ); 
-        if (fp_f == NULL) {        
-            return -2;
-        }
-        offset          = q_readbyte(input_q);
-        total_length    = fp_f->length;
+        offset = q_readbyte(input_q);
         q_writebyte(&txq, (ot_u8)offset );
         q_writebyte(&txq, (ot_u8)total_length );
-        vl_close(fp_f);
     }
     
     /// 4.  Check how much room is left in the frame.  If the number of bytes
@@ -890,93 +2401,146 @@ ot_int m2qp_isf_call( ot_u8 is_series, Queue* input_q, id_tmpl* user_id ) {
         max_bytes = scratch.sshort;
     }
     
-    /// 6.  Call the ISF load function to dump-out the data
-    return m2qp_load_isf(is_series, isf_id, offset, max_bytes, &sub_load_return, user_id);
+    /// 6.  Copy the data window into the TX queue
+    return sub_isfcall_load(member, n_members, offset, max_bytes, &sub_load_return);
 }
 #endif
 
 
 
-#ifndef EXTF_m2qp_load_isf
-ot_int m2qp_load_isf(   ot_u8       is_series, 
-                        ot_u8       isf_id, 
-                        ot_int      offset, 
-                        ot_int      window_bytes,
-                        ot_int      (*load_function)(ot_int*, ot_u8),
-                        id_tmpl*    user_id ) {            
-    Twobytes scratch;
+ot_int sub_isfcall_resolve(isfcall_member* member, ot_u8 is_series, ot_u8 isf_id, id_tmpl* user_id) {
+/// Files that can be read in place (mirrored ones always can) are resolved
+/// without a file pointer.  The others are opened once, to get their length
+/// and their VWORM data address.  A member
+/// of the series that is not accessible spoils the whole call, as before.
+    ot_u8   ids[M2_PARAM(ISFSCALL)];
+    ot_int  n_members   = 1;
+    ot_int  error       = -2;
     ot_int  i;
-    vlFILE* fp_f;
-    vlFILE* fp_s    = NULL;
-    ot_int  n_files = 1;
-    ot_int  j       = 0;
-    ot_int  output  = 0;
-
-    /// 1. Open the ISF Series, if enabled
-    ///    Do not respond if the series is not accessible (return negative)
+    
+    ids[0] = isf_id;
+    
     if (is_series) {
+        vlFILE* fp_s;
         fp_s = ISFS_open( isf_id, VL_ACCESS_R, user_id );
         if (fp_s == NULL) {
-            return -32768;
+            return -2;
+        }
+        n_members = fp_s->length;
+        if (n_members <= M2_PARAM(ISFSCALL)) {
+            vl_load(fp_s, n_members, ids);
+        }
+        vl_close(fp_s);
+        
+        error = -32768;
+        if (n_members > M2_PARAM(ISFSCALL)) {
+            return error;
         }
-        n_files = fp_s->length;
     }
     
-    /// 2. If no Series, spoof a single file access as a series of size 1
-    else {
-        scratch.ubyte[0]    = isf_id;
-        n_files             = 1;
+    for (i=0; i<n_members; i++, member++) {
+        vl_direct view;
+        ot_u8     code;
+        
+        member->id  = ids[i];
+        code        = vl_get_direct(&view, VL_ISF_BLOCKID, ids[i], user_id);
+        
+        if (code == 0) {
+            member->length  = (ot_u8)view.length;
+            member->data    = view.data;
+        }
+        else if (code == 2) {
+            vlFILE* fp_f;
+            fp_f = ISF_open( ids[i], VL_ACCESS_R, user_id );
+            if (fp_f == NULL) {
+                return error;
+            }
+            member->length  = (ot_u8)fp_f->length;
+            member->data    = NULL;
+            member->base    = fp_f->start;
+            vl_close(fp_f);
+        }
+        else {
+            return error;
+        }
     }
+    
+    return n_members;
+}
 
-    /// 3.  Step through each file of the ISF Series, and process it.
-    ///     This double-loop will extract and process a window of "window_bytes"
-    ///     bytes that is stored contiguously across any number of files in a
-    ///     series.  Processing stops when the series ends or the window is full.
-    for (i=0; i<n_files; i++) {
-        ot_u8 align = (i & 1);
+
+
+ot_int sub_isfcall_load(isfcall_member* member, ot_int n_members, ot_int offset, 
+                        ot_int window_bytes, m2qp_loadfn load_function) {
+/// The window may start in any member, and it continues across the members 
+/// after it.  Data that can be read in place is given to load_function() as
+/// one span per member.  Other data is block read into a small buffer, and 
+/// given one buffer at a time.
+    ot_int  j       = 0;
+    ot_int  output  = 0;
     
-        // Read the next file ID if we are processing a ISFS (series)
-        if ((is_series) && (align == 0)) {
-            scratch.ushort = vl_read(fp_s, i);
+    for (; (n_members > 0) && (j < window_bytes); n_members--, member++) {
+        ot_int span = (ot_int)member->length - offset;
+        
+        if (span <= 0) {
+            offset -= member->length;
+            continue;
+        }
+        if (span > (window_bytes - j)) {
+            span = window_bytes - j;
         }
         
-        // Open the file: 
-        // - If not accessible as a series, skip it
-        // - If not accessible as an file, bail
-        fp_f = ISF_open( scratch.ubyte[align], VL_ACCESS_R, user_id );
-        if (fp_f == NULL) {
-            vl_close(fp_s);
-            return -32768;
+        if (member->data != NULL) {
+            output += load_function(&j, &member->data[offset], span);
         }
-                
-        // Subtract the file length from the offset value.  When the offset 
-        // goes negative, the current file is the one we should start on.
-        offset -= fp_f->length;
-        if (offset < 0) {
-            offset += fp_f->length;
+        else {
+            // VWORM block reads start on an even address
+            ot_u8   buffer[16];
+            vaddr   addr = member->base + offset;
+            ot_int  skip = addr & 1;
             
-            // Load the window and process it, using the open file
-            while ( (j < window_bytes) && (offset < fp_f->length) ) {
-                Twobytes ldata;
-                
-                align = offset & 1;
-                if (align == 0) {
-                    ldata.ushort = vl_read(fp_f, offset);
+            addr -= skip;
+            while (span > 0) {
+                ot_int n = sizeof(buffer) - skip;
+                if (n > span) {
+                    n = span;
                 }
-                output += load_function( &j, ldata.ubyte[align] );
-                offset++;
+                vworm_read_block(addr, buffer, n+skip);
+                output += load_function(&j, &buffer[skip], n);
+                addr   += n+skip;
+                span   -= n;
+                skip    = 0;
             }
-            // reset offset to 0, so the process resumes at next series file
-            offset = 0;
         }
-        vl_close(fp_f);
+        offset = 0;
+    }
+    
+    return output;
+}
+
+
+
+#ifndef EXTF_m2qp_load_isf
+ot_int m2qp_load_isf(   ot_u8       is_series, 
+                        ot_u8       isf_id, 
+                        ot_int      offset, 
+                        ot_int      window_bytes,
+                        m2qp_loadfn load_function,
+                        id_tmpl*    user_id ) {
+/// Do not respond if the file, the series, or a file of the series is not
+/// accessible (return negative)
+    isfcall_member  member[M2_PARAM(ISFSCALL)];
+    ot_int          n_members;
+    
+    n_members = sub_isfcall_resolve(member, is_series, isf_id, user_id);
+    if (n_members < 0) {
+        return -32768;
     }
-    vl_close(fp_s);
     
     ///@todo Here is where an algorithm could go to manage the way "scoring" is
     /// done for search-based load operations.
     
-    return output;
+    return sub_isfcall_load(member, n_members, offset, window_bytes, load_function);
 }
 #endif
 
@@ -1003,75 +2567,173 @@ ot_int m2qp_load_isf(   ot_u8       is_series,
   * - Used as the load_function() argument to sub_load_isf()
   */
 
-ot_int sub_load_charcorrelation(ot_int* cursor, ot_u8 data_byte) {
-/// This is a pure character-by-character correlation, which is not as efficient
-/// for comparing strings as more specialized methods (The Boyer-Moore-Horspool
-/// method might fit nicely here) but it gives the ability to report partial
-/// matches, which the BM or BMH methods do not.
-///
-/// A correlation is a mathematic process for comparing two sequences, so check
-/// Wikipedia for more info (http://en.wikipedia.org/wiki/Cross-correlation).
-/// This function performs a correlation of a byte-wise token onto a byte-wise 
-/// datastream.  The token is usually supplied in the command data (stored in 
-/// shared memory), and the datastream is fed into this function byte-by-byte
-/// (usually referenced from file data).
-
-    ot_int i;
-    ot_int c;
+void sub_init_charcorrelation() {
+    ot_int length       = (ot_int)m2qp.qtmpl.length;
+    ot_int threshold    = (ot_int)(m2qp.qtmpl.code & M2QC_COR_THRMASK);
+    ot_int j;
     
-    /// The datastream is buffered in an unused part of the data-queue.
-    /// The LOCAL_U8() macro behaves similar to array nomenclature
-    LOCAL_U8(*cursor) = data_byte;
+    /// A window scores (matches - misses), and it passes when the score is at
+    /// least the threshold.  That is the same as having no more misses than
+    /// (length - threshold)/2.  If allowed is negative, no window can pass.
+    m2qp.corr.head      = -1;
+    m2qp.corr.skip      = 0;
+    m2qp.corr.allowed   = (threshold > length) ? -1 : ((length - threshold) >> 1);
     
-    /// If the datastream is *not* fully pre-buffered, return to the caller.
-    /// If the datastream is fully pre-buffered, then proceed to correlation.
-    if ( *cursor < (m2qp.qtmpl.length-1) ) {
-        (*cursor)++;
-        return 0;
+    /// The filter says which byte values can appear in the token (except its
+    /// last byte), so most bytes get the full shift without searching.  A
+    /// masked token byte can match anything, so it turns the filter off.
+    m2qp.corr.filter    = 0;
+    for (j=0; j<(length-1); j++) {
+        if (m2qp.qtmpl.mask[j] != 0xFF) {
+            m2qp.corr.filter = 0xFFFFFFFF;
+            break;
+        }
+        m2qp.corr.filter |= ((ot_u32)1 << (m2qp.qtmpl.value[j] & 31));
     }
+}
+
+
+ot_int sub_load_charcorrelation(ot_int* cursor, const ot_u8* span, ot_int length) {
+/// This is a character-by-character correlation of a byte-wise token onto a 
+/// byte-wise datastream.  A correlation is a mathematic process for comparing
+/// two sequences (http://en.wikipedia.org/wiki/Cross-correlation), and it can 
+/// report partial matches.  The token is usually supplied in the command data
+/// (stored in shared memory), and the datastream is fed into this function 
+/// span-by-span (usually referenced from file data).
+///
+/// The datastream is buffered as a ring, so each new byte is one store, and
+/// each window is compared from its newest byte back, stopping as soon as 
+/// the window has too many misses to pass.  When the query needs an exact
+/// match, the Boyer-Moore-Horspool shift is used to skip windows that cannot
+/// match.  The threshold, in the lower 5 bits of the query code, is an 
+/// integer value: windows that score at or above it are passing, and the 
+/// query score is the number of passing windows.
+    ot_int  tlength = (ot_int)m2qp.qtmpl.length;
+    ot_int  score   = 0;
     
-    /// Equality Correlation with data shifting of the buffer after each
-    /// comparison operation.  The value c is the comparison score.  It is a
-    /// bipolar accumulator, so a non-equality alters the score by -1 and an
-    /// equality by +1.  It is implemented as c += (0 or 2) - 1
-    else {
-        for (i=0, c=0; i<m2qp.qtmpl.length; i++) {
-            c += ( (LOCAL_U8(i) & m2qp.qtmpl.mask[i]) == \
-                   (m2qp.qtmpl.value[i] & m2qp.qtmpl.mask[i]) ) << 1;
-            c -= 1;
+    for (; length > 0; length--) {
+        ot_u8   data_byte = *span++;
+        ot_int  head;
+        ot_int  i;
+        ot_int  misses;
+        
+        /// The datastream is buffered in the query block.
+        /// The LOCAL_U8() macro behaves similar to array nomenclature.
+        /// If the datastream is *not* fully pre-buffered, go to the next byte.
+        if ( *cursor < (tlength-1) ) {
+            LOCAL_U8(*cursor)   = data_byte;
+            m2qp.corr.head      = *cursor;
+            (*cursor)++;
+            continue;
+        }
+        (*cursor)++;
+        
+        /// Put the new byte over the oldest one: nothing else in the ring moves
+        head = m2qp.corr.head + 1;
+        if (head >= tlength) {
+            head = 0;
+        }
+        m2qp.corr.head  = head;
+        LOCAL_U8(head)  = data_byte;
+        
+        /// Skip windows that the last shift proved could not match
+        if (m2qp.corr.skip != 0) {
+            m2qp.corr.skip--;
+            continue;
+        }
+        if (m2qp.corr.allowed < 0) {
+            continue;
+        }
+        
+        /// Masked comparison from the newest byte to the oldest.  Window 
+        /// position i is in the ring at (head + 1 + i) modulo length.
+        misses = 0;
+        for (i=(tlength-1); i>=0; i--) {
+            ot_u8 mask = m2qp.qtmpl.mask[i];
             
-            LOCAL_U8(i-1) = LOCAL_U8(i);
+            if ((LOCAL_U8(head) & mask) != (m2qp.qtmpl.value[i] & mask)) {
+                if (++misses > m2qp.corr.allowed) {
+                    break;
+                }
+            }
+            head = (head == 0) ? (tlength-1) : (head-1);
+        }
+        
+        /// Only exact-match queries can use the shift: with misses allowed, a 
+        /// skipped window might still pass.
+        if (m2qp.corr.allowed == 0) {
+            m2qp.corr.skip = sub_charcorrelation_shift(data_byte) - 1;
         }
+        
+        score += (misses <= m2qp.corr.allowed);
     }
     
-    /// One parameter of the correlation query is a correlation threshold.  It
-    /// occupies the lower 5 bits of the query code.  It is an integer value.
-    /// Scores higher than the threshold are passing scores.  The query score
-    /// indicates the number of hits the query made on the file data.
-    return (c >= (ot_int)(m2qp.qtmpl.code & 0x1F));  
+    return score;
 }
 
 
-ot_int sub_load_comparison(ot_int* cursor, ot_u8 data_byte) {
+ot_int sub_charcorrelation_shift(ot_u8 data_byte) {
+/// The next window that can match is the one that lines up this byte with its
+/// nearest match in the token, not counting the last token byte.
+    ot_int j;
+    
+    if ((m2qp.corr.filter & ((ot_u32)1 << (data_byte & 31))) != 0) {
+        for (j=(ot_int)m2qp.qtmpl.length-2; j>=0; j--) {
+            ot_u8 mask = m2qp.qtmpl.mask[j];
+            if ((data_byte & mask) == (m2qp.qtmpl.value[j] & mask)) {
+                return (ot_int)m2qp.qtmpl.length - 1 - j;
+            }
+        }
+    }
+    return (ot_int)m2qp.qtmpl.length;
+}
+
+
+ot_int sub_load_comparison(ot_int* cursor, const ot_u8* span, ot_int length) {
 /// Just loads comparison data, from the file system, into the local buffer.  
 /// Comparison is limited to16 bytes per the Mode 2 Spec.
-    LOCAL_U8(*cursor) = data_byte;
-    (*cursor)++;
+    platform_memcpy(&LOCAL_U8(*cursor), (ot_u8*)span, length);
+    *cursor += length;
     return 0;  
 }
 
 
-ot_int sub_load_return(ot_int* cursor, ot_u8 data_byte) {
+ot_int sub_load_pair(ot_int* cursor, const ot_u8* span, ot_int length) {
+/// Both queries see the same data, so they share the cursor.  Each one is 
+/// swapped in for its turn, and only gets the part of the span that is in 
+/// its window.
+    ot_int i;
+    
+    for (i=0; i<2; i++) {
+        ot_int n    = qpair.window[i] - *cursor;
+        ot_int j    = *cursor;
+        
+        if (n > length) {
+            n = length;
+        }
+        if (n > 0) {
+            qpair.score[i] += qpair.load[i](&j, span, n);
+        }
+        sub_query_swap();
+    }
+    
+    *cursor += length;
+    return 0;
+}
+
+
+ot_int sub_load_return(ot_int* cursor, const ot_u8* span, ot_int length) {
 /// Just loads file data into the TX queue.
-    q_writebyte(&txq, data_byte);
-    (*cursor)++;
+    q_writestring(&txq, (ot_u8*)span, length);
+    *cursor += length;
     return 0;  
 }
 
 
-ot_int sub_load_nonnull(ot_int* cursor, ot_u8 data_byte) {
+ot_int sub_load_nonnull(ot_int* cursor, const ot_u8* span, ot_int length) {
 /// Does Nothing: the nonnull comparison only requires that the specified file
 /// exists on the device.
+    *cursor += length;
     return 0;
 }
 
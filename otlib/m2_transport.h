@@ -34,6 +34,128 @@
 #include "queue.h"
 
 
+/// Number of recent ISF comparison results that M2QP keeps (0 = none).  A
+/// repeated query on files that have not changed is answered from the cache.
+#ifndef M2_PARAM_QCACHE
+#   define M2_PARAM_QCACHE      0
+#endif
+
+/// Most files in an ISF Series that an ISFS Call can return.  A call to a
+/// longer series is not answered.
+#ifndef M2_PARAM_ISFSCALL
+#   define M2_PARAM_ISFSCALL    16
+#endif
+
+/// Framed-slotted collection: with the FSA CA code, each responder to an A2P
+/// request hashes its UID into one slot of the contention period, and the
+/// requester resizes the contention period between rounds.
+#ifndef M2_FEATURE_FSACOLLECT
+#   define M2_FEATURE_FSACOLLECT    DISABLED
+#endif
+
+/// Largest frame exponent used by framed-slotted collection (2^q slots)
+#ifndef M2_PARAM_FSAMAXQ
+#   define M2_PARAM_FSAMAXQ     8
+#endif
+
+/// Compressed A2P ACK set: the ACK field of a request may be a Bloom filter of
+/// responder IDs, [0x80 | size][number of ACKs][2^size bytes of filter], in
+/// place of the list of IDs.  Each ID sets M2_PARAM_ACKBLOOM_K filter bits.
+#ifndef M2_FEATURE_ACKBLOOM
+#   define M2_FEATURE_ACKBLOOM      DISABLED
+#endif
+#ifndef M2_PARAM_ACKBLOOM_K
+#   define M2_PARAM_ACKBLOOM_K  3
+#endif
+#define M2_ACKBLOOM             0x80
+#define M2_ACKBLOOM_SIZEMASK    0x07
+#define M2_ACKBLOOM_MAXSIZE     5
+
+/// Sorted A2P ACK list: [0x40 | number of ACKs][IDs in ascending byte order].
+/// Responders find their ID by bisection, and the list holds up to 63 IDs.
+#ifndef M2_FEATURE_ACKSORT
+#   define M2_FEATURE_ACKSORT       DISABLED
+#endif
+#define M2_ACKSORT              0x40
+#define M2_ACKSORT_COUNTMASK    0x3F
+
+/// Differential collection: a collection with opcode M2OP_COL_DF or COL_DS has
+/// the CRC16 of the data window the requester already has after its ISF Call
+/// Template.  A responder whose window has the same CRC sends only the return
+/// header, which means "unchanged".  Requesters keep the last window of up to
+/// M2_PARAM_DIFFTAGS tags and put it back into unchanged responses.
+#ifndef M2_FEATURE_DIFFCOLLECT
+#   define M2_FEATURE_DIFFCOLLECT   DISABLED
+#endif
+#ifndef M2_PARAM_DIFFTAGS
+#   define M2_PARAM_DIFFTAGS    4
+#endif
+#ifndef M2_PARAM_DIFFBYTES
+#   define M2_PARAM_DIFFBYTES   32
+#endif
+
+/// Packed collection: a collection request with M2CE_PACK in its command
+/// extension may get a response with its data window packed by otutils_pack().
+/// A packed response has the extension flag on its command code, and an
+/// extension byte with M2CE_PACK, so requesters can tell.  Datastreams are not
+/// packed (M2CE_PACK is the scrap bit of a datastream).
+#ifndef M2_FEATURE_PACK
+#   define M2_FEATURE_PACK          DISABLED
+#endif
+
+/// Pipelined dialogs: a gateway or subcontroller keeps the dialog ID and the
+/// command of each request it sends, in a table of M2_PARAM_PIPELINE requests.
+/// A response is parsed with the command of its own request, so the next 
+/// request can go out before the responses to the last one are all in.  An
+/// entry is good for M2_PARAM_PIPETIME ticks after its request, except for the
+/// newest one.  A unicast dialog is over when its response is in.
+#ifndef M2_FEATURE_PIPELINE
+#   define M2_FEATURE_PIPELINE      DISABLED
+#endif
+#ifndef M2_PARAM_PIPELINE
+#   define M2_PARAM_PIPELINE    4
+#endif
+#ifndef M2_PARAM_PIPETIME
+#   define M2_PARAM_PIPETIME    1024
+#endif
+#define M2QP_PIPELINE   ((M2_FEATURE(PIPELINE) == ENABLED) && \
+                        ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED)))
+
+/// Inventory planner: a gateway or subcontroller runs the rounds of an A2P
+/// inventory by itself, on a policy from the host (m2qp_inv_start() or ALP).
+/// It keeps the tags that respond in a set of M2_PARAM_INVTAGS IDs and ACKs
+/// them on the next round, sizes the rounds with framed-slotted collection,
+/// and puts each round on the next of up to M2_PARAM_INVCHANNELS channels.
+/// The responses still go to the host as they come in.
+#ifndef M2_FEATURE_INVENTORY
+#   define M2_FEATURE_INVENTORY     DISABLED
+#endif
+#ifndef M2_PARAM_INVTAGS
+#   define M2_PARAM_INVTAGS     16
+#endif
+#ifndef M2_PARAM_INVCHANNELS
+#   define M2_PARAM_INVCHANNELS 4
+#endif
+#define M2QP_INVENTORY  ((M2_FEATURE(INVENTORY) == ENABLED) && \
+                         (M2_FEATURE(FSACOLLECT) == ENABLED) && \
+                         (OT_FEATURE(CAPI) == ENABLED) && \
+                        ((M2_FEATURE(GATEWAY) == ENABLED) || (M2_FEATURE(SUBCONTROLLER) == ENABLED)))
+
+/// ALP shell: the data of a shell request (M2OP_UDP_F/S) to port M2QP_PORT_ALP
+/// is ALP records, [flags][payload length][ID][CMD][payload], as in M2DP.
+/// They are run by alp_proc() in order, straight from rxq, with the requester
+/// as the user (as in an ISF call), and the output records are written in the
+/// same format straight into the response in txq.  So a gateway can do a set
+/// of file and management operations on a tag in one dialog.
+#ifndef M2_FEATURE_ALPSHELL
+#   define M2_FEATURE_ALPSHELL      DISABLED
+#endif
+#ifndef M2QP_PORT_ALP
+#   define M2QP_PORT_ALP        16
+#endif
+#define M2QP_ALPSHELL   ((M2_FEATURE(ALPSHELL) == ENABLED) && (OT_FEATURE(ALP) == ENABLED))
+
+
 
 // Mode 2 Application Subprotocol IDs
 #define M2SPID_NULL             (0x00)
@@ -72,6 +194,8 @@
 #define M2OP_COL_SF             0x07        //Collection: Series/File
 #define M2OP_COL_FS             0x08        //Collection: File/Series
 #define M2OP_COL_SS             0x09        //Collection: Series/Series
+#define M2OP_COL_DF             0x0A        //Differential Collection: File (OpenTag extension)
+#define M2OP_COL_DS             0x0B        //Differential Collection: Series (OpenTag extension)
 #define M2OP_DS_REQUEST         0x0C        //Datastream Request
 #define M2OP_DS_PROPOSE         0x0D        //Datastream Propose
 #define M2OP_DS_ACK             0x0E        //Datastream Acknowledge
@@ -80,13 +204,16 @@
 
 
 // M2QP Command Extension Options
+#define M2CE_NETTIME            (0x01 << 0)     // OpenTag extension
 #define M2CE_NORESP             (0x01 << 1)
 #define M2CE_NOCSMA             (0x01 << 2)
 #define M2CE_CA_MASK            (0x07 << 3)
 #define M2CE_CA_RIGD            (0x00 << 3)
 #define M2CE_CA_RAIND           (0x01 << 3)
 #define M2CE_CA_AIND            (0x02 << 3)
+#define M2CE_CA_FSA             (0x04 << 3)     // OpenTag extension
 #define M2CE_SCRAP              (0x01 << 6)
+#define M2CE_PACK               (0x01 << 6)     // OpenTag extension, collections only
 #define M2CE_NOACK              (0x01 << 7)
 
 // Mode 2 Query Comparisons 
@@ -139,6 +266,134 @@ typedef struct {
     ot_u8   ext;
 } cmd_data;
 
+/** corr_data
+  * State of a correlation (string search) query while data is fed to it.
+  *
+  * head:       position of the newest byte in the window ring
+  * skip:       windows left to pass over without comparing (Horspool shift)
+  * allowed:    misses a window may have and still pass the threshold
+  * filter:     bit (b & 31) is set for each token byte b that may shift
+  */
+typedef struct {
+    ot_int  head;
+    ot_int  skip;
+    ot_int  allowed;
+    ot_u32  filter;
+} corr_data;
+
+/** fsa_data
+  * State of a framed-slotted collection.  The requester keeps the frame size
+  * and the tallies of the current round.  The responder keeps the round seed.
+  *
+  * q:          frame size exponent (2^q slots in the contention period)
+  * seed:       responder: number of ACKs in the last request
+  * good:       requester: responses received in the current round
+  * damaged:    requester: frames received with errors in the current round
+  */
+typedef struct {
+    ot_u8   q;
+    ot_u8   seed;
+    ot_u8   good;
+    ot_u8   damaged;
+} fsa_data;
+
+
+/** pipe_data
+  * Requests of a gateway that responses are still taken for (M2QP_PIPELINE).
+  *
+  * next:       entry that the next request goes into
+  * current:    entry of the response being parsed
+  * entry[]     stamp:      platform_stamp() when the request was closed
+  *             dialog_id:  dialog ID of the request
+  *             open:       0 if the entry is not in use
+  *             unicast:    non-zero for a unicast request
+  *             cmd:        command of the request
+  */
+typedef struct {
+    ot_u32      stamp;
+    ot_u8       dialog_id;
+    ot_u8       open;
+    ot_u8       unicast;
+    cmd_data    cmd;
+} pipe_entry;
+
+typedef struct {
+    ot_u8       next;
+    ot_u8       current;
+    pipe_entry  entry[M2_PARAM(PIPELINE)];
+} pipe_data;
+
+
+/** inv_policy
+  * Policy of the inventory planner (M2QP_INVENTORY), from the host.
+  *
+  * opcode:     M2OP of the requests: an announcement or a collection
+  * flags:      M2_INV_VID:  tags are addressed, and ACKed, by VID
+  *             M2_INV_KEEP: the tag set is kept from one pass to the next
+  * subnet:     subnet of the requests
+  * q:          frame size exponent of the first round of a pass
+  * slot_ticks: duration of one response slot, in ticks
+  * rounds:     most rounds in a pass (0 = 255).  A silent round ends it, too.
+  * tca:        CSMA-CA time of each request, in ticks
+  * period:     ticks from the end of one pass to the start of the next, up
+  *             to 32767 (0 = one pass)
+  * comp_id:    ISF ID of the comparison (a null query runs on it)
+  * call_id:    ISF ID of the call, for collections
+  * max_return: most bytes returned by the call
+  * channels:   number of channels in chanlist[], one per round in turn
+  */
+#define M2_INV_VID      0x01
+#define M2_INV_KEEP     0x02
+
+typedef struct {
+    ot_u8   opcode;
+    ot_u8   flags;
+    ot_u8   subnet;
+    ot_u8   q;
+    ot_u16  slot_ticks;
+    ot_u8   rounds;
+    ot_u8   tca;
+    ot_u16  period;
+    ot_u8   comp_id;
+    ot_u8   call_id;
+    ot_u8   max_return;
+    ot_u8   channels;
+    ot_u8   chanlist[M2_PARAM(INVCHANNELS)];
+} inv_policy;
+
+
+/** inv_data
+  * State of the inventory planner (M2QP_INVENTORY).
+  *
+  * state:      M2_INV_OFF, M2_INV_START (pass due now), M2_INV_WAIT (pass due
+  *             at period after stamp) or M2_INV_ROUND (a round is on air)
+  * round:      rounds done in the pass
+  * chan:       index in chanlist[] of the next round
+  * length:     ID length of the tags in the set (2 for VID, 8 for UID)
+  * pass:       passes done
+  * count:      tags in the set
+  * fresh:      tags added to the set in the pass
+  * stamp:      platform_stamp() at the end of the last pass
+  * tag[]:      the tag set, in the order the tags were heard
+  */
+#define M2_INV_OFF      0
+#define M2_INV_START    1
+#define M2_INV_WAIT     2
+#define M2_INV_ROUND    3
+
+typedef struct {
+    ot_u8       state;
+    ot_u8       round;
+    ot_u8       chan;
+    ot_u8       length;
+    ot_u16      pass;
+    ot_u16      count;
+    ot_u16      fresh;
+    ot_u32      stamp;
+    inv_policy  policy;
+    ot_u8       tag[M2_PARAM(INVTAGS)][8];
+} inv_data;
+
 
 
 /** ot_sigresp function pointer type
@@ -175,7 +430,18 @@ typedef struct {
 typedef struct {
     cmd_data        cmd;        // internal usage
     query_data      qdata;      // internal usage
+    corr_data       corr;       // internal usage
     query_tmpl      qtmpl;
+    ot_u8*          qbuf;       // internal usage: query block, from the scratch pool
+#   if (M2_FEATURE(FSACOLLECT) == ENABLED)
+        fsa_data    fsa;        // internal usage
+#   endif
+#   if (M2QP_PIPELINE)
+        pipe_data   pipe;       // internal usage
+#   endif
+#   if (M2QP_INVENTORY)
+        inv_data    inv;        // internal usage
+#   endif
 #   if (OT_FEATURE(M2QP_CALLBACKS) == ENABLED)
         m2qp_sigs   signal;
 #   endif
@@ -310,6 +576,189 @@ void m2qp_mark_dsframe();
 
 
 
+/** Framed-Slotted Collection
+  * ========================================================================<BR>
+  * A requester starts a collection with m2qp_fsa_init() and puts the timeout
+  * code from m2qp_fsa_timeout() into the dialog template of each A2P request
+  * that uses M2CE_CA_FSA.  Responders pick a slot with m2qp_fsa_offset(), and
+  * responders on the ACK list stay quiet.  Between rounds, m2qp_fsa_endround()
+  * adjusts the frame size: damaged frames are taken as collisions, and the
+  * next frame is sized to the estimated backlog (2.39 tags per collision).
+  */
+
+/** @brief  Starts a framed-slotted collection
+  * @param  q           (ot_u8) frame size exponent for the first round
+  * @retval none
+  * @ingroup M2QP
+  */
+void m2qp_fsa_init(ot_u8 q);
+
+
+/** @brief  Returns the dialog timeout code for the current round
+  * @param  slot_ticks  (ot_uint) duration of one response, in ticks
+  * @retval ot_u8       timeout code for 2^q response slots
+  * @ingroup M2QP
+  */
+ot_u8 m2qp_fsa_timeout(ot_uint slot_ticks);
+
+
+/** @brief  Ends a round of framed-slotted collection and resizes the frame
+  * @param  none
+  * @retval ot_bool     False when the round was silent (collection finished)
+  * @ingroup M2QP
+  */
+ot_bool m2qp_fsa_endround();
+
+
+/** @brief  Tallies a damaged frame received during a collection round
+  * @param  session     (m2session*) the active session
+  * @retval none
+  * @ingroup M2QP
+  *
+  * Run this in the system module when a frame is received with errors.
+  */
+void m2qp_fsa_damaged(m2session* session);
+
+
+/** @brief  Returns the responder's TX offset in the contention period
+  * @param  slot_ticks  (ot_uint) duration of one response, in ticks
+  * @retval ot_uint     ticks until the start of this responder's slot
+  * @ingroup M2QP
+  *
+  * The slot is a hash of the device UID and the number of ACKs on the request,
+  * so a responder that collides moves to a different slot on the next round.
+  */
+ot_uint m2qp_fsa_offset(ot_uint slot_ticks);
+
+
+
+
+
+/** Compressed ACK Set and Sorted ACK List
+  * ========================================================================<BR>
+  * An A2P requester that expects more responders than an ID list can hold
+  * opens a Bloom filter ACK set in the request with m2qp_put_ackbloom().  Each
+  * A2P response then sets the bits of the responder's ID, so the next request
+  * silences every responder so far in 2^size bytes.  A false positive silences
+  * a responder that was not heard, so size the filter to the population: at
+  * K = 3, 32 bytes hold about 40 IDs at 5% false positives.
+  */
+
+/** @brief  Writes an empty Bloom filter ACK set into the TX queue
+  * @param  size        (ot_u8) filter size exponent: 2^size bytes (0-5)
+  * @retval none
+  * @ingroup M2QP
+  *
+  * Call this where the ACK field goes in the request.  It marks the field with
+  * txq.getcursor, as for an ACK list.
+  */
+void m2qp_put_ackbloom(ot_u8 size);
+
+
+/** @brief  Writes an empty sorted ACK list into the TX queue
+  * @param  none
+  * @retval none
+  * @ingroup M2QP
+  *
+  * Like an ACK list, but each A2P response inserts the responder's ID in byte
+  * order, so a responder checks a long list in log2(count) compares.  The 
+  * list holds up to 63 IDs.  Call this where the ACK field goes in the 
+  * request.
+  */
+void m2qp_put_acksort(void);
+
+
+/** @brief  Writes the ISF Call Template and the check of a differential
+  *         collection into the TX queue
+  * @param  status      (ot_u8*) set to 1
+  * @param  isfcall     (isfcall_tmpl*) the ISF Call Template
+  * @param  tag         (id_tmpl*) the tag that is polled, or NULL for any tag
+  *                     that was last collected with the same call
+  * @retval ot_u16      the length of txq
+  * @ingroup M2QP
+  *
+  * Use it in place of otapi_put_isf_call() in a M2OP_COL_DF or M2OP_COL_DS 
+  * request.  The check is the CRC16 of the window last received for the call,
+  * or of nothing if it is not kept.  Unchanged responses to the request get 
+  * that window back before they go to the host or to the callbacks.  Only for
+  * gateways and subcontrollers with M2_FEATURE(DIFFCOLLECT).
+  */
+ot_u16 m2qp_put_diffcall(ot_u8* status, isfcall_tmpl* isfcall, id_tmpl* tag);
+
+
+
+/** @brief  Keeps the request that was just closed in the dialog pipeline
+  * @param  session     (m2session*) session of the request
+  * @retval none
+  * @ingroup M2QP
+  *
+  * otapi_close_request() calls it.  The entry takes the dialog ID of the 
+  * session, the command in m2qp.cmd, and the addressing in m2np.header.  A
+  * request that is closed again with the same dialog ID stays in its entry.
+  * Only for gateways and subcontrollers with M2_FEATURE(PIPELINE).
+  */
+void m2qp_pipe_open(m2session* session);
+
+
+/** @brief  Looks up the request of a response in the dialog pipeline
+  * @param  dialog_id   (ot_u8) dialog ID of the response
+  * @retval ot_bool     True if there is a request with the dialog ID
+  * @ingroup M2QP
+  *
+  * The network layer calls it for each response frame.  If the request is
+  * there, its command goes into m2qp.cmd, for the response to be parsed with.
+  * Only for gateways and subcontrollers with M2_FEATURE(PIPELINE).
+  */
+ot_bool m2qp_pipe_match(ot_u8 dialog_id);
+
+
+
+
+/** Inventory Planner
+  * ========================================================================<BR>
+  * The host sets a policy with m2qp_inv_start(), and the planner does the
+  * rest from the idle task of the kernel: each round is a multicast A2P
+  * request with a null query, the FSA CA code, and an ACK list of the tags in
+  * the set.  A pass is over after a silent round or after policy.rounds, and
+  * the next pass starts after policy.period.  The ACK list only takes the
+  * newest tags that fit in the request, so size M2_PARAM_INVTAGS to the frame.
+  */
+
+/** @brief  Starts the inventory planner
+  * @param  policy      (inv_policy*) the policy, which is copied
+  * @retval ot_bool     False if the policy is not good
+  * @ingroup M2QP
+  *
+  * The first pass starts the next time the kernel is idle.  Only for gateways
+  * and subcontrollers with M2_FEATURE(INVENTORY) and M2_FEATURE(FSACOLLECT).
+  */
+ot_bool m2qp_inv_start(inv_policy* policy);
+
+
+/** @brief  Stops the inventory planner
+  * @param  none
+  * @retval none
+  * @ingroup M2QP
+  *
+  * A round that is on air finishes.  The tag set stays, for reading.
+  */
+void m2qp_inv_stop(void);
+
+
+/** @brief  Runs the inventory planner when the kernel is idle
+  * @param  event_eta   (ot_long*) ticks to the next kernel event
+  * @retval ot_bool     True if a round was started
+  * @ingroup M2QP
+  *
+  * The idle task of the kernel calls it when there is no session.  It ends the
+  * round that was on air and starts the next one, or it makes event_eta no
+  * longer than the wait for the next pass.
+  */
+ot_bool m2qp_inv_run(ot_long* event_eta);
+
+
+
+
 
 /** Static Callbacks
   * ========================================================================<BR>
@@ -358,6 +807,12 @@ ot_bool m2qp_sig_udpreq(id_tmpl* id, ot_int payload_length, ot_u8* payload);
   * these types of comparisons, a threshold value is specified in the comparison
   * input data.  If the score is below threshold, it will be returned as 0.  If 
   * it is equal or higher, the actual score will be returned.
+  *
+  * @note Query cache
+  * When M2_PARAM_QCACHE > 0, the results of the last few comparisons are kept.
+  * If the same query comes from the same requester for the same ISF target,
+  * and no file has changed since (see vl_writestamp and vl_mapstamp), the 
+  * cached score is returned without reading the files.
   */
 ot_int m2qp_isf_comp(ot_u8 is_series, id_tmpl* user_id);
 
@@ -385,12 +840,20 @@ ot_int m2qp_isf_call( ot_u8 is_series, Queue* input_q, id_tmpl* user_id );
 
 
 
+/** m2qp_loadfn
+  * Processing function for m2qp_load_isf().  It gets the window cursor (bytes
+  * of the window processed before this span), and a span of contiguous data,
+  * which it must process all of and add to the cursor.
+  */
+typedef ot_int (*m2qp_loadfn)(ot_int* cursor, const ot_u8* span, ot_int length);
+
+
 /** @brief Toolkit function for accessing UDB data, processing it, and returning a value
   * @param  is_series     (ot_u8)   0 is for UDB Element, non-zero for UDB List
   * @param  isf_id        (ot_int)  ID for the UDB Element or List
   * @param  offset        (ot_int)  Byte offset into the UDB dataset
   * @param  window_bytes  (ot_int)  Number of bytes, following offset, to process
-  * @param  load_function (ot_int (*)(ot_int*, ot_u8) ) Processing function
+  * @param  load_function (m2qp_loadfn) Processing function
   * @retval ot_int        A running sum of returns from the processing function
   * @ingroup Protocol_Special
   * @sa pm2_isf_comp()
@@ -404,16 +867,18 @@ ot_int m2qp_isf_call( ot_u8 is_series, Queue* input_q, id_tmpl* user_id );
   * It is one of the cooler and more useful functions in OpenTag.
   * 
   * The processing function is a subroutine that takes in an index pointer (this
-  * is issued by pm2_load_isf() ) and a byte of data.  It can do whatever it
-  * wants to the data, and return whatever it wants.  There are currently three
-  * subroutines used as processing functions for different tasks: 
+  * is issued by pm2_load_isf() ) and a span of data: as much of the window as
+  * is contiguous in one file, read in place when veelite allows it, or a block
+  * read of it otherwise.  It can do whatever it wants to the data, and return
+  * whatever it wants.  There are currently three subroutines used as 
+  * processing functions for different tasks: 
   * sub_load_charcorrelation(), sub_load_comparison(), sub_load_return()
   */
 ot_int m2qp_load_isf(   ot_u8       is_series, 
                         ot_u8       isf_id, 
                         ot_int      offset, 
                         ot_int      window_bytes,
-                        ot_int      (*load_function)(ot_int*, ot_u8),
+                        m2qp_loadfn load_function,
                         id_tmpl*    user_id );
 
 
@@ -56,17 +56,112 @@
 #if (OT_FEATURE(MPIPE) == ENABLED)
 
 
+/** OT_FEATURE_MPIPE_USBBULK
+  * USB MPipe drivers (MCU_FEATURE_MPIPEVCOM) normally move one NDEF message
+  * per transfer, half duplex, like the UART.  In bulk mode, messages given to
+  * mpipe_txndef() while a transfer is underway are batched into the next one,
+  * so one transfer of 64 byte full-speed packets can carry several messages.
+  * Received messages that share a packet are delivered one after the other.
+  * The STM32F10x USB-FS driver also double-buffers its bulk endpoints.
+  */
+#ifndef OT_FEATURE_MPIPE_USBBULK
+#   define OT_FEATURE_MPIPE_USBBULK     DISABLED
+#endif
+
+
+/** OT_FEATURE_MPIPE_GATHER
+  * Gather TX: mpipe_txsegs() sends one frame made of several segments (an
+  * NDEF header segment, and payload left where it is, such as in dir_in), so
+  * the payload is not copied into a TX buffer first.  The sequence and CRC
+  * footer are kept by the driver.  Supported by the MSP430F5 UART driver,
+  * which chains the segments on its TX DMA, and by the POSIX driver.  NDEF 
+  * uses it for ALP responses when dir_in and dir_out are separate 
+  * (OT_FEATURE(MPIPE_DUPLEX)).
+  */
+#ifndef OT_FEATURE_MPIPE_GATHER
+#   define OT_FEATURE_MPIPE_GATHER      DISABLED
+#endif
+
+
+/** OT_FEATURE_MPIPE_PORTS
+  * Concurrent MPipe ports: more than one MPipe driver is built into the
+  * image (e.g. USB to the host and UART to a co-processor), and each one is a
+  * port with its own state, sequence and RX buffer.  The mpipe_...() API below
+  * is then the port layer (mpipe_port.c).  Each port listens on its own, and
+  * a message that arrives while the NDEF server is busy with another port is
+  * held in that port until the server is free, so the ports take turns.
+  * 
+  * TX goes to the port of the last message that came in, so responses return
+  * to where the request came from.  MPIPE_Broadcast TX (logs, forwarded
+  * responses, captures) always goes to the host port, which is the first one
+  * in MPIPE_PORT_LIST.  mpipe_status() is busy if any port is busy.
+  * 
+  * A driver is built as a port when it defines MPIPE_DRIVER (its port name)
+  * before it includes mpipe.h: its mpipe_...() functions are then named
+  * mpipe_..._[name], its state is mpipe_obj_[name], and MPIPE_PORT_DEFINE()
+  * makes its table, mpipe_port_[name].  The UART and USB drivers of the
+  * STM32F10x and the MSP430F5, and the POSIX driver, are ports.  Ports need dynamic
+  * callbacks (OT_FEATURE(MPIPE_CALLBACKS)).  The ISR of a port driver is 
+  * mpipe_isr_[name]().
+  */
+#ifndef OT_FEATURE_MPIPE_PORTS
+#   define OT_FEATURE_MPIPE_PORTS       DISABLED
+#endif
+#ifndef MPIPE_PORT_RXMAX
+#   define MPIPE_PORT_RXMAX             (6 + 255 + 4)   // header, payload, footer
+#endif
+
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+#   if (OT_FEATURE(MPIPE_CALLBACKS) != ENABLED)
+#       error "OT_FEATURE(MPIPE_PORTS) needs OT_FEATURE(MPIPE_CALLBACKS)"
+#   endif
+#   if defined(MPIPE_DRIVER)
+#       define MPIPE_DRVCAT2(NAME, DRV)     mpipe_##NAME##_##DRV
+#       define MPIPE_DRVCAT(NAME, DRV)      MPIPE_DRVCAT2(NAME, DRV)
+#       define MPIPE_DRVNAME(NAME)          MPIPE_DRVCAT(NAME, MPIPE_DRIVER)
+#       define mpipe                        MPIPE_DRVCAT(obj, MPIPE_DRIVER)
+#       define mpipe_footerbytes            MPIPE_DRVNAME(footerbytes)
+#       define mpipe_init                   MPIPE_DRVNAME(init)
+#       define mpipe_kill                   MPIPE_DRVNAME(kill)
+#       define mpipe_wait                   MPIPE_DRVNAME(wait)
+#       define mpipe_setspeed               MPIPE_DRVNAME(setspeed)
+#       define mpipe_status                 MPIPE_DRVNAME(status)
+#       define mpipe_setsig_txdone          MPIPE_DRVNAME(setsig_txdone)
+#       define mpipe_setsig_rxdone          MPIPE_DRVNAME(setsig_rxdone)
+#       define mpipe_setsig_rxdetect        MPIPE_DRVNAME(setsig_rxdetect)
+#       define mpipe_txndef                 MPIPE_DRVNAME(txndef)
+#       define mpipe_txsegs                 MPIPE_DRVNAME(txsegs)
+#       define mpipe_rxndef                 MPIPE_DRVNAME(rxndef)
+#       define mpipe_isr                    MPIPE_DRVNAME(isr)
+#   endif
+#endif
+
+
 ///@todo when more hardware is supported by mpipe, variations of this will be
 ///      specified.  In certain implementations, this is superfluous
 typedef enum {
     MPIPE_9600bps    = 0,
     MPIPE_28800bps   = 1,
-    MPIPE_57600bps   = 2, 
+    MPIPE_57600bps   = 2,
     MPIPE_115200bps  = 3,
     MPIPE_230400bps  = 4,
-    MPIPE_460800bps  = 5
+    MPIPE_460800bps  = 5,
+    MPIPE_921600bps  = 6,
+    MPIPE_1Mbps      = 7,
+    MPIPE_2Mbps      = 8,
+    MPIPE_3Mbps      = 9
 } mpipe_speed;
 
+/// Baud rates of mpipe_speed, in order, for a UART driver to compute its
+/// dividers from the UART clock.  MPIPE_SPEED_DEFAULT is the speed set by
+/// mpipe_init(), and a board may raise it if its host (or USB converter) can
+/// keep up.
+#define MPIPE_BAUDRATES     9600, 28800, 57600, 115200, 230400, 460800, \
+                            921600, 1000000, 2000000, 3000000
+#ifndef MPIPE_SPEED_DEFAULT
+#   define MPIPE_SPEED_DEFAULT  MPIPE_115200bps
+#endif
+
 
 ///@note Priority might be altered in future implementations.
 typedef enum {
@@ -95,6 +190,56 @@ typedef enum {
 } mpipe_state;
 
 
+#if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+/// A gather TX segment.  Segments are not copied, so the data (and the
+/// segment list) must stay valid until the TX is done.  Length must not be 0.
+typedef struct {
+    ot_u8*  data;
+    ot_int  length;
+} mpipe_seg;
+#endif
+
+
+
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+/// The functions of a port driver.  kill may be NULL.
+typedef struct {
+    ot_u8       (*footerbytes)(void);
+    ot_int      (*init)(void*);
+    void        (*kill)(void);
+    void        (*wait)(void);
+    void        (*setspeed)(mpipe_speed);
+    mpipe_state (*status)(void);
+    void        (*setsig_txdone)(void (*)(ot_int));
+    void        (*setsig_rxdone)(void (*)(ot_int));
+    void        (*setsig_rxdetect)(void (*)(ot_int));
+    ot_int      (*txndef)(ot_u8*, ot_bool, mpipe_priority);
+    ot_int      (*rxndef)(ot_u8*, ot_bool, mpipe_priority);
+#   if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+    ot_int      (*txsegs)(mpipe_seg*, ot_int, ot_bool, mpipe_priority);
+#   endif
+} mpipe_driver;
+
+#   if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+#       define MPIPE_PORT_TXSEGS    , &mpipe_txsegs
+#   else
+#       define MPIPE_PORT_TXSEGS
+#   endif
+
+/// Put at the end of a port driver, with &mpipe_kill or NULL
+#   define MPIPE_PORT_DEFINE(KILL)                                          \
+        const mpipe_driver MPIPE_DRVCAT(port, MPIPE_DRIVER) = {            \
+            &mpipe_footerbytes, &mpipe_init, (KILL), &mpipe_wait,           \
+            &mpipe_setspeed, &mpipe_status, &mpipe_setsig_txdone,           \
+            &mpipe_setsig_rxdone, &mpipe_setsig_rxdetect, &mpipe_txndef,    \
+            &mpipe_rxndef MPIPE_PORT_TXSEGS }
+
+extern const mpipe_driver mpipe_port_usb;
+extern const mpipe_driver mpipe_port_uart;
+extern const mpipe_driver mpipe_port_posix;
+#endif
+
+
 
 
 
@@ -156,6 +301,9 @@ void mpipe_wait();
   * This function sets or resets data rate controlling attributes of the Mpipe.
   * In certain Mpipe implementations, data rate is irrelevant, and for these all
   * calls to mpipe_setspeed() will do the same thing.
+  *
+  * UART implementations compute the dividers from their clock.  A speed that
+  * the UART clock is too slow for is reduced to the fastest one it can do.
   */
 void mpipe_setspeed(mpipe_speed speed);
 
@@ -281,6 +429,27 @@ ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority)
 
 
 
+#if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+/** @brief  Transmits an NDEF structured datastream from a list of segments
+  * @param  seg         (mpipe_seg*) segments, the first has the NDEF header
+  * @param  segs        (ot_int) number of segments
+  * @param  blocking    (ot_bool) True/False for blocking/non-blocking call
+  * @param  data_priority (mpipe_priority) Priority of the TX
+  * @retval ot_int      same as mpipe_txndef()
+  * @ingroup Mpipe
+  * @sa mpipe_txndef
+  *
+  * The frame is the segments back to back, and then the MPipe footer, which 
+  * the driver computes over all of the segments.  Unlike mpipe_txndef(), 
+  * nothing is written after the data, so there is no need to leave room for
+  * the footer.
+  */
+ot_int mpipe_txsegs(mpipe_seg* seg, ot_int segs, ot_bool blocking, mpipe_priority data_priority);
+#endif
+
+
+
+
 
 /** @brief  Receives an NDEF structed datastream over the MPIPE
   * @param  data        (ot_u8*) Byte array to place received data
@@ -318,6 +487,28 @@ void mpipe_isr();
 
 
 
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+/** @brief  Returns the port that TX goes to (the port of the last message)
+  * @param  None
+  * @retval ot_u8       Port index in MPIPE_PORT_LIST, 0 is the host port
+  * @ingroup Mpipe
+  */
+ot_u8 mpipe_getport();
+
+
+/** @brief  Sets the port that TX goes to, until the next message comes in
+  * @param  port        (ot_u8) Port index in MPIPE_PORT_LIST
+  * @retval None
+  * @ingroup Mpipe
+  *
+  * For messages that the app starts on its own, such as a request to the
+  * co-processor.  It is ignored while the NDEF server has a message open.
+  */
+void mpipe_setport(ot_u8 port);
+#endif
+
+
+
 #endif
 
 #endif
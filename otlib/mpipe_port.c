@@ -0,0 +1,385 @@
+/* Copyright 2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /otlib/mpipe_port.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      MPipe port layer, for more than one MPipe driver at once
+  * @ingroup    MPipe
+  *
+  * See OT_FEATURE_MPIPE_PORTS in mpipe.h.  The app (i.e. the NDEF server)
+  * sees one MPipe.  Each port receives into its own buffer, and a message is
+  * copied to the buffer that the app gave to mpipe_rxndef() when the app can
+  * take it.  Until then it is held in its port, and the port does not listen,
+  * so nothing is lost or written over.
+  *
+  * An exchange is open from the RX of a message until the app listens again
+  * with a priority other than MPIPE_High (which is how NDEF asks for the next
+  * record of a chunked message).  Held messages are then delivered, starting
+  * from the port after the last one, so a busy port cannot starve the others.
+  ******************************************************************************
+  */
+
+#include "OT_config.h"
+#include "OT_platform.h"
+
+#if ((OT_FEATURE(MPIPE) == ENABLED) && (OT_FEATURE(MPIPE_PORTS) == ENABLED))
+
+#include "mpipe.h"
+#include "OT_utils.h"
+
+
+/** Port List
+  * The host port is first.  On boards with USB, it is USB, and the UART is
+  * the second port.  A platform may give its own list of &mpipe_port_[name],
+  * with MPIPE_PORTS.
+  */
+#ifndef MPIPE_PORT_LIST
+#   if (MCU_FEATURE(MPIPEVCOM) == ENABLED)
+#       define MPIPE_PORTS      2
+#       define MPIPE_PORT_LIST  &mpipe_port_usb, &mpipe_port_uart
+#   else
+#       define MPIPE_PORTS      1
+#       define MPIPE_PORT_LIST  &mpipe_port_uart
+#   endif
+#endif
+
+#if ((MPIPE_PORTS < 1) || (MPIPE_PORTS > 4))
+#   error "MPIPE_PORTS must be 1 to 4"
+#endif
+
+
+typedef struct {
+    ot_bool armed;                      // the driver is listening to rxbuf
+    ot_u8   held;                       // 1 + RX code of a held message, or 0
+    ot_u8   rxbuf[MPIPE_PORT_RXMAX];
+} mpipe_portrx;
+
+typedef struct {
+    ot_u8           active;             // port of the last message, TX goes here
+    ot_bool         open;               // the app has not finished that message
+    ot_u8*          rxdata;             // buffer from mpipe_rxndef(), or NULL
+    void (*sig_rxdone)(ot_int);
+    void (*sig_txdone)(ot_int);
+    void (*sig_rxdetect)(ot_int);
+    mpipe_portrx    rx[MPIPE_PORTS];
+} mpipe_portstruct;
+
+static const mpipe_driver* const mpipe_drv[MPIPE_PORTS] = { MPIPE_PORT_LIST };
+mpipe_portstruct mport;
+
+
+
+
+/** Port Subroutines <BR>
+  * ========================================================================<BR>
+  * The drivers do not pass a port to their callbacks, so each port has its
+  * own small set of them.
+  */
+void sub_port_arm(ot_u8 port);
+void sub_port_deliver(ot_u8 port);
+void sub_port_next();
+void sub_port_rxdone(ot_u8 port, ot_int code);
+void sub_port_txdone(ot_u8 port, ot_int code);
+void sub_port_rxdetect(ot_u8 port, ot_int code);
+ot_u8 sub_port_tx(mpipe_priority data_priority);
+
+#define MPIPE_PORT_SIGS(N) \
+    void sub_port_rxdone##N(ot_int code)    { sub_port_rxdone(N, code); }   \
+    void sub_port_txdone##N(ot_int code)    { sub_port_txdone(N, code); }   \
+    void sub_port_rxdetect##N(ot_int code)  { sub_port_rxdetect(N, code); }
+
+MPIPE_PORT_SIGS(0)
+#if (MPIPE_PORTS > 1)
+MPIPE_PORT_SIGS(1)
+#endif
+#if (MPIPE_PORTS > 2)
+MPIPE_PORT_SIGS(2)
+#endif
+#if (MPIPE_PORTS > 3)
+MPIPE_PORT_SIGS(3)
+#endif
+
+static void (* const mpipe_sig_rxdone[MPIPE_PORTS])(ot_int) = {
+    &sub_port_rxdone0
+#   if (MPIPE_PORTS > 1)
+    , &sub_port_rxdone1
+#   endif
+#   if (MPIPE_PORTS > 2)
+    , &sub_port_rxdone2
+#   endif
+#   if (MPIPE_PORTS > 3)
+    , &sub_port_rxdone3
+#   endif
+};
+
+static void (* const mpipe_sig_txdone[MPIPE_PORTS])(ot_int) = {
+    &sub_port_txdone0
+#   if (MPIPE_PORTS > 1)
+    , &sub_port_txdone1
+#   endif
+#   if (MPIPE_PORTS > 2)
+    , &sub_port_txdone2
+#   endif
+#   if (MPIPE_PORTS > 3)
+    , &sub_port_txdone3
+#   endif
+};
+
+static void (* const mpipe_sig_rxdetect[MPIPE_PORTS])(ot_int) = {
+    &sub_port_rxdetect0
+#   if (MPIPE_PORTS > 1)
+    , &sub_port_rxdetect1
+#   endif
+#   if (MPIPE_PORTS > 2)
+    , &sub_port_rxdetect2
+#   endif
+#   if (MPIPE_PORTS > 3)
+    , &sub_port_rxdetect3
+#   endif
+};
+
+
+
+void sub_port_arm(ot_u8 port) {
+/// A port that holds a message, or that is busy, is armed later
+    if ((mport.rx[port].armed == False) && (mport.rx[port].held == 0)) {
+        if (mpipe_drv[port]->rxndef(mport.rx[port].rxbuf, False, MPIPE_Low) >= 0) {
+            mport.rx[port].armed = True;
+        }
+    }
+}
+
+
+void sub_port_deliver(ot_u8 port) {
+/// The message is the 6 byte header and the payload (the footer is dropped)
+    ot_int code = (ot_int)mport.rx[port].held - 1;
+    ot_u8* data = mport.rxdata;
+
+    mport.rx[port].held = 0;
+    mport.rxdata        = NULL;
+    mport.active        = port;
+    mport.open          = True;
+    platform_memcpy(data, mport.rx[port].rxbuf, 6 + mport.rx[port].rxbuf[2]);
+    mport.sig_rxdone(code);
+}
+
+
+void sub_port_next() {
+/// An RX ISR may have let a message in already
+    ot_u8 port  = mport.active;
+    ot_u8 i;
+
+    if ((mport.rxdata == NULL) || mport.open) {
+        return;
+    }
+    for (i=0; i<MPIPE_PORTS; i++) {
+        port = (port+1 == MPIPE_PORTS) ? 0 : port+1;
+        if (mport.rx[port].held != 0) {
+            sub_port_deliver(port);
+            return;
+        }
+    }
+}
+
+
+void sub_port_rxdone(ot_u8 port, ot_int code) {
+    mport.rx[port].armed    = False;
+    mport.rx[port].held     = (ot_u8)(code + 1);
+
+    if ((mport.rxdata != NULL) && ((mport.open == False) || (mport.active == port))) {
+        sub_port_deliver(port);
+    }
+}
+
+
+void sub_port_txdone(ot_u8 port, ot_int code) {
+/// A TX stops the RX of a half duplex driver, so the port listens again,
+/// unless the app is still busy with its message (it listens once the app
+/// is done).
+    mport.rx[port].armed = False;
+    if ((mport.open == False) || (mport.active != port)) {
+        sub_port_arm(port);
+    }
+    mport.sig_txdone(code);
+}
+
+
+void sub_port_rxdetect(ot_u8 port, ot_int code) {
+    mport.sig_rxdetect(code);
+}
+
+
+ot_u8 sub_port_tx(mpipe_priority data_priority) {
+    return (data_priority == MPIPE_Broadcast) ? 0 : mport.active;
+}
+
+
+
+
+/** Mpipe Public Functions <BR>
+  * ========================================================================<BR>
+  */
+ot_u8 mpipe_footerbytes() {
+    ot_u8 i;
+    ot_u8 bytes = 0;
+
+    for (i=0; i<MPIPE_PORTS; i++) {
+        ot_u8 port_bytes = mpipe_drv[i]->footerbytes();
+        if (port_bytes > bytes) {
+            bytes = port_bytes;
+        }
+    }
+    return bytes;
+}
+
+
+ot_int mpipe_init(void* port_id) {
+/// "port_id" goes to each driver.  The ports listen from the start.
+    ot_u8   i;
+    ot_int  result = 0;
+
+    mport.active        = 0;
+    mport.open          = False;
+    mport.rxdata        = NULL;
+    mport.sig_rxdone    = &otutils_sig_null;
+    mport.sig_txdone    = &otutils_sig_null;
+    mport.sig_rxdetect  = &otutils_sig_null;
+
+    for (i=0; i<MPIPE_PORTS; i++) {
+        mport.rx[i].armed   = False;
+        mport.rx[i].held    = 0;
+        if (mpipe_drv[i]->init(port_id) < 0) {
+            result = -1;
+            continue;
+        }
+        mpipe_drv[i]->setsig_rxdone(mpipe_sig_rxdone[i]);
+        mpipe_drv[i]->setsig_txdone(mpipe_sig_txdone[i]);
+        mpipe_drv[i]->setsig_rxdetect(mpipe_sig_rxdetect[i]);
+        sub_port_arm(i);
+    }
+    return result;
+}
+
+
+void mpipe_kill() {
+    ot_u8 i;
+    for (i=0; i<MPIPE_PORTS; i++) {
+        if (mpipe_drv[i]->kill != NULL) {
+            mpipe_drv[i]->kill();
+        }
+    }
+}
+
+
+void mpipe_wait() {
+    ot_u8 i;
+    for (i=0; i<MPIPE_PORTS; i++) {
+        mpipe_drv[i]->wait();
+    }
+}
+
+
+void mpipe_setspeed(mpipe_speed speed) {
+    ot_u8 i;
+    for (i=0; i<MPIPE_PORTS; i++) {
+        mpipe_drv[i]->setspeed(speed);
+    }
+}
+
+
+mpipe_state mpipe_status() {
+    ot_u8 i;
+    for (i=0; i<MPIPE_PORTS; i++) {
+        mpipe_state state = mpipe_drv[i]->status();
+        if (state != MPIPE_Idle) {
+            return state;
+        }
+    }
+    return MPIPE_Idle;
+}
+
+
+void mpipe_setsig_txdone(void (*signal)(ot_int)) {
+    mport.sig_txdone = signal;
+}
+
+void mpipe_setsig_rxdone(void (*signal)(ot_int)) {
+    mport.sig_rxdone = signal;
+}
+
+void mpipe_setsig_rxdetect(void (*signal)(ot_int)) {
+    mport.sig_rxdetect = signal;
+}
+
+
+ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+    ot_u8   port    = sub_port_tx(data_priority);
+    ot_int  result  = mpipe_drv[port]->txndef(data, blocking, data_priority);
+
+    if (result >= 0) {
+        mport.rx[port].armed = False;
+    }
+    return result;
+}
+
+
+#if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+ot_int mpipe_txsegs(mpipe_seg* seg, ot_int segs, ot_bool blocking, mpipe_priority data_priority) {
+    ot_u8   port    = sub_port_tx(data_priority);
+    ot_int  result  = mpipe_drv[port]->txsegs(seg, segs, blocking, data_priority);
+
+    if (result >= 0) {
+        mport.rx[port].armed = False;
+    }
+    return result;
+}
+#endif
+
+
+ot_int mpipe_rxndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// MPIPE_High is the next record of the open message, from the same port.
+/// Anything else ends the message, and lets a held one in.
+    mport.rxdata = data;
+    sub_port_arm(mport.active);
+
+    if (data_priority == MPIPE_High) {
+        if (mport.rx[mport.active].held != 0) {
+            sub_port_deliver(mport.active);
+        }
+    }
+    else {
+        mport.open = False;
+        sub_port_next();
+    }
+    return 0;
+}
+
+
+ot_u8 mpipe_getport() {
+    return mport.active;
+}
+
+
+void mpipe_setport(ot_u8 port) {
+    if ((mport.open == False) && (port < MPIPE_PORTS)) {
+        mport.active = port;
+    }
+}
+
+
+#endif
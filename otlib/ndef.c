@@ -38,11 +38,31 @@
 #include "ndef.h"
 #include "mpipe.h"
 #include "auth.h"
+#include "system.h"
 
 
 // NDEF Module data
 ndef_message ndef;
 
+/// With half duplex buffers, dir_out is written over dir_in, so a payload can
+/// only be left in dir_in when they are separate (MPIPE_DUPLEX)
+#define NDEF_GATHER     ( (OT_FEATURE(MPIPE_GATHER) == ENABLED) \
+                       && (OT_FEATURE(MPIPE_DUPLEX) == ENABLED) \
+                       && (OT_FEATURE(ALP) == ENABLED) )
+
+/// Streaming executes each record as it arrives and recycles dir_in, so it
+/// also needs dir_out to be separate from dir_in
+#define NDEF_STREAM     ( (OT_FEATURE(NDEF_STREAM) == ENABLED) \
+                       && (OT_FEATURE(MPIPE_DUPLEX) == ENABLED) \
+                       && (OT_FEATURE(ALP) == ENABLED) )
+
+#if (NDEF_GATHER)
+/// The response goes out as segments of dir_out, with the payloads that ALP
+/// processors left in place (i.e. the logger echo, in dir_in) between them.
+static mpipe_seg    ndef_seg[NDEF_SEGS];
+static ot_int       ndef_segs;
+#endif
+
 
 
 /***************************
@@ -50,6 +70,11 @@ ndef_message ndef;
   **************************/
   
 ot_bool sub_put_header(alp_record* record, Queue* q);
+ot_bool sub_record_failed(alp_record* out_rec, ot_u8* payload);
+ot_bool sub_stream_out(Queue* out_q);
+void sub_send_out(Queue* out_q);
+void sub_open_response(Queue* out_q);
+ot_u8 sub_exec_record(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q);
 
 
 
@@ -67,6 +92,17 @@ ot_bool sub_put_header(alp_record* record, Queue* q);
 
 #ifndef EXTF_otapi_ndef_idle
 void otapi_ndef_idle(ot_int code) {
+#   if ((OT_FEATURE(ALP) == ENABLED) && (ALP_FILE_STREAM == ENABLED))
+    /// Push the next chunk of an open file stream, or drop it on TX error
+    if (code == 0) {
+        if (sub_stream_out(&dir_out)) {
+            return;
+        }
+    }
+    else {
+        alp_filedata_close();
+    }
+#   endif
 	ndef.last_flags = NDEF_MB | NDEF_SR | NDEF_IL | NDEF_TNF_UNKNOWN;
     q_empty(&dir_in);
     mpipe_rxndef(dir_in.front, False, MPIPE_Low);
@@ -75,6 +111,7 @@ void otapi_ndef_idle(ot_int code) {
 
 #ifndef EXTF_otapi_ndef_proc
 void otapi_ndef_proc(ot_int code) {
+    SYS_TRACE(SYS_TRACE_MPRX, code);
     switch (ndef_parse_record(&dir_in, &dir_out)) {
         //wipe queue and go back to idle listening
         case MSG_Null:          otapi_ndef_idle(0);
@@ -86,7 +123,7 @@ void otapi_ndef_proc(ot_int code) {
         
         //transmit next record/message
         case MSG_Chunking_Out:
-        case MSG_End:           mpipe_txndef(dir_out.front, False, MPIPE_High);
+        case MSG_End:           sub_send_out(&dir_out);
                                 break;
     }
 }
@@ -102,6 +139,21 @@ void otapi_ndef_proc(ot_int code) {
   ************************/
 #define HEADER_LENGTH   6
 
+void sub_send_out(Queue* out_q) {
+#if (NDEF_GATHER)
+    /// Close the last dir_out segment (dropped if empty), or use a plain TX if
+    /// no payload was left in place
+    if (ndef_segs != 0) {
+        ndef_seg[ndef_segs].length = out_q->putcursor - ndef_seg[ndef_segs].data;
+        ndef_segs += (ndef_seg[ndef_segs].length != 0);
+        mpipe_txsegs(ndef_seg, ndef_segs, False, MPIPE_High);
+        return;
+    }
+#endif
+    mpipe_txndef(out_q->front, False, MPIPE_High);
+}
+
+
 ot_bool sub_put_header(alp_record* record, Queue* q) {
     if ((q->putcursor + HEADER_LENGTH) >= q->back)
         return False;
@@ -123,6 +175,56 @@ ot_bool sub_put_header(alp_record* record, Queue* q) {
 
 
 
+/// ALP errors are in-band.  Filesystem ALP returns a list of (file id, error)
+/// pairs on its "Return Error" command, where error 0 is success.
+ot_bool sub_record_failed(alp_record* out_rec, ot_u8* payload) {
+    ot_int i;
+    if ((out_rec->dir_id == ALP_ID_FILEDATA) && ((out_rec->dir_cmd & 0x0F) == 0x0F)) {
+        for (i=1; i<out_rec->payload_length; i+=2) {
+            if (payload[i] != 0) {
+                return True;
+            }
+        }
+    }
+    return False;
+}
+
+
+
+#if ((OT_FEATURE(ALP) == ENABLED) && (ALP_FILE_STREAM == ENABLED))
+/// Continuation records of a chunked response use the UNCHANGED TNF.  They
+/// keep the 2 byte ID, because MPipe frames always have a 6 byte header.
+ot_bool sub_stream_out(Queue* out_q) {
+    alp_record out_rec;
+    
+    if ((ndef.last_flags & NDEF_CF) == 0) {
+        return False;
+    }
+    
+    q_empty(out_q);
+    out_q->back      -= mpipe_footerbytes();
+    out_q->putcursor += HEADER_LENGTH;
+    out_rec.flags     = 0;
+    
+    if (alp_filedata_stream(&out_rec, out_q) < 0) {
+        return False;
+    }
+    
+    out_rec.flags   = (out_rec.flags & NDEF_CF) ? NDEF_CF : NDEF_ME;
+    out_rec.flags  |= NDEF_SR | NDEF_IL | NDEF_TNF_UNCHANGED;
+    ndef.last_flags = out_rec.flags;
+    out_q->putcursor = out_q->front;
+    sub_put_header(&out_rec, out_q);
+    out_q->putcursor += HEADER_LENGTH + out_rec.payload_length;
+    out_q->length    += HEADER_LENGTH;
+    
+    mpipe_txndef(out_q->front, False, MPIPE_High);
+    return True;
+}
+#endif
+
+
+
 #ifndef EXTF_ndef_new_msg
 ot_bool ndef_new_msg(Queue* output) {
     if (output == NULL) {
@@ -239,6 +341,162 @@ ot_u8 sub_parse_header(alp_record* in_rec, Queue* in_q) {
 
 
 
+#if (OT_FEATURE(ALP) == ENABLED)
+/// Start the response message in out_q
+void sub_open_response(Queue* out_q) {
+    q_empty(out_q);
+    out_q->back    -= mpipe_footerbytes();
+    ndef.last_hdr   = NULL;
+#   if (NDEF_GATHER)
+    ndef_segs           = 0;
+    ndef_seg[0].data    = out_q->front;
+#   endif
+}
+
+
+
+/// Execute one well-formed record, and append its response to out_q.  Returns
+/// non-zero if the response carries an ALP error.
+ot_u8 sub_exec_record(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q) {
+    ot_int initial_length;
+    ot_u8* payload;
+    
+    /// Tentatively write header data.  It will be updated later.
+    out_q->getcursor    = out_q->putcursor;
+    out_q->putcursor   += HEADER_LENGTH;
+    initial_length      = out_q->length;
+    payload             = out_q->putcursor;
+    
+    /// A processor may leave its payload in place, if there are segments left
+    /// for it (see alp_record)
+    out_rec->bookmark   = NULL;
+#   if (NDEF_GATHER)
+    if ((ndef_segs+3) <= NDEF_SEGS) {
+        out_rec->bookmark = (void*)out_q;
+    }
+#   endif
+
+    alp_proc(in_rec, out_rec, in_q, out_q, AUTH_ROOT);
+    
+#   if (NDEF_GATHER)
+    if ((out_rec->bookmark != NULL) && (out_rec->bookmark != (void*)out_q) \
+        && (out_rec->payload_length != 0)) {
+        payload = (ot_u8*)out_rec->bookmark;
+    }
+#   endif
+
+    /// If there's no output data, rewind output queue to remove the parts 
+    /// added by sub_put_header().  If there is output data, put it on the 
+    /// output message queue.
+    if ((out_q->length == initial_length) && (payload == out_q->putcursor)) {
+        out_q->putcursor = out_q->getcursor;
+        return 0;
+    }
+    
+    if (out_rec->flags & NDEF_CF) {
+        out_rec->flags &= ~NDEF_ME;
+    }
+    ndef.last_hdr       = out_q->getcursor;
+    *out_q->getcursor++ = out_rec->flags;
+    out_rec->flags     &= ~NDEF_MB;
+    *out_q->getcursor++ = 0;
+    *out_q->getcursor++ = out_rec->payload_length;
+    *out_q->getcursor++ = 2;
+    *out_q->getcursor++ = out_rec->dir_id;
+    *out_q->getcursor   = out_rec->dir_cmd;
+    out_q->length      += HEADER_LENGTH;
+    
+#   if (NDEF_GATHER)
+    /// Close the dir_out segment after the header, then the payload, and 
+    /// dir_out goes on after it
+    if (payload != (ndef.last_hdr+HEADER_LENGTH)) {
+        ndef_seg[ndef_segs].length  = out_q->putcursor - ndef_seg[ndef_segs].data;
+        ndef_segs++;
+        ndef_seg[ndef_segs].data    = payload;
+        ndef_seg[ndef_segs].length  = out_rec->payload_length;
+        ndef_segs++;
+        ndef_seg[ndef_segs].data    = out_q->putcursor;
+    }
+#   endif
+
+    return sub_record_failed(out_rec, payload);
+}
+#endif
+
+
+
+#if (NDEF_STREAM)
+/// Each record is executed when its MPipe frame arrives, and its response is
+/// appended to the message in out_q, which goes out when the ME record is
+/// done.  dir_in is then free for the next record, unless a response payload
+/// was left in it (NDEF_GATHER), in which case the next record goes after it.
+NDEF_status sub_stream_record(Queue* in_q, Queue* out_q) {
+    alp_record  in_rec;
+    alp_record  out_rec;
+    ot_u8       error;
+    
+    error = sub_parse_header(&in_rec, in_q);
+    
+    /// MB opens the message.  Records of a message that was not opened (its
+    /// MB frame was lost) or that was stopped on an error are dropped.
+    if (in_rec.flags & NDEF_MB) {
+        sub_open_response(out_q);
+        ndef.last_flags = NDEF_MB | NDEF_SR | NDEF_IL | NDEF_TNF_UNKNOWN;
+        ndef.open       = True;
+    }
+    if (ndef.open == False) {
+        q_empty(in_q);
+        return (in_rec.flags & NDEF_ME) ? MSG_Null : MSG_Chunking_In;
+    }
+    
+    out_rec.flags = ndef.last_flags | (in_rec.flags & NDEF_ME);
+    
+    /// Malformed records in the message are skipped
+    if (error != 0) {
+        in_q->getcursor += in_rec.payload_length;
+    }
+    else {
+        error = sub_exec_record(&in_rec, &out_rec, in_q, out_q);
+    }
+    
+#   if (NDEF_STOP_ON_ERROR == ENABLED)
+    /// Stop the message, and close the response at the last record
+    if (error != 0) {
+        if (ndef.last_hdr != NULL) {
+            *ndef.last_hdr |= NDEF_ME;
+        }
+        out_rec.flags |= NDEF_ME;
+        in_rec.flags  |= NDEF_ME;
+    }
+#   endif
+    
+    ndef.last_flags = out_rec.flags;
+    
+    if (in_rec.flags & NDEF_ME) {
+        ndef.open = False;
+        return (out_q->length == 0) ? MSG_Null : MSG_End;
+    }
+    if (out_q->putcursor >= out_q->back) {
+        ndef.open = False;
+        return MSG_Chunking_Out;
+    }
+    
+    /// Recycle dir_in: the next record is received at in_q->getcursor
+#   if (NDEF_GATHER)
+    if (ndef_segs == 0)
+#   endif
+    {
+        q_empty(in_q);
+    }
+    return MSG_Chunking_In;
+}
+#endif
+
+
+
+
+
+
 /** ndef_parse_record()         <BR>
   * ========================================================================<BR>
   * This function is a major part of the OpenTag NDEF module, which is being 
@@ -251,10 +509,14 @@ ot_u8 sub_parse_header(alp_record* in_rec, Queue* in_q) {
   */
 #ifndef EXTF_ndef_parse_record
 NDEF_status ndef_parse_record(Queue* in_q, Queue* out_q) {
-#if (OT_FEATURE(ALP) == ENABLED)
+#if (NDEF_STREAM)
+    return sub_stream_record(in_q, out_q);
+
+#elif (OT_FEATURE(ALP) == ENABLED)
     alp_record in_rec;
     alp_record out_rec;
     ot_u8 error;
+    ot_bool reparse;
     
     /// Parse the new record header
     error = sub_parse_header(&in_rec, in_q);
@@ -275,43 +537,43 @@ NDEF_status ndef_parse_record(Queue* in_q, Queue* out_q) {
     /// Else, Message End is present, so process the Message!
     /// This will need to be updated when chunking is enabled.
     else {
-        q_empty(out_q);
-        out_q->back    -= mpipe_footerbytes();
-        in_q->getcursor = in_q->front;
+        sub_open_response(out_q);
         out_rec.flags   = ndef.last_flags;
         
+        /// A single-record message (MB & ME) has its header parsed already,
+        /// so it is processed in place.  Otherwise, rewind to the front and
+        /// process all the records in the message in one pass.
+        reparse = ((in_rec.flags & NDEF_MB) == 0);
+        if (reparse) {
+            in_q->getcursor = in_q->front;
+        }
+        
         /// Loop through records in the input message
         do {
-            ot_int initial_length;
-            sub_parse_header(&in_rec, in_q);
-        
-            /// Tentatively write header data.  It will be updated later.
-            out_rec.flags     |= (in_rec.flags & NDEF_ME);
-            out_q->getcursor    = out_q->putcursor;
-            out_q->putcursor   += HEADER_LENGTH;
-            initial_length      = out_q->length;
-
-            alp_proc(&in_rec, &out_rec, in_q, out_q, AUTH_ROOT);
+            if (reparse) {
+                error = sub_parse_header(&in_rec, in_q);
+            }
+            reparse        = True;
+            out_rec.flags |= (in_rec.flags & NDEF_ME);
             
-            /// If there's no output data, rewind output queue to remove
-            /// the parts added by sub_put_header().  If there is output
-            /// data, put it on the output message queue.
-            if (out_q->length == initial_length) {
-                out_q->putcursor  = out_q->getcursor;
+            /// Malformed records in the batch are skipped
+            if (error != 0) {
+                in_q->getcursor += in_rec.payload_length;
             }
             else {
-                if (out_rec.flags & NDEF_CF) {
-                    out_rec.flags &= ~NDEF_ME;
+                error = sub_exec_record(&in_rec, &out_rec, in_q, out_q);
+            }
+            
+#           if (NDEF_STOP_ON_ERROR == ENABLED)
+            /// Stop the batch, and close the response at the last record
+            if (error != 0) {
+                if (ndef.last_hdr != NULL) {
+                    *ndef.last_hdr |= NDEF_ME;
                 }
-                *out_q->getcursor++ = out_rec.flags;
-                out_rec.flags      &= ~NDEF_MB;
-                *out_q->getcursor++ = 0;
-                *out_q->getcursor++ = out_rec.payload_length;
-                *out_q->getcursor++ = 2;
-                *out_q->getcursor++ = out_rec.dir_id;
-                *out_q->getcursor   = out_rec.dir_cmd;
-                out_q->length      += HEADER_LENGTH;
+                ndef.last_flags = out_rec.flags | NDEF_ME;
+                break;
             }
+#           endif
             
             ndef.last_flags = out_rec.flags;
             
@@ -320,7 +582,7 @@ NDEF_status ndef_parse_record(Queue* in_q, Queue* out_q) {
                 return MSG_Chunking_Out;
             }
         }
-        while ((out_rec.flags & NDEF_ME) == 0);
+        while ((in_rec.flags & NDEF_ME) == 0);
         
         return (out_q->length == 0) ? MSG_Null : MSG_End;
     }
@@ -132,12 +132,48 @@ typedef enum {
 
 
 
+/** Batch Processing Policy
+  * A multi-record NDEF message is executed record-by-record, in sequence, and
+  * the responses are coalesced into a single outgoing NDEF message.  Records
+  * that are malformed are skipped.  If NDEF_STOP_ON_ERROR is ENABLED, the first
+  * malformed record, or the first record that returns an ALP error, stops the
+  * batch and the response message is closed at that point.
+  */
+#ifndef NDEF_STOP_ON_ERROR
+#   define NDEF_STOP_ON_ERROR   DISABLED
+#endif
+
+/** OT_FEATURE_NDEF_STREAM
+  * Execute each record of a multi-record message as soon as its MPipe frame
+  * arrives, instead of batching them at the ME record.  dir_in is reused for
+  * each record, so a message may be longer than dir_in.  The responses still
+  * go out as one message, so they must fit in dir_out.  It needs
+  * OT_FEATURE(MPIPE_DUPLEX), because dir_out is written over dir_in otherwise.
+  */
+#ifndef OT_FEATURE_NDEF_STREAM
+#   define OT_FEATURE_NDEF_STREAM   DISABLED
+#endif
+
+/** NDEF_SEGS
+  * With OT_FEATURE(MPIPE_GATHER), the max number of MPipe segments of a
+  * response.  Each payload left in place by its ALP processor takes two (the
+  * payload, and the rest of dir_out after it), plus one for the start.
+  */
+#ifndef NDEF_SEGS
+#   define NDEF_SEGS            5
+#endif
+
+
+
+
 /** ndef_message is an internal data store that is exposed only for purposes of
   * transparency (this is an open source project).
   */
 typedef struct {
     //Queue*  msgq;
     ot_u8   last_flags;
+    ot_bool open;           // a streamed message is underway (NDEF_STREAM)
+    ot_u8*  last_hdr;       // header of the last response record
     //ot_u8   msg_tnf;
     //ot_int  msg_records;
 } ndef_message;
@@ -246,6 +282,13 @@ ot_bool ndef_load_msg(Queue* input);
   * frames/records, this function will only do processing once the message is
   * fully transfered or if the chunk bit is set.
   *
+  * Multi-record messages are batch-processed: all records are executed in
+  * sequence once the final record (ME) arrives, and their responses go into a
+  * single output message.  See NDEF_STOP_ON_ERROR for the error policy.  With
+  * OT_FEATURE_NDEF_STREAM, each record is executed as it arrives instead, and
+  * MSG_Chunking_In is returned with in_q emptied for the next record (unless
+  * a response payload was left in it, see NDEF_GATHER in ndef.c).
+  *
   * A good usage example is in otapi_ndef_proc() (implemented inside ndef.c).
   * In the main app code, if the mpipe RXDONE callback is set to this, that is
   * a sufficient implementation in most cases.
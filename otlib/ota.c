@@ -0,0 +1,368 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/ota.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      Over-the-air firmware update by delta image
+  * @ingroup    OTA
+  *
+  ******************************************************************************
+  */
+
+#include "ota.h"
+
+#if (OTA_SUPPORT)
+
+#include "OT_platform.h"
+#include "crc16.h"
+#include "m2_network.h"
+#include "veelite.h"
+
+
+#define OTA_CHUNK   32
+
+ota_struct ota;
+
+
+
+
+/** Image Access
+  * ============================================================================
+  * The sink writes each pair of stream bytes as a big-endian word, so the
+  * first byte of a pair is the upper byte of the word vl_read() gives back.
+  */
+void sub_ota_read(vlFILE* fp, ot_uint offset, ot_u8* data, ot_int length) {
+    while (length-- > 0) {
+        ot_u16 word = vl_read(fp, offset & ~1);
+        *data++     = (offset & 1) ? (ot_u8)word : (ot_u8)(word >> 8);
+        offset++;
+    }
+}
+
+
+ot_u32 sub_ota_long(vlFILE* fp, ot_uint offset) {
+    return ((ot_u32)vl_read(fp, offset) << 16) | vl_read(fp, offset+2);
+}
+
+
+
+/** CRC16 over image and firmware data, in chunks.  The hardware CRC engine
+  * only runs one CRC, so there is only ever one of these going at a time.
+  */
+ot_u16 sub_ota_crc_start(void) {
+#if (MCU_FEATURE(CRC) == ENABLED)
+    platform_crc_init();
+    return 0;
+#else
+    return crc_calc_block(0, NULL);
+#endif
+}
+
+
+ot_u16 sub_ota_crc(ot_u16 crc, ot_u8* data, ot_int length) {
+#if (MCU_FEATURE(CRC) == ENABLED)
+    while (length-- > 0) {
+        platform_crc_byte(*data++);
+    }
+    return crc;
+#else
+    return crc_extend_block(crc, length, data);
+#endif
+}
+
+
+ot_u16 sub_ota_crc_end(ot_u16 crc) {
+#if (MCU_FEATURE(CRC) == ENABLED)
+    return platform_crc_result();
+#else
+    return crc;
+#endif
+}
+
+
+ot_u8 sub_ota_crc_bank(ot_u8 bank, ot_u32 length, ot_u16 check) {
+/// Returns OTA_ERR_NONE if the first length bytes of the bank have the CRC
+    ot_u8   chunk[OTA_CHUNK];
+    ot_u16  crc     = sub_ota_crc_start();
+    ot_u32  addr    = 0;
+
+    while (addr < length) {
+        ot_int span = ((length - addr) > OTA_CHUNK) ? OTA_CHUNK : (ot_int)(length - addr);
+        if (platform_fw_read(bank, addr, chunk, span) != 0) {
+            return OTA_ERR_WRITE;
+        }
+        crc     = sub_ota_crc(crc, chunk, span);
+        addr   += span;
+    }
+    return (sub_ota_crc_end(crc) == check) ? OTA_ERR_NONE : OTA_ERR_IMAGE;
+}
+
+
+
+
+/** Transfer
+  * ============================================================================
+  */
+#ifndef EXTF_ota_open
+ot_int ota_open(ot_u8 seg_bytes, ot_u16 blocks) {
+    ot_u16  base;
+    ot_u32  map;
+    ot_int  i;
+
+    seg_bytes &= ~1;
+    if ((seg_bytes == 0) || (blocks == 0) || (blocks > OT_PARAM(OTA_BLOCKS))) {
+        return -1;
+    }
+    {   vlFILE* fp = ISF_open_su(ISF_ID(ota_image));
+        if (fp == NULL) {
+            return -1;
+        }
+        i = (fp->alloc < ((ot_u32)seg_bytes * blocks));
+        vl_close(fp);
+        if (i) {
+            return -1;
+        }
+    }
+
+    /// A transfer of another image starts over
+    if ((ota.state != OTA_RECEIVING) || (ota.seg_bytes != seg_bytes) || \
+        (ota.blocks != blocks)) {
+        platform_memset(ota.map, 0, sizeof(ota.map));
+        ota.seg_bytes   = seg_bytes;
+        ota.blocks      = blocks;
+        ota.received    = 0;
+    }
+    ota.state   = OTA_RECEIVING;
+    ota.error   = OTA_ERR_NONE;
+
+    /// The sink window starts at the first missing frame, with the frames
+    /// after it that are in already marked
+    base    = ota_missing();
+    map     = 0;
+    for (i=0; (i < M2_PARAM(DSWINDOW)) && ((base + i) < blocks); i++) {
+        if (ota.map[(base+i) >> 3] & (1 << ((base+i) & 7))) {
+            map |= ((ot_u32)1 << i);
+        }
+    }
+    m2dp_sink_open(ISF_ID(ota_image), seg_bytes, blocks);
+    m2dp_win_seek(base, map);
+
+    return (ot_int)base;
+}
+#endif
+
+
+#ifndef EXTF_ota_mark
+void ota_mark(ot_u16 block) {
+    ot_u8 bit = (1 << (block & 7));
+
+    if ((ota.state == OTA_RECEIVING) && (block < ota.blocks) && \
+        ((ota.map[block >> 3] & bit) == 0)) {
+        ota.map[block >> 3] |= bit;
+        ota.received++;
+        if (ota.received == ota.blocks) {
+            ota.state = OTA_RECEIVED;
+        }
+    }
+}
+#endif
+
+
+#ifndef EXTF_ota_missing
+ot_u16 ota_missing(void) {
+    ot_u16 block;
+
+    for (block=0; block<ota.blocks; block++) {
+        if ((ota.map[block >> 3] & (1 << (block & 7))) == 0) {
+            break;
+        }
+    }
+    return block;
+}
+#endif
+
+
+
+
+/** Verify & Apply
+  * ============================================================================
+  */
+#ifndef EXTF_ota_verify
+ot_u8 ota_verify(void) {
+/// The header must fit in the frames received, the delta must match its CRC,
+/// and the running firmware must be the base that the delta is made from.
+    vlFILE* fp;
+    ot_u8   chunk[OTA_CHUNK];
+    ot_uint body;
+    ot_uint offset;
+    ot_u16  crc;
+
+    if ((ota.state != OTA_RECEIVED) && (ota.state != OTA_VERIFIED)) {
+        return (ota.error = OTA_ERR_STATE);
+    }
+    ota.state   = OTA_RECEIVED;
+    fp          = ISF_open_su(ISF_ID(ota_image));
+    if (fp == NULL) {
+        return (ota.error = OTA_ERR_STATE);
+    }
+
+    body = vl_read(fp, 2);
+    if ((vl_read(fp, 0) != OTA_MAGIC) || \
+        (((ot_u32)OTA_HEADER_BYTES + body) > ((ot_u32)ota.seg_bytes * ota.blocks))) {
+        ota.error = OTA_ERR_HEADER;
+        goto ota_verify_END;
+    }
+
+    crc = sub_ota_crc_start();
+    for (offset=0; offset<body; offset+=OTA_CHUNK) {
+        ot_int span = ((body - offset) > OTA_CHUNK) ? OTA_CHUNK : (ot_int)(body - offset);
+        sub_ota_read(fp, OTA_HEADER_BYTES+offset, chunk, span);
+        crc = sub_ota_crc(crc, chunk, span);
+    }
+    if (sub_ota_crc_end(crc) != vl_read(fp, 4)) {
+        ota.error = OTA_ERR_BODY;
+        goto ota_verify_END;
+    }
+
+    ota.error = sub_ota_crc_bank(0, sub_ota_long(fp, 8), vl_read(fp, 6));
+    if (ota.error != OTA_ERR_NONE) {
+        ota.error = OTA_ERR_BASE;
+    }
+    else {
+        ota.state = OTA_VERIFIED;
+    }
+
+    ota_verify_END:
+    vl_close(fp);
+    return ota.error;
+}
+#endif
+
+
+#ifndef EXTF_ota_apply
+ot_u8 ota_apply(void) {
+/// Each operation goes to the update bank in chunks.  The old cursor and the
+/// new length are checked against the header, so a bad delta cannot write or
+/// read out of the firmware.
+    vlFILE* fp;
+    ot_u8   chunk[OTA_CHUNK];
+    ot_uint offset;
+    ot_uint end;
+    ot_u32  base_len;
+    ot_u32  new_len;
+    ot_u32  old;
+    ot_u32  out;
+
+    if (ota.state != OTA_VERIFIED) {
+        return (ota.error = OTA_ERR_STATE);
+    }
+    fp = ISF_open_su(ISF_ID(ota_image));
+    if (fp == NULL) {
+        return (ota.error = OTA_ERR_STATE);
+    }
+
+    base_len    = sub_ota_long(fp, 8);
+    new_len     = sub_ota_long(fp, 12);
+    offset      = OTA_HEADER_BYTES;
+    end         = offset + vl_read(fp, 2);
+    old         = 0;
+    out         = 0;
+    ota.error   = OTA_ERR_NONE;
+
+    while ((offset < end) && (ota.error == OTA_ERR_NONE)) {
+        ot_u8   op;
+        ot_u16  arg;
+        ot_u32  count;
+
+        sub_ota_read(fp, offset++, &op, 1);
+        if ((op & 0x80) == 0) {
+            count = (ot_u32)op + 1;
+            if ((offset + count) > end) {
+                ota.error = OTA_ERR_DELTA;
+                break;
+            }
+        }
+        else {
+            ot_u8 lo;
+            if (offset >= end) {
+                ota.error = OTA_ERR_DELTA;
+                break;
+            }
+            sub_ota_read(fp, offset++, &lo, 1);
+            arg = ((ot_u16)(op & 0x3F) << 8) | lo;
+
+            /// Seek: the old cursor stays inside the base
+            if (op & 0x40) {
+                old += (ot_u32)((ot_s16)(arg << 2) >> 2);
+                if (old > base_len) {
+                    ota.error = OTA_ERR_DELTA;
+                }
+                continue;
+            }
+            count = (ot_u32)arg + 1;
+            if ((old + count) > base_len) {
+                ota.error = OTA_ERR_DELTA;
+                break;
+            }
+        }
+        if ((out + count) > new_len) {
+            ota.error = OTA_ERR_DELTA;
+            break;
+        }
+
+        /// Literal bytes come from the image, copies from the running firmware
+        while (count > 0) {
+            ot_int span = (count > OTA_CHUNK) ? OTA_CHUNK : (ot_int)count;
+            if (op & 0x80) {
+                if (platform_fw_read(0, old, chunk, span) != 0) {
+                    ota.error = OTA_ERR_WRITE;
+                    break;
+                }
+                old += span;
+            }
+            else {
+                sub_ota_read(fp, offset, chunk, span);
+                offset += span;
+            }
+            if (platform_fw_write(out, chunk, span) != 0) {
+                ota.error = OTA_ERR_WRITE;
+                break;
+            }
+            out     += span;
+            count   -= span;
+        }
+    }
+
+    if ((ota.error == OTA_ERR_NONE) && (out != new_len)) {
+        ota.error = OTA_ERR_DELTA;
+    }
+    if (ota.error == OTA_ERR_NONE) {
+        ota.error = sub_ota_crc_bank(1, new_len, vl_read(fp, 16));
+    }
+    vl_close(fp);
+
+    if (ota.error == OTA_ERR_NONE) {
+        ota.state = OTA_IDLE;
+        platform_fw_commit(new_len);
+    }
+    return ota.error;
+}
+#endif
+
+
+#endif
@@ -0,0 +1,159 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/ota.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      Over-the-air firmware update by delta image
+  * @defgroup   OTA
+  *
+  * A gateway streams an update image to a device with a sliding-window M2DP
+  * datastream (M2_FEATURE_DSWINDOW), which the device writes into the ISF
+  * ISF_ID(ota_image).  The app must define and allocate that file if it wants
+  * this feature.  The device keeps a bitmap of the frames it has, so a
+  * transfer that is cut off starts again at the first missing frame.  Once
+  * all the frames are in, ota_verify() checks the image, and ota_apply()
+  * builds the new firmware from the running firmware and the delta, into the
+  * update bank of the platform (platform_fw_...() in OT_platform.h).
+  *
+  * Image:      [header: 18 bytes] [delta: body bytes]
+  * Header:     [magic: 2] [body bytes: 2] [body CRC16: 2] [base CRC16: 2]
+  *             [base bytes: 4] [new bytes: 4] [new CRC16: 2], big-endian.
+  *             The base is the running firmware that the delta is made from.
+  *
+  * Delta:      a list of operations that write the new firmware in order.
+  *             An old cursor in the running firmware starts at 0.
+  * 0nnnnnnn:               n+1 literal bytes follow
+  * 10nnnnnn nnnnnnnn:      n+1 bytes are copied from the old cursor
+  * 11nnnnnn nnnnnnnn:      the old cursor moves by n (signed, 14 bits)
+  *
+  ******************************************************************************
+  */
+
+#ifndef __OTA_H
+#define __OTA_H
+
+#include "OT_types.h"
+#include "OT_config.h"
+
+
+#ifndef OT_FEATURE_OTA
+#   define OT_FEATURE_OTA       DISABLED
+#endif
+
+/// Most frames in an update image (the bitmap has a bit for each)
+#ifndef OT_PARAM_OTA_BLOCKS
+#   define OT_PARAM_OTA_BLOCKS  256
+#endif
+
+#define OTA_SUPPORT     ((OT_FEATURE(OTA) == ENABLED) && \
+                         (OT_FEATURE(VEELITE) == ENABLED) && \
+                         (M2_FEATURE(DSWINDOW) == ENABLED))
+
+#define OTA_MAGIC           0xD7F0
+#define OTA_HEADER_BYTES    18
+
+#define OTA_IDLE            0
+#define OTA_RECEIVING       1
+#define OTA_RECEIVED        2
+#define OTA_VERIFIED        3
+
+#define OTA_ERR_NONE        0
+#define OTA_ERR_STATE       1       // the image is not in the right state
+#define OTA_ERR_HEADER      2       // the header is not good
+#define OTA_ERR_BODY        3       // the delta does not match its CRC
+#define OTA_ERR_BASE        4       // the running firmware is not the base
+#define OTA_ERR_DELTA       5       // an operation of the delta is not good
+#define OTA_ERR_WRITE       6       // the update bank did not take the data
+#define OTA_ERR_IMAGE       7       // the new firmware does not match its CRC
+
+
+/** ota_struct
+  * state:      OTA_IDLE, OTA_RECEIVING, OTA_RECEIVED or OTA_VERIFIED
+  * error:      OTA_ERR_... of the last verify or apply
+  * seg_bytes:  image bytes per frame
+  * blocks:     frames in the image
+  * received:   frames received
+  * map[]:      bit (i & 7) of byte (i >> 3) is set when frame i is received
+  */
+typedef struct {
+    ot_u8   state;
+    ot_u8   error;
+    ot_u8   seg_bytes;
+    ot_u16  blocks;
+    ot_u16  received;
+    ot_u8   map[(OT_PARAM(OTA_BLOCKS)+7) >> 3];
+} ota_struct;
+
+extern ota_struct ota;
+
+
+
+/** @brief  Opens the image sink for a transfer, or resumes it
+  * @param  seg_bytes   (ot_u8) image bytes per frame (even)
+  * @param  blocks      (ot_u16) frames in the image
+  * @retval ot_int      first missing frame, or -1 if the image does not fit
+  * @ingroup OTA
+  *
+  * If the transfer that is open has the same size, the frames received so
+  * far are kept, and the datastream sink starts at the first missing frame.
+  * The source must start there, too (m2dp_win_seek()).
+  */
+ot_int ota_open(ot_u8 seg_bytes, ot_u16 blocks);
+
+
+/** @brief  Marks a frame of the image as received
+  * @param  block       (ot_u16) frame number
+  * @retval none
+  * @ingroup OTA
+  *
+  * The datastream sink calls it when it has written a frame of the image.
+  */
+void ota_mark(ot_u16 block);
+
+
+/** @brief  Returns the first missing frame of the image
+  * @param  none
+  * @retval ot_u16      first missing frame (blocks, if none is missing)
+  * @ingroup OTA
+  */
+ot_u16 ota_missing(void);
+
+
+/** @brief  Checks a received image against its header and the running firmware
+  * @param  none
+  * @retval ot_u8       OTA_ERR_...
+  * @ingroup OTA
+  */
+ot_u8 ota_verify(void);
+
+
+/** @brief  Writes the new firmware into the update bank, and commits it
+  * @param  none
+  * @retval ot_u8       OTA_ERR_... (platform_fw_commit() may reset, so most
+  *                     devices only return on an error)
+  * @ingroup OTA
+  *
+  * The image must be verified.  The new firmware is checked in the update
+  * bank before platform_fw_commit() hands it to the bootloader.  This is the
+  * only stage that needs the firmware banks, so a platform can also run it
+  * from its boot code.
+  */
+ot_u8 ota_apply(void);
+
+
+#endif
@@ -0,0 +1,95 @@
+/* Copyright 2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /otlib/prand.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      Pseudo-random number service
+  * @ingroup    PRand
+  *
+  ******************************************************************************
+  */
+
+#include "prand.h"
+#include "OT_platform.h"
+
+
+prand_struct prand;
+
+
+
+#ifndef EXTF_prand_seed
+void prand_seed(ot_u32 seed) {
+    prand.state = (seed == 0) ? PRAND_DEFAULT : seed;
+    prand.draws = PRAND_RESEED;
+}
+#endif
+
+
+#ifndef EXTF_prand_reseed
+void prand_reseed() {
+/// The entropy is XORed in, so a weak or broken platform_rand() (some ports
+/// fall back to prand) cannot make the state worse, only fail to improve it.
+    ot_u32 entropy = 0;
+
+    platform_rand((ot_u8*)&entropy, 4);
+    prand.state ^= entropy;
+    if (prand.state == 0) {
+        prand.state = PRAND_DEFAULT;
+    }
+    prand.draws = 0;
+}
+#endif
+
+
+#ifndef EXTF_prand_service
+void prand_service() {
+#if (PRAND_RESEED != 0)
+    if (prand.draws >= PRAND_RESEED) {
+        prand_reseed();
+    }
+#endif
+}
+#endif
+
+
+
+
+/** Platform PRand API <BR>
+  * ========================================================================<BR>
+  * Every platform uses this module for platform_prand_u8/16().  The seed of
+  * platform_init_prand() is 16 bits, so it is spread over the 32 bit state.
+  */
+#ifndef EXTF_platform_init_prand
+void platform_init_prand(ot_u16 seed) {
+    prand_seed( ((ot_u32)seed << 16) | (ot_u16)~seed );
+}
+#endif
+
+
+#ifndef EXTF_platform_prand_u8
+ot_u8 platform_prand_u8() {
+    return PRAND_U8();
+}
+#endif
+
+
+#ifndef EXTF_platform_prand_u16
+ot_u16 platform_prand_u16() {
+    return PRAND_U16();
+}
+#endif
@@ -0,0 +1,117 @@
+/* Copyright 2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /otlib/prand.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      Pseudo-random number service
+  * @defgroup   PRand (Pseudo-random number module)
+  * @ingroup    PRand
+  *
+  * One generator for all platforms: 32 bit xorshift (shifts 13, 17, 5), with
+  * a period of 2^32 - 1.  It is only CPU arithmetic, so it does not share any
+  * peripheral with other users (e.g. the CRC engine, which the CRC streaming
+  * in the encoder owns).  The draw is a macro, so the CSMA slot and scramble
+  * code pay a few shifts and no call.  platform_prand_u8() and
+  * platform_prand_u16() are the same draw as functions.
+  *
+  * After every PRAND_RESEED draws, the state is stirred with 32 bits from
+  * platform_rand().  That is done by prand_service(), which the kernel calls
+  * once per pass of its event loop, so the entropy pool is never read from
+  * inside a draw.  PRAND_RESEED 0 never reseeds.
+  *
+  * The generator is not for crypto.  Use platform_rand() for keys and nonces.
+  ******************************************************************************
+  */
+
+
+#ifndef __PRAND_H
+#define __PRAND_H
+
+#include "OT_types.h"
+#include "OT_config.h"
+
+
+#ifndef PRAND_RESEED
+#   define PRAND_RESEED     256
+#endif
+
+/// Used for a zero seed, which xorshift cannot leave
+#define PRAND_DEFAULT       0x2545F491
+
+
+/** @typedef prand_struct
+  * state   (ot_u32) generator state, never zero
+  * draws   (ot_u16) draws since the last reseed
+  */
+typedef struct {
+    ot_u32  state;
+    ot_u16  draws;
+} prand_struct;
+
+extern prand_struct prand;
+
+
+/** Inline draws <BR>
+  * ========================================================================<BR>
+  * The upper bits are returned for the short draws.  All bits of xorshift are
+  * equally good, but this keeps U8 and U16 from being parts of each other.
+  */
+#define PRAND_U32()     ( prand.draws++,                            \
+                          prand.state ^= (prand.state << 13),       \
+                          prand.state ^= (prand.state >> 17),       \
+                          prand.state ^= (prand.state << 5) )
+#define PRAND_U16()     ((ot_u16)(PRAND_U32() >> 16))
+#define PRAND_U8()      ((ot_u8)(PRAND_U32() >> 24))
+
+
+
+
+/** @brief  Sets the generator state
+  * @param  seed        (ot_u32) new state.  0 is replaced by PRAND_DEFAULT
+  * @retval none
+  * @ingroup PRand
+  *
+  * The first prand_service() after this reseeds from platform_rand(), so the
+  * seed only needs to differ between devices until the kernel runs (e.g. the
+  * device ID).  platform_init_prand() calls this.
+  */
+void prand_seed(ot_u32 seed);
+
+
+
+/** @brief  Stirs 32 bits from platform_rand() into the state now
+  * @param  none
+  * @retval none
+  * @ingroup PRand
+  */
+void prand_reseed();
+
+
+
+/** @brief  Reseeds if PRAND_RESEED draws have been made since the last time
+  * @param  none
+  * @retval none
+  * @ingroup PRand
+  *
+  * Called by the kernel once per pass of the event loop.  It is one compare
+  * when there is nothing to do.
+  */
+void prand_service();
+
+
+#endif
@@ -35,6 +35,30 @@
 #include "veelite.h"
 
 
+/// Queue data is big endian (network order).  Words are moved in one access,
+/// and swapped with PLATFORM_ENDIAN16/32 (one instruction on the supported
+/// MCUs), when the platform can access a word at that address: any address 
+/// with PLATFORM_UNALIGNED (Cortex-M3, x86), otherwise an aligned one.
+#ifndef PLATFORM_UNALIGNED
+#   define PLATFORM_UNALIGNED   DISABLED
+#endif
+#if (PLATFORM_UNALIGNED == ENABLED)
+#   define Q_WORD16(PTR)    True
+#   define Q_WORD32(PTR)    True
+#else
+#   define Q_WORD16(PTR)    ((((ot_uint)(PTR)) & 1) == 0)
+#   define Q_WORD32(PTR)    ((((ot_uint)(PTR)) & 3) == 0)
+#endif
+
+#if (QUEUE_CHECKS == ENABLED)
+#   define Q_PUTCHECK(Q, N)         if (((Q)->putcursor + (N)) > (Q)->back) return
+#   define Q_GETCHECK(Q, N, FAIL)   if (((Q)->getcursor + (N)) > (Q)->back) return FAIL
+#else
+#   define Q_PUTCHECK(Q, N)
+#   define Q_GETCHECK(Q, N, FAIL)
+#endif
+
+
 
 #ifndef EXTF_q_init
 void q_init(Queue* q, ot_u8* buffer, ot_u16 alloc) {
@@ -101,6 +125,7 @@ ot_u8* q_markbyte(Queue* q, ot_int shift) {
 
 #ifndef EXTF_q_writebyte
 void q_writebyte(Queue* q, ot_u8 byte_in) {
+    Q_PUTCHECK(q, 1);
     *(q->putcursor) = byte_in;
     q->putcursor++;
     q->length++;
@@ -110,16 +135,15 @@ void q_writebyte(Queue* q, ot_u8 byte_in) {
 
 #ifndef EXTF_q_writeshort
 void q_writeshort(Queue* q, ot_uint short_in) {
-    ot_u8* data;
-    data = (ot_u8*)&short_in;
-
-#   ifdef __BIG_ENDIAN__
-        q->putcursor[0] = data[0];
-        q->putcursor[1] = data[1];
-#   else
-        q->putcursor[0] = data[1];
-        q->putcursor[1] = data[0];
-#   endif
+    Q_PUTCHECK(q, 2);
+    
+    if (Q_WORD16(q->putcursor)) {
+        *(ot_u16*)q->putcursor = PLATFORM_ENDIAN16((ot_u16)short_in);
+    }
+    else {
+        q->putcursor[0] = (ot_u8)(short_in >> 8);
+        q->putcursor[1] = (ot_u8)short_in;
+    }
     
     q->putcursor  += 2;
     q->length     += 2;
@@ -129,19 +153,21 @@ void q_writeshort(Queue* q, ot_uint short_in) {
 
 #ifndef EXTF_q_writeshort_be
 void q_writeshort_be(Queue* q, ot_uint short_in) {
-#   ifdef __BIG_ENDIAN__
-        q_writeshort(q, short_in);
-
-#   else
-        ot_u8* data;
-        data = (ot_u8*)&short_in;
+/// The short is copied in memory order, with no conversion
+    Q_PUTCHECK(q, 2);
     
-        q->putcursor[0] = data[0];
-        q->putcursor[1] = data[1];
-        
-        q->putcursor  += 2;
-        q->length     += 2;
-#   endif    
+    if (Q_WORD16(q->putcursor)) {
+        *(ot_u16*)q->putcursor = (ot_u16)short_in;
+    }
+    else {
+        Twobytes data;
+        data.ushort     = (ot_u16)short_in;
+        q->putcursor[0] = data.ubyte[0];
+        q->putcursor[1] = data.ubyte[1];
+    }
+    
+    q->putcursor  += 2;
+    q->length     += 2;
 }
 #endif
 
@@ -149,20 +175,17 @@ void q_writeshort_be(Queue* q, ot_uint short_in) {
 
 #ifndef EXTF_q_writelong
 void q_writelong(Queue* q, ot_ulong long_in) {
-    ot_u8* data;
-    data = (ot_u8*)&long_in;
-
-#   ifdef __BIG_ENDIAN__
-        q->putcursor[0] = data[0];
-        q->putcursor[1] = data[1];
-        q->putcursor[2] = data[2];
-        q->putcursor[3] = data[3];
-#   else
-        q->putcursor[0] = data[3];
-        q->putcursor[1] = data[2];
-        q->putcursor[2] = data[1];
-        q->putcursor[3] = data[0];
-#   endif
+    Q_PUTCHECK(q, 4);
+    
+    if (Q_WORD32(q->putcursor)) {
+        *(ot_u32*)q->putcursor = PLATFORM_ENDIAN32((ot_u32)long_in);
+    }
+    else {
+        q->putcursor[0] = (ot_u8)(long_in >> 24);
+        q->putcursor[1] = (ot_u8)(long_in >> 16);
+        q->putcursor[2] = (ot_u8)(long_in >> 8);
+        q->putcursor[3] = (ot_u8)long_in;
+    }
     
     q->putcursor  += 4;
     q->length     += 4;
@@ -172,6 +195,7 @@ void q_writelong(Queue* q, ot_ulong long_in) {
 
 #ifndef EXTF_q_readbyte
 ot_u8 q_readbyte(Queue* q) {
+    Q_GETCHECK(q, 1, 0);
     return *(q->getcursor++);
 }
 #endif
@@ -179,61 +203,64 @@ ot_u8 q_readbyte(Queue* q) {
 
 #ifndef EXTF_q_readshort
 ot_u16 q_readshort(Queue* q) {
-    Twobytes data;
-
-#   ifdef __BIG_ENDIAN__
-        data.ubyte[0]   = q->getcursor[0];
-        data.ubyte[1]   = q->getcursor[1];
-#   else
-        data.ubyte[1]   = q->getcursor[0];
-        data.ubyte[0]   = q->getcursor[1];
-#   endif
+    ot_u16 data;
+    Q_GETCHECK(q, 2, 0);
+    
+    if (Q_WORD16(q->getcursor)) {
+        data = PLATFORM_ENDIAN16(*(ot_u16*)q->getcursor);
+    }
+    else {
+        data = ((ot_u16)q->getcursor[0] << 8) | (ot_u16)q->getcursor[1];
+    }
     
     q->getcursor  += 2;
-    return data.ushort;
+    return data;
 }
 #endif
 
 
 #ifndef EXTF_q_readshort_be
 ot_u16 q_readshort_be(Queue* q) {
-#   ifdef __BIG_ENDIAN__
-        return q_readshort(q);
-#   else
-        Twobytes data;
+/// The short is copied in memory order, with no conversion
+    Twobytes data;
+    Q_GETCHECK(q, 2, 0);
+    
+    if (Q_WORD16(q->getcursor)) {
+        data.ushort     = *(ot_u16*)q->getcursor;
+    }
+    else {
         data.ubyte[0]   = q->getcursor[0];
         data.ubyte[1]   = q->getcursor[1];
-        q->getcursor  += 2;
-        return data.ushort;
-#   endif
+    }
+    
+    q->getcursor  += 2;
+    return data.ushort;
 }
 #endif
 
 
 #ifndef EXTF_q_readlong
 ot_u32 q_readlong(Queue* q)  {
-    Fourbytes data;
-
-#   ifdef __BIG_ENDIAN__
-        data.ubyte[0]   = q->getcursor[0];
-        data.ubyte[1]   = q->getcursor[1];
-        data.ubyte[2]   = q->getcursor[2];
-        data.ubyte[3]   = q->getcursor[3];
-#   else
-        data.ubyte[3]   = q->getcursor[0];
-        data.ubyte[2]   = q->getcursor[1];
-        data.ubyte[1]   = q->getcursor[2];
-        data.ubyte[0]   = q->getcursor[3];
-#   endif
+    ot_u32 data;
+    Q_GETCHECK(q, 4, 0);
+    
+    if (Q_WORD32(q->getcursor)) {
+        data = PLATFORM_ENDIAN32(*(ot_u32*)q->getcursor);
+    }
+    else {
+        data    = ((ot_u32)q->getcursor[0] << 24) | ((ot_u32)q->getcursor[1] << 16) | \
+                  ((ot_u32)q->getcursor[2] << 8)  |  (ot_u32)q->getcursor[3];
+    }
     
     q->getcursor  += 4;
-    return data.ulong;
+    return data;
 }
 #endif
 
 
 #ifndef EXTF_q_writestring
 void q_writestring(Queue* q, ot_u8* string, ot_int length) {
+    Q_PUTCHECK(q, length);
     platform_memcpy(q->putcursor, string, length);
     q->length      += length;
     q->putcursor   += length;
@@ -243,9 +270,115 @@ void q_writestring(Queue* q, ot_u8* string, ot_int length) {
 
 #ifndef EXTF_q_readstring
 void q_readstring(Queue* q, ot_u8* string, ot_int length) {
+    Q_GETCHECK(q, length, );
     platform_memcpy(string, q->getcursor, length);
     q->getcursor += length;
 }
 #endif
 
 
+
+
+
+/** Ring Queue
+  * ========================================================================
+  * Each side reads the other side's index once, does its copying, and then
+  * publishes its own index last.  The data and the indices are volatile, so
+  * the compiler cannot move the copying past the publish.
+  */
+
+#ifndef EXTF_rq_init
+void rq_init(RingQueue* rq, ot_u8* buffer, ot_u16 alloc) {
+    rq->mask        = alloc - 1;
+    rq->front       = buffer;
+    rq->putindex    = 0;
+    rq->getindex    = 0;
+}
+#endif
+
+
+#ifndef EXTF_rq_empty
+void rq_empty(RingQueue* rq) {
+    rq->getindex = rq->putindex;
+}
+#endif
+
+
+#ifndef EXTF_rq_length
+ot_uint rq_length(RingQueue* rq) {
+    return (ot_u16)(rq->putindex - rq->getindex);
+}
+#endif
+
+
+#ifndef EXTF_rq_space
+ot_uint rq_space(RingQueue* rq) {
+    return (ot_u16)(rq->mask + 1 - (ot_u16)(rq->putindex - rq->getindex));
+}
+#endif
+
+
+#ifndef EXTF_rq_writebyte
+ot_bool rq_writebyte(RingQueue* rq, ot_u8 byte_in) {
+    ot_u16 put = rq->putindex;
+    
+    if ((ot_u16)(put - rq->getindex) > rq->mask) {
+        return False;
+    }
+    rq->front[put & rq->mask]   = byte_in;
+    rq->putindex                = put + 1;
+    return True;
+}
+#endif
+
+
+#ifndef EXTF_rq_readbyte
+ot_int rq_readbyte(RingQueue* rq) {
+    ot_u16  get = rq->getindex;
+    ot_u8   byte_out;
+    
+    if (get == rq->putindex) {
+        return -1;
+    }
+    byte_out        = rq->front[get & rq->mask];
+    rq->getindex    = get + 1;
+    return (ot_int)byte_out;
+}
+#endif
+
+
+#ifndef EXTF_rq_writestring
+ot_uint rq_writestring(RingQueue* rq, ot_u8* string, ot_uint length) {
+    ot_u16  put     = rq->putindex;
+    ot_u16  space   = rq->mask + 1 - (ot_u16)(put - rq->getindex);
+    ot_uint i;
+    
+    if (length > space) {
+        length = space;
+    }
+    for (i=0; i<length; i++, put++) {
+        rq->front[put & rq->mask] = string[i];
+    }
+    rq->putindex = put;
+    return length;
+}
+#endif
+
+
+#ifndef EXTF_rq_readstring
+ot_uint rq_readstring(RingQueue* rq, ot_u8* string, ot_uint length) {
+    ot_u16  get     = rq->getindex;
+    ot_u16  avail   = (ot_u16)(rq->putindex - get);
+    ot_uint i;
+    
+    if (length > avail) {
+        length = avail;
+    }
+    for (i=0; i<length; i++, get++) {
+        string[i] = rq->front[get & rq->mask];
+    }
+    rq->getindex = get;
+    return length;
+}
+#endif
+
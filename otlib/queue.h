@@ -63,6 +63,18 @@ typedef struct {
 } Queue;
 
 
+/** Bounds checking (QUEUE_CHECKS)
+  * Normally the Queue functions do not check the Queue boundaries, the caller
+  * does.  For debug builds, QUEUE_CHECKS makes each write or read that would
+  * go past q->back do nothing (a read gives 0).  Release builds leave it
+  * DISABLED, so that the checks are compiled out.
+  */
+#ifndef QUEUE_CHECKS
+#   define QUEUE_CHECKS     DISABLED
+#endif
+
+
+
 /** @brief Generic initialization routine for Queues.
   * @param q        (Queue*) Pointer to the Queue ADT
   * @param buffer   (ot_u8*) Queue data buffer
@@ -194,4 +206,105 @@ void q_readstring(Queue* q, ot_u8* string, ot_int length);
 
 
 
+
+/** @typedef RingQueue
+  * 
+  * A circular byte queue for exactly one producer and one consumer, such as
+  * an ISR and the kernel.  The producer only ever writes putindex and the 
+  * consumer only ever writes getindex, so neither side needs to disable
+  * interrupts.  The indices run freely and wrap at 65536, so the number of
+  * bytes in the queue is always (putindex - getindex).  This relies on 16 bit
+  * loads and stores being atomic, which they are on all supported MCUs.
+  *
+  * ot_u16 mask         Allocation of the queue data minus 1 (alloc must be 
+  *                     a power of 2, at most 32768)
+  * ot_u16 putindex     Count of bytes written (producer side)
+  * ot_u16 getindex     Count of bytes read (consumer side)
+  * ot_u8* front        First address of queue data
+  */
+typedef struct {
+    ot_u16          mask;
+    volatile ot_u16 putindex;
+    volatile ot_u16 getindex;
+    volatile ot_u8* front;
+} RingQueue;
+
+
+/** @brief Initialization routine for Ring Queues
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @param buffer   (ot_u8*) Queue data buffer
+  * @param alloc    (ot_u16) allocated bytes for queue (must be a power of 2)
+  * @retval none
+  * @ingroup Queue
+  *
+  * Run this before either side starts using the queue.
+  */
+void rq_init(RingQueue* rq, ot_u8* buffer, ot_u16 alloc);
+
+
+/** @brief Discards all data in the Ring Queue (consumer side only)
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @retval none
+  * @ingroup Queue
+  */
+void rq_empty(RingQueue* rq);
+
+
+/** @brief Returns the number of bytes that can be read from the Ring Queue
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @retval ot_uint Bytes in the queue
+  * @ingroup Queue
+  */
+ot_uint rq_length(RingQueue* rq);
+
+
+/** @brief Returns the number of bytes that can be written to the Ring Queue
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @retval ot_uint Free bytes in the queue
+  * @ingroup Queue
+  */
+ot_uint rq_space(RingQueue* rq);
+
+
+/** @brief Writes a byte to the Ring Queue (producer side only)
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @param byte_in  (ot_u8) byte to write
+  * @retval ot_bool False if the queue was full, and the byte was dropped
+  * @ingroup Queue
+  */
+ot_bool rq_writebyte(RingQueue* rq, ot_u8 byte_in);
+
+
+/** @brief Reads a byte from the Ring Queue (consumer side only)
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @retval ot_int  Byte read (0-255), or -1 if the queue was empty
+  * @ingroup Queue
+  */
+ot_int rq_readbyte(RingQueue* rq);
+
+
+/** @brief Writes as much of a string as fits into the Ring Queue (producer side)
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @param string   (ot_u8*) data to write
+  * @param length   (ot_uint) bytes of data to write
+  * @retval ot_uint Bytes written, which is less than length if the queue fills
+  * @ingroup Queue
+  *
+  * The consumer sees the data all at once, when the write is complete.
+  */
+ot_uint rq_writestring(RingQueue* rq, ot_u8* string, ot_uint length);
+
+
+/** @brief Reads up to length bytes from the Ring Queue (consumer side)
+  * @param rq       (RingQueue*) Pointer to the RingQueue ADT
+  * @param string   (ot_u8*) output buffer
+  * @param length   (ot_uint) most bytes to read
+  * @retval ot_uint Bytes read, which is less than length if the queue empties
+  * @ingroup Queue
+  */
+ot_uint rq_readstring(RingQueue* rq, ot_u8* string, ot_uint length);
+
+
+
+
 #endif
@@ -82,6 +82,16 @@
   * cca_rssi        (ot_u8) the max RSSI value to validate clear chan assesment 
   *                 for CSMA-CA.  It is usually lower than the decodable min
   *                 RSSI, in order to prevent "hidden node problem" in CSMA.
+  *
+  * tscale          (ot_u8) air time of one buffer byte, in 1/256 ti units,
+  *                 including FEC expansion.  The driver sets it with the 
+  *                 channel, so rm2_scale_codec() is one multiply and a shift.
+  *
+  * tpad            (ot_u8) packet overhead bytes (preamble, sync, ramping) 
+  *                 that rm2_pkt_duration() adds.  Set with the channel.
+  *
+  * max_eirp        (ot_u8) tx eirp setting of the channel, as configured, with
+  *                 the autoscale flag in bit 7 (M2_FEATURE(AUTOSCALE) only).
   */
 typedef struct {
     ot_int  tg;
@@ -91,10 +101,40 @@ typedef struct {
     ot_u8   link_qual;
     ot_u8   cs_thr;
     ot_u8   cca_thr;
+    ot_u8   tscale;
+    ot_u8   tpad;
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    ot_u8   max_eirp;
+#   endif
 } 
 phymac_struct;
 
 
+/** TX EIRP Autoscaling (M2_FEATURE(AUTOSCALE))
+  * A channel whose tx eirp setting has bit 7 set is autoscaled: the radio
+  * uses the lower of the channel eirp and dll.comm.tx_eirp, which the network
+  * layer sets for each dialog from the path loss to the peer.  The driver
+  * applies it when the channel is looked up, and again when a TX is set up, so
+  * the TX EIRP field of the frame is the one it goes out with.
+  */
+#if (M2_FEATURE(AUTOSCALE) == ENABLED)
+#   define RM2_EIRP_AUTOSCALE(EIRP) \
+        ( (((EIRP) & 0x80) && (dll.comm.tx_eirp < ((EIRP) & 0x7F))) ? \
+            dll.comm.tx_eirp : ((EIRP) & 0x7F) )
+#else
+#   define RM2_EIRP_AUTOSCALE(EIRP)     ((EIRP) & 0x7F)
+#endif
+
+
+/** Buffer byte air time, in 1/256 ti (1 ti = 1024 us)
+  * 55.555 kS/s = 144us per buffer byte, 200.00 kS/s = 40us per buffer byte.
+  * A packet of up to 455 buffer bytes scales without overflowing an ot_int,
+  * even with FEC (x2).
+  */
+#define RM2_TSCALE_55       36
+#define RM2_TSCALE_200      10
+
+
 
 /** PHY-MAC Channel Data
   * The MAC/System level rx chanlist maps to this array.  Mode 2 only supports
@@ -111,6 +151,31 @@ extern phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
 
 
 
+/** Radio Event Timestamps
+  * The driver stamps events with platform_stamp() as near to the event as the
+  * platform allows, which is the first thing in the ISR of the event.  The
+  * kernel times response windows and ETAs from these, instead of from when it
+  * gets around to reading GPTIM.
+  *
+  * rxsync          (ot_u32) sync word detect of the last RX frame
+  * txend           (ot_u32) end of the last TX packet
+  */
+typedef struct {
+    ot_u32  rxsync;
+    ot_u32  txend;
+} 
+rm2_stamp_struct;
+
+extern rm2_stamp_struct rm2_stamp;
+
+/// Ticks since the end of the last RX frame, which was FRAME_BYTES long
+/// (the sync stamp, plus the air time of the frame after the sync word)
+#define RM2_RXEND_AGE(FRAME_BYTES)  \
+    (PLATFORM_STAMP_AGE(rm2_stamp.rxsync) - rm2_scale_codec(FRAME_BYTES))
+
+
+
+
 /** Recasting of some radio attributes
   * Most radios we use have internal FIFO.  But the buffer could also be a DMA
   * on the MCU.  If you do not have a DMA on your micro, make sure you are using
@@ -177,6 +242,9 @@ extern phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
 // Wildcard Channel
 #define RM2_CHAN_WILDCARD   0x7F
 
+// Auto Channel: picked per peer by link adaptation (M2_FEATURE(LINKADAPT))
+#define RM2_CHAN_AUTO       0xFF
+
 // MAC configuration of PHY parameters via synchronizer packet
 #define RM2_ENCODING_FEC    0x80
 
@@ -321,6 +389,23 @@ void radio_idle();
 
 
 
+/** @brief  Calibrates the radio again, from idle time
+  * @param  None
+  * @retval None
+  * @ingroup Radio
+  *
+  * Only used with OT_FEATURE(RFCAL), where the radio runs with its automatic
+  * calibration off.  The kernel calls it with the radio off, when the
+  * temperature or the supply has drifted since the last calibration (see
+  * system.h).  The driver calibrates each center frequency that it holds
+  * results for, saves the new results, and puts the radio back to sleep.
+  */
+#if (OT_FEATURE(RFCAL) == ENABLED)
+void radio_recalibrate();
+#endif
+
+
+
 /** @brief Flushes the TX buffer
   * @param None
   * @retval None
@@ -358,11 +443,23 @@ void radio_putbyte(ot_u8 databyte);
   * @ingroup Radio
   * 
   * This function exists primarily as a way to dump a 32 bit block that has
-  * come from the FEC interleaver.  You can supply an ot_ulong (or ot_long) as
-  * the argument by this method: (ot_u8*)&(ot_ulong).
+  * come from the FEC interleaver.  The bytes are sent in array order, data[0]
+  * first, which is the same order radio_getfourbytes() loads them.
   */
 void radio_putfourbytes(ot_u8* data);
 
+/** @brief Puts as many bytes to the TX radio buffer as will fit, up to a limit
+  * @param data         (ot_u8*) array of bytes to put on TX
+  * @param limit        (ot_int) maximum number of bytes to put
+  * @retval ot_int      number of bytes taken from data
+  * @ingroup Radio
+  *
+  * This is the bulk version of radio_putbyte().  The free space in the TX 
+  * buffer is checked once, and the bytes that fit are moved in one transfer
+  * (burst register write, SPI burst, or DMA, depending on the driver).
+  */
+ot_int radio_putbytes(ot_u8* data, ot_int limit);
+
 
 
 /** @brief Gets a byte from the RX radio buffer
@@ -383,6 +480,21 @@ ot_u8 radio_getbyte();
   */
 void radio_getfourbytes(ot_u8* data);
 
+/** @brief Gets as many bytes from the RX radio buffer as are ready, up to a limit
+  * @param data         (ot_u8*) pointer to an array to load into
+  * @param limit        (ot_int) maximum number of bytes to load
+  * @retval ot_int      number of bytes loaded into data
+  * @ingroup Radio
+  *
+  * This is the bulk version of radio_getbyte().  The fill level of the RX
+  * buffer is checked once, and the ready bytes are moved in one transfer
+  * (burst register read, SPI burst, or DMA, depending on the driver).  The
+  * Mode 2 decoder uses it to land received data directly at rxq.putcursor.
+  * The same caveat as radio_rxopen() applies: drivers for radios with the
+  * CC11xx FIFO erratum will not draw-out the last byte until RX is done.
+  */
+ot_int radio_getbytes(ot_u8* data, ot_int limit);
+
 
 
 /** @brief Checks the RX buffer to see if there is at least 1 more byte in it
@@ -464,6 +576,20 @@ ot_int rm2_scale_codec(ot_int buf_bytes);
 
 
 
+/** Pipelined redundant TX (OT_FEATURE_TXPIPE)
+  * Redundant copies of a packet that need no CSMA (there is no response 
+  * window, or the packet is itself a response) can go out back-to-back.  When
+  * the last frame of a copy has been loaded, the driver calls the TX callback 
+  * with code 2.  If the callback calls rm2_prep_resend(), the driver rewinds
+  * txq and loads the next copy right away, without a trip through the kernel.
+  * The frame already carries its CRC, so only the encoder is re-primed.  This
+  * is for single-frame packets: multiframe packets use the kernel path.
+  */
+#ifndef OT_FEATURE_TXPIPE
+#   define OT_FEATURE_TXPIPE    DISABLED
+#endif
+
+
 /** @brief  Prepares the radio chain to resend a packet
   * @param  None
   * @retval None
@@ -472,6 +598,8 @@ ot_int rm2_scale_codec(ot_int buf_bytes);
   * This works with the redundant-TX feature.  It can be implemented in a
   * variety of ways, depending on how the radio core is designed.  For radio
   * cores that have full low-level MAC support of DASH7, it does nothing.
+  * With OT_FEATURE_TXPIPE, calling it from the code 2 TX callback chains the
+  * next copy onto the current one.
   */
 void rm2_prep_resend();
 
@@ -525,6 +653,81 @@ void rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback);
 
 
 
+/** @brief  Initializes a periodic, radio-timed scan (wake-on-radio)
+  * @param  channel     (ot_u8) Mode 2 channel ID to scan
+  * @param  netstate    (ot_u8) Network state: M2_NETFLAG_FLOOD for bscan
+  * @param  period      (ot_uint) ticks between the start of each scan
+  * @param  listen      (ot_uint) ticks to listen on each scan
+  * @param  callback    (ot_sig2) callback for when RX is done, on error or complete
+  * @retval ot_bool     True if the radio has taken over the scan cycle
+  * @ingroup Radio
+  * @sa rm2_rxinit_ff, rm2_rxinit_bf
+  *
+  * Only available when RF_FEATURE(SCANCYCLE) is enabled.  Instead of waking
+  * the MCU for each scan of a periodic sleep scan sequence, the radio's own
+  * sleep timer is programmed to wake the receiver for each listen window,
+  * and the MCU is only interrupted by a detected sync word.  After that, the
+  * reception continues exactly like rm2_rxinit_ff (or rm2_rxinit_bf when
+  * netstate contains M2_NETFLAG_FLOOD), using the same callback rules.
+  *
+  * The scan cycle runs until a packet is found or rm2_kill() (or radio_idle)
+  * stops it.  If the radio cannot resolve the requested listen duty cycle,
+  * the function returns False without doing anything, and the caller should
+  * use a normal scan.
+  */
+#if (RF_FEATURE(SCANCYCLE) == ENABLED)
+ot_bool rm2_rxinit_sniff(ot_u8 channel, ot_u8 netstate, ot_uint period, ot_uint listen, ot_sig2 callback);
+#endif
+
+
+
+/** @brief  Opens the auxiliary receiver on a channel
+  * @param  channel     (ot_u8) Mode 2 channel ID to listen on
+  * @retval None
+  * @ingroup Radio
+  * @sa rm2_auxrx_close, rm2_auxrx_take
+  *
+  * Only available when RF_FEATURE(AUXRX) is enabled, which is a board with a
+  * second transceiver that only receives.  It listens on its own, with no
+  * callbacks, and holds the foreground frames it hears until they are taken.
+  * Meanwhile, the main radio and the rm2 functions above are free for TX, so
+  * a gateway does not miss the frames that come in while it transmits.
+  * Opening it again changes the channel.  Frames that are held stay held.
+  */
+#if (RF_FEATURE(AUXRX) == ENABLED)
+void rm2_auxrx_open(ot_u8 channel);
+
+
+
+/** @brief  Closes the auxiliary receiver
+  * @param  None
+  * @retval None
+  * @ingroup Radio
+  * @sa rm2_auxrx_open, rm2_auxrx_take
+  *
+  * A frame that is still on the air when it closes is dropped.
+  */
+void rm2_auxrx_close();
+
+
+
+/** @brief  Loads the oldest frame held by the auxiliary receiver into rxq
+  * @param  None
+  * @retval ot_bool     True if a good frame is in rxq
+  * @ingroup Radio
+  * @sa rm2_auxrx_open, rm2_auxrx_close
+  *
+  * Frames that fail their CRC are dropped here, and a frame that is still on
+  * the air is not ready, so False means that no frame is ready.
+  * Call it only when the main radio is not receiving, because rxq is the RX
+  * queue of the main radio, and radio_rssi() returns the RSSI of the frame
+  * afterwards, as it does after a normal RX.
+  */
+ot_bool rm2_auxrx_take();
+#endif
+
+
+
 /** @brief  Initializes TX engine for "foreground" packet transmission
   * @param  est_frames  (ot_int) Number of frames in packet to transmit
   * @param  callback    (ot_sig2) callback for when TX is done, on error or complete
@@ -22,12 +22,11 @@
   * @ingroup    Session
   *
   * The session stack is not exposed, because it may be implemented in a lot of
-  * different ways.  The way it is implemented here is not very efficient for
-  * stacks any larger than a small few elements (maybe 4).  Many devices only
-  * need one session, and even more can do fine with just two, so it is not a
-  * big deal, yet.  For a complex device with large functionality, you would
-  * probably want to do change the data-copying method used here to some sort 
-  * of pointer shifting method.
+  * different ways.  The way it is implemented here is a binary heap of indices
+  * into a fixed pool of sessions, so inserting and popping are O(log n) and the
+  * sessions themselves are never copied.  Time is kept as one clock, against
+  * which each session has a due time, so refreshing is O(1) no matter how deep
+  * OT_FEATURE(SESSION_DEPTH) is.
   *
   ******************************************************************************
   */
@@ -43,43 +42,193 @@
 #define SESSION_STACK_DEPTH     OT_FEATURE(SESSION_DEPTH)
 //#define SESSION_STACK_DEPTH     4
 
+#if (SESSION_STACK_DEPTH > 127)
+#   error "OT_FEATURE(SESSION_DEPTH) must be 127 or less"
+#endif
+
 
-#define Session0    session.heap[session.top]
+#define Session0    session.pool[session.heap[0]]
 
 session_struct session;
 
 
 
+
+/** Session heap internals <BR>
+  * ========================================================================<BR>
+  * Sessions live in session.pool[] and never move, so m2session pointers stay
+  * good until the session is popped.  session.heap[] holds pool indices: the
+  * first (top+1) are a binary min-heap ordered by time-to-go, and the rest are
+  * the free pool slots.  Each session keeps an absolute due time against one
+  * session.clock, so session_refresh() only moves the clock.  The counter
+  * field of the top session is kept current (including changes made to it by
+  * way of session_top()), but the counters of the other sessions are only 
+  * brought up to date when they reach the top.
+  */
+
+ot_uint sub_session_togo(ot_u8 slot) {
+    ot_s32 togo;
+    togo = (ot_s32)(session.due[slot] - session.clock);
+    return (togo > 0) ? (ot_uint)togo : 0;
+}
+
+
+ot_bool sub_session_before(ot_u8 slot_a, ot_u8 slot_b) {
+/// Earlier time-to-go is first.  On a tie, the newer session is first, which
+/// is the way ad-hoc sessions (counter = 0) have always been stacked.
+    ot_uint togo_a = sub_session_togo(slot_a);
+    ot_uint togo_b = sub_session_togo(slot_b);
+    
+    if (togo_a != togo_b) {
+        return (ot_bool)(togo_a < togo_b);
+    }
+    return (ot_bool)((ot_s8)(session.stamp[slot_a] - session.stamp[slot_b]) > 0);
+}
+
+
+ot_bool sub_session_siftup(ot_int pos, ot_int floor) {
+    ot_bool moved = False;
+    ot_u8   slot  = session.heap[pos];
+    
+    while (pos > floor) {
+        ot_int parent = (pos - 1) >> 1;
+        if (sub_session_before(slot, session.heap[parent]) == False) {
+            break;
+        }
+        session.heap[pos]   = session.heap[parent];
+        pos                 = parent;
+        moved               = True;
+    }
+    session.heap[pos] = slot;
+    return moved;
+}
+
+
+void sub_session_siftdown(ot_int pos) {
+    ot_u8 slot = session.heap[pos];
+    
+    while (1) {
+        ot_int child = (pos << 1) + 1;
+        if (child > session.top) {
+            break;
+        }
+        if ((child < session.top) && \
+            sub_session_before(session.heap[child+1], session.heap[child])) {
+            child++;
+        }
+        if (sub_session_before(session.heap[child], slot) == False) {
+            break;
+        }
+        session.heap[pos]   = session.heap[child];
+        pos                 = child;
+    }
+    session.heap[pos] = slot;
+}
+
+
+void sub_session_occupy(ot_u8 chan_id) {
+/// Sessions are counted per channel index.  occ_chan is the channel ID of the
+/// index while occ_mixed is clear, and occ_mixed is set when sessions on two
+/// different ID's share the index.
+    ot_u8   i       = chan_id & 0x0F;
+    ot_u16  i_bit   = (ot_u16)1 << i;
+    
+    if (session.occ_count[i] == 0) {
+        session.occ_chan[i] = chan_id;
+    }
+    else if (session.occ_chan[i] != chan_id) {
+        session.occ_mixed |= i_bit;
+    }
+    session.occ_count[i]++;
+}
+
+
+void sub_session_vacate(ot_u8 chan_id) {
+    ot_u8 i = chan_id & 0x0F;
+    
+    if (--session.occ_count[i] == 0) {
+        session.occ_mixed &= ~((ot_u16)1 << i);
+    }
+}
+
+
+void sub_session_remove(ot_int pos) {
+/// The removed slot is parked just past the end of the heap, in the free part.
+/// The root is never displaced unless it is the one being removed.
+    ot_u8 slot;
+    slot                            = session.heap[pos];
+    session.pool[slot].netstate     = 0;
+    sub_session_vacate(session.pool[slot].channel);
+    session.heap[pos]               = session.heap[session.top];
+    session.heap[session.top]       = slot;
+    session.top--;
+    
+    if (pos <= session.top) {
+        if (sub_session_siftup(pos, 1) == False) {
+            sub_session_siftdown(pos);
+        }
+    }
+}
+
+
+void sub_session_publish() {
+    if (session.top >= 0) {
+        Session0.counter = sub_session_togo(session.heap[0]);
+    }
+    else {
+        session.clock = 0;
+    }
+}
+
+
+void sub_session_absorb() {
+/// Pick up a counter value that was written into the top session
+    if (session.top >= 0) {
+        ot_u8 slot = session.heap[0];
+        if (session.pool[slot].counter != sub_session_togo(slot)) {
+            session.due[slot] = session.clock + session.pool[slot].counter;
+            sub_session_siftdown(0);
+            sub_session_publish();
+        }
+    }
+}
+
+
+
+
 #ifndef EXTF_session_init
 void session_init() {
     ot_int i;
         
     for (i=0; i<OT_FEATURE(SESSION_DEPTH); i++) {
-        session.heap[i].netstate  = 0;
+        session.pool[i].netstate    = 0;
+        session.heap[i]             = (ot_u8)i;
+#       if (OT_FEATURE(NL_SECURITY))
+        session.nls[i].ready        = False;
+#       endif
+    }
+    for (i=0; i<16; i++) {
+        session.occ_count[i]        = 0;
     }
         
-    session.top = -1;
+    session.occ_mixed  = 0;
+    session.top        = -1;
+    session.clock      = 0;
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    session.hwm        = -1;
+#   endif
 }
 #endif
 
 
 
 #ifndef EXTF_session_refresh
-ot_bool session_refresh(ot_uint elapsed_ti) {
-    ot_bool test = False;
-    ot_s8   i;
-
-    for (i=session.top; (i>=0) /* && (session.heap[i].netstate != 0) */; i--) {
-        if (elapsed_ti >= session.heap[i].counter) {
-            session.heap[i].counter = 0;
-            test                    = True;
-        }
-        else {
-            session.heap[i].counter -= elapsed_ti;
-        }
-    }
+ot_bool session_refresh(ot_u32 elapsed_ti) {
+    sub_session_absorb();
+    session.clock += elapsed_ti;
+    sub_session_publish();
 
-    return test;
+    return (ot_bool)((session.top >= 0) && (Session0.counter == 0));
 }
 #endif
 
@@ -87,67 +236,94 @@ ot_bool session_refresh(ot_uint elapsed_ti) {
 
 #ifndef EXTF_session_new
 m2session* session_new(ot_uint new_counter, ot_u8 new_netstate, ot_u8 new_channel) {
-    ot_s8 pos = session.top+1;
-    
-    /// If this is a scheduled session (not ad-hoc) follow the session rules
-    /// when adding the session.
-    if (new_counter != 0) {
-        ot_s8  i;
-        for (i=session.top; i>=0; i--) {
-            // Set the position for the new session, by ascending order
-            pos -= (new_counter > session.heap[i].counter);
-            
-            // Discontinued feature: fail if there is already a session on this channel
-            //if (new_channel == session.heap[i].channel) {
-            //    return NULL;
-            //}
-        }
-    }
-
-    /// If the session stack is not full, shift prioritized sessions up
+    ot_int  pos;
+    ot_u8   slot;
+    
+    sub_session_absorb();
+    
+    /// If the session stack is not full, take a free slot.  If it is full, 
+    /// replace the session that is furthest away, which is always a leaf.
     if (session.top < (OT_FEATURE(SESSION_DEPTH)-1)) {
-        ot_s8 i;
         session.top++;
-
-        for (i=session.top; i>pos; ) {
-            ///@note Beware of stupid, little endian bullshit in this loop.
-            ///      The order of the new = old seems to matter.
-            ot_u32* new = (ot_u32*)&session.heap[i];
-            ot_u32* old = (ot_u32*)&session.heap[--i];
-            new[1]      = old[1];
-            new[0]      = old[0];
-            
-            ///@todo Experimental
-            //platform_memcpy((ot_u8*)old, (ot_u8*)new, sizeof(session));
+        pos = session.top;
+#       if (OT_FEATURE(MEMSTATS) == ENABLED)
+        if (session.top > session.hwm) {
+            session.hwm = session.top;
         }
+#       endif
     }
-    
-    /// If the stack is full, shift de-prioritized sessions down (deleting furthest)
     else {
         ot_int i;
-        pos--;
-        
-        for (i=0; i<pos; ) {
-            ///@note Beware of stupid, little endian bullshit in this loop.
-            ///      The order of the new = old seems to matter.
-            ot_u32* new = (ot_u32*)&session.heap[i];
-            ot_u32* old = (ot_u32*)&session.heap[++i];
-            new[0]      = old[0];
-            new[1]      = old[1];
-            
-            ///@todo Experimental
-            //platform_memcpy((ot_u8*)old, (ot_u8*)new, sizeof(session));
+        pos = session.top;
+        for (i=(session.top>>1); i<session.top; i++) {
+            if (sub_session_before(session.heap[pos], session.heap[i])) {
+                pos = i;
+            }
         }
+        sub_session_vacate(session.pool[session.heap[pos]].channel);
     }
     
     /// Write-out the session
-    session.heap[pos].counter   = new_counter;
-    session.heap[pos].channel   = new_channel;
-    session.heap[pos].dialog_id = ++session.seq_number;
-    session.heap[pos].protocol  = 0;                ///default protocol = 0 (Mode 2 normal dialog)
-    session.heap[pos].netstate  = new_netstate;     ///@note, may need to or with M2_NETSTATE_INIT
+    slot                            = session.heap[pos];
+    sub_session_occupy(new_channel);
+    session.due[slot]               = session.clock + new_counter;
+    session.pool[slot].counter      = new_counter;
+    session.pool[slot].channel      = new_channel;
+    session.pool[slot].dialog_id    = ++session.seq_number;
+    session.pool[slot].protocol     = 0;                ///default protocol = 0 (Mode 2 normal dialog)
+    session.pool[slot].netstate     = new_netstate;     ///@note, may need to or with M2_NETSTATE_INIT
+    session.stamp[slot]             = session.seq_number;
+#   if (OT_FEATURE(NL_SECURITY))
+    session.nls[slot].ready         = False;
+#   endif
+    
+    sub_session_siftup(pos, 0);
+    sub_session_publish();
+    
+    return &session.pool[slot];
+}
+#endif
+
+
+
+#ifndef EXTF_session_renew
+m2session* session_renew(ot_uint new_counter, ot_u8 new_netstate, ot_u8 new_channel) {
+    ot_u8 slot;
+    
+    if (session.top < 0) {
+        return session_new(new_counter, new_netstate, new_channel);
+    }
     
-    return &session.heap[pos];
+    /// The new session is the newest, so on a tie it stays ahead: it can only
+    /// move down the heap from the top.
+    slot                            = session.heap[0];
+    sub_session_vacate(session.pool[slot].channel);
+    sub_session_occupy(new_channel);
+    session.due[slot]               = session.clock + new_counter;
+    session.pool[slot].counter      = new_counter;
+    session.pool[slot].channel      = new_channel;
+    session.pool[slot].dialog_id    = ++session.seq_number;
+    session.pool[slot].protocol     = 0;
+    session.pool[slot].netstate     = new_netstate;
+    session.stamp[slot]             = session.seq_number;
+#   if (OT_FEATURE(NL_SECURITY))
+    session.nls[slot].ready         = False;
+#   endif
+    
+    sub_session_siftdown(0);
+    sub_session_publish();
+    
+    return &session.pool[slot];
+}
+#endif
+
+
+
+#ifndef EXTF_session_setchannel
+void session_setchannel(m2session* s_ptr, ot_u8 new_channel) {
+    sub_session_vacate(s_ptr->channel);
+    sub_session_occupy(new_channel);
+    s_ptr->channel = new_channel;
 }
 #endif
 
@@ -155,10 +331,17 @@ m2session* session_new(ot_uint new_counter, ot_u8 new_netstate, ot_u8 new_channe
 
 #ifndef EXTF_session_occupied
 ot_bool session_occupied(ot_u8 chan_id) {
-    ot_s8 i;
+    ot_s8 i = chan_id & 0x0F;
+    
+    if (session.occ_count[i] == 0) {
+        return False;
+    }
+    if ((session.occ_mixed & ((ot_u16)1 << i)) == 0) {
+        return (ot_bool)(session.occ_chan[i] == chan_id);
+    }
     
     for (   i=session.top; 
-            (i>=0) && (chan_id != session.heap[i].channel); 
+            (i>=0) && (chan_id != session.pool[session.heap[i]].channel); 
             i-- );
             
     return (ot_bool)(i>=0);
@@ -169,8 +352,10 @@ ot_bool session_occupied(ot_u8 chan_id) {
 
 #ifndef EXTF_session_pop
 void session_pop() {
-    Session0.netstate = 0;
-    session.top--;
+    if (session.top >= 0) {
+        sub_session_remove(0);
+        sub_session_publish();
+    }
 }
 #endif
 
@@ -178,7 +363,8 @@ void session_pop() {
 
 #ifndef EXTF_session_flush
 void session_flush() {
-    while ((Session0.counter == 0) && (session.top >= 0)) {
+    sub_session_absorb();
+    while ((session.top >= 0) && (Session0.counter == 0)) {
         session_pop();
     }
 }
@@ -188,11 +374,16 @@ void session_flush() {
 
 #ifndef EXTF_session_drop
 void session_drop() {
-    ot_u16 temp = Session0.counter;
+    ot_int pos;
     
-    Session0.counter = 1;
-    session_flush();
-    Session0.counter = temp;
+    /// Remove from the bottom up, so the session moved into each hole has 
+    /// already been checked.
+    sub_session_absorb();
+    for (pos=session.top; pos>0; pos--) {
+        if ((pos <= session.top) && (sub_session_togo(session.heap[pos]) == 0)) {
+            sub_session_remove(pos);
+        }
+    }
 }
 #endif
 
@@ -205,8 +396,35 @@ ot_int session_count() {
 #endif
 
 
+
+#if (OT_FEATURE(MEMSTATS) == ENABLED)
+#ifndef EXTF_session_hwm
+ot_int session_hwm() {
+    return (ot_int)session.hwm + 1;
+}
+#endif
+
+
+#ifndef EXTF_session_hwm_clear
+void session_hwm_clear() {
+    session.hwm = session.top;
+}
+#endif
+#endif
+
+
+#if (OT_FEATURE(NL_SECURITY))
+#ifndef EXTF_session_nls
+session_nlskey* session_nls(m2session* s_ptr) {
+    return &session.nls[s_ptr - session.pool];
+}
+#endif
+#endif
+
+
 #ifndef EXTF_session_top
 m2session* session_top() {
+    sub_session_absorb();
     return &Session0;
 }
 #endif
@@ -272,15 +490,16 @@ void print_stack() {
     if (session.top >= 0)
         printf("=======================================\n");
     
-    for (i=session.top; i>=0; i--) {
+    for (i=0; i<=session.top; i++) {
+        m2session* s = &session.pool[session.heap[i]];
         printf("%d: 0x%04X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X\n", i,
-            session.heap[i].counter, 
-            session.heap[i].channel, 
-            session.heap[i].dialog_id, 
-            session.heap[i].netstate,
-            session.heap[i].subnet, 
-            session.heap[i].protocol, 
-            session.heap[i].flags);
+            sub_session_togo(session.heap[i]), 
+            s->channel, 
+            s->dialog_id, 
+            s->netstate,
+            s->subnet, 
+            s->protocol, 
+            s->flags);
     }
     
     printf("\n");
@@ -27,14 +27,13 @@
   * requirements of the spec in addition to the storage of some other, session
   * oriented parameters that need to be passed between layers.
   * 
-  * The session module implements a session stack.  The stack is sorted when a
-  * new session is inserted.  The implementation of the stack itself is in the
-  * session.c file, and it is completely abstracted in case you want to do 
-  * something more complex than the really basic stack implementation that is
-  * currently used.  The current implementation is good for systems where there
-  * are fewer that four simultaneous sessions permitted, which is actually more
-  * than a lot of devices will ever need -- for many devices, one session is all
-  * that will ever be used at any given time.
+  * The session module implements a session stack.  The stack is kept in order
+  * so the top session is the one happening soonest.  The implementation of the
+  * stack itself is in the session.c file, and it is completely abstracted in 
+  * case you want to do something different.  The current implementation is a
+  * binary heap over a fixed pool of sessions, so it scales to the dozens of
+  * simultaneous sessions a gateway might keep, while a simple endpoint can 
+  * still use a depth of one or two.
   ******************************************************************************
   */
 
@@ -143,10 +142,39 @@ typedef struct {
 } m2session;
 
 
+/** Network Layer Security dialog keys (OT_FEATURE(NL_SECURITY))
+  * NLS derives one key per dialog (see m2_network.h).  Its AES-CCM schedule
+  * is kept with the slot of the session, so the frames of the dialog only run
+  * the cipher.  The key is dropped when the slot gets a new session.
+  *
+  * ready       (ot_bool) True when schedule holds the key of this dialog
+  * code        (ot_u8) NLS code of the dialog, echoed in the responses
+  * schedule    (ot_u32[]) AES_EXPKEY_SIZE words of AES-CCM key schedule
+  */
+typedef struct {
+    ot_bool ready;
+    ot_u8   code;
+    ot_u32  schedule[44];
+} session_nlskey;
+
+
 typedef struct {
-    m2session   heap[OT_FEATURE(SESSION_DEPTH)];
+    m2session   pool[OT_FEATURE(SESSION_DEPTH)];
+    ot_u32      due[OT_FEATURE(SESSION_DEPTH)];
+    ot_u8       stamp[OT_FEATURE(SESSION_DEPTH)];
+    ot_u8       heap[OT_FEATURE(SESSION_DEPTH)];
+#   if (OT_FEATURE(NL_SECURITY))
+    session_nlskey nls[OT_FEATURE(SESSION_DEPTH)];
+#   endif
+    ot_u8       occ_count[16];
+    ot_u8       occ_chan[16];
+    ot_u16      occ_mixed;
+    ot_u32      clock;
     ot_s8       top;
     ot_u8       seq_number;
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    ot_s8       hwm;                // highest top since init or clear
+#   endif
 } session_struct;
 
 extern session_struct session;
@@ -164,11 +192,15 @@ void session_init();
 
 
 /** @brief  Reduces the session counters uniformly, and alerts if a session is beginning
-  * @param  elapsed_ti      (ot_uint) ti to reduce all session counters by
+  * @param  elapsed_ti      (ot_u32) ti to reduce all session counters by
   * @retval ot_bool         True/False on session event timeout / no timeout
   * @ingroup Session
+  *
+  * Only the counter of the top session (from session_top()) is kept current.
+  * The other sessions are timed correctly, but their counter fields are not
+  * updated until they reach the top.
   */
-ot_bool session_refresh(ot_uint elapsed_ti);
+ot_bool session_refresh(ot_u32 elapsed_ti);
 
 
 
@@ -181,12 +213,44 @@ ot_bool session_refresh(ot_uint elapsed_ti);
   * @ingroup Session
   *
   * Additional session data not supplied as parameters to this function must be
-  * loaded-in by the user, via the returned pointer.
+  * loaded-in by the user, via the returned pointer.  The channel is the only
+  * exception: it is tracked for session_occupied(), so it must not be changed
+  * via the pointer.
   */
 m2session* session_new(ot_u16 new_counter, ot_u8 new_netstate, ot_u8 new_channel);
 
 
 
+/** @brief  Writes a new session over the top session, in place
+  * @param  new_counter     (ot_u16) new session initial counter value
+  * @param  new_netstate    (ot_u8) new session netstate value
+  * @param  new_channel     (ot_u8) new session channel id
+  * @retval m2session*      Pointer to the renewed session struct
+  * @ingroup Session
+  *
+  * Same result as session_pop() followed by session_new(), but the slot is
+  * reused and the heap is only sifted once.  Use it when the top session is
+  * being replaced by its follow-up, i.e. a background scan that receives a 
+  * flood frame.  If the stack is empty, it is just session_new().
+  */
+m2session* session_renew(ot_u16 new_counter, ot_u8 new_netstate, ot_u8 new_channel);
+
+
+
+/** @brief  Moves a session to another channel
+  * @param  s_ptr           (m2session*) session to move
+  * @param  new_channel     (ot_u8) new session channel id
+  * @retval none
+  * @ingroup Session
+  *
+  * This is the way to change the channel of a session that is on the stack,
+  * so that session_occupied() stays correct.  The kernel uses it when a scan
+  * hops to the next channel of its list.
+  */
+void session_setchannel(m2session* s_ptr, ot_u8 new_channel);
+
+
+
 /** @brief  Returns true if there is already a session scheduled on supplied channel
   * @param  chan_id         (ot_u8) channel id to check for occupancy
   * @retval none
@@ -199,6 +263,11 @@ m2session* session_new(ot_u16 new_counter, ot_u8 new_netstate, ot_u8 new_channel
   * order to potentially cancel the scan before it starts.
   * 
   * Ad-hoc sessions (counter set initially to 0) are exempt from any such rules.
+  *
+  * Occupancy is counted per channel index (low nibble of the channel ID) as
+  * sessions come and go, so the answer is O(1).  Only an index that has 
+  * sessions on two channel ID's at once (different spectrum classes) needs a
+  * scan of the stack.
   */
 ot_bool session_occupied(ot_u8 chan_id);
 
@@ -240,6 +309,39 @@ ot_int session_count();
 
 
 
+/** @brief  Returns the most sessions that have been in the stack at once
+  * @param  none
+  * @retval ot_int      Number of sessions (not zero indexed)
+  * @ingroup Session
+  *
+  * Only with OT_FEATURE(MEMSTATS).  It shows how much of SESSION_DEPTH the
+  * app really uses.
+  */
+ot_int session_hwm();
+
+
+/** @brief  Starts the session high-water mark over from the sessions in the
+  *         stack now
+  * @param  none
+  * @retval none
+  * @ingroup Session
+  */
+void session_hwm_clear();
+
+
+
+/** @brief  Returns the NLS dialog key of a session
+  * @param  s_ptr           (m2session*) session on the stack
+  * @retval session_nlskey* NLS key cache of the session's slot
+  * @ingroup Session
+  *
+  * Only with OT_FEATURE(NL_SECURITY).  The cache is not ready until the NLS
+  * code in m2_network.c derives the key of the dialog.
+  */
+session_nlskey* session_nls(m2session* s_ptr);
+
+
+
 /** @brief  Returns the session at the top of the stack.
   * @param  none
   * @retval m2session*   Session at top of stack
@@ -58,6 +58,11 @@
 #define SYS_RFA_TRANSMIT    (RF_FEATURE(TXTIMER) == DISABLED)
 #define SYS_RFA_FLOOD       ((RF_FEATURE(TXTIMER) == DISABLED) && SYS_FLOOD)
 
+/// Early RX filter: see sys_rxfilter()
+#ifndef M2_FEATURE_RXFILTER
+#   define M2_FEATURE_RXFILTER  ENABLED
+#endif
+
 
 
 
@@ -66,23 +71,47 @@
   * 
   * SYS_EVENT_MAX       max duration in ticks that an event may be queued
   * SYS_RUN_MAX         max duration in ticks that the sys_run can go between calls
+  *                     (the platform kernel timer is 32 bits, see platform_set_ktim)
   * SYS_BEACON_THRESH   block beacons that are this many ticks away from a priority comm event
   */
 #define SYS_EVENT_MAX               (ot_long)2147483647
-#define SYS_RUN_MAX                 65535
+#define SYS_RUN_MAX                 (ot_long)0x00FFFFFF
 #define SYS_BEACON_THRESH           (M2_FEATURE(BEACON_THRESH) * PLATFORM_GPTIM_TICKS_PER_TI)
 
 
 
 /** SYS Mutexes
   * The SYS module is the centerpiece of OpenTag.  It manages access of platform
-  * resources within other OpenTag modules.  You can at any time check the 
-  * mutexes.  This can gate the runtime of your app.  There is plenty of room
-  * left for more mutexes.
+  * resources within other OpenTag modules.  sys.mutex is a set of resource
+  * locks, one bit per resource, and a task only waits for the locks of the
+  * resources it uses.  You can at any time check the mutexes.  This can gate
+  * the runtime of your app.
+  *
+  * The three radio locks are one level of the radio and packet path: setting
+  * one of them clears the other two.  The other locks are independent.  The
+  * kernel takes SYS_MUTEX_FLASH during its flash erase window.  MPipe, crypto
+  * and buffer locks are for the drivers and the app: the kernel only skips its
+  * background jobs that need a resource that is locked (e.g. deferred logs
+  * wait for SYS_MUTEX_MPIPE).
+  *
+  * SYS_EXT_LOCKS is the set of locks the external event (sys.evt.EXT) needs.
+  * By default it needs the radio, so it waits for any radio event, as before.
+  * An app whose external process does not use the radio can set it to 0 (or
+  * to the locks it does use), and then its events run while the radio waits
+  * to listen or to transmit.
   */
 #define SYS_MUTEX_RADIO_LISTEN      0x01                                // bit 0
 #define SYS_MUTEX_RADIO_DATA        0x02                                // bit 1
 #define SYS_MUTEX_PROCESSING        0x04                                // bit 2
+#define SYS_MUTEX_FLASH             0x08                                // bit 3
+#define SYS_MUTEX_MPIPE             0x10                                // bit 4
+#define SYS_MUTEX_CRYPTO            0x20                                // bit 5
+#define SYS_MUTEX_BUFFERS           0x40                                // bit 6
+#define SYS_MUTEX_RADIO             (SYS_MUTEX_RADIO_LISTEN | SYS_MUTEX_RADIO_DATA | SYS_MUTEX_PROCESSING)
+
+#ifndef SYS_EXT_LOCKS
+#   define SYS_EXT_LOCKS            SYS_MUTEX_RADIO
+#endif
 
 
 
@@ -269,6 +298,11 @@ typedef struct {
   *                 store the single channel RX & TX chanlists in this dump and
   *                 point tx_chanlist & rx_chanlist to it, accordingly.  By
   *                 convention, [1] is used for rx_chanlist and [0] for tx.
+  *
+  * tx_eirp         (ot_u8) Highest tx eirp for this dialog, as the eirp code
+  *                 of the frame header (0x7F for no limit).  It only applies
+  *                 to autoscaled channels (see RM2_EIRP_AUTOSCALE).  Only with
+  *                 M2_FEATURE(AUTOSCALE).
   */
 
 // Parameters for csmaca_params
@@ -280,6 +314,7 @@ typedef struct {
 #define M2_CSMACA_RIGD      0x00
 #define M2_CSMACA_RAIND     0x08
 #define M2_CSMACA_AIND      0x10
+#define M2_CSMACA_FSA       0x20
 #define M2_CSMACA_MACCA     0x38
 
 typedef struct {
@@ -293,6 +328,9 @@ typedef struct {
     ot_u8*  tx_chanlist;
     ot_u8*  rx_chanlist;
     ot_u8   scratch[2];         // intended for chanlist storage during ad-hoc single channel dialogs
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    ot_u8   tx_eirp;
+#   endif
 } m2comm_struct;
 
 
@@ -357,6 +395,25 @@ void sys_init();
 void sys_refresh();
 
 
+/** @brief Applies the settings ISFs that have changed, without wiping sessions
+  * @param none
+  * @retval none  
+  * @ingroup System
+  * @sa sys_refresh(), vl_isfchange
+  *
+  * Veelite flags each ISF that is written (vl_isfchange).  For the Network
+  * Settings, Channel Configuration, Real Time Scheduler and the scan and 
+  * beacon sequence ISFs, this reloads only what the written files change: the
+  * network settings and idle state, the channel the radio has loaded, and the
+  * idle events whose sequence, RTC alarm or active setting changed.  Sessions
+  * are kept, and the other idle events keep their place in the schedule.
+  *
+  * The kernel calls it before it processes events, whenever one of these 
+  * ISFs has been written, so a user only needs it to apply a change at once.
+  */
+void sys_reconfigure();
+
+
 /** @brief Changes the device settings (see Network Settings ISF)
   * @param new_mask         (ot_u16) Bitmask for applying new settings
   * @param new_settings     (ot_u16) Compared with supported settings, and set.
@@ -365,7 +422,8 @@ void sys_refresh();
   *
   * This will alter the active device settings.  If settings cannot be 
   * supported (check supported settings), the value you input might be modified
-  * in order to meet supported settings.
+  * in order to meet supported settings.  The new settings are applied by
+  * sys_reconfigure(), so ongoing sessions are not flushed.
   */
 void sys_change_settings(ot_u16 new_mask, ot_u16 new_settings);
 
@@ -443,6 +501,20 @@ void sys_goto_listen();
 void sys_panic(ot_u8 err_code);
 
 
+/** @brief Makes due the idle event that an RTC alarm is for
+  * @param alarm_id     (ot_u8) alarm index given to platform_set_rtc_alarm()
+  * @retval None
+  * @ingroup System
+  *
+  * Called by the platform RTC ISR when an alarm matches.  An idle event that
+  * is run by the RTC scheduler (it has a sched_id) does not count down between
+  * its runs, it waits for its alarm, so a long-period event (e.g. an hourly
+  * beacon) does not wake the kernel in between.  This function sets the event
+  * to run now, and pre-empts the kernel.
+  */
+void sys_rtc_alarm(ot_u8 alarm_id);
+
+
 
 /** @brief Feed it a channel ID, it will tell you if CSMA is required
   * @param none
@@ -473,9 +545,12 @@ void sys_quit_rf();
 
 
 /** @brief Sets mutexes based on mask input
-  * @param set_mask         (ot_uint) The mutex value to set
+  * @param set_mask         (ot_uint) The mutex bits to set
   * @retval none
   * @ingroup System
+  *
+  * Other locks are kept, except that a radio lock replaces the radio lock
+  * that is held (see SYS_MUTEX_RADIO).
   */
 void sys_set_mutex(ot_uint set_mask);
 
@@ -497,15 +572,1294 @@ ot_int sys_get_mutex();
 
 
 
+/** @brief Filters a foreground frame on what has arrived of its header
+  * @param none
+  * @retval ot_bool         False if the frame is for another subnet or device
+  * @ingroup System
+  * @sa rm2_rxdata_isr()
+  *
+  * With M2_FEATURE(RXFILTER), the radio driver calls this in rm2_rxdata_isr()
+  * after the data is decoded into rxq, and it kills RX on False, as it does
+  * for a weak link.  Once the subnet byte is in, it gets the subnet filter of
+  * the MAC.  Once a unicast frame has its target ID in, and the frame is not
+  * DLLS-encrypted, the target must be this device.  The address part is not
+  * done with M2_FEATURE(MULTIHOP), which learns neighbors from all frames.
+  * Until the bytes are in, it returns True.
+  */
+ot_bool sys_rxfilter();
+
+
+
 /** @brief Event Management and Processing
-  * @param elapsed_ms   (ot_uint) Supply number of ticks since last call.
-  * @retval (ot_uint)   Number of ticks until you need to call it next
+  * @param elapsed_ms   (ot_u32) Supply number of ticks since last call.
+  * @retval (ot_u32)    Number of ticks until you need to call it next
   * @ingroup System
   * 
   * This is one of the functions that has to be in your client program.  It is
   * wrapped inside otapi_run(), which can contain other logic, if desired.
+  *
+  * Both values are 32 bits, so a long idle period is one sleep (at most
+  * SYS_RUN_MAX).  A platform with only a 16 bit kernel timer must clip the
+  * return value.
   */  
-ot_uint sys_event_manager(ot_uint elapsed);
+ot_u32 sys_event_manager(ot_u32 elapsed);
+
+
+
+
+/** Kernel Profiler (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(PROFILER) ENABLED, the kernel times each task it runs from
+  * sys_event_manager(), and the radio drivers time their RX sync, RX data, TX
+  * data and RX end ISRs.  Each of these has a sys_profile record, indexed by
+  * Task_Index for kernel tasks or by SYS_PROFILE_RXSYNC/RXDATA/TXDATA/RXEND
+  * for the ISRs.  The count of an RX/TX data record is the number of FIFO
+  * interrupts, so it shows how well the FIFO thresholds are sized.  Time
+  * is in the units of platform_get_cycles().  ISR time is also counted in the
+  * time of the task it interrupted.  The SYS_PROFILE_CCM record times each
+  * 16 byte block that AES-CCM processes (see crypto_aes128.h).
+  *
+  * The RX parsing pipeline has a record for each stage of a request that
+  * network_route_ff() routes: SYS_PROFILE_M2QP is m2qp_parse_frame(), and it
+  * includes SYS_PROFILE_QUERY, the query filter (sub_process_query()), and
+  * SYS_PROFILE_RESP, the response that M2QP builds for a passing request.
+  *
+  * The SYS_PROFILE_RFWAIT record times the windows where a non-radio ISR
+  * holds off the radio ISRs: from its entry to the point where it lets the
+  * radio preempt it (platform_isr_nest() on MSP430), or to its end.  Its max
+  * is the measured worst-case radio ISR latency that such handlers add.  On
+  * STM32 the radio has the highest NVIC priority, so no handler logs it.
+  *
+  * The histogram bins are 4x wider each: bin 0 is under 16 units, bin 1 is 
+  * under 64, and the last bin takes everything else.
+  */
+#define SYS_PROFILE_BINS        8
+#define SYS_PROFILE_TASKS       8
+#define SYS_PROFILE_RXDATA      (SYS_PROFILE_TASKS+0)
+#define SYS_PROFILE_TXDATA      (SYS_PROFILE_TASKS+1)
+#define SYS_PROFILE_RXEND       (SYS_PROFILE_TASKS+2)
+#define SYS_PROFILE_RXSYNC      (SYS_PROFILE_TASKS+3)
+#define SYS_PROFILE_CCM         (SYS_PROFILE_TASKS+4)
+#define SYS_PROFILE_RFWAIT      (SYS_PROFILE_TASKS+5)
+#define SYS_PROFILE_M2QP        (SYS_PROFILE_TASKS+6)
+#define SYS_PROFILE_QUERY       (SYS_PROFILE_TASKS+7)
+#define SYS_PROFILE_RESP        (SYS_PROFILE_TASKS+8)
+#define SYS_PROFILE_IDS         (SYS_PROFILE_TASKS+9)
+
+typedef struct {
+    ot_u32  total;
+    ot_u32  max;
+    ot_u16  count;
+    ot_u16  hist[SYS_PROFILE_BINS];
+} sys_profile;
+
+#ifndef OT_FEATURE_PROFILER
+#define OT_FEATURE_PROFILER     DISABLED
+#endif
+
+#if (OT_FEATURE(PROFILER) == ENABLED)
+#   define SYS_PROFILE_ISR_START()      sys_profile_isrstart()
+#   define SYS_PROFILE_ISR_STOP(ID)     sys_profile_isrstop(ID)
+#   define SYS_PROFILE_WAIT_START()     sys_profile_waitstart()
+#   define SYS_PROFILE_WAIT_STOP()      sys_profile_waitstop()
+#else
+#   define SYS_PROFILE_ISR_START()      while(0)
+#   define SYS_PROFILE_ISR_STOP(ID)     while(0)
+#   define SYS_PROFILE_WAIT_START()     while(0)
+#   define SYS_PROFILE_WAIT_STOP()      while(0)
+#endif
+
+
+
+/** @brief Logs the time from a platform_get_cycles() mark until now
+  * @param id           (ot_u8) profile id, < SYS_PROFILE_IDS
+  * @param mark         (ot_u32) value of platform_get_cycles() at start
+  * @retval None
+  * @ingroup System
+  */
+void sys_profile_log(ot_u8 id, ot_u32 mark);
+
+
+/** @brief Starts timing a radio ISR (use SYS_PROFILE_ISR_START())
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_profile_isrstart();
+
+
+/** @brief Stops timing a radio ISR and logs it (use SYS_PROFILE_ISR_STOP())
+  * @param id           (ot_u8) one of SYS_PROFILE_RXSYNC, RXDATA, TXDATA, RXEND
+  * @retval None
+  * @ingroup System
+  */
+void sys_profile_isrstop(ot_u8 id);
+
+
+/** @brief Starts timing a radio hold-off window (use SYS_PROFILE_WAIT_START())
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_profile_waitstart();
+
+
+/** @brief Stops timing a radio hold-off window, and logs it to the
+  *        SYS_PROFILE_RFWAIT record (use SYS_PROFILE_WAIT_STOP())
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_profile_waitstop();
+
+
+/** @brief Zeros all profile records
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_profile_clear();
+
+
+/** @brief Writes the profile records to the kernel profile ISF
+  * @param None
+  * @retval ot_int      Bytes written, or -1 if there is no such file
+  * @ingroup System
+  *
+  * The file is ISF_ID(kernel_profile), which the app must define and allocate
+  * if it wants this feature (a mirror-only file is the best choice, because 
+  * it lives in RAM).  Once exported, the records can be read like any other
+  * ISF, over ALP or MPipe.  Each record is written as big-endian 16 bit words:
+  * count, mean, max, and then the histogram bins (the 32 bit values saturate
+  * at 65535). Records are written in id order until the file is full.
+  */
+ot_int sys_profile_export();
+
+
+
+
+/** Kernel Trace (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(TRACE) ENABLED, the kernel writes a record into a RAM ring
+  * of SYS_TRACE_SIZE records (power of 2) for each traced event.  The ring
+  * keeps the newest records.  Each record is two 16 bit words:
+  * - (event id << 8) | argument
+  * - GPTIM ticks since the previous record
+  * Event ids below SYS_TRACE_USER are the kernel's.  The argument is the low
+  * byte of the value noted below.  An app can trace its own events with ids
+  * of SYS_TRACE_USER and above.  Supplements/trace_decode.c turns an export
+  * into a timeline on the host.
+  *
+  * MPRX, DIALOG and RESP mark the stages of a dialog that a host starts over
+  * MPipe, with FTX and FRX in between (see apps/bench_latency).  With
+  * SYS_TRACE_TRIG ENABLED, each record also toggles platform_trig2, so the
+  * stages can be timed on a scope or logic analyzer, finer than GPTIM.
+  */
+#define SYS_TRACE_TASK          1       // Task_Index from sub_clock_tasks()
+#define SYS_TRACE_TXCSMA        2       // rm2_txcsma() return code
+#define SYS_TRACE_BSCAN         3       // rfevt_bscan() scode
+#define SYS_TRACE_FRX           4       // rfevt_frx() pcode
+#define SYS_TRACE_FTX           5       // rfevt_ftx() pcode
+#define SYS_TRACE_BTX           6       // rfevt_btx() flcode
+#define SYS_TRACE_MPRX          7       // otapi_ndef_proc() code (MPipe RX)
+#define SYS_TRACE_DIALOG        8       // otapi_start_dialog(), 0
+#define SYS_TRACE_RESP          9       // M2QP response to the request, opcode
+#define SYS_TRACE_USER          0x80
+
+#ifndef SYS_TRACE_SIZE
+#   define SYS_TRACE_SIZE       64
+#endif
+#ifndef SYS_TRACE_TRIG
+#   define SYS_TRACE_TRIG       DISABLED
+#endif
+
+typedef struct {
+    ot_u16  last;               // GPTIM value at the last record
+    ot_u16  put;                // Records written (free-running)
+    ot_u16  ring[SYS_TRACE_SIZE][2];
+} sys_tracebuf;
+
+#ifndef OT_FEATURE_TRACE
+#define OT_FEATURE_TRACE        DISABLED
+#endif
+
+#if (OT_FEATURE(TRACE) == ENABLED)
+#   define SYS_TRACE(ID, ARG)   sys_trace(ID, (ot_u8)(ARG))
+#else
+#   define SYS_TRACE(ID, ARG)   do { } while(0)
+#endif
+
+
+
+/** @brief Writes a trace record (use SYS_TRACE(), which compiles out)
+  * @param id           (ot_u8) event id, one of SYS_TRACE_...
+  * @param arg          (ot_u8) event argument
+  * @retval None
+  * @ingroup System
+  */
+void sys_trace(ot_u8 id, ot_u8 arg);
+
+
+/** @brief Zeros the trace ring
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_trace_clear();
+
+
+/** @brief Writes the trace ring to the kernel trace ISF
+  * @param None
+  * @retval ot_int      Bytes written, or -1 if there is no such file
+  * @ingroup System
+  *
+  * The file is ISF_ID(kernel_trace), which the app must define and allocate
+  * if it wants this feature (like ISF_ID(kernel_profile), a mirror-only file
+  * is the best choice).  The first big-endian word is the number of records
+  * written since the last clear (which may be more than the ring holds), and
+  * the records follow, oldest first, until the file is full.
+  */
+ot_int sys_trace_export();
+
+
+
+
+/** Adaptive CSMA-CA (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(ADAPTIVECA) ENABLED, the kernel keeps statistics on the
+  * outcome of each TX CSMA-CA process, and uses the measured load to adjust
+  * the RIGD and RAIND slotting that dll.comm.csmaca_params requests:
+  * - Under light load, the first TX offset is picked from a shorter window
+  *   (1/4 below SYS_CA_LIGHT, 1/2 below SYS_CA_HEAVY/2), so replies go sooner.
+  * - Under heavy load (SYS_CA_HEAVY and above), RIGD is run as RAIND, so late
+  *   responders are not pushed together into shrinking subslots, and each
+  *   RAIND retry waits a random 1-4 packet durations instead of one.
+  * AIND and the default MAC CA are deterministic, and they are not changed.
+  *
+  * load and busy[] are busy fractions (0-255) kept as moving averages: each
+  * CCA failure moves them 1/8 of the way to 255, and each clear CSMA moves
+  * them 1/8 of the way to 0.  busy[] is indexed by center frequency (lower
+  * nibble of the channel ID), using the channel that was scanned last.
+  */
+#define SYS_CA_LIGHT            32
+#define SYS_CA_HEAVY            128
+
+typedef struct {
+    ot_u8   load;
+    ot_u8   retries;            // CCA failures in the ongoing CSMA-CA process
+    ot_u8   busy[16];
+    ot_u16  clear;              // CSMA-CA processes that got to TX
+    ot_u16  fail;               // CCA failures
+    ot_u16  expired;            // CSMA-CA processes that ran out of Tca
+    ot_u16  max_retries;        // most CCA failures before a TX
+} sys_castats;
+
+#ifndef OT_FEATURE_ADAPTIVECA
+#define OT_FEATURE_ADAPTIVECA   DISABLED
+#endif
+
+
+
+/** @brief Zeros the CSMA-CA statistics, which also resets the load estimate
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_ca_clear();
+
+
+/** @brief Writes the CSMA-CA statistics to the CSMA statistics ISF
+  * @param None
+  * @retval ot_int      Bytes written, or -1 if there is no such file
+  * @ingroup System
+  *
+  * The file is ISF_ID(csma_statistics), which the app must define and allocate
+  * if it wants this feature (like ISF_ID(kernel_profile), a mirror-only file
+  * is the best choice).  The data is written as big-endian 16 bit words:
+  * clear, fail, expired, max_retries, load, and then busy[] as 8 words of two
+  * bytes each.  Writing stops when the file is full.
+  */
+ot_int sys_ca_export();
+
+
+
+
+/** Response Slop Calibration (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(SLOPCAL) ENABLED, the kernel learns how late its responses
+  * go on air, and starts them that much earlier.  Tc is already taken from the
+  * end of the request frame (the time spent routing the request is measured
+  * each time), but what follows is not: the trip through the kernel, the radio
+  * TX setup and the CCA.  This "slop" is measured on each response as the time
+  * from the end of request processing until the response frame starts, less
+  * the CSMA-CA offset that was picked on purpose.
+  *
+  * The slop and the processing time are kept per request opcode (the lower
+  * nibble of the M2QP command code), as moving averages that move 1/8 of the
+  * way to each sample.  The slop of the opcode is taken off Tc before the
+  * response CSMA-CA is set up, so the response (and a listen clone, which runs
+  * from Tc) lands where the requester expects it.  Only responses that got
+  * through on the first CCA and were TX'ed as one packet are sampled.  All
+  * values are in ticks << 3, and samples are clipped at 4095 ticks.
+  */
+typedef struct {
+    ot_u32  mark;               // stamp at the end of request processing
+    ot_u16  offset;             // CSMA-CA offset picked for the response
+    ot_u8   type;               // opcode being answered, 0xFF if no sample
+    ot_u8   rfu;
+    ot_u16  slop[16];           // RF slop per request opcode
+    ot_u16  proc[16];           // processing time per request opcode
+} sys_slopstats;
+
+#ifndef OT_FEATURE_SLOPCAL
+#define OT_FEATURE_SLOPCAL      DISABLED
+#endif
+
+
+
+/** @brief Zeros the learned response slop and processing times
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_slop_clear();
+
+
+
+
+/** Self-tuning Response Window (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(RXTUNE) ENABLED, a requester learns when the responses to
+  * its requests come in, and it stops listening once they are in.  The dialog
+  * timeout (dll.comm.rx_timeout) is still the limit, for the worst case.
+  *
+  * The arrival of the last response to a request, in ticks from the end of the
+  * request TX, is kept per request opcode and channel ID.  There are
+  * SYS_RXTUNE_KEYS entries, picked by a hash of the two, and a new key takes
+  * over the entry.  The entry keeps a moving average of the arrival (1/8 of
+  * the way to each sample) and a moving mean deviation (1/4 of the way), as a
+  * TCP RTT estimator does.  Once it has SYS_RXTUNE_MIN samples, the response
+  * window is cut to the average plus 4 deviations plus SYS_RXTUNE_MARGIN
+  * ticks, which is a high percentile of the arrivals.  When a cut window gets
+  * no response, the deviation grows by half, so the window grows back when
+  * the responders get slower.
+  *
+  * The listen also ends as soon as the expected number of responses is in:
+  * one for a unicast request, or the number given to sys_rxtune_expect().  The
+  * request is then not TX'ed again (redundants are dropped).  Anycast and
+  * multicast requests listen through the window.  Values are ticks << 3, and
+  * samples are clipped at 4095 ticks.
+  */
+#ifndef SYS_RXTUNE_KEYS
+#   define SYS_RXTUNE_KEYS      8       // power of 2
+#endif
+#ifndef SYS_RXTUNE_MIN
+#   define SYS_RXTUNE_MIN       4
+#endif
+#ifndef SYS_RXTUNE_MARGIN
+#   define SYS_RXTUNE_MARGIN    4
+#endif
+
+typedef struct {
+    ot_u16  key;                // request opcode << 8 | channel ID
+    ot_u8   count;              // samples (saturates at 255)
+    ot_u8   rfu;
+    ot_u16  avg;                // arrival of the last response
+    ot_u16  dev;                // mean deviation of the arrival
+} sys_rxtune_entry;
+
+typedef struct {
+    ot_bool active;             // a request is out and its responses count
+    ot_bool cut;                // its response window was cut
+    ot_u8   index;              // entry of the request
+    ot_u8   expect;             // responses that end the listen, 0 if unknown
+    ot_u8   next_expect;        // from sys_rxtune_expect(), for the next one
+    ot_u8   responses;
+    ot_u16  arrival;            // age of the request at the last clean frame
+    ot_u16  last;               // arrival of the last response
+    sys_rxtune_entry entry[SYS_RXTUNE_KEYS];
+} sys_rxtune;
+
+#ifndef OT_FEATURE_RXTUNE
+#define OT_FEATURE_RXTUNE       DISABLED
+#endif
+
+
+
+/** @brief Zeros the learned response arrivals
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_rxtune_clear();
+
+
+/** @brief Sets the number of responses that ends the listen of the next request
+  * @param responders   (ot_u8) number of responses, 0 to listen to the end
+  * @retval None
+  * @ingroup System
+  *
+  * It applies to the next request that is TX'ed, and then it is reset.  Use it
+  * when the responders are known, e.g. a multicast to a group of known size.
+  */
+void sys_rxtune_expect(ot_u8 responders);
+
+
+/** @brief Counts a response to the last request
+  * @param None
+  * @retval None
+  * @ingroup System
+  *
+  * M2QP calls it for each response that matches the request.
+  */
+void sys_rxtune_response();
+
+
+
+
+/** Sniffer Mode (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(SNIFFER) ENABLED, sys_sniffer_start() turns the device into
+  * a capture tool.  The radio receives foreground frames without a break, on
+  * one channel or hopping over a list of them (OT_PARAM_SNIFFER_DWELL ticks on
+  * each).  No frame is filtered or parsed.  Each frame goes into a RAM ring of
+  * OT_PARAM_SNIFFER_RING bytes (power of 2) as a capture record, which is an
+  * NDEF short record with logger subcode DATA_m2frame.  Its payload is:
+  * - stamp (4 bytes, big endian): platform_stamp() at sync detect
+  * - channel ID (1 byte)
+  * - RSSI in dBm (1 byte, signed)
+  * - status (1 byte): SYS_SNIFF_CRCERR, SYS_SNIFF_CLIPPED
+  * - the frame as received, with its CRC, clipped to SYS_SNIFF_FRAMEMAX bytes
+  *
+  * The kernel sends the ring over MPipe as it fills: as many whole records as
+  * fit in OT_PARAM_SNIFFER_BATCH bytes go out as one NDEF message, straight
+  * from the ring with a gather TX, so the records are not copied again.  This
+  * needs OT_FEATURE(MPIPE_GATHER).  A record that does not fit in the ring is
+  * dropped and counted.
+  *
+  * The sniffer takes over the kernel: sessions and idle events are flushed
+  * when it starts, and the device settings are reloaded when it stops.
+  */
+#define SYS_SNIFF_CHANNELS      8
+#define SYS_SNIFF_FRAMEMAX      248
+#define SYS_SNIFF_CRCERR        0x01
+#define SYS_SNIFF_CLIPPED       0x02
+
+#ifndef OT_FEATURE_SNIFFER
+#define OT_FEATURE_SNIFFER      DISABLED
+#endif
+#ifndef OT_PARAM_SNIFFER_RING
+#define OT_PARAM_SNIFFER_RING   2048
+#endif
+#ifndef OT_PARAM_SNIFFER_BATCH
+#define OT_PARAM_SNIFFER_BATCH  1024
+#endif
+#ifndef OT_PARAM_SNIFFER_DWELL
+#define OT_PARAM_SNIFFER_DWELL  256
+#endif
+
+typedef struct {
+    ot_bool     active;
+    ot_bool     listening;          // the radio is set up to receive
+    ot_bool     rearm;              // a frame is in: receive again now
+    ot_u8       channel;            // channel being received
+    ot_u8       channels;
+    ot_u8       cursor;             // next channel in chanlist
+    ot_u8       chanlist[SYS_SNIFF_CHANNELS];
+    ot_u16      inflight;           // ring bytes in the MPipe TX underway
+    ot_u16      drops;              // records dropped (saturates at 65535)
+    ot_long     dwell;              // ticks left on the channel
+} sys_sniffer;
+
+
+
+/** @brief Starts sniffer mode
+  * @param channels     (ot_u8) number of channels in chanlist (1 to 8)
+  * @param chanlist     (ot_u8*) Mode 2 channel IDs to receive on
+  * @retval ot_bool     False if the channel count is out of range
+  * @ingroup System
+  *
+  * Calling it while sniffing changes the channels and keeps the ring.
+  */
+ot_bool sys_sniffer_start(ot_u8 channels, ot_u8* chanlist);
+
+
+/** @brief Stops sniffer mode, and restarts the kernel from the device settings
+  * @param None
+  * @retval None
+  * @ingroup System
+  *
+  * Records still in the ring are discarded.  Do not call it from an ISR.
+  */
+void sys_sniffer_stop();
+
+
+/** @brief Returns the number of capture records dropped since the start
+  * @param None
+  * @retval ot_u16      Dropped record count (saturates at 65535)
+  * @ingroup System
+  */
+ot_u16 sys_sniffer_drops();
+
+
+
+
+/** Response Forwarding (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(RESPFWD) ENABLED, a gateway or subcontroller sends the
+  * standard and A2P responses it gets to the host over MPipe by itself, in
+  * place of the M2QP response callbacks.  M2QP does not copy a response: the
+  * frame in rxq is exchanged with a free forwarding slot (OT_PARAM_FWDPOOL in
+  * buffers.h), and a descriptor that points into the slot is queued.  Each is
+  * an NDEF short record with logger subcode DATA_m2resp, and its payload is:
+  * - response type (1 byte): SYS_FWD_STANDARD, SYS_FWD_A2P
+  * - responder ID length (1 byte), and then the ID
+  * - the M2QP response payload
+  *
+  * The queued records go out as one NDEF message with a gather TX when the
+  * response listen is over, when all slots are in use, or when the oldest has
+  * waited OT_PARAM_RESPFWD_WINDOW ticks, whichever is first.  The slots are
+  * freed once MPipe is done with the message.  When no slot is free (they are
+  * all queued, or in the message going out), the response goes to the
+  * callback as usual and the drop is counted.  This needs
+  * OT_FEATURE(MPIPE_GATHER).
+  */
+#define SYS_FWD_STANDARD        0
+#define SYS_FWD_A2P             1
+
+#ifndef OT_FEATURE_RESPFWD
+#define OT_FEATURE_RESPFWD      DISABLED
+#endif
+#ifndef OT_PARAM_RESPFWD_WINDOW
+#define OT_PARAM_RESPFWD_WINDOW 64
+#endif
+
+typedef struct {
+    ot_u8*      id;                 // responder ID, in the slot
+    ot_u8*      payload;            // response payload, in the slot
+    ot_u8       slot;               // forwarding slot that holds the frame
+    ot_u8       header[8];          // NDEF header, type, ID length
+} sys_fwdrec;
+
+typedef struct {
+    ot_bool     flush;              // the listen is over: send what is queued
+    ot_u8       count;              // records queued (the first are in flight)
+    ot_u8       inflight;           // records in the MPipe TX underway
+    ot_u16      drops;              // responses not forwarded (saturates)
+    ot_u32      stamp;              // platform_stamp() of the oldest waiting
+} sys_respfwd;
+
+
+
+/** @brief Queues the response in rxq for forwarding to the host
+  * @param type         (ot_u8) SYS_FWD_STANDARD or SYS_FWD_A2P
+  * @param id_length    (ot_u8) responder ID length
+  * @param id           (ot_u8*) responder ID, in rxq
+  * @param length       (ot_int) response payload length
+  * @param payload      (ot_u8*) response payload, in rxq
+  * @retval ot_bool     True if queued, in which case rxq is left empty
+  * @ingroup System
+  *
+  * M2QP calls it for each response.  On False, the caller should handle the
+  * response itself.
+  */
+ot_bool sys_respfwd_put(ot_u8 type, ot_u8 id_length, ot_u8* id, ot_int length, ot_u8* payload);
+
+
+/** @brief Returns the number of responses that could not be forwarded
+  * @param None
+  * @retval ot_u16      Drop count since boot (saturates at 65535)
+  * @ingroup System
+  */
+ot_u16 sys_respfwd_drops();
+
+
+
+
+/** Network Time Sync (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(NETSYNC) ENABLED, the devices of a network share a clock,
+  * the network time, which counts ti (kernel ticks) from the boot of the
+  * gateway.  A gateway keeps its own, and puts it in each of its beacons, as
+  * the OpenTag command extension M2CE_NETTIME and 4 bytes after the extension
+  * byte.  The time is written when the TX starts, so the CSMA of the beacon is
+  * the only error.  A device that gets such a beacon takes the time (plus the
+  * time since the sync word) as its own, and from then on it puts it in its
+  * own beacons too.  All devices in the network need the feature, as the
+  * extension changes the beacon format.
+  *
+  * The sleep scan sequence then runs on the network time: it starts over at
+  * each multiple of its period (the sum of its Next Scan values), so datum N
+  * starts at the sum of the Next Scans before it.  Each synced beacon puts an
+  * endpoint's sleep scan back on that schedule.  A gateway with the same
+  * sleep_scan_sequence ISF can call sys_netsync_eta() to know when the
+  * endpoints next listen on a channel, and open a short session then, in
+  * place of a long advertising flood.  Sleep scans that use the RTC scheduler
+  * are not moved.
+  */
+#ifndef OT_FEATURE_NETSYNC
+#define OT_FEATURE_NETSYNC      DISABLED
+#endif
+
+typedef struct {
+    ot_bool     synced;             // the network time is known
+    ot_u8       txpos;              // offset of the time in the beacon in txq
+    ot_u8       txdialog;           // dialog ID of that beacon
+    ot_long     error;              // last correction, in ti
+    ot_u32      time;               // network time at the last kernel run
+} sys_netsync;
+
+
+
+/** @brief Returns the network time
+  * @param None
+  * @retval ot_u32      network time in ti
+  * @ingroup System
+  *
+  * It only means something when sys_netsync_synced() is True.
+  */
+ot_u32 sys_netsync_time();
+
+
+/** @brief Returns True once the network time is known
+  * @param None
+  * @retval ot_bool     always True on a gateway
+  * @ingroup System
+  */
+ot_bool sys_netsync_synced();
+
+
+/** @brief Sets the network time from a received beacon
+  * @param nettime      (ot_u32) network time in the beacon
+  * @retval None
+  * @ingroup System
+  *
+  * M2QP calls it while it parses the beacon, and the time since the sync word
+  * of the frame is added.  A gateway ignores it.  It also moves the sleep
+  * scan onto the network schedule.
+  */
+void sys_netsync_set(ot_u32 nettime);
+
+
+/** @brief Ticks until the next network sleep scan on a channel
+  * @param channel      (ot_u8) channel ID
+  * @retval ot_long     ti until the scan starts, or -1 if there is none on
+  *                     the channel or the network time is not known
+  * @ingroup System
+  *
+  * From the sleep_scan_sequence ISF of this device, which needs to be the
+  * same one as the endpoints have.
+  */
+ot_long sys_netsync_eta(ot_u8 channel);
+
+
+
+
+/** Power Manager (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(POWERMGR) ENABLED, the app calls sys_powerdown() where it
+  * would otherwise call SLEEP_MCU().  The kernel knows when it will run next,
+  * so it picks the deepest low power mode that can still wake up in time.
+  *
+  * The modes come from the platform header.  PLATFORM_LPM_MODES modes are
+  * numbered from 0 (SLEEP_MCU) to the deepest, PLATFORM_LPM_WAKE_STI gives the
+  * wakeup latency of each one, PLATFORM_LPM_CLKSTART_STI is the time to get
+  * the main clock stable again after a mode that stops it (all modes but 0),
+  * and platform_enter_lpm() goes to sleep.  Modes from PLATFORM_LPM_UNTIMED up
+  * stop GPTIM, so they are only used when the kernel has nothing scheduled.
+  * Platforms without a table only have mode 0, SLEEP_MCU().  All times are in
+  * STI (sub ticks, 1/32768 sec).
+  *
+  * A mode is used when its wakeup latency, its clock restart, and the radio
+  * cold start (SYS_PM_RADIO_STI) all fit before the next kernel event, so the
+  * radio can be started on time.  Mode 0 is used while the radio or a packet
+  * holds the mutex, or while MPipe or the TMS3705 is busy.  The residency
+  * records count the entries and the GPTIM ticks spent in each mode.
+  */
+#define SYS_PM_MODES            4
+
+#ifndef SYS_PM_RADIO_STI
+#   define SYS_PM_RADIO_STI     27      // radio cold start, worst case
+#endif
+
+typedef struct {
+    ot_u16  entries;
+    ot_u32  ticks;
+} sys_pmres;
+
+typedef struct {
+    ot_u8       limit;          // deepest mode the app allows
+    ot_u8       mode;           // mode in use, while asleep
+    ot_bool     asleep;
+    ot_bool     untimed;        // the kernel has nothing scheduled
+    ot_u32      eta;            // ticks to the next kernel run, from the last run
+    ot_u16      mark;           // GPTIM value at sleep
+    sys_pmres   res[SYS_PM_MODES];
+} sys_powerstats;
+
+#ifndef OT_FEATURE_POWERMGR
+#define OT_FEATURE_POWERMGR     DISABLED
+#endif
+
+
+
+/** @brief Puts the MCU in the deepest low power mode the next event allows
+  * @param None
+  * @retval None
+  * @ingroup System
+  *
+  * Call it from the main loop instead of SLEEP_MCU().  It returns when the MCU
+  * wakes up, like SLEEP_MCU() does.
+  */
+void sys_powerdown();
+
+
+/** @brief Sets the deepest low power mode that sys_powerdown() may use
+  * @param mode         (ot_u8) mode number, 0 to PLATFORM_LPM_MODES-1
+  * @retval None
+  * @ingroup System
+  *
+  * For example, an app that keeps a peripheral running on the main clock can
+  * limit the manager to mode 0 while the peripheral is in use.
+  */
+void sys_pm_limit(ot_u8 mode);
+
+
+/** @brief Zeros the low power mode residency records
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_pm_clear();
+
+
+/** @brief Writes the low power mode residency records to the power ISF
+  * @param None
+  * @retval ot_int      Bytes written, or -1 if there is no such file
+  * @ingroup System
+  *
+  * The file is ISF_ID(power_residency), which the app must define and allocate
+  * if it wants this feature (a mirror-only file is the best choice).  For each
+  * of the SYS_PM_MODES modes, the data is three big-endian 16 bit words: the
+  * entries, then the upper and lower halves of the ticks.  Writing stops when
+  * the file is full.
+  */
+ot_int sys_pm_export();
+
+
+
+
+/** Energy Account (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(ENERGY) ENABLED, the kernel counts the time the radio
+  * spends off, in RX, and in TX, and the time the CPU spends active and in
+  * each low power mode, and converts them to charge with the typical currents
+  * of the board.  The totals go to an ISF that a gateway can read, so that a
+  * fleet can be monitored for battery life.
+  *
+  * The radio state is taken from the radio level of the mutex: listening, or
+  * receiving a frame, is RX, and the data level while a TX event is running
+  * is TX.  The CSMA before a TX listens, so it is RX.  The time is taken with
+  * platform_stamp(), at each change and at each kernel run.  The CPU time in
+  * each mode comes from the Power Manager residency (OT_FEATURE(POWERMGR)),
+  * and the active time is what is left.  Without the Power Manager, all of
+  * the CPU time is counted as active.
+  *
+  * The board header gives the currents in uA: BOARD_PARAM_RFOFFuA,
+  * BOARD_PARAM_RXuA, BOARD_PARAM_TXuA, BOARD_PARAM_CPUuA (active), and
+  * BOARD_PARAM_LPMuA, a list with one value per low power mode, in the order
+  * of PLATFORM_LPM_WAKE_STI.  Missing values are 0.
+  */
+#define SYS_EN_RADIO_OFF        0
+#define SYS_EN_RADIO_RX         1
+#define SYS_EN_RADIO_TX         2
+#define SYS_EN_RADIO_STATES     3
+
+#ifndef OT_FEATURE_ENERGY
+#define OT_FEATURE_ENERGY       DISABLED
+#endif
+
+/// Ticks between the automatic exports, which happen in idle time.  Zero
+/// leaves the export to the app.
+#ifndef OT_PARAM_ENERGY_PERIOD
+#define OT_PARAM_ENERGY_PERIOD  10240
+#endif
+
+typedef struct {
+    ot_u8   radio;                          // SYS_EN_RADIO_...
+    ot_u32  mark;                           // platform_stamp() of the last count
+    ot_u32  total;                          // ticks counted
+    ot_u32  exported;                       // total at the last export
+    ot_u32  ticks[SYS_EN_RADIO_STATES];     // ticks in each radio state
+} sys_energy;
+
+
+
+/** @brief Zeros the energy account
+  * @param None
+  * @retval None
+  * @ingroup System
+  *
+  * It also zeros the Power Manager residency, so that the CPU modes and the
+  * radio states cover the same time.
+  */
+void sys_energy_clear();
+
+
+/** @brief Writes the energy account to the energy ISF
+  * @param None
+  * @retval ot_int      Bytes written, or -1 if there is no such file
+  * @ingroup System
+  *
+  * The file is ISF_ID(energy_account), which the app must define and allocate
+  * if it wants this feature (a mirror-only file is the best choice).  There
+  * are 4 + SYS_PM_MODES records: radio off, RX, TX, CPU active, and then the
+  * CPU low power modes from 0.  Each record is a 32 bit tick count and a 32
+  * bit charge in mC (millicoulombs), both big-endian.  Writing stops when the
+  * file is full.  The kernel calls it every OT_PARAM(ENERGY_PERIOD) ticks.
+  */
+ot_int sys_energy_export();
+
+
+
+
+/** Memory Statistics (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(MEMSTATS) ENABLED, the kernel keeps high-water marks of
+  * the RAM that OpenTag sizes at build time, so that OT_FEATURE(BUFFER_SIZE),
+  * OT_FEATURE(SESSION_DEPTH) and OT_FEATURE(VLFPS) can be cut to what the app
+  * really uses.  ALP ID 0x06 reads and clears them (see alp_memstats.c).
+  *
+  * - Stack: platform_poweron() fills PLATFORM_STACK_SIZE bytes of stack with a
+  *   pattern, and the idle time scans a few bytes of it on each pass.  The
+  *   pattern left at the bottom is the stack that has never been used.
+  * - Queues: the bytes used in rxq, txq, dir_in and dir_out are taken at
+  *   each kernel run, so a frame that is built and gone between two runs is
+  *   not seen.
+  * - The session heap and the veelite file pointers keep their own marks,
+  *   which are exact (see session_hwm() and vl_fp_hwm()).
+  */
+#define SYS_MEM_QUEUES          4       // rxq, txq, dir_in, dir_out
+#define SYS_MEM_STACKFILL       0xA5
+#define SYS_MEM_RECORD          (4 + (SYS_MEM_QUEUES*4) + 4)
+
+#ifndef OT_FEATURE_MEMSTATS
+#define OT_FEATURE_MEMSTATS     DISABLED
+#endif
+
+typedef struct {
+    ot_u16  stack_free;                 // painted bytes never used
+    ot_u16  stack_scan;                 // scan offset from the stack bottom
+    ot_u8*  stack_base;                 // lowest painted byte
+    ot_u16  q_hwm[SYS_MEM_QUEUES];      // most bytes used in each queue
+} sys_memstats;
+
+
+
+/** @brief Fills the unused stack with a pattern
+  * @param None
+  * @retval None
+  * @ingroup System
+  *
+  * platform_poweron() calls it first, while the stack is nearly empty.  The
+  * fill starts a few bytes below the frame of this function and covers
+  * PLATFORM_STACK_SIZE bytes.
+  */
+void sys_stack_paint();
+
+
+/** @brief Writes the memory statistics record to a buffer
+  * @param dst          (ot_u8*) buffer of SYS_MEM_RECORD bytes or more
+  * @retval ot_int      bytes written (SYS_MEM_RECORD)
+  * @ingroup System
+  *
+  * All values are big-endian:
+  * [stack size: 2] [stack never used: 2], then for each of rxq, txq, dir_in
+  * and dir_out [alloc: 2] [most used: 2], then [session depth: 1]
+  * [most sessions: 1] [VLFPS: 1] [most file pointers: 1].
+  */
+ot_int sys_mem_write(ot_u8* dst);
+
+
+/** @brief Clears the queue, session and file pointer high-water marks
+  * @param None
+  * @retval None
+  * @ingroup System
+  *
+  * The stack mark cannot be cleared, as the stack is only painted at boot.
+  */
+void sys_mem_clear();
+
+
+
+
+/** Link Statistics (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(LINKSTATS) ENABLED, the kernel counts link events where the
+  * radio reports them (rfevt_frx(), rfevt_ftx(), rfevt_btx() and the result
+  * of rm2_txcsma()), with one RAM increment each.  Frames received and
+  * responses sent are also counted for each of the first SYS_LS_CHANNELS
+  * channels that are used.  The counts persist: they are loaded from the
+  * link statistics ISF at sys_init(), so a gateway can collect them across
+  * power cycles for network tuning.
+  *
+  * The counts go to the ISF in batches, from idle time: after
+  * OT_PARAM(LINKSTATS_BATCH) events, or after OT_PARAM(LINKSTATS_PERIOD)
+  * ticks with any event, and before Sleep and Off.  The ISF should be
+  * mirrored, so each batch is a write to vsram.  The mirror then goes to
+  * vworm with ISF_syncmirror(), which writes only the words that changed:
+  * at Sleep with OT_FEATURE(VLLAZYSYNC), or else after each batch.
+  */
+#define SYS_LS_RXFRAMES         0       // good frames RX'ed (they pass the filter)
+#define SYS_LS_RXCRC            1       // frames RX'ed with a bad CRC
+#define SYS_LS_RXFILTER         2       // good frames dropped by the subnet filter
+#define SYS_LS_RXTIMEOUT        3       // listens that ended without a frame
+#define SYS_LS_TXPACKETS        4       // packets TX'ed that are not responses
+#define SYS_LS_TXRESP           5       // responses TX'ed
+#define SYS_LS_TXERROR          6       // packets that ended with a TX error
+#define SYS_LS_CCAFAIL          7       // CCA failures (RM2_ERR_CCAFAIL)
+#define SYS_LS_CSMAFAIL         8       // TX dropped: no channel, or Tca is over
+#define SYS_LS_FLOODS           9       // advertising floods finished
+#define SYS_LS_FLOODERROR       10      // advertising floods that failed
+#define SYS_LS_COUNTERS         11
+
+#ifndef SYS_LS_CHANNELS
+#define SYS_LS_CHANNELS         4
+#endif
+
+#ifndef OT_FEATURE_LINKSTATS
+#define OT_FEATURE_LINKSTATS    DISABLED
+#endif
+
+/// Events between the batches, and ticks after which any events are saved.
+/// A period of 0 saves them only by count and before Sleep and Off.
+#ifndef OT_PARAM_LINKSTATS_BATCH
+#define OT_PARAM_LINKSTATS_BATCH    32
+#endif
+#ifndef OT_PARAM_LINKSTATS_PERIOD
+#define OT_PARAM_LINKSTATS_PERIOD   61440
+#endif
+
+typedef struct {
+    ot_u8   channel;                    // 0 if the slot is free
+    ot_u32  rx;                         // frames RX'ed with a good CRC
+    ot_u32  resp;                       // responses TX'ed
+} sys_lschannel;
+
+typedef struct {
+    ot_u16          pending;            // events since the last batch
+    ot_u32          mark;               // platform_stamp() of the last batch
+    ot_u32          count[SYS_LS_COUNTERS];
+    sys_lschannel   chan[SYS_LS_CHANNELS];
+} sys_linkstats;
+
+
+
+/** @brief Zeros the link statistics, in RAM and in the ISF
+  * @param None
+  * @retval None
+  * @ingroup System
+  */
+void sys_linkstats_clear();
+
+
+/** @brief Writes the link statistics to the link statistics ISF
+  * @param None
+  * @retval ot_int      Bytes written, or -1 if there is no such file
+  * @ingroup System
+  *
+  * The file is ISF_ID(link_statistics), which the app must define and
+  * allocate if it wants this feature (a mirrored file is the best choice).
+  * The SYS_LS_COUNTERS counts come first, in the order of the SYS_LS_...
+  * indices, as 32 bit big-endian values.  Then for each of SYS_LS_CHANNELS
+  * channels: [channel: 1] [0: 1] [RX frames: 4] [responses: 4], where a
+  * slot with no counts is free.  Writing stops when the file is full, and
+  * words that have not changed are not written.  The kernel calls it in
+  * batches, and it also syncs the mirror if OT_FEATURE(VLLAZYSYNC) will not.
+  */
+ot_int sys_linkstats_export();
+
+
+
+
+/** Radio Calibration Scheduler (optional) <BR>
+  * ========================================================================<BR>
+  * The synthesizer calibration of the radio drifts with temperature and with
+  * the supply, not with time.  With OT_FEATURE(RFCAL) ENABLED, the radio runs
+  * with its automatic calibration off, so RX and TX start without a
+  * calibration stage, and the driver keeps the results of each center
+  * frequency (RF_FEATURE(CALCACHE)).  The kernel samples the temperature and
+  * the supply in idle time, every OT_PARAM(RFCAL_PERIOD) ticks, with one ADC
+  * burst of the first two sensor channels (OT_SENSOR_CHANS).  When either has
+  * drifted past its threshold since the last calibration, radio_recalibrate()
+  * calibrates the radio again, while it is off.
+  *
+  * The samples and the thresholds are raw ADC counts, so the thresholds
+  * depend on the sensors and the reference of the board.  Without
+  * OT_FEATURE(SENSORS), the kernel has no ADC, and the app gives its own
+  * samples to sys_rfcal_check().
+  */
+#ifndef OT_FEATURE_RFCAL
+#define OT_FEATURE_RFCAL        DISABLED
+#endif
+
+#ifndef OT_PARAM_RFCAL_PERIOD
+#define OT_PARAM_RFCAL_PERIOD       30720   // ticks between samples
+#endif
+#ifndef OT_PARAM_RFCAL_TEMPDRIFT
+#define OT_PARAM_RFCAL_TEMPDRIFT    40      // temperature counts
+#endif
+#ifndef OT_PARAM_RFCAL_VOLTDRIFT
+#define OT_PARAM_RFCAL_VOLTDRIFT    80      // supply counts
+#endif
+
+typedef struct {
+    ot_bool busy;                       // the ADC burst is running
+    ot_bool valid;                      // cal[] holds a sample
+    ot_u16  count;                      // calibrations since boot
+    ot_u32  mark;                       // platform_stamp() of the last burst
+    ot_u16  sample[2];                  // burst: temperature, supply
+    ot_u16  cal[2];                     // sample of the last calibration
+} sys_rfcal;
+
+
+
+/** @brief Calibrates the radio again if a sample has drifted from the last
+  * @param sample       (ot_u16*) temperature, then supply, in ADC counts
+  * @retval ot_bool     True if the radio was calibrated
+  * @ingroup System
+  *
+  * The kernel calls it with its own samples.  The first sample after boot is
+  * only kept, because the radio is calibrated at startup.  Only call it while
+  * the radio is off (no radio locks in sys.mutex).
+  */
+ot_bool sys_rfcal_check(ot_u16* sample);
+
+
+
+
+/** Clock Scaling (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(CLKSCALE) ENABLED, the kernel asks the platform for a CPU
+  * performance level (platform_set_perf()) before each task it runs, from a
+  * table indexed by Task_Index.  Packet processing, which parses the frame
+  * and builds the response, runs at SYS_PERF_HIGH.  Session and radio tasks,
+  * which set up a dialog or a CSMA-CA process, run at SYS_PERF_MID.  The
+  * idle-time tasks only start a scan or call the app, and they run at
+  * SYS_PERF_LOW.  The RX/TX data ISRs decode and encode the frame, so the
+  * level goes to SYS_PERF_HIGH when the radio sets SYS_MUTEX_RADIO_DATA, and
+  * it stays there past the kernel exit while the radio is moving data.  The
+  * kernel otherwise exits at SYS_PERF_LOW.
+  *
+  * The platform maps the levels to its clocks, and it keeps the clocks of
+  * GPTIM, the RTC and MPipe at the same rate.  Platforms without clock
+  * scaling ignore the level.
+  */
+#define SYS_PERF_LOW            0
+#define SYS_PERF_MID            1
+#define SYS_PERF_HIGH           2
+
+#ifndef OT_FEATURE_CLKSCALE
+#define OT_FEATURE_CLKSCALE     DISABLED
+#endif
+
+
+
+/** App Tasks (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(APPTASKS) ENABLED, the app can register up to SYS_APPTASKS
+  * tasks, each with a priority (0 is the highest) and a start time in ticks,
+  * which the kernel clocks like its own events.  Tasks only run in idle time,
+  * when the gap to the next kernel event is longer than SYS_APPTASK_GUARD
+  * ticks, and the task gets the gap less the guard as its budget.  Of the due
+  * tasks, the one with the highest priority runs (the latest one, on a tie).
+  * One task runs per pass of the kernel, so kernel events come first between
+  * two tasks, and the kernel wakes up for the start of a task.
+  *
+  * A task returns the ticks until it is due again (0 is the next gap), or a
+  * negative value when it is done, which frees its slot.  A long task calls
+  * sys_task_yield() at checkpoints, and returns 0 when it says so, so that
+  * its work is cut into parts that fit the gaps.  A task that does not yield can still be late for a kernel
+  * event, but the radio ISRs preempt tasks in any case.
+  */
+#ifndef OT_FEATURE_APPTASKS
+#define OT_FEATURE_APPTASKS     DISABLED
+#endif
+#ifndef SYS_APPTASKS
+#define SYS_APPTASKS            4
+#endif
+#ifndef SYS_APPTASK_GUARD
+#define SYS_APPTASK_GUARD       3       // ticks kept for the kernel before its event
+#endif
+
+typedef ot_long (*sys_taskfn)(void);
+
+typedef struct {
+    sys_taskfn  run;            // NULL when the slot is free
+    ot_u8       prio;
+    ot_long     nextevent;      // ticks until the task is due
+} sys_apptask;
+
+
+
+/** @brief Registers an app task
+  * @param run          (sys_taskfn) task function, returns <0 when done
+  * @param prio         (ot_u8) priority, 0 is the highest
+  * @param start        (ot_long) ticks from now until the task is due
+  * @retval ot_int      task id, or -1 if all SYS_APPTASKS slots are in use
+  * @ingroup System
+  */
+ot_int sys_task_add(sys_taskfn run, ot_u8 prio, ot_long start);
+
+
+/** @brief Removes an app task
+  * @param id           (ot_int) task id from sys_task_add()
+  * @retval None
+  * @ingroup System
+  */
+void sys_task_remove(ot_int id);
+
+
+/** @brief Checkpoint for a running app task
+  * @param None
+  * @retval ot_bool     True when the task has used its budget and must return
+  * @ingroup System
+  */
+ot_bool sys_task_yield();
+
+
+
+
+/** External Event Queue (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(EXTQUEUE) ENABLED, up to SYS_EXTQ_SOURCES interrupt sources
+  * (buttons, sensors, LF wake, host commands) each get a handler and a
+  * priority (0 is the highest).  The ISR of a source calls sys_ext_post(),
+  * which only adds one to the count of the source and pre-empts the kernel.
+  * Posts that come before the handler runs are coalesced: the handler is
+  * called once, with the number of posts (it saturates at 255), so a burst is
+  * never lost, only merged.
+  *
+  * The kernel runs the handlers in idle gaps longer than SYS_APPTASK_GUARD,
+  * and only while the locks in SYS_EXT_LOCKS are free.  Of the sources with
+  * posts, the one with the highest priority runs (the lowest id, on a tie).
+  * One handler runs per pass of the kernel, ahead of the app tasks, so kernel
+  * events come first between two handlers.
+  *
+  * Each source has its own count byte, so ISRs of different sources never
+  * write the same memory.  Code that posts outside an ISR must hold the
+  * interrupts if an ISR posts to the same source.  The single sys.evt.EXT
+  * event is still there for apps that time their own external process.
+  */
+#ifndef OT_FEATURE_EXTQUEUE
+#define OT_FEATURE_EXTQUEUE     DISABLED
+#endif
+#ifndef SYS_EXTQ_SOURCES
+#define SYS_EXTQ_SOURCES        8
+#endif
+
+typedef void (*sys_extfn)(ot_u8);
+
+typedef struct {
+    sys_extfn       handler[SYS_EXTQ_SOURCES];  // NULL when the source is free
+    ot_u8           prio[SYS_EXTQ_SOURCES];
+    volatile ot_u8  count[SYS_EXTQ_SOURCES];    // posts since the last call
+} sys_extqueue;
+
+
+
+/** @brief Registers an external event source
+  * @param handler      (sys_extfn) called with the number of coalesced posts
+  * @param prio         (ot_u8) priority, 0 is the highest
+  * @retval ot_int      source id, or -1 if all SYS_EXTQ_SOURCES are in use
+  * @ingroup System
+  */
+ot_int sys_ext_add(sys_extfn handler, ot_u8 prio);
+
+
+/** @brief Removes an external event source, and drops its posts
+  * @param id           (ot_int) source id from sys_ext_add()
+  * @retval None
+  * @ingroup System
+  */
+void sys_ext_remove(ot_int id);
+
+
+/** @brief Posts an event of a source, from its ISR
+  * @param id           (ot_int) source id from sys_ext_add()
+  * @retval None
+  * @ingroup System
+  */
+void sys_ext_post(ot_int id);
+
+
+
+
+/** Dialog Completion (optional) <BR>
+  * ========================================================================<BR>
+  * With OT_FEATURE(DIALOG_CALLBACKS) ENABLED, the kernel can watch the request
+  * dialog of the top session and call the app once it is over, with a result
+  * for that dialog.  The app then has no need to poll the session stack, and
+  * the MCU can sleep until the callback.  otapi_start_dialog_cb() starts a
+  * watched dialog.  For a flood, call sys_dialog_watch() before
+  * otapi_start_flood().
+  *
+  * The dialog is over when its session has left the stack: at the end of the
+  * response listen, when CSMA-CA fails, or when the session is flushed.  The
+  * kernel sees this at the start of its next pass, and it calls the callback
+  * from there, so the callback may start the next dialog.  One dialog is
+  * watched at a time: a new watch ends the one before with its result so far.
+  */
+#ifndef OT_FEATURE_DIALOG_CALLBACKS
+#define OT_FEATURE_DIALOG_CALLBACKS DISABLED
+#endif
+
+#define SYS_DIALOG_RUN          0       // not over (never passed to the callback)
+#define SYS_DIALOG_DONE         1       // the request went out, the listen is over
+#define SYS_DIALOG_NOCHANNEL    2       // CSMA-CA did not find a clear channel
+#define SYS_DIALOG_DROPPED      3       // the session ended before the request TX
+
+typedef struct {
+    ot_u16  handle;             // session number, as from otapi_new_session()
+    ot_u8   status;             // SYS_DIALOG_...
+    ot_u8   responses;          // responses that M2QP took (saturates)
+    ot_u8   errors;             // error responses (saturates)
+    ot_u16  tx_ticks;           // start to the end of the request TX
+    ot_u16  resp_ticks;         // start to the first response, 0 if none
+    ot_u16  total_ticks;        // start to the end of the dialog
+} sys_dialog_result;
+
+typedef void (*sys_dialogfn)(sys_dialog_result*);
+
+typedef struct {
+    sys_dialogfn        done;   // NULL when no dialog is watched
+    ot_bool             sent;   // the request TX is done
+    ot_u8               dialog_id;
+    ot_u32              stamp;  // platform_stamp() at the start
+    sys_dialog_result   result;
+} sys_dialogwatch;
+
+
+
+/** @brief Watches the dialog of the top session
+  * @param done         (sys_dialogfn) called once, when the dialog is over
+  * @retval ot_u16      handle of the dialog (session number), 0 if no session
+  * @ingroup System
+  *
+  * The result passed to done is only good during the call.
+  */
+ot_u16 sys_dialog_watch(sys_dialogfn done);
+
+
+/** @brief Counts a response to the watched dialog
+  * @param dialog_id    (ot_u8) dialog ID of the session of the response
+  * @param error        (ot_bool) True for an error response
+  * @retval None
+  * @ingroup System
+  *
+  * M2QP calls it for each response that matches the request.
+  */
+void sys_dialog_response(ot_u8 dialog_id, ot_bool error);
 
 
 
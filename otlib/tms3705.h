@@ -0,0 +1,206 @@
+/* Copyright 2010-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/tms3705.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      TMS3705 LF reader (PaLFi master) interface
+  * @defgroup   TMS3705 (TMS3705 LF Reader)
+  * @ingroup    TMS3705
+  *
+  * The TMS3705 is the LF base station IC used by a PaLFi master to wake up and
+  * talk to PaLFi tags.  It is driven by two lines: TXCT (input to the TMS3705,
+  * field on when low) and SCIO (output from the TMS3705, response data).  The
+  * implementation is in /otplatform/[platform name]/tms3705_[platform name].c,
+  * and the pins, timer and UART it uses are set in the board header.
+  *
+  * The driver is interrupt-driven: the TXCT waveform is made by a timer output
+  * that is reloaded from the timer ISR one segment ahead, and the response is
+  * received by the UART ISR.  The CPU is free (and asleep) between edges, so
+  * an LF exchange can run at the same time as DASH7 Mode 2 radio traffic.
+  *
+  * When an exchange is done, the driver sets sys.evt.EXT to TMS3705_EXTEVENT
+  * (unless it is 0) and pre-empts the kernel, so the application gets the
+  * result through its external event process.  tms3705_status() returns the
+  * result code.
+  *
+  * @note The message format of tms3705_load() is the one of TI's TMS3705 LF
+  * demo (Supplements/TMS3705_MSP430F5):
+  * [cmd1] [cmd2, if cmd1 EXT bit] [PB1: 1 or 2 bytes, per 2BPB bit]
+  * [extra bits, if WP or BBUP] [extra data] [PB4, if BBUP] [PB3, if not IMMO
+  * and not PE-noWP-22] [TX bits] [TX data] [PB2] [RX bytes]
+  * Power bursts are in milliseconds.
+  ******************************************************************************
+  */
+
+#ifndef __TMS3705_H
+#define __TMS3705_H
+
+#include "OT_types.h"
+#include "OT_config.h"
+#include "queue.h"
+
+#ifndef OT_FEATURE_TMS3705
+#   define OT_FEATURE_TMS3705   DISABLED
+#endif
+
+#if (OT_FEATURE(TMS3705) == ENABLED)
+
+
+/** TMS3705 driver parameters
+  * TMS3705_EXTEVENT:   sys.evt.EXT event number set when an exchange is done.
+  *                     0 turns the kernel hook off (poll tms3705_status()).
+  * TMS3705_MCW:        Mode Control Word sent before each message.  The
+  *                     response is read by UART, so the MCW must select the
+  *                     asynchronous (SCI) output at 15625 bps.
+  * TMS3705_RXTIMEOUT:  Timeout for each response byte, in ms.
+  * TMS3705_EXTRA_MAX:  Max bytes of wake pattern (extra bits) in a message
+  */
+#ifndef TMS3705_EXTEVENT
+#   define TMS3705_EXTEVENT     0x40
+#endif
+#ifndef TMS3705_MCW
+#   define TMS3705_MCW          0x1E
+#endif
+#ifndef TMS3705_RXTIMEOUT
+#   define TMS3705_RXTIMEOUT    20
+#endif
+#ifndef TMS3705_EXTRA_MAX
+#   define TMS3705_EXTRA_MAX    4
+#endif
+
+
+/** Command bytes (TI format)
+  */
+#define TMS3705_CMD1_PPM        0x02    // PPM/BLC data bits (else PWM)
+#define TMS3705_CMD1_X26        0x08    // with SELECT = PE_noWP: 26 (else 22)
+#define TMS3705_CMD1_SELECT     0x30    // 0 IMMO, 1 PE_WP, 2 PE_noWP, 3 BBUP
+#define TMS3705_CMD1_2BPB       0x40    // 2 byte power bursts (else 1 byte)
+#define TMS3705_CMD1_EXT        0x80    // cmd2 follows
+#define TMS3705_CMD2_KEEPTXON   0x10    // leave the field on after PB2
+
+#define TMS3705_MODE_IMMO       0
+#define TMS3705_MODE_PE_WP      1
+#define TMS3705_MODE_PE_NOWP22  2
+#define TMS3705_MODE_PE_NOWP26  3
+#define TMS3705_MODE_BBUP       4
+
+
+/** Result codes, from tms3705_status()
+  */
+#define TMS3705_BUSY            1
+#define TMS3705_OK              0
+#define TMS3705_ERR_TIMEOUT     -1      // fewer response bytes than expected
+#define TMS3705_ERR_KILLED      -2
+#define TMS3705_ERR_PARAM       -3
+
+
+/** TMS3705 message
+  * Loaded by tms3705_load() or tms3705_loadwake(), and kept until the next
+  * load: tms3705_start() can send the same message again and again.  The data
+  * pointed to by extra and data must stay valid while the message is used.
+  */
+typedef struct {
+    ot_u8   mode;           // TMS3705_MODE_...
+    ot_u8   cmd1;
+    ot_u8   cmd2;
+    ot_u8   extra_bytes;
+    ot_u8   tx_bytes;
+    ot_u8   rx_bytes;
+    ot_u16  pb1;            // power bursts, ms
+    ot_u16  pb2;
+    ot_u16  pb3;
+    ot_u16  pb4;
+    ot_u8*  extra;
+    ot_u8*  data;
+} tms3705_pkt;
+
+
+
+
+/** @brief  Initializes the TMS3705 pins, timer and UART
+  * @param  None
+  * @retval None
+  * @ingroup TMS3705
+  *
+  * TXCT is left high (field off, TMS3705 asleep).
+  */
+void tms3705_init();
+
+
+
+/** @brief  Loads a message in the TI LF demo format
+  * @param  msg         (Queue*) message, from its getcursor
+  * @retval ot_int      bytes read from msg, or TMS3705_ERR_PARAM
+  * @ingroup TMS3705
+  *
+  * The extra and TX data are not copied: msg must not be changed while the
+  * message is used.  Fails when an exchange is running.
+  */
+ot_int tms3705_load(Queue* msg);
+
+
+
+/** @brief  Loads a wake pattern burst
+  * @param  wp          (ot_u8*) wake pattern (sent LSB first)
+  * @param  wp_bytes    (ot_u8) bytes of wake pattern, up to TMS3705_EXTRA_MAX
+  * @param  charge_ms   (ot_u16) power burst before the wake pattern, ms
+  * @retval ot_int      0 on success, or TMS3705_ERR_PARAM
+  * @ingroup TMS3705
+  *
+  * The burst is: wake-up sequence, MCW, charge power burst, wake
+  * pattern (PWM) and stop bit, and then the field goes off.  Nothing is sent
+  * or received after the pattern, so the burst is as short as the TMS3705
+  * allows.  The pattern is copied, so it is ready to go again at each call of
+  * tms3705_start().
+  */
+ot_int tms3705_loadwake(ot_u8* wp, ot_u8 wp_bytes, ot_u16 charge_ms);
+
+
+
+/** @brief  Starts the loaded message
+  * @param  rxq         (Queue*) queue for the response, or NULL
+  * @retval ot_int      0 on success, TMS3705_BUSY if an exchange is running
+  * @ingroup TMS3705
+  *
+  * Returns as soon as the timer is running.  The response bytes are written at
+  * the putcursor of rxq.
+  */
+ot_int tms3705_start(Queue* rxq);
+
+
+
+/** @brief  Stops any exchange now, and turns the field off
+  * @param  None
+  * @retval None
+  * @ingroup TMS3705
+  */
+void tms3705_kill();
+
+
+
+/** @brief  Result of the last exchange
+  * @param  None
+  * @retval ot_int      TMS3705_BUSY, TMS3705_OK or a negative error code
+  * @ingroup TMS3705
+  */
+ot_int tms3705_status();
+
+
+
+#endif
+#endif
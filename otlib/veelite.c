@@ -36,6 +36,7 @@
 #include "OT_utils.h"
 #include "OT_platform.h"
 #include "auth.h"
+#include "crc16.h"
 #include "veelite.h"
 
 ///@todo remove this legacy provision
@@ -48,8 +49,61 @@
 vlFILE vl_file[OT_FEATURE(VLFPS)];
 
 
+/** File handles <BR>
+  * ========================================================================<BR>
+  * Opens of a file that is already open share its handle: vl_fpref[] counts
+  * the opens of each handle, and vl_close() only closes the file on the last
+  * one.  vl_fpfree has a bit set for each free handle, so a new one is taken
+  * without a scan of vl_file[].
+  */
+#if (OT_FEATURE(VLFPS) > 16)
+#   error "OT_FEATURE(VLFPS) must be 16 or less"
+#endif
+
+#define VL_FPMASK   ((ot_u16)((1UL << OT_FEATURE(VLFPS)) - 1))
+
+ot_u8   vl_fpref[OT_FEATURE(VLFPS)];
+ot_u16  vl_fpfree;
+
+#if (OT_FEATURE(MEMSTATS) == ENABLED)
+    ot_u8 vl_fphwm;
+#endif
+
+
 #define FP_ISVALID(fp_VAL)  (fp_VAL != NULL)
 
+// ISF 0 (network settings) and ISF 1 (device features) hold the device IDs
+#define FP_ISIDFILE(fp_VAL) ((vaddr)(fp_VAL->header - ISF_Header_START) < (2*sizeof(vl_header)))
+
+ot_u16 vl_idstamp;
+
+// ISF index of a file.  GFB and ISFS headers come before the ISF headers, so
+// their index wraps to a large number.
+#define FP_ISFINDEX(fp_VAL) \
+        ((ot_uint)((vaddr)(fp_VAL->header - ISF_Header_START) / sizeof(vl_header)))
+
+// Bit n is set by a write to ISF n, for n < 16
+#define VL_ISFCHANGE_FILES  16
+
+ot_u16 vl_isfchange;
+
+// Changes whenever a file header changes or a file moves (see vl_get_direct())
+ot_u16 vl_mapstamp;
+
+// Counts writes to file data, in any file
+ot_u16 vl_writestamp;
+
+// Counts writes to the root and user authentication key ISFs
+#if defined(ISF_ID_root_authentication_key)
+#   define FP_ISKEYFILE(fp_VAL) \
+        ((vaddr)(fp_VAL->header - (ISF_Header_START + \
+        (ISF_ID(root_authentication_key)*sizeof(vl_header)))) < (2*sizeof(vl_header)))
+#else
+#   define FP_ISKEYFILE(fp_VAL) False
+#endif
+
+ot_u16 vl_keystamp;
+
 //Slower but more robust version of above
 //#define FP_ISVALID(fp_VAL)  ((fp_VAL >= &vl_file[0]) && (fp_VAL <= &vl_file[OT_FEATURE(VLFPS)-1]))
 
@@ -58,10 +112,198 @@ vlFILE vl_file[OT_FEATURE(VLFPS)];
 #define MIRROR_TO_SRAM      0x00
 #define MIRROR_TO_FLASH     0xFF
 
+/** Mirror Dirty Map
+  * One bit for each word of the ISF mirror (VSRAM), set when the word is
+  * written, and cleared when the mirror is loaded or synced.  A sync writes
+  * only the words that have their bit set, and of those only the ones that
+  * differ from VWORM, so a small change to a mirrored file costs a few flash
+  * writes instead of a copy of every mirrored file.
+  */
+#if (ISF_MIRROR_HEAP_BYTES > 0)
+#   define VL_MIRROR_WORDS  ((ISF_MIRROR_HEAP_BYTES + 1) / 2)
+    ot_u8 vl_mirror_dirty[(VL_MIRROR_WORDS + 7) / 8];
+#endif
+
+
+/** Block Parameters
+  * Everything that differs between the GFB, ISFS and ISF blocks is in the
+  * constant table vl_block[], indexed by block ID - 1, so one set of block
+  * functions serves all three, with no function pointers.  The values all
+  * come from the file system config.  A block with no user files has 0
+  * "users", and vl_new() fails on it.
+  *
+  * Searches by ID look through the headers from scan_header.  In a direct
+  * block (ISF), stock IDs index the headers instead, and only the user IDs
+  * (user_lo to user_hi) are searched, from user_header.
+  */
+#if ((GFB_HEAP_BYTES > 0) && (GFB_NUM_USER_FILES > 0))
+#   define VL_GFB_USERS     GFB_NUM_USER_FILES
+#else
+#   define VL_GFB_USERS     0
+#endif
+#define VL_ISFS_USERS       ISFS_NUM_USER_LISTS
+#define VL_ISF_USERS        ISF_NUM_USER_FILES
+
+typedef struct {
+    vaddr   header;         // first header of the block
+    vaddr   scan_header;    // first header searched by ID
+    vaddr   user_header;    // first user header
+    vaddr   heap_base;      // start of the user heap
+    vaddr   heap_end;
+    ot_u16  new_alloc;      // alloc of a new user file, 0: from max_length
+    ot_u8   scan_count;     // headers searched by ID
+    ot_u8   users;          // user headers
+    ot_u8   user_lo;        // user file IDs, inclusive
+    ot_u8   user_hi;
+    ot_u8   ext;            // EXT stock files, at IDs 256-ext to 255
+    ot_bool direct;         // stock IDs index the headers
+} vl_blockparam;
+
+static const vl_blockparam vl_block[3] = {
+    {   GFB_Header_START, GFB_Header_START, GFB_Header_START_USER, GFB_HEAP_USER_START, GFB_HEAP_END,
+        GFB_FILE_BYTES, GFB_NUM_FILES, VL_GFB_USERS,
+        GFB_NUM_STOCK_FILES, 255, 0, False },
+    {   ISFS_Header_START, ISFS_Header_START, ISFS_Header_START_USER, ISFS_HEAP_USER_START, ISFS_HEAP_END,
+        ISFS_MAX_default, ISFS_NUM_LISTS, VL_ISFS_USERS,
+        ISFS_ID_extended_service, 255, 0, False },
+    {   ISF_Header_START, ISF_Header_START_USER, ISF_Header_START_USER, ISF_HEAP_USER_START, ISF_HEAP_END,
+        0, ISF_NUM_USER_FILES, VL_ISF_USERS,
+        (ISF_NUM_M1_FILES+ISF_NUM_M2_FILES), (255-ISF_NUM_EXT_FILES), ISF_NUM_EXT_FILES, True }
+};
+
+
+
+/** User Heap Extent Maps
+  * The user-allocated part of each heap (GFB, ISFS, ISF) has a RAM map of the
+  * files in it, sorted by base address.  It is built in vl_init() and kept up
+  * to date by vl_new() and vl_delete(), so allocation and compaction never
+  * have to scan the headers in VWORM.  Each map can hold as many extents as
+  * its block has user headers.
+  */
+#if (OT_FEATURE(VLNEW) == ENABLED)
+#   define VL_EXTENTS   (VL_GFB_USERS + VL_ISFS_USERS + VL_ISF_USERS)
+#else
+#   define VL_EXTENTS   0
+#endif
+
+typedef struct {
+    vaddr   base;
+    ot_u16  alloc;
+    vaddr   header;
+} vl_extent;
+
+typedef struct {
+    vl_extent*  ext;
+    ot_int      count;
+    ot_int      window;         // number of user headers = max extents
+    vaddr       header;         // first user header
+    vaddr       heap_base;
+    vaddr       heap_end;
+    ot_bool     dirty;          // a file was deleted since the last compaction
+} vl_heapmap;
+
+#if (VL_EXTENTS > 0)
+    vl_extent   vl_extents[VL_EXTENTS];
+    vl_heapmap  vl_heap[3];
+#endif
 
-typedef ot_u8 (*sub_check)(ot_u8);
-typedef vaddr (*sub_vaddr)(ot_u8);
-typedef vlFILE* (*sub_new)(ot_u8, ot_u8, ot_u8);
+
+
+/** Header Index
+  * With OT_FEATURE(VLINDEX) enabled, each block keeps a small RAM hash table
+  * from file ID to header.  It covers the same header windows that the
+  * search functions used to scan.  Stock ISF lookups are already direct, so
+  * only user ISFs are indexed.  The tables use open addressing, sized to the
+  * next power of two at least twice the window.  Each entry is 2 bytes, so
+  * the RAM cost is at most 4 bytes per header in the window.
+  */
+#if (OT_FEATURE(VLINDEX) == ENABLED)
+#   define VL_INDEX_SIZE(N)     ( ((N) <= 4)  ? 8  : ((N) <= 8)  ? 16  : \
+                                  ((N) <= 16) ? 32 : ((N) <= 32) ? 64  : \
+                                  ((N) <= 64) ? 128 : 256 )
+
+#   define VL_GFB_INDEX     VL_INDEX_SIZE(GFB_NUM_FILES)
+#   define VL_ISFS_INDEX    VL_INDEX_SIZE(ISFS_NUM_LISTS)
+#   define VL_ISF_INDEX     VL_INDEX_SIZE(ISF_NUM_USER_FILES)
+
+typedef struct {
+    ot_u8   id;
+    ot_u8   slot;           // header number + 1, 0 when the entry is empty
+} vl_indexentry;
+
+typedef struct {
+    vl_indexentry*  entry;
+    ot_u8           mask;
+    ot_u8           window;
+    vaddr           header;
+} vl_headerindex;
+
+    vl_indexentry   vl_index_gfb[VL_GFB_INDEX];
+    vl_indexentry   vl_index_isfs[VL_ISFS_INDEX];
+    vl_indexentry   vl_index_isf[VL_ISF_INDEX];
+    vl_headerindex  vl_index[3];
+#endif
+
+
+/** ISF Integrity Cache
+  * With OT_FEATURE(VLCRC) enabled, each stock ISF has a reference CRC16 of
+  * its data, as vl_read() sees it, and a state.  vl_store() sets the
+  * reference from the stored buffer, and a file changed by vl_write() takes
+  * a new reference from its data when it is closed.  A file is verified at
+  * most once per boot and once per write: a verified file stays VLCRC_OK
+  * until it is written again, so ISF_verify() on it costs nothing.  The
+  * kernel verifies the rest one at a time when it is idle (vl_verify()).
+  */
+#if (OT_FEATURE(VLCRC) == ENABLED)
+#   define VLCRC_NONE       0       // no reference: next check takes one
+#   define VLCRC_STALE      1       // reference, not verified since boot/write
+#   define VLCRC_OK         2
+#   define VLCRC_BAD        3
+
+    ot_u16  vl_crc[ISF_NUM_STOCK_FILES];
+    ot_u8   vl_crcstate[ISF_NUM_STOCK_FILES];
+    ot_u8   vl_crccursor;
+#endif
+
+
+/** ISF Summaries
+  * With OT_FEATURE(VLSUMMARY) enabled, each stock ISF has a vl_summary of its
+  * data, which vl_sumvalid says is up to date.  They are not in the boot 
+  * snapshot: after boot, ISF_summary() makes each one when it is first used.
+  */
+#if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    vl_summary  vl_sum[ISF_NUM_STOCK_FILES];
+    ot_u8       vl_sumvalid[ISF_NUM_STOCK_FILES];
+#endif
+
+
+/** Boot Snapshot
+  * With OT_FEATURE(VLSNAPSHOT) enabled, vl_save() hands these RAM tables to
+  * vworm_save_snapshot() at a clean shutdown, and vl_fastinit() gets them
+  * back instead of building them from the headers.  Reference CRCs from the
+  * snapshot are verified again, since the data could change while off.
+  */
+#if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+static const vworm_span vl_snapshot[] = {
+    { &vl_mapstamp,     sizeof(vl_mapstamp) },
+    { &vl_writestamp,   sizeof(vl_writestamp) },
+#   if (VL_EXTENTS > 0)
+    { vl_extents,       sizeof(vl_extents) },
+    { vl_heap,          sizeof(vl_heap) },
+#   endif
+#   if (OT_FEATURE(VLINDEX) == ENABLED)
+    { vl_index_gfb,     sizeof(vl_index_gfb) },
+    { vl_index_isfs,    sizeof(vl_index_isfs) },
+    { vl_index_isf,     sizeof(vl_index_isf) },
+#   endif
+#   if (OT_FEATURE(VLCRC) == ENABLED)
+    { vl_crc,           sizeof(vl_crc) },
+    { vl_crcstate,      sizeof(vl_crcstate) },
+#   endif
+};
+
+#   define VL_SNAPSHOT_SPANS    (sizeof(vl_snapshot)/sizeof(vworm_span))
+#endif
 
 
 /** VWORM Memory Allocation
@@ -85,15 +327,16 @@ typedef vlFILE* (*sub_new)(ot_u8, ot_u8, ot_u8);
 
 
 // Private Functions
-vlFILE* sub_gfb_new(ot_u8 id, ot_u8 mod, ot_u8 null_arg);
-vlFILE* sub_isfs_new(ot_u8 id, ot_u8 mod, ot_u8 null_arg);
-vlFILE* sub_isf_new(ot_u8 id, ot_u8 mod, ot_u8 max_length);
-ot_u8 sub_gfb_delete_check(ot_u8 id);
-ot_u8 sub_isfs_delete_check(ot_u8 id);
-ot_u8 sub_isf_delete_check(ot_u8 id);
-vaddr sub_gfb_search(ot_u8 id);
-vaddr sub_isfs_search(ot_u8 id);
-vaddr sub_isf_search(ot_u8 id);
+/** @brief Body of vl_init() and vl_fastinit()
+  * @param fast : (ot_bool) True to take the RAM tables from the boot snapshot
+  * @retval none
+  */
+void sub_vl_start(ot_bool fast);
+
+// "block" is the index of vl_block[]: block ID - 1
+vlFILE* sub_block_new(ot_u8 block, ot_u8 id, ot_u8 mod, ot_uint max_length);
+ot_bool sub_block_isuser(ot_u8 block, ot_u8 id);
+vaddr sub_block_search(ot_u8 block, ot_u8 id);
 
 
 /** @brief Performs mirroring operations on ISF files
@@ -105,9 +348,41 @@ vaddr sub_isf_search(ot_u8 id);
 ot_u8 sub_isf_mirror(ot_u8 direction);
 
 
+/** @brief Marks words of the ISF mirror as changed
+  * @param addr : (vaddr) VSRAM address of the first byte written
+  * @param length : (ot_uint) number of bytes written
+  * @retval None
+  */
+void sub_mirror_mark(vaddr addr, ot_uint length);
+ot_bool sub_mirror_take(vaddr addr);
+
+
+
+
+/** @brief Computes the CRC16 of a stock ISF's data
+  * @param id : (ot_u8) stock ISF ID
+  * @retval ot_u16 : CRC16 of the data (mirror data if the file is mirrored)
+  */
+ot_u16 sub_isf_crc(ot_u8 id);
+
+/** @brief Adds bytes to a file summary
+  * @param sum : (vl_summary*) summary
+  * @param length : (ot_int) number of bytes
+  * @param data : (ot_u8*) bytes
+  * @retval none
+  */
+void sub_sum_add(vl_summary* sum, ot_int length, ot_u8* data);
+
+/** @brief Verifies a stock ISF against its reference CRC, or takes one
+  * @param id : (ot_u8) stock ISF ID
+  * @retval ot_u8 : the new state of the file (VLCRC_OK or VLCRC_BAD)
+  */
+ot_u8 sub_isf_check(ot_u8 id);
 
 
 vlFILE* sub_new_fp();
+vlFILE* sub_shared_fp(vaddr header);
+ot_int sub_fp_index(ot_u16 bit);
 vlFILE* sub_new_file(vl_header* new_header, vaddr heap_base, vaddr heap_end, vaddr header_base, ot_int header_window );
 void sub_delete_file(vaddr del_header);
 void sub_copy_header( vaddr header, ot_u16* output_header );
@@ -143,35 +418,56 @@ vaddr sub_find_empty_header(vaddr header, ot_int num_headers);
 
 
 
+/** @brief Returns the extent map that owns a user header
+  * @param header : (vaddr) header virtual address
+  * @retval vl_heapmap* : the map, or NULL if the header is not a user header
+  */
+vl_heapmap* sub_heapmap_of(vaddr header);
+
+/** @brief Loads a map from the user headers of its block (used by vl_init)
+  * @param map : (vl_heapmap*) map to fill
+  * @retval none
+  */
+void sub_heapmap_build(vl_heapmap* map);
+
+/** @brief Binary search for the first extent with base >= the given base
+  * @param map : (vl_heapmap*) map to search
+  * @param base : (vaddr) heap address to look for
+  * @retval ot_int : index into map->ext[], between 0 and map->count
+  */
+ot_int sub_heapmap_find(vl_heapmap* map, vaddr base);
+
+void sub_heapmap_insert(vl_heapmap* map, vaddr header, vaddr base, ot_u16 alloc);
+void sub_heapmap_remove(vl_heapmap* map, vaddr base);
+
+
+
 /** @brief Searches for an amount of the empty space in the heap
-  * @param base : (vaddr*) physical pointer to the @c base @c file of a header
-  * @param alloc: (size_t) number of bytes needed to allocate
-  * @param header_size : (size_t) number of bytes in the given header type
-  * @param num_headers : (ot_int) number of headers to search through
+  * @param map : (vl_heapmap*) extent map of the heap
+  * @param new_alloc : (ot_uint) number of bytes needed to allocate
   * @retval vaddr : virtual address of the spot in heap to put data.
   *                 returns @c NULL_vaddr @c if heap has no room
   *
-  * @c sub_find_empty_heap() @c runs in quadratic time based on the @c num_headers
-  * parameter.  Implementations on systems that are less memory constrained 
-  * could be made faster.  @c sub_find_empty_heap() @c only runs when adding a ISF
-  * file, which may never even happen.
+  * This is a best-fit search: of all the gaps big enough for new_alloc, it
+  * returns the smallest one.  It walks the RAM map, so it is linear in the
+  * number of user files and never touches VWORM.
   */
-vaddr sub_find_empty_heap(  vaddr heap_base, vaddr heap_end, 
-                        vaddr header, ot_uint new_alloc, ot_int num_headers);
+vaddr sub_find_empty_heap(vl_heapmap* map, ot_uint new_alloc);
 
 
 
-/** @brief Defragments a given heap space
-  * @param base : (vaddr) base vaddr of the heap space to defragment
-  * @param size : (size_t) number of bytes in heap space
-  * @retval vaddr : Non-zero on failure
+/** @brief Runs one step of compaction on a heap
+  * @param map : (vl_heapmap*) extent map of the heap to compact
+  * @retval ot_u8 : 0 if a file was moved, non-zero if nothing could be moved
   *
-  * Run this function to clean out fragmented empty space in a heap.  For 
-  * example, if @c sub_find_empty_heap() @c returns NULL_vaddr
-  *
-  * Not implemented at time being.
+  * The lowest file that fits into a gap below it is moved into the lowest
+  * such gap.  Only one file is moved per call, so the caller can compact a
+  * bit at a time.  A file is only moved into a gap that does not overlap it.
+  * The steps are: copy the data, write the new base to the header, then wipe
+  * the old data.  If power fails at any point, the header still points to a
+  * complete copy of the data.
   */
-ot_u8 sub_defragment_heap(vaddr base, ot_uint window);
+ot_u8 sub_defragment_heap(vl_heapmap* map);
 
 
 
@@ -187,6 +483,35 @@ vaddr sub_header_search(vaddr header, ot_u8 search_id, ot_int num_headers);
 
 
 
+#if (OT_FEATURE(VLINDEX) == ENABLED)
+/** @brief Returns the header index whose window contains a header
+  * @param header : (vaddr) header virtual address
+  * @retval vl_headerindex* : the index, or NULL if no index covers the header
+  */
+vl_headerindex* sub_index_of(vaddr header);
+
+/** @brief Rebuilds an index from the headers in its window
+  * @param idx : (vl_headerindex*) index to rebuild
+  * @retval none
+  *
+  * The first valid header for an ID wins, which is the same result that
+  * sub_header_search() gives.  Deletes rebuild the index rather than
+  * removing entries from the open-addressed table.
+  */
+void sub_index_build(vl_headerindex* idx);
+
+void sub_index_insert(vl_headerindex* idx, ot_u8 id, vaddr header);
+
+/** @brief Looks up a header by ID in an index
+  * @param idx : (vl_headerindex*) index to search
+  * @param id : (ot_u8) file ID
+  * @retval vaddr : header address, or NULL_vaddr if the ID is not in the index
+  */
+vaddr sub_index_search(vl_headerindex* idx, ot_u8 id);
+#endif
+
+
+
 
 
 
@@ -204,6 +529,31 @@ vaddr sub_header_search(vaddr header, ot_u8 search_id, ot_int num_headers);
 
 #ifndef EXTF_vl_init
 void vl_init() {
+    sub_vl_start(False);
+}
+#endif
+
+
+#ifndef EXTF_vl_fastinit
+void vl_fastinit() {
+    sub_vl_start(True);
+}
+#endif
+
+
+#ifndef EXTF_vl_save
+ot_u8 vl_save() {
+    ISF_syncmirror();
+#   if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+        return vworm_save_snapshot(vl_snapshot, VL_SNAPSHOT_SPANS);
+#   else
+        return vworm_save();
+#   endif
+}
+#endif
+
+
+void sub_vl_start(ot_bool fast) {
     ot_int i;
     
     /// Initialize environment variables
@@ -213,15 +563,81 @@ void vl_init() {
         vl_file[i].length   = 0;
         vl_file[i].read     = NULL;
         vl_file[i].write    = NULL;
+        vl_fpref[i]         = 0;
     }
+    vl_fpfree = VL_FPMASK;
 
     /// Initialize core 
     /// @note This should be done already in platform_poweron()
     //vworm_init();
     
+    // The RAM tables come from the boot snapshot, if there is a good one
+#   if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+    if (fast) {
+        fast = (ot_bool)(vworm_load_snapshot(vl_snapshot, VL_SNAPSHOT_SPANS) == 0);
+    }
+    else {
+        vworm_load_snapshot(NULL, 0);
+    }
+#   else
+    fast = False;
+#   endif
+    
     // Copy to mirror
     ISF_loadmirror();
     
+    // Every stock ISF takes a new reference CRC after boot, unless it has
+    // one from the snapshot, in which case it is verified again.
+#   if (OT_FEATURE(VLCRC) == ENABLED)
+    for (i=0; i<ISF_NUM_STOCK_FILES; i++) {
+        if (fast == False) {
+            vl_crcstate[i] = VLCRC_NONE;
+        }
+        else if (vl_crcstate[i] == VLCRC_OK) {
+            vl_crcstate[i] = VLCRC_STALE;
+        }
+    }
+    vl_crccursor = 0;
+#   endif
+
+#   if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    platform_memset(vl_sumvalid, 0, sizeof(vl_sumvalid));
+#   endif
+    
+    /// Build the extent maps of the user heaps
+#   if (VL_EXTENTS > 0)
+    {   vl_extent* ext = vl_extents;
+        for (i=0; i<3; i++) {
+            vl_heap[i].ext          = ext;
+            vl_heap[i].window       = vl_block[i].users;
+            vl_heap[i].header       = vl_block[i].user_header;
+            vl_heap[i].heap_base    = vl_block[i].heap_base;
+            vl_heap[i].heap_end     = vl_block[i].heap_end;
+            ext                    += vl_block[i].users;
+            if (fast == False) {
+                sub_heapmap_build(&vl_heap[i]);
+            }
+        }
+    }
+#   endif
+    
+    /// Build the header indexes, over the same headers that searches scan
+#   if (OT_FEATURE(VLINDEX) == ENABLED)
+    vl_index[0].entry   = vl_index_gfb;
+    vl_index[0].mask    = (VL_GFB_INDEX-1);
+    vl_index[1].entry   = vl_index_isfs;
+    vl_index[1].mask    = (VL_ISFS_INDEX-1);
+    vl_index[2].entry   = vl_index_isf;
+    vl_index[2].mask    = (VL_ISF_INDEX-1);
+    
+    for (i=0; i<3; i++) {
+        vl_index[i].window  = vl_block[i].scan_count;
+        vl_index[i].header  = vl_block[i].scan_header;
+        if (fast == False) {
+            sub_index_build(&vl_index[i]);
+        }
+    }
+#   endif
     
 #if (CC_SUPPORT == SIM_GCC)
 
@@ -237,7 +653,6 @@ void vl_init() {
     //M1TAG.max_response  = 255;    
 #endif
 }
-#endif
 
 
 
@@ -263,13 +678,25 @@ ot_int vl_get_fd(vlFILE* fp) {
 #endif
 
 
+#if (OT_FEATURE(MEMSTATS) == ENABLED)
+#ifndef EXTF_vl_fp_hwm
+ot_u8 vl_fp_hwm() {
+    return vl_fphwm;
+}
+#endif
+
+
+#ifndef EXTF_vl_fp_hwm_clear
+void vl_fp_hwm_clear() {
+    vl_fphwm = 0;
+}
+#endif
+#endif
+
+
 #ifndef EXTF_vl_new
 ot_u8 vl_new(vlFILE** fp_new, vlBLOCK block_id, ot_u8 data_id, ot_u8 mod, ot_uint max_length, id_tmpl* user_id) {
 #if (OT_FEATURE(VLNEW) == ENABLED)
-    vaddr header;
-    sub_vaddr search_fn;
-    sub_new   new_fn;
-    
     /// 1. Authenticate, when it's not a su call
     if (user_id != NULL) {
         if ( auth_check(VL_ACCESS_USER, VL_ACCESS_W, user_id) == 0 ) {
@@ -279,28 +706,14 @@ ot_u8 vl_new(vlFILE** fp_new, vlBLOCK block_id, ot_u8 data_id, ot_u8 mod, ot_uin
 
     /// 2. Make sure the file is not already there
     block_id--;
-    switch (block_id) {
-        case 0: search_fn   = &sub_gfb_search;
-                new_fn      = &sub_gfb_new;
-                break;
-                
-        case 1: search_fn   = &sub_isfs_search;
-                new_fn      = &sub_isfs_new;
-                break;
-                
-        case 2: search_fn   = &sub_isf_search;
-                new_fn      = &sub_isf_new;
-                break;
-                
-       default: return 0xFF;
+    if ((ot_u8)block_id > 2) {
+        return 0xFF;
     }
-    
-    header = search_fn(data_id);
-    if (header != NULL_vaddr) {
+    if (sub_block_search(block_id, data_id) != NULL_vaddr) {
         return 0x02;
     }
     
-    *fp_new = new_fn(data_id, mod, max_length);
+    *fp_new = sub_block_new(block_id, data_id, mod, max_length);
     if (*fp_new == NULL) {
         return 0x06;
     }
@@ -318,29 +731,15 @@ ot_u8 vl_new(vlFILE** fp_new, vlBLOCK block_id, ot_u8 data_id, ot_u8 mod, ot_uin
 ot_u8 vl_delete(vlBLOCK block_id, ot_u8 data_id, id_tmpl* user_id) {
 #if (OT_FEATURE(VLNEW) == ENABLED)
     vaddr header = NULL_vaddr;
-    sub_vaddr   search_fn;
-    sub_check   check_fn;
 
-    /// 1. Get the header from the supplied Block ID & Data ID
+    /// 1. Get the header from the supplied Block ID & Data ID.  Only user
+    ///    files may be deleted.
     block_id--;
-    switch (block_id) {
-        case 0: check_fn    = &sub_gfb_delete_check;
-                search_fn   = &sub_gfb_search;
-                break;
-                
-        case 1: check_fn    = &sub_isfs_delete_check;
-                search_fn   = &sub_isfs_search;
-                break;
-                
-        case 2: check_fn    = &sub_isf_delete_check;
-                search_fn   = &sub_isf_search;
-                break;
-                
-       default: return 255;
+    if ((ot_u8)block_id > 2) {
+        return 255;
     }
-    
-    if (check_fn(data_id) != 0) {
-        header = search_fn(data_id);
+    if (sub_block_isuser(block_id, data_id)) {
+        header = sub_block_search(block_id, data_id);
     }
     
     /// 2. Bail if header is NULL
@@ -368,16 +767,140 @@ ot_u8 vl_delete(vlBLOCK block_id, ot_u8 data_id, id_tmpl* user_id) {
 
 
 
+#ifndef EXTF_vl_defragment
+ot_u8 vl_defragment() {
+#if (VL_EXTENTS > 0)
+    ot_int i;
+
+    /// Moving a file would leave open file pointers on stale addresses
+    for (i=0; i<OT_FEATURE(VLFPS); i++) {
+        if (vl_file[i].read != NULL) {
+            return 2;
+        }
+    }
+    
+    /// Work on the first heap that has had a delete since it was compacted
+    for (i=0; i<3; i++) {
+        if (vl_heap[i].dirty) {
+            if (sub_defragment_heap(&vl_heap[i]) == 0) {
+                return 0;
+            }
+            vl_heap[i].dirty = False;
+        }
+    }
+#endif
+    return 1;
+}
+#endif
+
+
+
+#ifndef EXTF_vl_restore
+ot_u8 vl_restore(vlBLOCK block_id, ot_u8 data_id, id_tmpl* user_id) {
+    vaddr   header;
+    vaddr   base;
+    ot_u16  alloc;
+    ot_int  i;
+    ot_u8   output;
+    
+    output = vl_getheader_vaddr(&header, block_id, data_id, VL_ACCESS_W, user_id);
+    if (output != 0) {
+        return output;
+    }
+    if (sub_block_isuser(block_id-1, data_id)) {
+        return 3;
+    }
+    
+    /// An open file pointer would write its length back over the restore
+    for (i=0; i<OT_FEATURE(VLFPS); i++) {
+        if ((vl_file[i].read != NULL) && (vl_file[i].header == header)) {
+            return 2;
+        }
+    }
+    
+    /// Restore the header first, so the stock base and alloc are used
+    if (vworm_restore(header, sizeof(vl_header)) != 0) {
+        return 3;
+    }
+    base    = vworm_read(header + 6);
+    alloc   = vworm_read(header + 2);
+    if ((base != NULL_vaddr) && (vworm_restore(base, alloc) != 0)) {
+        return 3;
+    }
+    
+#   if (ISF_MIRROR_HEAP_BYTES > 0)
+    /// Reload the mirror from the restored file, and drop its dirty words
+    {   vaddr mirror = vworm_read(header + 8);
+        if (mirror != NULL_vaddr) {
+            ot_u16* mirror_ptr = (ot_u16*)vsram_get(mirror);
+            *mirror_ptr = vworm_read(header + 0);
+            if (base != NULL_vaddr) {
+                vworm_read_block(base, (ot_u8*)(mirror_ptr+1), *mirror_ptr);
+            }
+            for (i=0; i<=alloc; i+=2) {
+                sub_mirror_take(mirror + i);
+            }
+        }
+    }
+#   endif
+
+#   if (OT_FEATURE(VLCRC) == ENABLED)
+    if (block_id == VL_ISF_BLOCKID) {
+        vl_crcstate[(header - ISF_Header_START) / sizeof(vl_header)] = VLCRC_NONE;
+    }
+#   endif
+#   if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    if (block_id == VL_ISF_BLOCKID) {
+        vl_sumvalid[(header - ISF_Header_START) / sizeof(vl_header)] = False;
+    }
+#   endif
+    
+    vl_isfchange = 0xFFFF;
+    vl_mapstamp++;
+    vl_writestamp++;
+    vl_idstamp++;
+    vl_keystamp++;
+    return 0;
+}
+#endif
+
+
+
+#ifndef EXTF_vl_restore_all
+ot_u8 vl_restore_all() {
+    ot_int i;
+    
+    for (i=0; i<OT_FEATURE(VLFPS); i++) {
+        if (vl_file[i].read != NULL) {
+            return 2;
+        }
+    }
+    if (vworm_restore(OVERHEAD_START_VADDR, \
+                (ISF_START_VADDR + ISF_TOTAL_BYTES) - OVERHEAD_START_VADDR) != 0) {
+        return 3;
+    }
+    
+    /// The mirrors, CRCs, extent maps and header index all start over
+    sub_vl_start(False);
+    vl_isfchange = 0xFFFF;
+    vl_mapstamp++;
+    vl_writestamp++;
+    vl_idstamp++;
+    vl_keystamp++;
+    return 0;
+}
+#endif
+
+
+
 #ifndef EXTF_vl_getheader
 ot_u8 vl_getheader_vaddr(vaddr* header, vlBLOCK block_id, ot_u8 data_id, ot_u8 mod, id_tmpl* user_id) {
 
     /// 1. Get the header from the supplied Block ID & Data ID
-    switch (block_id) {
-        case VL_GFB_BLOCKID:    *header = sub_gfb_search(data_id);      break;
-        case VL_ISFS_BLOCKID:   *header = sub_isfs_search(data_id);     break;
-        case VL_ISF_BLOCKID:    *header = sub_isf_search(data_id);      break;
-        default:                return 255;
+    if ((ot_u8)(block_id - 1) > 2) {
+        return 255;
     }
+    *header = sub_block_search(block_id - 1, data_id);
 
     /// 2. Bail if header is NULL
     if (*header == NULL_vaddr) {
@@ -416,10 +939,82 @@ ot_u8 vl_getheader(vl_header* header, vlBLOCK block_id, ot_u8 data_id, ot_u8 mod
 
 
 
+#ifndef EXTF_vl_nextheader
+ot_int vl_nextheader(vaddr* header, vlBLOCK block_id, ot_int index) {
+    const vl_blockparam* blk;
+    ot_int  count;
+    vaddr   base;
+
+    if ((ot_u8)(block_id - 1) > 2) {
+        return -1;
+    }
+    blk     = &vl_block[block_id - 1];
+    count   = blk->scan_count + ((blk->scan_header - blk->header) / sizeof(vl_header));
+    
+    for (; index < count; index++) {
+        *header = blk->header + (index * sizeof(vl_header));
+        base    = vworm_read(*header + 6);
+        if ((base != 0) && (base != 0xFFFF)) {
+            return index + 1;
+        }
+    }
+    
+    return -1;
+}
+#endif
+
+
+
+#ifndef EXTF_vl_get_direct
+ot_u8 vl_get_direct(vl_direct* view, vlBLOCK block_id, ot_u8 data_id, id_tmpl* user_id) {
+    vaddr   header = NULL_vaddr;
+    vaddr   mirror;
+    ot_u8   output;
+
+    output = vl_getheader_vaddr(&header, block_id, data_id, VL_ACCESS_R, user_id);
+    if (output == 0) {
+        view->stamp = (ot_u16)(vl_mapstamp + vworm_mapstamp);
+        mirror      = vworm_read(header + 8);
+        
+        /// Mirrored files are read from the mirror, which is always in place.
+        /// Others are read from VWORM, if the VWORM pages allow it.
+        if (mirror != NULL_vaddr) {
+            view->length    = vsram_read(mirror);
+            view->data      = vsram_get(mirror + 2);
+        }
+        else {
+            view->length    = vworm_read(header + 0);
+            view->data      = vworm_get_direct(vworm_read(header + 6), view->length);
+        }
+        
+        if (view->data == NULL) {
+            output = 2;
+        }
+    }
+    
+    return output;
+}
+#endif
+
+
+
+#ifndef EXTF_vl_direct_valid
+ot_bool vl_direct_valid(vl_direct* view) {
+    return (ot_bool)(view->stamp == (ot_u16)(vl_mapstamp + vworm_mapstamp));
+}
+#endif
+
+
+
 #ifndef EXTF_vl_open_file
 vlFILE* vl_open_file(vaddr header) {
     vlFILE* fp;
 
+    fp = sub_shared_fp(header);
+    if (fp != NULL) {
+        return fp;
+    }
+
     fp = sub_new_fp();
     
     if (fp != NULL) {
@@ -483,7 +1078,16 @@ ot_u8 vl_chmod(vlBLOCK block_id, ot_u8 data_id, ot_u8 mod, id_tmpl* user_id) {
 
 #ifndef EXTF_vl_read
 ot_u16 vl_read( vlFILE* fp, ot_uint offset ) {
+#   if (OT_FEATURE(STATIC_DISPATCH) == ENABLED)
+    /// There are only two file backends, so a compare and two direct calls
+    /// (which the compiler can inline) replace the indirect call.
+    if (fp->read == &vsram_read) {
+        return vsram_read( (ot_uint)(offset+fp->start) );
+    }
+    return vworm_read( (ot_uint)(offset+fp->start) );
+#   else
     return fp->read( (ot_uint)(offset+fp->start) );
+#   endif
 }
 #endif
 
@@ -495,10 +1099,49 @@ ot_u8 vl_write( vlFILE* fp, ot_uint offset, ot_u16 data ) {
         return 255;
     }
     if (offset >= fp->length) {
+        // Bytes between the old length and the write come back into the file
+#       if (OT_FEATURE(VLSUMMARY) == ENABLED)
+        if ((offset > fp->length) && (FP_ISFINDEX(fp) < ISF_NUM_STOCK_FILES)) {
+            vl_sumvalid[FP_ISFINDEX(fp)] = False;
+        }
+#       endif
         fp->length = offset+2;
     }
+    if (FP_ISIDFILE(fp)) {
+        vl_idstamp++;
+    }
+    if (FP_ISKEYFILE(fp)) {
+        vl_keystamp++;
+    }
+    if (FP_ISFINDEX(fp) < VL_ISFCHANGE_FILES) {
+        vl_isfchange |= (ot_u16)(1 << FP_ISFINDEX(fp));
+    }
+    vl_writestamp++;
+    
+#   if (OT_FEATURE(VLCRC) == ENABLED)
+    if (FP_ISFINDEX(fp) < ISF_NUM_STOCK_FILES) {
+        vl_crcstate[FP_ISFINDEX(fp)] = VLCRC_NONE;
+    }
+#   endif
+
+    // The summary keeps the bytes that are overwritten, which is safe
+#   if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    if ((FP_ISFINDEX(fp) < ISF_NUM_STOCK_FILES) && vl_sumvalid[FP_ISFINDEX(fp)]) {
+        sub_sum_add(&vl_sum[FP_ISFINDEX(fp)], 2, (ot_u8*)&data);
+    }
+#   endif
     
+    if (fp->write == &vsram_mark) {
+        sub_mirror_mark((offset+fp->start), 2);
+#       if (OT_FEATURE(STATIC_DISPATCH) == ENABLED)
+        return vsram_mark( (offset+fp->start), data);
+#       endif
+    }
+#   if (OT_FEATURE(STATIC_DISPATCH) == ENABLED)
+    return vworm_write( (offset+fp->start), data);
+#   else
     return fp->write( (offset+fp->start), data);
+#   endif
 }
 #endif
 
@@ -506,50 +1149,79 @@ ot_u8 vl_write( vlFILE* fp, ot_uint offset, ot_u16 data ) {
 
 #ifndef EXTF_vl_load
 ot_uint vl_load( vlFILE* fp, ot_uint length, ot_u8* data ) {
-    Twobytes    scratch;
-    ot_uint     cursor;
-
     if (length > fp->length) {
         length = fp->length;
     }
 
-    cursor      = fp->start;
-    length      = cursor+length;
-
-    for (; cursor<length; cursor++) {
-        ot_u8 align = (cursor & 1);
-        if (align == 0) {
-            scratch.ushort = fp->read(cursor);
-        }
-        *data++ = scratch.ubyte[align];
+    // Block reads avoid a function-pointer call per word
+    if (fp->read == &vsram_read) {
+        vsram_read_block(fp->start, data, length);
+    }
+    else {
+        vworm_read_block(fp->start, data, length);
     }
 
-    return (length - fp->start);
+    return length;
+}
+#endif
+
+
+#ifndef EXTF_vl_read_block
+ot_u8 vl_read_block( vlFILE* fp, ot_uint offset, ot_uint length, ot_u8* data ) {
+    if ((offset + length) > fp->alloc) {
+        return 255;
+    }
+    if (fp->read == &vsram_read) {
+        return vsram_read_block((fp->start + offset), data, length);
+    }
+    return vworm_read_block((fp->start + offset), data, length);
 }
 #endif
 
 
 #ifndef EXTF_vl_store
 ot_u8 vl_store( vlFILE* fp, ot_uint length, ot_u8* data ) {
-    Twobytes    scratch;
-    ot_uint     cursor;
-    ot_u8       test;
-
     if (length > fp->alloc) {
         return 255;
     }
 
-    fp->length  = length;
-    cursor      = fp->start;
-    length      = cursor+length;
+    if (FP_ISIDFILE(fp)) {
+        vl_idstamp++;
+    }
+    if (FP_ISKEYFILE(fp)) {
+        vl_keystamp++;
+    }
+    if (FP_ISFINDEX(fp) < VL_ISFCHANGE_FILES) {
+        vl_isfchange |= (ot_u16)(1 << FP_ISFINDEX(fp));
+    }
+    vl_writestamp++;
+
+    fp->length = length;
+
+    // The flash write is verified later against the CRC of the buffer
+#   if (OT_FEATURE(VLCRC) == ENABLED)
+    if (FP_ISFINDEX(fp) < ISF_NUM_STOCK_FILES) {
+        vl_crc[FP_ISFINDEX(fp)]         = crc_calc_block(length, data);
+        vl_crcstate[FP_ISFINDEX(fp)]    = VLCRC_STALE;
+    }
+#   endif
+
+    // The stored buffer is all of the data, so it makes an exact summary
+#   if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    if (FP_ISFINDEX(fp) < ISF_NUM_STOCK_FILES) {
+        vl_sum[FP_ISFINDEX(fp)].filter  = 0;
+        vl_sum[FP_ISFINDEX(fp)].min     = 0xFF;
+        vl_sum[FP_ISFINDEX(fp)].max     = 0;
+        vl_sumvalid[FP_ISFINDEX(fp)]    = True;
+        sub_sum_add(&vl_sum[FP_ISFINDEX(fp)], length, data);
+    }
+#   endif
 
-    for (test=0; cursor<length; cursor+=2) {
-        scratch.ubyte[0]    = *data++;
-        scratch.ubyte[1]    = *data++;
-        test               |= fp->write(cursor, scratch.ushort);
+    if (fp->write == &vsram_mark) {
+        sub_mirror_mark(fp->start, length);
+        return vsram_write_block(fp->start, data, length);
     }
-
-    return test;
+    return vworm_write_block(fp->start, data, length);
 }
 #endif
 
@@ -558,15 +1230,36 @@ ot_u8 vl_store( vlFILE* fp, ot_uint length, ot_u8* data ) {
 
 #ifndef EXTF_vl_close
 ot_u8 vl_close( vlFILE* fp ) {
-    if (FP_ISVALID(fp)) {        
+    if (FP_ISVALID(fp)) {
+        ot_int fd = vl_get_fd(fp);
+
+        // The file stays open while other opens share the handle
+        if (vl_fpref[fd] > 1) {
+            vl_fpref[fd]--;
+            return 0;
+        }
+
         if (fp->read == &vsram_read) {
             ot_u16* mhead;
             mhead   = (ot_u16*)vsram_get(fp->start-2);
-            *mhead  = (*mhead != fp->length) ? fp->length : *mhead;
+            if (*mhead != fp->length) {
+                *mhead = fp->length;
+                sub_mirror_mark(fp->start-2, 2);
+                vl_mapstamp++;
+            }
         }
         else if ( vworm_read(fp->header+0) != fp->length ) {
             sub_write_header( (fp->header+0), &(fp->length), 2);
         }
+        
+        // A file changed by vl_write() takes its new reference CRC here
+#       if (OT_FEATURE(VLCRC) == ENABLED)
+        if (FP_ISFINDEX(fp) < ISF_NUM_STOCK_FILES) {
+            if (vl_crcstate[FP_ISFINDEX(fp)] == VLCRC_NONE) {
+                sub_isf_check( (ot_u8)FP_ISFINDEX(fp) );
+            }
+        }
+#       endif
             
         // Kill file attributes
         fp->start   = 0;
@@ -574,6 +1267,8 @@ ot_u8 vl_close( vlFILE* fp ) {
         //fp->header  = NULL_vaddr;
         fp->read    = NULL;
         fp->write   = NULL;
+        vl_fpref[fd]= 0;
+        vl_fpfree  |= (ot_u16)(1 << fd);
         
         return 0;
     }
@@ -669,6 +1364,75 @@ ot_u8 ISF_chmod_su( ot_u8 id, ot_u8 mod ) {
 }
 
 
+#ifndef EXTF_ISF_verify
+ot_u8 ISF_verify( ot_u8 id ) {
+#if (OT_FEATURE(VLCRC) == ENABLED)
+    if (id >= ISF_NUM_STOCK_FILES) {
+        return 255;
+    }
+    if (vl_crcstate[id] != VLCRC_OK) {
+        return (sub_isf_check(id) != VLCRC_OK);
+    }
+#endif
+    return 0;
+}
+#endif
+
+
+#ifndef EXTF_ISF_summary
+const vl_summary* ISF_summary( ot_u8 id ) {
+#if (OT_FEATURE(VLSUMMARY) == ENABLED)
+    if (id >= ISF_NUM_STOCK_FILES) {
+        return NULL;
+    }
+    if (vl_sumvalid[id] == False) {
+        vlFILE* fp;
+        ot_int  i;
+        
+        fp = ISF_open_su(id);
+        if (fp == NULL) {
+            return NULL;
+        }
+        vl_sum[id].filter   = 0;
+        vl_sum[id].min      = 0xFF;
+        vl_sum[id].max      = 0;
+        for (i=0; i<fp->length; i+=2) {
+            Twobytes word;
+            word.ushort = vl_read(fp, i);
+            sub_sum_add(&vl_sum[id], ((fp->length - i) > 1) ? 2 : 1, word.ubyte);
+        }
+        vl_close(fp);
+        vl_sumvalid[id] = True;
+    }
+    return &vl_sum[id];
+#else
+    return NULL;
+#endif
+}
+#endif
+
+
+#ifndef EXTF_vl_verify
+ot_u8 vl_verify() {
+#if (OT_FEATURE(VLCRC) == ENABLED)
+    ot_int i;
+
+    for (i=0; i<ISF_NUM_STOCK_FILES; i++) {
+        ot_u8 id = vl_crccursor;
+        
+        if (++vl_crccursor >= ISF_NUM_STOCK_FILES) {
+            vl_crccursor = 0;
+        }
+        if (vl_crcstate[id] < VLCRC_OK) {
+            return (sub_isf_check(id) != VLCRC_OK);
+        }
+    }
+#endif
+    return 2;
+}
+#endif
+
+
 ot_u8 ISF_syncmirror() {
 #   if (ISF_MIRROR_HEAP_BYTES > 0)
         return sub_isf_mirror(MIRROR_TO_FLASH);
@@ -693,84 +1457,129 @@ ot_u8 ISF_loadmirror() {
 
 
 
-/// Private Block Functions
+/// Private ISF Integrity Functions
 
-vlFILE* sub_gfb_new(ot_u8 id, ot_u8 mod, ot_u8 null_arg) {
-#if ((OT_FEATURE(VLNEW) == ENABLED) && \
-     ((GFB_HEAP_BYTES > 0) && (GFB_NUM_USER_FILES > 0)))
-    Twobytes   idmod;
-    vl_header  new_header;
-    
-    idmod.ubyte[0]  = id;
-    idmod.ubyte[1]  = mod;
+#if (OT_FEATURE(VLCRC) == ENABLED)
+ot_u16 sub_isf_crc(ot_u8 id) {
+    vaddr           header;
+    vaddr           base;
+    ot_uint         length;
+    ot_u16          crc;
+    const ot_u8*    data;
     
-    // Fill vl_header
-    new_header.length   = (ot_u16)0;
-    new_header.alloc    = (ot_u16)GFB_FILE_BYTES;
-    new_header.idmod    = idmod.ushort;
-    new_header.mirror   = NULL_vaddr;
+    header  = ISF_Header_START + (id * sizeof(vl_header));
+    base    = vworm_read(header+8);
     
-    // Find where to put the new data, and if heap is full
-    return sub_new_file(    &new_header,
-                        GFB_HEAP_USER_START, 
-                        GFB_HEAP_END,
-                        GFB_Header_START_USER, 
-                        GFB_NUM_USER_FILES   ); 
-#else
-    return NULL;
-#endif
+    // Mirrored files are read from the mirror: the length is ahead of the data
+    if (base != NULL_vaddr) {
+        length  = *(ot_u16*)vsram_get(base);
+        return crc_calc_block(length, vsram_get(base+2));
+    }
+
+    base    = vworm_read(header+6);
+    length  = vworm_read(header+0);
+    if ((base == NULL_vaddr) || (length == 0)) {
+        return crc_calc_block(0, NULL);
+    }
+
+    data = vworm_get_direct(base, length);
+    if (data != NULL) {
+        return crc_calc_block(length, (ot_u8*)data);
+    }
+
+    // Data that is not contiguous in flash is read a word at a time
+#   if (MCU_FEATURE(CRC) == ENABLED)
+    platform_crc_init();
+#   else
+    crc = crc_calc_block(0, NULL);
+#   endif
+    for (; length>0; base+=2) {
+        Twobytes    word;
+        ot_int      span;
+        word.ushort = vworm_read(base);
+        span        = (length > 1) ? 2 : 1;
+        length     -= span;
+#       if (MCU_FEATURE(CRC) == ENABLED)
+        platform_crc_byte(word.ubyte[0]);
+        if (span > 1) {
+            platform_crc_byte(word.ubyte[1]);
+        }
+#       else
+        crc = crc_extend_block(crc, span, word.ubyte);
+#       endif
+    }
+#   if (MCU_FEATURE(CRC) == ENABLED)
+    crc = platform_crc_result();
+#   endif
+    return crc;
 }
 
-vlFILE* sub_isfs_new(ot_u8 id, ot_u8 mod, ot_u8 null_arg) {
-#if ((OT_FEATURE(VLNEW) == ENABLED) && (ISFS_NUM_USER_CODES > 0))
-    Twobytes   idmod;
-    vl_header  new_header;
+
+ot_u8 sub_isf_check(ot_u8 id) {
+    ot_u16 crc;
     
-    idmod.ubyte[0]  = id;
-    idmod.ubyte[1]  = mod;
+    crc = sub_isf_crc(id);
     
-    // Fill vl_header
-    new_header.length   = (ot_u16)0;
-    new_header.alloc    = (ot_u16)ISFS_MAX_default;
-    new_header.idmod    = idmod.ushort;
-    new_header.mirror   = NULL_vaddr;
+    if (vl_crcstate[id] == VLCRC_NONE) {
+        vl_crc[id]          = crc;
+        vl_crcstate[id]     = VLCRC_OK;
+    }
+    else {
+        vl_crcstate[id]     = (crc == vl_crc[id]) ? VLCRC_OK : VLCRC_BAD;
+    }
     
-    // Find where to put the new data, and if heap is full
-    return sub_new_file(    &new_header, 
-                        ISFS_HEAP_USER_START,
-                        ISFS_HEAP_END,
-                        ISFS_Header_START_USER, 
-                        ISFS_NUM_USER_CODES   );
-#else
-    return NULL;
+    return vl_crcstate[id];
+}
 #endif
+
+
+
+
+/// Private ISF Summary Functions
+
+#if (OT_FEATURE(VLSUMMARY) == ENABLED)
+void sub_sum_add(vl_summary* sum, ot_int length, ot_u8* data) {
+    for (; length>0; length--, data++) {
+        sum->filter |= ((ot_u32)1 << (*data & 31));
+        if (*data < sum->min)   sum->min = *data;
+        if (*data > sum->max)   sum->max = *data;
+    }
 }
+#endif
+
+
 
 
-vlFILE* sub_isf_new(ot_u8 id, ot_u8 mod, ot_u8 max_length ) {
-#if ((OT_FEATURE(VLNEW) == ENABLED) && (ISF_NUM_USER_FILES > 0))
-    Twobytes   idmod;
-    vl_header new_header;
+/// Private Block Functions
+
+vlFILE* sub_block_new(ot_u8 block, ot_u8 id, ot_u8 mod, ot_uint max_length) {
+#if (VL_EXTENTS > 0)
+    const vl_blockparam* blk = &vl_block[block];
+    Twobytes    idmod;
+    vl_header   new_header;
     
+    if (blk->users == 0) {
+        return NULL;
+    }
     idmod.ubyte[0]  = id;
     idmod.ubyte[1]  = mod;
     
-    // Fill vl_header
+    // Fill vl_header.  Blocks without a fixed file size take the requested
+    // length (up to 255 bytes), rounded up to keep the allocation even.
     new_header.length   = (ot_u16)0;
-    new_header.alloc    = (ot_u16)max_length;
+    new_header.alloc    = blk->new_alloc;
     new_header.idmod    = idmod.ushort;
     new_header.mirror   = NULL_vaddr;
-    
-    // determine amount of actual ISF allocation needed (keeping it even)
-    new_header.alloc += 1;
-    new_header.alloc &= ~1;
+    if (new_header.alloc == 0) {
+        new_header.alloc = ((ot_u16)(ot_u8)max_length + 1) & ~1;
+    }
     
     // Find where to put the new data, and if heap is full
     return sub_new_file(&new_header, 
-                        ISF_HEAP_USER_START, 
-                        ISF_HEAP_END,
-                        ISF_Header_START_USER, 
-                        ISF_NUM_USER_FILES ); 
+                        blk->heap_base, 
+                        blk->heap_end,
+                        blk->user_header, 
+                        blk->users ); 
 #else
     return NULL;
 #endif
@@ -779,70 +1588,36 @@ vlFILE* sub_isf_new(ot_u8 id, ot_u8 mod, ot_u8 max_length ) {
 
 
 
-ot_u8 sub_gfb_delete_check(ot_u8 id) { 
-#if ((OT_FEATURE(VLNEW) == ENABLED) && \
-     ((GFB_HEAP_BYTES > 0) && (GFB_NUM_USER_FILES > 0)))
-    return ( id > GFB_NUM_STOCK_FILES );
-#else
-    return 0;
-#endif
-}   
-
-
-ot_u8 sub_isfs_delete_check(ot_u8 id) {
-#if ((OT_FEATURE(VLNEW) == ENABLED) && (ISFS_NUM_USER_CODES > 0))
-    return ( id >= ISFS_ID_extended_service);
-#else
-    return 0;
-#endif
-}
-
-
-ot_u8 sub_isf_delete_check(ot_u8 id) { 
-#if ((OT_FEATURE(VLNEW) == ENABLED) && (ISF_NUM_USER_FILES > 0))
-    return ((id >= (ISF_NUM_M1_FILES+ISF_NUM_M2_FILES)) && \
-            (id < (256-ISF_NUM_EXT_FILES)) );
+ot_bool sub_block_isuser(ot_u8 block, ot_u8 id) {
+#if (OT_FEATURE(VLNEW) == ENABLED)
+    return (ot_bool)((id >= vl_block[block].user_lo) && (id <= vl_block[block].user_hi));
 #else
-    return 0;
+    return False;
 #endif
 }
 
 
 
 
-vaddr sub_gfb_search(ot_u8 id) {
-    return sub_header_search( GFB_Header_START, id, GFB_NUM_USER_FILES );
-}
-
-
-vaddr sub_isfs_search(ot_u8 id) {
-    return sub_header_search( ISFS_Header_START, id, ISFS_NUM_LISTS );
-}
+vaddr sub_block_search(ot_u8 block, ot_u8 id) {
+    const vl_blockparam* blk = &vl_block[block];
 
-
-vaddr sub_isf_search(ot_u8 id) {
-#   if (OT_FEATURE(VLNEW) == ENABLED)
-    // Check IDs added by the user during runtime
-    if ( (id >= (ISF_NUM_M1_FILES+ISF_NUM_M2_FILES)) && \
-            (id < (256-ISF_NUM_EXT_FILES)) ) {
-        return sub_header_search(ISF_Header_START_USER, id, ISF_NUM_USER_FILES);
+    // Search for IDs added by the user during runtime, and for all IDs of
+    // the blocks that are not direct
+    if ((blk->direct == False) || sub_block_isuser(block, id)) {
+#       if (OT_FEATURE(VLINDEX) == ENABLED)
+        return sub_index_search(&vl_index[block], id);
+#       else
+        return sub_header_search(blk->scan_header, id, blk->scan_count);
+#       endif
     }
-#   endif
 
-#   if (ISF_NUM_EXT_FILES != 0)
-    // Translate EXT IDs to a contiguous indexing with Stock Files
-    if (id > (255-ISF_NUM_EXT_FILES)) {
-        id = (ot_u8)((ot_int)ISF_NUM_STOCK_FILES + ((ot_int)id-256));
+    // Stock IDs index the headers.  EXT IDs are the last stock headers,
+    // which are just before the user headers.
+    if (id > (255-blk->ext)) {
+        return blk->user_header - ((256 - (ot_int)id) * sizeof(vl_header));
     }
-#   endif
-
-    // Look in stock files
-    //if (id <= (ISF_NUM_STOCK_FILES-1)) {
-    	return (sizeof(vl_header) * id) + ISF_Header_START;
-    //}
-    
-    // File ID does not exist
-    return NULL_vaddr;
+    return blk->header + (sizeof(vl_header) * id);
 }
 
 
@@ -850,14 +1625,19 @@ vaddr sub_isf_search(ot_u8 id) {
 
 
 ot_u8 sub_isf_mirror(ot_u8 direction) {
+#if (ISF_MIRROR_HEAP_BYTES > 0)
     vaddr   header;
     vaddr   header_base;
     vaddr   header_alloc;
     vaddr   header_mirror;
-    //vaddr   header_end;
     ot_int  i;
     ot_u16* mirror_ptr;
     
+    // Loading the mirror changes the data and length of mirrored files
+    if (direction == MIRROR_TO_SRAM) {
+        vl_mapstamp++;
+    }
+
     // Go through ISF Header array
     header = ISF_Header_START; 
     for (i=0; i<ISF_NUM_STOCK_FILES; i++, header+=sizeof(vl_header)) {
@@ -870,7 +1650,8 @@ ot_u8 sub_isf_mirror(ot_u8 direction) {
         // Copy vworm to mirror if there is a mirror
         // 0. Skip unmirrored or uninitialized, or unallocated files
         // 1. Resolve Mirror Length (in vsram it is right ahead of the data)
-        // 2. Load/Save Mirror Data (header_alloc is repurposed)
+        // 2. Load/Save Mirror Data (header_alloc is repurposed).  Saves only
+        //    write the words that are dirty and that differ from vworm.
         if ((header_mirror != NULL_vaddr) && (header_alloc  != 0)) {
         	mirror_ptr = (ot_u16*)vsram_get(header_mirror);
             if (direction == MIRROR_TO_SRAM) {  // LOAD
@@ -880,45 +1661,113 @@ ot_u8 sub_isf_mirror(ot_u8 direction) {
             	continue;
             }
             if (direction != MIRROR_TO_SRAM) {  // SAVE
-                vworm_write((header+0), *mirror_ptr);
+                if (sub_mirror_take(header_mirror) && (vworm_read(header+0) != *mirror_ptr)) {
+                    vworm_write((header+0), *mirror_ptr);
+                }
             }
             
             header_alloc = header_base + *mirror_ptr;
             mirror_ptr++;
-            for ( ; header_base<header_alloc; header_base+=2, mirror_ptr++) {
+            header_mirror += 2;
+            for ( ; header_base<header_alloc; header_base+=2, header_mirror+=2, mirror_ptr++) {
                 if (direction == MIRROR_TO_SRAM) {
                     *mirror_ptr = vworm_read(header_base);
                 }
-                else { 
+                else if (sub_mirror_take(header_mirror) && (vworm_read(header_base) != *mirror_ptr)) { 
                     vworm_write(header_base, *mirror_ptr);
                 }
             }
         }
     }
     
+    // Whatever is left is past the end of a file, or in a mirror-only file
+    for (i=0; i<(ot_int)sizeof(vl_mirror_dirty); i++) {
+        vl_mirror_dirty[i] = 0;
+    }
+#endif
     return 0;
 }
 
 
 
+#if (ISF_MIRROR_HEAP_BYTES > 0)
+ot_bool sub_mirror_take(vaddr addr) {
+/// Returns the dirty bit of a mirror word, and clears it
+    ot_uint word    = (ot_uint)(addr - ISF_MIRROR_BASE) >> 1;
+    ot_u8   mask    = (ot_u8)(1 << (word & 7));
+    ot_bool dirty   = (ot_bool)((vl_mirror_dirty[word >> 3] & mask) != 0);
+    
+    vl_mirror_dirty[word >> 3] &= ~mask;
+    return dirty;
+}
+#endif
+
+
+void sub_mirror_mark(vaddr addr, ot_uint length) {
+#if (ISF_MIRROR_HEAP_BYTES > 0)
+    ot_uint word    = (ot_uint)(addr - ISF_MIRROR_BASE) >> 1;
+    ot_uint end     = (ot_uint)(addr + length + 1 - ISF_MIRROR_BASE) >> 1;
+    
+    for (; (word < end) && (word < VL_MIRROR_WORDS); word++) {
+        vl_mirror_dirty[word >> 3] |= (ot_u8)(1 << (word & 7));
+    }
+#endif
+}
+
+
+
 
 
 
 
 /// Generic Subroutines
 
+ot_int sub_fp_index(ot_u16 bit) {
+/// Bit number of a one-bit mask, by halves
+    ot_int fd = 0;
+    if (bit & 0xFF00)   fd += 8;
+    if (bit & 0xF0F0)   fd += 4;
+    if (bit & 0xCCCC)   fd += 2;
+    if (bit & 0xAAAA)   fd += 1;
+    return fd;
+}
+
+
 vlFILE* sub_new_fp() {
-#if (OT_FEATURE(VLFPS) < 8)
-    ot_int fd;
+/// The lowest free handle is taken, as the lowest set bit of vl_fpfree
+    ot_u16  bit;
+    ot_int  fd;
+
+    bit = vl_fpfree & (ot_u16)(0 - vl_fpfree);
+    if (bit == 0) {
+        return NULL;
+    }
+    vl_fpfree  ^= bit;
+    fd          = sub_fp_index(bit);
+    vl_fpref[fd]= 1;
+
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    if (fd >= vl_fphwm) {
+        vl_fphwm = (ot_u8)(fd + 1);
+    }
+#   endif
+    return &vl_file[fd];
+}
+
 
-    for (fd=0; fd<OT_FEATURE(VLFPS); fd++) {
-        if (vl_file[fd].read == NULL) 
+vlFILE* sub_shared_fp(vaddr header) {
+/// Only the handles in use are compared
+    ot_u16 used = (ot_u16)~vl_fpfree & VL_FPMASK;
+
+    while (used != 0) {
+        ot_u16 bit  = used & (ot_u16)(0 - used);
+        ot_int fd   = sub_fp_index(bit);
+        if ((vl_file[fd].header == header) && (vl_fpref[fd] != 255)) {
+            vl_fpref[fd]++;
             return &vl_file[fd];
+        }
+        used ^= bit;
     }
-#else
-        ///@todo do a binary search
-#endif
-    
     return NULL;
 }
 
@@ -927,7 +1776,8 @@ vlFILE* sub_new_file(vl_header* new_header, vaddr heap_base, vaddr heap_end, vad
 #if (OT_FEATURE(VLNEW) == ENABLED)
     //vlFILE* fp;
     //vaddr   new_base    = 0;
-    vaddr   header_addr = 0;
+    vaddr       header_addr = 0;
+    vl_heapmap* map;
 
     // Find where to put the new header, and if it's full
     header_addr = sub_find_empty_header( header_base, header_window );
@@ -935,19 +1785,30 @@ vlFILE* sub_new_file(vl_header* new_header, vaddr heap_base, vaddr heap_end, vad
         return NULL;
     
     // Find where to put the new data, and if heap is full
-    new_header->base = sub_find_empty_heap( heap_base, 
-                                            heap_end, 
-                                            header_base, 
-                                            (ot_uint)new_header->alloc, 
-                                            header_window );
+    map = sub_heapmap_of(header_addr);
+    if (map == NULL)
+        return NULL;
+    
+    new_header->base = sub_find_empty_heap(map, (ot_uint)new_header->alloc);
     if (new_header->base == NULL_vaddr) 
         return NULL;
     
     // Make sure new header has the right base address
     //new_header->base = new_base;
     
-    // Write header to the header array
+    // Write header to the header array, and add the data to the heap map
     sub_write_header(header_addr, (ot_u16*)new_header, sizeof(vl_header));
+    sub_heapmap_insert(map, header_addr, new_header->base, new_header->alloc);
+    
+#   if (OT_FEATURE(VLINDEX) == ENABLED)
+    {   vl_headerindex* idx = sub_index_of(header_addr);
+        if (idx != NULL) {
+            Twobytes idmod;
+            idmod.ushort = new_header->idmod;
+            sub_index_insert(idx, idmod.ubyte[0], header_addr);
+        }
+    }
+#   endif
     
     // Open a file, now that data is allocated
     //fp = vl_open_file( header_addr );
@@ -970,16 +1831,33 @@ vlFILE* sub_new_file(vl_header* new_header, vaddr heap_base, vaddr heap_end, vad
 
 void sub_delete_file(vaddr del_header) { 
 #if (OT_FEATURE(VLNEW) == ENABLED)
-    vaddr   header_base;
-    ot_u16  header_alloc;
+    vaddr       header_base;
+    ot_u16      header_alloc;
+    vl_heapmap* map;
     
     header_alloc    = (ot_u16)vworm_read(del_header+2);
     header_base     = (vaddr)vworm_read(del_header+6);
     
     // Wipe the old data and mark header as deleted
+    vl_mapstamp++;
     vworm_wipeblock(header_base, header_alloc);
     vworm_mark((del_header+2), 0);                //alloc
     vworm_mark((del_header+6), NULL_vaddr);       //base
+    
+    // Free the extent, leaving a gap for the compactor
+    map = sub_heapmap_of(del_header);
+    if (map != NULL) {
+        sub_heapmap_remove(map, header_base);
+        map->dirty = True;
+    }
+    
+#   if (OT_FEATURE(VLINDEX) == ENABLED)
+    {   vl_headerindex* idx = sub_index_of(del_header);
+        if (idx != NULL) {
+            sub_index_build(idx);
+        }
+    }
+#   endif
 #endif
 }
 
@@ -1004,6 +1882,73 @@ vaddr sub_header_search(vaddr header, ot_u8 search_id, ot_int num_headers) {
 }
 
 
+#if (OT_FEATURE(VLINDEX) == ENABLED)
+vl_headerindex* sub_index_of(vaddr header) {
+    ot_int i;
+    
+    for (i=0; i<3; i++) {
+        vaddr span = (vaddr)(vl_index[i].window * sizeof(vl_header));
+        if ((vaddr)(header - vl_index[i].header) < span) {
+            return &vl_index[i];
+        }
+    }
+    return NULL;
+}
+
+
+void sub_index_build(vl_headerindex* idx) {
+    Twobytes    idmod;
+    vaddr       header;
+    ot_u16      base;
+    ot_int      i;
+    
+    for (i=0; i<=idx->mask; i++) {
+        idx->entry[i].slot = 0;
+    }
+    
+    header = idx->header;
+    for (i=0; i<idx->window; i++, header+=sizeof(vl_header)) {
+        base = vworm_read(header + 6);
+        if ((base != 0) && (base != 0xFFFF)) {
+            idmod.ushort = vworm_read(header + 4);
+            sub_index_insert(idx, idmod.ubyte[0], header);
+        }
+    }
+}
+
+
+void sub_index_insert(vl_headerindex* idx, ot_u8 id, vaddr header) {
+    ot_u8 i = (id & idx->mask);
+    
+    // Linear probe to an empty entry.  An ID already present keeps its
+    // existing (lower) header, like a front-to-back header scan would.
+    while (idx->entry[i].slot != 0) {
+        if (idx->entry[i].id == id) {
+            return;
+        }
+        i = (i+1) & idx->mask;
+    }
+    idx->entry[i].id    = id;
+    idx->entry[i].slot  = (ot_u8)((header - idx->header) / sizeof(vl_header)) + 1;
+}
+
+
+vaddr sub_index_search(vl_headerindex* idx, ot_u8 id) {
+    ot_u8 i = (id & idx->mask);
+    
+    // The table is never more than half full, so there is always an empty
+    // entry to stop the probe
+    while (idx->entry[i].slot != 0) {
+        if (idx->entry[i].id == id) {
+            return idx->header + ((idx->entry[i].slot-1) * sizeof(vl_header));
+        }
+        i = (i+1) & idx->mask;
+    }
+    return NULL_vaddr;
+}
+#endif
+
+
 void sub_copy_header( vaddr header, ot_u16* output_header ) {
     ot_int i;
     ot_int copy_length = sizeof(vl_header) / 2;
@@ -1018,6 +1963,7 @@ void sub_copy_header( vaddr header, ot_u16* output_header ) {
 void sub_write_header(vaddr header, ot_u16* data, ot_uint length ) {
     ot_int i;
 
+    vl_mapstamp++;
     for (i=0; i<length; i+=2, data++) {
         vworm_write( (header+i), *data);
     }
@@ -1040,63 +1986,110 @@ vaddr sub_find_empty_header(vaddr header, ot_int num_headers) {
 }
 
 
-/// @todo This checks out in testing, although it is a complex function that
-///       probably merits further testing
-vaddr sub_find_empty_heap(  vaddr heap_base, vaddr heap_end, 
-                        vaddr header, ot_uint new_alloc, ot_int num_headers) {
-#if (OT_FEATURE(VLNEW) == ENABLED)
-    //Search all header combinations to find:
-    // - pairs of adjacent files in the heap
-    // - gaps between these pairs
-    // - the smallest gap that is big enough.
-    vaddr   loop1           = header;
-    vaddr   loop1_base;
-    ot_uint loop1_alloc;
-    vaddr   loop2;
-    vaddr   loop2_base;
-    //ot_uint loop2_alloc;	///@todo figure out why this is disused
+vl_heapmap* sub_heapmap_of(vaddr header) {
+#if (VL_EXTENTS > 0)
+    ot_int i;
     
+    for (i=0; i<3; i++) {
+        vaddr span = (vaddr)(vl_heap[i].window * sizeof(vl_header));
+        if ((vaddr)(header - vl_heap[i].header) < span) {
+            return &vl_heap[i];
+        }
+    }
+#endif
+    return NULL;
+}
+
+
+void sub_heapmap_build(vl_heapmap* map) {
+    vaddr   header;
+    vaddr   base;
     ot_int  i;
-    ot_int  j;
-    ot_int  gap;
-    ot_int  closest_gap     = (ot_int)(heap_end - heap_base);
-    ot_int  bestfit_alloc   = (ot_int)(32767);
+    
+    map->count  = 0;
+    map->dirty  = True;         // compact anything left over from before reset
+    header      = map->header;
+    
+    for (i=0; i<map->window; i++, header+=sizeof(vl_header)) {
+        base = vworm_read(header + 6);
+        if ((base != NULL_vaddr) && (base != 0)) {
+            sub_heapmap_insert(map, header, base, vworm_read(header + 2));
+        }
+    }
+}
+
+
+ot_int sub_heapmap_find(vl_heapmap* map, vaddr base) {
+    ot_int lo = 0;
+    ot_int hi = map->count;
+    
+    while (lo < hi) {
+        ot_int mid = (lo + hi) >> 1;
+        if (map->ext[mid].base < base)  lo = mid + 1;
+        else                            hi = mid;
+    }
+    return lo;
+}
+
+
+void sub_heapmap_insert(vl_heapmap* map, vaddr header, vaddr base, ot_u16 alloc) {
+    ot_int i;
+    ot_int pos;
+    
+    if (map->count >= map->window) {
+        return;
+    }
+    
+    pos = sub_heapmap_find(map, base);
+    for (i=map->count; i>pos; i--) {
+        map->ext[i] = map->ext[i-1];
+    }
+    map->ext[pos].base      = base;
+    map->ext[pos].alloc     = alloc;
+    map->ext[pos].header    = header;
+    map->count++;
+}
+
+
+void sub_heapmap_remove(vl_heapmap* map, vaddr base) {
+    ot_int pos;
+    
+    pos = sub_heapmap_find(map, base);
+    if ((pos < map->count) && (map->ext[pos].base == base)) {
+        map->count--;
+        for (; pos<map->count; pos++) {
+            map->ext[pos] = map->ext[pos+1];
+        }
+    }
+}
+
+
+/// End of an extent, rounded up to keep the next base half-word aligned
+#define EXTENT_END(EXT)     ((vaddr)(((EXT)->base + (EXT)->alloc + 1) & ~1))
+
+
+vaddr sub_find_empty_heap(vl_heapmap* map, ot_uint new_alloc) {
+#if (OT_FEATURE(VLNEW) == ENABLED)
+    vaddr   cursor          = map->heap_base;
     vaddr   bestfit_base    = NULL_vaddr;
-    //vaddr   loop1_end       = heap_base;
+    ot_uint bestfit_gap     = ~0;
+    ot_uint gap;
+    ot_int  i;
     
-    for (i=0; i<num_headers; i++, loop1+=sizeof(vl_header) ) {
-        loop1_alloc = vworm_read(loop1 + 2);                                    // load alloc (max) from header
-        loop1_base  = vworm_read(loop1 + 6);                                    // load base from header
+    // Walk the gaps in address order: before each extent, then the tail
+    for (i=0; i<=map->count; i++) {
+        vaddr limit = (i < map->count) ? map->ext[i].base : map->heap_end;
         
-        if ( loop1_base != NULL_vaddr ) {                                       // skip if header is deleted, or empty
-            heap_base   = (vaddr)(loop1_base + loop1_alloc);
-            loop2       = header;
-        
-            for (j=0; j<num_headers; j++, loop2+=sizeof(vl_header) ) {
-                //loop2_alloc = vworm_read(loop2 + 2);
-                loop2_base  = vworm_read(loop2 + 6);
-            
-                if ( (loop2_base != NULL_vaddr) && (loop2_base > heap_base) ) { // if header is valid ...
-                    gap = (ot_int)(loop2_base - heap_base);                     // calc gap between the two files
-                
-                    if (gap < closest_gap) {                                    // The closest gap ...
-                        closest_gap = gap;                                      // will be between two adjacent ...
-                        //heap_base   = loop1_end;                                // files in the heap.
-                    }
-                }
+        if (limit > cursor) {
+            gap = (ot_uint)(limit - cursor);
+            if ((gap >= new_alloc) && (gap < bestfit_gap)) {
+                bestfit_gap     = gap;
+                bestfit_base    = cursor;
             }
         }
-        //if (closest_gap >= new_alloc) {                                         // If the gap between loop1 and next file ...
-        //    if (closest_gap < bestfit_alloc) {                                  // is big enough for the data we need ...
-        //        bestfit_alloc   = closest_gap;                                  // and is smaller than other big-enough gaps ...
-        //        bestfit_base    = heap_base;                                    // then it is the gap we will write into.
-        //    }
-        //}
-        if ((closest_gap >= new_alloc) && (closest_gap < bestfit_alloc))  {
-            bestfit_alloc   = closest_gap;
-            bestfit_base    = heap_base;
+        if (i < map->count) {
+            cursor = EXTENT_END(&map->ext[i]);
         }
-
     }
     
     return bestfit_base;
@@ -1106,11 +2099,53 @@ vaddr sub_find_empty_heap(  vaddr heap_base, vaddr heap_end,
 }
 
 
-
-
-//Save sub_defragment_heap for a rainy day
-ot_u8 sub_defragment_heap(vaddr base, ot_uint window) {
+ot_u8 sub_defragment_heap(vl_heapmap* map) {
+#if (OT_FEATURE(VLNEW) == ENABLED)
+    vl_extent   file;
+    vaddr       cursor;
+    vaddr       target;
+    ot_int      i;
+    ot_int      j;
+    ot_u16      k;
+    
+    /// 1. Find the lowest file that fits entirely into a gap below it.  The
+    ///    gap must not overlap the file, or the copy would not be safe.
+    target = NULL_vaddr;
+    for (i=0; i<map->count; i++) {
+        cursor = map->heap_base;
+        for (j=0; j<=i; j++) {
+            vaddr limit = map->ext[j].base;
+            if ((limit > cursor) && ((ot_uint)(limit - cursor) >= map->ext[i].alloc)) {
+                target = cursor;
+                break;
+            }
+            cursor = EXTENT_END(&map->ext[j]);
+        }
+        if (target != NULL_vaddr) {
+            break;
+        }
+    }
+    if (target == NULL_vaddr) {
+        return 1;
+    }
+    file = map->ext[i];
+    
+    /// 2. Copy the data, then point the header at it, then wipe the old data.
+    ///    Until the header write, the old copy is still the valid one.
+    for (k=0; k<file.alloc; k+=2) {
+        vworm_write(target+k, vworm_read(file.base+k));
+    }
+    vworm_write(file.header+6, target);
+    vl_mapstamp++;
+    vworm_wipeblock(file.base, file.alloc);
+    
+    /// 3. Update the map
+    sub_heapmap_remove(map, file.base);
+    sub_heapmap_insert(map, file.header, target, file.alloc);
+    return 0;
+#else
     return ~0;
+#endif
 }
 
 
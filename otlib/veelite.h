@@ -160,6 +160,31 @@ typedef struct {
 #define VL_ACCESS_CRYPTO    (ot_u8)b01000000
 
 
+/// Lazy mirror sync: the kernel syncs the ISF mirror to VWORM when it goes to
+/// Sleep or Off, so mirrored files keep their changes without a sync after
+/// each write
+#ifndef OT_FEATURE_VLLAZYSYNC
+#define OT_FEATURE_VLLAZYSYNC   DISABLED
+#endif
+
+/// File summaries: each stock ISF has a summary of its data bytes, so queries
+/// that cannot match the file are rejected without reading it (ISF_summary())
+#ifndef OT_FEATURE_VLSUMMARY
+#define OT_FEATURE_VLSUMMARY    DISABLED
+#endif
+
+
+/** @typedef vl_summary
+  * The bytes that may be in the data of a file.  filter has bit (b & 31) set
+  * for each byte b in the data, and min and max bound the bytes.  It can hold
+  * more than the data (a byte that was overwritten), never less, so it only
+  * proves that a byte is *not* in the file.
+  */
+typedef struct {
+    ot_u32  filter;
+    ot_u8   min;
+    ot_u8   max;
+} vl_summary;
 
 
 
@@ -226,6 +251,34 @@ void vl_init();
 
 
 
+/** @brief Initializes veelite from the boot snapshot, if there is a good one
+  * @param none
+  * @retval none
+  * @ingroup Veelite
+  *
+  * With OT_FEATURE(VLSNAPSHOT) enabled, the extent maps, the header indexes
+  * and the reference CRCs are taken from the snapshot saved by vl_save() at
+  * the last clean shutdown, instead of being built from the headers.  If
+  * there is no snapshot, or it fails its check, this is just vl_init().
+  * Call it in place of vl_init() (platform_fastinit_OT() does).
+  */
+void vl_fastinit();
+
+
+/** @brief Saves veelite for a clean shutdown
+  * @param none
+  * @retval ot_u8 : Non-zero on memory fault
+  * @ingroup Veelite
+  *
+  * Syncs the ISF mirror and saves the VWORM state.  With OT_FEATURE(VLSNAPSHOT)
+  * the save includes the boot snapshot for vl_fastinit().  Run it before the
+  * SRAM goes off (platform_poweroff() and sys_goto_off() do).  A write to
+  * VWORM after this voids the snapshot, so the next boot does a full init.
+  */
+ot_u8 vl_save();
+
+
+
 
 // General File functions
 
@@ -249,6 +302,25 @@ vlFILE* vl_get_fp(ot_int fd);
 ot_int  vl_get_fd(vlFILE* fp);
 
 
+/** @brief  Returns the most file pointers that have been needed at once
+  * @param  None
+  * @retval ot_u8       highest file pointer slot taken, plus one
+  * @ingroup Veelite
+  *
+  * Only with OT_FEATURE(MEMSTATS).  Open takes the lowest free slot, so this
+  * is the OT_FEATURE(VLFPS) that the app needs.
+  */
+ot_u8 vl_fp_hwm();
+
+
+/** @brief  Zeros the file pointer high-water mark
+  * @param  None
+  * @retval None
+  * @ingroup Veelite
+  */
+void vl_fp_hwm_clear();
+
+
 /** @brief  Creates a new file
   * @param  fp_new      (vlFILE**) A file pointer handle for new file
   * @param  block_id    (vlBLOCK) Block ID of new file (GFB, ISFB, ISFSB, etc)
@@ -301,6 +373,67 @@ ot_u8   vl_new(vlFILE** fp_new, vlBLOCK block_id, ot_u8 data_id, ot_u8 mod, ot_u
 ot_u8   vl_delete(vlBLOCK block_id, ot_u8 data_id, id_tmpl* user_id);
 
 
+
+
+/// Minimum idle time (ticks) for the kernel to run a compaction step
+#ifndef VL_DEFRAG_TICKS
+#   define VL_DEFRAG_TICKS  256
+#endif
+
+/** @brief  Runs one incremental step of user heap compaction
+  * @param  None
+  * @retval ot_u8       0 if a file was moved, non-zero otherwise
+  * @ingroup Veelite
+  *
+  * Deleting files leaves gaps in the user heaps.  Each call moves at most one
+  * file down into a gap, so the free space ends up in one piece at the top.
+  * The kernel calls it when it is idle and the next event is at least
+  * VL_DEFRAG_TICKS away.  It does nothing while any file is open.
+  *
+  * The return value is a numerical code.
+  * <LI>   0: A file was moved; call again to continue          </LI>
+  * <LI>   1: Nothing left to compact                           </LI>
+  * <LI>   2: Skipped, because a file is open                   </LI>
+  */
+ot_u8   vl_defragment();
+
+
+
+/** @brief  Restores a stock file to its default contents
+  * @param  block_id    (vlBLOCK) Block ID of file to restore
+  * @param  data_id     (ot_u8) 0-255 file ID of file to restore
+  * @param  user_id     (id_tmpl*) User ID that is trying to restore the file
+  * @retval ot_u8       Return code: 0 on success, non-zero on error
+  * @ingroup Veelite
+  * @sa vworm_restore()
+  *
+  * The header and the allocation of the file are copied back from the stock
+  * filesystem image with vworm_restore(), in bulk, and a mirrored file is
+  * reloaded from it.  User files have no stock image.
+  *
+  * The return value is a numerical code.
+  * <LI>   0: Success                                           </LI>
+  * <LI>   1: File could not be found                           </LI>
+  * <LI>   2: File is open                                      </LI>
+  * <LI>   3: File cannot be restored (user file, or no stock image) </LI>
+  * <LI>   4: User does not have sufficient access to this file </LI>
+  */
+ot_u8   vl_restore(vlBLOCK block_id, ot_u8 data_id, id_tmpl* user_id);
+
+
+
+/** @brief  Restores the whole filesystem to its stock image, in one pass
+  * @param  None
+  * @retval ot_u8       Return code: 0 on success, non-zero on error
+  * @ingroup Veelite
+  *
+  * All of VWORM is copied back from the stock image, so user files are gone,
+  * and the RAM tables are rebuilt.  It is for root only.  It returns 2 if any
+  * file is open, and 3 if there is no stock image (see vworm_restore()).
+  */
+ot_u8   vl_restore_all();
+
+
 /** @brief  Returns a file header as the vaddr of the header
   * @param  header      (vaddr*) Output header vaddr
   * @param  block_id    (vlBLOCK) Block ID of file header to get
@@ -345,6 +478,77 @@ ot_u8   vl_getheader_vaddr(vaddr* header, vlBLOCK block_id, ot_u8 data_id, ot_u8
 ot_u8   vl_getheader(vl_header* header, vlBLOCK block_id, ot_u8 data_id, ot_u8 mod, id_tmpl* user_id);
 
 
+
+/** @brief  Steps through the file headers of a block, in table order
+  * @param  header      (vaddr*) Output header vaddr
+  * @param  block_id    (vlBLOCK) Block ID of the headers
+  * @param  index       (ot_int) Table position to start from (0 for the first)
+  * @retval ot_int      Position to pass to the next call, or -1 at the end
+  * @ingroup Veelite
+  *
+  * Each call returns the next header in use at or after index, so a whole
+  * block (stock and user files) is listed in one pass over its header table,
+  * with no search by ID.  There is no authentication: it is for root and for
+  * header reads, which are not protected (see the File ALP).
+  */
+ot_int  vl_nextheader(vaddr* header, vlBLOCK block_id, ot_int index);
+
+
+
+/** @typedef vl_direct
+  * A read-only view of a file, made by vl_get_direct().  It uses no file
+  * pointer, and it needs no closing.
+  *
+  * const ot_u8* data:  physical pointer to the file data
+  * ot_uint length:     length of the file data in bytes
+  * ot_u16  stamp:      value of the veelite map stamp when the view was made
+  */
+typedef struct {
+    const ot_u8*    data;
+    ot_uint         length;
+    ot_u16          stamp;
+} vl_direct;
+
+
+/** @brief  Makes a read-only view of a file that reads the data in place
+  * @param  view        (vl_direct*) Output view datastruct
+  * @param  block_id    (vlBLOCK) Block ID of file to view
+  * @param  data_id     (ot_u8) 0-255 file ID of file to view
+  * @param  user_id     (id_tmpl*) User ID that is trying to read the file
+  * @retval ot_u8       Return code: 0 on success, non-zero on error
+  * @ingroup Veelite
+  * @sa vl_direct_valid()
+  *
+  * This is for files that are read often and written rarely, like channel
+  * configuration and scan sequences.  Instead of vl_open(), vl_read() and 
+  * vl_close(), the data is read straight out of memory with no copying.  
+  * Mirrored files are read from the mirror.  Others can only be read in place 
+  * if VWORM has them contiguously (see vworm_get_direct()), so the caller must
+  * be ready to use vl_open() when this function returns 2.
+  *
+  * The view stays good until vl_direct_valid() returns False, which happens
+  * after any file header changes, a file moves, or VWORM moves data around.
+  * Writes to the file that do not change its length do not invalidate the 
+  * view: the new data is visible through it.
+  *
+  * The return value is a numerical code.
+  * <LI>   0: Success                                           </LI>
+  * <LI>   1: File could not be found                           </LI>
+  * <LI>   2: File cannot be read in place at the moment        </LI>
+  * <LI>   4: User does not have sufficient access to this file </LI>
+  * <LI> 255: Miscellaneous Error                               </LI>
+  */
+ot_u8   vl_get_direct(vl_direct* view, vlBLOCK block_id, ot_u8 data_id, id_tmpl* user_id);
+
+
+/** @brief  Returns True if a view from vl_get_direct() is still good
+  * @param  view        (vl_direct*) view to check
+  * @retval ot_bool     True if the data pointer and length are still good
+  * @ingroup Veelite
+  */
+ot_bool vl_direct_valid(vl_direct* view);
+
+
 /** @brief  Opens a file from the virtual address of its header
   * @param  header      (vaddr) virtual address of the file header to open
   * @retval vlFILE*     File Pointer (NULL on error)
@@ -370,6 +574,11 @@ vlFILE* vl_open_file(vaddr header);
   * methods for opening are for special cases (they exist to make the filedata
   * ALP run faster and smaller).
   *
+  * A file that is already open is not opened again: the open returns the same
+  * File Pointer, which counts its opens, and each open needs its own
+  * vl_close().  The opens share the length, so a write through one is seen
+  * through the others.
+  *
   * There are several, specialized alias functions for vl_open().  These should
   * only be used internally (not in protocol routines).  The function aliases 
   * that contain "_su" at the end are super-user (root) calls.
@@ -428,6 +637,51 @@ ot_u8 ISF_chmod_su( ot_u8 id, ot_u8 mod );
 ot_u16 vl_read( vlFILE* fp, ot_uint offset );
 
 
+/** @brief  Counts writes to ISF 0 and ISF 1, which hold the device IDs
+  * @ingroup Veelite
+  *
+  * vl_write() and vl_store() increment it when the file is ISF 0 or 1.  Any
+  * module that keeps a RAM copy of data from these files can save the value
+  * when it loads the copy, and reload when the value has changed.
+  */
+extern ot_u16 vl_idstamp;
+
+
+/** @brief  Counts writes to the root and user authentication key ISFs
+  * @ingroup Veelite
+  *
+  * Like vl_idstamp, but for the key files.  The auth module keeps its RAM key
+  * table while (vl_keystamp + vl_mapstamp) is unchanged.
+  */
+extern ot_u16 vl_keystamp;
+
+
+/** @brief  Stamps that change when files change
+  * @ingroup Veelite
+  *
+  * vl_writestamp counts writes to file data (vl_write() and vl_store()).
+  * vl_mapstamp changes when a file header changes (length, permissions),
+  * when a file is created, deleted or moved, and when the ISF mirror is
+  * loaded.  If neither has changed, no file has changed.
+  */
+extern ot_u16 vl_writestamp;
+extern ot_u16 vl_mapstamp;
+
+
+
+/** @brief  Which of ISF 0 to 15 have been written
+  * @ingroup Veelite
+  *
+  * vl_write() and vl_store() set bit n when the file is ISF n, and a restore
+  * sets all bits.  Unlike the stamps, it says which file changed, so a module
+  * that keeps settings from several ISFs can reload only the ones that were
+  * written.  The consumer clears the bits it has handled: in OpenTag this is
+  * the kernel, in sys_reconfigure().
+  */
+extern ot_u16 vl_isfchange;
+
+
+
 /** @brief  Writes 16 bits at a time to the open file (GFB, ISF, ISFS)
   * @param  fp          (vlFILE*) file pointer of open file
   * @param  offset      (ot_uint) byte offset into the file
@@ -457,6 +711,21 @@ ot_uint vl_load( vlFILE* fp, ot_uint length, ot_u8* data );
 
 
 
+/** @brief  Reads a span of an open file into a byte-buffer, in one block copy
+  * @param  fp          (vlFILE*) file pointer of open file
+  * @param  offset      (ot_uint) file data offset to start from (even)
+  * @param  length      (ot_uint) number of bytes to read
+  * @param  data        (ot_u8*) byte buffer to read into
+  * @retval (ot_u8)     Non-zero if the span is outside of the file allocation
+  * @ingroup Veelite
+  *
+  * This is the bulk version of vl_read(), and the bytes are in the same
+  * (memory) order.  Unlike vl_load(), it does not stop at the file length.
+  */
+ot_u8 vl_read_block( vlFILE* fp, ot_uint offset, ot_uint length, ot_u8* data );
+
+
+
 /** @brief  Stores supplied byte-buffer into a file, replacing existing contents
   * @param  fp          (vlFILE*) file pointer of open file
   * @param  length      (ot_uint) number of bytes to store, starting from beginning of file
@@ -490,6 +759,9 @@ ot_u8 vl_erase(vlFILE* fp);
   * @param none
   * @retval (ot_u8) : Non-zero on failure
   * @ingroup Veelite
+  *
+  * If the File Pointer is shared by other opens of the file, this only drops
+  * the count, and the file stays open for them.
   */
 ot_u8 vl_close( vlFILE* fp );
 
@@ -527,6 +799,46 @@ ot_uint vl_checkalloc( vlFILE* fp );
 
 
 
+/** @brief Checks the data of a stock ISF against its reference CRC16
+  * @param id : (ot_u8) stock ISF ID
+  * @retval ot_u8 : 0 if the data matches, non-zero if it does not
+  * @ingroup Veelite
+  *
+  * Only does anything with OT_FEATURE(VLCRC) enabled, otherwise it returns 0.
+  * The result is cached until the file is written again, so calling it each
+  * time a config file is loaded costs a CRC only once per boot or write.  A
+  * file with no reference yet (after boot) takes one from its current data.
+  * IDs outside the stock ISFs return 255.
+  */
+ot_u8 ISF_verify( ot_u8 id );
+
+
+/** @brief Returns the summary of the data of a stock ISF
+  * @param id : (ot_u8) stock ISF ID
+  * @retval const vl_summary* : summary, or NULL if there is none
+  * @ingroup Veelite
+  *
+  * Only does anything with OT_FEATURE(VLSUMMARY) enabled, otherwise it returns
+  * NULL, as it does for IDs outside the stock ISFs.  vl_store() makes a new 
+  * summary from the stored buffer, and vl_write() adds the written bytes.  
+  * After boot or a restore, the first call reads the file to make one.  No
+  * access check is done, so only use it to reject what reading would reject.
+  */
+const vl_summary* ISF_summary( ot_u8 id );
+
+
+/** @brief Verifies one stock ISF that has not been verified since its last write
+  * @param none
+  * @retval ot_u8 : 0 if a file was verified, 1 if it failed, 2 if none left
+  * @ingroup Veelite
+  *
+  * With OT_FEATURE(VLCRC) enabled, the kernel calls this from the idle task
+  * until it returns 2, so the reference CRCs are taken soon after boot and
+  * every stored file is read back once.  Without it, it just returns 2.
+  */
+ot_u8 vl_verify( );
+
+
 /** @brief Syncs main ISF file data with the data in the mirror
   * @param none
   * @retval ot_u8 : Non-zero on failure
@@ -535,6 +847,11 @@ ot_uint vl_checkalloc( vlFILE* fp );
   * Only works on ISF files that are mirrored.  In certain implementations,
   * this function may do nothing at all.  It should really only be used by the
   * root user.
+  *
+  * Only the mirror words written since the last load or sync are written to
+  * VWORM, and only if they differ, so a sync with nothing changed does no
+  * flash writes.  With OT_FEATURE(VLLAZYSYNC) the kernel calls this when it
+  * goes to Sleep or Off.
   */
 ot_u8 ISF_syncmirror( );
 
@@ -112,6 +112,25 @@ typedef ot_u16 vaddr;
 //#   define VSRAM_BASE_PHYSICAL      OTF_VSRAM_START_ADDR
 //#   define VSRAM_PHYSICAL_ADDR(VAL) (VSRAM_BASE_PHYSICAL + (VAL) - VSRAM_BASE_VADDR)
 
+/// Number of VWORM pages held in the SRAM write-back cache (0 = no cache).
+/// Each cached page costs VWORM_PAGESIZE bytes of SRAM.  Only the X2 cores
+/// implement the cache.
+#   ifndef VWORM_CACHE_PAGES
+#   define VWORM_CACHE_PAGES        0
+#   endif
+
+/// Writes that would erase flash are held back while the erase window is
+/// closed (see vworm_window()).  VWORM_DEFER_WRITES is the depth of the list
+/// of held-back writes (0 = erase whenever needed).  The kernel opens the
+/// window when the next event is at least VWORM_ERASE_TICKS away, which must
+/// cover a page erase plus a page of writes.  Only the X2 cores defer writes.
+#   ifndef VWORM_DEFER_WRITES
+#   define VWORM_DEFER_WRITES       8
+#   endif
+#   ifndef VWORM_ERASE_TICKS
+#   define VWORM_ERASE_TICKS        64
+#   endif
+
 
 
 /** memory_faults
@@ -127,6 +146,40 @@ extern ot_u8 memory_faults;
 
 
 
+/** vworm_stats
+  * Flash activity counters, kept by the VWORM implementation.  Compare them
+  * across the same workload with and without VWORM_CACHE_PAGES to see how
+  * many erases the cache avoids.
+  *
+  * erases:     pages erased by wear leveling (recombination or rewrite)
+  * cached:     writes absorbed by the page cache
+  * flushes:    cached pages written back to flash
+  * rewrites:   flushes that had to rewrite the page into a fallow block
+  * deferred:   writes held back until the next erase window
+  * recombines: blocks recombined into a fallow to free their ancillary
+  */
+typedef struct {
+    ot_u32  erases;
+    ot_u32  cached;
+    ot_u32  flushes;
+    ot_u32  rewrites;
+    ot_u32  deferred;
+    ot_u32  recombines;
+} vworm_stats_struct;
+
+extern vworm_stats_struct vworm_stats;
+
+
+/** vworm_mapstamp
+  * Incremented whenever the VWORM implementation moves data in a way that can
+  * make a pointer from vworm_get_direct() stale: a block gets an ancillary, a
+  * block is recombined or rewritten, a page goes into the cache, or a write
+  * is deferred.
+  */
+extern ot_u16 vworm_mapstamp;
+
+
+
 /** @brief Checks which address space the supplied virtual address is in.
   * @param v_addr : (ot_uint) Virtual Address
   * @retval vas_loc : position of the address
@@ -173,6 +226,82 @@ ot_u8 vworm_save( );
 
 
 
+/** Boot Snapshot (OT_FEATURE(VLSNAPSHOT))
+  * At a clean shutdown, vworm_save_snapshot() saves the VWORM block table
+  * together with a list of RAM spans from the layers above (the veelite
+  * indexes), a generation number, and a CRC16 over all of it.  At the next
+  * boot, vworm_init() restores the block table only if the CRC is good, and
+  * vworm_load_snapshot() gives the spans back, so vl_fastinit() does not
+  * have to rebuild them from the headers.  A snapshot can be loaded once,
+  * and any VWORM write after the save voids it.  Only the X2 cores keep the
+  * block table in the snapshot.
+  */
+typedef struct {
+    void*   data;
+    ot_uint length;         // bytes
+} vworm_span;
+
+
+/** @brief Saves the state of the vworm system, with a snapshot of RAM spans
+  * @param span         (const vworm_span*) list of RAM spans to save
+  * @param spans        (ot_int) number of spans in the list
+  * @retval ot_u8       Non-zero on memory fault
+  * @ingroup Veelite
+  *
+  * Like vworm_save(), which is the same as calling this with no spans.  If
+  * the spans do not fit in the snapshot, only the block table is saved.
+  */
+ot_u8 vworm_save_snapshot(const vworm_span* span, ot_int spans);
+
+
+/** @brief Restores RAM spans from the snapshot of the last clean shutdown
+  * @param span         (const vworm_span*) list of RAM spans to restore
+  * @param spans        (ot_int) number of spans in the list
+  * @retval ot_u8       0 if the spans were restored, non-zero otherwise
+  * @ingroup Veelite
+  *
+  * Must be called after vworm_init() and before anything writes to VWORM.
+  * The spans must be the same as the ones that were saved, or nothing is
+  * restored.  Either way, the snapshot is discarded, so a call with no spans
+  * just discards it.
+  */
+ot_u8 vworm_load_snapshot(const vworm_span* span, ot_int spans);
+
+
+
+/** @brief Writes all cached VWORM pages back to flash
+  * @param none
+  * @retval ot_u8       Non-zero on memory fault
+  * @ingroup Veelite
+  *
+  * Applies writes deferred by a closed erase window, then writes back cached
+  * pages (VWORM_CACHE_PAGES > 0).  vworm_save() and vworm_window() call it.
+  * Erases are allowed while it runs, whatever the window.  Each page is written
+  * in place if no fallow block is needed.  Otherwise the page is rewritten
+  * into a fallow block, which costs at most two erases per page, however
+  * many writes went into it.
+  */
+ot_u8 vworm_flush( );
+
+
+
+/** @brief Opens or closes the VWORM erase window
+  * @param open         (ot_bool) True to allow erases, False to defer them
+  * @retval ot_u8       Non-zero on memory fault
+  * @ingroup Veelite
+  *
+  * A flash erase stalls the CPU for milliseconds, so it must not happen while
+  * the radio is active.  The kernel opens the window only in idle periods of
+  * at least VWORM_ERASE_TICKS, and closes it before the next event.  While the
+  * window is closed, a write that would erase is deferred (up to
+  * VWORM_DEFER_WRITES of them; once full, the write erases anyway).  Opening
+  * the window applies the deferred writes and, if the last fallow block is in
+  * use, recombines one block so the next write does not need an erase.
+  */
+ot_u8 vworm_window(ot_bool open);
+
+
+
 /** @brief Reads 16 bits of data at the virtual address
   * @param addr : (vaddr) Variable virtual address
   * @retval ot_u16 : returned read data
@@ -234,6 +363,96 @@ ot_u8* vworm_get(vaddr addr);
 
 
 
+/** @brief Returns a physical pointer to a span of VWORM, if it can be read in place
+  * @param addr : (vaddr) Virtual address of the first byte
+  * @param length : (ot_uint) number of bytes in the span
+  * @retval const ot_u8* : physical pointer to the span, or NULL
+  * @ingroup Veelite
+  *
+  * The span is readable in place when the physical memory holds the current
+  * data contiguously.  On X2 implementations, that means each page in the span
+  * has no ancillary block, is not cached and has no deferred writes, and the
+  * pages are physically adjacent.  Otherwise NULL is returned, and the data
+  * must be read with vworm_read() or vworm_read_block().  The pointer stays
+  * valid as long as vworm_mapstamp does not change.
+  */
+const ot_u8* vworm_get_direct(vaddr addr, ot_uint length);
+
+
+
+/** @brief Reads a contiguous span of bytes from VWORM into a buffer
+  * @param addr : (vaddr) Virtual address of the first byte (must be even)
+  * @param data : (ot_u8*) output buffer, length bytes
+  * @param length : (ot_uint) number of bytes to read
+  * @retval ot_u8 : Non-zero on memory fault
+  * @ingroup Veelite
+  *
+  * This is the bulk version of vworm_read().  Pages that have no ancillary
+  * block are copied straight out with platform_memcpy(), and pages that do
+  * are XNOR'ed a word at a time.
+  */
+ot_u8 vworm_read_block(vaddr addr, ot_u8* data, ot_uint length);
+
+
+
+/** @brief Writes a contiguous span of bytes from a buffer into VWORM
+  * @param addr : (vaddr) Virtual address of the first byte (must be even)
+  * @param data : (ot_u8*) input buffer, length bytes
+  * @param length : (ot_uint) number of bytes to write
+  * @retval ot_u8 : Non-zero on memory fault
+  * @ingroup Veelite
+  *
+  * This is the bulk version of vworm_write().  Words that already hold the
+  * value being written are skipped, which saves flash cycles and, on X2
+  * implementations, block recombinations.  If length is odd, the unused byte
+  * of the last word keeps its present value.
+  */
+ot_u8 vworm_write_block(vaddr addr, ot_u8* data, ot_uint length);
+
+
+
+
+/** @brief Copies a span of VWORM back from the stock filesystem image
+  * @param addr : (vaddr) Virtual address of the first byte (must be even)
+  * @param length : (ot_uint) number of bytes to restore
+  * @retval ot_u8 : Non-zero if there is no stock image, or on memory fault
+  * @ingroup Veelite
+  *
+  * The stock image is the const arrays of the stock files (overhead_files[],
+  * isfs_stock_codes[], gfb_stock_files[], isf_stock_files[]), and the part of
+  * each block past its stock bytes is erased, as in a fresh image.  It is used
+  * by vl_restore() and vl_restore_all().  Only implementations that keep the
+  * stock image apart from VWORM can restore.  On the MCU implementations the
+  * stock files are linked into VWORM itself, so it returns non-zero.
+  */
+ot_u8 vworm_restore(vaddr addr, ot_uint length);
+
+
+/** Factory Image (OT_FEATURE(VLFACTORY))
+  * The build links a precomputed image of the formatted file system pages,
+  * made by Supplements/vl_imagegen.c from the stock files of the app.  It is
+  * kept in its own section, apart from VWORM.
+  */
+extern const ot_u16     vworm_factory_image[];
+extern const ot_uint    vworm_factory_words;
+extern const ot_u16     vworm_factory_crc;
+
+
+/** @brief Formats VWORM and programs the factory image into it
+  * @param none
+  * @retval ot_u8 :       non-zero on memory fault, or if the CRC is not good
+  * @ingroup Veelite
+  *
+  * For the production line: the pages are erased, the image is programmed
+  * in one burst per page, and a CRC16 of the pages is checked against the
+  * image.  The block table is the one of a fresh format.  Nothing goes
+  * through the veelite file paths, so it must run before vl_init().  With
+  * the image linked in, vworm_restore() takes the stock data from it, too.
+  */
+ot_u8 vworm_factory( );
+
+
+
 /** @brief Debugging function that prints out the state of the block table
   * @param none
   * @retval none
@@ -256,6 +475,19 @@ ot_u8 vworm_wipeblock(vaddr addr, ot_uint wipe_span);
 
 
 
+/** @brief Returns the erase count of a physical VWORM page
+  * @param page : (ot_int) physical page, 0 to VWORM_NUM_PAGES-1
+  * @retval ot_u16 : erases of the page (stops at 0xFFFF), 0 if not counted
+  * @ingroup Veelite
+  *
+  * The X2 cores count the erases of each page and save them with the block
+  * table, and they always take the least worn fallow block next.  Cores with
+  * no page erases (or no wear leveling) return 0.
+  */
+ot_u16 vworm_wear(ot_int page);
+
+
+
 
 
 
@@ -296,6 +528,26 @@ ot_u8 vsram_mark_physical(ot_u16* addr, ot_u16 value);
   * @ingroup Veelite
   */
 ot_u8* vsram_get(vaddr addr);
+
+
+/** @brief Reads a contiguous span of bytes from VSRAM into a buffer
+  * @param addr : (vaddr) Virtual address of the first byte
+  * @param data : (ot_u8*) output buffer, length bytes
+  * @param length : (ot_uint) number of bytes to read
+  * @retval ot_u8 : Non-zero on memory fault
+  * @ingroup Veelite
+  */
+ot_u8 vsram_read_block(vaddr addr, ot_u8* data, ot_uint length);
+
+
+/** @brief Writes a contiguous span of bytes from a buffer into VSRAM
+  * @param addr : (vaddr) Virtual address of the first byte
+  * @param data : (ot_u8*) input buffer, length bytes
+  * @param length : (ot_uint) number of bytes to write
+  * @retval ot_u8 : Non-zero on memory fault
+  * @ingroup Veelite
+  */
+ot_u8 vsram_write_block(vaddr addr, ot_u8* data, ot_uint length);
     
 
 
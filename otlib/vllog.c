@@ -0,0 +1,364 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/vllog.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      Append-only log files on Veelite
+  * @ingroup    Veelite
+  *
+  ******************************************************************************
+  */
+
+#include "vllog.h"
+
+#if (VLLOG_SUPPORT)
+
+#include "OT_platform.h"
+
+
+#define VLLOG_HEADBYTES     4
+#define VLLOG_SLOT(LOG)     (2 + (((LOG)->rec_bytes + 1) & ~1))
+
+vllog_struct    vllog[OT_PARAM(VLLOGS)];
+ot_u8           vllog_num = 0;
+
+
+
+
+/** Segment Access
+  * ============================================================================
+  * A segment is in use when the upper word of its base is programmed.  The
+  * lower word goes in first, so a base that was cut off reads as free.
+  */
+ot_u32 sub_seg_base(vlFILE* fp, vllog_struct* log, ot_int seg) {
+    ot_uint offset  = (ot_uint)seg * log->seg_bytes;
+    ot_u16  upper   = vl_read(fp, offset);
+
+    if (upper == 0xFFFF) {
+        return VLLOG_FREE;
+    }
+    return ((ot_u32)upper << 16) | vl_read(fp, offset+2);
+}
+
+
+ot_uint sub_slot_offset(vllog_struct* log, ot_int seg, ot_uint slot) {
+    return ((ot_uint)seg * log->seg_bytes) + VLLOG_HEADBYTES + (slot * VLLOG_SLOT(log));
+}
+
+
+void sub_seg_wipe(vlFILE* fp, vllog_struct* log, ot_int seg) {
+/// The header goes first, so the segment is free if the wipe is cut off.
+/// Only programmed words are written, which spares VWORM most of the work.
+    ot_uint offset  = (ot_uint)seg * log->seg_bytes;
+    ot_uint end     = offset + log->seg_bytes;
+
+    for (; offset<end; offset+=2) {
+        if (vl_read(fp, offset) != 0xFFFF) {
+            vl_write(fp, offset, 0xFFFF);
+        }
+    }
+    log->base[seg] = VLLOG_FREE;
+}
+
+
+void sub_seg_open(vlFILE* fp, vllog_struct* log, ot_int seg) {
+    ot_uint offset = (ot_uint)seg * log->seg_bytes;
+
+    sub_seg_wipe(fp, log, seg);
+    vl_write(fp, offset+2, (ot_u16)log->next);
+    vl_write(fp, offset, (ot_u16)(log->next >> 16));
+    log->base[seg]  = log->next;
+    log->head       = (ot_u8)seg;
+}
+
+
+ot_int sub_seg_find(vllog_struct* log, ot_u32 seq) {
+    ot_int seg;
+
+    for (seg=0; seg<OT_PARAM(VLLOG_SEGS); seg++) {
+        if ((log->base[seg] != VLLOG_FREE) && (seq >= log->base[seg]) && \
+            ((seq - log->base[seg]) < log->per_seg)) {
+            return seg;
+        }
+    }
+    return -1;
+}
+
+
+void sub_rebuild(vlFILE* fp, vllog_struct* log) {
+/// The head is the segment with the highest base.  Its slots are in use up to
+/// the first one with a free mark, and a free mark over data that is not
+/// erased is a record that was cut off, so it is voided.
+    ot_u32  top = 0;
+    ot_uint slot;
+    ot_int  seg;
+
+    log->head = VLLOG_NONE;
+    for (seg=0; seg<OT_PARAM(VLLOG_SEGS); seg++) {
+        log->base[seg] = sub_seg_base(fp, log, seg);
+        if ((log->base[seg] != VLLOG_FREE) && \
+            ((log->head == VLLOG_NONE) || (log->base[seg] > top))) {
+            top         = log->base[seg];
+            log->head   = (ot_u8)seg;
+        }
+    }
+    if (log->head == VLLOG_NONE) {
+        log->next = 0;
+        return;
+    }
+
+    for (slot=0; slot<log->per_seg; slot++) {
+        ot_uint offset  = sub_slot_offset(log, log->head, slot);
+        ot_uint end     = offset + VLLOG_SLOT(log);
+        ot_uint i;
+
+        if (vl_read(fp, offset) != 0xFFFF) {
+            continue;
+        }
+        for (i=offset+2; i<end; i+=2) {
+            if (vl_read(fp, i) != 0xFFFF) {
+                vl_write(fp, offset, VLLOG_VOID);
+                break;
+            }
+        }
+        if (i == end) {
+            break;
+        }
+    }
+    log->next = top + slot;
+}
+
+
+
+
+/** Public Functions
+  * ============================================================================
+  */
+#ifndef EXTF_vllog_find
+ot_int vllog_find(vlBLOCK block_id, ot_u8 data_id) {
+    ot_int i;
+
+    for (i=0; i<vllog_num; i++) {
+        if ((vllog[i].block == (ot_u8)block_id) && (vllog[i].id == data_id)) {
+            return i;
+        }
+    }
+    return -1;
+}
+#endif
+
+
+#ifndef EXTF_vllog_get
+vllog_struct* vllog_get(ot_int log) {
+    if ((log < 0) || (log >= vllog_num)) {
+        return NULL;
+    }
+    return &vllog[log];
+}
+#endif
+
+
+#ifndef EXTF_vllog_open
+ot_int vllog_open(vlBLOCK block_id, ot_u8 data_id, ot_u8 rec_bytes) {
+    vllog_struct*   log;
+    vlFILE*         fp;
+    ot_int          i;
+
+    i = vllog_find(block_id, data_id);
+    if (i >= 0) {
+        return i;
+    }
+    if ((vllog_num >= OT_PARAM(VLLOGS)) || (rec_bytes == 0)) {
+        return -1;
+    }
+    fp = vl_open(block_id, data_id, VL_ACCESS_SU, NULL);
+    if (fp == NULL) {
+        return -1;
+    }
+
+    log             = &vllog[vllog_num];
+    log->block      = (ot_u8)block_id;
+    log->id         = data_id;
+    log->rec_bytes  = rec_bytes;
+    log->seg_bytes  = (fp->alloc / OT_PARAM(VLLOG_SEGS)) & ~1;
+    log->per_seg    = (log->seg_bytes > VLLOG_HEADBYTES) ? \
+                        ((log->seg_bytes - VLLOG_HEADBYTES) / VLLOG_SLOT(log)) : 0;
+
+    if (log->per_seg == 0) {
+        vl_close(fp);
+        return -1;
+    }
+
+    /// A file that is not a log yet holds whatever it had, so the first
+    /// open wipes it.  It takes its whole alloc as its length from then on.
+    if (fp->length != fp->alloc) {
+        log->next = 0;
+        for (i=0; i<OT_PARAM(VLLOG_SEGS); i++) {
+            sub_seg_wipe(fp, log, i);
+        }
+        log->head   = VLLOG_NONE;
+        fp->length  = fp->alloc;
+    }
+    else {
+        sub_rebuild(fp, log);
+    }
+    vl_close(fp);
+
+    return (ot_int)vllog_num++;
+}
+#endif
+
+
+#ifndef EXTF_vllog_append
+ot_u8 vllog_append(ot_int log_id, ot_u8* data) {
+    vllog_struct*   log = vllog_get(log_id);
+    vlFILE*         fp;
+    ot_uint         offset;
+    ot_int          i;
+
+    if (log == NULL) {
+        return 255;
+    }
+    fp = vl_open((vlBLOCK)log->block, log->id, VL_ACCESS_SU, NULL);
+    if (fp == NULL) {
+        return 255;
+    }
+
+    /// A full head moves to the next segment, which drops the oldest records
+    if ((log->head == VLLOG_NONE) || ((log->next - log->base[log->head]) >= log->per_seg)) {
+        i = (log->head == VLLOG_NONE) ? 0 : ((log->head + 1) % OT_PARAM(VLLOG_SEGS));
+        sub_seg_open(fp, log, i);
+    }
+
+    offset = sub_slot_offset(log, log->head, (ot_uint)(log->next - log->base[log->head]));
+    for (i=0; i<log->rec_bytes; i+=2) {
+        ot_u16 word = (ot_u16)data[i] << 8;
+        word       |= ((i+1) < log->rec_bytes) ? data[i+1] : 0xFF;
+        vl_write(fp, offset+2+i, word);
+    }
+    vl_write(fp, offset, VLLOG_VALID);
+    log->next++;
+
+    return vl_close(fp);
+}
+#endif
+
+
+#ifndef EXTF_vllog_clear
+ot_u8 vllog_clear(ot_int log_id) {
+    vllog_struct*   log = vllog_get(log_id);
+    vlFILE*         fp;
+    ot_int          seg;
+
+    if (log == NULL) {
+        return 255;
+    }
+    fp = vl_open((vlBLOCK)log->block, log->id, VL_ACCESS_SU, NULL);
+    if (fp == NULL) {
+        return 255;
+    }
+
+    /// The head is wiped last and opened again, so the sequence numbers go on
+    /// if the device resets in the middle
+    for (seg=0; seg<OT_PARAM(VLLOG_SEGS); seg++) {
+        if ((log->head != VLLOG_NONE) && (seg != log->head)) {
+            sub_seg_wipe(fp, log, seg);
+        }
+    }
+    if (log->head != VLLOG_NONE) {
+        sub_seg_open(fp, log, log->head);
+    }
+
+    return vl_close(fp);
+}
+#endif
+
+
+#ifndef EXTF_vllog_first
+ot_u32 vllog_first(ot_int log_id) {
+    vllog_struct*   log = vllog_get(log_id);
+    ot_u32          first;
+    ot_int          seg;
+
+    if (log == NULL) {
+        return 0;
+    }
+    first = log->next;
+    for (seg=0; seg<OT_PARAM(VLLOG_SEGS); seg++) {
+        if ((log->base[seg] != VLLOG_FREE) && (log->base[seg] < first)) {
+            first = log->base[seg];
+        }
+    }
+    return first;
+}
+#endif
+
+
+#ifndef EXTF_vllog_read
+ot_int vllog_read(ot_int log_id, ot_u32* seq, ot_uint count, Queue* q, id_tmpl* user_id) {
+    vllog_struct*   log = vllog_get(log_id);
+    vlFILE*         fp;
+    ot_u32          first;
+    ot_uint         fit;
+    ot_uint         i;
+
+    if (log == NULL) {
+        return -1;
+    }
+    fp = vl_open((vlBLOCK)log->block, log->id, VL_ACCESS_R, user_id);
+    if (fp == NULL) {
+        return -1;
+    }
+
+    first = vllog_first(log_id);
+    if ((*seq < first) || (*seq > log->next)) {
+        *seq = first;
+    }
+    fit = (ot_uint)(q->back - q->putcursor) / log->rec_bytes;
+    if (count > (log->next - *seq))     count = (ot_uint)(log->next - *seq);
+    if (count > fit)                    count = fit;
+
+    for (i=0; i<count; i++) {
+        ot_int  seg     = sub_seg_find(log, *seq + i);
+        ot_uint offset  = 0;
+        ot_bool valid   = False;
+        ot_int  j;
+
+        if (seg >= 0) {
+            offset  = sub_slot_offset(log, seg, (ot_uint)(*seq + i - log->base[seg]));
+            valid   = (ot_bool)(vl_read(fp, offset) == VLLOG_VALID);
+        }
+
+        for (j=0; j<log->rec_bytes; j+=2) {
+            ot_u16 word = valid ? vl_read(fp, offset+2+j) : 0xFFFF;
+            if ((j+1) < log->rec_bytes) {
+                q_writeshort(q, word);
+            }
+            else {
+                q_writebyte(q, (ot_u8)(word >> 8));
+            }
+        }
+    }
+
+    vl_close(fp);
+    return (ot_int)count;
+}
+#endif
+
+
+#endif
@@ -0,0 +1,176 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/vllog.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      Append-only log files on Veelite
+  * @defgroup   Veelite
+  *
+  * A log file is a veelite file that is only ever appended to.  Records are
+  * programmed into erased space in order, so each write only takes bits from
+  * 1 to 0, which VWORM can always do in place: no fallow is attached and no
+  * block is recombined for a record.  The file is a ring of OT_PARAM(VLLOG_SEGS)
+  * segments.  When the last one is full, the oldest segment is wiped all at
+  * once and written again, so the erases come once per segment, not once per
+  * record.
+  *
+  * Records are fixed-size and numbered by a 32 bit sequence number that does
+  * not restart.  The file has no index: vllog_open() rebuilds one in RAM from
+  * the segment headers when it attaches a log after a boot.
+  *
+  * Segment:    [base seq: 4] [record 0] [record 1] ... (FFFFFFFF: free)
+  * Record:     [mark: 2] [data: rec_bytes, padded to even]
+  *             mark is FFFF for a free slot, VLLOG_VALID once the data is in,
+  *             and VLLOG_VOID for a slot that was cut off by a reset.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __VLLOG_H
+#define __VLLOG_H
+
+#include "OT_types.h"
+#include "OT_config.h"
+#include "veelite.h"
+#include "queue.h"
+
+
+#ifndef OT_FEATURE_VLLOG
+#   define OT_FEATURE_VLLOG     DISABLED
+#endif
+
+/// Log files that can be attached at once
+#ifndef OT_PARAM_VLLOGS
+#   define OT_PARAM_VLLOGS      1
+#endif
+
+/// Segments in a log file (the oldest one is reclaimed as a whole)
+#ifndef OT_PARAM_VLLOG_SEGS
+#   define OT_PARAM_VLLOG_SEGS  4
+#endif
+
+#define VLLOG_SUPPORT   ((OT_FEATURE(VLLOG) == ENABLED) && (OT_FEATURE(VEELITE) == ENABLED))
+
+#define VLLOG_VALID     0x0F0F
+#define VLLOG_VOID      0x0000
+#define VLLOG_FREE      0xFFFFFFFF
+#define VLLOG_NONE      0xFF
+
+
+/** vllog_struct
+  * block, id:  the file
+  * rec_bytes:  data bytes per record
+  * head:       segment that is appended to, or VLLOG_NONE
+  * seg_bytes:  bytes per segment
+  * per_seg:    records per segment
+  * next:       sequence number of the next record
+  * base[]:     sequence number of the first record of each segment, or
+  *             VLLOG_FREE.  Only the head segment is ever part full.
+  */
+typedef struct {
+    ot_u8   block;
+    ot_u8   id;
+    ot_u8   rec_bytes;
+    ot_u8   head;
+    ot_u16  seg_bytes;
+    ot_u16  per_seg;
+    ot_u32  next;
+    ot_u32  base[OT_PARAM(VLLOG_SEGS)];
+} vllog_struct;
+
+
+
+/** @brief  Attaches a file as a log, and rebuilds its index from the file
+  * @param  block_id    (vlBLOCK) block of the file
+  * @param  data_id     (ot_u8) file ID
+  * @param  rec_bytes   (ot_u8) data bytes per record
+  * @retval ot_int      log number, or -1 if it cannot be attached
+  * @ingroup Veelite
+  *
+  * The file must already exist, and its alloc sets how many records it holds.
+  * A file that is already attached gives back the same log number.  Slots
+  * that were cut off by a reset are voided, and they keep their sequence
+  * numbers.  The file length is set to its alloc once, so writing records
+  * never updates the file header.
+  */
+ot_int vllog_open(vlBLOCK block_id, ot_u8 data_id, ot_u8 rec_bytes);
+
+
+/** @brief  Returns the log number of an attached file
+  * @param  block_id    (vlBLOCK) block of the file
+  * @param  data_id     (ot_u8) file ID
+  * @retval ot_int      log number, or -1 if the file is not attached
+  * @ingroup Veelite
+  */
+ot_int vllog_find(vlBLOCK block_id, ot_u8 data_id);
+
+
+/** @brief  Appends a record to a log
+  * @param  log         (ot_int) log number
+  * @param  data        (ot_u8*) rec_bytes of record data
+  * @retval ot_u8       0 on success, non-zero on error
+  * @ingroup Veelite
+  *
+  * The data goes in first and the mark last, so a record is either all there
+  * or voided at the next vllog_open().
+  */
+ot_u8 vllog_append(ot_int log, ot_u8* data);
+
+
+/** @brief  Wipes all of the records of a log
+  * @param  log         (ot_int) log number
+  * @retval ot_u8       0 on success, non-zero on error
+  * @ingroup Veelite
+  *
+  * Sequence numbers go on from where they were.
+  */
+ot_u8 vllog_clear(ot_int log);
+
+
+/** @brief  Returns the sequence number of the oldest record in a log
+  * @param  log         (ot_int) log number
+  * @retval ot_u32      oldest record, or the next one if the log is empty
+  * @ingroup Veelite
+  */
+ot_u32 vllog_first(ot_int log);
+
+
+/** @brief  Returns the log data of an attached file
+  * @param  log         (ot_int) log number
+  * @retval vllog_struct*   the log, or NULL if the number is not attached
+  * @ingroup Veelite
+  */
+vllog_struct* vllog_get(ot_int log);
+
+
+/** @brief  Writes a range of records into a queue
+  * @param  log         (ot_int) log number
+  * @param  seq         (ot_u32*) first record, moved up to the oldest if that
+  *                     one is gone
+  * @param  count       (ot_uint) most records to write
+  * @param  q           (Queue*) queue to write, as many as fit
+  * @param  user_id     (id_tmpl*) user for the read permission of the file
+  * @retval ot_int      records written, or -1 on error
+  * @ingroup Veelite
+  *
+  * Void records are written as rec_bytes of 0xFF.
+  */
+ot_int vllog_read(ot_int log, ot_u32* seq, ot_uint count, Queue* q, id_tmpl* user_id);
+
+
+#endif
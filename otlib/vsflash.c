@@ -0,0 +1,295 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/vsflash.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      External serial flash address space for Veelite
+  * @ingroup    Veelite
+  *
+  ******************************************************************************
+  */
+
+#include "vsflash.h"
+
+#if (OT_FEATURE(VSFLASH) == ENABLED)
+
+
+#define VSFLASH_LINEMASK        ((vsaddr)OT_PARAM(VSFLASH_LINEBYTES) - 1)
+#define VSFLASH_SECTOR(ADDR)    ((ot_u16)((ADDR) / SFLASH_SECTOR_SIZE))
+
+vsflash_struct vsflash;
+
+
+
+
+/** Erase Queue
+  * ============================================================================
+  * sector[0] is the one the chip erases when erasing is set.  The chip can
+  * do nothing else while it erases, so every SPI access waits for it first.
+  */
+void sub_vsflash_pop(ot_int i) {
+    vsflash.pending--;
+    for (; i<vsflash.pending; i++) {
+        vsflash.sector[i] = vsflash.sector[i+1];
+    }
+}
+
+
+void sub_vsflash_wait(void) {
+    while (platform_sflash_busy());
+
+    if (vsflash.erasing) {
+        vsflash.erasing = False;
+        sub_vsflash_pop(0);
+    }
+}
+
+
+ot_int sub_vsflash_queued(ot_u16 sector) {
+    ot_int i;
+
+    for (i=0; i<vsflash.pending; i++) {
+        if (vsflash.sector[i] == sector) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+ot_u8 sub_vsflash_erase_now(ot_u16 sector) {
+/// Erases a sector and waits for it, and takes it out of the queue.  If the
+/// chip is erasing it already, that erase is waited for.
+    ot_bool erasing = (ot_bool)(vsflash.erasing && (vsflash.sector[0] == sector));
+    ot_int  i;
+
+    sub_vsflash_wait();
+    if (erasing) {
+        return 0;
+    }
+    i = sub_vsflash_queued(sector);
+    if (i >= 0) {
+        sub_vsflash_pop(i);
+    }
+    if (platform_sflash_erase((ot_u32)sector * SFLASH_SECTOR_SIZE) != 0) {
+        return 1;
+    }
+    while (platform_sflash_busy());
+    return 0;
+}
+
+
+void sub_vsflash_drop(ot_u16 sector) {
+/// Cache lines of a sector that is going to be erased are let go
+    ot_int i;
+
+    for (i=0; i<OT_PARAM(VSFLASH_LINES); i++) {
+        if ((vsflash.line[i].addr != VSFLASH_NOLINE) && \
+            (VSFLASH_SECTOR(vsflash.line[i].addr) == sector)) {
+            vsflash.line[i].addr = VSFLASH_NOLINE;
+        }
+    }
+}
+
+
+
+
+/** Line Cache
+  * ============================================================================
+  */
+vsflash_line* sub_vsflash_line(vsaddr base) {
+/// Returns the line with the base address, which is filled from the chip on a
+/// miss, into the line that was used least recently.
+    vsflash_line*   line;
+    ot_int          i;
+
+    line = &vsflash.line[0];
+    for (i=0; i<OT_PARAM(VSFLASH_LINES); i++) {
+        if (vsflash.line[i].addr == base) {
+            line = &vsflash.line[i];
+            goto sub_vsflash_line_HIT;
+        }
+        if ((vsflash.line[i].addr == VSFLASH_NOLINE) || \
+            ((ot_u16)(vsflash.use - vsflash.line[i].stamp) > (ot_u16)(vsflash.use - line->stamp))) {
+            line = &vsflash.line[i];
+        }
+    }
+
+    sub_vsflash_wait();
+    if (platform_sflash_read(base, line->data, OT_PARAM(VSFLASH_LINEBYTES)) != 0) {
+        line->addr = VSFLASH_NOLINE;
+        return NULL;
+    }
+    line->addr = base;
+
+    sub_vsflash_line_HIT:
+    line->stamp = ++vsflash.use;
+    return line;
+}
+
+
+
+
+/** Public Functions
+  * ============================================================================
+  */
+#ifndef EXTF_vsflash_init
+void vsflash_init(void) {
+    ot_int i;
+
+    vsflash.use     = 0;
+    vsflash.erasing = False;
+    vsflash.pending = 0;
+    for (i=0; i<OT_PARAM(VSFLASH_LINES); i++) {
+        vsflash.line[i].addr = VSFLASH_NOLINE;
+    }
+}
+#endif
+
+
+#ifndef EXTF_vsflash_read
+ot_u8 vsflash_read(vsaddr addr, ot_u8* data, ot_uint length) {
+    if ((addr > VSFLASH_SIZE) || (length > (VSFLASH_SIZE - addr))) {
+        return 1;
+    }
+
+    while (length != 0) {
+        vsaddr  base    = addr & ~VSFLASH_LINEMASK;
+        ot_uint offset  = (ot_uint)(addr - base);
+        ot_uint span    = OT_PARAM(VSFLASH_LINEBYTES) - offset;
+        span            = (span > length) ? length : span;
+
+        if (sub_vsflash_queued(VSFLASH_SECTOR(addr)) >= 0) {
+            platform_memset(data, 0xFF, span);
+        }
+        else {
+            vsflash_line* line = sub_vsflash_line(base);
+            if (line == NULL) {
+                return 2;
+            }
+            platform_memcpy(data, &line->data[offset], span);
+        }
+        addr   += span;
+        data   += span;
+        length -= span;
+    }
+    return 0;
+}
+#endif
+
+
+#ifndef EXTF_vsflash_write
+ot_u8 vsflash_write(vsaddr addr, ot_u8* data, ot_uint length) {
+    if ((addr > VSFLASH_SIZE) || (length > (VSFLASH_SIZE - addr))) {
+        return 1;
+    }
+
+    /// One burst per page: the chip wraps a program at the page boundary
+    while (length != 0) {
+        ot_uint span = SFLASH_PAGE_SIZE - (ot_uint)(addr % SFLASH_PAGE_SIZE);
+        ot_int  i;
+        span = (span > length) ? length : span;
+
+        if (sub_vsflash_queued(VSFLASH_SECTOR(addr)) >= 0) {
+            if (sub_vsflash_erase_now(VSFLASH_SECTOR(addr)) != 0) {
+                return 2;
+            }
+        }
+        sub_vsflash_wait();
+        if (platform_sflash_program(addr, data, span) != 0) {
+            return 2;
+        }
+
+        /// Lines that hold the span take the bits that went to 0
+        for (i=0; i<OT_PARAM(VSFLASH_LINES); i++) {
+            vsflash_line*   line = &vsflash.line[i];
+            vsaddr          j;
+            if ((line->addr == VSFLASH_NOLINE) || (line->addr >= (addr + span)) || \
+                ((line->addr + OT_PARAM(VSFLASH_LINEBYTES)) <= addr)) {
+                continue;
+            }
+            for (j=addr; j<(addr+span); j++) {
+                if ((j >= line->addr) && (j < (line->addr + OT_PARAM(VSFLASH_LINEBYTES)))) {
+                    line->data[j - line->addr] &= data[j - addr];
+                }
+            }
+        }
+
+        addr   += span;
+        data   += span;
+        length -= span;
+    }
+    return 0;
+}
+#endif
+
+
+#ifndef EXTF_vsflash_erase
+ot_u8 vsflash_erase(vsaddr addr) {
+    ot_u16 sector;
+
+    if (addr >= VSFLASH_SIZE) {
+        return 1;
+    }
+    sector = VSFLASH_SECTOR(addr);
+    sub_vsflash_drop(sector);
+
+    if (sub_vsflash_queued(sector) >= 0) {
+        return 0;
+    }
+    if (vsflash.pending >= OT_PARAM(VSFLASH_ERASES)) {
+        return sub_vsflash_erase_now(sector);
+    }
+    vsflash.sector[vsflash.pending++] = sector;
+    return 0;
+}
+#endif
+
+
+#ifndef EXTF_vsflash_service
+ot_u8 vsflash_service(void) {
+    if (vsflash.erasing) {
+        if (platform_sflash_busy()) {
+            return vsflash.pending;
+        }
+        sub_vsflash_wait();
+    }
+    if (vsflash.pending != 0) {
+        if (platform_sflash_erase((ot_u32)vsflash.sector[0] * SFLASH_SECTOR_SIZE) == 0) {
+            vsflash.erasing = True;
+        }
+    }
+    return vsflash.pending;
+}
+#endif
+
+
+#ifndef EXTF_vsflash_flush
+ot_u8 vsflash_flush(void) {
+    sub_vsflash_wait();
+    while (vsflash.pending != 0) {
+        if (sub_vsflash_erase_now(vsflash.sector[0]) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+
+#endif
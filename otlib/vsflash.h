@@ -0,0 +1,194 @@
+/* Copyright 2010-2011 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlib/vsflash.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 July 2011
+  * @brief      External serial flash address space for Veelite
+  * @defgroup   Veelite
+  *
+  * VSFLASH is a third address space next to VWORM and VSRAM, for an external
+  * SPI NOR flash.  It has 32 bit addresses, so it can hold data that is much
+  * bigger than the 64K of the veelite filesystem, such as logs and bulk GFB
+  * data.  Like NOR flash, a write can only take bits from 1 to 0, and a
+  * sector has to be erased to set them back.  How the space is laid out is
+  * up to the app.
+  *
+  * - Writes go out as page-program bursts, which the platform may send by
+  *   DMA.  A write is cut at each page boundary of the chip.
+  * - Reads go through a small cache of lines of recently used sectors, so
+  *   small reads of the same data do not each cost an SPI transaction.
+  * - Erases are queued.  The kernel starts them one at a time in idle
+  *   periods long enough to hold one, away from radio activity, and the chip
+  *   erases while the CPU goes on.  A sector in the queue already reads as
+  *   erased.  A write to it, or a full queue, erases at once.
+  *
+  * The SPI driver is part of the platform (platform_sflash_...() in
+  * OT_platform.h), and so is the geometry of the chip (SFLASH_...).
+  *
+  ******************************************************************************
+  */
+
+#ifndef __VSFLASH_H
+#define __VSFLASH_H
+
+#include "OT_types.h"
+#include "OT_config.h"
+#include "OT_platform.h"
+
+
+#ifndef OT_FEATURE_VSFLASH
+#   define OT_FEATURE_VSFLASH       DISABLED
+#endif
+
+/// Lines in the read cache, and bytes per line (a power of 2, at most a page)
+#ifndef OT_PARAM_VSFLASH_LINES
+#   define OT_PARAM_VSFLASH_LINES   4
+#endif
+#ifndef OT_PARAM_VSFLASH_LINEBYTES
+#   define OT_PARAM_VSFLASH_LINEBYTES 32
+#endif
+
+/// Sector erases that can wait in the queue
+#ifndef OT_PARAM_VSFLASH_ERASES
+#   define OT_PARAM_VSFLASH_ERASES  8
+#endif
+
+/// Chip geometry, from the platform or board.  These are for a common 4 KB
+/// sector, 256 byte page part of 1 MB.
+#ifndef SFLASH_PAGE_SIZE
+#   define SFLASH_PAGE_SIZE         256
+#endif
+#ifndef SFLASH_SECTOR_SIZE
+#   define SFLASH_SECTOR_SIZE       4096
+#endif
+#ifndef SFLASH_NUM_SECTORS
+#   define SFLASH_NUM_SECTORS       256
+#endif
+
+/// Kernel ticks that a sector erase takes on the chip, with some margin
+#ifndef SFLASH_ERASE_TICKS
+#   define SFLASH_ERASE_TICKS       64
+#endif
+
+#define VSFLASH_SIZE        ((ot_u32)SFLASH_SECTOR_SIZE * SFLASH_NUM_SECTORS)
+#define VSFLASH_NOLINE      0xFFFFFFFF
+
+
+/** @typedef vsaddr
+  * A 32 bit address in VSFLASH.
+  */
+typedef ot_u32 vsaddr;
+
+
+/** vsflash_struct
+  * use:        use stamp, which goes up with each cache hit or fill
+  * erasing:    True while the chip erases sector[0]
+  * pending:    sectors in the erase queue (with the one that is erasing)
+  * sector[]:   erase queue, oldest first
+  * line[]:     read cache.  addr is the first address of the line, or
+  *             VSFLASH_NOLINE, and stamp is the use stamp of its last use.
+  */
+typedef struct {
+    vsaddr  addr;
+    ot_u16  stamp;
+    ot_u8   data[OT_PARAM(VSFLASH_LINEBYTES)];
+} vsflash_line;
+
+typedef struct {
+    ot_u16          use;
+    ot_u8           erasing;
+    ot_u8           pending;
+    ot_u16          sector[OT_PARAM(VSFLASH_ERASES)];
+    vsflash_line    line[OT_PARAM(VSFLASH_LINES)];
+} vsflash_struct;
+
+extern vsflash_struct vsflash;
+
+
+
+/** @brief  Initializes VSFLASH: the cache is empty and no erase is queued
+  * @param  none
+  * @retval none
+  * @ingroup Veelite
+  *
+  * The platform runs it at power-on, after it sets up the SPI.
+  */
+void vsflash_init(void);
+
+
+/** @brief  Reads bytes from VSFLASH
+  * @param  addr        (vsaddr) first address
+  * @param  data        (ot_u8*) output
+  * @param  length      (ot_uint) number of bytes
+  * @retval ot_u8       0 on success, non-zero if the span is out of VSFLASH
+  * @ingroup Veelite
+  *
+  * Reads go through the line cache.  Sectors that wait to be erased read as
+  * 0xFF.
+  */
+ot_u8 vsflash_read(vsaddr addr, ot_u8* data, ot_uint length);
+
+
+/** @brief  Programs bytes into VSFLASH
+  * @param  addr        (vsaddr) first address
+  * @param  data        (ot_u8*) bytes to program
+  * @param  length      (ot_uint) number of bytes
+  * @retval ot_u8       0 on success, non-zero if the span is out of VSFLASH,
+  *                     or on a fault
+  * @ingroup Veelite
+  *
+  * Each byte becomes (old & new), as in NOR flash, so the span should be
+  * erased first.  A sector of the span that waits to be erased is erased now.
+  */
+ot_u8 vsflash_write(vsaddr addr, ot_u8* data, ot_uint length);
+
+
+/** @brief  Queues the erase of a sector
+  * @param  addr        (vsaddr) any address in the sector
+  * @retval ot_u8       0 on success, non-zero if the address is out of VSFLASH
+  * @ingroup Veelite
+  *
+  * The sector reads as erased from now on.  If the queue is full, the sector
+  * is erased now, which stalls until the chip is done.
+  */
+ot_u8 vsflash_erase(vsaddr addr);
+
+
+/** @brief  Starts the next queued erase, if the chip is free
+  * @param  none
+  * @retval ot_u8       sectors still in the queue
+  * @ingroup Veelite
+  *
+  * The kernel calls it in idle periods of at least SFLASH_ERASE_TICKS with
+  * no radio activity.  It does not wait for the erase, which goes on while
+  * the CPU does other work or sleeps.
+  */
+ot_u8 vsflash_service(void);
+
+
+/** @brief  Erases all the queued sectors now
+  * @param  none
+  * @retval ot_u8       Non-zero on a fault
+  * @ingroup Veelite
+  *
+  * For a power-down: the queue is in RAM, so the erases would be lost.
+  */
+ot_u8 vsflash_flush(void);
+
+
+#endif
@@ -0,0 +1,450 @@
+/*  Copyright 2010-2012, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTlibext/coap.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      CoAP message parser, writer and resource router
+  * @defgroup   CoAP
+  * @ingroup    CoAP
+  *
+  * CoAP messages (RFC 7252) are carried as the payload of an ALP record with
+  * the ID COAP_ALP_ID, one message per record.  ALP records already travel
+  * over MPipe (NDEF) and over the air (M2DP), so an IP gateway can pass CoAP
+  * to a device with no translation, only the ALP header.
+  *
+  * Messages are parsed in place: coap_parse_message() checks the framing and
+  * returns pointers into the buffer, and options are read from the buffer
+  * one at a time with coap_opt_next().  Nothing is copied.
+  *
+  * Requests are routed by their Uri-Path, through a table that the app makes
+  * with Supplements/coap_routegen.c.  The table is a perfect hash of the
+  * paths, so a lookup is one hash over the path and one compare.  A path
+  * routes to a Veelite file (GET reads it, PUT writes it), or to an ALP, which
+  * gets the CoAP payload as its record payload.  Large files go in blocks
+  * (Block1 & Block2, RFC 7959).
+  *
+  * The device is a server only.  It answers requests, and it does not send
+  * them, so it keeps no state between messages.
+  ******************************************************************************
+  */
+
+#ifndef __COAP_H
+#define __COAP_H
+
+#include "OT_types.h"
+#include "OT_config.h"
+#include "alp.h"
+#include "queue.h"
+
+#if (OT_FEATURE(COAP) == ENABLED)
+#if (OT_FEATURE(ALPEXT) != ENABLED)
+#   error "CoAP needs OT_FEATURE_ALPEXT ENABLED, for its ALP handler"
+#endif
+
+
+/** Configuration
+  * COAP_ALP_ID is not a spec ID.  Use one that is free on the network.
+  * COAP_BLOCK_SZX is the largest block the server uses (16 << SZX bytes).
+  * COAP_REGISTRY_NAMES builds the registry names, for debug output.
+  */
+#ifndef COAP_ALP_ID
+#   define COAP_ALP_ID          0x10
+#endif
+#ifndef COAP_BLOCK_SZX
+#   define COAP_BLOCK_SZX       3
+#endif
+#ifndef COAP_REGISTRY_NAMES
+#   define COAP_REGISTRY_NAMES  DISABLED
+#endif
+
+
+/** Message Header
+  * Ver (2 bits, always 1), Type (2), Token Length (4), Code, Message ID (16)
+  */
+#define COAP_VERSION            1
+#define COAP_HEADER_BYTES       4
+#define COAP_TOKEN_MAX          8
+#define COAP_PAYLOAD_MARKER     0xFF
+
+#define COAP_TYPE_CON           0
+#define COAP_TYPE_NON           1
+#define COAP_TYPE_ACK           2
+#define COAP_TYPE_RST           3
+
+
+/** Codes
+  * A code is a class (3 bits) and a detail (5 bits), written c.dd
+  */
+#define COAP_CODE(C, DD)        (ot_u8)(((C) << 5) | (DD))
+#define COAP_CODE_CLASS(CODE)   ((CODE) >> 5)
+
+#define COAP_EMPTY              COAP_CODE(0, 0)
+#define COAP_GET                COAP_CODE(0, 1)
+#define COAP_POST               COAP_CODE(0, 2)
+#define COAP_PUT                COAP_CODE(0, 3)
+#define COAP_DELETE             COAP_CODE(0, 4)
+
+#define COAP_CREATED            COAP_CODE(2, 1)
+#define COAP_DELETED            COAP_CODE(2, 2)
+#define COAP_VALID              COAP_CODE(2, 3)
+#define COAP_CHANGED            COAP_CODE(2, 4)
+#define COAP_CONTENT            COAP_CODE(2, 5)
+#define COAP_CONTINUE           COAP_CODE(2, 31)
+#define COAP_BAD_REQUEST        COAP_CODE(4, 0)
+#define COAP_UNAUTHORIZED       COAP_CODE(4, 1)
+#define COAP_BAD_OPTION         COAP_CODE(4, 2)
+#define COAP_FORBIDDEN          COAP_CODE(4, 3)
+#define COAP_NOT_FOUND          COAP_CODE(4, 4)
+#define COAP_NOT_ALLOWED        COAP_CODE(4, 5)
+#define COAP_INCOMPLETE         COAP_CODE(4, 8)
+#define COAP_TOO_LARGE          COAP_CODE(4, 13)
+#define COAP_SERVER_ERROR       COAP_CODE(5, 0)
+#define COAP_NOT_IMPLEMENTED    COAP_CODE(5, 1)
+
+
+/** Option Numbers
+  * Odd numbers are critical: a request with a critical option that the server
+  * does not know must be refused.
+  */
+#define COAP_OPT_IF_MATCH       1
+#define COAP_OPT_URI_HOST       3
+#define COAP_OPT_ETAG           4
+#define COAP_OPT_IF_NONE_MATCH  5
+#define COAP_OPT_OBSERVE        6
+#define COAP_OPT_URI_PORT       7
+#define COAP_OPT_LOCATION_PATH  8
+#define COAP_OPT_URI_PATH       11
+#define COAP_OPT_CONTENT_FORMAT 12
+#define COAP_OPT_MAX_AGE        14
+#define COAP_OPT_URI_QUERY      15
+#define COAP_OPT_ACCEPT         17
+#define COAP_OPT_LOCATION_QUERY 20
+#define COAP_OPT_BLOCK2         23
+#define COAP_OPT_BLOCK1         27
+#define COAP_OPT_SIZE2          28
+#define COAP_OPT_PROXY_URI      35
+#define COAP_OPT_PROXY_SCHEME   39
+#define COAP_OPT_SIZE1          60
+
+#define COAP_OPT_CRITICAL(NUM)  ((NUM) & 1)
+
+/** Content Formats */
+#define COAP_FORMAT_TEXT        0
+#define COAP_FORMAT_LINK        40
+#define COAP_FORMAT_XML         41
+#define COAP_FORMAT_OCTETS      42
+#define COAP_FORMAT_EXI         47
+#define COAP_FORMAT_JSON        50
+
+
+/** @typedef coapreg_opt
+  * Option registry descriptor (otcoap_registry.c)
+  *
+  * ot_u16  max         largest value length
+  * ot_u8   number      option number
+  * ot_u8   flags       COAP_REG_... value format, critical, repeatable
+  * ot_u8   min         smallest value length
+  */
+#define COAP_REG_EMPTY          0
+#define COAP_REG_OPAQUE         1
+#define COAP_REG_UINT           2
+#define COAP_REG_STRING         3
+#define COAP_REG_FORMAT(FLAGS)  ((FLAGS) & 3)
+#define COAP_REG_CRITICAL       0x04
+#define COAP_REG_REPEAT         0x08
+
+typedef struct {
+    ot_u16  max;
+    ot_u8   number;
+    ot_u8   flags;
+    ot_u8   min;
+} coapreg_opt;
+
+
+/** Parser return codes */
+#define COAP_ERR_FORMAT         -1
+#define COAP_ERR_VERSION        -2
+
+
+
+/** @typedef coap_msg
+  * A parsed message.  All the pointers are into the buffer that was parsed.
+  *
+  * ot_u8   type        COAP_TYPE_...
+  * ot_u8   code        request method or response code
+  * ot_u16  mid         Message ID
+  * ot_u8   tkl         token length (0-8)
+  * ot_u8*  token       token (tkl bytes)
+  * ot_u8*  options     first option, or the payload marker, or end
+  * ot_u8*  payload     payload (equal to end if there is none)
+  * ot_u8*  end         end of the message
+  */
+typedef struct {
+    ot_u8   type;
+    ot_u8   code;
+    ot_u16  mid;
+    ot_u8   tkl;
+    ot_u8*  token;
+    ot_u8*  options;
+    ot_u8*  payload;
+    ot_u8*  end;
+} coap_msg;
+
+
+/** @typedef coap_opt
+  * Option iterator.  Set cursor to NULL before the first coap_opt_next().
+  *
+  * ot_u16  number      option number
+  * ot_u16  length      option value length
+  * ot_u8*  value       option value, in the message buffer
+  * ot_u8*  cursor      next option (internal)
+  */
+typedef struct {
+    ot_u16  number;
+    ot_u16  length;
+    ot_u8*  value;
+    ot_u8*  cursor;
+} coap_opt;
+
+
+/** @typedef coap_block
+  * Value of a Block1 or Block2 option
+  *
+  * ot_u32  num         block number
+  * ot_u8   more        1 if more blocks follow
+  * ot_u8   szx         block size is 16 << szx bytes (0-6)
+  */
+typedef struct {
+    ot_u32  num;
+    ot_u8   more;
+    ot_u8   szx;
+} coap_block;
+
+#define COAP_BLOCK_SIZE(SZX)    (16 << (SZX))
+
+
+/** Routes
+  * A route takes a Uri-Path (segments joined by '/', no leading '/') to a
+  * Veelite file or to an ALP.  target is a vlBLOCK (GFB, ISFS or ISF) for a
+  * file, or COAP_TARGET_ALP.  For an ALP, id and cmd are the directive ID and
+  * command of the record that the CoAP payload goes in.  methods is a mask of
+  * COAP_ALLOW_... for the methods that the route takes.
+  *
+  * The table has "slots" entries, and unused ones have a NULL path.  A path
+  * goes in slot (hash of the path, from the seed) % slots, and no
+  * two paths of the table go in the same slot.
+  */
+#define COAP_TARGET_ALP         0x80
+
+#define COAP_ALLOW_GET          0x01
+#define COAP_ALLOW_POST         0x02
+#define COAP_ALLOW_PUT          0x04
+#define COAP_ALLOW_DELETE       0x08
+#define COAP_ALLOW(METHOD)      (1 << ((METHOD) - 1))
+
+typedef struct {
+    const char* path;
+    ot_u8       target;
+    ot_u8       id;
+    ot_u8       cmd;
+    ot_u8       methods;
+} coap_route;
+
+typedef struct {
+    ot_u16              seed;
+    ot_u16              slots;
+    const coap_route*   table;
+} coap_routemap;
+
+/** The route table of the app, made by Supplements/coap_routegen.c */
+extern const coap_routemap coap_routes;
+
+/** One step of the path hash: the host generator uses the same one */
+#define COAP_HASH_STEP(HASH, BYTE)  (ot_u16)((((HASH) << 5) + (HASH)) ^ (BYTE))
+
+
+
+
+/** @brief  Parses a CoAP message in place
+  * @param  msg         (coap_msg*) output message description
+  * @param  data        (ot_u8*) message buffer
+  * @param  length      (ot_int) message length in bytes
+  * @retval ot_int      0 on success, or COAP_ERR_...
+  * @ingroup CoAP
+  *
+  * All the options are checked for framing, so coap_opt_next() does not need
+  * to check anything later.  When the header is good but the rest is not,
+  * the type, code, mid and token are still loaded, so a Reset can be sent.
+  */
+ot_int coap_parse_message(coap_msg* msg, ot_u8* data, ot_int length);
+
+
+/** @brief  Moves an option iterator to the next option of a message
+  * @param  msg         (const coap_msg*) message from coap_parse_message()
+  * @param  opt         (coap_opt*) iterator, with cursor NULL to start
+  * @retval ot_bool     True if opt holds the next option, False at the end
+  * @ingroup CoAP
+  */
+ot_bool coap_opt_next(const coap_msg* msg, coap_opt* opt);
+
+
+/** @brief  Finds the first option with a given number
+  * @param  msg         (const coap_msg*) message from coap_parse_message()
+  * @param  opt         (coap_opt*) output option
+  * @param  number      (ot_u16) option number
+  * @retval ot_bool     True if the option is in the message
+  * @ingroup CoAP
+  */
+ot_bool coap_opt_find(const coap_msg* msg, coap_opt* opt, ot_u16 number);
+
+
+/** @brief  Returns the value of an unsigned integer option (0-4 bytes)
+  * @param  opt         (const coap_opt*) option
+  * @retval ot_u32      value
+  * @ingroup CoAP
+  */
+ot_u32 coap_opt_uint(const coap_opt* opt);
+
+
+/** @brief  Reads a Block1 or Block2 option
+  * @param  msg         (const coap_msg*) message from coap_parse_message()
+  * @param  block       (coap_block*) output block value
+  * @param  number      (ot_u16) COAP_OPT_BLOCK1 or COAP_OPT_BLOCK2
+  * @retval ot_bool     True if the option is in the message and is good
+  * @ingroup CoAP
+  */
+ot_bool coap_get_block(const coap_msg* msg, coap_block* block, ot_u16 number);
+
+
+/** @brief  Writes a message header and token
+  * @param  q           (Queue*) output queue
+  * @param  type        (ot_u8) COAP_TYPE_...
+  * @param  code        (ot_u8) method or response code
+  * @param  mid         (ot_u16) Message ID
+  * @param  token       (const ot_u8*) token
+  * @param  tkl         (ot_u8) token length (0-8)
+  * @retval None
+  * @ingroup CoAP
+  */
+void coap_put_header(Queue* q, ot_u8 type, ot_u8 code, ot_u16 mid, const ot_u8* token, ot_u8 tkl);
+
+
+/** @brief  Writes an option
+  * @param  q           (Queue*) output queue
+  * @param  last        (ot_u16*) number of the last option written, 0 at first
+  * @param  number      (ot_u16) option number, not lower than *last
+  * @param  value       (const ot_u8*) option value
+  * @param  length      (ot_u16) option value length
+  * @retval None
+  * @ingroup CoAP
+  */
+void coap_put_option(Queue* q, ot_u16* last, ot_u16 number, const ot_u8* value, ot_u16 length);
+
+
+/** @brief  Writes an unsigned integer option, in as few bytes as it needs
+  * @param  q           (Queue*) output queue
+  * @param  last        (ot_u16*) number of the last option written, 0 at first
+  * @param  number      (ot_u16) option number, not lower than *last
+  * @param  value       (ot_u32) option value
+  * @retval None
+  * @ingroup CoAP
+  */
+void coap_put_uint(Queue* q, ot_u16* last, ot_u16 number, ot_u32 value);
+
+
+/** @brief  Finds the route for the Uri-Path of a request
+  * @param  msg         (const coap_msg*) request from coap_parse_message()
+  * @retval const coap_route*   route, or NULL if the path has none
+  * @ingroup CoAP
+  */
+const coap_route* coap_route_find(const coap_msg* msg);
+
+
+/** @brief  Returns True if a code is a registered method or response code
+  * @param  code        (ot_u8) code
+  * @retval ot_bool     True if registered
+  * @ingroup CoAP
+  */
+ot_bool coapreg_is_code(ot_u8 code);
+
+
+/** @brief  Returns the registry descriptor of an option
+  * @param  number      (ot_u16) option number
+  * @retval const coapreg_opt*  descriptor, or NULL if the option is not registered
+  * @ingroup CoAP
+  */
+const coapreg_opt* coapreg_get_option(ot_u16 number);
+
+
+/** @brief  Checks an option against the registry
+  * @param  opt         (const coap_opt*) option
+  * @retval ot_bool     True if the option is registered and its length is good
+  * @ingroup CoAP
+  *
+  * RFC 7252 treats an option with a bad length as an option that is not
+  * known, so a False return means "unrecognized" for both cases.
+  */
+ot_bool coapreg_check_option(const coap_opt* opt);
+
+
+/** @brief  Returns True if a content format is registered
+  * @param  format      (ot_u16) Content-Format number
+  * @retval ot_bool     True if registered
+  * @ingroup CoAP
+  */
+ot_bool coapreg_is_format(ot_u16 format);
+
+
+#if (COAP_REGISTRY_NAMES == ENABLED)
+/** @brief  Registry names, for debug output
+  * @retval const char* name, or NULL if the number is not registered
+  * @ingroup CoAP
+  */
+const char* coapreg_code_name(ot_u8 code);
+const char* coapreg_option_name(ot_u16 number);
+const char* coapreg_format_name(ot_u16 format);
+#endif
+
+
+/** @brief  Registers the CoAP server as the handler of COAP_ALP_ID
+  * @param  None
+  * @retval ot_bool     True on success (see alp_register())
+  * @ingroup CoAP
+  */
+ot_bool coap_init();
+
+
+/** @brief  ALP handler for CoAP records: answers one request
+  * @param  in_rec      (alp_record*) Header of input ALP record, to be processed
+  * @param  out_rec     (alp_record*) Header of output ALP record, due to processing
+  * @param  in_q        (Queue*) input queue containing record
+  * @param  out_q       (Queue*) output queue for [optional] record response
+  * @param  user_id     (id_tmpl*) user id for performing the record
+  * @retval None
+  * @ingroup CoAP
+  *
+  * Confirmable requests get a piggybacked ACK, and non-confirmable requests
+  * get a non-confirmable response.  Empty confirmable messages (CoAP ping) get
+  * a Reset.  Responses and Resets are dropped, because the device does not
+  * send requests.  The file and ALP access is done as user_id.
+  */
+void coap_proc(alp_record* in_rec, alp_record* out_rec, Queue* in_q, Queue* out_q, id_tmpl* user_id);
+
+
+#endif
+#endif
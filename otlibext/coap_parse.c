@@ -1,4 +1,4 @@
-/*  Copyright 2010-2011, JP Norair
+/*  Copyright 2010-2012, JP Norair
   *
   * Licensed under the OpenTag License, Version 1.0 (the "License");
   * you may not use this file except in compliance with the License.
@@ -12,37 +12,258 @@
   * See the License for the specific language governing permissions and
   * limitations under the License.
   */
-
+/**
+  * @file       /OTlibext/coap_parse.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      CoAP message parser and writer
+  * @ingroup    CoAP
+  *
+  * Options are framed as a header byte (delta:4, length:4), then the extended
+  * delta, then the extended length, then the value.  A nibble of 13 means one
+  * more byte (value - 13), 14 means two more bytes (value - 269), and 15 is
+  * only allowed in the payload marker (0xFF).
+  ******************************************************************************
+  */
 
 #include "OTAPI.h"
+#include "coap.h"
+
+#if (OT_FEATURE(COAP) == ENABLED)
+
+
+
+ot_u8* sub_opt_field(ot_u8* cursor, ot_u8 nibble, ot_u16* value) {
+/// Reads the extended part of a delta or length nibble
+    if (nibble == 13) {
+        *value = 13 + cursor[0];
+        return cursor + 1;
+    }
+    if (nibble == 14) {
+        *value = 269 + (((ot_u16)cursor[0] << 8) | cursor[1]);
+        return cursor + 2;
+    }
+    *value = nibble;
+    return cursor;
+}
+
+
+ot_int sub_opt_extra(ot_u8 nibble) {
+/// Bytes that follow the option header for a delta or length nibble
+    return (nibble < 13) ? 0 : (nibble - 12);
+}
+
+
+
+
+#ifndef EXTF_coap_parse_message
+ot_int coap_parse_message(coap_msg* msg, ot_u8* data, ot_int length) {
+    ot_u8*  cursor;
+    ot_u8*  end;
+
+    /// A message too short for a header is dropped, so it is marked NON
+    end         = data + length;
+    msg->end    = end;
+    if (length < COAP_HEADER_BYTES) {
+        msg->type = COAP_TYPE_NON;
+        return COAP_ERR_FORMAT;
+    }
+
+    /// 1. Header: Ver:2 T:2 TKL:4, Code, Message ID
+    msg->type   = (data[0] >> 4) & 3;
+    msg->tkl    = data[0] & 15;
+    msg->code   = data[1];
+    msg->mid    = ((ot_u16)data[2] << 8) | data[3];
+    msg->token  = &data[4];
+
+    if ((data[0] >> 6) != COAP_VERSION) {
+        return COAP_ERR_VERSION;
+    }
+    if ((msg->tkl > COAP_TOKEN_MAX) || (msg->token + msg->tkl > end)) {
+        msg->tkl = 0;
+        return COAP_ERR_FORMAT;
+    }
+
+    /// 2. Options: check the framing of each one, up to the payload marker
+    cursor          = msg->token + msg->tkl;
+    msg->options    = cursor;
+    msg->payload    = end;
+
+    while (cursor < end) {
+        ot_u8   delta   = cursor[0] >> 4;
+        ot_u8   len     = cursor[0] & 15;
+        ot_u16  value_len;
+
+        if (cursor[0] == COAP_PAYLOAD_MARKER) {
+            /// A marker with no payload after it is a format error
+            if (++cursor == end) {
+                return COAP_ERR_FORMAT;
+            }
+            msg->payload = cursor;
+            break;
+        }
+        if ((delta == 15) || (len == 15)) {
+            return COAP_ERR_FORMAT;
+        }
+
+        cursor++;
+        if ((cursor + sub_opt_extra(delta) + sub_opt_extra(len)) > end) {
+            return COAP_ERR_FORMAT;
+        }
+        cursor += sub_opt_extra(delta);
+        cursor  = sub_opt_field(cursor, len, &value_len);
+        if ((ot_long)value_len > (end - cursor)) {
+            return COAP_ERR_FORMAT;
+        }
+        cursor += value_len;
+    }
+
+    return 0;
+}
+#endif
+
+
+
+#ifndef EXTF_coap_opt_next
+ot_bool coap_opt_next(const coap_msg* msg, coap_opt* opt) {
+/// The message is already checked, so the framing is not checked again
+    ot_u8*  cursor;
+    ot_u16  delta;
+
+    if (opt->cursor == NULL) {
+        opt->cursor = msg->options;
+        opt->number = 0;
+    }
+    cursor = opt->cursor;
+
+    if ((cursor >= msg->end) || (cursor[0] == COAP_PAYLOAD_MARKER)) {
+        return False;
+    }
+
+    cursor          = sub_opt_field(cursor+1, cursor[0] >> 4, &delta);
+    cursor          = sub_opt_field(cursor, opt->cursor[0] & 15, &opt->length);
+    opt->number    += delta;
+    opt->value      = cursor;
+    opt->cursor     = cursor + opt->length;
+    return True;
+}
+#endif
+
 
 
+#ifndef EXTF_coap_opt_find
+ot_bool coap_opt_find(const coap_msg* msg, coap_opt* opt, ot_u16 number) {
+/// Options are in order, so the search stops after the number
+    opt->cursor = NULL;
 
-ot_int coap_parse_message(Queue* in_q, Queue* out_q) {
-    
-    /// 1. First Byte:  <BR>
-    /// b7:6    Version Number (always 01)
-    /// b5:4    Type (Confirmable=0, Non-Confirmable=1, Acknowledgement=2, Reset=3)
-    /// b3:0    Option Count
-    scratch = q_readbyte(in_q);
-    options = scratch & 0xF;
-    type    = (scratch >> 4) & 0x03;
-    
-    if ((scratch & 0xC0) != 0x40) {
-        return -1;  // Bad Version
+    while (coap_opt_next(msg, opt)) {
+        if (opt->number >= number) {
+            return (ot_bool)(opt->number == number);
+        }
     }
-    
-    
-    
-    
+    return False;
+}
+#endif
+
 
+
+#ifndef EXTF_coap_opt_uint
+ot_u32 coap_opt_uint(const coap_opt* opt) {
+    ot_u32  value = 0;
+    ot_u16  i;
+
+    for (i=0; (i<opt->length) && (i<4); i++) {
+        value = (value << 8) | opt->value[i];
+    }
+    return value;
 }
+#endif
+
+
 
+#ifndef EXTF_coap_get_block
+ot_bool coap_get_block(const coap_msg* msg, coap_block* block, ot_u16 number) {
+/// NUM:4-20 M:1 SZX:3.  SZX 7 is reserved.
+    coap_opt    opt;
+    ot_u32      value;
+
+    if ((coap_opt_find(msg, &opt, number) == False) || (opt.length > 3)) {
+        return False;
+    }
+    value       = coap_opt_uint(&opt);
+    block->num  = value >> 4;
+    block->more = (value >> 3) & 1;
+    block->szx  = value & 7;
+
+    return (ot_bool)(block->szx != 7);
+}
+#endif
+
+
+
+
+#ifndef EXTF_coap_put_header
+void coap_put_header(Queue* q, ot_u8 type, ot_u8 code, ot_u16 mid, const ot_u8* token, ot_u8 tkl) {
+    q_writebyte(q, (COAP_VERSION << 6) | (type << 4) | tkl);
+    q_writebyte(q, code);
+    q_writebyte(q, (ot_u8)(mid >> 8));
+    q_writebyte(q, (ot_u8)mid);
+    q_writestring(q, (ot_u8*)token, tkl);
+}
+#endif
+
+
+
+void sub_put_nibble(ot_u8* nibble, ot_u8* ext, ot_int* ext_len, ot_u16 value) {
+/// Makes the header nibble and the extended bytes for a delta or length
+    if (value < 13) {
+        *nibble = (ot_u8)value;
+    }
+    else if (value < 269) {
+        *nibble             = 13;
+        ext[(*ext_len)++]   = (ot_u8)(value - 13);
+    }
+    else {
+        value              -= 269;
+        *nibble             = 14;
+        ext[(*ext_len)++]   = (ot_u8)(value >> 8);
+        ext[(*ext_len)++]   = (ot_u8)value;
+    }
+}
+
+
+#ifndef EXTF_coap_put_option
+void coap_put_option(Queue* q, ot_u16* last, ot_u16 number, const ot_u8* value, ot_u16 length) {
+    ot_u8   delta;
+    ot_u8   len;
+    ot_u8   ext[4];
+    ot_int  ext_len = 0;
+
+    sub_put_nibble(&delta, ext, &ext_len, number - *last);
+    sub_put_nibble(&len, ext, &ext_len, length);
+    *last = number;
+
+    q_writebyte(q, (delta << 4) | len);
+    q_writestring(q, ext, ext_len);
+    q_writestring(q, (ot_u8*)value, length);
+}
+#endif
+
+
+
+#ifndef EXTF_coap_put_uint
+void coap_put_uint(Queue* q, ot_u16* last, ot_u16 number, ot_u32 value) {
+    ot_u8   data[4];
+    ot_int  i = 4;
+
+    while (value != 0) {
+        data[--i]   = (ot_u8)value;
+        value     >>= 8;
+    }
+    coap_put_option(q, last, number, &data[i], 4-i);
+}
+#endif
 
 
-ot_int sub_parse_option(in_q) {
-    ot_int length;
-    
-    
-    
-}
\ No newline at end of file
+#endif
@@ -0,0 +1,444 @@
+/*  Copyright 2010-2012, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+/**
+  * @file       /OTlibext/coap_server.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      CoAP request router and server, as an ALP
+  * @ingroup    CoAP
+  *
+  * The response is written straight into the output queue of the ALP, with
+  * the code filled in last.  File data goes from the Veelite file to the
+  * queue (in place, when vl_get_direct() allows it), and file writes go from
+  * the input queue to the file, so payloads are never copied to a buffer.
+  ******************************************************************************
+  */
+
+#include "OTAPI.h"
+#include "coap.h"
+
+#if (OT_FEATURE(COAP) == ENABLED)
+
+/// Largest CoAP message that fits in one ALP record
+#define COAP_RECORD_MAX     255
+
+/// Options that the server knows, as a mask of option numbers (all < 32).
+/// Size1 (60) is known too.  Uri-Host and Uri-Port are ignored, because
+/// the device has one host.
+#define COAP_KNOWN_OPTS     ( (1UL << COAP_OPT_URI_HOST)        \
+                            | (1UL << COAP_OPT_URI_PORT)        \
+                            | (1UL << COAP_OPT_URI_PATH)        \
+                            | (1UL << COAP_OPT_CONTENT_FORMAT)  \
+                            | (1UL << COAP_OPT_URI_QUERY)       \
+                            | (1UL << COAP_OPT_ACCEPT)          \
+                            | (1UL << COAP_OPT_BLOCK2)          \
+                            | (1UL << COAP_OPT_BLOCK1)          \
+                            | (1UL << COAP_OPT_SIZE2) )
+
+/// Bytes of options that a file response can have: Content-Format (2),
+/// Block2 (4), Size2 (3), and the payload marker.
+#define COAP_FILE_OPTBYTES  10
+
+
+/** Server Data <BR>
+  * ========================================================================<BR>
+  * mid         Message ID of the next non-confirmable response
+  */
+typedef struct {
+    ot_u16  mid;
+} coap_struct;
+
+coap_struct coap;
+
+
+
+
+void sub_rewind(Queue* q, ot_u8* cursor) {
+    q->length      -= (ot_u16)(q->putcursor - cursor);
+    q->putcursor    = cursor;
+}
+
+
+ot_u8 sub_check_options(const coap_msg* msg) {
+/// Critical options that are not known, or that have a bad length, make the
+/// request fail (4.02).  Elective ones are ignored.
+    coap_opt opt;
+
+    opt.cursor = NULL;
+    while (coap_opt_next(msg, &opt)) {
+        if (COAP_OPT_CRITICAL(opt.number) == 0) {
+            continue;
+        }
+        if ((opt.number >= 32) || ((COAP_KNOWN_OPTS & (1UL << opt.number)) == 0) \
+        || (coapreg_check_option(&opt) == False)) {
+            return COAP_BAD_OPTION;
+        }
+    }
+    return 0;
+}
+
+
+ot_u8 sub_vl_code(ot_u8 vl_error) {
+/// Veelite error codes (see vl_getheader_vaddr()) to response codes
+    switch (vl_error) {
+        case 1:     return COAP_NOT_FOUND;
+        case 4:     return COAP_FORBIDDEN;
+        default:    return COAP_SERVER_ERROR;
+    }
+}
+
+
+
+
+/** Routing <BR>
+  * ========================================================================<BR>
+  */
+ot_bool sub_path_match(const coap_msg* msg, const char* path) {
+/// Compares the Uri-Path options of the request with a route path
+    coap_opt    opt;
+    ot_bool     first = True;
+    ot_u16      i;
+
+    opt.cursor = NULL;
+    while (coap_opt_next(msg, &opt) && (opt.number <= COAP_OPT_URI_PATH)) {
+        if (opt.number != COAP_OPT_URI_PATH) {
+            continue;
+        }
+        if (first == False) {
+            if (*path++ != '/') {
+                return False;
+            }
+        }
+        first = False;
+        for (i=0; i<opt.length; i++, path++) {
+            if ((*path == 0) || (*path == '/') || (*path != (char)opt.value[i])) {
+                return False;
+            }
+        }
+    }
+    return (ot_bool)(*path == 0);
+}
+
+
+#ifndef EXTF_coap_route_find
+const coap_route* coap_route_find(const coap_msg* msg) {
+/// The Uri-Path segments are hashed as the path string would be, with '/'
+/// between the segments.
+    const coap_route*   route;
+    coap_opt            opt;
+    ot_u16              hash    = coap_routes.seed;
+    ot_bool             first   = True;
+    ot_u16              i;
+
+    opt.cursor = NULL;
+    while (coap_opt_next(msg, &opt) && (opt.number <= COAP_OPT_URI_PATH)) {
+        if (opt.number != COAP_OPT_URI_PATH) {
+            continue;
+        }
+        if (first == False) {
+            hash = COAP_HASH_STEP(hash, '/');
+        }
+        first = False;
+        for (i=0; i<opt.length; i++) {
+            hash = COAP_HASH_STEP(hash, opt.value[i]);
+        }
+    }
+
+    route = &coap_routes.table[hash % coap_routes.slots];
+    if ((route->path == NULL) || (sub_path_match(msg, route->path) == False)) {
+        return NULL;
+    }
+    return route;
+}
+#endif
+
+
+
+
+/** Resources <BR>
+  * ========================================================================<BR>
+  */
+ot_u8 sub_file_get(const coap_msg* msg, const coap_route* route, Queue* out_q, id_tmpl* user_id) {
+/// Sends the file, or the block of it that is asked for.  The block size is
+/// cut down to fit the response, and the block number is scaled to match.
+    coap_block  block;
+    vl_direct   view;
+    ot_u16      last = 0;
+    ot_u32      offset;
+    ot_uint     span;
+    ot_int      room;
+    ot_u8       szx;
+    ot_u8       err;
+
+    offset  = 0;
+    szx     = COAP_BLOCK_SZX;
+    if (coap_get_block(msg, &block, COAP_OPT_BLOCK2)) {
+        offset  = block.num << (block.szx + 4);
+        szx     = (block.szx < szx) ? block.szx : szx;
+    }
+    room = (ot_int)(out_q->back - out_q->putcursor) - COAP_FILE_OPTBYTES;
+    while ((szx != 0) && (COAP_BLOCK_SIZE(szx) > room)) {
+        szx--;
+    }
+    if (COAP_BLOCK_SIZE(szx) > room) {
+        return COAP_SERVER_ERROR;
+    }
+
+    err = vl_get_direct(&view, (vlBLOCK)route->target, route->id, user_id);
+    if ((err != 0) && (err != 2)) {
+        return sub_vl_code(err);
+    }
+    if ((offset > view.length) || ((offset == view.length) && (offset != 0))) {
+        return COAP_BAD_OPTION;
+    }
+
+    span = view.length - (ot_uint)offset;
+    span = (span > COAP_BLOCK_SIZE(szx)) ? COAP_BLOCK_SIZE(szx) : span;
+
+    coap_put_uint(out_q, &last, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_OCTETS);
+    if ((offset != 0) || ((offset + span) < view.length)) {
+        ot_u32 more = ((offset + span) < view.length);
+        coap_put_uint(out_q, &last, COAP_OPT_BLOCK2, \
+                        ((offset >> (szx + 4)) << 4) | (more << 3) | szx);
+        if (offset == 0) {
+            coap_put_uint(out_q, &last, COAP_OPT_SIZE2, view.length);
+        }
+    }
+    if (span == 0) {
+        return COAP_CONTENT;
+    }
+    q_writebyte(out_q, COAP_PAYLOAD_MARKER);
+
+    /// Read in place if Veelite allows it, else word by word
+    if (err == 0) {
+        q_writestring(out_q, (ot_u8*)&view.data[offset], span);
+    }
+    else {
+        vlFILE* fp = vl_open((vlBLOCK)route->target, route->id, VL_ACCESS_R, user_id);
+        if (fp == NULL) {
+            return COAP_SERVER_ERROR;
+        }
+        for (; span!=0; span--, offset++) {
+            Twobytes word;
+            word.ushort = vl_read(fp, (ot_uint)offset & ~1);
+            q_writebyte(out_q, word.ubyte[offset & 1]);
+        }
+        vl_close(fp);
+    }
+    return COAP_CONTENT;
+}
+
+
+ot_u8 sub_file_put(const coap_msg* msg, const coap_route* route, Queue* out_q, id_tmpl* user_id) {
+/// Writes the payload to the file, from the input queue.  With Block1, each
+/// block goes at its offset and the file ends after it, so the blocks must
+/// come in order.  Blocks with "more" set must be full.
+    coap_block  block;
+    ot_bool     blockwise;
+    vlFILE*     fp;
+    vaddr       header;
+    ot_u32      offset  = 0;
+    ot_uint     length  = (ot_uint)(msg->end - msg->payload);
+    ot_u16      last    = 0;
+    ot_u8       err;
+
+    blockwise = coap_get_block(msg, &block, COAP_OPT_BLOCK1);
+    if (blockwise) {
+        offset = block.num << (block.szx + 4);
+        if (block.more && (length != COAP_BLOCK_SIZE(block.szx))) {
+            return COAP_BAD_REQUEST;
+        }
+    }
+
+    err = vl_getheader_vaddr(&header, (vlBLOCK)route->target, route->id, VL_ACCESS_W, user_id);
+    if (err != 0) {
+        return sub_vl_code(err);
+    }
+    fp = vl_open_file(header);
+    if (fp == NULL) {
+        return COAP_SERVER_ERROR;
+    }
+
+    if ((offset + length) > fp->alloc) {
+        err = COAP_TOO_LARGE;
+    }
+    else if (offset > fp->length) {
+        err = COAP_INCOMPLETE;
+    }
+    else if (offset == 0) {
+        err = (vl_store(fp, length, msg->payload) == 0) ? 0 : COAP_SERVER_ERROR;
+    }
+    else {
+        ot_uint i;
+        for (i=0; i<length; i+=2) {
+            Twobytes word;
+            word.ubyte[0]   = msg->payload[i];
+            word.ubyte[1]   = ((i+1) < length) ? msg->payload[i+1] : 0;
+            err            |= vl_write(fp, (ot_uint)offset+i, word.ushort);
+        }
+        fp->length  = (ot_uint)offset + length;
+        err         = (err == 0) ? 0 : COAP_SERVER_ERROR;
+    }
+    vl_close(fp);
+
+    if (err != 0) {
+        return err;
+    }
+    if (blockwise) {
+        coap_put_uint(out_q, &last, COAP_OPT_BLOCK1, \
+                        (block.num << 4) | ((ot_u32)block.more << 3) | block.szx);
+        if (block.more) {
+            return COAP_CONTINUE;
+        }
+    }
+    return COAP_CHANGED;
+}
+
+
+ot_u8 sub_alp(const coap_msg* msg, const coap_route* route, \
+                Queue* in_q, Queue* out_q, id_tmpl* user_id) {
+/// The CoAP payload is the payload of an ALP record for the route, and the
+/// payload of the ALP response is the CoAP payload of the response.
+    alp_record  alp_in;
+    alp_record  alp_out;
+    ot_u8*      marker;
+    ot_u16      length;
+
+    alp_in.flags            = ALP_FLAG_MB | ALP_FLAG_ME;
+    alp_in.payload_length   = (ot_u8)(msg->end - msg->payload);
+    alp_in.dir_id           = route->id;
+    alp_in.dir_cmd          = route->cmd;
+    alp_in.bookmark         = NULL;
+    alp_out                 = alp_in;
+    alp_out.payload_length  = 0;
+    in_q->getcursor         = msg->payload;
+
+    marker = out_q->putcursor;
+    q_writebyte(out_q, COAP_PAYLOAD_MARKER);
+    length = out_q->length;
+
+    alp_proc(&alp_in, &alp_out, in_q, out_q, user_id);
+
+    if (out_q->length == length) {
+        sub_rewind(out_q, marker);
+    }
+    return (msg->code == COAP_GET) ? COAP_CONTENT : COAP_CHANGED;
+}
+
+
+ot_u8 sub_request(const coap_msg* msg, Queue* in_q, Queue* out_q, id_tmpl* user_id) {
+    const coap_route* route;
+    ot_u8 code;
+
+    code = sub_check_options(msg);
+    if (code != 0) {
+        return code;
+    }
+    route = coap_route_find(msg);
+    if (route == NULL) {
+        return COAP_NOT_FOUND;
+    }
+    if ((msg->code > COAP_DELETE) || ((route->methods & COAP_ALLOW(msg->code)) == 0)) {
+        return COAP_NOT_ALLOWED;
+    }
+    if (route->target & COAP_TARGET_ALP) {
+        return sub_alp(msg, route, in_q, out_q, user_id);
+    }
+    if (msg->code == COAP_GET) {
+        return sub_file_get(msg, route, out_q, user_id);
+    }
+    if ((msg->code == COAP_PUT) || (msg->code == COAP_POST)) {
+        return sub_file_put(msg, route, out_q, user_id);
+    }
+    return COAP_NOT_ALLOWED;
+}
+
+
+
+
+/** Public Functions <BR>
+  * ========================================================================<BR>
+  */
+#ifndef EXTF_coap_init
+ot_bool coap_init() {
+    coap.mid = platform_prand_u16();
+    return alp_register(COAP_ALP_ID, &coap_proc);
+}
+#endif
+
+
+
+#ifndef EXTF_coap_proc
+void coap_proc(alp_record* in_rec, alp_record* out_rec, \
+                Queue* in_q, Queue* out_q, id_tmpl* user_id) {
+    coap_msg    msg;
+    ot_int      err;
+    ot_u8*      head;
+    ot_u8*      body;
+    ot_u8*      back;
+    ot_u8       code;
+
+    err             = coap_parse_message(&msg, in_q->getcursor, in_rec->payload_length);
+    in_q->getcursor = msg.end;
+
+    out_rec->dir_cmd        = in_rec->dir_cmd;
+    out_rec->flags         &= ~ALP_FLAG_CF;
+    out_rec->payload_length = 0;
+    head                    = out_q->putcursor;
+
+    /// Messages with another version are dropped.  Bad confirmable messages,
+    /// and empty ones (ping), get a Reset.  Responses are dropped.
+    if (err == COAP_ERR_VERSION) {
+        return;
+    }
+    if ((err != 0) || (msg.code == COAP_EMPTY)) {
+        if (msg.type == COAP_TYPE_CON) {
+            coap_put_header(out_q, COAP_TYPE_RST, COAP_EMPTY, msg.mid, NULL, 0);
+            out_rec->payload_length = COAP_HEADER_BYTES;
+        }
+        return;
+    }
+    if ((msg.type > COAP_TYPE_NON) || (COAP_CODE_CLASS(msg.code) != 0)) {
+        return;
+    }
+
+    /// The response may not pass the end of the ALP record
+    back = out_q->back;
+    if ((back - head) > COAP_RECORD_MAX) {
+        out_q->back = head + COAP_RECORD_MAX;
+    }
+
+    if (msg.type == COAP_TYPE_CON) {
+        coap_put_header(out_q, COAP_TYPE_ACK, 0, msg.mid, msg.token, msg.tkl);
+    }
+    else {
+        coap_put_header(out_q, COAP_TYPE_NON, 0, coap.mid++, msg.token, msg.tkl);
+    }
+    body = out_q->putcursor;
+    code = sub_request(&msg, in_q, out_q, user_id);
+    if (COAP_CODE_CLASS(code) >= 4) {
+        sub_rewind(out_q, body);
+    }
+    head[1]         = code;
+    in_q->getcursor = msg.end;
+    out_q->back     = back;
+
+    out_rec->payload_length = (ot_u8)(out_q->putcursor - head);
+}
+#endif
+
+
+#endif
@@ -1,4 +1,4 @@
-/*  Copyright 2010-2011, JP Norair
+/*  Copyright 2010-2012, JP Norair
   *
   * Licensed under the OpenTag License, Version 1.0 (the "License");
   * you may not use this file except in compliance with the License.
@@ -12,306 +12,243 @@
   * See the License for the specific language governing permissions and
   * limitations under the License.
   */
-
-
-
+/**
+  * @file       /OTlibext/otcoap_registry.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      CoAP registries: methods, response codes, options, formats
+  * @ingroup    CoAP
+  *
+  * The registries of RFC 7252 (section 12) and RFC 7959, as tables of numbers.
+  * Codes are a bitmap per class, options are descriptors sorted by number,
+  * and content formats are a sorted list.  The names are only built when
+  * COAP_REGISTRY_NAMES is ENABLED, for debug output.
+  ******************************************************************************
+  */
 
 #include "OTAPI.h"
+#include "coap.h"
 
+#if (OT_FEATURE(COAP) == ENABLED)
 
 
+/** Code Registry <BR>
+  * ------------------------------------------------------------------------<BR>
+  * One bit per detail (0-31) for each class.  Class 0 is the methods (and
+  * Empty), classes 2, 4 and 5 are the responses.
+  */
+static const ot_u32 code_map[8] = {
+    0x0000001F,     // 0.00 Empty, 0.01-0.04 GET, POST, PUT, DELETE
+    0x00000000,
+    0x8000003E,     // 2.01-2.05, 2.31 Continue
+    0x00000000,
+    0x0000B17F,     // 4.00-4.06, 4.08, 4.12, 4.13, 4.15
+    0x0000003F,     // 5.00-5.05
+    0x00000000,
+    0x00000000
+};
+
 
 
-/** Method Registry <BR>
+/** Option Registry <BR>
   * ------------------------------------------------------------------------<BR>
-  * Described in 11.1.1 of the CoAP spec.  Methods are request commands, and
-  * there are 4 described in CoAP.
+  * Sorted by number, for a binary search.
   */
-static const ot_u8 method_1[]   = {
-    3,  'G','E','T',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 method_2[]   = {
-    4,  'P','O','S','T',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 method_3[]   = {
-    3,  'P','U','T',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 method_4[]   = {
-    6,  'D','E','L','E','T','E',
-    9,  '[','R','F','C','X','X','X','X',']'
+#define C       COAP_REG_CRITICAL
+#define R       COAP_REG_REPEAT
+
+static const coapreg_opt option_reg[] = {
+    {    8, COAP_OPT_IF_MATCH,          COAP_REG_OPAQUE | C | R,    0 },
+    {  255, COAP_OPT_URI_HOST,          COAP_REG_STRING | C,        1 },
+    {    8, COAP_OPT_ETAG,              COAP_REG_OPAQUE | R,        1 },
+    {    0, COAP_OPT_IF_NONE_MATCH,     COAP_REG_EMPTY | C,         0 },
+    {    3, COAP_OPT_OBSERVE,           COAP_REG_UINT,              0 },
+    {    2, COAP_OPT_URI_PORT,          COAP_REG_UINT | C,          0 },
+    {  255, COAP_OPT_LOCATION_PATH,     COAP_REG_STRING | R,        0 },
+    {  255, COAP_OPT_URI_PATH,          COAP_REG_STRING | C | R,    0 },
+    {    2, COAP_OPT_CONTENT_FORMAT,    COAP_REG_UINT,              0 },
+    {    4, COAP_OPT_MAX_AGE,           COAP_REG_UINT,              0 },
+    {  255, COAP_OPT_URI_QUERY,         COAP_REG_STRING | C | R,    0 },
+    {    2, COAP_OPT_ACCEPT,            COAP_REG_UINT | C,          0 },
+    {  255, COAP_OPT_LOCATION_QUERY,    COAP_REG_STRING | R,        0 },
+    {    3, COAP_OPT_BLOCK2,            COAP_REG_UINT | C,          0 },
+    {    3, COAP_OPT_BLOCK1,            COAP_REG_UINT | C,          0 },
+    {    4, COAP_OPT_SIZE2,             COAP_REG_UINT,              0 },
+    { 1034, COAP_OPT_PROXY_URI,         COAP_REG_STRING | C,        1 },
+    {  255, COAP_OPT_PROXY_SCHEME,      COAP_REG_STRING | C,        1 },
+    {    4, COAP_OPT_SIZE1,             COAP_REG_UINT,              0 }
+};
+
+#undef C
+#undef R
+
+#define OPTION_REG_COUNT    (sizeof(option_reg) / sizeof(coapreg_opt))
+
+
+
+/** Content Format Registry <BR>
+  * ------------------------------------------------------------------------<BR>
+  */
+static const ot_u8 format_reg[] = {
+    COAP_FORMAT_TEXT,
+    COAP_FORMAT_LINK,
+    COAP_FORMAT_XML,
+    COAP_FORMAT_OCTETS,
+    COAP_FORMAT_EXI,
+    COAP_FORMAT_JSON
 };
 
-static const ot_u8* method_data[] = {
-    NULL,
-    method_1,
-    method_2,
-    method_3,
-    method_4,
-};
 
-ot_u8* otcoap_getreg_method(ot_u8 index) {
-    if (index > 4) {
-        index = 0; 
-    }
-    return method_data[index];
-}
 
 
+#ifndef EXTF_coapreg_is_code
+ot_bool coapreg_is_code(ot_u8 code) {
+    return (ot_bool)((code_map[code >> 5] >> (code & 31)) & 1);
+}
+#endif
 
 
 
-/** Response Registry <BR>
-  * ------------------------------------------------------------------------<BR>
-  * Described in 11.1.2 of the CoAP spec.  Response Codes are included after 
-  * completion of a request Method.
-  */
-static const ot_u8 response_65[] = {
-    12, '2','.','0','1',' ','C','r','e','a','t','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_66[] = {
-    12, '2','.','0','2',' ','D','e','l','e','t','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_67[] = {
-    10, '2','.','0','3',' ','V','a','l','i','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_68[] = {
-    12, '2','.','0','4',' ','C','h','a','n','g','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_69[] = {
-    12, '2','.','0','5',' ','C','o','n','t','e','n','t',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_128[] = {
-    16, '4','.','0','0',' ','B','a','d',' ','R','e','q','u','e','s','t',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_129[] = {
-    17, '4','.','0','1',' ','U','n','a','u','t','h','o','r','i','z','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_130[] = {
-    15, '4','.','0','2',' ','B','a','d',' ','O','p','t','i','o','n',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_131[] = {
-    14, '4','.','0','3',' ','F','o','r','b','i','d','d','e','n',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_132[] = {
-    14, '4','.','0','4',' ','N','o','t',' ','F','o','u','n','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_133[] = {
-    23, '4','.','0','5',' ','M','e','t','h','o','d',' ','N','o','t',' ','A','l','l','o','w','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_134[] = {
-    19, '4','.','0','6',' ','N','o','t',' ','A','c','c','e','p','t','a','b','l','e',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_140[] = {
-    24, '4','.','1','2',' ','P','r','e','c','o','n','d','i','t','i','o','n',' ','F','a','i','l','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_141[] = {
-    29, '4','.','1','3',' ','R','e','q','u','e','s','t',' ','E','n','t','i','t','y',' ','T','o','o',' ','L','a','r','g','e',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_143[] = {
-    27, '4','.','1','5',' ','U','n','s','u','p','p','o','r','t','e','d',' ','M','e','d','i','a',' ','T','y','p','e',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_160[] = {
-    26, '5','.','0','0',' ','I','n','t','e','r','n','a','l',' ','S','e','r','v','e','r',' ','E','r','r','o','r',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_161[] = {
-    20, '5','.','0','1',' ','N','o','t',' ','I','m','p','l','e','m','e','n','t','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_162[] = {
-    16, '5','.','0','2',' ','B','a','d',' ','G','a','t','e','w','a','y',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_163[] = {
-    24, '5','.','0','3',' ','S','e','r','v','i','c','e',' ','U','n','a','v','a','i','l','a','b','l','e',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_164[] = {
-    20, '5','.','0','4',' ','G','a','t','e','w','a','y',' ','T','i','m','e','o','u','t',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 response_165[] = {
-    27, '5','.','0','5',' ','P','r','o','x','y','i','n','g',' ','N','o','t',' ','S','u','p','p','o','r','t','e','d',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
+#ifndef EXTF_coapreg_get_option
+const coapreg_opt* coapreg_get_option(ot_u16 number) {
+    ot_int lo = 0;
+    ot_int hi = OPTION_REG_COUNT - 1;
 
-///@todo put in search function once I know how this gets used
+    while (lo <= hi) {
+        ot_int mid = (lo + hi) >> 1;
+        if (option_reg[mid].number == number) {
+            return &option_reg[mid];
+        }
+        if (option_reg[mid].number < number)    lo = mid + 1;
+        else                                    hi = mid - 1;
+    }
+    return NULL;
+}
+#endif
 
 
 
+#ifndef EXTF_coapreg_check_option
+ot_bool coapreg_check_option(const coap_opt* opt) {
+    const coapreg_opt* reg;
 
+    reg = coapreg_get_option(opt->number);
+    if (reg == NULL) {
+        return False;
+    }
+    return (ot_bool)((opt->length >= reg->min) && (opt->length <= reg->max));
+}
+#endif
 
-/** Option Registry <BR>
-  * ------------------------------------------------------------------------<BR>
-  * Described in 11.2 of the CoAP spec.  Options are present (optionally) in
-  * requests.
-  */
-static const ot_u8 option_1[]  = { 
-    12, 'C','o','n','t','e','n','t','-','T','y','p','e',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 option_2[]  = { 
-    7,  'M','a','x','-','A','g','e',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_3[]  = { 
-    9,  'P','r','o','x','y','-','U','r','i',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_4[]  = { 
-    4,  'E','t','a','g',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 option_5[]  = { 
-    8,  'U','r','i','_','H','o','s','t',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_6[]  = { 
-    13, 'L','o','c','a','t','i','o','n','-','P','a','t','h',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_7[]  = { 
-    8,  'U','r','i','-','P','o','r','t',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_8[]  = { 
-    14  'L','o','c','a','t','i','o','n','-','Q','u','e','r','y',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_9[]  = { 
-    8   'U','r','i','-','P','a','t','h',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_11[] = { 
-    5,  'T','o','k','e','n',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 option_12[] = { 
-    6   'A','c','c','e','p','t',
-    9,  '[','R','F','C','X','X','X','X',']'
-};
-static const ot_u8 option_13[] = { 
-    8,  'I','f','-','M','a','t','c','h',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_15[] = { 
-    9   'U','r','i','-','Q','u','e','r','y',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
-static const ot_u8 option_21[] = { 
-    13, 'I','f','-','N','o','n','e','-','M','a','t','c','h',
-    9,  '[','R','F','C','X','X','X','X',']' 
-};
 
-static const ot_u8* option_data[] = {
-    NULL, 
-    option_1,
-    option_2,
-    option_3,
-    option_4,
-    option_5,
-    option_6,
-    option_7,
-    option_8,
-    option_9,
-    NULL,
-    option_11,
-    option_12,
-    option_13,
-    NULL,
-    option_15,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    option_21
-};
 
-ot_u8* coapreg_get_option(ot_u8 index) {
-    if (index > 21) {
-        index = 0; 
+#ifndef EXTF_coapreg_is_format
+ot_bool coapreg_is_format(ot_u16 format) {
+    ot_int i;
+
+    for (i=0; i<(ot_int)sizeof(format_reg); i++) {
+        if (format_reg[i] == format) {
+            return True;
+        }
     }
-    return option_data[index];
+    return False;
 }
+#endif
 
 
 
 
-
-/** Media Type Registry <BR>
+#if (COAP_REGISTRY_NAMES == ENABLED)
+/** Debug Names <BR>
   * ------------------------------------------------------------------------<BR>
-  * Described in 11.3 of the CoAP spec.  Media types are identifiers of a 
-  * format for request or response data.
+  * option_name[] is in the order of option_reg[], and format_name[] in the
+  * order of format_reg[].
   */
-static const ot_u8 media_list[] = { 
-    0, 40, 41, 47, 50
-};
-static const ot_u8 media_0[] = { 
-    25, 't','e','x','t','/','p','l','a','i','n',';',' ','c','h','a','r','s','e','t','=','u','t','f','-','8',
-    27, '[','R','F','C','2','0','4','6',']','[','R','F','C','3','6','7','6',']','[','R','F','C','5','1','4','7',']' 
-};
-static const ot_u8 media_40[] = { 
-    23, 'a','p','p','l','i','c','a','t','i','o','n','/','l','i','n','k','-','f','o','r','m','a','t',
-    27, '[','I','-','D','.','i','e','t','f','-','c','o','r','e','-','l','i','n','k','-','f','o','r','m','a','t',']'
-};
-static const ot_u8 media_41[] = { 
-    15, 'a','p','p','l','i','c','a','t','i','o','n','/','x','m','l',
-    9,  '[','R','F','C','3','0','2','3',']'
-};
-static const ot_u8 media_42[] = { 
-    24, 'a','p','p','l','i','c','a','t','i','o','n','/','o','c','t','e','t','-','s','t','r','e','a','m',
-    18, '[','R','F','C','2','0','4','5',']','[','R','F','C','2','0','4','6',']'
-};
-static const ot_u8 media_47[] = { 
-    15, 'a','p','p','l','i','c','a','t','i','o','n','/','e','x','i',
-    9,  '[','E','X','I','M','I','M','E',']'
-};
-static const ot_u8 media_50[] = { 
-    16, 'a','p','p','l','i','c','a','t','i','o','n','/','j','s','o','n',
-    9,  '[','R','F','C','4','6','2','7',']'
-};
-
-static const ot_u8 media_data[] = {
-    media_0,
-    media_40,
-    media_41,
-    media_42,
-    media_47,
-    media_50
-}
-
-ot_u8* coapreg_get_mediatype(ot_u8 index) {
-    for (i=0; i<sizeof(media_list); i++) {
-        if (media_list[i] == index) {
-            return media_data[i];
+static const char* const option_name[] = {
+    "If-Match",         "Uri-Host",         "ETag",             "If-None-Match",
+    "Observe",          "Uri-Port",         "Location-Path",    "Uri-Path",
+    "Content-Format",   "Max-Age",          "Uri-Query",        "Accept",
+    "Location-Query",   "Block2",           "Block1",           "Size2",
+    "Proxy-Uri",        "Proxy-Scheme",     "Size1"
+};
+
+static const char* const format_name[] = {
+    "text/plain;charset=utf-8",
+    "application/link-format",
+    "application/xml",
+    "application/octet-stream",
+    "application/exi",
+    "application/json"
+};
+
+typedef struct {
+    ot_u8       code;
+    const char* name;
+} code_name_rec;
+
+static const code_name_rec code_name[] = {
+    { COAP_EMPTY,               "Empty" },
+    { COAP_GET,                 "GET" },
+    { COAP_POST,                "POST" },
+    { COAP_PUT,                 "PUT" },
+    { COAP_DELETE,              "DELETE" },
+    { COAP_CREATED,             "Created" },
+    { COAP_DELETED,             "Deleted" },
+    { COAP_VALID,               "Valid" },
+    { COAP_CHANGED,             "Changed" },
+    { COAP_CONTENT,             "Content" },
+    { COAP_CONTINUE,            "Continue" },
+    { COAP_BAD_REQUEST,         "Bad Request" },
+    { COAP_UNAUTHORIZED,        "Unauthorized" },
+    { COAP_BAD_OPTION,          "Bad Option" },
+    { COAP_FORBIDDEN,           "Forbidden" },
+    { COAP_NOT_FOUND,           "Not Found" },
+    { COAP_NOT_ALLOWED,         "Method Not Allowed" },
+    { COAP_CODE(4, 6),          "Not Acceptable" },
+    { COAP_INCOMPLETE,          "Request Entity Incomplete" },
+    { COAP_CODE(4, 12),         "Precondition Failed" },
+    { COAP_TOO_LARGE,           "Request Entity Too Large" },
+    { COAP_CODE(4, 15),         "Unsupported Content-Format" },
+    { COAP_SERVER_ERROR,        "Internal Server Error" },
+    { COAP_NOT_IMPLEMENTED,     "Not Implemented" },
+    { COAP_CODE(5, 2),          "Bad Gateway" },
+    { COAP_CODE(5, 3),          "Service Unavailable" },
+    { COAP_CODE(5, 4),          "Gateway Timeout" },
+    { COAP_CODE(5, 5),          "Proxying Not Supported" }
+};
+
+
+const char* coapreg_code_name(ot_u8 code) {
+    ot_int i;
+
+    for (i=0; i<(ot_int)(sizeof(code_name)/sizeof(code_name_rec)); i++) {
+        if (code_name[i].code == code) {
+            return code_name[i].name;
         }
     }
     return NULL;
 }
 
 
+const char* coapreg_option_name(ot_u16 number) {
+    const coapreg_opt* reg = coapreg_get_option(number);
+    return (reg == NULL) ? NULL : option_name[reg - option_reg];
+}
 
 
+const char* coapreg_format_name(ot_u16 format) {
+    ot_int i;
 
+    for (i=0; i<(ot_int)sizeof(format_reg); i++) {
+        if (format_reg[i] == format) {
+            return format_name[i];
+        }
+    }
+    return NULL;
+}
 
+#endif
 
 
+#endif
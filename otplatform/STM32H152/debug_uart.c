@@ -10,73 +10,133 @@ char uart_rx_buf[UART_RX_BUF_SIZE+1];    // +1 for null termination
 ot_u8 uart_rx_buf_idx;
 ot_bool new_uart_rx;
 
+volatile ot_u32 debug_tx_drops;
+volatile ot_u32 debug_defer_drops;
+
+
+/* Reserves n slots of a ring that is written from any context (main loop and
+ * ISRs of any priority).  The reservation is a LDREX/STREX loop, so writers
+ * never block each other and interrupts are never masked.  Returns the first
+ * slot, or -1 if the ring has no room. */
+static int
+ring_reserve(volatile ot_u32 *resv, ot_u32 tail, ot_u32 size, ot_u32 n)
+{
+    ot_u32 head;
+
+    do {
+        head = __LDREXW((uint32_t *)resv);
+        if ((head - tail) > (size - n)) {
+            __CLREX();
+            return -1;
+        }
+    } while (__STREXW(head + n, (uint32_t *)resv) != 0);
+
+    return (int)head;
+}
+
+
 #ifndef BLOCKING_UART_TX
 
-#define TX_DMA_FIFO_SIZE    7000
+/* TX ring.  Indices run free (they are taken modulo the size), so full and
+ * empty are told apart without a spare byte.
+ *   tx_resv:   next byte to be reserved by a writer
+ *   tx_commit: end of the bytes that are written (all writers are done)
+ *   tx_tail:   start of the bytes the DMA has not finished
+ * Writers nest (an ISR can print in the middle of a main loop print), and the
+ * last one out commits for all of them.  The DMA channel ISR is the only
+ * place where a transfer is started, so the DMA needs no lock either. */
+#define TX_DMA_FIFO_SIZE    4096    // power of 2
 ot_u8 usart_tx_dmafifo[TX_DMA_FIFO_SIZE];
-int usart_tx_dmafifo_in_idx;
-int usart_tx_dmafifo_out_idx;
-volatile char dma_running;
+static volatile ot_u32 tx_resv;
+static volatile ot_u32 tx_commit;
+static volatile ot_u32 tx_tail;
+static volatile ot_u32 tx_writers;
+static ot_u32 tx_dmalen;            // bytes in the DMA, 0 if it is idle
+
+#if (TX_DMA_FIFO_SIZE & (TX_DMA_FIFO_SIZE-1))
+#   error "TX_DMA_FIFO_SIZE must be a power of 2"
+#endif
 
-void
-kick_dma_usart_tx(char context)
+static void
+tx_writer_enter(void)
 {
-    dma_running = context;
-
-    DMA_ITConfig(USART3_TX_DMA_CHANNEL, DMA_IT_TC, DISABLE);
-    DMA_DeInit(USART3_TX_DMA_CHANNEL);
-    if (usart_tx_dmafifo_in_idx < usart_tx_dmafifo_out_idx) {   
-        // wrap-around condition, will need to be sent in two parts, first do unsent up to end of buffer
-        UTX_DMA_Init.DMA_BufferSize = (uint16_t)(TX_DMA_FIFO_SIZE - usart_tx_dmafifo_out_idx);
-    } else {
-        UTX_DMA_Init.DMA_BufferSize = (uint16_t)(usart_tx_dmafifo_in_idx - usart_tx_dmafifo_out_idx);
-    }
-    UTX_DMA_Init.DMA_MemoryBaseAddr = (uint32_t)&usart_tx_dmafifo[usart_tx_dmafifo_out_idx];
-    if (UTX_DMA_Init.DMA_BufferSize > 1) {
-        DMA_Init(USART3_TX_DMA_CHANNEL, &UTX_DMA_Init);
+    ot_u32 n;
+    do {
+        n = __LDREXW((uint32_t *)&tx_writers);
+    } while (__STREXW(n + 1, (uint32_t *)&tx_writers) != 0);
+}
 
-        DMA_ClearFlag(DMA1_FLAG_TC2);
-        DMA_Cmd(USART3_TX_DMA_CHANNEL, ENABLE);
-        DMA_ITConfig(USART3_TX_DMA_CHANNEL, DMA_IT_TC, ENABLE);
-    } else {
-        USART_SendData(USART3, usart_tx_dmafifo[usart_tx_dmafifo_out_idx]);
-        USART_ITConfig(USART3, USART_IT_TXE, ENABLE);
+static void
+tx_writer_exit(void)
+{
+    ot_u32 n, resv, commit;
+    do {
+        n    = __LDREXW((uint32_t *)&tx_writers);
+        resv = tx_resv;
+    } while (__STREXW(n - 1, (uint32_t *)&tx_writers) != 0);
+
+    /* Nested writers finish before the one they interrupted, so the last one
+     * out has seen every reservation finished.  An ISR that reserves after
+     * the STREX above commits by itself, maybe before this one: the commit
+     * only moves forward. */
+    if (n == 1) {
+        do {
+            commit = __LDREXW((uint32_t *)&tx_commit);
+            if ((ot_s32)(resv - commit) <= 0) {
+                __CLREX();
+                return;
+            }
+        } while (__STREXW(resv, (uint32_t *)&tx_commit) != 0);
     }
+}
 
+void
+kick_dma_usart_tx(char context)
+{
+/* The transfer is started in the DMA channel ISR, so a kick only pends it.
+ * context is kept for the callers, who pass where they kick from. */
+    (void)context;
+    NVIC_SetPendingIRQ(DMA1_Channel2_IRQn);
 }
 
 void
 DMA1_Channel2_IRQHandler()
 {
-    if (DMA_GetITStatus(DMA1_IT_TC2) == SET) {
-
-        if (USART_GetFlagStatus(USART3, USART_FLAG_TXE) == SET) {
-            if (usart_tx_dmafifo_out_idx == usart_tx_dmafifo_in_idx) {
-                dma_running = 0;    // no more to send, shut down
-                DMA_ITConfig(USART3_TX_DMA_CHANNEL, DMA_IT_TC, DISABLE);
-                DMA_Cmd(USART3_TX_DMA_CHANNEL, DISABLE);
-            } else {
-                if (USART_GetFlagStatus(USART3, USART_FLAG_TXE) == RESET) {
-                    debug_printf("DMACH2\r\n");
-                    for (;;)
-                        asm("nop"); // why am i here?
-                }
-                kick_dma_usart_tx(4);
-            }
-        } else {
-            USART_ITConfig(USART3, USART_IT_TXE, ENABLE);
-            dma_running = 3;    // indicate DMA TC occurred (but not yet USART TC)
-        }
+    ot_u32 tail, avail;
 
+    /* The last transfer is done: release its bytes */
+    if (DMA_GetITStatus(DMA1_IT_TC2) == SET) {
         DMA_ClearITPendingBit(DMA1_IT_GL2);
-        //redundant DMA_ClearFlag(DMA1_FLAG_TC2);
-        DMA_ClearFlag(USART3_TX_DMA_FLAG_GL);   // in example
-
+        DMA_ClearFlag(USART3_TX_DMA_FLAG_GL);
+        tx_tail  += tx_dmalen;
+        tx_dmalen = 0;
+    }
+    if (tx_dmalen != 0) {
+        return;     // kicked while a transfer is running
+    }
 
-    } // ...if (DMA_GetITStatus(DMA1_IT_TC2) == SET)
-    else {
-        asm("nop"); // why am i here?
+    /* Continue with what is committed, up to the end of the buffer (the part
+     * after a wrap goes in the next transfer) */
+    tail  = tx_tail;
+    avail = tx_commit - tail;
+    if (avail == 0) {
+        DMA_ITConfig(USART3_TX_DMA_CHANNEL, DMA_IT_TC, DISABLE);
+        DMA_Cmd(USART3_TX_DMA_CHANNEL, DISABLE);
+        return;
+    }
+    tail &= (TX_DMA_FIFO_SIZE-1);
+    if (avail > (TX_DMA_FIFO_SIZE - tail)) {
+        avail = TX_DMA_FIFO_SIZE - tail;
     }
+    tx_dmalen = avail;
+
+    DMA_Cmd(USART3_TX_DMA_CHANNEL, DISABLE);
+    UTX_DMA_Init.DMA_BufferSize     = (uint16_t)avail;
+    UTX_DMA_Init.DMA_MemoryBaseAddr = (uint32_t)&usart_tx_dmafifo[tail];
+    DMA_Init(USART3_TX_DMA_CHANNEL, &UTX_DMA_Init);
+    DMA_ClearFlag(USART3_TX_DMA_FLAG_GL);
+    DMA_ITConfig(USART3_TX_DMA_CHANNEL, DMA_IT_TC, ENABLE);
+    DMA_Cmd(USART3_TX_DMA_CHANNEL, ENABLE);
 }
 
 #endif /* !BLOCKING_UART_TX */
@@ -99,41 +159,18 @@ void USART3_IRQHandler(void)
                 __io_putchar(8);
                 uart_rx_buf_idx--;
 #ifndef BLOCKING_UART_TX
-                if (dma_running == 0)
-                    kick_dma_usart_tx(2);
+                kick_dma_usart_tx(2);
 #endif
             }
         } else if (uart_rx_buf_idx < UART_RX_BUF_SIZE) {
                 uart_rx_buf[uart_rx_buf_idx++] = rxchar;
                 __io_putchar(rxchar);
 #ifndef BLOCKING_UART_TX
-                if ( (dma_running == 0) && (rxchar != '\n') )
+                if (rxchar != '\n')
                     kick_dma_usart_tx(2);
 #endif
         }
     }
-
-    if (USART_GetITStatus(USART3, USART_IT_TXE) != RESET) {   
-        USART_ClearFlag(USART3, USART_FLAG_TXE);
-        USART_ITConfig(USART3, USART_IT_TXE, DISABLE);
-
-#ifndef BLOCKING_UART_TX
-        usart_tx_dmafifo_out_idx += UTX_DMA_Init.DMA_BufferSize;
-        if (usart_tx_dmafifo_out_idx == TX_DMA_FIFO_SIZE)
-            usart_tx_dmafifo_out_idx = 0;   // this was a "wrap"
-
-        if (usart_tx_dmafifo_out_idx == usart_tx_dmafifo_in_idx) {
-            // no more to send, shut down
-            dma_running = 0;
-            DMA_ITConfig(USART3_TX_DMA_CHANNEL, DMA_IT_TC, DISABLE);
-            DMA_Cmd(USART3_TX_DMA_CHANNEL, DISABLE);
-        } else {
-            kick_dma_usart_tx(2);
-        }
-#endif
-    } // ...if (USART_GetITStatus(USART3, USART_IT_TC) != RESET)
-
-    //lr = LR_U3;
 }
 
 /**
@@ -143,9 +180,6 @@ void USART3_IRQHandler(void)
   */
 PUTCHAR_PROTOTYPE
 {
-/*    if (usart3_initialized == 0)
-        return ch;*/
-
 #ifdef BLOCKING_UART_TX
     USART_SendData(USART3, (uint8_t) ch);
 
@@ -153,31 +187,84 @@ PUTCHAR_PROTOTYPE
     while (USART_GetFlagStatus(USART3, USART_FLAG_TXE) == RESET)
     {}
 #else
-
-    usart_tx_dmafifo[usart_tx_dmafifo_in_idx] = ch;
-    //total_bytes_tx++;
-    if (++usart_tx_dmafifo_in_idx == TX_DMA_FIFO_SIZE)
-        usart_tx_dmafifo_in_idx = 0;
-
-/* will be dropping chars:   if (usart_tx_dmafifo_in_idx == usart_tx_dmafifo_out_idx ) { */
-    if (usart_tx_dmafifo_in_idx == usart_tx_dmafifo_out_idx ) {
-        for (;;)
-            asm("nop"); // full
+    int slot;
+
+    /* A full ring drops the character and counts it, rather than waiting on
+     * the UART (which would change the timing of the code that prints) */
+    tx_writer_enter();
+    slot = ring_reserve(&tx_resv, tx_tail, TX_DMA_FIFO_SIZE, 1);
+    if (slot >= 0) {
+        usart_tx_dmafifo[slot & (TX_DMA_FIFO_SIZE-1)] = ch;
+    } else {
+        debug_tx_drops++;
     }
+    tx_writer_exit();
 
     /* using newline as delimiter, start DMA transmitting if its not running already */
-    if ( (dma_running == 0) && (ch == '\n') ) {
+    if (ch == '\n') {
         kick_dma_usart_tx(1);
+    }
+#endif
+    return ch;
+}
+
 
-/*        while (dma_running != 0)    // to make each line a blocking call
-            asm("nop");*/
+/* Deferred printf records.  The writer only stores the format pointer and
+ * the arguments; the formatting is done by debug_defer_flush() in the main
+ * loop.  A record is ready when its format pointer is set, so records that
+ * are reserved but not yet written stop the flush, and are taken next time. */
+#define DEFER_RECORDS       32      // power of 2
 
-    } // ...dma not running and newline just "sent"
+typedef struct {
+    const char * volatile fmt;
+    ot_u32      arg[DEBUG_DEFER_ARGS];
+} defer_record;
 
+static defer_record defer_ring[DEFER_RECORDS];
+static volatile ot_u32 defer_resv;
+static ot_u32 defer_tail;
+
+#if (DEFER_RECORDS & (DEFER_RECORDS-1))
+#   error "DEFER_RECORDS must be a power of 2"
 #endif
-    return ch;
+
+void
+debug_defer_push(const char *fmt, ot_u32 a0, ot_u32 a1, ot_u32 a2, ot_u32 a3, ...)
+{
+    defer_record *rec;
+    int slot;
+
+    slot = ring_reserve(&defer_resv, defer_tail, DEFER_RECORDS, 1);
+    if (slot < 0) {
+        debug_defer_drops++;
+        return;
+    }
+    rec         = &defer_ring[slot & (DEFER_RECORDS-1)];
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+    rec->arg[3] = a3;
+    __DMB();
+    rec->fmt    = fmt;
 }
 
+void
+debug_defer_flush()
+{
+    defer_record *rec;
+
+    while (defer_tail != defer_resv) {
+        rec = &defer_ring[defer_tail & (DEFER_RECORDS-1)];
+        if (rec->fmt == NULL)
+            break;
+        printf(rec->fmt, rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+        rec->fmt = NULL;
+        __DMB();
+        defer_tail++;
+    }
+}
+
+
 /* from ascii hex */
 void
 from_hex(char *str, unsigned char *out)
@@ -209,7 +296,7 @@ from_hex(char *str, unsigned char *out)
 void    /* generic minimal default */
 console_service()
 {
-    asm("nop");
+    debug_defer_flush();
 
     if (new_uart_rx == 0)
         return;
@@ -226,22 +313,27 @@ console_service()
     spi_save_restore(False);
 }
 #else
-    // defined in app
+    // defined in app (call debug_defer_flush() from it)
 #endif
 
 void
 debug_uart_init()
 {
 #ifndef BLOCKING_UART_TX
-    usart_tx_dmafifo_in_idx = 0;
-    usart_tx_dmafifo_out_idx = 0;
-    dma_running = 0;
+    tx_resv = 0;
+    tx_commit = 0;
+    tx_tail = 0;
+    tx_writers = 0;
+    tx_dmalen = 0;
+    NVIC_EnableIRQ(DMA1_Channel2_IRQn);
 #endif
+    defer_resv = 0;
+    defer_tail = 0;
+    debug_tx_drops = 0;
+    debug_defer_drops = 0;
 
     uart_rx_buf_idx = 0;
     new_uart_rx = 0;
 }
 
 #endif /* RADIO_DEBUG */
-
-
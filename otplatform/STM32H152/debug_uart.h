@@ -22,5 +22,20 @@ void console_service(void);
 void kick_dma_usart_tx(char context);
 #endif
 
+/* Characters dropped because the TX ring was full, and deferred prints
+ * dropped because the record ring was full */
+extern volatile ot_u32 debug_tx_drops;
+extern volatile ot_u32 debug_defer_drops;
+
+/* Deferred printf: safe and quick in an ISR, because only the format pointer
+ * and up to DEBUG_DEFER_ARGS integer arguments are stored.  They are printed
+ * by debug_defer_flush(), from the main loop.  Format strings and %s
+ * arguments must still be valid then (string literals are). */
+#define DEBUG_DEFER_ARGS    4
+#define debug_deferf(...)   debug_defer_push(__VA_ARGS__, 0, 0, 0, 0)
+
+void debug_defer_push(const char *fmt, ot_u32 a0, ot_u32 a1, ot_u32 a2, ot_u32 a3, ...);
+void debug_defer_flush(void);
+
 
 #endif /* RADIO_DEBUG */
@@ -43,6 +43,7 @@
 #include "radio.h"
 #include "system.h"
 #include "session.h"
+#include "prand.h"
 #ifdef RADIO_DEBUG
 #   include "debug_uart.h"
 #endif
@@ -81,7 +82,7 @@ platform_uart_init(void)
 
         USART_DMACmd(USART3, USART_DMAReq_Tx, ENABLE);  // non-blocking dma for usart3 tx
     }
-    
+
     /* Enable USART */
     USART_Cmd(USART3, ENABLE);
 
@@ -89,14 +90,16 @@ platform_uart_init(void)
 
 }
 
-unsigned int rprime = 83;   // rand number generator
-static unsigned int r = 73; // rand number generator
-
-static void
-rng_seed()
-{
+/** Platform Random Number Generation Routines <BR>
+  * ========================================================================<BR>
+  * platform_rand() takes the LSBs of the temperature sensor conversions, which
+  * are noise, and packs 8 of them into each byte.  The pseudo random number 
+  * generator is in otlib/prand.c.  rng_seed() seeds it from platform_rand().
+  */
+#ifndef EXTF_platform_rand
+void platform_rand(ot_u8* rand_out, ot_int bytes_out) {
     ADC_InitTypeDef ADC_InitStructure;
-    ot_u16 ADCdata;
+    ot_u8 scratch;
     int n;
 
     /* Enable The HSI (16Mhz) */
@@ -126,38 +129,31 @@ rng_seed()
     /* Start ADC1 Software Conversion */
     ADC_SoftwareStartConv(ADC1);
 
-    r = 0;
-    for (n = 0; n < 30; n++) {
-        /* Wait until end of conversion */
-        while (ADC_GetFlagStatus(ADC1, ADC_FLAG_EOC) == RESET)
-            asm("nop");
+    while (--bytes_out >= 0) {
+        scratch = 0;
+        for (n = 0; n < 8; n++) {
+            /* Wait until end of conversion */
+            while (ADC_GetFlagStatus(ADC1, ADC_FLAG_EOC) == RESET)
+                asm("nop");
 
-        /* Read ADC conversion result */
-        ADCdata = ADC_GetConversionValue(ADC1);
-        r += ADCdata & 0x07;    // take lower noise bits
+            /* Read ADC conversion result, take lowest noise bit */
+            scratch = (scratch << 1) | (ADC_GetConversionValue(ADC1) & 1);
+        }
+        *rand_out++ = scratch;
     }
 
-    //debug_printf("r: %x\r\n", r);
-
     ADC_Cmd(ADC1, DISABLE);
     RCC_HSICmd(DISABLE); // assuming HSI not used
 }
+#endif
 
-ot_u8 platform_prand_u8() {
-    static unsigned int Y;
-    // TODO: some random number from STM32L
-    if (r==0 || r==1 || r==-1)
-        r=rprime; /* keep from getting stuck */
-    r = (9973 * ~r) + ((Y) % 701); /* the actual algorithm */
-//    Y = (r>>24) % 9; /* choose upper bits and reduce */
-    Y = r>>24; /* choose upper bits and reduce */
-    return Y;
-}
+static void
+rng_seed()
+{
+    ot_u32 seed;
 
-ot_u16 platform_prand_u16() {
-    ot_u16 ret = platform_prand_u8();
-    ret <<= 8;
-    return ret + platform_prand_u8();
+    platform_rand((ot_u8*)&seed, 4);
+    prand_seed(seed);
 }
 
 static void
@@ -206,7 +202,7 @@ platform_init_gptim(ot_uint prescaler)
     tbase_in.TIM_CounterMode    = TIM_CounterMode_Up;
     tbase_in.TIM_ClockDivision  = TIM_CKD_DIV1;
     TIM_TimeBaseInit(OT_GPTIM, &tbase_in);
-    
+
     TIM_SetCompare1(OT_GPTIM, prescaler);
 
     // Timers 9/10/11 have external clock wired to RTC crystal.
@@ -225,14 +221,15 @@ void platform_init_interruptor() {
 /// enabled by default so that, to turn the interrupts on or off, only the
 /// peripheral interrupt bits need to be set.
 ///
-/// @note   Priority Group 2 is used.  In this method, there are 4 subpriorities
-///         and 4 pre-emption priorities.  OpenTag itself sits in pre-emption
-///         group 1, using the subpriorities as follows:
-///              0 - SX1212 interrupts (GPIOs to IRQ0, IRQ1)
-///              0 - SX1212 Pseudo-interrupts (TIM3)
-///              1 - OpenTag Timer interrupt (TIM2)
-///              1 - RTC interrupt
-///              1 - Mpipe interrupts
+/// @note   PLATFORM_NVIC_GROUP (default group 2: 4 subpriorities and 4
+///         pre-emption priorities) is used.  The pre-emption priorities are
+///         PLATFORM_PRIO_RADIO, _MPIPE, _KERNEL and _APP (platform header),
+///         and the radio is always the highest.  Within a pre-emption
+///         priority, the subpriorities are:
+///              0 - Radio interrupts (GPIOs to DIO0, DIO1)
+///              0 - Mpipe and AES DMA interrupts
+///              1 - OpenTag Timer interrupt (GPTIM), RX timer
+///              2 - SPI2, USART3, APPTIM
 
     NVIC_InitTypeDef nvic_in;
     EXTI_InitTypeDef exti_in;
@@ -266,13 +263,14 @@ void platform_init_interruptor() {
 
     //nonexistant function NVIC_DeInit();
     NVIC_SetVectorTable(NVIC_VectTab_FLASH, 0x00);                              //Vector Table @ 0x08000000
-    NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);                             // Priority Group to 2 bits
+    NVIC_PriorityGroupConfig(PLATFORM_NVIC_GROUP);                              // Priority Group (default 2 bits)
     //TODO find systick priority: NVIC_SystemHandlerPriorityConfig(SystemHandler_SysTick, 0, 0);              // SysTick priority = 0,0 (highest)
 
     ///1. Radio interrupts (Group 0)
 #ifdef _STM32L152VBT6_ // !STM32H152:
     nvic_in.NVIC_IRQChannel                     = EXTI4_IRQn;    // from PA4 SX1231-DIO0
-    nvic_in.NVIC_IRQChannelPreemptionPriority   = 0;
+    nvic_in.NVIC_IRQChannelPreemptionPriority   = PLATFORM_PRIO_RADIO;
+    nvic_in.NVIC_IRQChannelSubPriority          = 0;
     nvic_in.NVIC_IRQChannelCmd                  = ENABLE;
     NVIC_Init(&nvic_in);
 
@@ -282,28 +280,34 @@ void platform_init_interruptor() {
 #error x
     ///   - IRQ0, IRQ1 GPIN external interrupts
     nvic_in.NVIC_IRQChannel                     = EXTI1_IRQn;    // from PA1 IRQ0
-    nvic_in.NVIC_IRQChannelPreemptionPriority   = 0;
+    nvic_in.NVIC_IRQChannelPreemptionPriority   = PLATFORM_PRIO_RADIO;
+    nvic_in.NVIC_IRQChannelSubPriority          = 0;
     nvic_in.NVIC_IRQChannelCmd                  = ENABLE;
     NVIC_Init(&nvic_in);
 
     nvic_in.NVIC_IRQChannel                     = EXTI2_IRQn;    // from PA2 IRQ1
     NVIC_Init(&nvic_in);
 #endif
-    
+
     // TIM3 interrupt (for RX Timeout Timer, unused presently)
     //nvic_in.NVIC_IRQChannel                     = TIM10_IRQChannel;
     //nvic_in.NVIC_IRQChannelSubPriority          = 2;
     //NVIC_Init(&nvic_in);
-    
+
     ///2. OpenTag Interrupts
     ///   - Mpipe, GPTIM, RTC
-    nvic_in.NVIC_IRQChannelPreemptionPriority   = 1;
+    nvic_in.NVIC_IRQChannelPreemptionPriority   = PLATFORM_PRIO_MPIPE;
     nvic_in.NVIC_IRQChannelSubPriority          = 0;
     nvic_in.NVIC_IRQChannel                     = DMA1_Channel2_IRQn; //MPIPE TX DMA Channel;
     NVIC_Init(&nvic_in);
     nvic_in.NVIC_IRQChannel                     = DMA1_Channel3_IRQn; //MPIPE RX DMA Channel;
     NVIC_Init(&nvic_in);
-    
+#   if (MCU_FEATURE(AES128) == ENABLED)
+    nvic_in.NVIC_IRQChannel                     = DMA2_Channel3_IRQn; //AES output DMA Channel
+    NVIC_Init(&nvic_in);
+#   endif
+
+    nvic_in.NVIC_IRQChannelPreemptionPriority   = PLATFORM_PRIO_KERNEL;
     nvic_in.NVIC_IRQChannelSubPriority          = 1;
     nvic_in.NVIC_IRQChannel                     = OT_GPTIM_IRQn;
     NVIC_Init(&nvic_in);
@@ -311,11 +315,12 @@ void platform_init_interruptor() {
     nvic_in.NVIC_IRQChannelSubPriority          = 1;
     nvic_in.NVIC_IRQChannel                     = RXTIM_IRQn;
     NVIC_Init(&nvic_in);
-    
+
     //nvic_in.NVIC_IRQChannelSubPriority          = 2;
     //nvic_in.NVIC_IRQChannel                     = RTC_IRQChannel;
     //NVIC_Init(&nvic_in);
 
+    nvic_in.NVIC_IRQChannelPreemptionPriority   = PLATFORM_PRIO_APP;
     nvic_in.NVIC_IRQChannelSubPriority          = 2;
     nvic_in.NVIC_IRQChannel                     = SPI2_IRQn;
     NVIC_Init(&nvic_in);
@@ -384,7 +389,7 @@ void platform_init_gpio() {
     // Also, all outputs in the schematic are push-pull (no drains)
     gpio_in.GPIO_Speed      = GPIO_Speed_10MHz;
     gpio_in.GPIO_OType      = GPIO_OType_PP;
-    
+
     /// Generic Input
     // (not established right now)
 
@@ -393,7 +398,7 @@ void platform_init_gpio() {
     gpio_in.GPIO_PuPd       = GPIO_PuPd_NOPULL;
     gpio_in.GPIO_Pin        = GPIO_Pin_5;
     GPIO_Init(GPIOA, &gpio_in);
-    
+
     /// LED Interface
     gpio_in.GPIO_Mode       = GPIO_Mode_OUT;    ///@todo check IPD/IPU
     gpio_in.GPIO_Pin        = GPIO_Pin_LED_RED | GPIO_Pin_LED_GREEN;
@@ -446,7 +451,7 @@ void platform_init_gpio() {
     GPIO_PinAFConfig(GPIOB, GPIO_PinSource13, GPIO_AF_SPI2);    // SCK
     GPIO_PinAFConfig(GPIOB, GPIO_PinSource14, GPIO_AF_SPI2);    // MISO
     GPIO_PinAFConfig(GPIOB, GPIO_PinSource15, GPIO_AF_SPI2);    // MOSI
-    
+
     /// Serial UART to breakout board
     // (have driver module set up the UART interface)
     gpio_in.GPIO_Pin        = GPIO_Pin_10 | GPIO_Pin_11;
@@ -454,14 +459,14 @@ void platform_init_gpio() {
     GPIO_Init(GPIOB, &gpio_in);
     GPIO_PinAFConfig(GPIOB, GPIO_PinSource10, GPIO_AF_USART3);
     GPIO_PinAFConfig(GPIOB, GPIO_PinSource11, GPIO_AF_USART3);
-    
+
     /// I2C Bus to sensors
     // (have driver module set up the I2C interface)
     gpio_in.GPIO_Pin        = GPIO_Pin_6 | GPIO_Pin_7;
     GPIO_Init(GPIOB, &gpio_in);
     GPIO_PinAFConfig(GPIOB, GPIO_PinSource6, GPIO_AF_I2C1);
     GPIO_PinAFConfig(GPIOB, GPIO_PinSource7, GPIO_AF_I2C1);
-    
+
     /// USB to I/O connector
     // (have driver module set up the I2C interface)
     gpio_in.GPIO_Pin        = GPIO_Pin_11 | GPIO_Pin_12;
@@ -493,6 +498,11 @@ void platform_init_periphclk() {
 #ifdef _STM32L152VBT6_ // STM32H152:
     RCC_AHBPeriphClockCmd(  RCC_AHBPeriph_GPIOE, ENABLE);
 #endif
+#if (MCU_FEATURE(AES128) == ENABLED)
+    RCC_AHBPeriphClockCmd(  RCC_AHBPeriph_AES       |   \
+                            RCC_AHBPeriph_DMA2,         \
+                            ENABLE);
+#endif
 
     /// Enable APB1 clocks (16 MHz)
     /// Available peripherals on APB1, (*) denotes known Platform usage:
@@ -546,6 +556,11 @@ void platform_init_periphclk() {
 void
 platform_poweron()
 {
+    /// Paint the stack while it is nearly empty (see OT_FEATURE_MEMSTATS)
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    sys_stack_paint();
+#   endif
+
     /// Hardware turn-on stuff
     SystemInit();                   // comes from STLib, does lots of startup
     platform_init_busclk();         // extra bus clock setup not in SystemInit()
@@ -554,7 +569,7 @@ platform_poweron()
     platform_init_gptim(32);        // Initialize GPTIM (to 1024 Hz)
     platform_init_gpio();           // Set up connections on the board
     platform_init_spi();            // initialize command interface to radio
-    
+
 #if ( defined(RADIO_DEBUG) || (OT_FEATURE(MPIPE) == ENABLED) )
     platform_uart_init();
 #endif /* RADIO_DEBUG */
@@ -566,7 +581,7 @@ platform_poweron()
 
     /// Restore vworm (following save on shutdown)
     vworm_init();
-    
+
 #   if (OT_FEATURE(MPIPE) == ENABLED)
         /// Mpipe (message pipe) typically used for serial-line comm.
         mpipe_init(NULL);
@@ -584,11 +599,26 @@ void platform_init_OT() {
 }
 
 
+/* GPTIM is zeroed each time the kernel runs, so the free-running count for
+ * platform_stamp() is what GPTIM had counted each time it was zeroed, plus the
+ * count now.  In up mode GPTIM also wraps at the compare (UIF). */
+static ot_u32 gptim_epoch = 0;
+
+static ot_u32
+sub_gptim_count(void)
+{
+    ot_u32 count = gptim_epoch + OT_GPTIM->CNT;
+    if (OT_GPTIM->SR & TIM_SR_UIF)
+        count += (ot_u32)OT_GPTIM->ARR + 1;
+    return count;
+}
+
 static void
 sub_gptim_reattach(ot_u16 next_event)
 {
     // Flush GPTIM and switch it back to up-counting interrupt mode
     TIM_Cmd(OT_GPTIM, DISABLE);    // TI: MC=00b stop mode
+    gptim_epoch = sub_gptim_count();
     TIM_SetCompare1(OT_GPTIM, next_event);
     TIM_SetAutoreload(OT_GPTIM, next_event);    // TI: "up" timer mode (count to compare)
     TIM_SetCounter(OT_GPTIM, 0);    // TI: TACLR
@@ -613,47 +643,91 @@ platform_ot_preempt()
     TIM_GenerateEvent(OT_GPTIM, TIM_EventSource_CC1);
 }
 
-void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
-/// Behavior is always blocking.
+void
+platform_disable_interrupts()
+{
+    __disable_irq();
+}
 
-#if (OS_FEATURE(MEMCPY) == ENABLED)
-    memcpy(dest, src, length);
+void
+platform_enable_interrupts()
+{
+    __enable_irq();
+}
 
-#elif (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+/** Platform memcpy Routines <BR>
+  * ========================================================================<BR>
+  * Similar to standard implementation of "memcpy".  Copies shorter than
+  * MEMCPY_DMA_THRESHOLD bytes always go through the CPU, because setting up
+  * the DMA costs more than it saves on a short run.  The CPU copies 32 bits at
+  * a time when both addresses are word-aligned.
+  */
+#ifndef MEMCPY_DMA_THRESHOLD
+#   define MEMCPY_DMA_THRESHOLD     32
+#endif
 
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+void sub_memcpy_dma(ot_u8* dest, ot_u8* src, ot_int length, ot_u32 ccr) {
+/// The channel must be off before it can be set up again, so any async copy
+/// still running is waited-out first.
+    platform_memcpy_wait();
+    MEMCPY_DMA_CHAN->CCR    = 0;
     MEMCPY_DMA->IFCR        = MEMCPY_DMA_INT;
-
     MEMCPY_DMA_CHAN->CPAR   = (ot_u32)dest;
-
     MEMCPY_DMA_CHAN->CMAR   = (ot_u32)src;
-
     MEMCPY_DMA_CHAN->CNDTR  = length;
-
     MEMCPY_DMA_CHAN->CCR    = DMA_DIR_PeripheralDST       | \
-
                               DMA_Mode_Normal             | \
-
                               DMA_PeripheralInc_Enable    | \
-
-                              DMA_MemoryInc_Enable        | \
-
-                              DMA_PeripheralDataSize_Byte | \
-
-                              DMA_MemoryDataSize_Byte     | \
-
                               DMA_Priority_VeryHigh       | \
-
                               DMA_M2M_Enable              | \
-
+                              ccr                         | \
                               DMA_CCR1_EN;
+}
 
-    while((MEMCPY_DMA->ISR & MEMCPY_DMA_INT) == 0);
+void sub_memcpy_dmastart(ot_u8* dest, ot_u8* src, ot_int length) {
+    ot_int i;
 
+    if ((((ot_u32)dest | (ot_u32)src) & 3) == 0) {
+        sub_memcpy_dma(dest, src, (length >> 2), DMA_MemoryInc_Enable        | \
+                                                 DMA_PeripheralDataSize_Word | \
+                                                 DMA_MemoryDataSize_Word);
+        /// The CPU does the odd tail bytes while the DMA runs
+        for (i=(length & ~3); i<length; i++) {
+            dest[i] = src[i];
+        }
+    }
+    else {
+        sub_memcpy_dma(dest, src, length, DMA_MemoryInc_Enable        | \
+                                          DMA_PeripheralDataSize_Byte | \
+                                          DMA_MemoryDataSize_Byte);
+    }
+}
+#endif
+
+
+void sub_memcpy_cpu(ot_u8* dest, ot_u8* src, ot_int length) {
+    if (length <= 0) {
+        return;
+    }
+    if ((((ot_u32)dest | (ot_u32)src) & 3) == 0) {
+        ot_u32* dest4   = (ot_u32*)dest;
+        ot_u32* src4    = (ot_u32*)src;
+        ot_int  i;
+        
+        for (i=(length>>2); i>0; i--) {
+            *dest4++ = *src4++;
+        }
+        dest    = (ot_u8*)dest4;
+        src     = (ot_u8*)src4;
+        for (i=(length & 3); i>0; i--) {
+            *dest++ = *src++;
+        }
+    }
 
-#else
     /// Uses the "Duff's Device" for loop unrolling.  If this is incredibly 
     /// confusing to you, check the internet for "Duff's Device."
-    if (length > 0) {
+    else {
         ot_int loops = (length + 7) >> 3;
         
         switch (length & 0x7) {
@@ -669,8 +743,119 @@ void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
                         while (--loops > 0);
         }
     }
-    
+}
+
+
+void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
+/// Behavior is always blocking.
+
+#if (OS_FEATURE(MEMCPY) == ENABLED)
+    memcpy(dest, src, length);
+
+#elif (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length < MEMCPY_DMA_THRESHOLD) {
+        platform_memcpy_wait();
+        sub_memcpy_cpu(dest, src, length);
+    }
+    else {
+        sub_memcpy_dmastart(dest, src, length);
+        platform_memcpy_wait();
+    }
+
+#else
+    sub_memcpy_cpu(dest, src, length);
+#endif
+}
+
+
+void platform_memcpy_2(ot_u16* dest, ot_u16* src, ot_int length) {
+/// Same as platform_memcpy(), but length is in 16 bit words, and both 
+/// addresses must be halfword-aligned.
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= (MEMCPY_DMA_THRESHOLD/2)) {
+        sub_memcpy_dma((ot_u8*)dest, (ot_u8*)src, length, DMA_MemoryInc_Enable            | \
+                                                          DMA_PeripheralDataSize_HalfWord | \
+                                                          DMA_MemoryDataSize_HalfWord);
+        platform_memcpy_wait();
+        return;
+    }
+    platform_memcpy_wait();
+#endif
+    if (length > 0) {
+        ot_int loops = (length + 3) >> 2;
+
+        switch (length & 0x3) {
+            case 0: do {    *dest++ = *src++;
+            case 3:         *dest++ = *src++;
+            case 2:         *dest++ = *src++;
+            case 1:         *dest++ = *src++;
+                        }
+                        while (--loops > 0);
+        }
+    }
+}
+
+
+void platform_memcpy_async(ot_u8* dest, ot_u8* src, ot_int length) {
+/// Returns while the DMA is still copying.  Neither buffer may be touched until
+/// platform_memcpy_busy() returns False.  Short copies are just done.
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_dmastart(dest, src, length);
+        return;
+    }
 #endif
+    platform_memcpy(dest, src, length);
+}
+
+
+ot_bool platform_memcpy_busy() {
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    return (ot_bool)(   ((MEMCPY_DMA_CHAN->CCR & DMA_CCR1_EN) != 0) && \
+                        ((MEMCPY_DMA->ISR & MEMCPY_DMA_INT) == 0)   );
+#else
+    return False;
+#endif
+}
+
+
+void platform_memcpy_wait() {
+    while (platform_memcpy_busy());
+}
+
+
+void platform_memset(ot_u8* dest, ot_u8 value, ot_int length) {
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_dma(dest, &value, length, DMA_MemoryInc_Disable       | \
+                                             DMA_PeripheralDataSize_Byte | \
+                                             DMA_MemoryDataSize_Byte);
+        platform_memcpy_wait();
+        return;
+    }
+    platform_memcpy_wait();
+#endif
+    if (length <= 0) {
+        return;
+    }
+    if (((ot_u32)dest & 3) == 0) {
+        ot_u32* dest4   = (ot_u32*)dest;
+        ot_u32  value4  = value * 0x01010101;
+        ot_int  i;
+        
+        for (i=(length>>2); i>0; i--) {
+            *dest4++ = value4;
+        }
+        dest = (ot_u8*)dest4;
+        for (i=(length & 3); i>0; i--) {
+            *dest++ = value;
+        }
+    }
+    else {
+        while (--length >= 0) {
+            *dest++ = value;
+        }
+    }
 }
 
 /** Platform Debug Triggers <BR>
@@ -713,6 +898,220 @@ void platform_swdelay_us(ot_u16 n) {
 	for (; c>0; c--);
 }
 
+/** Platform AES128 Routines <BR>
+  * ========================================================================<BR>
+  * The STM32L1 AES engine keeps its key registers while it is disabled, so the
+  * key is only written when it differs from the last one, and the decryption
+  * key is only derived once per key.  Multi-block jobs are fed by DMA2: 
+  * channel 5 writes AES_DINR and channel 3 reads AES_DOUTR, and the channel 3 
+  * transfer-complete interrupt ends background jobs.  Jobs shorter than 
+  * AES_DMA_THRESHOLD blocks go through the CPU, because setting up two DMA
+  * channels costs more than it saves on one block.
+  */
+#if (MCU_FEATURE(AES128) == ENABLED)
+
+#ifndef AES_DMA_THRESHOLD
+#   define AES_DMA_THRESHOLD    2
+#endif
+
+#define AES_OP_NONE         0xFFFFFFFF
+#define AES_OP_ENCRYPT      0
+#define AES_OP_DERIVE       AES_CR_MODE_0
+#define AES_OP_DECRYPT      AES_CR_MODE_1
+#define AES_DATATYPE_8b     AES_CR_DATATYPE_1       // byte-swapped words
+#define AES_DMAIN_CHAN      DMA2_Channel5
+#define AES_DMAOUT_CHAN     DMA2_Channel3
+#define AES_DMA_CLEAR       (DMA_IFCR_CGIF3 | DMA_IFCR_CGIF5)
+
+typedef struct {
+    ot_u32          key[4];         // copy of the key in the engine
+    ot_u32          keyop;          // AES_OP_ENCRYPT, _DECRYPT, or _NONE
+    volatile ot_int blocks;         // blocks left in a DMA job
+    ot_sig          callback;
+} aes_struct;
+
+static aes_struct platform_aes = { {0, 0, 0, 0}, AES_OP_NONE, 0, NULL };
+
+
+
+void sub_aes_loadkey(ot_u32* key, ot_u32 op) {
+/// The key registers are big-endian and are not swapped by DATATYPE, and they
+/// can only be written while the engine is disabled.
+    if ((platform_aes.keyop == op)      && \
+        (platform_aes.key[0] == key[0]) && (platform_aes.key[1] == key[1]) && \
+        (platform_aes.key[2] == key[2]) && (platform_aes.key[3] == key[3])) {
+        return;
+    }
+
+    AES->CR     = 0;
+    AES->KEYR3  = __REV(key[0]);
+    AES->KEYR2  = __REV(key[1]);
+    AES->KEYR1  = __REV(key[2]);
+    AES->KEYR0  = __REV(key[3]);
+
+    /// Mode 2 leaves the derived decryption key in the key registers
+    if (op == AES_OP_DECRYPT) {
+        AES->CR = AES_OP_DERIVE | AES_CR_EN;
+        while ((AES->SR & AES_SR_CCF) == 0);
+        AES->CR = AES_CR_CCFC;
+    }
+
+    platform_aes.key[0] = key[0];
+    platform_aes.key[1] = key[1];
+    platform_aes.key[2] = key[2];
+    platform_aes.key[3] = key[3];
+    platform_aes.keyop  = op;
+}
+
+
+void sub_aes_cpu(ot_u32* input, ot_u32* output, ot_int blocks, ot_u32 op) {
+/// Each block is read in completely before its output is written, so input
+/// and output may be the same buffer.  The same holds for the DMA, because
+/// the engine does not request input until the last output word is read.
+    AES->CR = op | AES_DATATYPE_8b | AES_CR_EN;
+
+    for (; blocks > 0; blocks--) {
+        AES->DINR   = input[0];
+        AES->DINR   = input[1];
+        AES->DINR   = input[2];
+        AES->DINR   = input[3];
+        input      += 4;
+        while ((AES->SR & AES_SR_CCF) == 0);
+        AES->CR    |= AES_CR_CCFC;
+        output[0]   = AES->DOUTR;
+        output[1]   = AES->DOUTR;
+        output[2]   = AES->DOUTR;
+        output[3]   = AES->DOUTR;
+        output     += 4;
+    }
+
+    AES->CR = 0;
+}
+
+
+void sub_aes_dmastart(ot_u32* input, ot_u32* output, ot_int blocks, ot_u32 op, ot_u32 ie) {
+    ot_int words = (blocks << 2);
+
+    AES->CR                 = 0;
+    AES_DMAIN_CHAN->CCR     = 0;
+    AES_DMAOUT_CHAN->CCR    = 0;
+    DMA2->IFCR              = AES_DMA_CLEAR;
+
+    AES_DMAIN_CHAN->CPAR    = (ot_u32)&AES->DINR;
+    AES_DMAIN_CHAN->CMAR    = (ot_u32)input;
+    AES_DMAIN_CHAN->CNDTR   = words;
+    AES_DMAOUT_CHAN->CPAR   = (ot_u32)&AES->DOUTR;
+    AES_DMAOUT_CHAN->CMAR   = (ot_u32)output;
+    AES_DMAOUT_CHAN->CNDTR  = words;
+
+    AES_DMAOUT_CHAN->CCR    = DMA_DIR_PeripheralSRC       | \
+                              DMA_Mode_Normal             | \
+                              DMA_PeripheralInc_Disable   | \
+                              DMA_MemoryInc_Enable        | \
+                              DMA_PeripheralDataSize_Word | \
+                              DMA_MemoryDataSize_Word     | \
+                              DMA_Priority_VeryHigh       | \
+                              DMA_M2M_Disable             | \
+                              ie                          | \
+                              DMA_CCR1_EN;
+    AES_DMAIN_CHAN->CCR     = DMA_DIR_PeripheralDST       | \
+                              DMA_Mode_Normal             | \
+                              DMA_PeripheralInc_Disable   | \
+                              DMA_MemoryInc_Enable        | \
+                              DMA_PeripheralDataSize_Word | \
+                              DMA_MemoryDataSize_Word     | \
+                              DMA_Priority_High           | \
+                              DMA_M2M_Disable             | \
+                              DMA_CCR1_EN;
+
+    AES->CR = op | AES_DATATYPE_8b | AES_CR_DMAINEN | AES_CR_DMAOUTEN | AES_CR_EN;
+}
+
+
+ot_int sub_aes_dmastop() {
+/// Returns -1 if either channel had a transfer error
+    ot_int result;
+
+    result                  = (DMA2->ISR & (DMA_ISR_TEIF3 | DMA_ISR_TEIF5)) ? -1 : 0;
+    AES->CR                 = 0;
+    AES_DMAIN_CHAN->CCR     = 0;
+    AES_DMAOUT_CHAN->CCR    = 0;
+    DMA2->IFCR              = AES_DMA_CLEAR;
+
+    if (result < 0) {
+        platform_aes.keyop  = AES_OP_NONE;
+    }
+    return result;
+}
+
+
+void sub_aes_run(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks, ot_u32 op) {
+    while (platform_aes_busy());
+
+    sub_aes_loadkey(key, op);
+    if (blocks < AES_DMA_THRESHOLD) {
+        sub_aes_cpu(input, output, blocks, op);
+    }
+    else {
+        sub_aes_dmastart(input, output, blocks, op, 0);
+        while ((DMA2->ISR & (DMA_ISR_TCIF3 | DMA_ISR_TEIF3 | DMA_ISR_TEIF5)) == 0);
+        sub_aes_dmastop();
+    }
+}
+
+
+void platform_aes_encrypt(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks) {
+    sub_aes_run(input, output, key, blocks, AES_OP_ENCRYPT);
+}
+
+
+void platform_aes_decrypt(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks) {
+    sub_aes_run(input, output, key, blocks, AES_OP_DECRYPT);
+}
+
+
+void platform_aes_start(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks,
+                        ot_bool decrypt, ot_sig callback ) {
+    ot_u32 op = (decrypt) ? AES_OP_DECRYPT : AES_OP_ENCRYPT;
+
+    while (platform_aes_busy());
+
+    if (blocks <= 0) {
+        if (callback != NULL) {
+            callback(0);
+        }
+        return;
+    }
+
+    sub_aes_loadkey(key, op);
+    platform_aes.callback   = callback;
+    platform_aes.blocks     = blocks;
+    sub_aes_dmastart(input, output, blocks, op, (DMA_CCR1_TCIE | DMA_CCR1_TEIE));
+}
+
+
+ot_bool platform_aes_busy() {
+    return (ot_bool)(platform_aes.blocks != 0);
+}
+
+
+void DMA2_Channel3_IRQHandler(void) {
+/// AES output channel: the job is done, or the channel faulted
+    ot_int result;
+
+    result = sub_aes_dmastop();
+    if (result == 0) {
+        result = platform_aes.blocks;
+    }
+    platform_aes.blocks = 0;
+
+    if (platform_aes.callback != NULL) {
+        platform_aes.callback(result);
+    }
+}
+
+#endif /* (MCU_FEATURE(AES128) == ENABLED) */
+
 #if (MCU_FEATURE(CRC) == ENABLED)
 #endif /* (MCU_FEATURE(CRC) == ENABLED) */
 
@@ -754,12 +1153,38 @@ platform_get_gptim()
     return OT_GPTIM->CNT;
 }
 
+ot_u32
+platform_stamp()
+{
+    return sub_gptim_count();
+}
+
+#if (OT_FEATURE(PROFILER) == ENABLED)
+/// The CMSIS core header in this tree does not describe the DWT unit
+#define DWT_CTRL        (*(volatile ot_u32*)0xE0001000)
+#define DWT_CYCCNT      (*(volatile ot_u32*)0xE0001004)
+
+ot_u32
+platform_get_cycles()
+{
+    // Turn on the cycle counter the first time it is used
+    if ((DWT_CTRL & 1) == 0) {
+        CoreDebug->DEMCR   |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT_CYCCNT          = 0;
+        DWT_CTRL           |= 1;
+    }
+    return DWT_CYCCNT;
+}
+#endif
+
 static void
 sub_gptim_unattach()
 {
     // Stop GPTIM, resume in continuous mode with interrupt off.
     TIM_Cmd(OT_GPTIM, DISABLE);    // TI: MC=00b stop mode
+    gptim_epoch = sub_gptim_count();
     TIM_SetCounter(OT_GPTIM, 0);    // TI: TACLR
+    OT_GPTIM->SR = ~TIM_SR_UIF;     // wrap is in the epoch now
     TIM_SetAutoreload(OT_GPTIM, 0xffff);    // TI: "continuous" timer mode
     TIM_ITConfig(OT_GPTIM, TIM_IT_CC1, DISABLE);    // TI: TAIE off
     TIM_Cmd(OT_GPTIM, ENABLE);
@@ -777,31 +1202,36 @@ platform_flush_gptim()
 void
 platform_ot_run()
 {
-    ot_u16 next_event;
+    ot_u32 next_event;
     ot_u16 elapsed_time;
-    
+
     elapsed_time = OT_GPTIM->CCR1;
     //debug_printf("otrun: %d:%d\r\n", OT_GPTIM->CNT, OT_GPTIM->CCR1);
     if (OT_GPTIM->CNT != OT_GPTIM->CCR1) {
         asm("nop");
     }
-    
+
     /// Clear and disable the timer interrupt while in the ISR
     /// (Also stop it, and restart it in continuous mode).
     sub_gptim_unattach();
-    
+
     next_event = sys_event_manager( elapsed_time );
     /* next_event will be 1 if nextevent occured during radio i/o */
 
+    /// GPTIM is only 16 bits here (no kernel timer extension), so the
+    /// kernel comes back at least every 65535 ticks.
+    if (next_event > 65535) {
+        next_event = 65535;
+    }
+
     /// Flush GPTIM and switch it back to up-counting interrupt mode
-    sub_gptim_reattach(next_event);
+    sub_gptim_reattach((ot_u16)next_event);
 }
 
-void
-sleep_mcu(void)
+static void
+sub_mcu_wake(void)
 {
-    PWR_EnterSleepMode(PWR_Regulator_LowPower, PWR_SLEEPEntry_WFI);
-
+    // The kernel runs here, in main loop context, after the GPTIM interrupt
 #ifdef RADIO_DEBUG
     console_service();
 #endif
@@ -818,3 +1248,30 @@ sleep_mcu(void)
 
 }
 
+void
+sleep_mcu(void)
+{
+    PWR_EnterSleepMode(PWR_Regulator_LowPower, PWR_SLEEPEntry_WFI);
+    sub_mcu_wake();
+}
+
+#if (OT_FEATURE(POWERMGR) == ENABLED)
+void
+platform_enter_lpm(ot_u8 mode)
+{
+    // WFI wakes up on a pending interrupt even with interrupts on hold, so the
+    // interrupts are enabled after the sleep.  STOP comes back on MSI, so the
+    // system clocks are set up again before the ISR runs.
+    if (mode == 0) {
+        PWR_EnterSleepMode(PWR_Regulator_LowPower, PWR_SLEEPEntry_WFI);
+    }
+    else {
+        PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+        SystemInit();
+        platform_init_busclk();
+    }
+    __enable_irq();
+    sub_mcu_wake();
+}
+#endif
+
@@ -49,6 +49,10 @@
 #define PLATFORM_POINTER_SIZE       4               // How many bytes is a pointer?
 #define PLATFORM_ENDIAN16(VAR16)    __REV16(VAR16)  // Big-endian to Platform-endian
 #define PLATFORM_ENDIAN32(VAR32)    __REV(VAR32)    // Big-endian to Platform-endian
+#define PLATFORM_UNALIGNED          ENABLED         // LDRH/LDR/STRH/STR at any address
+#ifndef PLATFORM_STACK_SIZE
+#   define PLATFORM_STACK_SIZE      960             // Paint size (linker __Stack_Size is 1024)
+#endif
 
 
 /** Low Power Mode Macros:
@@ -72,6 +76,47 @@
 
 void sleep_mcu(void);
 
+
+/** Low Power Mode Table, for the kernel Power Manager (OT_FEATURE(POWERMGR))
+  * Mode 0 is SLEEP and mode 1 is STOP.  STOP stops the APB clock of GPTIM, so
+  * it is only used when the kernel has nothing scheduled.  The wakeup from
+  * STOP is about 8 us, and then SystemInit() has to start HSI and the PLL
+  * again, which is the clock restart cost.  Times are in STI (1/32768 sec).
+  */
+#define PLATFORM_LPM_MODES          2
+#define PLATFORM_LPM_UNTIMED        1
+#define PLATFORM_LPM_WAKE_STI       { 0, 1 }
+#define PLATFORM_LPM_CLKSTART_STI   8
+
+
+/** Interrupt Priorities <BR>
+  * NVIC pre-emption priorities (0 is highest) in PLATFORM_NVIC_GROUP, which
+  * with group 2 are 0-3.  Only a higher pre-emption priority interrupts a
+  * running handler, so the radio has the highest one to itself.  Then a long
+  * MPipe or kernel handler cannot hold off the radio ISRs and overflow the
+  * FIFO.  The subpriorities, which only order pending interrupts, are set in
+  * platform_init_interruptor().
+  */
+#ifndef PLATFORM_NVIC_GROUP
+#   define PLATFORM_NVIC_GROUP      NVIC_PriorityGroup_2
+#endif
+#ifndef PLATFORM_PRIO_RADIO
+#   define PLATFORM_PRIO_RADIO      0           // Radio GPIO interrupts
+#endif
+#ifndef PLATFORM_PRIO_MPIPE
+#   define PLATFORM_PRIO_MPIPE      1           // MPipe and AES DMA
+#endif
+#ifndef PLATFORM_PRIO_KERNEL
+#   define PLATFORM_PRIO_KERNEL     1           // GPTIM, RX timer
+#endif
+#ifndef PLATFORM_PRIO_APP
+#   define PLATFORM_PRIO_APP        1           // SPI2, USART3, APPTIM
+#endif
+#if (   (PLATFORM_PRIO_RADIO >= PLATFORM_PRIO_MPIPE) \
+     || (PLATFORM_PRIO_RADIO >= PLATFORM_PRIO_KERNEL) )
+#   error "The radio must have the highest NVIC pre-emption priority"
+#endif
+
 /**********************************************************************/
 
 #ifndef BLOCKING_UART_TX
@@ -85,7 +130,11 @@ void sleep_mcu(void);
     void spi_save_restore(ot_bool); // from radio driver
     // USART3 for temporary debug scaffolding
     #include <stdio.h>
-    #define debug_printf     printf
+    #ifdef DEBUG_DEFER_PRINTF
+    #   define debug_printf     debug_deferf
+    #else
+    #   define debug_printf     printf
+    #endif
 #else
     #define debug_printf    // does nothing
 #endif /* !RADIO_DEBUG */
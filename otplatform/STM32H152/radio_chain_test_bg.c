@@ -192,9 +192,9 @@ make_session()
     q_start(&rxq, 0, 0);
     
     
-    /// Create a new ad-hoc session on channel 0x10.  Fill up the remaining
+    /// Create a new ad-hoc session on the test channel.  Fill up the remaining
     /// session parameters with [effectively] dummy values.
-    session = session_new(0, M2_NETSTATE_INIT, 0x10);
+    session = session_new(0, M2_NETSTATE_INIT, test_channel);
     if (session == NULL) {
         debug_printf("-> Session could not be created (Fatal error)\r\n");
         return -1;
@@ -203,7 +203,6 @@ make_session()
     session->subnet     = 0xF0;
     session->protocol   = 0x51;
     session->flags      = 0;
-    session->channel    = test_channel;
     
     
     /// Setup System Comm Variables, which are used by the MAC, Network, and
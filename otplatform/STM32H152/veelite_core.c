@@ -12,53 +12,100 @@
 #error VSRAM_SIZE_is_zero
 #endif
 
+/** Data EEPROM geometry
+  * VWORM_EEPROM_SIZE is the data EEPROM of the device, in bytes.  Any access
+  * past it returns an error (or NULL_vaddr on reads) rather than faulting.
+  * VWORM_EEPROM_DWORD lets vworm_write_block() program aligned 8 byte spans
+  * with the double word command, which is half the time of two word writes
+  * but runs from RAM (__RAM_FUNC) with interrupts held off for the write.
+  */
+#ifndef VWORM_EEPROM_SIZE
+#   if (defined(EEPROM_SIZE) && (EEPROM_SIZE > 0))
+#       define VWORM_EEPROM_SIZE    EEPROM_SIZE
+#   else
+#       define VWORM_EEPROM_SIZE    4096
+#   endif
+#endif
+#ifndef VWORM_EEPROM_DWORD
+#   define VWORM_EEPROM_DWORD       DISABLED
+#endif
+
+#define EE_FLAGS    (FLASH_FLAG_EOP | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | \
+                     FLASH_FLAG_SIZERR | FLASH_FLAG_OPTVERR)
+
 volatile ot_u16*  _vworm;
+static ot_u8      ee_burst = 0;     // nesting of sub_ee_open()
 
-ot_u16 vworm_read(vaddr addr) {
-/*    ot_u16 ret;
-    ret = _vworm[addr >> 1];
-    //debug_printf("%04x = vworm_read(%04x) at %p\r\n", ret, addr, &_vworm[addr >> 1]);
-    return ret;*/
-    if (addr > 4095) {
-        /* STM32L1xx: reading beyond memory would probably cause hard fault */
-        for (;;)
-            asm("nop"); // this device only has 4k of eeprom
+vworm_stats_struct vworm_stats;   // data EEPROM has no erase cycles to count
+ot_u16 vworm_mapstamp;              // data EEPROM is never remapped
+
+
+/** Data EEPROM write bursts
+  * The EEPROM is unlocked once for a whole burst (a block write or a wipe),
+  * not once per word.  Bursts can nest: the outer one locks it again.
+  */
+static void sub_ee_open() {
+    if (ee_burst++ == 0) {
+        DATA_EEPROM_Unlock();
+        FLASH_ClearFlag(EE_FLAGS);
     }
+}
+
+static void sub_ee_close() {
+    if (--ee_burst == 0)
+        DATA_EEPROM_Lock();
+}
+
+static ot_bool sub_ee_inbounds(vaddr addr, ot_uint length) {
+    return (ot_bool)(((ot_u32)addr + (ot_u32)length) <= VWORM_EEPROM_SIZE);
+}
+
+/// Programs an aligned word, unless it already holds the data.  The fast mode
+/// (FTDW off) skips the erase phase when the old word is already zero.
+static ot_u8 sub_ee_word(ot_u32 offset, ot_u32 data) {
+    if (*(volatile ot_u32*)(EEPROM_START_ADDR + offset) == data)
+        return 0;
+    return (ot_u8)(DATA_EEPROM_FastProgramWord(EEPROM_START_ADDR+offset, data) != FLASH_COMPLETE);
+}
+
+static ot_u8 sub_ee_byte(ot_u32 offset, ot_u8 data) {
+    if (*(volatile ot_u8*)(EEPROM_START_ADDR + offset) == data)
+        return 0;
+    return (ot_u8)(DATA_EEPROM_FastProgramByte(EEPROM_START_ADDR+offset, data) != FLASH_COMPLETE);
+}
+
+
+
+ot_u16 vworm_read(vaddr addr) {
+    if (sub_ee_inbounds(addr, 2) == False)
+        return NULL_vaddr;
 
     return _vworm[addr >> 1];
 }
 
 ot_u8 vworm_write(vaddr addr, ot_u16 data) {
-    ot_u32 Address;
     FLASH_Status status;
 
 #ifdef RADIO_DEBUG   // 18
     debug_printf("vworm_write(%x, %x)\r\n", addr, data);
 #endif /* RADIO_DEBUG */
-    DATA_EEPROM_Unlock();
-
-    /* Clear all pending flags */
-    FLASH_ClearFlag(FLASH_FLAG_EOP|FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
-                            FLASH_FLAG_SIZERR | FLASH_FLAG_OPTVERR);
-    Address = EEPROM_START_ADDR + addr;
-    status = DATA_EEPROM_ProgramHalfWord(Address, data);
+    if (sub_ee_inbounds(addr, 2) == False)
+        return 1;   // return non-zero on fault
 
-    DATA_EEPROM_Lock();
+    sub_ee_open();
+    status = DATA_EEPROM_FastProgramHalfWord(EEPROM_START_ADDR + addr, data);
+    sub_ee_close();
 
-    if (status == FLASH_COMPLETE)
-        return 0;
-    else
-        return 1;   // return non-zero on fault
+    return (ot_u8)(status != FLASH_COMPLETE);
 }
 
 ot_u16 vsram_read(vaddr addr) {
     addr -= VSRAM_BASE_VADDR;
     addr >>= 1;
     //debug_printf("%04x = vsram_read(%x)\r\n", vsram[addr], addr);
-    if (addr > (VSRAM_SIZE/2) ) {
-        for (;;)
-            asm("nop");
-    }
+    if (addr >= (VSRAM_SIZE/2) )
+        return NULL_vaddr;
+
     return vsram[addr];
 }
 
@@ -69,7 +116,7 @@ ot_u8 vsram_mark(vaddr addr, ot_u16 value) {
     debug_printf("vsram_mark(%x, %x)\r\n", addr, value);
 #endif /* RADIO_DEBUG */
 
-    if ( addr > (VSRAM_SIZE/2) )
+    if ( addr >= (VSRAM_SIZE/2) )
         return 1;   // non-zero for fault
 
     vsram[addr] = value;
@@ -103,18 +150,149 @@ ot_u8 vworm_wipeblock(vaddr addr, ot_uint wipe_span) {
     return ~0;
     
 #else
-    ot_u8 output = 0;
-    
-    wipe_span += addr;
-    for (; ((addr < (vaddr)wipe_span) && (output == 0)); addr+=2) {
-        output |= vworm_write(addr, NULL_vaddr);
+    ot_u32 offset;
+    ot_u32 end;
+    ot_u8  output = 0;
+
+    if (sub_ee_inbounds(addr, wipe_span) == False)
+        return 1;
+
+    /* Wipe the span to NULL_vaddr a word at a time, skipping words that are
+     * already wiped.  Halfwords are only used at unaligned edges. */
+    offset  = addr & ~1;
+    end     = (ot_u32)addr + wipe_span;
+    sub_ee_open();
+    if ((offset & 2) && (offset < end)) {
+        output |= vworm_write((vaddr)offset, NULL_vaddr);
+        offset += 2;
     }
-    
+    for (; ((offset+4) <= end) && (output == 0); offset+=4) {
+        output |= sub_ee_word(offset, 0xFFFFFFFF);
+    }
+    if ((offset < end) && (output == 0)) {
+        output |= vworm_write((vaddr)offset, NULL_vaddr);
+    }
+    sub_ee_close();
+
     return output;
 
 #endif
 }
 
+ot_u8 vworm_flush( ) {
+    /* data EEPROM is written word by word, so there is no page cache */
+    return 0;
+}
+
+ot_u8 vworm_window(ot_bool open) {
+    /* data EEPROM writes never erase a page, so nothing is deferred */
+    return 0;
+}
+
+ot_u8 vworm_save_snapshot(const vworm_span* span, ot_int spans) {
+    /* data EEPROM has no block table to save, and no spare page for spans */
+    return 0;
+}
+
+ot_u8 vworm_load_snapshot(const vworm_span* span, ot_int spans) {
+    return 1;
+}
+
+ot_u16 vworm_wear(ot_int page) {
+    /* data EEPROM is not erased by pages, so there is no page wear */
+    return 0;
+}
+
+ot_u8 vworm_factory( ) {
+    /* the stock files are linked into the data EEPROM, so there is no image */
+    return 255;
+}
+
+const ot_u8* vworm_get_direct(vaddr addr, ot_uint length) {
+    if (sub_ee_inbounds(addr, length) == False) {
+        return NULL;
+    }
+
+    /* data EEPROM is memory-mapped, so every span can be read in place */
+    return (const ot_u8*)_vworm + addr;
+}
+
+ot_u8 vworm_read_block(vaddr addr, ot_u8* data, ot_uint length) {
+    if (sub_ee_inbounds(addr, length) == False)
+        return 1;   // non-zero for fault
+
+    /* data EEPROM is memory-mapped and contiguous, so no page handling */
+    platform_memcpy(data, (ot_u8*)_vworm + addr, (ot_int)length);
+    return 0;
+}
+
+ot_u8 vworm_write_block(vaddr addr, ot_u8* data, ot_uint length) {
+    ot_u32 offset;
+    ot_u32 word[2];
+    ot_u8  test = 0;
+
+    if (sub_ee_inbounds(addr, length) == False)
+        return 1;   // non-zero for fault
+
+    /* Bytes up to the first word boundary, then whole words (or double words)
+     * and then the bytes that are left.  Unchanged data is not written. */
+    offset = addr;
+    sub_ee_open();
+    for (; (length != 0) && (offset & 3); offset++, length--) {
+        test |= sub_ee_byte(offset, *data++);
+    }
+    while ((length >= 4) && (test == 0)) {
+#       if (VWORM_EEPROM_DWORD == ENABLED)
+        if (((offset & 7) == 0) && (length >= 8)) {
+            volatile ot_u32* dest = (volatile ot_u32*)(EEPROM_START_ADDR + offset);
+            platform_memcpy((ot_u8*)word, data, 8);
+            if ((dest[0] != word[0]) || (dest[1] != word[1])) {
+                test    = (ot_u8)(DATA_EEPROM_ProgramDoubleWord(EEPROM_START_ADDR+offset,
+                                    ((uint64_t)word[1] << 32) | word[0]) != FLASH_COMPLETE);
+                data   += 8;
+                offset += 8;
+                length -= 8;
+                continue;
+            }
+        }
+#       endif
+        platform_memcpy((ot_u8*)word, data, 4);   // data may be unaligned
+        test   |= sub_ee_word(offset, word[0]);
+        data   += 4;
+        offset += 4;
+        length -= 4;
+    }
+    for (; (length != 0) && (test == 0); offset++, length--) {
+        test |= sub_ee_byte(offset, *data++);
+    }
+    sub_ee_close();
+
+    return test;
+}
+
+ot_u8 vworm_restore(vaddr addr, ot_uint length) {
+/// The stock files are linked into VWORM itself, so no stock image is kept
+    return 255;
+}
+
+ot_u8 vsram_read_block(vaddr addr, ot_u8* data, ot_uint length) {
+    addr -= VSRAM_BASE_VADDR;
+    if ((addr + length) > VSRAM_SIZE)
+        return 1;   // non-zero for fault
+
+    platform_memcpy(data, (ot_u8*)vsram + addr, (ot_int)length);
+    return 0;
+}
+
+ot_u8 vsram_write_block(vaddr addr, ot_u8* data, ot_uint length) {
+    addr -= VSRAM_BASE_VADDR;
+    if ((addr + length) > VSRAM_SIZE)
+        return 1;   // non-zero for fault
+
+    platform_memcpy((ot_u8*)vsram + addr, data, (ot_int)length);
+    return 0;
+}
+
 
 /* accessing files here prevents compiler from optimizing them away */
 extern const ot_u8 overhead_files[];
@@ -134,8 +312,7 @@ ot_u8 vworm_init( )
 #ifdef RADIO_DEBUG   // 19
         debug_printf("overhead_files bad addr.  %p vs %p\r\n", overhead_files, (ot_u8 *)EEPROM_START_ADDR);
 #endif /* RADIO_DEBUG */
-        for (;;)
-            asm("nop");
+        return 1;
     }
 
     if ( isfs_stock_codes != (ot_u8 *)(EEPROM_START_ADDR + ISFS_START_VADDR) ) {
@@ -143,8 +320,7 @@ ot_u8 vworm_init( )
         debug_printf("isfs_stock_codes at %p bad vs %p\r\n",
             isfs_stock_codes, (ot_u8 *)(EEPROM_START_ADDR + ISFS_START_VADDR) );
 #endif /* RADIO_DEBUG */
-        for (;;)
-            asm("nop");
+        return 1;
     } 
 
 #if (GFB_TOTAL_BYTES > 0)
@@ -152,8 +328,7 @@ ot_u8 vworm_init( )
 #ifdef RADIO_DEBUG   // 21
         debug_printf("gfb_stock_files bad addr %x\r\n", EEPROM_START_ADDR + GFB_START_VADDR);
 #endif /* RADIO_DEBUG */
-        for (;;)
-            asm("nop");
+        return 1;
     }
 #endif /* if (GFB_TOTAL_BYTES > 0) */
     
@@ -162,8 +337,7 @@ ot_u8 vworm_init( )
 #ifdef RADIO_DEBUG   // 22
         debug_printf("isf_stock_files bad addr %x\r\n", EEPROM_START_ADDR + ISF_START_VADDR);
 #endif /* RADIO_DEBUG */
-        for (;;)
-            asm("nop");
+        return 1;
     }
 
     /* initialize pointer to eeprom */
@@ -17,37 +17,46 @@
   * @file       /otplatform/cc430/mpipe_CC430_i2c.c
   * @author     JP Norair
   * @version    V1.0
-  * @date       1 July 2012
-  * @brief      Message Pipe (MPIPE) implementation(s) for CC430
+  * @date       15 October 2012
+  * @brief      Message Pipe (MPIPE) I2C slave implementation for CC430
   * @defgroup   MPipe (Message Pipe)
   * @ingroup    MPipe
   *
   * As far as I know, the CC430 has the ability to use the following peripherals
   * for the MPIPE.  This list may change over time as new models of the CC430
-  * are released.  This is the I2C implementation.  Speed is 400kbps.
+  * are released.  This is the I2C implementation.
   *     I/F     HW      Impl.   Baudrate Notes
-  * 1.  UART    USCI    yes     Keep baudrate <= 115.2 kbps
+  * 1.  UART    USCI    yes     Up to SMCLK/3 (3 Mbps at most)
   * 2.  SPI     USCI    no      Potentially up to 5 Mbps, using SMCLK
-  * 3.  I2C     USCI    no      100 or 400 kbps
+  * 3.  I2C     USCI    yes     Slave, 100 or 400 kbps (the host sets it)
   * 4.  IrDA    USCI    no      Need more information
   *
+  * The CC430 is an I2C slave at MPIPE_I2C_SELF, for a host MCU that uses it
+  * as a co-processor.  Both directions use the DMA.  The USCI stretches the
+  * clock only while the DMA is set up: at the START of a transfer, after the
+  * NDEF header of a written frame, and after the status of a read.
+  *
   * Design Assumptions:
-  * - Using SMCLK at 2.49625 MHz Clock (19.97 MHz / 8)
-  * - Using UART0
-  * - If changing the input frequency, changes need to be made to implementation
-  *   of setspeed function.
-  * - If changing to another UART, changes to platform_config_CC430.h and to
-  *   some macros in this file will be needed
+  * - Using a USCI_B (MPIPE_I2C) and one DMA channel (MPIPE_DMANUM)
+  * - One transfer per START ... STOP (no repeated START between a write and
+  *   a read)
   *
   * Implemented Mpipe Protocol:
   * The Mpipe protocol is a simple wrapper to NDEF.
   * Legend: [ NDEF Header ] [ NDEF Payload ] [ Seq. Number ] [ CRC16 ]
   * Bytes:        6             <= 255             2             2
   *
-  * The protocol includes an ACK/NACK feature.  After receiving a message, the
-  * Mpipe send an ACK/NACK.  The "YY" byte is 0 for ACK and non-zero for ACK.
-  * Presently, 0x7F is used as the YY NACK value.
-  * [ Seq ID ] 0xDD 0x00 0x00 0x02 0x00 0xYY  [ CRC16 ]
+  * Host write: one MPipe frame.  There are no ACK frames on I2C: the bus ACKs
+  * each byte, and a frame with a bad CRC (or one that is cut short, or sent
+  * while the CC430 is not listening) sets MPIPE_I2C_RXERROR, so the host
+  * sends it again.
+  *
+  * Host read: the status, then the frame that the CC430 has to send, if any.
+  * Legend: [ Status ] [ Frame Length ] [ Frame ]
+  * Bytes:      1            2          0 to 265
+  * The host polls by reading the 3 status bytes alone.  A read that stops
+  * before the end of the frame leaves the frame in place, and the next read
+  * starts with the status again.  Bytes read past the end are 0xFF.
   ******************************************************************************
   */
 
@@ -57,14 +66,30 @@
 #if ((OT_FEATURE(MPIPE) == ENABLED) && defined(MPIPE_I2C))
 
 #include "mpipe.h"
+#include "system.h"
 #include "OT_platform.h"
 
-#define UART_CLOSE()        (MPIPE_I2C->CTL1   |= UCSWRST)
-#define UART_OPEN()         (MPIPE_I2C->CTL1   &= ~UCSWRST)
-#define UART_SET_TXIFG()    (MPIPE_I2C->IFG    |= UCTXIFG)
-#define UART_CLEAR_TXIFG()  (MPIPE_I2C->IFG    &= ~UCTXIFG)
-#define UART_SET_RXIFG()    (MPIPE_I2C->IFG    |= UCRXIFG)
-#define UART_CLEAR_RXIFG()  (MPIPE_I2C->IFG    &= ~UCRXIFG)
+
+/// Status byte, the first byte of every host read
+#define MPIPE_I2C_RXREADY   0x01    // listening, the host may write a frame
+#define MPIPE_I2C_TXREADY   0x02    // a frame is waiting to be read
+#define MPIPE_I2C_RXERROR   0x04    // last frame written was lost, send again
+
+/// USCI_B I2C: CTLW0 is CTL1 (low byte) and CTL0 (high byte), ICTL is IE (low
+/// byte) and IFG (high byte)
+#define I2C_CTLW0_SLAVE     ((UCMODE_3 | UCSYNC) << 8)
+#define I2C_CLOSE()         (MPIPE_I2C->CTLW0  |= UCSWRST)
+#define I2C_OPEN()          (MPIPE_I2C->CTLW0  &= ~UCSWRST)
+#define I2C_ISTX()          (MPIPE_I2C->CTLW0 & UCTR)
+#define I2C_IE_BASE         (UCSTTIE | UCSTPIE)
+#define I2C_TXIFG           (UCTXIFG << 8)
+#define I2C_RXIFG           (UCRXIFG << 8)
+
+/// I2C IV values
+#define I2C_IV_START        0x06
+#define I2C_IV_STOP         0x08
+#define I2C_IV_RX           0x0A
+#define I2C_IV_TX           0x0C
 
 
 
@@ -77,15 +102,6 @@
                                       DMA_TriggerLevel_RisingEdge | \
                                       0x0014 )
 
-// Setup DMA for RX, but disable / do not enable
-#define MPIPE_DMA_RXCTL_OFF         ( DMA_Mode_Single | \
-                                      DMA_DestinationInc_Enable | \
-                                      DMA_SourceInc_Disable | \
-                                      DMA_DestinationDataSize_Byte | \
-                                      DMA_SourceDataSize_Byte | \
-                                      DMA_TriggerLevel_RisingEdge | \
-                                      0x0004 )
-
 // Setup DMA for TX, and enable it
 #define MPIPE_DMA_TXCTL_ON          ( DMA_Mode_Single | \
                                       DMA_DestinationInc_Disable | \
@@ -95,44 +111,54 @@
                                       DMA_TriggerLevel_RisingEdge | \
                                       0x0014 )
 
-// Setup DMA for TX, but disable / do not enable
-#define MPIPE_DMA_TXCTL_OFF         ( DMA_Mode_Single | \
-                                      DMA_DestinationInc_Disable | \
-                                      DMA_SourceInc_Enable | \
-                                      DMA_DestinationDataSize_Byte | \
-                                      DMA_SourceDataSize_Byte | \
-                                      DMA_TriggerLevel_RisingEdge | \
-                                      0x0004 )
+#if (MCU_FEATURE(MPIPEDMA) != ENABLED)
+#   error "Mpipe requires a DMA in this implementation"
+#elif (MPIPE_DMANUM == 0)
+#   define MPIPE_DMA_TRIGSEL(TRIG)  (DMA->CTL0 = (DMA->CTL0 & 0xFF00) | (TRIG))
+#   define MPIPE_DMA_IV             2
+#elif (MPIPE_DMANUM == 1)
+#   define MPIPE_DMA_TRIGSEL(TRIG)  (DMA->CTL0 = (DMA->CTL0 & 0x00FF) | ((TRIG) << 8))
+#   define MPIPE_DMA_IV             4
+#elif (MPIPE_DMANUM == 2)
+#   define MPIPE_DMA_TRIGSEL(TRIG)  (DMA->CTL1 = (DMA->CTL1 & 0xFF00) | (TRIG))
+#   define MPIPE_DMA_IV             6
+#else
+#   error "MPIPE_DMANUM is set to a DMA that does not exist on this device"
+#endif
+
+/// The DMA starts on the rising edge of the USCI flag.  When the flag is up
+/// already (the USCI is stretching the clock), it is raised again.
+#define MPIPE_DMA_KICK(IFG) \
+    do { \
+        if (MPIPE_I2C->ICTL & (IFG)) { \
+            MPIPE_I2C->ICTL &= ~(IFG); \
+            MPIPE_I2C->ICTL |= (IFG); \
+        } \
+    } while(0)
 
-#define MPIPE_DMA_RXCONFIG(DEST, SIZE, ONOFF) \
+#define MPIPE_DMA_RXCONFIG(DEST, SIZE) \
     do { \
+        MPIPE_DMA_TRIGSEL(MPIPE_I2C_RXTRIG); \
         MPIPE_DMA->SA_L = (ot_u16)&(MPIPE_I2C->RXBUF); \
-        MPIPE_DMA->DA_L = (ot_u16)DEST; \
-        MPIPE_DMA->SZ   = SIZE; \
-        MPIPE_DMA->CTL  = MPIPE_DMA_RXCTL_##ONOFF; \
+        MPIPE_DMA->DA_L = (ot_u16)(DEST); \
+        MPIPE_DMA->SZ   = (SIZE); \
+        MPIPE_DMA->CTL  = MPIPE_DMA_RXCTL_ON; \
+        MPIPE_DMA_KICK(I2C_RXIFG); \
     } while(0)
 
-///@todo Resolve SIZE+2 workaround for DMA interrupt delay
-#define MPIPE_DMA_TXCONFIG(SOURCE, SIZE, ONOFF) \
+#define MPIPE_DMA_TXCONFIG(SOURCE, SIZE) \
     do { \
-        MPIPE_DMA->SA_L = (ot_u16)SOURCE; \
+        MPIPE_DMA_TRIGSEL(MPIPE_I2C_TXTRIG); \
+        MPIPE_DMA->SA_L = (ot_u16)(SOURCE); \
         MPIPE_DMA->DA_L = (ot_u16)&(MPIPE_I2C->TXBUF); \
-        MPIPE_DMA->SZ   = SIZE; \
-        MPIPE_DMA->CTL  = MPIPE_DMA_TXCTL_##ONOFF; \
+        MPIPE_DMA->SZ   = (SIZE); \
+        MPIPE_DMA->CTL  = MPIPE_DMA_TXCTL_ON; \
+        MPIPE_DMA_KICK(I2C_TXIFG); \
     } while(0)
 
 #define MPIPE_DMAEN(ONOFF)  MPIPE_DMA_##ONOFF
-#define MPIPE_DMAIE(ONOFF)  MPIPE_DMAIE_##ONOFF
 #define MPIPE_DMA_ON        (MPIPE_DMA->CTL |= 0x0010)
 #define MPIPE_DMA_OFF       (MPIPE_DMA->CTL &= ~0x0010)
-#define MPIPE_DMAIE_ON      (MPIPE_DMA->CTL |= 0x0004)
-#define MPIPE_DMAIE_OFF     (MPIPE_DMA->CTL &= ~0x0004)
-
-#define MPIPE_DMA_TXTRIGGER()   do { \
-                                    UART_CLEAR_TXIFG(); \
-                                    UART_SET_TXIFG(); \
-                                } while(0)
-//#define MPIPE_DMA_TXTRIGGER()   (MPIPE_DMA->CTL |= 1)
 
 
 
@@ -143,15 +169,12 @@
 
 
 /** Mpipe Module Data
-  * At present this consumes 24 bytes of SRAM.  6 bytes can be freed by
-  * removing the callbacks, which rarely (if ever) need to be dynamic.
+  * status is sent as it is to the host: [ Status ] [ Length MSB ] [ LSB ]
   */
 typedef struct {
-#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-        ot_u8           ackbuf[10];
-        mpipe_priority  priority;
-#   endif
     mpipe_state     state;
+    ot_bool         txframe;        // the status is out, the frame is next
+    ot_u8           status[3];
     Twobytes        sequence;
     ot_u8*          pktbuf;
     ot_int          pktlen;
@@ -167,7 +190,12 @@ mpipe_struct mpipe;
 
 
 void sub_signull(ot_int sigval);
-void sub_uart_setup();
+void sub_i2c_portsetup();
+void sub_i2c_reset();
+void sub_i2c_start();
+void sub_i2c_stop();
+void sub_rxdone();
+void sub_txdone();
 
 
 
@@ -189,15 +217,14 @@ void sub_uart_setup();
 #endif
 OT_INTERRUPT void mpipe_dma_isr(void) {
     //MPIPE_DMAEN(OFF); //unnecessary on single transfer mode
-#   if (MPIPE_DMANUM == 0)
-        if (DMA->IV == 2) mpipe_isr();
-#   elif (MPIPE_DMANUM == 1)
-        if (DMA->IV == 4) mpipe_isr();
-#   elif (MPIPE_DMANUM == 2)
-        if (DMA->IV == 6) mpipe_isr();
-#   else
-#       error "This version of MPIPE requires DMA."
-#   endif
+    if (PLATFORM_ISR_DEFER_DMA()) {
+        return;
+    }
+    SYS_PROFILE_WAIT_START();
+    if (DMA->IV == MPIPE_DMA_IV) {
+        mpipe_isr();
+    }
+    SYS_PROFILE_WAIT_STOP();
     LPM4_EXIT;
 }
 
@@ -210,13 +237,27 @@ OT_INTERRUPT void mpipe_dma_isr(void) {
 #else
 #   error "A known compiler has not been defined"
 #endif
-OT_INTERRUPT void mpipe_uart_isr(void) {
-    //MPIPE_I2C->IFG = 0;
-    if ((mpipe.state == MPIPE_Tx_Wait) || (mpipe.state == MPIPE_TxAck_Wait)) {
-        mpipe.state++;
-    }
-    else {
-        mpipe_isr();
+OT_INTERRUPT void mpipe_i2c_isr(void) {
+/// The USCI interrupts are START and STOP, and RX/TX only for bytes that are
+/// not for the DMA: written bytes that are not taken, and reads past the end.
+    switch (MPIPE_I2C->IV) {
+        case I2C_IV_START:  sub_i2c_start();    break;
+        case I2C_IV_STOP:   sub_i2c_stop();     break;
+
+        case I2C_IV_RX: {
+            volatile ot_u8 scratch;
+            scratch             = MPIPE_I2C->RXBUF;
+            mpipe.status[0]    |= MPIPE_I2C_RXERROR;
+        } break;
+
+        case I2C_IV_TX:
+            if (mpipe.txframe && (mpipe.state == MPIPE_Tx_Wait)) {
+                mpipe.state = MPIPE_Tx_Done;    // last byte is going out
+            }
+            MPIPE_I2C->TXBUF = 0xFF;
+            break;
+
+        default: break;
     }
     LPM4_EXIT;
 }
@@ -247,21 +288,94 @@ void mpipe_setsig_rxdetect(void (*signal)(ot_int)) {
 
 
 
-void sub_uart_portsetup() {
+void sub_i2c_portsetup() {
     // Get write-access to port mapping regs, update, re-lock
     PM->PWD                 = 0x2D52;
-    MPIPE_I2C_TXMAP         = MPIPE_I2C_TXSIG;
-    MPIPE_I2C_RXMAP         = MPIPE_I2C_RXSIG;
+    MPIPE_I2C_SCLMAP        = MPIPE_I2C_SCLSIG;
+    MPIPE_I2C_SDAMAP        = MPIPE_I2C_SDASIG;
     PM->PWD                 = 0;
-    
-    MPIPE_I2C->IFG          = 0;
-    MPIPE_I2C->IE           = 0;
+
     MPIPE_I2C_PORT->SEL    |= MPIPE_I2C_PINS;       // Set pins to alternate function
-  //MPIPE_I2C_PORT->IE     &= ~MPIPE_I2C_PINS;      // disable any interrupts on TX/RX pins
-    MPIPE_I2C_PORT->IFG    &= ~MPIPE_I2C_PINS;      // clear any interrupt flags on TX/RX pins
-    MPIPE_I2C_PORT->DDIR   &= ~MPIPE_I2C_PINS;      // Clear direction (set input)
-    MPIPE_I2C_PORT->DDIR   |= MPIPE_I2C_TXPIN;      // Set TX to output
-  //MPIPE_I2C_PORT->DS     |= MPIPE_I2C_TXPIN;      // Set drive strength to high on TX pin
+    MPIPE_I2C_PORT->IFG    &= ~MPIPE_I2C_PINS;      // clear any interrupt flags on the pins
+    MPIPE_I2C_PORT->DDIR   &= ~MPIPE_I2C_PINS;      // Open drain, the pull-ups are on the bus
+}
+
+
+
+void sub_i2c_reset() {
+/// The reset drops a TX byte that is loaded but not read, and clears ICTL
+    MPIPE_DMAEN(OFF);
+    I2C_CLOSE();
+    I2C_OPEN();
+    MPIPE_I2C->ICTL = I2C_IE_BASE;
+}
+
+
+
+void sub_i2c_start() {
+/// Host read: the status goes first, from the DMA.  Host write: the header
+/// of a frame goes to the DMA, if the app is listening.  Else the bytes are
+/// taken and dropped, and the host sees RXERROR.
+    if (I2C_ISTX()) {
+        mpipe.txframe = False;
+        MPIPE_DMA_TXCONFIG(mpipe.status, 3);
+    }
+    else {
+        mpipe.status[0] &= ~MPIPE_I2C_RXERROR;
+        if (mpipe.status[0] & MPIPE_I2C_RXREADY) {
+            mpipe.state = MPIPE_RxHeader;
+            MPIPE_DMA_RXCONFIG(mpipe.pktbuf, 6);
+        }
+        else {
+            MPIPE_I2C->ICTL |= UCRXIE;
+        }
+    }
+}
+
+
+
+void sub_i2c_stop() {
+/// A frame that is read to the end is done.  A write that is cut short is
+/// dropped, and the buffer listens again.
+    sub_i2c_reset();
+
+    switch (mpipe.state) {
+        case MPIPE_Tx_Done:
+            sub_txdone();
+            break;
+
+        case MPIPE_RxHeader:
+        case MPIPE_RxPayload:
+            mpipe.status[0]    |= MPIPE_I2C_RXERROR;
+            mpipe.state         = MPIPE_Idle;
+            mpipe.pktlen        = 6;
+            break;
+
+        default: break;
+    }
+}
+
+
+
+void sub_rxdone() {
+    mpipe.state         = MPIPE_Idle;
+    mpipe.status[0]    &= ~MPIPE_I2C_RXREADY;
+#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+        mpipe.sig_rxdone(0);
+#   endif
+}
+
+
+
+void sub_txdone() {
+    mpipe.sequence.ushort++;    //increment sequence on TX Done
+    mpipe.state         = MPIPE_Idle;
+    mpipe.status[0]    &= ~MPIPE_I2C_TXREADY;
+    mpipe.status[1]     = 0;
+    mpipe.status[2]     = 0;
+#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+        mpipe.sig_txdone(0);
+#   endif
 }
 
 
@@ -283,8 +397,8 @@ ot_u8 mpipe_footerbytes() {
 ot_int mpipe_init(void* port_id) {
 /// 0. "port_id" is unused in this impl, and it may be NULL
 /// 1. Set all signal callbacks to NULL, and initialize other variables.
-/// 2. Prepare the HW, which in this case is a UART
-/// 3. Set default speed, which in this case is 115200 bps
+/// 2. Prepare the HW, which in this case is a USCI_B in I2C slave mode
+/// 3. There is no speed to set: the host clocks the bus
 
 #   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
         mpipe.sig_rxdone    = &sub_signull;
@@ -293,18 +407,19 @@ ot_int mpipe_init(void* port_id) {
 #   endif
 
     //mpipe.sequence.ushort   = 0;          //not actually necessary
-#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-    mpipe.priority          = MPIPE_Low;
-#   endif
     mpipe.state             = MPIPE_Idle;
+    mpipe.status[0]         = 0;
+    mpipe.status[1]         = 0;
+    mpipe.status[2]         = 0;
+
+    sub_i2c_portsetup();
 
-    sub_uart_portsetup();
-    
-    MPIPE_I2C->CTL0 = (UCMST | UCMODE_3 | UCSYNC);
-    MPIPE_I2C->CTL1 = (UCSSEL_2 | UCSWRST);
-    MPIPE_I2C->BRW  = 7;
-    MPIPE_I2C->I2COA= MPIPE_I2C_SELF;
-    MPIPE_I2C->I2CSA= MPIPE_I2C_TARGET;
+    DMA->CTL4           = (DMA_Options_RMWDisable | DMA_Options_RoundRobinDisable | \
+                           DMA_Options_ENMIEnable);
+    MPIPE_I2C->CTLW0    = I2C_CTLW0_SLAVE | UCSWRST;
+    MPIPE_I2C->I2COA    = MPIPE_I2C_SELF;
+    I2C_OPEN();
+    MPIPE_I2C->ICTL     = I2C_IE_BASE;
 
     return 0;
 }
@@ -321,10 +436,7 @@ void mpipe_wait() {
 
 
 void mpipe_setspeed(mpipe_speed speed) {
-    I2C_CLOSE();
-    MPIPE_I2C->IE   = 0;
-    MPIPE_I2C->IFG  = 0;
-    MPIPE_I2C->BRW  = 7;
+/// The host is the master, so it sets the speed
 }
 
 
@@ -336,45 +448,14 @@ mpipe_state mpipe_status() {
 
 
 ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
-/// Data TX occurs after a CTS detect event.  The DMA is setup beforehand, and
-/// it is activated in the CTS ISR or manually (in this function) in the cases
-/// where CTS might be locked high (i.e. receiver is always ready, maybe it is
-/// full duplex or whatever).
+/// The frame waits for the host to read it.  The length goes into the status
+/// before the TXREADY flag, so a host that sees the flag has the length.
     Twobytes crcval;
     ot_int data_length = data[2] + 6;
 
-#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-        if (data_priority != MPIPE_Ack) {
-            if (mpipe.state != MPIPE_Idle) {
-                return -1;
-            }
-            mpipe.priority  = data_priority;
-            mpipe.pktbuf    = data;
-            mpipe.pktlen    = data_length;
-        }
-#   else
-        if (mpipe.state != MPIPE_Idle) {
-            return -1;
-        }
-        mpipe.pktbuf    = data;
-#   endif
-
-    mpipe.state = MPIPE_Tx_Wait;
-
-    MPIPE_DMAEN(OFF);
-
-#if (MCU_FEATURE(MPIPEDMA) == ENABLED)
-#   if (MPIPE_DMANUM == 0)
-        DMA->CTL0  |= MPIPE_I2C_TXTRIG;
-#   elif (MPIPE_DMANUM == 1)
-        DMA->CTL0  |= (MPIPE_I2C_TXTRIG << 8);
-#   elif (MPIPE_DMANUM == 2)
-        DMA->CTL1   = MPIPE_I2C_TXTRIG;
-#   else
-#       error MPIPE_DMANUM is set to a DMA that does not exist on this device
-#   endif
-
-    DMA->CTL4 = (DMA_Options_RMWDisable | DMA_Options_RoundRobinDisable | DMA_Options_ENMIEnable);
+    if (mpipe.state != MPIPE_Idle) {
+        return -1;
+    }
 
     // add sequence id & crc to end of the datastream
     data[data_length++] = mpipe.sequence.ubyte[UPPER];
@@ -383,17 +464,18 @@ ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority)
     data[data_length++] = crcval.ubyte[UPPER];
     data[data_length++] = crcval.ubyte[LOWER];
 
-    MPIPE_DMA_TXCONFIG(data, data_length, ON);
-    UART_OPEN();
-    MPIPE_DMA_TXTRIGGER();
+    mpipe.pktbuf        = data;
+    mpipe.pktlen        = data_length;
+    mpipe.state         = MPIPE_Tx_Wait;
+    mpipe.status[1]     = (ot_u8)(data_length >> 8);
+    mpipe.status[2]     = (ot_u8)data_length;
+    mpipe.status[0]     = (mpipe.status[0] & ~MPIPE_I2C_RXREADY) | MPIPE_I2C_TXREADY;
 
     if (blocking == True) {
         mpipe_wait();
     }
 
     return data_length;
-#else
-#endif
 }
 
 
@@ -401,172 +483,70 @@ ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority)
 
 
 ot_int mpipe_rxndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
-    ot_int data_length = 10;
-
-#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-        if (data_priority != MPIPE_Ack) {
-            if (mpipe.state != MPIPE_Idle) {
-                return -1;
-            }
-            mpipe.priority  = data_priority;
-            mpipe.pktbuf    = data;
-            mpipe.pktlen    = 6;
-        }
-#   else
-        if (mpipe.state != MPIPE_Idle) {
-            return -1;
-        }
-        mpipe.pktbuf    = data;
-        mpipe.pktlen    = 6;
-#   endif
-
-    mpipe.state = MPIPE_Idle;
-    MPIPE_DMAEN(OFF);
-
-#if (MCU_FEATURE(MPIPEDMA) == ENABLED)
-#   if (MPIPE_DMANUM == 0)
-        DMA->CTL0  |= MPIPE_I2C_RXTRIG;
-#   elif (MPIPE_DMANUM == 1)
-        DMA->CTL0  |= (MPIPE_I2C_RXTRIG << 8);
-#   elif (MPIPE_DMANUM == 2)
-        DMA->CTL1   = MPIPE_I2C_RXTRIG;
-#   else
-#       error MPIPE_DMANUM is set to a DMA that does not exist on this device
-#   endif
+    if (mpipe.state != MPIPE_Idle) {
+        return -1;
+    }
 
-    DMA->CTL4 = (DMA_Options_RMWDisable | DMA_Options_RoundRobinDisable | \
-                 DMA_Options_ENMIEnable);
-
-    MPIPE_DMA_RXCONFIG(data, data_length, ON);
-    I2C_OPEN();
-    I2C_CLEAR_RXIFG();
+    mpipe.pktbuf        = data;
+    mpipe.pktlen        = 6;
+    mpipe.status[0]    |= MPIPE_I2C_RXREADY;
 
     return 0;
-#else
-#endif
 }
 
 
 
 
-void sub_rxdone() {
-    UART_CLOSE();
-    mpipe.state = MPIPE_Idle;
-#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-        mpipe.priority = MPIPE_Low;
-#   endif
-#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
-        mpipe.sig_rxdone(0);
-#   endif
-}
-
-void sub_txdone() {
-    UART_CLOSE();
-    mpipe.sequence.ushort++;    //increment sequence on TX Done
-    mpipe.state = MPIPE_Idle;
-#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-        mpipe.priority = MPIPE_Low;
-#   endif
-#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
-        mpipe.sig_txdone(0);
-#   endif
-}
-
 void mpipe_isr() {
-/// MPipe is state-based.  Depending on the MPipe implementation and the HW
-/// implementation of the DMA+UART, state transitions may happen differently.
-/// <LI> In typical RX, there is a header detection event that sets-up a second
-///      RX process for downloading the rest of the packet.  When the DMA is
-///      done, the process completes.  </LI>
-/// <LI> For TX, there is a wait-state needed while the HW UART finishes
-///      sending the DMA buffered data (two bytes). </LI>
-/// <LI> If MPipe does not have HW acks, then software can be used to manage
-///      Acks.  In this case, a complete TX process also requires RX'ing an
-///      Ack, and a complete RX process requires TX'ing an Ack. </LI>
+/// MPipe is state-based.  This is the DMA done event, and the direction of the
+/// transfer is the USCI's.
+/// <LI> In a host read, the status is followed by the frame (if there is one).
+///      Then the TX interrupt gives 0xFF.  Its first call means the last
+///      byte of the frame is in the shifter, and the frame is done when the
+///      host stops. </LI>
+/// <LI> In a host write, the header sets up the RX of the rest of the frame,
+///      and the frame is checked when the DMA is done.  Bytes after it are
+///      dropped. </LI>
+
+    if (I2C_ISTX()) {
+        if ((mpipe.state == MPIPE_Tx_Wait) && (mpipe.txframe == False)) {
+            mpipe.txframe = True;
+            MPIPE_DMA_TXCONFIG(mpipe.pktbuf, mpipe.pktlen);
+        }
+        else {
+            MPIPE_I2C->ICTL |= UCTXIE;
+        }
+        return;
+    }
 
     switch (mpipe.state) {
-        case MPIPE_Idle: //note, case doesn't break!
+        case MPIPE_RxHeader:
 #           if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
                 mpipe.sig_rxdetect(0);
 #           endif
-
-        case MPIPE_RxHeader: {
             mpipe.state     = MPIPE_RxPayload;
             mpipe.pktlen   += mpipe.pktbuf[2] + MPIPE_FOOTERBYTES;
-            //@todo Might need to put in a DMA Disabler here
-            MPIPE_DMA_RXCONFIG(mpipe.pktbuf+6, mpipe.pktlen-6, ON);
+            MPIPE_DMA_RXCONFIG(mpipe.pktbuf+6, mpipe.pktlen-6);
             break;
-        }
 
         case MPIPE_RxPayload:
-#           if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-            if (mpipe.priority != MPIPE_Broadcast) {
-                // Copy RX'ed seq into ACK
-                ot_u8*  seq_val             = &mpipe.pktbuf[mpipe.pktlen-MPIPE_FOOTERBYTES];
-                mpipe.sequence.ubyte[UPPER] = *seq_val++;
-                mpipe.sequence.ubyte[LOWER] = *seq_val;
-
-                mpipe.ackbuf[0] = 0xDD;     //NDEF message flags
-                mpipe.ackbuf[1] = 0;        //Typelen = 0
-                mpipe.ackbuf[2] = 0;        //Paylod len = 0
-                mpipe.ackbuf[3] = 2;        //ID len = 2
-                mpipe.ackbuf[4] = 0;
-                mpipe.ackbuf[5] = (platform_crc_block(mpipe.pktbuf, mpipe.pktlen)) ? 0x7F : 0;
-
-                mpipe_txndef(mpipe.ackbuf, False, MPIPE_Ack);
-                mpipe.state = MPIPE_TxAck_Wait;
+            MPIPE_I2C->ICTL |= UCRXIE;
+            mpipe.pktlen    = 6;
+            if (platform_crc_block(mpipe.pktbuf, mpipe.pktbuf[2]+6+MPIPE_FOOTERBYTES) != 0) {
+                mpipe.status[0]    |= MPIPE_I2C_RXERROR;
+                mpipe.state         = MPIPE_Idle;
                 break;
             }
-#           endif
-            // Broadcast, so no ACK
-            sub_rxdone();
-            break;
-
-        case MPIPE_TxAck_Wait:
-            MPIPE_I2C->IE = UCTXIE;
-            break;
-
-        case MPIPE_TxAck_Done:  // TX'ed an ACK
-            MPIPE_I2C->IE = 0;
-#           if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-            if (mpipe.ackbuf[5] != 0) { // TX'ed a NACK
-                mpipe_rxndef(mpipe.pktbuf, False, mpipe.priority);
-                mpipe.state = MPIPE_RxHeader;
-                break;
+            {   ot_u8* seq_val              = &mpipe.pktbuf[mpipe.pktbuf[2]+6];
+                mpipe.sequence.ubyte[UPPER] = *seq_val++;
+                mpipe.sequence.ubyte[LOWER] = *seq_val;
             }
-#           endif
             sub_rxdone();
             break;
 
-        case MPIPE_Tx_Wait:
-            MPIPE_I2C->IE = UCTXIE;
-            break;
-
-        case MPIPE_Tx_Done:
-            MPIPE_I2C->IE = 0;
-#           if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-            if (mpipe.priority != MPIPE_Broadcast) {
-                mpipe_rxndef(mpipe.ackbuf, False, MPIPE_Ack);
-                mpipe.state = MPIPE_RxAck;
-                break;
-            }
-#           endif
-            sub_txdone();  // Broadcast, so no ACK
-            break;
-
-        case MPIPE_RxAck:
-#           if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
-            if (platform_crc_block(mpipe.ackbuf, 10) != 0) { //RX'ed NACK
-                mpipe_txndef(mpipe.pktbuf, False, mpipe.priority);
-                break;
-            }
-#           endif
-            //RX'ed ACK
-            sub_txdone();
-            break;
+        default: break;
     }
 }
 
 
 #endif
-
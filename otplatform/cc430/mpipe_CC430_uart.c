@@ -26,23 +26,21 @@
   * for the MPIPE.  This list may change over time as new models of the CC430
   * are released:
   *     I/F     HW      Impl.   Baudrate Notes
-  * 1.  UART    USCI    yes     Keep baudrate <= 115.2 kbps
+  * 1.  UART    USCI    yes     Up to SMCLK/3 (3 Mbps at most)
   * 2.  SPI     USCI    no      Potentially up to 5 Mbps, using SMCLK
   * 3.  I2C     USCI    no      100 or 400 kbps
   * 4.  IrDA    USCI    no      Need more information
   *
   * The UART implementation is the only one presently implemented.
-  * Baudrates supported:    9600, 115200
+  * Baudrates supported:    9600 to 3 Mbps (all of mpipe_speed, to SMCLK/3)
   * Byte structure:         8N1
-  * Duplex:                 Half
+  * Duplex:                 Half, or Full with OT_FEATURE_MPIPE_DUPLEX
   * Flow control:           HW (CTS/RTS for Null modem)
   * Connection:             RS-232, DTE-DTE (use a null-modem connector)
   *
   * Design Assumptions:
-  * - Using SMCLK at 2.49625 MHz Clock (19.97 MHz / 8)
+  * - Using SMCLK (MPIPE_UART_CLKHZ), the dividers are computed from it
   * - Using UART0
-  * - If changing the input frequency, changes need to be made to implementation
-  *   of setspeed function.
   * - If changing to another UART, changes to platform_config_CC430.h and to
   *   some macros in this file will be needed
   *
@@ -55,6 +53,31 @@
   * Mpipe send an ACK/NACK.  The "YY" byte is 0 for ACK and non-zero for ACK.
   * Presently, 0x7F is used as the YY NACK value.
   * [ Seq ID ] 0xDD 0x00 0x00 0x02 0x00 0xYY  [ CRC16 ]
+  *
+  * Full Duplex (OT_FEATURE_MPIPE_DUPLEX):
+  * RX and TX run on separate DMA channels (MPIPE_RXDMA and MPIPE_DMA), so RX
+  * is always armed.  Received frames are stored back-to-back in the dir_in
+  * buffer, used as a ring, and they are ACKed as soon as they arrive.  They
+  * are given to the rxdone callback one at a time; calling mpipe_rxndef()
+  * releases the last one and delivers the next.  mpipe_txndef() copies the
+  * frame into a TX ring and computes its CRC during the copy, so it does not
+  * need to wait for an earlier TX.  Frames are sent back-to-back, and they
+  * stay in the TX ring until they are ACKed.  A NACK sends the frame again,
+  * together with the frames after it.
+  *
+  * The MSP430 DMA has no half-transfer interrupt, so the RX ring is filled one
+  * frame at a time: the header goes to a scratch buffer, and the rest goes to
+  * the ring behind it.  A frame never wraps around the end of the ring, and a
+  * chunked message must fit in one contiguous part of the ring.  For the same
+  * reason, the rest of the frame is received in blocks of MPIPE_RXBLOCK bytes.
+  * Each block interrupt arms the next block and then adds the block that just
+  * arrived to the CRC, so only the last block is left to check when the frame
+  * ends, and the ACK goes out sooner.
+  *
+  * Half Duplex TX starts the DMA before the footer is written: the CRC is
+  * computed while the first bytes go out, which is much faster than the UART.
+  * If the footer is late (an ISR held off the main context for most of the
+  * frame), the frame fails its CRC and the receiver NACKs it.
   ******************************************************************************
   */
 
@@ -65,12 +88,27 @@
 
 #include "mpipe.h"
 #include "OT_platform.h"
+#include "system.h"
 
 
 #if ((MPIPE_UARTNUM != 0) && (MPIPE_UARTNUM != 1))
 #   error "MPIPE_UARTNUM not defined to an available UART"
 #endif
 
+#if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+#   include "buffers.h"
+#   if !defined(MPIPE_RXDMANUM)
+#       error "Full duplex MPIPE needs a second DMA channel (MPIPE_RXDMANUM)"
+#   endif
+#endif
+
+
+/// UART clock, SMCLK.  The USCI needs at least 3 clocks per bit, which sets
+/// the fastest speed of mpipe_setspeed().
+#ifndef MPIPE_UART_CLKHZ
+#   define MPIPE_UART_CLKHZ     (PLATFORM_HSCLOCK_HZ / PLATFORM_SMCLK_DIV)
+#endif
+#define MPIPE_BAUDMAX           (MPIPE_UART_CLKHZ / 3)
 
 #define UART_CLOSE()        (MPIPE_UART->CTL1   |= UCSWRST)
 #define UART_OPEN()         (MPIPE_UART->CTL1   &= ~UCSWRST)
@@ -153,6 +191,109 @@
 
 
 
+#if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+/// Bytes in the TX ring.  It must hold the largest frame (265 bytes) plus an
+/// ACK or two, or the largest frame will never be accepted.
+#   ifndef MPIPE_TXRING_BYTES
+#       define MPIPE_TXRING_BYTES   384
+#   endif
+
+/// RX DMA block size.  Smaller blocks leave less CRC for the end of the frame,
+/// but each one is an interrupt that must re-arm the DMA within a byte time,
+/// and the DMA interrupts are masked while a frame is copied into the TX ring.
+#   ifndef MPIPE_RXBLOCK
+#       define MPIPE_RXBLOCK        64
+#   endif
+
+#   define MPIPE_DMAIFG         0x0008
+
+// Setup DMA for RX into a dump byte (frames that don't fit), and enable it
+#   define MPIPE_DMA_DUMPCTL_ON ( DMA_Mode_Single | \
+                                  DMA_DestinationInc_Disable | \
+                                  DMA_SourceInc_Disable | \
+                                  DMA_DestinationDataSize_Byte | \
+                                  DMA_SourceDataSize_Byte | \
+                                  DMA_TriggerLevel_RisingEdge | \
+                                  0x0014 )
+
+#   define MPIPE_RXDMA_CONFIG(DEST, SIZE, CTLVAL) \
+        do { \
+            MPIPE_RXDMA->SA_L = (ot_u16)&(MPIPE_UART->RXBUF); \
+            MPIPE_RXDMA->DA_L = (ot_u16)(DEST); \
+            MPIPE_RXDMA->SZ   = SIZE; \
+            MPIPE_RXDMA->CTL  = CTLVAL; \
+        } while(0)
+
+// Trigger selection that leaves the other channel in the same register alone
+#   if (MPIPE_RXDMANUM == 0)
+#       define MPIPE_RXDMA_TRIGSEL()    (DMA->CTL0 = (DMA->CTL0 & 0xFF00) | MPIPE_UART_RXTRIG)
+#   elif (MPIPE_RXDMANUM == 1)
+#       define MPIPE_RXDMA_TRIGSEL()    (DMA->CTL0 = (DMA->CTL0 & 0x00FF) | (MPIPE_UART_RXTRIG << 8))
+#   elif (MPIPE_RXDMANUM == 2)
+#       define MPIPE_RXDMA_TRIGSEL()    (DMA->CTL1 = MPIPE_UART_RXTRIG)
+#   else
+#       error MPIPE_RXDMANUM is set to a DMA that does not exist on this device
+#   endif
+#   if (MPIPE_DMANUM == 0)
+#       define MPIPE_TXDMA_TRIGSEL()    (DMA->CTL0 = (DMA->CTL0 & 0xFF00) | MPIPE_UART_TXTRIG)
+#   elif (MPIPE_DMANUM == 1)
+#       define MPIPE_TXDMA_TRIGSEL()    (DMA->CTL0 = (DMA->CTL0 & 0x00FF) | (MPIPE_UART_TXTRIG << 8))
+#   elif (MPIPE_DMANUM == 2)
+#       define MPIPE_TXDMA_TRIGSEL()    (DMA->CTL1 = MPIPE_UART_TXTRIG)
+#   else
+#       error MPIPE_DMANUM is set to a DMA that does not exist on this device
+#   endif
+
+/// Ring state is shared by the main context and both DMA ISRs.  Masking the two
+/// channel interrupts (not GIE) is safe from ISR context, where this also runs.
+#   define MPIPE_DMAIE_MASK()   do { \
+                                    MPIPE_RXDMA->CTL &= ~0x0004; \
+                                    MPIPE_DMA->CTL   &= ~0x0004; \
+                                } while(0)
+#   define MPIPE_DMAIE_UNMASK() do { \
+                                    MPIPE_RXDMA->CTL |= 0x0004; \
+                                    MPIPE_DMA->CTL   |= 0x0004; \
+                                } while(0)
+
+/// When frames are chained, the UART may still hold a byte from the last one.
+/// Only force the trigger edge when the TX buffer is empty, otherwise the next
+/// TXIFG edge starts the DMA by itself.
+#   define MPIPE_DMA_TXKICK()   do { \
+                                    if (MPIPE_UART->IFG & UCTXIFG) \
+                                        MPIPE_DMA_TXTRIGGER(); \
+                                } while(0)
+
+// TX ring entry flags (the first byte of each entry)
+#   define TXENT_NOACK          0x01    // No ACK expected (broadcast or ACK)
+#   define TXENT_DONE           0x02    // Sent and ACKed, or sent and NOACK
+#   define TXENT_ACK            0x04    // Entry is an ACK/NACK we send
+
+// RX DMA phases
+#   define RXPHASE_HEADER       0       // Header, into rxhdr
+#   define RXPHASE_PAYLOAD      1       // Rest of frame, into the RX ring
+#   define RXPHASE_ACK          2       // Footer of ACK/NACK, into rxhdr
+#   define RXPHASE_DUMP         3       // Frame that didn't fit, discarded
+#   define RXPHASE_NACK         4       // Footer of discarded frame
+
+/** Frame ring used for full duplex RX and TX.
+  * Frames are stored back-to-back between tail and put, and they never wrap
+  * around the end: when a frame doesn't fit at the end, end marks where the
+  * frames stop and the frame goes to the start.  read is the next frame to
+  * deliver (RX) or send (TX).  One byte is always left free, so tail == put
+  * means the ring is empty.
+  */
+typedef struct {
+    ot_u8*  base;
+    ot_u16  size;
+    ot_u16  tail;
+    ot_u16  read;
+    ot_u16  put;
+    ot_u16  end;
+} mpipe_ring;
+#endif
+
+
+
 
 
 /** Mpipe Module Data
@@ -174,13 +315,38 @@ typedef struct {
         void (*sig_txdone)(ot_int);
         void (*sig_rxdetect)(ot_int);
 #   endif
+
+#   if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+        mpipe_ring      txring;
+        mpipe_ring      rxring;
+        ot_u16          txcur;      // TX entry in the DMA
+        ot_u16          rxframe;    // RX frame in the DMA
+        ot_u16          rxstop;     // End of the last complete RX frame
+        ot_u8*          rxjoin;     // Where the next chunk of a message goes
+        ot_bool         txbusy;
+        ot_bool         rxheld;     // A frame has been delivered, not released
+        ot_bool         rxlock;
+        ot_u8           rxphase;
+        ot_u8           rxflags;    // NDEF flags of the delivered frame
+        ot_u8           rxdump;
+        ot_u8           rxhdr[10];
+        ot_u16          rxcrc;      // CRC of the frame up to rxcrcpos
+        ot_u16          rxleft;     // Bytes of the frame not yet in the DMA
+        ot_u8*          rxcrcpos;   // First received byte not in rxcrc
+        ot_u8*          rxput;      // Where the next RX DMA block goes
+#   endif
 } mpipe_struct;
 
 mpipe_struct mpipe;
 
+#if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+ot_u8 mpipe_txbuf[MPIPE_TXRING_BYTES];
+#endif
+
 
 void sub_signull(ot_int sigval);
 void sub_uart_setup();
+ot_u16 sub_crc_extend(ot_u16 crcval, ot_u8* data, ot_int length);
 
 
 
@@ -201,8 +367,18 @@ void sub_uart_setup();
 #   error "A known compiler has not been defined"
 #endif
 OT_INTERRUPT void mpipe_dma_isr(void) {
+/// In duplex mode there is no UART ISR, so the radio ISRs can preempt the
+/// rest of MPipe (see PLATFORM_ISR_NEST() in OT_platform.h), which includes
+/// the RX done callback.  mpipe_isr() clears the channel flags itself.
     //MPIPE_DMAEN(OFF); //unnecessary on single transfer mode
-#   if (MPIPE_DMANUM == 0)
+    if (PLATFORM_ISR_DEFER_DMA()) {
+        return;
+    }
+    SYS_PROFILE_WAIT_START();
+#   if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+        PLATFORM_ISR_NEST();
+        mpipe_isr();
+#   elif (MPIPE_DMANUM == 0)
 		if (DMA->IV == 2) mpipe_isr();
 #   elif (MPIPE_DMANUM == 1)
 		if (DMA->IV == 4) mpipe_isr();
@@ -211,10 +387,12 @@ OT_INTERRUPT void mpipe_dma_isr(void) {
 #   else
 #       error "This version of MPIPE requires DMA."
 #   endif
+    PLATFORM_ISR_UNNEST();
 	LPM4_EXIT;
 }
 
 
+#if (OT_FEATURE(MPIPE_DUPLEX) != ENABLED)
 #if (CC_SUPPORT == CL430)
 #	pragma vector=MPIPE_UART_VECTOR
 #elif (CC_SUPPORT == GCC)
@@ -225,15 +403,18 @@ OT_INTERRUPT void mpipe_dma_isr(void) {
 #endif
 OT_INTERRUPT void mpipe_uart_isr(void) {
 	//MPIPE_UART->IFG = 0;
+    SYS_PROFILE_WAIT_START();
 	if ((mpipe.state == MPIPE_Tx_Wait) || (mpipe.state == MPIPE_TxAck_Wait)) {
 		mpipe.state++;
 	}
 	else {
 		mpipe_isr();
 	}
+    SYS_PROFILE_WAIT_STOP();
 	LPM4_EXIT;
 }
 #endif
+#endif
 
 
 
@@ -287,6 +468,23 @@ void sub_uart_portsetup() {
  * Public Mpipe Functions *
  **************************/
 
+ot_u16 sub_crc_extend(ot_u16 crcval, ot_u8* data, ot_int length) {
+/// CRC16 of "data", continued from crcval (0xFFFF starts a new one).  This is
+/// used from the DMA ISRs, so the CRC engine is given back in the state that
+/// the interrupted code left it.
+    ot_u16 saved = CRC->INIRES;
+
+    CRC->INIRES = crcval;
+    for (; length > 0; length--) {
+        CRCb->DIRB_L = *data++;
+    }
+    crcval      = CRC->INIRES;
+    CRC->INIRES = saved;
+
+    return crcval;
+}
+
+
 ot_u8 mpipe_footerbytes() {
     return MPIPE_FOOTERBYTES;
 }
@@ -297,7 +495,8 @@ ot_int mpipe_init(void* port_id) {
 /// 0. "port_id" is unused in this impl, and it may be NULL
 /// 1. Set all signal callbacks to NULL, and initialize other variables.
 /// 2. Prepare the HW, which in this case is a UART
-/// 3. Set default speed, which in this case is 115200 bps
+/// 3. Set default speed, MPIPE_SPEED_DEFAULT (115200 bps unless the board
+///    changes it)
 
 #   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
         mpipe.sig_rxdone    = &sub_signull;
@@ -311,8 +510,25 @@ ot_int mpipe_init(void* port_id) {
 #   endif
     mpipe.state             = MPIPE_Idle;
 
+#   if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+    mpipe.txring.base       = mpipe_txbuf;
+    mpipe.txring.size       = MPIPE_TXRING_BYTES;
+    mpipe.txring.end        = MPIPE_TXRING_BYTES;
+    mpipe.txring.tail       = 0;
+    mpipe.txring.read       = 0;
+    mpipe.txring.put        = 0;
+    mpipe.txbusy            = False;
+    mpipe.rxheld            = False;
+    mpipe.rxlock            = False;
+    mpipe.rxjoin            = NULL;
+
+    MPIPE_TXDMA_TRIGSEL();
+    DMA->CTL4 = (DMA_Options_RMWDisable | DMA_Options_RoundRobinDisable | \
+                 DMA_Options_ENMIEnable);
+#   endif
+
     sub_uart_portsetup();
-    mpipe_setspeed(MPIPE_115200bps);     //default baud rate
+    mpipe_setspeed(MPIPE_SPEED_DEFAULT);
 
     return 0;
 }
@@ -329,20 +545,45 @@ void mpipe_wait() {
 
 
 void mpipe_setspeed(mpipe_speed speed) {
-    ot_u8* baud_data;
-
-    /// You will need to change this baud rate matrix if
-    /// you change the bit clock from SMCLK @ 2.496 MHz
-    /// Order is [ BR0, BR1, MCTL, ... ]
-    /// BR1:0 = Floor(BitCLK/BaudRate)
-    /// MCTL  = Round(((BitCLK/BaudRate) - Floor(BitCLK/BaudRate)) * 8) << 1
-    static const ot_u8 baud_matrix[] = { 0x04, 0x01, 0x00, 0, \
-                                         0x56, 0x00, 0x0A, 0, \
-                                         0x2B, 0x00, 0x06, 0, \
-                                         0x15, 0x00, 0x0A, 0  };
+/// The dividers are computed from the UART clock (SMCLK), as in the USCI
+/// chapter of the user's guide.  "n16" is UART clocks per bit, x16.  With 16
+/// or more clocks per bit, 16x oversampling is used: BR = N/16 and UCBRFx is
+/// the fraction of N/16 (x16).  Else BR = N and UCBRSx is the fraction of N
+/// (x8).  The USCI needs at least 3 clocks per bit.
+    static const ot_u32 baudrate[] = { MPIPE_BAUDRATES };
+    ot_u32  n16;
+    ot_u16  br;
+    ot_u8   mctl;
+
+    while ((speed != MPIPE_9600bps) && (baudrate[speed] > MPIPE_BAUDMAX)) {
+        speed--;
+    }
+    n16 = ((ot_u32)MPIPE_UART_CLKHZ << 4) / baudrate[speed];
+    if (n16 >= (16 << 4)) {
+        br      = (ot_u16)(n16 >> 8);
+        mctl    = (ot_u8)(((n16 & 0xFF) + 8) >> 4);
+        if (mctl == 16) {
+            br++;
+            mctl = 0;
+        }
+        mctl = (mctl << 4) | 0x01;      // UCBRFx, UCOS16
+    }
+    else {
+        br      = (ot_u16)(n16 >> 4);
+        mctl    = (ot_u8)(((n16 & 0x0F) + 1) >> 1);
+        if (mctl == 8) {
+            br++;
+            mctl = 0;
+        }
+        mctl <<= 1;                     // UCBRSx
+    }
 
 #   if (MCU_FEATURE(MPIPEDMA) == ENABLED)
         MPIPE_DMAEN(OFF);
+#       if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+        MPIPE_RXDMA->CTL   &= ~0x0010;
+        mpipe.rxring.base   = NULL;     // RX is opened again by mpipe_rxndef()
+#       endif
 #   else
 #       error "Mpipe requires a DMA in this implementation"
 #   endif
@@ -355,13 +596,518 @@ void mpipe_setspeed(mpipe_speed speed) {
     MPIPE_UART->CTL1 = 0x81;
     MPIPE_UART->IE   = 0;
     MPIPE_UART->IFG  = 0;
-    baud_data        = (ot_u8*)&baud_matrix[speed << 2];
-    MPIPE_UART->BR0  = *baud_data++;
-    MPIPE_UART->BR1  = *baud_data++;
-    MPIPE_UART->MCTL = *baud_data;
+    MPIPE_UART->BR0  = (ot_u8)br;
+    MPIPE_UART->BR1  = (ot_u8)(br >> 8);
+    MPIPE_UART->MCTL = mctl;
+}
+
+
+#if (OT_FEATURE(MPIPE_DUPLEX) == ENABLED)
+/*************************************
+ * Full Duplex Mpipe (ring-buffered) *
+ *************************************/
+
+ot_int sub_ring_reserve(mpipe_ring* ring, ot_uint bytes) {
+/// Reserve a contiguous space for a frame at the head of the ring.  Returns
+/// the offset of the space, or -1 if there is no room.
+    ot_uint put = ring->put;
+    ot_uint limit;
+
+    if (put < ring->tail) {
+        limit = ring->tail;
+    }
+    else {
+        limit = ring->size + (ring->tail != 0);
+        if ((put + bytes) >= limit) {
+            limit = ring->tail;         // No room at the end, try the start
+            if (bytes < limit) {
+                ring->end   = put;
+                put         = 0;
+            }
+        }
+    }
+    if ((put + bytes) >= limit) {
+        return -1;
+    }
+
+    ring->put = put + bytes;
+    if (ring->put >= ring->size) {
+        ring->put = 0;
+    }
+    return (ot_int)put;
+}
+
+
+ot_uint sub_ring_skip(mpipe_ring* ring, ot_uint pos, ot_uint bytes) {
+/// Offset of the frame after the one at pos, which is "bytes" long
+    pos += bytes;
+    return (pos >= ring->end) ? 0 : pos;
+}
+
+
+ot_uint sub_ring_read(mpipe_ring* ring) {
+/// The read cursor can be left on the end marker when put wraps behind it
+    if (ring->read >= ring->end) {
+        ring->read = 0;
+    }
+    return ring->read;
+}
+
+
+void sub_ring_settail(mpipe_ring* ring, ot_uint pos) {
+/// Release the frames before pos.  When the tail wraps, the end marker is
+/// cleared (after taking the read cursor off of it).
+    if (pos >= ring->end) {
+        pos = 0;
+    }
+    if (pos < ring->tail) {
+        sub_ring_read(ring);
+        ring->end = ring->size;
+    }
+    ring->tail = pos;
+}
+
+
+
+
+void sub_txstart() {
+/// Start the DMA on the next TX entry that needs to go out.  Skip entries that
+/// are done, which can be after the read cursor following a NACK.
+    mpipe_ring* ring    = &mpipe.txring;
+    ot_uint     pos     = sub_ring_read(ring);
+
+    while (pos != ring->put) {
+        ot_u8*  entry   = ring->base + pos;
+        ot_uint length  = entry[3] + (6+MPIPE_FOOTERBYTES);
+
+        pos         = sub_ring_skip(ring, pos, length+1);
+        ring->read  = pos;
+
+        if ((entry[0] & TXENT_DONE) == 0) {
+            mpipe.txbusy    = True;
+            mpipe.txcur     = (ot_u16)(entry - ring->base);
+            mpipe.state     = MPIPE_Tx_Wait;
+            UART_OPEN();
+            MPIPE_DMA_TXCONFIG(entry+1, length, ON);
+            MPIPE_DMA_TXKICK();
+            return;
+        }
+    }
+
+    mpipe.state = MPIPE_Idle;
+}
+
+
+void sub_txrelease() {
+/// Free the TX entries at the tail that are done.  The entry in the DMA and
+/// the entries not yet sent are never freed.
+    mpipe_ring* ring    = &mpipe.txring;
+    ot_uint     pos     = ring->tail;
+
+    while (pos != sub_ring_read(ring)) {
+        ot_u8* entry = ring->base + pos;
+
+        if (((entry[0] & TXENT_DONE) == 0) || (mpipe.txbusy && (pos == mpipe.txcur))) {
+            break;
+        }
+        pos = sub_ring_skip(ring, pos, entry[3] + (7+MPIPE_FOOTERBYTES));
+    }
+    sub_ring_settail(ring, pos);
+
+    // When empty, start again from the base of the ring, for the most room
+    if ((ring->tail == ring->put) && (mpipe.txbusy == False)) {
+        ring->tail  = 0;
+        ring->read  = 0;
+        ring->put   = 0;
+        ring->end   = ring->size;
+    }
+}
+
+
+ot_int sub_txqueue(ot_u8* data, ot_u8 flags, ot_u8* seq) {
+/// Copy an NDEF record into the TX ring, and add the Mpipe footer.  The CRC is
+/// computed in the copy loop.  Call with the Mpipe DMA interrupts masked.
+    ot_int  length  = data[2] + 6;
+    ot_int  offset;
+    ot_u8*  cursor;
+    ot_int  i;
+    Twobytes crcval;
+
+    offset = sub_ring_reserve(&mpipe.txring, length+MPIPE_FOOTERBYTES+1);
+    if (offset < 0) {
+        return -1;
+    }
+
+    cursor      = mpipe.txring.base + offset;
+    *cursor++   = flags;
+
+    platform_crc_init();
+    for (i=length; i!=0; i--) {
+        platform_crc_byte(*data);
+        *cursor++ = *data++;
+    }
+    platform_crc_byte(seq[0]);
+    platform_crc_byte(seq[1]);
+    *cursor++       = seq[0];
+    *cursor++       = seq[1];
+    crcval.ushort   = platform_crc_result();
+    *cursor++       = crcval.ubyte[UPPER];
+    *cursor         = crcval.ubyte[LOWER];
+
+    if (mpipe.txbusy == False) {
+        sub_txstart();
+    }
+
+    return length + MPIPE_FOOTERBYTES;
+}
+
+
+void sub_txack(ot_u8* seq, ot_u8 nack) {
+/// Queue an ACK (nack == 0) or NACK for the received frame with Seq ID "seq".
+/// The USB converter has its own link integrity, so there are no ACKs.
+#if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
+    ot_u8 ack[6];
+
+    if (mpipe.priority != MPIPE_Broadcast) {
+        ack[0]  = 0xDD;     //NDEF message flags
+        ack[1]  = 0;        //Typelen = 0
+        ack[2]  = 0;        //Payload len = 0
+        ack[3]  = 2;        //ID len = 2
+        ack[4]  = 0;
+        ack[5]  = nack;
+        sub_txqueue(ack, (TXENT_NOACK | TXENT_ACK), seq);
+    }
+#endif
+}
+
+
+void sub_txacked(ot_u8* seq, ot_bool nack) {
+/// An ACK/NACK arrived.  An ACK frees the frame with the matching Seq ID.  A
+/// NACK rewinds the read cursor to it, so it and the frames after it are sent
+/// again (frames that are already done are skipped).
+    mpipe_ring* ring    = &mpipe.txring;
+    ot_uint     pos     = ring->tail;
+
+    while (pos != sub_ring_read(ring)) {
+        ot_u8*  entry   = ring->base + pos;
+        ot_uint length  = entry[3] + (6+MPIPE_FOOTERBYTES);
+
+        if (((entry[0] & (TXENT_NOACK|TXENT_DONE)) == 0) && \
+            (entry[length-3] == seq[0]) && (entry[length-2] == seq[1])) {
+            if (nack)   ring->read  = pos;
+            else        entry[0]   |= TXENT_DONE;
+            break;
+        }
+        pos = sub_ring_skip(ring, pos, length+1);
+    }
+
+    sub_txrelease();
+    if (mpipe.txbusy == False) {
+        sub_txstart();
+    }
+}
+
+
+void sub_txdma_isr() {
+    ot_u8* entry = mpipe.txring.base + mpipe.txcur;
+    ot_u8  flags = *entry;
+
+    if (flags & TXENT_NOACK) {
+        *entry = flags | TXENT_DONE;
+    }
+    mpipe.txbusy = False;
+    sub_txrelease();
+    sub_txstart();
+
+#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+    if ((flags & TXENT_ACK) == 0) {
+        mpipe.sig_txdone(0);
+    }
+#   endif
+}
+
+
+
+
+void sub_rxarm() {
+    mpipe.rxphase = RXPHASE_HEADER;
+    MPIPE_RXDMA_CONFIG(mpipe.rxhdr, 6, MPIPE_DMA_RXCTL_ON);
+}
+
+
+void sub_rxblock() {
+/// Arm the DMA for the next block of the frame
+    ot_u16 size = (mpipe.rxleft > MPIPE_RXBLOCK) ? MPIPE_RXBLOCK : mpipe.rxleft;
+
+    MPIPE_RXDMA_CONFIG(mpipe.rxput, size, MPIPE_DMA_RXCTL_ON);
+    mpipe.rxput    += size;
+    mpipe.rxleft   -= size;
+}
+
+
+void sub_rxnext() {
+/// Deliver the next received frame through dir_in, unless the last one has not
+/// been released.  This is called from the RX ISR and from mpipe_rxndef(), and
+/// it can be re-entered from the rxdone callback, so there is a lock.  The
+/// pending check runs again after unlocking, in case a frame completed while
+/// it was locked.
+    mpipe_ring* ring = &mpipe.rxring;
+
+    while (1) {
+        ot_u8*  frame;
+        ot_int  length;
+        ot_uint stop;
+
+        MPIPE_DMAIE_MASK();
+        stop = (mpipe.rxstop >= ring->end) ? 0 : mpipe.rxstop;
+        if (mpipe.rxlock || mpipe.rxheld || (sub_ring_read(ring) == stop)) {
+            MPIPE_DMAIE_UNMASK();
+            break;
+        }
+
+        mpipe.rxlock    = True;
+        frame           = ring->base + ring->read;
+        length          = frame[2] + 6;
+        ring->read      = sub_ring_skip(ring, ring->read, length+MPIPE_FOOTERBYTES);
+
+        /// Next chunk of a message: slide it down behind the last chunk, over
+        /// its footer, so the message is contiguous.  A chunk that wrapped to
+        /// the start of the ring can't be joined, so the earlier ones are lost.
+        dir_in.front = frame;
+        if (mpipe.rxjoin != NULL) {
+            if (frame > mpipe.rxjoin) {
+                ot_u8*  dst = mpipe.rxjoin;
+                ot_int  i;
+                for (i=0; i<length; i++) {
+                    dst[i] = frame[i];
+                }
+                frame           = dst;
+                dir_in.front    = ring->base + ring->tail;
+            }
+            else {
+                sub_ring_settail(ring, (ot_uint)(frame - ring->base));
+            }
+            mpipe.rxjoin = NULL;
+        }
+
+        dir_in.getcursor    = frame;
+        dir_in.putcursor    = frame + length;
+        dir_in.length       = dir_in.putcursor - dir_in.front;
+        mpipe.rxflags       = frame[0];
+        mpipe.rxheld        = True;
+        MPIPE_DMAIE_UNMASK();
+
+#       if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+            mpipe.sig_rxdone(0);
+#       endif
+        mpipe.rxlock = False;
+    }
+}
+
+
+void sub_rxdma_isr() {
+    mpipe_ring* ring = &mpipe.rxring;
+    ot_u8*      frame;
+    ot_int      length;
+    ot_int      offset;
+
+    switch (mpipe.rxphase) {
+        case RXPHASE_HEADER: {
+#           if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+                mpipe.sig_rxdetect(0);
+#           endif
+            length = mpipe.rxhdr[2] + (6+MPIPE_FOOTERBYTES);
+
+            // ACK/NACK from the other side: only the footer is needed
+            if ((mpipe.rxhdr[0] == 0xDD) && (mpipe.rxhdr[2] == 0) && (mpipe.rxhdr[3] == 2)) {
+                mpipe.rxphase = RXPHASE_ACK;
+                MPIPE_RXDMA_CONFIG(&mpipe.rxhdr[6], MPIPE_FOOTERBYTES, MPIPE_DMA_RXCTL_ON);
+                break;
+            }
+
+            // No room in the ring: discard the frame, but keep the footer
+            // so it can be NACKed.
+            offset = sub_ring_reserve(ring, length);
+            if (offset < 0) {
+                length -= (6+MPIPE_FOOTERBYTES);
+                if (length != 0) {
+                    mpipe.rxphase = RXPHASE_DUMP;
+                    MPIPE_RXDMA_CONFIG(&mpipe.rxdump, length, MPIPE_DMA_DUMPCTL_ON);
+                    break;
+                }
+                mpipe.rxphase = RXPHASE_NACK;
+                MPIPE_RXDMA_CONFIG(&mpipe.rxhdr[6], MPIPE_FOOTERBYTES, MPIPE_DMA_RXCTL_ON);
+                break;
+            }
+
+            mpipe.rxframe = (ot_u16)offset;
+            frame       = ring->base + offset;
+            frame[0]    = mpipe.rxhdr[0];
+            frame[1]    = mpipe.rxhdr[1];
+            frame[2]    = mpipe.rxhdr[2];
+            frame[3]    = mpipe.rxhdr[3];
+            frame[4]    = mpipe.rxhdr[4];
+            frame[5]    = mpipe.rxhdr[5];
+            mpipe.rxphase   = RXPHASE_PAYLOAD;
+            mpipe.rxput     = frame+6;
+            mpipe.rxcrcpos  = frame+6;
+            mpipe.rxleft    = length-6;
+            sub_rxblock();
+            mpipe.rxcrc     = sub_crc_extend(0xFFFF, mpipe.rxhdr, 6);
+            break;
+        }
+
+        case RXPHASE_PAYLOAD: {
+            ot_u8*  block = mpipe.rxcrcpos;
+            ot_u8   nack;
+
+            // More to come: arm the next block first, then CRC this one
+            if (mpipe.rxleft != 0) {
+                mpipe.rxcrcpos = mpipe.rxput;
+                sub_rxblock();
+                mpipe.rxcrc = sub_crc_extend(mpipe.rxcrc, block, mpipe.rxcrcpos-block);
+                break;
+            }
+
+            sub_rxarm();
+            frame   = ring->base + mpipe.rxframe;
+            length  = frame[2] + (6+MPIPE_FOOTERBYTES);
+            nack    = sub_crc_extend(mpipe.rxcrc, block, mpipe.rxput-block) ? 0x7F : 0;
+            sub_txack(&frame[length-MPIPE_FOOTERBYTES], nack);
+
+            // A bad frame is taken back out of the ring (it is the newest)
+            if (nack)   ring->put       = mpipe.rxframe;
+            else        mpipe.rxstop    = ring->put;
+            sub_rxnext();
+            break;
+        }
+
+        case RXPHASE_DUMP:
+            mpipe.rxphase = RXPHASE_NACK;
+            MPIPE_RXDMA_CONFIG(&mpipe.rxhdr[6], MPIPE_FOOTERBYTES, MPIPE_DMA_RXCTL_ON);
+            break;
+
+        case RXPHASE_NACK:
+            sub_rxarm();
+            sub_txack(&mpipe.rxhdr[6], 0x7F);
+            break;
+
+        case RXPHASE_ACK:
+            sub_rxarm();
+            if (sub_crc_extend(0xFFFF, mpipe.rxhdr, 10) == 0) {
+                sub_txacked(&mpipe.rxhdr[6], (ot_bool)(mpipe.rxhdr[5] != 0));
+            }
+            break;
+    }
+}
+
+
+
+
+mpipe_state mpipe_status() {
+    return mpipe.state;
+}
+
+
+
+
+ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// The frame is copied into the TX ring, so "data" can be reused as soon as
+/// this returns.  Returns -1 only when the TX ring has no room for it.
+    ot_int  data_length;
+    ot_u8   seq[2];
+    ot_u8   flags;
+
+#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
+    flags   = (data_priority == MPIPE_Broadcast) ? TXENT_NOACK : 0;
+#   else
+    flags   = TXENT_NOACK;
+#   endif
+    seq[0]  = mpipe.sequence.ubyte[UPPER];
+    seq[1]  = mpipe.sequence.ubyte[LOWER];
+
+    MPIPE_DMAIE_MASK();
+    data_length = sub_txqueue(data, flags, seq);
+    if (data_length > 0) {
+        mpipe.sequence.ushort++;
+    }
+    MPIPE_DMAIE_UNMASK();
+
+    if ((data_length > 0) && (blocking == True)) {
+    	mpipe_wait();
+    }
+
+    return data_length;
+}
+
+
+
+
+ot_int mpipe_rxndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// RX is always running.  The first call opens the RX ring on dir_in.  Later
+/// calls release the frame that was last delivered, unless it is part of an
+/// unfinished chunked message, and then deliver the next frame.  "data" is not
+/// used: frames are always delivered in dir_in.
+    mpipe_ring* ring = &mpipe.rxring;
+
+#   if (PLATFORM_FEATURE_USBCONVERTER != ENABLED)
+    if (data_priority != MPIPE_Ack) {
+        mpipe.priority = data_priority;
+    }
+#   endif
+
+    if (ring->base == NULL) {
+        ring->base      = dir_in.front;
+        ring->size      = dir_in.alloc;
+        ring->end       = dir_in.alloc;
+        ring->tail      = 0;
+        ring->read      = 0;
+        ring->put       = 0;
+        mpipe.rxstop    = 0;
+        mpipe.rxheld    = False;
+        mpipe.rxjoin    = NULL;
+
+        MPIPE_RXDMA_TRIGSEL();
+        sub_rxarm();
+        UART_OPEN();
+        UART_CLEAR_RXIFG();
+        return 0;
+    }
+
+    MPIPE_DMAIE_MASK();
+    if (mpipe.rxheld) {
+        mpipe.rxheld = False;
+        if (mpipe.rxflags & 0x40) {     // NDEF Message End
+            sub_ring_settail(ring, ring->read);
+        }
+        else {
+            mpipe.rxjoin = dir_in.putcursor;
+        }
+    }
+    MPIPE_DMAIE_UNMASK();
+
+    sub_rxnext();
+    return 0;
 }
 
 
+
+
+void mpipe_isr() {
+/// The RX and TX DMA channels both come here.  The channel interrupt flags are
+/// checked (and cleared) directly, so there is no need to read DMA->IV first.
+    if (MPIPE_RXDMA->CTL & MPIPE_DMAIFG) {
+        MPIPE_RXDMA->CTL &= ~MPIPE_DMAIFG;
+        sub_rxdma_isr();
+    }
+    if (MPIPE_DMA->CTL & MPIPE_DMAIFG) {
+        MPIPE_DMA->CTL &= ~MPIPE_DMAIFG;
+        sub_txdma_isr();
+    }
+}
+
+
+#else
 mpipe_state mpipe_status() {
     return mpipe.state;
 }
@@ -410,17 +1156,19 @@ ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority)
 
     DMA->CTL4 = (DMA_Options_RMWDisable | DMA_Options_RoundRobinDisable | DMA_Options_ENMIEnable);
 
-    // add sequence id & crc to end of the datastream
+    // add sequence id & crc to end of the datastream.  The DMA is started
+    // first, and the CRC is written while the frame goes out (see top).
     data[data_length++] = mpipe.sequence.ubyte[UPPER];
     data[data_length++] = mpipe.sequence.ubyte[LOWER];
-    crcval.ushort       = platform_crc_block(data, data_length);
-    data[data_length++] = crcval.ubyte[UPPER];
-    data[data_length++] = crcval.ubyte[LOWER];
 
-    MPIPE_DMA_TXCONFIG(data, data_length, ON);
+    MPIPE_DMA_TXCONFIG(data, data_length+2, ON);
     UART_OPEN();
     MPIPE_DMA_TXTRIGGER();
 
+    crcval.ushort       = sub_crc_extend(0xFFFF, data, data_length);
+    data[data_length++] = crcval.ubyte[UPPER];
+    data[data_length++] = crcval.ubyte[LOWER];
+
     if (blocking == True) {
     	mpipe_wait();
     }
@@ -602,5 +1350,7 @@ void mpipe_isr() {
 }
 
 
-#endif
+#endif /* MPIPE_DUPLEX */
+
 
+#endif
@@ -43,6 +43,17 @@
 #include "system.h"
 #include "session.h"
 
+#if (PLATFORM_RAMCODE == ENABLED)
+#   if (CC_SUPPORT == CL430)
+#       include <cpy_tbl.h>
+        extern COPY_TABLE ramcode_copy;
+#   elif (CC_SUPPORT == GCC)
+        extern ot_u8 __ramcode_load[];
+        extern ot_u8 __ramcode_start[];
+        extern ot_u8 __ramcode_end[];
+#   endif
+#endif
+
 
 //API wrappers
 void otapi_poweron()    { platform_poweron(); }
@@ -121,8 +132,32 @@ void otapi_led2_off() {
   */
 platform_struct platform;
 
+#if (PLATFORM_ISR_NESTING == ENABLED)
+    /// While a handler is nested (see platform_isr_nest()), the interrupt
+    /// enables that the other platform ISRs have masked are kept in masked.
+#   define NEST_CCR1        0x01
+#   define NEST_CCR2        0x02
+#   define NEST_OVERFLOW    0x04
+#   define NEST_RT1PS       0x08
+#   define NEST_RTCTEV      0x10
+#   define NEST_DMA0        0x20
+#   define NEST_DMA1        0x40
+#   define NEST_DMA2        0x80
+
+    typedef struct {
+        ot_bool active;
+        ot_u8   masked;
+    } nest_struct;
+
+    static nest_struct nest;
+#endif
+
+// Entropy pool driver, see platform_rand()
+void platform_rand_init();
+void platform_rand_harvest();
+
 #if (OT_FEATURE(RTC) == ENABLED)
-#   define RTC_ALARMS       0 //(ALARM_beacon + __todo_IS_STM32L__)
+#   define RTC_ALARMS       (ALARM_event+1)
 #   define RTC_OVERSAMPLE   0
     // RTC_OVERSAMPLE: min 0, max 16
 
@@ -130,14 +165,19 @@ platform_struct platform;
         ot_bool active;
         ot_u16  mask;
         ot_u16  value;
+        ot_u32  next;               // RTC second of the next match
     } rtcalarm;
 
+    /// The active alarms are queued in order[], soonest first, so the RTC ISR
+    /// only has to look at order[0].
     typedef struct {
 #       if (RTC_OVERSAMPLE != 0)
             ot_u32      utc;
 #       endif
 #       if (RTC_ALARMS > 0)
-            rtcalarm    alarm[RTC_ALARMS]
+            ot_u8       count;
+            ot_u8       order[RTC_ALARMS];
+            rtcalarm    alarm[RTC_ALARMS];
 #       endif
     } otrtc_struct;
 
@@ -147,6 +187,36 @@ platform_struct platform;
 #endif
 
 
+/** Kernel Timer (KTIM)
+  * GPTIM runs in continuous mode.  Its overflows are counted in ktim.hi, which
+  * makes a 32 bit count, and CCR1 interrupts at the deadline once ktim.hi
+  * reaches the upper half of the deadline.  GPTIM counts sub-ticks, with
+  * 2^PLATFORM_KTIM_SUBBITS sub-ticks per tick.  The mark replaces zeroing the
+  * timer, and it always moves by whole ticks.
+  */
+#if (PLATFORM_KTIM_SUBBITS > 5)
+#   error "PLATFORM_KTIM_SUBBITS must be 0-5 (GPTIM from ACLK/32 to ACLK/1)"
+#elif (PLATFORM_KTIM_SUBBITS > 2)
+#   define KTIM_PRESCALER   (TIMA_Ctl_Clock_ACLK | ((5-PLATFORM_KTIM_SUBBITS) << 6))
+#else
+#   define KTIM_PRESCALER   (TIMA_Ctl_Clock_ACLK | TIMA_Ctl_Divider_8 | \
+                            ((1 << (2-PLATFORM_KTIM_SUBBITS)) - 1))
+#endif
+#define KTIM_IV_CCR1        0x0002
+#define KTIM_IV_CCR2        0x0004
+#define KTIM_IV_OVERFLOW    0x000E
+#define KTIM_TICK           (((ot_u32)1 << PLATFORM_KTIM_SUBBITS) - 1)
+
+typedef struct {
+    ot_u16  hi;             // GPTIM overflow count
+    ot_bool armed;          // there is a deadline
+    ot_u32  mark;           // count at the last set or flush
+    ot_u32  deadline;       // count of the next kernel run
+} ktim_struct;
+
+ktim_struct ktim;
+
+
 
 
 
@@ -318,6 +388,70 @@ __interrupt void Reset_ISR(void) {
 
 
 // 5. Kernel Timer Interrupt
+ot_u32 sub_ktim_count() {
+/// GPTIM is clocked from ACLK, so it is read until two reads agree.  An
+/// overflow that is not serviced yet (in an ISR, or with interrupts off) is
+/// counted here.  If the overflow ISR runs during the read, it is read again.
+    ot_u16 hi, lo;
+    ot_u32 count;
+
+    do {
+        hi = ktim.hi;
+        do { lo = OT_GPTIM->R; } while (lo != OT_GPTIM->R);
+        count = ((ot_u32)hi << 16) | lo;
+        if ((OT_GPTIM->CTL & TIMA_FLG_IFG) && (lo < 0x8000)) {
+            count += 0x00010000;
+        }
+    } while (hi != ktim.hi);
+
+    return count;
+}
+
+
+void sub_ktim_program() {
+/// CCR1 is loaded when the deadline is in the present 16 bit period of GPTIM,
+/// else the overflow ISR calls this again.  A deadline that has passed (also
+/// while CCR1 was being loaded) sets the CCR1 flag by hand.
+    ot_u32 count;
+
+    OT_GPTIM->CCTL1 = 0;
+    if (ktim.armed) {
+        count = sub_ktim_count();
+        if ((ot_u16)(ktim.deadline >> 16) == (ot_u16)(count >> 16)) {
+            OT_GPTIM->CCR1  = (ot_u16)ktim.deadline;
+            OT_GPTIM->CCTL1 = TIMA_IT_CC;
+            count           = sub_ktim_count();
+        }
+        if ((ot_long)(ktim.deadline - count) <= 0) {
+            OT_GPTIM->CCTL1 = TIMA_IT_CC | TIMA_FLG_CC_CCIFG;
+        }
+    }
+}
+
+
+void sub_ktim_mark() {
+    ktim.mark += (sub_ktim_count() - ktim.mark) & ~KTIM_TICK;
+}
+
+
+#if (PLATFORM_ISR_NESTING == ENABLED)
+static void sub_gptim_defer() {
+/// A handler is nested: mask the GPTIM interrupts, and leave the flags set
+    if (OT_GPTIM->CCTL1 & TIMA_IT_CC) {
+        nest.masked     |= NEST_CCR1;
+        OT_GPTIM->CCTL1 &= ~TIMA_IT_CC;
+    }
+    if (OT_GPTIM->CCTL2 & TIMA_IT_CC) {
+        nest.masked     |= NEST_CCR2;
+        OT_GPTIM->CCTL2 &= ~TIMA_IT_CC;
+    }
+    if (OT_GPTIM->CTL & TIMA_IT_Update) {
+        nest.masked     |= NEST_OVERFLOW;
+        OT_GPTIM->CTL   &= ~TIMA_IT_Update;
+    }
+}
+#endif
+
 #if (ISR_EMBED(GPTIM) == ENABLED)
 #	if (CC_SUPPORT == CL430)
 #		pragma vector=OT_GPTIM_VECTOR
@@ -327,8 +461,38 @@ __interrupt void Reset_ISR(void) {
     OT_IRQPRAGMA(OT_GPTIM_VECTOR)
 #	endif
 OT_INTERRUPT void platform_gptim_isr() {
-    platform_ot_run();
-	LPM4_EXIT;
+/// The overflow only extends the count (and loads CCR1 when the deadline comes
+/// into range), so the MCU goes back to sleep.  CCR1 runs the kernel, which
+/// the radio ISRs can preempt with PLATFORM_ISR_NESTING.
+#   if (PLATFORM_ISR_NESTING == ENABLED)
+    if (nest.active) {
+        sub_gptim_defer();
+        return;
+    }
+#   endif
+
+    switch (OT_GPTIM->IV) {
+        case KTIM_IV_CCR1:
+            OT_GPTIM->CCTL1 = 0;
+            SYS_PROFILE_WAIT_START();
+            PLATFORM_ISR_NEST();
+            platform_ot_run();
+            PLATFORM_ISR_UNNEST();
+            LPM4_EXIT;
+            break;
+
+        case KTIM_IV_CCR2:
+            OT_GPTIM->CCTL2 = 0;
+            LPM4_EXIT;
+            break;
+
+        case KTIM_IV_OVERFLOW:
+            ktim.hi++;
+            sub_ktim_program();
+            break;
+
+        default: break;
+    }
 }
 #endif
 
@@ -336,22 +500,113 @@ OT_INTERRUPT void platform_gptim_isr() {
 // 6. RTC Interrupt
 #if (OT_FEATURE(RTC) == ENABLED)
 
+static ot_u32 sub_rtc_count() {
+/// The RTC is in counter mode, counting seconds in TIM1:TIM0.  It is read until
+/// TIM1 is stable, because it can tick between the two reads.
+    ot_u16 hi, lo;
+    do {
+        hi = RTC->TIM1;
+        lo = RTC->TIM0;
+    } while (hi != RTC->TIM1);
+
+    return ((ot_u32)hi << 16) | lo;
+}
+
+
 #if (RTC_ALARMS > 0)
-void sub_juggle_rtc_alarm() {
-    ot_u8  i;
-    ot_u32 comp;
-    ot_u32 next     = ~0;
-    ot_u32 rtcval   = RTC_GetCounter();
-
-    for (i=0; i<RTC_ALARMS; i++) {
-        if (otrtc.alarm[i].active) {
-            comp    = rtcval & ((ot_u32)otrtc.alarm[i].mask << RTC_OVERSAMPLE);
-            comp   += (ot_u32)otrtc.alarm[i].value << RTC_OVERSAMPLE;
-            next    = (comp < next) ? comp : next;
+static void sub_rtc_program(ot_u32 now) {
+/// RTC_A has no compare register in counter mode.  While the head alarm is
+/// more than 256 s away, only the 8 bit counter overflow (RTCTEV, every 256 s)
+/// interrupts.  In the last 256 s, the 1 Hz RT1PS interval interrupts.  The
+/// ISR only compares the head alarm, and the MCU is only woken from LPM when
+/// an alarm is due.
+    RTC->PS1CTL    &= ~RT1PSIE;
+    RTC->CTL01     &= ~RTCTEVIE;
+
+    if (otrtc.count != 0) {
+        if ((otrtc.alarm[otrtc.order[0]].next - now) <= 256) {
+            RTC->PS1CTL    |= RT1PSIE;
+        }
+        else {
+            RTC->CTL01     |= RTCTEVIE;
         }
     }
+}
+#endif
+
 
-    RTC_SetAlarm(rtcval+next);
+#if (RTC_ALARMS > 0)
+static ot_u32 sub_rtc_next(ot_u32 now, ot_u16 mask, ot_u16 value) {
+/// Returns the first second after "now" where the masked lower 16 bits of the
+/// RTC equal the masked value.  The RTC bits above the mask are free, so this
+/// always exists, and it is found without counting through the seconds.
+    ot_u32 next = now + 1;
+    ot_u32 m    = mask;
+    ot_u32 v    = value & m;
+    ot_u32 diff = (next ^ v) & m;
+    ot_u32 bit;
+
+    if (diff == 0) {
+        return next;
+    }
+
+    // Highest masked bit that differs: if next has a 0 there, set it and take
+    // the masked value below it.  Otherwise, carry into the lowest free 0 bit
+    // above it.
+    for (bit=0x8000; (bit & diff) == 0; bit>>=1);
+    if (v & bit) {
+        return (next & ~((bit<<1)-1)) | (v & ((bit<<1)-1));
+    }
+    for (bit<<=1; (bit != 0) && (bit & (m | next)); bit<<=1);
+    return (next & ~((bit<<1)-1)) | bit | (v & (bit-1));
+}
+
+
+static void sub_rtc_remove(ot_u8 alarm_id) {
+    ot_u8 i, j;
+    for (i=0, j=0; i<otrtc.count; i++) {
+        if (otrtc.order[i] != alarm_id) {
+            otrtc.order[j++] = otrtc.order[i];
+        }
+    }
+    otrtc.count = j;
+}
+
+
+static void sub_rtc_queue(ot_u8 alarm_id, ot_u32 now) {
+/// Takes the alarm out of the queue and, if it is active, puts it back in at
+/// its next match.  The compare is wrap-safe.
+    ot_u8 i;
+    sub_rtc_remove(alarm_id);
+
+    if (otrtc.alarm[alarm_id].active) {
+        otrtc.alarm[alarm_id].next = sub_rtc_next(now, otrtc.alarm[alarm_id].mask,
+                                                       otrtc.alarm[alarm_id].value);
+        for (i=otrtc.count; i>0; i--) {
+            if ((ot_long)(otrtc.alarm[otrtc.order[i-1]].next - otrtc.alarm[alarm_id].next) <= 0) {
+                break;
+            }
+            otrtc.order[i] = otrtc.order[i-1];
+        }
+        otrtc.order[i] = alarm_id;
+        otrtc.count++;
+    }
+}
+
+
+static void sub_rtc_service() {
+/// Pops each due alarm from the head of the queue, requeues it at its next
+/// match, and hands it to the kernel.  Then the head is programmed.
+    ot_u32  now = sub_rtc_count();
+    ot_u8   alarm_id;
+
+    while ((otrtc.count != 0) && \
+           ((ot_long)(now - otrtc.alarm[otrtc.order[0]].next) >= 0)) {
+        alarm_id = otrtc.order[0];
+        sub_rtc_queue(alarm_id, now);
+        sys_rtc_alarm(alarm_id);
+    }
+    sub_rtc_program(now);
 }
 #endif
 
@@ -365,21 +620,41 @@ void sub_juggle_rtc_alarm() {
 		//unknown at this time
 #	endif
 OT_INTERRUPT void platform_rtc_isr() {
-/// Currently Psuedocode.  RTC is normally used with ALARM interrupt.  If it
-/// is oversampling, then it will also interrupt on each second, so the user
-/// can increment the UTC.
+/// The interrupt is the 1 Hz RT1PS interval or the 8 bit counter overflow
+/// (RTCTEV).  Reading RTC->IV clears the flag.  If the RTC is oversampling,
+/// the 1 Hz interrupt is also used to increment the UTC.  While a handler is
+/// nested, the interrupts are masked instead, and the flag stays set.
+    ot_u16 rtc_iv;
+
+#   if (PLATFORM_ISR_NESTING == ENABLED)
+    if (nest.active) {
+        if (RTC->PS1CTL & RT1PSIE) {
+            nest.masked |= NEST_RT1PS;
+            RTC->PS1CTL &= ~RT1PSIE;
+        }
+        if (RTC->CTL01 & RTCTEVIE) {
+            nest.masked |= NEST_RTCTEV;
+            RTC->CTL01  &= ~RTCTEVIE;
+        }
+        return;
+    }
+#   endif
+
+    SYS_PROFILE_WAIT_START();
+    rtc_iv = RTC->IV;
+
 #   if (RTC_OVERSAMPLE != 0)
-        if (__rtc_interrupt_is_second__) {
+        if (rtc_iv == RTCIV_RT1PSIFG) {
             otrtc.utc++;
-            //add clear flag
         }
 #   endif
 #   if (RTC_ALARMS > 0)
-        if (__rtc_interrupt_is_alarm__) {
-            sub_juggle_rtc_alarm();
-            //add clear flag
+        if ((rtc_iv == RTCIV_RT1PSIFG) || (rtc_iv == RTCIV_RTCTEVIFG)) {
+            sub_rtc_service();
         }
-#    endif
+#   endif
+
+    SYS_PROFILE_WAIT_STOP();
 }
 #endif
 
@@ -406,13 +681,107 @@ void platform_enable_interrupts() {
     __no_operation();
 }
 
+#if (PLATFORM_ISR_NESTING == ENABLED)
+void platform_isr_nest() {
+/// The caller has cleared its own flag.  From here to platform_isr_unnest(),
+/// the radio ISRs can preempt it, and the GPTIM, RTC and DMA ISRs defer.
+    nest.active = True;
+    SYS_PROFILE_WAIT_STOP();
+    platform_enable_interrupts();
+}
+
+void platform_isr_unnest() {
+/// The deferred ISRs still have their flags set, so they run when the caller
+/// returns.  An enable that the nested code cleared meanwhile may come back:
+/// at worst this gives an early kernel run or an extra RTC interval, and both
+/// of these are harmless.
+    platform_disable_interrupts();
+    nest.active = False;
+
+    if (nest.masked & NEST_CCR1)        OT_GPTIM->CCTL1 |= TIMA_IT_CC;
+    if (nest.masked & NEST_CCR2)        OT_GPTIM->CCTL2 |= TIMA_IT_CC;
+    if (nest.masked & NEST_OVERFLOW)    OT_GPTIM->CTL   |= TIMA_IT_Update;
+#   if (OT_FEATURE(RTC) == ENABLED)
+    if (nest.masked & NEST_RT1PS)       RTC->PS1CTL     |= RT1PSIE;
+    if (nest.masked & NEST_RTCTEV)      RTC->CTL01      |= RTCTEVIE;
+#   endif
+#   ifdef DMA0
+    if (nest.masked & NEST_DMA0)        DMA0->CTL       |= DMA_IT_IE;
+#   endif
+#   ifdef DMA1
+    if (nest.masked & NEST_DMA1)        DMA1->CTL       |= DMA_IT_IE;
+#   endif
+#   ifdef DMA2
+    if (nest.masked & NEST_DMA2)        DMA2->CTL       |= DMA_IT_IE;
+#   endif
+    nest.masked = 0;
+}
+
+ot_bool platform_isr_defer_dma() {
+/// Called first in a DMA ISR.  If a handler is nested, the DMA interrupts are
+/// masked until platform_isr_unnest(), and the ISR must return at once.
+    if (nest.active == False) {
+        return False;
+    }
+#   ifdef DMA0
+    if (DMA0->CTL & DMA_IT_IE) { nest.masked |= NEST_DMA0;  DMA0->CTL &= ~DMA_IT_IE; }
+#   endif
+#   ifdef DMA1
+    if (DMA1->CTL & DMA_IT_IE) { nest.masked |= NEST_DMA1;  DMA1->CTL &= ~DMA_IT_IE; }
+#   endif
+#   ifdef DMA2
+    if (DMA2->CTL & DMA_IT_IE) { nest.masked |= NEST_DMA2;  DMA2->CTL &= ~DMA_IT_IE; }
+#   endif
+    return True;
+}
+#endif
+
+#if (OT_FEATURE(POWERMGR) == ENABLED)
+void platform_enter_lpm(ot_u8 mode) {
+/// Interrupts are on hold.  LPM0 and LPM4 enable them in the instruction that
+/// sleeps.  LPM3 keeps GPTIM running, so an interrupt before PMM_EnterLPM3()
+/// sleeps only costs a later wakeup.
+    switch (mode) {
+        case 0:     __bis_SR_register(LPM0_bits + GIE);
+                    break;
+
+        case 1:     platform_enable_interrupts();
+                    PMM_EnterLPM3();
+                    break;
+
+        default:    PMM_EnterLPM4();
+                    break;
+    }
+    __no_operation();
+}
+#endif
+
+#if (OT_FEATURE(CLKSCALE) == ENABLED)
+void platform_set_perf(ot_u8 level) {
+/// Only the MCLK divider (DIVM) changes.  The new rate takes effect within a
+/// few MCLK cycles, so there is nothing to wait for.
+    static const ot_u16 mclk_div[PLATFORM_PERF_LEVELS] = {
+        (div4 << clockMCLK), (div2 << clockMCLK), (div1 << clockMCLK)
+    };
+    ot_u16 ctl5;
+
+    if (level >= PLATFORM_PERF_LEVELS) {
+        level = PLATFORM_PERF_LEVELS-1;
+    }
+    ctl5 = (UCS->CTL5 & ~(7 << clockMCLK)) | mclk_div[level];
+    if (UCS->CTL5 != ctl5) {
+        UCS->CTL5 = ctl5;
+    }
+}
+#endif
+
 void platform_ot_preempt() {
-/// Manually kick the GPTIM interrupt flag in order to pre-empt the kernel.
-/// Also, save the current value of the timer so that the kernel can subtract
-/// whatever time passed since the last event.
-    ot_u16 scratch = OT_GPTIM->R;
-    platform_set_gptim(scratch);
-    OT_GPTIM->CTL  |= 1;
+/// Manually kick the CCR1 interrupt flag in order to pre-empt the kernel.  The
+/// mark is kept, so the kernel can subtract whatever time passed since the
+/// last event.
+    ktim.armed      = True;
+    ktim.deadline   = sub_ktim_count();
+    OT_GPTIM->CCTL1 = TIMA_IT_CC | TIMA_FLG_CC_CCIFG;
 }
 
 void platform_ot_pause() {
@@ -421,14 +790,13 @@ void platform_ot_pause() {
 }
 
 void platform_ot_run() {
-/// 1. Save the amount of time that just passed
-/// 2. Put the timer into free-running upcounter to time kernel process
-/// 3. Run System Kernel, which returns its next scheduled call
-/// 4. Put the next scheduled call into the timer, and turn it back on
-    ot_u16 next_event;
-    ot_u16 elapsed_time;
-    elapsed_time    = OT_GPTIM->CCR0;
-  //elapsed_time   += platform_get_gptim();  //experimental, for use with continuous timer
+/// 1. Save the amount of time that just passed, in whole ticks.  The sub-tick
+///    stays with the mark, so the kernel timebase does not slip.
+/// 2. Run System Kernel, which returns its next scheduled call
+/// 3. Put the next scheduled call into the timer (32 bits)
+    ot_u32 next_event;
+    ot_u32 elapsed_time;
+    elapsed_time    = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
     next_event      = sys_event_manager( elapsed_time );
 
 #   if (OT_PARAM(KERNEL_LIMIT) > 0)
@@ -436,7 +804,11 @@ void platform_ot_run() {
             next_event = OT_PARAM(KERNEL_LIMIT);
 #   endif
 
-    platform_set_gptim( next_event );
+    platform_set_ktim( next_event );
+
+#   if (MCU_FEATURE(RANDDMA) == ENABLED)
+        platform_rand_harvest();
+#   endif
 }
 
 
@@ -459,6 +831,26 @@ void platform_poweron() {
 
     WDTA->CTL = WDTPW + WDTHOLD;
 
+    /// Paint the stack while it is nearly empty (see OT_FEATURE_MEMSTATS)
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    sys_stack_paint();
+#   endif
+
+    /// Copy the OT_RAMCODE functions to SRAM, before any of them can run.
+    /// DMA is not set up yet, so the GCC copy is a plain loop.
+#   if (PLATFORM_RAMCODE == ENABLED)
+#   if (CC_SUPPORT == CL430)
+    copy_in(&ramcode_copy);
+#   elif (CC_SUPPORT == GCC)
+    {   ot_u8* src  = __ramcode_load;
+        ot_u8* dst  = __ramcode_start;
+        while (dst < __ramcode_end) {
+            *dst++ = *src++;
+        }
+    }
+#   endif
+#   endif
+
     ///@note On SVSM Config Flags: (1) It is advised in all cases to include
     ///      SVSM_EventDelay.  (2) If using line-power (not battery), it is
     ///      advised to enable FullPerformance and ActiveDuringLPM.  (3) Change
@@ -476,10 +868,11 @@ void platform_poweron() {
     SFRIFG1 &= ~(NMIIFG | OFIFG | VMAIFG);
     SFRIE1   = (NMIIE | /* OFIE | */ ACCVIE);   //Oscillator fault can be glitchy
 
-    platform_init_gptim(0x01C3);        // Initialize GPTIM (to 1024 Hz)
+    platform_init_gptim(KTIM_PRESCALER); // Initialize GPTIM (to 1024 Hz ticks)
     platform_init_gpio();
     platform_init_memcpy();
     platform_init_prand(0xBEEF);        // BEEF is tasty
+    platform_rand_init();
 
     /// 3. Initialize Low-Level Drivers (worm, mpipe)
     // Restore vworm (following save on shutdown)
@@ -495,11 +888,10 @@ void platform_poweron() {
 void platform_poweroff() {
 /// 1. Disable all NMI interrupts that can break flash writes. <BR>
 /// 2. Put any mirror data into the flash <BR>
-/// 3. Save the vworm mapping table
+/// 3. Save the vworm mapping table and the veelite boot snapshot
     ot_u8 old_sfrie1 = SFRIE1;
     SFRIE1 = 0;
-    ISF_syncmirror();
-    vworm_save();
+    vl_save();
     SFRIE1 = old_sfrie1;
 }
 
@@ -513,7 +905,10 @@ void platform_init_OT() {
 
 
 void platform_fastinit_OT() {
-    platform_init_OT();
+	buffers_init(); //buffers init must be first in order to do core dumps
+	vl_fastinit();  //Veelite from the boot snapshot, if there is one
+	radio_init();   //radio init third
+	sys_init();     //system init last
 }
 
 
@@ -699,13 +1094,19 @@ void platform_init_gptim(ot_uint prescaler) {
 /// bits 7:6 - Input Divider (ID) -     values {0,1,2,3} yield division by {1,2,4,8}  <BR>
 /// bits 2:0 - Input Divider 2 (IDEX) - values b000-b111 yield division by 1 to 8  <BR>
 
-	// Don't enable interrupt on init.  Call platform_ot_preempt to enable.
-    ot_u16 ctl      = (prescaler & 0x01E0) /* | TIMA_IT_Update */;
+/// GPTIM runs continuously, with only the overflow interrupt, until there is a
+/// deadline (call platform_ot_preempt to start the kernel).
+    ot_u16 ctl      = (prescaler & 0x01E0) | TIMA_Ctl_Mode_Continuous | TIMA_IT_Update;
     ot_u16 idex     = (prescaler & 0x0007);
 
+    ktim.hi         = 0;
+    ktim.mark       = 0;
+    ktim.armed      = False;
+    OT_GPTIM->CCTL1 = 0;
+    OT_GPTIM->CCTL2 = 0;
     OT_GPTIM->CTL  |= TIMA_FLG_TACLR;   //Clear the timer before changing mode
-    OT_GPTIM->CTL   = ctl;
     OT_GPTIM->EX0   = idex;
+    OT_GPTIM->CTL   = ctl;
 }
 
 
@@ -758,8 +1159,8 @@ void platform_init_rtc(ot_u32 value) {
 
 
     // Set RTC value from that stored in configuration
-    RTC->TIM0   = ((ot_u16*)value)[0];
-    RTC->TIM1   = ((ot_u16*)value)[1];
+    RTC->TIM0   = (ot_u16)value;
+    RTC->TIM1   = (ot_u16)(value >> 16);
 
     platform_enable_rtc();
 #endif
@@ -792,22 +1193,42 @@ void platform_init_memcpy() {
   */
 
 ot_u16 platform_get_gptim() {
-    return OT_GPTIM->R;
+    ot_u32 ticks = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
+    return (ticks > 65535) ? 65535 : (ot_u16)ticks;
+}
+
+
+ot_u32 platform_get_ktim() {
+    return sub_ktim_count() - ktim.mark;
+}
+
+
+ot_u32 platform_stamp() {
+    return sub_ktim_count();
 }
 
+#if (OT_FEATURE(PROFILER) == ENABLED)
+ot_u32 platform_get_cycles() {
+    return (ot_u32)OT_GPTIM->R;
+}
+#endif
+
 void platform_set_gptim(ot_u16 value) {
-    OT_GPTIM->CTL  |= 0x0004;   //clear & stop timer
-    OT_GPTIM->CTL  &= ~0x0033;  //clear configuration
-    OT_GPTIM->CCR0  = value;    //set next interval
-    OT_GPTIM->CTL  |= 0x0012;   //restart in upmode, with interrupt
-    ///@todo continuous-up with interrupt is experimental
+    platform_set_ktim(value);
+}
+
+
+void platform_set_ktim(ot_u32 value) {
+    sub_ktim_mark();
+    ktim.deadline   = ktim.mark + (value << PLATFORM_KTIM_SUBBITS);
+    ktim.armed      = True;
+    sub_ktim_program();
 }
 
 void platform_flush_gptim() {
-    OT_GPTIM->CTL  |= 0x0004;   //clear & stop timer
-    OT_GPTIM->CTL  &= ~0x0033;  //clear configuration
-    OT_GPTIM->CCR0  = 65535;    //workaround to a known CC430 erratum
-    OT_GPTIM->CTL  |= 0x0020;   //restart in continuous-up, without interrupt
+    sub_ktim_mark();
+    ktim.armed      = False;
+    OT_GPTIM->CCTL1 = 0;
 }
 
 void platform_run_watchdog() {
@@ -825,17 +1246,24 @@ void platform_reset_watchdog(ot_u16 reset) {
 }
 
 void platform_enable_rtc() {
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    sub_rtc_program(sub_rtc_count());
+#else
     RTC->PS1CTL |= RT1PSIE;
+#endif
 }
 
+
 void platform_disable_rtc() {
     RTC->PS1CTL &= ~RT1PSIE;
+    RTC->CTL01  &= ~RTCTEVIE;
 }
 
+
 ot_u32 platform_get_time() {
 #if (OT_FEATURE(RTC) == ENABLED)
 #   if (RTC_OVERSAMPLE == 0)
-        return ///@todo find time register, if it exists
+        return sub_rtc_count();
 #   else
         return otrtc.utc;
 #   endif
@@ -844,24 +1272,55 @@ ot_u32 platform_get_time() {
 #endif
 }
 
+
 void platform_set_time(ot_u32 utc_time) {
-#if (RTC_OVERSAMPLE != 0)
-    otrtc.utc   = utc_time;
-#else
-    ///@todo find time register, if it exists
+#if (OT_FEATURE(RTC) == ENABLED)
+#   if (RTC_OVERSAMPLE != 0)
+        otrtc.utc   = utc_time;
+#   else
+        RTC->CTL01 |= RTCHOLD;
+        RTC->TIM0   = (ot_u16)utc_time;
+        RTC->TIM1   = (ot_u16)(utc_time >> 16);
+        RTC->CTL01 &= ~RTCHOLD;
+#   endif
+#   if (RTC_ALARMS > 0)
+    {   // The time has jumped, so every alarm is requeued
+        ot_u8 i;
+        platform_disable_interrupts();
+        for (i=0; i<RTC_ALARMS; i++) {
+            sub_rtc_queue(i, sub_rtc_count());
+        }
+        sub_rtc_program(sub_rtc_count());
+        platform_enable_interrupts();
+    }
+#   endif
 #endif
 }
 
-void platform_set_rtc_alarm(ot_u8 alarm_i, ot_u16 mask, ot_u16 value) {
-#if (OT_FEATURE(RTC) == ENABLED)
-    otrtc.alarm[alarm_i].mask     = mask;
-    otrtc.alarm[alarm_i].value    = value;
+
+void platform_set_rtc_alarm(ot_u8 alarm_id, ot_u16 mask, ot_u16 value) {
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    ot_u32 now;
+    platform_disable_interrupts();
+    otrtc.alarm[alarm_id].mask  = mask;
+    otrtc.alarm[alarm_id].value = value;
+    now                         = sub_rtc_count();
+    sub_rtc_queue(alarm_id, now);
+    sub_rtc_program(now);
+    platform_enable_interrupts();
 #endif
 }
 
+
 void platform_enable_rtc_alarm(ot_u8 alarm_id, ot_bool enable) {
-#if (OT_FEATURE(RTC) == ENABLED)
-    otrtc.alarm[alarm_i].active   = enable;
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    ot_u32 now;
+    platform_disable_interrupts();
+    otrtc.alarm[alarm_id].active = enable;
+    now                          = sub_rtc_count();
+    sub_rtc_queue(alarm_id, now);
+    sub_rtc_program(now);
+    platform_enable_interrupts();
 #endif
 }
 
@@ -869,7 +1328,6 @@ void platform_enable_rtc_alarm(ot_u8 alarm_id, ot_bool enable) {
 
 
 
-
 /** Platform Debug Triggers <BR>
   * ========================================================================<BR>
   * Triggers are optional pins mostly used for debugging.  Sometimes they are
@@ -938,122 +1396,579 @@ ot_u16 platform_crc_result() {
 
 
 
+/** Platform AES128 Routines <BR>
+  * ========================================================================<BR>
+  * The CC430 AES accelerator keeps its key between blocks, so the key is only
+  * written when it differs from the last one, and the decryption key is only
+  * derived once per key.  This AES module has no DMA trigger, so background
+  * jobs are fed from the AES ready interrupt: the ISR drains each block and
+  * loads the next one, and the CPU is free while the engine runs.
+  */
+#if (MCU_FEATURE(AES128) == ENABLED)
+
+#define AES_OP_NONE     0xFFFF
+
+typedef struct {
+    ot_u32          key[4];         // copy of the key in the engine
+    ot_u16          keyop;          // AES_OP_ENCRYPT, _DECRYPT, or _NONE
+    ot_u16*         input;
+    ot_u16*         output;
+    volatile ot_int blocks;         // blocks left in a background job
+    ot_int          done;
+    ot_sig          callback;
+} aes_struct;
+
+static aes_struct platform_aes = { {0, 0, 0, 0}, AES_OP_NONE, NULL, NULL, 0, 0, NULL };
+
+
+
+void sub_aes_loadkey(ot_u32* key, ot_u16 op) {
+    ot_u16* key16;
+    ot_int  i;
+
+    if ((platform_aes.keyop == op)      && \
+        (platform_aes.key[0] == key[0]) && (platform_aes.key[1] == key[1]) && \
+        (platform_aes.key[2] == key[2]) && (platform_aes.key[3] == key[3])) {
+        return;
+    }
+
+    /// Decryption uses the last round key, which the engine derives from the
+    /// key with AES_OP_GENKEY.  It stays in the engine after switching over.
+    AES->CTL0   = (op == AES_OP_DECRYPT) ? AES_OP_GENKEY : op;
+    key16       = (ot_u16*)key;
+    for (i=0; i<8; i++) {
+        AES->KEY = key16[i];
+    }
+    if (op == AES_OP_DECRYPT) {
+        while (AES->STAT & AES_BUSY);
+        AES->CTL0 = AES_OP_DECRYPT;
+    }
+
+    for (i=0; i<4; i++) {
+        platform_aes.key[i] = key[i];
+    }
+    platform_aes.keyop = op;
+}
+
+
+void sub_aes_load() {
+/// The engine starts on its own when the 16th byte is written
+    ot_u16* in = platform_aes.input;
+    ot_int  i;
+
+    for (i=0; i<8; i++) {
+        AES->DIN = *in++;
+    }
+    platform_aes.input = in;
+}
+
+
+void sub_aes_unload() {
+    ot_u16* out = platform_aes.output;
+    ot_int  i;
+
+    for (i=0; i<8; i++) {
+        *out++ = AES->DOUT;
+    }
+    platform_aes.output = out;
+}
+
+
+void sub_aes_run(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks, ot_u16 op) {
+/// Each block is read in completely before its output is written, so input
+/// and output may be the same buffer.
+    while (platform_aes_busy());
+
+    sub_aes_loadkey(key, op);
+    platform_aes.input  = (ot_u16*)input;
+    platform_aes.output = (ot_u16*)output;
+
+    for (; blocks > 0; blocks--) {
+        sub_aes_load();
+        while (AES->STAT & AES_BUSY);
+        sub_aes_unload();
+    }
+}
+
+
+void platform_aes_encrypt(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks) {
+    sub_aes_run(input, output, key, blocks, AES_OP_ENCRYPT);
+}
+
+
+void platform_aes_decrypt(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks) {
+    sub_aes_run(input, output, key, blocks, AES_OP_DECRYPT);
+}
+
+
+void platform_aes_start(ot_u32* input, ot_u32* output, ot_u32* key, ot_int blocks,
+                        ot_bool decrypt, ot_sig callback ) {
+    while (platform_aes_busy());
+
+    if (blocks <= 0) {
+        if (callback != NULL) {
+            callback(0);
+        }
+        return;
+    }
+
+    sub_aes_loadkey(key, (decrypt) ? AES_OP_DECRYPT : AES_OP_ENCRYPT);
+    platform_aes.input      = (ot_u16*)input;
+    platform_aes.output     = (ot_u16*)output;
+    platform_aes.done       = 0;
+    platform_aes.callback   = callback;
+    platform_aes.blocks     = blocks;
+
+    AES->CTL0  &= ~(AES_RDYIFG | AES_ERRFG);
+    AES->CTL0  |= AES_RDYIE;
+    sub_aes_load();
+}
+
+
+ot_bool platform_aes_busy() {
+    return (ot_bool)(platform_aes.blocks != 0);
+}
+
+
+#if (CC_SUPPORT == CL430)
+#   pragma vector=AES_VECTOR
+#elif (CC_SUPPORT == IAR_V5)
+    //unknown at this time
+#elif (CC_SUPPORT == GCC)
+    OT_IRQPRAGMA(AES_VECTOR)
+#endif
+OT_INTERRUPT void platform_aes_isr(void) {
+/// Reading the output clears AES_RDYIFG.  An engine error ends the job.
+    ot_int result;
+
+    if (AES->CTL0 & AES_ERRFG) {
+        platform_aes.keyop  = AES_OP_NONE;
+        result              = -1;
+    }
+    else {
+        sub_aes_unload();
+        platform_aes.done++;
+        if (--platform_aes.blocks > 0) {
+            sub_aes_load();
+            return;
+        }
+        result = platform_aes.done;
+    }
+
+    AES->CTL0          &= ~(AES_RDYIE | AES_RDYIFG | AES_ERRFG);
+    platform_aes.blocks = 0;
+    if (platform_aes.callback != NULL) {
+        platform_aes.callback(result);
+    }
+    LPM4_EXIT;
+}
+
+#endif
+
+
+
+
+
 /** Platform Random Number Generation Routines <BR>
   * ========================================================================<BR>
   * The platform must be able to compute a strong random number (via function
-  * platform_rand()) and a "pseudo" random number (via platform_prand_u8()).
+  * platform_rand()).  The "pseudo" random number generator is in otlib/prand.c,
+  * and it does not use the CRC HW, so prand and CRC streaming do not collide.
+  *
+  * platform_rand() draws bytes from a small RAM pool of conditioned entropy,
+  * so a draw costs O(1) per byte unless the pool is empty.  The pool is filled
+  * in batches of RAND_SAMPLES ADC12 conversions of the GWNADC pin (floating,
+  * or a zener if the board has one).  With MCU_FEATURE_RANDDMA the DMA moves
+  * each conversion to RAM while the CPU sleeps or works, and the completed
+  * batch is picked up after the next kernel run.  Each batch is then:
+  * - Health tested on the low 4 bits of each sample, which are the noisy ones
+  *   (see Supplements/rand testing).  The tests are a repetition count and a
+  *   16 bin chi-square, which is the ent test reduced to integer math.  A
+  *   failed batch is discarded.
+  * - Conditioned by the HW CRC, which compresses 64 bits of sampled noise into
+  *   each 16 bits of output.  The CRC state carries across batches.
+  *
+  * If RAND_FAIL_LIMIT batches fail in a row, the source is considered broken
+  * and platform_rand() falls back to platform_prand_u8() rather than hanging.
   */
 
-void platform_rand(ot_u8* rand_out, ot_int bytes_out) {
-/*
-/// The operation here is to pull 32 bits for the least-significant bit of
-/// 32 12 bit samples of the temperature sensor.  The CC430 ADC works fairly
-/// fast, so this function can be done in, ideally, less than 200 us.
-/// One thing you can do is buffer random numbers when the device is idle.
-    ot_uint adclsr;
-    ot_uint *adcmemory;
-    ot_u8   *adcmctl;
+#ifndef MCU_FEATURE_RANDDMA
+#   define MCU_FEATURE_RANDDMA  DISABLED
+#endif
+#ifndef OT_GWNADC_CHAN
+#   define OT_GWNADC_CHAN       1
+#endif
+#ifndef RAND_POOL_SIZE
+#   define RAND_POOL_SIZE       16          // bytes, must be a power of 2
+#endif
+#ifndef RAND_FAIL_LIMIT
+#   define RAND_FAIL_LIMIT      8
+#endif
 
-#   ifdef OT_GWNZENER_PORT
-        OT_GWNZENER_PORT |= OT_GWNZENER_PIN;
-#   endif
+#define RAND_SAMPLES            64                      // samples per batch
+#define RAND_BATCH_BYTES        (RAND_SAMPLES/8)        // 4 bits in : 1 bit out
+#define RAND_RCT_CUTOFF         6                       // ~2^-20 per sample
+#define RAND_CHISQ_LIMIT        151                     // 4 * 37.7 (p=0.001)
 
-    ///1. Initialize ADC12_A
-    //    - default sampling time = minimum (better for random numbers anyway)
-    //    - use multi-sample-converter
-    ADC12CTL0 = ADC12ON + ADC12MSC;
+#if (MCU_FEATURE(RANDDMA) == ENABLED) && \
+    (MCU_FEATURE(MEMCPYDMA) == ENABLED) && (RAND_DMANUM == MEMCPY_DMANUM)
+#   error "RAND_DMANUM and MEMCPY_DMANUM must use different DMA channels"
+#endif
 
-    // use temperature sensor input source
-    // use internal sampling timer
-    // use repeat-single-channel mode
-    // use other defaults (start at MEM0, MODOSC, no clock divide, etc)
-    ADC12CTL1 = ADC12SHP + ADC12CONSEQ_2;
+typedef struct {
+    volatile ot_u8  busy;
+    ot_u8           active;
+    ot_u8           fails;
+    ot_u8           get;
+    volatile ot_u8  put;
+    ot_u16          crc;
+    ot_u8           pool[RAND_POOL_SIZE];
+    ot_u8           sample[RAND_SAMPLES];
+} rand_struct;
 
-    // use 12 bit precision
-    // use other defaults, including temp sensor ON
-    ADC12CTL2 = ADC12RES_2;
+static rand_struct platform_rng;
 
-#   if (OT_GWNADC_BITS == 8)
-    //Special case for direct synthesis of random bytes.
 
-#   else
 
+void sub_rand_start() {
+/// Sample the GWNADC pin as fast as the ADC goes: minimum sampling time, 
+/// multi-sample-converter, repeat-single-channel, 12 bit.  The DMA stores the
+/// low byte of each conversion.  Without the DMA, the batch is polled here.
+#   ifdef OT_GWNZENER_PORT
+        OT_GWNZENER_PORT->DOUT |= OT_GWNZENER_PIN;
+#   endif
+    OT_GWNADC_PORT->SEL    |= OT_GWNADC_PIN;
+    ADC12CTL0               = ADC12ON + ADC12MSC;
+    ADC12CTL1               = ADC12SHP + ADC12CONSEQ_2;
+    ADC12CTL2               = ADC12RES_2;
+    ADC12MCTL0              = OT_GWNADC_CHAN;
+
+#   if (MCU_FEATURE(RANDDMA) == ENABLED)
+#       if (RAND_DMANUM == 0)
+            DMA->CTL0       = (DMA->CTL0 & 0xFF00) | DMA_Trigger_ADC12IFGx;
+#       elif (RAND_DMANUM == 1)
+            DMA->CTL0       = (DMA->CTL0 & 0x00FF) | (DMA_Trigger_ADC12IFGx << 8);
+#       else
+            DMA->CTL1       = DMA_Trigger_ADC12IFGx;
+#       endif
+        RAND_DMA->SA_L      = (ot_u16)&ADC12MEM0;
+        RAND_DMA->DA_L      = (ot_u16)platform_rng.sample;
+        RAND_DMA->SZ        = RAND_SAMPLES;
+        RAND_DMA->CTL       = ( DMA_Mode_Single | \
+                                DMA_DestinationInc_Enable | \
+                                DMA_SourceInc_Disable | \
+                                DMA_DestinationDataSize_Byte | \
+                                DMA_SourceDataSize_Word | \
+                                DMA_TriggerLevel_RisingEdge | \
+                                0x10 );
+        ADC12CTL0          |= ADC12ENC + ADC12SC;
+#   else
+    {   ot_int i;
+        ADC12CTL0          |= ADC12ENC + ADC12SC;
+        for (i=0; i<RAND_SAMPLES; i++) {
+            while ((ADC12IFG & 1) == 0);
+            platform_rng.sample[i] = (ot_u8)ADC12MEM0;
+        }
+    }
 #   endif
 
-    ///3. Shut down ADC
-    ADC12CTL0 = 0;
+    platform_rng.active = True;
+}
+
 
+void sub_rand_stop() {
+    ADC12CTL0              &= ~ADC12ENC;
+    ADC12CTL0               = 0;
+#   if (MCU_FEATURE(RANDDMA) == ENABLED)
+        RAND_DMA->CTL       = 0;
+#   endif
+    OT_GWNADC_PORT->SEL    &= ~OT_GWNADC_PIN;
 #   ifdef OT_GWNZENER_PORT
-        OT_GWNZENER_PORT &= ~(OT_GWNZENER_PIN);
+        OT_GWNZENER_PORT->DOUT &= ~(OT_GWNZENER_PIN);
 #   endif
-*/
+    platform_rng.active = False;
 }
 
 
-ot_u16 prand_reg;
+ot_bool sub_rand_health() {
+/// Online health tests on the noise nibbles of a batch.  The repetition count
+/// catches a stuck source, the chi-square catches a biased one.
+    ot_u8   bins[16];
+    ot_u8   run     = 0;
+    ot_u8   last    = 0xFF;
+    ot_u16  chisq   = 0;
+    ot_int  i;
 
-void platform_init_prand(ot_u16 seed) {
-    prand_reg = seed;
+    for (i=0; i<16; i++) {
+        bins[i] = 0;
+    }
+    for (i=0; i<RAND_SAMPLES; i++) {
+        ot_u8 nibble = platform_rng.sample[i] & 0x0F;
+        run     = (nibble == last) ? (run + 1) : 1;
+        last    = nibble;
+        if (run >= RAND_RCT_CUTOFF) {
+            return False;
+        }
+        bins[nibble]++;
+    }
+    for (i=0; i<16; i++) {
+        ot_int diff = (ot_int)bins[i] - (RAND_SAMPLES/16);
+        chisq      += (ot_u16)(diff * diff);
+    }
+    return (ot_bool)(chisq <= RAND_CHISQ_LIMIT);
 }
 
-ot_u8 platform_prand_u8() {
-    return (ot_u8)platform_prand_u16();
+
+void sub_rand_condition() {
+/// Pack four noise nibbles per CRC input word; read out the CRC after every
+/// four words.  The CRC HW is shared with the CRC routines, so its register
+/// is saved and restored.
+    ot_u16  scratch;
+    ot_u8*  s = platform_rng.sample;
+    ot_int  i;
+
+    scratch     = CRC->INIRES;
+    CRC->INIRES = platform_rng.crc;
+
+    for (i=1; i<=(RAND_SAMPLES/4); i++, s+=4) {
+        CRC->DIRB = ((ot_u16)(s[0] & 0x0F) << 12) | ((ot_u16)(s[1] & 0x0F) << 8) \
+                  | ((ot_u16)(s[2] & 0x0F) << 4)  |  (ot_u16)(s[3] & 0x0F);
+
+        if ((i & 3) == 0) {
+            ot_u16 word     = CRC->INIRES;
+            ot_u8  put      = platform_rng.put;
+            platform_rng.pool[put & (RAND_POOL_SIZE-1)]     = (ot_u8)(word >> 8);
+            platform_rng.pool[(put+1) & (RAND_POOL_SIZE-1)] = (ot_u8)word;
+            platform_rng.put = put + 2;
+        }
+    }
+
+    platform_rng.crc    = CRC->INIRES;
+    CRC->INIRES         = scratch;
 }
 
-ot_u16 platform_prand_u16() {
-/// Run the HW CRC on the prand register stored value.  Always save the value in
-/// the CRC HW and return it when the process is done.  prand_reg should be
-/// initialized at startup with the device ID or serial number (or something)
-    ot_u16 scratch  = CRC->INIRES;
-    CRC->INIRES     = prand_reg;
-    CRCb->DIRB_L    = 0;
-    prand_reg       = CRC->INIRES;
-    CRC->INIRES     = scratch;
 
-    return prand_reg;
+void sub_rand_service() {
+/// Collect a finished batch, then start another one if the pool has room.
+/// The DMA clears its enable bit when the last sample of the batch is moved.
+    if (platform_rng.active) {
+#       if (MCU_FEATURE(RANDDMA) == ENABLED)
+        if (RAND_DMA->CTL & 0x10) {
+            return;
+        }
+#       endif
+        sub_rand_stop();
+        if (sub_rand_health()) {
+            platform_rng.fails = 0;
+            sub_rand_condition();
+        }
+        else if (platform_rng.fails < RAND_FAIL_LIMIT) {
+            platform_rng.fails++;
+        }
+    }
+
+    if ((ot_u8)(platform_rng.put - platform_rng.get) <= (RAND_POOL_SIZE-RAND_BATCH_BYTES)) {
+#       if (OT_FEATURE(SENSORS) == ENABLED)
+        if (platform_adc_busy()) {
+            return;
+        }
+#       endif
+        sub_rand_start();
+    }
+}
+
+
+void platform_rand_init() {
+/// Start filling the pool.  With the DMA this runs in the background; without
+/// it, the first batch is taken here at startup.
+    platform_rng.crc = 0xFFFF;
+    sub_rand_service();
 }
 
 
+#if (MCU_FEATURE(RANDDMA) == ENABLED)
+void platform_rand_harvest() {
+/// Called by platform_ot_run() after each kernel run.  Skipped if the kernel
+/// ran on top of platform_rand(), which is servicing the pool itself.
+    if (platform_rng.busy == 0) {
+        sub_rand_service();
+    }
+}
+#endif
 
 
+void platform_rand(ot_u8* rand_out, ot_int bytes_out) {
+    platform_rng.busy = 1;
+
+    while (bytes_out > 0) {
+        if (platform_rng.get == platform_rng.put) {
+            sub_rand_service();
+            if ((platform_rng.get == platform_rng.put) && \
+                (platform_rng.fails >= RAND_FAIL_LIMIT)) {
+                *rand_out++ = platform_prand_u8();
+                bytes_out--;
+            }
+            continue;
+        }
+        *rand_out++ = platform_rng.pool[platform_rng.get & (RAND_POOL_SIZE-1)];
+        platform_rng.get++;
+        bytes_out--;
+    }
 
-/** Platform memcpy Routine <BR>
+    // Top up the pool in the background for next time
+    if (platform_rng.active == False) {
+        sub_rand_service();
+    }
+    platform_rng.busy = 0;
+}
+
+
+
+
+
+
+/** Platform Sensor ADC Routines <BR>
   * ========================================================================<BR>
-  * Similar to standard implementation of "memcpy"
+  * A burst is one pass of the ADC12 sequence-of-channels mode: the MCTL
+  * registers list the channels (OT_SENSOR_CHANS), round after round, up to
+  * the 16 MEM registers, and the last one has EOS.  The ADC12 runs through
+  * the sequence on its own (MSC).  At the end of the sequence, the DMA moves
+  * all of the MEM registers to the buffer in one block transfer.  No ISR is
+  * used: platform_adc_busy() checks the DMA enable bit, which the DMA clears
+  * when the block is moved, and then turns off the ADC12.
+  *
+  * The ADC12 is shared with platform_rand(): a burst is refused while a rand
+  * batch runs, and a rand batch waits for a burst to finish.
   */
+#if (OT_FEATURE(SENSORS) == ENABLED)
+#ifndef OT_SENSOR_CHANS
+#   define OT_SENSOR_CHANS      { 10, 11 }          // temperature, AVcc/2
+#endif
+#ifndef OT_SENSOR_SREF
+#   define OT_SENSOR_SREF       ADC12SREF_0         // AVcc and AVss
+#endif
+#ifndef ADC_DMANUM
+#   define ADC_DMANUM           0
+#endif
+#if (ADC_DMANUM == 0)
+#   define ADC_DMA              DMA0
+#elif (ADC_DMANUM == 1)
+#   define ADC_DMA              DMA1
+#elif (ADC_DMANUM == 2)
+#   define ADC_DMA              DMA2
+#else
+#   error "ADC_DMANUM is not defined to an available index (0-2)"
+#endif
+#if ((MCU_FEATURE(MEMCPYDMA) == ENABLED) && (ADC_DMANUM == MEMCPY_DMANUM)) || \
+    ((MCU_FEATURE(MPIPEDMA) == ENABLED) && (ADC_DMANUM == MPIPE_DMANUM))
+#   error "ADC_DMANUM must not use the MEMCPY or MPIPE DMA channel"
+#endif
 
-void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
-/// Behavior is always blocking.
+static const ot_u8 adc_chans[] = OT_SENSOR_CHANS;
+static ot_bool adc_active = False;
 
-#if (OS_FEATURE(MEMCPY) == ENABLED)
-    memcpy(dest, src, length);
 
-#elif (MCU_FEATURE(MEMCPYDMA) == ENABLED)
-/// DMA driven method: CC430 DMA Block Transfer is blocking, and the CPU is
-/// stopped during the data movement.  Thus the while loop is not needed.
-/// DMA memcpy cannot be used reliably if OpenTag makes use of the DMA for some
-/// other non-blocking process (e.g. MPipe).
+ot_bool platform_adc_start(ot_u16* buffer, ot_u8 channels, ot_u8 rounds) {
+    ot_u8 i;
+    ot_u8 n = channels * rounds;
+
+    if (adc_active || platform_rng.active || (n > 16) || (n == 0) || \
+        (channels > sizeof(adc_chans))) {
+        return False;
+    }
+
+    ADC12CTL0   = ADC12ON + ADC12MSC + ADC12SHT0_2;
+    ADC12CTL1   = ADC12SHP + ADC12CONSEQ_1;
+    ADC12CTL2   = ADC12RES_2;
+    for (i=0; i<n; i++) {
+        (&ADC12MCTL0)[i] = OT_SENSOR_SREF | adc_chans[i % channels];
+    }
+    (&ADC12MCTL0)[n-1] |= ADC12EOS;
+
+#   if (ADC_DMANUM == 0)
+        DMA->CTL0       = (DMA->CTL0 & 0xFF00) | DMA_Trigger_ADC12IFGx;
+#   elif (ADC_DMANUM == 1)
+        DMA->CTL0       = (DMA->CTL0 & 0x00FF) | (DMA_Trigger_ADC12IFGx << 8);
+#   else
+        DMA->CTL1       = DMA_Trigger_ADC12IFGx;
+#   endif
+    ADC_DMA->SA_L   = (ot_u16)&ADC12MEM0;
+    ADC_DMA->DA_L   = (ot_u16)buffer;
+    ADC_DMA->SZ     = n;
+    ADC_DMA->CTL    = ( DMA_Mode_Block | \
+                        DMA_DestinationInc_Enable | \
+                        DMA_SourceInc_Enable | \
+                        DMA_DestinationDataSize_Word | \
+                        DMA_SourceDataSize_Word | \
+                        DMA_TriggerLevel_RisingEdge | \
+                        0x10 );
+    adc_active      = True;
+    ADC12CTL0      |= ADC12ENC + ADC12SC;
+    return True;
+}
+
+
+ot_bool platform_adc_busy() {
+    if (adc_active) {
+        if (ADC_DMA->CTL & 0x10) {
+            return True;
+        }
+        ADC12CTL0  &= ~ADC12ENC;
+        ADC12CTL0   = 0;
+        adc_active  = False;
+    }
+    return False;
+}
+#endif
+
+
+
+
+
+/** Platform memcpy Routines <BR>
+  * ========================================================================<BR>
+  * Similar to standard implementation of "memcpy".  Copies shorter than
+  * MEMCPY_DMA_THRESHOLD bytes always go through the CPU, because setting up
+  * the DMA costs more than it saves on a short run.  The CPU copies a word at 
+  * a time when both addresses are even.
+  *
+  * The DMA methods cannot be used reliably if OpenTag makes use of the DMA for
+  * some other non-blocking process (e.g. MPipe).
+  */
+#ifndef MEMCPY_DMA_THRESHOLD
+#   define MEMCPY_DMA_THRESHOLD     16
+#endif
+
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+void sub_memcpy_dma(ot_u8* dest, ot_u8* src, ot_int length, ot_u16 ctl) {
+/// CC430 DMA Block Transfer is blocking, and the CPU is stopped during the
+/// data movement.  Thus no while loop is needed.
     MEMCPY_DMA->SA_L    = (ot_u16)src;
     MEMCPY_DMA->DA_L    = (ot_u16)dest;
     MEMCPY_DMA->SZ      = length;
-    //DMA->CTL4           = ( DMA_Options_RMWDisable | \
-                            DMA_Options_RoundRobinDisable | \
-                            DMA_Options_ENMIDisable      );
     MEMCPY_DMA->CTL     = ( DMA_Mode_Block | \
                             DMA_DestinationInc_Enable | \
-                            DMA_SourceInc_Enable | \
-                            DMA_DestinationDataSize_Byte | \
-                            DMA_SourceDataSize_Byte | \
                             DMA_TriggerLevel_RisingEdge | \
+                            ctl | \
                             0x11);
-    //MEMCPY_DMA->CTL    |= 0x0001;
+}
+#endif
 
-    //while ((MEMCPY_DMA->CTL & DMAIFG) == 0);
 
-#else
-/// Uses the "Duff's Device" for loop unrolling.  If this is incredibly
-/// confusing to you, check the internet for "Duff's Device."
-    if (length > 0) {
+void sub_memcpy_cpu(ot_u8* dest, ot_u8* src, ot_int length) {
+    if (length <= 0) {
+        return;
+    }
+    if ((((ot_uint)dest | (ot_uint)src) & 1) == 0) {
+        platform_memcpy_2((ot_u16*)dest, (ot_u16*)src, length >> 1);
+        if (length & 1) {
+            dest[length-1] = src[length-1];
+        }
+    }
+    
+    /// Uses the "Duff's Device" for loop unrolling.  If this is incredibly
+    /// confusing to you, check the internet for "Duff's Device."
+    else {
         ot_int loops = (length + 7) >> 3;
 
         switch (length & 0x7) {
@@ -1069,60 +1984,191 @@ void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
                         while (--loops > 0);
         }
     }
+}
 
+
+void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
+/// Behavior is always blocking.
+
+#if (OS_FEATURE(MEMCPY) == ENABLED)
+    memcpy(dest, src, length);
+
+#elif (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length < MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_cpu(dest, src, length);
+    }
+    else if ((((ot_uint)dest | (ot_uint)src) & 1) == 0) {
+        sub_memcpy_dma(dest, src, (length >> 1), DMA_SourceInc_Enable | \
+                                                 DMA_DestinationDataSize_Word | \
+                                                 DMA_SourceDataSize_Word);
+        if (length & 1) {
+            dest[length-1] = src[length-1];
+        }
+    }
+    else {
+        sub_memcpy_dma(dest, src, length, DMA_SourceInc_Enable | \
+                                          DMA_DestinationDataSize_Byte | \
+                                          DMA_SourceDataSize_Byte);
+    }
+
+#else
+    sub_memcpy_cpu(dest, src, length);
 #endif
 }
 
 
+void platform_memcpy_2(ot_u16* dest, ot_u16* src, ot_int length) {
+/// Same as platform_memcpy(), but length is in 16 bit words, and both 
+/// addresses must be word-aligned.
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= (MEMCPY_DMA_THRESHOLD/2)) {
+        sub_memcpy_dma((ot_u8*)dest, (ot_u8*)src, length, DMA_SourceInc_Enable | \
+                                                          DMA_DestinationDataSize_Word | \
+                                                          DMA_SourceDataSize_Word);
+        return;
+    }
+#endif
+    if (length > 0) {
+        ot_int loops = (length + 3) >> 2;
 
+        switch (length & 0x3) {
+            case 0: do {    *dest++ = *src++;
+            case 3:         *dest++ = *src++;
+            case 2:         *dest++ = *src++;
+            case 1:         *dest++ = *src++;
+                        }
+                        while (--loops > 0);
+        }
+    }
+}
 
 
+void platform_memcpy_async(ot_u8* dest, ot_u8* src, ot_int length) {
+/// The MSP430 DMA stops the CPU during a block transfer, so there is no CPU 
+/// work to overlap with it.  The copy is done when this returns.
+    platform_memcpy(dest, src, length);
+}
 
 
+ot_bool platform_memcpy_busy() {
+    return False;
+}
 
-/** Platform Utility Functions <BR>
-  * ========================================================================<BR>
-  * Random crap
-  */
 
-void platform_delay(ot_u16 n) {
-    ot_u16 reg;
+void platform_memcpy_wait() {
+}
 
-    reg         = 0x007F & WDTA->CTL;              // clear hold bit and passkey
-    WDTA->CTL   = (WDTPW | WDTCNTCL | reg);     // reset with passkey and clear timer
 
-    for (; n > 0; n--) {          // run nCount iterations
-        PMM_EnterLPM3();                        // sleep until interrupt (change LPM if needed)
+void platform_memset(ot_u8* dest, ot_u8 value, ot_int length) {
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_dma(dest, &value, length, DMA_SourceInc_Disable | \
+                                             DMA_DestinationDataSize_Byte | \
+                                             DMA_SourceDataSize_Byte);
+        return;
+    }
+#endif
+    if (length <= 0) {
+        return;
+    }
+    if (((ot_uint)dest & 1) == 0) {
+        ot_u16* dest2   = (ot_u16*)dest;
+        ot_u16  value2  = ((ot_u16)value << 8) | value;
+        ot_int  i;
+        
+        for (i=(length>>1); i>0; i--) {
+            *dest2++ = value2;
+        }
+        if (length & 1) {
+            dest[length-1] = value;
+        }
+    }
+    else {
+        while (--length >= 0) {
+            *dest++ = value;
+        }
     }
-
-    WDTA->CTL   = (WDTPW | WDTHOLD | reg);      // hold WDT after completion
 }
 
 
 
 
-/** @note
-  * The multiplier values used in Proc_SwDelay...() are hard-coded into the
-  * constants below.  At the moment, it is hardcoded to work with a roughly
-  * 20 MHz (± 1%) instruction clock.
-  *
-  * @todo
-  * Test constants with logic probe to verify accuracy
-  * Might need to code in assembly due to 16 bit integer limit of CC430
+
+
+
+
+/** Platform Utility Functions <BR>
+  * ========================================================================<BR>
+  * Random crap
   */
-#define CNT1us_20MHz    (20/2)
-#define CNT1ms_20MHz    (CNT1us_20MHz*1000)
+
+/** Platform Delays
+  * A wait of PLATFORM_DELAY_SLEEP_US or more sleeps until GPTIM CCR2, which
+  * the kernel timer does not use.  CCR2 matches once per 16 bit period of 
+  * GPTIM, so a longer wait wakes up once per period and goes back to sleep.
+  * The wait is rounded up to whole sub-ticks, plus the sub-tick underway.  
+  * A shorter wait counts PLATFORM_HSCLOCK_HZ cycles, and so does any wait 
+  * made with interrupts off (i.e. in an ISR) or before GPTIM is started.
+  */
+#define DELAY_SUBTICK_HZ    ((ot_u32)1024 << PLATFORM_KTIM_SUBBITS)
+#define DELAY_CAN_SLEEP()   ((__get_SR_register() & GIE) && \
+                            (OT_GPTIM->CTL & TIMA_Ctl_Mode_Continuous))
+
+void sub_delay_sleep(ot_u32 subticks, ot_u16 lpm_bits) {
+/// The deadline is checked with interrupts off, and the sleep turns them back
+/// on in the same instruction, so a CCR2 match is never lost in between.
+    ot_u32 until;
+
+    until = sub_ktim_count() + subticks + 1;
+    while (1) {
+        __disable_interrupt();
+        if ((ot_long)(until - sub_ktim_count()) <= 0) {
+            break;
+        }
+        OT_GPTIM->CCR2  = (ot_u16)until;
+        OT_GPTIM->CCTL2 = TIMA_IT_CC;
+        if ((ot_long)(until - sub_ktim_count()) <= 0) {
+            OT_GPTIM->CCTL2 = TIMA_IT_CC | TIMA_FLG_CC_CCIFG;
+        }
+        __bis_SR_register(lpm_bits + GIE);
+        __no_operation();
+    }
+    OT_GPTIM->CCTL2 = 0;
+    platform_enable_interrupts();
+}
+
+
+void platform_delay(ot_u16 n) {
+/// n ticks in LPM3, which keeps ACLK (and GPTIM) running
+    if (DELAY_CAN_SLEEP()) {
+        sub_delay_sleep(((ot_u32)n << PLATFORM_KTIM_SUBBITS), LPM3_bits);
+    }
+    else {
+        for (; n>0; n--) {
+            __delay_cycles( (PLATFORM_HSCLOCK_HZ/1024) );
+        }
+    }
+}
+
 
 void platform_swdelay_ms(ot_u16 n) {
+    if ((((ot_u32)n * 1000) >= PLATFORM_DELAY_SLEEP_US) && DELAY_CAN_SLEEP()) {
+        sub_delay_sleep((((ot_u32)n * DELAY_SUBTICK_HZ) + 999) / 1000, LPM0_bits);
+        return;
+    }
 	for (; n>0; n--) {
-	    __delay_cycles(20000);
+	    __delay_cycles( (PLATFORM_HSCLOCK_HZ/1000) );
 	}
 }
 
 
 void platform_swdelay_us(ot_u16 n) {
+    if ((n >= PLATFORM_DELAY_SLEEP_US) && DELAY_CAN_SLEEP()) {
+        sub_delay_sleep((((ot_u32)n * DELAY_SUBTICK_HZ) + 999999) / 1000000, LPM0_bits);
+        return;
+    }
 	for (; n>0; n--) {
-        __delay_cycles(20);
+        __delay_cycles( (PLATFORM_HSCLOCK_HZ/1000000) );
 	}
 }
 
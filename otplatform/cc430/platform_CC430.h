@@ -47,6 +47,12 @@
 // How many bytes is a pointer?
 #define PLATFORM_POINTER_SIZE   2
 
+// Stack bytes that sys_stack_paint() may fill.  The CCS projects reserve 80
+// bytes of stack (--stack_size): raise both together.
+#ifndef PLATFORM_STACK_SIZE
+#   define PLATFORM_STACK_SIZE  64
+#endif
+
 // Big-endian to Platform-endian
 #define PLATFORM_ENDIAN16(VAR16)    __swap_bytes(VAR16)
 #define PLATFORM_ENDIAN32(VAR32)    __swap_long_bytes(VAR32)
@@ -86,6 +92,27 @@
 #elif (CC_SUPPORT == IAR_V5)
 #endif
 
+/// OT_RAMCODE(FN) marks a function that is copied to SRAM at startup, when
+/// PLATFORM_RAMCODE is enabled.  The linker file must have a .ramcode section
+/// that loads in flash and runs in RAM: for CL430 with a copy table named
+/// ramcode_copy, and for GCC with the symbols __ramcode_load, __ramcode_start
+/// and __ramcode_end.  platform_poweron() does the copy.
+#if (defined(PLATFORM_RAMCODE) && (PLATFORM_RAMCODE == ENABLED))
+#   if (CC_SUPPORT == GCC)
+#       define OT_RAMCODE(FN)           __attribute__((section(".ramcode")))
+#   elif (CC_SUPPORT == CL430)
+#       define OT_PRAGMA_STR(...)       #__VA_ARGS__
+#       define OT_RAMCODE(FN)           _Pragma(OT_PRAGMA_STR(CODE_SECTION(FN, ".ramcode")))
+#   endif
+#endif
+
+/// Interrupt nesting, with PLATFORM_ISR_NESTING (see OT_platform.h)
+#if (defined(PLATFORM_ISR_NESTING) && (PLATFORM_ISR_NESTING == ENABLED))
+#   define PLATFORM_ISR_NEST()          platform_isr_nest()
+#   define PLATFORM_ISR_UNNEST()        platform_isr_unnest()
+#   define PLATFORM_ISR_DEFER_DMA()     platform_isr_defer_dma()
+#endif
+
 
 
 
@@ -109,6 +136,42 @@
 #define MCU_SLEEP_WHILE_RF() SLEEP_WHILE_UHF()
 
 
+/** Low Power Mode Table, for the kernel Power Manager (OT_FEATURE(POWERMGR))
+  * Mode 0 is LPM0, mode 1 is LPM3 (STOP_MCU), and mode 2 is LPM4, which also
+  * stops ACLK and therefore GPTIM.  With the SVS in normal mode, the wakeup
+  * from LPM3/4 takes up to 150 us.  The DCO then needs the UCS7 erratum delay
+  * and PMM_EnterLPM3() restores the GPIO, which is the clock restart cost.
+  * Times are in STI (1/32768 sec).
+  */
+#define PLATFORM_LPM_MODES          3
+#define PLATFORM_LPM_UNTIMED        2
+#define PLATFORM_LPM_WAKE_STI       { 0, 5, 5 }
+#define PLATFORM_LPM_CLKSTART_STI   1
+
+
+/** CPU Performance Levels, for kernel clock scaling (OT_FEATURE(CLKSCALE))
+  * SYS_PERF_LOW, MID and HIGH run MCLK at the DCO divided by 4, 2 and 1.  The
+  * DCO itself stays locked by the FLL, because moving it means a new FLL lock
+  * that can take longer than the packet.  SMCLK has its own divider from the
+  * DCO, and ACLK (GPTIM, RTC) is the 32768 Hz clock, so no timer or MPipe
+  * baud rate changes.  Software delays (platform_swdelay_us/ms) shorter than
+  * PLATFORM_DELAY_SLEEP_US count MCLK cycles, so they are longer than asked 
+  * below SYS_PERF_HIGH.  Longer ones sleep on GPTIM, which is not scaled.
+  */
+#define PLATFORM_PERF_LEVELS        3
+
+
+/** Delay threshold
+  * platform_swdelay_us/ms() of this many microseconds or more sleep in LPM0
+  * until a GPTIM compare, instead of counting cycles.  GPTIM counts sub-ticks
+  * of 1/(1024 * 2^PLATFORM_KTIM_SUBBITS) sec, so a sleep can be up to one 
+  * sub-tick longer than asked.
+  */
+#ifndef PLATFORM_DELAY_SLEEP_US
+#   define PLATFORM_DELAY_SLEEP_US  1000
+#endif
+
+
 
 /** #### DMA Macros
   * - How many bytes/transfers are left for the DMA
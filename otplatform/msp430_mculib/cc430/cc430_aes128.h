@@ -0,0 +1,53 @@
+/* Copyright 2009 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/** @file       /Platforms/CC430/cc430_lib/cc430_aes128.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       1 Dec 2009
+  * @brief      Library resources for AES128 peripheral
+  * @ingroup    CC430 Library
+  *
+  ******************************************************************************
+  */
+
+
+#ifndef __CC430_LIB_AES128_H
+#define __CC430_LIB_AES128_H
+
+#include "cc430_map.h"
+
+
+
+// AES->CTL0 bits
+#define AES_OP_ENCRYPT          ((u16)0x0000)
+#define AES_OP_DECRYPT          ((u16)0x0001)       // with decryption key
+#define AES_OP_GENKEY           ((u16)0x0002)       // derive decryption key
+#define AES_OP_DECRYPT_SLOW     ((u16)0x0003)       // with encryption key
+#define AES_OP_MASK             ((u16)0x0003)
+#define AES_SWRST               ((u16)0x0080)
+#define AES_RDYIFG              ((u16)0x0100)
+#define AES_ERRFG               ((u16)0x0800)
+#define AES_RDYIE               ((u16)0x1000)
+
+// AES->STAT bits
+#define AES_BUSY                ((u16)0x0001)
+#define AES_KEYWR               ((u16)0x0002)
+#define AES_DINWR               ((u16)0x0004)
+#define AES_DOUTRD              ((u16)0x0008)
+
+
+#endif
+
@@ -121,8 +121,7 @@
 
 // AES128 Calculation Peripheral (AES)
 #ifdef _AES
-// module not available yet
-//#   include "cc430_aes128.h"
+#   include "cc430_aes128.h"
 #endif
 
 
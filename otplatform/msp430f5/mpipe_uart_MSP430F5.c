@@ -25,23 +25,21 @@
   * As far as I know, the MSP430F5 has the ability to use the following periphs
   * for the MPIPE.  This list may change over time as new models are released:
   *     I/F     HW      Impl.   Baudrate Notes
-  * 1.  UART    USCI    yes     Keep baudrate <= 115.2 kbps
+  * 1.  UART    USCI    yes     Up to SMCLK/3 (3 Mbps at most)
   * 2.  SPI     USCI    no      Potentially up to 5 Mbps, using SMCLK
   * 3.  I2C     USCI    no      100 or 400 kbps
   * 4.  IrDA    USCI    no      Need more information
   *
   * The UART implementation is the only one presently implemented.
-  * Baudrates supported:    9600, 115200
+  * Baudrates supported:    9600 to 3 Mbps (all of mpipe_speed, to SMCLK/3)
   * Byte structure:         8N1
   * Duplex:                 Half
   * Flow control:           HW (CTS/RTS for Null modem)
   * Connection:             RS-232, DTE-DTE (use a null-modem connector)
   *
   * Design Assumptions:
-  * - Using SMCLK at 2.49625 MHz Clock (19.97 MHz / 8)
+  * - Using SMCLK (MPIPE_UART_CLKHZ), the dividers are computed from it
   * - Using UART0
-  * - If changing the input frequency, changes need to be made to implementation
-  *   of setspeed function.
   * - If changing to another UART, changes to platform_config_CC430.h and to
   *   some macros in this file will be needed
   *
@@ -54,6 +52,10 @@
   * Mpipe send an ACK/NACK.  The "YY" byte is 0 for ACK and non-zero for ACK.
   * Presently, 0x7F is used as the YY NACK value.
   * [ Seq ID ] 0xDD 0x00 0x00 0x02 0x00 0xYY  [ CRC16 ]
+  *
+  * Gather TX (OT_FEATURE(MPIPE_GATHER)): each segment is a DMA block, and the
+  * DMA ISR loads the next one, so the frame is sent back to back without
+  * copying the payload.  The footer is the last block, from mpipe.footer.
   ******************************************************************************
   */
 
@@ -61,11 +63,22 @@
 #include "OT_config.h"
 #include "OT_platform.h"
 
-#if ((OT_FEATURE(MPIPE) == ENABLED) && (MCU_FEATURE(MPIPEVCOM) != ENABLED))
+/// Compile when MPipe does not use USB, or when the UART is a port next to USB
+#if ((OT_FEATURE(MPIPE) == ENABLED) && \
+    ((MCU_FEATURE(MPIPEVCOM) != ENABLED) || (OT_FEATURE(MPIPE_PORTS) == ENABLED)))
 
+#define MPIPE_DRIVER    uart    // port name, for OT_FEATURE(MPIPE_PORTS)
 #include "mpipe.h"
+#include "system.h"
+
 
 
+/// UART clock, SMCLK.  The USCI needs at least 3 clocks per bit, which sets
+/// the fastest speed of mpipe_setspeed().
+#ifndef MPIPE_UART_CLKHZ
+#   define MPIPE_UART_CLKHZ     (PLATFORM_HSCLOCK_HZ / PLATFORM_SMCLK_DIV)
+#endif
+#define MPIPE_BAUDMAX           (MPIPE_UART_CLKHZ / 3)
 
 #define UART_CLOSE()        (MPIPE_UART->CTL1   |= UCSWRST)
 #define UART_OPEN()         (MPIPE_UART->CTL1   &= ~UCSWRST)
@@ -129,6 +142,14 @@
         MPIPE_DMA->CTL  = MPIPE_DMA_TXCTL_##ONOFF; \
     } while(0)
 
+// Gather TX segment: exact size, because more data follows in the frame
+#define MPIPE_DMA_TXSEG(SOURCE, SIZE) \
+    do { \
+        MPIPE_DMA->SA_L = (ot_u16)SOURCE; \
+        MPIPE_DMA->SZ   = SIZE; \
+        MPIPE_DMA->CTL  = MPIPE_DMA_TXCTL_ON; \
+    } while(0)
+
 #define MPIPE_DMAEN(ONOFF)  MPIPE_DMA_##ONOFF
 #define MPIPE_DMAIE(ONOFF)  MPIPE_DMAIE_##ONOFF
 #define MPIPE_DMA_ON        (MPIPE_DMA->CTL |= 0x0010)
@@ -163,6 +184,13 @@ typedef struct {
     Twobytes        sequence;
     ot_u8*          pktbuf;
     ot_int          pktlen;
+#   if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+        mpipe_seg*  seg;            // segment list of the gather TX
+        mpipe_seg*  segcursor;      // segment in the DMA
+        ot_int      segs;           // segments in the list, 0 if not gather
+        ot_int      segsleft;       // DMA blocks after the current one
+        ot_u8       footer[MPIPE_FOOTERBYTES+2];    // +2: see MPIPE_DMA_TXCONFIG
+#   endif
 
 #   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
         void (*sig_rxdone)(ot_int);
@@ -197,7 +225,10 @@ void sub_uart_setup();
 #endif
 OT_INTERRUPT void mpipe_dma_isr(void) {
     //MPIPE_DMAEN(OFF); //unnecessary on single transfer mode
-
+    if (PLATFORM_ISR_DEFER_DMA()) {
+        return;
+    }
+    SYS_PROFILE_WAIT_START();
 #   if (MPIPE_DMANUM == 0)
 		if (DMA->IV == 2) mpipe_isr();
 #   elif (MPIPE_DMANUM == 1)
@@ -207,6 +238,7 @@ OT_INTERRUPT void mpipe_dma_isr(void) {
 #   else
 #       error "This version of MPIPE requires DMA."
 #   endif
+    SYS_PROFILE_WAIT_STOP();
 	LPM4_EXIT;
 }
 
@@ -358,7 +390,8 @@ ot_int mpipe_init(void* port_id) {
 /// 0. "port_id" is unused in this impl, and it may be NULL
 /// 1. Set all signal callbacks to NULL, and initialize other variables.
 /// 2. Prepare the HW, which in this case is a UART
-/// 3. Set default speed, which in this case is 115200 bps
+/// 3. Set default speed, MPIPE_SPEED_DEFAULT (115200 bps unless the board
+///    changes it)
 
 #   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
         mpipe.sig_rxdone    = &sub_signull;
@@ -373,7 +406,7 @@ ot_int mpipe_init(void* port_id) {
     mpipe.state             = MPIPE_Idle;
 
     sub_uart_portsetup();
-    mpipe_setspeed(MPIPE_115200bps);     //default baud rate
+    mpipe_setspeed(MPIPE_SPEED_DEFAULT);
 
     return 0;
 }
@@ -390,17 +423,38 @@ void mpipe_wait() {
 
 
 void mpipe_setspeed(mpipe_speed speed) {
-    ot_u8* baud_data;
-
-    /// You will need to change this baud rate matrix if
-    /// you change the bit clock from SMCLK @ 6 MHz
-    /// Order is [ BR0, BR1, MCTL, ... ]
-    /// BR1:0 = Floor(BitCLK/BaudRate)
-    /// MCTL  = Round(((BitCLK/BaudRate) - Floor(BitCLK/BaudRate)) * 8) << 1
-    static const ot_u8 baud_matrix[] = { 0x71, 0x02, 0x00, 0, \
-                                         0xD0, 0x00, 0x92, 0, \
-                                         0x68, 0x00, 0x08, 0, \
-                                         0x34, 0x00, 0x40, 0  };
+/// The dividers are computed from the UART clock (SMCLK), as in the USCI
+/// chapter of the user's guide.  "n16" is UART clocks per bit, x16.  With 16
+/// or more clocks per bit, 16x oversampling is used: BR = N/16 and UCBRFx is
+/// the fraction of N/16 (x16).  Else BR = N and UCBRSx is the fraction of N
+/// (x8).  The USCI needs at least 3 clocks per bit.
+    static const ot_u32 baudrate[] = { MPIPE_BAUDRATES };
+    ot_u32  n16;
+    ot_u16  br;
+    ot_u8   mctl;
+
+    while ((speed != MPIPE_9600bps) && (baudrate[speed] > MPIPE_BAUDMAX)) {
+        speed--;
+    }
+    n16 = ((ot_u32)MPIPE_UART_CLKHZ << 4) / baudrate[speed];
+    if (n16 >= (16 << 4)) {
+        br      = (ot_u16)(n16 >> 8);
+        mctl    = (ot_u8)(((n16 & 0xFF) + 8) >> 4);
+        if (mctl == 16) {
+            br++;
+            mctl = 0;
+        }
+        mctl = (mctl << 4) | 0x01;      // UCBRFx, UCOS16
+    }
+    else {
+        br      = (ot_u16)(n16 >> 4);
+        mctl    = (ot_u8)(((n16 & 0x0F) + 1) >> 1);
+        if (mctl == 8) {
+            br++;
+            mctl = 0;
+        }
+        mctl <<= 1;                     // UCBRSx
+    }
 
 #   if (MCU_FEATURE(MPIPEDMA) == ENABLED)
         MPIPE_DMAEN(OFF);
@@ -416,10 +470,9 @@ void mpipe_setspeed(mpipe_speed speed) {
     MPIPE_UART->CTL1 = 0x81;
     MPIPE_UART->IE   = 0;
     MPIPE_UART->IFG  = 0;
-    baud_data        = (ot_u8*)&baud_matrix[speed << 2];
-    MPIPE_UART->BR0  = *baud_data++;
-    MPIPE_UART->BR1  = *baud_data++;
-    MPIPE_UART->MCTL = *baud_data;
+    MPIPE_UART->BR0  = (ot_u8)br;
+    MPIPE_UART->BR1  = (ot_u8)(br >> 8);
+    MPIPE_UART->MCTL = mctl;
 }
 
 
@@ -430,6 +483,102 @@ mpipe_state mpipe_status() {
 
 
 
+void sub_txopen() {
+#   if (MPIPE_DMANUM == 0)
+        DMA->CTL0  |= MPIPE_UART_TXTRIG;
+#   elif (MPIPE_DMANUM == 1)
+        DMA->CTL0  |= (MPIPE_UART_TXTRIG << 8);
+#   elif (MPIPE_DMANUM == 2)
+        DMA->CTL1   = MPIPE_UART_TXTRIG;
+#   else
+#       error MPIPE_DMANUM is set to a DMA that does not exist on this device
+#   endif
+
+    DMA->CTL4 = (DMA_Options_RMWDisable | DMA_Options_RoundRobinDisable | DMA_Options_ENMIEnable);
+}
+
+
+#if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+ot_int mpipe_txsegs(mpipe_seg* seg, ot_int segs, ot_bool blocking, mpipe_priority data_priority) {
+    Twobytes    crcval;
+    ot_int      data_length;
+    ot_int      i;
+
+#   if (BOARD_FEATURE(USBCONVERTER) != ENABLED)
+        if (data_priority != MPIPE_Ack) {
+            if (mpipe.state != MPIPE_Idle) {
+                return -1;
+            }
+            mpipe.priority  = data_priority;
+            mpipe.pktbuf    = seg[0].data;
+        }
+#   else
+        if (mpipe.state != MPIPE_Idle) {
+            return -1;
+        }
+        mpipe.pktbuf    = seg[0].data;
+#   endif
+
+    mpipe.state     = MPIPE_Tx_Wait;
+    mpipe.seg       = seg;
+    mpipe.segcursor = seg;
+    mpipe.segs      = segs;
+    mpipe.segsleft  = segs;
+
+    MPIPE_DMAEN(OFF);
+    sub_txopen();
+
+    // The CRC engine runs over the segments in place, then over the sequence
+    mpipe.footer[0] = mpipe.sequence.ubyte[UPPER];
+    mpipe.footer[1] = mpipe.sequence.ubyte[LOWER];
+    CRC->INIRES     = 0xFFFF;
+    data_length     = 2;
+    for (i=0; i<segs; i++) {
+        ot_u8*  data    = seg[i].data;
+        ot_int  j       = seg[i].length;
+        data_length    += j;
+        for (; j>0; j--) {
+            CRCb->DIRB_L = *data++;
+        }
+    }
+    CRCb->DIRB_L    = mpipe.footer[0];
+    CRCb->DIRB_L    = mpipe.footer[1];
+    crcval.ushort   = CRC->INIRES;
+    mpipe.footer[2] = crcval.ubyte[UPPER];
+    mpipe.footer[3] = crcval.ubyte[LOWER];
+    mpipe.pktlen    = data_length;
+
+    MPIPE_DMA->DA_L = (ot_u16)&(MPIPE_UART->TXBUF);
+    MPIPE_DMA_TXSEG(seg[0].data, seg[0].length);
+    UART_OPEN();
+    MPIPE_DMA_TXTRIGGER();
+
+    if (blocking == True) {
+    	mpipe_wait();
+    }
+
+    return data_length + 2;
+}
+
+
+void sub_txseg() {
+/// Load the next DMA block of a gather TX.  The DMA triggers on the edge of
+/// TXIFG, so wait for TXBUF to be empty (less than one byte time) and then 
+/// make the edge in SW.
+    while ((MPIPE_UART->IFG & UCTXIFG) == 0);
+    
+    if (--mpipe.segsleft == 0) {
+        MPIPE_DMA_TXSEG(mpipe.footer, MPIPE_FOOTERBYTES+2);
+    }
+    else {
+        mpipe.segcursor++;
+        MPIPE_DMA_TXSEG(mpipe.segcursor->data, mpipe.segcursor->length);
+    }
+    MPIPE_DMA_TXTRIGGER();
+}
+#endif
+
+
 ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
 /// Data TX occurs after a CTS detect event.  The DMA is setup beforehand, and
 /// it is activated in the CTS ISR or manually (in this function) in the cases
@@ -455,21 +604,15 @@ ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority)
 #   endif
 
     mpipe.state = MPIPE_Tx_Wait;
+#   if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+    mpipe.segs      = 0;
+    mpipe.segsleft  = 0;
+#   endif
 
     MPIPE_DMAEN(OFF);
 
 #if (MCU_FEATURE(MPIPEDMA) == ENABLED)
-#   if (MPIPE_DMANUM == 0)
-        DMA->CTL0  |= MPIPE_UART_TXTRIG;
-#   elif (MPIPE_DMANUM == 1)
-        DMA->CTL0  |= (MPIPE_UART_TXTRIG << 8);
-#   elif (MPIPE_DMANUM == 2)
-        DMA->CTL1   = MPIPE_UART_TXTRIG;
-#   else
-#       error MPIPE_DMANUM is set to a DMA that does not exist on this device
-#   endif
-
-    DMA->CTL4 = (DMA_Options_RMWDisable | DMA_Options_RoundRobinDisable | DMA_Options_ENMIEnable);
+    sub_txopen();
 
     // add sequence id & crc to end of the datastream
     data[data_length++] = mpipe.sequence.ubyte[UPPER];
@@ -648,6 +791,12 @@ void mpipe_isr() {
         //mpipe_isr_Tx_Wait:
         	//MPIPE_UART->IE = UCTXIE;
             //break;
+#           if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+            if (mpipe.segsleft != 0) {
+                sub_txseg();
+                break;
+            }
+#           endif
 
         case MPIPE_Tx_Done:
         	//MPIPE_UART->IE = 0;
@@ -664,6 +813,12 @@ void mpipe_isr() {
         case MPIPE_RxAck:
 #           if (BOARD_FEATURE(USBCONVERTER) != ENABLED)
             if (platform_crc_block(mpipe.ackbuf, 10) != 0) { //RX'ed NACK
+#               if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+                if (mpipe.segs != 0) {
+                    mpipe_txsegs(mpipe.seg, mpipe.segs, False, mpipe.priority);
+                    break;
+                }
+#               endif
                 mpipe_txndef(mpipe.pktbuf, False, mpipe.priority);
                 break;
             }
@@ -675,5 +830,10 @@ void mpipe_isr() {
 }
 
 
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+MPIPE_PORT_DEFINE(NULL);
+#endif
+
+
 #endif
 
@@ -27,6 +27,17 @@
   * Legend: [ NDEF Header ] [ NDEF Payload ] [ Seq. Number ] [ CRC16 ]          <BR>
   * Bytes:        6             <= 255             2             2              <BR><BR>
   *
+  * Bulk mode (OT_FEATURE_MPIPE_USBBULK):                                      <BR>
+  * TX and RX run independently.  mpipe_txndef() copies the message into one of
+  * two batch buffers, computing the CRC during the copy.  While one batch is
+  * being sent, the other collects messages, and it goes out as one transfer
+  * (the CDC backend splits it into 64 byte packets).  On RX, each packet is
+  * copied from the endpoint X/Y buffers straight into its place in dir_in as
+  * soon as it arrives (the "data received" event), and the NDEF header is read
+  * as soon as its 6 bytes are in, so rxdetect runs on the first packet and the
+  * message is delivered in place on its last one.  Only the bytes the message
+  * needs are taken: the rest stays in the endpoint, which NAKs while both X
+  * and Y are full, until mpipe_rxndef() releases the message.
   ******************************************************************************
   */
 
@@ -37,6 +48,7 @@
 /// Do not compile if MPIPE is disabled, or MPIPE does not use USB VCOM
 #if ((OT_FEATURE(MPIPE) == ENABLED) && (MCU_FEATURE(MPIPEVCOM) == ENABLED))
 
+#define MPIPE_DRIVER    usb     // port name, for OT_FEATURE(MPIPE_PORTS)
 #include "mpipe.h"
 #include "OT_utils.h"
 
@@ -70,6 +82,15 @@
 // Footer is 2 byte sequence ID + CRC (usually 2 bytes, but could be more)
 #define MPIPE_FOOTERBYTES   4
 
+// Bulk mode TX batch buffers (there are two).  Each must hold the largest
+// message, which is 265 bytes with the footer.
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+#   ifndef MPIPE_USBBULK_TXBYTES
+#       define MPIPE_USBBULK_TXBYTES    320
+#   endif
+#   include "buffers.h"
+#endif
+
 
 typedef struct {
     mpipe_state     state;
@@ -89,6 +110,15 @@ typedef struct {
 
 typedef struct {
     ot_int i;
+
+#   if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+        ot_u16      rxlen;      // Bytes received at pktbuf
+        ot_u16      rxframe;    // Length of the delivered message (0 if none)
+        ot_u8       txfill;     // Batch being filled (the other is sending)
+        ot_u16      txlen[2];
+        ot_u8       txmsgs[2];
+        ot_u8       txbuf[2][MPIPE_USBBULK_TXBYTES];
+#   endif
 } mpipe_ext_struct;
 
 
@@ -105,6 +135,10 @@ mpipe_ext_struct mpipe_ext;
 void sub_usb_loadrx();
 ot_u8 sub_usb_loadtx();
 void sub_usb_portsetup();
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+void sub_usb_rxparse();
+void sub_usb_txdone();
+#endif
 
 
 
@@ -207,9 +241,9 @@ ot_u8 USB_handleEnumCompleteEvent () {
   * no data receive operation is underway.  returns True to keep CPU awake
   */
 ot_u8 USBCDC_handleDataReceived (ot_u8 intfNum) {
-    //TO DO: You can place your code here
-    //mpipe_isr();
-    //bCDCDataReceived_event = True;
+#   if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+    mpipe_isr();
+#   endif
     return True;
 }
 
@@ -219,7 +253,11 @@ ot_u8 USBCDC_handleDataReceived (ot_u8 intfNum) {
   */
 ot_u8 USBCDC_handleSendCompleted (ot_u8 intfNum) {
     //TO DO: You can place your code here
+#   if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+    sub_usb_txdone();
+#   else
     mpipe_isr();
+#   endif
     return False;
 }
 
@@ -229,9 +267,11 @@ ot_u8 USBCDC_handleSendCompleted (ot_u8 intfNum) {
   * CPU slept before interrupt)
   */
 ot_u8 USBCDC_handleReceiveCompleted (ot_u8 intfNum){
-    //TO DO: You can place your code here
-    //sub_usb_loadrx();
+/// In bulk mode, receives only ask for bytes that are already in, so they are
+/// done when USBCDC_receiveData() returns, and there is nothing to do here.
+#   if (OT_FEATURE(MPIPE_USBBULK) != ENABLED)
     mpipe_isr();
+#   endif
     return False;
 }
 
@@ -403,6 +443,88 @@ ot_u8 sub_usb_loadtx() {
 }
 
 
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+void sub_usb_rxparse() {
+/// Take what the message at pktbuf still needs from the endpoint buffers, and
+/// deliver it once all of it is in.  Nothing is taken while a delivered
+/// message is held, or before RX is started.  A message that would overflow
+/// dir_in is dropped, with what is in the endpoint buffers.
+    ot_u16  need;
+    ot_u8   avail;
+
+    while ((mpipe.pktbuf != NULL) && (mpipe_ext.rxframe == 0)) {
+        avail = USBCDC_bytesInUSBBuffer(CDC0_INTFNUM);
+        if (avail == 0) {
+            return;
+        }
+        if (mpipe_ext.rxlen == 0) {
+#           if ((OT_FEATURE(MPIPE_CALLBACKS) == ENABLED) && !defined(EXTF_mpipe_sig_rxdetect))
+                mpipe.sig_rxdetect(0);  
+#           elif defined(EXTF_mpipe_sig_rxdetect)
+                mpipe_sig_rxdetect(0);
+#			endif
+        }
+
+        need = (mpipe_ext.rxlen < 6) ? 6 : (mpipe.pktbuf[2] + 6 + MPIPE_FOOTERBYTES);
+        need = need - mpipe_ext.rxlen;
+        if (need > avail) {
+            need = avail;
+        }
+        if (USBCDC_receiveData(&mpipe.pktbuf[mpipe_ext.rxlen], need, CDC0_INTFNUM) \
+            != kUSBCDC_receiveCompleted) {
+            return;
+        }
+        mpipe_ext.rxlen += need;
+
+        if (mpipe_ext.rxlen >= 6) {
+            need = mpipe.pktbuf[2] + 6 + MPIPE_FOOTERBYTES;
+            if ((mpipe.pktbuf + need) > (dir_in.front + dir_in.alloc)) {
+                USBCDC_rejectData(CDC0_INTFNUM);
+                mpipe_ext.rxlen = 0;
+            }
+            else if (mpipe_ext.rxlen == need) {
+                mpipe_ext.rxframe = need;
+#               if ((OT_FEATURE(MPIPE_CALLBACKS) == ENABLED) && !defined(EXTF_mpipe_sig_rxdone))
+                    mpipe.sig_rxdone(0);
+#               elif defined(EXTF_mpipe_sig_rxdone)
+                    mpipe_sig_rxdone(0);
+#			    endif
+            }
+        }
+    }
+}
+
+
+void sub_usb_txstart() {
+/// Send the batch that has been filling, and fill the other one
+    ot_u8 batch = mpipe_ext.txfill;
+
+    mpipe_ext.txfill                   ^= 1;
+    mpipe_ext.txlen[mpipe_ext.txfill]   = 0;
+    mpipe_ext.txmsgs[mpipe_ext.txfill]  = 0;
+    mpipe.state                         = MPIPE_Tx_Wait;
+    USBCDC_sendData(mpipe_ext.txbuf[batch], mpipe_ext.txlen[batch], CDC0_INTFNUM);
+}
+
+
+void sub_usb_txdone() {
+/// The batch that was sending is done.  Start the one that filled meanwhile.
+/// The txdone code is the number of messages that were sent.
+    ot_int msgs = mpipe_ext.txmsgs[mpipe_ext.txfill ^ 1];
+
+    mpipe.state = MPIPE_Idle;
+    if (mpipe_ext.txlen[mpipe_ext.txfill] != 0) {
+        sub_usb_txstart();
+    }
+#   if ((OT_FEATURE(MPIPE_CALLBACKS) == ENABLED) && !defined(EXTF_mpipe_sig_txdone))
+        mpipe.sig_txdone(msgs);
+#   elif defined(EXTF_mpipe_sig_txdone)
+        mpipe_sig_txdone(msgs);
+#   endif
+}
+#endif
+
+
 
 
 
@@ -452,6 +574,15 @@ ot_int mpipe_init(void* port_id) {
 
     mpipe.sequence.ushort   = 0;          //not actually necessary
     mpipe.state             = MPIPE_Idle;
+
+#   if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+    mpipe.pktbuf            = NULL;     // RX starts on the first mpipe_rxndef()
+    mpipe_ext.rxlen         = 0;
+    mpipe_ext.rxframe       = 0;
+    mpipe_ext.txfill        = 0;
+    mpipe_ext.txlen[0]      = 0;
+    mpipe_ext.txmsgs[0]     = 0;
+#   endif
     
     USB_init();
     USB_disconnect();	//disconnect USB first
@@ -491,6 +622,91 @@ mpipe_state mpipe_status() {
 
 
 
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// The message is copied into the batch that is filling, and the CRC is taken
+/// during the copy, so "data" is free on return.  If nothing is sending, the
+/// batch goes out at once.  Returns -1 if the batch has no room for it.
+    ot_int          length = data[2] + 6;
+    ot_u8           batch;
+    ot_u8*          cursor;
+    ot_int          i;
+    Twobytes        crcval;
+    unsigned short  bGIE;
+
+    bGIE = (__get_SR_register() & GIE);
+    __disable_interrupt();
+    batch = mpipe_ext.txfill;
+
+    if ((mpipe_ext.txlen[batch] + length + MPIPE_FOOTERBYTES) > MPIPE_USBBULK_TXBYTES) {
+        __bis_SR_register(bGIE);
+        return -1;
+    }
+
+    cursor = &mpipe_ext.txbuf[batch][mpipe_ext.txlen[batch]];
+    platform_crc_init();
+    for (i=length; i!=0; i--) {
+        platform_crc_byte(*data);
+        *cursor++ = *data++;
+    }
+    platform_crc_byte(mpipe.sequence.ubyte[UPPER]);
+    platform_crc_byte(mpipe.sequence.ubyte[LOWER]);
+    *cursor++       = mpipe.sequence.ubyte[UPPER];
+    *cursor++       = mpipe.sequence.ubyte[LOWER];
+    crcval.ushort   = platform_crc_result();
+    *cursor++       = crcval.ubyte[UPPER];
+    *cursor         = crcval.ubyte[LOWER];
+
+    mpipe.sequence.ushort++;
+    mpipe_ext.txlen[batch] += length + MPIPE_FOOTERBYTES;
+    mpipe_ext.txmsgs[batch]++;
+
+    if (mpipe.state == MPIPE_Idle) {
+        sub_usb_txstart();
+    }
+    __bis_SR_register(bGIE);
+
+    if (blocking == True) {
+    	mpipe_wait();	
+    }
+    return length + MPIPE_FOOTERBYTES;
+}
+
+
+
+ot_int mpipe_rxndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// Release the message that was delivered, if any, and continue RX at "data".
+/// RX does not depend on TX here.  If the next message is already waiting in
+/// the endpoint buffers, it is delivered (and rxdone runs) right away.
+/// Returns -1 if a message is only partly received, in which case RX
+/// continues where it is.
+    unsigned short bGIE;
+
+    bGIE = (__get_SR_register() & GIE);
+    __disable_interrupt();
+    if ((mpipe_ext.rxframe == 0) && (mpipe_ext.rxlen != 0)) {
+        __bis_SR_register(bGIE);
+        return -1;
+    }
+    mpipe.pktbuf        = data;
+    mpipe_ext.rxlen     = 0;
+    mpipe_ext.rxframe   = 0;
+    sub_usb_rxparse();
+    __bis_SR_register(bGIE);
+
+    return 0;
+}
+
+
+
+void mpipe_isr() {
+/// In bulk mode this is the RX event: data is in the endpoint buffers, and no
+/// receive is underway.  TX completion goes to sub_usb_txdone().
+    sub_usb_rxparse();
+}
+
+
+#else
 ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
     Twobytes crcval;
     
@@ -586,5 +802,11 @@ void mpipe_isr() {
     }
 }
 
+#endif /* MPIPE_USBBULK */
+
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+MPIPE_PORT_DEFINE(&mpipe_kill);
 #endif
 
+
+#endif
@@ -43,6 +43,17 @@
 #include "system.h"
 #include "session.h"
 
+#if (PLATFORM_RAMCODE == ENABLED)
+#   if (CC_SUPPORT == CL430)
+#       include <cpy_tbl.h>
+        extern COPY_TABLE ramcode_copy;
+#   elif (CC_SUPPORT == GCC)
+        extern ot_u8 __ramcode_load[];
+        extern ot_u8 __ramcode_start[];
+        extern ot_u8 __ramcode_end[];
+#   endif
+#endif
+
 
 //API wrappers
 void otapi_poweron()    { platform_poweron(); }
@@ -121,22 +132,47 @@ void otapi_led2_off() {
   */
 platform_struct platform;
 
+#if (PLATFORM_ISR_NESTING == ENABLED)
+    /// While a handler is nested (see platform_isr_nest()), the interrupt
+    /// enables that the other platform ISRs have masked are kept in masked.
+#   define NEST_CCR1        0x01
+#   define NEST_CCR2        0x02
+#   define NEST_OVERFLOW    0x04
+#   define NEST_RT1PS       0x08
+#   define NEST_RTCTEV      0x10
+#   define NEST_DMA0        0x20
+#   define NEST_DMA1        0x40
+#   define NEST_DMA2        0x80
+
+    typedef struct {
+        ot_bool active;
+        ot_u8   masked;
+    } nest_struct;
+
+    static nest_struct nest;
+#endif
+
 #if (OT_FEATURE(RTC) == ENABLED)
-#   define RTC_ALARMS       0 
+#   define RTC_ALARMS       (ALARM_event+1)
 #   define RTC_OVERSAMPLE   0       // RTC_OVERSAMPLE: 0=1Hz, 10=1024Hz, 15=32768Hz
 
     typedef struct {
         ot_bool active;
         ot_u16  mask;
         ot_u16  value;
+        ot_u32  next;               // RTC second of the next match
     } rtcalarm;
 
+    /// The active alarms are queued in order[], soonest first, so the RTC ISR
+    /// only has to look at order[0].
     typedef struct {
 #       if (RTC_OVERSAMPLE != 0)
             ot_u32      utc;
 #       endif
 #       if (RTC_ALARMS > 0)
-            rtcalarm    alarm[RTC_ALARMS]
+            ot_u8       count;
+            ot_u8       order[RTC_ALARMS];
+            rtcalarm    alarm[RTC_ALARMS];
 #       endif
     } otrtc_struct;
 
@@ -146,6 +182,36 @@ platform_struct platform;
 #endif
 
 
+/** Kernel Timer (KTIM)
+  * GPTIM runs in continuous mode.  Its overflows are counted in ktim.hi, which
+  * makes a 32 bit count, and CCR1 interrupts at the deadline once ktim.hi
+  * reaches the upper half of the deadline.  GPTIM counts sub-ticks, with
+  * 2^PLATFORM_KTIM_SUBBITS sub-ticks per tick.  The mark replaces zeroing the
+  * timer, and it always moves by whole ticks.
+  */
+#if (PLATFORM_KTIM_SUBBITS > 5)
+#   error "PLATFORM_KTIM_SUBBITS must be 0-5 (GPTIM from ACLK/32 to ACLK/1)"
+#elif (PLATFORM_KTIM_SUBBITS > 2)
+#   define KTIM_PRESCALER   (TIMA_Ctl_Clock_ACLK | ((5-PLATFORM_KTIM_SUBBITS) << 6))
+#else
+#   define KTIM_PRESCALER   (TIMA_Ctl_Clock_ACLK | TIMA_Ctl_Divider_8 | \
+                            ((1 << (2-PLATFORM_KTIM_SUBBITS)) - 1))
+#endif
+#define KTIM_IV_CCR1        0x0002
+#define KTIM_IV_CCR2        0x0004
+#define KTIM_IV_OVERFLOW    0x000E
+#define KTIM_TICK           (((ot_u32)1 << PLATFORM_KTIM_SUBBITS) - 1)
+
+typedef struct {
+    ot_u16  hi;             // GPTIM overflow count
+    ot_bool armed;          // there is a deadline
+    ot_u32  mark;           // count at the last set or flush
+    ot_u32  deadline;       // count of the next kernel run
+} ktim_struct;
+
+ktim_struct ktim;
+
+
 
 
 
@@ -321,6 +387,70 @@ __interrupt void Reset_ISR(void) {
 
 
 // 5. Kernel Timer Interrupt
+ot_u32 sub_ktim_count() {
+/// GPTIM is clocked from ACLK, so it is read until two reads agree.  An
+/// overflow that is not serviced yet (in an ISR, or with interrupts off) is
+/// counted here.  If the overflow ISR runs during the read, it is read again.
+    ot_u16 hi, lo;
+    ot_u32 count;
+
+    do {
+        hi = ktim.hi;
+        do { lo = OT_GPTIM->R; } while (lo != OT_GPTIM->R);
+        count = ((ot_u32)hi << 16) | lo;
+        if ((OT_GPTIM->CTL & TIMA_FLG_IFG) && (lo < 0x8000)) {
+            count += 0x00010000;
+        }
+    } while (hi != ktim.hi);
+
+    return count;
+}
+
+
+void sub_ktim_program() {
+/// CCR1 is loaded when the deadline is in the present 16 bit period of GPTIM,
+/// else the overflow ISR calls this again.  A deadline that has passed (also
+/// while CCR1 was being loaded) sets the CCR1 flag by hand.
+    ot_u32 count;
+
+    OT_GPTIM->CCTL1 = 0;
+    if (ktim.armed) {
+        count = sub_ktim_count();
+        if ((ot_u16)(ktim.deadline >> 16) == (ot_u16)(count >> 16)) {
+            OT_GPTIM->CCR1  = (ot_u16)ktim.deadline;
+            OT_GPTIM->CCTL1 = TIMA_IT_CC;
+            count           = sub_ktim_count();
+        }
+        if ((ot_long)(ktim.deadline - count) <= 0) {
+            OT_GPTIM->CCTL1 = TIMA_IT_CC | TIMA_FLG_CC_CCIFG;
+        }
+    }
+}
+
+
+void sub_ktim_mark() {
+    ktim.mark += (sub_ktim_count() - ktim.mark) & ~KTIM_TICK;
+}
+
+
+#if (PLATFORM_ISR_NESTING == ENABLED)
+static void sub_gptim_defer() {
+/// A handler is nested: mask the GPTIM interrupts, and leave the flags set
+    if (OT_GPTIM->CCTL1 & TIMA_IT_CC) {
+        nest.masked     |= NEST_CCR1;
+        OT_GPTIM->CCTL1 &= ~TIMA_IT_CC;
+    }
+    if (OT_GPTIM->CCTL2 & TIMA_IT_CC) {
+        nest.masked     |= NEST_CCR2;
+        OT_GPTIM->CCTL2 &= ~TIMA_IT_CC;
+    }
+    if (OT_GPTIM->CTL & TIMA_IT_Update) {
+        nest.masked     |= NEST_OVERFLOW;
+        OT_GPTIM->CTL   &= ~TIMA_IT_Update;
+    }
+}
+#endif
+
 #ifndef EXTF_platform_gptim_isr
 #if (ISR_EMBED(GPTIM) == ENABLED)
 #	if (CC_SUPPORT == CL430)
@@ -331,8 +461,38 @@ __interrupt void Reset_ISR(void) {
     OT_IRQPRAGMA(OT_GPTIM_VECTOR)
 #	endif
 OT_INTERRUPT void platform_gptim_isr() {
-    platform_ot_run();
-	LPM4_EXIT;
+/// The overflow only extends the count (and loads CCR1 when the deadline comes
+/// into range), so the MCU goes back to sleep.  CCR1 runs the kernel, which
+/// the radio ISRs can preempt with PLATFORM_ISR_NESTING.
+#   if (PLATFORM_ISR_NESTING == ENABLED)
+    if (nest.active) {
+        sub_gptim_defer();
+        return;
+    }
+#   endif
+
+    switch (OT_GPTIM->IV) {
+        case KTIM_IV_CCR1:
+            OT_GPTIM->CCTL1 = 0;
+            SYS_PROFILE_WAIT_START();
+            PLATFORM_ISR_NEST();
+            platform_ot_run();
+            PLATFORM_ISR_UNNEST();
+            LPM4_EXIT;
+            break;
+
+        case KTIM_IV_CCR2:
+            OT_GPTIM->CCTL2 = 0;
+            LPM4_EXIT;
+            break;
+
+        case KTIM_IV_OVERFLOW:
+            ktim.hi++;
+            sub_ktim_program();
+            break;
+
+        default: break;
+    }
 }
 #endif
 #endif
@@ -342,22 +502,113 @@ OT_INTERRUPT void platform_gptim_isr() {
 // 6. RTC Interrupt
 #if (OT_FEATURE(RTC) == ENABLED)
 
+static ot_u32 sub_rtc_count() {
+/// The RTC is in counter mode, counting seconds in TIM1:TIM0.  It is read until
+/// TIM1 is stable, because it can tick between the two reads.
+    ot_u16 hi, lo;
+    do {
+        hi = RTC->TIM1;
+        lo = RTC->TIM0;
+    } while (hi != RTC->TIM1);
+
+    return ((ot_u32)hi << 16) | lo;
+}
+
+
 #if (RTC_ALARMS > 0)
-void sub_juggle_rtc_alarm() {
-    ot_u8  i;
-    ot_u32 comp;
-    ot_u32 next     = ~0;
-    ot_u32 rtcval   = RTC_GetCounter();
-
-    for (i=0; i<RTC_ALARMS; i++) {
-        if (otrtc.alarm[i].active) {
-            comp    = rtcval & ((ot_u32)otrtc.alarm[i].mask << RTC_OVERSAMPLE);
-            comp   += (ot_u32)otrtc.alarm[i].value << RTC_OVERSAMPLE;
-            next    = (comp < next) ? comp : next;
+static void sub_rtc_program(ot_u32 now) {
+/// RTC_A has no compare register in counter mode.  While the head alarm is
+/// more than 256 s away, only the 8 bit counter overflow (RTCTEV, every 256 s)
+/// interrupts.  In the last 256 s, the 1 Hz RT1PS interval interrupts.  The
+/// ISR only compares the head alarm, and the MCU is only woken from LPM when
+/// an alarm is due.
+    RTC->PS1CTL    &= ~RT1PSIE;
+    RTC->CTL01     &= ~RTCTEVIE;
+
+    if (otrtc.count != 0) {
+        if ((otrtc.alarm[otrtc.order[0]].next - now) <= 256) {
+            RTC->PS1CTL    |= RT1PSIE;
+        }
+        else {
+            RTC->CTL01     |= RTCTEVIE;
         }
     }
+}
+#endif
+
 
-    RTC_SetAlarm(rtcval+next);
+#if (RTC_ALARMS > 0)
+static ot_u32 sub_rtc_next(ot_u32 now, ot_u16 mask, ot_u16 value) {
+/// Returns the first second after "now" where the masked lower 16 bits of the
+/// RTC equal the masked value.  The RTC bits above the mask are free, so this
+/// always exists, and it is found without counting through the seconds.
+    ot_u32 next = now + 1;
+    ot_u32 m    = mask;
+    ot_u32 v    = value & m;
+    ot_u32 diff = (next ^ v) & m;
+    ot_u32 bit;
+
+    if (diff == 0) {
+        return next;
+    }
+
+    // Highest masked bit that differs: if next has a 0 there, set it and take
+    // the masked value below it.  Otherwise, carry into the lowest free 0 bit
+    // above it.
+    for (bit=0x8000; (bit & diff) == 0; bit>>=1);
+    if (v & bit) {
+        return (next & ~((bit<<1)-1)) | (v & ((bit<<1)-1));
+    }
+    for (bit<<=1; (bit != 0) && (bit & (m | next)); bit<<=1);
+    return (next & ~((bit<<1)-1)) | bit | (v & (bit-1));
+}
+
+
+static void sub_rtc_remove(ot_u8 alarm_id) {
+    ot_u8 i, j;
+    for (i=0, j=0; i<otrtc.count; i++) {
+        if (otrtc.order[i] != alarm_id) {
+            otrtc.order[j++] = otrtc.order[i];
+        }
+    }
+    otrtc.count = j;
+}
+
+
+static void sub_rtc_queue(ot_u8 alarm_id, ot_u32 now) {
+/// Takes the alarm out of the queue and, if it is active, puts it back in at
+/// its next match.  The compare is wrap-safe.
+    ot_u8 i;
+    sub_rtc_remove(alarm_id);
+
+    if (otrtc.alarm[alarm_id].active) {
+        otrtc.alarm[alarm_id].next = sub_rtc_next(now, otrtc.alarm[alarm_id].mask,
+                                                       otrtc.alarm[alarm_id].value);
+        for (i=otrtc.count; i>0; i--) {
+            if ((ot_long)(otrtc.alarm[otrtc.order[i-1]].next - otrtc.alarm[alarm_id].next) <= 0) {
+                break;
+            }
+            otrtc.order[i] = otrtc.order[i-1];
+        }
+        otrtc.order[i] = alarm_id;
+        otrtc.count++;
+    }
+}
+
+
+static void sub_rtc_service() {
+/// Pops each due alarm from the head of the queue, requeues it at its next
+/// match, and hands it to the kernel.  Then the head is programmed.
+    ot_u32  now = sub_rtc_count();
+    ot_u8   alarm_id;
+
+    while ((otrtc.count != 0) && \
+           ((ot_long)(now - otrtc.alarm[otrtc.order[0]].next) >= 0)) {
+        alarm_id = otrtc.order[0];
+        sub_rtc_queue(alarm_id, now);
+        sys_rtc_alarm(alarm_id);
+    }
+    sub_rtc_program(now);
 }
 #endif
 
@@ -372,21 +623,41 @@ void sub_juggle_rtc_alarm() {
 		//unknown at this time
 #	endif
 OT_INTERRUPT void platform_rtc_isr() {
-/// Currently Psuedocode.  RTC is normally used with ALARM interrupt.  If it
-/// is oversampling, then it will also interrupt on each second, so the user
-/// can increment the UTC.
+/// The interrupt is the 1 Hz RT1PS interval or the 8 bit counter overflow
+/// (RTCTEV).  Reading RTC->IV clears the flag.  If the RTC is oversampling,
+/// the 1 Hz interrupt is also used to increment the UTC.  While a handler is
+/// nested, the interrupts are masked instead, and the flag stays set.
+    ot_u16 rtc_iv;
+
+#   if (PLATFORM_ISR_NESTING == ENABLED)
+    if (nest.active) {
+        if (RTC->PS1CTL & RT1PSIE) {
+            nest.masked |= NEST_RT1PS;
+            RTC->PS1CTL &= ~RT1PSIE;
+        }
+        if (RTC->CTL01 & RTCTEVIE) {
+            nest.masked |= NEST_RTCTEV;
+            RTC->CTL01  &= ~RTCTEVIE;
+        }
+        return;
+    }
+#   endif
+
+    SYS_PROFILE_WAIT_START();
+    rtc_iv = RTC->IV;
+
 #   if (RTC_OVERSAMPLE != 0)
-        if (__rtc_interrupt_is_second__) {
+        if (rtc_iv == RTCIV_RT1PSIFG) {
             otrtc.utc++;
-            //add clear flag
         }
 #   endif
 #   if (RTC_ALARMS > 0)
-        if (__rtc_interrupt_is_alarm__) {
-            sub_juggle_rtc_alarm();
-            //add clear flag
+        if ((rtc_iv == RTCIV_RT1PSIFG) || (rtc_iv == RTCIV_RTCTEVIFG)) {
+            sub_rtc_service();
         }
-#    endif
+#   endif
+
+    SYS_PROFILE_WAIT_STOP();
 }
 #endif
 #endif
@@ -420,14 +691,117 @@ void platform_enable_interrupts() {
 #endif
 
 
+#if (PLATFORM_ISR_NESTING == ENABLED)
+#ifndef EXTF_platform_isr_nest
+void platform_isr_nest() {
+/// The caller has cleared its own flag.  From here to platform_isr_unnest(),
+/// the radio ISRs can preempt it, and the GPTIM, RTC and DMA ISRs defer.
+    nest.active = True;
+    SYS_PROFILE_WAIT_STOP();
+    platform_enable_interrupts();
+}
+#endif
+
+#ifndef EXTF_platform_isr_unnest
+void platform_isr_unnest() {
+/// The deferred ISRs still have their flags set, so they run when the caller
+/// returns.  An enable that the nested code cleared meanwhile may come back:
+/// at worst this gives an early kernel run or an extra RTC interval, and both
+/// of these are harmless.
+    platform_disable_interrupts();
+    nest.active = False;
+
+    if (nest.masked & NEST_CCR1)        OT_GPTIM->CCTL1 |= TIMA_IT_CC;
+    if (nest.masked & NEST_CCR2)        OT_GPTIM->CCTL2 |= TIMA_IT_CC;
+    if (nest.masked & NEST_OVERFLOW)    OT_GPTIM->CTL   |= TIMA_IT_Update;
+#   if (OT_FEATURE(RTC) == ENABLED)
+    if (nest.masked & NEST_RT1PS)       RTC->PS1CTL     |= RT1PSIE;
+    if (nest.masked & NEST_RTCTEV)      RTC->CTL01      |= RTCTEVIE;
+#   endif
+#   ifdef DMA0
+    if (nest.masked & NEST_DMA0)        DMA0->CTL       |= DMA_IT_IE;
+#   endif
+#   ifdef DMA1
+    if (nest.masked & NEST_DMA1)        DMA1->CTL       |= DMA_IT_IE;
+#   endif
+#   ifdef DMA2
+    if (nest.masked & NEST_DMA2)        DMA2->CTL       |= DMA_IT_IE;
+#   endif
+    nest.masked = 0;
+}
+#endif
+
+#ifndef EXTF_platform_isr_defer_dma
+ot_bool platform_isr_defer_dma() {
+/// Called first in a DMA ISR.  If a handler is nested, the DMA interrupts are
+/// masked until platform_isr_unnest(), and the ISR must return at once.
+    if (nest.active == False) {
+        return False;
+    }
+#   ifdef DMA0
+    if (DMA0->CTL & DMA_IT_IE) { nest.masked |= NEST_DMA0;  DMA0->CTL &= ~DMA_IT_IE; }
+#   endif
+#   ifdef DMA1
+    if (DMA1->CTL & DMA_IT_IE) { nest.masked |= NEST_DMA1;  DMA1->CTL &= ~DMA_IT_IE; }
+#   endif
+#   ifdef DMA2
+    if (DMA2->CTL & DMA_IT_IE) { nest.masked |= NEST_DMA2;  DMA2->CTL &= ~DMA_IT_IE; }
+#   endif
+    return True;
+}
+#endif
+#endif
+
+
+#if ((OT_FEATURE(POWERMGR) == ENABLED) && !defined(EXTF_platform_enter_lpm))
+void platform_enter_lpm(ot_u8 mode) {
+/// Interrupts are on hold.  LPM0 and LPM4 enable them in the instruction that
+/// sleeps.  LPM3 keeps GPTIM running, so an interrupt before PMM_EnterLPM3()
+/// sleeps only costs a later wakeup.
+    switch (mode) {
+        case 0:     __bis_SR_register(LPM0_bits + GIE);
+                    break;
+
+        case 1:     platform_enable_interrupts();
+                    PMM_EnterLPM3();
+                    break;
+
+        default:    PMM_EnterLPM4();
+                    break;
+    }
+    __no_operation();
+}
+#endif
+
+
+#if ((OT_FEATURE(CLKSCALE) == ENABLED) && !defined(EXTF_platform_set_perf))
+void platform_set_perf(ot_u8 level) {
+/// Only the MCLK divider (DIVM) changes.  The new rate takes effect within a
+/// few MCLK cycles, so there is nothing to wait for.
+    static const ot_u16 mclk_div[PLATFORM_PERF_LEVELS] = {
+        (div4 << clockMCLK), (div2 << clockMCLK), (div1 << clockMCLK)
+    };
+    ot_u16 ctl5;
+
+    if (level >= PLATFORM_PERF_LEVELS) {
+        level = PLATFORM_PERF_LEVELS-1;
+    }
+    ctl5 = (UCS->CTL5 & ~(7 << clockMCLK)) | mclk_div[level];
+    if (UCS->CTL5 != ctl5) {
+        UCS->CTL5 = ctl5;
+    }
+}
+#endif
+
+
 #ifndef EXTF_platform_ot_preempt
 void platform_ot_preempt() {
-/// Manually kick the GPTIM interrupt flag in order to pre-empt the kernel.
-/// Also, save the current value of the timer so that the kernel can subtract
-/// whatever time passed since the last event.
-    ot_u16 scratch = OT_GPTIM->R;
-    platform_set_gptim(scratch);
-    OT_GPTIM->CTL  |= 1;
+/// Manually kick the CCR1 interrupt flag in order to pre-empt the kernel.  The
+/// mark is kept, so the kernel can subtract whatever time passed since the
+/// last event.
+    ktim.armed      = True;
+    ktim.deadline   = sub_ktim_count();
+    OT_GPTIM->CCTL1 = TIMA_IT_CC | TIMA_FLG_CC_CCIFG;
 }
 #endif
 
@@ -442,14 +816,13 @@ void platform_ot_pause() {
 
 #ifndef EXTF_platform_ot_run
 void platform_ot_run() {
-/// 1. Save the amount of time that just passed
-/// 2. Put the timer into free-running upcounter to time kernel process
-/// 3. Run System Kernel, which returns its next scheduled call
-/// 4. Put the next scheduled call into the timer, and turn it back on
-    ot_u16 next_event;
-    ot_u16 elapsed_time;
-    elapsed_time    = OT_GPTIM->CCR0;
-  //elapsed_time   += platform_get_gptim();  //experimental, for use with continuous timer
+/// 1. Save the amount of time that just passed, in whole ticks.  The sub-tick
+///    stays with the mark, so the kernel timebase does not slip.
+/// 2. Run System Kernel, which returns its next scheduled call
+/// 3. Put the next scheduled call into the timer (32 bits)
+    ot_u32 next_event;
+    ot_u32 elapsed_time;
+    elapsed_time    = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
     next_event      = sys_event_manager( elapsed_time );
 
 #   if (OT_PARAM(KERNEL_LIMIT) > 0)
@@ -457,7 +830,7 @@ void platform_ot_run() {
             next_event = OT_PARAM(KERNEL_LIMIT);
 #   endif
 
-    platform_set_gptim( next_event );
+    platform_set_ktim( next_event );
 }
 #endif
 
@@ -480,6 +853,26 @@ void platform_poweron() {
 
     WDTA->CTL = WDTPW + WDTHOLD;
 
+    /// Paint the stack while it is nearly empty (see OT_FEATURE_MEMSTATS)
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    sys_stack_paint();
+#   endif
+
+    /// Copy the OT_RAMCODE functions to SRAM, before any of them can run.
+    /// DMA is not set up yet, so the GCC copy is a plain loop.
+#   if (PLATFORM_RAMCODE == ENABLED)
+#   if (CC_SUPPORT == CL430)
+    copy_in(&ramcode_copy);
+#   elif (CC_SUPPORT == GCC)
+    {   ot_u8* src  = __ramcode_load;
+        ot_u8* dst  = __ramcode_start;
+        while (dst < __ramcode_end) {
+            *dst++ = *src++;
+        }
+    }
+#   endif
+#   endif
+
     BOARD_POWER_STARTUP();
 
     /// 2. Initialize OpenTag platform peripherals
@@ -489,7 +882,7 @@ void platform_poweron() {
     SFRIFG1 &= ~(NMIIFG | OFIFG | VMAIFG);
     SFRIE1   = (NMIIE | /* OFIE | */ ACCVIE);   //Oscillator fault can be glitchy
 
-    platform_init_gptim(0x01C3);        // Initialize GPTIM (to 1024 Hz)
+    platform_init_gptim(KTIM_PRESCALER); // Initialize GPTIM (to 1024 Hz ticks)
     platform_init_gpio();
     platform_init_memcpy();
     platform_init_prand(0xBEEF);        // BEEF is tasty
@@ -510,12 +903,11 @@ void platform_poweron() {
 void platform_poweroff() {
 /// 1. Disable all NMI interrupts that can break flash writes. <BR>
 /// 2. Put any mirror data into the flash <BR>
-/// 3. Save the vworm mapping table
+/// 3. Save the vworm mapping table and the veelite boot snapshot
 /// 4. If using USB, disconnect it
     ot_u8 old_sfrie1 = SFRIE1;
     SFRIE1 = 0;
-    ISF_syncmirror();
-    vworm_save();
+    vl_save();
     SFRIE1 = old_sfrie1;
 
 #   if (OT_FEATURE(MPIPE) == ENABLED)
@@ -542,7 +934,15 @@ void platform_init_OT() {
 
 #ifndef EXTF_fastinit_OT
 void platform_fastinit_OT() {
-    platform_init_OT();
+	buffers_init(); //buffers init must be first in order to do core dumps
+	vl_fastinit();  //Veelite from the boot snapshot, if there is one
+	radio_init();   //radio init third
+	sys_init();     //system init last
+
+#   ifdef BOARD_RF430USB_5509
+	// For this board, Radio must be initialized before MPipe
+		mpipe_init(NULL);
+#   endif
 }
 #endif
 
@@ -678,13 +1078,19 @@ void platform_init_gptim(ot_uint prescaler) {
 /// bits 7:6 - Input Divider (ID) -     values {0,1,2,3} yield division by {1,2,4,8}  <BR>
 /// bits 2:0 - Input Divider 2 (IDEX) - values b000-b111 yield division by 1 to 8  <BR>
 
-	// Don't enable interrupt on init.  Call platform_ot_preempt to enable.
-    ot_u16 ctl      = (prescaler & 0x01E0) /* | TIMA_IT_Update */;
+/// GPTIM runs continuously, with only the overflow interrupt, until there is a
+/// deadline (call platform_ot_preempt to start the kernel).
+    ot_u16 ctl      = (prescaler & 0x01E0) | TIMA_Ctl_Mode_Continuous | TIMA_IT_Update;
     ot_u16 idex     = (prescaler & 0x0007);
 
+    ktim.hi         = 0;
+    ktim.mark       = 0;
+    ktim.armed      = False;
+    OT_GPTIM->CCTL1 = 0;
+    OT_GPTIM->CCTL2 = 0;
     OT_GPTIM->CTL  |= TIMA_FLG_TACLR;   //Clear the timer before changing mode
-    OT_GPTIM->CTL   = ctl;
     OT_GPTIM->EX0   = idex;
+    OT_GPTIM->CTL   = ctl;
 }
 #endif
 
@@ -746,8 +1152,8 @@ void platform_init_rtc(ot_u32 value) {
 
 
     // Set RTC value from that stored in configuration
-    RTC->TIM0   = ((ot_u16*)value)[0];
-    RTC->TIM1   = ((ot_u16*)value)[1];
+    RTC->TIM0   = (ot_u16)value;
+    RTC->TIM1   = (ot_u16)(value >> 16);
 
     platform_enable_rtc();
 #endif
@@ -783,28 +1189,55 @@ void platform_init_memcpy() {
   */
 #ifndef EXTF_platform_get_gptim
 ot_u16 platform_get_gptim() {
-    return OT_GPTIM->R;
+    ot_u32 ticks = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
+    return (ticks > 65535) ? 65535 : (ot_u16)ticks;
+}
+#endif
+
+
+#ifndef EXTF_platform_get_ktim
+ot_u32 platform_get_ktim() {
+    return sub_ktim_count() - ktim.mark;
+}
+#endif
+
+#ifndef EXTF_platform_stamp
+ot_u32 platform_stamp() {
+    return sub_ktim_count();
 }
 #endif
 
+#if (OT_FEATURE(PROFILER) == ENABLED)
+#ifndef EXTF_platform_get_cycles
+ot_u32 platform_get_cycles() {
+    return (ot_u32)OT_GPTIM->R;
+}
+#endif
+#endif
+
 
 #ifndef EXTF_platform_set_gptim
 void platform_set_gptim(ot_u16 value) {
-    OT_GPTIM->CTL  |= 0x0004;   //clear & stop timer
-    OT_GPTIM->CTL  &= ~0x0033;  //clear configuration
-    OT_GPTIM->CCR0  = value;    //set next interval
-    OT_GPTIM->CTL  |= 0x0012;   //restart in upmode, with interrupt
-    ///@todo continuous-up with interrupt is experimental
+    platform_set_ktim(value);
+}
+#endif
+
+
+#ifndef EXTF_platform_set_ktim
+void platform_set_ktim(ot_u32 value) {
+    sub_ktim_mark();
+    ktim.deadline   = ktim.mark + (value << PLATFORM_KTIM_SUBBITS);
+    ktim.armed      = True;
+    sub_ktim_program();
 }
 #endif
 
 
 #ifndef EXTF_platform_flush_gptim
 void platform_flush_gptim() {
-    OT_GPTIM->CTL  |= 0x0004;   //clear & stop timer
-    OT_GPTIM->CTL  &= ~0x0033;  //clear configuration
-    OT_GPTIM->CCR0  = 65535;    //workaround to a known CC430 erratum
-    OT_GPTIM->CTL  |= 0x0020;   //restart in continuous-up, without interrupt
+    sub_ktim_mark();
+    ktim.armed      = False;
+    OT_GPTIM->CCTL1 = 0;
 }
 #endif
 
@@ -831,7 +1264,11 @@ void platform_reset_watchdog(ot_u16 reset) {
 
 #ifndef EXTF_platform_enable_rtc
 void platform_enable_rtc() {
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    sub_rtc_program(sub_rtc_count());
+#else
     RTC->PS1CTL |= RT1PSIE;
+#endif
 }
 #endif
 
@@ -839,6 +1276,7 @@ void platform_enable_rtc() {
 #ifndef EXTF_platform_disable_rtc
 void platform_disable_rtc() {
     RTC->PS1CTL &= ~RT1PSIE;
+    RTC->CTL01  &= ~RTCTEVIE;
 }
 #endif
 
@@ -847,7 +1285,7 @@ void platform_disable_rtc() {
 ot_u32 platform_get_time() {
 #if (OT_FEATURE(RTC) == ENABLED)
 #   if (RTC_OVERSAMPLE == 0)
-        return ///@todo find time register, if it exists
+        return sub_rtc_count();
 #   else
         return otrtc.utc;
 #   endif
@@ -860,20 +1298,42 @@ ot_u32 platform_get_time() {
 
 #ifndef EXTF_platform_set_time
 void platform_set_time(ot_u32 utc_time) {
-#if (RTC_OVERSAMPLE != 0)
-    otrtc.utc   = utc_time;
-#else
-    ///@todo find time register, if it exists
+#if (OT_FEATURE(RTC) == ENABLED)
+#   if (RTC_OVERSAMPLE != 0)
+        otrtc.utc   = utc_time;
+#   else
+        RTC->CTL01 |= RTCHOLD;
+        RTC->TIM0   = (ot_u16)utc_time;
+        RTC->TIM1   = (ot_u16)(utc_time >> 16);
+        RTC->CTL01 &= ~RTCHOLD;
+#   endif
+#   if (RTC_ALARMS > 0)
+    {   // The time has jumped, so every alarm is requeued
+        ot_u8 i;
+        platform_disable_interrupts();
+        for (i=0; i<RTC_ALARMS; i++) {
+            sub_rtc_queue(i, sub_rtc_count());
+        }
+        sub_rtc_program(sub_rtc_count());
+        platform_enable_interrupts();
+    }
+#   endif
 #endif
 }
 #endif
 
 
 #ifndef EXTF_platform_set_rtc_alarm
-void platform_set_rtc_alarm(ot_u8 alarm_i, ot_u16 mask, ot_u16 value) {
-#if (OT_FEATURE(RTC) == ENABLED)
-    otrtc.alarm[alarm_i].mask     = mask;
-    otrtc.alarm[alarm_i].value    = value;
+void platform_set_rtc_alarm(ot_u8 alarm_id, ot_u16 mask, ot_u16 value) {
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    ot_u32 now;
+    platform_disable_interrupts();
+    otrtc.alarm[alarm_id].mask  = mask;
+    otrtc.alarm[alarm_id].value = value;
+    now                         = sub_rtc_count();
+    sub_rtc_queue(alarm_id, now);
+    sub_rtc_program(now);
+    platform_enable_interrupts();
 #endif
 }
 #endif
@@ -881,8 +1341,14 @@ void platform_set_rtc_alarm(ot_u8 alarm_i, ot_u16 mask, ot_u16 value) {
 
 #ifndef EXTF_platform_enable_rtc_alarm
 void platform_enable_rtc_alarm(ot_u8 alarm_id, ot_bool enable) {
-#if (OT_FEATURE(RTC) == ENABLED)
-    otrtc.alarm[alarm_i].active   = enable;
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    ot_u32 now;
+    platform_disable_interrupts();
+    otrtc.alarm[alarm_id].active = enable;
+    now                          = sub_rtc_count();
+    sub_rtc_queue(alarm_id, now);
+    sub_rtc_program(now);
+    platform_enable_interrupts();
 #endif
 }
 #endif
@@ -988,7 +1454,7 @@ ot_u16 platform_crc_result() {
 /** Platform Random Number Generation Routines <BR>
   * ========================================================================<BR>
   * The platform must be able to compute a strong random number (via function
-  * platform_rand()) and a "pseudo" random number (via platform_prand_u8()).
+  * platform_rand()).  The "pseudo" random number generator is in otlib/prand.c.
   */
 #ifndef EXTF_platform_rand
 void platform_rand(ot_u8* rand_out, ot_int bytes_out) {
@@ -1038,43 +1504,69 @@ void platform_rand(ot_u8* rand_out, ot_int bytes_out) {
 #endif
 
 
-#ifndef EXTF_platform_init_prand
-ot_u16 prand_reg;
-void platform_init_prand(ot_u16 seed) {
-    prand_reg = seed;
-}
-#endif
 
 
-#ifndef EXTF_platform_prand_u8
-ot_u8 platform_prand_u8() {
-    return (ot_u8)platform_prand_u16();
-}
+/** Platform memcpy Routines <BR>
+  * ========================================================================<BR>
+  * Similar to standard implementation of "memcpy".  Copies shorter than
+  * MEMCPY_DMA_THRESHOLD bytes always go through the CPU, because setting up
+  * the DMA costs more than it saves on a short run.  The CPU copies a word at 
+  * a time when both addresses are even.
+  *
+  * The DMA methods cannot be used reliably if OpenTag makes use of the DMA for
+  * some other non-blocking process (e.g. MPipe).
+  */
+#ifndef MEMCPY_DMA_THRESHOLD
+#   define MEMCPY_DMA_THRESHOLD     16
 #endif
 
-
-#ifndef EXTF_platform_prand_u16
-ot_u16 platform_prand_u16() {
-/// Run the HW CRC on the prand register stored value.  Always save the value in
-/// the CRC HW and return it when the process is done.  prand_reg should be
-/// initialized at startup with the device ID or serial number (or something)
-    ot_u16 scratch  = CRC->INIRES;
-    CRC->INIRES     = prand_reg;
-    CRCb->DIRB_L    = 0;
-    prand_reg       = CRC->INIRES;
-    CRC->INIRES     = scratch;
-
-    return prand_reg;
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+void sub_memcpy_dma(ot_u8* dest, ot_u8* src, ot_int length, ot_u16 ctl) {
+/// CC430 DMA Block Transfer is blocking, and the CPU is stopped during the
+/// data movement.  Thus no while loop is needed.
+    MEMCPY_DMA->SA_L    = (ot_u16)src;
+    MEMCPY_DMA->DA_L    = (ot_u16)dest;
+    MEMCPY_DMA->SZ      = length;
+    MEMCPY_DMA->CTL     = ( DMA_Mode_Block | \
+                            DMA_DestinationInc_Enable | \
+                            DMA_TriggerLevel_RisingEdge | \
+                            ctl | \
+                            0x11);
 }
 #endif
 
 
+void sub_memcpy_cpu(ot_u8* dest, ot_u8* src, ot_int length) {
+    if (length <= 0) {
+        return;
+    }
+    if ((((ot_uint)dest | (ot_uint)src) & 1) == 0) {
+        platform_memcpy_2((ot_u16*)dest, (ot_u16*)src, length >> 1);
+        if (length & 1) {
+            dest[length-1] = src[length-1];
+        }
+    }
+    
+    /// Uses the "Duff's Device" for loop unrolling.  If this is incredibly
+    /// confusing to you, check the internet for "Duff's Device."
+    else {
+        ot_int loops = (length + 7) >> 3;
 
+        switch (length & 0x7) {
+            case 0: do {    *dest++ = *src++;
+            case 7:         *dest++ = *src++;
+            case 6:         *dest++ = *src++;
+            case 5:         *dest++ = *src++;
+            case 4:         *dest++ = *src++;
+            case 3:         *dest++ = *src++;
+            case 2:         *dest++ = *src++;
+            case 1:         *dest++ = *src++;
+                        }
+                        while (--loops > 0);
+        }
+    }
+}
 
-/** Platform memcpy Routine <BR>
-  * ========================================================================<BR>
-  * Similar to standard implementation of "memcpy"
-  */
 
 #ifndef EXTF_platform_memcpy
 void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
@@ -1084,39 +1576,47 @@ void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
     memcpy(dest, src, length);
 
 #elif (MCU_FEATURE(MEMCPYDMA) == ENABLED)
-/// DMA driven method: CC430 DMA Block Transfer is blocking, and the CPU is
-/// stopped during the data movement.  Thus the while loop is not needed.
-/// DMA memcpy cannot be used reliably if OpenTag makes use of the DMA for some
-/// other non-blocking process (e.g. MPipe).
-    MEMCPY_DMA->SA_L    = (ot_u16)src;
-    MEMCPY_DMA->DA_L    = (ot_u16)dest;
-    MEMCPY_DMA->SZ      = length;
-    //DMA->CTL4           = ( DMA_Options_RMWDisable | \
-                            DMA_Options_RoundRobinDisable | \
-                            DMA_Options_ENMIDisable      );
-    MEMCPY_DMA->CTL     = ( DMA_Mode_Block | \
-                            DMA_DestinationInc_Enable | \
-                            DMA_SourceInc_Enable | \
-                            DMA_DestinationDataSize_Byte | \
-                            DMA_SourceDataSize_Byte | \
-                            DMA_TriggerLevel_RisingEdge | \
-                            0x11);
-    //MEMCPY_DMA->CTL    |= 0x0001;
-
-    //while ((MEMCPY_DMA->CTL & DMAIFG) == 0);
+    if (length < MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_cpu(dest, src, length);
+    }
+    else if ((((ot_uint)dest | (ot_uint)src) & 1) == 0) {
+        sub_memcpy_dma(dest, src, (length >> 1), DMA_SourceInc_Enable | \
+                                                 DMA_DestinationDataSize_Word | \
+                                                 DMA_SourceDataSize_Word);
+        if (length & 1) {
+            dest[length-1] = src[length-1];
+        }
+    }
+    else {
+        sub_memcpy_dma(dest, src, length, DMA_SourceInc_Enable | \
+                                          DMA_DestinationDataSize_Byte | \
+                                          DMA_SourceDataSize_Byte);
+    }
 
 #else
-/// Uses the "Duff's Device" for loop unrolling.  If this is incredibly
-/// confusing to you, check the internet for "Duff's Device."
+    sub_memcpy_cpu(dest, src, length);
+#endif
+}
+#endif
+
+
+#ifndef EXTF_platform_memcpy_2
+void platform_memcpy_2(ot_u16* dest, ot_u16* src, ot_int length) {
+/// Same as platform_memcpy(), but length is in 16 bit words, and both 
+/// addresses must be word-aligned.
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= (MEMCPY_DMA_THRESHOLD/2)) {
+        sub_memcpy_dma((ot_u8*)dest, (ot_u8*)src, length, DMA_SourceInc_Enable | \
+                                                          DMA_DestinationDataSize_Word | \
+                                                          DMA_SourceDataSize_Word);
+        return;
+    }
+#endif
     if (length > 0) {
-        ot_int loops = (length + 7) >> 3;
+        ot_int loops = (length + 3) >> 2;
 
-        switch (length & 0x7) {
+        switch (length & 0x3) {
             case 0: do {    *dest++ = *src++;
-            case 7:         *dest++ = *src++;
-            case 6:         *dest++ = *src++;
-            case 5:         *dest++ = *src++;
-            case 4:         *dest++ = *src++;
             case 3:         *dest++ = *src++;
             case 2:         *dest++ = *src++;
             case 1:         *dest++ = *src++;
@@ -1124,8 +1624,62 @@ void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
                         while (--loops > 0);
         }
     }
+}
+#endif
+
+
+#ifndef EXTF_platform_memcpy_async
+void platform_memcpy_async(ot_u8* dest, ot_u8* src, ot_int length) {
+/// The MSP430 DMA stops the CPU during a block transfer, so there is no CPU 
+/// work to overlap with it.  The copy is done when this returns.
+    platform_memcpy(dest, src, length);
+}
+#endif
+
+
+#ifndef EXTF_platform_memcpy_busy
+ot_bool platform_memcpy_busy() {
+    return False;
+}
+#endif
 
+
+#ifndef EXTF_platform_memcpy_wait
+void platform_memcpy_wait() {
+}
 #endif
+
+
+#ifndef EXTF_platform_memset
+void platform_memset(ot_u8* dest, ot_u8 value, ot_int length) {
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_dma(dest, &value, length, DMA_SourceInc_Disable | \
+                                             DMA_DestinationDataSize_Byte | \
+                                             DMA_SourceDataSize_Byte);
+        return;
+    }
+#endif
+    if (length <= 0) {
+        return;
+    }
+    if (((ot_uint)dest & 1) == 0) {
+        ot_u16* dest2   = (ot_u16*)dest;
+        ot_u16  value2  = ((ot_u16)value << 8) | value;
+        ot_int  i;
+        
+        for (i=(length>>1); i>0; i--) {
+            *dest2++ = value2;
+        }
+        if (length & 1) {
+            dest[length-1] = value;
+        }
+    }
+    else {
+        while (--length >= 0) {
+            *dest++ = value;
+        }
+    }
 }
 #endif
 
@@ -1139,37 +1693,63 @@ void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
   * ========================================================================<BR>
   * Random crap
   */
-#ifndef EXTF_platform_delay
-void platform_delay(ot_u16 n) {
-    ot_u16 reg;
+/** Platform Delays
+  * A wait of PLATFORM_DELAY_SLEEP_US or more sleeps until GPTIM CCR2, which
+  * the kernel timer does not use.  CCR2 matches once per 16 bit period of 
+  * GPTIM, so a longer wait wakes up once per period and goes back to sleep.
+  * The wait is rounded up to whole sub-ticks, plus the sub-tick underway.  
+  * A shorter wait counts PLATFORM_HSCLOCK_HZ cycles, and so does any wait 
+  * made with interrupts off (i.e. in an ISR) or before GPTIM is started.
+  */
+#define DELAY_SUBTICK_HZ    ((ot_u32)1024 << PLATFORM_KTIM_SUBBITS)
+#define DELAY_CAN_SLEEP()   ((__get_SR_register() & GIE) && \
+                            (OT_GPTIM->CTL & TIMA_Ctl_Mode_Continuous))
+
+void sub_delay_sleep(ot_u32 subticks, ot_u16 lpm_bits) {
+/// The deadline is checked with interrupts off, and the sleep turns them back
+/// on in the same instruction, so a CCR2 match is never lost in between.
+    ot_u32 until;
+
+    until = sub_ktim_count() + subticks + 1;
+    while (1) {
+        __disable_interrupt();
+        if ((ot_long)(until - sub_ktim_count()) <= 0) {
+            break;
+        }
+        OT_GPTIM->CCR2  = (ot_u16)until;
+        OT_GPTIM->CCTL2 = TIMA_IT_CC;
+        if ((ot_long)(until - sub_ktim_count()) <= 0) {
+            OT_GPTIM->CCTL2 = TIMA_IT_CC | TIMA_FLG_CC_CCIFG;
+        }
+        __bis_SR_register(lpm_bits + GIE);
+        __no_operation();
+    }
+    OT_GPTIM->CCTL2 = 0;
+    platform_enable_interrupts();
+}
 
-    reg         = 0x007F & WDTA->CTL;              // clear hold bit and passkey
-    WDTA->CTL   = (WDTPW | WDTCNTCL | reg);     // reset with passkey and clear timer
 
-    for (; n > 0; n--) {          // run nCount iterations
-        PMM_EnterLPM3();                        // sleep until interrupt (change LPM if needed)
+#ifndef EXTF_platform_delay
+void platform_delay(ot_u16 n) {
+/// n ticks in LPM3, which keeps ACLK (and GPTIM) running
+    if (DELAY_CAN_SLEEP()) {
+        sub_delay_sleep(((ot_u32)n << PLATFORM_KTIM_SUBBITS), LPM3_bits);
+    }
+    else {
+        for (; n>0; n--) {
+            __delay_cycles( (PLATFORM_HSCLOCK_HZ/1024) );
+        }
     }
-
-    WDTA->CTL   = (WDTPW | WDTHOLD | reg);      // hold WDT after completion
 }
 #endif
 
 
-
-/** @note
-  * The multiplier values used in Proc_SwDelay...() are hard-coded into the
-  * constants below.  At the moment, it is hardcoded to work with a roughly
-  * 20 MHz (± 1%) instruction clock.
-  *
-  * @todo
-  * Test constants with logic probe to verify accuracy
-  * Might need to code in assembly due to 16 bit integer limit of MSP430
-  */
-#define CNT1us_20MHz    (20/2)
-#define CNT1ms_20MHz    (CNT1us_20MHz*1000)
-
 #ifndef EXTF_platform_swdelay_ms
 void platform_swdelay_ms(ot_u16 n) {
+    if ((((ot_u32)n * 1000) >= PLATFORM_DELAY_SLEEP_US) && DELAY_CAN_SLEEP()) {
+        sub_delay_sleep((((ot_u32)n * DELAY_SUBTICK_HZ) + 999) / 1000, LPM0_bits);
+        return;
+    }
 	for (; n>0; n--) {
 	    __delay_cycles( (PLATFORM_HSCLOCK_HZ/1000) );
 	}
@@ -1179,6 +1759,10 @@ void platform_swdelay_ms(ot_u16 n) {
 
 #ifndef EXTF_platform_swdelay_us
 void platform_swdelay_us(ot_u16 n) {
+    if ((n >= PLATFORM_DELAY_SLEEP_US) && DELAY_CAN_SLEEP()) {
+        sub_delay_sleep((((ot_u32)n * DELAY_SUBTICK_HZ) + 999999) / 1000000, LPM0_bits);
+        return;
+    }
 	for (; n>0; n--) {
         __delay_cycles( (PLATFORM_HSCLOCK_HZ/1000000) );
 	}
@@ -0,0 +1,565 @@
+/* Copyright 2010-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTplatform/MSP430F5/tms3705_MSP430F5.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       15 October 2012
+  * @brief      TMS3705 LF reader driver for MSP430F5
+  * @ingroup    TMS3705
+  *
+  * TXCT is driven by output unit 1 of PALFI_TIM, and SCIO is read by
+  * PALFI_UART (RX only), both through the port mapping controller.  The timer
+  * ticks at 2 us and runs in up mode.  Each period is one segment of the TXCT
+  * waveform: at the start of a period, CCR1 (= 0) sets the output to the level
+  * of the segment (OUTMOD set or reset), and TBCL0 latches its length (CLLD_1).
+  * The CCR1 ISR then loads the next segment, so it has a whole segment (at
+  * least 100 us) to do it, and the edges do not depend on ISR latency.
+  *
+  * The response is read in the TMS3705 asynchronous mode (SCI), which the MCW
+  * must select.  The TI demo in Supplements/TMS3705_MSP430F5 clocks it out of
+  * SCIO in synchronous mode instead, which needs the CPU for each bit.
+  *
+  * On the EXP5529 boards, the TMS3705 uses USCI_A1 and P4.4/P4.5, which are
+  * also the UART MPipe pins, so use the USB MPipe with it.
+  ******************************************************************************
+  */
+
+#include "OT_config.h"
+#include "OT_platform.h"
+
+#if (OT_FEATURE(TMS3705) == ENABLED)
+
+#include "tms3705.h"
+#include "queue.h"
+#include "system.h"
+
+#if ((OT_FEATURE(MPIPE) == ENABLED) && (MCU_FEATURE(MPIPEVCOM) != ENABLED))
+#   error "The TMS3705 uses the UART and pins of the UART MPipe: use the USB MPipe."
+#endif
+
+
+
+/** Timer setup
+  * The timer runs from SMCLK divided down to 500 kHz (2 us), with the input
+  * divider (ID) and the expansion divider (TBxEX0, which holds divisor-1).
+  */
+#define TMS3705_SMCLK_HZ    (PLATFORM_HSCLOCK_HZ / PLATFORM_SMCLK_DIV)
+#define TMS3705_TIMDIV      (TMS3705_SMCLK_HZ / 500000)
+
+#if (((TMS3705_TIMDIV % 8) == 0) && (TMS3705_TIMDIV <= 64))
+#   define TMS3705_TIMID    TIMA_Ctl_Divider_8
+#   define TMS3705_TIMEX    ((TMS3705_TIMDIV / 8) - 1)
+#elif (((TMS3705_TIMDIV % 4) == 0) && (TMS3705_TIMDIV <= 32))
+#   define TMS3705_TIMID    TIMA_Ctl_Divider_4
+#   define TMS3705_TIMEX    ((TMS3705_TIMDIV / 4) - 1)
+#elif (((TMS3705_TIMDIV % 2) == 0) && (TMS3705_TIMDIV <= 16))
+#   define TMS3705_TIMID    TIMA_Ctl_Divider_2
+#   define TMS3705_TIMEX    ((TMS3705_TIMDIV / 2) - 1)
+#elif ((TMS3705_TIMDIV > 0) && (TMS3705_TIMDIV <= 8))
+#   define TMS3705_TIMID    TIMA_Ctl_Divider_1
+#   define TMS3705_TIMEX    (TMS3705_TIMDIV - 1)
+#else
+#   error "SMCLK cannot be divided to 500 kHz for the TMS3705 timer."
+#endif
+
+#define TMS3705_CLLD_ZERO   0x0200              // TBCCTLx CLLD_1: load at TBR = 0
+#define TMS3705_US(US)      ((US) / 2)          // timer ticks
+#define TMS3705_SEGMAX      50000               // longest segment (100 ms)
+#define TMS3705_RXUNITS     TMS3705_US((ot_u32)TMS3705_RXTIMEOUT*1000)
+#define TMS3705_BRW         (ot_u16)(TMS3705_SMCLK_HZ / 15625)
+
+#if (TMS3705_RXTIMEOUT > 130)
+#   error "TMS3705_RXTIMEOUT must be 130 ms or less."
+#endif
+
+
+
+/** Waveform states
+  * Each state is a field of the message.  A field is a fixed sequence of
+  * segments, bits, or a power burst (TXCT low).
+  */
+#define TMS_IDLE        0
+#define TMS_WAKE        1
+#define TMS_MCW         2
+#define TMS_PB1         3
+#define TMS_EXTRA       4
+#define TMS_EXTRAEND    5
+#define TMS_INITMC      6
+#define TMS_PB3         7
+#define TMS_DATA        8
+#define TMS_PB2         9
+#define TMS_TAIL        10
+#define TMS_RX          11
+
+typedef struct {
+    tms3705_pkt     pkt;
+    ot_int          code;
+    ot_u8           state;
+    ot_u8           level;          // TXCT level of the segment being loaded
+    ot_bool         field_on;       // TXCT left low by the last message
+    ot_u8           mcw;
+
+    const ot_u16*   seq;            // fixed sequence, alternating levels
+    ot_u8           seq_len;
+    ot_u8           bytes;          // bits field: bytes left
+    ot_u8           shift;          // bits field: bit being sent
+    ot_u8           half;           // bits field: 0 off time, 1 on time
+    ot_u8*          cursor;
+    const ot_u16*   times;          // bit times {off0, on0, off1, on1}, or NULL for MCW
+    ot_u32          hold;           // power burst ticks left
+
+    Queue*          rxq;
+    ot_u8           rx_left;
+    ot_u8           wp[TMS3705_EXTRA_MAX];
+} tms3705_struct;
+
+tms3705_struct tms;
+
+
+/// Timing from the TMS3705 datasheet and the TI demo
+static const ot_u16 tms3705_pwm[4]    = { TMS3705_US(170), TMS3705_US(330),
+                                          TMS3705_US(480), TMS3705_US(520) };
+static const ot_u16 tms3705_ppm[4]    = { TMS3705_US(170), TMS3705_US(230),
+                                          TMS3705_US(170), TMS3705_US(350) };
+static const ot_u16 tms3705_initmc[2] = { TMS3705_US(100), TMS3705_US(350) };
+
+/// Wake-up sequence, from high.  If the field was left on, the TMS3705 is
+/// taken out of the charge phase first.  Otherwise only the last two (from
+/// low) are needed: t_wake (< 120 us) and t_init.
+static const ot_u16 tms3705_wake[5]   = { TMS3705_US(2000), TMS3705_US(50),
+                                          TMS3705_US(110000), TMS3705_US(50),
+                                          TMS3705_US(3000) };
+
+
+
+
+/** Waveform Generator <BR>
+  * ========================================================================<BR>
+  */
+void sub_seq(const ot_u16* seq, ot_u8 len) {
+/// All sequences start high
+    tms.seq     = seq;
+    tms.seq_len = len;
+    tms.level   = 0;
+}
+
+void sub_bits(ot_u8* data, ot_u8 bytes, const ot_u16* times) {
+    tms.cursor  = data;
+    tms.bytes   = bytes;
+    tms.shift   = 1;
+    tms.half    = 0;
+    tms.times   = times;
+}
+
+void sub_burst(ot_u16 ms) {
+    tms.hold = (ot_u32)ms * TMS3705_US(1000);
+}
+
+const ot_u16* sub_times() {
+/// Wake patterns are always PWM
+    if ((tms.pkt.cmd1 & TMS3705_CMD1_PPM) && (tms.pkt.mode != TMS3705_MODE_PE_WP)) {
+        return tms3705_ppm;
+    }
+    return tms3705_pwm;
+}
+
+
+ot_bool sub_nextfield() {
+/// Sets up the field after the one in tms.state, which may be empty
+    ot_u8 mode = tms.pkt.mode;
+
+    switch (tms.state++) {
+        case TMS_WAKE:      tms.mcw = TMS3705_MCW;
+                            sub_bits(&tms.mcw, 1, NULL);
+                            break;
+
+        case TMS_MCW:       sub_burst(tms.pkt.pb1);
+                            break;
+
+        case TMS_PB1:       if ((mode == TMS3705_MODE_PE_WP) || (mode == TMS3705_MODE_BBUP)) {
+                                sub_bits(tms.pkt.extra, tms.pkt.extra_bytes, sub_times());
+                            }
+                            break;
+
+        case TMS_EXTRA:     if (mode == TMS3705_MODE_PE_WP) {
+                                sub_seq(tms3705_pwm, 2);        // stop bit: PWM 0
+                            }
+                            else if (mode == TMS3705_MODE_BBUP) {
+                                sub_burst(tms.pkt.pb4);
+                            }
+                            break;
+
+        case TMS_EXTRAEND:  if (mode == TMS3705_MODE_PE_NOWP26) {
+                                sub_seq(tms3705_initmc, 2);
+                            }
+                            break;
+
+        case TMS_INITMC:    if ((mode == TMS3705_MODE_PE_WP) || (mode == TMS3705_MODE_BBUP) \
+                            || (mode == TMS3705_MODE_PE_NOWP26)) {
+                                sub_burst(tms.pkt.pb3);
+                            }
+                            break;
+
+        case TMS_PB3:       sub_bits(tms.pkt.data, tms.pkt.tx_bytes, sub_times());
+                            break;
+
+        case TMS_DATA:      if (tms.pkt.cmd1 & TMS3705_CMD1_PPM) {
+                                sub_seq(tms3705_ppm, 1);        // off time before PB2
+                            }
+                            sub_burst(tms.pkt.pb2);
+                            break;
+
+        default:            return False;
+    }
+    return True;
+}
+
+
+ot_u16 sub_segment() {
+/// Returns the ticks of the next segment and puts its level in tms.level, or
+/// returns 0 when the message is all sent.
+    ot_u16  units;
+    ot_u8   bit;
+
+    do {
+        if (tms.seq_len != 0) {
+            tms.seq_len--;
+            tms.level ^= 1;
+            return *tms.seq++;
+        }
+        if (tms.bytes != 0) {
+            bit = ((*tms.cursor & tms.shift) != 0);
+            if (tms.times == NULL) {
+                tms.level   = bit;
+                units       = TMS3705_US(128);
+                tms.half    = 1;
+            }
+            else {
+                tms.level   = tms.half ^ 1;
+                units       = tms.times[(bit << 1) + tms.half];
+            }
+            tms.half ^= 1;
+            if (tms.half == 0) {
+                tms.shift <<= 1;
+                if (tms.shift == 0) {
+                    tms.shift = 1;
+                    tms.cursor++;
+                    tms.bytes--;
+                }
+            }
+            return units;
+        }
+        if (tms.hold != 0) {
+            units       = (tms.hold > TMS3705_SEGMAX) ? TMS3705_SEGMAX : (ot_u16)tms.hold;
+            tms.hold   -= units;
+            tms.level   = 0;
+            return units;
+        }
+    } while (sub_nextfield());
+
+    return 0;
+}
+
+
+void sub_loadnext() {
+/// Loads the segment after the one that just started.  After the last one,
+/// the tail holds TXCT at its idle level: it is the RX timeout if there is a
+/// response, else it is only there to apply the level.
+    ot_u16 units;
+
+    units = sub_segment();
+    if (units == 0) {
+        tms.state       = TMS_TAIL;
+        tms.field_on    = (tms.pkt.cmd2 & TMS3705_CMD2_KEEPTXON) != 0;
+        tms.level       = (tms.field_on == False);
+        units           = (tms.rx_left != 0) ? TMS3705_RXUNITS : TMS3705_US(100);
+    }
+    PALFI_TIM->CCR0     = units - 1;
+    PALFI_TIM->CCTL1    = TIMA_IT_CC | ((tms.level) ? TIMA_CCOutput_Mode_Set : \
+                                                      TIMA_CCOutput_Mode_Reset);
+}
+
+
+void sub_stop() {
+/// TXCT is frozen at its level in output mode 0 before the timer stops
+    PALFI_UART->IE      = 0;
+    PALFI_UART->CTL1   |= UCSWRST;
+    PALFI_TIM->CCTL1    = TIMA_CCOutput_Mode_OUT | ((tms.field_on) ? 0 : TIMA_FLG_CC_OUT);
+    PALFI_TIM->CTL      = TIMA_Ctl_Clock_SMCLK | TMS3705_TIMID | TIMA_Ctl_Mode_Stop;
+    tms.state           = TMS_IDLE;
+}
+
+
+void sub_finish(ot_int code) {
+    sub_stop();
+    tms.code = code;
+
+#   if ((TMS3705_EXTEVENT != 0) && (OT_FEATURE(EXTERNAL_EVENT) == ENABLED))
+    sys.evt.EXT.event_no    = TMS3705_EXTEVENT;
+    sys.evt.EXT.nextevent   = 0;
+    platform_ot_preempt();
+#   endif
+}
+
+
+
+
+/** Platform ISRs <BR>
+  * ========================================================================<BR>
+  * The timer ISR is the CCR1-6 & overflow vector.  Only CCR1 is used.  The
+  * MCU is only woken from LPM when the exchange is done.
+  */
+#if (CC_SUPPORT == CL430)
+#	pragma vector=PALFI_TIMER_VECTOR
+#elif (CC_SUPPORT == GCC)
+    OT_IRQPRAGMA(PALFI_TIMER_VECTOR)
+#elif (CC_SUPPORT == IAR_V5)
+#else
+#   error "A known compiler has not been defined"
+#endif
+OT_INTERRUPT void tms3705_timer_isr(void) {
+    if (PALFI_TIM->IV == 2) {
+        if (tms.state == TMS_RX) {
+            sub_finish(TMS3705_ERR_TIMEOUT);
+        }
+        else if (tms.state != TMS_TAIL) {
+            sub_loadnext();
+        }
+        else if (tms.rx_left == 0) {
+            sub_finish(TMS3705_OK);
+        }
+        else {
+            tms.state               = TMS_RX;
+            PALFI_UART->CTL1       &= ~UCSWRST;
+            PALFI_UART->IFG         = 0;
+            PALFI_UART->IE          = UCRXIE;
+        }
+
+        if (tms.state == TMS_IDLE) {
+            LPM4_EXIT;
+        }
+    }
+}
+
+
+#if (CC_SUPPORT == CL430)
+#	pragma vector=PALFI_UART_VECTOR
+#elif (CC_SUPPORT == GCC)
+    OT_IRQPRAGMA(PALFI_UART_VECTOR)
+#elif (CC_SUPPORT == IAR_V5)
+#else
+#   error "A known compiler has not been defined"
+#endif
+OT_INTERRUPT void tms3705_uart_isr(void) {
+/// Each byte restarts the timeout
+    ot_u8 byte = PALFI_UART->RXBUF;
+
+    if (tms.state == TMS_RX) {
+        PALFI_TIM->CTL |= TIMA_FLG_TACLR;
+        if (tms.rxq != NULL) {
+            q_writebyte(tms.rxq, byte);
+        }
+        if (--tms.rx_left == 0) {
+            sub_finish(TMS3705_OK);
+            LPM4_EXIT;
+        }
+    }
+}
+
+
+
+
+/** Public Functions <BR>
+  * ========================================================================<BR>
+  */
+#ifndef EXTF_tms3705_init
+void tms3705_init() {
+    tms.state       = TMS_IDLE;
+    tms.code        = TMS3705_OK;
+    tms.field_on    = False;
+
+    /// TXCT from timer output 1, SCIO to UART RX
+    PM->PWD         = 0x2D52;
+    PALFI_TXCT_MAP  = PALFI_TIMOC_MAP;
+    PALFI_SCIO_MAP  = PALFI_UARTRX_MAP;
+    PM->PWD         = 0;
+    PALFI_PORT->DDIR   |= PALFI_TXCT_PIN;
+    PALFI_PORT->DDIR   &= ~PALFI_SCIO_PIN;
+    PALFI_PORT->SEL    |= PALFI_PINS;
+
+    /// Timer stopped, TXCT high
+    PALFI_TIM->CTL      = TIMA_Ctl_Clock_SMCLK | TMS3705_TIMID | TIMA_FLG_TACLR;
+    PALFI_TIM->EX0      = TMS3705_TIMEX;
+    PALFI_TIM->CCTL1    = TIMA_CCOutput_Mode_OUT | TIMA_FLG_CC_OUT;
+    PALFI_TIM->CCR1     = 0;
+
+    /// UART RX 8N1 at 15625 bps, held in reset until a response is due
+    PALFI_UART->CTL1    = UCSSEL_2 | UCSWRST;
+    PALFI_UART->CTL0    = 0;
+    PALFI_UART->BR0     = (ot_u8)TMS3705_BRW;
+    PALFI_UART->BR1     = (ot_u8)(TMS3705_BRW >> 8);
+    PALFI_UART->MCTL    = 0;
+    PALFI_UART->IE      = 0;
+}
+#endif
+
+
+
+#ifndef EXTF_tms3705_load
+ot_int tms3705_load(Queue* msg) {
+/// The select bits give the mode: 0 IMMO, 1 PE_WP, 2 PE_noWP (22 or 26), and
+/// 3 BBUP.  Bit counts in the message are rounded down to bytes.
+    ot_u8*  start;
+    ot_u8   select;
+
+    if (tms.state != TMS_IDLE) {
+        return TMS3705_ERR_PARAM;
+    }
+
+    start           = msg->getcursor;
+    tms.pkt.cmd1    = q_readbyte(msg);
+    tms.pkt.cmd2    = (tms.pkt.cmd1 & TMS3705_CMD1_EXT) ? q_readbyte(msg) : 0;
+    select          = (tms.pkt.cmd1 & TMS3705_CMD1_SELECT) >> 4;
+    tms.pkt.mode    = select;
+    if (select == 2) {
+        tms.pkt.mode = (tms.pkt.cmd1 & TMS3705_CMD1_X26) ? \
+                        TMS3705_MODE_PE_NOWP26 : TMS3705_MODE_PE_NOWP22;
+    }
+    else if (select == 3) {
+        tms.pkt.mode = TMS3705_MODE_BBUP;
+    }
+
+#   define _READ_PB()   ((tms.pkt.cmd1 & TMS3705_CMD1_2BPB) ? q_readshort(msg) : q_readbyte(msg))
+
+    tms.pkt.pb1         = _READ_PB();
+    tms.pkt.pb3         = 0;
+    tms.pkt.pb4         = 0;
+    tms.pkt.extra_bytes = 0;
+    if ((tms.pkt.mode == TMS3705_MODE_PE_WP) || (tms.pkt.mode == TMS3705_MODE_BBUP)) {
+        tms.pkt.extra_bytes = q_readbyte(msg) >> 3;
+        tms.pkt.extra       = q_markbyte(msg, tms.pkt.extra_bytes);
+        if (tms.pkt.mode == TMS3705_MODE_BBUP) {
+            tms.pkt.pb4 = _READ_PB();
+        }
+    }
+    if ((tms.pkt.mode != TMS3705_MODE_IMMO) && (tms.pkt.mode != TMS3705_MODE_PE_NOWP22)) {
+        tms.pkt.pb3 = _READ_PB();
+    }
+    tms.pkt.tx_bytes    = q_readbyte(msg) >> 3;
+    tms.pkt.data        = q_markbyte(msg, tms.pkt.tx_bytes);
+    tms.pkt.pb2         = _READ_PB();
+    tms.pkt.rx_bytes    = q_readbyte(msg);
+
+#   undef _READ_PB
+
+    /// The response is not read when the field is kept on
+    if (tms.pkt.cmd2 & TMS3705_CMD2_KEEPTXON) {
+        tms.pkt.rx_bytes = 0;
+    }
+
+    return (ot_int)(msg->getcursor - start);
+}
+#endif
+
+
+
+#ifndef EXTF_tms3705_loadwake
+ot_int tms3705_loadwake(ot_u8* wp, ot_u8 wp_bytes, ot_u16 charge_ms) {
+    if ((tms.state != TMS_IDLE) || (wp_bytes > TMS3705_EXTRA_MAX)) {
+        return TMS3705_ERR_PARAM;
+    }
+    platform_memcpy(tms.wp, wp, wp_bytes);
+
+    tms.pkt.mode        = TMS3705_MODE_PE_WP;
+    tms.pkt.cmd1        = (TMS3705_MODE_PE_WP << 4);
+    tms.pkt.cmd2        = 0;
+    tms.pkt.pb1         = charge_ms;
+    tms.pkt.pb2         = 0;
+    tms.pkt.pb3         = 0;
+    tms.pkt.pb4         = 0;
+    tms.pkt.extra       = tms.wp;
+    tms.pkt.extra_bytes = wp_bytes;
+    tms.pkt.tx_bytes    = 0;
+    tms.pkt.rx_bytes    = 0;
+    return 0;
+}
+#endif
+
+
+
+#ifndef EXTF_tms3705_start
+ot_int tms3705_start(Queue* rxq) {
+/// The first segment is put on TXCT now, and the second one is loaded behind
+/// it before the timer starts.
+    ot_u16 units;
+
+    if (tms.state != TMS_IDLE) {
+        return TMS3705_BUSY;
+    }
+    tms.code    = TMS3705_BUSY;
+    tms.rxq     = rxq;
+    tms.rx_left = tms.pkt.rx_bytes;
+    tms.state   = TMS_WAKE;
+    tms.bytes   = 0;
+    tms.hold    = 0;
+    if (tms.field_on) {
+        sub_seq(tms3705_wake, 5);
+    }
+    else {
+        sub_seq(&tms3705_wake[3], 2);
+        tms.level = 1;
+    }
+
+    units               = sub_segment();
+    PALFI_TIM->CTL      = TIMA_Ctl_Clock_SMCLK | TMS3705_TIMID | TIMA_FLG_TACLR;
+    PALFI_TIM->EX0      = TMS3705_TIMEX;
+    PALFI_TIM->CCTL0    = 0;
+    PALFI_TIM->CCR0     = units - 1;
+    PALFI_TIM->CCTL0    = TMS3705_CLLD_ZERO;
+    PALFI_TIM->CCTL1    = TIMA_CCOutput_Mode_OUT | ((tms.level) ? TIMA_FLG_CC_OUT : 0);
+    PALFI_TIM->CCR1     = 0;
+    sub_loadnext();
+    PALFI_TIM->CTL     |= TIMA_Ctl_Mode_Up;
+
+    return 0;
+}
+#endif
+
+
+
+#ifndef EXTF_tms3705_kill
+void tms3705_kill() {
+    platform_disable_interrupts();
+    tms.field_on = False;
+    sub_stop();
+    if (tms.code == TMS3705_BUSY) {
+        tms.code = TMS3705_ERR_KILLED;
+    }
+    platform_enable_interrupts();
+}
+#endif
+
+
+
+#ifndef EXTF_tms3705_status
+ot_int tms3705_status() {
+    return tms.code;
+}
+#endif
+
+
+#endif
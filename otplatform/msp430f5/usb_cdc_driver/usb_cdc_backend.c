@@ -49,7 +49,7 @@ _CdcReadCtrl    CdcReadCtrl[CDC_NUM_INTERFACES];
 #   define USBCDC_HANDLE_RXCOMPLETE(INTFNUM)    0
 #endif
 
-#if (USBEVT_MASK & USBEVT_TXCOMPLETE)
+#if (USBEVT_MASK & USBEVT_RXBUFFERED)
 #   define USBCDC_HANDLE_RXBUFFERED(INTFNUM)    USBCDC_handleDataReceived(INTFNUM)
 #else
 #   define USBCDC_HANDLE_RXBUFFERED(INTFNUM)    0
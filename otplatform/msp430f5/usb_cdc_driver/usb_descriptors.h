@@ -48,7 +48,7 @@
                              USBEVT_RESET         | \
                             /* USBEVT_SUSPEND      | */\
                             /* USBEVT_RESUME       | */\
-                            /* USBEVT_RXBUFFERED   | */ \
+                             USBEVT_RXBUFFERED   | \
                              USBEVT_TXCOMPLETE   | \
                              USBEVT_RXCOMPLETE   | \
                              0 )
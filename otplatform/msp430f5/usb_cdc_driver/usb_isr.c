@@ -108,7 +108,14 @@ __interrupt VOID iUsbInterruptHandler(VOID) {
 
         case USBVECINT_OUTPUT_ENDPOINT1: break;
 
-        case USBVECINT_OUTPUT_ENDPOINT2: bWakeUp = CdcToBufferFromHost(CDC0_INTFNUM);
+        case USBVECINT_OUTPUT_ENDPOINT2: if (CdcIsReceiveInProgress(CDC0_INTFNUM)) {
+                                            bWakeUp = CdcToBufferFromHost(CDC0_INTFNUM);
+                                        }
+#                                       if (USBEVT_MASK & USBEVT_RXBUFFERED)
+                                        else {
+                                            bWakeUp = USBCDC_handleDataReceived(CDC0_INTFNUM);
+                                        }
+#                                       endif
             						    break;
             
         case USBVECINT_OUTPUT_ENDPOINT3: break;
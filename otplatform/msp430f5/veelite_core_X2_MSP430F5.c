@@ -59,6 +59,7 @@
 #include "OT_platform.h"
 #include "OTAPI.h"              // for logging faults
 #include "veelite_core.h"
+#include "crc16.h"
 
 #ifndef OT_FEATURE_VLNVWRITE
 #   define OT_FEATURE_VLNVWRITE ENABLED
@@ -73,6 +74,7 @@
 /// Name conversion (nothing special)
 #define NAND_erase_page(page_addr)      (ot_u8)FLASH_EraseSegment(page_addr)
 #define NAND_write_short(addr, data)    (ot_u8)FLASH_WriteShort(addr, data)
+#define NAND_write_block(addr, data, words)  (ot_u8)FLASH_WriteShortBlock(addr, data, words)
 
 
 /// Set Segmentation Fault (code 11) if trying to access an invalid virtual
@@ -131,6 +133,13 @@
 #define PTR_OFFSET(PTR_BASE, OFFSET)    (ot_u16*)(((ot_u8*)PTR_BASE) + OFFSET)
 
 
+/// Flash activity counters
+vworm_stats_struct vworm_stats;
+
+/// Changes whenever a pointer from vworm_get_direct() may have gone stale
+ot_u16 vworm_mapstamp;
+
+
 /// VSRAM (Mirror) memory buffer
 #if (VSRAM_SIZE > 0)
     ot_u16 vsram[ (VSRAM_SIZE/2) ];
@@ -192,15 +201,116 @@ typedef struct {
   * rotate through the table.  The table also stores a series of "fallow" blocks
   * that are reserved for the wear-leveling block rotation process.  Using a
   * larger number of fallows improves performance but increases ROM overhead.
+  * wear[] is the erase count of each physical page (it stops at 0xFFFF).  It
+  * is saved with the rest of the table, and the least worn fallow is always
+  * the next one used.
   */
 typedef struct {
     block_ptr   block[VWORM_PRIMARY_PAGES];
     ot_u16*     fallow[VWORM_FALLOW_PAGES];
+    ot_u16      wear[VWORM_NUM_PAGES];
 } X2_struct;
 
 
 X2_struct X2table;
 
+#define X2_PAGE(PTR)    ((ot_uint)((ot_u8*)(PTR) - (ot_u8*)VWORM_BASE_PHYSICAL) >> VWORM_PAGESHIFT)
+
+
+/** @typedef X2age_struct
+  * The last write to each block, by a clock that ticks on each write that goes
+  * to flash.  When the fallows run low, the block written least recently is
+  * recombined, so a block that is written often keeps its ancillary.  This is
+  * only kept in SRAM: after a boot, all blocks are the same age.
+  */
+typedef struct {
+    ot_u16  clock;
+    ot_u16  stamp[VWORM_PRIMARY_PAGES];
+} X2age_struct;
+
+X2age_struct X2age;
+
+#define X2_STAMP(BLOCK) (X2age.stamp[(BLOCK) - X2table.block] = ++X2age.clock)
+
+
+/** @typedef X2cache_struct
+  * The write-back page cache.  Each entry holds the logical contents of one
+  * virtual page.  vpage is the page index + 1, so a zeroed entry is free.
+  * Age is used for LRU eviction.
+  */
+#if (VWORM_CACHE_PAGES > 0)
+typedef struct {
+    ot_int  vpage;
+    ot_u16  age;
+    ot_u16  data[VWORM_PAGESIZE/2];
+} X2cache_page;
+
+typedef struct {
+    X2cache_page    page[VWORM_CACHE_PAGES];
+    ot_u16          clock;
+} X2cache_struct;
+
+X2cache_struct X2cache;
+#endif
+
+
+/** @typedef X2pending_struct
+  * Deferred writes.  Outside of an erase window (see vworm_window()), a write
+  * that would erase flash is held here instead, one entry per address.  The
+  * writes are applied in the next window or when the list is full.
+  */
+#if (VWORM_DEFER_WRITES > 0)
+typedef struct {
+    vaddr   addr;
+    ot_u16  data;
+} X2write;
+
+typedef struct {
+    ot_bool window;
+    ot_int  count;
+    X2write entry[VWORM_DEFER_WRITES];
+} X2pending_struct;
+
+X2pending_struct X2pending;
+
+#   define X2_ERASE_OK()    (X2pending.window != False)
+#else
+#   define X2_ERASE_OK()    True
+#endif
+
+
+/** @typedef X2snapshot_struct
+  * Boot snapshot state (OT_FEATURE(VLSNAPSHOT)).  The snapshot is on the last
+  * physical page: the block table, the generation, the length of the spans
+  * from vworm_save_snapshot() and the spans, and then a CRC16 of all that.
+  * The page is always a fallow, so while it holds a snapshot (valid or not)
+  * it is erased before the next fallow is taken.  Once loaded, or once VWORM
+  * is written, the snapshot is voided by programming its generation to 0,
+  * which is never saved, so a later boot does not restore it.
+  */
+#if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+#   define X2SNAP_NONE      0       // page is erased
+#   define X2SNAP_VALID     1       // page holds a snapshot not yet loaded
+#   define X2SNAP_STALE     2       // page must be erased before use
+
+#   define X2_SNAPSHOT_PAGE     ((ot_u16*)(VWORM_BASE_PHYSICAL + (VWORM_PAGESIZE*(VWORM_NUM_PAGES-1))))
+#   define X2_TABLE_WORDS       (sizeof(X2_struct)/2)
+#   define X2_SNAPSHOT_BYTES    (VWORM_PAGESIZE - (2*(X2_TABLE_WORDS+3)))
+
+typedef struct {
+    ot_u8   state;
+    ot_u16  generation;
+} X2snapshot_struct;
+
+X2snapshot_struct X2snap;
+
+#   define X2_SNAPSHOT_CLEAR()  if (X2snap.state != X2SNAP_NONE) sub_snapshot_erase()
+#   define X2_SNAPSHOT_VOID()   if (X2snap.state == X2SNAP_VALID) sub_snapshot_void()
+#else
+#   define X2_SNAPSHOT_CLEAR()  while(0)
+#   define X2_SNAPSHOT_VOID()   while(0)
+#endif
+
 
 /** Local Subroutine Prototypes <BR>
   * ========================================================================<BR>
@@ -220,6 +330,82 @@ ot_u16* sub_recombine_block(block_ptr* block_in, ot_int skip, ot_int span);
   */
 void sub_attach_fallow(block_ptr* block_in);
 
+/** @brief Recombines the block whose ancillary was written least recently
+  * @retval none
+  */
+void sub_recombine_oldest();
+
+/** @brief Takes the least worn block out of the fallow table
+  * @retval ot_u16*     the fallow block
+  */
+ot_u16* sub_take_fallow();
+
+/** @brief Puts an erased block into the fallow table
+  * @param page         (ot_u16*) the erased block
+  * @retval none
+  */
+void sub_put_fallow(ot_u16* page);
+
+/** @brief Erases a block and adds the erase to its wear
+  * @param page         (ot_u16*) the block to erase
+  * @retval ot_u8       Non-zero on memory fault
+  */
+ot_u8 sub_erase_page(ot_u16* page);
+
+
+/** @brief Writes a word to a block if no fallow or recombination is needed
+  * @param block_in     (block_ptr*) pointer to the block to write
+  * @param offset       (ot_int) byte offset into the page
+  * @param data         (ot_u16) data to write
+  * @param commit       (ot_bool) False to only test if the write is possible
+  * @retval ot_u8       0 on success, 255 if not possible in place, else fault
+  */
+ot_u8 sub_write_inplace(block_ptr* block_in, ot_int offset, ot_u16 data, ot_bool commit);
+
+/** @brief Programs a full page image into a fallow and retires the old block
+  * @param block_in     (block_ptr*) pointer to the block to rewrite
+  * @param data         (ot_u16*) page image, VWORM_PAGESIZE bytes
+  * @retval ot_u8       Non-zero on memory fault
+  */
+ot_u8 sub_rewrite_block(block_ptr* block_in, ot_u16* data);
+
+
+/** @brief Erases the snapshot page
+  * @retval none
+  */
+void sub_snapshot_erase();
+
+/** @brief Voids the snapshot on the page, without an erase
+  * @retval none
+  */
+void sub_snapshot_void();
+
+/** @brief Restores the block table from the snapshot page, if the CRC is good
+  * @param s_ptr : (ot_u16*) snapshot page
+  * @retval ot_bool : True if the block table was restored
+  */
+ot_bool sub_snapshot_restore(ot_u16* s_ptr);
+
+/** @brief Returns True if a write to a block would cause an erase
+  * @param block_in     (block_ptr*) pointer to the block to write
+  * @param offset       (ot_int) byte offset into the page
+  * @param data         (ot_u16) data to write
+  * @retval ot_bool     True when the write needs a recombination
+  */
+ot_bool sub_write_erases(block_ptr* block_in, ot_int offset, ot_u16 data);
+
+#if (VWORM_DEFER_WRITES > 0)
+X2write* sub_pending_find(vaddr addr);
+void sub_pending_merge(ot_int index, ot_u16* page_data);
+#endif
+
+#if (VWORM_CACHE_PAGES > 0)
+ot_u16* sub_cache_get(ot_int index);
+ot_bool sub_cache_hasfree();
+ot_u16* sub_cache_load(ot_int index);
+ot_u8   sub_cache_flush(X2cache_page* page);
+#endif
+
 #endif
 #endif
 
@@ -288,14 +474,18 @@ ot_u8 vworm_format( ) {
 
     /// 2. Format all Blocks, Put Block IDs into Primary Blocks
     for (i=0; i<VWORM_PRIMARY_PAGES; i++) {
-        output |= NAND_erase_page(cursor);
+        output |= sub_erase_page(cursor);
         cursor  = PTR_OFFSET(cursor, VWORM_PAGESIZE);
     }
     for (i=0; i<VWORM_FALLOW_PAGES; i++) {
-        output |= NAND_erase_page(cursor);
+        output |= sub_erase_page(cursor);
         cursor  = PTR_OFFSET(cursor, VWORM_PAGESIZE);
     }
 
+#   if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+    X2snap.state = X2SNAP_NONE;
+#   endif
+
     return output;
 #else
     return 0;
@@ -331,6 +521,15 @@ ot_u8 vworm_init( ) {
 
     s_ptr = (ot_u16*)(VWORM_BASE_PHYSICAL + (VWORM_PAGESIZE*(VWORM_NUM_PAGES-1)));
 
+#   if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+    /// 1. Restore the lookup table from the snapshot of the last clean
+    ///    shutdown, if there is one and its CRC is good.  The snapshot page
+    ///    is erased later, before it is used as a fallow.
+    X2snap.state = X2SNAP_NONE;
+    if ((*s_ptr != 0xFFFF) && sub_snapshot_restore(s_ptr)) {
+        test = 0;
+    }
+#   else
     /// 1. If the last block starts with FFFF, assume that a format just
     ///    happened, in which case we can ignore doing anything.
     if (*s_ptr != 0xFFFF) {
@@ -345,8 +544,9 @@ ot_u8 vworm_init( ) {
         }
 
         /// 3. Erase the last page, which is once again a fallow block
-        test = NAND_erase_page( s_ptr );
+        test = sub_erase_page( s_ptr );
     }
+#   endif
 
     /// Load the lookup table with initial values
     else {
@@ -374,6 +574,49 @@ ot_u8 vworm_init( ) {
 
 
 
+#ifndef EXTF_vworm_factory
+#if (OT_FEATURE(VLFACTORY) == ENABLED)
+ot_u8 vworm_factory( ) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE(VLNVWRITE) == ENABLED))
+    ot_u16* cursor;
+    ot_u16* image;
+    ot_uint words;
+    ot_u8   test;
+
+    if (vworm_factory_words > (VWORM_PRIMARY_PAGES * (VWORM_PAGESIZE/2))) {
+        return MEM_VWORM_FAULT;
+    }
+
+    /// 1. Erase all the pages, and take the block table of a fresh format
+    test    = vworm_format();
+    test   |= vworm_init();
+
+    /// 2. Program the image into the primary pages, one burst per page
+    cursor  = (ot_u16*)(OTF_VWORM_START_ADDR);
+    image   = (ot_u16*)vworm_factory_image;
+    for (words=vworm_factory_words; words!=0; ) {
+        ot_uint span = (words > (VWORM_PAGESIZE/2)) ? (VWORM_PAGESIZE/2) : words;
+        test   |= NAND_write_block(cursor, image, span);
+        cursor += span;
+        image  += span;
+        words  -= span;
+    }
+
+    /// 3. The pages must match the image
+    if (crc_calc_block((ot_int)(vworm_factory_words*2), (ot_u8*)(OTF_VWORM_START_ADDR)) \
+        != vworm_factory_crc) {
+        test |= MEM_VWORM_FAULT;
+    }
+    return test;
+#else
+    return 255;
+#endif
+}
+#endif
+#endif
+
+
+
 #ifndef EXTF_vworm_print_table
 void vworm_print_table() {
 #ifdef DEBUG_ON
@@ -396,7 +639,79 @@ void vworm_print_table() {
 
 
 
+ot_u8 vworm_flush( ) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE_VLNVWRITE == ENABLED))
+    ot_u8   test = 0;
+    ot_int  i;
+
+    /// 1. Apply deferred writes, with erases allowed while doing so
+#   if (VWORM_DEFER_WRITES > 0)
+    X2write work[VWORM_DEFER_WRITES];
+    ot_bool window  = X2pending.window;
+    ot_int  count   = X2pending.count;
+
+    for (i=0; i<count; i++) {
+        work[i] = X2pending.entry[i];
+    }
+    X2pending.count     = 0;
+    X2pending.window    = True;
+    for (i=0; i<count; i++) {
+        test |= vworm_write(work[i].addr, work[i].data);
+    }
+#   endif
+
+    /// 2. Write back cached pages
+#   if (VWORM_CACHE_PAGES > 0)
+    for (i=0; i<VWORM_CACHE_PAGES; i++) {
+        if (X2cache.page[i].vpage != 0) {
+            test |= sub_cache_flush(&X2cache.page[i]);
+        }
+    }
+#   endif
+
+#   if (VWORM_DEFER_WRITES > 0)
+    X2pending.window    = window;
+#   endif
+    return test;
+#else
+    return 0;
+#endif
+}
+
+
+
+ot_u8 vworm_window(ot_bool open) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE_VLNVWRITE == ENABLED))
+    ot_u8 test = 0;
+
+#   if (VWORM_DEFER_WRITES > 0)
+    X2pending.window = open;
+#   endif
+
+    if (open) {
+        /// 1. Catch up on everything that was held back
+        test = vworm_flush();
+
+        /// 2. If only one fallow is left, the next write that needs a fallow
+        ///    would have to recombine first.  Do that now instead.
+        if (X2table.fallow[(VWORM_FALLOW_PAGES-2)] == NULL) {
+            sub_recombine_oldest();
+        }
+    }
+    return test;
+#else
+    return 0;
+#endif
+}
+
+
+
 #ifndef EXTF_vworm_save
+#if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+ot_u8 vworm_save( ) {
+    return vworm_save_snapshot(NULL, 0);
+}
+#else
 ot_u8 vworm_save( ) {
 #if ((VWORM_SIZE > 0) && (OT_FEATURE_VLNVWRITE == ENABLED))
     /// @note init & save processes have not been tested enough.
@@ -409,6 +724,9 @@ ot_u8 vworm_save( ) {
     ot_u16* s_ptr   = (ot_u16*)(VWORM_BASE_PHYSICAL + \
                         (VWORM_PAGESIZE*(VWORM_PRIMARY_PAGES+VWORM_FALLOW_PAGES-1)));
 
+    /// 0.  Write back deferred and cached data before saving the table
+    test = vworm_flush();
+
     /// 1.  look through used blocks to see if the last physical block is
     ///     somewhere inside.  In this case, we need to recombine it.
     for (i=0; i<VWORM_PRIMARY_PAGES; i++) {
@@ -445,6 +763,112 @@ ot_u8 vworm_save( ) {
 #endif
 
 
+#if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+ot_u8 vworm_save_snapshot(const vworm_span* span, ot_int spans) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE_VLNVWRITE == ENABLED))
+    ot_u8       test;
+    ot_int      i;
+    ot_int      n;
+    ot_uint     ext;
+    ot_u16*     s_ptr;
+    Twobytes    word;
+
+    /// 0.  Write back deferred and cached data, and erase the old snapshot
+    test = vworm_flush();
+    if (X2snap.state != X2SNAP_NONE) {
+        sub_snapshot_erase();
+    }
+
+    /// 1.  If the last physical block is in use, recombine it, which puts it
+    ///     in the list of fallows like the rest of the saved table expects.
+    s_ptr = X2_SNAPSHOT_PAGE;
+    for (i=0; i<VWORM_PRIMARY_PAGES; i++) {
+        if ( (X2table.block[i].primary == s_ptr) || (X2table.block[i].ancillary == s_ptr) ) {
+            sub_recombine_block(&X2table.block[i], 0, 0);
+            break;
+        }
+    }
+
+    /// 2.  Write the table, the generation, and the spans if they fit
+    for (i=0, ext=0; i<spans; i++) {
+        ext += span[i].length;
+    }
+    if (ext > X2_SNAPSHOT_BYTES) {
+        ext     = 0;
+        spans   = 0;
+    }
+    
+    for (i=0; i<X2_TABLE_WORDS; i++) {
+        test |= vworm_mark_physical(s_ptr++, ((ot_u16*)&X2table)[i]);
+    }
+    if (++X2snap.generation == 0) {
+        X2snap.generation = 1;
+    }
+    test |= vworm_mark_physical(s_ptr++, X2snap.generation);
+    test |= vworm_mark_physical(s_ptr++, (ot_u16)ext);
+
+    for (n=0; spans>0; spans--, span++) {
+        ot_u8* data = (ot_u8*)span->data;
+        for (i=0; i<span->length; i++) {
+            word.ubyte[n]   = data[i];
+            n              ^= 1;
+            if (n == 0) {
+                test |= vworm_mark_physical(s_ptr++, word.ushort);
+            }
+        }
+    }
+    if (n != 0) {
+        word.ubyte[1]   = 0xFF;
+        test           |= vworm_mark_physical(s_ptr++, word.ushort);
+    }
+
+    /// 3.  The CRC goes last, so a snapshot cut short fails the check
+    n       = (ot_int)((ot_u8*)s_ptr - (ot_u8*)X2_SNAPSHOT_PAGE);
+    test   |= vworm_mark_physical(s_ptr, crc_calc_block(n, (ot_u8*)X2_SNAPSHOT_PAGE));
+
+    X2snap.state = X2SNAP_VALID;
+    return test;
+#else
+    return 0;
+#endif
+}
+
+
+
+ot_u8 vworm_load_snapshot(const vworm_span* span, ot_int spans) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE_VLNVWRITE == ENABLED))
+    ot_u8*  s_ptr;
+    ot_uint ext;
+    ot_int  i;
+
+    if (X2snap.state != X2SNAP_VALID) {
+        return 1;
+    }
+    sub_snapshot_void();
+
+    for (i=0, ext=0; i<spans; i++) {
+        ext += span[i].length;
+    }
+    s_ptr = (ot_u8*)&X2_SNAPSHOT_PAGE[X2_TABLE_WORDS+1];
+    if ((spans == 0) || (ext != *(ot_u16*)s_ptr)) {
+        return 1;
+    }
+    
+    s_ptr += 2;
+    for (i=0; i<spans; i++) {
+        platform_memcpy((ot_u8*)span[i].data, s_ptr, span[i].length);
+        s_ptr += span[i].length;
+    }
+    return 0;
+#else
+    return 1;
+#endif
+}
+#endif
+
+#endif
+
+
 
 #ifndef EXTF_vworm_read
 ot_u16 vworm_read(vaddr addr) {
@@ -461,6 +885,24 @@ ot_u16 vworm_read(vaddr addr) {
     index   = (addr-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT;
     p_ptr   = PTR_OFFSET(X2table.block[index].primary, offset);
 
+    #   if (VWORM_CACHE_PAGES > 0)
+    /// 1b. A cached page has the current data
+    {   ot_u16* c_ptr = sub_cache_get(index);
+        if (c_ptr != NULL) {
+            return *PTR_OFFSET(c_ptr, offset);
+        }
+    }
+#   endif
+
+#   if (VWORM_DEFER_WRITES > 0)
+    /// 1c. A deferred write has the current data
+    {   X2write* pending = sub_pending_find(addr);
+        if (pending != NULL) {
+            return pending->data;
+        }
+    }
+#   endif
+
     /// 2. return either the primary pointer in full or the XNOR
     if (X2table.block[index].ancillary == NULL) {
         return *p_ptr;
@@ -492,11 +934,55 @@ ot_u8 vworm_write(vaddr addr, ot_u16 data) {
 
     SEGFAULT_CHECK(addr, in_vworm, 7, "VLC_493");   //__LINE__
 
+    /// 0.  A snapshot saved before this write is out of date
+    X2_SNAPSHOT_VOID();
+
     /// 1.  Resolve the vaddr directly
     offset  = addr & (VWORM_PAGESIZE-1);
     index   = (addr-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT;
     p_ptr   = PTR_OFFSET(X2table.block[index].primary, offset);
 
+    #   if (VWORM_CACHE_PAGES > 0)
+    /// 1b. Writes to a cached page go to SRAM.  A write that would need a
+    ///     fallow or a recombination loads its page into the cache first, so
+    ///     following writes to the page coalesce into one flush.
+    {   ot_u16* c_ptr = sub_cache_get(index);
+        if ((c_ptr == NULL) && (X2_ERASE_OK() || sub_cache_hasfree()) && \
+            (sub_write_inplace(&X2table.block[index], offset, data, False) != 0)) {
+            c_ptr = sub_cache_load(index);
+        }
+        if (c_ptr != NULL) {
+            *PTR_OFFSET(c_ptr, offset) = data;
+            vworm_stats.cached++;
+            return 0;
+        }
+    }
+#   endif
+
+#   if (VWORM_DEFER_WRITES > 0)
+    /// 1c. Outside of an erase window, a write that would erase is deferred.
+    ///     A write to an address that is already deferred just updates it.
+    {   X2write* pending = sub_pending_find(addr);
+        if (pending == NULL) {
+            if ((X2pending.window == False) && \
+                (X2pending.count < VWORM_DEFER_WRITES) && \
+                sub_write_erases(&X2table.block[index], offset, data)) {
+                pending         = &X2pending.entry[X2pending.count++];
+                pending->addr   = addr;
+                vworm_stats.deferred++;
+                vworm_mapstamp++;
+            }
+        }
+        if (pending != NULL) {
+            pending->data = data;
+            return 0;
+        }
+    }
+#   endif
+
+    /// 1d. The block is written to flash, which makes it the newest
+    X2_STAMP(&X2table.block[index]);
+
     /// 2. No ancillary block, but try a write anyway
     if (X2table.block[index].ancillary == NULL) {
 
@@ -591,6 +1077,213 @@ ot_u8 vworm_wipeblock(vaddr addr, ot_uint wipe_span) {
 
 
 
+#ifndef EXTF_vworm_wear
+ot_u16 vworm_wear(ot_int page) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE(VLNVWRITE) == ENABLED))
+    if ((page < 0) || (page >= VWORM_NUM_PAGES)) {
+        return 0;
+    }
+    return X2table.wear[page];
+#else
+    return 0;
+#endif
+}
+#endif
+
+
+
+
+
+const ot_u8* vworm_get_direct(vaddr addr, ot_uint length) {
+#if (VWORM_SIZE > 0)
+    ot_int  index;
+    ot_int  last;
+    ot_u16* p_ptr;
+
+    SEGFAULT_CHECK(addr, in_vworm, 7, "VLC_G_D");
+
+    index   = (addr-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT;
+    last    = (length == 0) ? index : \
+                (((addr+length-1)-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT);
+    if (last >= VWORM_PRIMARY_PAGES) {
+        return NULL;
+    }
+    p_ptr   = X2table.block[index].primary;
+
+    /// The span is only directly readable if each of its pages is a bare
+    /// primary block holding the current data, and the primaries follow each
+    /// other in physical memory.
+    for (; index<=last; index++) {
+        if ((X2table.block[index].primary != p_ptr) || \
+            (X2table.block[index].ancillary != NULL)) {
+            return NULL;
+        }
+#       if (VWORM_CACHE_PAGES > 0)
+        if (sub_cache_get(index) != NULL) {
+            return NULL;
+        }
+#       endif
+#       if (VWORM_DEFER_WRITES > 0)
+        {   ot_int j;
+            for (j=0; j<X2pending.count; j++) {
+                if (((X2pending.entry[j].addr-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT) == index) {
+                    return NULL;
+                }
+            }
+        }
+#       endif
+        p_ptr = PTR_OFFSET(p_ptr, VWORM_PAGESIZE);
+    }
+
+    index = (addr-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT;
+    return (const ot_u8*)X2table.block[index].primary + (addr & (VWORM_PAGESIZE-1));
+#else
+    return NULL;
+#endif
+}
+
+
+
+
+
+ot_u8 vworm_read_block(vaddr addr, ot_u8* data, ot_uint length) {
+#if (VWORM_SIZE > 0)
+    ot_int  offset;
+    ot_int  index;
+    ot_uint span;
+    ot_u16* p_ptr;
+    ot_u16* a_ptr;
+
+    SEGFAULT_CHECK(addr, in_vworm, 7, "VLC_R_B");
+
+    /// Go page by page, because the physical pages are not contiguous
+    while (length != 0) {
+        offset  = addr & (VWORM_PAGESIZE-1);
+        index   = (addr-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT;
+        span    = VWORM_PAGESIZE - offset;
+        span    = (span > length) ? length : span;
+        p_ptr   = PTR_OFFSET(X2table.block[index].primary, offset);
+        a_ptr   = X2table.block[index].ancillary;
+
+#       if (VWORM_CACHE_PAGES > 0)
+        {   ot_u16* c_ptr = sub_cache_get(index);
+            if (c_ptr != NULL) {
+                p_ptr = PTR_OFFSET(c_ptr, offset);
+                a_ptr = NULL;
+            }
+        }
+#       endif
+
+        /// 1. No ancillary block (or cached): the page is the data
+        if (a_ptr == NULL) {
+            platform_memcpy(data, (ot_u8*)p_ptr, (ot_int)span);
+        }
+
+        /// 2. Ancillary block: XNOR the two pages word-wide
+        else {
+            Twobytes    scratch;
+            ot_uint     i;
+
+            a_ptr = PTR_OFFSET(a_ptr, offset);
+            for (i=0; i<span; i+=2) {
+                scratch.ushort  = ~(*p_ptr++ ^ *a_ptr++);
+                data[i]         = scratch.ubyte[0];
+                if ((i+1) < span) {
+                    data[i+1]   = scratch.ubyte[1];
+                }
+            }
+        }
+
+#       if (VWORM_DEFER_WRITES > 0)
+        /// 3. Patch in deferred writes that fall into this span
+        {   ot_int j;
+            for (j=0; j<X2pending.count; j++) {
+                ot_int off = (ot_int)X2pending.entry[j].addr - (ot_int)addr;
+                if ((off >= -1) && (off < (ot_int)span)) {
+                    Twobytes scratch;
+                    scratch.ushort  = X2pending.entry[j].data;
+                    if (off >= 0) {
+                        data[off]   = scratch.ubyte[0];
+                    }
+                    if ((off+1) < (ot_int)span) {
+                        data[off+1] = scratch.ubyte[1];
+                    }
+                }
+            }
+        }
+#       endif
+
+        addr   += span;
+        data   += span;
+        length -= span;
+    }
+
+    return 0;
+#else
+    return ~0;
+#endif
+}
+
+
+
+ot_u8 vworm_write_block(vaddr addr, ot_u8* data, ot_uint length) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE_VLNVWRITE == ENABLED))
+    Twobytes    scratch;
+    ot_u16      stored;
+    ot_u8       test = 0;
+
+    SEGFAULT_CHECK(addr, in_vworm, 7, "VLC_W_B");
+
+    for (; length != 0; addr+=2) {
+        stored              = vworm_read(addr);
+        scratch.ushort      = stored;
+        scratch.ubyte[0]    = *data++;
+        length--;
+        if (length != 0) {
+            scratch.ubyte[1] = *data++;
+            length--;
+        }
+        if (scratch.ushort != stored) {
+            test |= vworm_write(addr, scratch.ushort);
+        }
+    }
+
+    return test;
+#else
+    return 0;
+#endif
+}
+
+
+
+ot_u8 vworm_restore(vaddr addr, ot_uint length) {
+#if ((VWORM_SIZE > 0) && (OT_FEATURE(VLNVWRITE) == ENABLED) && (OT_FEATURE(VLFACTORY) == ENABLED))
+/// The stock data comes from the factory image, and past its end is erased.
+/// Only the words that differ are written.
+    ot_uint index;
+    ot_u8   test = 0;
+
+    SEGFAULT_CHECK(addr, in_vworm, 7, "VLC_RST");
+
+    index   = (ot_uint)(addr - VWORM_BASE_VADDR) >> 1;
+    length  = (length + 1) >> 1;
+    for (; length != 0; length--, addr+=2, index++) {
+        ot_u16 word = (index < vworm_factory_words) ? vworm_factory_image[index] : 0xFFFF;
+        if (vworm_read(addr) != word) {
+            test |= vworm_write(addr, word);
+        }
+    }
+    return test;
+#else
+/// The stock files are linked into VWORM itself, so no stock image is kept
+    return 255;
+#endif
+}
+
+
+
+
+
 /** VSRAM Functions <BR>
   * ========================================================================<BR>
   */
@@ -654,11 +1347,98 @@ ot_u8* vsram_get(vaddr addr) {
 
 
 
+ot_u8 vsram_read_block(vaddr addr, ot_u8* data, ot_uint length) {
+#if (VSRAM_SIZE <= 0)
+    return ~0;
+#else
+    SEGFAULT_CHECK(addr, in_vsram, 7, "VLC_R_B");
+    addr -= VSRAM_BASE_VADDR;
+    platform_memcpy(data, (ot_u8*)vsram + addr, (ot_int)length);
+    return 0;
+#endif
+}
+
+
+
+ot_u8 vsram_write_block(vaddr addr, ot_u8* data, ot_uint length) {
+#if (VSRAM_SIZE <= 0)
+    return ~0;
+#else
+    SEGFAULT_CHECK(addr, in_vsram, 7, "VLC_W_B");
+    addr -= VSRAM_BASE_VADDR;
+    platform_memcpy((ot_u8*)vsram + addr, data, (ot_int)length);
+    return 0;
+#endif
+}
+
+
+
+
+
+
+
 /** Subroutine Implementations <BR>
   * ========================================================================<BR>
   */
 
+#if ((VWORM_SIZE > 0) && (OT_FEATURE(VLNVWRITE) == ENABLED))
+ot_u8 sub_erase_page(ot_u16* page) {
+    ot_uint i = X2_PAGE(page);
+
+    if (X2table.wear[i] != 0xFFFF) {
+        X2table.wear[i]++;
+    }
+    return NAND_erase_page(page);
+}
+#endif
+
+
 #if ((VWORM_SIZE > 0) && (OT_FEATURE_VLNVWRITE == ENABLED))
+#if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+void sub_snapshot_erase() {
+    sub_erase_page( X2_SNAPSHOT_PAGE );
+    vworm_stats.erases++;
+    X2snap.state = X2SNAP_NONE;
+}
+
+
+
+void sub_snapshot_void() {
+    vworm_mark_physical(&X2_SNAPSHOT_PAGE[X2_TABLE_WORDS], 0);
+    X2snap.state = X2SNAP_STALE;
+}
+
+
+
+ot_bool sub_snapshot_restore(ot_u16* s_ptr) {
+    ot_uint words;
+    ot_int  i;
+
+    /// A voided snapshot has generation 0.  The length of the spans must be
+    /// plausible before it is used for the CRC.  Whatever the result, the
+    /// page has to be erased before use.
+    X2snap.state    = X2SNAP_STALE;
+    words           = s_ptr[X2_TABLE_WORDS+1];
+    if ((s_ptr[X2_TABLE_WORDS] == 0) || (words > X2_SNAPSHOT_BYTES)) {
+        return False;
+    }
+    words = X2_TABLE_WORDS + 2 + ((words+1) >> 1);
+    if (s_ptr[words] != crc_calc_block((ot_int)(words*2), (ot_u8*)s_ptr)) {
+        return False;
+    }
+
+    for (i=0; i<X2_TABLE_WORDS; i++) {
+        ((ot_u16*)&X2table)[i] = s_ptr[i];
+    }
+    X2snap.generation   = s_ptr[X2_TABLE_WORDS];
+    X2snap.state        = X2SNAP_VALID;
+    return True;
+}
+#endif
+
+
+
+
 ot_u16* sub_recombine_block(block_ptr* block_in, ot_int skip, ot_int span) {
     ot_u8 test;
     ot_int i;
@@ -667,10 +1447,13 @@ ot_u16* sub_recombine_block(block_ptr* block_in, ot_int skip, ot_int span) {
     ot_u16* p_ptr;
     ot_u16* a_ptr;
 
+    /// The snapshot page may be the next fallow
+    X2_SNAPSHOT_CLEAR();
+
     /// 1. Assign pointers
     p_ptr   = block_in->primary;
     a_ptr   = block_in->ancillary;
-    new_ptr = X2table.fallow[(VWORM_FALLOW_PAGES-1)];
+    new_ptr = sub_take_fallow();
     f_ptr   = new_ptr;
 
     /// 2. Combine the old blocks into the fallow block
@@ -697,22 +1480,16 @@ ot_u16* sub_recombine_block(block_ptr* block_in, ot_int skip, ot_int span) {
 //    }
 
     /// 3. Erase the old blocks
-    NAND_erase_page( block_in->primary );
-    NAND_erase_page( block_in->ancillary );
-
-    /// 4. Make the two erased blocks fallow blocks. If we are in this function,
-    /// we can deduce that there is at least one ancillary and one fallow, so we
-    /// stop when NULL is discovered or when at the end of the fallows.
-#   if (VWORM_FALLOW_PAGES >= 2)
-        for (i=(VWORM_FALLOW_PAGES-1); X2table.fallow[i] != NULL; i--) {
-            X2table.fallow[i] = X2table.fallow[i-1];
-        }
-        X2table.fallow[i+1] = block_in->primary;
-        X2table.fallow[i]   = block_in->ancillary;
-#   else
-        X2table.fallow[1]   = block_in->primary;
-        X2table.fallow[0]   = block_in->ancillary;
-#   endif
+    sub_erase_page( block_in->primary );
+    sub_erase_page( block_in->ancillary );
+    vworm_stats.erases += 2;
+    vworm_stats.recombines++;
+    vworm_mapstamp++;
+
+    /// 4. Make the two erased blocks fallow blocks.  The fallow just taken and
+    /// the one that became the ancillary leave room for both.
+    sub_put_fallow(block_in->primary);
+    sub_put_fallow(block_in->ancillary);
 
     /// 5. Set the primary block to its new position, and ancillary to NULL
     block_in->ancillary = NULL;
@@ -726,30 +1503,314 @@ ot_u16* sub_recombine_block(block_ptr* block_in, ot_int skip, ot_int span) {
 
 
 void sub_attach_fallow(block_ptr* block_in) {
-    ot_int  i;
+    /// The snapshot page may be the next fallow
+    X2_SNAPSHOT_CLEAR();
 
     /// If there is only one fallow block left, we need to recombine some other
-    /// blocks first (the one fallow left will get rotated).
+    /// block first (the one fallow left will get rotated).  The block written
+    /// least recently is the least likely to need an ancillary again soon.
     if (X2table.fallow[(VWORM_FALLOW_PAGES-2)] == NULL) {
-        for (i=0; i<VWORM_PRIMARY_PAGES; i++) {
-            if (X2table.block[i].ancillary != NULL) {
-                sub_recombine_block(&X2table.block[i], 0, 0);
-                break;
-            }
+        sub_recombine_oldest();
+    }
+
+    /// The least worn fallow becomes the new ancillary for the supplied primary
+    block_in->ancillary = sub_take_fallow();
+    vworm_mapstamp++;
+}
+
+
+
+void sub_recombine_oldest() {
+    block_ptr*  oldest = NULL;
+    ot_int      i;
+
+    for (i=0; i<VWORM_PRIMARY_PAGES; i++) {
+        if ((X2table.block[i].ancillary != NULL) && ((oldest == NULL) || \
+            ((ot_u16)(X2age.clock - X2age.stamp[i]) > \
+             (ot_u16)(X2age.clock - X2age.stamp[oldest - X2table.block])))) {
+            oldest = &X2table.block[i];
         }
     }
+    if (oldest != NULL) {
+        sub_recombine_block(oldest, 0, 0);
+    }
+}
+
 
-    /// Make the fallow at the back of the fallow table become the new ancillary
-    /// for the supplied primary.
-    block_in->ancillary = X2table.fallow[(VWORM_FALLOW_PAGES-1)];
 
-    /// Shift-up other fallow blocks and make the new bottom fallow NULL
-    for (i=(VWORM_FALLOW_PAGES-1); i>0; i--) {
+ot_u16* sub_take_fallow() {
+/// The fallows are at the back of the table, with NULL in front of them.  On
+/// equal wear, the one at the back goes first.
+    ot_int  i;
+    ot_int  pick;
+    ot_u16* page;
+
+    pick = (VWORM_FALLOW_PAGES-1);
+    for (i=pick-1; (i>=0) && (X2table.fallow[i] != NULL); i--) {
+        if (X2table.wear[X2_PAGE(X2table.fallow[i])] < \
+            X2table.wear[X2_PAGE(X2table.fallow[pick])]) {
+            pick = i;
+        }
+    }
+    page = X2table.fallow[pick];
+
+    /// Shift-up the fallows in front of it and make the new bottom fallow NULL
+    for (i=pick; i>0; i--) {
         X2table.fallow[i] = X2table.fallow[i-1];
     }
     X2table.fallow[0] = NULL;
+    return page;
+}
+
+
+
+void sub_put_fallow(ot_u16* page) {
+    ot_int i;
+
+    for (i=0; (i<(VWORM_FALLOW_PAGES-1)) && (X2table.fallow[i+1] == NULL); i++);
+    X2table.fallow[i] = page;
+}
+
+
+
+ot_u8 sub_write_inplace(block_ptr* block_in, ot_int offset, ot_u16 data, ot_bool commit) {
+    ot_u8   test = 0;
+    ot_u16  wrtest;
+    ot_u16* p_ptr;
+    ot_u16* a_ptr;
+
+    p_ptr = PTR_OFFSET(block_in->primary, offset);
+
+    /// No ancillary: only 1->0 transitions can be programmed
+    if (block_in->ancillary == NULL) {
+        if ((data & ~(*p_ptr)) != 0) {
+            return 255;
+        }
+        return (commit) ? vworm_mark_physical(p_ptr, data) : 0;
+    }
+
+    /// Ancillary: everything except [1->0 via 0,0] (same as vworm_write)
+    a_ptr = PTR_OFFSET(block_in->ancillary, offset);
+    if ((~data & ~(*p_ptr) & ~(*a_ptr)) != 0) {
+        return 255;
+    }
+    if (commit) {
+        wrtest  = ~data & *p_ptr & *a_ptr;
+        wrtest |= data & *p_ptr & ~(*a_ptr);
+        if (wrtest != 0) {
+            test |= vworm_mark_physical(p_ptr, *p_ptr ^ wrtest);
+        }
+        wrtest  = data & ~(*p_ptr) & *a_ptr;
+        if (wrtest != 0) {
+            test |= vworm_mark_physical(a_ptr, *a_ptr ^ wrtest);
+        }
+    }
+    return test;
+}
+
+
+
+
+ot_u8 sub_rewrite_block(block_ptr* block_in, ot_u16* data) {
+    ot_u8   test = 0;
+    ot_int  i;
+    ot_u16* new_ptr;
+
+    /// The snapshot page may be the next fallow
+    X2_SNAPSHOT_CLEAR();
+
+    /// 1. Program the image into the least worn fallow.  It is erased
+    ///    already, so 0xFFFF words do not need programming.
+    new_ptr = sub_take_fallow();
+    for (i=0; i<(VWORM_PAGESIZE/2); i++) {
+        if (data[i] != 0xFFFF) {
+            test |= vworm_mark_physical(&new_ptr[i], data[i]);
+        }
+    }
+
+    /// 2. Erase the old block(s), and put them in the fallow table in place
+    ///    of the one just used (as in sub_recombine_block())
+    sub_erase_page( block_in->primary );
+    sub_put_fallow( block_in->primary );
+    vworm_stats.erases++;
+
+    if (block_in->ancillary != NULL) {
+        sub_erase_page( block_in->ancillary );
+        sub_put_fallow( block_in->ancillary );
+        vworm_stats.erases++;
+    }
+
+    block_in->ancillary = NULL;
+    block_in->primary   = new_ptr;
+    vworm_mapstamp++;
+    return test;
+}
+
+
+
+
+#if (VWORM_CACHE_PAGES > 0)
+ot_u16* sub_cache_get(ot_int index) {
+    ot_int i;
+
+    for (i=0; i<VWORM_CACHE_PAGES; i++) {
+        if (X2cache.page[i].vpage == (index+1)) {
+            X2cache.page[i].age = ++X2cache.clock;
+            return X2cache.page[i].data;
+        }
+    }
+    return NULL;
+}
+
+
+
+
+ot_bool sub_cache_hasfree() {
+    ot_int i;
+
+    for (i=0; i<VWORM_CACHE_PAGES; i++) {
+        if (X2cache.page[i].vpage == 0) {
+            return True;
+        }
+    }
+    return False;
+}
+
+
+
+
+ot_u16* sub_cache_load(ot_int index) {
+    X2cache_page*   page;
+    ot_u16*         p_ptr;
+    ot_u16*         a_ptr;
+    ot_int          i;
+
+    /// 1. Use a free entry, or evict the least recently used one
+    page = &X2cache.page[0];
+    for (i=0; i<VWORM_CACHE_PAGES; i++) {
+        if (X2cache.page[i].vpage == 0) {
+            page = &X2cache.page[i];
+            break;
+        }
+        if ((ot_u16)(X2cache.clock - X2cache.page[i].age) > \
+            (ot_u16)(X2cache.clock - page->age)) {
+            page = &X2cache.page[i];
+        }
+    }
+    if (page->vpage != 0) {
+        sub_cache_flush(page);
+    }
+
+    /// 2. Load the logical contents of the page
+    p_ptr = X2table.block[index].primary;
+    a_ptr = X2table.block[index].ancillary;
+    for (i=0; i<(VWORM_PAGESIZE/2); i++) {
+        page->data[i] = (a_ptr == NULL) ? p_ptr[i] : ~(p_ptr[i] ^ a_ptr[i]);
+    }
+
+#   if (VWORM_DEFER_WRITES > 0)
+    sub_pending_merge(index, page->data);
+#   endif
+
+    page->vpage = index+1;
+    vworm_mapstamp++;
+    page->age   = ++X2cache.clock;
+    return page->data;
 }
 
 
+
+
+ot_u8 sub_cache_flush(X2cache_page* page) {
+    block_ptr*  block_in;
+    ot_u16*     p_ptr;
+    ot_u16*     a_ptr;
+    ot_u8       test = 0;
+    ot_int      i;
+
+    block_in    = &X2table.block[page->vpage-1];
+    p_ptr       = block_in->primary;
+    a_ptr       = block_in->ancillary;
+
+    /// 1. Check if every changed word can be programmed in place
+    for (i=0; i<(VWORM_PAGESIZE/2); i++) {
+        ot_u16 stored = (a_ptr == NULL) ? p_ptr[i] : ~(p_ptr[i] ^ a_ptr[i]);
+        if (page->data[i] != stored) {
+            if (sub_write_inplace(block_in, (i<<1), page->data[i], False) != 0) {
+                break;
+            }
+        }
+    }
+
+    /// 2. Program in place, or else rewrite the whole page into a fallow
+    X2_STAMP(block_in);
+    if (i == (VWORM_PAGESIZE/2)) {
+        for (i=0; i<(VWORM_PAGESIZE/2); i++) {
+            ot_u16 stored = (a_ptr == NULL) ? p_ptr[i] : ~(p_ptr[i] ^ a_ptr[i]);
+            if (page->data[i] != stored) {
+                test |= sub_write_inplace(block_in, (i<<1), page->data[i], True);
+            }
+        }
+    }
+    else {
+        test = sub_rewrite_block(block_in, page->data);
+        vworm_stats.rewrites++;
+    }
+
+    vworm_stats.flushes++;
+    page->vpage = 0;
+    return test;
+}
+#endif
+
+
+
+ot_bool sub_write_erases(block_ptr* block_in, ot_int offset, ot_u16 data) {
+    if (sub_write_inplace(block_in, offset, data, False) == 0) {
+        return False;
+    }
+
+    /// Attaching a fallow only costs an erase when the fallows are used up
+    if (block_in->ancillary == NULL) {
+        return (ot_bool)(X2table.fallow[(VWORM_FALLOW_PAGES-2)] == NULL);
+    }
+    return True;
+}
+
+
+
+
+#if (VWORM_DEFER_WRITES > 0)
+X2write* sub_pending_find(vaddr addr) {
+    ot_int i;
+
+    for (i=0; i<X2pending.count; i++) {
+        if (X2pending.entry[i].addr == addr) {
+            return &X2pending.entry[i];
+        }
+    }
+    return NULL;
+}
+
+
+
+
+void sub_pending_merge(ot_int index, ot_u16* page_data) {
+    ot_int i = 0;
+
+    while (i < X2pending.count) {
+        vaddr addr = X2pending.entry[i].addr;
+        if (((addr-VWORM_BASE_VADDR) >> VWORM_PAGESHIFT) == index) {
+            *PTR_OFFSET(page_data, (addr & (VWORM_PAGESIZE-1))) = X2pending.entry[i].data;
+            X2pending.entry[i] = X2pending.entry[--X2pending.count];
+        }
+        else {
+            i++;
+        }
+    }
+}
+#endif
+
+
 #endif
 
@@ -0,0 +1,353 @@
+/* Copyright 2010-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTplatform/POSIX/mpipe_POSIX.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Message Pipe (MPIPE) on the standard output of a POSIX node
+  * @ingroup    MPipe
+  *
+  * TX frames are written to stdout in the same format as the UART MPipes
+  * (NDEF header + payload + sequence + CRC16), so the output of a node can be
+  * piped into the usual MPipe client tools.  The write completes at once, and
+  * the TX done event is delivered through MPIPE_VECTOR, so the callback runs
+  * "in the ISR", as it does on an MCU.  The host has no CRC engine, so the
+  * CRC is computed by the OTlib CRC16 module.
+  *
+  * Gather TX (OT_FEATURE(MPIPE_GATHER)) writes the segments one after the
+  * other, and then the footer.
+  *
+  * RX is on stdin, when it is a pipe or a socket (not a terminal), and not in
+  * virtual time.  Input raises MPIPE_RX_VECTOR (O_ASYNC).  A packet has the
+  * same format as TX, and its CRC is checked.  A packet is held until
+  * mpipe_rxndef() gives it a buffer, as the UART FIFO of an MCU would hold
+  * it, and packets with a bad CRC are dropped.  Without stdin RX, nodes are
+  * driven by signals instead (see main.c of the apps).
+  ******************************************************************************
+  */
+
+#define _GNU_SOURCE         // F_SETSIG
+#include "OT_config.h"
+#include "OT_platform.h"
+
+#if (OT_FEATURE(MPIPE) == ENABLED)
+
+#define MPIPE_DRIVER    posix   // port name, for OT_FEATURE(MPIPE_PORTS)
+#include "mpipe.h"
+#include "crc16.h"
+#include "system.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define MPIPE_FOOTERBYTES   4
+#define MPIPE_HEADERBYTES   6
+#define MPIPE_RXMAX         (MPIPE_HEADERBYTES + 255 + MPIPE_FOOTERBYTES)
+
+
+typedef struct {
+    mpipe_state     state;
+    mpipe_priority  priority;
+    Twobytes        sequence;
+#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+        void (*sig_rxdone)(ot_int);
+        void (*sig_txdone)(ot_int);
+        void (*sig_rxdetect)(ot_int);
+#   endif
+    ot_u8*          rxdata;
+    ot_int          rxlen;
+    ot_u8           rxbuf[MPIPE_RXMAX];
+} mpipe_struct;
+
+mpipe_struct mpipe;
+
+
+void sub_txdone_isr(int signo);
+void sub_rx_isr(int signo);
+
+
+
+
+/*****************************************
+ * Mpipe Subroutines (private functions) *
+ *****************************************/
+
+#if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+void sub_signull(ot_int sigval) { }
+
+void mpipe_setsig_txdone(void (*signal)(ot_int)) {
+    mpipe.sig_txdone = signal;
+}
+
+void mpipe_setsig_rxdone(void (*signal)(ot_int)) {
+    mpipe.sig_rxdone = signal;
+}
+
+void mpipe_setsig_rxdetect(void (*signal)(ot_int)) {
+    mpipe.sig_rxdetect = signal;
+}
+#endif
+
+
+
+void sub_txdone_isr(int signo) {
+    SYS_PROFILE_WAIT_START();
+    mpipe_isr();
+    PLATFORM_ISR_UNNEST();
+}
+
+
+void sub_rx_isr(int signo) {
+/// Reads stdin up to the end of the packet, and no further, so the next one
+/// stays in the pipe until this one is taken.  A header that is not an NDEF
+/// short record with a 2 byte ID is skipped a byte at a time.
+    ot_int need;
+    ot_int rc;
+
+    SYS_PROFILE_WAIT_START();
+    while (1) {
+        need = MPIPE_HEADERBYTES;
+        if (mpipe.rxlen >= MPIPE_HEADERBYTES) {
+            if ((mpipe.rxbuf[1] != 0) || (mpipe.rxbuf[3] != 2)) {
+                mpipe.rxlen--;
+                memmove(mpipe.rxbuf, &mpipe.rxbuf[1], mpipe.rxlen);
+                continue;
+            }
+            need += mpipe.rxbuf[2] + MPIPE_FOOTERBYTES;
+        }
+        if (mpipe.rxlen < need) {
+            rc = (ot_int)read(STDIN_FILENO, &mpipe.rxbuf[mpipe.rxlen], (size_t)(need - mpipe.rxlen));
+            if (rc <= 0) {
+                break;
+            }
+            mpipe.rxlen += rc;
+            continue;
+        }
+
+        /// A whole packet: it waits for a buffer, or goes to it now
+        if (mpipe.rxdata == NULL) {
+            break;
+        }
+        need       -= MPIPE_FOOTERBYTES;
+        mpipe.rxlen = 0;
+        if (crc_calc_block(need+2, mpipe.rxbuf) != \
+            (((ot_u16)mpipe.rxbuf[need+2] << 8) | mpipe.rxbuf[need+3])) {
+            continue;
+        }
+        platform_memcpy(mpipe.rxdata, mpipe.rxbuf, need);
+        mpipe.rxdata = NULL;
+#       if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+            mpipe.sig_rxdone(0);
+#       endif
+    }
+    PLATFORM_ISR_UNNEST();
+}
+
+
+
+
+/**************************
+ * Public Mpipe Functions *
+ **************************/
+
+ot_u8 mpipe_footerbytes() {
+    return MPIPE_FOOTERBYTES;
+}
+
+
+
+ot_int mpipe_init(void* port_id) {
+/// "port_id" is unused in this impl, and it may be NULL
+#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+        mpipe.sig_rxdone    = &sub_signull;
+        mpipe.sig_txdone    = &sub_signull;
+        mpipe.sig_rxdetect  = &sub_signull;
+#   endif
+
+    mpipe.priority  = MPIPE_Low;
+    mpipe.state     = MPIPE_Idle;
+    mpipe.rxdata    = NULL;
+    mpipe.rxlen     = 0;
+
+    platform_posix_isr(MPIPE_VECTOR, &sub_txdone_isr);
+
+    /// O_NONBLOCK is on the open file, which a terminal shares with the shell,
+    /// so stdin RX is only for pipes and sockets.
+#   if defined(F_SETSIG)
+    if ((platform_posix_sim() == False) && (isatty(STDIN_FILENO) == 0)) {
+        platform_posix_isr(MPIPE_RX_VECTOR, &sub_rx_isr);
+        fcntl(STDIN_FILENO, F_SETOWN, getpid());
+        fcntl(STDIN_FILENO, F_SETSIG, MPIPE_RX_VECTOR);
+        fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK | O_ASYNC);
+        raise(MPIPE_RX_VECTOR);
+    }
+#   endif
+    return 0;
+}
+
+
+
+void mpipe_kill() {
+    mpipe.state = MPIPE_Idle;
+}
+
+
+
+void mpipe_wait() {
+/// The write in mpipe_txndef() is already done, but the TX done event may be
+/// pending behind masked interrupts.
+    while (mpipe.state != MPIPE_Idle) {
+        platform_posix_sleep();
+    }
+}
+
+
+
+void mpipe_setspeed(mpipe_speed speed) {
+/// stdout has no baud rate
+}
+
+
+
+mpipe_state mpipe_status() {
+    return mpipe.state;
+}
+
+
+
+void sub_write(ot_u8* data, ot_int length) {
+    ot_int sent;
+    for (sent=0; sent<length; ) {
+        ot_int rc = (ot_int)write(STDOUT_FILENO, &data[sent], (size_t)(length-sent));
+        if (rc <= 0) {
+            break;
+        }
+        sent += rc;
+    }
+}
+
+
+
+#if (OT_FEATURE(MPIPE_GATHER) == ENABLED)
+ot_int mpipe_txsegs(mpipe_seg* seg, ot_int segs, ot_bool blocking, mpipe_priority data_priority) {
+    ot_u8   footer[MPIPE_FOOTERBYTES];
+    ot_u16  crcval;
+    ot_int  data_length;
+    ot_int  i;
+
+    if (mpipe.state != MPIPE_Idle) {
+        return -1;
+    }
+    mpipe.priority  = data_priority;
+    mpipe.state     = MPIPE_Tx_Done;
+
+    footer[0]   = mpipe.sequence.ubyte[UPPER];
+    footer[1]   = mpipe.sequence.ubyte[LOWER];
+    crcval      = crc_calc_block(seg[0].length, seg[0].data);
+    data_length = seg[0].length;
+    for (i=1; i<segs; i++) {
+        crcval       = crc_extend_block(crcval, seg[i].length, seg[i].data);
+        data_length += seg[i].length;
+    }
+    crcval      = crc_extend_block(crcval, 2, footer);
+    footer[2]   = (ot_u8)(crcval >> 8);
+    footer[3]   = (ot_u8)crcval;
+
+    for (i=0; i<segs; i++) {
+        sub_write(seg[i].data, seg[i].length);
+    }
+    sub_write(footer, MPIPE_FOOTERBYTES);
+
+    raise(MPIPE_VECTOR);
+
+    if (blocking == True) {
+        mpipe_wait();
+    }
+
+    return data_length + MPIPE_FOOTERBYTES;
+}
+#endif
+
+
+
+ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+    Twobytes crcval;
+    ot_int  data_length;
+
+    if (mpipe.state != MPIPE_Idle) {
+        return -1;
+    }
+    mpipe.priority  = data_priority;
+    mpipe.state     = MPIPE_Tx_Done;
+
+    // add sequence id & crc to end of the datastream
+    data_length         = data[2] + 6;
+    data[data_length++] = mpipe.sequence.ubyte[UPPER];
+    data[data_length++] = mpipe.sequence.ubyte[LOWER];
+    crcval.ushort       = crc_calc_block(data_length, data);
+    data[data_length++] = crcval.ubyte[UPPER];
+    data[data_length++] = crcval.ubyte[LOWER];
+
+    sub_write(data, data_length);
+
+    raise(MPIPE_VECTOR);
+
+    if (blocking == True) {
+        mpipe_wait();
+    }
+
+    return data_length;
+}
+
+
+
+ot_int mpipe_rxndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// A packet that is held already is delivered from the RX ISR
+    if (mpipe.state != MPIPE_Idle) {
+        return -1;
+    }
+    mpipe.priority  = data_priority;
+    mpipe.rxdata    = data;
+    if (mpipe.rxlen != 0) {
+        raise(MPIPE_RX_VECTOR);
+    }
+    return 0;
+}
+
+
+
+void mpipe_isr() {
+    if (mpipe.state == MPIPE_Tx_Done) {
+        mpipe.sequence.ushort++;    //increment sequence on TX Done
+        mpipe.state     = MPIPE_Idle;
+        mpipe.priority  = MPIPE_Low;
+#       if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+            mpipe.sig_txdone(0);
+#       endif
+    }
+}
+
+
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+MPIPE_PORT_DEFINE(&mpipe_kill);
+#endif
+
+
+#endif
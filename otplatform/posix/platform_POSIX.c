@@ -0,0 +1,1027 @@
+/* Copyright 2010-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTplatform/POSIX/platform_POSIX.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      ISRs and hardware services abstracted by the platform module
+  * @ingroup    Platform
+  *
+  * The POSIX platform runs one OpenTag node per process.  Interrupts are
+  * signals: GPTIM is a POSIX timer on CLOCK_MONOTONIC, and the kernel runs in
+  * its signal handler, just as it runs in the GPTIM ISR on an MCU.  See
+  * _Readme_POSIX.txt for building and running nodes.
+  *
+  ******************************************************************************
+  */
+
+#include "OT_utils.h"
+#include "OT_types.h"
+#include "OT_config.h"
+#include "OT_platform.h"
+
+// OT modules that need initialization
+#include "veelite.h"
+#include "veelite_core.h"
+#include "buffers.h"
+#include "auth.h"
+#include "mpipe.h"
+#include "radio.h"
+#include "system.h"
+#include "session.h"
+#include "ota.h"
+#include "vsflash.h"
+#include "sim_POSIX.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+//API wrappers
+void otapi_poweron()    { platform_poweron(); }
+void otapi_poweroff()   { platform_poweroff(); }
+void otapi_init()       { platform_init_OT(); }
+void otapi_exec()       { platform_ot_run(); }
+void otapi_preempt()    { platform_ot_preempt(); }
+void otapi_pause()      { platform_ot_pause(); }
+
+#ifndef EXTF_otapi_led1_on
+void otapi_led1_on()    { platform_trig1_high(); }
+#endif
+#ifndef EXTF_otapi_led2_on
+void otapi_led2_on()    { platform_trig2_high(); }
+#endif
+#ifndef EXTF_otapi_led1_off
+void otapi_led1_off()   { platform_trig1_low(); }
+#endif
+#ifndef EXTF_otapi_led2_off
+void otapi_led2_off()   { platform_trig2_low(); }
+#endif
+
+
+
+
+
+/** Feature Configuration Macros <BR>
+  * ========================================================================<BR>
+  * These should be defined in apps/.../app_config.h.  If one or more are
+  * missing, use the defaults.
+  */
+#ifndef OT_FEATURE_RTC
+#   define OT_FEATURE_RTC       DISABLED
+#endif
+#ifndef OT_FEATURE_MPIPE
+#   define OT_FEATURE_MPIPE     DISABLED
+#endif
+
+
+
+
+
+/** Platform Data <BR>
+  * ============================================================================
+  * irqset      the signals that are "interrupts" (see platform_posix_isr())
+  * gptim       the GPTIM timer
+  * gptim_start host time when GPTIM was last zeroed
+  * vgptim_start virtual time when GPTIM was last zeroed (OT_SIM)
+  * nodeid      node number, 0 until platform_posix_nodeid() first runs
+  * trig        test trigger states (bit 0 = trig1, bit 1 = trig2)
+  */
+platform_struct platform;
+
+typedef struct {
+    sigset_t        irqset;
+    timer_t         gptim;
+    struct timespec gptim_start;
+    ot_u32          vgptim_start;
+    ot_u16          nodeid;
+    ot_u8           trig;
+} posix_struct;
+
+posix_struct posix;
+
+
+
+
+/** Virtual Time Data <BR>
+  * ============================================================================
+  * With OT_SIM set, the node runs in the virtual time of the simulator (see
+  * sim_POSIX.h).  The timers of platform_posix_timer() are virtual then: they
+  * only keep their expiry, and platform_posix_sleep() runs their handlers and
+  * the events from the simulator in time order.
+  *
+  * on          the node is in virtual time
+  * running     the node is in a window of the simulator
+  * fd          socket to the simulator
+  * now         virtual time (ti)
+  * until       end of the window
+  * timers      virtual timers in use
+  * timer[]     virtual timers: the timer_t each stands for, its signal, and
+  *             its expiry when it is armed
+  * events      events of the window, and get, the next to run
+  * current     the event being run (see platform_posix_simevent())
+  * isr[]       signal handlers, which the virtual timers and events call
+  */
+#define POSIX_SIM_TIMERS    4
+
+typedef struct {
+    timer_t*    id;
+    int         signo;
+    ot_bool     armed;
+    ot_u32      due;
+} posixsim_timer;
+
+typedef struct {
+    ot_bool         on;
+    ot_bool         running;
+    int             fd;
+    ot_u32          now;
+    ot_u32          until;
+    ot_int          timers;
+    posixsim_timer  timer[POSIX_SIM_TIMERS];
+    ot_int          events;
+    ot_int          get;
+    sim_msg*        current;
+    void            (*isr[NSIG])(int);
+    sim_msg         event[SIM_EVENTS+1];
+} posixsim_struct;
+
+posixsim_struct posixsim;
+
+
+#define NSEC_PER_SEC    1000000000LL
+
+void sub_ti_sleep(ot_uint n, long nsec_each);
+void sub_poweroff_isr(int signo);
+void sub_node_identity();
+void sub_sim_open();
+void sub_sim_sleep();
+posixsim_timer* sub_sim_timer(timer_t* timer);
+
+
+
+
+
+/** Platform Interrupts <BR>
+  * ========================================================================<BR>
+  */
+
+// Kernel Timer Interrupt.  The radio signals are masked while it runs, as a
+// radio ISR waits for the kernel on an MSP430 without PLATFORM_ISR_NESTING.
+OT_INTERRUPT void platform_gptim_isr(int signo) {
+    SYS_PROFILE_WAIT_START();
+    platform_ot_run();
+    PLATFORM_ISR_UNNEST();
+}
+
+
+// Termination (Ctrl-C, kill): save the file system the way a power-down does
+void sub_poweroff_isr(int signo) {
+    platform_poweroff();
+    exit(0);
+}
+
+
+
+
+
+/** Platform Interrupt & Event Management Routines <BR>
+  * ========================================================================<BR>
+  */
+void platform_disable_interrupts() {
+    sigprocmask(SIG_BLOCK, &posix.irqset, NULL);
+}
+
+void platform_enable_interrupts() {
+    sigprocmask(SIG_UNBLOCK, &posix.irqset, NULL);
+}
+
+void platform_ot_preempt() {
+/// Raise the GPTIM signal in order to pre-empt the kernel.  The timer is not
+/// zeroed, so the kernel gets the time that passed since the last event.  If
+/// interrupts are disabled, the signal is pending until they are enabled.
+    raise(OT_GPTIM_VECTOR);
+}
+
+void platform_ot_pause() {
+    platform_ot_preempt();
+    platform_flush_gptim();
+}
+
+void platform_ot_run() {
+/// 1. Save the amount of time that just passed.  A signal can be delivered
+///    late on a loaded host, so use the timer value (never less than the
+///    interval that expired) rather than the interval itself.
+/// 2. Run System Kernel, which returns its next scheduled call
+/// 3. Put the next scheduled call into the timer, and turn it back on
+    ot_u32 next_event;
+    ot_u32 elapsed_time;
+    elapsed_time    = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
+    next_event      = sys_event_manager( elapsed_time );
+
+#   if (OT_PARAM(KERNEL_LIMIT) > 0)
+        if (next_event > OT_PARAM(KERNEL_LIMIT))
+            next_event = OT_PARAM(KERNEL_LIMIT);
+#   endif
+
+    platform_set_ktim( next_event );
+}
+
+
+
+
+
+
+
+/** Platform Startup and Shutdown Routines <BR>
+  * ========================================================================<BR>
+  */
+
+void platform_poweron() {
+    /// Paint the stack while it is nearly empty (see OT_FEATURE_MEMSTATS)
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    sys_stack_paint();
+#   endif
+
+    /// 1. Initialize OpenTag platform peripherals.  In virtual time, the
+    ///    random seed is only the node number, so a run can be repeated.
+    sub_sim_open();
+    platform_init_interruptor();
+    platform_init_gptim(0, &platform_gptim_isr);
+    platform_init_gpio();
+    platform_init_memcpy();
+    platform_init_prand( (ot_u16)(platform_posix_nodeid() ^ (posixsim.on ? 0 : getpid())) );
+
+    /// 2. A terminated node saves its file system, like on power-down
+    platform_posix_isr(SIGINT, &sub_poweroff_isr);
+    platform_posix_isr(SIGTERM, &sub_poweroff_isr);
+
+    /// 3. Initialize Low-Level Drivers (worm, mpipe)
+    // Restore vworm (following save on shutdown)
+    vworm_init();
+#   if (OT_FEATURE(VSFLASH) == ENABLED)
+    vsflash_init();
+#   endif
+
+    // Mpipe (message pipe) typically used for serial-line comm.
+#   if (OT_FEATURE(MPIPE) == ENABLED)
+        mpipe_init(NULL);
+#   endif
+}
+
+
+void platform_poweroff() {
+/// 1. Put any mirror data into the file system <BR>
+/// 2. Save the vworm image
+/// 3. Do the serial flash erases that are still queued
+    platform_disable_interrupts();
+    vl_save();
+#   if (OT_FEATURE(VSFLASH) == ENABLED)
+    vsflash_flush();
+#   endif
+}
+
+
+void platform_init_OT() {
+	buffers_init(); //buffers init must be first in order to do core dumps
+	vl_init();      //Veelite init must be second
+	sub_node_identity();
+	radio_init();   //radio init third
+	sys_init();     //system init last
+}
+
+
+void platform_fastinit_OT() {
+	buffers_init(); //buffers init must be first in order to do core dumps
+	vl_fastinit();  //Veelite from the boot snapshot, if there is one
+	sub_node_identity();
+	radio_init();   //radio init third
+	sys_init();     //system init last
+}
+
+
+void platform_init_busclk() {
+}
+
+
+void platform_init_periphclk() {
+}
+
+
+void platform_init_interruptor() {
+/// The "interrupts" are the signals used by the platform and radio drivers.
+/// Signals that are not in the set keep their default behavior.
+    sigemptyset(&posix.irqset);
+    sigaddset(&posix.irqset, OT_GPTIM_VECTOR);
+    sigaddset(&posix.irqset, RADIO_IRQ_VECTOR);
+    sigaddset(&posix.irqset, RADIO_TIM_VECTOR);
+    sigaddset(&posix.irqset, SIGINT);
+    sigaddset(&posix.irqset, SIGTERM);
+}
+
+
+void platform_init_gpio() {
+    posix.trig = 0;
+}
+
+
+void platform_init_gptim(ot_u16 prescaler, void (*timer_handler)(int)) {
+/// The POSIX GPTIM always counts ti (1/1024 s) of CLOCK_MONOTONIC, so the
+/// prescaler is ignored.  timer_handler is the GPTIM ISR.  Don't start the
+/// timer on init.  Call platform_ot_preempt to run the kernel.
+    platform_posix_timer(&posix.gptim, OT_GPTIM_VECTOR);
+    platform_posix_isr(OT_GPTIM_VECTOR, timer_handler);
+    platform_flush_gptim();
+}
+
+
+void platform_init_watchdog() {
+}
+
+
+void platform_init_resetswitch() {
+}
+
+
+void platform_init_systick(ot_uint period) {
+}
+
+
+void platform_init_rtc(ot_u32 value) {
+/// The host clock is the RTC, so there is nothing to initialize
+}
+
+
+void platform_init_memcpy() {
+}
+
+
+
+
+
+
+
+
+/** POSIX Platform Services <BR>
+  * ========================================================================<BR>
+  */
+
+void platform_posix_sleep() {
+    sigset_t mask;
+    int      signo;
+
+    /// In virtual time, the node only waits for the host when a signal is
+    /// pending, such as a raise() behind masked interrupts.
+    if (posixsim.on) {
+        sigpending(&mask);
+        for (signo=1; signo<NSIG; signo++) {
+            if ((sigismember(&posix.irqset, signo) == 1) && (sigismember(&mask, signo) == 1)) {
+                break;
+            }
+        }
+        if (signo == NSIG) {
+            sub_sim_sleep();
+            return;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, NULL, &mask);
+    for (signo=1; signo<NSIG; signo++) {
+        if (sigismember(&posix.irqset, signo) == 1) {
+            sigdelset(&mask, signo);
+        }
+    }
+    sigsuspend(&mask);
+}
+
+
+void platform_posix_isr(int signo, void (*isr)(int)) {
+    struct sigaction action;
+
+    sigaddset(&posix.irqset, signo);
+    posixsim.isr[signo] = isr;
+    action.sa_handler   = isr;
+    action.sa_mask      = posix.irqset;
+    action.sa_flags     = SA_RESTART;
+    sigaction(signo, &action, NULL);
+}
+
+
+void platform_posix_timer(timer_t* timer, int signo) {
+    struct sigevent event;
+
+    if (posixsim.on) {
+        posixsim_timer* vtimer = sub_sim_timer(timer);
+        if ((vtimer == NULL) && (posixsim.timers < POSIX_SIM_TIMERS)) {
+            vtimer = &posixsim.timer[posixsim.timers++];
+        }
+        if (vtimer != NULL) {
+            vtimer->id      = timer;
+            vtimer->signo   = signo;
+            vtimer->armed   = False;
+        }
+        return;
+    }
+
+    event.sigev_notify          = SIGEV_SIGNAL;
+    event.sigev_signo           = signo;
+    event.sigev_value.sival_ptr = timer;
+    timer_create(OT_GPTIM_CLOCK, &event, timer);
+}
+
+
+void platform_posix_settimer(timer_t* timer, ot_long ticks) {
+/// A zero it_value stops a POSIX timer, so an immediate expiry is 1 ns.  The
+/// interval is rounded up to whole ns, so it never expires early.
+    struct itimerspec setting;
+    long long nsec;
+
+    if (posixsim.on) {
+        posixsim_timer* vtimer = sub_sim_timer(timer);
+        if (vtimer != NULL) {
+            vtimer->armed   = (ot_bool)(ticks >= 0);
+            vtimer->due     = posixsim.now + (ot_u32)((ticks < 0) ? 0 : ticks);
+        }
+        return;
+    }
+
+    nsec = (ticks < 0) ? 0 : ((((long long)ticks * NSEC_PER_SEC) + 1023) >> 10);
+    nsec = ((ticks >= 0) && (nsec == 0)) ? 1 : nsec;
+
+    setting.it_interval.tv_sec  = 0;
+    setting.it_interval.tv_nsec = 0;
+    setting.it_value.tv_sec     = (time_t)(nsec / NSEC_PER_SEC);
+    setting.it_value.tv_nsec    = (long)(nsec % NSEC_PER_SEC);
+    timer_settime(*timer, 0, &setting, NULL);
+}
+
+
+ot_u32 platform_posix_ticks() {
+    struct timespec now;
+
+    if (posixsim.on) {
+        return posixsim.now;
+    }
+    clock_gettime(OT_GPTIM_CLOCK, &now);
+    return (ot_u32)( (((long long)now.tv_sec << 10)) + \
+                     (((long long)now.tv_nsec << 10) / NSEC_PER_SEC) );
+}
+
+
+ot_u16 platform_posix_nodeid() {
+    if (posix.nodeid == 0) {
+        char* env = getenv("OT_NODE");
+        posix.nodeid = (env != NULL) ? (ot_u16)atoi(env) : (ot_u16)getpid();
+        posix.nodeid = (posix.nodeid == 0) ? 1 : posix.nodeid;
+    }
+    return posix.nodeid;
+}
+
+
+void sub_node_identity() {
+/// Every node starts from the same default file system, so the node number is
+/// written into the last two bytes of the UID and into the VID.  Otherwise all
+/// the nodes would answer to the same address.
+    vlFILE* fp;
+    ot_u16  id = PLATFORM_ENDIAN16(platform_posix_nodeid());
+
+    fp = ISF_open_su( ISF_ID(device_features) );
+    if (fp != NULL) {
+        vl_write(fp, 6, id);
+        vl_close(fp);
+    }
+    fp = ISF_open_su( ISF_ID(network_settings) );
+    if (fp != NULL) {
+        vl_write(fp, 0, id);
+        vl_close(fp);
+    }
+}
+
+
+
+
+
+
+
+
+/** Virtual Time <BR>
+  * ========================================================================<BR>
+  */
+
+void sub_sim_open() {
+    char* env = getenv(SIM_ENV);
+
+    posixsim.on         = (ot_bool)(env != NULL);
+    posixsim.fd         = (env != NULL) ? atoi(env) : -1;
+    posixsim.running    = False;
+    posixsim.now        = 0;
+    posixsim.until      = 0;
+    posixsim.events     = 0;
+    posixsim.get        = 0;
+    posixsim.current    = NULL;
+}
+
+
+posixsim_timer* sub_sim_timer(timer_t* timer) {
+    ot_int i;
+
+    for (i=0; i<posixsim.timers; i++) {
+        if (posixsim.timer[i].id == timer) {
+            return &posixsim.timer[i];
+        }
+    }
+    return NULL;
+}
+
+
+void sub_sim_event(sim_msg* event) {
+/// A signal from the simulator is raised behind the masked interrupts, so it
+/// runs when they are enabled again.  Frame events go to the radio ISR.
+    if (event->type == SIM_MSG_SIGNAL) {
+        raise((int)event->arg);
+    }
+    else if (posixsim.isr[RADIO_IRQ_VECTOR] != NULL) {
+        posixsim.current = event;
+        posixsim.isr[RADIO_IRQ_VECTOR](RADIO_IRQ_VECTOR);
+        posixsim.current = NULL;
+    }
+}
+
+
+void sub_sim_sleep() {
+/// Runs the next timer or event of the window, like an interrupt that wakes
+/// the MCU.  Events go first when a timer is due at the same time, as the
+/// radio interrupts come before the kernel timer on an MCU.
+/// When the window has nothing more, the node tells the simulator when its
+/// next timer is, and it waits for the next window.
+    posixsim_timer* timer;
+    sim_msg*        event;
+    sim_msg         msg;
+    ot_u32          wake;
+    ot_u32          next;
+    ot_int          i;
+
+    for (;;) {
+        timer   = NULL;
+        next    = SIM_NEVER;
+        for (i=0; i<posixsim.timers; i++) {
+            if (posixsim.timer[i].armed && (posixsim.timer[i].due < next)) {
+                timer   = &posixsim.timer[i];
+                next    = timer->due;
+            }
+        }
+        wake    = next;
+        event   = (posixsim.get < posixsim.events) ? &posixsim.event[posixsim.get] : NULL;
+        if ((event != NULL) && (event->time <= next)) {
+            timer   = NULL;
+            next    = event->time;
+        }
+
+        if (posixsim.running && (next < posixsim.until)) {
+            posixsim.now = (next > posixsim.now) ? next : posixsim.now;
+            platform_disable_interrupts();
+            if (timer != NULL) {
+                timer->armed = False;
+                if (posixsim.isr[timer->signo] != NULL) {
+                    posixsim.isr[timer->signo](timer->signo);
+                }
+            }
+            else {
+                posixsim.get++;
+                sub_sim_event(event);
+            }
+            platform_enable_interrupts();
+            return;
+        }
+
+        /// The window is over.  An event can only be left if it is past the
+        /// window, which the simulator does not do.
+        posixsim.running    = False;
+        posixsim.events     = 0;
+        posixsim.get        = 0;
+        msg.type            = SIM_MSG_SLEEP;
+        msg.time            = posixsim.now;
+        msg.arg             = wake;
+        msg.length          = 0;
+        platform_posix_simsend(&msg);
+
+        while (posixsim.running == False) {
+            sim_msg* in = &posixsim.event[posixsim.events];
+            ssize_t  bytes;
+
+            bytes = recv(posixsim.fd, in, sizeof(sim_msg), 0);
+            if ((bytes < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if (bytes < SIM_MSG_HEAD) {
+                exit(0);                // the simulator is gone
+            }
+            switch (in->type) {
+                case SIM_MSG_RUN:   posixsim.until      = in->arg;
+                                    posixsim.running    = True;
+                                    break;
+
+                case SIM_MSG_STOP:  sub_poweroff_isr(SIGTERM);
+                                    break;
+
+                default:            if (posixsim.events < SIM_EVENTS) {
+                                        posixsim.events++;
+                                    }
+                                    break;
+            }
+        }
+    }
+}
+
+
+ot_bool platform_posix_sim() {
+    return posixsim.on;
+}
+
+
+void platform_posix_simsend(sim_msg* msg) {
+    while (send(posixsim.fd, msg, SIM_MSG_HEAD + msg->length, 0) < 0) {
+        if (errno != EINTR) {
+            exit(0);
+        }
+    }
+}
+
+
+sim_msg* platform_posix_simevent() {
+    return posixsim.current;
+}
+
+
+
+
+
+
+
+
+/** Platform Peripheral Access Routines <BR>
+  * ========================================================================<BR>
+  */
+
+ot_u16 platform_get_gptim() {
+    ot_u32 ticks = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
+    return (ticks > 65535) ? 65535 : (ot_u16)ticks;
+}
+
+ot_u32 platform_get_ktim() {
+/// The host timer is not 16 bits, so the kernel timer is just the time since
+/// GPTIM was last set or flushed.
+    struct timespec now;
+    long long       nsec;
+
+    if (posixsim.on) {
+        return (posixsim.now - posix.vgptim_start) << PLATFORM_KTIM_SUBBITS;
+    }
+    clock_gettime(OT_GPTIM_CLOCK, &now);
+    nsec    = (long long)(now.tv_sec - posix.gptim_start.tv_sec) * NSEC_PER_SEC;
+    nsec   += (now.tv_nsec - posix.gptim_start.tv_nsec);
+
+    return (ot_u32)((nsec << (10+PLATFORM_KTIM_SUBBITS)) / NSEC_PER_SEC);
+}
+
+ot_u32 platform_stamp() {
+/// The host clock in sub-ticks.  Seconds and nanoseconds are scaled apart so
+/// a long uptime does not overflow, and the count wraps modulo 2^32.
+    struct timespec now;
+    ot_u32          count;
+
+    if (posixsim.on) {
+        return posixsim.now << PLATFORM_KTIM_SUBBITS;
+    }
+    clock_gettime(OT_GPTIM_CLOCK, &now);
+    count   = (ot_u32)now.tv_sec << (10+PLATFORM_KTIM_SUBBITS);
+    count  += (ot_u32)(((long long)now.tv_nsec << (10+PLATFORM_KTIM_SUBBITS)) / NSEC_PER_SEC);
+    return count;
+}
+
+#if (OT_FEATURE(PROFILER) == ENABLED)
+ot_u32 platform_get_cycles() {
+/// Nanoseconds of the host clock (a 1 GHz "cycle"), or of the virtual time
+    struct timespec now;
+    if (posixsim.on) {
+        return (ot_u32)(((long long)posixsim.now * NSEC_PER_SEC) >> 10);
+    }
+    clock_gettime(OT_GPTIM_CLOCK, &now);
+    return (ot_u32)(((long long)now.tv_sec * NSEC_PER_SEC) + now.tv_nsec);
+}
+#endif
+
+void platform_set_gptim(ot_u16 value) {
+    platform_set_ktim(value);
+}
+
+void platform_set_ktim(ot_u32 value) {
+    posix.vgptim_start = posixsim.now;
+    clock_gettime(OT_GPTIM_CLOCK, &posix.gptim_start);
+    platform_posix_settimer(&posix.gptim, (ot_long)value);
+}
+
+void platform_flush_gptim() {
+    posix.vgptim_start = posixsim.now;
+    clock_gettime(OT_GPTIM_CLOCK, &posix.gptim_start);
+    platform_posix_settimer(&posix.gptim, -1);
+}
+
+void platform_run_watchdog() {
+}
+
+void platform_reset_watchdog(ot_u16 reset) {
+}
+
+void platform_enable_rtc() {
+}
+
+void platform_disable_rtc() {
+}
+
+ot_u32 platform_get_time() {
+/// In virtual time, the clock starts at 0 with the run
+#if (OT_FEATURE(RTC) == ENABLED)
+    if (posixsim.on) {
+        return posixsim.now >> 10;
+    }
+    return (ot_u32)time(NULL);
+#else
+    return 0;
+#endif
+}
+
+void platform_set_time(ot_u32 utc_time) {
+/// The host clock is not changed by a node
+}
+
+void platform_set_rtc_alarm(ot_u8 alarm_i, ot_u16 mask, ot_u16 value) {
+}
+
+void platform_enable_rtc_alarm(ot_u8 alarm_id, ot_bool enable) {
+}
+
+
+
+
+
+
+
+
+/** Platform Debug Triggers <BR>
+  * ========================================================================<BR>
+  * There are no pins, so the triggers only keep their state.
+  */
+void platform_trig1_high() {    posix.trig |= 1; }
+void platform_trig1_low() {     posix.trig &= ~1; }
+void platform_trig1_toggle() {  posix.trig ^= 1; }
+void platform_trig2_high() {    posix.trig |= 2; }
+void platform_trig2_low() {     posix.trig &= ~2; }
+void platform_trig2_toggle() {  posix.trig ^= 2; }
+
+
+
+
+
+
+
+
+/** Platform Random Number Generation Routines <BR>
+  * ========================================================================<BR>
+  * The platform should be able to generate a true random number from the host
+  * (platform_rand(), via /dev/urandom).  The "pseudo" random number generator
+  * is in otlib/prand.c, and its seed should differ between nodes, or the nodes
+  * will pick the same CSMA slots.  In virtual time, platform_rand() is made by
+  * prand, so a run (with the prand reseeds) can be repeated.
+  */
+void platform_rand(ot_u8* rand_out, ot_int bytes_out) {
+    int     fd;
+    ot_int  got = 0;
+
+    fd = posixsim.on ? -1 : open("/dev/urandom", O_RDONLY);
+    if (fd >= 0) {
+        while (got < bytes_out) {
+            ssize_t n = read(fd, &rand_out[got], (size_t)(bytes_out - got));
+            if (n <= 0) {
+                if ((n < 0) && (errno == EINTR)) continue;
+                break;
+            }
+            got += (ot_int)n;
+        }
+        close(fd);
+    }
+
+    /// Fallback if the host has no entropy device, and virtual time
+    for (; got < bytes_out; got++) {
+        rand_out[got] = platform_prand_u8();
+    }
+}
+
+
+
+
+
+/** Platform Sensor ADC Routines <BR>
+  * ========================================================================<BR>
+  * There is no ADC on the host, so a burst is made up at once: channel n reads
+  * about 2048 + 512n counts, plus a ramp of 1 count per second and a few
+  * counts of noise, which is enough to watch the sensor pipeline work.
+  */
+#if (OT_FEATURE(SENSORS) == ENABLED)
+ot_bool platform_adc_start(ot_u16* buffer, ot_u8 channels, ot_u8 rounds) {
+    ot_u16 ramp = (ot_u16)((platform_get_ktim() >> 10) & 0xFF);
+    ot_u8  i, j;
+
+    for (i=0; i<rounds; i++) {
+        for (j=0; j<channels; j++) {
+            *buffer++ = (2048 + (j << 9) + ramp + (platform_prand_u8() & 7)) & 0x0FFF;
+        }
+    }
+    return True;
+}
+
+ot_bool platform_adc_busy() {
+    return False;
+}
+#endif
+
+
+
+
+
+/** Platform memcpy Routines <BR>
+  * ========================================================================<BR>
+  * The host library versions are as fast as anything here could be.
+  */
+void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
+    if (length > 0) {
+        memcpy(dest, src, (size_t)length);
+    }
+}
+
+
+void platform_memcpy_2(ot_u16* dest, ot_u16* src, ot_int length) {
+/// Same as platform_memcpy(), but length is in 16 bit words
+    if (length > 0) {
+        memcpy(dest, src, (size_t)length << 1);
+    }
+}
+
+
+void platform_memcpy_async(ot_u8* dest, ot_u8* src, ot_int length) {
+    platform_memcpy(dest, src, length);
+}
+
+
+ot_bool platform_memcpy_busy() {
+    return False;
+}
+
+
+void platform_memcpy_wait() {
+}
+
+
+void platform_memset(ot_u8* dest, ot_u8 value, ot_int length) {
+    if (length > 0) {
+        memset(dest, value, (size_t)length);
+    }
+}
+
+
+
+
+
+
+
+
+/** Platform Utility Functions <BR>
+  * ========================================================================<BR>
+  */
+
+void sub_ti_sleep(ot_uint n, long nsec_each) {
+    struct timespec span;
+    long long       nsec = (long long)n * nsec_each;
+
+    /// A delay in virtual time is the node being busy, so the clock moves on
+    if (posixsim.on) {
+        posixsim.now += (ot_u32)((nsec << 10) / NSEC_PER_SEC);
+        return;
+    }
+    span.tv_sec     = (time_t)(nsec / NSEC_PER_SEC);
+    span.tv_nsec    = (long)(nsec % NSEC_PER_SEC);
+    while (nanosleep(&span, &span) != 0) {
+        if (errno != EINTR) break;
+    }
+}
+
+void platform_delay(ot_uint n) {
+/// n ti (1/1024 s); signals do not cut the delay short
+    sub_ti_sleep(n, 976563);
+}
+
+void platform_swdelay_ms(ot_uint n) {
+    sub_ti_sleep(n, 1000000);
+}
+
+void platform_swdelay_us(ot_uint n) {
+    sub_ti_sleep(n, 1000);
+}
+
+
+
+
+
+/** Firmware Banks <BR>
+  * ========================================================================<BR>
+  * A POSIX node has no firmware of its own, so the banks are RAM.  Commit is
+  * the bootloader: it copies the update bank over the running one.
+  */
+#if (OT_FEATURE(OTA) == ENABLED)
+static ot_u8 posix_fw[2][POSIX_FW_BYTES];
+
+ot_u8 platform_fw_read(ot_u8 bank, ot_u32 addr, ot_u8* data, ot_uint length) {
+    if ((bank > 1) || (addr > POSIX_FW_BYTES) || (length > (POSIX_FW_BYTES - addr))) {
+        return 1;
+    }
+    memcpy(data, &posix_fw[bank][addr], length);
+    return 0;
+}
+
+ot_u8 platform_fw_write(ot_u32 addr, ot_u8* data, ot_uint length) {
+    if ((addr > POSIX_FW_BYTES) || (length > (POSIX_FW_BYTES - addr))) {
+        return 1;
+    }
+    memcpy(&posix_fw[1][addr], data, length);
+    return 0;
+}
+
+void platform_fw_commit(ot_u32 length) {
+    memcpy(posix_fw[0], posix_fw[1], length);
+}
+#endif
+
+
+
+
+
+/** Serial Flash <BR>
+  * ========================================================================<BR>
+  * A POSIX node has no SPI, so the serial flash is RAM with NOR rules.  The
+  * operations are done at once, so the chip is never busy.
+  */
+#if (OT_FEATURE(VSFLASH) == ENABLED)
+static ot_u8 posix_sflash[(ot_u32)SFLASH_SECTOR_SIZE * SFLASH_NUM_SECTORS];
+
+ot_u8 platform_sflash_read(ot_u32 addr, ot_u8* data, ot_uint length) {
+    if ((addr > sizeof(posix_sflash)) || (length > (sizeof(posix_sflash) - addr))) {
+        return 1;
+    }
+    memcpy(data, &posix_sflash[addr], length);
+    return 0;
+}
+
+ot_u8 platform_sflash_program(ot_u32 addr, ot_u8* data, ot_uint length) {
+    if ((addr > sizeof(posix_sflash)) || (length > (sizeof(posix_sflash) - addr)) || \
+        (((addr % SFLASH_PAGE_SIZE) + length) > SFLASH_PAGE_SIZE)) {
+        return 1;
+    }
+    while (length-- > 0) {
+        posix_sflash[addr++] &= *data++;
+    }
+    return 0;
+}
+
+ot_u8 platform_sflash_erase(ot_u32 addr) {
+    if (addr >= sizeof(posix_sflash)) {
+        return 1;
+    }
+    addr -= (addr % SFLASH_SECTOR_SIZE);
+    memset(&posix_sflash[addr], 0xFF, SFLASH_SECTOR_SIZE);
+    return 0;
+}
+
+ot_bool platform_sflash_busy(void) {
+    return False;
+}
+#endif
@@ -0,0 +1,215 @@
+/* Copyright 2009-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTplatform/POSIX/platform_POSIX.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Platform Library Macros and Functions for POSIX hosts
+  * @ingroup    Platform
+  *
+  ******************************************************************************
+  */
+
+
+#ifndef __PLATFORM_POSIX_H
+#define __PLATFORM_POSIX_H
+
+#include "build_config.h"
+#include "OT_support.h"
+#include "OT_types.h"
+
+#include "sim_POSIX.h"
+
+#include <signal.h>
+#include <time.h>
+
+
+
+/** Platform Support settings
+  * These reference the exhaustive list of officially supported platform
+  * setting options.  PLATFORM_POSIX selects the POSIX prototype of
+  * platform_init_gptim() in OT_platform.h.
+  */
+#define PLATFORM(VAL)           PLATFORM_##VAL
+#define PLATFORM_POSIX          ENABLED
+
+#if (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__))
+#   ifndef __BIG_ENDIAN__
+#       error "Endian-ness misdefined, should be __BIG_ENDIAN__ (check build_config.h)"
+#   endif
+#   define PLATFORM_ENDIAN16(VAR16)    (VAR16)
+#   define PLATFORM_ENDIAN32(VAR32)    (VAR32)
+#else
+#   ifndef __LITTLE_ENDIAN__
+#       error "Endian-ness misdefined, should be __LITTLE_ENDIAN__ (check build_config.h)"
+#   endif
+#   define PLATFORM_ENDIAN16(VAR16)    __builtin_bswap16(VAR16)
+#   define PLATFORM_ENDIAN32(VAR32)    __builtin_bswap32(VAR32)
+#endif
+#define PLATFORM_UNALIGNED          ENABLED     // hosts load words at any address
+
+// How many bytes is a pointer?
+#if defined(__LP64__)
+#   define PLATFORM_POINTER_SIZE   8
+#else
+#   define PLATFORM_POINTER_SIZE   4
+#endif
+
+// Stack bytes that sys_stack_paint() may fill, from the main thread stack
+#ifndef PLATFORM_STACK_SIZE
+#   define PLATFORM_STACK_SIZE  8192
+#endif
+
+// Bytes in each RAM firmware bank of the OTA update (OT_FEATURE_OTA)
+#ifndef POSIX_FW_BYTES
+#   define POSIX_FW_BYTES       65536
+#endif
+
+// Serial flash in RAM (OT_FEATURE_VSFLASH): 256 byte pages, 4 KB sectors
+#define SFLASH_PAGE_SIZE        256
+#define SFLASH_SECTOR_SIZE      4096
+#ifndef SFLASH_NUM_SECTORS
+#   define SFLASH_NUM_SECTORS   64
+#endif
+#define SFLASH_ERASE_TICKS      1
+
+
+
+
+/** Interrupt Nomenclature  <BR>
+  * ========================================================================<BR>
+  * Interrupts are signal handlers, which need no special attributes.
+  */
+#define OT_IRQPRAGMA(VAL)
+#define OT_INTERRUPT
+
+
+
+
+/** Low Power Mode Macros:
+  * A sleeping node waits for the next signal (i.e. interrupt).  There is no
+  * difference between the sleep depths on a host.
+  */
+#define SLEEP_MCU()         platform_posix_sleep()
+#define SLEEP_WHILE_UHF()   platform_posix_sleep()
+#define STOP_MCU()          platform_posix_sleep()
+#define STANDBY_MCU()       platform_posix_sleep()
+
+#define MCU_SLEEP_WHILE_RF() SLEEP_WHILE_UHF()
+
+
+
+
+/** POSIX Platform Services  <BR>
+  * ========================================================================<BR>
+  * Used by the drivers in /otplatform/posix and /otradio/posix.  Apps do not
+  * normally need them.
+  */
+
+/** @brief Waits for the next interrupt (signal), with interrupts enabled
+  * @param None
+  * @retval None
+  * @ingroup Platform
+  */
+void platform_posix_sleep();
+
+
+/** @brief Installs an interrupt handler on a signal
+  * @param signo        (int) signal number, such as OT_GPTIM_VECTOR
+  * @param isr          (void (*)(int)) handler
+  * @retval None
+  * @ingroup Platform
+  *
+  * The signal joins the interrupt set, so it is masked by
+  * platform_disable_interrupts() and it wakes platform_posix_sleep().  The
+  * handler masks all signals already in the set, like interrupts of the same
+  * priority.
+  */
+void platform_posix_isr(int signo, void (*isr)(int));
+
+
+/** @brief Creates a one-shot timer that raises a signal
+  * @param timer        (timer_t*) timer to create
+  * @param signo        (int) signal raised at expiry
+  * @retval None
+  * @ingroup Platform
+  */
+void platform_posix_timer(timer_t* timer, int signo);
+
+
+/** @brief Starts a one-shot timer in GPTIM ticks (ti), or stops it
+  * @param timer        (timer_t*) timer from platform_posix_timer()
+  * @param ticks        (ot_long) ticks until expiry, or negative to stop
+  * @retval None
+  * @ingroup Platform
+  *
+  * A zero tick timer expires right away.  A timer never expires early.
+  */
+void platform_posix_settimer(timer_t* timer, ot_long ticks);
+
+
+/** @brief Returns the monotonic time of the host, in GPTIM ticks (ti)
+  * @param None
+  * @retval ot_u32      ticks since an arbitrary start
+  * @ingroup Platform
+  *
+  * In virtual time, it is the virtual time since the start of the run.
+  */
+ot_u32 platform_posix_ticks();
+
+
+/** @brief Returns the node number of this process
+  * @param None
+  * @retval ot_u16      node number, from the OT_NODE environment variable
+  * @ingroup Platform
+  *
+  * The node number goes into the UID and VID of the node, and it names the
+  * file system image.  Without OT_NODE, it is taken from the process ID.
+  */
+ot_u16 platform_posix_nodeid();
+
+
+/** @brief Returns True if the node runs in virtual time
+  * @param None
+  * @retval ot_bool     True when the OT_SIM environment variable is set
+  * @ingroup Platform
+  *
+  * In virtual time, the simulator (Supplements/ot_sim.c) owns the clock and
+  * the air (see sim_POSIX.h).  The virtual timers of platform_posix_timer()
+  * and the simulator events run in platform_posix_sleep().
+  */
+ot_bool platform_posix_sim();
+
+
+/** @brief Sends a message to the simulator
+  * @param msg          (sim_msg*) message, of SIM_MSG_HEAD + length bytes
+  * @retval None
+  * @ingroup Platform
+  */
+void platform_posix_simsend(sim_msg* msg);
+
+
+/** @brief Returns the frame event that the radio ISR is called for
+  * @param None
+  * @retval sim_msg*    SIM_MSG_START or SIM_MSG_END, or NULL if the ISR runs
+  *                     for another reason
+  * @ingroup Platform
+  */
+sim_msg* platform_posix_simevent();
+
+
+#endif
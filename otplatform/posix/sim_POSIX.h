@@ -0,0 +1,138 @@
+/* Copyright 2010-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTplatform/POSIX/sim_POSIX.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Messages between POSIX nodes and the virtual time simulator
+  * @ingroup    Platform
+  *
+  * In virtual time, a node does not use host timers or the multicast air.  It
+  * talks to the simulator (Supplements/ot_sim.c) on a SOCK_SEQPACKET socket,
+  * one message per packet, and the simulator owns the clock and the channel.
+  *
+  * The simulator runs the nodes in windows of virtual time.  A frame that a
+  * node sends at time t starts at the other nodes at t + lookahead, so the
+  * nodes cannot affect each other inside a window shorter than that, and all
+  * the nodes with something to do in it run at once, each in its process:
+  *
+  * 1. The simulator sends the frame and signal events of the window to a node
+  *    (START, END, SIGNAL, in time order), then RUN with the end of the window.
+  * 2. The node runs its own timers and these events in time order, up to the
+  *    end of the window.  Each frame it sends is a TX message.
+  * 3. The node sends SLEEP with the time of its next timer, and waits.
+  *
+  * STOP ends the run.  The node answers it with STATS, and exits.
+  *
+  * This header is shared with the simulator, which is built without the rest
+  * of OpenTag, so it only uses the standard integer types.  Both ends run on
+  * the same host, so the messages are in host byte order.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __SIM_POSIX_H
+#define __SIM_POSIX_H
+
+#include <stdint.h>
+
+
+/// Environment variable with the socket descriptor, set by the simulator
+#define SIM_ENV             "OT_SIM"
+
+/// Most events in one window, and most data bytes in one message
+#define SIM_EVENTS          16
+#define SIM_FRAME_MAX       512
+
+/// Time of a node that has no timer running
+#define SIM_NEVER           0xFFFFFFFF
+
+
+/** Message types
+  * Node to simulator:
+  * SIM_MSG_SLEEP   the node is done with the window.  arg is its next timer.
+  * SIM_MSG_TX      a frame goes on the air at time.  arg is the time its packet
+  *                 was queued for TX, or SIM_NEVER if it is not the first frame.
+  * SIM_MSG_STATS   radio statistics, as uint32_t in the order of sim_stats
+  *
+  * Simulator to node:
+  * SIM_MSG_RUN     run up to (not including) arg
+  * SIM_MSG_START   a frame from node arg starts, with its RSSI and airtime
+  * SIM_MSG_END     the frame from node arg ends.  corrupt is set if it was
+  *                 lost to interference, or other frames captured it.
+  * SIM_MSG_SIGNAL  the signal arg is raised in the node (app stimulus)
+  * SIM_MSG_STOP    end of the run
+  */
+#define SIM_MSG_SLEEP       1
+#define SIM_MSG_TX          2
+#define SIM_MSG_STATS       3
+#define SIM_MSG_RUN         4
+#define SIM_MSG_START       5
+#define SIM_MSG_END         6
+#define SIM_MSG_SIGNAL      7
+#define SIM_MSG_STOP        8
+
+
+/** sim_msg
+  * Only the first SIM_MSG_HEAD + length bytes are sent.
+  *
+  * type        SIM_MSG_...
+  * channel     channel ID of the frame
+  * eirp        TX EIRP code of the frame, as in phymac
+  * corrupt     END: the frame is lost
+  * rssi        START: RSSI at the node (dBm)
+  * duration    airtime of the frame (ti)
+  * time        virtual time of the message (ti)
+  * arg         depends on the type
+  * length      bytes of data
+  */
+typedef struct {
+    uint8_t     type;
+    uint8_t     channel;
+    uint8_t     eirp;
+    uint8_t     corrupt;
+    int16_t     rssi;
+    uint16_t    duration;
+    uint32_t    time;
+    uint32_t    arg;
+    uint16_t    length;
+    uint16_t    reserved;
+    uint8_t     data[SIM_FRAME_MAX];
+} sim_msg;
+
+#define SIM_MSG_HEAD        20
+
+
+/** sim_stats
+  * The data of SIM_MSG_STATS.  listen_ti is the time the receiver was on, and
+  * tx_ti the airtime of the frames sent, for the energy of the node.
+  */
+typedef struct {
+    uint32_t    tx_frames;
+    uint32_t    tx_bytes;
+    uint32_t    rx_frames;
+    uint32_t    rx_bytes;
+    uint32_t    rx_crcerrs;
+    uint32_t    rx_collisions;
+    uint32_t    rx_weak;
+    uint32_t    cca_busy;
+    uint32_t    listen_ti;
+    uint32_t    tx_ti;
+} sim_stats;
+
+
+#endif
@@ -0,0 +1,512 @@
+/* Copyright 2009-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTplatform/POSIX/veelite_core_POSIX.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Veelite Core Functions for POSIX hosts
+  * @ingroup    Veelite
+  *
+  * VWORM is an image file that is mapped into memory, so the file system of
+  * each node survives a restart, like flash does.  The image is named from the
+  * node number (ot_node_<N>.vworm, in the working directory).  A new image is
+  * made from the stock files of the app.  Delete it to restore the defaults.
+  *
+  * The image is plain memory: there are no erases, no wear leveling and no
+  * ancillary blocks, so every span can be read in place, and vworm_mapstamp
+  * and vworm_stats never change.  VSRAM is a RAM array.
+  *
+  * The app must define the stock file arrays (overhead_files, isfs_stock_codes,
+  * gfb_stock_files, isf_stock_files).  On a host they can not be located at
+  * their virtual addresses, so they are copied there.  The arrays are usually
+  * shorter than their blocks (unused user headers are left out), so the app
+  * also defines vl_stock_bytes[] with their sizes, and the rest of each block
+  * stays erased, as it does in flash.
+  ******************************************************************************
+  */
+
+#include "OT_types.h"
+#include "OT_config.h"
+#include "OT_platform.h"
+#include "veelite_core.h"
+#include "crc16.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#if (VSRAM_SIZE > 0)
+    static ot_u16 vsram[ (VSRAM_SIZE/2) ];
+#endif
+
+static ot_u16* vworm = NULL;
+
+vworm_stats_struct vworm_stats;     // the image has no erase cycles to count
+ot_u16 vworm_mapstamp;              // the image is never remapped
+
+extern const ot_u8 overhead_files[];
+extern const ot_u8 isfs_stock_codes[];
+extern const ot_u8 gfb_stock_files[];
+extern const ot_u8 isf_stock_files[];
+extern const ot_uint vl_stock_bytes[4];
+
+
+
+
+/** Generic Veelite Core Function Implementations <BR>
+  * ========================================================================<BR>
+  */
+
+vas_loc vas_check(vaddr addr) {
+    if ((vaddr)(addr - VWORM_BASE_VADDR) < (VWORM_PRIMARY_PAGES*VWORM_PAGESIZE)) {
+        return in_vworm;
+    }
+    if ((addr >= VSRAM_BASE_VADDR) && \
+        (addr < (VSRAM_BASE_VADDR+VSRAM_SIZE)) ) {
+        return in_vsram;
+    }
+    return vas_error;
+}
+
+
+
+
+/** VWORM Functions <BR>
+  * ========================================================================<BR>
+  */
+
+void sub_copy_stock(ot_u8* dst, const ot_u8* src, ot_uint bytes, ot_uint limit) {
+    memcpy(dst, src, (bytes < limit) ? bytes : limit);
+}
+
+
+
+ot_u8 vworm_format( ) {
+    ot_u8* base = (ot_u8*)vworm;
+
+    memset(base, 0xFF, VWORM_ALLOC);
+    sub_copy_stock(base + OVERHEAD_START_VADDR, overhead_files, vl_stock_bytes[0], OVERHEAD_TOTAL_BYTES);
+    sub_copy_stock(base + ISFS_START_VADDR, isfs_stock_codes, vl_stock_bytes[1], ISFS_TOTAL_BYTES);
+#   if (GFB_TOTAL_BYTES > 0)
+    sub_copy_stock(base + GFB_START_VADDR, gfb_stock_files, vl_stock_bytes[2], GFB_TOTAL_BYTES);
+#   endif
+    sub_copy_stock(base + ISF_START_VADDR, isf_stock_files, vl_stock_bytes[3], ISF_TOTAL_BYTES);
+
+    return 0;
+}
+
+
+
+
+ot_u8 vworm_init( ) {
+/// Maps the image of this node, and makes it from the stock files if it is new
+    char        name[32];
+    int         fd;
+    struct stat st;
+    ot_bool     fresh;
+
+    if (vworm != NULL) {
+        return 0;
+    }
+
+    snprintf(name, sizeof(name), "ot_node_%u.vworm", platform_posix_nodeid());
+    fd = open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(name);
+        return MEM_HW_FAULT;
+    }
+
+    fresh = (ot_bool)((fstat(fd, &st) != 0) || (st.st_size != VWORM_ALLOC));
+    if (fresh && (ftruncate(fd, VWORM_ALLOC) != 0)) {
+        close(fd);
+        return MEM_HW_FAULT;
+    }
+
+    vworm = (ot_u16*)mmap(NULL, VWORM_ALLOC, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (vworm == (ot_u16*)MAP_FAILED) {
+        vworm = NULL;
+        return MEM_HW_FAULT;
+    }
+
+    if (fresh) {
+        vworm_format();
+    }
+
+    return 0;
+}
+
+
+
+
+ot_u8 vworm_save( ) {
+    return vworm_flush();
+}
+
+
+
+
+/// The image file is the flash, so there is no block table to save.  The
+/// snapshot of the spans goes into a file next to it: the generation, the
+/// length of the spans, the spans, and a CRC16 of all that.
+#if (OT_FEATURE(VLSNAPSHOT) == ENABLED)
+#define POSIX_SNAPSHOT_BYTES    4096
+
+static ot_u16  vworm_generation;
+static ot_bool vworm_snapshot_saved;
+
+static void sub_snapshot_name(char* name, int size) {
+    snprintf(name, size, "ot_node_%u.snap", platform_posix_nodeid());
+}
+
+/// A write after vworm_save_snapshot() makes the snapshot out of date
+#   define POSIX_SNAPSHOT_VOID()    if (vworm_snapshot_saved) sub_snapshot_void()
+
+static void sub_snapshot_void() {
+    char name[32];
+    sub_snapshot_name(name, sizeof(name));
+    unlink(name);
+    vworm_snapshot_saved = False;
+}
+
+
+ot_u8 vworm_save_snapshot(const vworm_span* span, ot_int spans) {
+    char    name[32];
+    ot_u8   buffer[POSIX_SNAPSHOT_BYTES];
+    ot_u8*  cursor;
+    ot_u16  word;
+    ot_uint ext;
+    ot_int  i;
+    FILE*   fp;
+
+    for (i=0, ext=0; i<spans; i++) {
+        ext += span[i].length;
+    }
+    if (ext > (POSIX_SNAPSHOT_BYTES-6)) {
+        ext     = 0;
+        spans   = 0;
+    }
+
+    vworm_generation++;
+    cursor  = buffer;
+    memcpy(cursor, &vworm_generation, 2);   cursor += 2;
+    word    = (ot_u16)ext;
+    memcpy(cursor, &word, 2);               cursor += 2;
+    for (i=0; i<spans; i++) {
+        memcpy(cursor, span[i].data, span[i].length);
+        cursor += span[i].length;
+    }
+    word    = crc_calc_block((ot_int)(cursor-buffer), buffer);
+    memcpy(cursor, &word, 2);               cursor += 2;
+
+    sub_snapshot_name(name, sizeof(name));
+    fp = fopen(name, "wb");
+    if (fp == NULL) {
+        return MEM_HW_FAULT;
+    }
+    i = (ot_int)fwrite(buffer, 1, (size_t)(cursor-buffer), fp);
+    fclose(fp);
+    vworm_snapshot_saved = True;
+
+    return (vworm_flush() | ((i != (cursor-buffer)) ? MEM_HW_FAULT : 0));
+}
+
+
+ot_u8 vworm_load_snapshot(const vworm_span* span, ot_int spans) {
+    char    name[32];
+    ot_u8   buffer[POSIX_SNAPSHOT_BYTES];
+    ot_u8*  cursor;
+    ot_u16  word;
+    ot_uint ext;
+    ot_int  i;
+    ot_int  size;
+    FILE*   fp;
+
+    // A snapshot is only good once: it is removed whatever happens
+    sub_snapshot_name(name, sizeof(name));
+    fp = fopen(name, "rb");
+    if (fp == NULL) {
+        return 1;
+    }
+    size = (ot_int)fread(buffer, 1, sizeof(buffer), fp);
+    fclose(fp);
+    unlink(name);
+
+    for (i=0, ext=0; i<spans; i++) {
+        ext += span[i].length;
+    }
+    if ((spans == 0) || (size != (ot_int)(ext+6))) {
+        return 1;
+    }
+    memcpy(&word, &buffer[size-2], 2);
+    if (word != crc_calc_block(size-2, buffer)) {
+        return 1;
+    }
+    memcpy(&word, &buffer[2], 2);
+    if (word != ext) {
+        return 1;
+    }
+
+    memcpy(&vworm_generation, buffer, 2);
+    cursor = &buffer[4];
+    for (i=0; i<spans; i++) {
+        memcpy(span[i].data, cursor, span[i].length);
+        cursor += span[i].length;
+    }
+    return 0;
+}
+#else
+#   define POSIX_SNAPSHOT_VOID()    while(0)
+#endif
+
+
+
+
+ot_u8 vworm_flush( ) {
+    if (vworm == NULL) {
+        return 0;
+    }
+    return (msync(vworm, VWORM_ALLOC, MS_SYNC) != 0) ? MEM_HW_FAULT : 0;
+}
+
+
+
+
+ot_u8 vworm_window(ot_bool open) {
+/// There are no erases to hold back
+    return 0;
+}
+
+
+
+
+ot_u16 vworm_read(vaddr addr) {
+    addr -= VWORM_BASE_VADDR;
+    if (addr >= VWORM_ALLOC) {
+        return 0xFFFF;
+    }
+    return vworm[addr >> 1];
+}
+
+
+
+
+ot_u8 vworm_write(vaddr addr, ot_u16 data) {
+    addr -= VWORM_BASE_VADDR;
+    if (addr >= VWORM_ALLOC) {
+        return MEM_ADDR_FAULT;
+    }
+    POSIX_SNAPSHOT_VOID();
+    vworm[addr >> 1] = data;
+    return 0;
+}
+
+
+
+
+ot_u8 vworm_mark(vaddr addr, ot_u16 value) {
+    return vworm_write(addr, value);
+}
+
+
+ot_u8 vworm_mark_physical(ot_u16* addr, ot_u16 value) {
+    *addr = value;
+    return 0;
+}
+
+
+
+
+ot_u8* vworm_get(vaddr addr) {
+    addr -= VWORM_BASE_VADDR;
+    return (ot_u8*)vworm + addr;
+}
+
+
+
+
+const ot_u8* vworm_get_direct(vaddr addr, ot_uint length) {
+/// The image is contiguous, so every span can be read in place
+    addr -= VWORM_BASE_VADDR;
+    if (((ot_u32)addr + length) > VWORM_ALLOC) {
+        return NULL;
+    }
+    return (const ot_u8*)vworm + addr;
+}
+
+
+
+
+ot_u8 vworm_read_block(vaddr addr, ot_u8* data, ot_uint length) {
+    addr -= VWORM_BASE_VADDR;
+    if (((ot_u32)addr + length) > VWORM_ALLOC) {
+        return MEM_ADDR_FAULT;
+    }
+    memcpy(data, (ot_u8*)vworm + addr, length);
+    return 0;
+}
+
+
+
+
+ot_u8 vworm_write_block(vaddr addr, ot_u8* data, ot_uint length) {
+    addr -= VWORM_BASE_VADDR;
+    if (((ot_u32)addr + length) > VWORM_ALLOC) {
+        return MEM_ADDR_FAULT;
+    }
+    POSIX_SNAPSHOT_VOID();
+    memcpy((ot_u8*)vworm + addr, data, length);
+    return 0;
+}
+
+
+
+
+void sub_restore_stock(vaddr addr, vaddr end, vaddr start, ot_uint total, 
+                        const ot_u8* stock, ot_uint bytes) {
+/// Restores the part of [addr, end) in one block: stock bytes, then erased
+    ot_u8*  base = (ot_u8*)vworm;
+    vaddr   stop;
+    
+    addr    = (addr > start) ? addr : start;
+    end     = (end < (start+total)) ? end : (start+total);
+    stop    = start + ((bytes < total) ? bytes : total);
+    
+    if (addr >= end) {
+        return;
+    }
+    if (addr < stop) {
+        ot_uint span = ((end < stop) ? end : stop) - addr;
+        memcpy(base + addr, stock + (addr - start), span);
+        addr += span;
+    }
+    if (addr < end) {
+        memset(base + addr, 0xFF, end - addr);
+    }
+}
+
+
+
+ot_u8 vworm_restore(vaddr addr, ot_uint length) {
+    vaddr end = addr + length;
+    
+    if (((ot_u32)addr + length) > VWORM_ALLOC) {
+        return MEM_ADDR_FAULT;
+    }
+    POSIX_SNAPSHOT_VOID();
+    sub_restore_stock(addr, end, OVERHEAD_START_VADDR, OVERHEAD_TOTAL_BYTES, overhead_files, vl_stock_bytes[0]);
+    sub_restore_stock(addr, end, ISFS_START_VADDR, ISFS_TOTAL_BYTES, isfs_stock_codes, vl_stock_bytes[1]);
+#   if (GFB_TOTAL_BYTES > 0)
+    sub_restore_stock(addr, end, GFB_START_VADDR, GFB_TOTAL_BYTES, gfb_stock_files, vl_stock_bytes[2]);
+#   endif
+    sub_restore_stock(addr, end, ISF_START_VADDR, ISF_TOTAL_BYTES, isf_stock_files, vl_stock_bytes[3]);
+    
+    return 0;
+}
+
+
+
+
+void vworm_print_table() {
+}
+
+
+
+
+ot_u8 vworm_wipeblock(vaddr addr, ot_uint wipe_span) {
+    addr -= VWORM_BASE_VADDR;
+    if (((ot_u32)addr + wipe_span) > VWORM_ALLOC) {
+        return MEM_ADDR_FAULT;
+    }
+    memset((ot_u8*)vworm + addr, 0xFF, wipe_span);
+    return 0;
+}
+
+
+
+ot_u16 vworm_wear(ot_int page) {
+/// The image has no pages to wear
+    return 0;
+}
+
+
+
+
+ot_u8 vworm_factory( ) {
+/// The stock image is kept apart here, and a format writes all of it in bulk
+    return vworm_format();
+}
+
+
+
+
+
+
+
+/** VSRAM Functions <BR>
+  * ========================================================================<BR>
+  */
+
+#if (VSRAM_SIZE > 0)
+
+ot_u16 vsram_read(vaddr addr) {
+    addr -= VSRAM_BASE_VADDR;
+    return vsram[addr >> 1];
+}
+
+
+ot_u8 vsram_mark(vaddr addr, ot_u16 value) {
+    addr -= VSRAM_BASE_VADDR;
+    if (addr >= VSRAM_SIZE) {
+        return MEM_ADDR_FAULT;
+    }
+    vsram[addr >> 1] = value;
+    return 0;
+}
+
+
+ot_u8 vsram_mark_physical(ot_u16* addr, ot_u16 value) {
+    *addr = value;
+    return 0;
+}
+
+
+ot_u8* vsram_get(vaddr addr) {
+    addr -= VSRAM_BASE_VADDR;
+    return (ot_u8*)vsram + addr;
+}
+
+
+ot_u8 vsram_read_block(vaddr addr, ot_u8* data, ot_uint length) {
+    addr -= VSRAM_BASE_VADDR;
+    memcpy(data, (ot_u8*)vsram + addr, length);
+    return 0;
+}
+
+
+ot_u8 vsram_write_block(vaddr addr, ot_u8* data, ot_uint length) {
+    addr -= VSRAM_BASE_VADDR;
+    memcpy((ot_u8*)vsram + addr, data, length);
+    return 0;
+}
+
+#endif
+
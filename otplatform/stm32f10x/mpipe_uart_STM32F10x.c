@@ -22,10 +22,11 @@
   * @defgroup   MPipe (Message Pipe)
   * @ingroup    MPipe
   *
-  * Baudrates supported:    9600, 115200                                        <BR>
+  * Baudrates supported:    9600 to 3 Mbps (all of mpipe_speed, to UARTCLK/16)  <BR>
   * Byte structure:         8N1                                                 <BR>
   * Duplex:                 Half                                                <BR>
-  * Flow control:           Custom, ACK-based                                   <BR>
+  * Flow control:           Custom, ACK-based, and HW RTS/CTS if the board      <BR>
+  *                         has MPIPE_RTS_PIN and MPIPE_CTS_PIN                 <BR>
   * Connection:             RS-232, DTE-DTE (use a null-modem connector)        <BR><BR>
   * 
   * Implemented Mpipe Protocol:                                                 <BR>
@@ -44,9 +45,12 @@
 #include "OT_config.h"
 #include "OT_platform.h"
 
-// Compile only when MPipe is enabled, but USB is disabled
-#if ((OT_FEATURE(MPIPE) == ENABLED) && (MCU_FEATURE(MPIPEVCOM) != ENABLED))
+// Compile only when MPipe is enabled, but USB is disabled, or when the UART
+// is a port next to USB
+#if ((OT_FEATURE(MPIPE) == ENABLED) && \
+    ((MCU_FEATURE(MPIPEVCOM) != ENABLED) || (OT_FEATURE(MPIPE_PORTS) == ENABLED)))
 
+#define MPIPE_DRIVER    uart    // port name, for OT_FEATURE(MPIPE_PORTS)
 #include "mpipe.h"
 #include "OT_utils.h"
 
@@ -93,10 +97,22 @@
 
 
 
-#define DIV9600     (UARTCLK/(9600))
-#define DIV28800    (UARTCLK/(28800))
-#define DIV57600    (UARTCLK/(57600))
-#define DIV115200   (UARTCLK/(115200))
+/// The baud rate register (BRR) is UARTCLK / baud rate: a 12 bit mantissa and
+/// a 4 bit fraction of the 16x oversampling divider.  It must be at least 16,
+/// so the fastest speed is UARTCLK/16 (4.5 Mbps on APB2 at 72 MHz).
+#define MPIPE_BAUDMAX   (UARTCLK/16)
+
+/// HW flow control, when the board wires RTS and CTS of the UART.  TX waits
+/// for CTS in the UART, so the TX DMA starts at once, and RTS is deasserted
+/// while a received byte has not been taken by the RX DMA, so the host holds
+/// off between packets instead of overrunning.
+#if (defined(MPIPE_RTS_PIN) && defined(MPIPE_CTS_PIN))
+#   define MPIPE_FLOWCTL        ENABLED
+#   define MPIPE_CR3_FLOWCTL    (USART_CR3_RTSE | USART_CR3_CTSE)
+#else
+#   define MPIPE_FLOWCTL        DISABLED
+#   define MPIPE_CR3_FLOWCTL    0
+#endif
 
 
 
@@ -315,16 +331,26 @@ void sub_uart_portsetup() {
         GPIOinit.GPIO_Pin   = MPIPE_TXD_PIN;
         GPIOinit.GPIO_Mode  = GPIO_Mode_AF_PP;
         GPIO_Init(MPIPE_TXD_PORT, &GPIOinit);
+        
+#       if (MPIPE_FLOWCTL == ENABLED)
+        GPIOinit.GPIO_Pin   = MPIPE_CTS_PIN;
+        GPIOinit.GPIO_Mode  = GPIO_Mode_IN_FLOATING;
+        GPIO_Init(MPIPE_CTS_PORT, &GPIOinit);
+        
+        GPIOinit.GPIO_Pin   = MPIPE_RTS_PIN;
+        GPIOinit.GPIO_Mode  = GPIO_Mode_AF_PP;
+        GPIO_Init(MPIPE_RTS_PORT, &GPIOinit);
+#       endif
     }
 
     
-    /// MPIPE UART Interrupt: 0,3 priority (high)
-    NVIC->IP[(ot_u32)MPIPE_UART_IRQn]           = b0011 << (8 - __NVIC_PRIO_BITS);
+    /// MPIPE UART Interrupt: PLATFORM_NVIC_MPIPE priority (below the radio)
+    NVIC->IP[(ot_u32)MPIPE_UART_IRQn]           = PLATFORM_NVIC_MPIPE << (8 - __NVIC_PRIO_BITS);
     NVIC->ISER[(ot_u32)(MPIPE_UART_IRQn>>5)]    = (1 << ((ot_u32)MPIPE_UART_IRQn & 0x1F));
 
-    /// MPIPE DMA RX & TX interrupts get 0,3 priority (high)
-    NVIC->IP[(ot_u32)MPIPE_DMA_RXIRQn]          = b0011 << (8 - __NVIC_PRIO_BITS);
-    NVIC->IP[(ot_u32)MPIPE_DMA_TXIRQn]          = b0011 << (8 - __NVIC_PRIO_BITS);
+    /// MPIPE DMA RX & TX interrupts get the same priority
+    NVIC->IP[(ot_u32)MPIPE_DMA_RXIRQn]          = PLATFORM_NVIC_MPIPE << (8 - __NVIC_PRIO_BITS);
+    NVIC->IP[(ot_u32)MPIPE_DMA_TXIRQn]          = PLATFORM_NVIC_MPIPE << (8 - __NVIC_PRIO_BITS);
     NVIC->ISER[(ot_u32)(MPIPE_DMA_RXIRQn>>5)]   = (1 << ((ot_u32)MPIPE_DMA_RXIRQn & 0x1F));
     NVIC->ISER[(ot_u32)(MPIPE_DMA_TXIRQn>>5)]   = (1 << ((ot_u32)MPIPE_DMA_RXIRQn & 0x1F));
 
@@ -360,7 +386,7 @@ void sub_uart_portsetup() {
     __UART_CLKON();
     MPIPE_UART->CR1 = USART_WordLength_8b | USART_Parity_No;  
     MPIPE_UART->CR2 = USART_StopBits_1;
-    MPIPE_UART->CR3 = USART_CR3_DMAR | USART_CR3_DMAT;
+    MPIPE_UART->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | MPIPE_CR3_FLOWCTL;
     MPIPE_UART->GTPR= 0;
 }
 
@@ -407,7 +433,8 @@ ot_int mpipe_init(void* port_id) {
 /// 0. "port_id" is unused in this impl, and it may be NULL
 /// 1. Set all signal callbacks to NULL, and initialize other variables.
 /// 2. Prepare the HW, which in this case is a UART
-/// 3. Set default speed, which in this case is 115200 bps
+/// 3. Set default speed, MPIPE_SPEED_DEFAULT (115200 bps unless the board
+///    changes it)
 
 #   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
         mpipe.sig_rxdone    = &otutils_sig_null;
@@ -420,7 +447,7 @@ ot_int mpipe_init(void* port_id) {
     mpipe.priority          = MPIPE_Low;
     
     sub_uart_portsetup();
-    mpipe_setspeed(MPIPE_115200bps);     //default baud rate
+    mpipe_setspeed(MPIPE_SPEED_DEFAULT);
 
     return 0;
 }
@@ -438,8 +465,12 @@ void mpipe_wait() {
 
 #ifndef EXT_mpipe_setspeed
 void mpipe_setspeed(mpipe_speed speed) {
-    static const ot_u16 br_lut[4] = { DIV9600, DIV28800, DIV57600, DIV115200 };
-    MPIPE_UART->BRR = br_lut[(ot_u8)speed];
+    static const ot_u32 baudrate[] = { MPIPE_BAUDRATES };
+    
+    while ((speed != MPIPE_9600bps) && (baudrate[speed] > MPIPE_BAUDMAX)) {
+        speed--;
+    }
+    MPIPE_UART->BRR = (ot_u16)((UARTCLK + (baudrate[speed] >> 1)) / baudrate[speed]);
 }
 #endif
 
@@ -593,5 +624,10 @@ void mpipe_isr() {
 #endif
 
 
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+MPIPE_PORT_DEFINE(NULL);
+#endif
+
+
 #endif
 
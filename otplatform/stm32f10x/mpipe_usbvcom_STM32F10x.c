@@ -37,6 +37,25 @@
   * Mpipe send an ACK/NACK.  The "YY" byte is 0 for ACK and non-zero for ACK.   <BR>
   * Presently, 0x7F is used as the YY NACK value.                               <BR>
   * [ Seq ID ] 0xDD 0x00 0x00 0x02 0x00 0xYY  [ CRC16 ]
+  *
+  * Bulk mode (OT_FEATURE_MPIPE_USBBULK):                                      <BR>
+  * TX and RX run independently.  mpipe_txndef() copies the message into one of
+  * two batch buffers, computing the CRC during the copy.  While one batch is
+  * on the bus, the other collects messages, so a transfer of 64 byte packets
+  * can carry several messages.  A transfer that ends on a full packet is ended
+  * with a ZLP.  On RX, each EP3 packet is copied from the PMA straight into
+  * its place in dir_in, and a message is delivered in place as soon as all of
+  * it is in.  EP3 NAKs until mpipe_rxndef() releases the message, so the host
+  * is throttled by USB flow control instead of by ACKs.  Bytes of the next
+  * message that came in the same packet are moved up behind the release point.
+  *
+  * On the USB-FS device (not STM32F10X_CL), bulk mode double-buffers EP1 and
+  * EP3 in the PMA.  TX loads the next packet while the last one is on the bus,
+  * and a batch is swapped out as soon as all of it is in the PMA, so messages
+  * queued meanwhile go on in the next packets without a pause.  RX copies a
+  * packet out of one PMA buffer while the host fills the other.  There is no
+  * flow control state in software: the endpoint registers tell how many PMA
+  * buffers are loaded, and the USB NAKs when both are in use.
   ******************************************************************************
   */
 
@@ -47,12 +66,17 @@
 /// Do not compile if MPIPE is disabled, or MPIPE does not use USB VCOM
 #if ((OT_FEATURE(MPIPE) == ENABLED) && (MCU_FEATURE(MPIPEVCOM) == ENABLED))
 
+#define MPIPE_DRIVER    usb     // port name, for OT_FEATURE(MPIPE_PORTS)
 #include "mpipe.h"
 #include "OT_utils.h"
 
 #include "usb_conf.h"   //local file
 #include "usb_lib.h"
 
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+#   include "buffers.h"
+#endif
+
 
 
 
@@ -65,6 +89,19 @@
 // Footer is 2 byte sequence ID + CRC (usually 2 bytes, but could be more)
 #define MPIPE_FOOTERBYTES   4
 
+// Bulk mode TX batch buffers (there are two).  Each must hold the largest
+// message, which is 265 bytes with the footer.
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+#   ifndef MPIPE_USBBULK_TXBYTES
+#       define MPIPE_USBBULK_TXBYTES    320
+#   endif
+#   define MPIPE_USB_IRQOFF()   (NVIC->ICER[MPIPE_USB_IRQn>>5] = (1 << (MPIPE_USB_IRQn & 0x1F)))
+#   define MPIPE_USB_IRQON()    (NVIC->ISER[MPIPE_USB_IRQn>>5] = (1 << (MPIPE_USB_IRQn & 0x1F)))
+#   ifndef STM32F10X_CL
+#       define MPIPE_USBDBL
+#   endif
+#endif
+
 
 typedef struct {
     mpipe_state     state;
@@ -84,6 +121,21 @@ typedef struct {
 
 typedef struct {
     ot_int i;
+
+#   if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+        ot_u16  rxlen;          // Bytes received at pktbuf
+        ot_u16  rxframe;        // Length of the delivered message (0 if none)
+        ot_bool rxpending;      // EP3 holds a packet that is not read yet
+        ot_bool txzlp;          // Last packet was full: ZLP needed to end
+        ot_u8   txfill;         // Batch being filled (the other is on the bus)
+        ot_u16  txpos;          // Bytes of the bus batch loaded so far
+        ot_u16  txlen[2];
+        ot_u8   txmsgs[2];
+#       ifdef MPIPE_USBDBL
+        ot_u8   txsent;         // Messages loaded since the pipe was idle
+#       endif
+        ot_u8   txbuf[2][MPIPE_USBBULK_TXBYTES];
+#   endif
 } mpipe_ext_struct;
 
 
@@ -99,6 +151,9 @@ mpipe_ext_struct mpipe_ext;
   */
 void sub_usb_loadtx();
 void sub_usb_portsetup();
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+void sub_usb_rxparse();
+#endif
 
 
 
@@ -887,7 +942,15 @@ void Virtual_Com_Port_Reset(void) {
 
     // Initialize Endpoint 1 
     SetEPType(ENDP1, EP_BULK);
+#   ifdef MPIPE_USBDBL
+    SetEPDoubleBuff(ENDP1);
+    SetEPDblBuffAddr(ENDP1, ENDP1_BUF0ADDR, ENDP1_BUF1ADDR);
+    SetEPDblBuffCount(ENDP1, EP_DBUF_IN, 0);
+    ClearDTOG_RX(ENDP1);
+    ClearDTOG_TX(ENDP1);
+#   else
     SetEPTxAddr(ENDP1, ENDP1_TXADDR);
+#   endif
     SetEPTxStatus(ENDP1, EP_TX_NAK);
     SetEPRxStatus(ENDP1, EP_RX_DIS);
 
@@ -899,8 +962,16 @@ void Virtual_Com_Port_Reset(void) {
 
     // Initialize Endpoint 3
     SetEPType(ENDP3, EP_BULK);
+#   ifdef MPIPE_USBDBL
+    SetEPDoubleBuff(ENDP3);
+    SetEPDblBuffAddr(ENDP3, ENDP3_BUF0ADDR, ENDP3_BUF1ADDR);
+    SetEPDblBuffCount(ENDP3, EP_DBUF_OUT, VIRTUAL_COM_PORT_DATA_SIZE);
+    ClearDTOG_RX(ENDP3);
+    ClearDTOG_TX(ENDP3);
+#   else
     SetEPRxAddr(ENDP3, ENDP3_RXADDR);
     SetEPRxCount(ENDP3, VIRTUAL_COM_PORT_DATA_SIZE);
+#   endif
     SetEPRxStatus(ENDP3, EP_RX_VALID);
     SetEPTxStatus(ENDP3, EP_TX_DIS);
 
@@ -1220,6 +1291,24 @@ void EP1_IN_Callback (void) {
 
 
 /// EP3_OUT is for USB RX (Host Output = Device RX)
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+void EP3_OUT_Callback(void) {
+/// The packet is read now, unless a delivered message is still held or RX has
+/// not been started.  Then it stays in the PMA (EP3 NAKs) until it can be.
+    if (mpipe_ext.rxlen == 0) {
+#       if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+            mpipe.sig_rxdetect(0);
+#       endif
+    }
+#   ifndef MPIPE_USBDBL
+    mpipe_ext.rxpending = True;
+#   endif
+    if ((mpipe.pktbuf != NULL) && (mpipe_ext.rxframe == 0)) {
+        sub_usb_rxparse();
+    }
+}
+
+#else
 void EP3_OUT_Callback(void) {
 /// Copy data from the USB HW buffer into the SW pipe, and also
 /// Advance the position of the pipe cursor for the next call.
@@ -1235,6 +1324,7 @@ void EP3_OUT_Callback(void) {
     
     mpipe_isr();
 }
+#endif
 
 
 /*
@@ -1271,6 +1361,180 @@ void Handle_USBAsynchXfer (void) {
 /** Mpipe Main Subroutines   <BR>
   * ========================================================================
   */
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+#ifdef MPIPE_USBDBL
+ot_u8 sub_usb_txloaded() {
+/// EP1 PMA buffers that are loaded and not sent yet.  SW_BUF (DTOG_RX) is the
+/// buffer to load next, and DTOG_TX the one the USB sends next.  When they are
+/// equal, the USB has set NAK if both are sent, and it is VALID if both are 
+/// loaded.
+    ot_u16 epval = _GetENDPOINT(ENDP1);
+    if (((epval & EP_DTOG_RX) != 0) != ((epval & EP_DTOG_TX) != 0)) {
+        return 1;
+    }
+    return ((epval & EPTX_STAT) == EP_TX_VALID) ? 2 : 0;
+}
+
+
+ot_u8 sub_usb_rxloaded() {
+/// EP3 PMA buffers that are received and not read yet.  SW_BUF (DTOG_TX) is
+/// the buffer to read next, and DTOG_RX the one the USB fills next.  When they
+/// are equal, the USB has set NAK if both are full.
+    ot_u16 epval = _GetENDPOINT(ENDP3);
+    if (((epval & EP_DTOG_TX) != 0) != ((epval & EP_DTOG_RX) != 0)) {
+        return 1;
+    }
+    return ((epval & EPRX_STAT) == EP_RX_NAK) ? 2 : 0;
+}
+#endif
+
+
+void sub_usb_rxparse() {
+/// Deliver the message at pktbuf once all of it is in, and hold EP3 until it
+/// is released.  Otherwise, read any packet waiting in the PMA, or let the
+/// host send the next one.  A message that would overflow dir_in is dropped.
+    while (1) {
+        if (mpipe_ext.rxlen >= 6) {
+            ot_u16 frame = mpipe.pktbuf[2] + (6+MPIPE_FOOTERBYTES);
+            if (mpipe_ext.rxlen >= frame) {
+                mpipe_ext.rxframe = frame;
+#               if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+                    mpipe.sig_rxdone(0);
+#               endif
+                return;
+            }
+        }
+        mpipe_ext.rxframe = 0;
+
+        if ((mpipe.pktbuf + mpipe_ext.rxlen + VIRTUAL_COM_PORT_DATA_SIZE) > \
+            (dir_in.front + dir_in.alloc)) {
+            mpipe_ext.rxlen = 0;
+        }
+#       ifdef MPIPE_USBDBL
+        {   ot_u16 count;
+            if (sub_usb_rxloaded() == 0) {
+                return;
+            }
+            if (_GetENDPOINT(ENDP3) & EP_DTOG_TX) {
+                count = GetEPDblBuf1Count(ENDP3);
+                PMAToUserBufferCopy(&mpipe.pktbuf[mpipe_ext.rxlen], ENDP3_BUF1ADDR, count);
+            }
+            else {
+                count = GetEPDblBuf0Count(ENDP3);
+                PMAToUserBufferCopy(&mpipe.pktbuf[mpipe_ext.rxlen], ENDP3_BUF0ADDR, count);
+            }
+            FreeUserBuffer(ENDP3, EP_DBUF_OUT);
+            SetEPRxValid(ENDP3);
+            mpipe_ext.rxlen += count;
+        }
+#       else
+        if (mpipe_ext.rxpending == False) {
+#           ifndef STM32F10X_CL
+                SetEPRxValid(ENDP3);
+#           endif
+            return;
+        }
+        mpipe_ext.rxpending = False;
+        mpipe_ext.rxlen    += USB_SIL_Read(EP3_OUT, &mpipe.pktbuf[mpipe_ext.rxlen]);
+#       endif
+    }
+}
+
+
+#ifdef MPIPE_USBDBL
+void sub_usb_txswap() {
+/// Put the batch that has been filling on the bus, and fill the other one
+    mpipe_ext.txsent                   += mpipe_ext.txmsgs[mpipe_ext.txfill];
+    mpipe_ext.txfill                   ^= 1;
+    mpipe_ext.txlen[mpipe_ext.txfill]   = 0;
+    mpipe_ext.txmsgs[mpipe_ext.txfill]  = 0;
+    mpipe_ext.txpos                     = 0;
+}
+
+
+void sub_usb_loadtx() {
+/// Load packets into the free EP1 PMA buffers.  A full packet must be followed
+/// by a short packet (or ZLP) to end the transfer.  Once the batch on the bus
+/// is all loaded, the batch that has been filling goes next, in the same
+/// stream of packets.
+    ot_u8*  batch;
+    ot_u16  transfer_size;
+
+    while (sub_usb_txloaded() < 2) {
+        if ((mpipe_ext.txpos >= mpipe_ext.txlen[mpipe_ext.txfill ^ 1]) && \
+            (mpipe_ext.txzlp == False)) {
+            if (mpipe_ext.txlen[mpipe_ext.txfill] == 0) {
+                return;
+            }
+            sub_usb_txswap();
+        }
+
+        batch           = &mpipe_ext.txbuf[mpipe_ext.txfill ^ 1][mpipe_ext.txpos];
+        transfer_size   = mpipe_ext.txlen[mpipe_ext.txfill ^ 1] - mpipe_ext.txpos;
+        if (transfer_size > VIRTUAL_COM_PORT_DATA_SIZE) {
+            transfer_size = VIRTUAL_COM_PORT_DATA_SIZE;
+        }
+        mpipe_ext.txzlp = (transfer_size == VIRTUAL_COM_PORT_DATA_SIZE);
+
+        if (_GetENDPOINT(ENDP1) & EP_DTOG_RX) {
+            UserToPMABufferCopy(batch, ENDP1_BUF1ADDR, transfer_size);
+            SetEPDblBuf1Count(ENDP1, EP_DBUF_IN, transfer_size);
+        }
+        else {
+            UserToPMABufferCopy(batch, ENDP1_BUF0ADDR, transfer_size);
+            SetEPDblBuf0Count(ENDP1, EP_DBUF_IN, transfer_size);
+        }
+        FreeUserBuffer(ENDP1, EP_DBUF_IN);
+        SetEPTxValid(ENDP1);
+        mpipe_ext.txpos += transfer_size;
+    }
+}
+
+
+void sub_usb_txstart() {
+    mpipe_ext.txsent    = 0;
+    mpipe.state         = MPIPE_Tx_Wait;
+    sub_usb_loadtx();
+}
+
+#else
+void sub_usb_loadtx() {
+/// Load the next packet of the batch that is on the bus.  If it is a full
+/// packet, the transfer is not over until a short packet (or ZLP) follows.
+    ot_u8*  batch;
+    ot_u16  transfer_size;
+
+    batch           = mpipe_ext.txbuf[mpipe_ext.txfill ^ 1];
+    transfer_size   = mpipe_ext.txlen[mpipe_ext.txfill ^ 1] - mpipe_ext.txpos;
+    if (transfer_size > VIRTUAL_COM_PORT_DATA_SIZE) {
+        transfer_size = VIRTUAL_COM_PORT_DATA_SIZE;
+    }
+    mpipe_ext.txzlp = (transfer_size == VIRTUAL_COM_PORT_DATA_SIZE);
+
+#   ifdef USE_STM3210C_EVAL
+        USB_SIL_Write(EP1_IN, &batch[mpipe_ext.txpos], transfer_size);  
+#   else
+        UserToPMABufferCopy(&batch[mpipe_ext.txpos], ENDP1_TXADDR, transfer_size);
+        SetEPTxCount(ENDP1, transfer_size);
+        SetEPTxValid(ENDP1); 
+#   endif  
+
+    mpipe_ext.txpos += transfer_size;
+}
+
+
+void sub_usb_txstart() {
+/// Put the batch that has been filling on the bus, and fill the other one
+    mpipe_ext.txfill                   ^= 1;
+    mpipe_ext.txlen[mpipe_ext.txfill]   = 0;
+    mpipe_ext.txmsgs[mpipe_ext.txfill]  = 0;
+    mpipe_ext.txpos                     = 0;
+    mpipe.state                         = MPIPE_Tx_Wait;
+    sub_usb_loadtx();
+}
+#endif
+
+#else
 void sub_usb_loadtx() {
     ot_u16 transfer_size;
     ot_u16 transfer_start;
@@ -1289,6 +1553,7 @@ void sub_usb_loadtx() {
         SetEPTxValid(ENDP1); 
 #   endif  
 }
+#endif
 
 
 void sub_usb_portsetup() {
@@ -1311,8 +1576,8 @@ void sub_usb_portsetup() {
     /// Enable USB Clocks
     MPIPE_USBCLK(ENABLE);
 
-    /// Set USB interrupt (Priority 0, Sub-priority 3)
-    NVIC->IP[MPIPE_USB_IRQn]        = b0011 << (8 - __NVIC_PRIO_BITS);
+    /// Set USB interrupt (PLATFORM_NVIC_MPIPE, below the radio)
+    NVIC->IP[MPIPE_USB_IRQn]        = PLATFORM_NVIC_MPIPE << (8 - __NVIC_PRIO_BITS);
     NVIC->ISER[MPIPE_USB_IRQn>>5]   = (1 << (MPIPE_USB_IRQn & 0x1F));
 
     ///Initialize USB (using ST library function)
@@ -1378,6 +1643,19 @@ ot_int mpipe_init(void* port_id) {
 
     mpipe.sequence.ushort   = 0;          //not actually necessary
     mpipe.state             = MPIPE_Idle;
+
+#   if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+    mpipe.pktbuf            = NULL;     // RX starts on the first mpipe_rxndef()
+    mpipe_ext.rxlen         = 0;
+    mpipe_ext.rxframe       = 0;
+    mpipe_ext.rxpending     = False;
+    mpipe_ext.txfill        = 0;
+    mpipe_ext.txlen[0]      = 0;
+    mpipe_ext.txlen[1]      = 0;
+    mpipe_ext.txmsgs[0]     = 0;
+    mpipe_ext.txpos         = 0;
+    mpipe_ext.txzlp         = False;
+#   endif
     
     mpipe_setspeed(MPIPE_115200bps);     //default baud rate
     sub_usb_portsetup();
@@ -1414,6 +1692,133 @@ mpipe_state mpipe_status() {
 
 
 
+#if (OT_FEATURE(MPIPE_USBBULK) == ENABLED)
+#ifndef EXT_mpipe_txndef
+ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// The message is copied into the batch that is filling, and the CRC is taken
+/// during the copy, so "data" is free on return.  If no transfer is underway,
+/// the batch goes out at once.  Returns -1 if the batch has no room for it.
+    ot_int  length = data[2] + 6;
+    ot_u8   batch;
+    ot_u8*  cursor;
+    ot_int  i;
+    Twobytes crcval;
+
+    MPIPE_USB_IRQOFF();
+    batch = mpipe_ext.txfill;
+
+    if ((mpipe_ext.txlen[batch] + length + MPIPE_FOOTERBYTES) > MPIPE_USBBULK_TXBYTES) {
+        MPIPE_USB_IRQON();
+        return -1;
+    }
+
+    cursor = &mpipe_ext.txbuf[batch][mpipe_ext.txlen[batch]];
+    platform_crc_init();
+    for (i=length; i!=0; i--) {
+        platform_crc_byte(*data);
+        *cursor++ = *data++;
+    }
+    platform_crc_byte(mpipe.sequence.ubyte[UPPER]);
+    platform_crc_byte(mpipe.sequence.ubyte[LOWER]);
+    *cursor++       = mpipe.sequence.ubyte[UPPER];
+    *cursor++       = mpipe.sequence.ubyte[LOWER];
+    crcval.ushort   = platform_crc_result();
+    *cursor++       = crcval.ubyte[UPPER];
+    *cursor         = crcval.ubyte[LOWER];
+
+    mpipe.sequence.ushort++;
+    mpipe_ext.txlen[batch] += length + MPIPE_FOOTERBYTES;
+    mpipe_ext.txmsgs[batch]++;
+
+    if (mpipe.state == MPIPE_Idle) {
+        sub_usb_txstart();
+    }
+#   ifdef MPIPE_USBDBL
+    else {
+        sub_usb_loadtx();   // goes now if the bus batch is all in the PMA
+    }
+#   endif
+    MPIPE_USB_IRQON();
+
+    if (blocking == True) {
+    	mpipe_wait();	
+    }
+    
+    return length + MPIPE_FOOTERBYTES;
+}
+#endif
+
+
+
+#ifndef EXT_mpipe_rxndef
+ot_int mpipe_rxndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
+/// Release the message that was delivered, if any, and continue RX at "data".
+/// Bytes that came after the message (the start of the next one) are moved to
+/// "data", which is never after them.  Returns -1 if a message is only partly
+/// received, in which case RX continues where it is.
+    ot_u8*  src;
+    ot_u16  carry;
+    ot_u16  i;
+
+    MPIPE_USB_IRQOFF();
+    if ((mpipe_ext.rxframe == 0) && (mpipe_ext.rxlen != 0)) {
+        MPIPE_USB_IRQON();
+        return -1;
+    }
+    src             = mpipe.pktbuf + mpipe_ext.rxframe;
+    carry           = mpipe_ext.rxlen - mpipe_ext.rxframe;
+    mpipe.pktbuf    = data;
+    mpipe_ext.rxlen = carry;
+    for (i=0; i<carry; i++) {
+        data[i] = src[i];
+    }
+    MPIPE_USB_IRQON();
+
+    // EP3 is NAKing here, so the USB ISR does not use these until it is valid
+    sub_usb_rxparse();
+    return 0;
+}
+#endif
+
+
+
+#ifndef EXT_mpipe_isr
+void mpipe_isr() {
+/// In bulk mode this is the EP1 (TX) packet-done event.  The batch is done
+/// after its last packet, which is short or a ZLP.  The batch that filled in
+/// the meantime goes next.  The txdone code is the number of messages sent.
+    ot_int msgs;
+
+    if (mpipe.state != MPIPE_Tx_Wait) {
+        return;
+    }
+#   ifdef MPIPE_USBDBL
+    sub_usb_loadtx();
+    if (sub_usb_txloaded() != 0) {
+        return;
+    }
+    msgs        = mpipe_ext.txsent;
+    mpipe.state = MPIPE_Idle;
+#   else
+    if ((mpipe_ext.txpos < mpipe_ext.txlen[mpipe_ext.txfill ^ 1]) || mpipe_ext.txzlp) {
+        sub_usb_loadtx();
+        return;
+    }
+
+    msgs        = mpipe_ext.txmsgs[mpipe_ext.txfill ^ 1];
+    mpipe.state = MPIPE_Idle;
+    if (mpipe_ext.txlen[mpipe_ext.txfill] != 0) {
+        sub_usb_txstart();
+    }
+#   endif
+#   if (OT_FEATURE(MPIPE_CALLBACKS) == ENABLED)
+        mpipe.sig_txdone(msgs);
+#   endif
+}
+#endif
+
+
+#else
 #ifndef EXT_mpipe_txndef
 ot_int mpipe_txndef(ot_u8* data, ot_bool blocking, mpipe_priority data_priority) {
     Twobytes crcval;
@@ -1516,5 +1921,12 @@ void mpipe_isr() {
 
 
 
+#endif /* MPIPE_USBBULK */
+
+
+#if (OT_FEATURE(MPIPE_PORTS) == ENABLED)
+MPIPE_PORT_DEFINE(NULL);
 #endif
 
+
+#endif
@@ -295,7 +295,7 @@
 platform_struct platform;
 
 #if (OT_FEATURE(RTC) == ENABLED)
-#   define RTC_ALARMS       0 //(ALARM_beacon + __todo_IS_STM32L__)
+#   define RTC_ALARMS       (ALARM_event+1)
 #   define RTC_OVERSAMPLE   0
     // RTC_OVERSAMPLE: min 0, max 16
 
@@ -303,14 +303,19 @@ platform_struct platform;
         ot_bool active;
         ot_u16  mask;
         ot_u16  value;
+        ot_u32  next;               // RTC second of the next match
     } rtcalarm;
 
+    /// The active alarms are queued in order[], soonest first, so the RTC
+    /// alarm register is always loaded from order[0].
     typedef struct {
 #       if (RTC_OVERSAMPLE != 0)
             ot_u32      utc;
 #       endif
 #       if (RTC_ALARMS > 0)
-            rtcalarm    alarm[RTC_ALARMS]
+            ot_u8       count;
+            ot_u8       order[RTC_ALARMS];
+            rtcalarm    alarm[RTC_ALARMS];
 #       endif
     } otrtc_struct;
 
@@ -320,6 +325,25 @@ platform_struct platform;
 #endif
 
 
+/** Kernel Timer (KTIM)
+  * GPTIM counts up continuously.  Its overflows are counted in ktim.hi, which
+  * makes a 32 bit count, and CC1 interrupts at the deadline once ktim.hi
+  * reaches the upper half of the deadline.  GPTIM counts sub-ticks, with
+  * 2^PLATFORM_KTIM_SUBBITS sub-ticks per tick.  The mark replaces zeroing the
+  * timer, and it always moves by whole ticks.
+  */
+#define KTIM_TICK           (((ot_u32)1 << PLATFORM_KTIM_SUBBITS) - 1)
+
+typedef struct {
+    ot_u16  hi;             // GPTIM overflow count
+    ot_bool armed;          // there is a deadline
+    ot_u32  mark;           // count at the last set or flush
+    ot_u32  deadline;       // count of the next kernel run
+} ktim_struct;
+
+ktim_struct ktim;
+
+
 
 
 
@@ -349,46 +373,182 @@ void NMI_Handler(void) {
 }
   
 
+ot_u32 sub_ktim_count() {
+/// An overflow that is not serviced yet (in an ISR, or with interrupts off) is
+/// counted here.  If the overflow ISR runs during the read, it is read again.
+    ot_u16 hi, lo;
+    ot_u32 count;
+
+    do {
+        hi      = ktim.hi;
+        lo      = OT_GPTIM->CNT;
+        count   = ((ot_u32)hi << 16) | lo;
+        if ((OT_GPTIM->SR & TIM_SR_UIF) && (lo < 0x8000)) {
+            count += 0x00010000;
+        }
+    } while (hi != ktim.hi);
+
+    return count;
+}
+
+
+void sub_ktim_program() {
+/// CC1 is loaded when the deadline is in the present 16 bit period of GPTIM,
+/// else the overflow ISR calls this again.  A deadline that has passed (also
+/// while CC1 was being loaded) generates the CC1 event by software.
+    ot_u32 count;
+
+    OT_GPTIM->DIER  = TIM_DIER_UIE;
+    if (ktim.armed) {
+        count = sub_ktim_count();
+        if ((ot_u16)(ktim.deadline >> 16) == (ot_u16)(count >> 16)) {
+            OT_GPTIM->CCR1  = (ot_u16)ktim.deadline;
+            OT_GPTIM->SR    = ~TIM_SR_CC1IF;
+            OT_GPTIM->DIER  = TIM_DIER_UIE | TIM_DIER_CC1IE;
+            count           = sub_ktim_count();
+        }
+        if ((ot_long)(ktim.deadline - count) <= 0) {
+            OT_GPTIM->DIER  = TIM_DIER_UIE | TIM_DIER_CC1IE;
+            OT_GPTIM->EGR   = TIM_EGR_CC1G;
+        }
+    }
+}
+
+
+void sub_ktim_mark() {
+    ktim.mark += (sub_ktim_count() - ktim.mark) & ~KTIM_TICK;
+}
+
+
 void OT_GPTIM_ISR() {
-// References a TIMx_IRQHandler() function
-    platform_ot_run();
+// References a TIMx_IRQHandler() function.  The overflow only extends the
+// count (and loads CC1 when the deadline comes into range).  CC1 runs the
+// kernel.  CC2 only wakes up a platform delay.
+    if ((OT_GPTIM->DIER & TIM_DIER_CC2IE) && (OT_GPTIM->SR & TIM_SR_CC2IF)) {
+        OT_GPTIM->SR    = ~TIM_SR_CC2IF;
+        OT_GPTIM->DIER &= ~TIM_DIER_CC2IE;
+    }
+    if ((OT_GPTIM->DIER & TIM_DIER_CC1IE) && (OT_GPTIM->SR & TIM_SR_CC1IF)) {
+        OT_GPTIM->SR    = ~TIM_SR_CC1IF;
+        OT_GPTIM->DIER  = TIM_DIER_UIE;
+        platform_ot_run();
+    }
+    if (OT_GPTIM->SR & TIM_SR_UIF) {
+        OT_GPTIM->SR    = ~TIM_SR_UIF;
+        ktim.hi++;
+        sub_ktim_program();
+    }
 }
 
 #if (OT_FEATURE(RTC) == ENABLED)
 
+static ot_u32 sub_rtc_count() {
+    return RTC_GetCounter() >> RTC_OVERSAMPLE;
+}
+
+
 #if (RTC_ALARMS > 0)
-void sub_juggle_rtc_alarm() {
-    ot_u8  i;
-    ot_u32 comp;
-    ot_u32 next     = ~0;
-    ot_u32 rtcval   = RTC_GetCounter();
-    
-    for (i=0; i<RTC_ALARMS; i++) {
-        if (otrtc.alarm[i].active) {
-            comp    = rtcval & ((ot_u32)otrtc.alarm[i].mask << RTC_OVERSAMPLE);
-            comp   += (ot_u32)otrtc.alarm[i].value << RTC_OVERSAMPLE;
-            next    = (comp < next) ? comp : next;
+static void sub_rtc_program(ot_u32 now) {
+/// Loads the alarm register with the head of the queue.  With no alarm queued
+/// the register is left alone, and a stray alarm interrupt finds nothing due.
+    if (otrtc.count != 0) {
+        RTC_WaitForLastTask();
+        RTC_SetAlarm(otrtc.alarm[otrtc.order[0]].next << RTC_OVERSAMPLE);
+        RTC_WaitForLastTask();
+    }
+}
+#endif
+
+
+#if (RTC_ALARMS > 0)
+static ot_u32 sub_rtc_next(ot_u32 now, ot_u16 mask, ot_u16 value) {
+/// Returns the first second after "now" where the masked lower 16 bits of the
+/// RTC equal the masked value.  The RTC bits above the mask are free, so this
+/// always exists, and it is found without counting through the seconds.
+    ot_u32 next = now + 1;
+    ot_u32 m    = mask;
+    ot_u32 v    = value & m;
+    ot_u32 diff = (next ^ v) & m;
+    ot_u32 bit;
+
+    if (diff == 0) {
+        return next;
+    }
+
+    // Highest masked bit that differs: if next has a 0 there, set it and take
+    // the masked value below it.  Otherwise, carry into the lowest free 0 bit
+    // above it.
+    for (bit=0x8000; (bit & diff) == 0; bit>>=1);
+    if (v & bit) {
+        return (next & ~((bit<<1)-1)) | (v & ((bit<<1)-1));
+    }
+    for (bit<<=1; (bit != 0) && (bit & (m | next)); bit<<=1);
+    return (next & ~((bit<<1)-1)) | bit | (v & (bit-1));
+}
+
+
+static void sub_rtc_remove(ot_u8 alarm_id) {
+    ot_u8 i, j;
+    for (i=0, j=0; i<otrtc.count; i++) {
+        if (otrtc.order[i] != alarm_id) {
+            otrtc.order[j++] = otrtc.order[i];
+        }
+    }
+    otrtc.count = j;
+}
+
+
+static void sub_rtc_queue(ot_u8 alarm_id, ot_u32 now) {
+/// Takes the alarm out of the queue and, if it is active, puts it back in at
+/// its next match.  The compare is wrap-safe.
+    ot_u8 i;
+    sub_rtc_remove(alarm_id);
+
+    if (otrtc.alarm[alarm_id].active) {
+        otrtc.alarm[alarm_id].next = sub_rtc_next(now, otrtc.alarm[alarm_id].mask,
+                                                       otrtc.alarm[alarm_id].value);
+        for (i=otrtc.count; i>0; i--) {
+            if ((ot_long)(otrtc.alarm[otrtc.order[i-1]].next - otrtc.alarm[alarm_id].next) <= 0) {
+                break;
+            }
+            otrtc.order[i] = otrtc.order[i-1];
         }
+        otrtc.order[i] = alarm_id;
+        otrtc.count++;
     }
+}
 
-    RTC_SetAlarm(rtcval+next);
+
+static void sub_rtc_service() {
+/// Pops each due alarm from the head of the queue, requeues it at its next
+/// match, and hands it to the kernel.  Then the head is programmed.
+    ot_u32  now = sub_rtc_count();
+    ot_u8   alarm_id;
+
+    while ((otrtc.count != 0) && \
+           ((ot_long)(now - otrtc.alarm[otrtc.order[0]].next) >= 0)) {
+        alarm_id = otrtc.order[0];
+        sub_rtc_queue(alarm_id, now);
+        sys_rtc_alarm(alarm_id);
+    }
+    sub_rtc_program(now);
 }
 #endif
 
+
 void RTC_IRQHandler(void) {
-/// Currently Psuedocode.  RTC is normally used with ALARM interrupt.  If it
-/// is oversampling, then it will also interrupt on each second, so the user
-/// can increment the UTC.
+/// RTC is normally used with ALARM interrupt.  If it is oversampling, then it
+/// will also interrupt on each second, so the user can increment the UTC.
 #if (RTC_OVERSAMPLE != 0)
-    if (__rtc_interrupt_is_second__) {
+    if (RTC_GetITStatus(RTC_IT_SEC) != RESET) {
+        RTC_ClearITPendingBit(RTC_IT_SEC);
         otrtc.utc++;
-        //add clear flag
     }
 #endif
 #if (RTC_ALARMS > 0)
-    if (__rtc_interrupt_is_alarm__) {
-        sub_juggle_rtc_alarm();
-        //add clear flag
+    if (RTC_GetITStatus(RTC_IT_ALR) != RESET) {
+        RTC_ClearITPendingBit(RTC_IT_ALR);
+        sub_rtc_service();
     }
 #endif
 }
@@ -412,13 +572,22 @@ void RTC_IRQHandler(void) {
   * ========================================================================<BR>
   */
 
+void platform_disable_interrupts() {
+    __disable_irq();
+}
+
+void platform_enable_interrupts() {
+    __enable_irq();
+}
+
 void platform_ot_preempt() {
-/// Assure interrupt is enabled and cause a SW update interrupt
-    OT_GPTIM->DIER  = 0;
-    OT_GPTIM->ARR   = platform_get_gptim();
-    OT_GPTIM->DIER  = TIM_DIER_UIE;
-    OT_GPTIM->EGR   = TIM_EGR_UG;
-    __NOP();  //No-op to let forced update event (TIM_EGR_UG) stabilize
+/// Cause a SW CC1 interrupt.  The mark is kept, so the kernel can subtract
+/// whatever time passed since the last event.
+    ktim.armed      = True;
+    ktim.deadline   = sub_ktim_count();
+    OT_GPTIM->DIER  = TIM_DIER_UIE | TIM_DIER_CC1IE;
+    OT_GPTIM->EGR   = TIM_EGR_CC1G;
+    __NOP();  //No-op to let forced CC1 event (TIM_EGR_CC1G) stabilize
 }
 
 void platform_ot_pause() {
@@ -428,13 +597,13 @@ void platform_ot_pause() {
 
 
 void platform_ot_run() {
-/// 1. Save the amount of time that just passed
-/// 2. Put the timer into free-running upcounter to time kernel process
-/// 3. Run System Kernel, which returns its next scheduled call
-/// 4. Put the next scheduled call into the timer, and turn it back on
-    ot_u16 next_event;
-    ot_u16 elapsed_time;
-    elapsed_time    = OT_GPTIM->ARR;
+/// 1. Save the amount of time that just passed, in whole ticks.  The sub-tick
+///    stays with the mark, so the kernel timebase does not slip.
+/// 2. Run System Kernel, which returns its next scheduled call
+/// 3. Put the next scheduled call into the timer (32 bits)
+    ot_u32 next_event;
+    ot_u32 elapsed_time;
+    elapsed_time    = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
     next_event      = sys_event_manager( elapsed_time );
     
 #   if (OT_PARAM(KERNEL_LIMIT) > 0)
@@ -442,7 +611,7 @@ void platform_ot_run() {
             next_event = OT_PARAM(KERNEL_LIMIT);
 #   endif
 
-    platform_set_gptim(next_event);
+    platform_set_ktim(next_event);
 }
 
 
@@ -459,6 +628,11 @@ void platform_ot_run() {
   */
   
 void platform_poweron() {
+    /// Paint the stack while it is nearly empty (see OT_FEATURE_MEMSTATS)
+#   if (OT_FEATURE(MEMSTATS) == ENABLED)
+    sys_stack_paint();
+#   endif
+
     /// Hardware turn-on stuff
     platform_init_busclk();         // extra bus clock setup not in SystemInit()
     platform_init_periphclk();      // Peripherals OpenTag cares about
@@ -477,8 +651,7 @@ void platform_poweron() {
 
 
 void platform_poweroff() {
-    ISF_syncmirror();
-    vworm_save();
+    vl_save();
 }
 
 
@@ -491,7 +664,10 @@ void platform_init_OT() {
 
 
 void platform_fastinit_OT() {
-    platform_init_OT();
+    buffers_init(); //buffers init must be first in order to do core dumps
+    vl_fastinit();  //Veelite from the boot snapshot, if there is one
+    radio_init();   //radio init third
+    sys_init();     //system init last
 }
 
 
@@ -547,10 +723,11 @@ void platform_init_interruptor() {
 /// Below is the NVIC priority system used by OpenTag.  It uses 2 bits for the
 /// priority group and 2 bits for subpriority.  Groups 0-1 are for kernel events 
 /// and 2-3 for user/application interrupts.                                    <BR>
-/// <LI> Priority 0: Primary I/O (Radio interrupts, MPipe)                      </LI>
-/// <LI> Priority 1: OpenTag Kernel Pre-emption sources (GPTim, RTC, Systick)   </LI>
+/// <LI> Priority 0: Radio interrupts                                          </LI>
+/// <LI> Priority 1: MPipe, OpenTag Kernel Pre-emption sources (GPTim, RTC)     </LI>
 /// <LI> Priority 2: Nested User/Application interrupts                         </LI>
 /// <LI> Priority 3: General User/Application interrupts                        </LI>
+/// The values are PLATFORM_NVIC_RADIO, _MPIPE and _KERNEL (platform header).
 
 
     /// Vector Table @ 0x08000000 (offset = 0)
@@ -559,12 +736,13 @@ void platform_init_interruptor() {
     /// Group 2 = 2 bits for Priority, 2 bits for subpriority
     NVIC_SetPriorityGrouping(5);    //NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
     
-    /// Priority Group 0: Radio interrupts and Mpipe: 
-    /// These are initialized in their respective modules (radio, mpipe, etc)
+    /// Priority Group 0: Radio interrupts
+    /// These are initialized in the radio module
     
-    /// Priority Group 1: OpenTag Kernel Pre-emptors
+    /// Priority Group 1: Mpipe (initialized in the mpipe module) and the
+    /// OpenTag Kernel Pre-emptors
     //NVIC->IP[(uint32_t)(RTC_IRQn)]              = b0100 << (8 - __NVIC_PRIO_BITS);
-    NVIC->IP[(uint32_t)(OT_GPTIM_IRQn)]         = b0101 << (8 - __NVIC_PRIO_BITS);
+    NVIC->IP[(uint32_t)(OT_GPTIM_IRQn)]         = PLATFORM_NVIC_KERNEL << (8 - __NVIC_PRIO_BITS);
     //NVIC->ISER[((uint32_t)(RTC_IRQn) >> 5)]     = (1 << ((uint32_t)(RTC_IRQn) & 0x1F));
     NVIC->ISER[((uint32_t)(OT_GPTIM_IRQn) >> 5)]= (1 << ((uint32_t)(OT_GPTIM_IRQn) & 0x1F));
     
@@ -605,13 +783,17 @@ void platform_init_gpio() {
 
 void platform_init_gptim(ot_uint prescaler) {
 /// Right now, prescaler input is ignored.
-/// GPTIM is put into a normal upcounting mode, but in "one pulse mode" so that
-/// the counter is halted after reaching the limit
+/// GPTIM counts up continuously, with the update (overflow) interrupt for the
+/// kernel timer.  CC1 is the kernel deadline, and CC2 is for platform delays.
+    ktim.hi         = 0;
+    ktim.mark       = 0;
+    ktim.armed      = False;
     OT_GPTIM->CR1   = 0;
     OT_GPTIM->CR2   = 0;
     OT_GPTIM->SMCR  = 0;
+    OT_GPTIM->CCMR1 = 0;        // CC1 and CC2 are frozen output compares
     OT_GPTIM->ARR   = 65535;
-    OT_GPTIM->PSC   = ((OT_GPTIM_CLOCK/2) / OT_GPTIM_RES);  // Should be always 1024 Hz
+    OT_GPTIM->PSC   = ((OT_GPTIM_CLOCK/2) / (OT_GPTIM_RES << PLATFORM_KTIM_SUBBITS));
     OT_GPTIM->EGR   = TIM_PSCReloadMode_Immediate;     // generate update to lock-in prescaler
     OT_GPTIM->SR    = 0;        // clear update flag
     OT_GPTIM->DIER  = TIM_DIER_UIE;   // Update Interrupt
@@ -675,25 +857,52 @@ void platform_init_memcpy() {
   */
 
 ot_u16 platform_get_gptim() {
-/// Return Present value of the counter
-    return OT_GPTIM->CNT;
+/// Return ticks since the mark
+    ot_u32 ticks = platform_get_ktim() >> PLATFORM_KTIM_SUBBITS;
+    return (ticks > 65535) ? 65535 : (ot_u16)ticks;
+}
+
+ot_u32 platform_get_ktim() {
+    return sub_ktim_count() - ktim.mark;
+}
+
+ot_u32 platform_stamp() {
+    return sub_ktim_count();
+}
+
+#if (OT_FEATURE(PROFILER) == ENABLED)
+/// The CMSIS core header in this tree does not describe the DWT unit
+#define DWT_CTRL        (*(volatile ot_u32*)0xE0001000)
+#define DWT_CYCCNT      (*(volatile ot_u32*)0xE0001004)
+
+ot_u32 platform_get_cycles() {
+/// Turn on the cycle counter the first time it is used
+    if ((DWT_CTRL & 1) == 0) {
+        CoreDebug->DEMCR   |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT_CYCCNT          = 0;
+        DWT_CTRL           |= 1;
+    }
+    return DWT_CYCCNT;
 }
+#endif
 
 void platform_set_gptim(ot_u16 value) {
-/// Flush GPTIM and assure it is in up-counting interrupt mode
-    OT_GPTIM->DIER  = 0;
-    OT_GPTIM->ARR   = value;
-    OT_GPTIM->EGR   = TIM_EGR_UG;
-    //__NOP();    // NOP needed for update to stabilize
-    OT_GPTIM->SR    = 0;
-	OT_GPTIM->DIER  = TIM_DIER_UIE;
+    platform_set_ktim(value);
+}
+
+void platform_set_ktim(ot_u32 value) {
+/// Move the mark to now and set the deadline
+    sub_ktim_mark();
+    ktim.deadline   = ktim.mark + (value << PLATFORM_KTIM_SUBBITS);
+    ktim.armed      = True;
+    sub_ktim_program();
 }
 
 void platform_flush_gptim() { 
-/// Flush GPTIM, resume in continuous mode with interrupt off.
-    OT_GPTIM->DIER  = 0;
-    OT_GPTIM->ARR   = 65535;
-    OT_GPTIM->EGR   = TIM_EGR_UG;
+/// Move the mark to now, with no deadline (GPTIM keeps running).
+    sub_ktim_mark();
+    ktim.armed      = False;
+    OT_GPTIM->DIER  = TIM_DIER_UIE;
 }
 
 void platform_run_watchdog() {
@@ -733,10 +942,49 @@ ot_u32 platform_get_time() {
 }
 
 void platform_set_time(ot_u32 utc_time) {
-#if (RTC_OVERSAMPLE != 0)
-    otrtc.utc   = utc_time;
-#else
-    RTC_SetCounter(utc_time);
+#if (OT_FEATURE(RTC) == ENABLED)
+#   if (RTC_OVERSAMPLE != 0)
+        otrtc.utc   = utc_time;
+#   else
+        RTC_WaitForLastTask();
+        RTC_SetCounter(utc_time);
+#   endif
+#   if (RTC_ALARMS > 0)
+    {   // The time has jumped, so every alarm is requeued
+        ot_u8 i;
+        platform_disable_interrupts();
+        for (i=0; i<RTC_ALARMS; i++) {
+            sub_rtc_queue(i, sub_rtc_count());
+        }
+        sub_rtc_program(sub_rtc_count());
+        platform_enable_interrupts();
+    }
+#   endif
+#endif
+}
+
+void platform_set_rtc_alarm(ot_u8 alarm_id, ot_u16 mask, ot_u16 value) {
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    ot_u32 now;
+    platform_disable_interrupts();
+    otrtc.alarm[alarm_id].mask  = mask;
+    otrtc.alarm[alarm_id].value = value;
+    now                         = sub_rtc_count();
+    sub_rtc_queue(alarm_id, now);
+    sub_rtc_program(now);
+    platform_enable_interrupts();
+#endif
+}
+
+void platform_enable_rtc_alarm(ot_u8 alarm_id, ot_bool enable) {
+#if (OT_FEATURE(RTC) == ENABLED) && (RTC_ALARMS > 0)
+    ot_u32 now;
+    platform_disable_interrupts();
+    otrtc.alarm[alarm_id].active = enable;
+    now                          = sub_rtc_count();
+    sub_rtc_queue(alarm_id, now);
+    sub_rtc_program(now);
+    platform_enable_interrupts();
 #endif
 }
 
@@ -780,30 +1028,31 @@ void platform_trig2_toggle() { }
 
 /** Platform Default CRC Routine <BR>
   * ========================================================================<BR>
-  * Uses the CRC table from the CRC module because STM32F1 does not have a 
-  * standalone CRC peripheral
+  * The STM32F1 CRC peripheral is CRC-32 only, so these run on the SW engine
+  * of the CRC module (CRC16_ENGINE, optionally with CRC16_TABLE_RAM).  Blocks
+  * go through crc_extend_block(), which folds 4 bytes per round with SLICE4.
   */
 #include "crc16.h"
 
+static ot_u16 platform_crcval;
+
 ot_u16 platform_crc_init() {
-/// No HW CRC
+/// No HW CRC, so the running value is kept here for platform_crc_byte()
+    platform_crcval = 0xFFFF;
+    return platform_crcval;
 }
 
 ot_u16 platform_crc_block(ot_u8* block_addr, ot_int block_size) {
-    ot_u16 crc_val;
-
-    while (block_size > 0) {
-        crc_val = (crc_val << 8) ^ crc_table[ ((crc_val >> 8) & 0xff) ^ *block_addr++ ];
-        block_size--;
-    }
+    platform_crcval = crc_extend_block(0xFFFF, block_size, block_addr);
+    return platform_crcval;
 }
 
 void platform_crc_byte(ot_u8 databyte) {
-/// No HW CRC
+    platform_crcval = crc_extend_block(platform_crcval, 1, &databyte);
 }
 
 ot_u16 platform_crc_result() {
-/// No HW CRC
+    return platform_crcval;
 }
 
 
@@ -812,56 +1061,34 @@ ot_u16 platform_crc_result() {
 /** Platform Random Number Generation Routines <BR>
   * ========================================================================<BR>
   * The platform must be able to compute a strong random number (via function
-  * platform_rand()) and a "pseudo" random number (via platform_prand_u8()).
+  * platform_rand()).  The "pseudo" random number generator is in otlib/prand.c.
   */
 void platform_rand(ot_u8* rand_out, ot_int bytes_out) {
 }
 
 
-ot_u32 rprime;
-static ot_u32 r;
-
 
-void platform_init_prand(ot_u16 seed) {
-    rprime  = 83;
-    r       = 73;
-}
-
-sub_rotate_prand() {
-    static ot_u32 Y;
-    r   = ((r+1) < 3) ? rprime : r;
-    r   = (9973 * ~r) + ((Y) % 701);
-    Y   = r;
-}
 
-ot_u8 platform_prand_u8() {
-	sub_rotate_prand();
-    return (ot_u8)(r>>24);
-}
-
-ot_u16 platform_prand_u16() {
-    sub_rotate_prand();
-    return (ot_u8)(r>>24);
-}
 
 
 
-
-
-
-
-/** Platform memcpy Routine <BR>
+/** Platform memcpy Routines <BR>
   * ========================================================================<BR>
-  * Similar to standard implementation of "memcpy"
+  * Similar to standard implementation of "memcpy".  Copies shorter than
+  * MEMCPY_DMA_THRESHOLD bytes always go through the CPU, because setting up
+  * the DMA costs more than it saves on a short run.  The CPU copies 32 bits at
+  * a time when both addresses are word-aligned.
   */
+#ifndef MEMCPY_DMA_THRESHOLD
+#   define MEMCPY_DMA_THRESHOLD     32
+#endif
 
-void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
-/// Behavior is always blocking.
-
-#if (OS_FEATURE(MEMCPY) == ENABLED)
-    memcpy(dest, src, length);
-
-#elif (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+void sub_memcpy_dma(ot_u8* dest, ot_u8* src, ot_int length, ot_u32 ccr) {
+/// The channel must be off before it can be set up again, so any async copy
+/// still running is waited-out first.
+    platform_memcpy_wait();
+    MEMCPY_DMA_CHAN->CCR    = 0;
     MEMCPY_DMA->IFCR        = MEMCPY_DMA_INT;
     MEMCPY_DMA_CHAN->CPAR   = (ot_u32)dest;
     MEMCPY_DMA_CHAN->CMAR   = (ot_u32)src;
@@ -869,18 +1096,55 @@ void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
     MEMCPY_DMA_CHAN->CCR    = DMA_DIR_PeripheralDST       | \
                               DMA_Mode_Normal             | \
                               DMA_PeripheralInc_Enable    | \
-                              DMA_MemoryInc_Enable        | \
-                              DMA_PeripheralDataSize_Byte | \
-                              DMA_MemoryDataSize_Byte     | \
                               DMA_Priority_VeryHigh       | \
                               DMA_M2M_Enable              | \
+                              ccr                         | \
                               DMA_CCR1_EN;
-    while((MEMCPY_DMA->ISR & MEMCPY_DMA_INT) == 0);
+}
 
-#else
+void sub_memcpy_dmastart(ot_u8* dest, ot_u8* src, ot_int length) {
+    ot_int i;
+    
+    if ((((ot_u32)dest | (ot_u32)src) & 3) == 0) {
+        sub_memcpy_dma(dest, src, (length >> 2), DMA_MemoryInc_Enable        | \
+                                                 DMA_PeripheralDataSize_Word | \
+                                                 DMA_MemoryDataSize_Word);
+        /// The CPU does the odd tail bytes while the DMA runs
+        for (i=(length & ~3); i<length; i++) {
+            dest[i] = src[i];
+        }
+    }
+    else {
+        sub_memcpy_dma(dest, src, length, DMA_MemoryInc_Enable        | \
+                                          DMA_PeripheralDataSize_Byte | \
+                                          DMA_MemoryDataSize_Byte);
+    }
+}
+#endif
+
+
+void sub_memcpy_cpu(ot_u8* dest, ot_u8* src, ot_int length) {
+    if (length <= 0) {
+        return;
+    }
+    if ((((ot_u32)dest | (ot_u32)src) & 3) == 0) {
+        ot_u32* dest4   = (ot_u32*)dest;
+        ot_u32* src4    = (ot_u32*)src;
+        ot_int  i;
+        
+        for (i=(length>>2); i>0; i--) {
+            *dest4++ = *src4++;
+        }
+        dest    = (ot_u8*)dest4;
+        src     = (ot_u8*)src4;
+        for (i=(length & 3); i>0; i--) {
+            *dest++ = *src++;
+        }
+    }
+    
     /// Uses the "Duff's Device" for loop unrolling.  If this is incredibly 
     /// confusing to you, check the internet for "Duff's Device."
-    if (length > 0) {
+    else {
         ot_int loops = (length + 7) >> 3;
         
         switch (length & 0x7) {
@@ -896,20 +1160,173 @@ void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
                         while (--loops > 0);
         }
     }
-    
+}
+
+
+void platform_memcpy(ot_u8* dest, ot_u8* src, ot_int length) {
+/// Behavior is always blocking.
+
+#if (OS_FEATURE(MEMCPY) == ENABLED)
+    memcpy(dest, src, length);
+
+#elif (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length < MEMCPY_DMA_THRESHOLD) {
+        platform_memcpy_wait();
+        sub_memcpy_cpu(dest, src, length);
+    }
+    else {
+        sub_memcpy_dmastart(dest, src, length);
+        platform_memcpy_wait();
+    }
+
+#else
+    sub_memcpy_cpu(dest, src, length);
+#endif
+}
+
+
+void platform_memcpy_2(ot_u16* dest, ot_u16* src, ot_int length) {
+/// Same as platform_memcpy(), but length is in 16 bit words, and both 
+/// addresses must be halfword-aligned.
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= (MEMCPY_DMA_THRESHOLD/2)) {
+        sub_memcpy_dma((ot_u8*)dest, (ot_u8*)src, length, DMA_MemoryInc_Enable            | \
+                                                          DMA_PeripheralDataSize_HalfWord | \
+                                                          DMA_MemoryDataSize_HalfWord);
+        platform_memcpy_wait();
+        return;
+    }
+    platform_memcpy_wait();
+#endif
+    if (length > 0) {
+        ot_int loops = (length + 3) >> 2;
+
+        switch (length & 0x3) {
+            case 0: do {    *dest++ = *src++;
+            case 3:         *dest++ = *src++;
+            case 2:         *dest++ = *src++;
+            case 1:         *dest++ = *src++;
+                        }
+                        while (--loops > 0);
+        }
+    }
+}
+
+
+void platform_memcpy_async(ot_u8* dest, ot_u8* src, ot_int length) {
+/// Returns while the DMA is still copying.  Neither buffer may be touched until
+/// platform_memcpy_busy() returns False.  Short copies are just done.
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_dmastart(dest, src, length);
+        return;
+    }
+#endif
+    platform_memcpy(dest, src, length);
+}
+
+
+ot_bool platform_memcpy_busy() {
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    return (ot_bool)(   ((MEMCPY_DMA_CHAN->CCR & DMA_CCR1_EN) != 0) && \
+                        ((MEMCPY_DMA->ISR & MEMCPY_DMA_INT) == 0)   );
+#else
+    return False;
 #endif
 }
 
 
+void platform_memcpy_wait() {
+    while (platform_memcpy_busy());
+}
+
+
+void platform_memset(ot_u8* dest, ot_u8 value, ot_int length) {
+#if (MCU_FEATURE(MEMCPYDMA) == ENABLED)
+    if (length >= MEMCPY_DMA_THRESHOLD) {
+        sub_memcpy_dma(dest, &value, length, DMA_MemoryInc_Disable       | \
+                                             DMA_PeripheralDataSize_Byte | \
+                                             DMA_MemoryDataSize_Byte);
+        platform_memcpy_wait();
+        return;
+    }
+    platform_memcpy_wait();
+#endif
+    if (length <= 0) {
+        return;
+    }
+    if (((ot_u32)dest & 3) == 0) {
+        ot_u32* dest4   = (ot_u32*)dest;
+        ot_u32  value4  = value * 0x01010101;
+        ot_int  i;
+        
+        for (i=(length>>2); i>0; i--) {
+            *dest4++ = value4;
+        }
+        dest = (ot_u8*)dest4;
+        for (i=(length & 3); i>0; i--) {
+            *dest++ = value;
+        }
+    }
+    else {
+        while (--length >= 0) {
+            *dest++ = value;
+        }
+    }
+}
+
 
 
 
-#define CNT1us    (PLATFORM_HSCLOCK_HZ/(1000000 * 5))
-#define CNT1ms    (CNT1us*1000)
+
+/** Platform Delays
+  * A wait of PLATFORM_DELAY_SLEEP_US or more sleeps until GPTIM CC2, which
+  * the kernel timer does not use.  CC2 matches once per 16 bit period of 
+  * GPTIM, so a longer wait wakes up once per period and goes back to sleep.
+  * The wait is rounded up to whole sub-ticks, plus the sub-tick underway.
+  * A shorter wait counts loops, and so does any wait made in a handler or 
+  * with interrupts off, because CC2 could not wake it up from there.  The
+  * kernel runs in the GPTIM handler, so waits made by it are always counted.
+  */
+#define CNT1us              (PLATFORM_HSCLOCK_HZ/(1000000 * 5))
+#define CNT1ms              (CNT1us*1000)
+#define DELAY_SUBTICK_HZ    ((ot_u32)OT_GPTIM_RES << PLATFORM_KTIM_SUBBITS)
+#define DELAY_CAN_SLEEP()   (((SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) == 0) && \
+                            (__get_PRIMASK() == 0) && \
+                            (OT_GPTIM->CR1 & TIM_CR1_CEN))
+
+void sub_delay_sleep(ot_u32 subticks) {
+/// The deadline is checked with interrupts off, and WFI still wakes up on a
+/// pending interrupt while they are off, so a CC2 match is never lost.  The
+/// handlers run once interrupts are on again, and the loop re-arms CC2.
+    ot_u32 until;
+
+    until = sub_ktim_count() + subticks + 1;
+    while (1) {
+        __disable_irq();
+        if ((ot_long)(until - sub_ktim_count()) <= 0) {
+            break;
+        }
+        OT_GPTIM->CCR2  = (ot_u16)until;
+        OT_GPTIM->SR    = ~TIM_SR_CC2IF;
+        OT_GPTIM->DIER |= TIM_DIER_CC2IE;
+        if ((ot_long)(until - sub_ktim_count()) > 0) {
+            SLEEP_MCU();
+        }
+        __enable_irq();
+    }
+    OT_GPTIM->DIER &= ~TIM_DIER_CC2IE;
+    __enable_irq();
+}
+
 
 void platform_swdelay_ms(ot_u16 n) {
 	ot_u32 c;
 
+    if ((((ot_u32)n * 1000) >= PLATFORM_DELAY_SLEEP_US) && DELAY_CAN_SLEEP()) {
+        sub_delay_sleep((((ot_u32)n * DELAY_SUBTICK_HZ) + 999) / 1000);
+        return;
+    }
 	c = n * CNT1ms;
 	for (; c>0; c--);
 }
@@ -918,6 +1335,10 @@ void platform_swdelay_ms(ot_u16 n) {
 void platform_swdelay_us(ot_u16 n) {
 	ot_u32 c;
 
+    if ((n >= PLATFORM_DELAY_SLEEP_US) && DELAY_CAN_SLEEP()) {
+        sub_delay_sleep((((ot_u32)n * DELAY_SUBTICK_HZ) + 999999) / 1000000);
+        return;
+    }
 	c = n * CNT1us;
 	for (; c>0; c--);
 }
@@ -49,6 +49,10 @@
 #define PLATFORM_POINTER_SIZE       4               // How many bytes is a pointer?
 #define PLATFORM_ENDIAN16(VAR16)    __REV16(VAR16)  // Big-endian to Platform-endian
 #define PLATFORM_ENDIAN32(VAR32)    __REV(VAR32)    // Big-endian to Platform-endian
+#define PLATFORM_UNALIGNED          ENABLED         // LDRH/LDR/STRH/STR at any address
+#ifndef PLATFORM_STACK_SIZE
+#   define PLATFORM_STACK_SIZE      960             // Paint size (linker __Stack_Size is 1024)
+#endif
 
 
 /** Low Power Mode Macros:
@@ -71,5 +75,40 @@
 #define MCU_SLEEP_WHILE_RF() SLEEP_WHILE_UHF()
 
 
+/** Delay threshold
+  * platform_swdelay_us/ms() of this many microseconds or more sleep until a
+  * GPTIM compare, instead of counting loops.  GPTIM counts sub-ticks of 
+  * 1/(1024 * 2^PLATFORM_KTIM_SUBBITS) sec, so a sleep can be up to one 
+  * sub-tick longer than asked.
+  */
+#ifndef PLATFORM_DELAY_SLEEP_US
+#   define PLATFORM_DELAY_SLEEP_US  1000
+#endif
+
+
+
+/** Interrupt Priorities <BR>
+  * ========================================================================<BR>
+  * NVIC priorities are written b<pp><ss>: 2 bits of pre-emption priority and
+  * 2 bits of subpriority (group 2, see platform_init_interruptor()).  Only a
+  * higher pre-emption priority interrupts a running handler, so the radio has
+  * group 0 to itself, and MPipe and the kernel timer share group 1.  Then a
+  * long MPipe handler cannot hold off the radio ISRs and overflow the FIFO.
+  */
+#ifndef PLATFORM_NVIC_RADIO
+#   define PLATFORM_NVIC_RADIO      b0001       // Radio GPIO interrupts
+#endif
+#ifndef PLATFORM_NVIC_MPIPE
+#   define PLATFORM_NVIC_MPIPE      b0100       // MPipe UART, DMA and USB
+#endif
+#ifndef PLATFORM_NVIC_KERNEL
+#   define PLATFORM_NVIC_KERNEL     b0101       // GPTIM
+#endif
+#if (   ((PLATFORM_NVIC_RADIO >> 2) >= (PLATFORM_NVIC_MPIPE >> 2)) \
+     || ((PLATFORM_NVIC_RADIO >> 2) >= (PLATFORM_NVIC_KERNEL >> 2)) )
+#   error "The radio must have the highest NVIC pre-emption priority"
+#endif
+
+
 
 #endif
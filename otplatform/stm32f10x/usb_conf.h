@@ -42,6 +42,13 @@
 #define ENDP2_TXADDR        (0x100)
 #define ENDP3_RXADDR        (0x110)
 
+/* EP1 and EP3 double-buffered (MPipe bulk mode) */
+/* buffer 0 is the single-buffer address, buffer 1 is in the free PMA above */
+#define ENDP1_BUF0ADDR      ENDP1_TXADDR
+#define ENDP1_BUF1ADDR      (0x150)
+#define ENDP3_BUF0ADDR      ENDP3_RXADDR
+#define ENDP3_BUF1ADDR      (0x190)
+
 
 /*-------------------------------------------------------------*/
 /* -------------------   ISTR events  -------------------------*/
@@ -246,6 +246,67 @@ ot_u8   cc1101_txbytes()        { return cc1101_read( RFREG(TXBYTES) ); }
 #define __SPI_GET(VAL)  (VAL = RADIO_SPI->RXBUF)
 #define __SPI_PUT(VAL)  (RADIO_SPI->TXBUF = VAL)
 
+/// FIFO burst DMA (see cc1101_fifo_write() and cc1101_fifo_read())
+#ifndef CC1101_DMA_FIFOMIN
+#   define CC1101_DMA_FIFOMIN   8
+#endif
+
+#define _DMA_EN     0x0010
+
+#if ((MCU_FEATURE(RADIODMA) == ENABLED) && defined(RADIO_DMA_TX))
+#   define _FIFO_TXDMA  ENABLED
+#else
+#   define _FIFO_TXDMA  DISABLED
+#endif
+#if ((_FIFO_TXDMA == ENABLED) && defined(RADIO_DMA_RX))
+#   define _FIFO_RXDMA  ENABLED
+#else
+#   define _FIFO_RXDMA  DISABLED
+#endif
+
+#define RADIO_DMA_TXCTL     ( DMA_Mode_Single | \
+                              DMA_DestinationInc_Disable | \
+                              DMA_SourceInc_Enable | \
+                              DMA_DestinationDataSize_Byte | \
+                              DMA_SourceDataSize_Byte | \
+                              DMA_TriggerLevel_RisingEdge | \
+                              _DMA_EN )
+
+#define RADIO_DMA_DUMMYCTL  ( DMA_Mode_Single | \
+                              DMA_DestinationInc_Disable | \
+                              DMA_SourceInc_Disable | \
+                              DMA_DestinationDataSize_Byte | \
+                              DMA_SourceDataSize_Byte | \
+                              DMA_TriggerLevel_RisingEdge | \
+                              _DMA_EN )
+
+#define RADIO_DMA_RXCTL     ( DMA_Mode_Single | \
+                              DMA_DestinationInc_Enable | \
+                              DMA_SourceInc_Disable | \
+                              DMA_DestinationDataSize_Byte | \
+                              DMA_SourceDataSize_Byte | \
+                              DMA_TriggerLevel_RisingEdge | \
+                              _DMA_EN )
+
+/// The DMA triggers are edges, and the TX flag is already up when the data
+/// starts, so it is dropped and raised again to start the channel(s).
+#define __SPI_TXTRIGGER() \
+    do { \
+        RADIO_SPI->IFG &= ~UCTXIFG; \
+        RADIO_SPI->IFG |= UCTXIFG; \
+    } while(0)
+
+
+
+#if (_FIFO_TXDMA == ENABLED)
+void sub_dma_trigger(ot_u8 dmanum, ot_u16 trigger) {
+/// DMACTL0 has the trigger selects of channels 0 & 1, DMACTL1 of channel 2
+    volatile ot_u16* ctl    = &DMA->CTL0 + (dmanum >> 1);
+    ot_u8 shift             = (dmanum & 1) << 3;
+    *ctl = (*ctl & ~(0x00FF << shift)) | (trigger << shift);
+}
+#endif
+
 
 
 void cc1101_init_bus() {
@@ -287,7 +348,15 @@ void cc1101_init_bus() {
     while (RADIO_SPIMISO_PORT->DIN & RADIO_SPIMISO_PIN);
     RADIO_SPICS_HIGH();
     
-    ///4. Perform reset of the digital core.
+    ///4. Select the SPI flags as the triggers of the FIFO DMA channel(s)
+#   if (_FIFO_TXDMA == ENABLED)
+    sub_dma_trigger(RADIO_DMA_TXNUM, RADIO_DMA_TXTRIG);
+#   endif
+#   if (_FIFO_RXDMA == ENABLED)
+    sub_dma_trigger(RADIO_DMA_RXNUM, RADIO_DMA_RXTRIG);
+#   endif
+
+    ///5. Perform reset of the digital core.
     cc1101_reset();
 }
 
@@ -360,6 +429,87 @@ void cc1101_burstwrite(ot_u8 length, ot_u8* cmd_data) {
 
 
 
+/** FIFO bursts <BR>
+  * ============================================================================
+  * The FIFO header (address + burst bit) goes out by the CPU, then the data
+  * goes directly between the FIFO and the caller's buffer in the same SPI
+  * transaction.  With MCU_FEATURE(RADIODMA), bursts of CC1101_DMA_FIFOMIN or
+  * more bytes are clocked by RADIO_DMA_TX on the SPI TX flag, and RX bursts
+  * are taken by RADIO_DMA_RX on the RX flag, if the board gives that channel.
+  * A burst is at most one FIFO (64 bytes), which is done before an LPM0 wake-
+  * up would be, so completion is polled on DMAEN (the DMA vector belongs to
+  * MPipe).  Single transfers clear DMAEN when SZ reaches 0.
+  */
+void sub_fifo_start(ot_u8 header) {
+	cc1101_waitforidle();
+	__SPI_ENABLE();
+    __SPI_PUT(header);
+    while ((RADIO_SPI->IFG & UCRXIFG) == 0);
+    __SPI_GET(cc1101.chipstatus);
+}
+
+
+void cc1101_fifo_write(ot_u8* data, ot_u8 length) {
+    sub_fifo_start( RFREG(TXFIFO) | 0x40 );
+
+#   if (_FIFO_TXDMA == ENABLED)
+    if (length >= CC1101_DMA_FIFOMIN) {
+        RADIO_DMA_TX->SA_L  = (ot_u16)data;
+        RADIO_DMA_TX->DA_L  = (ot_u16)&(RADIO_SPI->TXBUF);
+        RADIO_DMA_TX->SZ    = length;
+        RADIO_DMA_TX->CTL   = RADIO_DMA_TXCTL;
+        __SPI_TXTRIGGER();
+        while (RADIO_DMA_TX->CTL & _DMA_EN);
+        length = 0;
+    }
+#   endif
+
+    ///The RX side is not read: it overruns, but the USCI reset clears that
+    while (length != 0) {
+        length--;
+        while ((RADIO_SPI->IFG & UCTXIFG) == 0);
+        __SPI_PUT(*data++);
+    }
+
+    cc1101_spibus_wait();
+    __SPI_DISABLE();
+}
+
+
+void cc1101_fifo_read(ot_u8* data, ot_u8 length) {
+    sub_fifo_start( RFREG(RXFIFO) | 0xC0 );
+
+#   if (_FIFO_RXDMA == ENABLED)
+    if (length >= CC1101_DMA_FIFOMIN) {
+        static const ot_u8 dummy = 0;
+        RADIO_DMA_RX->SA_L  = (ot_u16)&(RADIO_SPI->RXBUF);
+        RADIO_DMA_RX->DA_L  = (ot_u16)data;
+        RADIO_DMA_RX->SZ    = length;
+        RADIO_DMA_RX->CTL   = RADIO_DMA_RXCTL;
+        RADIO_DMA_TX->SA_L  = (ot_u16)&dummy;
+        RADIO_DMA_TX->DA_L  = (ot_u16)&(RADIO_SPI->TXBUF);
+        RADIO_DMA_TX->SZ    = length;
+        RADIO_DMA_TX->CTL   = RADIO_DMA_DUMMYCTL;
+        __SPI_TXTRIGGER();
+        while (RADIO_DMA_RX->CTL & _DMA_EN);
+        length = 0;
+    }
+#   endif
+
+    while (length != 0) {
+        length--;
+        while ((RADIO_SPI->IFG & UCTXIFG) == 0);
+        __SPI_PUT(0);
+        while ((RADIO_SPI->IFG & UCRXIFG) == 0);
+        __SPI_GET(*data++);
+    }
+
+    __SPI_DISABLE();
+}
+
+
+
+
 
 
 
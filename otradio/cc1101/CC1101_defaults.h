@@ -87,13 +87,18 @@
 #define DRF_MDMCFG3_HI          0xF8
 #define DRF_MDMCFG2             (_DEM_DCFILT_OFF | _MOD_FORMAT_GFSK | _SYNC_MODE_16in16)
 #define DRF_MDMCFG1             (_NUM_PREAMBLE_4B | _CHANSPC_E(2)) //From SRFS
+#define DRF_MDMCFG1_HI          (_NUM_PREAMBLE_6B | _CHANSPC_E(2)) //6B preamble on Hi-speed
 #define DRF_MDMCFG0             0x11    //From SRFS
 
 #define DRF_DEVIATN             0x50    //From SRFS (50 kHz)
 
 #define DRF_MCSM2               0
 #define DRF_MCSM1               (_CCA_MODE_RSSILOWRX | _RXOFF_MODE_IDLE | _TXOFF_MODE_IDLE)
-#define DRF_MCSM0               (_FS_AUTOCAL_4THIDLE | _PO_TIMEOUT_155us)
+#if (OT_FEATURE(RFCAL) == ENABLED)
+#   define DRF_MCSM0            (_FS_AUTOCAL_NEVER | _PO_TIMEOUT_155us)     // calibrated by the kernel
+#else
+#   define DRF_MCSM0            (_FS_AUTOCAL_4THIDLE | _PO_TIMEOUT_155us)
+#endif
 
 #define DRF_FOCCFG              0x16    //From SRFS
 #define DRF_BSCFG               0x6C    //From SRFS
@@ -276,6 +276,30 @@ void cc1101_burstwrite(ot_u8 length, ot_u8* cmd_data);
 
 
 
+/** @brief  Burst write of data into the TX FIFO
+  * @param  data        (ot_u8*) data to write
+  * @param  length      (ot_u8) number of bytes to write
+  * @retval none
+  * @ingroup CC1101
+  *
+  * Unlike cc1101_burstwrite(), the data buffer does not carry the address, so
+  * the caller does not need to stage the data behind it.  The implementation
+  * may use DMA for the data phase of the burst.
+  */
+void cc1101_fifo_write(ot_u8* data, ot_u8 length);
+
+
+
+/** @brief  Burst read of data from the RX FIFO
+  * @param  data        (ot_u8*) buffer to read data into
+  * @param  length      (ot_u8) number of bytes to read
+  * @retval none
+  * @ingroup CC1101
+  */
+void cc1101_fifo_read(ot_u8* data, ot_u8 length);
+
+
+
 
 
 
@@ -277,6 +277,7 @@
 #   define _EVENT1_TIMEOUT24    (5<<4)
 #   define _EVENT1_TIMEOUT32    (6<<4)
 #   define _EVENT1_TIMEOUT48    (7<<4)
+#   define _RC_CAL              (1<<3)
 #   define _WOR_RES_29us        (0)
 #   define _WOR_RES_920us       (1)
 #   define _WOR_RES_30ms        (2)
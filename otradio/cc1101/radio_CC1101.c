@@ -52,6 +52,7 @@
 #include "veelite.h"
 #include "session.h"
 #include "system.h"
+#include "m2_network.h"     // M2AdvP flood frames
 
 #include "CC1101_interface.h"
 #include "CC1101_defaults.h"      // register definitions file
@@ -64,6 +65,7 @@
   * This driver only supports M2_PARAM_MI_CHANNELS = 1.
   */
 phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
+rm2_stamp_struct rm2_stamp;
 
 
 /** Radio struct array declaration
@@ -73,6 +75,98 @@ radio_struct radio;
 
 
 
+
+/** Channel Table & Calibration Cache
+  * The channel configuration ISF is copied into RAM when it is first needed,
+  * and it is copied again only after veelite reports that a file has changed
+  * (vl_writestamp, vl_mapstamp).  subcc1101_channel_lookup() reads from the
+  * table, so a channel scan does not need to open the ISF.
+  *
+  * The FSCAL3-1 results from calibration are saved for each of the 16 center
+  * frequencies when the radio leaves it.  Returning to that center frequency
+  * writes the saved results, and RADIO_FLAG_AUTOCAL is not set, so RX/TX entry
+  * skips the 799us calibration stage.  The cache is cleared in radio_init().
+  *
+  * stamp       value of vl_writestamp + vl_mapstamp when table was loaded
+  * valid       False forces the table to be reloaded
+  * count       number of channels in the table
+  * entry[]     channel data bytes 0-5 of each 8 byte ISF record
+  * calnow      center freq the FSCAL registers are set for (0xFF = none)
+  * calmask     bit N is set when fscal[N] holds saved results
+  * fscal[][]   saved FSCAL3, FSCAL2, FSCAL1 of each center frequency
+  */
+#ifndef RF_PARAM_CHANNELS
+#   define RF_PARAM_CHANNELS    (ISF_MAX(channel_configuration) / 8)
+#endif
+#ifndef RF_FEATURE_CALCACHE
+#   define RF_FEATURE_CALCACHE  ENABLED
+#endif
+
+typedef struct {
+    ot_u8   spectrum_id;
+    ot_u8   autoscale;
+    ot_u8   tx_eirp;
+    ot_u8   link_qual;
+    ot_u8   cs_thr;
+    ot_u8   cca_thr;
+} chanentry_struct;
+
+typedef struct {
+    ot_u16  stamp;
+    ot_bool valid;
+    ot_u8   count;
+    chanentry_struct entry[RF_PARAM_CHANNELS];
+#   if (RF_FEATURE(CALCACHE) == ENABLED)
+        ot_u8   calnow;
+        ot_u16  calmask;
+        ot_u8   fscal[16][3];
+#   endif
+} chantable_struct;
+
+chantable_struct chantable;
+
+
+
+
+/** Channel Scan Occupancy
+  * A moving average (EWMA) of the RSSI measured on each of the 16 center
+  * frequencies, updated by every CCA scan.  rm2_txcsma() orders the TX channel
+  * list by it before the first CCA, so the channel most likely to be clear is
+  * scanned first, and the scan stops at the first clear channel.  Averages are
+  * stored in 1/16 dBm.  Channels whose averages are in the same 4 dB bucket
+  * keep the order they had (e.g. from sub_csma_scramble()).
+  */
+#ifndef RF_FEATURE_SCANSORT
+#   define RF_FEATURE_SCANSORT  ENABLED
+#endif
+
+#define SCAN_EWMA_SHIFT     2               // each scan moves the average 1/4
+#define SCAN_KEY_SHIFT      (4+2)           // ordering buckets of 4 dB
+
+#if (RF_FEATURE(SCANSORT) == ENABLED)
+ot_int scan_ewma[16];
+#endif
+
+
+
+
+/** FIFO Threshold Sizing
+  * The FIFO thresholds are sized from the data rate: each FIFO interrupt moves
+  * as many bytes as it can, and the FIFO keeps enough room (TX: data) to cover
+  * an ISR latency of 1/2^RF_PARAM_ISRLATENCY ti.  The FIFO time comes from
+  * rm2_scale_codec().  When DISABLED, the thresholds are fixed at 48 for RX
+  * and 5 for TX.  cc1101_virtual_isr() already gets one vector per event, so
+  * unlike CC430 there is no state test to remove from the dispatch.
+  */
+#ifndef RF_FEATURE_CHAINEDISR
+#   define RF_FEATURE_CHAINEDISR    ENABLED
+#endif
+#ifndef RF_PARAM_ISRLATENCY
+#   define RF_PARAM_ISRLATENCY      2           // 1/4 ti = ~244us
+#endif
+
+
+
 /** Virtual ISR (gets supplied by real ISR from CC1101_....c)  <BR>
   * ========================================================================<BR>
   */
@@ -116,21 +210,30 @@ void    subcc1101_launch_tx(ot_u8 flags, ot_sig2 callback);
 
 void    subcc1101_kill(ot_int main_err, ot_int frame_err);
 void    subcc1101_killonlowrssi();
+void    subcc1101_endsniff();
 void 	subcc1101_reset_autocal();
 
-ot_bool subcc1101_chan_scan();
+ot_bool subcc1101_chan_scan(ot_bool use_cca);
 ot_bool subcc1101_cca_scan();
 
-ot_bool subcc1101_channel_lookup(ot_u8 chan_id, vlFILE* fp);
+void    subcc1101_chantable_refresh();
+ot_u8   subcc1101_chan_fc(ot_u8 chan_id);
+void    subcc1101_chan_sort();
+ot_bool subcc1101_channel_lookup(ot_u8 chan_id);
+void    subcc1101_calibrate(ot_u8 fc_i);
 void    subcc1101_syncword_config(sync_enum sync_class);
 void    subcc1101_buffer_config(ot_u8 mode, ot_u8 param);
 void    subcc1101_chan_config(ot_u8 old_chan, ot_u8 old_eirp);
+void    subcc1101_phy_timing(ot_u8 chan_id);
 
 void    subcc1101_prep_q(Queue* q);
 //ot_int  subcc1101_eta(ot_int next_int);
 //ot_int  subcc1101_eta_rxi();
 //ot_int  subcc1101_eta_txi();
 void    subcc1101_offset_rxtimeout();
+ot_int  subcc1101_fifo_margin();
+ot_int  subcc1101_rxlimit();
+ot_u8   subcc1101_txthr();
 
 
 
@@ -187,6 +290,19 @@ void radio_idle() {
 	}
 #endif
 	cc1101_strobe(STROBE(SIDLE));
+
+    /// The other registers are retained in SLEEP, but the test registers are
+    /// not, so on the way out of SLEEP they are written back in one burst.
+    /// PATABLE is also lost, and RADIO_FLAG_SETPWR already rewrites it at TX.
+#   ifndef BOARD_RF430USB_5509
+    if (radio.flags & RADIO_FLAG_ASLEEP) {
+        static const ot_u8 test_regs[] = { RFREG(FSTEST)|0x40, 
+                                           DRF_FSTEST, DRF_PTEST, DRF_AGCTEST,
+                                           DRF_TEST2, DRF_TEST1, DRF_TEST0 };
+        radio.flags &= ~RADIO_FLAG_ASLEEP;
+        cc1101_spibus_io(7, 0, (ot_u8*)test_regs, NULL);
+    }
+#   endif
 }
 #endif
 
@@ -198,6 +314,56 @@ void radio_calibrate() {
 #endif
 
 
+#if (OT_FEATURE(RFCAL) == ENABLED)
+#ifndef EXTF_radio_recalibrate
+void radio_recalibrate() {
+/// SCAL starts from IDLE and ends in IDLE.  Each center frequency with saved
+/// results is calibrated in turn.  calnow is then calibrated too, so the
+/// staged calibration (RADIO_FLAG_AUTOCAL) is not needed anymore.
+#if (RF_FEATURE(CALCACHE) == ENABLED)
+    ot_u16  calmask;
+    ot_u8   fc_i;
+
+    calmask = chantable.calmask;
+    if (chantable.calnow < 16) {
+        calmask |= (1 << chantable.calnow);
+    }
+    if (calmask == 0) {
+        return;
+    }
+
+    radio_idle();
+    for (fc_i=0; fc_i<16; fc_i++) {
+        if (calmask & (1 << fc_i)) {
+            cc1101_write(RFREG(CHANNR), fc_i);
+            radio_calibrate();
+            while ((cc1101_read(RFREG(MARCSTATE)) & 0x1F) != 0x01);    // IDLE
+            cc1101_burstread(RFREG(FSCAL3), 3, &chantable.fscal[fc_i][0]);
+        }
+    }
+    chantable.calmask = calmask;
+
+    if (chantable.calnow < 16) {
+        ot_u8 cmd[4];
+        cmd[0]  = RFREG(FSCAL3);
+        cmd[1]  = chantable.fscal[chantable.calnow][0];
+        cmd[2]  = chantable.fscal[chantable.calnow][1];
+        cmd[3]  = chantable.fscal[chantable.calnow][2];
+        cc1101_write(RFREG(CHANNR), chantable.calnow);
+        cc1101_burstwrite(4, cmd);
+    }
+#else
+    radio_idle();
+    radio_calibrate();
+    while ((cc1101_read(RFREG(MARCSTATE)) & 0x1F) != 0x01);            // IDLE
+#endif
+    subcc1101_reset_autocal();
+    radio_sleep();
+}
+#endif
+#endif
+
+
 
 
 
@@ -209,8 +375,6 @@ void radio_calibrate() {
 
 #ifndef EXTF_radio_init
 void radio_init( ) {
-    vlFILE* fp;
-
     cc1101_init_bus();           //Initialize IO
     cc1101_load_defaults();     //Load default registers                  
 
@@ -218,14 +382,26 @@ void radio_init( ) {
     /// lookup on the default channel (0x00) to kick things off.  Since the 
     /// startup channel will always be different than a real channel, the 
     /// necessary settings and calibration will always occur. 
-    fp                  = ISF_open_su( ISF_ID(channel_configuration) );
     phymac[0].channel   = 0x55;
     phymac[0].tx_eirp   = 0x7F;
+    subcc1101_phy_timing(0x55);
     radio.flags			= 0;
     radio.state         = 0;
     radio.evtdone       = &otutils_sig2_null;
-    subcc1101_channel_lookup(0x00, fp);
-    vl_close(fp);
+    radio.sync          = 0xFF;
+    chantable.valid     = False;
+#   if (RF_FEATURE(CALCACHE) == ENABLED)
+    chantable.calnow    = 0xFF;
+    chantable.calmask   = 0;
+#   endif
+#   if (RF_FEATURE(SCANSORT) == ENABLED)
+    {   ot_int i;
+        for (i=0; i<16; i++) {
+            scan_ewma[i] = (-140 << 4);     // unknown channels sort first
+        }
+    }
+#   endif
+    subcc1101_channel_lookup(0x00);
 
     radio_sleep();
 }
@@ -271,21 +447,28 @@ void radio_putbyte(ot_u8 databyte) {
 
 #ifndef EXTF_radio_putfourbytes
 void radio_putfourbytes(ot_u8* data) {
-/// @note Eventually I would like to use an endian-independent implementation,
-/// (basically, this is the big endian version) but now is not the time. Doing
-/// so will involve revising the FEC encoder in the Encode Module.
+/// The FEC interleaver output is a byte array already in over-the-air order
 #if (M2_FEATURE(FEC) == ENABLED)
-#   ifdef __BIG_ENDIAN__
-        data--;
-        *data = RFREG(TXFIFO);
-        cc1101_burstwrite(5, data);
-#   else
-        cc1101_write(RFREG(TXFIFO), data[3]);
-        cc1101_write(RFREG(TXFIFO), data[2]);
-        cc1101_write(RFREG(TXFIFO), data[1]);
-        cc1101_write(RFREG(TXFIFO), data[0]);
-#   endif
+    cc1101_fifo_write(data, 4);
+#endif
+}
 #endif
+
+
+
+#ifndef EXTF_radio_putbytes
+ot_int radio_putbytes(ot_u8* data, ot_int limit) {
+/// The data goes in one FIFO burst, straight from the caller's buffer
+    ot_int room;
+    room = radio.txlimit - (ot_int)cc1101_read(RFREG(TXBYTES));
+    if (room > limit) {
+        room = limit;
+    }
+    if (room > 0) {
+        cc1101_fifo_write(data, (ot_u8)room);
+        return room;
+    }
+    return 0;
 }
 #endif
 
@@ -302,7 +485,26 @@ ot_u8 radio_getbyte() {
 #ifndef EXTF_radio_getfourbytes
 void radio_getfourbytes(ot_u8* data) {
 ///@note Radio is big endian as is datastream, so no conversion necessary
-    cc1101_burstread(RFREG(RXFIFO), 4, data);
+    cc1101_fifo_read(data, 4);
+}
+#endif
+
+
+
+#ifndef EXTF_radio_getbytes
+ot_int radio_getbytes(ot_u8* data, ot_int limit) {
+///@note Do not draw-out the bottom byte in the FIFO until packet is complete.
+///      This is a known erratum of CC11xx.
+    ot_int ready;
+    ready = (ot_int)cc1101_read(RFREG(RXBYTES)) - (radio.state != RADIO_STATE_RXDONE);
+    if (ready > limit) {
+        ready = limit;
+    }
+    if (ready > 0) {
+        cc1101_fifo_read(data, (ot_u8)ready);
+        return ready;
+    }
+    return 0;
 }
 #endif
 
@@ -381,13 +583,8 @@ ot_bool subcc1101_test_channel(ot_u8 channel, ot_u8 netstate) {
     ot_bool test = True;
 
     if ((channel != phymac[0].channel) || (netstate == M2_NETSTATE_UNASSOC)) {
-        vlFILE* fp;
-        /// Open the Mode 2 FS Config register that contains the channel list
-        /// for this host, and make sure the channel we want to use is available
-        ///@todo assert fp in debug
-        fp      = ISF_open_su( ISF_ID(channel_configuration) );
-        test    = subcc1101_channel_lookup(channel, fp);
-        vl_close(fp);
+        /// Make sure the channel we want to use is in the channel list
+        test    = subcc1101_channel_lookup(channel);
     }
 
     return test;
@@ -405,7 +602,9 @@ void subcc1101_launch_rx(ot_u8 channel, ot_u8 netstate, ot_u8 mcsm2_val) {
 	sync_enum	sync_type;
 
 	/// 1.  Prepare RX queue by flushing it
-#   ifdef RADIO_IRQ2_PIN
+#   if (defined(RADIO_IRQ2_PIN) && (RF_FEATURE(CHAINEDISR) == ENABLED))
+	radio.rxlimit = subcc1101_rxlimit();
+#   elif defined(RADIO_IRQ2_PIN)
 	radio.rxlimit = 48;
 #   else
 	radio.rxlimit = 8;
@@ -449,7 +648,11 @@ void subcc1101_launch_rx(ot_u8 channel, ot_u8 netstate, ot_u8 mcsm2_val) {
             radio.state     = ((radio.flags & RADIO_FLAG_FRCONT) == 0);
             radio.state    += auto_flag;
             radio.flags    |= (auto_flag << 3);     // sets RADIO_FLAG_RESIZE
+#           if (RF_FEATURE(CHAINEDISR) == ENABLED)
+            radio.rxlimit   = (auto_flag) ? subcc1101_rxlimit() : 8;
+#           else
             radio.rxlimit   = (auto_flag) ? 48 : 8; ///@todo 48 is a magic-number
+#           endif
             buffer_mode     = 2 - auto_flag;
 #       else
             // Initial state is always RXAUTO (2)
@@ -462,6 +665,17 @@ void subcc1101_launch_rx(ot_u8 channel, ot_u8 netstate, ot_u8 mcsm2_val) {
 
     /// 5.  Configure CC1101 for FG or BG receiving
     subcc1101_buffer_config(buffer_mode, pktlen);
+#   if (RF_FEATURE(SUBNETFILTER) == ENABLED)
+    /// BG frames start with the subnet, so the address check can drop frames
+    /// for other subnets.  It is exact only when the device subnet mask is
+    /// 0xF (passing subnets are 0xFF and ours), and not usable with FEC.
+    if ( (radio.flags & RADIO_FLAG_FLOOD) \
+        && ((dll.netconf.subnet & 0x0F) == 0x0F) \
+        && ((phymac[0].channel & 0x80) == 0) ) {
+        cc1101_write(RFREG(ADDR), dll.netconf.subnet);
+        cc1101_write(RFREG(PKTCTRL1), (DRF_PKTCTRL1 | _ADR_CHK_ON_FF));
+    }
+#   endif
     subcc1101_syncword_config(sync_type);
     cc1101_write(RFREG(FIFOTHR), (ot_u8)((radio.rxlimit >> 2) - 1));
     cc1101_write(RFREG(AGCCTRL2), phymac[0].cs_thr);
@@ -475,8 +689,31 @@ void subcc1101_launch_rx(ot_u8 channel, ot_u8 netstate, ot_u8 mcsm2_val) {
     em2_decode_newframe();
     subcc1101_offset_rxtimeout();     // if timeout is 0, set it to a minimal amount
 
-    /// 7.  Setup interrupts for Sync Detect and IDLE fallback, then Turn on RX
+    /// 7.  Sniff RX: the WOR timer (RC oscillator, 1 count = ~0.923 ms at
+    ///     WOR_RES=1) wakes the receiver every EVENT0, and it listens for
+    ///     EVENT0/2^(6+RX_TIME) unless a sync word is qualified.  The chip
+    ///     sleeps between listens, so only Sync Detect interrupts the MCU.
     radio_flush_rx();
+#   if (RF_FEATURE(SCANCYCLE) == ENABLED)
+    if (radio.sniff_evt0 != 0) {
+        ot_uint evt0;
+        ot_u8   wor_block[4];
+        evt0            = radio.sniff_evt0 + (radio.sniff_evt0 >> 4);
+        radio.flags    |= RADIO_FLAG_SNIFF;
+        cc1101_write(RFREG(MCSM2), (mcsm2_val & _RX_TIME_RSSI) | _RX_TIME_QUAL | radio.sniff_rxtime);
+        wor_block[0]    = RFREG(WOREVT1);       // WOREVT1, WOREVT0, WORCTRL
+        wor_block[1]    = (ot_u8)(evt0 >> 8);
+        wor_block[2]    = (ot_u8)evt0;
+        wor_block[3]    = _EVENT1_TIMEOUT4 | _RC_CAL | _WOR_RES_920us;
+        cc1101_burstwrite(4, wor_block);
+        cc1101_iocfg_listen();
+        cc1101_strobe( STROBE(SWOR) );
+        cc1101_int_turnon(RFI_SYNC);
+        return;
+    }
+#   endif
+
+    /// 8.  Setup interrupts for Sync Detect and IDLE fallback, then Turn on RX
     cc1101_iocfg_listen();
     cc1101_strobe( STROBE(SRX) );
     cc1101_int_turnon(RFI_SYNC | RFI_RXIDLE);
@@ -525,9 +762,7 @@ ot_int rm2_default_tgd(ot_u8 chan_id) {
 ot_int rm2_pkt_duration(ot_int pkt_bytes) {
 /// Wrapper function for rm2_scale_codec that adds some slop overhead
 /// Slop = preamble bytes + sync bytes + ramp-up + ramp-down + padding
-    pkt_bytes  += RF_PARAM_PKT_OVERHEAD;
-    pkt_bytes  += (phymac[0].channel >> 4) & 2;
-    return rm2_scale_codec(pkt_bytes);
+    return rm2_scale_codec(pkt_bytes + phymac[0].tpad);
 }
 #endif
 
@@ -537,21 +772,8 @@ ot_int rm2_pkt_duration(ot_int pkt_bytes) {
 ot_int rm2_scale_codec(ot_int buf_bytes) {
 /// Turns a number of bytes (buf_bytes) into a number of ti units.
 /// To refresh your memory: 1 ti = ((1sec/32768) * 2^5) = 2^-10 sec = ~0.977 ms
-
-    /// Pursuant to DASH7 Mode 2 spec, b6:4 of channel ID corresponds to kS/s.
-    /// 55.555 kS/s = 144us per buffer byte
-    /// 200.00 kS/s = 40us per buffer bytes
-    buf_bytes *= (phymac[0].channel & 0x20) ? 40 : 144;
-
-    /// Divide us into Ticks
-    /// (shift right 10 = divide by 1024)
-#   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) == ENABLED))
-        buf_bytes >>= (10 - ((phymac[0].channel & 0x80) != 0) );
-#   else
-        buf_bytes >>= 10;
-#   endif
-
-    return buf_bytes;
+/// phymac[0].tscale is the byte air time in 1/256 ti (see subcc1101_phy_timing()).
+    return (buf_bytes * phymac[0].tscale) >> 8;
 }
 #endif
 
@@ -620,17 +842,53 @@ void rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback) {
 
 
 
+#if (RF_FEATURE(SCANCYCLE) == ENABLED)
+#ifndef EXTF_rm2_rxinit_sniff
+ot_bool rm2_rxinit_sniff(ot_u8 channel, ot_u8 netstate, ot_uint period, ot_uint listen, ot_sig2 callback) {
+#if (SYS_RECEIVE == ENABLED)
+    /// The shortest WOR listen window (RX_TIME = 0) is about 1/64 of EVENT0,
+    /// and each RX_TIME step halves it.  Pick the shortest one that is still
+    /// at least the requested listen time.  Longer listens are not sniffable,
+    /// and neither are periods that overflow EVENT0 after RC scaling.
+    ot_u8 rx_time;
+
+    if (((period >> 6) <= listen) || (period > 0xF000)) {
+        return False;
+    }
+    for (rx_time=0; (rx_time < 6) && ((period >> (7+rx_time)) >= listen); rx_time++);
+
+    radio.sniff_evt0    = period;
+    radio.sniff_rxtime  = rx_time;
+    if (netstate & M2_NETFLAG_FLOOD)    rm2_rxinit_bf(channel, callback);
+    else                                rm2_rxinit_ff(channel, netstate, 0, callback);
+    radio.sniff_evt0    = 0;
+
+    return True;
+#else
+    return False;
+#endif
+}
+#endif
+#endif
+
+
+
+
 #ifndef EXTF_rm2_rxsync_isr
 void rm2_rxsync_isr() {
 /// Reset the radio interruptor to catch the next RX FIFO interrupt, having
 /// qualified the Sync Word.  rm2_rxdata_isr() will be called on that interrupt.
 /// Also, re-schedule a system event as a watchdog.
+    rm2_stamp.rxsync = platform_stamp();
+    SYS_PROFILE_ISR_START();
 	cc1101_int_turnoff(RFI_SOURCE0 | RFI_SOURCE2);
+    subcc1101_endsniff();
     cc1101_iocfg_rxdata();
     cc1101_int_turnon(RFI_SOURCE0 | RFI_SOURCE2);
 
     sys_set_mutex((ot_uint)SYS_MUTEX_RADIO_DATA);
     subcc1101_killonlowrssi();
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXSYNC);
 }
 #endif
 
@@ -649,13 +907,33 @@ void rm2_rxtimeout_isr() {
 
 #ifndef EXTF_rm2_rxdata_isr
 void rm2_rxdata_isr() {
+    SYS_PROFILE_ISR_START();
 #if (SYS_RECEIVE == ENABLED)
     subcc1101_killonlowrssi();
 
+    /// 0. Background frames are constant length and are only serviced once
+    ///    they are done, so they take the short path
+    if (radio.flags & RADIO_FLAG_FLOOD) {
+        subcc1101_kill(0, em2_decode_bf());
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+        return;
+    }
+
     /// 1. load data
     //RFGET_RXDATA();         // Only needed w/ internal DMA usage to set buffer params
     em2_decode_data();      // Contains logic to prevent over-run
 
+#   if (M2_FEATURE(RXFILTER) == ENABLED)
+    /// 1b. Kill RX as soon as the header shows the frame is for another
+    ///     subnet or device (see sys_rxfilter())
+    if (sys_rxfilter() == False) {
+        radio_idle();
+        subcc1101_kill(RM2_ERR_LINK, 0);
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+        return;
+    }
+#   endif
+
     /// 2. Handle each RX type, and transitions
     switch ((radio.state >> RADIO_STATE_RXSHIFT) & (RADIO_STATE_RXMASK >> RADIO_STATE_RXSHIFT)) {
 
@@ -680,8 +958,7 @@ void rm2_rxdata_isr() {
 
                 // Prepare the next frame by moving the "front" pointer and
                 // re-initializing the decoder engine
-                q_rebase(&rxq, rxq.putcursor);
-                em2_decode_newframe();
+                em2_decode_nextframe();
 
                 // Clear out what's leftover in the FIFO, from the new frame,
                 // and re-do boundary checks on this new frame.
@@ -732,7 +1009,12 @@ void rm2_rxdata_isr() {
             }
 #           ifndef RADIO_IRQ2_PIN
             else if (radio.rxlimit <= 8) {
-            	radio.rxlimit = (remaining_bytes < 48) ? remaining_bytes : 48;
+#               if (RF_FEATURE(CHAINEDISR) == ENABLED)
+                ot_int limit  = subcc1101_rxlimit();
+#               else
+                ot_int limit  = 48;
+#               endif
+            	radio.rxlimit = (remaining_bytes < limit) ? remaining_bytes : limit;
             	cc1101_write(RFREG(FIFOTHR), (ot_u8)((radio.rxlimit >> 2) - 1));
             }
 #           endif
@@ -743,12 +1025,14 @@ void rm2_rxdata_isr() {
         case (RADIO_STATE_RXDONE >> RADIO_STATE_RXSHIFT): {
         rm2_rxpkt_DONE:
             subcc1101_kill(0, (ot_int)crc_check() - 1);
+            SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
             return;
         }
 
         /// Bug Trap
         default:
             rm2_kill();
+            SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
             return;
     }
 
@@ -761,6 +1045,7 @@ void rm2_rxdata_isr() {
 #   endif
 
 #endif
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
 }
 #endif
 
@@ -838,17 +1123,24 @@ ot_int rm2_txcsma() {
     // It may seem silly, but it allows the switch to be compiled better.
     switch ( (radio.state >> RADIO_STATE_TXSHIFT) & (RADIO_STATE_TXMASK >> RADIO_STATE_TXSHIFT) ) {
 
-        /// 1. First CCA: Find a usable channel, then do 1st CCA
-        /// Note: case fall-through on success
+        /// 1. First CCA: Find a usable channel that passes the 1st CCA, or
+        ///    just a usable channel if CSMA is disabled.
         case (RADIO_STATE_TXCCA1 >> RADIO_STATE_TXSHIFT): {
-            if (subcc1101_chan_scan() == False) {	//Get usable channel
-            	retval = RM2_ERR_BADCHANNEL;
-            	break;
-            }
             if (dll.comm.csmaca_params & M2_CSMACA_NOCSMA) {
+                if (subcc1101_chan_scan(False) == False) {
+                    retval = RM2_ERR_BADCHANNEL;
+                    break;
+                }
             	goto rm2_txcsma_START;
             }
-            retval = phymac[0].tg;
+            subcc1101_chan_sort();
+            if (subcc1101_chan_scan(True) == False) {
+            	retval = RM2_ERR_CCAFAIL;
+            	break;
+            }
+            radio.state = RADIO_STATE_TXCCA2;
+            retval      = phymac[0].tg;
+            break;
         }
 
         /// 2. Second CCA
@@ -869,6 +1161,12 @@ ot_int rm2_txcsma() {
         ///now the system is just burning energy in IDLE
         case (RADIO_STATE_TXSTART >> RADIO_STATE_TXSHIFT): {
         rm2_txcsma_START:
+#       if (M2_FEATURE(AUTOSCALE) == ENABLED)
+        	if (phymac[0].tx_eirp != RM2_EIRP_AUTOSCALE(phymac[0].max_eirp)) {
+        	    phymac[0].tx_eirp = RM2_EIRP_AUTOSCALE(phymac[0].max_eirp);
+        	    radio.flags      |= RADIO_FLAG_SETPWR;
+        	}
+#       endif
         	if (radio.flags & RADIO_FLAG_SETPWR) {
         		radio.flags &= ~RADIO_FLAG_SETPWR;
         		cc1101_set_txpwr( phymac[0].tx_eirp );
@@ -876,8 +1174,16 @@ ot_int rm2_txcsma() {
         	radio.state		= RADIO_STATE_TXDATA;
         	radio.txlimit   = 8;
         	txq.getcursor   = txq.front;
-        	txq.front[1]    = phymac[0].tx_eirp;
-        	subcc1101_prep_q(&txq);
+#       if (SYS_FLOOD == ENABLED)
+        	if (radio.flags & RADIO_FLAG_FLOOD) {
+        	    txq.options.ubyte[UPPER] = 0;   // M2AdvP frames carry their CRC
+        	}
+        	else
+#       endif
+        	{
+        	    txq.front[1]    = phymac[0].tx_eirp;
+        	    subcc1101_prep_q(&txq);
+        	}
         	radio_flush_tx();
         	em2_encode_newpacket();
         	em2_encode_newframe();
@@ -906,7 +1212,11 @@ ot_int rm2_txcsma() {
 #       endif
 
             radio.txlimit = RADIO_BUFFER_TXMAX;
+#           if (RF_FEATURE(CHAINEDISR) == ENABLED)
+            cc1101_write(RFREG(FIFOTHR), DRF_FIFOTHR | subcc1101_txthr());
+#           else
             cc1101_write(RFREG(FIFOTHR), DRF_FIFOTHR | _FIFO_TXTHR(5));
+#           endif
             cc1101_iocfg_txdata();
             cc1101_int_turnon(RFI_SOURCE0 | RFI_SOURCE2);
             cc1101_strobe(STROBE(STX));
@@ -926,6 +1236,7 @@ ot_int rm2_txcsma() {
 
 #ifndef EXTF_rm2_txdata_isr
 void rm2_txdata_isr() {
+    SYS_PROFILE_ISR_START();
     /// Continues where rm2_txcsma() leaves off.
     switch ( (radio.state >> RADIO_STATE_TXSHIFT) & (RADIO_STATE_TXMASK >> RADIO_STATE_TXSHIFT) ) {
 
@@ -940,11 +1251,14 @@ void rm2_txdata_isr() {
 
 #           if (SYS_FLOOD == ENABLED)
             /// Packet flooding.  Only needed on devices that can send M2AdvP
+            /// The next frame is already prepared: load it before anything
+            /// else, and let the callback prepare the one after it.
             if (radio.flags & RADIO_FLAG_FLOOD) {
-                radio.evtdone(2, 0);
-                txq.getcursor = txq.front;
+                m2advp_swap();
                 em2_encode_newframe();
-                goto rm2_txpkt_TXDATA;
+                em2_encode_data();
+                radio.evtdone(2, 0);
+                break;
             }
 #           endif
 
@@ -952,12 +1266,13 @@ void rm2_txdata_isr() {
             /// If the frame is done, but more need to be sent (e.g. MFP's)
             /// queue it up.  The additional encode stage is there to fill up
             /// what's left of the buffer.
+            /// The buffer is filled before the callback runs, so the callback
+            /// does not widen the gap between the frames.
             if (radio.flags & RADIO_FLAG_FRCONT) {
-                q_rebase(&txq, txq.getcursor);
-                radio.evtdone(1, 0);        //callback action for next frame
-                em2_encode_newframe();
+                em2_encode_nextframe();
                 txq.front[1] = phymac[0].tx_eirp;
                 em2_encode_data();
+                radio.evtdone(1, 0);        //callback action for next frame
                 goto rm2_txpkt_TXDATA;
             }
 
@@ -970,6 +1285,21 @@ void rm2_txdata_isr() {
             }
 #           endif
 
+            /// Redundant TX pipelining: the callback may chain the next copy
+            /// with rm2_prep_resend().  The frame already carries its CRC.
+#           if (OT_FEATURE(TXPIPE) == ENABLED)
+            if (!(radio.flags & RADIO_FLAG_FRCONT)) {
+                radio.evtdone(2, 0);
+                if (txq.options.ubyte[UPPER] == 255) {
+                    txq.options.ubyte[UPPER] = 0;
+                    txq.getcursor = txq.front;
+                    em2_encode_newframe();
+                    em2_encode_data();
+                    break;
+                }
+            }
+#           endif
+
             /// The last part of the frame needs to exit the FIFO
             //radio.txlimit = cc1101_read(RFREG(TXBYTES));
             radio.state = RADIO_STATE_TXDONE;
@@ -984,6 +1314,7 @@ void rm2_txdata_isr() {
         /// 5. Conclude the TX process, and wipe the radio state
         //     turn off any remaining TX interrupts
         case (RADIO_STATE_TXDONE >> RADIO_STATE_TXSHIFT):
+            rm2_stamp.txend = platform_stamp();
             subcc1101_kill(0, 0);
             break;
 
@@ -992,6 +1323,7 @@ void rm2_txdata_isr() {
             rm2_kill();
             break;
     }
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_TXDATA);
 }
 #endif
 
@@ -1016,6 +1348,7 @@ void subcc1101_kill(ot_int main_err, ot_int frame_err) {
     radio_gag();
     //radio_idle();			//should already be in idle, or going to idle
     subcc1101_reset_autocal();
+    subcc1101_endsniff();
 
     /// 2.  Run callback, then reset callback and reset radio state
     radio.evtdone(main_err, frame_err);
@@ -1027,6 +1360,20 @@ void subcc1101_kill(ot_int main_err, ot_int frame_err) {
 
 
 
+void subcc1101_endsniff() {
+/// Once a sniff RX has found a sync word or been killed, the RC oscillator is
+/// powered-down again (WORCTRL default).
+#if (RF_FEATURE(SCANCYCLE) == ENABLED)
+    if (radio.flags & RADIO_FLAG_SNIFF) {
+        radio.flags &= ~RADIO_FLAG_SNIFF;
+        cc1101_write(RFREG(WORCTRL), DRF_WORCTRL);
+    }
+#endif
+}
+
+
+
+
 void subcc1101_killonlowrssi() {
     /// need to inspect the CS bit
 }
@@ -1041,26 +1388,23 @@ void subcc1101_reset_autocal() {
 }
 
 
-ot_bool subcc1101_chan_scan( ) {
-    vlFILE* fp;
+ot_bool subcc1101_chan_scan(ot_bool use_cca) {
     ot_int  i;
     
     //radio.flags &= ~RADIO_FLAG_CCAFAIL;	//this flag presently unused
 
-    fp = ISF_open_su( ISF_ID(channel_configuration) );
-    ///@todo assert fp
-
     /// Go through the list of tx channels
     /// - Make sure the channel ID is valid
     /// - Make sure the transmission can fit within the contention period.
     /// - Scan it, to make sure it can be used
     for (i=0; i<dll.comm.tx_channels; i++) {
-        if (subcc1101_channel_lookup(dll.comm.tx_chanlist[i], fp) != False) {
-            break;
+        if (subcc1101_channel_lookup(dll.comm.tx_chanlist[i]) != False) {
+            if ((use_cca == False) || subcc1101_cca_scan()) {
+                break;
+            }
         }
     }
 
-    vl_close(fp);
     return (ot_bool)(i < dll.comm.tx_channels);
 }
 
@@ -1075,6 +1419,7 @@ ot_bool subcc1101_cca_scan() {
 /// safe amount of time for the RSSI to stabilize after starting RX.
     ot_bool check_cca;
     ot_u16	wait_period;
+    ot_int  rssi;
 
     cc1101_int_turnoff(RFI_SOURCE0 | RFI_SOURCE2);
     //radio_idle();  //should be in idle already
@@ -1085,9 +1430,16 @@ ot_bool subcc1101_cca_scan() {
 
     // Wait for RSSI, check it against threshold, go back to idle, stop autocal
     platform_swdelay_us(wait_period);
-    check_cca = radio_check_cca();
+    rssi        = radio_rssi();
+    check_cca   = (ot_bool)(rssi < ((ot_int)phymac[0].cca_thr - 140));
     radio_idle();
     subcc1101_reset_autocal();
+
+#   if (RF_FEATURE(SCANSORT) == ENABLED)
+    {   ot_int* avg = &scan_ewma[subcc1101_chan_fc(phymac[0].channel)];
+        *avg       += ((rssi << 4) - *avg) >> SCAN_EWMA_SHIFT;
+    }
+#   endif
     
     return check_cca;
 }
@@ -1095,15 +1447,88 @@ ot_bool subcc1101_cca_scan() {
 
 
 
-ot_bool subcc1101_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
+ot_u8 subcc1101_chan_fc(ot_u8 chan_id) {
+/// Returns the center frequency index that subcc1101_chan_config() uses.
+    return (chan_id & 0x0F);
+}
+
+
+
+
+void subcc1101_chan_sort() {
+/// Called by rm2_txcsma() before the first CCA
+/// Duty: Stable insertion sort of dll.comm.tx_chanlist by the occupancy of
+///       each channel, least occupied first.  The list is short (usually one
+///       to four channels), and already-ordered lists take one pass.
+#if (RF_FEATURE(SCANSORT) == ENABLED)
+    ot_int i, j;
+
+    for (i=1; i<dll.comm.tx_channels; i++) {
+        ot_u8   chan_id = dll.comm.tx_chanlist[i];
+        ot_int  key     = scan_ewma[subcc1101_chan_fc(chan_id)] >> SCAN_KEY_SHIFT;
+
+        for (j=i; j>0; j--) {
+            ot_u8 prev_id = dll.comm.tx_chanlist[j-1];
+            if ((scan_ewma[subcc1101_chan_fc(prev_id)] >> SCAN_KEY_SHIFT) <= key) {
+                break;
+            }
+            dll.comm.tx_chanlist[j] = prev_id;
+        }
+        dll.comm.tx_chanlist[j] = chan_id;
+    }
+#endif
+}
+
+
+
+
+void subcc1101_chantable_refresh() {
+/// Called by subcc1101_channel_lookup()
+/// Duty: Reload the channel table from the channel configuration ISF if it has
+///       not been loaded yet, or if any file has been changed since.
+    ot_u16 stamp = (ot_u16)(vl_writestamp + vl_mapstamp);
+
+    if ((chantable.valid == False) || (chantable.stamp != stamp)) {
+        vlFILE*     fp;
+        ot_int      i;
+        ot_u8       j = 0;
+        Twobytes    scratch;
+
+        fp = ISF_open_su( ISF_ID(channel_configuration) );
+        if (fp != NULL) {
+            for (i=0; (i < fp->length) && (j < RF_PARAM_CHANNELS); i+=8, j++) {
+                scratch.ushort                  = vl_read(fp, i);
+                chantable.entry[j].spectrum_id  = scratch.ubyte[0];
+                chantable.entry[j].autoscale    = scratch.ubyte[1];
+                scratch.ushort                  = vl_read(fp, i+2);
+                chantable.entry[j].tx_eirp      = scratch.ubyte[0];
+                chantable.entry[j].link_qual    = scratch.ubyte[1];
+                scratch.ushort                  = vl_read(fp, i+4);
+                chantable.entry[j].cs_thr       = scratch.ubyte[0];
+                chantable.entry[j].cca_thr      = scratch.ubyte[1];
+            }
+            vl_close(fp);
+        }
+
+        chantable.count = j;
+        chantable.stamp = stamp;
+        chantable.valid = True;
+    }
+}
+
+
+
+
+ot_bool subcc1101_channel_lookup(ot_u8 chan_id) {
 /// Called during channel scans.
 /// Duty: (a) See if the supplied channel is supported on this device & config.
 ///       If yes, return true.  (b) Determine if recalibration is required
 ///       before changing to the new channel, and recalibrate if so.
-    ot_u8       fec_id;
-    ot_u8       spectrum_id;
-    ot_int      i;
-    Twobytes    scratch;
+    ot_u8               fec_id;
+    ot_u8               spectrum_id;
+    ot_int              i;
+    ot_u8               thr_offset;
+    chanentry_struct*   entry;
 
     /// Only do the channel lookup if the new channel is different than before
     if (chan_id == phymac[0].channel) {
@@ -1175,29 +1600,30 @@ ot_bool subcc1101_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
 #       define AUTOSCALE_MASK(VAL)      (VAL)
 #   endif
 
-    for (i=0; i<fp->length; i+=8) {
-        scratch.ushort = vl_read(fp, i);
+    subcc1101_chantable_refresh();
+    entry = &chantable.entry[0];
 
-        if (spectrum_id == scratch.ubyte[0]) {
+    for (i=0; i<chantable.count; i++, entry++) {
+        if (spectrum_id == entry->spectrum_id) {
             ot_u8 old_chan_id   = phymac[0].channel;
             ot_u8 old_tx_eirp   = phymac[0].tx_eirp;
 
             phymac[0].tg        = rm2_default_tgd(chan_id);
+            subcc1101_phy_timing(chan_id);
             phymac[0].channel   = chan_id;
-            phymac[0].autoscale = scratch.ubyte[1];
-
-            scratch.ushort      = vl_read(fp, i+2);
-            phymac[0].tx_eirp   = AUTOSCALE_MASK(scratch.ubyte[0]);
-            phymac[0].link_qual = AUTOSCALE_MASK(scratch.ubyte[1]);
-
-            scratch.ushort      = vl_read(fp, i+4);
-            phymac[0].cs_thr    = AUTOSCALE_MASK(scratch.ubyte[0]);
-            phymac[0].cca_thr   = AUTOSCALE_MASK(scratch.ubyte[1]);
+            phymac[0].autoscale = entry->autoscale;
+#           if (M2_FEATURE(AUTOSCALE) == ENABLED)
+            phymac[0].max_eirp  = entry->tx_eirp;
+#           endif
+            phymac[0].tx_eirp   = RM2_EIRP_AUTOSCALE(entry->tx_eirp);
+            phymac[0].link_qual = AUTOSCALE_MASK(entry->link_qual);
+            phymac[0].cs_thr    = AUTOSCALE_MASK(entry->cs_thr);
+            phymac[0].cca_thr   = AUTOSCALE_MASK(entry->cca_thr);
 
             /// @note This is experimental
-            scratch.ubyte[0]    = (phymac[0].channel >> 4) & 2;
-            phymac[0].cs_thr    = cc1101_calc_rssithr(phymac[0].cs_thr, scratch.ubyte[0]);
-            phymac[0].cca_thr   = cc1101_calc_rssithr(phymac[0].cca_thr, scratch.ubyte[0]);
+            thr_offset          = (phymac[0].channel >> 4) & 2;
+            phymac[0].cs_thr    = cc1101_calc_rssithr(phymac[0].cs_thr, thr_offset);
+            phymac[0].cca_thr   = cc1101_calc_rssithr(phymac[0].cca_thr, thr_offset);
 
             subcc1101_chan_config(old_chan_id, old_tx_eirp);
             return True;
@@ -1210,12 +1636,21 @@ ot_bool subcc1101_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
 
 
 
+/// SPI bursts for MDMCFG4 to MDMCFG1, indexed by channel class: b0 = 200 kS/s,
+/// b1 = FEC.  They are built at compile time from CC1101_defaults.h.
+static const ot_u8 phy_block[][5] = {
+    { 0x40|RFREG(MDMCFG4), DRF_MDMCFG4,    DRF_MDMCFG3,    DRF_MDMCFG2, DRF_MDMCFG1 },
+    { 0x40|RFREG(MDMCFG4), DRF_MDMCFG4_HI, DRF_MDMCFG3_HI, DRF_MDMCFG2, DRF_MDMCFG1_HI },
+    { 0x40|RFREG(MDMCFG4), DRF_MDMCFG4,    DRF_MDMCFG3,    DRF_MDMCFG2, DRF_MDMCFG1|_FEC_EN },
+    { 0x40|RFREG(MDMCFG4), DRF_MDMCFG4_HI, DRF_MDMCFG3_HI, DRF_MDMCFG2, DRF_MDMCFG1_HI|_FEC_EN }
+};
+
+
 void subcc1101_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
 /// Called by subcc1101_channel_lookup()
 /// Duty: perform channel setup and recalibration when moving from one channel
 /// to another.
     ot_u8 fc_i;
-    ot_u8 mdmcfg[5] = {0x40|RFREG(MDMCFG4) , DRF_MDMCFG4, DRF_MDMCFG3, DRF_MDMCFG2, DRF_MDMCFG1};
 
     /// CC1101 power table is lost during sleep, so it is programmed always
     /// when going into TX after sleeping or whenever a new power is selected
@@ -1230,13 +1665,10 @@ void subcc1101_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
     /// Reprogram data rate, packet method, and modulation per upper nibble
     /// (Don't reprogram if radio is using the same channel class already)
     if ( (old_chan ^ phymac[0].channel) & 0xF0 ) {
-        mdmcfg[4] |= phymac[0].channel & 0x80; //FEC enable (or not)
-        if (phymac[0].channel & 0x20) {
-        	mdmcfg[1]   = DRF_MDMCFG4_HI;
-            mdmcfg[2]   = DRF_MDMCFG3_HI;
-            mdmcfg[4]  |= _NUM_PREAMBLE_6B;	//6B preamble on Hi-speed
-        }
-        cc1101_spibus_io(5, 0, mdmcfg, NULL);
+        ot_u8 phy_i;
+        phy_i   = ((phymac[0].channel & 0x20) != 0);
+        phy_i  |= (phymac[0].channel >> 6) & 2;
+        cc1101_spibus_io(5, 0, (ot_u8*)phy_block[phy_i], NULL);
     }
 
     /// If channel frequency is different than before, move to the new channel,
@@ -1244,13 +1676,62 @@ void subcc1101_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
     /// @note: CC1101 contains a channel-offset built-in mechanism. 
     if ( fc_i != (old_chan & 0x0F) ) {
         cc1101_write(RFREG(CHANNR), (ot_u8)fc_i);
-        radio.flags |= RADIO_FLAG_AUTOCAL;
+        subcc1101_calibrate(fc_i);
     }
 }
 
 
 
 
+void subcc1101_phy_timing(ot_u8 chan_id) {
+/// Called when the channel is set: precomputes the PHY timing constants for
+/// rm2_scale_codec() and rm2_pkt_duration(), so those need no channel tests.
+    ot_u8 turbo         = ((chan_id & 0x20) != 0);
+    phymac[0].tscale    = turbo ? RM2_TSCALE_200 : RM2_TSCALE_55;
+    phymac[0].tpad      = RF_PARAM_PKT_OVERHEAD + (turbo << 1);
+#   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) == ENABLED))
+    phymac[0].tscale  <<= ((chan_id & 0x80) != 0);
+#   endif
+}
+
+
+
+
+void subcc1101_calibrate(ot_u8 fc_i) {
+/// Called by subcc1101_chan_config() after CHANNR is changed.
+/// Duty: Save the FSCAL results of the center frequency being left, then load
+///       the saved results for the new one, or stage calibration if there are
+///       none.  The FSCAL registers only hold results for calnow once the
+///       staged calibration has run (RADIO_FLAG_AUTOCAL is cleared).
+#if (RF_FEATURE(CALCACHE) == ENABLED)
+    ot_u16 fc_bit;
+
+    if ((chantable.calnow < 16) && ((radio.flags & RADIO_FLAG_AUTOCAL) == 0)) {
+        cc1101_burstread(RFREG(FSCAL3), 3, &chantable.fscal[chantable.calnow][0]);
+        chantable.calmask |= (1 << chantable.calnow);
+    }
+
+    chantable.calnow    = fc_i;
+    fc_bit              = (1 << fc_i);
+
+    if (chantable.calmask & fc_bit) {
+        ot_u8 cmd[4];
+        cmd[0]  = RFREG(FSCAL3);
+        cmd[1]  = chantable.fscal[fc_i][0];
+        cmd[2]  = chantable.fscal[fc_i][1];
+        cmd[3]  = chantable.fscal[fc_i][2];
+        cc1101_burstwrite(4, cmd);
+        subcc1101_reset_autocal();
+        return;
+    }
+#endif
+
+    radio.flags |= RADIO_FLAG_AUTOCAL;
+}
+
+
+
+
 void subcc1101_syncword_config(sync_enum sync_class) {
 #   if (M2_FEATURE(FEC) != ENABLED)
     static const ot_u8 sync_matrix[] = { RFREG(SYNC1)|0x40, 0xE6, 0xD0, 
@@ -1265,8 +1746,13 @@ void subcc1101_syncword_config(sync_enum sync_class) {
         (ot_u8)sync_class += 6;
     }
 #   endif
-    
-    cc1101_spibus_io(3, 0, (ot_u8*)(sync_matrix+sync_class), NULL);
+
+    /// SYNC1/SYNC0 are retained in SLEEP, so they are only written when the 
+    /// sync word changes (usually never between two foreground frames)
+    if (radio.sync != (ot_u8)sync_class) {
+        radio.sync = (ot_u8)sync_class;
+        cc1101_spibus_io(3, 0, (ot_u8*)(sync_matrix+sync_class), NULL);
+    }
 }
 
 
@@ -1276,8 +1762,14 @@ void subcc1101_buffer_config(ot_u8 mode, ot_u8 param) {
 /// CC430 specific implementation.  This function selects between three
 /// buffering modes: FIFO buffering (2), automatic packet handling (1), or
 /// fixed-length packet (0).  The "param" argument is a chip-specific option.
-    cc1101_write( RFREG(PKTLEN), param );
-    cc1101_write( RFREG(PKTCTRL0), DRF_PKTCTRL0 | mode);
+/// PKTLEN, PKTCTRL1, PKTCTRL0 are contiguous, so they go in one burst, with
+/// PKTCTRL1 from its default (address check off, see subcc1101_launch_rx).
+    ot_u8 pkt_block[4];
+    pkt_block[0]    = RFREG(PKTLEN);
+    pkt_block[1]    = param;
+    pkt_block[2]    = DRF_PKTCTRL1;
+    pkt_block[3]    = DRF_PKTCTRL0 | mode;
+    cc1101_burstwrite(4, pkt_block);
 }
 
 
@@ -1312,6 +1804,27 @@ ot_int subcc1101_eta_txi() {
 
 
 
+ot_int subcc1101_fifo_margin() {
+/// Bytes that go through the FIFO during the ISR latency budget (at least 1).
+/// A full FIFO takes rm2_scale_codec(FIFO) ti, rounded up.
+    ot_int fifo_ti;
+    fifo_ti = rm2_scale_codec(RF_FEATURE(RXFIFO_BYTES)) + 1;
+    return (RF_FEATURE(RXFIFO_BYTES) / (fifo_ti << RF_PARAM_ISRLATENCY)) + 1;
+}
+
+ot_int subcc1101_rxlimit() {
+/// RX threshold is the FIFO minus the margin, rounded down to FIFOTHR steps (4)
+    return (RF_FEATURE(RXFIFO_BYTES) - subcc1101_fifo_margin()) & ~3;
+}
+
+ot_u8 subcc1101_txthr() {
+/// FIFO_THR field for a TX threshold of at least the margin (4n+1 bytes)
+    return (ot_u8)(15 - ((subcc1101_fifo_margin() + 3) >> 2));
+}
+
+
+
+
 
 void subcc1101_offset_rxtimeout() {
 /// If the rx timeout is 0, set it to a minimally small amount, which relates to
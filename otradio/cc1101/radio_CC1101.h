@@ -64,17 +64,19 @@
 #define RF_FEATURE_CSMA                  DISABLED                // CSMA                     Low
 #define RF_FEATURE_RXTIMER               DISABLED                // RX Timeout capability    Low
 #define RF_FEATURE_TXTIMER               DISABLED                // TX MAC capability        DASH7-specific
-#define RF_FEATURE_SCANCYCLE             DISABLED                // Wake-on scan cycle       DASH7-specific
+#define RF_FEATURE_SCANCYCLE             ENABLED                 // Wake-on scan cycle       DASH7-specific
 #define RF_FEATURE_MIRROR                DISABLED                // UDB Register Mirroring   DASH7-specific
 #define RF_FEATURE_SYNCFILTER            DISABLED                // Synchronizer Filtering   DASH7-specific
 #define RF_FEATURE_LBFILTER              DISABLED                // Link Budget Filtering    DASH7-specific
 #define RF_FEATURE_SIDFILTER             DISABLED                // Session ID Filtering     DASH7-specific
 #define RF_FEATURE_ADDRFILTER            DISABLED                // Address Filtering        DASH7-specific
+#define RF_FEATURE_SUBNETFILTER          ENABLED                 // Subnet HW Filtering      Moderate (BG frames)
 #define RF_FEATURE_PARSEFILTER           DISABLED                // Full Parse Filtering     DASH7-specific
 #define RF_FEATURE_MAC                   DISABLED                // Full Integrated MAC      DASH7-specific
 #define RF_FEATURE_AES128                DISABLED                // AES128 engine            Rare/None yet
 #define RF_FEATURE_ECC                   DISABLED                // ECC engine               Rare/None yet
 #define RF_FEATURE_ALGE                  DISABLED                // Algebraic Eraser engine  Rare/None yet
+#define RF_FEATURE_AUXRX                 DISABLED                // Auxiliary RX radio       Rare (2nd transceiver)
 
 #define RF_PARAM_PKT_OVERHEAD           (2+4+2)
 
@@ -130,7 +132,7 @@
 #define RADIO_FLAG_RESIZE       (1 << 3)
 #define RADIO_FLAG_AUTOCAL		(1 << 4)
 #define RADIO_FLAG_SETPWR		(1 << 5)
-//#define RADIO_FLAG_CCAFAIL      (1 << 6)  //this flag presently unused
+#define RADIO_FLAG_SNIFF        (1 << 6)
 #define RADIO_FLAG_ASLEEP		(1 << 7)
 
 
@@ -173,6 +175,9 @@
   * rxcursor    holds some data about rx buffer position (MCU-based buffer only)
   * buffer[]    buffer data.  (MCU-based buffer only)
   * last_rssi   The most recent value of the rss (not always needed)
+  * sniff_evt0  WOR EVENT0 for the next RX launch, 0 for normal RX (RF_FEATURE(SCANCYCLE))
+  * sniff_rxtime MCSM2.RX_TIME duty cycle code for the next sniff RX
+  * sync        offset of the sync word in the SYNC1/SYNC0 registers (0xFF = unknown)
   */
 typedef struct {
     ot_u8   state;
@@ -181,6 +186,11 @@ typedef struct {
     ot_int  rxlimit;
 //  ot_int  last_rssi;
     ot_sig2 evtdone;
+    ot_u8   sync;
+#   if (RF_FEATURE(SCANCYCLE) == ENABLED)
+        ot_u16  sniff_evt0;
+        ot_u8   sniff_rxtime;
+#   endif
 #   if (BUFFER_ALLOC > 0)
         ot_int  txcursor;
         ot_int  rxcursor;
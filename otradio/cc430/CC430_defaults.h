@@ -113,6 +113,20 @@
 
 #define RADIO_CHANNEL_SPC_M     (16)        // MDMCFG0.CHANSPC_M (107.94 kHz)
 
+/// PHY register blocks: MDMCFG4, MDMCFG3, MDMCFG2, MDMCFG1.  These registers
+/// are consecutive, so a channel class change is one burst write of a block.
+/// MDMCFG2 holds the sync qualifier, which depends on the encoding.
+#define RADIO_MDMCFG2_PN9       b10010010   // MDMCFG2 for PN9 channels (16/16 sync)
+#define RADIO_MDMCFG2_FEC       b10010101   // MDMCFG2 for FEC channels (15/16 sync)
+
+#define RADIO_PHYBLOCK_NORMAL(MDMCFG2)  \
+    { (RADIO_FILTER_NORMAL | RADIO_DRATE_NORMAL_E), RADIO_DRATE_NORMAL_M, \
+      (MDMCFG2), (RADIO_PREAMBLE_NORMAL | RADIO_CHANNEL_SPC_E) }
+
+#define RADIO_PHYBLOCK_TURBO(MDMCFG2)   \
+    { (RADIO_FILTER_TURBO | RADIO_DRATE_TURBO_E), RADIO_DRATE_TURBO_M, \
+      (MDMCFG2), (RADIO_PREAMBLE_TURBO | RADIO_CHANNEL_SPC_E) }
+
 #define RADIO_DEV               ((5<<4)|0)  // DEVIATN (default, FSK 50 kHz)
 
 #define RADIO_RXCS_ENABLE       (1 << 4)    // MCSM2.RX_TIME_RSSI (sed for bf)
@@ -212,7 +226,11 @@
 #define RFREG_DEVIATN      RADIO_DEV    
 #define RFREG_MCSM2        (RADIO_RXCS_DISABLE | RADIO_RXTO_ENABLE)    
 #define RFREG_MCSM1        (RADIO_CCA_GUARDED | RADIO_RXOFF_IDLE | RADIO_TXOFF_IDLE)   
-#define RFREG_MCSM0        (RADIO_AUTOCAL_SHUTDOWN4)        
+#if (OT_FEATURE(RFCAL) == ENABLED)
+#   define RFREG_MCSM0     (RADIO_AUTOCAL_OFF)              // calibrated by the kernel
+#else
+#   define RFREG_MCSM0     (RADIO_AUTOCAL_SHUTDOWN4)
+#endif
 #define RFREG_FOCCFG       RADIO_FOCCFG        
 #define RFREG_BSCFG        RADIO_BSCFG        
 #define RFREG_AGCCTRL2     (RADIO_DVGA_GAIN | RADIO_LNA_GAIN | RADIO_MAGN_TARGET)
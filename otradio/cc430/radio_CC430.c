@@ -53,6 +53,7 @@
 #include "veelite.h"
 #include "session.h"
 #include "system.h"
+#include "m2_network.h"     // M2AdvP flood frames
 
 #include "CC430_defaults.h"      // register definitions file
 
@@ -100,6 +101,7 @@
 #define RADIO_FLAG_FLOOD        (1 << 1)
 #define RADIO_FLAG_AUTO         (1 << 2)
 #define RADIO_FLAG_RESIZE       (1 << 3)
+#define RADIO_FLAG_SNIFF        (1 << 4)
 
 
 /** Internal Radio Interrupt Flags
@@ -130,11 +132,31 @@
 
 
 
+/** Chained FIFO Interrupts
+  * When RX or TX enters its data state, the EndState handler for that state
+  * is put into radio.isr_end, so radio_isr() does not test the radio state.
+  * The FIFO thresholds are also sized from the data rate: each interrupt
+  * moves as many bytes as it can, and the FIFO keeps enough room (TX: data)
+  * to cover an ISR latency of 1/2^RF_PARAM_ISRLATENCY ti.  The FIFO time
+  * comes from rm2_scale_codec().  When DISABLED, the thresholds are fixed at
+  * 48 for RX and 5 for TX.
+  */
+#ifndef RF_FEATURE_CHAINEDISR
+#   define RF_FEATURE_CHAINEDISR    ENABLED
+#endif
+#ifndef RF_PARAM_ISRLATENCY
+#   define RF_PARAM_ISRLATENCY      2           // 1/4 ti = ~244us
+#endif
+
+
+
+
 /** PHY-MAC Array declaration
   * Described in radio.h of the OTlib.
   * This driver only supports M2_PARAM_MI_CHANNELS = 1.
   */
 phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
+rm2_stamp_struct rm2_stamp;
 
 
 
@@ -154,6 +176,13 @@ phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
   * rxcursor    holds some data about rx buffer position (MCU-based buffer only)
   * buffer[]    buffer data.  (MCU-based buffer only)
   * last_rssi   The most recent value of the rss (not always needed)
+  * isr_end     EndState handler of the current state (RF_FEATURE(CHAINEDISR))
+  * sniff_evt0  WOR EVENT0 for the next RX launch, 0 for normal RX (RF_FEATURE(SCANCYCLE))
+  * sniff_rxtime MCSM2.RX_TIME duty cycle code for the next sniff RX
+  * asleep      True after radio_sleep(), until radio_idle() restores the core
+  * sync        sync class in the SYNC1/SYNC0 registers (0xFF = unknown)
+  * pa_start    first used entry of pa_table[] (8 = none yet)
+  * pa_table[]  PATABLE image from sub_set_txpower(), for restoring after SLEEP
   */
 typedef struct {
     ot_u8   state;
@@ -162,6 +191,17 @@ typedef struct {
     ot_int  rxlimit;
 //  ot_int  last_rssi;
     ot_sig2 evtdone;
+    ot_bool asleep;
+    ot_u8   sync;
+    ot_u8   pa_start;
+    ot_u8   pa_table[8];
+#   if (RF_FEATURE(CHAINEDISR) == ENABLED)
+        ot_sub  isr_end;
+#   endif
+#   if (RF_FEATURE(SCANCYCLE) == ENABLED)
+        ot_u16  sniff_evt0;
+        ot_u8   sniff_rxtime;
+#   endif
 #   if (BUFFER_ALLOC > 0)
         ot_int  txcursor;
         ot_int  rxcursor;
@@ -174,11 +214,88 @@ radio_struct radio;
 
 
 
+/** Channel Table & Calibration Cache
+  * The channel configuration ISF is copied into RAM when it is first needed,
+  * and it is copied again only after veelite reports that a file has changed
+  * (vl_writestamp, vl_mapstamp).  sub_channel_lookup() reads from the table,
+  * so a channel scan does not need to open the ISF or thread a vlFILE*.
+  *
+  * The FSCAL3-1 results from calibration are saved for each of the 16 center
+  * frequencies when the radio leaves it.  Returning to that center frequency
+  * writes the saved results instead of recalibrating (RADIO_FASTHOP_STI vs.
+  * RADIO_CALIBRATE_STI).  The cache is cleared in radio_init().  Autocal
+  * (MCSM0) still runs normally, and its results replace the saved ones on the
+  * next hop.
+  *
+  * stamp       value of vl_writestamp + vl_mapstamp when table was loaded
+  * valid       False forces the table to be reloaded
+  * count       number of channels in the table
+  * entry[]     channel data bytes 0-5 of each 8 byte ISF record
+  * calnow      center freq the FSCAL registers are calibrated for (0xFF = none)
+  * calmask     bit N is set when fscal[N] holds saved results
+  * fscal[][]   saved FSCAL3, FSCAL2, FSCAL1 of each center frequency
+  */
+#ifndef RF_PARAM_CHANNELS
+#   define RF_PARAM_CHANNELS    (ISF_MAX(channel_configuration) / 8)
+#endif
+#ifndef RF_FEATURE_CALCACHE
+#   define RF_FEATURE_CALCACHE  ENABLED
+#endif
+
+typedef struct {
+    ot_u8   spectrum_id;
+    ot_u8   autoscale;
+    ot_u8   tx_eirp;
+    ot_u8   link_qual;
+    ot_u8   cs_thr;
+    ot_u8   cca_thr;
+} chanentry_struct;
+
+typedef struct {
+    ot_u16  stamp;
+    ot_bool valid;
+    ot_u8   count;
+    chanentry_struct entry[RF_PARAM_CHANNELS];
+#   if (RF_FEATURE(CALCACHE) == ENABLED)
+        ot_u8   calnow;
+        ot_u16  calmask;
+        ot_u8   fscal[16][3];
+#   endif
+} chantable_struct;
+
+chantable_struct chantable;
+
+
+
+
+/** Channel Scan Occupancy
+  * A moving average (EWMA) of the RSSI measured on each of the 16 center
+  * frequencies, updated by every CCA scan.  sub_csma_init() orders the TX
+  * channel list by it before the first CCA, so the channel most likely to be
+  * clear is scanned first, and the scan stops at the first clear channel.
+  * Averages are stored in 1/16 dBm.  Channels whose averages are in the same
+  * 4 dB bucket keep the order they had (e.g. from sub_csma_scramble()).
+  */
+#ifndef RF_FEATURE_SCANSORT
+#   define RF_FEATURE_SCANSORT  ENABLED
+#endif
+
+#define SCAN_EWMA_SHIFT     2               // each scan moves the average 1/4
+#define SCAN_KEY_SHIFT      (4+2)           // ordering buckets of 4 dB
+
+#if (RF_FEATURE(SCANSORT) == ENABLED)
+ot_int scan_ewma[16];
+#endif
+
+
+
+
 /** Local Subroutine Prototypes  <BR>
   * ========================================================================<BR>
   */
 void    sub_kill(ot_int main_err, ot_int frame_err);
 void    sub_killonlowrssi();
+void    sub_endsniff();
 
 ot_u8   sub_rssithr_calc(ot_u8 input, ot_u8 offset); // Fiddling necessary
 ot_bool sub_cca_init();
@@ -189,10 +306,16 @@ ot_bool sub_cca_scan();
 ot_bool sub_csma_init();
 ot_bool sub_nocsma_init();
 
-ot_bool sub_channel_lookup(ot_u8 chan_id, vlFILE* fp);
+void    sub_chantable_refresh();
+ot_u8   sub_chan_fc(ot_u8 chan_id);
+void    sub_chan_sort();
+ot_bool sub_channel_lookup(ot_u8 chan_id);
+void    sub_calibrate(ot_u8 fc_i);
 void    sub_syncword_config(ot_u8 sync_class);
 void    sub_buffer_config(ot_u8 mode, ot_u8 param);
+void    sub_hwfilter(ot_bool bgframe);
 void    sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp);
+void    sub_phy_timing(ot_u8 chan_id);
 
 void    sub_set_txpower(ot_u8 eirp_code);
 void    sub_prep_q(Queue* q);
@@ -200,6 +323,9 @@ ot_int  sub_eta(ot_int next_int);
 ot_int  sub_eta_rxi();
 ot_int  sub_eta_txi();
 void    sub_offset_rxtimeout();
+ot_int  sub_fifo_margin();
+ot_int  sub_rxlimit();
+ot_int  sub_txlimit();
 
 
 
@@ -217,6 +343,7 @@ void    sub_offset_rxtimeout();
 #elif (CC_SUPPORT == GCC)
     OT_IRQPRAGMA(CC1101_VECTOR)
 #	endif
+OT_RAMCODE(radio_isr)
 OT_INTERRUPT void radio_isr(void) {
     u16 core_edge;
     u16 core_vector;
@@ -316,8 +443,12 @@ OT_INTERRUPT void radio_isr(void) {
         //case 0x32:  __no_operation();       break;  //RXFlushed_ISR();
         //case 0x34:  __no_operation();       break;  //TXFlushed_ISR();
         case 0x36:
+#       if (RF_FEATURE(CHAINEDISR) == ENABLED)
+            radio.isr_end();
+#       else
         	if (radio.state & RADIO_STATE_TXMASK)	rm2_txdata_isr();
         	else 									rm2_rxend_isr();
+#       endif
         	break;  //EndState_ISR();
 
         //case 0x38:  __no_operation();       break;  //RXFirstByte_ISR();
@@ -363,13 +494,26 @@ void radio_gag() {
 
 
 void radio_sleep() {
+    radio.asleep = True;
     RF_CmdStrobe(RF_CoreStrobe_IDLE);
     RF_CmdStrobe(RF_CoreStrobe_PWD);
 }
 
 
 void radio_idle() {
+/// The RF core keeps its configuration registers in SLEEP, but TEST0 and the
+/// PATABLE are lost.  Coming out of SLEEP, they are written back from the
+/// defaults and the image of the last sub_set_txpower(), one burst each, so
+/// nothing else needs to be reloaded.
     RF_CmdStrobe(RF_CoreStrobe_IDLE);
+
+    if (radio.asleep) {
+        radio.asleep = False;
+        RF_WriteSingleReg(RF_CoreReg_TEST0, RFREG_TEST0);
+        if (radio.pa_start < 8) {
+            RF_WriteBurstPATable(&radio.pa_table[radio.pa_start], (ot_u8)(8-radio.pa_start));
+        }
+    }
 }
 
 
@@ -378,6 +522,48 @@ void radio_calibrate() {
 }
 
 
+#if (OT_FEATURE(RFCAL) == ENABLED)
+void radio_recalibrate() {
+/// The core is woken to IDLE, and each center frequency is calibrated in
+/// turn: CAL starts from IDLE and ends in IDLE.  The FSCAL registers are left
+/// with the results of calnow, as they were before.
+#if (RF_FEATURE(CALCACHE) == ENABLED)
+    ot_u16  calmask;
+    ot_u8   fc_i;
+
+    calmask = chantable.calmask;
+    if (chantable.calnow < 16) {
+        calmask |= (1 << chantable.calnow);
+    }
+    if (calmask == 0) {
+        return;
+    }
+
+    radio_idle();
+    for (fc_i=0; fc_i<16; fc_i++) {
+        if (calmask & (1 << fc_i)) {
+            RF_WriteSingleReg(RF_CoreReg_CHANNR, fc_i);
+            radio_calibrate();
+            while ((RF_ReadSingleReg(RF_CoreReg_MARCSTATE) & 0x1F) != RF_MARCState_IDLE);
+            RF_ReadBurstReg(RF_CoreReg_FSCAL3, &chantable.fscal[fc_i][0], 3);
+        }
+    }
+    chantable.calmask = calmask;
+
+    if (chantable.calnow < 16) {
+        RF_WriteSingleReg(RF_CoreReg_CHANNR, chantable.calnow);
+        RF_WriteBurstReg(RF_CoreReg_FSCAL3, &chantable.fscal[chantable.calnow][0], 3);
+    }
+#else
+    radio_idle();
+    radio_calibrate();
+    while ((RF_ReadSingleReg(RF_CoreReg_MARCSTATE) & 0x1F) != RF_MARCState_IDLE);
+#endif
+    radio_sleep();
+}
+#endif
+
+
 
 
 
@@ -442,16 +628,31 @@ void radio_init( ) {
 
     /// Set incumbent channel to a completely invalid channel ID and run lookup
     /// on the default channel (0x00) to kick things off.
-    {
-        vlFILE* fp          = ISF_open_su( ISF_ID(channel_configuration) );
-        phymac[0].channel   = 0x55;         // 55=invalid, forces calibration.
-        phymac[0].tx_eirp   = 0x00;         // initialized to zero
-        radio.state         = 0;            // (idle)
-        radio.evtdone       = &otutils_sig2_null;
-
-        sub_channel_lookup(0x00, fp);
-        vl_close(fp);
+    phymac[0].channel   = 0x55;         // 55=invalid, forces calibration.
+    phymac[0].tx_eirp   = 0x00;         // initialized to zero
+    sub_phy_timing(0x55);
+    radio.state         = 0;            // (idle)
+    radio.evtdone       = &otutils_sig2_null;
+    radio.asleep        = False;
+    radio.sync          = 0xFF;         // 0xFF=unknown, forces a write
+    radio.pa_start      = 8;            // 8=no table yet
+#   if (RF_FEATURE(CHAINEDISR) == ENABLED)
+    radio.isr_end       = &rm2_rxend_isr;
+#   endif
+    chantable.valid     = False;
+#   if (RF_FEATURE(CALCACHE) == ENABLED)
+    chantable.calnow    = 0xFF;
+    chantable.calmask   = 0;
+#   endif
+#   if (RF_FEATURE(SCANSORT) == ENABLED)
+    {   ot_int i;
+        for (i=0; i<16; i++) {
+            scan_ewma[i] = (-140 << 4);     // unknown channels sort first
+        }
     }
+#   endif
+
+    sub_channel_lookup(0x00);
 }
 
 
@@ -519,24 +720,32 @@ void radio_putbyte(ot_u8 databyte) {
 
 
 void radio_putfourbytes(ot_u8* data) {
-/// @note Eventually I would like to use an endian-independent implementation,
-/// (basically, this is the big endian version) but now is not the time. Doing
-/// so will involve revising the FEC encoder in the Encode Module.
+/// The FEC interleaver output is a byte array already in over-the-air order
 #if (M2_FEATURE(FEC) == ENABLED)
-#   ifdef __BIG_ENDIAN__
-        RF_WriteBurstReg(RF_TXFIFOWR, data, 4);
-#   else
-        RF_WriteSingleReg(RF_TXFIFOWR, data[3]);
-        RF_WriteSingleReg(RF_TXFIFOWR, data[2]);
-        RF_WriteSingleReg(RF_TXFIFOWR, data[1]);
-        RF_WriteSingleReg(RF_TXFIFOWR, data[0]);
-#   endif
+    RF_WriteBurstReg(RF_TXFIFOWR, data, 4);
 #endif
 }
 
 
 
 
+ot_int radio_putbytes(ot_u8* data, ot_int limit) {
+/// Transceiver implementation dependent
+    ot_int room;
+    room = RADIO_BUFFER_TXMAX - (ot_int)RF_GetTXBYTES();
+    if (room > limit) {
+        room = limit;
+    }
+    if (room > 0) {
+        RF_WriteBurstReg(RF_TXFIFOWR, data, (ot_u8)room);
+        return room;
+    }
+    return 0;
+}
+
+
+
+
 ot_u8 radio_getbyte() {
 /// Transceiver implementation dependent
     return RF_ReadSingleReg(RF_RXFIFORD);
@@ -554,6 +763,25 @@ void radio_getfourbytes(ot_u8* data) {
 
 
 
+ot_int radio_getbytes(ot_u8* data, ot_int limit) {
+/// Transceiver implementation dependent
+/// @note Same FIFO erratum as radio_rxopen(): leave the bottom byte in the
+///       FIFO until the packet is complete.
+    ot_int ready;
+    ready = (ot_int)RF_GetRXBYTES() - (radio.state != RADIO_STATE_RXDONE);
+    if (ready > limit) {
+        ready = limit;
+    }
+    if (ready > 0) {
+        RF_ReadBurstReg(RF_RXFIFORD, data, (ot_u8)ready);
+        return ready;
+    }
+    return 0;
+}
+
+
+
+
 void radio_flush_rx() {
 /// Transceiver implementation dependent
     RF_CmdStrobe( RF_CoreStrobe_FRX );
@@ -626,15 +854,8 @@ ot_bool sub_test_channel(ot_u8 channel, ot_u8 netstate) {
     ot_bool test = True;
 
     if ((channel != phymac[0].channel) || (netstate == M2_NETSTATE_UNASSOC)) {
-        vlFILE* fp;
-
-        /// Open the Mode 2 FS Config register that contains the channel list
-        /// for this host, and make sure the channel we want to use is available
-        fp = ISF_open_su( ISF_ID(channel_configuration) );
-        ///@todo assert fp
-
-        test = sub_channel_lookup(channel, fp);
-        vl_close(fp);
+        /// Make sure the channel we want to use is in the channel list
+        test = sub_channel_lookup(channel);
     }
 
     return test;
@@ -647,6 +868,7 @@ ot_bool sub_test_channel(ot_u8 channel, ot_u8 netstate) {
 
 #if (SYS_RECEIVE == ENABLED)
 void subcc430_launch_rx(ot_u8 mcsm2_val, ot_u16 intr_en, ot_u16 intr_eselect ) {
+    radio_idle();               // RX is strobed from IDLE, restored if asleep
     sub_prep_q(&rxq);
     em2_decode_newpacket();
     em2_decode_newframe();
@@ -666,6 +888,26 @@ void subcc430_launch_rx(ot_u8 mcsm2_val, ot_u16 intr_en, ot_u16 intr_eselect ) {
     }
 #   endif
 
+    /// Sniff RX: WOR wakes the receiver every EVENT0 (1 count = 1 ti), and
+    /// it listens for EVENT0/2^(6+RX_TIME) unless a sync word is qualified.
+    /// Only the sync word interrupts the MCU, until rm2_rxsync_isr().
+#   if (RF_FEATURE(SCANCYCLE) == ENABLED)
+    if (radio.sniff_evt0 != 0) {
+        Twobytes evt0;
+        evt0.ushort     = radio.sniff_evt0;
+        radio.flags    |= RADIO_FLAG_SNIFF;
+        RF_WriteSingleReg(RF_CoreReg_WOREVT1, evt0.ubyte[UPPER]);
+        RF_WriteSingleReg(RF_CoreReg_WOREVT0, evt0.ubyte[LOWER]);
+        RF_WriteSingleReg(RF_CoreReg_WORCTRL, (RADIO_WOR_ENABLE | RADIO_WOREV1_DELAY | RADIO_WOR_RES));
+        RF_WriteSingleReg(RF_CoreReg_MCSM2, (mcsm2_val & RADIO_RXCS_ENABLE) | b00001000 | radio.sniff_rxtime);
+        RF_ClearCoreITPendingBit(RF_CoreIT_ALL);
+        RFWord->IE  = (ot_u16)(RF_CoreIT_SyncWord >> 16);
+        RFWord->IES = (ot_u16)RF_CoreIT_SyncWord;
+        RF_CmdStrobe( RF_CoreStrobe_WOR );
+        return;
+    }
+#   endif
+
     RF_WriteSingleReg(RF_CoreReg_MCSM2, mcsm2_val);
     RF_ClearCoreITPendingBit(RF_CoreIT_ALL);
     RFWord->IE  = intr_en;
@@ -713,30 +955,14 @@ ot_int rm2_default_tgd(ot_u8 chan_id) {
 ot_int rm2_pkt_duration(ot_int pkt_bytes) {
 /// Wrapper function for rm2_scale_codec that adds some slop overhead
 /// Slop = preamble bytes + sync bytes + ramp-up + ramp-down + padding
-    pkt_bytes  += RADIO_PKT_OVERHEAD;
-    pkt_bytes  += ((phymac[0].channel & 0x60) != 0) << 1;
-
-    return rm2_scale_codec(pkt_bytes);
+    return rm2_scale_codec(pkt_bytes + phymac[0].tpad);
 }
 
 ot_int rm2_scale_codec(ot_int buf_bytes) {
 /// Turns a number of bytes (buf_bytes) into a number of ti units.
 /// To refresh your memory: 1 ti = ((1sec/32768) * 2^5) = 2^-10 sec = ~0.977 ms
-
-    /// Pursuant to DASH7 Mode 2 spec, b6:4 of channel ID corresponds to kS/s.
-    /// 55.555 kS/s = 144us per buffer byte
-    /// 200.00 kS/s = 40us per buffer bytes
-    buf_bytes *= (phymac[0].channel & 0x60) ? 40 : 144;
-
-    /// Divide us into Ticks
-    /// (shift right 10 = divide by 1024)
-#   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) == ENABLED))
-        buf_bytes >>= (10 - ((phymac[0].channel & 0x80) != 0) );
-#   else
-        buf_bytes >>= 10;
-#   endif
-
-    return buf_bytes;
+/// phymac[0].tscale is the byte air time in 1/256 ti (see sub_phy_timing()).
+    return (buf_bytes * phymac[0].tscale) >> 8;
 }
 
 
@@ -789,16 +1015,25 @@ void rm2_rxinit_ff(ot_u8 channel, ot_u8 netstate, ot_int est_frames, ot_sig2 cal
             radio.state     = ((radio.flags & RADIO_FLAG_FRCONT) == 0);
             radio.state    += auto_flag;
             radio.flags    |= (auto_flag << 3);     // sets RADIO_FLAG_RESIZE
+#           if (RF_FEATURE(CHAINEDISR) == ENABLED)
+            radio.rxlimit   = (auto_flag) ? sub_rxlimit() : 8;
+#           else
             radio.rxlimit   = (auto_flag) ? 48 : 8; ///@todo 48 is a magic-number
+#           endif
             buffer_mode     = 2 - auto_flag;
 #       else
             // Initial state is always RXAUTO (2)
             radio.state     = RADIO_STATE_RXAUTO;
+#           if (RF_FEATURE(CHAINEDISR) == ENABLED)
+            radio.rxlimit   = sub_rxlimit();
+#           else
             radio.rxlimit   = 48;
+#           endif
             buffer_mode     = 1;
 #       endif
 
         sub_buffer_config(buffer_mode, 0);
+        sub_hwfilter(False);
         sub_syncword_config(1);
 
         // RX startup routine specific to CC430
@@ -847,6 +1082,7 @@ void rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback) {
 
         radio_flush_rx();
         sub_buffer_config(0, pktlen);
+        sub_hwfilter(True);
 
         /// Start Decoder
         /// - Enable direct RX termination based on RSSI value, which is not
@@ -869,14 +1105,50 @@ void rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback) {
 
 
 
+#if (RF_FEATURE(SCANCYCLE) == ENABLED)
+ot_bool rm2_rxinit_sniff(ot_u8 channel, ot_u8 netstate, ot_uint period, ot_uint listen, ot_sig2 callback) {
+#if (SYS_RECEIVE == ENABLED)
+    /// The shortest WOR listen window (RX_TIME = 0) is about 1/64 of EVENT0,
+    /// and each RX_TIME step halves it.  Pick the shortest one that is still
+    /// at least the requested listen time.  Longer listens are not sniffable.
+    ot_u8 rx_time;
+
+    if ((period >> 6) <= listen) {
+        return False;
+    }
+    for (rx_time=0; (rx_time < 6) && ((period >> (7+rx_time)) >= listen); rx_time++);
+
+    radio.sniff_evt0    = period;
+    radio.sniff_rxtime  = rx_time;
+    if (netstate & M2_NETFLAG_FLOOD)    rm2_rxinit_bf(channel, callback);
+    else                                rm2_rxinit_ff(channel, netstate, 0, callback);
+    radio.sniff_evt0    = 0;
+
+    return True;
+#else
+    return False;
+#endif
+}
+#endif
+
+
+
+
 void rm2_rxsync_isr() {
 /// Reset the radio interruptor to catch the next RX FIFO interrupt, having
 /// qualified the Sync Word.  rm2_rxdata_isr() will be called on that interrupt.
 /// Also, re-schedule a system event as a watchdog.
+    rm2_stamp.rxsync = platform_stamp();
+    SYS_PROFILE_ISR_START();
+    sub_endsniff();
+#   if (RF_FEATURE(CHAINEDISR) == ENABLED)
+    radio.isr_end       = &rm2_rxend_isr;
+#   endif
     RFWord->IE          = (ot_u16)((RF_CoreIT_RXFull | RF_CoreIT_EndState) >> 16);
     RFWord->IES         = (ot_u16)(RF_CoreIT_RXFull | RF_CoreIT_EndState);
     sys_set_mutex((ot_uint)SYS_MUTEX_RADIO_DATA);
     sub_killonlowrssi();
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXSYNC);
 }
 
 
@@ -888,7 +1160,9 @@ void rm2_rxtimeout_isr() {
 
 
 
+OT_RAMCODE(rm2_rxdata_isr)
 void rm2_rxdata_isr() {
+    SYS_PROFILE_ISR_START();
 #if (SYS_RECEIVE == ENABLED)
     sub_killonlowrssi();
 
@@ -896,6 +1170,16 @@ void rm2_rxdata_isr() {
     //RFGET_RXDATA();         // Only needed w/ internal DMA usage to set buffer params
     em2_decode_data();      // Contains logic to prevent over-run
 
+#   if (M2_FEATURE(RXFILTER) == ENABLED)
+    /// 1b. Kill RX as soon as the header shows the frame is for another
+    ///     subnet or device (see sys_rxfilter())
+    if (sys_rxfilter() == False) {
+        sub_kill(RM2_ERR_LINK, 0);
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+        return;
+    }
+#   endif
+
     /// 2. Handle each RX type, and transitions
     switch ((radio.state >> RADIO_STATE_RXSHIFT) & (RADIO_STATE_RXMASK >> RADIO_STATE_RXSHIFT)) {
 
@@ -920,8 +1204,7 @@ void rm2_rxdata_isr() {
 
                 // Prepare the next frame by moving the "front" pointer and
                 // re-initializing the decoder engine
-                q_rebase(&rxq, rxq.putcursor);
-                em2_decode_newframe();
+                em2_decode_nextframe();
 
                 // Clear out what's leftover in the FIFO, from the new frame,
                 // and re-do boundary checks on this new frame.
@@ -955,6 +1238,14 @@ void rm2_rxdata_isr() {
                 radio.flags    &= ~RADIO_FLAG_RESIZE;
                 radio.state     = RADIO_STATE_RXDONE;
             }
+#           if (RF_FEATURE(CHAINEDISR) == ENABLED)
+            /// The header is in: the rest of the packet can use the biggest
+            /// threshold that the data rate allows.
+            else if (radio.rxlimit == 8) {
+                radio.rxlimit   = sub_rxlimit();
+                radio.flags    |= RADIO_FLAG_RESIZE;
+            }
+#           endif
             break;
         }
 #       endif
@@ -994,15 +1285,24 @@ void rm2_rxdata_isr() {
 #   endif
 
 #endif
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
 }
 
 
 
 void rm2_rxend_isr() {
+    SYS_PROFILE_ISR_START();
+    /// Background frames are constant length, so they take the short path
+    if (radio.flags & RADIO_FLAG_FLOOD) {
+        sub_kill(0, em2_decode_bf());
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXEND);
+        return;
+    }
 #if ((M2_FEATURE(MULTIFRAME) == ENABLED) || (M2_FEATURE(FEC_RX) == ENABLED))
     em2_decode_data();  // New: decode any leftover data
 #endif
     sub_kill(0, (ot_int)crc_check() - 1);
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXEND);
 }
 
 
@@ -1018,6 +1318,12 @@ void rm2_txinit_ff(ot_int est_frames, ot_sig2 callback) {
     RFCONFIG_TXINIT();
 
     /// Prepare the foreground frame packet
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    if (phymac[0].tx_eirp != RM2_EIRP_AUTOSCALE(phymac[0].max_eirp)) {
+        phymac[0].tx_eirp = RM2_EIRP_AUTOSCALE(phymac[0].max_eirp);
+        sub_set_txpower(phymac[0].tx_eirp);
+    }
+#   endif
     txq.getcursor   = txq.front;
     txq.front[1]    = phymac[0].tx_eirp;
 
@@ -1046,6 +1352,7 @@ void rm2_txinit_bf(ot_sig2 callback) {
     txq.getcursor   = txq.front;
 
     sub_prep_q(&txq);
+    txq.options.ubyte[UPPER] = 0;   // M2AdvP frames carry their CRC
     em2_encode_newpacket();
     em2_encode_newframe();
     sub_buffer_config(0, em2_remaining_bytes() );
@@ -1105,9 +1412,16 @@ ot_int rm2_txcsma() {
 
         /// 3. TX startup
         case (RADIO_STATE_TXSTART >> RADIO_STATE_TXSHIFT): {
+            radio_idle();           // no CCA has woken the radio with NOCSMA
             radio.state     = RADIO_STATE_TXDATA;
+#           if (RF_FEATURE(CHAINEDISR) == ENABLED)
+            radio.isr_end   = &rm2_txdata_isr;
+            radio.txlimit   = sub_txlimit();
+            RFCONFIG_TXBUFFER(radio.txlimit);
+#           else
             radio.txlimit   = 5;
             RFCONFIG_TXBUFFER(5);
+#           endif
 
 #           if (SYS_FLOOD == ENABLED)
             /// Packet flooding.  Only needed on devices that can send M2AdvP
@@ -1145,6 +1459,7 @@ ot_int rm2_txcsma() {
 
 
 void rm2_txdata_isr() {
+    SYS_PROFILE_ISR_START();
     /// Continues where rm2_txcsma() leaves off.
     switch ( (radio.state >> RADIO_STATE_TXSHIFT) & (RADIO_STATE_TXMASK >> RADIO_STATE_TXSHIFT) ) {
 
@@ -1159,11 +1474,29 @@ void rm2_txdata_isr() {
 
             /// Packet flooding.  Only needed on devices that can send M2AdvP
 #           if (SYS_FLOOD == ENABLED)
+            /// The next frame is already prepared: load it before anything
+            /// else, and let the callback prepare the one after it.
             if (radio.flags & RADIO_FLAG_FLOOD) {
-                radio.evtdone(2, 0);
-                txq.getcursor = txq.front;
+                m2advp_swap();
                 em2_encode_newframe();
-                goto rm2_txpkt_TXDATA;
+                em2_encode_data();
+                radio.evtdone(2, 0);
+                break;
+            }
+#           endif
+
+            /// Redundant TX pipelining: the callback may chain the next copy
+            /// with rm2_prep_resend().  The frame already carries its CRC.
+#           if (OT_FEATURE(TXPIPE) == ENABLED)
+            if ((em2_remaining_frames() == 0) && !(radio.flags & RADIO_FLAG_FRCONT)) {
+                radio.evtdone(2, 0);
+                if (txq.options.ubyte[UPPER] == 255) {
+                    txq.options.ubyte[UPPER] = 0;
+                    txq.getcursor = txq.front;
+                    em2_encode_newframe();
+                    em2_encode_data();
+                    break;
+                }
             }
 #           endif
 
@@ -1180,13 +1513,14 @@ void rm2_txdata_isr() {
             /// If the frame is done, but more need to be sent (e.g. MFP's)
             /// queue it up.  The additional encode stage is there to fill up
             /// what's left of the buffer.
+            /// The buffer is filled before the callback runs, so the callback
+            /// does not widen the gap between the frames.
 #           if (M2_FEATURE(MULTIFRAME) == ENABLED)
             if (radio.flags & RADIO_FLAG_FRCONT) {
-                q_rebase(&txq, txq.getcursor);
-                radio.evtdone(1, 0);        //callback action for next frame
-                em2_encode_newframe();
+                em2_encode_nextframe();
                 txq.front[1] = phymac[0].tx_eirp;
                 em2_encode_data();
+                radio.evtdone(1, 0);        //callback action for next frame
                 goto rm2_txpkt_TXDATA;
             }
 #           endif
@@ -1195,6 +1529,7 @@ void rm2_txdata_isr() {
         /// 5. Conclude the TX process, and wipe the radio state
         //     turn off any remaining TX interrupts
         case (RADIO_STATE_TXDONE >> RADIO_STATE_TXSHIFT):
+            rm2_stamp.txend = platform_stamp();
             sub_kill(0, 0);
             break;
 
@@ -1203,6 +1538,7 @@ void rm2_txdata_isr() {
             sub_kill(RM2_ERR_GENERIC, 0);
             break;
     }
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_TXDATA);
 }
 
 
@@ -1225,9 +1561,25 @@ void sub_null(ot_int arg1, ot_int arg2) { return; }
 void sub_kill(ot_int main_err, ot_int frame_err) {
     radio_gag();
     radio_idle();
+    sub_endsniff();
     radio.evtdone(main_err, frame_err);
     radio.evtdone   = &otutils_sig2_null;
     radio.state     = 0;
+#   if (RF_FEATURE(CHAINEDISR) == ENABLED)
+    radio.isr_end   = &rm2_rxend_isr;
+#   endif
+}
+
+
+void sub_endsniff() {
+/// Once a sniff RX has found a sync word or been killed, the WOR timer is
+/// put back to its normal configuration (powered-down unless RXTIMER).
+#if (RF_FEATURE(SCANCYCLE) == ENABLED)
+    if (radio.flags & RADIO_FLAG_SNIFF) {
+        radio.flags &= ~RADIO_FLAG_SNIFF;
+        RF_WriteSingleReg(RF_CoreReg_WORCTRL, RFREG_WORCTL);
+    }
+#endif
 }
 
 
@@ -1292,25 +1644,20 @@ ot_bool sub_cca2() {
 
 
 ot_bool sub_chan_scan( ot_bool (*scan_test)() ) {
-    vlFILE* fp;
     ot_int  i;
 
-    fp = ISF_open_su( ISF_ID(channel_configuration) );
-    ///@todo assert fp
-
     /// Go through the list of tx channels
     /// - Make sure the channel ID is valid
     /// - Make sure the transmission can fit within the contention period.
     /// - Scan it, to make sure it can be used
     for (i=0; i<dll.comm.tx_channels; i++) {
-        if (sub_channel_lookup(dll.comm.tx_chanlist[i], fp) != False) {
+        if (sub_channel_lookup(dll.comm.tx_chanlist[i]) != False) {
             if (scan_test()) {
                 break;
             }
         }
     }
 
-    vl_close(fp);
     return (ot_bool)(i < dll.comm.tx_channels);
 }
 
@@ -1329,6 +1676,7 @@ ot_bool sub_cca_scan() {
 /// CC1xxx and don't have the RSSI_Valid interrupt, but RSSI_Valid is more
 /// reliable.  Then we just compare returned RSSI's with the stored limits.
     ot_bool cca_status = True;
+    ot_int  rssi;
 
     RFCONFIG_CCA();
     RFCONFIG_CSMA_INTON();              //enable CSMA/CCA Interrupt(s)
@@ -1340,9 +1688,16 @@ ot_bool sub_cca_scan() {
     platform_disable_interrupts();
     RFCONFIG_CSMA_INTOFF();             //disable CSMA/CCA Interrupt(s)
 
-    cca_status = radio_check_cca();     //Compare radio RSSI with limits
+    rssi        = radio_rssi();         //Compare radio RSSI with limits
+    cca_status  = (ot_bool)(rssi < ((ot_int)phymac[0].cca_thr - 140));
     radio_idle();                       //send radio to idle mode
 
+#   if (RF_FEATURE(SCANSORT) == ENABLED)
+    {   ot_int* avg = &scan_ewma[sub_chan_fc(phymac[0].channel)];
+        *avg       += ((rssi << 4) - *avg) >> SCAN_EWMA_SHIFT;
+    }
+#   endif
+
     return cca_status;
 }
 
@@ -1367,7 +1722,9 @@ ot_bool sub_csma_init() {
     /// One of the two (CS vs. CCA) will always happen.
     RF_WriteSingleReg(RF_CoreReg_MCSM2, 0x07);
 
-    /// Setup channel, scan it, and power down RF on scan fail
+    /// Put the least occupied channels first, then setup channel, scan it,
+    /// and power down RF on scan fail
+    sub_chan_sort();
     cca1_status = sub_chan_scan( &sub_cca_scan );
     if (cca1_status == False) {         //Optimizers may remove this if() for
         radio_sleep();                  //certain implementations
@@ -1389,16 +1746,89 @@ ot_bool sub_nocsma_init() {
 
 
 
-ot_bool sub_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
+ot_u8 sub_chan_fc(ot_u8 chan_id) {
+/// Returns the center frequency index that sub_chan_config() uses for chan_id.
+/// Base channels (class 0) always use center frequency 7.
+    return ((chan_id & 0x30) == 0) ? 7 : (chan_id & 0x0F);
+}
+
+
+
+
+void sub_chan_sort() {
+/// Called by sub_csma_init()
+/// Duty: Stable insertion sort of dll.comm.tx_chanlist by the occupancy of
+///       each channel, least occupied first.  The list is short (usually one
+///       to four channels), and already-ordered lists take one pass.
+#if (RF_FEATURE(SCANSORT) == ENABLED)
+    ot_int i, j;
+
+    for (i=1; i<dll.comm.tx_channels; i++) {
+        ot_u8   chan_id = dll.comm.tx_chanlist[i];
+        ot_int  key     = scan_ewma[sub_chan_fc(chan_id)] >> SCAN_KEY_SHIFT;
+
+        for (j=i; j>0; j--) {
+            ot_u8 prev_id = dll.comm.tx_chanlist[j-1];
+            if ((scan_ewma[sub_chan_fc(prev_id)] >> SCAN_KEY_SHIFT) <= key) {
+                break;
+            }
+            dll.comm.tx_chanlist[j] = prev_id;
+        }
+        dll.comm.tx_chanlist[j] = chan_id;
+    }
+#endif
+}
+
+
+
+
+void sub_chantable_refresh() {
+/// Called by sub_channel_lookup()
+/// Duty: Reload the channel table from the channel configuration ISF if it has
+///       not been loaded yet, or if any file has been changed since.
+    ot_u16 stamp = (ot_u16)(vl_writestamp + vl_mapstamp);
+
+    if ((chantable.valid == False) || (chantable.stamp != stamp)) {
+        vlFILE*     fp;
+        ot_int      i;
+        ot_u8       j = 0;
+        Twobytes    scratch;
+
+        fp = ISF_open_su( ISF_ID(channel_configuration) );
+        if (fp != NULL) {
+            for (i=0; (i < fp->length) && (j < RF_PARAM_CHANNELS); i+=8, j++) {
+                scratch.ushort                  = vl_read(fp, i);
+                chantable.entry[j].spectrum_id  = scratch.ubyte[0];
+                chantable.entry[j].autoscale    = scratch.ubyte[1];
+                scratch.ushort                  = vl_read(fp, i+2);
+                chantable.entry[j].tx_eirp      = scratch.ubyte[0];
+                chantable.entry[j].link_qual    = scratch.ubyte[1];
+                scratch.ushort                  = vl_read(fp, i+4);
+                chantable.entry[j].cs_thr       = scratch.ubyte[0];
+                chantable.entry[j].cca_thr      = scratch.ubyte[1];
+            }
+            vl_close(fp);
+        }
+
+        chantable.count = j;
+        chantable.stamp = stamp;
+        chantable.valid = True;
+    }
+}
+
+
+
+
+ot_bool sub_channel_lookup(ot_u8 chan_id) {
 /// Called during channel scans.
 /// Duty: (a) See if the supplied channel is supported on this device & config.
 ///       If yes, return true.  (b) Determine if recalibration is required
 ///       before changing to the new channel, and recalibrate if so.
 
-    ot_u8       fec_id;
-    ot_u8       spectrum_id;
-    ot_int      i;
-    Twobytes    scratch;
+    ot_u8               fec_id;
+    ot_u8               spectrum_id;
+    ot_int              i;
+    chanentry_struct*   entry;
 
     /// Only do the channel lookup if the new channel is different than before
     if (chan_id == phymac[0].channel) {
@@ -1473,24 +1903,25 @@ ot_bool sub_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
 #       define AUTOSCALE_MASK(VAL)      (VAL)
 #   endif
 
-    for (i=0; i<fp->length; i+=8) {
-        scratch.ushort = vl_read(fp, i);
+    sub_chantable_refresh();
+    entry = &chantable.entry[0];
 
-        if (spectrum_id == scratch.ubyte[0]) {
+    for (i=0; i<chantable.count; i++, entry++) {
+        if (spectrum_id == entry->spectrum_id) {
             ot_u8 old_chan_id   = phymac[0].channel;
             ot_u8 old_tx_eirp   = phymac[0].tx_eirp;
 
             phymac[0].tg        = rm2_default_tgd(chan_id);
+            sub_phy_timing(chan_id);
             phymac[0].channel   = chan_id;
-            phymac[0].autoscale = scratch.ubyte[1];
-
-            scratch.ushort      = vl_read(fp, i+2);
-            phymac[0].tx_eirp   = AUTOSCALE_MASK(scratch.ubyte[0]);
-            phymac[0].link_qual = AUTOSCALE_MASK(scratch.ubyte[1]);
-
-            scratch.ushort      = vl_read(fp, i+4);
-            phymac[0].cs_thr    = AUTOSCALE_MASK(scratch.ubyte[0]);
-            phymac[0].cca_thr   = AUTOSCALE_MASK(scratch.ubyte[1]);
+            phymac[0].autoscale = entry->autoscale;
+#           if (M2_FEATURE(AUTOSCALE) == ENABLED)
+            phymac[0].max_eirp  = entry->tx_eirp;
+#           endif
+            phymac[0].tx_eirp   = RM2_EIRP_AUTOSCALE(entry->tx_eirp);
+            phymac[0].link_qual = AUTOSCALE_MASK(entry->link_qual);
+            phymac[0].cs_thr    = AUTOSCALE_MASK(entry->cs_thr);
+            phymac[0].cca_thr   = AUTOSCALE_MASK(entry->cca_thr);
 
             /// @note This is a CC430-centric method to set cs_thr and cca_thr.
             /// Based on some internal features of the CC1101 radio core.  It
@@ -1511,6 +1942,21 @@ ot_bool sub_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
 
 
 
+/// PHY register blocks, indexed by channel class: b0 = 200 kS/s, b1 = FEC.
+/// They are built at compile time from CC430_defaults.h.
+static const ot_u8 phy_block[][4] = {
+#   if (M2_FEATURE(FEC) == ENABLED)
+    RADIO_PHYBLOCK_NORMAL(RADIO_MDMCFG2_PN9),
+    RADIO_PHYBLOCK_TURBO(RADIO_MDMCFG2_PN9),
+    RADIO_PHYBLOCK_NORMAL(RADIO_MDMCFG2_FEC),
+    RADIO_PHYBLOCK_TURBO(RADIO_MDMCFG2_FEC)
+#   else
+    RADIO_PHYBLOCK_NORMAL(RFREG_MDMCFG2),
+    RADIO_PHYBLOCK_TURBO(RFREG_MDMCFG2)
+#   endif
+};
+
+
 void sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
 /// Called by sub_channel_lookup()
 /// Duty: perform channel setup and recalibration when moving from one channel
@@ -1519,39 +1965,22 @@ void sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
     ot_u8 fc_i;
 
 #   if (M2_FEATURE(FEC) == ENABLED)
-    /// Only worry about changing encoding method if:
+    /// Only worry about changing packet qualifiers if:
     /// (a) Optional FEC is enabled (otherwise only one kind of encoding)
     /// (b) The last-used channel had a different encoding type
-
+    /// MDMCFG2 (sync qualifier) is part of the PHY block, below.
         if ( (old_chan ^ phymac[0].channel) & 0x80 ) {
-            ot_u8 pktctrl1_val;
-            ot_u8 mdmcfg2_val;
-
             if (phymac[0].channel & 0x80) {
-                /// Set up transceiver for FEC
-                /// set Preamble qualifier on the low side (eg PQT=4 on CC430)
-                /// set Sync Word qualifier to allow up to two bit errors
-                //RFCONFIG_FECQUAL();
-                pktctrl1_val    = b00100000;
-                mdmcfg2_val     = b10010101;
-
+                /// FEC: set Preamble qualifier on the low side (PQT=4)
+                RF_WriteSingleReg(RF_CoreReg_PKTCTRL1, b00100000);
             }
             else {
-                /// Set up transceiver for PN9 method
-                /// If FEC is disabled, these settings will always be in the regs.
-                ///set FEC to OFF and PN9 to ON
-                ///set Preamble qualifier on the high side (eg PQT=8 on CC430)
-                ///set Sync qualifier to allow no bit errors (16/16)
+                /// PN9: set Preamble qualifier on the high side (PQT=8)
                 RFCONFIG_PN9HW();
-                RFCONFIG_PN9QUAL();
-                pktctrl1_val    = b01000000;
-                mdmcfg2_val     = b10010010;
+                RF_WriteSingleReg(RF_CoreReg_PKTCTRL1, b01000000);
                 radio.flags    |= RADIO_FLAG_AUTO;
             }
 
-            RF_WriteSingleReg(RF_CoreReg_PKTCTRL1, pktctrl1_val);
-            RF_WriteSingleReg(RF_CoreReg_MDMCFG2, mdmcfg2_val);
-
             /// @note On CC430 register PKTCTRL0:
             /// Pktctrl0 is adjusted later, by sub_buffer_config, during RX/TX
             /// Pktctrl0 contains the bit that turns on CC430 PN9 HW.
@@ -1566,32 +1995,19 @@ void sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
     /// Center Frequency index = lower four bits channel ID
     fc_i = (phymac[0].channel & 0x0F);
 
-    /// @note Settings of "mdmcfg..." are CC430 specific implementation
-    /// Reprogram data rate, packet method, and modulation per upper nibble
+    /// Reprogram data rate, sync qualifier, and preamble per upper nibble, as
+    /// one burst of the precomputed PHY block.  The base channel is on fc 7.
     /// (Don't reprogram if radio is using the same channel class already)
-    if ( (old_chan ^ phymac[0].channel) & 0x70 ) {
-        ot_u8 mdmcfg4_val;
-        ot_u8 mdmcfg3_val;
-        ot_u8 mdmcfg1_val;
-
-        switch ((phymac[0].channel >> 4) & 0x03) {
-            case 0: fc_i = 7;
-            case 1: //RFCONFIG_FSK18();       /// 55 kS/s method
-                    mdmcfg4_val = (RADIO_FILTER_NORMAL | RADIO_DRATE_NORMAL_E);
-                    mdmcfg3_val = RADIO_DRATE_NORMAL_M;
-                    mdmcfg1_val = (RADIO_PREAMBLE_NORMAL | RADIO_CHANNEL_SPC_E);
-                    break;
-            case 2:
-            case 3: //RFCONFIG_FSK05();       /// 200 kS/s method
-                    mdmcfg4_val = (RADIO_FILTER_TURBO | RADIO_DRATE_TURBO_E);
-                    mdmcfg3_val = RADIO_DRATE_TURBO_M;
-                    mdmcfg1_val = (RADIO_PREAMBLE_TURBO | RADIO_CHANNEL_SPC_E);
-                    break;
+    if ( (old_chan ^ phymac[0].channel) & 0xF0 ) {
+        ot_u8 phy_i;
+        phy_i = ((phymac[0].channel & 0x20) != 0);
+#       if (M2_FEATURE(FEC) == ENABLED)
+        phy_i |= (phymac[0].channel >> 6) & 2;
+#       endif
+        if ((phymac[0].channel & 0x30) == 0) {
+            fc_i = 7;
         }
-
-        RF_WriteSingleReg(RF_CoreReg_MDMCFG4, mdmcfg4_val);
-        RF_WriteSingleReg(RF_CoreReg_MDMCFG3, mdmcfg3_val);
-        RF_WriteSingleReg(RF_CoreReg_MDMCFG1, mdmcfg1_val);
+        RF_WriteBurstReg(RF_CoreReg_MDMCFG4, (ot_u8*)phy_block[phy_i], 4);
     }
 
 
@@ -1602,8 +2018,51 @@ void sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
     /// - But don't do these things if radio is already set on this center channel
     if ( fc_i != (old_chan & 0x0F) ) {
         RF_WriteSingleReg(RF_CoreReg_CHANNR, (ot_u8)fc_i); //RFCONFIG_FC(fc_i);
-        radio_calibrate();  //Manual Calibrate
+        sub_calibrate(fc_i);
+    }
+}
+
+
+
+
+void sub_phy_timing(ot_u8 chan_id) {
+/// Called when the channel is set: precomputes the PHY timing constants for
+/// rm2_scale_codec() and rm2_pkt_duration(), so those need no channel tests.
+    ot_u8 turbo         = ((chan_id & 0x60) != 0);
+    phymac[0].tscale    = turbo ? RM2_TSCALE_200 : RM2_TSCALE_55;
+    phymac[0].tpad      = RADIO_PKT_OVERHEAD + (turbo << 1);
+#   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) == ENABLED))
+    phymac[0].tscale  <<= ((chan_id & 0x80) != 0);
+#   endif
+}
+
+
+
+
+void sub_calibrate(ot_u8 fc_i) {
+/// Called by sub_chan_config() after CHANNR is changed.
+/// Duty: Save the FSCAL results of the center frequency being left, then load
+///       the saved results for the new one, or calibrate if there are none.
+#if (RF_FEATURE(CALCACHE) == ENABLED)
+    ot_u16 fc_bit;
+
+    /// Calibration results are only complete once the core is back in IDLE
+    if ((chantable.calnow < 16) && \
+        ((RF_ReadSingleReg(RF_CoreReg_MARCSTATE) & 0x1F) == RF_MARCState_IDLE)) {
+        RF_ReadBurstReg(RF_CoreReg_FSCAL3, &chantable.fscal[chantable.calnow][0], 3);
+        chantable.calmask |= (1 << chantable.calnow);
+    }
+
+    chantable.calnow    = fc_i;
+    fc_bit              = (1 << fc_i);
+
+    if (chantable.calmask & fc_bit) {
+        RF_WriteBurstReg(RF_CoreReg_FSCAL3, &chantable.fscal[fc_i][0], 3);
+        return;
     }
+#endif
+
+    radio_calibrate();  //Manual Calibrate
 }
 
 
@@ -1611,23 +2070,23 @@ void sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
 
 void sub_syncword_config(ot_u8 sync_class) {
 ///@note The MSP430 core is little endian, and CC1101 core is big endian, so
-/// syncwords might need to be twiddled.
-    Twobytes sync_value;
+/// syncwords might need to be twiddled.  The table is indexed by FEC (b1)
+/// and sync class (b0).  Actual= 0xE6D0 : 0x0B67, FEC= 0xF498 : 0x192F
+    static const ot_u16 sync_word[] = { 0xE6D0, 0x0B67, 0xF498, 0x192F };
 
 #   if (M2_FEATURE(FEC) == ENABLED)
-        if (phymac[0].channel & 0x80) {   //Actual= 0xF498 : 0x192F;
-            sync_value.ushort = (sync_class == 0) ? 0xF498 : 0x192F;
-        }
-        else
+        sync_class |= (phymac[0].channel >> 6) & 2;
 #   endif
-    {                                 //Actual= 0xE6D0 : 0x0B67;
-        sync_value.ushort = (sync_class == 0) ? 0xE6D0 : 0x0B67;
-    }
 
     ///@note Depending on how the RF core interface is designed, you may want to
     ///      redefine this macro to take-in the 16 bit value in a different way.
+    ///      SYNC1/SYNC0 are retained in SLEEP, so they are only written when
+    ///      the sync word changes.
     //RFCONFIG_SYNCWORD( &sync_value.ubyte[0] );
-    RF_WriteBurstReg(RF_CoreReg_SYNC1, &sync_value.ubyte[0], 2);
+    if (radio.sync != sync_class) {
+        radio.sync = sync_class;
+        RF_WriteBurstReg(RF_CoreReg_SYNC1, (ot_u8*)&sync_word[sync_class], 2);
+    }
 }
 
 
@@ -1655,6 +2114,29 @@ void sub_buffer_config(ot_u8 mode, ot_u8 param) {
 
 
 
+void sub_hwfilter(ot_bool bgframe) {
+/// CC430 specific implementation.  Background frames carry the subnet in the
+/// first byte, so the packet engine's address check can drop frames for other
+/// subnets before the MCU sees any data.  It is only exact when the device
+/// subnet mask is 0xF (then the passing subnets are 0xFF and our own), and
+/// the check does not work on FEC-coded data.  Foreground frames have the
+/// subnet at offset 2, so they are left to the software filter.
+#if (RF_FEATURE(SUBNETFILTER) == ENABLED)
+    ot_u8 pktctrl1 = RFREG_PKTCTRL1;
+
+    if ( bgframe \
+        && ((dll.netconf.subnet & 0x0F) == 0x0F) \
+        && ((phymac[0].channel & 0x80) == 0) ) {
+        RF_WriteSingleReg(RF_CoreReg_ADDR, dll.netconf.subnet);
+        pktctrl1 |= 3;      // ADR_CHK = 3: ADDR, 0x00, 0xFF broadcast
+    }
+    RF_WriteSingleReg(RF_CoreReg_PKTCTRL1, pktctrl1);
+#endif
+}
+
+
+
+
 void sub_prep_q(Queue* q) {
 /// Put some special data in the queue options field.
 /// Lower byte is encoding options (i.e. FEC)
@@ -1690,6 +2172,27 @@ ot_int sub_eta_txi() {
 
 
 
+ot_int sub_fifo_margin() {
+/// Bytes that go through the FIFO during the ISR latency budget (at least 1).
+/// A full FIFO takes rm2_scale_codec(FIFO) ti, rounded up.
+    ot_int fifo_ti;
+    fifo_ti = rm2_scale_codec(RF_FEATURE(RXFIFO_BYTES)) + 1;
+    return (RF_FEATURE(RXFIFO_BYTES) / (fifo_ti << RF_PARAM_ISRLATENCY)) + 1;
+}
+
+ot_int sub_rxlimit() {
+/// RX threshold is the FIFO minus the margin, rounded down to FIFOTHR steps (4)
+    return (RF_FEATURE(RXFIFO_BYTES) - sub_fifo_margin()) & ~3;
+}
+
+ot_int sub_txlimit() {
+/// TX threshold is the margin, rounded up to FIFOTHR steps (4n+1)
+    return ((sub_fifo_margin() + 3) & ~3) + 1;
+}
+
+
+
+
 
 void sub_offset_rxtimeout() {
 /// If the rx timeout is 0, set it to a minimally small amount, which relates to
@@ -1738,7 +2241,7 @@ void sub_set_txpower( ot_u8 eirp_code ) {
         0x85, 0x83, 0x81, 0xCA, 0xC9, 0xC7, 0xC6, 0xC4, 0xC3, 0xC1      //5 to 9.5
     };
 
-    ot_u8   pa_table[8];
+    ot_u8*  pa_table = radio.pa_table;
     ot_int  i;
     ot_int  eirp_val;
 
@@ -1752,6 +2255,7 @@ void sub_set_txpower( ot_u8 eirp_code ) {
     }
     i++;
 
+    radio.pa_start = (ot_u8)i;
     RF_WriteBurstPATable(&pa_table[i], (ot_u8)(8-i));
     RF_WriteSingleReg( RF_CoreReg_FREND0, (RFREG_FREND0 | (ot_u8)(7-i)) );
 }
@@ -63,17 +63,19 @@
 #define RF_FEATURE_CSMA                  DISABLED                // CSMA                     Low
 #define RF_FEATURE_RXTIMER               DISABLED                // RX Timeout capability    Low
 #define RF_FEATURE_TXTIMER               DISABLED                // TX MAC capability        DASH7-specific
-#define RF_FEATURE_SCANCYCLE             DISABLED                // Wake-on scan cycle       DASH7-specific
+#define RF_FEATURE_SCANCYCLE             ENABLED                 // Wake-on scan cycle       DASH7-specific
 #define RF_FEATURE_MIRROR                DISABLED                // UDB Register Mirroring   DASH7-specific
 #define RF_FEATURE_SYNCFILTER            DISABLED                // Synchronizer Filtering   DASH7-specific
 #define RF_FEATURE_LBFILTER              DISABLED                // Link Budget Filtering    DASH7-specific
 #define RF_FEATURE_SIDFILTER             DISABLED                // Session ID Filtering     DASH7-specific
 #define RF_FEATURE_ADDRFILTER            DISABLED                // Address Filtering        DASH7-specific
+#define RF_FEATURE_SUBNETFILTER          ENABLED                 // Subnet HW Filtering      Moderate (BG frames)
 #define RF_FEATURE_PARSEFILTER           DISABLED                // Full Parse Filtering     DASH7-specific
 #define RF_FEATURE_MAC                   DISABLED                // Full Integrated MAC      DASH7-specific
 #define RF_FEATURE_AES128                DISABLED                // AES128 engine            Rare/None yet
 #define RF_FEATURE_ECC                   DISABLED                // ECC engine               Rare/None yet
 #define RF_FEATURE_ALGE                  DISABLED                // Algebraic Eraser engine  Rare/None yet
+#define RF_FEATURE_AUXRX                 DISABLED                // Auxiliary RX radio       Rare (2nd transceiver)
 
 
 
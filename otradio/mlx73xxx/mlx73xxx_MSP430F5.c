@@ -380,12 +380,20 @@ ot_u8 mlx73_pwrstatus() {
     return (ot_u8)mlx73_read_bank(BANK_0, B0REG(PWRSTATUS));
 }
 
+ot_u8 mlx73_rxstatus() {
+    ot_u8 addr = RFREG(STATUS1);
+    ot_u8 status[4];
+    mlx73_spibus_io(0, 1, 4, &addr, status);
+    mlx73.status1 = status[0];
+    return status[3];
+}
+
 ot_u8 mlx73_check_crc() {
 /// Return 0 when crc is good (similar to checking CRC value == 0)
-    //return ((ot_u8)mlx73_read(RFREG(STATUS1)) & 1) - 1;
+    //return ((ot_u8)mlx73.status1 & 1) - 1;
 
     ot_u8 status2E;
-    status2E    = mlx73_read(RFREG(STATUS1));
+    status2E    = mlx73.status1;
     status2E   &= ~(7<<2);
     return (status2E == (7<<2));
 }
@@ -678,6 +686,45 @@ ot_s8 mlx73_spibus_io(ot_u8 bank, ot_u8 cmd_len, ot_u8 resp_len, ot_u8* cmd, ot_
 }
 
 
+/** FIFO bursts <BR>
+  * ============================================================================
+  * The FIFO register does not auto-increment, so a burst is the address byte
+  * and then the data, which goes straight between the SPI and the caller's 
+  * buffer (no copy, and no length limit from the DMA buffer).
+  */
+void sub_fifo_cpu(ot_u8 addr, ot_u8* data, ot_u8 length, ot_bool write) {
+    ot_u8 rxbyte;
+    
+    __SPI_CS_ON();
+    __SPI_ENABLE();
+    while ((RADIO_SPI->SR & SPI_I2S_FLAG_TXE) == 0);
+    __SPI_PUT(addr);
+    while ((RADIO_SPI->SR & SPI_I2S_FLAG_RXNE) == 0);
+    __SPI_GET(rxbyte);
+    
+    for (; length != 0; length--, data++) {
+        while ((RADIO_SPI->SR & SPI_I2S_FLAG_TXE) == 0);
+        __SPI_PUT( (write) ? *data : 0 );
+        while ((RADIO_SPI->SR & SPI_I2S_FLAG_RXNE) == 0);
+        __SPI_GET(rxbyte);
+        if (write == False) {
+            *data = rxbyte;
+        }
+    }
+    
+    __SPI_CS_OFF();
+    __SPI_DISABLE();
+}
+
+void mlx73_fifo_read(ot_u8* data, ot_u8 length) {
+    sub_fifo_cpu((RFREG(RXFIFORD) | 1), data, length, False);
+}
+
+void mlx73_fifo_write(ot_u8* data, ot_u8 length) {
+    sub_fifo_cpu(RFREG(TXFIFOWR), data, length, True);
+}
+
+
 ot_u8 mlx73_read(ot_u8 addr) {
     ot_u8 read_data;
     mlx73_spibus_io(0, 1, 1, &addr, &read_data);
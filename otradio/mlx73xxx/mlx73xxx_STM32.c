@@ -42,6 +42,28 @@
 // you need to use the DMA, and it needs to be double buffered
 #ifdef MLX73_DMA_BUFFER
     ot_u8 __dma_buffer[MLX73_DMA_BUFFER];
+
+/// Channel setup for mlx73_spibus_io() (RX & TX), and the part of it that
+/// FIFO bursts share (they set direction and memory increment themselves)
+#   define RADIO_DMA_FIFOCCR   (DMA_Mode_Normal             | \
+                                DMA_PeripheralInc_Disable   | \
+                                DMA_PeripheralDataSize_Byte | \
+                                DMA_MemoryDataSize_Byte     | \
+                                DMA_Priority_VeryHigh       | \
+                                DMA_M2M_Disable)
+
+#   define RADIO_DMA_RXCCR     (DMA_DIR_PeripheralSRC       | \
+                                DMA_MemoryInc_Enable        | \
+                                RADIO_DMA_FIFOCCR)
+
+#   define RADIO_DMA_TXCCR     (DMA_DIR_PeripheralDST       | \
+                                DMA_Mode_Circular           | \
+                                DMA_PeripheralInc_Disable   | \
+                                DMA_MemoryInc_Enable        | \
+                                DMA_PeripheralDataSize_Byte | \
+                                DMA_MemoryDataSize_Byte     | \
+                                DMA_Priority_VeryHigh       | \
+                                DMA_M2M_Disable)
 #endif
 
 
@@ -379,12 +401,20 @@ ot_u8 mlx73_pwrstatus() {
     return (ot_u8)mlx73_read_bank(BANK_0, B0REG(PWRSTATUS));
 }
 
+ot_u8 mlx73_rxstatus() {
+    ot_u8 addr = RFREG(STATUS1);
+    ot_u8 status[4];
+    mlx73_spibus_io(0, 1, 4, &addr, status);
+    mlx73.status1 = status[0];
+    return status[3];
+}
+
 ot_u8 mlx73_check_crc() {
 /// Return 0 when crc is good (similar to checking CRC value == 0)
-    //return ((ot_u8)mlx73_read(RFREG(STATUS1)) & 1) - 1;
+    //return ((ot_u8)mlx73.status1 & 1) - 1;
 
     ot_u8 status2E;
-    status2E    = mlx73_read(RFREG(STATUS1));
+    status2E    = mlx73.status1;
     status2E   &= ~(7<<2);
     return (status2E == (7<<2));
 }
@@ -533,11 +563,11 @@ void mlx73_init_bus() {
     ///   requirements of the other interrupts used by OpenTag
     sub_clear_irqs();
     
-    // Using Interrupt Priority 0,1 per OpenTag requirements
-    NVIC->IP[(uint32_t)(RADIO_IRQ0_IRQn)]       = b0001 << (8 - __NVIC_PRIO_BITS);
-    NVIC->IP[(uint32_t)(RADIO_IRQ1_IRQn)]       = b0001 << (8 - __NVIC_PRIO_BITS);
-    NVIC->IP[(uint32_t)(RADIO_IRQ2_IRQn)]       = b0001 << (8 - __NVIC_PRIO_BITS);
-    NVIC->IP[(uint32_t)(RADIO_IRQ3_IRQn)]       = b0001 << (8 - __NVIC_PRIO_BITS);
+    // Using PLATFORM_NVIC_RADIO (0,1), above MPipe and the kernel
+    NVIC->IP[(uint32_t)(RADIO_IRQ0_IRQn)]       = PLATFORM_NVIC_RADIO << (8 - __NVIC_PRIO_BITS);
+    NVIC->IP[(uint32_t)(RADIO_IRQ1_IRQn)]       = PLATFORM_NVIC_RADIO << (8 - __NVIC_PRIO_BITS);
+    NVIC->IP[(uint32_t)(RADIO_IRQ2_IRQn)]       = PLATFORM_NVIC_RADIO << (8 - __NVIC_PRIO_BITS);
+    NVIC->IP[(uint32_t)(RADIO_IRQ3_IRQn)]       = PLATFORM_NVIC_RADIO << (8 - __NVIC_PRIO_BITS);
     NVIC->ISER[((uint32_t)(RADIO_IRQ0_IRQn)>>5)]= (1 << ((uint32_t)(RADIO_IRQ0_IRQn) & 0x1F));
     NVIC->ISER[((uint32_t)(RADIO_IRQ1_IRQn)>>5)]= (1 << ((uint32_t)(RADIO_IRQ1_IRQn) & 0x1F));
     NVIC->ISER[((uint32_t)(RADIO_IRQ2_IRQn)>>5)]= (1 << ((uint32_t)(RADIO_IRQ2_IRQn) & 0x1F));
@@ -559,23 +589,8 @@ void mlx73_init_bus() {
     /// line after the TX command is done, and only a single DMA buffer is needed for
     /// both RX and TX.
 
-    RADIO_DMA_RXCHAN->CCR   =   DMA_DIR_PeripheralSRC       | \
-                                DMA_Mode_Normal             | \
-                                DMA_PeripheralInc_Disable   | \
-                                DMA_MemoryInc_Enable        | \
-                                DMA_PeripheralDataSize_Byte | \
-                                DMA_MemoryDataSize_Byte     | \
-                                DMA_Priority_VeryHigh       | \
-                                DMA_M2M_Disable;
-    
-    RADIO_DMA_TXCHAN->CCR   =   DMA_DIR_PeripheralDST       | \
-                                DMA_Mode_Circular           | \
-                                DMA_PeripheralInc_Disable   | \
-                                DMA_MemoryInc_Enable        | \
-                                DMA_PeripheralDataSize_Byte | \
-                                DMA_MemoryDataSize_Byte     | \
-                                DMA_Priority_VeryHigh       | \
-                                DMA_M2M_Disable;
+    RADIO_DMA_RXCHAN->CCR   = RADIO_DMA_RXCCR;
+    RADIO_DMA_TXCHAN->CCR   = RADIO_DMA_TXCCR;
     
     RADIO_DMA_RXCHAN->CPAR  = (ot_u32)&RADIO_SPI->DR;
     RADIO_DMA_TXCHAN->CPAR  = (ot_u32)&RADIO_SPI->DR;
@@ -601,44 +616,49 @@ void mlx73_spibus_wait() {
 
 
 ot_s8 mlx73_spibus_io(ot_u8 bank, ot_u8 cmd_len, ot_u8 resp_len, ot_u8* cmd, ot_u8* resp) {   
+    ot_u8 dummy;
+    
 #ifdef MLX73_DMA_BUFFER
     ///Still experimental, use with care
     ///DMA is recommended if: Desired SPI clock < (System Clock / 16)
-
-    /// Check to see if read/write is too big.  This is commented-out because my
-    /// driver never sends too much data at one time
-    //if ((cmd_len + resp_len) > MLX73_DMA_BUFFER) {
-    //    return -1;
-    //}
-
-    /// If you modify this function to be non-blocking, make sure to wait
-    //mlx73_spibus_wait();
-    
-    /// The Radio DMA's should be mostly configured via mlx73_init_bus().
-    /// What remains is to make the lengths correspond.
-    data[bank]             |= (resp_len != 0);  //Add read bit if required
-    RADIO_DMA->IFCR         = (RADIO_DMA_TXINT | RADIO_DMA_RXINT);
-    RADIO_DMA_TXCHAN->CNDTR = (ot_u16)cmd_len;
-    RADIO_DMA_RXCHAN->CNDTR = (ot_u16)(cmd_len + resp_len);
-    RADIO_DMA_TXCHAN->CMAR  = (ot_u32)data;
-    RADIO_DMA_RXCHAN->CMAR  = (ot_u32)data;
-    RADIO_DMA_TXCHAN->CCR  |= DMA_CCR1_EN;
-    RADIO_DMA_RXCHAN->CCR  |= DMA_CCR1_EN;
-    RADIO_SPI->CR2          = (SPI_I2S_DMAReq_Tx | SPI_I2S_DMAReq_Rx);
-    __SPI_CS_ON();
-    __SPI_ENABLE();
-    
-    //blocking: wait for RX to be done
-    while ((RADIO_DMA->ISR & RADIO_DMA_RXINT) == 0);
-    __SPI_CS_OFF();
-    __SPI_DISABLE();
-    RADIO_DMA_TXCHAN->CCR  &= ~DMA_CCR1_EN;
-    RADIO_DMA_RXCHAN->CCR  &= ~DMA_CCR1_EN;
     
-    return 0;
-
-#else
-    ot_u8 dummy;
+    /// Transfers that fit in the DMA buffer go by DMA, which is what the FIFO
+    /// bursts from radio_putbytes() and radio_getbytes() want.  Anything that
+    /// doesn't fit falls through to the CPU-driven transfer below.
+    if ((cmd_len + resp_len) <= MLX73_DMA_BUFFER) {
+        /// If you modify this function to be non-blocking, make sure to wait
+        //mlx73_spibus_wait();
+        
+        /// The Radio DMA's should be mostly configured via mlx73_init_bus().
+        /// What remains is to load the DMA buffer and make the lengths 
+        /// correspond.  RX lands in the same buffer, after the command.
+        platform_memcpy(__dma_buffer, cmd, cmd_len);
+        __dma_buffer[bank]     |= (resp_len != 0);  //Add read bit if required
+        RADIO_DMA->IFCR         = (RADIO_DMA_TXINT | RADIO_DMA_RXINT);
+        RADIO_DMA_TXCHAN->CNDTR = (ot_u16)cmd_len;
+        RADIO_DMA_RXCHAN->CNDTR = (ot_u16)(cmd_len + resp_len);
+        RADIO_DMA_TXCHAN->CMAR  = (ot_u32)__dma_buffer;
+        RADIO_DMA_RXCHAN->CMAR  = (ot_u32)__dma_buffer;
+        RADIO_DMA_TXCHAN->CCR  |= DMA_CCR1_EN;
+        RADIO_DMA_RXCHAN->CCR  |= DMA_CCR1_EN;
+        RADIO_SPI->CR2          = (SPI_I2S_DMAReq_Tx | SPI_I2S_DMAReq_Rx);
+        __SPI_CS_ON();
+        __SPI_ENABLE();
+        
+        //blocking: wait for RX to be done
+        while ((RADIO_DMA->ISR & RADIO_DMA_RXINT) == 0);
+        __SPI_CS_OFF();
+        __SPI_DISABLE();
+        RADIO_DMA_TXCHAN->CCR  &= ~DMA_CCR1_EN;
+        RADIO_DMA_RXCHAN->CCR  &= ~DMA_CCR1_EN;
+        RADIO_SPI->CR2          = 0;
+        
+        if (resp_len != 0) {
+            platform_memcpy(resp, &__dma_buffer[cmd_len], resp_len);
+        }
+        return 0;
+    }
+#endif
     
     /// Put read bit high if required
     /// This needs to be in an "if" so that static memory can be used to write.
@@ -673,7 +693,98 @@ ot_s8 mlx73_spibus_io(ot_u8 bank, ot_u8 cmd_len, ot_u8 resp_len, ot_u8* cmd, ot_
     __SPI_DISABLE();
     
     return 0;
+}
+
+
+/** FIFO bursts <BR>
+  * ============================================================================
+  * The FIFO register does not auto-increment, so a burst is the address byte
+  * and then the data, which goes straight between the SPI and the caller's 
+  * buffer (no copy, and no length limit from the DMA buffer).
+  */
+#ifdef MLX73_DMA_BUFFER
+static ot_u8 fifo_dummy;
+
+void sub_fifo_dma(ot_u8 addr, ot_u8* data, ot_u8 length, ot_bool write) {
+/// The address byte goes out by CPU, then both channels run for the data.  On
+/// a write, the RX channel drains the SPI into a dummy byte, and on a read, 
+/// the TX channel clocks-out a dummy byte.  The channels are put back the way
+/// mlx73_spibus_io() wants them.
+    ot_u8 rxbyte;
+    
+    RADIO_DMA_TXCHAN->CCR   = RADIO_DMA_FIFOCCR | DMA_DIR_PeripheralDST | \
+                                ((write) ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable);
+    RADIO_DMA_RXCHAN->CCR   = RADIO_DMA_FIFOCCR | DMA_DIR_PeripheralSRC | \
+                                ((write) ? DMA_MemoryInc_Disable : DMA_MemoryInc_Enable);
+    RADIO_DMA_TXCHAN->CMAR  = (write) ? (ot_u32)data : (ot_u32)&fifo_dummy;
+    RADIO_DMA_RXCHAN->CMAR  = (write) ? (ot_u32)&fifo_dummy : (ot_u32)data;
+    RADIO_DMA_TXCHAN->CNDTR = (ot_u16)length;
+    RADIO_DMA_RXCHAN->CNDTR = (ot_u16)length;
+    RADIO_DMA->IFCR         = (RADIO_DMA_TXINT | RADIO_DMA_RXINT);
+    fifo_dummy              = 0;
+    
+    __SPI_CS_ON();
+    __SPI_ENABLE();
+    __SPI_PUT(addr);
+    while ((RADIO_SPI->SR & SPI_I2S_FLAG_RXNE) == 0);
+    __SPI_GET(rxbyte);
+    
+    RADIO_DMA_RXCHAN->CCR  |= DMA_CCR1_EN;
+    RADIO_DMA_TXCHAN->CCR  |= DMA_CCR1_EN;
+    RADIO_SPI->CR2          = (SPI_I2S_DMAReq_Tx | SPI_I2S_DMAReq_Rx);
+    
+    //blocking: wait for RX to be done
+    while ((RADIO_DMA->ISR & RADIO_DMA_RXINT) == 0);
+    __SPI_CS_OFF();
+    __SPI_DISABLE();
+    RADIO_SPI->CR2          = 0;
+    RADIO_DMA_TXCHAN->CCR   = RADIO_DMA_TXCCR;
+    RADIO_DMA_RXCHAN->CCR   = RADIO_DMA_RXCCR;
+}
 #endif
+
+void sub_fifo_cpu(ot_u8 addr, ot_u8* data, ot_u8 length, ot_bool write) {
+    ot_u8 rxbyte;
+    
+    __SPI_CS_ON();
+    __SPI_ENABLE();
+    while ((RADIO_SPI->SR & SPI_I2S_FLAG_TXE) == 0);
+    __SPI_PUT(addr);
+    while ((RADIO_SPI->SR & SPI_I2S_FLAG_RXNE) == 0);
+    __SPI_GET(rxbyte);
+    
+    for (; length != 0; length--, data++) {
+        while ((RADIO_SPI->SR & SPI_I2S_FLAG_TXE) == 0);
+        __SPI_PUT( (write) ? *data : 0 );
+        while ((RADIO_SPI->SR & SPI_I2S_FLAG_RXNE) == 0);
+        __SPI_GET(rxbyte);
+        if (write == False) {
+            *data = rxbyte;
+        }
+    }
+    
+    __SPI_CS_OFF();
+    __SPI_DISABLE();
+}
+
+void mlx73_fifo_read(ot_u8* data, ot_u8 length) {
+#   ifdef MLX73_DMA_BUFFER
+    if (length >= MLX73_DMA_FIFOMIN) {
+        sub_fifo_dma((RFREG(RXFIFORD) | 1), data, length, False);
+        return;
+    }
+#   endif
+    sub_fifo_cpu((RFREG(RXFIFORD) | 1), data, length, False);
+}
+
+void mlx73_fifo_write(ot_u8* data, ot_u8 length) {
+#   ifdef MLX73_DMA_BUFFER
+    if (length >= MLX73_DMA_FIFOMIN) {
+        sub_fifo_dma(RFREG(TXFIFOWR), data, length, True);
+        return;
+    }
+#   endif
+    sub_fifo_cpu(RFREG(TXFIFOWR), data, length, True);
 }
 
 
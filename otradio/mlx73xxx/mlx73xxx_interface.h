@@ -38,8 +38,15 @@
 
 ///Comment this if not using the SPI DMA (experimental)
 ///You can give it a value to correspond the amount of bytes the buffer will have
+///FIFO bursts do not use the buffer: the DMA moves them in place
 //#define MLX73_DMA_BUFFER	16
 
+///FIFO bursts of at least this many bytes go through the DMA (if enabled).
+///Shorter ones cost less with the CPU than with setting-up two DMA channels.
+#ifndef MLX73_DMA_FIFOMIN
+#   define MLX73_DMA_FIFOMIN    8
+#endif
+
 
 
 
@@ -65,6 +72,7 @@ typedef struct {
 //    ot_u8 rfstatus[2];
 //    ot_u8 lfstatus;         //lf not currently implemented
     MLX73_IMode imode;     
+    ot_u8 status1;          //STATUS1 from the last mlx73_rxstatus()
     //ot_u8 burstbuf[6];    //only needed if you use burstwrite functions (they aren't used)
 } mlx73_struct;
 
@@ -132,6 +140,26 @@ ot_u8 mlx73_iostatus();
 ot_u8 mlx73_pwrstatus();
 
 
+/** @brief  Reads the RX FIFO count, and latches STATUS1 for mlx73_check_crc()
+  * @param  None
+  * @retval ot_u8       RXFIFOCNT register value
+  * @ingroup MLX73xxx
+  *
+  * STATUS1, STATUS0, TXFIFOCNT and RXFIFOCNT are consecutive registers, so 
+  * they are read in one burst.  The RX data ISR's need the FIFO count anyway,
+  * so the CRC status comes along without a transfer of its own.
+  */
+ot_u8 mlx73_rxstatus();
+
+
+/** @brief  Checks the CRC status latched by mlx73_rxstatus()
+  * @param  None
+  * @retval ot_u8       0 when the CRC is good
+  * @ingroup MLX73xxx
+  */
+ot_u8 mlx73_check_crc();
+
+
 
 /** @brief  Returns an 8bit random number from the onboard RNG
   * @param  None
@@ -221,6 +249,31 @@ ot_s8 mlx73_spibus_io(ot_u8 bank, ot_u8 cmd_len, ot_u8 resp_len, ot_u8* cmd, ot_
 
 
 
+/** @brief  Burst-reads bytes from the RX FIFO
+  * @param  data        (ot_u8*) where to put the bytes
+  * @param  length      (ot_u8) number of bytes to read
+  * @retval None
+  * @ingroup MLX73xxx
+  *
+  * The FIFO address does not increment, so a burst is one address byte and
+  * then the data.  The data goes directly into the buffer: by DMA when the 
+  * radio DMA's are enabled (MLX73_DMA_BUFFER) and the burst is at least 
+  * MLX73_DMA_FIFOMIN bytes, else by CPU.
+  */
+void mlx73_fifo_read(ot_u8* data, ot_u8 length);
+
+
+/** @brief  Burst-writes bytes to the TX FIFO
+  * @param  data        (ot_u8*) bytes to write (not clobbered)
+  * @param  length      (ot_u8) number of bytes to write
+  * @retval None
+  * @ingroup MLX73xxx
+  * @sa mlx73_fifo_read()
+  */
+void mlx73_fifo_write(ot_u8* data, ot_u8 length);
+
+
+
 
 /** @brief  Reads one byte of data from an unbanked, addressed register
   * @param  addr        (ot_u8) Register address (must be shifted)
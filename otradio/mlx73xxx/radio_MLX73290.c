@@ -51,6 +51,8 @@
 #include "queue.h"
 #include "veelite.h"
 #include "session.h"
+#include "system.h"
+#include "m2_network.h"     // M2AdvP flood frames
 
 #include "mlx73xxx_interface.h"
 
@@ -132,6 +134,7 @@
   * Described in radio.h -- This driver only supports M2_PARAM_MI_CHANNELS = 1.
   */
 phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
+rm2_stamp_struct rm2_stamp;
 
 
 /** Radio Module Data <BR>
@@ -194,6 +197,7 @@ ot_bool sub_channel_lookup(ot_u8 chan_id, vlFILE* fp);
 void    sub_syncword_config(Sync_Class sync_class);
 void    sub_buffer_config(ot_u8 mode, ot_u8 param);
 void    sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp);
+void    sub_phy_timing(ot_u8 chan_id);
 
 ot_int  sub_check_crc();
 void    sub_set_txpower(ot_u8 eirp_code);
@@ -281,6 +285,17 @@ void radio_calibrate() {
 }
 
 
+#if (OT_FEATURE(RFCAL) == ENABLED)
+void radio_recalibrate() {
+/// There is no cache of results on this radio, so the VCO is calibrated for
+/// the channel it is on, and the radio goes back to sleep.
+    radio_idle();
+    radio_calibrate();
+    radio_sleep();
+}
+#endif
+
+
 
 
 
@@ -306,6 +321,7 @@ void radio_init( ) {
         vlFILE* fp          = ISF_open_su( ISF_ID(channel_configuration) );        
         phymac[0].channel   = 0x55;         // 55=invalid, forces calibration.
         phymac[0].tx_eirp   = 0x00;         // initialized to zero
+        sub_phy_timing(0x55);
         radio.state         = 0;            // (idle)
         radio.evtdone       = &otutils_sig2_null;
         
@@ -350,28 +366,47 @@ void radio_putbyte(ot_u8 databyte) {
 }
 
 void radio_putfourbytes(ot_u8* data) {
-    ot_u8 tx_buf[5];
-    tx_buf[0]   = RFREG(TXFIFOWR);
-    tx_buf[1]   = data[B3];
-    tx_buf[2]   = data[B2];
-    tx_buf[3]   = data[B1];
-    tx_buf[4]   = data[B0];
-    
-    mlx73_spibus_io(0, 5, 0, tx_buf, NULL);
+    mlx73_fifo_write(data, 4);
     radio.fifoest += 4;
 }
 
+ot_int radio_putbytes(ot_u8* data, ot_int limit) {
+/// Fills all the room in the FIFO with one burst (see mlx73_fifo_write())
+    ot_int room;
+    room = RADIO_BUFFER_TXMAX - radio.fifoest;
+    if (room > limit) {
+        room = limit;
+    }
+    if (room > 0) {
+        mlx73_fifo_write(data, (ot_u8)room);
+        radio.fifoest += room;
+        return room;
+    }
+    return 0;
+}
+
 ot_u8 radio_getbyte() {
     radio.fifoest--;
     return mlx73_read( RFREG(RXFIFORD) );
 }
 
 void radio_getfourbytes(ot_u8* data) {
-    ot_u8 addr = RFREG(RXFIFORD);
-    mlx73_spibus_io(0, 1, 4, &addr, data);
+    mlx73_fifo_read(data, 4);
     radio.fifoest -= 4;
 }
 
+ot_int radio_getbytes(ot_u8* data, ot_int limit) {
+/// Drains all that is in the FIFO with one burst (see mlx73_fifo_read())
+    ot_int ready;
+    ready = (radio.fifoest < limit) ? radio.fifoest : limit;
+    if (ready > 0) {
+        mlx73_fifo_read(data, (ot_u8)ready);
+        radio.fifoest -= ready;
+        return ready;
+    }
+    return 0;
+}
+
 
 
 void radio_flush_rx() {
@@ -541,27 +576,14 @@ ot_int rm2_default_tgd(ot_u8 chan_id) {
 ot_int rm2_pkt_duration(ot_int pkt_bytes) {
 /// Wrapper function for rm2_scale_codec that adds some slop overhead
 /// Slop = preamble bytes + sync bytes + ramp-up + ramp-down + padding
-    pkt_bytes  += RADIO_PKT_OVERHEAD + 2;
-    pkt_bytes  += ((phymac[0].channel & 0x60) != 0) << 1; 
-    return rm2_scale_codec(pkt_bytes);
+    return rm2_scale_codec(pkt_bytes + phymac[0].tpad);
 }
 
 ot_int rm2_scale_codec(ot_int buf_bytes) {
 /// Turns a number of bytes (buf_bytes) into a number of tick (ti) units.
 /// To refresh your memory: 1 ti = ((1sec/32768) * 2^5) = 2^-10 sec = ~0.977 ms.
-/// Pursuant to DASH7 Mode 2 spec, b6:4 of channel ID corresponds to kS/s.
-/// 55.555 kS/s = 144us per buffer byte
-/// 200.00 kS/s = 40us per buffer bytes
-    buf_bytes *= (phymac[0].channel & 0x60) ? 40 : 144;
-    
-    /// Divide us into Ticks (shift right 10 = divide by 1024)
-#   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) == ENABLED))     
-        buf_bytes >>= (10 - ((phymac[0].channel & 0x80) != 0) );
-#   else
-        buf_bytes >>= 10;
-#   endif
-
-    return buf_bytes;
+/// phymac[0].tscale is the byte air time in 1/256 ti (see sub_phy_timing()).
+    return (buf_bytes * phymac[0].tscale) >> 8;
 }
 
 
@@ -706,12 +728,15 @@ void rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback) {
 void rm2_rxsync_isr() {
 /// Reset the radio interruptor to catch the next RX FIFO interrupt, having 
 /// qualified the Sync Word.  rm2_rxdata_isr() will be called on that interrupt.
+    rm2_stamp.rxsync = platform_stamp();
+    SYS_PROFILE_ISR_START();
     if (sub_killonlowrssi() == False) {
         sys_set_mutex(SYS_MUTEX_RADIO_DATA);
         //sys_quit_rf();
         mlx73_iocfg_rxdata();
         mlx73_intcfg_rxdata();
     }
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXSYNC);
 }
 
 
@@ -724,13 +749,26 @@ void rm2_rxtimeout_isr() {
 
 
 void rm2_rxdata_isr() { 
+    SYS_PROFILE_ISR_START();
 #if (SYS_RECEIVE == ENABLED)
-    if ( sub_killonlowrssi() ) 
+    if ( sub_killonlowrssi() ) {
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
         return;
+    }
     
-    radio.fifoest = mlx73_read(RFREG(RXFIFOCNT));
+    radio.fifoest = mlx73_rxstatus();
     em2_decode_data(); // Loads from FIFO & Contains logic to prevent over-run
     
+#   if (M2_FEATURE(RXFILTER) == ENABLED)
+    // Kill RX as soon as the header shows the frame is for another subnet or
+    // device (see sys_rxfilter())
+    if (sys_rxfilter() == False) {
+        sub_kill(RM2_ERR_LINK, 0);
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+        return;
+    }
+#   endif
+    
     switch ((radio.state >> RADIO_STATE_RXSHIFT) & (RADIO_STATE_RXMASK >> RADIO_STATE_RXSHIFT)) {
     
         /// RX State 0: Multiframe packets
@@ -748,16 +786,18 @@ void rm2_rxdata_isr() {
             else if (em2_remaining_bytes() == 0) {
                 /// @todo: I might require in the future that queue rebasing is
                 ///        done in the evtdone callback (gives more flexibility).
+                /// One status burst gets the frame CRC and the FIFO count of
+                /// the new frame (bytes that come in later are left for the
+                /// next interrupt).
+                radio.fifoest = mlx73_rxstatus();
                 radio.evtdone(frames_left, (ot_int)sub_check_crc() );            // arg 2 is negative on bad Frame CRC
                 
                 // Prepare the next frame by moving the "front" pointer and 
                 // re-initializing the decoder engine
-                q_rebase(&rxq, rxq.putcursor);
-                em2_decode_newframe();
+                em2_decode_nextframe();
                 
                 // Clear out what's leftover in the FIFO, from the new frame,
                 // and re-do boundary checks on this new frame.
-                radio.fifoest = mlx73_read(RFREG(RXFIFOCNT));
                 em2_decode_data(); 
                 goto rm2_rxpkt_MFP;
             }
@@ -798,13 +838,15 @@ void rm2_rxdata_isr() {
     }
       
 #endif
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
 }
 
 
 
 void rm2_rxend_isr() {
     ot_int kill_status;
-    radio.fifoest = mlx73_read(RFREG(RXFIFOCNT));
+    SYS_PROFILE_ISR_START();
+    radio.fifoest = mlx73_rxstatus();
     em2_decode_data(); // Loads from FIFO & Contains logic to prevent over-run
 
     if (radio.flags & RADIO_FLAG_ERROR) {
@@ -814,6 +856,7 @@ void rm2_rxend_isr() {
         kill_status = sub_check_crc();
     }
     sub_kill(0, kill_status );    
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXEND);
 }
 
 
@@ -827,6 +870,12 @@ void rm2_txinit_ff(ot_int est_frames, ot_sig2 callback) {
         radio.flags = 0;
 #   endif
     radio.evtdone   = callback;
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    if (phymac[0].tx_eirp != RM2_EIRP_AUTOSCALE(phymac[0].max_eirp)) {
+        phymac[0].tx_eirp = RM2_EIRP_AUTOSCALE(phymac[0].max_eirp);
+        sub_set_txpower(phymac[0].tx_eirp);
+    }
+#   endif
     txq.getcursor   = txq.front;
     txq.front[1]    = phymac[0].tx_eirp;
     sub_prep_q(&txq);
@@ -975,6 +1024,7 @@ ot_int rm2_txcsma() {
 
 
 void rm2_txdata_isr() {
+    SYS_PROFILE_ISR_START();
     /// Continues where rm2_txcsma() leaves off.
     switch ( (radio.state >> RADIO_STATE_TXSHIFT) & (RADIO_STATE_TXMASK >> RADIO_STATE_TXSHIFT) ) {
         
@@ -1002,14 +1052,15 @@ void rm2_txdata_isr() {
             /// If the frame is done, but more need to be sent (e.g. MFP's)
             /// queue it up.  The additional encode stage is there to fill up
             /// what's left of the buffer.
+            /// The buffer is filled before the callback runs, so the callback
+            /// does not widen the gap between the frames.
 #       if (M2_FEATURE(MULTIFRAME) == ENABLED)
             if (radio.flags & RADIO_FLAG_FRCONT) {
-                q_rebase(&txq, txq.getcursor);
-                radio.evtdone(1, 0);        //callback action for next frame
-                em2_encode_newframe();
+                em2_encode_nextframe();
                 txq.front[1] = phymac[0].tx_eirp;
                 radio.fifoest = mlx73_read(RFREG(TXFIFOCNT));
                 em2_encode_data();
+                radio.evtdone(1, 0);        //callback action for next frame
                 goto rm2_txpkt_TXDATA;
             }
 #       endif
@@ -1018,14 +1069,17 @@ void rm2_txdata_isr() {
         /// 5. Conclude the TX process, and wipe the radio state
         //     turn off any remaining TX interrupts
         case (RADIO_STATE_TXDONE >> RADIO_STATE_TXSHIFT): {
+            rm2_stamp.txend = platform_stamp();
 #       if (SYS_FLOOD == ENABLED)
             /// Packet flooding.  Only needed on devices that can send M2AdvP
+            /// The next frame is already prepared: load it, and then let
+            /// the callback prepare the one after it.
             if (radio.flags & RADIO_FLAG_FLOOD) {
-                radio.evtdone(2, 0);
-                txq.getcursor = txq.front;
+                m2advp_swap();
                 em2_encode_newpacket();
                 em2_encode_newframe();
                 em2_encode_data();
+                radio.evtdone(2, 0);
             }
             else
 #       endif
@@ -1039,6 +1093,7 @@ void rm2_txdata_isr() {
             sub_kill(RM2_ERR_GENERIC, 0);
             break;
     }
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_TXDATA);
 }
 
 
@@ -1270,11 +1325,15 @@ ot_bool sub_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
             ot_u8 old_tx_eirp   = phymac[0].tx_eirp;
 
             phymac[0].tg        = rm2_default_tgd(chan_id);
+            sub_phy_timing(chan_id);
             phymac[0].channel   = chan_id;
             phymac[0].autoscale = scratch.ubyte[1];
 
             scratch.ushort      = vl_read(fp, i+2);
-            phymac[0].tx_eirp   = AUTOSCALE_MASK(scratch.ubyte[0]);
+#           if (M2_FEATURE(AUTOSCALE) == ENABLED)
+            phymac[0].max_eirp  = scratch.ubyte[0];
+#           endif
+            phymac[0].tx_eirp   = RM2_EIRP_AUTOSCALE(scratch.ubyte[0]);
             phymac[0].link_qual = AUTOSCALE_MASK(scratch.ubyte[1]);
 
             scratch.ushort      = vl_read(fp, i+4);
@@ -1292,6 +1351,20 @@ ot_bool sub_channel_lookup(ot_u8 chan_id, vlFILE* fp) {
 
 
 
+void sub_phy_timing(ot_u8 chan_id) {
+/// Called when the channel is set: precomputes the PHY timing constants for
+/// rm2_scale_codec() and rm2_pkt_duration(), so those need no channel tests.
+    ot_u8 turbo         = ((chan_id & 0x60) != 0);
+    phymac[0].tscale    = turbo ? RM2_TSCALE_200 : RM2_TSCALE_55;
+    phymac[0].tpad      = RADIO_PKT_OVERHEAD + 2 + (turbo << 1);
+#   if ((M2_FEATURE(FEC) == ENABLED) && (RF_FEATURE(FEC) == ENABLED))
+    phymac[0].tscale  <<= ((chan_id & 0x80) != 0);
+#   endif
+}
+
+
+
+
 void sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp) {
 /// Called by sub_channel_lookup()
 /// Duty: perform channel setup and recalibration when moving from one channel
@@ -1442,6 +1515,7 @@ void sub_prep_q(Queue* q) {
 ot_int sub_check_crc() {
 ///Returns 0 when CRC passes
 ///MLX73 does not support FEC, so CRC on FEC packets needs to be done in SW.
+///The HW CRC status is the one latched by the last mlx73_rxstatus().
 #if ((M2_FEATURE(FEC_RX) == ENABLED) && (RF_FEATURE(CRC) == ENABLED))
     if (rxq.options.ubyte[LOWER]) {
         return crc_get();
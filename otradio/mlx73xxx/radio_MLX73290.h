@@ -68,11 +68,13 @@
 #define RF_FEATURE_LBFILTER             DISABLED                // Link Budget Filtering    DASH7-specific
 #define RF_FEATURE_SIDFILTER            DISABLED                // Session ID Filtering     DASH7-specific
 #define RF_FEATURE_ADDRFILTER           DISABLED                // Address Filtering        DASH7-specific
+#define RF_FEATURE_SUBNETFILTER         DISABLED                // Subnet HW Filtering      Moderate (BG frames)
 #define RF_FEATURE_PARSEFILTER          DISABLED                // Full Parse Filtering     DASH7-specific
 #define RF_FEATURE_MAC                  DISABLED                // Full Integrated MAC      DASH7-specific
 #define RF_FEATURE_AES128               DISABLED                // AES128 engine            Rare/None yet
 #define RF_FEATURE_ECC                  DISABLED                // ECC engine               Rare/None yet
 #define RF_FEATURE_ALGE                 DISABLED                // Algebraic Eraser engine  Rare/None yet
+#define RF_FEATURE_AUXRX                DISABLED                // Auxiliary RX radio       Rare (2nd transceiver)
 
 
 
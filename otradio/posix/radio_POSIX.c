@@ -0,0 +1,1558 @@
+/* Copyright 2009-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTradio/POSIX/radio_POSIX.c
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Simulated Radio Driver for POSIX hosts
+  * @defgroup   Radio (Radio Module)
+  * @ingroup    Radio
+  *
+  * The header file for this implementation is /OTlib/radio.h.  There is also
+  * a header file at /OTradio/POSIX/radio_POSIX.h that has the RF features.
+  *
+  * The "air" is a UDP multicast group.  Each frame is sent as one datagram
+  * when its transmission starts, with a header that carries the channel, the
+  * TX EIRP and the airtime of the frame.  Every node in the group receives
+  * it, and a node that is listening on the same channel runs the normal RX
+  * path: the sync interrupt (rm2_rxsync_isr) right away, and the data and end
+  * interrupts (rm2_rxdata_isr) after the airtime has passed.  So the kernel
+  * sees the same timing as it does with real radios.
+  *
+  * The channel model is simple, but it is enough for MAC benchmarking:
+  * - RSSI is the TX EIRP minus a path loss that is equal for all nodes.
+  * - A node is half duplex: it does not hear anything while it transmits.
+  * - Frames that overlap on the same center frequency collide.  The frame
+  *   being received fails its CRC, and the frame that arrived later is lost.
+  * - CCA sees a channel as busy while any frame is on the air on it.
+  *
+  * There is also an auxiliary receiver (RF_FEATURE_AUXRX), as on a gateway
+  * board with a second transceiver.  It has its own front end, so it hears
+  * the frames on its channel while the main radio transmits.
+  *
+  * In virtual time (platform_posix_sim()), the air is the simulator instead
+  * (see sim_POSIX.h).  It sends the start and the end of each frame, with the
+  * RSSI from the positions of the nodes, and it decides which frames are lost
+  * to collisions and which capture the receiver.  A frame that starts while
+  * another one is being received is then only energy on the channel.
+  ******************************************************************************
+  */
+
+#include "OT_types.h"
+#include "OT_config.h"
+#include "OT_utils.h"
+#include "OT_platform.h"
+
+#include "radio.h"
+#include "m2_encode.h"
+#include "crc16.h"
+#include "buffers.h"
+#include "queue.h"
+#include "veelite.h"
+#include "session.h"
+#include "system.h"
+#include "m2_network.h"     // M2AdvP flood frames
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+
+
+/** Packet overhead & slop, in bytes (same as CC430)
+  */
+#ifndef RADIO_PKT_OVERHEAD
+#   define RADIO_PKT_OVERHEAD   3
+#endif
+
+/** Frames held by the auxiliary receiver (power of 2)
+  */
+#ifndef RADIO_AUX_FRAMES
+#   define RADIO_AUX_FRAMES     4
+#endif
+
+#if (RADIO_AUX_FRAMES & (RADIO_AUX_FRAMES-1))
+#   error "RADIO_AUX_FRAMES must be a power of 2"
+#endif
+
+
+
+
+/** Internal Radio States
+  *
+  * b5:3        b2:0
+  * TX States   RX States
+  */
+#define RADIO_STATE_RXSHIFT     0
+#define RADIO_STATE_RXMASK      (3 << RADIO_STATE_RXSHIFT)
+#define RADIO_STATE_RXINIT      (4 << RADIO_STATE_RXSHIFT)
+#define RADIO_STATE_RXMFP       (0 << RADIO_STATE_RXSHIFT)
+#define RADIO_STATE_RXPAGE      (1 << RADIO_STATE_RXSHIFT)
+#define RADIO_STATE_RXAUTO      (2 << RADIO_STATE_RXSHIFT)
+#define RADIO_STATE_RXDONE      (3 << RADIO_STATE_RXSHIFT)
+
+#define RADIO_STATE_TXSHIFT     3
+#define RADIO_STATE_TXMASK      (7 << RADIO_STATE_TXSHIFT)
+#define RADIO_STATE_TXINIT      (1 << RADIO_STATE_TXSHIFT)
+#define RADIO_STATE_TXCCA1      (2 << RADIO_STATE_TXSHIFT)
+#define RADIO_STATE_TXCCA2      (3 << RADIO_STATE_TXSHIFT)
+#define RADIO_STATE_TXSTART     (4 << RADIO_STATE_TXSHIFT)
+#define RADIO_STATE_TXDATA      (5 << RADIO_STATE_TXSHIFT)
+#define RADIO_STATE_TXDONE      (6 << RADIO_STATE_TXSHIFT)
+
+/** Internal Radio Flags
+  * LISTEN is the receiver being on, RXFRAME is a frame being received, and
+  * CORRUPT marks that frame as collided.
+  */
+#define RADIO_FLAG_FRCONT       (1 << 0)
+#define RADIO_FLAG_FLOOD        (1 << 1)
+#define RADIO_FLAG_LISTEN       (1 << 5)
+#define RADIO_FLAG_RXFRAME      (1 << 6)
+#define RADIO_FLAG_CORRUPT      (1 << 7)
+
+
+
+
+/** PHY-MAC Array declaration
+  * Described in radio.h of the OTlib.
+  * This driver only supports M2_PARAM_MI_CHANNELS = 1.
+  */
+phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
+rm2_stamp_struct rm2_stamp;
+
+radio_posix_stats_struct radio_posix_stats;
+
+
+
+
+/** Simulated Air Frame
+  * One datagram on the multicast group.  The sender is the process ID, so a
+  * node can drop its own frames (multicast loopback is on).
+  */
+typedef struct {
+    ot_u32  sender;
+    ot_u8   channel;
+    ot_u8   eirp;
+    ot_u16  duration;           // airtime in ti
+    ot_u8   data[RADIO_BUFFER_TXMAX];
+} airframe_struct;
+
+#define AIRFRAME_HEADER     8
+
+
+
+
+/** Radio Module Data
+  * state       Radio State, used with multi-call functions (RX/TX)
+  * flags       A local store for usage flags
+  * evtdone     A callback that is used when RX or TX is completed (i.e. done)
+  * sock        multicast socket (the air)
+  * timer       radio event timer, for the airtime of frames
+  * group       multicast group address, for sending
+  * pid         process ID, to drop our own frames
+  * pathloss    path loss between all nodes (dB)
+  * rssi        RSSI of the frame being received, or the last one received
+  * rxsender    sender of the frame being received
+  * txlen       bytes in the TX buffer
+  * rxlen       bytes in the RX buffer
+  * rxcursor    read position in the RX buffer
+  * busy_until  end of the last frame heard on each center frequency (ti)
+  * busy_rssi   RSSI of the last frame heard on each center frequency
+  * queued      time the packet was queued for TX, for the simulator, or
+  *             SIM_NEVER after its first frame
+  * listen_start time the receiver was turned on
+  * tx          TX buffer, with the air frame header
+  * rxbuf[]     RX buffer
+  */
+typedef struct {
+    ot_u8   state;
+    ot_u8   flags;
+    ot_sig2 evtdone;
+    int     sock;
+    timer_t timer;
+    struct sockaddr_in group;
+    ot_u32  pid;
+    ot_int  pathloss;
+    ot_int  rssi;
+    ot_u32  rxsender;
+    ot_int  txlen;
+    ot_int  rxlen;
+    ot_int  rxcursor;
+    ot_u32  busy_until[16];
+    ot_int  busy_rssi[16];
+    ot_u32  queued;
+    ot_u32  listen_start;
+    airframe_struct tx;
+    ot_u8   rxbuf[RADIO_BUFFER_RXMAX];
+} radio_struct;
+
+radio_struct radio;
+
+
+
+
+/** Auxiliary Receiver Data
+  * The held frames are a ring.  The air ISR puts and rm2_auxrx_take() gets,
+  * so each index has one writer and the ring needs no lock.  The indices run
+  * free, and they are taken modulo the size.
+  *
+  * open        the receiver is on
+  * channel     channel it listens on
+  * put         next frame to be heard
+  * get         next frame to be taken
+  * frame[]     held frames: sender, channel, end of airtime (ti), RSSI, and
+  *             the collided flag, which works like RADIO_FLAG_CORRUPT
+  */
+#if (RF_FEATURE(AUXRX) == ENABLED)
+typedef struct {
+    ot_u32  sender;
+    ot_u32  end;
+    ot_int  rssi;
+    ot_int  length;
+    ot_u8   channel;
+    ot_u8   corrupt;
+    ot_u8   data[RADIO_BUFFER_RXMAX];
+} auxframe_struct;
+
+typedef struct {
+    ot_bool         open;
+    ot_u8           channel;
+    volatile ot_u8  put;
+    volatile ot_u8  get;
+    auxframe_struct frame[RADIO_AUX_FRAMES];
+} auxrx_struct;
+
+auxrx_struct auxrx;
+#endif
+
+
+
+
+/** Local Subroutine Prototypes  <BR>
+  * ========================================================================<BR>
+  */
+void    sub_kill(ot_int main_err, ot_int frame_err);
+void    sub_killonlowrssi();
+
+ot_bool sub_cca2();
+ot_bool sub_chan_scan( ot_bool (*scan_test)() );
+ot_bool sub_noscan();
+ot_bool sub_cca_scan();
+ot_int  sub_air_rssi();
+ot_bool sub_csma_init();
+ot_bool sub_nocsma_init();
+
+ot_u8   sub_chan_fc(ot_u8 chan_id);
+ot_bool sub_channel_lookup(ot_u8 chan_id);
+void    sub_phy_timing(ot_u8 chan_id);
+void    sub_prep_q(Queue* q);
+void    sub_offset_rxtimeout();
+
+void    sub_air_open();
+void    sub_air_isr(int signo);
+void    sub_timer_isr(int signo);
+void    sub_txframe();
+void    sub_report();
+void    sub_aux_hear(airframe_struct* frame, ot_int length, ot_u8 fc, ot_int rssi);
+void    sub_aux_end(sim_msg* event);
+void    sub_air_hear(airframe_struct* frame, ot_int length, ot_int rssi);
+void    sub_sim_air(int signo);
+void    sub_sim_report();
+void    sub_listen_stop();
+
+
+
+
+
+
+/** Simulated Air Interrupt Handlers  <BR>
+  * ========================================================================<BR>
+  */
+
+void sub_air_isr(int signo) {
+/// Datagram input (SIGIO)
+    static airframe_struct frame;
+    ssize_t bytes;
+
+    while ((bytes = recv(radio.sock, &frame, sizeof(airframe_struct), 0)) > 0) {
+        if ((bytes <= AIRFRAME_HEADER) || (frame.sender == radio.pid)) {
+            continue;
+        }
+        sub_air_hear(&frame, (ot_int)bytes - AIRFRAME_HEADER,
+                     (ot_int)((frame.eirp & 0x7F) >> 1) - 40 - radio.pathloss);
+    }
+}
+
+
+
+void sub_sim_air(int signo) {
+/// Frame events of the simulator.  The end of the frame being received is
+/// the data interrupt, and the simulator says if it was lost.
+    static airframe_struct frame;
+    sim_msg* event = platform_posix_simevent();
+
+    if (event == NULL) {
+        return;
+    }
+    if (event->type == SIM_MSG_END) {
+#       if (RF_FEATURE(AUXRX) == ENABLED)
+        sub_aux_end(event);
+#       endif
+        if ((radio.flags & RADIO_FLAG_RXFRAME) && (radio.rxsender == event->arg)) {
+            if (event->corrupt) {
+                radio.flags |= RADIO_FLAG_CORRUPT;
+                radio_posix_stats.rx_collisions++;
+            }
+            rm2_rxdata_isr();
+        }
+        return;
+    }
+
+    frame.sender    = event->arg;
+    frame.channel   = event->channel;
+    frame.eirp      = event->eirp;
+    frame.duration  = event->duration;
+    memcpy(frame.data, event->data, event->length);
+    sub_air_hear(&frame, (ot_int)event->length, (ot_int)event->rssi);
+}
+
+
+
+void sub_air_hear(airframe_struct* frame, ot_int length, ot_int rssi) {
+/// Every frame marks its center frequency as busy for its airtime.  Frames on
+/// our channel start an RX, if we are listening.
+    ot_u8 fc            = sub_chan_fc(frame->channel);
+    radio.busy_until[fc]= platform_posix_ticks() + frame->duration;
+    radio.busy_rssi[fc] = rssi;
+
+#   if (RF_FEATURE(AUXRX) == ENABLED)
+    sub_aux_hear(frame, length, fc, rssi);
+#   endif
+
+    /// Must be listening on the same center frequency and data rate
+    if (((radio.flags & RADIO_FLAG_LISTEN) == 0) \
+    ||  (fc != sub_chan_fc(phymac[0].channel)) \
+    ||  ((frame->channel ^ phymac[0].channel) & 0xE0)) {
+        return;
+    }
+
+    /// A frame is already coming in.  If it is from the same sender, it
+    /// is over (a sender sends one frame at a time, and back-to-back
+    /// frames only look like they overlap because of host latency), so
+    /// finish it first.  Otherwise both are lost.  In virtual time, the
+    /// simulator has the overlap already, and it tells at the end.
+    if (radio.flags & RADIO_FLAG_RXFRAME) {
+        if (platform_posix_sim()) {
+            return;
+        }
+        if (frame->sender != radio.rxsender) {
+            radio.flags |= RADIO_FLAG_CORRUPT;
+            radio_posix_stats.rx_collisions++;
+            return;
+        }
+        platform_posix_settimer(&radio.timer, -1);
+        rm2_rxdata_isr();
+        if ((radio.flags & RADIO_FLAG_LISTEN) == 0) {
+            return;
+        }
+    }
+
+    radio.rxlen     = length;
+    radio.rxcursor  = 0;
+    radio.rssi      = rssi;
+    radio.rxsender  = frame->sender;
+    radio.flags    |= RADIO_FLAG_RXFRAME;
+    memcpy(radio.rxbuf, frame->data, radio.rxlen);
+
+    /// Sync word now, the rest of the frame when its airtime is over
+    rm2_rxsync_isr();
+    if ((radio.flags & RADIO_FLAG_RXFRAME) && !platform_posix_sim()) {
+        platform_posix_settimer(&radio.timer, frame->duration);
+    }
+}
+
+
+
+#if (RF_FEATURE(AUXRX) == ENABLED)
+void sub_aux_hear(airframe_struct* frame, ot_int length, ot_u8 fc, ot_int rssi) {
+/// The auxiliary receiver holds every frame on its center frequency and data
+/// rate.  A frame that overlaps the last one from another sender collides
+/// with it, and both are lost.
+    auxframe_struct* held;
+    ot_u32 now;
+
+    if ((auxrx.open == False) \
+    ||  (fc != sub_chan_fc(auxrx.channel)) \
+    ||  ((frame->channel ^ auxrx.channel) & 0xE0)) {
+        return;
+    }
+
+    now = platform_posix_ticks();
+    if ((auxrx.put != auxrx.get) && !platform_posix_sim()) {
+        held = &auxrx.frame[(ot_u8)(auxrx.put-1) & (RADIO_AUX_FRAMES-1)];
+        if (((ot_s32)(held->end - now) > 0) && (held->sender != frame->sender)) {
+            held->corrupt = True;
+            radio_posix_stats.rx_collisions++;
+            return;
+        }
+    }
+    if ((ot_u8)(auxrx.put - auxrx.get) >= RADIO_AUX_FRAMES) {
+        radio_posix_stats.aux_drops++;
+        return;
+    }
+
+    held            = &auxrx.frame[auxrx.put & (RADIO_AUX_FRAMES-1)];
+    held->sender    = frame->sender;
+    held->end       = now + frame->duration;
+    held->rssi      = rssi;
+    held->length    = length;
+    held->channel   = frame->channel;
+    held->corrupt   = False;
+    memcpy(held->data, frame->data, length);
+    auxrx.put++;
+    radio_posix_stats.aux_frames++;
+}
+
+
+void sub_aux_end(sim_msg* event) {
+/// Virtual time: the frame from the sender that ends now is marked if the
+/// simulator says it was lost
+    ot_u8 i;
+
+    for (i=auxrx.get; i!=auxrx.put; i++) {
+        auxframe_struct* held = &auxrx.frame[i & (RADIO_AUX_FRAMES-1)];
+        if ((held->sender == event->arg) && (held->end == event->time)) {
+            held->corrupt = event->corrupt;
+            radio_posix_stats.rx_collisions += (event->corrupt != 0);
+        }
+    }
+}
+#endif
+
+
+
+void sub_timer_isr(int signo) {
+/// Radio event timer (frame airtime is over)
+    if (radio.flags & RADIO_FLAG_RXFRAME) {
+        rm2_rxdata_isr();
+    }
+    else if (radio.state & RADIO_STATE_TXMASK) {
+        rm2_txdata_isr();
+    }
+}
+
+
+
+
+
+
+/** Radio Core Control Functions
+  * ============================================================================
+  * The radio has no power states, only the receiver being on or off.
+  */
+
+void radio_off() {
+    radio_sleep();
+}
+
+
+void radio_gag() {
+    platform_posix_settimer(&radio.timer, -1);
+    sub_listen_stop();
+    radio.flags &= ~(RADIO_FLAG_LISTEN | RADIO_FLAG_RXFRAME | RADIO_FLAG_CORRUPT);
+}
+
+
+void radio_sleep() {
+    radio_idle();
+}
+
+
+void radio_idle() {
+    sub_listen_stop();
+    radio.flags &= ~RADIO_FLAG_LISTEN;
+}
+
+
+void sub_listen_stop() {
+/// Adds the time the receiver has been on.  It may be called again before
+/// the receiver is off, so the count starts over.
+    if (radio.flags & RADIO_FLAG_LISTEN) {
+        radio_posix_stats.listen_ti    += platform_posix_ticks() - radio.listen_start;
+        radio.listen_start              = platform_posix_ticks();
+    }
+}
+
+
+void radio_calibrate() {
+}
+
+
+#if (OT_FEATURE(RFCAL) == ENABLED)
+void radio_recalibrate() {
+/// The simulated synthesizer does not drift, so only the count is kept
+    radio_posix_stats.recals++;
+}
+#endif
+
+
+
+
+
+
+
+/** Radio Module Control Functions
+  * ============================================================================
+  */
+
+void radio_init( ) {
+    if (radio.pid == 0) {
+        sub_air_open();
+    }
+
+    /// Set incumbent channel to a completely invalid channel ID and run lookup
+    /// on the default channel (0x00) to kick things off.
+    phymac[0].channel   = 0x55;         // 55=invalid
+    phymac[0].tx_eirp   = 0x00;         // initialized to zero
+    sub_phy_timing(0x55);
+    radio.state         = 0;            // (idle)
+    radio.flags         = 0;
+    radio.evtdone       = &otutils_sig2_null;
+    radio.txlen         = 0;
+    radio.rxlen         = 0;
+    radio.rxcursor      = 0;
+    radio.rssi          = RADIO_POSIX_NOISEFLOOR;
+    radio.queued        = SIM_NEVER;
+#   if (RF_FEATURE(AUXRX) == ENABLED)
+    auxrx.open          = False;
+    auxrx.get           = auxrx.put;
+#   endif
+
+    sub_channel_lookup(0x00);
+}
+
+
+
+
+void sub_air_open() {
+/// Joins the multicast group, and installs the interrupt handlers.  SIGIO
+/// comes on every datagram (O_ASYNC).  In virtual time, the frame events of
+/// the simulator come on the same vector, and the radio timer is virtual.
+    struct sockaddr_in  local;
+    struct ip_mreq      mreq;
+    const char*         group;
+    char*               env;
+    int                 port;
+    int                 opt = 1;
+
+    if (platform_posix_sim()) {
+        radio.pid = platform_posix_nodeid();
+        platform_posix_timer(&radio.timer, RADIO_TIM_VECTOR);
+        platform_posix_isr(RADIO_TIM_VECTOR, &sub_timer_isr);
+        platform_posix_isr(RADIO_IRQ_VECTOR, &sub_sim_air);
+        atexit(&sub_sim_report);
+        if (getenv("OT_STATS") != NULL) {
+            atexit(&sub_report);
+        }
+        return;
+    }
+
+    group           = ((env = getenv("OT_GROUP")) != NULL) ? env : RADIO_POSIX_GROUP;
+    port            = ((env = getenv("OT_PORT")) != NULL) ? atoi(env) : RADIO_POSIX_PORT;
+    radio.pathloss  = ((env = getenv("OT_PATHLOSS")) != NULL) ? atoi(env) : RADIO_POSIX_PATHLOSS;
+    radio.pid       = (ot_u32)getpid();
+
+    radio.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (radio.sock < 0) {
+        perror("radio socket");
+        exit(1);
+    }
+    setsockopt(radio.sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#   ifdef SO_REUSEPORT
+    setsockopt(radio.sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+#   endif
+
+    memset(&local, 0, sizeof(local));
+    local.sin_family        = AF_INET;
+    local.sin_addr.s_addr   = htonl(INADDR_ANY);
+    local.sin_port          = htons((ot_u16)port);
+    if (bind(radio.sock, (struct sockaddr*)&local, sizeof(local)) < 0) {
+        perror("radio bind");
+        exit(1);
+    }
+
+    mreq.imr_multiaddr.s_addr   = inet_addr(group);
+    mreq.imr_interface.s_addr   = htonl(INADDR_ANY);
+    if (setsockopt(radio.sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("radio multicast");
+        exit(1);
+    }
+    setsockopt(radio.sock, IPPROTO_IP, IP_MULTICAST_LOOP, &opt, sizeof(opt));
+
+    radio.group             = local;
+    radio.group.sin_addr    = mreq.imr_multiaddr;
+
+    platform_posix_timer(&radio.timer, RADIO_TIM_VECTOR);
+    platform_posix_isr(RADIO_TIM_VECTOR, &sub_timer_isr);
+    platform_posix_isr(RADIO_IRQ_VECTOR, &sub_air_isr);
+
+    fcntl(radio.sock, F_SETOWN, getpid());
+    fcntl(radio.sock, F_SETFL, fcntl(radio.sock, F_GETFL) | O_NONBLOCK | O_ASYNC);
+
+    if (getenv("OT_STATS") != NULL) {
+        atexit(&sub_report);
+    }
+}
+
+
+
+
+void sub_sim_report() {
+/// The statistics go to the simulator when the node exits
+    sim_msg     msg;
+    sim_stats*  stats = (sim_stats*)msg.data;
+
+    sub_listen_stop();
+    stats->tx_frames        = radio_posix_stats.tx_frames;
+    stats->tx_bytes         = radio_posix_stats.tx_bytes;
+    stats->rx_frames        = radio_posix_stats.rx_frames;
+    stats->rx_bytes         = radio_posix_stats.rx_bytes;
+    stats->rx_crcerrs       = radio_posix_stats.rx_crcerrs;
+    stats->rx_collisions    = radio_posix_stats.rx_collisions;
+    stats->rx_weak          = radio_posix_stats.rx_weak;
+    stats->cca_busy         = radio_posix_stats.cca_busy;
+    stats->listen_ti        = radio_posix_stats.listen_ti;
+    stats->tx_ti            = radio_posix_stats.tx_ti;
+    msg.type                = SIM_MSG_STATS;
+    msg.time                = platform_posix_ticks();
+    msg.length              = sizeof(sim_stats);
+    platform_posix_simsend(&msg);
+}
+
+
+
+void sub_report() {
+    fprintf(stderr, "node %u: tx %u frames %u bytes, rx %u frames %u bytes, "
+                    "%u crc errors, %u collisions, %u weak, %u cca busy\n",
+            platform_posix_nodeid(),
+            radio_posix_stats.tx_frames,    radio_posix_stats.tx_bytes,
+            radio_posix_stats.rx_frames,    radio_posix_stats.rx_bytes,
+            radio_posix_stats.rx_crcerrs,   radio_posix_stats.rx_collisions,
+            radio_posix_stats.rx_weak,      radio_posix_stats.cca_busy);
+#   if (RF_FEATURE(AUXRX) == ENABLED)
+    fprintf(stderr, "node %u: aux rx %u frames, %u dropped\n",
+            platform_posix_nodeid(),
+            radio_posix_stats.aux_frames,   radio_posix_stats.aux_drops);
+#   endif
+#   if (OT_FEATURE(RFCAL) == ENABLED)
+    fprintf(stderr, "node %u: %u recalibrations\n",
+            platform_posix_nodeid(), radio_posix_stats.recals);
+#   endif
+}
+
+
+
+
+ot_bool radio_check_cca() {
+    ot_int thr  = (ot_int)phymac[0].cca_thr - 140;
+    ot_int rssi = sub_air_rssi();
+
+    return (ot_bool)(rssi < thr);
+}
+
+
+
+
+ot_int radio_rssi() {
+/// While listening, this is the RSSI on the channel.  Otherwise it is held at
+/// the RSSI of the last frame received, like the RSSI register of a real
+/// radio, for the link budget filter that runs after RX.
+    if ((radio.flags & (RADIO_FLAG_LISTEN | RADIO_FLAG_RXFRAME)) == RADIO_FLAG_LISTEN) {
+        return sub_air_rssi();
+    }
+    return radio.rssi;
+}
+
+
+
+
+ot_int sub_air_rssi() {
+/// RSSI of the last frame heard on the channel if it is still on the air,
+/// else the noise floor.
+    ot_u8 fc = sub_chan_fc(phymac[0].channel);
+
+    if ((ot_s32)(radio.busy_until[fc] - platform_posix_ticks()) > 0) {
+        return radio.busy_rssi[fc];
+    }
+    return RADIO_POSIX_NOISEFLOOR;
+}
+
+
+
+
+ot_u8 radio_buffer(ot_int index) {
+    return (index < radio.rxlen) ? radio.rxbuf[index] : 0;
+}
+
+
+
+
+void radio_putbyte(ot_u8 databyte) {
+    if (radio.txlen < RADIO_BUFFER_TXMAX) {
+        radio.tx.data[radio.txlen++] = databyte;
+    }
+}
+
+
+
+
+void radio_putfourbytes(ot_u8* data) {
+    radio_putbytes(data, 4);
+}
+
+
+
+
+ot_int radio_putbytes(ot_u8* data, ot_int limit) {
+    ot_int room;
+    room = RADIO_BUFFER_TXMAX - radio.txlen;
+    if (room > limit) {
+        room = limit;
+    }
+    if (room > 0) {
+        memcpy(&radio.tx.data[radio.txlen], data, room);
+        radio.txlen += room;
+        return room;
+    }
+    return 0;
+}
+
+
+
+
+ot_u8 radio_getbyte() {
+    return (radio.rxcursor < radio.rxlen) ? radio.rxbuf[radio.rxcursor++] : 0;
+}
+
+
+
+
+void radio_getfourbytes(ot_u8* data) {
+    ot_int i;
+    for (i=0; i<4; i++) {
+        data[i] = radio_getbyte();
+    }
+}
+
+
+
+
+ot_int radio_getbytes(ot_u8* data, ot_int limit) {
+    ot_int ready;
+    ready = radio.rxlen - radio.rxcursor;
+    if (ready > limit) {
+        ready = limit;
+    }
+    if (ready > 0) {
+        memcpy(data, &radio.rxbuf[radio.rxcursor], ready);
+        radio.rxcursor += ready;
+        return ready;
+    }
+    return 0;
+}
+
+
+
+
+void radio_flush_rx() {
+    radio.rxlen     = 0;
+    radio.rxcursor  = 0;
+}
+
+
+
+
+void radio_flush_tx() {
+    radio.txlen = 0;
+}
+
+
+
+
+void radio_posix_loopback() {
+    radio.rxlen     = (radio.txlen < RADIO_BUFFER_RXMAX) ? radio.txlen : RADIO_BUFFER_RXMAX;
+    radio.rxcursor  = 0;
+    memcpy(radio.rxbuf, radio.tx.data, radio.rxlen);
+}
+
+
+
+ot_bool radio_rxopen() {
+    return (ot_bool)(radio.rxcursor < radio.rxlen);
+}
+
+
+
+
+ot_bool radio_rxopen_4() {
+    return (ot_bool)((radio.rxcursor + 4) <= radio.rxlen);
+}
+
+
+
+
+ot_bool radio_txopen() {
+    return (ot_bool)(radio.txlen < RADIO_BUFFER_TXMAX);
+}
+
+
+
+ot_bool radio_txopen_4() {
+    return (ot_bool)(radio.txlen < (RADIO_BUFFER_TXMAX-4));
+}
+
+
+
+
+
+
+
+
+
+/** Radio I/O Functions
+  * ============================================================================
+  */
+
+ot_bool sub_test_channel(ot_u8 channel, ot_u8 netstate) {
+#if (SYS_RECEIVE == ENABLED)
+    ot_bool test = True;
+
+    if ((channel != phymac[0].channel) || (netstate == M2_NETSTATE_UNASSOC)) {
+        /// Make sure the channel we want to use is in the channel list
+        test = sub_channel_lookup(channel);
+    }
+
+    return test;
+#else
+    return True;
+#endif
+}
+
+
+
+#if (SYS_RECEIVE == ENABLED)
+void subposix_launch_rx() {
+    sub_prep_q(&rxq);
+    em2_decode_newpacket();
+    em2_decode_newframe();
+    sub_offset_rxtimeout();     // if timeout is 0, set it to a minimal amount
+    if ((radio.flags & RADIO_FLAG_LISTEN) == 0) {
+        radio.listen_start = platform_posix_ticks();
+    }
+    radio.flags |= RADIO_FLAG_LISTEN;
+}
+#endif
+
+
+#if (RF_FEATURE(AUXRX) == ENABLED)
+void rm2_auxrx_open(ot_u8 channel) {
+    auxrx.channel   = channel;
+    auxrx.open      = True;
+}
+
+
+
+void rm2_auxrx_close() {
+/// Only the last frame can still be on the air.  The air ISR puts nothing
+/// once open is False, so it is safe to drop it here.
+    auxrx.open = False;
+    if (auxrx.put != auxrx.get) {
+        auxframe_struct* held;
+        held = &auxrx.frame[(ot_u8)(auxrx.put-1) & (RADIO_AUX_FRAMES-1)];
+        if ((ot_s32)(held->end - platform_posix_ticks()) > 0) {
+            auxrx.put--;
+        }
+    }
+}
+
+
+
+ot_bool rm2_auxrx_take() {
+/// The frame goes through the RX buffer of the main radio, and it is decoded
+/// in one pass, as in rm2_rxdata_isr().
+    auxframe_struct* held;
+    ot_int frame_err;
+
+    while (auxrx.get != auxrx.put) {
+        held = &auxrx.frame[auxrx.get & (RADIO_AUX_FRAMES-1)];
+        if ((ot_s32)(held->end - platform_posix_ticks()) > 0) {
+            break;
+        }
+        if (held->corrupt) {
+            held->data[held->length-1] ^= 0xFF;
+        }
+        memcpy(radio.rxbuf, held->data, held->length);
+        radio.rxlen     = held->length;
+        radio.rxcursor  = 0;
+        radio.rssi      = held->rssi;
+        q_empty(&rxq);
+        rxq.options.ubyte[LOWER]    = (held->channel & 0x80);
+        rxq.options.ubyte[UPPER]    = 1;
+        auxrx.get++;
+
+        em2_decode_newpacket();
+        em2_decode_newframe();
+        em2_decode_data();
+
+        frame_err = (ot_int)crc_check() - 1;
+        radio_posix_stats.rx_frames++;
+        radio_posix_stats.rx_bytes     += radio.rxlen;
+        radio_posix_stats.rx_crcerrs   += (frame_err != 0);
+        if (frame_err == 0) {
+            return True;
+        }
+    }
+    return False;
+}
+#endif
+
+
+
+
+ot_int rm2_default_tgd(ot_u8 chan_id) {
+#if ((M2_FEATURE(FEC) == DISABLED) && (M2_FEATURE(TURBO) == DISABLED))
+    return M2_TGD_55FULL;
+
+#elif ((M2_FEATURE(FEC) == DISABLED) && (M2_FEATURE(TURBO) == ENABLED))
+    return (chan_id & 0x60) ? M2_TGD_200FULL : M2_TGD_55FULL;
+
+#elif ((M2_FEATURE(FEC) == ENABLED) && (M2_FEATURE(TURBO) == DISABLED))
+    return (chan_id & 0x80) ? M2_TGD_55FULL : M2_TGD_55HALF;
+
+#elif ((M2_FEATURE(FEC) == ENABLED) && (M2_FEATURE(TURBO) == ENABLED))
+    static const ot_int tgd[4] = {
+        M2_TGD_55FULL,
+        M2_TGD_200FULL,
+        M2_TGD_55HALF,
+        M2_TGD_200HALF
+    };
+
+    chan_id    += 0x20;
+    chan_id   >>= 6;
+
+    return tgd[chan_id];
+
+#else
+#   error "Missing definitions of M2_FEATURE(FEC) and/or M2_FEATURE(TURBO)"
+    return 0;
+#endif
+}
+
+
+
+
+
+ot_int rm2_pkt_duration(ot_int pkt_bytes) {
+/// Wrapper function for rm2_scale_codec that adds some slop overhead
+/// Slop = preamble bytes + sync bytes + ramp-up + ramp-down + padding
+    return rm2_scale_codec(pkt_bytes + phymac[0].tpad);
+}
+
+ot_int rm2_scale_codec(ot_int buf_bytes) {
+/// Turns a number of bytes (buf_bytes) into a number of ti units.
+/// phymac[0].tscale is the byte air time in 1/256 ti (see sub_phy_timing()).
+/// A FEC frame is up to 512 buffer bytes, so the product needs 32 bits.
+    return (ot_int)(((ot_long)buf_bytes * phymac[0].tscale) >> 8);
+}
+
+
+
+void rm2_prep_resend() {
+	txq.options.ubyte[UPPER] = 255;
+}
+
+
+void rm2_kill() {
+    sub_kill(RM2_ERR_KILL, 0);
+}
+
+
+
+void rm2_rxinit_ff(ot_u8 channel, ot_u8 netstate, ot_int est_frames, ot_sig2 callback) {
+#if (SYS_RECEIVE == ENABLED)
+    sub_listen_stop();
+    radio.evtdone   = callback;
+#   if (M2_FEATURE(MULTIFRAME) == ENABLED)
+        radio.flags = (est_frames > 1); //sets RADIO_FLAG_FRCONT
+#   else
+        radio.flags = 0;
+#   endif
+
+    /// Make sure channel is supported.  If not, stop now.
+    if (sub_test_channel(channel, netstate) == False) {
+        radio.evtdone(RM2_ERR_BADCHANNEL, 0);
+    }
+    else {
+        q_empty(&rxq);
+        radio_flush_rx();
+        radio.state = RADIO_STATE_RXAUTO;
+        subposix_launch_rx();
+    }
+
+#else
+    // BLINKER only (no RX)
+    callback(RM2_ERR_GENERIC, 0);
+#endif
+}
+
+
+
+
+
+void rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback) {
+#if (SYS_RECEIVE == ENABLED)
+    sub_listen_stop();
+    radio.state     = RADIO_STATE_RXDONE;
+    radio.flags     = RADIO_FLAG_FLOOD;
+    radio.evtdone   = callback;
+
+    /// Make sure channel is supported.  If not, stop now.
+    if (sub_test_channel(channel, M2_NETSTATE_UNASSOC) == False) {
+        radio.evtdone(RM2_ERR_BADCHANNEL, 0);
+    }
+    else {
+        ot_u8 pktlen = 7;
+
+        /// Queue manipulation to fit background frame into common model
+        q_empty(&rxq);
+        rxq.length      = pktlen + 2;
+        rxq.front[0]    = pktlen;
+        rxq.front[1]    = 0;
+        rxq.getcursor   = &rxq.front[2];
+        rxq.putcursor   = &rxq.front[2];
+
+        radio_flush_rx();
+        subposix_launch_rx();
+    }
+
+#else
+    // BLINKER only (no RX)
+    callback(RM2_ERR_GENERIC, 0);
+#endif
+}
+
+
+
+
+void rm2_rxsync_isr() {
+/// The frame has started.  rm2_rxdata_isr() comes when it has ended.  The
+/// mutex makes the kernel wait for it instead of timing out the RX.
+    rm2_stamp.rxsync = platform_stamp();
+    SYS_PROFILE_ISR_START();
+    sys_set_mutex((ot_uint)SYS_MUTEX_RADIO_DATA);
+    sub_killonlowrssi();
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXSYNC);
+}
+
+
+
+void rm2_rxtimeout_isr() {
+    sub_kill(RM2_ERR_TIMEOUT, 0);
+}
+
+
+
+
+void rm2_rxdata_isr() {
+/// The whole frame is in the RX buffer, so it can be decoded in one pass.
+    SYS_PROFILE_ISR_START();
+#if (SYS_RECEIVE == ENABLED)
+    radio_posix_stats.rx_frames++;
+    radio_posix_stats.rx_bytes += radio.rxlen;
+
+    /// A collided frame is damaged at the end, so its CRC fails
+    if (radio.flags & RADIO_FLAG_CORRUPT) {
+        radio.rxbuf[radio.rxlen-1] ^= 0xFF;
+    }
+
+    /// Background frames are constant length, so they take the short path
+    if (radio.flags & RADIO_FLAG_FLOOD) {
+        ot_int frame_err = em2_decode_bf();
+        radio_posix_stats.rx_crcerrs += (frame_err != 0);
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+        sub_kill(0, frame_err);
+        return;
+    }
+
+    em2_decode_data();
+
+    /// The whole frame is in, but the early filter is run as on a real radio
+#   if (M2_FEATURE(RXFILTER) == ENABLED)
+    if (sys_rxfilter() == False) {
+        sub_kill(RM2_ERR_LINK, 0);
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+        return;
+    }
+#   endif
+
+    /// Multiframe packets: each frame is one datagram.  Page out this one and
+    /// wait for the next.
+#   if (M2_FEATURE(MULTIFRAME) == ENABLED)
+    if ((radio.flags & RADIO_FLAG_FRCONT) && (em2_remaining_frames() != 0)) {
+        ot_int frames_left = em2_remaining_frames();
+        ot_int frame_err   = (ot_int)crc_check() - 1;
+
+        radio_posix_stats.rx_crcerrs += (frame_err != 0);
+        radio.flags &= ~(RADIO_FLAG_RXFRAME | RADIO_FLAG_CORRUPT);
+        radio.evtdone(frames_left, frame_err);
+        em2_decode_nextframe();
+        radio_flush_rx();
+        SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+        return;
+    }
+#   endif
+
+    /// RX-done is its own interrupt on a real radio, so it is profiled apart
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+    rm2_rxend_isr();
+#else
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
+#endif
+}
+
+
+
+void rm2_rxend_isr() {
+    ot_int frame_err;
+    SYS_PROFILE_ISR_START();
+    frame_err = (ot_int)crc_check() - 1;
+    radio_posix_stats.rx_crcerrs += (frame_err != 0);
+    sub_kill(0, frame_err);
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXEND);
+}
+
+
+
+
+void rm2_txinit_ff(ot_int est_frames, ot_sig2 callback) {
+    sub_listen_stop();
+    radio.queued    = platform_posix_ticks();
+    radio.state     = RADIO_STATE_TXCCA1;
+    radio.flags     = (est_frames > 1);
+    radio.evtdone   = callback;
+
+    radio_flush_tx();
+
+    /// Prepare the foreground frame packet
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    phymac[0].tx_eirp = RM2_EIRP_AUTOSCALE(phymac[0].max_eirp);
+#   endif
+    txq.getcursor   = txq.front;
+    txq.front[1]    = phymac[0].tx_eirp;
+
+    sub_prep_q(&txq);
+    em2_encode_newpacket();
+    em2_encode_newframe();
+}
+
+
+
+
+void rm2_txinit_bf(ot_sig2 callback) {
+#if (SYS_FLOOD == ENABLED)
+    sub_listen_stop();
+    radio.queued    = platform_posix_ticks();
+    radio.state     = RADIO_STATE_TXCCA1;
+    radio.flags     = RADIO_FLAG_FLOOD;
+    radio.evtdone   = callback;
+
+    radio_flush_tx();
+
+    /// Prepare the background frame packet
+    txq.getcursor   = txq.front;
+
+    sub_prep_q(&txq);
+    txq.options.ubyte[UPPER] = 0;   // M2AdvP frames carry their CRC
+    em2_encode_newpacket();
+    em2_encode_newframe();
+#endif
+}
+
+
+
+
+
+void rm2_txstop_flood() {
+#if (SYS_FLOOD == ENABLED)
+    radio.state = RADIO_STATE_TXDONE;
+#endif
+}
+
+
+
+
+
+ot_int rm2_txcsma() {
+    switch ( (radio.state >> RADIO_STATE_TXSHIFT) & (RADIO_STATE_TXMASK >> RADIO_STATE_TXSHIFT) ) {
+
+        /// 1. First CCA
+        case (RADIO_STATE_TXCCA1 >> RADIO_STATE_TXSHIFT): {
+            if (dll.comm.csmaca_params & M2_CSMACA_NOCSMA) {
+                if (sub_nocsma_init()) {
+                    radio.state = RADIO_STATE_TXSTART;
+                    return 0;
+                }
+                return RM2_ERR_BADCHANNEL;
+            }
+            if (sub_csma_init() == False){
+                return RM2_ERR_CCAFAIL;
+            }
+            radio.state = RADIO_STATE_TXCCA2;
+            return phymac[0].tg;
+        }
+
+        /// 2. Second CCA
+        case (RADIO_STATE_TXCCA2 >> RADIO_STATE_TXSHIFT): {
+            ot_int test;
+            test            = (ot_int)sub_cca2();
+            radio.state     = test ? RADIO_STATE_TXSTART : RADIO_STATE_TXCCA1;
+            return            test ? 0 : RM2_ERR_CCAFAIL;
+        }
+
+        /// 3. TX startup: the first frame goes on the air
+        case (RADIO_STATE_TXSTART >> RADIO_STATE_TXSHIFT): {
+            radio.state = RADIO_STATE_TXDATA;
+            sub_txframe();
+            return -1;
+        }
+    }
+
+    /// Some bug has occurred
+    radio.state = 0;
+    return RM2_ERR_GENERIC;
+}
+
+
+
+
+
+
+void rm2_txdata_isr() {
+/// The airtime of the last frame is over.  Send the next frame, or finish.
+    SYS_PROFILE_ISR_START();
+    switch ( (radio.state >> RADIO_STATE_TXSHIFT) & (RADIO_STATE_TXMASK >> RADIO_STATE_TXSHIFT) ) {
+
+        case (RADIO_STATE_TXDATA >> RADIO_STATE_TXSHIFT): {
+            /// Packet flooding.  The callback prepares the frame after next.
+#           if (SYS_FLOOD == ENABLED)
+            if (radio.flags & RADIO_FLAG_FLOOD) {
+                m2advp_swap();
+                em2_encode_newframe();
+                sub_txframe();
+                radio.evtdone(2, 0);
+                break;
+            }
+#           endif
+
+            /// More frames to send (MFP's)
+#           if (M2_FEATURE(MULTIFRAME) == ENABLED)
+            if ((radio.flags & RADIO_FLAG_FRCONT) && (em2_remaining_frames() != 0)) {
+                em2_encode_nextframe();
+                txq.front[1] = phymac[0].tx_eirp;
+                sub_txframe();
+                radio.evtdone(1, 0);        //callback action for next frame
+                break;
+            }
+#           endif
+
+            /// Redundant TX pipelining: the callback may chain the next copy
+            /// with rm2_prep_resend().  The frame already carries its CRC.
+#           if (OT_FEATURE(TXPIPE) == ENABLED)
+            if (!(radio.flags & RADIO_FLAG_FRCONT)) {
+                radio.evtdone(2, 0);
+                if (txq.options.ubyte[UPPER] == 255) {
+                    txq.options.ubyte[UPPER] = 0;
+                    txq.getcursor = txq.front;
+                    em2_encode_newframe();
+                    sub_txframe();
+                    break;
+                }
+            }
+#           endif
+        }
+        /* fall through */
+
+        /// Conclude the TX process, and wipe the radio state
+        case (RADIO_STATE_TXDONE >> RADIO_STATE_TXSHIFT):
+            rm2_stamp.txend = platform_stamp();
+            sub_kill(0, 0);
+            break;
+
+        /// Bug trap
+        default:
+            sub_kill(RM2_ERR_GENERIC, 0);
+            break;
+    }
+    SYS_PROFILE_ISR_STOP(SYS_PROFILE_TXDATA);
+}
+
+
+
+
+
+
+
+
+/** Radio Subroutines
+  * ============================================================================
+  */
+
+void sub_txframe() {
+/// Encodes the whole frame, sends it as one datagram, and times its airtime.
+    ot_int last;
+
+    do {
+        last = radio.txlen;
+        em2_encode_data();
+    } while ((em2_remaining_bytes() != 0) && (radio.txlen != last));
+
+    radio.tx.sender     = radio.pid;
+    radio.tx.channel    = phymac[0].channel;
+    radio.tx.eirp       = phymac[0].tx_eirp;
+    radio.tx.duration   = (ot_u16)rm2_pkt_duration(radio.txlen);
+
+    /// Short frames at 200 kS/s are under 1 ti, which would put them on the
+    /// air for no time at all: one tick is the shortest airtime.
+    if (radio.tx.duration == 0) {
+        radio.tx.duration = 1;
+    }
+
+    if (platform_posix_sim()) {
+        static sim_msg msg;
+        msg.type        = SIM_MSG_TX;
+        msg.channel     = radio.tx.channel;
+        msg.eirp        = radio.tx.eirp;
+        msg.duration    = radio.tx.duration;
+        msg.time        = platform_posix_ticks();
+        msg.arg         = radio.queued;
+        msg.length      = (ot_u16)radio.txlen;
+        memcpy(msg.data, radio.tx.data, radio.txlen);
+        platform_posix_simsend(&msg);
+        radio.queued    = SIM_NEVER;
+    }
+    else {
+        sendto( radio.sock, &radio.tx, AIRFRAME_HEADER + radio.txlen, 0,
+                (struct sockaddr*)&radio.group, sizeof(radio.group) );
+    }
+
+    radio_posix_stats.tx_frames++;
+    radio_posix_stats.tx_bytes += radio.txlen;
+    radio_posix_stats.tx_ti    += radio.tx.duration;
+    radio.txlen = 0;
+
+    platform_posix_settimer(&radio.timer, radio.tx.duration);
+}
+
+
+
+void sub_kill(ot_int main_err, ot_int frame_err) {
+    radio_gag();
+    radio_idle();
+    radio.evtdone(main_err, frame_err);
+    radio.evtdone   = &otutils_sig2_null;
+    radio.state     = 0;
+}
+
+
+void sub_killonlowrssi() {
+    ot_int min_rssi = (ot_int)phymac[0].cs_thr - 140;
+    if (radio_rssi() < min_rssi) {
+        radio_posix_stats.rx_weak++;
+        sub_kill(RM2_ERR_LINK, 0);
+    }
+}
+
+
+
+
+ot_bool sub_cca2() {
+    return sub_cca_scan();
+}
+
+
+
+
+ot_bool sub_chan_scan( ot_bool (*scan_test)() ) {
+    ot_int  i;
+
+    for (i=0; i<dll.comm.tx_channels; i++) {
+        if (sub_channel_lookup(dll.comm.tx_chanlist[i]) != False) {
+            if (scan_test()) {
+                break;
+            }
+        }
+    }
+
+    return (ot_bool)(i < dll.comm.tx_channels);
+}
+
+
+
+
+ot_bool sub_cca_scan() {
+    ot_bool cca_status = radio_check_cca();
+    radio_posix_stats.cca_busy += (cca_status == False);
+    return cca_status;
+}
+
+
+ot_bool sub_noscan() {
+    return True;
+}
+
+
+ot_bool sub_csma_init() {
+    return sub_chan_scan( &sub_cca_scan );
+}
+
+
+ot_bool sub_nocsma_init() {
+    return sub_chan_scan( &sub_noscan );
+}
+
+
+
+
+ot_u8 sub_chan_fc(ot_u8 chan_id) {
+/// Returns the center frequency index of chan_id (same as CC430).
+/// Base channels (class 0) always use center frequency 7.
+    return ((chan_id & 0x30) == 0) ? 7 : (chan_id & 0x0F);
+}
+
+
+
+
+void sub_phy_timing(ot_u8 chan_id) {
+/// Called when the channel is set: precomputes the PHY timing constants for
+/// rm2_scale_codec() and rm2_pkt_duration(), so those need no channel tests.
+    ot_u8 turbo         = ((chan_id & 0x60) != 0);
+    phymac[0].tscale    = turbo ? RM2_TSCALE_200 : RM2_TSCALE_55;
+    phymac[0].tpad      = RADIO_PKT_OVERHEAD + (turbo << 1);
+}
+
+
+
+
+ot_bool sub_channel_lookup(ot_u8 chan_id) {
+/// Called during channel scans.
+/// Duty: See if the supplied channel is supported on this device & config.
+///       If yes, load its settings and return true.
+    ot_u8       fec_id;
+    ot_u8       spectrum_id;
+    ot_int      i;
+    vlFILE*     fp;
+    Twobytes    scratch;
+
+    if (chan_id == phymac[0].channel) {
+        return True;
+    }
+
+    fec_id      = chan_id & 0x80;
+    spectrum_id = chan_id & ~0x80;
+
+    /// The encoder does FEC, if it is built
+    if (fec_id && (M2_FEATURE(FEC) != ENABLED)) {
+        return False;
+    }
+
+    /// 0x7F is the wildcard spectrum id.  It means use same spectrum as before.
+    if (spectrum_id == 0x7F) {
+        return True;
+    }
+
+#   if (M2_FEATURE(AUTOSCALE) != ENABLED)
+#       define AUTOSCALE_MASK(VAL)      ((VAL) & 0x7F)
+#   else
+#       define AUTOSCALE_MASK(VAL)      (VAL)
+#   endif
+
+    fp = ISF_open_su( ISF_ID(channel_configuration) );
+    if (fp == NULL) {
+        return False;
+    }
+
+    for (i=0; i<fp->length; i+=8) {
+        scratch.ushort = vl_read(fp, i);
+        if (spectrum_id == scratch.ubyte[0]) {
+            phymac[0].tg        = rm2_default_tgd(chan_id);
+            sub_phy_timing(chan_id);
+            phymac[0].channel   = chan_id;
+            phymac[0].autoscale = scratch.ubyte[1];
+            scratch.ushort      = vl_read(fp, i+2);
+#           if (M2_FEATURE(AUTOSCALE) == ENABLED)
+            phymac[0].max_eirp  = scratch.ubyte[0];
+#           endif
+            phymac[0].tx_eirp   = RM2_EIRP_AUTOSCALE(scratch.ubyte[0]);
+            phymac[0].link_qual = AUTOSCALE_MASK(scratch.ubyte[1]);
+            scratch.ushort      = vl_read(fp, i+4);
+            phymac[0].cs_thr    = AUTOSCALE_MASK(scratch.ubyte[0]);
+            phymac[0].cca_thr   = AUTOSCALE_MASK(scratch.ubyte[1]);
+            vl_close(fp);
+            return True;
+        }
+    }
+
+    vl_close(fp);
+    return False;
+}
+
+
+
+
+void sub_prep_q(Queue* q) {
+/// Put some special data in the queue options field.
+/// Lower byte is encoding options (i.e. FEC)
+/// Upper byte is processing options (i.e. CRC)
+    q->options.ubyte[LOWER]    = (phymac[0].channel & 0x80);
+    q->options.ubyte[UPPER]   += 1;
+}
+
+
+
+
+void sub_offset_rxtimeout() {
+/// If the rx timeout is 0, set it to a minimally small amount, which relates to
+/// the rounded-up duration of an M2AdvP packet: 1, 2, 3, 4, or 6 ti.
+    if (dll.comm.rx_timeout == 0) {
+#       if (M2_FEATURE(TURBO) == ENABLED)
+            dll.comm.rx_timeout  += 1;
+            dll.comm.rx_timeout  += (((phymac[0].channel & 0x60) == 0) << 1);
+#       else
+            dll.comm.rx_timeout   = 3;
+#       endif
+#       if (M2_FEATURE(FEC) == ENABLED)
+            dll.comm.rx_timeout <<= ((phymac[0].channel & 0x80) != 0);
+#       endif
+    }
+}
+
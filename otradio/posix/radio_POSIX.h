@@ -0,0 +1,134 @@
+/* Copyright 2009-2012 JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  *
+  */
+/**
+  * @file       /OTradio/POSIX/radio_POSIX.h
+  * @author     JP Norair
+  * @version    V1.0
+  * @date       14 October 2012
+  * @brief      Radio configuration file for the simulated POSIX radio
+  * @ingroup    Platform
+  *
+  ******************************************************************************
+  */
+
+
+#ifndef __radio_POSIX_H
+#define __radio_POSIX_H
+
+#include "OT_support.h"
+#include "OT_types.h"
+
+
+#ifndef ENABLED
+#   define ENABLED  1
+#endif
+
+#ifndef DISABLED
+#   define DISABLED  0
+#endif
+
+
+
+
+/** POSIX RF Feature settings      <BR>
+  * ========================================================================<BR>
+  * The simulated radio acts like a CC430 with a frame-sized FIFO: it has the
+  * PN9 codec and a packet handler, but CRC and FEC are done by the encoder.
+  * Each frame goes over the network as one datagram.
+  */
+#define RF_FEATURE(VAL)                  RF_FEATURE_##VAL        // FEATURE                  AVAILABILITY
+#define RF_FEATURE_MSK                   ENABLED                 // MSK Modulation           Moderate
+#define RF_FEATURE_55K                   ENABLED                 // 55kHz baudrate           High
+#define RF_FEATURE_200K                  ENABLED                 // 200kHz baudrate          High
+#define RF_FEATURE_PN9                   ENABLED                 // Integrated PN9 codec     Moderate (DASH7 has particular sequence)
+#define RF_FEATURE_FEC                   DISABLED                // Integrated FEC codec     Moderate (DASH7 has particular sequence)
+#define RF_FEATURE_FIFO                  ENABLED                 // RF TX/RX FIFO            High
+#define RF_FEATURE_TXFIFO_BYTES          512                     // A FEC frame of 255 bytes is 512 bytes
+#define RF_FEATURE_RXFIFO_BYTES          512
+#define RF_FEATURE_PACKET                ENABLED                 // Packet Handler           High
+#define RF_FEATURE_CRC                   DISABLED                // CCITT CRC16              High
+#define RF_FEATURE_CSMA                  DISABLED                // CSMA                     Low
+#define RF_FEATURE_RXTIMER               DISABLED                // RX Timeout capability    Low
+#define RF_FEATURE_TXTIMER               DISABLED                // TX MAC capability        DASH7-specific
+#define RF_FEATURE_SCANCYCLE             DISABLED                // Wake-on scan cycle       DASH7-specific
+#define RF_FEATURE_MIRROR                DISABLED                // UDB Register Mirroring   DASH7-specific
+#define RF_FEATURE_SYNCFILTER            DISABLED                // Synchronizer Filtering   DASH7-specific
+#define RF_FEATURE_LBFILTER              DISABLED                // Link Budget Filtering    DASH7-specific
+#define RF_FEATURE_SIDFILTER             DISABLED                // Session ID Filtering     DASH7-specific
+#define RF_FEATURE_ADDRFILTER            DISABLED                // Address Filtering        DASH7-specific
+#define RF_FEATURE_SUBNETFILTER          DISABLED                // Subnet HW Filtering      Moderate (BG frames)
+#define RF_FEATURE_PARSEFILTER           DISABLED                // Full Parse Filtering     DASH7-specific
+#define RF_FEATURE_MAC                   DISABLED                // Full Integrated MAC      DASH7-specific
+#define RF_FEATURE_AES128                DISABLED                // AES128 engine            Rare/None yet
+#define RF_FEATURE_ECC                   DISABLED                // ECC engine               Rare/None yet
+#define RF_FEATURE_ALGE                  DISABLED                // Algebraic Eraser engine  Rare/None yet
+#define RF_FEATURE_AUXRX                 ENABLED                 // Auxiliary RX radio       Rare (2nd transceiver)
+
+
+
+
+/** Simulated Radio Statistics
+  * Counted by the driver for benchmarking.  When the environment variable
+  * OT_STATS is set, they are printed to stderr when the process exits.
+  *
+  * tx_frames       frames sent
+  * tx_bytes        bytes sent, including the length byte and CRC
+  * rx_frames       frames received (sync detected and fully received)
+  * rx_bytes        bytes received
+  * rx_crcerrs      received frames that failed CRC
+  * rx_collisions   frames that overlapped a frame already being received
+  * rx_weak         frames heard below the carrier sense threshold
+  * cca_busy        CCA scans that found the channel occupied
+  * aux_frames      frames held by the auxiliary receiver (RF_FEATURE_AUXRX)
+  * aux_drops       frames the auxiliary receiver heard but had no room for
+  * listen_ti       time the receiver was on (ti)
+  * tx_ti           airtime of the frames sent (ti)
+  * recals          calls of radio_recalibrate() (OT_FEATURE_RFCAL)
+  */
+typedef struct {
+    ot_u32  tx_frames;
+    ot_u32  tx_bytes;
+    ot_u32  rx_frames;
+    ot_u32  rx_bytes;
+    ot_u32  rx_crcerrs;
+    ot_u32  rx_collisions;
+    ot_u32  rx_weak;
+    ot_u32  cca_busy;
+    ot_u32  aux_frames;
+    ot_u32  aux_drops;
+    ot_u32  listen_ti;
+    ot_u32  tx_ti;
+    ot_u32  recals;
+} radio_posix_stats_struct;
+
+extern radio_posix_stats_struct radio_posix_stats;
+
+
+
+/** @brief Copies the TX buffer into the RX buffer, as if the frame was heard
+  * @param None
+  * @retval None
+  *
+  * The air is not used, and the TX buffer is kept.  This lets a test drive
+  * the RX decoder with exactly what the TX encoder produced, as many times as
+  * it likes (see /apps/bench_otlib).
+  */
+void radio_posix_loopback();
+
+
+
+
+#endif
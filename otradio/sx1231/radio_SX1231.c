@@ -47,6 +47,7 @@
 #include "queue.h"
 #include "veelite.h"
 #include "session.h"
+#include "system.h"
 
 #ifdef RADIO_DEBUG
 #   include "debug_uart.h"
@@ -101,10 +102,12 @@ radio_struct radio;
 
 #define SIZEOF_RF_DATA_BUF        632
 ot_u8 rf_data_buf[SIZEOF_RF_DATA_BUF];
+ot_u8* rf_rx_buf = rf_data_buf;   // where the RX DMA lands fifo data
 int num_bytes_sent;
 int num_bytes_to_send;
 
 phymac_struct   phymac[M2_PARAM_MI_CHANNELS];
+rm2_stamp_struct rm2_stamp;
 
 RegFifoThresh_t RegFifoThresh;
 RegOpMode_t RegOpMode;
@@ -113,11 +116,195 @@ RegPaLevel_t RegPaLevel;
 RegDataModul_t RegDataModul;
 RegLna_t RegLna;
 
+/** Register Shadow
+  * A RAM copy of registers 0x01-0x4F, loaded from the chip by radio_init().
+  * sub_setreg() only changes the copy and marks the register dirty if the
+  * value is new, and sub_flushregs() then writes each run of consecutive
+  * dirty registers as one burst (WriteBurst_Sx1231()).  sub_getreg() answers
+  * from the copy, except for registers the chip changes by itself, and for
+  * OPMODE and FIFOTHRESH, which are written from ISRs and mirrored only by
+  * RegOpMode and RegFifoThresh.  Those go straight to SPI, as do test
+  * registers above the shadow (e.g. REG_TESTDAGC).
+  */
+#define SX1231_SHADOW_REGS  (REG_TEMP2+1)
+
+static ot_u8 shadow_reg[SX1231_SHADOW_REGS];
+static ot_u8 shadow_dirty[(SX1231_SHADOW_REGS+7)/8];
+
+#define SHADOW_ISDIRTY(ADDR)    (shadow_dirty[(ADDR)>>3] & (1 << ((ADDR)&7)))
+#define SHADOW_SETDIRTY(ADDR)   (shadow_dirty[(ADDR)>>3] |= (1 << ((ADDR)&7)))
+#define SHADOW_CLRDIRTY(ADDR)   (shadow_dirty[(ADDR)>>3] &= ~(1 << ((ADDR)&7)))
+
 EXTI_InitTypeDef exti9_5_init;
 EXTI_InitTypeDef exti4_init;
 
 volatile ot_bool hold_tx_power = False;
 
+/** Channel Table
+  * The channel configuration ISF is copied into RAM when it is first needed,
+  * and it is copied again only after veelite reports that a file has changed
+  * (vl_writestamp, vl_mapstamp).  sub_channel_lookup() reads from the table,
+  * so a channel scan does not need to open the ISF.  The SX1231 synthesizer
+  * has no calibration results to restore: a hop is the FRF write from frf[].
+  *
+  * stamp       value of vl_writestamp + vl_mapstamp when table was loaded
+  * valid       False forces the table to be reloaded
+  * count       number of channels in the table
+  * entry[]     channel data bytes 0-5 of each 8 byte ISF record
+  */
+#ifndef RF_PARAM_CHANNELS
+#   define RF_PARAM_CHANNELS    (ISF_MAX(channel_configuration) / 8)
+#endif
+
+typedef struct {
+    ot_u8   spectrum_id;
+    ot_u8   autoscale;
+    ot_u8   tx_eirp;
+    ot_u8   link_qual;
+    ot_u8   cs_thr;
+    ot_u8   cca_thr;
+} chanentry_struct;
+
+typedef struct {
+    ot_u16  stamp;
+    ot_bool valid;
+    ot_u8   count;
+    chanentry_struct entry[RF_PARAM_CHANNELS];
+} chantable_struct;
+
+static chantable_struct chantable;
+
+/** Channel Scan Occupancy
+  * A moving average (EWMA) of the RSSI measured on each of the 16 center
+  * frequencies, updated when rm2_txcsma() finishes a CCA measurement.
+  * sub_csma_init() orders the TX channel list by it, so the channel most
+  * likely to be clear is tried first.  Averages are stored in 1/16 dBm.
+  * Channels whose averages are in the same 4 dB bucket keep the order they
+  * had (e.g. from sub_csma_scramble()).
+  */
+#ifndef RF_FEATURE_SCANSORT
+#   define RF_FEATURE_SCANSORT  ENABLED
+#endif
+
+#define SCAN_EWMA_SHIFT     2               // each scan moves the average 1/4
+#define SCAN_KEY_SHIFT      (4+2)           // ordering buckets of 4 dB
+
+#if (RF_FEATURE(SCANSORT) == ENABLED)
+static ot_int scan_ewma[16];
+#endif
+
+/** FIFO Burst Sizing
+  * The FifoLevel interrupts already start one DMA burst each, and spi2_state
+  * already selects the handler for the current state.  The burst size is set
+  * from the data rate: each burst moves as many bytes as it can, and the FIFO
+  * keeps enough room (TX: data) to cover an ISR latency of
+  * 1/2^RF_PARAM_ISRLATENCY ti.  The FIFO time comes from rm2_scale_codec().
+  * When DISABLED, bursts are half of the FIFO.
+  */
+#ifndef RF_FEATURE_CHAINEDISR
+#   define RF_FEATURE_CHAINEDISR    ENABLED
+#endif
+#ifndef RF_PARAM_ISRLATENCY
+#   define RF_PARAM_ISRLATENCY      2           // 1/4 ti = ~244us
+#endif
+
+void update_shadow_regs(ot_u8 addr, ot_u8 val);
+
+static ot_bool
+sub_reg_volatile(ot_u8 addr)
+{
+/// True for registers that must not be served from (or staged in) the shadow
+    switch (addr) {
+        case REG_FIFO:
+        case REG_OPMODE:            // ModeReady, and written from ISRs
+        case REG_OSC1:              // RcCalDone
+        case REG_LNA:               // LnaCurrentGain
+        case REG_AFCFEI:
+        case REG_AFCMSB:
+        case REG_AFCLSB:
+        case REG_FEIMSB:
+        case REG_FEILSB:
+        case REG_RSSICONFIG:        // RssiDone
+        case REG_RSSIVALUE:
+        case REG_IRQFLAGS1:
+        case REG_IRQFLAGS2:
+        case REG_FIFOTHRESH:        // written from ISRs
+        case REG_TEMP1:
+        case REG_TEMP2:
+            return True;
+    } // ...switch (addr)
+
+    return (ot_bool)(addr >= SX1231_SHADOW_REGS);
+}
+
+static ot_u8
+sub_getreg(ot_u8 addr)
+{
+    if (sub_reg_volatile(addr))
+        return ReadReg_Sx1231(addr);
+
+    return shadow_reg[addr];
+}
+
+static void
+sub_setreg(ot_u8 addr, ot_u8 val)
+{
+/// Stage a register write for sub_flushregs().  Volatile registers are
+/// written immediately.
+    if (sub_reg_volatile(addr)) {
+        WriteReg_Sx1231(addr, val);
+    }
+    else if (shadow_reg[addr] != val) {
+        SHADOW_SETDIRTY(addr);
+    }
+
+    update_shadow_regs(addr, val);
+}
+
+static void
+sub_flushregs(void)
+{
+/// Write the dirty registers: one burst for each run of consecutive dirty
+/// registers, or a plain register write for a run of one.
+    ot_u8 addr, end;
+
+    for (addr=REG_OPMODE; addr<SX1231_SHADOW_REGS; ) {
+        if (((addr & 7) == 0) && (shadow_dirty[addr>>3] == 0)) {
+            addr += 8;
+            continue;
+        }
+        if (SHADOW_ISDIRTY(addr) == 0) {
+            addr++;
+            continue;
+        }
+        for (end=addr; (end<SX1231_SHADOW_REGS) && SHADOW_ISDIRTY(end); end++) {
+            SHADOW_CLRDIRTY(end);
+        }
+        if ((end-addr) == 1)
+            WriteReg_Sx1231(addr, shadow_reg[addr]);
+        else
+            WriteBurst_Sx1231(addr, &shadow_reg[addr], end-addr);
+
+        addr = end;
+    }
+}
+
+static ot_u8
+sub_fifo_limit(void)
+{
+    /// Bytes per burst: the FIFO less the bytes that go through it during
+    /// the ISR latency budget (at least 1).  A full FIFO takes
+    /// rm2_scale_codec(FIFO) ti, rounded up.
+#if (RF_FEATURE(CHAINEDISR) == ENABLED)
+    ot_int fifo_ti;
+    fifo_ti = rm2_scale_codec(RF_FEATURE_TXFIFO_BYTES) + 1;
+    return (ot_u8)(RF_FEATURE_TXFIFO_BYTES - 1 - \
+                   (RF_FEATURE_TXFIFO_BYTES / (fifo_ti << RF_PARAM_ISRLATENCY)));
+#else
+    return SX1231_FIFO_SIZE_HALF;
+#endif
+}
+
 static void
 sub_set_txpower( ot_u8 eirp_code )
 {
@@ -138,7 +325,8 @@ sub_set_txpower( ot_u8 eirp_code )
 
     RegPaLevel.bits.OutputPower = eirp_code;
 
-    WriteReg_Sx1231(REG_PALEVEL, RegPaLevel.octet);
+    // written by the caller's sub_flushregs()
+    sub_setreg(REG_PALEVEL, RegPaLevel.octet);
 }
 
 static void
@@ -165,20 +353,20 @@ sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp)
         switch ((phymac[0].channel >> 4) & 0x03) {
             case 0: fc_i = 7;
             case 1:     /// 55 kS/s method
-                WriteReg_Sx1231(REG_BITRATEMSB, REG_BITRATEMSB_55555BPS);
-                WriteReg_Sx1231(REG_BITRATELSB, REG_BITRATELSB_55555BPS);
+                sub_setreg(REG_BITRATEMSB, REG_BITRATEMSB_55555BPS);
+                sub_setreg(REG_BITRATELSB, REG_BITRATELSB_55555BPS);
                 // slower bitrate, slightly less occupied bandwidth
                 RegRxBw.bits.RxBw = RXBW_83KHZ;
                 break;
             case 2: 
             case 3:     /// 200 kS/s method
-                WriteReg_Sx1231(REG_BITRATEMSB, REG_BITRATEMSB_200KBPS);
-                WriteReg_Sx1231(REG_BITRATELSB, REG_BITRATELSB_200KBPS);
+                sub_setreg(REG_BITRATEMSB, REG_BITRATEMSB_200KBPS);
+                sub_setreg(REG_BITRATELSB, REG_BITRATELSB_200KBPS);
                 // faster bitrate, slightly more occupied bandwidth
                 RegRxBw.bits.RxBw = RXBW_100KHZ;
                 break;
         } // ...switch ((phymac[0].channel >> 4) & 0x03)
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
     }
 
     if ( fc_i != (old_chan & 0x0F) ) {
@@ -187,24 +375,94 @@ sub_chan_config(ot_u8 old_chan, ot_u8 old_eirp)
 #ifdef RADIO_DEBUG
         debug_printf("new freq 0x%x: %04x %02x %02x\r\n", fc_i, cur_frf.ushort, cur_frf.ubyte[UPPER], cur_frf.ubyte[LOWER]);
 #endif /* RADIO_DEBUG */
-        WriteReg_Sx1231(REG_FRFMID, cur_frf.ubyte[UPPER]);
-        WriteReg_Sx1231(REG_FRFLSB, cur_frf.ubyte[LOWER]);
+        sub_setreg(REG_FRFMID, cur_frf.ubyte[UPPER]);
+        sub_setreg(REG_FRFLSB, cur_frf.ubyte[LOWER]);
     }
 
+    sub_flushregs();
+}
+
+static ot_u8
+sub_chan_fc(ot_u8 chan_id)
+{
+/// Returns the center frequency index that sub_chan_config() uses for chan_id.
+/// Base channels (class 0) always use center frequency 7.
+    return ((chan_id & 0x30) == 0) ? 7 : (chan_id & 0x0F);
+}
+
+static void
+sub_chan_sort(void)
+{
+/// Called by sub_csma_init()
+/// Duty: Stable insertion sort of dll.comm.tx_chanlist by the occupancy of
+///       each channel, least occupied first.
+#if (RF_FEATURE(SCANSORT) == ENABLED)
+    ot_int i, j;
+
+    for (i=1; i<dll.comm.tx_channels; i++) {
+        ot_u8   chan_id = dll.comm.tx_chanlist[i];
+        ot_int  key     = scan_ewma[sub_chan_fc(chan_id)] >> SCAN_KEY_SHIFT;
+
+        for (j=i; j>0; j--) {
+            ot_u8 prev_id = dll.comm.tx_chanlist[j-1];
+            if ((scan_ewma[sub_chan_fc(prev_id)] >> SCAN_KEY_SHIFT) <= key) {
+                break;
+            }
+            dll.comm.tx_chanlist[j] = prev_id;
+        }
+        dll.comm.tx_chanlist[j] = chan_id;
+    }
+#endif
+}
+
+static void
+sub_chantable_refresh(void)
+{
+/// Called by sub_channel_lookup()
+/// Duty: Reload the channel table from the channel configuration ISF if it has
+///       not been loaded yet, or if any file has been changed since.
+    ot_u16 stamp = (ot_u16)(vl_writestamp + vl_mapstamp);
+
+    if ((chantable.valid == False) || (chantable.stamp != stamp)) {
+        vlFILE*     fp;
+        ot_int      i;
+        ot_u8       j = 0;
+        Twobytes    scratch;
+
+        fp = ISF_open_su( ISF_ID(channel_configuration) );
+        if (fp != NULL) {
+            for (i=0; (i < fp->length) && (j < RF_PARAM_CHANNELS); i+=8, j++) {
+                scratch.ushort                  = vl_read(fp, i);
+                chantable.entry[j].spectrum_id  = scratch.ubyte[0];
+                chantable.entry[j].autoscale    = scratch.ubyte[1];
+                scratch.ushort                  = vl_read(fp, i+2);
+                chantable.entry[j].tx_eirp      = scratch.ubyte[0];
+                chantable.entry[j].link_qual    = scratch.ubyte[1];
+                scratch.ushort                  = vl_read(fp, i+4);
+                chantable.entry[j].cs_thr       = scratch.ubyte[0];
+                chantable.entry[j].cca_thr      = scratch.ubyte[1];
+            }
+            vl_close(fp);
+        }
+
+        chantable.count = j;
+        chantable.stamp = stamp;
+        chantable.valid = True;
+    }
 }
 
 static ot_bool
-sub_channel_lookup(ot_u8 chan_id, vlFILE* fp)
+sub_channel_lookup(ot_u8 chan_id)
 {
 /// Called during channel scans.
 /// Duty: (a) See if the supplied channel is supported on this device & config.
 ///       If yes, return true.  (b) Determine if recalibration is required 
 ///       before changing to the new channel, and recalibrate if so.
 
-    ot_u8       fec_id;
-    ot_u8       spectrum_id;
-    ot_int      i;
-    Twobytes    scratch;
+    ot_u8               fec_id;
+    ot_u8               spectrum_id;
+    ot_int              i;
+    chanentry_struct*   entry;
     
     //debug_printf("sub_channel_lookup(%x)", chan_id);
     /// Only do the channel lookup if the new channel is different than before
@@ -296,24 +554,24 @@ sub_channel_lookup(ot_u8 chan_id, vlFILE* fp)
 #       define AUTOSCALE_MASK(VAL)      (VAL)
 #   endif
     
-    for (i=0; i<fp->length; i+=8) {
-        scratch.ushort = vl_read(fp, i);
-        
-        if (spectrum_id == scratch.ubyte[0]) {
+    sub_chantable_refresh();
+    entry = &chantable.entry[0];
+
+    for (i=0; i<chantable.count; i++, entry++) {
+        if (spectrum_id == entry->spectrum_id) {
             ot_u8 old_chan_id   = phymac[0].channel;
             ot_u8 old_tx_eirp   = phymac[0].tx_eirp;
 
             phymac[0].tg        = rm2_default_tgd(chan_id);
             phymac[0].channel   = chan_id;
-            phymac[0].autoscale = scratch.ubyte[1];
-
-            scratch.ushort      = vl_read(fp, i+2);
-            phymac[0].tx_eirp   = AUTOSCALE_MASK(scratch.ubyte[0]);
-            phymac[0].link_qual = AUTOSCALE_MASK(scratch.ubyte[1]);
-
-            scratch.ushort      = vl_read(fp, i+4);
-            phymac[0].cs_thr    = AUTOSCALE_MASK(scratch.ubyte[0]);
-            phymac[0].cca_thr   = AUTOSCALE_MASK(scratch.ubyte[1]);
+            phymac[0].autoscale = entry->autoscale;
+#           if (M2_FEATURE(AUTOSCALE) == ENABLED)
+            phymac[0].max_eirp  = entry->tx_eirp;
+#           endif
+            phymac[0].tx_eirp   = RM2_EIRP_AUTOSCALE(entry->tx_eirp);
+            phymac[0].link_qual = AUTOSCALE_MASK(entry->link_qual);
+            phymac[0].cs_thr    = AUTOSCALE_MASK(entry->cs_thr);
+            phymac[0].cca_thr   = AUTOSCALE_MASK(entry->cca_thr);
 #ifdef RADIO_DEBUG
             debug_printf("sid %2x: cca=%d cs=%d\r\n", spectrum_id, phymac[0].cca_thr, phymac[0].cs_thr);
 #endif /* RADIO_DEBUG */
@@ -339,6 +597,29 @@ sub_channel_lookup(ot_u8 chan_id, vlFILE* fp)
     return False;
 }
 
+static void
+sub_subnet_filter(ot_bool bgframe)
+{
+/// Background frames start with the subnet, so the packet engine's address
+/// filter can drop frames for other subnets.  It is exact only when the device
+/// subnet mask is 0xF (passing subnets are 0xFF and ours), and it cannot see
+/// through FEC.  PN9 is done in software and its first byte is 0xFF, so the
+/// filter addresses are the whitened subnet (ours, and 0xFF -> 0x00).
+#if (RF_FEATURE(SUBNETFILTER) == ENABLED)
+    ot_u8 config = RF_PACKET1_FORMAT_FIXED;
+
+    if ( bgframe
+        && ((dll.netconf.subnet & 0x0F) == 0x0F)
+        && ((phymac[0].channel & 0x80) == 0) ) {
+        sub_setreg(REG_NODEADRS, dll.netconf.subnet ^ 0xFF);
+        sub_setreg(REG_BROADCASTADRS, 0x00);
+        config |= RF_PACKET1_ADRSFILTERING_NODEBROADCAST;
+    }
+    sub_setreg(REG_PACKETCONFIG1, config);
+    sub_flushregs();
+#endif
+}
+
 Twobytes sync_value; // global for access from transmitter
 
 static void
@@ -374,13 +655,15 @@ sub_syncword_config(ot_u8 sync_class)
     debug_printf("sync %02x %02x\r\n", sync_value.ubyte[LOWER], sync_value.ubyte[UPPER]);
 #endif /* RADIO_DEBUG */
     // SyncValue1 is last byte of preamble
-    WriteReg_Sx1231(REG_SYNCVALUE2, sync_value.ubyte[LOWER]);
-    WriteReg_Sx1231(REG_SYNCVALUE3, sync_value.ubyte[UPPER]);
+    sub_setreg(REG_SYNCVALUE2, sync_value.ubyte[LOWER]);
+    sub_setreg(REG_SYNCVALUE3, sync_value.ubyte[UPPER]);
+    sub_flushregs();
 }
 
 void
 set_chip_mode(ot_u8 chip_mode, char nonblocking)
 {
+    ot_u8 last_mode = RegOpMode.bits.Mode;
     RegOpMode.bits.Mode = chip_mode;
 
 #ifdef RADIO_DEBUG
@@ -397,8 +680,14 @@ set_chip_mode(ot_u8 chip_mode, char nonblocking)
     }*/
 #endif /* RADIO_DEBUG */
 
-    if (nonblocking)
-        WriteReg_Sx1231__nonblocking(REG_OPMODE, RegOpMode.octet);
+    if (nonblocking) {
+        // With the SPI queue full, the mode stays as it was, so that the
+        // next call (e.g. radio_sleep()) tries again
+        if (WriteReg_Sx1231__nonblocking(REG_OPMODE, RegOpMode.octet) == False) {
+            RegOpMode.bits.Mode = last_mode;
+            return;
+        }
+    }
     else
         WriteReg_Sx1231(REG_OPMODE, RegOpMode.octet);
 
@@ -418,6 +707,13 @@ set_chip_mode(ot_u8 chip_mode, char nonblocking)
 void
 update_shadow_regs(ot_u8 addr, ot_u8 val)
 {
+/// Keeps the named register unions in step.  The shadow file itself is
+/// changed by sub_setreg(), or here when a register was accessed directly
+/// (radio console).
+    if (!sub_reg_volatile(addr)) {
+        shadow_reg[addr] = val;
+    }
+
     switch (addr) {
         case REG_OPMODE:
             RegOpMode.octet = val;
@@ -485,10 +781,18 @@ radio_init(void)
         WriteReg_Sx1231(REG_AESKEY1, 0xaa);
     } while (ReadReg_Sx1231(REG_AESKEY1) != 0xaa);
 
+    /* load the shadow from the chip (not REG_FIFO: reading it pops a byte) */
+    for (i = REG_OPMODE; i < SX1231_SHADOW_REGS; i++) {
+        shadow_reg[i] = ReadReg_Sx1231(i);
+    }
+    for (i = 0; i < sizeof(shadow_dirty); i++) {
+        shadow_dirty[i] = 0;
+    }
+
     for (i = 0; defaults[i][0] != 255; i++) {
-        WriteReg_Sx1231(defaults[i][0], defaults[i][1]);
-        update_shadow_regs(defaults[i][0], defaults[i][1]);
+        sub_setreg(defaults[i][0], defaults[i][1]);
     }
+    sub_flushregs();
 
 #ifdef RADIO_DEBUG
     i = ReadReg_Sx1231(REG_VERSION);
@@ -502,17 +806,21 @@ radio_init(void)
     TIM_ETRClockMode2Config(RXTIM, TIM_ExtTRGPSC_OFF, TIM_ExtTRGPolarity_NonInverted, 0);
     
     radio.evtdone       = &otutils_sig2_null;   // in case enabling RXTIM interrupt causes evtdone()
+    radio.fifo_limit    = SX1231_FIFO_SIZE_HALF;
     TIM_ITConfig(RXTIM, TIM_IT_CC1, ENABLE);
 
     {
-        vlFILE* fp          = ISF_open_su( ISF_ID(channel_configuration) );        
-        debug_printf("fp=%p\r\n", fp);
         phymac[0].channel   = 0x55;         // 55=invalid, forces calibration.
         phymac[0].tx_eirp   = 0x00;
         radio.state         = 0;            // (idle)
+        chantable.valid     = False;
+#       if (RF_FEATURE(SCANSORT) == ENABLED)
+        for (i=0; i<16; i++) {
+            scan_ewma[i] = (-140 << 4);     // unknown channels sort first
+        }
+#       endif
         
-        sub_channel_lookup(0x00, fp);
-        vl_close(fp);
+        sub_channel_lookup(0x00);
     }
 
     /* SPI2 RX/TX DMA CH5 Configuration:  -----------------------------------------*/
@@ -637,6 +945,7 @@ sx1231_start_rx()
 
     set_chip_mode(CHIP_MODE_RECEIVER, 0);
 
+    radio.fifo_limit = sub_fifo_limit();
     RegFifoThresh.bits.FifoThreshold = em2_remaining_bytes();
 /*    if (RegFifoThresh.bits.FifoThreshold > SX1231_FIFO_SIZE) {
         for (;;)
@@ -741,7 +1050,9 @@ start_tx(ot_bool initial)
 
     set_chip_mode(CHIP_MODE_TRANSMITTER, 0);
 
-    RegFifoThresh.bits.FifoThreshold = SX1231_FIFO_SIZE_HALF;
+    /* FifoLevel falls when there is room for a whole burst */
+    radio.fifo_limit = sub_fifo_limit();
+    RegFifoThresh.bits.FifoThreshold = RF_FEATURE_TXFIFO_BYTES - radio.fifo_limit;
     WriteReg_Sx1231(REG_FIFOTHRESH, RegFifoThresh.octet);
 
     num_bytes_sent = 0;
@@ -759,10 +1070,7 @@ start_tx(ot_bool initial)
         SPI2_DMA_Init.DMA_BufferSize = num_bytes_to_send;
 
     /* SPI2_TX DMA will be started in SPI2 ISR (burst transfer to radio) */
-    SPI_DataSizeConfig(SPI2, SPI_DataSize_8b); 
-    ASSERT_NSS_CONFIG();
-    SPI_I2S_SendData(SPI2, 0x80);   // bit 7 to address 0: write to fifo
-    spi2_state = SPI2_STATE__START_TX_DMA;
+    spi2_fifo_burst(SPI2_STATE__START_TX_DMA);
     start_tx_from = 1;
 
 }
@@ -823,24 +1131,19 @@ rm2_pkt_duration(ot_int pkt_bytes)
 
 static ot_bool
 sub_chan_scan( void ) {
-    vlFILE* fp;
     ot_int  i;
     
-    fp = ISF_open_su( ISF_ID(channel_configuration) );
-    ///@todo assert fp
-
     /// Go through the list of tx channels
     /// - Make sure the channel ID is valid
     /// - Make sure the transmission can fit within the contention period.
     /// - Scan it, to make sure it can be used
     for (i=0; i<dll.comm.tx_channels; i++) {
-        if (sub_channel_lookup(dll.comm.tx_chanlist[i], fp) != False) {
+        if (sub_channel_lookup(dll.comm.tx_chanlist[i]) != False) {
             // rm2_txcsma() is measuring rssi for energy detection
             break;
         }
     }
     
-    vl_close(fp);
     return (ot_bool)(i < dll.comm.tx_channels);
 }
 
@@ -858,7 +1161,9 @@ sub_csma_init() {
 /// Duty: Initialize csma process, and run scan.
     ot_bool cca1_status;
     
-    /// Setup channel, scan it, and power down RF on scan fail
+    /// Put the least occupied channels first, then setup channel, scan it,
+    /// and power down RF on scan fail
+    sub_chan_sort();
     cca1_status = sub_chan_scan( );
     if (cca1_status == False) {         //Optimizers may remove this if() for
         radio_sleep();                  //certain implementations
@@ -881,7 +1186,7 @@ rm2_txcsma()
 
 #ifdef RADIO_DEBUG
     //debug_printf("csma%02x ", radio.state);
-    if (spi2_state != SPI2_STATE__NONE) {
+    if ((spi2_state != SPI2_STATE__NONE) && (spi2_state != SPI2_STATE__REG)) {
         debug_printf("csma spi2_state:%d\r\n", spi2_state);
         for (;;)
             asm("nop");    // currently radio message in progress
@@ -952,6 +1257,11 @@ rm2_txcsma()
             rssi = 0 - rssi;
             rssi += 140;
             //debug_printf("rssi=%d ", rssi);
+#           if (RF_FEATURE(SCANSORT) == ENABLED)
+            {   ot_int* avg = &scan_ewma[sub_chan_fc(phymac[0].channel)];
+                *avg       += (((rssi - 140) << 4) - *avg) >> SCAN_EWMA_SHIFT;
+            }
+#           endif
             if (rssi > phymac[0].cca_thr) {
 #ifdef RADIO_DEBUG
                 debug_printf("[41m%d[0m\r\n", rssi);
@@ -1060,6 +1370,22 @@ void radio_putbyte(ot_u8 databyte)
     rf_data_buf[num_bytes_to_send++] = databyte;
 }
 
+// radio_putbytes(): Puts up to limit bytes to the TX radio buffer (sent by DMA)
+ot_int
+radio_putbytes(ot_u8* data, ot_int limit)
+{
+    ot_int room;
+    room = SIZEOF_RF_DATA_BUF - num_bytes_to_send;
+    if (room > limit)
+        room = limit;
+    if (room <= 0)
+        return 0;
+
+    platform_memcpy(&rf_data_buf[num_bytes_to_send], data, room);
+    num_bytes_to_send += room;
+    return room;
+}
+
 static void
 sub_prep_q(Queue* q)
 {
@@ -1086,7 +1412,7 @@ void rm2_txinit_ff(ot_int est_frames, ot_sig2 callback)
     debug_printf("rm2_txinit_ff\r\n");
     if (est_frames != 1)
         debug_printf("est_frames=%d\r\n", est_frames);
-    if (spi2_state != SPI2_STATE__NONE) {
+    if ((spi2_state != SPI2_STATE__NONE) && (spi2_state != SPI2_STATE__REG)) {
         debug_printf("txinit_ff spi2_state:%d\r\n", spi2_state);
         for (;;)
             asm("nop");    // currently radio message in progress
@@ -1098,6 +1424,14 @@ void rm2_txinit_ff(ot_int est_frames, ot_sig2 callback)
     radio.evtdone   = callback;
 
     /// Prepare the foreground frame packet
+#   if (M2_FEATURE(AUTOSCALE) == ENABLED)
+    if (phymac[0].tx_eirp != RM2_EIRP_AUTOSCALE(phymac[0].max_eirp)) {
+        phymac[0].tx_eirp = RM2_EIRP_AUTOSCALE(phymac[0].max_eirp);
+        if (!hold_tx_power) {
+            sub_set_txpower(phymac[0].tx_eirp);
+        }
+    }
+#   endif
     txq.getcursor   = txq.front;
     txq.front[1]    = phymac[0].tx_eirp;
     
@@ -1111,16 +1445,9 @@ sub_test_channel(ot_u8 channel, ot_u8 netstate) {
     ot_bool test = True;
 
     if ((channel != phymac[0].channel) || (netstate == M2_NETSTATE_UNASSOC)) {
-        vlFILE* fp;
-
-        /// Open the Mode 2 FS Config register that contains the channel list
-        /// for this host, and make sure the channel we want to use is available
-        fp = ISF_open_su( ISF_ID(channel_configuration) );
-        ///@todo assert fp
-    
+        /// Make sure the channel we want to use is in the channel list
         //debug_printf("sub_test_channel(0x%02x)\r\n", channel);
-        test = sub_channel_lookup(channel, fp);
-        vl_close(fp);
+        test = sub_channel_lookup(channel);
     }
     
     return test;
@@ -1138,7 +1465,7 @@ rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback)
 
 #ifdef RADIO_DEBUG
     debug_printf("rm2_rxinit_bf(%d)\r\n", channel);
-    if (spi2_state != SPI2_STATE__NONE) {
+    if ((spi2_state != SPI2_STATE__NONE) && (spi2_state != SPI2_STATE__REG)) {
         debug_printf("rxinit_bf spi2_state:%d\r\n", spi2_state);
         for (;;)
             asm("nop");    // currently radio message in progress
@@ -1163,6 +1490,7 @@ rm2_rxinit_bf(ot_u8 channel, ot_sig2 callback)
     em2_decode_newpacket();
     em2_decode_newframe();
 
+    sub_subnet_filter(True);
     sub_syncword_config(0);
     sx1231_start_rx();
 
@@ -1191,8 +1519,26 @@ radio_rxopen()
 ot_u8
 radio_getbyte()
 {
-    //debug_printf("%02x ", rf_data_buf[num_bytes_sent]);
-    return rf_data_buf[num_bytes_sent++];
+    //debug_printf("%02x ", rf_rx_buf[num_bytes_sent]);
+    return rf_rx_buf[num_bytes_sent++];
+}
+
+// Gets up to limit bytes from the RX radio buffer (already moved by DMA).
+// When the DMA has landed the data where it is wanted, there is no copy.
+ot_int
+radio_getbytes(ot_u8* data, ot_int limit)
+{
+    ot_int ready;
+    ready = (ot_int)SPI2_DMA_Init.DMA_BufferSize - num_bytes_sent;
+    if (ready > limit)
+        ready = limit;
+    if (ready <= 0)
+        return 0;
+
+    if (data != &rf_rx_buf[num_bytes_sent])
+        platform_memcpy(data, &rf_rx_buf[num_bytes_sent], ready);
+    num_bytes_sent += ready;
+    return ready;
 }
 
 ot_int
@@ -1213,7 +1559,7 @@ rm2_txinit_bf(ot_sig2 callback)
 #if (SYS_FLOOD == ENABLED)
 
 #ifdef RADIO_DEBUG
-    if (spi2_state != SPI2_STATE__NONE) {
+    if ((spi2_state != SPI2_STATE__NONE) && (spi2_state != SPI2_STATE__REG)) {
         debug_printf("txinit_bf spi2_state:%d\r\n", spi2_state);
         for (;;)
             asm("nop");    // currently radio message in progress
@@ -1227,11 +1573,11 @@ rm2_txinit_bf(ot_sig2 callback)
     radio.flags     = RADIO_FLAG_FLOOD;
     radio.evtdone   = callback;
 
-    /// Prepare the foreground frame packet
+    /// Prepare the background frame packet (M2AdvP frames carry their CRC)
     txq.getcursor   = txq.front;
-    txq.front[1]    = phymac[0].tx_eirp;
     
     sub_prep_q(&txq);
+    txq.options.ubyte[UPPER] = 0;
 #endif /* ...SYS_FLOOD == ENABLED */
 }
 
@@ -1243,7 +1589,7 @@ void rm2_rxinit_ff(ot_u8 channel, ot_u8 netstate, ot_int est_frames, ot_sig2 cal
 
 #ifdef RADIO_DEBUG
     debug_printf("rm2_rxinit_ff(0x%x, 0x%x, %d) %d\r\n", channel, netstate, est_frames, dll.comm.rx_timeout);
-    if (spi2_state != SPI2_STATE__NONE) {
+    if ((spi2_state != SPI2_STATE__NONE) && (spi2_state != SPI2_STATE__REG)) {
         debug_printf("rxinit_ff spi2_state:%d %d\r\n", spi2_state, start_tx_from);
         for (;;)
             asm("nop");    // state machine got hung up?
@@ -1273,6 +1619,7 @@ void rm2_rxinit_ff(ot_u8 channel, ot_u8 netstate, ot_int est_frames, ot_sig2 cal
     em2_decode_newpacket();
     em2_decode_newframe();
 
+    sub_subnet_filter(False);
     sub_syncword_config(1);
     sx1231_start_rx();
 
@@ -1319,17 +1666,18 @@ frf_adj(ot_bool up)
 {
     ot_u16 f;
 
-    f = ReadReg_Sx1231(REG_FRFMID);
+    f = sub_getreg(REG_FRFMID);
     f <<= 8;
-    f += ReadReg_Sx1231(REG_FRFLSB);
+    f += sub_getreg(REG_FRFLSB);
 
     if (up)
         f += 16;    // up nearly 1KHz
     else
         f -= 16;    // down nearly 1KHz
 
-    WriteReg_Sx1231(REG_FRFMID, f >> 8);
-    WriteReg_Sx1231(REG_FRFLSB, f & 0xff);
+    sub_setreg(REG_FRFMID, f >> 8);
+    sub_setreg(REG_FRFLSB, f & 0xff);
+    sub_flushregs();
 }
 
 void
@@ -1383,7 +1731,8 @@ radio_console_service()
         else
             RegRxBw.bits.DccFreq++;
 
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
+        sub_flushregs();
         debug_printf("\r\ndcc=%d", RegRxBw.bits.DccFreq);
     } else if (uart_rx_buf[0] == '-') {
         if (RegRxBw.bits.DccFreq == 0)
@@ -1391,27 +1740,33 @@ radio_console_service()
         else
             RegRxBw.bits.DccFreq--;
 
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
+        sub_flushregs();
         debug_printf("\r\ndcc=%d", RegRxBw.bits.DccFreq);
     } else if (uart_rx_buf[0] == '1') { // rxbw
         RegRxBw.bits.RxBw = RXBW_62KHZ;
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
+        sub_flushregs();
         debug_printf("\r\nrxbw 62khz");
     } else if (uart_rx_buf[0] == '2') { // rxbw
         RegRxBw.bits.RxBw = RXBW_83KHZ;
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
+        sub_flushregs();
         debug_printf("\r\nrxbw 83khz");
     } else if (uart_rx_buf[0] == '3') { // rxbw
         RegRxBw.bits.RxBw = RXBW_100KHZ;
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
+        sub_flushregs();
         debug_printf("\r\nrxbw 100khz");
     } else if (uart_rx_buf[0] == '4') { // rxbw
         RegRxBw.bits.RxBw = RXBW_125KHZ;
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
+        sub_flushregs();
         debug_printf("\r\nrxbw 125khz");
     } else if (uart_rx_buf[0] == '5') { // rxbw
         RegRxBw.bits.RxBw = RXBW_167KHZ;
-        WriteReg_Sx1231(REG_RXBW, RegRxBw.octet);
+        sub_setreg(REG_RXBW, RegRxBw.octet);
+        sub_flushregs();
         debug_printf("\r\nrxbw 167khz");
     } else if (uart_rx_buf[0] == 'g') { // trigger rssi
         // trigger not necessary if DAGC running continuously
@@ -1435,11 +1790,11 @@ radio_console_service()
     } else if (uart_rx_buf[0] == 'F' && uart_rx_buf[1] == 0) { // read freq
         unsigned int frf;
         float f;
-        frf = ReadReg_Sx1231(REG_FRFMSB);
+        frf = sub_getreg(REG_FRFMSB);
         frf <<= 8;
-        frf += ReadReg_Sx1231(REG_FRFMID);
+        frf += sub_getreg(REG_FRFMID);
         frf <<= 8;
-        frf += ReadReg_Sx1231(REG_FRFLSB);
+        frf += sub_getreg(REG_FRFLSB);
         f = frf * 61.03515625;
         debug_printf("\r\nfrf: %d, %dHz", frf, (int)f);
     /*} else if (uart_rx_buf[0] == 'I') { // poll rssi
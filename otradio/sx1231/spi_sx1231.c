@@ -1,4 +1,5 @@
 #include "system.h" // get SYS_* definitions
+#include "OT_platform.h"
 #include "stm32l1xx.h"
 #include "stm32l1xx_it.h"
 #include "sx1231_registers.h"
@@ -7,115 +8,338 @@
 #include "m2_encode.h"
 #include "crc16.h"
 #include "radio.h"
+#include "buffers.h"
+
+void em2_decode_data_PN9();
+#if (M2_FEATURE(FEC) == ENABLED)
+void em2_decode_data_FEC();
+#endif
 
 spi2_state_e spi2_state = SPI2_STATE__NONE;
 static volatile ot_u16 spi_rx_word;
-static volatile ot_bool spi_busy = False;
-static volatile ot_bool spi_16b_rx = False;
+
+/** SPI2 Transaction Queue
+  * Every register access is a descriptor (spi_xfer) in a small ring.  The
+  * descriptor at the head is started when SPI2 is idle, its done() callback
+  * is called from SPI2_IRQHandler with the byte read back, and then the next
+  * one is started.  ISRs never wait for SPI2: they post a transaction and
+  * carry on in its callback.  WriteReg_Sx1231() and ReadReg_Sx1231() post a
+  * transaction and wait for it, so they are for task context only.
+  *
+  * FIFO bursts are not queued.  spi2_fifo_burst() starts one at once if SPI2
+  * is idle, otherwise it is held in spi_fifo_req and is started, ahead of the
+  * queue, when the transaction on the bus is done.
+  */
+#define SPI_XFER_SLOTS      8       // must be a power of 2
+#define SPI_LOCK()          primask = __get_PRIMASK(); __disable_irq()
+#define SPI_UNLOCK()        __set_PRIMASK(primask)
+
+typedef struct {
+    ot_u8       addr;       // bit 7 high for write register to radio
+    ot_u8       val;
+    spi_done_fn done;       // may be NULL
+} spi_xfer;
+
+static spi_xfer                 spi_xferq[SPI_XFER_SLOTS];
+static volatile ot_u8           spi_xfer_get = 0;
+static volatile ot_u8           spi_xfer_put = 0;
+static volatile spi2_state_e    spi_fifo_req = SPI2_STATE__NONE;
+
+static volatile ot_u8   spi_block_rx;       // result of a blocking access
+static volatile ot_bool spi_block_done;
+
+static volatile ot_u8 spi_burst_sink;       // rx bytes of a register burst
+static ot_u8* spi_burst_data;
+static ot_u8  spi_burst_len;
 
 DMA_InitTypeDef SPI2_DMA_Init;
 
 
-void
-WriteReg_Sx1231__nonblocking(ot_u8 addr, ot_u8 val)
+static ot_u8
+sub_check_fifothresh(ot_u8 addr, ot_u8 val)
+{
+    /// FifoThreshold can not be more than the FIFO: clip it, rather than
+    /// stopping the radio in an ISR.
+    if ((addr == REG_FIFOTHRESH) && ((val & 0x7f) > RF_FEATURE_TXFIFO_BYTES)) {
+        val = (val & 0x80) | RF_FEATURE_TXFIFO_BYTES;
+    }
+    return val;
+}
+
+static void
+sub_spi_fifo_start(spi2_state_e s)
+{
+    /// Sends the FIFO address: SPI2_IRQHandler starts the DMA burst from it
+    ASSERT_NSS_CONFIG();
+    SPI_DataSizeConfig(SPI2, SPI_DataSize_8b);
+    spi2_state = s;
+    SPI_I2S_SendData(SPI2, (s == SPI2_STATE__START_TX_DMA) ? 0x80 : 0x00);
+}
+
+static void
+sub_spi_next(void)
 {
+    /// Starts the next transaction if SPI2 is idle: a held FIFO burst first,
+    /// then the head of the queue.  Call it with interrupts masked, or from
+    /// the SPI2 and DMA1 ISRs.
     Twobytes output;
+    spi_xfer* xfer;
 
-    if (addr == REG_FIFOTHRESH && ((val & 0x7f) > RF_FEATURE_TXFIFO_BYTES) ) {
-        for (;;)
-            asm("nop");
+    if (spi2_state != SPI2_STATE__NONE)
+        return;
+
+    if (spi_fifo_req != SPI2_STATE__NONE) {
+        sub_spi_fifo_start(spi_fifo_req);
+        spi_fifo_req = SPI2_STATE__NONE;
+        return;
     }
 
-    // Copy address and register value to output variable
-    output.ubyte[UPPER] = addr | 0x80;    // bit 7 is high for write register to radio
-    output.ubyte[LOWER] = val;
+    if (spi_xfer_get != spi_xfer_put) {
+        xfer                = &spi_xferq[spi_xfer_get & (SPI_XFER_SLOTS-1)];
+        output.ubyte[UPPER] = xfer->addr;
+        output.ubyte[LOWER] = xfer->val;
 
-    ASSERT_NSS_CONFIG();
+        ASSERT_NSS_CONFIG();
+        spi2_state = SPI2_STATE__REG;
+        SPI_I2S_SendData(SPI2, output.ushort);
+    }
+}
 
-    spi_busy = 1;
-    SPI_I2S_SendData(SPI2, output.ushort);
+static ot_bool
+sub_spi_post(ot_u8 addr, ot_u8 val, spi_done_fn done)
+{
+    /// Queues a register transaction and starts it if SPI2 is idle.  Returns
+    /// False if the queue is full.
+    spi_xfer* xfer;
+    ot_u32 primask;
+
+    SPI_LOCK();
+    if ((ot_u8)(spi_xfer_put - spi_xfer_get) >= SPI_XFER_SLOTS) {
+        SPI_UNLOCK();
+        return False;
+    }
+    xfer        = &spi_xferq[spi_xfer_put & (SPI_XFER_SLOTS-1)];
+    xfer->addr  = addr;
+    xfer->val   = val;
+    xfer->done  = done;
+    spi_xfer_put++;
+
+    sub_spi_next();
+    SPI_UNLOCK();
+    return True;
+}
 
-    //lr = LR_SPI_WRN;
+static void
+sub_spi_blockdone(ot_u8 rxbyte)
+{
+    spi_block_rx    = rxbyte;
+    spi_block_done  = True;
+}
+
+static ot_u8
+sub_spi_block(ot_u8 addr, ot_u8 val)
+{
+    /// Task context only: posts a transaction and waits until it is done
+    spi_block_done = False;
+    while (sub_spi_post(addr, val, &sub_spi_blockdone) == False)
+        ;
+    while (spi_block_done == False)
+        ;
+    return spi_block_rx;
 }
 
 void
-WriteReg_Sx1231(ot_u8 addr, ot_u8 val)
+spi2_fifo_burst(spi2_state_e s)
 {
-    Twobytes output;
+    ot_u32 primask;
 
-    while (spi_busy == 1)
-        ;
+    SPI_LOCK();
+    if (spi2_state == SPI2_STATE__NONE)
+        sub_spi_fifo_start(s);
+    else
+        spi_fifo_req = s;
+    SPI_UNLOCK();
+}
 
-    if (addr == REG_FIFOTHRESH && ((val & 0x7f) > RF_FEATURE_TXFIFO_BYTES) ) {
-        for (;;)
-            asm("nop");
+void
+spi2_abort(void)
+{
+    /// Stops a FIFO burst in progress (receive timeout).  A register
+    /// transaction on the bus is left to finish, and the queue is kept.
+    ot_u32 primask;
+
+    SPI_LOCK();
+    spi_fifo_req = SPI2_STATE__NONE;
+#if (SYS_RECEIVE == ENABLED)
+    if (spi2_state == SPI2_STATE__START_RX_DMA) {
+        DMA_Cmd(SPI2TX_DMA_CHANNEL, DISABLE);
+        DMA_Cmd(SPI2RX_DMA_CHANNEL, DISABLE);
+        SPI_I2S_DMACmd(SPI2, SPI_I2S_DMAReq_Tx, DISABLE);
+        SPI_I2S_DMACmd(SPI2, SPI_I2S_DMAReq_Rx, DISABLE);
+        DEASSERT_NSS_CONFIG();
+        SPI_DataSizeConfig(SPI2, SPI_DataSize_16b);
+        SPI_I2S_ITConfig(SPI2, SPI_I2S_IT_RXNE, ENABLE);
+        spi2_state = SPI2_STATE__NONE;
+        sub_spi_next();
     }
+#endif /* SYS_RECEIVE == ENABLED */
+    SPI_UNLOCK();
+}
 
-    // Copy address and register value to output variable
-    output.ubyte[UPPER] = addr | 0x80;    // bit 7 is high for write register to radio
-    output.ubyte[LOWER] = val;
+ot_bool
+WriteReg_Sx1231__async(ot_u8 addr, ot_u8 val, spi_done_fn done)
+{
+    val = sub_check_fifothresh(addr, val);
 
-    ASSERT_NSS_CONFIG();
+    if (sub_spi_post(addr | 0x80, val, done) == False) {   // bit 7 is high for write register to radio
+#ifdef RADIO_DEBUG
+        debug_printf("spi queue\r\n");
+#endif /* RADIO_DEBUG */
+        return False;
+    }
+    return True;
+}
 
-    /* Send it through the SPI2 peripheral */
-    spi_busy = 1;
-    spi_16b_rx = False;
-    SPI_I2S_SendData(SPI2, output.ushort);
+ot_bool
+ReadReg_Sx1231__async(ot_u8 addr, spi_done_fn done)
+{
+    if (sub_spi_post(addr, 0, done) == False) {    // bit 7 is low for read register from radio
+#ifdef RADIO_DEBUG
+        debug_printf("spi queue\r\n");
+#endif /* RADIO_DEBUG */
+        return False;
+    }
+    return True;
+}
 
-    /* Wait for receive to complete */
-    while (spi_16b_rx == False)
-        ;
-    //lr = LR_SPI_WR;
+ot_bool
+WriteReg_Sx1231__nonblocking(ot_u8 addr, ot_u8 val)
+{
+    return WriteReg_Sx1231__async(addr, val, NULL);
+}
+
+void
+WriteReg_Sx1231(ot_u8 addr, ot_u8 val)
+{
+    sub_spi_block(addr | 0x80, sub_check_fifothresh(addr, val));
 }
 
 ot_u8
 ReadReg_Sx1231(ot_u8 addr)
 {
-    Twobytes output;
+    return sub_spi_block(addr, 0);
+}
 
-    while (spi_busy == 1)
-        ;
+void
+WriteBurst_Sx1231(ot_u8 addr, ot_u8* data, ot_u8 len)
+{
+    /// Writes len consecutive registers, starting at addr, in one SPI
+    /// transaction (the SX1231 increments the address after each byte).  The
+    /// address byte is sent alone, then SPI2_IRQHandler gives the data to
+    /// DMA1, like it does for a FIFO burst.  Task context only: it waits for
+    /// SPI2 to be idle and for the burst to end.
+    ot_u32 primask;
+
+    for (;;) {
+        SPI_LOCK();
+        if ((spi2_state == SPI2_STATE__NONE) && (spi_xfer_get == spi_xfer_put))
+            break;
+        SPI_UNLOCK();
+    }
 
-    // Copy address and register value to output variable
-    output.ubyte[UPPER] = addr; // bit 7 is low for read register from radio
+    spi_burst_data  = data;
+    spi_burst_len   = len;
 
     ASSERT_NSS_CONFIG();
+    SPI_DataSizeConfig(SPI2, SPI_DataSize_8b);
+    spi2_state = SPI2_STATE__REG_BURST;
+    SPI_I2S_SendData(SPI2, addr | 0x80);    // bit 7 is high for write register to radio
+    SPI_UNLOCK();
 
-    /* Send it through SPI2 peripheral */
-    spi_busy = 1;
-    spi_16b_rx = False;
-    SPI_I2S_SendData(SPI2, output.ushort);
-
-    /* Wait for receive to complete */
-    while (spi_16b_rx == False)
+    while (spi2_state == SPI2_STATE__REG_BURST)
         ;
+}
+
+
+#if (SYS_RECEIVE == ENABLED)
+/** Receive callbacks
+  * Between FIFO bursts, the receiver samples RSSI and polls FifoLevel through
+  * a chain of register transactions.  Each link checks radio.state, so that a
+  * chain that is still queued when reception ends does nothing.
+  */
+static void sub_rx_rssi(ot_u8 rssi);
 
-    /* Return the byte read from the SPI bus */
-    //lr = LR_SPI_RD;
-    return spi_rx_word & 0xff;
+static void
+sub_rx_fifowait(void)
+{
+    /// fifo not full enough: do another (or first) rssi if needed, else
+    /// wait for FifoLevel.  With the SPI queue full, the rssi is skipped.
+    if ((radio.rssi_count < RSSI_SUM_COUNT) && \
+        ReadReg_Sx1231__async(REG_RSSIVALUE, &sub_rx_rssi)) {
+        // sample rssi during packet reception, then poll FifoLevel
+        return;
+    }
+
+    // rssi done: enable FifoLevel interrupt now. EXTI9_5
+    // @todo: sub_killonlowrssi()
+    exti9_5_init.EXTI_Trigger = EXTI_Trigger_Rising;
+    exti9_5_init.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&exti9_5_init);
+    if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_SET) {
+        // FifoLevel was asserted before the interrupt was enabled
+        exti9_5_init.EXTI_LineCmd = DISABLE;
+        EXTI_Init(&exti9_5_init);
+        EXTI_ClearITPendingBit(EXTI_Line5);
+        spi2_fifo_burst(SPI2_STATE__START_RX_DMA);
+    }
 }
 
-void
-ReadReg_Sx1231__nonblocking(ot_u8 addr, spi2_state_e s)
+static void
+sub_rx_dma_next(ot_u8 rxbyte)
 {
-    Twobytes output;
+    /// FifoThreshold written: is it already exceeded?
+    if (radio.state != RADIO_STATE_RX)
+        return;
 
-/*    ignoring, called from SPI2_ISR: while (spi_busy == 1)
-        ;*/
+    TIM_SetCounter(RXTIM, 0);   // keep it from tripping
+    if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_SET)
+        spi2_fifo_burst(SPI2_STATE__START_RX_DMA);      // yes, start next rx dma now
+    else
+        sub_rx_fifowait();
+}
 
-    // Copy address and register value to output variable
-    output.ubyte[UPPER] = addr; // bit 7 is low for read register from radio
+static void
+sub_rx_rssi(ot_u8 rssi)
+{
+    if (radio.state != RADIO_STATE_RX)
+        return;
 
-    ASSERT_NSS_CONFIG();
+    radio.rssi_sum += rssi;
+    radio.rssi_count++;
+
+    if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_SET)
+        spi2_fifo_burst(SPI2_STATE__START_RX_DMA);
+    else
+        sub_rx_fifowait();
+}
+
+static void
+sub_rx_rssi_tail(ot_u8 rssi)
+{
+    /// rssi samples after a short packet, then reception is done
+    if (radio.state != RADIO_STATE_RX)
+        return;
 
-    spi2_state = s;    // handler for received data
+    radio.rssi_sum += rssi;
 
-    /* Send byte through the SPI2 peripheral */
-    spi_busy = 1;
-    SPI_I2S_SendData(SPI2, output.ushort);
+    // with the SPI queue full, reception ends with the samples it has
+    if ((++radio.rssi_count < RSSI_SUM_COUNT) && \
+        ReadReg_Sx1231__async(REG_RSSIVALUE, &sub_rx_rssi_tail))
+        return;
 
-    //lr = LR_SPI_RDN;
+    rx_done_isr(0);
 }
+#endif /* SYS_RECEIVE == ENABLED */
 
 /***********************************************************************/
 
@@ -124,6 +348,7 @@ void EXTI4_IRQHandler(void)
 
     if (EXTI_GetITStatus(EXTI_Line4) != RESET) {
         /* SX1231-DIO0 PacketSent (end of transmission) */
+        rm2_stamp.txend = platform_stamp();
         EXTI_ClearITPendingBit(EXTI_Line4);
 
 #if (SYS_FLOOD == ENABLED)
@@ -156,9 +381,9 @@ initiate_tx_burst(char context)
     start_tx_from = 10 + context;   // debug
 
     remaining = num_bytes_to_send - num_bytes_sent;
-    /* FifoLevel threshold is set to half of fifo size */
-    if (remaining > SX1231_FIFO_SIZE_HALF)
-        SPI2_DMA_Init.DMA_BufferSize = SX1231_FIFO_SIZE_HALF;
+    /* FifoLevel threshold leaves room for radio.fifo_limit bytes */
+    if (remaining > radio.fifo_limit)
+        SPI2_DMA_Init.DMA_BufferSize = radio.fifo_limit;
     else
         SPI2_DMA_Init.DMA_BufferSize = remaining;
 }
@@ -178,12 +403,13 @@ void EXTI9_5_IRQHandler(void)
                 for (;;)
                     asm("nop"); // bad sample
             }*/
-            /* a received packet is now starting to come in */
+            /* a received packet is now starting to come in.  There is no
+             * sync interrupt: FifoLevel is past the sync word by the FIFO
+             * threshold (+1 byte), so the sync stamp is moved back by that. */
+            rm2_stamp.rxsync = platform_stamp() - \
+                ((ot_u32)rm2_scale_codec(RegFifoThresh.bits.FifoThreshold + 1) << PLATFORM_KTIM_SUBBITS);
             TIM_SetCounter(RXTIM, 0);   // keep it from tripping
-            ASSERT_NSS_CONFIG();
-            SPI_DataSizeConfig(SPI2, SPI_DataSize_8b); 
-            SPI_I2S_SendData(SPI2, 0x00);   // bit 0 to address 0x00: read from fifo
-            spi2_state = SPI2_STATE__START_RX_DMA;
+            spi2_fifo_burst(SPI2_STATE__START_RX_DMA);
         } else {
 #endif /* SYS_RECEIVE == ENABLED */
             /*if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_SET) {
@@ -229,7 +455,13 @@ void SPI2_IRQHandler(void)
 
                 SPI2_DMA_Init.DMA_BufferSize = RegFifoThresh.bits.FifoThreshold;
                 //debug_printf("{%d} ", SPI2_DMA_Init.DMA_BufferSize);
-                SPI2_DMA_Init.DMA_MemoryBaseAddr = (uint32_t)&rf_data_buf[0];
+                /* the PN9 decoder works in place, so land its data straight
+                 * in rxq; FEC (and anything else) decodes from rf_data_buf */
+                if (em2_decode_data == &em2_decode_data_PN9)
+                    rf_rx_buf = rxq.putcursor;
+                else
+                    rf_rx_buf = rf_data_buf;
+                SPI2_DMA_Init.DMA_MemoryBaseAddr = (uint32_t)rf_rx_buf;
 
                 SPI2_DMA_Init.DMA_DIR = DMA_DIR_PeripheralDST;  // for tx
                 DMA_Init(SPI2TX_DMA_CHANNEL, &SPI2_DMA_Init);
@@ -240,85 +472,6 @@ void SPI2_IRQHandler(void)
                 DMA_Cmd(SPI2TX_DMA_CHANNEL, ENABLE);
                 DMA_Cmd(SPI2RX_DMA_CHANNEL, ENABLE);
                 break;
-            case SPI2_STATE__RX_DMA_NEXT:
-                DEASSERT_NSS_CONFIG();
-                TIM_SetCounter(RXTIM, 0);   // keep it from tripping
-                // is fifo threshold already exceeded?
-                if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_SET) {
-                    // yes, start next rx dma now
-                    ASSERT_NSS_CONFIG();
-                    SPI_DataSizeConfig(SPI2, SPI_DataSize_8b); 
-                    SPI_I2S_SendData(SPI2, 0x00);   // bit 0 to address 0x00: read from fifo
-                    spi2_state = SPI2_STATE__START_RX_DMA;
-                } else {
-                    // fifo not full enough, do another (or first) rssi if needed
-                    if (radio.rssi_count < RSSI_SUM_COUNT) {
-                        // sample rssi during packet reception, then poll FifoLevel
-                        ReadReg_Sx1231__nonblocking(REG_RSSIVALUE, SPI2_STATE__RX_RSSI);
-                    } else {
-                        // rssi done: enable FifoLevel interrupt now. EXTI9_5
-                        // @todo: sub_killonlowrssi()
-                        exti9_5_init.EXTI_Trigger = EXTI_Trigger_Rising;
-                        exti9_5_init.EXTI_LineCmd = ENABLE;
-                        EXTI_Init(&exti9_5_init);
-                        if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_SET) {
-                            /* bad sample */
-                            /*for (;;)
-                                asm("nop"); // bad sample */
-                            exti9_5_init.EXTI_LineCmd = DISABLE;
-                            EXTI_Init(&exti9_5_init);
-                            EXTI_ClearITPendingBit(EXTI_Line5);
-
-                            ASSERT_NSS_CONFIG();
-                            SPI_DataSizeConfig(SPI2, SPI_DataSize_8b); 
-                            SPI_I2S_SendData(SPI2, 0x00);   // bit 0 to address 0x00: read from fifo
-                            spi2_state = SPI2_STATE__START_RX_DMA;
-                            if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_RESET) {
-                                // this would be called "having a bad day"
-                                debug_printf("FifoLevel\r\n");
-                                for (;;)
-                                    asm("nop");
-                            }
-                        } // ..if FifoLevel asserted
-                    } // ..if rssi sampling done
-                } // ..if FifoLevel de-asserted
-                break;
-            case SPI2_STATE__RX_RSSI:
-                DEASSERT_NSS_CONFIG();
-                radio.rssi_sum += spi_rx_word & 0xff;
-                radio.rssi_count++;
-
-                if (GPIO_ReadInputDataBit(GPIO_Port_FifoLevel, GPIO_Pin_FifoLevel) == Bit_SET) {
-                    ASSERT_NSS_CONFIG();
-                    SPI_DataSizeConfig(SPI2, SPI_DataSize_8b); 
-                    SPI_I2S_SendData(SPI2, 0x00);   // bit 0 to address 0x00: read from fifo
-                    spi2_state = SPI2_STATE__START_RX_DMA;
-                } else {
-                    // fifo not full enough, do another rssi
-                    if (radio.rssi_count < RSSI_SUM_COUNT) {
-                        // sample rssi during packet reception, then poll FifoLevel
-                        ReadReg_Sx1231__nonblocking(REG_RSSIVALUE, SPI2_STATE__RX_RSSI);
-                    } else {
-                        // rssi done: enable FifoLevel interrupt now. EXTI9_5
-                        // @todo: sub_killonlowrssi()
-                        exti9_5_init.EXTI_Trigger = EXTI_Trigger_Rising;
-                        exti9_5_init.EXTI_LineCmd = ENABLE;
-                        EXTI_Init(&exti9_5_init);
-                    }
-                }
-                break;
-            case SPI2_STATE__RX_RSSI_TAIL:
-                DEASSERT_NSS_CONFIG();
-                radio.rssi_sum += spi_rx_word & 0xff;
-
-                if (++radio.rssi_count < RSSI_SUM_COUNT)
-                    ReadReg_Sx1231__nonblocking(REG_RSSIVALUE, SPI2_STATE__RX_RSSI_TAIL);
-                else {
-                    spi_busy = 0;
-                    spi2_state = SPI2_STATE__NONE;
-                    rx_done_isr(0);
-                }
-                break;
 #endif /* SYS_RECEIVE == ENABLED */
             case SPI2_STATE__START_TX_DMA:
                 /* burst transfer to sx1231: address was just sent, now data to radio fifo */
@@ -339,21 +492,43 @@ void SPI2_IRQHandler(void)
                 DMA_Cmd(SPI2RX_DMA_CHANNEL, ENABLE);
                 //GPIO_WriteBit(GPIO_Port_CON2_40, GPIO_Pin_CON2_40, Bit_SET);    // tmp debug
                 break;
+            case SPI2_STATE__REG_BURST:
+                /* burst transfer to sx1231: address was just sent, now the register values */
+                SPI_I2S_ITConfig(SPI2, SPI_I2S_IT_RXNE, DISABLE);
+                SPI_I2S_DMACmd(SPI2, SPI_I2S_DMAReq_Rx, ENABLE);
+                SPI_I2S_DMACmd(SPI2, SPI_I2S_DMAReq_Tx, ENABLE);
+
+                SPI2_DMA_Init.DMA_BufferSize = spi_burst_len;
+                SPI2_DMA_Init.DMA_MemoryBaseAddr = (uint32_t)spi_burst_data;
+                SPI2_DMA_Init.DMA_DIR = DMA_DIR_PeripheralDST;  // for tx
+                DMA_Init(SPI2TX_DMA_CHANNEL, &SPI2_DMA_Init);
+                // received bytes are dropped: they must not land in the shadow
+                SPI2_DMA_Init.DMA_MemoryBaseAddr = (uint32_t)&spi_burst_sink;
+                SPI2_DMA_Init.DMA_MemoryInc = DMA_MemoryInc_Disable;
+                SPI2_DMA_Init.DMA_DIR = DMA_DIR_PeripheralSRC;  // for rx
+                DMA_Init(SPI2RX_DMA_CHANNEL, &SPI2_DMA_Init);
+                SPI2_DMA_Init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+
+                DMA_ITConfig(SPI2RX_DMA_CHANNEL, DMA_IT_TC, ENABLE);
+                DMA_Cmd(SPI2TX_DMA_CHANNEL, ENABLE);
+                DMA_Cmd(SPI2RX_DMA_CHANNEL, ENABLE);
+                break;
+            case SPI2_STATE__REG: {
+                /* register transaction done: callback, then the next one */
+                spi_done_fn done;
+                DEASSERT_NSS_CONFIG();
+                done = spi_xferq[spi_xfer_get & (SPI_XFER_SLOTS-1)].done;
+                spi_xfer_get++;
+                spi2_state = SPI2_STATE__NONE;
+                if (done != NULL)
+                    done(spi_rx_word & 0xff);
+                sub_spi_next();
+            } break;
             default:
+                /* nothing was expected */
                 DEASSERT_NSS_CONFIG();
-                if (SPI2->CR1 & SPI_DataSize_16b) {
-                    // 16bit size: NSS_CONFIG
-                    spi_16b_rx = True;
-                }
-#ifdef RADIO_DEBUG
-                else {
-                    // 8bit size: NSS_DATA
-                    debug_printf("8bit\r\n");
-                    for (;;)
-                        asm("nop");
-                }
-#endif /* RADIO_DEBUG */
-                spi_busy = 0;
+                spi2_state = SPI2_STATE__NONE;
+                sub_spi_next();
                 break;
         } // ...switch (spi2_state)
 
@@ -362,39 +537,27 @@ void SPI2_IRQHandler(void)
 }
 
 #if (SYS_RECEIVE == ENABLED)
-static void
+static ot_bool
 update_fifo_threshold(ot_u8 thr)
 {
-/*    if (thr > SX1231_FIFO_SIZE_HALF)
-        thr = SX1231_FIFO_SIZE_HALF;*/
-    if (thr > SX1231_FIFO_SIZE_HALF)
-        RegFifoThresh.bits.FifoThreshold = SX1231_FIFO_SIZE_HALF;
+    /// Posts the new threshold, and sub_rx_dma_next() continues once it is
+    /// written.  Returns False if the SPI queue is full.
+    if (thr > radio.fifo_limit)
+        RegFifoThresh.bits.FifoThreshold = radio.fifo_limit;
     else
         RegFifoThresh.bits.FifoThreshold = thr;
-/*    if (thr > 33) {
-        for (;;)
-            asm("nop");
-    }*/
-    if (RegFifoThresh.bits.FifoThreshold > 33) {
-        debug_printf("ft>33\r\n");
-        for (;;)
-            asm("nop");
-    }
-    WriteReg_Sx1231__nonblocking(REG_FIFOTHRESH, RegFifoThresh.octet);
+
+    return WriteReg_Sx1231__async(REG_FIFOTHRESH, RegFifoThresh.octet, &sub_rx_dma_next);
 }
 #endif /* SYS_RECEIVE == ENABLED */
 
-void em2_decode_data_PN9();
-#if (M2_FEATURE(FEC) == ENABLED)
-void em2_decode_data_FEC();
-#endif
-
 void    /* SPI2 RX */
 DMA1_Channel4_IRQHandler(void)
 {
 
     if (DMA_GetITStatus(SPI2RX_DMA_IT_TC)) {
         DMA_ClearITPendingBit(SPI2RX_DMA_IT_TC);
+        SYS_PROFILE_ISR_START();
 
         /* this interrupt occurs after spi activity finished */
         DEASSERT_NSS_CONFIG();
@@ -462,7 +625,14 @@ DMA1_Channel4_IRQHandler(void)
                 SPI_DataSizeConfig(SPI2, SPI_DataSize_16b); 
                 spi2_state = SPI2_STATE__NONE;
                 start_tx_from = 0;
+                sub_spi_next();
             }
+            SYS_PROFILE_ISR_STOP(SYS_PROFILE_TXDATA);
+        } else if (spi2_state == SPI2_STATE__REG_BURST) {
+            // register burst done: back to 16 bit register access
+            SPI_DataSizeConfig(SPI2, SPI_DataSize_16b); 
+            spi2_state = SPI2_STATE__NONE;
+            sub_spi_next();
         } else {    // ********** reception...
 #if (SYS_RECEIVE == ENABLED)
             int i;
@@ -484,37 +654,37 @@ DMA1_Channel4_IRQHandler(void)
             //debug_printf("(%d)\r\n", i);
             //debug_printf("num_bytes_sent:%d,%d ", num_bytes_sent, i);
             SPI_DataSizeConfig(SPI2, SPI_DataSize_16b); 
+            spi2_state = SPI2_STATE__NONE;
             if (i < 0) {
                 // damaged header, abort reception
-                spi2_state = SPI2_STATE__NONE;
                 radio.evtdone(em2_remaining_frames(), -1);   // report it as bad crc
             } else if (i == 0) {
                 ot_int frames_left;
                 // packet reception complete
                 TIM_Cmd(RXTIM, DISABLE);
-                spi_busy = 0;
-                spi2_state = SPI2_STATE__NONE;
                 frames_left = em2_remaining_frames();
                 if (frames_left  > 0) {
                     radio.evtdone(frames_left, (ot_int)crc_check() - 1);
                     // Prepare the next frame by moving the "front" pointer and 
-                    q_rebase(&rxq, rxq.putcursor);
                     // re-initializing the decoder engine
-                    em2_decode_newframe();
+                    em2_decode_nextframe();
                 } else {
-                    if (radio.rssi_count < RSSI_SUM_COUNT) {
-                        /* small packet, hopefully this is flood reception
-                         * or last samples could read transmitter unkeying */
-                        ReadReg_Sx1231__nonblocking(REG_RSSIVALUE, SPI2_STATE__RX_RSSI_TAIL);
-                    } else
+                    /* small packet, hopefully this is flood reception
+                     * or last samples could read transmitter unkeying.
+                     * With the SPI queue full, it is done now. */
+                    if ((radio.rssi_count >= RSSI_SUM_COUNT) || \
+                        (ReadReg_Sx1231__async(REG_RSSIVALUE, &sub_rx_rssi_tail) == False))
                         rx_done_isr(i);
                 }
+            } else if (update_fifo_threshold(i) == False) {
+                // the rest of the packet cannot be waited for: abort reception
+                radio.evtdone(em2_remaining_frames(), -1);   // report it as bad crc
             } else {
                 // more to come..
-                update_fifo_threshold(i);
-                spi2_state = SPI2_STATE__RX_DMA_NEXT;
                 TIM_SetCounter(RXTIM, 0);   // keep it from tripping
             }
+            sub_spi_next();
+            SYS_PROFILE_ISR_STOP(SYS_PROFILE_RXDATA);
 #endif /* SYS_RECEIVE == ENABLED */
         } /// ..if (spi2_state != SPI2_STATE__START_TX_DMA)
 
@@ -532,11 +702,7 @@ TIM10_IRQHandler(void)
 
 #if (SYS_RECEIVE == ENABLED)
         GPIO_WriteBit(GPIO_Port_CON2_40, GPIO_Pin_CON2_40, Bit_RESET);    // tmp debug
-        if (spi2_state != SPI2_STATE__NONE) {
-            debug_printf("TIM10\r\n");
-            for (;;)
-                asm("nop"); // state machine lockup
-        }
+        spi2_abort();       // a FIFO burst may be in progress
         rm2_rxtimeout_isr();
 #endif /* SYS_RECEIVE == ENABLED */
     }
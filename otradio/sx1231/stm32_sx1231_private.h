@@ -16,14 +16,17 @@
 typedef enum {
     SPI2_STATE__NONE = 0,
     SPI2_STATE__START_TX_DMA,   // 1
+    SPI2_STATE__REG,            // 2: queued register transaction
+    SPI2_STATE__REG_BURST,      // 3: register burst from the shadow (WriteBurst_Sx1231)
 #if (SYS_RECEIVE == ENABLED)
-    SPI2_STATE__START_RX_DMA,   // 2
-    SPI2_STATE__RX_DMA_NEXT,    // 3
-    SPI2_STATE__RX_RSSI,        // 4
-    SPI2_STATE__RX_RSSI_TAIL,   // 5
+    SPI2_STATE__START_RX_DMA,   // 4
 #endif /* SYS_RECEIVE == ENABLED */
 } spi2_state_e;
 
+/// Completion of a queued register transaction, called from SPI2_IRQHandler
+/// with the byte read from the radio (don't care for a write)
+typedef void (*spi_done_fn)(ot_u8 rxbyte);
+
 extern spi2_state_e spi2_state;
 
 typedef struct {
@@ -33,6 +36,7 @@ typedef struct {
     ot_u8    unlock_count; 
 #endif /* RADIO_DEBUG */
     ot_u8    rssi_count;
+    ot_u8    fifo_limit;    // max bytes per FIFO burst (sub_fifo_limit())
     ot_u16    rssi_sum;
     ot_sig2 evtdone;
 } radio_struct;
@@ -40,6 +44,7 @@ typedef struct {
 extern radio_struct radio;
 
 extern ot_u8 rf_data_buf[]; // from radio_SX1231.c
+extern ot_u8* rf_rx_buf; // from radio_SX1231.c
 extern int num_bytes_sent; // from radio_SX1231.c
 extern int num_bytes_to_send; // from radio_SX1231.c
 
@@ -48,9 +53,18 @@ extern DMA_InitTypeDef SPI2_DMA_Init;   // from spi_sx1231.c
 extern EXTI_InitTypeDef exti4_init;
 extern EXTI_InitTypeDef exti9_5_init;
 
-void WriteReg_Sx1231(ot_u8 addr, ot_u8 val);
-ot_u8 ReadReg_Sx1231(ot_u8 addr);
-void WriteReg_Sx1231__nonblocking(ot_u8 addr, ot_u8 val);
+void WriteReg_Sx1231(ot_u8 addr, ot_u8 val);             // task context only
+ot_u8 ReadReg_Sx1231(ot_u8 addr);                       // task context only
+
+/// The queued accesses return False when the SPI queue is full.  The access
+/// is then not done and its callback is never called, so the caller must
+/// carry on some other way.
+ot_bool WriteReg_Sx1231__nonblocking(ot_u8 addr, ot_u8 val);
+ot_bool WriteReg_Sx1231__async(ot_u8 addr, ot_u8 val, spi_done_fn done);
+ot_bool ReadReg_Sx1231__async(ot_u8 addr, spi_done_fn done);
+void WriteBurst_Sx1231(ot_u8 addr, ot_u8* data, ot_u8 len);  // task context only
+void spi2_fifo_burst(spi2_state_e s);
+void spi2_abort(void);
 
 
 extern volatile ot_u8 start_tx_from;    // diag